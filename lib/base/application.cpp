@@ -94,6 +94,8 @@ void Application::Exit(int rc)
 	std::cout.flush();
 	std::cerr.flush();
 
+	Logger::FlushLogQueue();
+
 	for (const Logger::Ptr& logger : Logger::GetLoggers()) {
 		logger->Flush();
 	}
@@ -8,15 +8,17 @@
 #include "base/configwriter.hpp"
 #include "base/convert.hpp"
 #include "base/exception.hpp"
+#include <algorithm>
 
 using namespace icinga;
 
 template class std::vector<Value>;
 
 REGISTER_PRIMITIVE_TYPE(Array, Object, Array::GetPrototype());
+IMPLEMENT_OBJECT_POOL(Array);
 
 Array::Array(const ArrayData& other)
-	: m_Data(other)
+	: m_Data(ArrayData(other))
 { }
 
 Array::Array(ArrayData&& other)
@@ -24,7 +26,7 @@ Array::Array(ArrayData&& other)
 { }
 
 Array::Array(std::initializer_list<Value> init)
-	: m_Data(init)
+	: m_Data(ArrayData(init))
 { }
 
 /**
@@ -35,9 +37,9 @@ Array::Array(std::initializer_list<Value> init)
  */
 Value Array::Get(SizeType index) const
 {
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 
-	return m_Data.at(index);
+	return m_Data.Get().at(index);
 }
 
 /**
@@ -54,7 +56,7 @@ void Array::Set(SizeType index, const Value& value, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Value in array must not be modified."));
 
-	m_Data.at(index) = value;
+	m_Data.Mutate().at(index) = value;
 }
 
 /**
@@ -71,7 +73,7 @@ void Array::Set(SizeType index, Value&& value, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
-	m_Data.at(index).Swap(value);
+	m_Data.Mutate().at(index).Swap(value);
 }
 
 /**
@@ -87,7 +89,7 @@ void Array::Add(Value value, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
-	m_Data.push_back(std::move(value));
+	m_Data.Mutate().push_back(std::move(value));
 }
 
 /**
@@ -101,7 +103,7 @@ Array::Iterator Array::Begin()
 {
 	ASSERT(OwnsLock());
 
-	return m_Data.begin();
+	return GetIterable().begin();
 }
 
 /**
@@ -115,7 +117,22 @@ Array::Iterator Array::End()
 {
 	ASSERT(OwnsLock());
 
-	return m_Data.end();
+	return GetIterable().end();
+}
+
+/**
+ * Returns the items for iterating over them. Their iterators allow modifying
+ * them, so they aren't shared anymore afterwards. Frozen arrays must not be
+ * modified anyway.
+ *
+ * Note: Caller must hold the object lock.
+ */
+std::vector<Value>& Array::GetIterable()
+{
+	if (m_Frozen.load(std::memory_order_acquire) || m_Data.Get().empty())
+		return const_cast<std::vector<Value>&>(m_Data.Get());
+
+	return m_Data.Mutate();
 }
 
 /**
@@ -125,9 +142,9 @@ Array::Iterator Array::End()
  */
 size_t Array::GetLength() const
 {
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 
-	return m_Data.size();
+	return m_Data.Get().size();
 }
 
 /**
@@ -138,9 +155,11 @@ size_t Array::GetLength() const
  */
 bool Array::Contains(const Value& value) const
 {
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
+
+	auto& data (m_Data.Get());
 
-	return (std::find(m_Data.begin(), m_Data.end(), value) != m_Data.end());
+	return (std::find(data.begin(), data.end(), value) != data.end());
 }
 
 /**
@@ -154,12 +173,13 @@ void Array::Insert(SizeType index, Value value, bool overrideFrozen)
 {
 	ObjectLock olock(this);
 
-	ASSERT(index <= m_Data.size());
+	ASSERT(index <= m_Data.Get().size());
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
-	m_Data.insert(m_Data.begin() + index, std::move(value));
+	auto& data (m_Data.Mutate());
+	data.insert(data.begin() + index, std::move(value));
 }
 
 /**
@@ -175,10 +195,11 @@ void Array::Remove(SizeType index, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
-	if (index >= m_Data.size())
+	if (index >= m_Data.Get().size())
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Index to remove must be within bounds."));
 
-	m_Data.erase(m_Data.begin() + index);
+	auto& data (m_Data.Mutate());
+	data.erase(data.begin() + index);
 }
 
 /**
@@ -194,7 +215,11 @@ void Array::Remove(Array::Iterator it, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
-	m_Data.erase(it);
+	/* The iterator may point into items which are still shared (frozen arrays). */
+	auto index = it - m_Data.Get().begin();
+	auto& data (m_Data.Mutate());
+
+	data.erase(data.begin() + index);
 }
 
 void Array::Resize(SizeType newSize, bool overrideFrozen)
@@ -204,7 +229,7 @@ void Array::Resize(SizeType newSize, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
-	m_Data.resize(newSize);
+	m_Data.Mutate().resize(newSize);
 }
 
 void Array::Clear(bool overrideFrozen)
@@ -214,7 +239,7 @@ void Array::Clear(bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
-	m_Data.clear();
+	m_Data.Clear();
 }
 
 void Array::Reserve(SizeType newSize, bool overrideFrozen)
@@ -224,18 +249,25 @@ void Array::Reserve(SizeType newSize, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
-	m_Data.reserve(newSize);
+	m_Data.Mutate().reserve(newSize);
 }
 
 void Array::CopyTo(const Array::Ptr& dest) const
 {
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 	ObjectLock xlock(dest);
 
 	if (dest->m_Frozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
-	std::copy(m_Data.begin(), m_Data.end(), std::back_inserter(dest->m_Data));
+	/* Empty arrays share the items until either one is modified. */
+	if (dest.get() != this && dest->m_Data.Get().empty()) {
+		dest->m_Data = m_Data;
+		return;
+	}
+
+	auto& data (m_Data.Get());
+	std::copy(data.begin(), data.end(), std::back_inserter(dest->m_Data.Mutate()));
 }
 
 /**
@@ -260,8 +292,20 @@ Object::Ptr Array::Clone() const
 {
 	ArrayData arr;
 
-	ObjectLock olock(this);
-	for (const Value& val : m_Data) {
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
+
+	auto& data (m_Data.Get());
+
+	/* Values other than objects are cloned by copying them, so the items can be shared. */
+	if (std::none_of(data.begin(), data.end(), [](const Value& val) { return val.IsObject(); })) {
+		Array::Ptr clone = new Array();
+		clone->m_Data = m_Data;
+		return clone;
+	}
+
+	arr.reserve(data.size());
+
+	for (const Value& val : data) {
 		arr.push_back(val.Clone());
 	}
 
@@ -272,10 +316,11 @@ Array::Ptr Array::Reverse() const
 {
 	Array::Ptr result = new Array();
 
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 	ObjectLock xlock(result);
 
-	std::copy(m_Data.rbegin(), m_Data.rend(), std::back_inserter(result->m_Data));
+	auto& data (m_Data.Get());
+	result->m_Data = ArrayData(data.rbegin(), data.rend());
 
 	return result;
 }
@@ -287,7 +332,8 @@ void Array::Sort(bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Array must not be modified."));
 
-	std::sort(m_Data.begin(), m_Data.end());
+	auto& data (m_Data.Mutate());
+	std::sort(data.begin(), data.end());
 }
 
 String Array::ToString() const
@@ -302,9 +348,9 @@ Value Array::Join(const Value& separator) const
 	Value result;
 	bool first = true;
 
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 
-	for (const Value& item : m_Data) {
+	for (const Value& item : m_Data.Get()) {
 		if (first) {
 			first = false;
 		} else {
@@ -321,19 +367,24 @@ Array::Ptr Array::Unique() const
 {
 	std::set<Value> result;
 
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 
-	for (const Value& item : m_Data) {
+	for (const Value& item : m_Data.Get()) {
 		result.insert(item);
 	}
 
 	return Array::FromSet(result);
 }
 
+/**
+ * Makes the array read-only. Frozen arrays are read without locking them,
+ * modifying them with overrideFrozen is only safe while no other thread
+ * might read them.
+ */
 void Array::Freeze()
 {
 	ObjectLock olock(this);
-	m_Frozen = true;
+	m_Frozen.store(true, std::memory_order_release);
 }
 
 Value Array::GetFieldByName(const String& field, bool sandboxed, const DebugInfo& debugInfo) const
@@ -346,7 +397,7 @@ Value Array::GetFieldByName(const String& field, bool sandboxed, const DebugInfo
 		return Object::GetFieldByName(field, sandboxed, debugInfo);
 	}
 
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 
 	if (index < 0 || static_cast<size_t>(index) >= GetLength())
 		BOOST_THROW_EXCEPTION(ScriptError("Array index '" + Convert::ToString(index) + "' is out of bounds.", debugInfo));
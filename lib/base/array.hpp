@@ -6,6 +6,9 @@
 #include "base/i2-base.hpp"
 #include "base/objectlock.hpp"
 #include "base/value.hpp"
+#include "base/objectpool.hpp"
+#include "base/copyonwrite.hpp"
+#include <atomic>
 #include <boost/range/iterator.hpp>
 #include <vector>
 #include <set>
@@ -24,6 +27,7 @@ class Array final : public Object
 {
 public:
 	DECLARE_OBJECT(Array);
+	DECLARE_OBJECT_POOL();
 
 	/**
 	 * An iterator that can be used to iterate over array elements.
@@ -65,10 +69,7 @@ public:
 	template<typename T>
 	static Array::Ptr FromVector(const std::vector<T>& v)
 	{
-		Array::Ptr result = new Array();
-		ObjectLock olock(result);
-		std::copy(v.begin(), v.end(), std::back_inserter(result->m_Data));
-		return result;
+		return new Array(ArrayData(v.begin(), v.end()));
 	}
 
 	template<typename T>
@@ -81,10 +82,7 @@ public:
 	template<typename T>
 	static Array::Ptr FromSet(const std::set<T>& v)
 	{
-		Array::Ptr result = new Array();
-		ObjectLock olock(result);
-		std::copy(v.begin(), v.end(), std::back_inserter(result->m_Data));
-		return result;
+		return new Array(ArrayData(v.begin(), v.end()));
 	}
 
 	Object::Ptr Clone() const override;
@@ -103,8 +101,11 @@ public:
 	void SetFieldByName(const String& field, const Value& value, bool overrideFrozen, const DebugInfo& debugInfo) override;
 
 private:
-	std::vector<Value> m_Data; /**< The data for the array. */
-	bool m_Frozen{false};
+	/* Shared with clones until either one is modified. */
+	CopyOnWrite<std::vector<Value> > m_Data; /**< The data for the array. */
+	std::atomic<bool> m_Frozen{false}; /**< Frozen arrays are read without locking them. */
+
+	std::vector<Value>& GetIterable();
 };
 
 Array::Iterator begin(const Array::Ptr& x);
@@ -72,7 +72,7 @@ struct Atomicable
 {
 	// Doesn't work with too old compilers.
 	//static constexpr bool value = std::is_trivially_copyable<T>::value && sizeof(T) <= sizeof(void*);
-	static constexpr bool value = (std::is_fundamental<T>::value || std::is_pointer<T>::value) && sizeof(T) <= sizeof(void*);
+	static constexpr bool value = (std::is_fundamental<T>::value || std::is_pointer<T>::value || std::is_enum<T>::value) && sizeof(T) <= sizeof(void*);
 };
 
 /**
@@ -0,0 +1,108 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/compressedstring.hpp"
+#include "base/exception.hpp"
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <zlib.h>
+
+using namespace icinga;
+
+/**
+ * @param savedBytes Keeps track of how much memory is saved, may be shared by many strings
+ */
+CompressedString::CompressedString(MetricGauge *savedBytes)
+	: m_SavedBytes(savedBytes)
+{
+}
+
+CompressedString::~CompressedString()
+{
+	if (m_SavedBytes)
+		m_SavedBytes->Decrement(GetSavedBytes());
+}
+
+/**
+ * Inflates the string if necessary.
+ *
+ * @returns The original string
+ */
+String CompressedString::Get() const
+{
+	String data;
+	size_t length;
+
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		if (!m_Length)
+			return m_Data;
+
+		data = m_Data;
+		length = m_Length;
+	}
+
+	std::string result;
+	result.resize(length);
+
+	uLongf used = length;
+	int rc = uncompress(reinterpret_cast<Bytef *>(&result[0]), &used, reinterpret_cast<const Bytef *>(data.CStr()), data.GetLength());
+
+	if (rc != Z_OK || used != length)
+		BOOST_THROW_EXCEPTION(std::runtime_error(String("uncompress() failed: ") + zError(rc)));
+
+	return std::move(result);
+}
+
+/**
+ * Replaces the string, deflating it if that's worth it.
+ *
+ * @param value The new string
+ * @param minLength Strings shorter than this are kept as they are, 0 to never deflate
+ */
+void CompressedString::Set(const String& value, size_t minLength)
+{
+	String data = value;
+	size_t length = 0;
+
+	if (minLength && value.GetLength() >= minLength) {
+		std::string compressed;
+		compressed.resize(compressBound(value.GetLength()));
+
+		uLongf used = compressed.size();
+
+		/* Saving memory isn't worth slowing down the processing of check results. */
+		int rc = compress2(reinterpret_cast<Bytef *>(&compressed[0]), &used,
+			reinterpret_cast<const Bytef *>(value.CStr()), value.GetLength(), Z_BEST_SPEED);
+
+		if (rc == Z_OK && used < value.GetLength()) {
+			compressed.resize(used);
+			compressed.shrink_to_fit();
+
+			data = String(std::move(compressed));
+			length = value.GetLength();
+		}
+	}
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+	int_fast64_t oldSavedBytes = GetSavedBytes();
+
+	m_Data = std::move(data);
+	m_Length = length;
+
+	if (m_SavedBytes)
+		m_SavedBytes->Increment(GetSavedBytes() - oldSavedBytes);
+}
+
+bool CompressedString::IsCompressed() const
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+	return m_Length;
+}
+
+/* Has to be called with m_Mutex held (or from the destructor). */
+int_fast64_t CompressedString::GetSavedBytes() const
+{
+	return m_Length ? static_cast<int_fast64_t>(m_Length) - static_cast<int_fast64_t>(m_Data.GetLength()) : 0;
+}
@@ -0,0 +1,51 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef COMPRESSEDSTRING_H
+#define COMPRESSEDSTRING_H
+
+#include "base/i2-base.hpp"
+#include "base/metric.hpp"
+#include "base/string.hpp"
+#include <cstddef>
+#include <mutex>
+
+namespace icinga
+{
+
+/**
+ * Holds a string which is kept deflated in memory if it's long enough and
+ * actually gets smaller. It's inflated again on every read, so this is meant
+ * for large strings which are kept for a long time but are rarely read,
+ * e.g. the output of the last check result of a checkable.
+ *
+ * @ingroup base
+ */
+class CompressedString final
+{
+public:
+	CompressedString(MetricGauge *savedBytes = nullptr);
+	~CompressedString();
+
+	CompressedString(const CompressedString&) = delete;
+	CompressedString& operator=(const CompressedString&) = delete;
+
+	String Get() const;
+	void Set(const String& value, size_t minLength);
+
+	bool IsCompressed() const;
+
+private:
+	mutable std::mutex m_Mutex;
+	String m_Data;
+
+	/* The length of the original string if m_Data is deflated, 0 otherwise. */
+	size_t m_Length{0};
+
+	MetricGauge *m_SavedBytes;
+
+	int_fast64_t GetSavedBytes() const;
+};
+
+}
+
+#endif /* COMPRESSEDSTRING_H */
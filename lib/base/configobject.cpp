@@ -16,7 +16,13 @@
 #include "base/workqueue.hpp"
 #include "base/context.hpp"
 #include "base/application.hpp"
+#include <algorithm>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 #include <boost/exception/errinfo_api_function.hpp>
 #include <boost/exception/errinfo_errno.hpp>
 #include <boost/exception/errinfo_file_name.hpp>
@@ -463,8 +469,27 @@ void ConfigObject::SetAuthority(bool authority)
 	}
 }
 
+/**
+ * Writes the state attributes of all objects to a file.
+ *
+ * Objects are serialized in parallel. An object's record is only serialized
+ * again if its state changed since the previous dump, see MarkStateDirty().
+ * As a safety net for in-place modifications which nobody marked, every
+ * object is serialized again every few dumps.
+ *
+ * @param filename The state file.
+ * @param attributeTypes The attributes to dump.
+ */
 void ConfigObject::DumpObjects(const String& filename, int attributeTypes)
 {
+	/* The objects' records may only be used by one dump at a time. */
+	static std::mutex dumpMutex;
+	static unsigned int dumpCount = 0;
+
+	std::unique_lock<std::mutex> dumpLock (dumpMutex);
+
+	bool full = dumpCount++ % 12u == 0u;
+
 	Log(LogInformation, "ConfigObject")
 		<< "Dumping program state to file '" << filename << "'";
 
@@ -483,27 +508,64 @@ void ConfigObject::DumpObjects(const String& filename, int attributeTypes)
 
 	StdioStream::Ptr sfp = new StdioStream(&fp, false);
 
+	WorkQueue upq(0, Configuration::Concurrency);
+	upq.SetName("ConfigObject::DumpObjects");
+
+	std::atomic<unsigned long> serialized (0);
+	unsigned long total = 0;
+
 	for (const Type::Ptr& type : Type::GetAllTypes()) {
 		auto *dtype = dynamic_cast<ConfigType *>(type.get());
 
 		if (!dtype)
 			continue;
 
-		for (const ConfigObject::Ptr& object : dtype->GetObjects()) {
-			Dictionary::Ptr update = Serialize(object, attributeTypes);
+		String typeName = type->GetName();
+		std::vector<ConfigObject::Ptr> objects = dtype->GetObjects();
 
-			if (!update)
-				continue;
+		/* Serialize in batches, so that not all records have to be kept twice at once. */
+		for (decltype(objects.size()) offset = 0; offset < objects.size(); offset += 4096) {
+			std::vector<ConfigObject::Ptr> batch (objects.begin() + offset, objects.begin() + std::min<decltype(offset)>(offset + 4096, objects.size()));
+
+			upq.ParallelFor(batch, [&typeName, attributeTypes, full, &serialized](const ConfigObject::Ptr& object) {
+				auto version (object->GetStateVersion());
 
-			Dictionary::Ptr persistentObject = new Dictionary({
-				{ "type", type->GetName() },
-				{ "name", object->GetName() },
-				{ "update", update }
+				if (!full && object->m_StateDumpVersion == version && object->m_StateDumpTypes == attributeTypes)
+					return;
+
+				Dictionary::Ptr update = Serialize(object, attributeTypes);
+
+				if (update) {
+					Dictionary::Ptr persistentObject = new Dictionary({
+						{ "type", typeName },
+						{ "name", object->GetName() },
+						{ "update", update }
+					});
+
+					object->m_StateDump = JsonEncode(persistentObject);
+				} else {
+					object->m_StateDump = String();
+				}
+
+				object->m_StateDumpVersion = version;
+				object->m_StateDumpTypes = attributeTypes;
+
+				serialized++;
 			});
 
-			String json = JsonEncode(persistentObject);
+			upq.Join();
+
+			if (upq.HasExceptions()) {
+				upq.ReportExceptions("ConfigObject");
+				BOOST_THROW_EXCEPTION(std::runtime_error("Could not serialize all objects for '" + tempFilename + "'"));
+			}
 
-			NetString::WriteStringToStream(sfp, json);
+			for (const ConfigObject::Ptr& object : batch) {
+				if (!object->m_StateDump.IsEmpty())
+					NetString::WriteStringToStream(sfp, object->m_StateDump);
+			}
+
+			total += batch.size();
 		}
 	}
 
@@ -512,6 +574,9 @@ void ConfigObject::DumpObjects(const String& filename, int attributeTypes)
 	fp.close();
 
 	Utility::RenameFile(tempFilename, filename);
+
+	Log(LogNotice, "ConfigObject")
+		<< "Dumped " << total << " objects, " << serialized.load() << " of them had to be serialized again.";
 }
 
 void ConfigObject::RestoreObject(const String& message, int attributeTypes)
@@ -544,33 +609,41 @@ void ConfigObject::RestoreObjects(const String& filename, int attributeTypes)
 	Log(LogInformation, "ConfigObject")
 		<< "Restoring program state from file '" << filename << "'";
 
-	std::fstream fp;
-	fp.open(filename.CStr(), std::ios_base::in);
+	namespace ip = boost::interprocess;
 
-	StdioStream::Ptr sfp = new StdioStream (&fp, false);
+	/* The file is mapped and the workers decode the messages right from the mapping. */
+	std::unique_ptr<ip::mapped_region> region;
+
+	if (boost::filesystem::file_size(filename.CStr()) > 0) {
+		ip::file_mapping file (filename.CStr(), ip::read_only);
+		region.reset(new ip::mapped_region(file, ip::read_only));
+		region->advise(ip::mapped_region::advice_sequential);
+	}
+
+	const char *data = region ? static_cast<const char *>(region->get_address()) : nullptr;
+	const char *end = data + (region ? region->get_size() : 0);
 
 	unsigned long restored = 0;
 
 	WorkQueue upq(25000, Configuration::Concurrency);
 	upq.SetName("ConfigObject::RestoreObjects");
 
-	String message;
-	StreamReadContext src;
-	for (;;) {
-		StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+	/* Objects are only listed once, so their messages can be restored in any order. */
+	std::vector<TaskFunction> batch;
+	boost::string_view message;
 
-		if (srs == StatusEof)
-			break;
+	while (NetString::ReadStringFromBuffer(data, end, message)) {
+		batch.emplace_back([message, attributeTypes]() {
+			RestoreObject(String(message), attributeTypes);
+		});
 
-		if (srs != StatusNewItem)
-			continue;
-
-		upq.Enqueue(std::bind(&ConfigObject::RestoreObject, message, attributeTypes));
 		restored++;
-	}
 
-	sfp->Close();
+		if (batch.size() >= 256u)
+			upq.EnqueueBatch(std::move(batch));
+	}
 
+	upq.EnqueueBatch(std::move(batch));
 	upq.Join();
 
 	unsigned long no_state = 0;
@@ -698,6 +771,18 @@ ConfigObject::Ptr ConfigObject::GetZone() const
 	return m_Zone;
 }
 
+/**
+ * Returns a small integer which identifies the object among the registered
+ * objects of its type. Indices of unregistered objects are reused, so side
+ * tables can be flat vectors (see ConfigType::GetIndexCount()).
+ *
+ * @returns The index, -1 if the object isn't registered.
+ */
+int ConfigObject::GetTypeIndex() const
+{
+	return m_TypeIndex.load(std::memory_order_relaxed);
+}
+
 Dictionary::Ptr ConfigObject::GetSourceLocation() const
 {
 	DebugInfo di = GetDebugInfo();
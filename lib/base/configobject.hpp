@@ -9,6 +9,7 @@
 #include "base/type.hpp"
 #include "base/dictionary.hpp"
 #include <boost/signals2.hpp>
+#include <atomic>
 
 namespace icinga
 {
@@ -36,6 +37,8 @@ public:
 
 	ConfigObject::Ptr GetZone() const;
 
+	int GetTypeIndex() const;
+
 	void ModifyAttribute(const String& attr, const Value& value, bool updateVersion = true);
 	void RestoreAttribute(const String& attr, bool updateVersion = true);
 	bool IsAttributeModified(const String& attr) const;
@@ -81,8 +84,16 @@ public:
 
 private:
 	ConfigObject::Ptr m_Zone;
+	std::atomic<int> m_TypeIndex{-1};
+
+	/* The record of the last state dump, reused as long as the state doesn't change. */
+	String m_StateDump;
+	uint_fast32_t m_StateDumpVersion{0};
+	int m_StateDumpTypes{0};
 
 	static void RestoreObject(const String& message, int attributeTypes);
+
+	friend class ConfigType;
 };
 
 #define DECLARE_OBJECTNAME(klass)						\
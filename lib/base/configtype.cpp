@@ -43,6 +43,21 @@ void ConfigType::RegisterObject(const ConfigObject::Ptr& object)
 
 		m_ObjectMap[name] = object;
 		m_ObjectVector.push_back(object);
+		m_ObjectsSnapshot.reset();
+
+		/* Reuse the indices of removed objects to keep them dense. */
+		int index;
+
+		if (m_FreeIndices.empty()) {
+			index = m_ObjectsByIndex.size();
+			m_ObjectsByIndex.push_back(object);
+		} else {
+			index = m_FreeIndices.back();
+			m_FreeIndices.pop_back();
+			m_ObjectsByIndex[index] = object;
+		}
+
+		object->m_TypeIndex.store(index);
 	}
 }
 
@@ -55,6 +70,15 @@ void ConfigType::UnregisterObject(const ConfigObject::Ptr& object)
 
 		m_ObjectMap.erase(name);
 		m_ObjectVector.erase(std::remove(m_ObjectVector.begin(), m_ObjectVector.end(), object), m_ObjectVector.end());
+		m_ObjectsSnapshot.reset();
+
+		int index = object->m_TypeIndex.load();
+
+		if (index != -1 && index < static_cast<int>(m_ObjectsByIndex.size()) && m_ObjectsByIndex[index] == object) {
+			m_ObjectsByIndex[index] = nullptr;
+			m_FreeIndices.push_back(index);
+			object->m_TypeIndex.store(-1);
+		}
 	}
 }
 
@@ -64,13 +88,62 @@ std::vector<ConfigObject::Ptr> ConfigType::GetObjects() const
 	return m_ObjectVector;
 }
 
+/**
+ * Returns the current objects. The list is shared by all callers until
+ * objects are added or removed, so they register one at a time cheaply.
+ *
+ * @returns The objects.
+ */
+std::shared_ptr<const ConfigType::ObjectVector> ConfigType::GetObjectsSnapshot() const
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (!m_ObjectsSnapshot)
+		m_ObjectsSnapshot = std::make_shared<const ObjectVector>(m_ObjectVector);
+
+	return m_ObjectsSnapshot;
+}
+
 std::vector<ConfigObject::Ptr> ConfigType::GetObjectsHelper(Type *type)
 {
 	return static_cast<TypeImpl<ConfigObject> *>(type)->GetObjects();
 }
 
+std::shared_ptr<const ConfigType::ObjectVector> ConfigType::GetObjectsSnapshotHelper(Type *type)
+{
+	return static_cast<TypeImpl<ConfigObject> *>(type)->GetObjectsSnapshot();
+}
+
 int ConfigType::GetObjectCount() const
 {
 	std::unique_lock<std::mutex> lock(m_Mutex);
 	return m_ObjectVector.size();
 }
+
+/**
+ * Returns the object which currently holds the specified index.
+ *
+ * @param index The index, see ConfigObject::GetTypeIndex().
+ * @returns The object, nullptr if the index isn't in use.
+ */
+ConfigObject::Ptr ConfigType::GetObjectByIndex(int index) const
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (index < 0 || index >= static_cast<int>(m_ObjectsByIndex.size()))
+		return nullptr;
+
+	return m_ObjectsByIndex[index];
+}
+
+/**
+ * Returns an upper bound for the indices of this type's objects, i.e. the
+ * size a table indexed by them needs.
+ *
+ * @returns The number of indices.
+ */
+int ConfigType::GetIndexCount() const
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	return m_ObjectsByIndex.size();
+}
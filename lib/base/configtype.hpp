@@ -7,13 +7,77 @@
 #include "base/object.hpp"
 #include "base/type.hpp"
 #include "base/dictionary.hpp"
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace icinga
 {
 
 class ConfigObject;
 
+/**
+ * An immutable list of a type's objects, see ConfigType::GetObjectsView().
+ * It keeps the objects alive, iterating over it neither locks nor copies.
+ *
+ * @ingroup base
+ */
+template<typename T>
+class ConfigObjectsView
+{
+public:
+	typedef std::vector<intrusive_ptr<ConfigObject> > ObjectVector;
+
+	class Iterator
+	{
+	public:
+		Iterator(ObjectVector::const_iterator it)
+			: m_It(it)
+		{ }
+
+		T *operator*() const
+		{
+			return static_cast<T *>(m_It->get());
+		}
+
+		Iterator& operator++()
+		{
+			++m_It;
+			return *this;
+		}
+
+		bool operator!=(const Iterator& other) const
+		{
+			return m_It != other.m_It;
+		}
+
+	private:
+		ObjectVector::const_iterator m_It;
+	};
+
+	ConfigObjectsView(std::shared_ptr<const ObjectVector> objects)
+		: m_Objects(std::move(objects))
+	{ }
+
+	Iterator begin() const
+	{
+		return m_Objects->begin();
+	}
+
+	Iterator end() const
+	{
+		return m_Objects->end();
+	}
+
+	size_t GetLength() const
+	{
+		return m_Objects->size();
+	}
+
+private:
+	std::shared_ptr<const ObjectVector> m_Objects;
+};
+
 class ConfigType
 {
 public:
@@ -45,8 +109,21 @@ for (const auto& object : objects) {
 		return result;
 	}
 
+	/**
+	 * Like GetObjectsByType(), but for loops which just look at the objects.
+	 * The list is only rebuilt after objects have been added or removed.
+	 */
+	template<typename T>
+	static ConfigObjectsView<T> GetObjectsView()
+	{
+		return ConfigObjectsView<T>(GetObjectsSnapshotHelper(T::TypeInstance.get()));
+	}
+
 	int GetObjectCount() const;
 
+	intrusive_ptr<ConfigObject> GetObjectByIndex(int index) const;
+	int GetIndexCount() const;
+
 private:
 	typedef std::map<String, intrusive_ptr<ConfigObject> > ObjectMap;
 	typedef std::vector<intrusive_ptr<ConfigObject> > ObjectVector;
@@ -54,8 +131,14 @@ private:
 	mutable std::mutex m_Mutex;
 	ObjectMap m_ObjectMap;
 	ObjectVector m_ObjectVector;
+	mutable std::shared_ptr<const ObjectVector> m_ObjectsSnapshot;
+	ObjectVector m_ObjectsByIndex;
+	std::vector<int> m_FreeIndices;
+
+	std::shared_ptr<const ObjectVector> GetObjectsSnapshot() const;
 
 	static std::vector<intrusive_ptr<ConfigObject> > GetObjectsHelper(Type *type);
+	static std::shared_ptr<const ObjectVector> GetObjectsSnapshotHelper(Type *type);
 };
 
 }
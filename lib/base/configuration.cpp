@@ -12,18 +12,25 @@ String Configuration::ApiBindHost{"::"};
 String Configuration::ApiBindPort{"5665"};
 bool Configuration::AttachDebugger{false};
 String Configuration::CacheDir;
+int Configuration::CheckOutputCompressionThreshold{4096};
+bool Configuration::CompactConfigItems{false};
 int Configuration::Concurrency{static_cast<int>(std::thread::hardware_concurrency())};
 String Configuration::ConfigDir;
 String Configuration::DataDir;
 String Configuration::EventEngine;
 String Configuration::IncludeConfDir;
 String Configuration::InitRunDir;
+bool Configuration::IoContextPerThread{false};
+bool Configuration::IoThreadAffinity{false};
 String Configuration::LogDir;
 String Configuration::ModAttrPath;
 String Configuration::ObjectsPath;
 String Configuration::PidPath;
 String Configuration::PkgDataDir;
 String Configuration::PrefixDir;
+int Configuration::ProcessIOThreads{4};
+int Configuration::ProcessMaxOutputSize{0};
+int Configuration::ProcessSpawnHelpers{4};
 String Configuration::ProgramData;
 int Configuration::RLimitFiles;
 int Configuration::RLimitProcesses;
@@ -93,6 +100,26 @@ void Configuration::SetCacheDir(const String& val, bool suppress_events, const V
 	HandleUserWrite("CacheDir", &Configuration::CacheDir, val, m_ReadOnly);
 }
 
+int Configuration::GetCheckOutputCompressionThreshold() const
+{
+	return Configuration::CheckOutputCompressionThreshold;
+}
+
+void Configuration::SetCheckOutputCompressionThreshold(int val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("CheckOutputCompressionThreshold", &Configuration::CheckOutputCompressionThreshold, val, m_ReadOnly);
+}
+
+bool Configuration::GetCompactConfigItems() const
+{
+	return Configuration::CompactConfigItems;
+}
+
+void Configuration::SetCompactConfigItems(bool val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("CompactConfigItems", &Configuration::CompactConfigItems, val, m_ReadOnly);
+}
+
 int Configuration::GetConcurrency() const
 {
 	return Configuration::Concurrency;
@@ -153,6 +180,26 @@ void Configuration::SetInitRunDir(const String& val, bool suppress_events, const
 	HandleUserWrite("InitRunDir", &Configuration::InitRunDir, val, m_ReadOnly);
 }
 
+bool Configuration::GetIoContextPerThread() const
+{
+	return Configuration::IoContextPerThread;
+}
+
+void Configuration::SetIoContextPerThread(bool val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("IoContextPerThread", &Configuration::IoContextPerThread, val, m_ReadOnly);
+}
+
+bool Configuration::GetIoThreadAffinity() const
+{
+	return Configuration::IoThreadAffinity;
+}
+
+void Configuration::SetIoThreadAffinity(bool val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("IoThreadAffinity", &Configuration::IoThreadAffinity, val, m_ReadOnly);
+}
+
 String Configuration::GetLogDir() const
 {
 	return Configuration::LogDir;
@@ -213,6 +260,36 @@ void Configuration::SetPrefixDir(const String& val, bool suppress_events, const
 	HandleUserWrite("PrefixDir", &Configuration::PrefixDir, val, m_ReadOnly);
 }
 
+int Configuration::GetProcessIOThreads() const
+{
+	return Configuration::ProcessIOThreads;
+}
+
+void Configuration::SetProcessIOThreads(int val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("ProcessIOThreads", &Configuration::ProcessIOThreads, val, m_ReadOnly);
+}
+
+int Configuration::GetProcessMaxOutputSize() const
+{
+	return Configuration::ProcessMaxOutputSize;
+}
+
+void Configuration::SetProcessMaxOutputSize(int val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("ProcessMaxOutputSize", &Configuration::ProcessMaxOutputSize, val, m_ReadOnly);
+}
+
+int Configuration::GetProcessSpawnHelpers() const
+{
+	return Configuration::ProcessSpawnHelpers;
+}
+
+void Configuration::SetProcessSpawnHelpers(int val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("ProcessSpawnHelpers", &Configuration::ProcessSpawnHelpers, val, m_ReadOnly);
+}
+
 String Configuration::GetProgramData() const
 {
 	return Configuration::ProgramData;
@@ -31,6 +31,12 @@ public:
 	String GetCacheDir() const override;
 	void SetCacheDir(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
+	int GetCheckOutputCompressionThreshold() const override;
+	void SetCheckOutputCompressionThreshold(int value, bool suppress_events = false, const Value& cookie = Empty) override;
+
+	bool GetCompactConfigItems() const override;
+	void SetCompactConfigItems(bool value, bool suppress_events = false, const Value& cookie = Empty) override;
+
 	int GetConcurrency() const override;
 	void SetConcurrency(int value, bool suppress_events = false, const Value& cookie = Empty) override;
 
@@ -49,6 +55,12 @@ public:
 	String GetInitRunDir() const override;
 	void SetInitRunDir(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
+	bool GetIoContextPerThread() const override;
+	void SetIoContextPerThread(bool value, bool suppress_events = false, const Value& cookie = Empty) override;
+
+	bool GetIoThreadAffinity() const override;
+	void SetIoThreadAffinity(bool value, bool suppress_events = false, const Value& cookie = Empty) override;
+
 	String GetLogDir() const override;
 	void SetLogDir(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
@@ -67,6 +79,15 @@ public:
 	String GetPrefixDir() const override;
 	void SetPrefixDir(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
+	int GetProcessIOThreads() const override;
+	void SetProcessIOThreads(int value, bool suppress_events = false, const Value& cookie = Empty) override;
+
+	int GetProcessMaxOutputSize() const override;
+	void SetProcessMaxOutputSize(int value, bool suppress_events = false, const Value& cookie = Empty) override;
+
+	int GetProcessSpawnHelpers() const override;
+	void SetProcessSpawnHelpers(int value, bool suppress_events = false, const Value& cookie = Empty) override;
+
 	String GetProgramData() const override;
 	void SetProgramData(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
@@ -117,18 +138,25 @@ public:
 	static String ApiBindPort;
 	static bool AttachDebugger;
 	static String CacheDir;
+	static int CheckOutputCompressionThreshold;
+	static bool CompactConfigItems;
 	static int Concurrency;
 	static String ConfigDir;
 	static String DataDir;
 	static String EventEngine;
 	static String IncludeConfDir;
 	static String InitRunDir;
+	static bool IoContextPerThread;
+	static bool IoThreadAffinity;
 	static String LogDir;
 	static String ModAttrPath;
 	static String ObjectsPath;
 	static String PidPath;
 	static String PkgDataDir;
 	static String PrefixDir;
+	static int ProcessIOThreads;
+	static int ProcessMaxOutputSize;
+	static int ProcessSpawnHelpers;
 	static String ProgramData;
 	static int RLimitFiles;
 	static int RLimitProcesses;
@@ -0,0 +1,83 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef COPYONWRITE_H
+#define COPYONWRITE_H
+
+#include "base/i2-base.hpp"
+#include <atomic>
+#include <memory>
+#include <utility>
+
+namespace icinga
+{
+
+/**
+ * Holds a container which is shared by all copies of the holder until one
+ * of them is about to modify it, e.g. the items of a dictionary and its
+ * shallow clones.
+ *
+ * Like the container itself, each holder has to be synchronized by its user.
+ * Sharing is safe across threads as long as copying a holder happens with
+ * the same synchronization as modifying it.
+ *
+ * @ingroup base
+ */
+template<typename T>
+class CopyOnWrite
+{
+public:
+	CopyOnWrite() = default;
+
+	CopyOnWrite(T data)
+	{
+		if (!data.empty())
+			m_Data = std::make_shared<T>(std::move(data));
+	}
+
+	/**
+	 * @returns The container for reading only
+	 */
+	const T& Get() const
+	{
+		if (!m_Data)
+			return GetEmpty();
+
+		return *m_Data;
+	}
+
+	/**
+	 * Copies the container first if it's shared.
+	 *
+	 * @returns The container for modifying it
+	 */
+	T& Mutate()
+	{
+		if (!m_Data)
+			m_Data = std::make_shared<T>();
+		else if (m_Data.use_count() > 1)
+			m_Data = std::make_shared<T>(*m_Data);
+		else
+			/* Pairs with the release of the last other holder which may have just read it. */
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+		return *m_Data;
+	}
+
+	void Clear()
+	{
+		m_Data.reset();
+	}
+
+private:
+	std::shared_ptr<T> m_Data;
+
+	static const T& GetEmpty()
+	{
+		static const T empty;
+		return empty;
+	}
+};
+
+}
+
+#endif /* COPYONWRITE_H */
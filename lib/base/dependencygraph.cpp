@@ -1,23 +1,40 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/dependencygraph.hpp"
+#include <cstdint>
 
 using namespace icinga;
 
-std::mutex DependencyGraph::m_Mutex;
-std::map<Object *, std::map<Object *, int> > DependencyGraph::m_Dependencies;
+DependencyGraph::Shard DependencyGraph::m_Shards[DependencyGraph::ShardCount];
+
+DependencyGraph::Shard& DependencyGraph::GetShard(Object *child)
+{
+	/* Objects are allocated with an alignment of 16 bytes, the lower bits are always the same. */
+	auto address = reinterpret_cast<uintptr_t>(child) / 16;
+
+	return m_Shards[address % ShardCount];
+}
 
 void DependencyGraph::AddDependency(Object *parent, Object *child)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
-	m_Dependencies[child][parent]++;
+	Shard& shard (GetShard(child));
+
+	std::unique_lock<std::mutex> lock(shard.Mutex);
+	shard.Dependencies[child][parent]++;
 }
 
 void DependencyGraph::RemoveDependency(Object *parent, Object *child)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	Shard& shard (GetShard(child));
 
-	auto& refs = m_Dependencies[child];
+	std::unique_lock<std::mutex> lock(shard.Mutex);
+
+	auto refsIt = shard.Dependencies.find(child);
+
+	if (refsIt == shard.Dependencies.end())
+		return;
+
+	auto& refs = refsIt->second;
 	auto it = refs.find(parent);
 
 	if (it == refs.end())
@@ -29,17 +46,19 @@ void DependencyGraph::RemoveDependency(Object *parent, Object *child)
 		refs.erase(it);
 
 	if (refs.empty())
-		m_Dependencies.erase(child);
+		shard.Dependencies.erase(refsIt);
 }
 
 std::vector<Object::Ptr> DependencyGraph::GetParents(const Object::Ptr& child)
 {
 	std::vector<Object::Ptr> objects;
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
-	auto it = m_Dependencies.find(child.get());
+	Shard& shard (GetShard(child.get()));
+
+	std::unique_lock<std::mutex> lock(shard.Mutex);
+	auto it = shard.Dependencies.find(child.get());
 
-	if (it != m_Dependencies.end()) {
+	if (it != shard.Dependencies.end()) {
 		typedef std::pair<Object *, int> kv_pair;
 		for (const kv_pair& kv : it->second) {
 			objects.emplace_back(kv.first);
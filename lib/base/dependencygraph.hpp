@@ -7,12 +7,16 @@
 #include "base/object.hpp"
 #include <map>
 #include <mutex>
+#include <unordered_map>
 
 namespace icinga {
 
 /**
  * A graph that tracks dependencies between objects.
  *
+ * The graph is split into shards by the child object, each with its own
+ * lock, so that objects can be activated or modified in parallel.
+ *
  * @ingroup base
  */
 class DependencyGraph
@@ -25,8 +29,17 @@ public:
 private:
 	DependencyGraph();
 
-	static std::mutex m_Mutex;
-	static std::map<Object *, std::map<Object *, int> > m_Dependencies;
+	struct Shard
+	{
+		std::mutex Mutex;
+		std::unordered_map<Object *, std::map<Object *, int> > Dependencies;
+	};
+
+	static const size_t ShardCount = 61;
+
+	static Shard m_Shards[ShardCount];
+
+	static Shard& GetShard(Object *child);
 };
 
 }
@@ -5,29 +5,66 @@
 #include "base/debug.hpp"
 #include "base/primitivetype.hpp"
 #include "base/configwriter.hpp"
+#include <algorithm>
+#include <iterator>
 #include <sstream>
 
 using namespace icinga;
 
-template class std::map<String, Value>;
+template class std::vector<std::pair<String, Value> >;
 
 REGISTER_PRIMITIVE_TYPE(Dictionary, Object, Dictionary::GetPrototype());
+IMPLEMENT_OBJECT_POOL(Dictionary);
+
+static bool ComparePairKeys(const Dictionary::Pair& a, const Dictionary::Pair& b)
+{
+	return a.first < b.first;
+}
+
+static bool ComparePairKey(const Dictionary::Pair& pair, const String& key)
+{
+	return pair.first < key;
+}
+
+/* Sorts the items by key. Like inserting them one by one into a map, the first value for a key wins. */
+static void SortItems(std::vector<Dictionary::Pair>& data)
+{
+	std::stable_sort(data.begin(), data.end(), ComparePairKeys);
+
+	data.erase(std::unique(data.begin(), data.end(), [](const Dictionary::Pair& a, const Dictionary::Pair& b) {
+		return a.first == b.first;
+	}), data.end());
+}
+
+static std::vector<Dictionary::Pair>::const_iterator FindItem(const std::vector<Dictionary::Pair>& data, const String& key)
+{
+	auto it = std::lower_bound(data.begin(), data.end(), key, ComparePairKey);
+
+	if (it != data.end() && it->first == key)
+		return it;
+
+	return data.end();
+}
 
 Dictionary::Dictionary(const DictionaryData& other)
 {
-	for (const auto& kv : other)
-		m_Data.insert(kv);
+	DictionaryData data (other);
+	SortItems(data);
+	m_Data = std::move(data);
 }
 
 Dictionary::Dictionary(DictionaryData&& other)
 {
-	for (auto& kv : other)
-		m_Data.insert(std::move(kv));
+	SortItems(other);
+	m_Data = std::move(other);
 }
 
 Dictionary::Dictionary(std::initializer_list<Dictionary::Pair> init)
-	: m_Data(init)
-{ }
+{
+	DictionaryData data (init);
+	SortItems(data);
+	m_Data = std::move(data);
+}
 
 /**
  * Retrieves a value from a dictionary.
@@ -37,14 +74,12 @@ Dictionary::Dictionary(std::initializer_list<Dictionary::Pair> init)
  */
 Value Dictionary::Get(const String& key) const
 {
-	ObjectLock olock(this);
-
-	auto it = m_Data.find(key);
+	Value result;
 
-	if (it == m_Data.end())
+	if (!Get(key, &result))
 		return Empty;
 
-	return it->second;
+	return result;
 }
 
 /**
@@ -56,15 +91,24 @@ Value Dictionary::Get(const String& key) const
  */
 bool Dictionary::Get(const String& key, Value *result) const
 {
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 
-	auto it = m_Data.find(key);
+	auto& data (m_Data.Get());
+	auto it = FindItem(data, key);
 
-	if (it == m_Data.end())
-		return false;
+	if (it != data.end()) {
+		*result = it->second;
+		return true;
+	}
 
-	*result = it->second;
-	return true;
+	it = FindItem(m_Pending, key);
+
+	if (it != m_Pending.end()) {
+		*result = it->second;
+		return true;
+	}
+
+	return false;
 }
 
 /**
@@ -81,7 +125,77 @@ void Dictionary::Set(const String& key, Value value, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Value in dictionary must not be modified."));
 
-	m_Data[key] = std::move(value);
+	auto& data (m_Data.Get());
+	auto it = std::lower_bound(data.begin(), data.end(), key, ComparePairKey);
+	auto index = it - data.begin();
+
+	if (it != data.end() && it->first == key) {
+		m_Data.Mutate()[index].second = std::move(value);
+		return;
+	}
+
+	/* Keys which are added in order can be appended right away. Frozen
+	 * dictionaries must not have pending items, they're read without locking.
+	 */
+	if (m_Frozen) {
+		auto& items (m_Data.Mutate());
+		items.emplace(items.begin() + index, key, std::move(value));
+		return;
+	}
+
+	if (it == data.end() && m_Pending.empty()) {
+		m_Data.Mutate().emplace_back(key, std::move(value));
+		return;
+	}
+
+	auto pending = std::lower_bound(m_Pending.begin(), m_Pending.end(), key, ComparePairKey);
+
+	if (pending != m_Pending.end() && pending->first == key) {
+		pending->second = std::move(value);
+		return;
+	}
+
+	m_Pending.emplace(pending, key, std::move(value));
+
+	if (m_Pending.size() * m_Pending.size() > data.size())
+		Merge();
+}
+
+/**
+ * Merges the recently added items into the sorted items.
+ *
+ * Note: Caller must hold the object lock.
+ */
+void Dictionary::Merge() const
+{
+	if (m_Pending.empty())
+		return;
+
+	auto& data (m_Data.Mutate());
+	SizeType size = data.size();
+
+	data.reserve(size + m_Pending.size());
+	std::move(m_Pending.begin(), m_Pending.end(), std::back_inserter(data));
+	m_Pending.clear();
+
+	std::inplace_merge(data.begin(), data.begin() + size, data.end(), ComparePairKeys);
+}
+
+/**
+ * Returns the items for iterating over them. Their iterators allow modifying
+ * them, so they aren't shared anymore afterwards. Frozen dictionaries must
+ * not be modified anyway.
+ *
+ * Note: Caller must hold the object lock.
+ */
+std::vector<Dictionary::Pair>& Dictionary::GetIterable()
+{
+	Merge();
+
+	if (m_Frozen.load(std::memory_order_acquire) || m_Data.Get().empty())
+		return const_cast<std::vector<Pair>&>(m_Data.Get());
+
+	return m_Data.Mutate();
 }
 
 /**
@@ -91,9 +205,9 @@ void Dictionary::Set(const String& key, Value value, bool overrideFrozen)
  */
 size_t Dictionary::GetLength() const
 {
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 
-	return m_Data.size();
+	return m_Data.Get().size() + m_Pending.size();
 }
 
 /**
@@ -104,9 +218,11 @@ size_t Dictionary::GetLength() const
  */
 bool Dictionary::Contains(const String& key) const
 {
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 
-	return (m_Data.find(key) != m_Data.end());
+	auto& data (m_Data.Get());
+
+	return FindItem(data, key) != data.end() || FindItem(m_Pending, key) != m_Pending.end();
 }
 
 /**
@@ -120,7 +236,7 @@ Dictionary::Iterator Dictionary::Begin()
 {
 	ASSERT(OwnsLock());
 
-	return m_Data.begin();
+	return GetIterable().begin();
 }
 
 /**
@@ -134,7 +250,7 @@ Dictionary::Iterator Dictionary::End()
 {
 	ASSERT(OwnsLock());
 
-	return m_Data.end();
+	return GetIterable().end();
 }
 
 /**
@@ -150,7 +266,11 @@ void Dictionary::Remove(Dictionary::Iterator it, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Dictionary must not be modified."));
 
-	m_Data.erase(it);
+	/* The iterator may point into items which are still shared (frozen dictionaries). */
+	auto index = it - m_Data.Get().begin();
+	auto& data (m_Data.Mutate());
+
+	data.erase(data.begin() + index);
 }
 
 /**
@@ -166,13 +286,21 @@ void Dictionary::Remove(const String& key, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Dictionary must not be modified."));
 
-	Dictionary::Iterator it;
-	it = m_Data.find(key);
+	auto& data (m_Data.Get());
+	auto it = FindItem(data, key);
 
-	if (it == m_Data.end())
+	if (it != data.end()) {
+		auto index = it - data.begin();
+		auto& items (m_Data.Mutate());
+
+		items.erase(items.begin() + index);
 		return;
+	}
+
+	it = FindItem(m_Pending, key);
 
-	m_Data.erase(it);
+	if (it != m_Pending.end())
+		m_Pending.erase(it);
 }
 
 /**
@@ -187,14 +315,27 @@ void Dictionary::Clear(bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Dictionary must not be modified."));
 
-	m_Data.clear();
+	m_Data.Clear();
+	m_Pending.clear();
 }
 
 void Dictionary::CopyTo(const Dictionary::Ptr& dest) const
 {
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
+
+	Merge();
+
+	{
+		ObjectLock xlock(dest);
+
+		/* Empty dictionaries share the items until either one is modified. */
+		if (dest.get() != this && !dest->m_Frozen && dest->m_Data.Get().empty() && dest->m_Pending.empty()) {
+			dest->m_Data = m_Data;
+			return;
+		}
+	}
 
-	for (const Dictionary::Pair& kv : m_Data) {
+	for (const Dictionary::Pair& kv : m_Data.Get()) {
 		dest->Set(kv.first, kv.second);
 	}
 }
@@ -222,11 +363,22 @@ Object::Ptr Dictionary::Clone() const
 	DictionaryData dict;
 
 	{
-		ObjectLock olock(this);
+		ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 
-		dict.reserve(GetLength());
+		Merge();
 
-		for (const Dictionary::Pair& kv : m_Data) {
+		auto& data (m_Data.Get());
+
+		/* Values other than objects are cloned by copying them, so the items can be shared. */
+		if (std::none_of(data.begin(), data.end(), [](const Dictionary::Pair& kv) { return kv.second.IsObject(); })) {
+			Dictionary::Ptr clone = new Dictionary();
+			clone->m_Data = m_Data;
+			return clone;
+		}
+
+		dict.reserve(data.size());
+
+		for (const Dictionary::Pair& kv : data) {
 			dict.emplace_back(kv.first, kv.second.Clone());
 		}
 	}
@@ -242,11 +394,15 @@ Object::Ptr Dictionary::Clone() const
  */
 std::vector<String> Dictionary::GetKeys() const
 {
-	ObjectLock olock(this);
+	ObjectLock olock(m_Frozen.load(std::memory_order_acquire) ? nullptr : this);
 
+	Merge();
+
+	auto& data (m_Data.Get());
 	std::vector<String> keys;
+	keys.reserve(data.size());
 
-	for (const Dictionary::Pair& kv : m_Data) {
+	for (const Dictionary::Pair& kv : data) {
 		keys.push_back(kv.first);
 	}
 
@@ -260,10 +416,18 @@ String Dictionary::ToString() const
 	return msgbuf.str();
 }
 
+/**
+ * Makes the dictionary read-only. Frozen dictionaries are read without
+ * locking them, modifying them with overrideFrozen is only safe while
+ * no other thread might read them.
+ */
 void Dictionary::Freeze()
 {
 	ObjectLock olock(this);
-	m_Frozen = true;
+
+	Merge();
+
+	m_Frozen.store(true, std::memory_order_release);
 }
 
 Value Dictionary::GetFieldByName(const String& field, bool, const DebugInfo& debugInfo) const
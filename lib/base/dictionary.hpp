@@ -6,8 +6,12 @@
 #include "base/i2-base.hpp"
 #include "base/object.hpp"
 #include "base/value.hpp"
+#include "base/objectpool.hpp"
+#include "base/copyonwrite.hpp"
 #include <boost/range/iterator.hpp>
+#include <atomic>
 #include <map>
+#include <utility>
 #include <vector>
 
 namespace icinga
@@ -24,15 +28,16 @@ class Dictionary final : public Object
 {
 public:
 	DECLARE_OBJECT(Dictionary);
+	DECLARE_OBJECT_POOL();
+
+	typedef std::pair<String, Value> Pair;
 
 	/**
 	 * An iterator that can be used to iterate over dictionary elements.
 	 */
-	typedef std::map<String, Value>::iterator Iterator;
-
-	typedef std::map<String, Value>::size_type SizeType;
+	typedef std::vector<Pair>::iterator Iterator;
 
-	typedef std::map<String, Value>::value_type Pair;
+	typedef std::vector<Pair>::size_type SizeType;
 
 	Dictionary() = default;
 	Dictionary(const DictionaryData& other);
@@ -74,8 +79,19 @@ public:
 	bool GetOwnField(const String& field, Value *result) const override;
 
 private:
-	std::map<String, Value> m_Data; /**< The data for the dictionary. */
-	bool m_Frozen{false};
+	/* Both vectors are sorted by key. New keys are collected in m_Pending
+	 * and merged into m_Data once there are too many of them, which keeps
+	 * inserting keys in random order from being quadratic.
+	 *
+	 * m_Data is shared with clones until either one is modified, e.g. the
+	 * vars of many objects which have been copied from the same template.
+	 */
+	mutable CopyOnWrite<std::vector<Pair> > m_Data; /**< The data for the dictionary. */
+	mutable std::vector<Pair> m_Pending; /**< Recently added items. */
+	std::atomic<bool> m_Frozen{false}; /**< Frozen dictionaries are read without locking them. */
+
+	void Merge() const;
+	std::vector<Pair>& GetIterable();
 };
 
 Dictionary::Iterator begin(const Dictionary::Ptr& x);
@@ -83,6 +99,6 @@ Dictionary::Iterator end(const Dictionary::Ptr& x);
 
 }
 
-extern template class std::map<icinga::String, icinga::Value>;
+extern template class std::vector<std::pair<icinga::String, icinga::Value> >;
 
 #endif /* DICTIONARY_H */
@@ -0,0 +1,289 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef EVENTBUS_H
+#define EVENTBUS_H
+
+#include "base/i2-base.hpp"
+#include "base/rcu.hpp"
+#include "base/utility.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * What an asynchronous subscriber's queue does with an event once it is full.
+ *
+ * @ingroup base
+ */
+enum EventOverflowPolicy
+{
+	/* The new event is dropped. */
+	EventDropNewest,
+	/* A pending event for the same object (the first argument) is replaced
+	 * by the new one. If there is none, the new event is delivered
+	 * synchronously, so the latest event for every object is seen.
+	 */
+	EventCoalesce
+};
+
+template<typename T>
+inline const void *GetEventKey(const intrusive_ptr<T>& object)
+{
+	return object.get();
+}
+
+template<typename T>
+inline const void *GetEventKey(const T&)
+{
+	return nullptr;
+}
+
+template<typename Signature>
+class EventBus;
+
+/**
+ * A signal for hot events, e.g. new check results.
+ *
+ * Emitting an event doesn't take any lock, the list of subscribers is
+ * published via RCU and only copied when somebody subscribes. Subscribers
+ * either run in the emitting thread or have their own bounded queue which
+ * is drained by the thread pool, one event at a time and in order.
+ *
+ * The interface is the subset of boost::signals2::signal which is used for
+ * these events, existing connect() calls and invocations keep working.
+ *
+ * @ingroup base
+ */
+template<typename... Args>
+class EventBus<void (Args...)>
+{
+public:
+	typedef std::function<void (Args...)> Slot;
+
+	EventBus() = default;
+	EventBus(const EventBus&) = delete;
+	EventBus& operator=(const EventBus&) = delete;
+
+	~EventBus()
+	{
+		delete m_Subscribers.load();
+	}
+
+	/**
+	 * Subscribes a slot which runs in the thread emitting the event.
+	 *
+	 * @param slot The slot.
+	 */
+	void connect(Slot slot)
+	{
+		Subscribe(Subscriber{std::move(slot), nullptr});
+	}
+
+	/**
+	 * Subscribes a slot which runs asynchronously in the thread pool.
+	 *
+	 * @param slot The slot.
+	 * @param maxDepth How many events may be pending for this slot.
+	 * @param policy What to do with events once maxDepth is reached.
+	 */
+	void connect(Slot slot, size_t maxDepth, EventOverflowPolicy policy)
+	{
+		std::shared_ptr<AsyncQueue> queue (new AsyncQueue(slot, maxDepth, policy));
+
+		Subscribe(Subscriber{std::move(slot), std::move(queue)});
+	}
+
+	void operator()(Args... args) const
+	{
+		RcuReadLock lock;
+
+		auto *subscribers (m_Subscribers.load(std::memory_order_acquire));
+
+		if (!subscribers)
+			return;
+
+		for (auto& subscriber : *subscribers) {
+			if (subscriber.Queue)
+				subscriber.Queue->Push(args...);
+			else
+				subscriber.Callback(args...);
+		}
+	}
+
+	bool empty() const
+	{
+		return num_slots() == 0;
+	}
+
+	size_t num_slots() const
+	{
+		RcuReadLock lock;
+
+		auto *subscribers (m_Subscribers.load(std::memory_order_acquire));
+
+		return subscribers ? subscribers->size() : 0;
+	}
+
+	/**
+	 * Returns how many events asynchronous subscribers have dropped so far.
+	 *
+	 * @returns The number of dropped events.
+	 */
+	uint_fast64_t GetDroppedEvents() const
+	{
+		RcuReadLock lock;
+
+		auto *subscribers (m_Subscribers.load(std::memory_order_acquire));
+		uint_fast64_t dropped = 0;
+
+		if (subscribers) {
+			for (auto& subscriber : *subscribers) {
+				if (subscriber.Queue)
+					dropped += subscriber.Queue->Dropped.load();
+			}
+		}
+
+		return dropped;
+	}
+
+private:
+	class AsyncQueue : public std::enable_shared_from_this<AsyncQueue>
+	{
+	public:
+		typedef std::function<void (const Slot&)> Invocation;
+
+		std::atomic<uint_fast64_t> Dropped{0};
+
+		AsyncQueue(Slot slot, size_t maxDepth, EventOverflowPolicy policy)
+			: m_Slot(std::move(slot)), m_MaxDepth(maxDepth), m_Policy(policy)
+		{ }
+
+		void Push(Args... args)
+		{
+			Invocation invocation ([args...](const Slot& slot) { slot(args...); });
+
+			{
+				std::unique_lock<std::mutex> lock (m_Mutex);
+
+				const void *key = m_Policy == EventCoalesce ? GetKey(args...) : nullptr;
+
+				if (key) {
+					for (auto& pending : m_Pending) {
+						if (pending.first == key) {
+							pending.second = std::move(invocation);
+							return;
+						}
+					}
+				}
+
+				if (m_Pending.size() < m_MaxDepth) {
+					m_Pending.emplace_back(key, std::move(invocation));
+
+					if (!m_Running) {
+						m_Running = true;
+
+						auto self (this->shared_from_this());
+						Utility::QueueAsyncCallback([self]() { self->Drain(); });
+					}
+
+					return;
+				}
+			}
+
+			if (m_Policy == EventCoalesce)
+				m_Slot(args...);
+			else
+				Dropped++;
+		}
+
+	private:
+		Slot m_Slot;
+		size_t m_MaxDepth;
+		EventOverflowPolicy m_Policy;
+
+		std::mutex m_Mutex;
+		std::deque<std::pair<const void *, Invocation> > m_Pending;
+		bool m_Running{false};
+
+		static const void *GetKey()
+		{
+			return nullptr;
+		}
+
+		template<typename First, typename... Rest>
+		static const void *GetKey(const First& first, const Rest&...)
+		{
+			return GetEventKey(first);
+		}
+
+		void Drain()
+		{
+			/* Give the thread pool back now and then, other subscribers may be waiting. */
+			for (int i = 0; i < 256; i++) {
+				Invocation invocation;
+
+				{
+					std::unique_lock<std::mutex> lock (m_Mutex);
+
+					if (m_Pending.empty()) {
+						m_Running = false;
+						return;
+					}
+
+					invocation = std::move(m_Pending.front().second);
+					m_Pending.pop_front();
+				}
+
+				try {
+					invocation(m_Slot);
+				} catch (const std::exception& ex) {
+					Log(LogCritical, "EventBus")
+						<< "Exception in asynchronous event subscriber: " << DiagnosticInformation(ex);
+				}
+			}
+
+			auto self (this->shared_from_this());
+			Utility::QueueAsyncCallback([self]() { self->Drain(); });
+		}
+	};
+
+	struct Subscriber
+	{
+		Slot Callback;
+		std::shared_ptr<AsyncQueue> Queue;
+	};
+
+	typedef std::vector<Subscriber> SubscriberList;
+
+	std::mutex m_Mutex;
+	std::atomic<SubscriberList *> m_Subscribers{nullptr};
+
+	void Subscribe(Subscriber subscriber)
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		auto *current (m_Subscribers.load());
+		auto *next (current ? new SubscriberList(*current) : new SubscriberList());
+
+		next->emplace_back(std::move(subscriber));
+
+		m_Subscribers.store(next, std::memory_order_release);
+
+		if (current)
+			Rcu::Retire([current]() { delete current; });
+	}
+};
+
+}
+
+#endif /* EVENTBUS_H */
@@ -8,17 +8,16 @@
 
 using namespace icinga;
 
-static Value FunctionCall(const std::vector<Value>& args)
+static Value FunctionCall(const Value *args, size_t count)
 {
-	if (args.size() < 1)
+	if (count < 1)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Too few arguments for call()"));
 
 	ScriptFrame *vframe = ScriptFrame::GetCurrentFrame();
 	Function::Ptr self = static_cast<Function::Ptr>(vframe->Self);
 	REQUIRE_NOT_NULL(self);
 
-	std::vector<Value> uargs(args.begin() + 1, args.end());
-	return self->InvokeThis(args[0], uargs);
+	return self->InvokeThis(args[0], args + 1, count - 1);
 }
 
 static Value FunctionCallV(const Value& thisArg, const Array::Ptr& args)
@@ -41,7 +40,7 @@ static Value FunctionCallV(const Value& thisArg, const Array::Ptr& args)
 Object::Ptr Function::GetPrototype()
 {
 	static Dictionary::Ptr prototype = new Dictionary({
-		{ "call", new Function("Function#call", FunctionCall) },
+		{ "call", new Function("Function#call", Function::Callback(FunctionCall)) },
 		{ "callv", new Function("Function#callv", FunctionCallV) }
 	});
 
@@ -20,15 +20,41 @@ Function::Function(const String& name, Callback function, const std::vector<Stri
 }
 
 Value Function::Invoke(const std::vector<Value>& arguments)
+{
+	return Invoke(arguments.data(), arguments.size());
+}
+
+Value Function::Invoke(std::initializer_list<Value> arguments)
+{
+	return Invoke(arguments.begin(), arguments.size());
+}
+
+/**
+ * Calls the function with the arguments as they are, e.g. from an array on the caller's stack.
+ *
+ * @param arguments The first argument, may be nullptr if there are none
+ * @param count The number of arguments
+ */
+Value Function::Invoke(const Value *arguments, size_t count)
 {
 	ScriptFrame frame(false);
-	return m_Callback(arguments);
+	return m_Callback(arguments, count);
 }
 
 Value Function::InvokeThis(const Value& otherThis, const std::vector<Value>& arguments)
+{
+	return InvokeThis(otherThis, arguments.data(), arguments.size());
+}
+
+Value Function::InvokeThis(const Value& otherThis, std::initializer_list<Value> arguments)
+{
+	return InvokeThis(otherThis, arguments.begin(), arguments.size());
+}
+
+Value Function::InvokeThis(const Value& otherThis, const Value *arguments, size_t count)
 {
 	ScriptFrame frame(false, otherThis);
-	return m_Callback(arguments);
+	return m_Callback(arguments, count);
 }
 
 Object::Ptr Function::Clone() const
@@ -8,6 +8,8 @@
 #include "base/value.hpp"
 #include "base/functionwrapper.hpp"
 #include "base/scriptglobal.hpp"
+#include <cstddef>
+#include <initializer_list>
 #include <vector>
 
 namespace icinga
@@ -23,7 +25,7 @@ class Function final : public ObjectImpl<Function>
 public:
 	DECLARE_OBJECT(Function);
 
-	typedef std::function<Value (const std::vector<Value>& arguments)> Callback;
+	typedef std::function<Value (const Value *arguments, size_t count)> Callback;
 
 	template<typename F>
 	Function(const String& name, F function, const std::vector<String>& args = std::vector<String>(),
@@ -32,7 +34,11 @@ public:
 	{ }
 
 	Value Invoke(const std::vector<Value>& arguments = std::vector<Value>());
+	Value Invoke(std::initializer_list<Value> arguments);
+	Value Invoke(const Value *arguments, size_t count);
 	Value InvokeThis(const Value& otherThis, const std::vector<Value>& arguments = std::vector<Value>());
+	Value InvokeThis(const Value& otherThis, std::initializer_list<Value> arguments);
+	Value InvokeThis(const Value& otherThis, const Value *arguments, size_t count);
 
 	bool IsSideEffectFree() const
 	{
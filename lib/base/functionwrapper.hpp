@@ -16,30 +16,42 @@ using namespace std::placeholders;
 namespace icinga
 {
 
+/* Functions get their arguments as an array rather than as a vector, so calling them doesn't need to allocate,
+ * see Function::Invoke(). Callbacks which take the arguments like this have to be passed as std::function.
+ */
+inline std::function<Value (const Value *, size_t)> WrapFunction(std::function<Value (const Value *, size_t)> function)
+{
+	return function;
+}
+
 template<typename FuncType>
 typename std::enable_if<
     std::is_class<FuncType>::value &&
     std::is_same<typename boost::function_types::result_type<decltype(&FuncType::operator())>::type, Value>::value &&
 	boost::function_types::function_arity<decltype(&FuncType::operator())>::value == 2,
-    std::function<Value (const std::vector<Value>&)>>::type
+    std::function<Value (const Value *, size_t)>>::type
 WrapFunction(FuncType function)
 {
 	static_assert(std::is_same<typename boost::mpl::at_c<typename boost::function_types::parameter_types<decltype(&FuncType::operator())>, 1>::type, const std::vector<Value>&>::value, "Argument type must be const std::vector<Value>");
-	return function;
+	return [function](const Value *arguments, size_t count) {
+		return function(std::vector<Value>(arguments, arguments + count));
+	};
 }
 
-inline std::function<Value (const std::vector<Value>&)> WrapFunction(void (*function)(const std::vector<Value>&))
+inline std::function<Value (const Value *, size_t)> WrapFunction(void (*function)(const std::vector<Value>&))
 {
-	return [function](const std::vector<Value>& arguments) {
-		function(arguments);
+	return [function](const Value *arguments, size_t count) {
+		function(std::vector<Value>(arguments, arguments + count));
 		return Empty;
 	};
 }
 
 template<typename Return>
-std::function<Value (const std::vector<Value>&)> WrapFunction(Return (*function)(const std::vector<Value>&))
+std::function<Value (const Value *, size_t)> WrapFunction(Return (*function)(const std::vector<Value>&))
 {
-	return std::bind(function, _1);
+	return [function](const Value *arguments, size_t count) -> Value {
+		return function(std::vector<Value>(arguments, arguments + count));
+	};
 }
 
 template <std::size_t... Indices>
@@ -64,14 +76,14 @@ struct UnpackCaller
 {
 private:
 	template <typename FuncType, size_t... I>
-	auto Invoke(FuncType f, const std::vector<Value>& args, indices<I...>) -> decltype(f(args[I]...))
+	auto Invoke(FuncType f, const Value *args, indices<I...>) -> decltype(f(args[I]...))
 	{
 		return f(args[I]...);
 	}
 
 public:
 	template <typename FuncType, int Arity>
-	auto operator() (FuncType f, const std::vector<Value>& args) -> decltype(Invoke(f, args, BuildIndices<Arity>{}))
+	auto operator() (FuncType f, const Value *args) -> decltype(Invoke(f, args, BuildIndices<Arity>{}))
 	{
 		return Invoke(f, args, BuildIndices<Arity>{});
 	}
@@ -80,7 +92,7 @@ public:
 template<typename FuncType, int Arity, typename ReturnType>
 struct FunctionWrapper
 {
-	static Value Invoke(FuncType function, const std::vector<Value>& arguments)
+	static Value Invoke(FuncType function, const Value *arguments)
 	{
 		return UnpackCaller().operator()<FuncType, Arity>(function, arguments);
 	}
@@ -89,7 +101,7 @@ struct FunctionWrapper
 template<typename FuncType, int Arity>
 struct FunctionWrapper<FuncType, Arity, void>
 {
-	static Value Invoke(FuncType function, const std::vector<Value>& arguments)
+	static Value Invoke(FuncType function, const Value *arguments)
 	{
 		UnpackCaller().operator()<FuncType, Arity>(function, arguments);
 		return Empty;
@@ -99,20 +111,20 @@ struct FunctionWrapper<FuncType, Arity, void>
 template<typename FuncType>
 typename std::enable_if<
 	std::is_function<typename std::remove_pointer<FuncType>::type>::value && !std::is_same<FuncType, Value(*)(const std::vector<Value>&)>::value,
-	std::function<Value (const std::vector<Value>&)>>::type
+	std::function<Value (const Value *, size_t)>>::type
 WrapFunction(FuncType function)
 {
-	return [function](const std::vector<Value>& arguments) {
+	return [function](const Value *arguments, size_t count) {
 		constexpr size_t arity = boost::function_types::function_arity<typename std::remove_pointer<FuncType>::type>::value;
 
 		if (arity > 0) {
-			if (arguments.size() < arity)
+			if (count < arity)
 				BOOST_THROW_EXCEPTION(std::invalid_argument("Too few arguments for function."));
-			else if (arguments.size() > arity)
+			else if (count > arity)
 				BOOST_THROW_EXCEPTION(std::invalid_argument("Too many arguments for function."));
 		}
 
-		using ReturnType = decltype(UnpackCaller().operator()<FuncType, arity>(*static_cast<FuncType *>(nullptr), std::vector<Value>()));
+		using ReturnType = decltype(UnpackCaller().operator()<FuncType, arity>(*static_cast<FuncType *>(nullptr), static_cast<const Value *>(nullptr)));
 
 		return FunctionWrapper<FuncType, arity, ReturnType>::Invoke(function, arguments);
 	};
@@ -123,24 +135,24 @@ typename std::enable_if<
     std::is_class<FuncType>::value &&
     !(std::is_same<typename boost::function_types::result_type<decltype(&FuncType::operator())>::type, Value>::value &&
 	boost::function_types::function_arity<decltype(&FuncType::operator())>::value == 2),
-    std::function<Value (const std::vector<Value>&)>>::type
+    std::function<Value (const Value *, size_t)>>::type
 WrapFunction(FuncType function)
 {
 	static_assert(!std::is_same<typename boost::mpl::at_c<typename boost::function_types::parameter_types<decltype(&FuncType::operator())>, 1>::type, const std::vector<Value>&>::value, "Argument type must be const std::vector<Value>");
 
 	using FuncTypeInvoker = decltype(&FuncType::operator());
 
-	return [function](const std::vector<Value>& arguments) {
+	return [function](const Value *arguments, size_t count) {
 		constexpr size_t arity = boost::function_types::function_arity<FuncTypeInvoker>::value - 1;
 
 		if (arity > 0) {
-			if (arguments.size() < arity)
+			if (count < arity)
 				BOOST_THROW_EXCEPTION(std::invalid_argument("Too few arguments for function."));
-			else if (arguments.size() > arity)
+			else if (count > arity)
 				BOOST_THROW_EXCEPTION(std::invalid_argument("Too many arguments for function."));
 		}
 
-		using ReturnType = decltype(UnpackCaller().operator()<FuncType, arity>(*static_cast<FuncType *>(nullptr), std::vector<Value>()));
+		using ReturnType = decltype(UnpackCaller().operator()<FuncType, arity>(*static_cast<FuncType *>(nullptr), static_cast<const Value *>(nullptr)));
 
 		return FunctionWrapper<FuncType, arity, ReturnType>::Invoke(function, arguments);
 	};
@@ -0,0 +1,218 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/histogram.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/statsfunction.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <mutex>
+
+using namespace icinga;
+
+REGISTER_STATSFUNCTION(Histogram, &Histogram::StatsFunc);
+
+struct HistogramRegistry
+{
+	std::mutex Mutex;
+	std::map<String, std::unique_ptr<Histogram>> Histograms;
+};
+
+static HistogramRegistry& GetHistogramRegistry()
+{
+	static HistogramRegistry registry;
+	return registry;
+}
+
+Histogram::Histogram()
+{
+	for (auto& bucket : m_Buckets)
+		bucket.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Returns the histogram with the given name, it's created on first use.
+ *
+ * The returned reference stays valid, so callers with a fixed name should look it up once.
+ *
+ * @param name The name, e.g. "checkable_process_check_result".
+ * @returns The histogram.
+ */
+Histogram& Histogram::GetByName(const String& name)
+{
+	auto& registry (GetHistogramRegistry());
+	std::unique_lock<std::mutex> lock (registry.Mutex);
+	auto& histogram (registry.Histograms[name]);
+
+	if (!histogram)
+		histogram.reset(new Histogram());
+
+	return *histogram;
+}
+
+std::map<String, const Histogram*> Histogram::GetAll()
+{
+	auto& registry (GetHistogramRegistry());
+	std::map<String, const Histogram*> histograms;
+	std::unique_lock<std::mutex> lock (registry.Mutex);
+
+	for (auto& kv : registry.Histograms)
+		histograms.emplace(kv.first, kv.second.get());
+
+	return histograms;
+}
+
+/**
+ * Records a duration.
+ *
+ * @param seconds The duration in seconds, negative ones are recorded as 0.
+ */
+void Histogram::Record(double seconds)
+{
+	uint_fast64_t value = 0;
+
+	if (seconds > 0) {
+		double us = seconds * 1e6;
+		double limit = static_cast<double>((uint_fast64_t(1) << MaxValueBits) - 1);
+
+		value = static_cast<uint_fast64_t>(std::min(us, limit));
+	}
+
+	m_Buckets[GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+	m_Count.fetch_add(1, std::memory_order_relaxed);
+	m_Sum.fetch_add(value, std::memory_order_relaxed);
+
+	auto max (m_Max.load(std::memory_order_relaxed));
+
+	while (value > max && !m_Max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+		;
+}
+
+uint_fast64_t Histogram::GetCount() const
+{
+	return m_Count.load(std::memory_order_relaxed);
+}
+
+double Histogram::GetSum() const
+{
+	return m_Sum.load(std::memory_order_relaxed) / 1e6;
+}
+
+double Histogram::GetAverage() const
+{
+	auto count (GetCount());
+
+	return count > 0 ? m_Sum.load(std::memory_order_relaxed) / 1e6 / count : 0;
+}
+
+double Histogram::GetMax() const
+{
+	return m_Max.load(std::memory_order_relaxed) / 1e6;
+}
+
+/**
+ * Returns the value below which the given percentage of the recorded durations fall.
+ * It's the upper bound of the bucket it falls into, but never above the maximum.
+ *
+ * @param percentile The percentage, e.g. 99.
+ * @returns The duration in seconds or 0 if nothing has been recorded yet.
+ */
+double Histogram::GetPercentile(double percentile) const
+{
+	uint_fast64_t counts[BucketCount];
+	uint_fast64_t total = 0;
+
+	/* Concurrent recordings may be missing, that doesn't matter for the result. */
+	for (size_t i = 0; i < BucketCount; i++) {
+		counts[i] = m_Buckets[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+
+	if (total == 0)
+		return 0;
+
+	auto rank (static_cast<uint_fast64_t>(std::ceil(percentile / 100.0 * total)));
+
+	if (rank < 1)
+		rank = 1;
+
+	uint_fast64_t seen = 0;
+	auto max (m_Max.load(std::memory_order_relaxed));
+
+	for (size_t i = 0; i < BucketCount; i++) {
+		seen += counts[i];
+
+		if (seen >= rank)
+			return std::min(GetBucketUpperBound(i), max) / 1e6;
+	}
+
+	return max / 1e6;
+}
+
+Dictionary::Ptr Histogram::ToDictionary() const
+{
+	return new Dictionary({
+		{ "count", GetCount() },
+		{ "avg", GetAverage() },
+		{ "p50", GetPercentile(50) },
+		{ "p90", GetPercentile(90) },
+		{ "p99", GetPercentile(99) },
+		{ "p999", GetPercentile(99.9) },
+		{ "max", GetMax() }
+	});
+}
+
+void Histogram::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	DictionaryData nodes;
+
+	for (auto& kv : GetAll()) {
+		Dictionary::Ptr stats = kv.second->ToDictionary();
+
+		nodes.emplace_back(kv.first, stats);
+
+		/* Names may contain URLs, perfdata labels shouldn't. */
+		String label = "histogram_" + kv.first;
+
+		for (char& ch : label) {
+			if (!isalnum(static_cast<unsigned char>(ch)) && ch != '_')
+				ch = '_';
+		}
+
+		perfdata->Add(new PerfdataValue(label + "_count", stats->Get("count"), true));
+		perfdata->Add(new PerfdataValue(label + "_p50", stats->Get("p50"), false, "s"));
+		perfdata->Add(new PerfdataValue(label + "_p99", stats->Get("p99"), false, "s"));
+		perfdata->Add(new PerfdataValue(label + "_max", stats->Get("max"), false, "s"));
+	}
+
+	status->Set("histograms", new Dictionary(std::move(nodes)));
+}
+
+size_t Histogram::GetBucket(uint_fast64_t value)
+{
+	if (value < SubBucketCount)
+		return value;
+
+	int highestBit = 0;
+
+	for (int step = 32; step > 0; step /= 2) {
+		if (value >> (highestBit + step))
+			highestBit += step;
+	}
+
+	/* Keep the SubBucketBits + 1 most significant bits, the highest one is implied by the shift. */
+	int shift = highestBit - SubBucketBits;
+
+	return (shift + 1) * SubBucketCount + (value >> shift) - SubBucketCount;
+}
+
+uint_fast64_t Histogram::GetBucketUpperBound(size_t bucket)
+{
+	if (bucket < SubBucketCount)
+		return bucket;
+
+	int shift = bucket / SubBucketCount - 1;
+	uint_fast64_t subBucket = bucket % SubBucketCount + SubBucketCount;
+
+	return ((subBucket + 1) << shift) - 1;
+}
@@ -0,0 +1,106 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "base/i2-base.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include "base/string.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+namespace icinga
+{
+
+/**
+ * A latency histogram with logarithmic buckets in the style of HdrHistogram.
+ *
+ * Durations are recorded in microseconds. Each power of two is split into
+ * 2^SubBucketBits linear sub-buckets, so percentiles are accurate to about
+ * 3% of the value. Recording is lock-free and may happen from any thread.
+ *
+ * Histograms are registered by name and live until the process exits, their
+ * percentiles are part of the feature stats (/v1/status and the icinga check)
+ * and of /v1/metrics.
+ *
+ * @ingroup base
+ */
+class Histogram final
+{
+public:
+	static constexpr int SubBucketBits = 5;
+	static constexpr uint_fast64_t SubBucketCount = uint_fast64_t(1) << SubBucketBits;
+	static constexpr int MaxValueBits = 40;
+	static constexpr size_t BucketCount = (MaxValueBits - SubBucketBits + 1) * SubBucketCount;
+
+	Histogram();
+	Histogram(const Histogram&) = delete;
+	Histogram& operator=(const Histogram&) = delete;
+
+	static Histogram& GetByName(const String& name);
+	static std::map<String, const Histogram*> GetAll();
+
+	void Record(double seconds);
+
+	/**
+	 * Records the time since the given point in time.
+	 *
+	 * @param start The start of the duration.
+	 */
+	void RecordSince(std::chrono::steady_clock::time_point start)
+	{
+		Record(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	uint_fast64_t GetCount() const;
+	double GetSum() const;
+	double GetAverage() const;
+	double GetMax() const;
+	double GetPercentile(double percentile) const;
+
+	Dictionary::Ptr ToDictionary() const;
+
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
+private:
+	std::atomic<uint_fast64_t> m_Buckets[BucketCount];
+	std::atomic<uint_fast64_t> m_Count{0};
+	std::atomic<uint_fast64_t> m_Sum{0};
+	std::atomic<uint_fast64_t> m_Max{0};
+
+	static size_t GetBucket(uint_fast64_t value);
+	static uint_fast64_t GetBucketUpperBound(size_t bucket);
+};
+
+/**
+ * Records the time between its construction and its destruction in a histogram.
+ *
+ * @ingroup base
+ */
+class HistogramTimer final
+{
+public:
+	explicit HistogramTimer(Histogram& histogram)
+		: m_Histogram(histogram), m_Start(std::chrono::steady_clock::now())
+	{ }
+
+	HistogramTimer(const HistogramTimer&) = delete;
+	HistogramTimer& operator=(const HistogramTimer&) = delete;
+
+	~HistogramTimer()
+	{
+		m_Histogram.RecordSince(m_Start);
+	}
+
+private:
+	Histogram& m_Histogram;
+	std::chrono::steady_clock::time_point m_Start;
+};
+
+}
+
+#endif /* HISTOGRAM_H */
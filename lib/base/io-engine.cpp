@@ -1,75 +1,60 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
+#include "base/configuration.hpp"
 #include "base/exception.hpp"
 #include "base/io-engine.hpp"
 #include "base/lazy-init.hpp"
 #include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
 #include <exception>
 #include <memory>
 #include <thread>
+#include <boost/asio/async_result.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/spawn.hpp>
 #include <boost/asio/post.hpp>
 #include <boost/date_time/posix_time/ptime.hpp>
 #include <boost/system/error_code.hpp>
 
+#ifdef __linux__
+#	include <pthread.h>
+#	include <sched.h>
+#endif /* __linux__ */
+
 using namespace icinga;
 
-CpuBoundWork::CpuBoundWork(boost::asio::yield_context yc)
-	: m_Done(false)
+CpuBoundWork::CpuBoundWork(boost::asio::yield_context yc, CpuBoundWorkClass workClass)
+	: m_Class(workClass), m_Done(false)
 {
-	auto& ioEngine (IoEngine::Get());
-
-	for (;;) {
-		auto availableSlots (ioEngine.m_CpuBoundSemaphore.fetch_sub(1));
-
-		if (availableSlots < 1) {
-			ioEngine.m_CpuBoundSemaphore.fetch_add(1);
-			ioEngine.m_AlreadyExpiredTimer.async_wait(yc);
-			continue;
-		}
-
-		break;
-	}
+	IoEngine::Get().AcquireCpuBoundSlot(yc, workClass);
 }
 
 CpuBoundWork::~CpuBoundWork()
 {
 	if (!m_Done) {
-		IoEngine::Get().m_CpuBoundSemaphore.fetch_add(1);
+		IoEngine::Get().ReleaseCpuBoundSlot(m_Class);
 	}
 }
 
 void CpuBoundWork::Done()
 {
 	if (!m_Done) {
-		IoEngine::Get().m_CpuBoundSemaphore.fetch_add(1);
+		IoEngine::Get().ReleaseCpuBoundSlot(m_Class);
 
 		m_Done = true;
 	}
 }
 
-IoBoundWorkSlot::IoBoundWorkSlot(boost::asio::yield_context yc)
-	: yc(yc)
+IoBoundWorkSlot::IoBoundWorkSlot(boost::asio::yield_context yc, CpuBoundWorkClass workClass)
+	: yc(yc), m_Class(workClass)
 {
-	IoEngine::Get().m_CpuBoundSemaphore.fetch_add(1);
+	IoEngine::Get().ReleaseCpuBoundSlot(workClass);
 }
 
 IoBoundWorkSlot::~IoBoundWorkSlot()
 {
-	auto& ioEngine (IoEngine::Get());
-
-	for (;;) {
-		auto availableSlots (ioEngine.m_CpuBoundSemaphore.fetch_sub(1));
-
-		if (availableSlots < 1) {
-			ioEngine.m_CpuBoundSemaphore.fetch_add(1);
-			ioEngine.m_AlreadyExpiredTimer.async_wait(yc);
-			continue;
-		}
-
-		break;
-	}
+	IoEngine::Get().AcquireCpuBoundSlot(yc, m_Class);
 }
 
 LazyInit<std::unique_ptr<IoEngine>> IoEngine::m_Instance ([]() { return std::unique_ptr<IoEngine>(new IoEngine()); });
@@ -84,20 +69,84 @@ boost::asio::io_context& IoEngine::GetIoContext()
 	return m_IoContext;
 }
 
-IoEngine::IoEngine() : m_IoContext(), m_KeepAlive(boost::asio::make_work_guard(m_IoContext)), m_Threads(decltype(m_Threads)::size_type(std::thread::hardware_concurrency() * 2u)), m_AlreadyExpiredTimer(m_IoContext)
+/**
+ * Returns the I/O context for a new connection. Everything belonging to the
+ * connection (its stream, strands and timers) should use this one.
+ *
+ * @returns The next shard if IoContextPerThread is enabled, GetIoContext() otherwise
+ */
+boost::asio::io_context& IoEngine::GetConnectionIoContext()
 {
-	m_AlreadyExpiredTimer.expires_at(boost::posix_time::neg_infin);
-	m_CpuBoundSemaphore.store(std::thread::hardware_concurrency() * 3u / 2u);
+	if (m_Shards.empty()) {
+		return m_IoContext;
+	}
 
-	for (auto& thread : m_Threads) {
-		thread = std::thread(&IoEngine::RunEventLoop, this);
+	return *m_Shards[m_NextShard.fetch_add(1) % m_Shards.size()];
+}
+
+/* Pins an I/O thread to a CPU, only supported on Linux. */
+static void SetThreadAffinity(std::thread& thread, unsigned int cpu)
+{
+#ifdef __linux__
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+
+	int rc = pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+
+	if (rc) {
+		Log(LogWarning, "IoEngine")
+			<< "Cannot pin I/O thread to CPU " << cpu << ": " << Utility::FormatErrorNumber(rc);
+	}
+#endif /* __linux__ */
+}
+
+IoEngine::IoEngine() : m_IoContext(), m_KeepAlive(boost::asio::make_work_guard(m_IoContext)), m_Threads(decltype(m_Threads)::size_type(std::thread::hardware_concurrency() * 2u)), m_NextShard(0), m_CpuBoundNext(0)
+{
+	size_t slots = std::max(std::thread::hardware_concurrency() * 3u / 2u, 1u);
+
+	m_CpuBoundFree = slots;
+
+	/* Cluster messages may use all slots, the other classes leave some of them to the cluster. */
+	m_CpuBoundReserved = slots > 1u ? std::max(slots / 4u, (size_t)1u) : 0u;
+
+	m_CpuBoundQueues[(size_t)CpuBoundWorkClass::Cluster].Quota = slots;
+	m_CpuBoundQueues[(size_t)CpuBoundWorkClass::ApiRead].Quota = std::max(slots / 2u, (size_t)1u);
+	m_CpuBoundQueues[(size_t)CpuBoundWorkClass::ApiWrite].Quota = std::max(slots / 2u, (size_t)1u);
+	m_CpuBoundQueues[(size_t)CpuBoundWorkClass::EventStream].Quota = std::max(slots / 4u, (size_t)1u);
+
+	for (auto& queue : m_CpuBoundQueues) {
+		queue.InUse = 0;
+	}
+
+	/* Half of the threads share the main context, e.g. for timers and acceptors.
+	 * Each of the others runs the context of one shard.
+	 */
+	size_t shards = Configuration::IoContextPerThread ? m_Threads.size() / 2u : 0u;
+
+	for (size_t i = 0; i < shards; i++) {
+		m_Shards.emplace_back(new boost::asio::io_context(1));
+		m_ShardKeepAlives.emplace_back(boost::asio::make_work_guard(*m_Shards.back()));
+	}
+
+	for (size_t i = 0; i < m_Threads.size(); i++) {
+		if (i < shards) {
+			m_Threads[i] = std::thread(&IoEngine::RunEventLoop, this, std::ref(*m_Shards[i]));
+
+			if (Configuration::IoThreadAffinity) {
+				SetThreadAffinity(m_Threads[i], i % std::max(std::thread::hardware_concurrency(), 1u));
+			}
+		} else {
+			m_Threads[i] = std::thread(&IoEngine::RunEventLoop, this, std::ref(m_IoContext));
+		}
 	}
 }
 
 IoEngine::~IoEngine()
 {
-	for (auto& thread : m_Threads) {
-		boost::asio::post(m_IoContext, []() {
+	for (size_t i = 0; i < m_Threads.size(); i++) {
+		boost::asio::post(i < m_Shards.size() ? *m_Shards[i] : m_IoContext, []() {
 			throw TerminateIoThread();
 		});
 	}
@@ -107,11 +156,11 @@ IoEngine::~IoEngine()
 	}
 }
 
-void IoEngine::RunEventLoop()
+void IoEngine::RunEventLoop(boost::asio::io_context& io)
 {
 	for (;;) {
 		try {
-			m_IoContext.run();
+			io.run();
 
 			break;
 		} catch (const TerminateIoThread&) {
@@ -123,6 +172,101 @@ void IoEngine::RunEventLoop()
 	}
 }
 
+/**
+ * Whether a slot for the given class of CPU-bound work is available right now.
+ * The caller must hold m_CpuBoundMutex.
+ *
+ * @param workClass The class of the work.
+ * @returns true if the slot may be taken
+ */
+bool IoEngine::CanAcquireCpuBoundSlot(CpuBoundWorkClass workClass) const
+{
+	auto& queue (m_CpuBoundQueues[(size_t)workClass]);
+
+	if (!m_CpuBoundFree || queue.InUse >= queue.Quota) {
+		return false;
+	}
+
+	if (workClass == CpuBoundWorkClass::Cluster) {
+		return true;
+	}
+
+	/* The slots reserved for cluster messages which are not used by them right now */
+	auto& cluster (m_CpuBoundQueues[(size_t)CpuBoundWorkClass::Cluster]);
+	auto reserved (cluster.InUse < m_CpuBoundReserved ? m_CpuBoundReserved - cluster.InUse : 0u);
+
+	return m_CpuBoundFree > reserved;
+}
+
+/**
+ * Takes a slot for CPU-bound work or waits in the queue of its class until
+ * a released slot is handed over. The coroutine doesn't poll meanwhile.
+ *
+ * @param yc The coroutine to suspend.
+ * @param workClass The class of the work.
+ */
+void IoEngine::AcquireCpuBoundSlot(boost::asio::yield_context& yc, CpuBoundWorkClass workClass)
+{
+	auto& queue (m_CpuBoundQueues[(size_t)workClass]);
+
+	/* async_completion moves from the token, yc has to stay usable for the caller. */
+	boost::asio::yield_context token (yc);
+	boost::asio::async_completion<boost::asio::yield_context, void()> completion (token);
+
+	{
+		std::unique_lock<std::mutex> lock (m_CpuBoundMutex);
+
+		if (queue.Waiters.empty() && CanAcquireCpuBoundSlot(workClass)) {
+			m_CpuBoundFree--;
+			queue.InUse++;
+			return;
+		}
+
+		auto handler (std::move(completion.completion_handler));
+
+		queue.Waiters.emplace_back([handler]() { boost::asio::post(handler); });
+	}
+
+	completion.result.get();
+}
+
+/**
+ * Releases a slot for CPU-bound work. If waiting work may take it, the slot
+ * is handed over to the longest waiting one, the classes take turns.
+ *
+ * @param workClass The class of the work.
+ */
+void IoEngine::ReleaseCpuBoundSlot(CpuBoundWorkClass workClass)
+{
+	std::function<void()> wakeUp;
+
+	{
+		std::unique_lock<std::mutex> lock (m_CpuBoundMutex);
+
+		m_CpuBoundQueues[(size_t)workClass].InUse--;
+		m_CpuBoundFree++;
+
+		for (size_t i = 0; i < m_CpuBoundClasses; i++) {
+			auto next ((m_CpuBoundNext + i) % m_CpuBoundClasses);
+			auto& queue (m_CpuBoundQueues[next]);
+
+			if (!queue.Waiters.empty() && CanAcquireCpuBoundSlot((CpuBoundWorkClass)next)) {
+				m_CpuBoundNext = (next + 1u) % m_CpuBoundClasses;
+				m_CpuBoundFree--;
+				queue.InUse++;
+
+				wakeUp = std::move(queue.Waiters.front());
+				queue.Waiters.pop_front();
+				break;
+			}
+		}
+	}
+
+	if (wakeUp) {
+		wakeUp();
+	}
+}
+
 AsioConditionVariable::AsioConditionVariable(boost::asio::io_context& io, bool init)
 	: m_Timer(io)
 {
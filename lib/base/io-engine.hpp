@@ -8,8 +8,12 @@
 #include "base/logger.hpp"
 #include "base/shared-object.hpp"
 #include <atomic>
+#include <cstddef>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -22,6 +26,19 @@
 namespace icinga
 {
 
+/**
+ * Kinds of CPU-bound work done in I/O threads, each one has its own quota of slots
+ *
+ * @ingroup base
+ */
+enum class CpuBoundWorkClass
+{
+	Cluster,
+	ApiRead,
+	ApiWrite,
+	EventStream
+};
+
 /**
  * Scope lock for CPU-bound work done in an I/O thread
  *
@@ -30,7 +47,7 @@ namespace icinga
 class CpuBoundWork
 {
 public:
-	CpuBoundWork(boost::asio::yield_context yc);
+	CpuBoundWork(boost::asio::yield_context yc, CpuBoundWorkClass workClass);
 	CpuBoundWork(const CpuBoundWork&) = delete;
 	CpuBoundWork(CpuBoundWork&&) = delete;
 	CpuBoundWork& operator=(const CpuBoundWork&) = delete;
@@ -40,6 +57,7 @@ public:
 	void Done();
 
 private:
+	CpuBoundWorkClass m_Class;
 	bool m_Done;
 };
 
@@ -51,7 +69,7 @@ private:
 class IoBoundWorkSlot
 {
 public:
-	IoBoundWorkSlot(boost::asio::yield_context yc);
+	IoBoundWorkSlot(boost::asio::yield_context yc, CpuBoundWorkClass workClass);
 	IoBoundWorkSlot(const IoBoundWorkSlot&) = delete;
 	IoBoundWorkSlot(IoBoundWorkSlot&&) = delete;
 	IoBoundWorkSlot& operator=(const IoBoundWorkSlot&) = delete;
@@ -60,6 +78,7 @@ public:
 
 private:
 	boost::asio::yield_context yc;
+	CpuBoundWorkClass m_Class;
 };
 
 /**
@@ -82,6 +101,7 @@ public:
 	static IoEngine& Get();
 
 	boost::asio::io_context& GetIoContext();
+	boost::asio::io_context& GetConnectionIoContext();
 
 	static inline size_t GetCoroutineStackSize() {
 #ifdef _WIN32
@@ -96,8 +116,17 @@ public:
 #endif /* _WIN32 */
 	}
 
+	/* For coroutines which only wait for something and don't parse or build messages, e.g. timeouts. */
+	static inline size_t GetSmallCoroutineStackSize() {
+#ifdef _WIN32
+		return GetCoroutineStackSize();
+#else /* _WIN32 */
+		return 64 * 1024;
+#endif /* _WIN32 */
+	}
+
 	template <typename Handler, typename Function>
-	static void SpawnCoroutine(Handler& h, Function f) {
+	static void SpawnCoroutine(Handler& h, Function f, size_t stackSize = GetCoroutineStackSize()) {
 
 		boost::asio::spawn(h,
 			[f](boost::asio::yield_context yc) {
@@ -115,22 +144,44 @@ public:
 					Log(LogCritical, "IoEngine", "Exception in coroutine!");
 				}
 			},
-			boost::coroutines::attributes(GetCoroutineStackSize()) // Set a pre-defined stack size.
+			boost::coroutines::attributes(stackSize) // Set a pre-defined stack size.
 		);
 	}
 
 private:
 	IoEngine();
 
-	void RunEventLoop();
+	void RunEventLoop(boost::asio::io_context& io);
+
+	void AcquireCpuBoundSlot(boost::asio::yield_context& yc, CpuBoundWorkClass workClass);
+	void ReleaseCpuBoundSlot(CpuBoundWorkClass workClass);
+	bool CanAcquireCpuBoundSlot(CpuBoundWorkClass workClass) const;
 
 	static LazyInit<std::unique_ptr<IoEngine>> m_Instance;
 
 	boost::asio::io_context m_IoContext;
 	boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_KeepAlive;
 	std::vector<std::thread> m_Threads;
-	boost::asio::deadline_timer m_AlreadyExpiredTimer;
-	std::atomic_int_fast32_t m_CpuBoundSemaphore;
+
+	/* With IoContextPerThread each of these is run by only one thread, connections are spread across them. */
+	std::vector<std::unique_ptr<boost::asio::io_context>> m_Shards;
+	std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> m_ShardKeepAlives;
+	std::atomic<size_t> m_NextShard;
+
+	struct CpuBoundQueue
+	{
+		size_t Quota;
+		size_t InUse;
+		std::deque<std::function<void()>> Waiters;
+	};
+
+	static const size_t m_CpuBoundClasses = 4;
+
+	std::mutex m_CpuBoundMutex;
+	size_t m_CpuBoundFree;
+	size_t m_CpuBoundReserved;
+	size_t m_CpuBoundNext;
+	CpuBoundQueue m_CpuBoundQueues[m_CpuBoundClasses];
 };
 
 class TerminateIoThread : public std::exception
@@ -195,7 +246,7 @@ public:
 
 			auto f (onTimeout);
 			f(std::move(yc));
-		});
+		}, IoEngine::GetSmallCoroutineStackSize());
 	}
 
 	void Cancel();
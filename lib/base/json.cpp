@@ -8,40 +8,149 @@
 #include "base/objectlock.hpp"
 #include "base/convert.hpp"
 #include "base/utility.hpp"
+#include <algorithm>
 #include <bitset>
 #include <boost/exception_ptr.hpp>
+#include <clocale>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <json.hpp>
 #include <stack>
+#include <stdexcept>
+#include <string>
+#include <utf8.h>
 #include <utility>
 #include <vector>
 
 using namespace icinga;
 
-class JsonSax : public nlohmann::json_sax<nlohmann::json>
+/* The scanners below look at eight characters at once and only fall back to
+ * single characters around the ones which need attention. This is plain C++,
+ * the compiler is free to vectorize it further.
+ */
+static const uint_fast64_t l_Ones = 0x0101010101010101ull;
+static const uint_fast64_t l_Highs = 0x8080808080808080ull;
+
+static inline uint_fast64_t LoadChunk(const char *data)
+{
+	uint64_t chunk;
+	memcpy(&chunk, data, sizeof(chunk));
+	return chunk;
+}
+
+/* Each of these is non-zero if any byte of the chunk matches. They may report
+ * false positives next to a real match, but never miss one.
+ */
+static inline uint_fast64_t HasByte(uint_fast64_t chunk, unsigned char c)
+{
+	chunk ^= l_Ones * c;
+	return (chunk - l_Ones) & ~chunk & l_Highs;
+}
+
+static inline uint_fast64_t HasLess(uint_fast64_t chunk, unsigned char c)
+{
+	return (chunk - l_Ones * c) & ~chunk & l_Highs;
+}
+
+static inline uint_fast64_t HasMore(uint_fast64_t chunk, unsigned char c)
+{
+	return ((chunk + l_Ones * (127u - c)) | chunk) & l_Highs;
+}
+
+/**
+ * Skips the characters at the start of a string which appear as they are
+ * in a JSON string, i.e. printable ASCII except for quotes and backslashes.
+ */
+static inline const char *SkipPlainAscii(const char *begin, const char *end)
+{
+	while (end - begin >= 8) {
+		auto chunk (LoadChunk(begin));
+
+		if (HasByte(chunk, '"') | HasByte(chunk, '\\') | HasLess(chunk, 0x20) | HasMore(chunk, 0x7e))
+			break;
+
+		begin += 8;
+	}
+
+	for (; begin < end; begin++) {
+		auto c ((unsigned char)*begin);
+
+		if (c < 0x20 || c == '"' || c == '\\' || c >= 0x7f)
+			break;
+	}
+
+	return begin;
+}
+
+/**
+ * Skips the characters at the start of a JSON string literal which can be
+ * copied as they are, i.e. everything but quotes, backslashes and control characters.
+ */
+static inline const char *SkipUnescaped(const char *begin, const char *end)
+{
+	while (end - begin >= 8) {
+		auto chunk (LoadChunk(begin));
+
+		if (HasByte(chunk, '"') | HasByte(chunk, '\\') | HasLess(chunk, 0x20))
+			break;
+
+		begin += 8;
+	}
+
+	for (; begin < end; begin++) {
+		auto c ((unsigned char)*begin);
+
+		if (c < 0x20 || c == '"' || c == '\\')
+			break;
+	}
+
+	return begin;
+}
+
+/**
+ * Builds a Value tree directly from JSON text.
+ *
+ * The parser is iterative, so deeply nested input doesn't exhaust the stack.
+ */
+class JsonDecoder
 {
 public:
-	bool null() override;
-	bool boolean(bool val) override;
-	bool number_integer(number_integer_t val) override;
-	bool number_unsigned(number_unsigned_t val) override;
-	bool number_float(number_float_t val, const string_t& s) override;
-	bool string(string_t& val) override;
-	bool start_object(std::size_t elements) override;
-	bool key(string_t& val) override;
-	bool end_object() override;
-	bool start_array(std::size_t elements) override;
-	bool end_array() override;
-	bool parse_error(std::size_t position, const std::string& last_token, const nlohmann::detail::exception& ex) override;
-
-	Value GetResult();
+	JsonDecoder(const char *begin, const char *end, const LargeStringSink *sink = nullptr);
 
-private:
-	Value m_Root;
-	std::stack<std::pair<Dictionary*, Array*>> m_CurrentSubtree;
-	String m_CurrentKey;
+	Value Parse();
 
+private:
+	/* Containers are only created once all of their items are known,
+	 * so that dictionaries can sort their keys in one go.
+	 */
+	struct Node
+	{
+		bool IsObject;
+		DictionaryData Items;
+		ArrayData Elements;
+		String Key;
+	};
+
+	const char *m_Begin;
+	const char *m_Current;
+	const char *m_End;
+	const LargeStringSink *m_Sink;
+	std::vector<Node> m_CurrentSubtree;
+
+	void SkipWhitespace();
+	void Expect(char c);
+	void ExpectLiteral(const char *literal, size_t length);
+
+	String ParseString();
+	unsigned ParseHex4();
+	double ParseNumber();
+
+	Value FinishContainer();
 	void FillCurrentTarget(Value value);
+	std::vector<String> GetPath() const;
+
+	[[noreturn]] void ThrowError(const char *message) const;
 };
 
 const char l_Null[] = "null";
@@ -49,7 +158,6 @@ const char l_False[] = "false";
 const char l_True[] = "true";
 const char l_Indent[] = "    ";
 
-// https://github.com/nlohmann/json/issues/1512
 template<bool prettyPrint>
 class JsonEncoder
 {
@@ -57,9 +165,9 @@ public:
 	void Null();
 	void Boolean(bool value);
 	void NumberFloat(double value);
-	void Strng(String value);
+	void Strng(const String& value);
 	void StartObject();
-	void Key(String value);
+	void Key(const String& value);
 	void EndObject();
 	void StartArray();
 	void EndArray();
@@ -67,8 +175,8 @@ public:
 	String GetResult();
 
 private:
-	std::vector<char> m_Result;
-	String m_CurrentKey;
+	std::string m_Result;
+	const String *m_CurrentKey{nullptr};
 	std::stack<std::bitset<2>> m_CurrentSubtree;
 
 	void AppendChar(char c);
@@ -76,7 +184,9 @@ private:
 	template<class Iterator>
 	void AppendChars(Iterator begin, Iterator end);
 
-	void AppendJson(nlohmann::json json);
+	void AppendString(const String& value);
+	void AppendEscaped(const char *begin, const char *end);
+	void AppendUnicodeEscape(unsigned codepoint);
 
 	void BeforeItem();
 
@@ -94,7 +204,7 @@ void EncodeNamespace(JsonEncoder<prettyPrint>& stateMachine, const Namespace::Pt
 
 	ObjectLock olock(ns);
 	for (const Namespace::Pair& kv : ns) {
-		stateMachine.Key(Utility::ValidateUTF8(kv.first));
+		stateMachine.Key(kv.first);
 		Encode(stateMachine, kv.second->Get());
 	}
 
@@ -109,7 +219,7 @@ void EncodeDictionary(JsonEncoder<prettyPrint>& stateMachine, const Dictionary::
 
 	ObjectLock olock(dict);
 	for (const Dictionary::Pair& kv : dict) {
-		stateMachine.Key(Utility::ValidateUTF8(kv.first));
+		stateMachine.Key(kv.first);
 		Encode(stateMachine, kv.second);
 	}
 
@@ -143,7 +253,7 @@ void Encode(JsonEncoder<prettyPrint>& stateMachine, const Value& value)
 			break;
 
 		case ValueString:
-			stateMachine.Strng(Utility::ValidateUTF8(value.Get<String>()));
+			stateMachine.Strng(value.Get<String>());
 			break;
 
 		case ValueObject:
@@ -203,140 +313,423 @@ String icinga::JsonEncode(const Value& value, bool pretty_print)
 	}
 }
 
-Value icinga::JsonDecode(const String& data)
+/**
+ * Decodes JSON text.
+ *
+ * @param data The JSON text
+ * @param sink Replaces large strings, e.g. to not keep them in memory
+ * @return The value
+ */
+Value icinga::JsonDecode(const String& data, const LargeStringSink *sink)
 {
-	String sanitized (Utility::ValidateUTF8(data));
-
-	JsonSax stateMachine;
+	if (utf8::find_invalid(data.Begin(), data.End()) != data.End()) {
+		String sanitized (Utility::ValidateUTF8(data));
 
-	nlohmann::json::sax_parse(sanitized.Begin(), sanitized.End(), &stateMachine);
+		return JsonDecoder(sanitized.CStr(), sanitized.CStr() + sanitized.GetLength(), sink).Parse();
+	}
 
-	return stateMachine.GetResult();
+	return JsonDecoder(data.CStr(), data.CStr() + data.GetLength(), sink).Parse();
 }
 
 inline
-bool JsonSax::null()
+JsonDecoder::JsonDecoder(const char *begin, const char *end, const LargeStringSink *sink)
+	: m_Begin(begin), m_Current(begin), m_End(end), m_Sink(sink)
 {
-	FillCurrentTarget(Value());
-
-	return true;
+	/* Skip the UTF-8 byte order mark. */
+	if (end - begin >= 3 && !memcmp(begin, "\xEF\xBB\xBF", 3))
+		m_Current += 3;
 }
 
-inline
-bool JsonSax::boolean(bool val)
+Value JsonDecoder::Parse()
 {
-	FillCurrentTarget(val);
+	for (;;) {
+		Value value;
 
-	return true;
-}
+		SkipWhitespace();
 
-inline
-bool JsonSax::number_integer(JsonSax::number_integer_t val)
-{
-	FillCurrentTarget((double)val);
+		if (m_Current == m_End)
+			ThrowError("Unexpected end of input, expected a value");
+
+		switch (*m_Current) {
+			case '{':
+				m_Current++;
+				m_CurrentSubtree.push_back({true});
 
-	return true;
+				SkipWhitespace();
+
+				if (m_Current < m_End && *m_Current == '}') {
+					m_Current++;
+					value = FinishContainer();
+					break;
+				}
+
+				m_CurrentSubtree.back().Key = ParseString();
+				SkipWhitespace();
+				Expect(':');
+
+				continue;
+			case '[':
+				m_Current++;
+				m_CurrentSubtree.push_back({false});
+
+				SkipWhitespace();
+
+				if (m_Current < m_End && *m_Current == ']') {
+					m_Current++;
+					value = FinishContainer();
+					break;
+				}
+
+				continue;
+			case '"':
+				{
+					String string = ParseString();
+
+					if (m_Sink && string.GetLength() >= m_Sink->MinLength)
+						value = m_Sink->Handler(GetPath(), std::move(string));
+					else
+						value = std::move(string);
+				}
+
+				break;
+			case 't':
+				ExpectLiteral(l_True, 4);
+				value = true;
+				break;
+			case 'f':
+				ExpectLiteral(l_False, 5);
+				value = false;
+				break;
+			case 'n':
+				ExpectLiteral(l_Null, 4);
+				break;
+			default:
+				value = ParseNumber();
+		}
+
+		/* Add the value to its container and close all containers which end here. */
+		for (;;) {
+			if (m_CurrentSubtree.empty()) {
+				SkipWhitespace();
+
+				if (m_Current != m_End)
+					ThrowError("Unexpected data after the value");
+
+				return value;
+			}
+
+			FillCurrentTarget(std::move(value));
+
+			SkipWhitespace();
+
+			if (m_Current == m_End)
+				ThrowError("Unexpected end of input, expected ',' or the end of a container");
+
+			auto& node (m_CurrentSubtree.back());
+			char c = *m_Current++;
+
+			if (c == ',') {
+				if (node.IsObject) {
+					SkipWhitespace();
+					node.Key = ParseString();
+					SkipWhitespace();
+					Expect(':');
+				}
+
+				break;
+			}
+
+			if (c != (node.IsObject ? '}' : ']')) {
+				m_Current--;
+				ThrowError("Expected ',' or the end of a container");
+			}
+
+			value = FinishContainer();
+		}
+	}
 }
 
 inline
-bool JsonSax::number_unsigned(JsonSax::number_unsigned_t val)
+void JsonDecoder::SkipWhitespace()
 {
-	FillCurrentTarget((double)val);
-
-	return true;
+	while (m_Current < m_End && (*m_Current == ' ' || *m_Current == '\n' || *m_Current == '\r' || *m_Current == '\t'))
+		m_Current++;
 }
 
 inline
-bool JsonSax::number_float(JsonSax::number_float_t val, const JsonSax::string_t&)
+void JsonDecoder::Expect(char c)
 {
-	FillCurrentTarget((double)val);
+	if (m_Current == m_End || *m_Current != c) {
+		char message[] = "Expected ' '";
+		message[10] = c;
+		ThrowError(message);
+	}
 
-	return true;
+	m_Current++;
 }
 
 inline
-bool JsonSax::string(JsonSax::string_t& val)
+void JsonDecoder::ExpectLiteral(const char *literal, size_t length)
 {
-	FillCurrentTarget(String(std::move(val)));
+	if ((size_t)(m_End - m_Current) < length || memcmp(m_Current, literal, length))
+		ThrowError("Invalid literal");
 
-	return true;
+	m_Current += length;
 }
 
-inline
-bool JsonSax::start_object(std::size_t)
+String JsonDecoder::ParseString()
 {
-	auto object (new Dictionary());
+	Expect('"');
 
-	FillCurrentTarget(object);
+	auto end (SkipUnescaped(m_Current, m_End));
 
-	m_CurrentSubtree.push({object, nullptr});
+	/* Most strings don't contain any escape sequences. */
+	if (end < m_End && *end == '"') {
+		String result (m_Current, end);
+		m_Current = end + 1;
+		return result;
+	}
 
-	return true;
-}
+	std::string result (m_Current, end);
+	m_Current = end;
 
-inline
-bool JsonSax::key(JsonSax::string_t& val)
-{
-	m_CurrentKey = String(std::move(val));
+	for (;;) {
+		if (m_Current == m_End)
+			ThrowError("Unterminated string");
+
+		char c = *m_Current;
+
+		if (c == '"') {
+			m_Current++;
+			return String(std::move(result));
+		}
+
+		if (c != '\\')
+			ThrowError("Control characters must be escaped in strings");
+
+		if (m_End - m_Current < 2)
+			ThrowError("Unterminated string");
+
+		m_Current += 2;
+
+		switch (m_Current[-1]) {
+			case '"':
+				result += '"';
+				break;
+			case '\\':
+				result += '\\';
+				break;
+			case '/':
+				result += '/';
+				break;
+			case 'b':
+				result += '\b';
+				break;
+			case 'f':
+				result += '\f';
+				break;
+			case 'n':
+				result += '\n';
+				break;
+			case 'r':
+				result += '\r';
+				break;
+			case 't':
+				result += '\t';
+				break;
+			case 'u':
+				{
+					auto codepoint (ParseHex4());
+
+					if (codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+						ThrowError("Unexpected low surrogate");
+
+					if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+						if (m_End - m_Current < 2 || m_Current[0] != '\\' || m_Current[1] != 'u')
+							ThrowError("Expected a low surrogate");
+
+						m_Current += 2;
 
-	return true;
+						auto low (ParseHex4());
+
+						if (low < 0xDC00 || low > 0xDFFF)
+							ThrowError("Expected a low surrogate");
+
+						codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+					}
+
+					utf8::unchecked::append(codepoint, std::back_inserter(result));
+				}
+
+				break;
+			default:
+				m_Current--;
+				ThrowError("Invalid escape sequence");
+		}
+
+		end = SkipUnescaped(m_Current, m_End);
+		result.append(m_Current, end);
+		m_Current = end;
+	}
 }
 
 inline
-bool JsonSax::end_object()
+unsigned JsonDecoder::ParseHex4()
 {
-	m_CurrentSubtree.pop();
-	m_CurrentKey = String();
+	if (m_End - m_Current < 4)
+		ThrowError("Unterminated string");
+
+	unsigned codepoint = 0;
+
+	for (auto end (m_Current + 4); m_Current < end; m_Current++) {
+		char c = *m_Current;
 
-	return true;
+		codepoint <<= 4;
+
+		if (c >= '0' && c <= '9')
+			codepoint |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			codepoint |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			codepoint |= c - 'A' + 10;
+		else
+			ThrowError("Invalid \\u escape sequence");
+	}
+
+	return codepoint;
 }
 
-inline
-bool JsonSax::start_array(std::size_t)
+double JsonDecoder::ParseNumber()
 {
-	auto array (new Array());
+	auto begin (m_Current);
+	bool negative = false;
+
+	if (m_Current < m_End && *m_Current == '-') {
+		negative = true;
+		m_Current++;
+	}
+
+	auto isDigit ([this]() { return m_Current < m_End && *m_Current >= '0' && *m_Current <= '9'; });
+
+	if (!isDigit())
+		ThrowError("Invalid value");
+
+	/* Up to 15 digits fit into a double exactly. */
+	uint_fast64_t integer = 0;
+	auto digitsBegin (m_Current);
+
+	if (*m_Current == '0') {
+		m_Current++;
+	} else {
+		while (isDigit()) {
+			integer = integer * 10u + (*m_Current - '0');
+			m_Current++;
+
+			if (m_Current - digitsBegin > 15)
+				break;
+		}
+
+		while (isDigit())
+			m_Current++;
+	}
+
+	bool simple = m_Current - digitsBegin <= 15;
+
+	if (m_Current < m_End && *m_Current == '.') {
+		simple = false;
+		m_Current++;
+
+		if (!isDigit())
+			ThrowError("Expected digits after the decimal point");
+
+		while (isDigit())
+			m_Current++;
+	}
+
+	if (m_Current < m_End && (*m_Current == 'e' || *m_Current == 'E')) {
+		simple = false;
+		m_Current++;
+
+		if (m_Current < m_End && (*m_Current == '+' || *m_Current == '-'))
+			m_Current++;
+
+		if (!isDigit())
+			ThrowError("Expected digits in the exponent");
+
+		while (isDigit())
+			m_Current++;
+	}
+
+	if (simple)
+		return negative ? -(double)integer : (double)integer;
+
+	/* strtod() uses the decimal point of the current locale. */
+	std::string number (begin, m_Current);
+	char decimalPoint = *localeconv()->decimal_point;
 
-	FillCurrentTarget(array);
+	if (decimalPoint != '.')
+		std::replace(number.begin(), number.end(), '.', decimalPoint);
 
-	m_CurrentSubtree.push({nullptr, array});
+	auto result (strtod(number.c_str(), nullptr));
 
-	return true;
+	if (!std::isfinite(result)) {
+		m_Current = begin;
+		ThrowError("Number out of range");
+	}
+
+	return result;
 }
 
 inline
-bool JsonSax::end_array()
+Value JsonDecoder::FinishContainer()
 {
-	m_CurrentSubtree.pop();
+	auto& node (m_CurrentSubtree.back());
+	Value container;
+
+	if (node.IsObject) {
+		DictionaryData items (std::move(node.Items));
+
+		/* The first item for a key wins when constructing a dictionary, the last one has to win here. */
+		std::reverse(items.begin(), items.end());
+
+		container = new Dictionary(std::move(items));
+	} else {
+		container = new Array(std::move(node.Elements));
+	}
+
+	m_CurrentSubtree.pop_back();
 
-	return true;
+	return container;
 }
 
 inline
-bool JsonSax::parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex)
+void JsonDecoder::FillCurrentTarget(Value value)
 {
-	throw std::invalid_argument(ex.what());
+	auto& node (m_CurrentSubtree.back());
+
+	if (node.IsObject) {
+		node.Items.emplace_back(std::move(node.Key), std::move(value));
+	} else {
+		node.Elements.emplace_back(std::move(value));
+	}
 }
 
-inline
-Value JsonSax::GetResult()
+/**
+ * Returns the keys (or array indexes) leading to the value which is being parsed.
+ */
+std::vector<String> JsonDecoder::GetPath() const
 {
-	return m_Root;
+	std::vector<String> path;
+
+	for (auto& node : m_CurrentSubtree)
+		path.emplace_back(node.IsObject ? node.Key : String(std::to_string(node.Elements.size())));
+
+	return path;
 }
 
-inline
-void JsonSax::FillCurrentTarget(Value value)
+void JsonDecoder::ThrowError(const char *message) const
 {
-	if (m_CurrentSubtree.empty()) {
-		m_Root = value;
-	} else {
-		auto& node (m_CurrentSubtree.top());
-
-		if (node.first) {
-			node.first->Set(m_CurrentKey, value);
-		} else {
-			node.second->Add(value);
-		}
-	}
+	throw std::invalid_argument(String(message) + " at position " + Convert::ToString(m_Current - m_Begin) + " of the JSON input");
 }
 
 template<bool prettyPrint>
@@ -365,15 +758,25 @@ inline
 void JsonEncoder<prettyPrint>::NumberFloat(double value)
 {
 	BeforeItem();
-	AppendJson(value);
+
+	if (!std::isfinite(value)) {
+		AppendChars((const char*)l_Null, (const char*)l_Null + 4);
+		return;
+	}
+
+	/* The shortest representation which reads back as the same double. */
+	char buffer[64];
+	auto end (nlohmann::detail::to_chars(buffer, buffer + sizeof(buffer), value));
+
+	AppendChars((const char*)buffer, (const char*)end);
 }
 
 template<bool prettyPrint>
 inline
-void JsonEncoder<prettyPrint>::Strng(String value)
+void JsonEncoder<prettyPrint>::Strng(const String& value)
 {
 	BeforeItem();
-	AppendJson(std::move(value));
+	AppendString(value);
 }
 
 template<bool prettyPrint>
@@ -388,9 +791,9 @@ void JsonEncoder<prettyPrint>::StartObject()
 
 template<bool prettyPrint>
 inline
-void JsonEncoder<prettyPrint>::Key(String value)
+void JsonEncoder<prettyPrint>::Key(const String& value)
 {
-	m_CurrentKey = std::move(value);
+	m_CurrentKey = &value;
 }
 
 template<bool prettyPrint>
@@ -421,14 +824,14 @@ template<bool prettyPrint>
 inline
 String JsonEncoder<prettyPrint>::GetResult()
 {
-	return String(m_Result.begin(), m_Result.end());
+	return String(std::move(m_Result));
 }
 
 template<bool prettyPrint>
 inline
 void JsonEncoder<prettyPrint>::AppendChar(char c)
 {
-	m_Result.emplace_back(c);
+	m_Result += c;
 }
 
 template<bool prettyPrint>
@@ -436,14 +839,109 @@ template<class Iterator>
 inline
 void JsonEncoder<prettyPrint>::AppendChars(Iterator begin, Iterator end)
 {
-	m_Result.insert(m_Result.end(), begin, end);
+	m_Result.append(begin, end);
 }
 
+/**
+ * Appends a string literal. Invalid UTF-8 is replaced and all non-ASCII
+ * characters are escaped, so the output is plain ASCII.
+ */
 template<bool prettyPrint>
 inline
-void JsonEncoder<prettyPrint>::AppendJson(nlohmann::json json)
+void JsonEncoder<prettyPrint>::AppendString(const String& value)
 {
-	nlohmann::detail::serializer<nlohmann::json>(nlohmann::detail::output_adapter<char>(m_Result), ' ').dump(std::move(json), prettyPrint, true, 0);
+	auto begin (value.CStr());
+	auto end (begin + value.GetLength());
+
+	AppendChar('"');
+
+	auto plain (SkipPlainAscii(begin, end));
+
+	if (plain == end) {
+		AppendChars(begin, end);
+	} else if (utf8::find_invalid(plain, end) == end) {
+		AppendChars(begin, plain);
+		AppendEscaped(plain, end);
+	} else {
+		String sanitized (Utility::ValidateUTF8(value));
+
+		AppendEscaped(sanitized.CStr(), sanitized.CStr() + sanitized.GetLength());
+	}
+
+	AppendChar('"');
+}
+
+/**
+ * Appends the escaped form of valid UTF-8.
+ */
+template<bool prettyPrint>
+inline
+void JsonEncoder<prettyPrint>::AppendEscaped(const char *begin, const char *end)
+{
+	while (begin < end) {
+		auto plain (SkipPlainAscii(begin, end));
+
+		AppendChars(begin, plain);
+		begin = plain;
+
+		if (begin == end)
+			break;
+
+		char escaped;
+
+		switch (*begin) {
+			case '\b':
+				escaped = 'b';
+				break;
+			case '\t':
+				escaped = 't';
+				break;
+			case '\n':
+				escaped = 'n';
+				break;
+			case '\f':
+				escaped = 'f';
+				break;
+			case '\r':
+				escaped = 'r';
+				break;
+			case '"':
+			case '\\':
+				escaped = *begin;
+				break;
+			default:
+				escaped = 0;
+		}
+
+		if (escaped) {
+			AppendChar('\\');
+			AppendChar(escaped);
+			begin++;
+		} else if ((unsigned char)*begin < 0x80) {
+			AppendUnicodeEscape((unsigned char)*begin);
+			begin++;
+		} else {
+			auto codepoint (utf8::unchecked::next(begin));
+
+			if (codepoint > 0xFFFF) {
+				AppendUnicodeEscape(0xD7C0 + (codepoint >> 10));
+				AppendUnicodeEscape(0xDC00 + (codepoint & 0x3FF));
+			} else {
+				AppendUnicodeEscape(codepoint);
+			}
+		}
+	}
+}
+
+template<bool prettyPrint>
+inline
+void JsonEncoder<prettyPrint>::AppendUnicodeEscape(unsigned codepoint)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	char escape[] = { '\\', 'u', hex[(codepoint >> 12) & 0xF], hex[(codepoint >> 8) & 0xF], hex[(codepoint >> 4) & 0xF], hex[codepoint & 0xF] };
+
+	AppendChars((const char*)escape, (const char*)escape + sizeof(escape));
 }
 
 template<bool prettyPrint>
@@ -468,7 +966,7 @@ void JsonEncoder<prettyPrint>::BeforeItem()
 		}
 
 		if (node[1]) {
-			AppendJson(std::move(m_CurrentKey));
+			AppendString(*m_CurrentKey);
 			AppendChar(':');
 
 			if (prettyPrint) {
@@ -4,6 +4,7 @@
 #define JSON_H
 
 #include "base/i2-base.hpp"
+#include "base/largestringsink.hpp"
 
 namespace icinga
 {
@@ -12,7 +13,7 @@ class String;
 class Value;
 
 String JsonEncode(const Value& value, bool pretty_print = false);
-Value JsonDecode(const String& data);
+Value JsonDecode(const String& data, const LargeStringSink *sink = nullptr);
 
 }
 
@@ -0,0 +1,31 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef LARGESTRINGSINK_H
+#define LARGESTRINGSINK_H
+
+#include "base/i2-base.hpp"
+#include "base/value.hpp"
+#include <functional>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * Replaces large strings while decoding, e.g. to keep them on disk instead of in memory.
+ * See JsonDecode() and UnpackObject().
+ *
+ * @ingroup base
+ */
+struct LargeStringSink
+{
+	/* Shorter strings are decoded as usual. */
+	size_t MinLength;
+
+	/* Gets the keys (or array indexes) leading to the string and the string, returns its replacement. */
+	std::function<Value (const std::vector<String>& path, String&& value)> Handler;
+};
+
+}
+
+#endif /* LARGESTRINGSINK_H */
@@ -0,0 +1,215 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/listenerhandover.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+
+#ifndef _WIN32
+#	include <cerrno>
+#	include <cstring>
+#	include <map>
+#	include <mutex>
+#	include <sys/socket.h>
+#	include <sys/types.h>
+#	include <unistd.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+#ifndef _WIN32
+
+/* The umbrella's end [0] and the workers' end [1] of the datagram socket pair, -1 if not started by an umbrella. */
+static int l_ListenerHandoverFDs[2] = { -1, -1 };
+
+/* The umbrella's copies of the published sockets, inherited by a newly started worker. */
+static std::mutex l_ListenerHandoverMutex;
+static std::map<String, int> l_HandedOverListeners;
+
+/**
+ * Creates the socket pair workers publish their listeners over.
+ * Must be called by the umbrella process before it starts the first worker.
+ */
+void ListenerHandover::InitializeUmbrella()
+{
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, l_ListenerHandoverFDs) < 0) {
+		Log(LogWarning, "ListenerHandover")
+			<< "socketpair() failed with error code " << errno << ", \"" << Utility::FormatErrorNumber(errno)
+			<< "\". Listening sockets will be closed during reloads.";
+
+		l_ListenerHandoverFDs[0] = -1;
+		l_ListenerHandoverFDs[1] = -1;
+		return;
+	}
+
+	Utility::SetCloExec(l_ListenerHandoverFDs[0]);
+	Utility::SetCloExec(l_ListenerHandoverFDs[1]);
+	Utility::SetNonBlocking(l_ListenerHandoverFDs[0]);
+}
+
+/**
+ * Closes the umbrella's end of the socket pair. Must be called by a worker right after fork().
+ */
+void ListenerHandover::InitializeWorker()
+{
+	if (l_ListenerHandoverFDs[0] != -1) {
+		(void)close(l_ListenerHandoverFDs[0]);
+		l_ListenerHandoverFDs[0] = -1;
+	}
+}
+
+/**
+ * Stores the sockets published by the current worker (umbrella only).
+ * A socket published again under the same key replaces the previous one.
+ */
+void ListenerHandover::ReceivePublished()
+{
+	if (l_ListenerHandoverFDs[0] == -1)
+		return;
+
+	for (;;) {
+		char key[1024];
+		char cbuf[CMSG_SPACE(sizeof(int))];
+
+		struct iovec io;
+		io.iov_base = key;
+		io.iov_len = sizeof(key);
+
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+
+		msg.msg_iov = &io;
+		msg.msg_iovlen = 1;
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+
+		ssize_t rc = recvmsg(l_ListenerHandoverFDs[0], &msg, MSG_CMSG_CLOEXEC);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return;
+		}
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+		if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+			continue;
+
+		int fd;
+		memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+
+		if (msg.msg_flags & MSG_TRUNC) {
+			(void)close(fd);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock (l_ListenerHandoverMutex);
+		auto held (l_HandedOverListeners.emplace(String(key, key + rc), fd));
+
+		if (!held.second) {
+			(void)close(held.first->second);
+			held.first->second = fd;
+		}
+	}
+}
+
+/**
+ * Closes the held copies of published sockets which haven't been taken.
+ *
+ * The umbrella calls this once a new worker has been started successfully.
+ * That one owns the inherited copies now and publishes the ones it actually
+ * uses again. The worker calls this once it has started its listeners, so
+ * the ones removed from the config get closed with the old worker.
+ */
+void ListenerHandover::CloseHeld()
+{
+	std::unique_lock<std::mutex> lock (l_ListenerHandoverMutex);
+
+	for (auto& listener : l_HandedOverListeners)
+		(void)close(listener.second);
+
+	l_HandedOverListeners.clear();
+}
+
+/**
+ * Like CloseHeld(), but for a child process forked off a worker, e.g. a process spawn helper.
+ * Only the forking thread exists in the child, so the mutex may be locked by one which doesn't.
+ */
+void ListenerHandover::CloseHeldAfterFork()
+{
+	for (auto& listener : l_HandedOverListeners)
+		(void)close(listener.second);
+
+	l_HandedOverListeners.clear();
+
+	if (l_ListenerHandoverFDs[1] != -1) {
+		(void)close(l_ListenerHandoverFDs[1]);
+		l_ListenerHandoverFDs[1] = -1;
+	}
+}
+
+/**
+ * Takes over a listening socket inherited from the previous worker.
+ *
+ * @param key Identifies the listener, e.g. by its configured address
+ * @returns The socket or -1 if there's none for the key
+ */
+int ListenerHandover::Take(const String& key)
+{
+	std::unique_lock<std::mutex> lock (l_ListenerHandoverMutex);
+	auto it (l_HandedOverListeners.find(key));
+
+	if (it == l_HandedOverListeners.end())
+		return -1;
+
+	int fd = it->second;
+
+	l_HandedOverListeners.erase(it);
+	return fd;
+}
+
+/**
+ * Publishes a listening socket to the umbrella, so that the next worker can take it over.
+ *
+ * @param key Identifies the listener, e.g. by its configured address
+ * @param fd The socket, still owned by the caller
+ */
+void ListenerHandover::Publish(const String& key, int fd)
+{
+	if (l_ListenerHandoverFDs[1] == -1)
+		return;
+
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	memset(cbuf, 0, sizeof(cbuf));
+
+	struct iovec io;
+	io.iov_base = const_cast<char*>(key.CStr());
+	io.iov_len = key.GetLength();
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+
+	msg.msg_iov = &io;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	while (sendmsg(l_ListenerHandoverFDs[1], &msg, 0) < 0) {
+		if (errno != EINTR) {
+			Log(LogWarning, "ListenerHandover")
+				<< "Can't hand over listener '" << key << "' to the next worker: sendmsg() failed with error code "
+				<< errno << ", \"" << Utility::FormatErrorNumber(errno) << "\"";
+			return;
+		}
+	}
+}
+
+#endif /* _WIN32 */
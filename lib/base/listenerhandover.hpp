@@ -0,0 +1,43 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef LISTENERHANDOVER_H
+#define LISTENERHANDOVER_H
+
+#include "base/i2-base.hpp"
+#include "base/string.hpp"
+
+namespace icinga
+{
+
+/**
+ * Hands listening sockets over from one seamless worker to the next one on reload.
+ *
+ * Workers publish the sockets they listen on to the umbrella process which keeps
+ * a copy of each. The next worker inherits these copies by fork() and takes them
+ * instead of binding anew. So the sockets never get closed during a reload and
+ * clients connecting meanwhile wait in the backlog instead of being refused.
+ *
+ * @ingroup base
+ */
+class ListenerHandover
+{
+public:
+#ifndef _WIN32
+	static void InitializeUmbrella();
+	static void InitializeWorker();
+
+	static void ReceivePublished();
+	static void CloseHeld();
+	static void CloseHeldAfterFork();
+
+	static int Take(const String& key);
+	static void Publish(const String& key, int fd);
+#endif /* _WIN32 */
+
+private:
+	ListenerHandover();
+};
+
+}
+
+#endif /* LISTENERHANDOVER_H */
@@ -0,0 +1,183 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/lockprofiler.hpp"
+#include "base/array.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+
+using namespace icinga;
+
+/* The call site which acquired a lock last, by the address of the lock. */
+static std::atomic<const void *> l_Holders[4096];
+
+struct LockWaitStats
+{
+	uint_fast64_t Count{0};
+	double Total{0};
+	double Max{0};
+};
+
+/* name, waiting site, holding site */
+typedef std::tuple<String, const void *, const void *> LockWaitKey;
+
+static std::mutex l_WaitsMutex;
+static std::map<LockWaitKey, LockWaitStats> l_Waits;
+static double l_Since = Utility::GetTime();
+
+/* Initialized after the above, so nothing is recorded before they are. */
+std::atomic<bool> LockProfiler::m_Enabled (!Utility::GetFromEnvironment("ICINGA2_LOCK_PROFILER").IsEmpty());
+
+static std::atomic<const void *>& GetHolderSlot(const void *lock)
+{
+	return l_Holders[(reinterpret_cast<uintptr_t>(lock) / sizeof(void *)) % (sizeof(l_Holders) / sizeof(l_Holders[0]))];
+}
+
+void LockProfiler::SetEnabled(bool enabled)
+{
+	if (enabled && !m_Enabled.load())
+		Reset();
+
+	m_Enabled.store(enabled);
+}
+
+/**
+ * Discards the recorded waits.
+ */
+void LockProfiler::Reset()
+{
+	std::unique_lock<std::mutex> lock(l_WaitsMutex);
+
+	l_Waits.clear();
+	l_Since = Utility::GetTime();
+}
+
+/**
+ * Returns the call site which acquired a lock last, i.e. the one holding it if it's locked.
+ *
+ * @param lock The address of the lock.
+ */
+const void *LockProfiler::GetHolder(const void *lock)
+{
+	return GetHolderSlot(lock).load(std::memory_order_relaxed);
+}
+
+/**
+ * Remembers which call site acquired a lock.
+ *
+ * @param lock The address of the lock.
+ * @param site The code address of the call site.
+ */
+void LockProfiler::SetHolder(const void *lock, const void *site)
+{
+	GetHolderSlot(lock).store(site, std::memory_order_relaxed);
+}
+
+/**
+ * Records that a thread had to wait for a lock, call it once the lock has been acquired.
+ *
+ * @param name The name of the lock in the report.
+ * @param site The code address of the call site which waited.
+ * @param holder The code address of the call site which held the lock.
+ * @param start When the thread started to wait.
+ */
+void LockProfiler::RecordWait(const String& name, const void *site, const void *holder,
+	std::chrono::steady_clock::time_point start)
+{
+	double wait = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::unique_lock<std::mutex> lock(l_WaitsMutex);
+	auto& stats (l_Waits[LockWaitKey(name, site, holder)]);
+
+	stats.Count++;
+	stats.Total += wait;
+	stats.Max = std::max(stats.Max, wait);
+}
+
+std::unique_lock<std::mutex> LockProfiler::ProfiledLock(std::mutex& mutex, const char *name)
+{
+	const void *site = I2_RETURN_ADDRESS();
+	std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+
+	if (!lock) {
+		const void *holder = GetHolder(&mutex);
+		auto start (std::chrono::steady_clock::now());
+
+		lock.lock();
+		RecordWait(name, site, holder, start);
+	}
+
+	SetHolder(&mutex, site);
+
+	return lock;
+}
+
+/**
+ * Returns the lock waits with the longest total wait time, by lock and call sites.
+ *
+ * @param limit The maximum number of entries.
+ * @returns The report.
+ */
+Dictionary::Ptr LockProfiler::GetReport(size_t limit)
+{
+	std::map<LockWaitKey, LockWaitStats> waits;
+	double since;
+
+	{
+		std::unique_lock<std::mutex> lock(l_WaitsMutex);
+		waits = l_Waits;
+		since = l_Since;
+	}
+
+	/* Sites are merged by function, resolving symbols is expensive, so cache them. */
+	std::map<const void *, String> symbols;
+	std::map<std::tuple<String, String, String>, LockWaitStats> merged;
+
+	auto resolve ([&symbols](const void *site) -> const String& {
+		auto it (symbols.find(site));
+
+		if (it == symbols.end())
+			it = symbols.emplace(site, Utility::GetCallSiteName(site)).first;
+
+		return it->second;
+	});
+
+	for (auto& kv : waits) {
+		auto& stats (merged[std::make_tuple(std::get<0>(kv.first), resolve(std::get<1>(kv.first)), resolve(std::get<2>(kv.first)))]);
+
+		stats.Count += kv.second.Count;
+		stats.Total += kv.second.Total;
+		stats.Max = std::max(stats.Max, kv.second.Max);
+	}
+
+	std::vector<std::pair<std::tuple<String, String, String>, LockWaitStats>> sorted (merged.begin(), merged.end());
+
+	std::sort(sorted.begin(), sorted.end(), [](const decltype(sorted)::value_type& a, const decltype(sorted)::value_type& b) {
+		return a.second.Total > b.second.Total;
+	});
+
+	if (sorted.size() > limit)
+		sorted.resize(limit);
+
+	ArrayData locks;
+
+	for (auto& entry : sorted) {
+		locks.emplace_back(new Dictionary({
+			{ "lock", std::get<0>(entry.first) },
+			{ "waiter", std::get<1>(entry.first) },
+			{ "holder", std::get<2>(entry.first) },
+			{ "count", entry.second.Count },
+			{ "wait_total", entry.second.Total },
+			{ "wait_avg", entry.second.Total / entry.second.Count },
+			{ "wait_max", entry.second.Max }
+		}));
+	}
+
+	return new Dictionary({
+		{ "enabled", IsEnabled() },
+		{ "since", since },
+		{ "locks", new Array(std::move(locks)) }
+	});
+}
@@ -0,0 +1,82 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef LOCKPROFILER_H
+#define LOCKPROFILER_H
+
+#include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
+#include "base/string.hpp"
+#include <boost/config.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#ifdef _MSC_VER
+#	include <intrin.h>
+#	pragma intrinsic(_ReturnAddress)
+#	define I2_RETURN_ADDRESS() _ReturnAddress()
+#else /* _MSC_VER */
+#	define I2_RETURN_ADDRESS() __builtin_return_address(0)
+#endif /* _MSC_VER */
+
+namespace icinga
+{
+
+/**
+ * Samples contended lock acquisitions: how long a thread waited for a lock,
+ * where it tried to acquire it and where the thread holding it acquired it.
+ *
+ * It's disabled by default and enabled at runtime via /v1/debug/locks or at
+ * startup via the ICINGA2_LOCK_PROFILER environment variable. While disabled,
+ * it costs one relaxed load per acquisition.
+ *
+ * Call sites are code addresses, they're resolved to function names only for
+ * the report. The holder of a lock is looked up in a fixed-size table keyed
+ * by the address of the lock, so it's occasionally wrong.
+ *
+ * @ingroup base
+ */
+class LockProfiler
+{
+public:
+	static bool IsEnabled()
+	{
+		return m_Enabled.load(std::memory_order_relaxed);
+	}
+
+	static void SetEnabled(bool enabled);
+	static void Reset();
+
+	/**
+	 * Locks a mutex and records the wait time if it's contended.
+	 *
+	 * @param mutex The mutex.
+	 * @param name The name of the lock in the report, e.g. "WorkQueue".
+	 * @returns The lock.
+	 */
+	static BOOST_FORCEINLINE std::unique_lock<std::mutex> Lock(std::mutex& mutex, const char *name)
+	{
+		if (!IsEnabled())
+			return std::unique_lock<std::mutex>(mutex);
+
+		return ProfiledLock(mutex, name);
+	}
+
+	static const void *GetHolder(const void *lock);
+	static void SetHolder(const void *lock, const void *site);
+	static void RecordWait(const String& name, const void *site, const void *holder,
+		std::chrono::steady_clock::time_point start);
+
+	static Dictionary::Ptr GetReport(size_t limit);
+
+private:
+	LockProfiler();
+
+	static std::atomic<bool> m_Enabled;
+
+	static BOOST_NOINLINE std::unique_lock<std::mutex> ProfiledLock(std::mutex& mutex, const char *name);
+};
+
+}
+
+#endif /* LOCKPROFILER_H */
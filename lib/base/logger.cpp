@@ -9,7 +9,11 @@
 #include "base/objectlock.hpp"
 #include "base/context.hpp"
 #include "base/scriptglobal.hpp"
+#include <condition_variable>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <thread>
 #include <utility>
 
 using namespace icinga;
@@ -31,6 +35,111 @@ std::mutex Logger::m_Mutex;
 bool Logger::m_ConsoleLogEnabled = true;
 bool Logger::m_TimestampEnabled = true;
 LogSeverity Logger::m_ConsoleLogSeverity = LogInformation;
+std::atomic<int> Logger::m_MinLogSeverity (LogInformation);
+std::atomic<int> Logger::m_MinLoggerSeverity (LogCritical + 1);
+
+/**
+ * Hands log entries over to the loggers in a background thread, so logging
+ * threads neither wait for the loggers' locks nor for formatting and I/O.
+ *
+ * @ingroup base
+ */
+class LogQueue
+{
+public:
+	static LogQueue& Get()
+	{
+		/* Never destroyed, log entries may be written until the very end. */
+		static auto *instance (new LogQueue());
+
+		return *instance;
+	}
+
+	void Push(LogEntry entry)
+	{
+		if (m_IsDispatcher) {
+			/* A logger logs itself, waiting for the queue would deadlock. */
+			Logger::ProcessLogEntries({ std::move(entry) });
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		m_Processed.wait(lock, [this]() { return m_Entries.size() < m_MaxEntries; });
+
+		m_Entries.emplace_back(std::move(entry));
+		m_Pushed++;
+
+		if (!m_Started) {
+			m_Started = true;
+			std::thread(&LogQueue::Run, this).detach();
+		}
+
+		if (m_Entries.size() == 1u)
+			m_Queued.notify_one();
+	}
+
+	/**
+	 * Waits until all log entries queued so far have been processed.
+	 */
+	void Flush()
+	{
+		if (m_IsDispatcher)
+			return;
+
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		auto pushed (m_Pushed);
+
+		m_Processed.wait(lock, [this, pushed]() { return m_Done >= pushed; });
+	}
+
+private:
+	static const size_t m_MaxEntries = 64 * 1024;
+	static thread_local bool m_IsDispatcher;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Queued;
+	std::condition_variable m_Processed;
+	std::vector<LogEntry> m_Entries;
+	uint_fast64_t m_Pushed = 0;
+	uint_fast64_t m_Done = 0;
+	bool m_Started = false;
+
+	LogQueue() = default;
+
+	void Run()
+	{
+		Utility::SetThreadName("Log");
+
+		m_IsDispatcher = true;
+
+		std::vector<LogEntry> entries;
+
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock (m_Mutex);
+
+				m_Done += entries.size();
+				m_Processed.notify_all();
+
+				entries.clear();
+
+				m_Queued.wait(lock, [this]() { return !m_Entries.empty(); });
+
+				std::swap(entries, m_Entries);
+			}
+
+			try {
+				Logger::ProcessLogEntries(entries);
+			} catch (const std::exception&) {
+				/* There's nowhere to log this. */
+			}
+		}
+	}
+};
+
+thread_local bool LogQueue::m_IsDispatcher = false;
 
 INITIALIZE_ONCE([]() {
 	ScriptGlobal::Set("System.LogDebug", LogDebug, true);
@@ -47,8 +156,14 @@ void Logger::Start(bool runtimeCreated)
 {
 	ObjectImpl<Logger>::Start(runtimeCreated);
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
-	m_Loggers.insert(this);
+	m_CachedMinSeverity.store(GetMinSeverity());
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Loggers.insert(this);
+	}
+
+	UpdateMinLogSeverity();
 }
 
 void Logger::Stop(bool runtimeRemoved)
@@ -58,9 +173,98 @@ void Logger::Stop(bool runtimeRemoved)
 		m_Loggers.erase(this);
 	}
 
+	UpdateMinLogSeverity();
+
 	ObjectImpl<Logger>::Stop(runtimeRemoved);
 }
 
+void Logger::NotifySeverity(const Value& cookie)
+{
+	m_CachedMinSeverity.store(GetMinSeverity());
+
+	UpdateMinLogSeverity();
+
+	ObjectImpl<Logger>::NotifySeverity(cookie);
+}
+
+/**
+ * Recalculates the lowest severity which is logged by any logger or the console.
+ */
+void Logger::UpdateMinLogSeverity()
+{
+	int minLoggerSeverity = LogCritical + 1;
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		for (auto& logger : m_Loggers) {
+			int severity = logger->m_CachedMinSeverity.load();
+
+			if (severity < minLoggerSeverity)
+				minLoggerSeverity = severity;
+		}
+	}
+
+	int minLogSeverity = minLoggerSeverity;
+
+	if (m_ConsoleLogEnabled && m_ConsoleLogSeverity < minLogSeverity)
+		minLogSeverity = m_ConsoleLogSeverity;
+
+	m_MinLoggerSeverity.store(minLoggerSeverity);
+	m_MinLogSeverity.store(minLogSeverity);
+}
+
+/**
+ * Queues a log entry for the loggers. Critical entries are processed
+ * before this returns, the application might be about to terminate.
+ *
+ * @param entry The log entry.
+ */
+void Logger::QueueLogEntry(LogEntry entry)
+{
+	bool critical = entry.Severity >= LogCritical;
+
+	LogQueue::Get().Push(std::move(entry));
+
+	if (critical)
+		LogQueue::Get().Flush();
+}
+
+/**
+ * Waits until the loggers have processed all queued log entries.
+ */
+void Logger::FlushLogQueue()
+{
+	LogQueue::Get().Flush();
+}
+
+/**
+ * Passes log entries to the loggers. Every logger is locked once per batch.
+ *
+ * @param entries The log entries.
+ */
+void Logger::ProcessLogEntries(const std::vector<LogEntry>& entries)
+{
+	for (const Logger::Ptr& logger : Logger::GetLoggers()) {
+		ObjectLock llock(logger);
+
+		if (!logger->IsActive())
+			continue;
+
+		auto minSeverity (logger->m_CachedMinSeverity.load());
+
+		for (auto& entry : entries) {
+			if (entry.Severity >= minSeverity)
+				logger->ProcessLogEntry(entry);
+		}
+
+#ifdef I2_DEBUG /* I2_DEBUG */
+		/* Always flush, don't depend on the timer. Enable this for development sprints on Linux/macOS only. Windows crashes. */
+		//logger->Flush();
+#endif /* I2_DEBUG */
+	}
+}
+
 std::set<Logger::Ptr> Logger::GetLoggers()
 {
 	std::unique_lock<std::mutex> lock(m_Mutex);
@@ -135,11 +339,15 @@ LogSeverity Logger::StringToSeverity(const String& severity)
 void Logger::DisableConsoleLog()
 {
 	m_ConsoleLogEnabled = false;
+
+	UpdateMinLogSeverity();
 }
 
 void Logger::EnableConsoleLog()
 {
 	m_ConsoleLogEnabled = true;
+
+	UpdateMinLogSeverity();
 }
 
 bool Logger::IsConsoleLogEnabled()
@@ -150,6 +358,8 @@ bool Logger::IsConsoleLogEnabled()
 void Logger::SetConsoleLogSeverity(LogSeverity logSeverity)
 {
 	m_ConsoleLogSeverity = logSeverity;
+
+	UpdateMinLogSeverity();
 }
 
 LogSeverity Logger::GetConsoleLogSeverity()
@@ -183,14 +393,61 @@ void Logger::ValidateSeverity(const Lazy<String>& lvalue, const ValidationUtils&
 	}
 }
 
+/* Constructing a stream is expensive, every thread keeps its unused ones. Log
+ * objects may be nested (e.g. while formatting a value), so it's a stack. */
+static thread_local std::vector<std::unique_ptr<std::ostringstream>> l_LogBuffers;
+
+/**
+ * Borrows a buffer for a log message from the current thread.
+ *
+ * @param severity The severity of the message.
+ * @returns The buffer or nullptr if the severity isn't logged anywhere.
+ */
+std::ostringstream *Log::AcquireBuffer(LogSeverity severity)
+{
+	if (severity < Logger::GetMinLogSeverity())
+		return nullptr;
+
+	if (l_LogBuffers.empty())
+		return new std::ostringstream();
+
+	auto *buffer (l_LogBuffers.back().release());
+	l_LogBuffers.pop_back();
+
+	return buffer;
+}
+
+/**
+ * Returns a buffer borrowed by AcquireBuffer() to the current thread.
+ *
+ * @param buffer The buffer.
+ */
+void Log::ReleaseBuffer(std::ostringstream *buffer)
+{
+	/* Don't keep large messages' memory or the formatting of previous ones. */
+	if (l_LogBuffers.size() >= 8u || buffer->tellp() > std::streamoff(64 * 1024)) {
+		delete buffer;
+		return;
+	}
+
+	static const std::ostringstream defaultFormat;
+
+	buffer->str(std::string());
+	buffer->clear();
+	buffer->copyfmt(defaultFormat);
+
+	l_LogBuffers.emplace_back(buffer);
+}
+
 Log::Log(LogSeverity severity, String facility, const String& message)
-	: m_Severity(severity), m_Facility(std::move(facility))
+	: m_Severity(severity), m_Facility(std::move(facility)), m_Buffer(AcquireBuffer(severity))
 {
-	m_Buffer << message;
+	if (m_Buffer)
+		*m_Buffer << message;
 }
 
 Log::Log(LogSeverity severity, String facility)
-	: m_Severity(severity), m_Facility(std::move(facility))
+	: m_Severity(severity), m_Facility(std::move(facility)), m_Buffer(AcquireBuffer(severity))
 { }
 
 /**
@@ -198,17 +455,20 @@ Log::Log(LogSeverity severity, String facility)
  */
 Log::~Log()
 {
+	if (!m_Buffer)
+		return;
+
+	auto msg (m_Buffer->str());
+
+	ReleaseBuffer(m_Buffer);
+
 	LogEntry entry;
 	entry.Timestamp = Utility::GetTime();
 	entry.Severity = m_Severity;
 	entry.Facility = m_Facility;
 
-	{
-		auto msg (m_Buffer.str());
-		msg.erase(msg.find_last_not_of("\n") + 1u);
-
-		entry.Message = std::move(msg);
-	}
+	msg.erase(msg.find_last_not_of("\n") + 1u);
+	entry.Message = std::move(msg);
 
 	if (m_Severity >= LogWarning) {
 		ContextTrace context;
@@ -220,21 +480,6 @@ Log::~Log()
 		}
 	}
 
-	for (const Logger::Ptr& logger : Logger::GetLoggers()) {
-		ObjectLock llock(logger);
-
-		if (!logger->IsActive())
-			continue;
-
-		if (entry.Severity >= logger->GetMinSeverity())
-			logger->ProcessLogEntry(entry);
-
-#ifdef I2_DEBUG /* I2_DEBUG */
-		/* Always flush, don't depend on the timer. Enable this for development sprints on Linux/macOS only. Windows crashes. */
-		//logger->Flush();
-#endif /* I2_DEBUG */
-	}
-
 	if (Logger::IsConsoleLogEnabled() && entry.Severity >= Logger::GetConsoleLogSeverity()) {
 		StreamLogger::ProcessLogEntry(std::cout, entry);
 
@@ -242,10 +487,15 @@ Log::~Log()
 		 * then cout will not flush lines automatically. */
 		std::cout << std::flush;
 	}
+
+	if (Logger::IsLogSeverityProcessed(entry.Severity))
+		Logger::QueueLogEntry(std::move(entry));
 }
 
 Log& Log::operator<<(const char *val)
 {
-	m_Buffer << val;
+	if (m_Buffer)
+		*m_Buffer << val;
+
 	return *this;
 }
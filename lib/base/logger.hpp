@@ -5,8 +5,10 @@
 
 #include "base/i2-base.hpp"
 #include "base/logger-ti.hpp"
+#include <atomic>
 #include <set>
 #include <sstream>
+#include <vector>
 
 namespace icinga
 {
@@ -64,6 +66,27 @@ public:
 
 	static std::set<Logger::Ptr> GetLoggers();
 
+	/**
+	 * Returns the lowest severity which is logged anywhere. Log messages
+	 * with a lower one are discarded before they're formatted.
+	 */
+	static inline LogSeverity GetMinLogSeverity()
+	{
+		return static_cast<LogSeverity>(m_MinLogSeverity.load(std::memory_order_relaxed));
+	}
+
+	/**
+	 * Whether any logger object processes log entries with this severity.
+	 */
+	static inline bool IsLogSeverityProcessed(LogSeverity severity)
+	{
+		return severity >= m_MinLoggerSeverity.load(std::memory_order_relaxed);
+	}
+
+	static void QueueLogEntry(LogEntry entry);
+	static void FlushLogQueue();
+	static void ProcessLogEntries(const std::vector<LogEntry>& entries);
+
 	static void DisableConsoleLog();
 	static void EnableConsoleLog();
 	static bool IsConsoleLogEnabled();
@@ -79,6 +102,7 @@ public:
 protected:
 	void Start(bool runtimeCreated) override;
 	void Stop(bool runtimeRemoved) override;
+	void NotifySeverity(const Value& cookie = Empty) override;
 
 private:
 	static std::mutex m_Mutex;
@@ -86,6 +110,12 @@ private:
 	static bool m_ConsoleLogEnabled;
 	static bool m_TimestampEnabled;
 	static LogSeverity m_ConsoleLogSeverity;
+	static std::atomic<int> m_MinLogSeverity;
+	static std::atomic<int> m_MinLoggerSeverity;
+
+	std::atomic<int> m_CachedMinSeverity{LogInformation};
+
+	static void UpdateMinLogSeverity();
 };
 
 class Log
@@ -103,7 +133,9 @@ public:
 	template<typename T>
 	Log& operator<<(const T& val)
 	{
-		m_Buffer << val;
+		if (m_Buffer)
+			*m_Buffer << val;
+
 		return *this;
 	}
 
@@ -112,7 +144,10 @@ public:
 private:
 	LogSeverity m_Severity;
 	String m_Facility;
-	std::ostringstream m_Buffer;
+	std::ostringstream *m_Buffer; /**< Borrowed from the thread's buffers, nullptr if the severity isn't logged anywhere. */
+
+	static std::ostringstream *AcquireBuffer(LogSeverity severity);
+	static void ReleaseBuffer(std::ostringstream *buffer);
 };
 
 extern template Log& Log::operator<<(const Value&);
@@ -0,0 +1,191 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/metric.hpp"
+#include "base/histogram.hpp"
+#include <cctype>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <utility>
+
+using namespace icinga;
+
+template<class T>
+struct MetricRegistry
+{
+	std::mutex Mutex;
+
+	/* Keyed by name and object, so that all metrics of a name are adjacent. */
+	std::map<std::pair<String, String>, std::unique_ptr<T>> Metrics;
+
+	T& GetByName(const String& name, const String& object)
+	{
+		std::unique_lock<std::mutex> lock (Mutex);
+		auto& metric (Metrics[std::make_pair(name, object)]);
+
+		if (!metric)
+			metric.reset(new T());
+
+		return *metric;
+	}
+
+	std::map<std::pair<String, String>, const T*> GetAll()
+	{
+		std::map<std::pair<String, String>, const T*> metrics;
+		std::unique_lock<std::mutex> lock (Mutex);
+
+		for (auto& kv : Metrics)
+			metrics.emplace(kv.first, kv.second.get());
+
+		return metrics;
+	}
+};
+
+static MetricRegistry<MetricCounter>& GetCounterRegistry()
+{
+	static MetricRegistry<MetricCounter> registry;
+	return registry;
+}
+
+static MetricRegistry<MetricGauge>& GetGaugeRegistry()
+{
+	static MetricRegistry<MetricGauge> registry;
+	return registry;
+}
+
+/**
+ * Returns the counter with the given name, it's created on first use.
+ *
+ * The returned reference stays valid, so callers should look it up once.
+ *
+ * @param name The name, e.g. "checks_executed".
+ * @param object The object the counter belongs to, if any.
+ * @returns The counter.
+ */
+MetricCounter& MetricCounter::GetByName(const String& name, const String& object)
+{
+	return GetCounterRegistry().GetByName(name, object);
+}
+
+/**
+ * Returns the gauge with the given name, it's created on first use.
+ *
+ * @see MetricCounter::GetByName()
+ */
+MetricGauge& MetricGauge::GetByName(const String& name, const String& object)
+{
+	return GetGaugeRegistry().GetByName(name, object);
+}
+
+/**
+ * Makes a Prometheus metric name out of ours, e.g. of histograms named after URLs.
+ */
+static String GetPrometheusName(const String& name, const char *suffix = "")
+{
+	String result = "icinga2_" + name + suffix;
+
+	for (char& ch : result) {
+		if (!isalnum(static_cast<unsigned char>(ch)) && ch != '_' && ch != ':')
+			ch = '_';
+	}
+
+	return result;
+}
+
+static void WritePrometheusLabels(std::ostream& out, const String& object, const char *quantile = nullptr)
+{
+	if (object.IsEmpty() && !quantile)
+		return;
+
+	out << '{';
+
+	if (!object.IsEmpty()) {
+		out << "name=\"";
+
+		for (char ch : object) {
+			switch (ch) {
+				case '\\':
+					out << "\\\\";
+					break;
+				case '"':
+					out << "\\\"";
+					break;
+				case '\n':
+					out << "\\n";
+					break;
+				default:
+					out << ch;
+			}
+		}
+
+		out << '"';
+
+		if (quantile)
+			out << ',';
+	}
+
+	if (quantile)
+		out << "quantile=\"" << quantile << '"';
+
+	out << '}';
+}
+
+template<class T>
+static void WritePrometheusMetrics(std::ostream& out, MetricRegistry<T>& registry, const char *type, const char *suffix)
+{
+	String lastName;
+
+	for (auto& kv : registry.GetAll()) {
+		String name = GetPrometheusName(kv.first.first, suffix);
+
+		if (name != lastName) {
+			out << "# TYPE " << name << ' ' << type << '\n';
+			lastName = name;
+		}
+
+		out << name;
+		WritePrometheusLabels(out, kv.first.second);
+		out << ' ' << kv.second->GetValue() << '\n';
+	}
+}
+
+/**
+ * Renders all counters, gauges and histograms in the Prometheus text format (version 0.0.4).
+ *
+ * Histograms become summaries of the same percentiles as in the feature stats,
+ * their buckets are far too many to be exported as such.
+ *
+ * @returns The metrics
+ */
+String icinga::FormatPrometheusMetrics()
+{
+	std::ostringstream out;
+
+	out.precision(15);
+
+	WritePrometheusMetrics(out, GetCounterRegistry(), "counter", "_total");
+	WritePrometheusMetrics(out, GetGaugeRegistry(), "gauge", "");
+
+	static const std::pair<const char *, double> quantiles[] = {
+		{ "0.5", 50 }, { "0.9", 90 }, { "0.99", 99 }, { "0.999", 99.9 }
+	};
+
+	for (auto& kv : Histogram::GetAll()) {
+		String name = GetPrometheusName(kv.first, "_seconds");
+		const Histogram& histogram (*kv.second);
+
+		out << "# TYPE " << name << " summary\n";
+
+		for (auto& quantile : quantiles) {
+			out << name;
+			WritePrometheusLabels(out, String(), quantile.first);
+			out << ' ' << histogram.GetPercentile(quantile.second) << '\n';
+		}
+
+		out << name << "_sum " << histogram.GetSum() << '\n'
+			<< name << "_count " << histogram.GetCount() << '\n';
+	}
+
+	return out.str();
+}
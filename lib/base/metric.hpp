@@ -0,0 +1,91 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef METRIC_H
+#define METRIC_H
+
+#include "base/i2-base.hpp"
+#include "base/string.hpp"
+#include <atomic>
+#include <cstdint>
+
+namespace icinga
+{
+
+/**
+ * A monotonically increasing number, e.g. of executed checks.
+ *
+ * Counters are registered by name (and optionally by the name of the object
+ * they belong to) and live until the process exits. Counting is lock-free and
+ * may happen from any thread, reading them for /v1/metrics doesn't touch any
+ * objects.
+ *
+ * @ingroup base
+ */
+class MetricCounter final
+{
+public:
+	MetricCounter() = default;
+	MetricCounter(const MetricCounter&) = delete;
+	MetricCounter& operator=(const MetricCounter&) = delete;
+
+	static MetricCounter& GetByName(const String& name, const String& object = String());
+
+	void Increment(uint_fast64_t amount = 1)
+	{
+		m_Value.fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	uint_fast64_t GetValue() const
+	{
+		return m_Value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<uint_fast64_t> m_Value{0};
+};
+
+/**
+ * A number which goes up and down, e.g. the length of a queue.
+ *
+ * Gauges are registered like counters, see MetricCounter.
+ *
+ * @ingroup base
+ */
+class MetricGauge final
+{
+public:
+	MetricGauge() = default;
+	MetricGauge(const MetricGauge&) = delete;
+	MetricGauge& operator=(const MetricGauge&) = delete;
+
+	static MetricGauge& GetByName(const String& name, const String& object = String());
+
+	void Set(int_fast64_t value)
+	{
+		m_Value.store(value, std::memory_order_relaxed);
+	}
+
+	void Increment(int_fast64_t amount = 1)
+	{
+		m_Value.fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	void Decrement(int_fast64_t amount = 1)
+	{
+		m_Value.fetch_sub(amount, std::memory_order_relaxed);
+	}
+
+	int_fast64_t GetValue() const
+	{
+		return m_Value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<int_fast64_t> m_Value{0};
+};
+
+String FormatPrometheusMetrics();
+
+}
+
+#endif /* METRIC_H */
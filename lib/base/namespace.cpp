@@ -2,6 +2,7 @@
 
 #include "base/namespace.hpp"
 #include "base/objectlock.hpp"
+#include "base/rcu.hpp"
 #include "base/debug.hpp"
 #include "base/primitivetype.hpp"
 #include "base/debuginfo.hpp"
@@ -18,10 +19,13 @@ Namespace::Namespace(NamespaceBehavior *behavior)
 	: m_Behavior(std::unique_ptr<NamespaceBehavior>(behavior))
 { }
 
-Value Namespace::Get(const String& field) const
+Namespace::~Namespace()
 {
-	ObjectLock olock(this);
+	delete m_Snapshot.load();
+}
 
+Value Namespace::Get(const String& field) const
+{
 	Value value;
 	if (!GetOwnField(field, &value))
 		BOOST_THROW_EXCEPTION(ScriptError("Namespace does not contain field '" + field + "'"));
@@ -30,8 +34,6 @@ Value Namespace::Get(const String& field) const
 
 bool Namespace::Get(const String& field, Value *value) const
 {
-	ObjectLock olock(this);
-
 	auto nsVal = GetAttribute(field);
 
 	if (!nsVal)
@@ -50,8 +52,6 @@ void Namespace::Set(const String& field, const Value& value, bool overrideFrozen
 
 bool Namespace::Contains(const String& field) const
 {
-	ObjectLock olock(this);
-
 	return HasOwnField(field);
 }
 
@@ -73,15 +73,18 @@ void Namespace::RemoveAttribute(const String& field)
 		return;
 
 	m_Data.erase(it);
+
+	InvalidateSnapshot();
 }
 
 NamespaceValue::Ptr Namespace::GetAttribute(const String& key) const
 {
-	ObjectLock olock(this);
+	RcuReadLock rlock;
 
-	auto it = m_Data.find(key);
+	auto snapshot (GetSnapshot());
+	auto it = snapshot->find(key);
 
-	if (it == m_Data.end())
+	if (it == snapshot->end())
 		return nullptr;
 
 	return it->second;
@@ -92,12 +95,50 @@ void Namespace::SetAttribute(const String& key, const NamespaceValue::Ptr& nsVal
 	ObjectLock olock(this);
 
 	m_Data[key] = nsVal;
+
+	InvalidateSnapshot();
 }
 
-Value Namespace::GetFieldByName(const String& field, bool, const DebugInfo& debugInfo) const
+/**
+ * Returns the published copy of the fields, creating it if necessary.
+ *
+ * Note: Caller must be in an RCU read-side critical section while using the copy.
+ *
+ * @returns The fields.
+ */
+const std::map<String, NamespaceValue::Ptr> *Namespace::GetSnapshot() const
 {
-	ObjectLock olock(this);
+	auto snapshot (m_Snapshot.load());
+
+	if (!snapshot) {
+		ObjectLock olock(this);
+
+		snapshot = m_Snapshot.load();
+
+		if (!snapshot) {
+			snapshot = new std::map<String, NamespaceValue::Ptr>(m_Data);
+			m_Snapshot.store(snapshot);
+		}
+	}
+
+	return snapshot;
+}
+
+/**
+ * Drops the published copy of the fields after they've been modified.
+ *
+ * Note: Caller must hold the object lock.
+ */
+void Namespace::InvalidateSnapshot()
+{
+	auto snapshot (m_Snapshot.exchange(nullptr));
 
+	if (snapshot)
+		Rcu::Retire([snapshot]() { delete snapshot; });
+}
+
+Value Namespace::GetFieldByName(const String& field, bool, const DebugInfo& debugInfo) const
+{
 	auto nsVal = GetAttribute(field);
 
 	if (nsVal)
@@ -120,15 +161,11 @@ void Namespace::SetFieldByName(const String& field, const Value& value, bool ove
 
 bool Namespace::HasOwnField(const String& field) const
 {
-	ObjectLock olock(this);
-
 	return GetAttribute(field) != nullptr;
 }
 
 bool Namespace::GetOwnField(const String& field, Value *result) const
 {
-	ObjectLock olock(this);
-
 	auto nsVal = GetAttribute(field);
 
 	if (!nsVal)
@@ -139,17 +176,26 @@ bool Namespace::GetOwnField(const String& field, Value *result) const
 }
 
 EmbeddedNamespaceValue::EmbeddedNamespaceValue(const Value& value)
-	: m_Value(value)
+	: m_Value(new Value(value))
 { }
 
+EmbeddedNamespaceValue::~EmbeddedNamespaceValue()
+{
+	delete m_Value.load();
+}
+
 Value EmbeddedNamespaceValue::Get(const DebugInfo& debugInfo) const
 {
-	return m_Value;
+	RcuReadLock rlock;
+
+	return *m_Value.load();
 }
 
 void EmbeddedNamespaceValue::Set(const Value& value, bool, const DebugInfo&)
 {
-	m_Value = value;
+	auto oldValue (m_Value.exchange(new Value(value)));
+
+	Rcu::Retire([oldValue]() { delete oldValue; });
 }
 
 void ConstEmbeddedNamespaceValue::Set(const Value& value, bool overrideFrozen, const DebugInfo& debugInfo)
@@ -8,6 +8,7 @@
 #include "base/shared-object.hpp"
 #include "base/value.hpp"
 #include "base/debuginfo.hpp"
+#include <atomic>
 #include <map>
 #include <vector>
 #include <memory>
@@ -26,12 +27,14 @@ struct NamespaceValue : public SharedObject
 struct EmbeddedNamespaceValue : public NamespaceValue
 {
 	EmbeddedNamespaceValue(const Value& value);
+	~EmbeddedNamespaceValue() override;
 
 	Value Get(const DebugInfo& debugInfo) const override;
 	void Set(const Value& value, bool overrideFrozen, const DebugInfo& debugInfo) override;
 
 private:
-	Value m_Value;
+	/* Replaced as a whole and retired via RCU, readers don't lock the namespace. */
+	std::atomic<Value *> m_Value;
 };
 
 struct ConstEmbeddedNamespaceValue : public EmbeddedNamespaceValue
@@ -74,6 +77,7 @@ public:
 	typedef std::map<String, NamespaceValue::Ptr>::value_type Pair;
 
 	Namespace(NamespaceBehavior *behavior = new NamespaceBehavior);
+	~Namespace() override;
 
 	Value Get(const String& field) const;
 	bool Get(const String& field, Value *value) const;
@@ -96,8 +100,16 @@ public:
 	static Object::Ptr GetPrototype();
 
 private:
+	/* m_Data is only modified while holding the object lock. Readers look up
+	 * fields in an immutable copy of it which is published via RCU, rebuilt
+	 * on demand and dropped whenever m_Data changes.
+	 */
 	std::map<String, NamespaceValue::Ptr> m_Data;
+	mutable std::atomic<const std::map<String, NamespaceValue::Ptr> *> m_Snapshot{nullptr};
 	std::unique_ptr<NamespaceBehavior> m_Behavior;
+
+	const std::map<String, NamespaceValue::Ptr> *GetSnapshot() const;
+	void InvalidateSnapshot();
 };
 
 Namespace::Iterator begin(const Namespace::Ptr& x);
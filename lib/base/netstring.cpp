@@ -100,6 +100,59 @@ StreamReadStatus NetString::ReadStringFromStream(const Stream::Ptr& stream, Stri
 	return StatusNewItem;
 }
 
+/**
+ * Reads a message in netstring format from memory, e.g. from a mapped file.
+ *
+ * @param data Where to start reading, moved past the message.
+ * @param end The end of the data.
+ * @param message The message, it points into the data.
+ * @returns false if there isn't a complete message left.
+ * @exception invalid_argument The data is invalid.
+ */
+bool NetString::ReadStringFromBuffer(const char *& data, const char *end, boost::string_view& message)
+{
+	const char *current = data;
+	size_t len = 0;
+
+	for (;; current++) {
+		if (current == end)
+			return false;
+
+		if (*current == ':')
+			break;
+
+		if (!isdigit(*current))
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing :)"));
+
+		/* length specifier must have at most 9 characters */
+		if (current - data >= 9)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Length specifier must not exceed 9 characters"));
+
+		/* no leading zeros allowed */
+		if (current != data && *data == '0')
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (leading zero)"));
+
+		len = len * 10 + (*current - '0');
+	}
+
+	/* make sure there's a header */
+	if (current == data)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (no length specifier)"));
+
+	current++;
+
+	if ((size_t)(end - current) < len + 1)
+		return false;
+
+	if (current[len] != ',')
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing ,)"));
+
+	message = boost::string_view(current, len);
+	data = current + len + 1;
+
+	return true;
+}
+
 /**
  * Writes data into a stream using the netstring format and returns bytes written.
  *
@@ -8,6 +8,7 @@
 #include "base/tlsstream.hpp"
 #include <memory>
 #include <boost/asio/spawn.hpp>
+#include <boost/utility/string_view.hpp>
 
 namespace icinga
 {
@@ -33,6 +34,7 @@ public:
 	static size_t WriteStringToStream(const Shared<AsioTlsStream>::Ptr& stream, const String& message);
 	static size_t WriteStringToStream(const Shared<AsioTlsStream>::Ptr& stream, const String& message, boost::asio::yield_context yc);
 	static void WriteStringToStream(std::ostream& stream, const String& message);
+	static bool ReadStringFromBuffer(const char *& data, const char *end, boost::string_view& message);
 
 private:
 	NetString();
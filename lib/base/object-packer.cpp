@@ -3,14 +3,22 @@
 #include "base/object-packer.hpp"
 #include "base/debug.hpp"
 #include "base/dictionary.hpp"
+#include "base/namespace.hpp"
 #include "base/array.hpp"
 #include "base/objectlock.hpp"
 #include "base/stringbuilder.hpp"
+#include "base/exception.hpp"
+#include "base/utility.hpp"
 #include <algorithm>
 #include <climits>
 #include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
 #include <utility>
 #include <vector>
+#include <utf8.h>
 
 using namespace icinga;
 
@@ -30,7 +38,7 @@ static const EndiannessDetector l_EndiannessDetector;
 // Assumption: The compiler will optimize (away) if/else statements using this.
 #define MACHINE_LITTLE_ENDIAN (l_EndiannessDetector.buf[0])
 
-static void PackAny(const Value& value, StringBuilder& builder);
+static void PackAny(const Value& value, StringBuilder& builder, bool message);
 
 /**
  * std::swap() seems not to work
@@ -128,9 +136,19 @@ static inline void PackFloat64BE(double f, StringBuilder& builder)
 
 /**
  * Append the given string's length (BE uint64) and the string itself
+ *
+ * Messages get invalid UTF-8 replaced just like JsonEncode() does.
  */
-static inline void PackString(const String& string, StringBuilder& builder)
+static inline void PackString(const String& string, StringBuilder& builder, bool message)
 {
+	if (message && utf8::find_invalid(string.Begin(), string.End()) != string.End()) {
+		String sanitized (Utility::ValidateUTF8(string));
+
+		PackUInt64BE(sanitized.GetLength(), builder);
+		builder.Append(sanitized);
+		return;
+	}
+
 	PackUInt64BE(string.GetLength(), builder);
 	builder.Append(string);
 }
@@ -138,7 +156,7 @@ static inline void PackString(const String& string, StringBuilder& builder)
 /**
  * Append the given array
  */
-static inline void PackArray(const Array::Ptr& arr, StringBuilder& builder)
+static inline void PackArray(const Array::Ptr& arr, StringBuilder& builder, bool message)
 {
 	ObjectLock olock(arr);
 
@@ -146,14 +164,14 @@ static inline void PackArray(const Array::Ptr& arr, StringBuilder& builder)
 	PackUInt64BE(arr->GetLength(), builder);
 
 	for (const Value& value : arr) {
-		PackAny(value, builder);
+		PackAny(value, builder, message);
 	}
 }
 
 /**
  * Append the given dictionary
  */
-static inline void PackDictionary(const Dictionary::Ptr& dict, StringBuilder& builder)
+static inline void PackDictionary(const Dictionary::Ptr& dict, StringBuilder& builder, bool message)
 {
 	ObjectLock olock(dict);
 
@@ -161,20 +179,38 @@ static inline void PackDictionary(const Dictionary::Ptr& dict, StringBuilder& bu
 	PackUInt64BE(dict->GetLength(), builder);
 
 	for (const Dictionary::Pair& kv : dict) {
-		PackString(kv.first, builder);
-		PackAny(kv.second, builder);
+		PackString(kv.first, builder, message);
+		PackAny(kv.second, builder, message);
+	}
+}
+
+/**
+ * Append the given namespace like a dictionary
+ */
+static inline void PackNamespace(const Namespace::Ptr& ns, StringBuilder& builder)
+{
+	ObjectLock olock(ns);
+
+	builder.Append('\6');
+	PackUInt64BE(std::distance(ns->Begin(), ns->End()), builder);
+
+	for (const Namespace::Pair& kv : ns) {
+		PackString(kv.first, builder, true);
+		PackAny(kv.second->Get(), builder, true);
 	}
 }
 
 /**
  * Append any JSON-encodable value
+ *
+ * @param message Whether to encode the same values as JsonEncode(), see PackMessage()
  */
-static void PackAny(const Value& value, StringBuilder& builder)
+static void PackAny(const Value& value, StringBuilder& builder, bool message)
 {
 	switch (value.GetType()) {
 		case ValueString:
 			builder.Append('\4');
-			PackString(value.Get<String>(), builder);
+			PackString(value.Get<String>(), builder, message);
 			break;
 
 		case ValueNumber:
@@ -194,15 +230,23 @@ static void PackAny(const Value& value, StringBuilder& builder)
 			{
 				const Object::Ptr& obj = value.Get<Object::Ptr>();
 
+				if (message) {
+					Namespace::Ptr ns = dynamic_pointer_cast<Namespace>(obj);
+					if (ns) {
+						PackNamespace(ns, builder);
+						break;
+					}
+				}
+
 				Dictionary::Ptr dict = dynamic_pointer_cast<Dictionary>(obj);
 				if (dict) {
-					PackDictionary(dict, builder);
+					PackDictionary(dict, builder, message);
 					break;
 				}
 
 				Array::Ptr arr = dynamic_pointer_cast<Array>(obj);
 				if (arr) {
-					PackArray(arr, builder);
+					PackArray(arr, builder, message);
 					break;
 				}
 			}
@@ -241,7 +285,209 @@ static void PackAny(const Value& value, StringBuilder& builder)
 String icinga::PackObject(const Value& value)
 {
 	StringBuilder builder;
-	PackAny(value, builder);
+	PackAny(value, builder, false);
+
+	return builder.ToString();
+}
+
+/**
+ * Pack a cluster message like PackObject(), but accept the same values as JsonEncode():
+ * Namespaces are packed as objects and invalid UTF-8 is replaced in all strings.
+ * UnpackObject() of the result yields the same as JsonDecode() of JsonEncode().
+ */
+String icinga::PackMessage(const Value& value)
+{
+	StringBuilder builder;
+	PackAny(value, builder, true);
 
 	return builder.ToString();
 }
+
+/**
+ * Reads from packed data, see UnpackObject()
+ */
+class ObjectUnpacker
+{
+public:
+	ObjectUnpacker(const String& packed, const LargeStringSink *sink)
+		: m_Pos(packed.CStr()), m_End(packed.CStr() + packed.GetLength()), m_Sink(sink)
+	{
+	}
+
+	Value UnpackAny(unsigned int depth = 0)
+	{
+		/* Nesting isn't limited by the packer, but no sane message nests that deep. */
+		if (depth > 128)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is nested too deep"));
+
+		switch (ReadByte()) {
+			case '\0':
+				return Empty;
+
+			case '\1':
+				return false;
+
+			case '\2':
+				return true;
+
+			case '\3':
+				return UnpackFloat64BE();
+
+			case '\4':
+				{
+					String string = UnpackString();
+
+					if (m_Sink && string.GetLength() >= m_Sink->MinLength)
+						return m_Sink->Handler(m_Path, std::move(string));
+
+					return string;
+				}
+
+			case '\5':
+				{
+					uint_least64_t length = UnpackLength(1);
+					ArrayData items;
+					items.reserve(length);
+
+					for (uint_least64_t i = 0; i < length; i++) {
+						if (m_Sink)
+							m_Path.emplace_back(std::to_string(i));
+
+						items.emplace_back(UnpackAny(depth + 1));
+
+						if (m_Sink)
+							m_Path.pop_back();
+					}
+
+					return new Array(std::move(items));
+				}
+
+			case '\6':
+				{
+					uint_least64_t length = UnpackLength(9);
+					DictionaryData items;
+					items.reserve(length);
+
+					for (uint_least64_t i = 0; i < length; i++) {
+						String key = UnpackString();
+
+						if (m_Sink)
+							m_Path.push_back(key);
+
+						Value value = UnpackAny(depth + 1);
+
+						if (m_Sink)
+							m_Path.pop_back();
+
+						items.emplace_back(std::move(key), std::move(value));
+					}
+
+					return new Dictionary(std::move(items));
+				}
+
+			default:
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid type in packed object"));
+		}
+	}
+
+	bool AtEnd() const
+	{
+		return m_Pos == m_End;
+	}
+
+private:
+	const char *m_Pos;
+	const char *m_End;
+	const LargeStringSink *m_Sink;
+
+	/* The keys (or array indexes) leading to the current value, only tracked for the sink. */
+	std::vector<String> m_Path;
+
+	void Need(uint_least64_t bytes)
+	{
+		if (bytes > static_cast<uint_least64_t>(m_End - m_Pos))
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Unexpected end of packed object"));
+	}
+
+	char ReadByte()
+	{
+		Need(1);
+		return *m_Pos++;
+	}
+
+	uint_least64_t UnpackUInt64BE()
+	{
+		Need(8);
+
+		uint_least64_t i = 0;
+
+		for (int j = 0; j < 8; j++)
+			i = (i << 8u) | static_cast<unsigned char>(m_Pos[j]);
+
+		m_Pos += 8;
+		return i;
+	}
+
+	/**
+	 * Reads a length and makes sure that the data can actually contain that many items,
+	 * so that we don't allocate memory for bogus lengths.
+	 */
+	uint_least64_t UnpackLength(uint_least64_t minItemSize)
+	{
+		uint_least64_t length = UnpackUInt64BE();
+
+		if (length > static_cast<uint_least64_t>(m_End - m_Pos) / minItemSize)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Unexpected end of packed object"));
+
+		return length;
+	}
+
+	double UnpackFloat64BE()
+	{
+		Need(8);
+
+		Double2BytesConverter converter;
+		memcpy(converter.buf, m_Pos, 8);
+		m_Pos += 8;
+
+		if (MACHINE_LITTLE_ENDIAN) {
+			SwapBytes(converter.buf[0], converter.buf[7]);
+			SwapBytes(converter.buf[1], converter.buf[6]);
+			SwapBytes(converter.buf[2], converter.buf[5]);
+			SwapBytes(converter.buf[3], converter.buf[4]);
+		}
+
+		return converter.f;
+	}
+
+	String UnpackString()
+	{
+		uint_least64_t length = UnpackLength(1);
+		String string (m_Pos, m_Pos + length);
+
+		m_Pos += length;
+		return string;
+	}
+};
+
+/**
+ * Unpack a value packed by PackObject()
+ *
+ * Dictionaries are restored from their sorted key/value pairs as they are.
+ * Objects which aren't dictionaries or arrays have been packed as null
+ * and are therefore unpacked as null.
+ *
+ * @param packed The packed value
+ * @param sink Replaces large strings, e.g. to not keep them in memory
+ * @returns The value
+ */
+Value icinga::UnpackObject(const String& packed, const LargeStringSink *sink)
+{
+	ObjectUnpacker unpacker (packed, sink);
+	Value value = unpacker.UnpackAny();
+
+	if (!unpacker.AtEnd())
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Trailing data after packed object"));
+
+	return value;
+}
@@ -4,6 +4,7 @@
 #define OBJECT_PACKER
 
 #include "base/i2-base.hpp"
+#include "base/largestringsink.hpp"
 
 namespace icinga
 {
@@ -12,6 +13,8 @@ class String;
 class Value;
 
 String PackObject(const Value& value);
+String PackMessage(const Value& value);
+Value UnpackObject(const String& packed, const LargeStringSink *sink = nullptr);
 
 }
 
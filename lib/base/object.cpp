@@ -2,23 +2,29 @@
 
 #include "base/object.hpp"
 #include "base/value.hpp"
+#include "base/array.hpp"
 #include "base/dictionary.hpp"
 #include "base/primitivetype.hpp"
 #include "base/utility.hpp"
 #include "base/timer.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
+#include "base/objectpool.hpp"
+#include "base/statsfunction.hpp"
 #include <boost/lexical_cast.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <deque>
+#include <map>
+#include <memory>
 #include <thread>
+#include <typeindex>
+#include <unordered_map>
 
 using namespace icinga;
 
 DEFINE_TYPE_INSTANCE(Object);
 
 #ifdef I2_LEAK_DEBUG
-static std::mutex l_ObjectCountLock;
-static std::map<String, int> l_ObjectCounts;
 static Timer::Ptr l_ObjectCountTimer;
 #endif /* I2_LEAK_DEBUG */
 
@@ -28,10 +34,8 @@ static Timer::Ptr l_ObjectCountTimer;
 Object::Object()
 {
 	m_References.store(0);
-
-#ifdef I2_DEBUG
+	m_LockState.store(0);
 	m_LockOwner.store(decltype(m_LockOwner.load())());
-#endif /* I2_DEBUG */
 }
 
 /**
@@ -41,6 +45,32 @@ Object::~Object()
 {
 }
 
+/**
+ * Allocates a new object from the pool of its size class.
+ *
+ * @param size The size of the object.
+ * @returns The memory for the object.
+ */
+void *Object::operator new(size_t size)
+{
+	return ObjectPool::AllocateBySize(size);
+}
+
+void Object::operator delete(void *ptr, size_t size)
+{
+	ObjectPool::ReleaseBySize(ptr, size);
+}
+
+/**
+ * Returns the size of the object, for the memory statistics.
+ *
+ * @returns The size in bytes.
+ */
+size_t Object::GetObjectSize() const
+{
+	return sizeof(Object);
+}
+
 /**
  * Returns a string representation for the object.
  */
@@ -49,7 +79,6 @@ String Object::ToString() const
 	return "Object of type '" + GetReflectionType()->GetName() + "'";
 }
 
-#ifdef I2_DEBUG
 /**
  * Checks if the calling thread owns the lock on this object.
  *
@@ -59,7 +88,6 @@ bool Object::OwnsLock() const
 {
 	return m_LockOwner.load() == std::this_thread::get_id();
 }
-#endif /* I2_DEBUG */
 
 void Object::SetField(int id, const Value&, bool, const Value&)
 {
@@ -200,34 +228,208 @@ Value icinga::GetPrototypeField(const Value& context, const String& field, bool
 		return Empty;
 }
 
-#ifdef I2_LEAK_DEBUG
+/* The live objects of all types, the census. Every thread counts the objects it creates and
+ * destroys on its own, so nobody has to wait for anybody. The counts are summed up on demand.
+ */
+struct ObjectCensusType
+{
+	String Name;
+	size_t Size;
+};
+
+struct ObjectCensusThreadState
+{
+	std::mutex Mutex;
+	std::deque<std::atomic<int_fast64_t> > Counts;
+};
+
+struct ObjectCensusRegistry
+{
+	std::mutex Mutex;
+	std::map<std::type_index, size_t> Ids;
+	std::vector<ObjectCensusType> Types;
+	std::vector<int_fast64_t> ExitedThreadCounts;
+	std::vector<std::shared_ptr<ObjectCensusThreadState> > Threads;
+};
+
+/* Never destroyed, objects are still destroyed while the process shuts down. */
+static ObjectCensusRegistry& GetObjectCensusRegistry()
+{
+	static auto *registry = new ObjectCensusRegistry();
+	return *registry;
+}
+
+/**
+ * Returns the census ID of an object's type, registering the type if necessary.
+ *
+ * The registry mutex has to be held.
+ */
+static size_t GetObjectCensusId(ObjectCensusRegistry& registry, Object *object)
+{
+	std::type_index type (typeid(*object));
+	auto it (registry.Ids.find(type));
+
+	if (it != registry.Ids.end())
+		return it->second;
+
+	size_t id = registry.Types.size();
+
+	registry.Ids.emplace(type, id);
+	registry.Types.push_back({ Utility::GetTypeName(typeid(*object)), object->GetObjectSize() });
+	registry.ExitedThreadCounts.push_back(0);
+
+	return id;
+}
+
+struct ObjectCensusThreadHandle
+{
+	std::shared_ptr<ObjectCensusThreadState> State;
+
+	/* Several type_info instances of the same type may exist, the registry maps them to one ID. */
+	std::unordered_map<const std::type_info *, size_t> Ids;
+
+	ObjectCensusThreadHandle() : State(std::make_shared<ObjectCensusThreadState>())
+	{
+		auto& registry (GetObjectCensusRegistry());
+		std::unique_lock<std::mutex> lock (registry.Mutex);
+
+		registry.Threads.push_back(State);
+	}
+
+	~ObjectCensusThreadHandle();
+};
+
+static thread_local ObjectCensusThreadHandle l_ObjectCensusThread;
+
+/* Other thread-local objects may still hold the last reference to some objects. */
+static thread_local bool l_ObjectCensusThreadExited = false;
+
+ObjectCensusThreadHandle::~ObjectCensusThreadHandle()
+{
+	l_ObjectCensusThreadExited = true;
+
+	auto& registry (GetObjectCensusRegistry());
+	std::unique_lock<std::mutex> lock (registry.Mutex);
+	std::unique_lock<std::mutex> stateLock (State->Mutex);
+
+	for (size_t id = 0; id < State->Counts.size(); id++)
+		registry.ExitedThreadCounts[id] += State->Counts[id].load();
+
+	for (auto it (registry.Threads.begin()); it != registry.Threads.end(); ++it) {
+		if (*it == State) {
+			registry.Threads.erase(it);
+			break;
+		}
+	}
+}
+
+static void CountObject(Object *object, int_fast64_t delta)
+{
+	if (l_ObjectCensusThreadExited) {
+		auto& registry (GetObjectCensusRegistry());
+		std::unique_lock<std::mutex> lock (registry.Mutex);
+
+		registry.ExitedThreadCounts[GetObjectCensusId(registry, object)] += delta;
+		return;
+	}
+
+	auto& thread (l_ObjectCensusThread);
+	auto& type (typeid(*object));
+	auto it (thread.Ids.find(&type));
+	size_t id;
+
+	if (it == thread.Ids.end()) {
+		auto& registry (GetObjectCensusRegistry());
+		std::unique_lock<std::mutex> lock (registry.Mutex);
+
+		id = GetObjectCensusId(registry, object);
+		thread.Ids.emplace(&type, id);
+	} else {
+		id = it->second;
+	}
+
+	auto& counts (thread.State->Counts);
+
+	if (counts.size() <= id) {
+		std::unique_lock<std::mutex> lock (thread.State->Mutex);
+
+		while (counts.size() <= id)
+			counts.emplace_back(0);
+	}
+
+	/* Only this thread writes its counts. */
+	counts[id].store(counts[id].load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
 void icinga::TypeAddObject(Object *object)
 {
-	std::unique_lock<std::mutex> lock(l_ObjectCountLock);
-	String typeName = Utility::GetTypeName(typeid(*object));
-	l_ObjectCounts[typeName]++;
+	CountObject(object, 1);
 }
 
 void icinga::TypeRemoveObject(Object *object)
 {
-	std::unique_lock<std::mutex> lock(l_ObjectCountLock);
-	String typeName = Utility::GetTypeName(typeid(*object));
-	l_ObjectCounts[typeName]--;
+	CountObject(object, -1);
 }
 
-static void TypeInfoTimerHandler()
+/**
+ * Returns the number of live objects per type.
+ *
+ * @returns The type names, their object sizes and their numbers of live objects.
+ */
+static std::vector<std::pair<ObjectCensusType, int_fast64_t> > GetObjectCensus()
 {
-	std::unique_lock<std::mutex> lock(l_ObjectCountLock);
+	auto& registry (GetObjectCensusRegistry());
+	std::unique_lock<std::mutex> lock (registry.Mutex);
 
-	typedef std::map<String, int>::value_type kv_pair;
-	for (kv_pair& kv : l_ObjectCounts) {
-		if (kv.second == 0)
-			continue;
+	std::vector<int_fast64_t> counts (registry.ExitedThreadCounts);
 
-		Log(LogInformation, "TypeInfo")
-			<< kv.second << " " << kv.first << " objects";
+	for (auto& state : registry.Threads) {
+		std::unique_lock<std::mutex> stateLock (state->Mutex);
 
-		kv.second = 0;
+		for (size_t id = 0; id < state->Counts.size(); id++)
+			counts[id] += state->Counts[id].load(std::memory_order_relaxed);
+	}
+
+	std::vector<std::pair<ObjectCensusType, int_fast64_t> > census;
+
+	for (size_t id = 0; id < counts.size(); id++) {
+		if (counts[id] > 0)
+			census.emplace_back(registry.Types[id], counts[id]);
+	}
+
+	return census;
+}
+
+static void ObjectCensusStatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+{
+	int_fast64_t totalObjects = 0, totalBytes = 0;
+	DictionaryData types;
+
+	for (auto& type : GetObjectCensus()) {
+		int_fast64_t bytes = type.second * type.first.Size;
+
+		types.emplace_back(type.first.Name, new Dictionary({
+			{ "count", type.second },
+			{ "bytes", bytes }
+		}));
+
+		totalObjects += type.second;
+		totalBytes += bytes;
+	}
+
+	status->Set("objects", totalObjects);
+	status->Set("bytes", totalBytes);
+	status->Set("types", new Dictionary(std::move(types)));
+}
+
+REGISTER_STATSFUNCTION(Memory, &ObjectCensusStatsFunc);
+
+#ifdef I2_LEAK_DEBUG
+static void TypeInfoTimerHandler()
+{
+	for (auto& type : GetObjectCensus()) {
+		Log(LogInformation, "TypeInfo")
+			<< type.second << " " << type.first.Name << " objects";
 	}
 }
 
@@ -241,12 +443,8 @@ INITIALIZE_ONCE([]() {
 
 void icinga::intrusive_ptr_add_ref(Object *object)
 {
-#ifdef I2_LEAK_DEBUG
 	if (object->m_References.fetch_add(1) == 0u)
 		TypeAddObject(object);
-#else /* I2_LEAK_DEBUG */
-	object->m_References.fetch_add(1);
-#endif /* I2_LEAK_DEBUG */
 }
 
 void icinga::intrusive_ptr_release(Object *object)
@@ -254,9 +452,7 @@ void icinga::intrusive_ptr_release(Object *object)
 	auto previous (object->m_References.fetch_sub(1));
 
 	if (previous == 1u) {
-#ifdef I2_LEAK_DEBUG
 		TypeRemoveObject(object);
-#endif /* I2_LEAK_DEBUG */
 
 		delete object;
 	}
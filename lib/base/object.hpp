@@ -43,7 +43,11 @@ extern Value Empty;
 
 #define DECLARE_OBJECT(klass) \
 	DECLARE_PTR_TYPEDEFS(klass); \
-	IMPL_TYPE_LOOKUP();
+	IMPL_TYPE_LOOKUP(); \
+	size_t GetObjectSize() const override \
+	{ \
+		return sizeof(klass); \
+	}
 
 #define REQUIRE_NOT_NULL(ptr) RequireNotNullInternal(ptr, #ptr)
 
@@ -161,6 +165,11 @@ public:
 	Object();
 	virtual ~Object();
 
+	static void *operator new(size_t size);
+	static void operator delete(void *ptr, size_t size);
+
+	virtual size_t GetObjectSize() const;
+
 	virtual String ToString() const;
 
 	virtual intrusive_ptr<Type> GetReflectionType() const;
@@ -177,9 +186,7 @@ public:
 	virtual void NotifyField(int id, const Value& cookie = Empty);
 	virtual Object::Ptr NavigateField(int id) const;
 
-#ifdef I2_DEBUG
 	bool OwnsLock() const;
-#endif /* I2_DEBUG */
 
 	static Object::Ptr GetPrototype();
 
@@ -187,17 +194,19 @@ public:
 
 	static intrusive_ptr<Type> TypeInstance;
 
+protected:
+	/* Called by the setters of state attributes, only config objects keep track of them. */
+	void MarkStateDirty()
+	{ }
+
 private:
 	Object(const Object& other) = delete;
 	Object& operator=(const Object& rhs) = delete;
 
 	std::atomic<uint_fast64_t> m_References;
-	mutable std::recursive_mutex m_Mutex;
-
-#ifdef I2_DEBUG
+	mutable std::atomic<uint_fast32_t> m_LockState;
 	mutable std::atomic<std::thread::id> m_LockOwner;
 	mutable size_t m_LockCount = 0;
-#endif /* I2_DEBUG */
 
 	friend struct ObjectLock;
 
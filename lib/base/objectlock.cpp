@@ -1,55 +1,147 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/objectlock.hpp"
+#include "base/lockprofiler.hpp"
+#include "base/type.hpp"
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 using namespace icinga;
 
 #define I2MUTEX_UNLOCKED 0
 #define I2MUTEX_LOCKED 1
+#define I2MUTEX_CONTENDED 2
+
+/* How often to retry before a thread is put to sleep. */
+static const int l_SpinCount = 128;
+
+/* Threads waiting for a contended lock sleep on one of these, objects are
+ * mapped to them by their address.
+ */
+struct ObjectLockParkingSlot
+{
+	std::mutex Mutex;
+	std::condition_variable CV;
+};
+
+static ObjectLockParkingSlot l_ParkingSlots[64];
+
+static ObjectLockParkingSlot& GetParkingSlot(const Object *object)
+{
+	return l_ParkingSlots[(reinterpret_cast<uintptr_t>(object) / sizeof(void *)) % (sizeof(l_ParkingSlots) / sizeof(l_ParkingSlots[0]))];
+}
 
 ObjectLock::~ObjectLock()
 {
 	Unlock();
 }
 
-ObjectLock::ObjectLock(const Object::Ptr& object)
-	: ObjectLock(object.get())
+/* The constructors and Lock() pass their return address to the lock profiler,
+ * so they must not be inlined into their callers.
+ */
+BOOST_NOINLINE ObjectLock::ObjectLock(const Object::Ptr& object)
+	: m_Object(object.get()), m_Locked(false)
 {
+	if (m_Object)
+		Lock(I2_RETURN_ADDRESS());
 }
 
-ObjectLock::ObjectLock(const Object *object)
+BOOST_NOINLINE ObjectLock::ObjectLock(const Object *object)
 	: m_Object(object), m_Locked(false)
 {
 	if (m_Object)
-		Lock();
+		Lock(I2_RETURN_ADDRESS());
 }
 
-void ObjectLock::Lock()
+BOOST_NOINLINE void ObjectLock::Lock()
+{
+	Lock(I2_RETURN_ADDRESS());
+}
+
+/**
+ * Acquires the lock.
+ *
+ * @param site The code address of the caller, for the lock profiler.
+ */
+void ObjectLock::Lock(const void *site)
 {
 	ASSERT(!m_Locked && m_Object);
 
-	m_Object->m_Mutex.lock();
+	auto self (std::this_thread::get_id());
+
+	/* Only the owning thread can find itself in m_LockOwner, re-entering doesn't touch the lock state. */
+	if (m_Object->m_LockOwner.load(std::memory_order_relaxed) == self) {
+		m_Object->m_LockCount++;
+		m_Locked = true;
+		return;
+	}
+
+	bool locked = false;
+	bool profile = LockProfiler::IsEnabled();
+	const void *holder = nullptr;
+	std::chrono::steady_clock::time_point waitStart;
+
+	for (int i = 0; i < l_SpinCount; i++) {
+		uint_fast32_t expected = I2MUTEX_UNLOCKED;
 
+		if (m_Object->m_LockState.load(std::memory_order_relaxed) == I2MUTEX_UNLOCKED &&
+			m_Object->m_LockState.compare_exchange_weak(expected, I2MUTEX_LOCKED, std::memory_order_acquire, std::memory_order_relaxed)) {
+			locked = true;
+			break;
+		}
+
+		if (profile && i == 0) {
+			holder = LockProfiler::GetHolder(m_Object);
+			waitStart = std::chrono::steady_clock::now();
+		}
+	}
+
+	if (!locked) {
+		auto& slot (GetParkingSlot(m_Object));
+		std::unique_lock<std::mutex> lock(slot.Mutex);
+
+		/* The lock is taken over as contended, Unlock() has to wake up the other waiters. */
+		while (m_Object->m_LockState.exchange(I2MUTEX_CONTENDED, std::memory_order_acquire) != I2MUTEX_UNLOCKED)
+			slot.CV.wait(lock);
+	}
+
+	m_Object->m_LockOwner.store(self, std::memory_order_relaxed);
+	m_Object->m_LockCount = 1;
 	m_Locked = true;
 
-#ifdef I2_DEBUG
-	if (++m_Object->m_LockCount == 1u) {
-		m_Object->m_LockOwner.store(std::this_thread::get_id());
+	if (profile) {
+		if (waitStart != std::chrono::steady_clock::time_point()) {
+			/* Objects may be locked before the types have been initialized. */
+			Type::Ptr type = m_Object->GetReflectionType();
+
+			LockProfiler::RecordWait(type ? "ObjectLock " + type->GetName() : "ObjectLock", site, holder, waitStart);
+		}
+
+		LockProfiler::SetHolder(m_Object, site);
 	}
-#endif /* I2_DEBUG */
 }
 
 void ObjectLock::Unlock()
 {
-#ifdef I2_DEBUG
-	if (m_Locked && !--m_Object->m_LockCount) {
-		m_Object->m_LockOwner.store(decltype(m_Object->m_LockOwner.load())());
-	}
-#endif /* I2_DEBUG */
+	if (!m_Locked)
+		return;
+
+	m_Locked = false;
+
+	if (--m_Object->m_LockCount)
+		return;
+
+	m_Object->m_LockOwner.store(decltype(m_Object->m_LockOwner.load())(), std::memory_order_relaxed);
+
+	if (m_Object->m_LockState.exchange(I2MUTEX_UNLOCKED, std::memory_order_release) == I2MUTEX_CONTENDED) {
+		auto& slot (GetParkingSlot(m_Object));
+
+		/* Waiters check the lock state while holding the slot's mutex. */
+		{
+			std::unique_lock<std::mutex> lock(slot.Mutex);
+		}
 
-	if (m_Locked) {
-		m_Object->m_Mutex.unlock();
-		m_Locked = false;
+		slot.CV.notify_all();
 	}
 }
@@ -25,6 +25,8 @@ public:
 private:
 	const Object *m_Object{nullptr};
 	bool m_Locked{false};
+
+	void Lock(const void *site);
 };
 
 }
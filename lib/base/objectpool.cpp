@@ -0,0 +1,278 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/objectpool.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include "base/statsfunction.hpp"
+#include <new>
+#include <utility>
+
+using namespace icinga;
+
+REGISTER_STATSFUNCTION(ObjectPool, &ObjectPool::StatsFunc);
+
+/* How many free blocks a thread keeps per pool, it hands half of them over to the pool once it has more. */
+static const size_t l_ThreadCacheSize = 256;
+
+/* How many free blocks a pool keeps for all threads. */
+static const size_t l_SharedCacheSize = 16384;
+
+/* Objects up to this size share the pools of their size class, larger ones come from the heap. */
+static const size_t l_SizeClassGranularity = 16;
+static const size_t l_SizeClassLimit = 512;
+
+/* Pools are never destroyed, threads may still release objects while the process shuts down. */
+static std::mutex& GetPoolsMutex()
+{
+	static auto *mutex = new std::mutex();
+	return *mutex;
+}
+
+static std::vector<ObjectPool *>& GetPools()
+{
+	static auto *pools = new std::vector<ObjectPool *>();
+	return *pools;
+}
+
+namespace icinga
+{
+
+struct ObjectPoolThreadCache
+{
+	std::vector<std::vector<void *> > Caches;
+
+	~ObjectPoolThreadCache();
+};
+
+}
+
+static thread_local ObjectPoolThreadCache l_ThreadCache;
+
+/* Other thread-local objects may still release pooled objects after l_ThreadCache is gone. */
+static thread_local bool l_ThreadCacheDestroyed = false;
+
+ObjectPoolThreadCache::~ObjectPoolThreadCache()
+{
+	l_ThreadCacheDestroyed = true;
+
+	std::vector<ObjectPool *> pools;
+
+	{
+		std::unique_lock<std::mutex> lock (GetPoolsMutex());
+		pools = GetPools();
+	}
+
+	for (size_t id = 0; id < Caches.size(); id++)
+		pools[id]->Flush(Caches[id], 0);
+}
+
+ObjectPool::ObjectPool(std::string name, size_t size)
+	: m_Name(std::move(name)), m_Size(size)
+{
+	std::unique_lock<std::mutex> lock (GetPoolsMutex());
+	auto& pools (GetPools());
+
+	m_Id = pools.size();
+	pools.push_back(this);
+}
+
+/**
+ * Returns the current thread's free blocks of this pool.
+ *
+ * @returns The free blocks or nullptr if the thread is exiting.
+ */
+std::vector<void *> *ObjectPool::GetThreadCache()
+{
+	if (l_ThreadCacheDestroyed)
+		return nullptr;
+
+	auto& caches (l_ThreadCache.Caches);
+
+	if (caches.size() <= m_Id)
+		caches.resize(m_Id + 1);
+
+	return &caches[m_Id];
+}
+
+/**
+ * Hands the current thread's free blocks over to the pool.
+ *
+ * @param cache The thread's free blocks.
+ * @param keep How many of them the thread keeps.
+ */
+void ObjectPool::Flush(std::vector<void *>& cache, size_t keep)
+{
+	std::vector<void *> excess;
+
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		while (cache.size() > keep) {
+			if (m_Free.size() < l_SharedCacheSize)
+				m_Free.push_back(cache.back());
+			else
+				excess.push_back(cache.back());
+
+			cache.pop_back();
+		}
+	}
+
+	for (auto ptr : excess)
+		::operator delete(ptr);
+}
+
+/**
+ * Allocates a block for a new object, preferably a recycled one.
+ *
+ * @param size The size of the object.
+ * @returns The block.
+ */
+void *ObjectPool::Allocate(size_t size)
+{
+	if (size != m_Size)
+		return ::operator new(size);
+
+	m_Allocations.fetch_add(1, std::memory_order_relaxed);
+	m_InUse.fetch_add(1, std::memory_order_relaxed);
+
+	auto *cache (GetThreadCache());
+
+	if (cache) {
+		if (cache->empty()) {
+			std::unique_lock<std::mutex> lock (m_Mutex);
+
+			while (!m_Free.empty() && cache->size() < l_ThreadCacheSize / 2) {
+				cache->push_back(m_Free.back());
+				m_Free.pop_back();
+			}
+		}
+
+		if (!cache->empty()) {
+			void *ptr = cache->back();
+			cache->pop_back();
+
+			m_Recycled.fetch_add(1, std::memory_order_relaxed);
+
+			return ptr;
+		}
+	}
+
+	return ::operator new(size);
+}
+
+/**
+ * Takes back the block of a destroyed object.
+ *
+ * @param ptr The block.
+ * @param size The size of the object.
+ */
+void ObjectPool::Release(void *ptr, size_t size)
+{
+	if (!ptr)
+		return;
+
+	if (size != m_Size) {
+		::operator delete(ptr);
+		return;
+	}
+
+	m_InUse.fetch_sub(1, std::memory_order_relaxed);
+
+	auto *cache (GetThreadCache());
+
+	if (!cache) {
+		::operator delete(ptr);
+		return;
+	}
+
+	/* Objects are often released by other threads than the ones which allocated them. */
+	if (cache->size() >= l_ThreadCacheSize)
+		Flush(*cache, l_ThreadCacheSize / 2);
+
+	cache->push_back(ptr);
+}
+
+ObjectPool *ObjectPool::GetSizeClassPool(size_t size)
+{
+	static auto *pools (([]() {
+		auto *pools (new std::vector<ObjectPool *>());
+
+		for (size_t size = l_SizeClassGranularity; size <= l_SizeClassLimit; size += l_SizeClassGranularity)
+			pools->push_back(new ObjectPool("size_" + std::to_string(size), size));
+
+		return pools;
+	})());
+
+	if (size == 0 || size > l_SizeClassLimit)
+		return nullptr;
+
+	return (*pools)[(size - 1) / l_SizeClassGranularity];
+}
+
+/**
+ * Allocates a block from the pool of the size class the size belongs to.
+ *
+ * @param size The size of the object.
+ * @returns The block.
+ */
+void *ObjectPool::AllocateBySize(size_t size)
+{
+	auto *pool (GetSizeClassPool(size));
+
+	if (!pool)
+		return ::operator new(size);
+
+	return pool->Allocate(pool->m_Size);
+}
+
+/**
+ * Takes back a block allocated by AllocateBySize().
+ *
+ * @param ptr The block.
+ * @param size The size of the object.
+ */
+void ObjectPool::ReleaseBySize(void *ptr, size_t size)
+{
+	auto *pool (GetSizeClassPool(size));
+
+	if (!pool) {
+		::operator delete(ptr);
+		return;
+	}
+
+	pool->Release(ptr, pool->m_Size);
+}
+
+void ObjectPool::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+{
+	std::vector<ObjectPool *> pools;
+
+	{
+		std::unique_lock<std::mutex> lock (GetPoolsMutex());
+		pools = GetPools();
+	}
+
+	DictionaryData nodes;
+
+	for (auto pool : pools) {
+		/* Most size classes are never used. */
+		if (!pool->m_Allocations.load())
+			continue;
+
+		size_t free;
+
+		{
+			std::unique_lock<std::mutex> lock (pool->m_Mutex);
+			free = pool->m_Free.size();
+		}
+
+		nodes.emplace_back(String(pool->m_Name), new Dictionary({
+			{ "allocations", pool->m_Allocations.load() },
+			{ "recycled", pool->m_Recycled.load() },
+			{ "in_use", pool->m_InUse.load() },
+			{ "shared_free", free }
+		}));
+	}
+
+	status->Set("objectpool", new Dictionary(std::move(nodes)));
+}
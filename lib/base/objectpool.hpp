@@ -0,0 +1,92 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include "base/i2-base.hpp"
+#include "base/object.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace icinga
+{
+
+class Array;
+class Dictionary;
+
+/**
+ * Recycles the memory of short-lived objects of one type, e.g. check results,
+ * or of one size class. Objects use the pool of their size class unless their
+ * class has its own one.
+ *
+ * Every thread keeps a few free blocks for itself, the rest is shared between
+ * all threads. Blocks are only returned to the heap if there are too many.
+ *
+ * @ingroup base
+ */
+class ObjectPool final
+{
+public:
+	ObjectPool(std::string name, size_t size);
+
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+	void *Allocate(size_t size);
+	void Release(void *ptr, size_t size);
+
+	static void *AllocateBySize(size_t size);
+	static void ReleaseBySize(void *ptr, size_t size);
+
+	static void StatsFunc(const intrusive_ptr<Dictionary>& status, const intrusive_ptr<Array>& perfdata);
+
+private:
+	std::string m_Name;
+	size_t m_Size;
+	size_t m_Id;
+
+	std::atomic<uint_fast64_t> m_Allocations{0};
+	std::atomic<uint_fast64_t> m_Recycled{0};
+	std::atomic<int_fast64_t> m_InUse{0};
+
+	std::mutex m_Mutex;
+	std::vector<void *> m_Free;
+
+	std::vector<void *> *GetThreadCache();
+	void Flush(std::vector<void *>& cache, size_t keep);
+
+	static ObjectPool *GetSizeClassPool(size_t size);
+
+	friend struct ObjectPoolThreadCache;
+};
+
+/**
+ * Lets the objects of a class be allocated from their own ObjectPool.
+ * The class has to be final, the pool only hands out blocks of its size.
+ */
+#define DECLARE_OBJECT_POOL() \
+	static void *operator new(size_t size); \
+	static void operator delete(void *ptr, size_t size)
+
+#define IMPLEMENT_OBJECT_POOL(klass) \
+	static ObjectPool& Get ## klass ## Pool() \
+	{ \
+		static auto *pool = new ObjectPool(#klass, sizeof(klass)); \
+		return *pool; \
+	} \
+	void *klass::operator new(size_t size) \
+	{ \
+		return Get ## klass ## Pool().Allocate(size); \
+	} \
+	void klass::operator delete(void *ptr, size_t size) \
+	{ \
+		Get ## klass ## Pool().Release(ptr, size); \
+	}
+
+}
+
+#endif /* OBJECTPOOL_H */
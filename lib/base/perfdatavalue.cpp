@@ -227,48 +227,63 @@ PerfdataValue::PerfdataValue(const String& label, double value, bool counter,
 
 PerfdataValue::Ptr PerfdataValue::Parse(const String& perfdata)
 {
-	size_t eqp = perfdata.FindLastOf('=');
+	/* Only views into perfdata are used while parsing, the label and unit are copied once at the end. */
+	boost::string_view input (perfdata);
 
-	if (eqp == String::NPos)
+	size_t eqp = input.rfind('=');
+
+	if (eqp == boost::string_view::npos)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid performance data value: " + perfdata));
 
-	String label = perfdata.SubStr(0, eqp);
+	boost::string_view label = input.substr(0, eqp);
 
-	if (label.GetLength() > 2 && label[0] == '\'' && label[label.GetLength() - 1] == '\'')
-		label = label.SubStr(1, label.GetLength() - 2);
+	if (label.size() > 2 && label.front() == '\'' && label.back() == '\'')
+		label = label.substr(1, label.size() - 2);
 
-	size_t spq = perfdata.FindFirstOf(' ', eqp);
+	size_t spq = input.find(' ', eqp);
 
-	if (spq == String::NPos)
-		spq = perfdata.GetLength();
+	if (spq == boost::string_view::npos)
+		spq = input.size();
 
-	String valueStr = perfdata.SubStr(eqp + 1, spq - eqp - 1);
+	boost::string_view valueStr = input.substr(eqp + 1, spq - eqp - 1);
 
-	size_t pos = valueStr.FindFirstNotOf("+-0123456789.e");
+	size_t pos = valueStr.find_first_not_of("+-0123456789.e");
 
-	if (pos != String::NPos && valueStr[pos] == ',') {
+	if (pos != boost::string_view::npos && valueStr[pos] == ',') {
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid performance data value: " + perfdata));
 	}
 
-	double value = Convert::ToDouble(valueStr.SubStr(0, pos));
+	double value = Convert::ToDouble(valueStr.substr(0, pos));
+
+	/* value[unit];warn;crit;min;max - missing tokens stay empty, just like empty ones. */
+	boost::string_view tokens[5];
+
+	for (size_t i = 0, begin = 0; i < sizeof(tokens) / sizeof(tokens[0]); i++) {
+		size_t end = valueStr.find(';', begin);
+
+		tokens[i] = valueStr.substr(begin, end == boost::string_view::npos ? end : end - begin);
 
-	std::vector<String> tokens = valueStr.Split(";");
+		if (end == boost::string_view::npos)
+			break;
+
+		begin = end + 1;
+	}
 
 	bool counter = false;
-	String unit;
+	std::string unit;
 	Value warn, crit, min, max;
 
-	if (pos != String::NPos)
-		unit = valueStr.SubStr(pos, tokens[0].GetLength() - pos);
+	if (pos != boost::string_view::npos)
+		unit.assign(valueStr.data() + pos, tokens[0].size() - pos);
 
 	double base;
 
 	{
-		auto uom (l_CsUoMs.find(unit.GetData()));
+		auto uom (l_CsUoMs.find(unit));
 
 		if (uom == l_CsUoMs.end()) {
-			auto ciUnit (unit.ToLower());
-			auto uom (l_CiUoMs.find(ciUnit.GetData()));
+			auto ciUnit (boost::algorithm::to_lower_copy(unit));
+			auto uom (l_CiUoMs.find(ciUnit));
 
 			if (uom == l_CiUoMs.end()) {
 				Log(LogDebug, "PerfdataValue")
@@ -290,10 +305,10 @@ PerfdataValue::Ptr PerfdataValue::Parse(const String& perfdata)
 		counter = true;
 	}
 
-	warn = ParseWarnCritMinMaxToken(tokens, 1, "warning");
-	crit = ParseWarnCritMinMaxToken(tokens, 2, "critical");
-	min = ParseWarnCritMinMaxToken(tokens, 3, "minimum");
-	max = ParseWarnCritMinMaxToken(tokens, 4, "maximum");
+	warn = ParseWarnCritMinMaxToken(tokens[1], "warning");
+	crit = ParseWarnCritMinMaxToken(tokens[2], "critical");
+	min = ParseWarnCritMinMaxToken(tokens[3], "minimum");
+	max = ParseWarnCritMinMaxToken(tokens[4], "maximum");
 
 	value = value * base;
 
@@ -309,7 +324,7 @@ PerfdataValue::Ptr PerfdataValue::Parse(const String& perfdata)
 	if (!max.IsEmpty())
 		max = max * base;
 
-	return new PerfdataValue(label, value, counter, unit, warn, crit, min, max);
+	return new PerfdataValue(String(label.data(), label.data() + label.size()), value, counter, std::move(unit), warn, crit, min, max);
 }
 
 static const std::unordered_map<std::string, const char*> l_FormatUoMs ({
@@ -377,14 +392,14 @@ String PerfdataValue::Format() const
 	return result.str();
 }
 
-Value PerfdataValue::ParseWarnCritMinMaxToken(const std::vector<String>& tokens, std::vector<String>::size_type index, const String& description)
+Value PerfdataValue::ParseWarnCritMinMaxToken(boost::string_view token, const char *description)
 {
-	if (tokens.size() > index && tokens[index] != "U" && tokens[index] != "" && tokens[index].FindFirstNotOf("+-0123456789.e") == String::NPos)
-		return Convert::ToDouble(tokens[index]);
+	if (token != "U" && !token.empty() && token.find_first_not_of("+-0123456789.e") == boost::string_view::npos)
+		return Convert::ToDouble(token);
 	else {
-		if (tokens.size() > index && tokens[index] != "")
+		if (!token.empty())
 			Log(LogDebug, "PerfdataValue")
-				<< "Ignoring unsupported perfdata " << description << " range, value: '" << tokens[index] << "'.";
+				<< "Ignoring unsupported perfdata " << description << " range, value: '" << token << "'.";
 		return Empty;
 	}
 }
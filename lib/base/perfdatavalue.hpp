@@ -5,6 +5,7 @@
 
 #include "base/i2-base.hpp"
 #include "base/perfdatavalue-ti.hpp"
+#include <boost/utility/string_view.hpp>
 
 namespace icinga
 {
@@ -29,8 +30,7 @@ public:
 	String Format() const;
 
 private:
-	static Value ParseWarnCritMinMaxToken(const std::vector<String>& tokens,
-		std::vector<String>::size_type index, const String& description);
+	static Value ParseWarnCritMinMaxToken(boost::string_view token, const char *description);
 };
 
 }
@@ -8,19 +8,27 @@
 #include "base/utility.hpp"
 #include "base/initialize.hpp"
 #include "base/logger.hpp"
+#include "base/listenerhandover.hpp"
 #include "base/utility.hpp"
 #include "base/scriptglobal.hpp"
-#include "base/json.hpp"
+#include "base/configuration.hpp"
 #include <boost/algorithm/string/join.hpp>
 #include <boost/thread/once.hpp>
+#include <algorithm>
+#include <memory>
 #include <thread>
 #include <iostream>
 
 #ifndef _WIN32
 #	include <execvpe.h>
 #	include <poll.h>
+#	include <spawn.h>
 #	include <string.h>
 
+#	ifdef __linux__
+#		include <sys/epoll.h>
+#	endif /* __linux__ */
+
 #	ifndef __APPLE__
 extern char **environ;
 #	else /* __APPLE__ */
@@ -31,19 +39,44 @@ extern char **environ;
 
 using namespace icinga;
 
-#define IOTHREADS 4
-
-static std::mutex l_ProcessMutex[IOTHREADS];
-static std::map<Process::ProcessHandle, Process::Ptr> l_Processes[IOTHREADS];
+/**
+ * The processes handled by one of the ProcessIO threads.
+ */
+struct ProcessIOThread
+{
+	std::mutex Mutex;
+	std::map<Process::ProcessHandle, Process::Ptr> Processes;
 #ifdef _WIN32
-static HANDLE l_Events[IOTHREADS];
+	HANDLE Event;
 #else /* _WIN32 */
-static int l_EventFDs[IOTHREADS][2];
-static std::map<Process::ConsoleHandle, Process::ProcessHandle> l_FDs[IOTHREADS];
+	int EventFDs[2];
+	std::map<Process::ConsoleHandle, Process::ProcessHandle> FDs;
+#	ifdef __linux__
+	/* The processes' output FDs stay registered with the epoll instance while they're running. */
+	int EpollFD{-1};
+	double NextDeadline{-1};
+#	endif /* __linux__ */
+#endif /* _WIN32 */
+};
+
+static std::unique_ptr<ProcessIOThread[]> l_IOThreads;
+static int l_IOThreadCount;
+
+#ifndef _WIN32
+/**
+ * A helper process which forks the children. They're spawned by a process
+ * which is started early on and still small, requests are sent to it via
+ * a UNIX socket.
+ */
+struct SpawnHelper
+{
+	std::mutex Mutex;
+	int FD{-1};
+	pid_t PID{-1};
+};
 
-static std::mutex l_ProcessControlMutex;
-static int l_ProcessControlFD = -1;
-static pid_t l_ProcessControlPID;
+static std::unique_ptr<SpawnHelper[]> l_SpawnHelpers;
+static int l_SpawnHelperCount;
 #endif /* _WIN32 */
 static boost::once_flag l_ProcessOnceFlag = BOOST_ONCE_INIT;
 static boost::once_flag l_SpawnHelperOnceFlag = BOOST_ONCE_INIT;
@@ -56,7 +89,8 @@ Process::Process(Process::Arguments arguments, Dictionary::Ptr extraEnvironment)
 #else /* _WIN32 */
 	, m_SentSigterm(false)
 #endif /* _WIN32 */
-	, m_AdjustPriority(false), m_ResultAvailable(false)
+	, m_AdjustPriority(false), m_MaxOutputSize(std::max(Configuration::ProcessMaxOutputSize, 0)),
+	  m_OutputTruncated(false), m_ResultAvailable(false)
 {
 #ifdef _WIN32
 	m_Overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
@@ -71,77 +105,198 @@ Process::~Process()
 }
 
 #ifndef _WIN32
-static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
+enum SpawnHelperCommand : uint32_t
+{
+	SpawnHelperSpawn = 1,
+	SpawnHelperKill,
+	SpawnHelperWaitPID
+};
+
+/* Requests consist of this header, which carries the FDs for spawn requests,
+ * and Length bytes of payload. The payload is a sequence of int32_t values,
+ * followed by NUL-terminated strings for spawn requests.
+ */
+struct SpawnHelperHeader
+{
+	uint32_t Command;
+	uint32_t Length;
+};
+
+struct SpawnHelperResponse
+{
+	int32_t RC;
+	int32_t Error;
+	int32_t Status;
+};
+
+static void AppendInt(std::string& buffer, int32_t value)
+{
+	buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static bool ReadInt(const char *& position, const char *end, int32_t& value)
+{
+	if (end - position < static_cast<ptrdiff_t>(sizeof(value)))
+		return false;
+
+	memcpy(&value, position, sizeof(value));
+	position += sizeof(value);
+	return true;
+}
+
+static bool ReadString(char *& position, char *end, char *& value)
+{
+	auto terminator (static_cast<char *>(memchr(position, '\0', end - position)));
+
+	if (!terminator)
+		return false;
+
+	value = position;
+	position = terminator + 1;
+	return true;
+}
+
+#ifdef POSIX_SPAWN_SETSID
+/**
+ * Starts a child process with posix_spawn(), which uses vfork() semantics
+ * on Linux and doesn't have to copy the helper's page tables.
+ *
+ * @returns The child's PID or -1 if it has to be spawned with fork().
+ */
+static pid_t ProcessPosixSpawn(int controlFD, char **argv, char **envp, int fds[3])
+{
+	posix_spawn_file_actions_t fileActions;
+	posix_spawnattr_t attr;
+	sigset_t mask;
+	pid_t pid = -1;
+
+	if (posix_spawn_file_actions_init(&fileActions))
+		return -1;
+
+	if (posix_spawnattr_init(&attr)) {
+		posix_spawn_file_actions_destroy(&fileActions);
+		return -1;
+	}
+
+	sigemptyset(&mask);
+
+	if (!posix_spawn_file_actions_addclose(&fileActions, controlFD) &&
+		!posix_spawn_file_actions_adddup2(&fileActions, fds[0], STDIN_FILENO) &&
+		!posix_spawn_file_actions_adddup2(&fileActions, fds[1], STDOUT_FILENO) &&
+		!posix_spawn_file_actions_adddup2(&fileActions, fds[2], STDERR_FILENO) &&
+		!posix_spawn_file_actions_addclose(&fileActions, fds[0]) &&
+		!posix_spawn_file_actions_addclose(&fileActions, fds[1]) &&
+		!posix_spawn_file_actions_addclose(&fileActions, fds[2]) &&
+		!posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK) &&
+		!posix_spawnattr_setsigmask(&attr, &mask)) {
+		/* Errors like ENOENT are reported by the fork() path, it writes them to the plugin output. */
+		if (posix_spawnp(&pid, argv[0], &fileActions, &attr, argv, envp))
+			pid = -1;
+	}
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&fileActions);
+
+	return pid;
+}
+#endif /* POSIX_SPAWN_SETSID */
+
+static SpawnHelperResponse ProcessSpawnImpl(int controlFD, struct msghdr *msgh, char *payload, char *end)
 {
+	SpawnHelperResponse response = { -1, EINVAL, 0 };
 	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msgh);
 
 	if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3)) {
 		std::cerr << "Invalid 'spawn' request: FDs missing" << std::endl;
-		return Empty;
+		return response;
 	}
 
-	auto *fds = (int *)CMSG_DATA(cmsg);
+	int fds[3];
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+	const char *position = payload;
+	int32_t adjustPriority, argc, envc;
+
+	if (!ReadInt(position, end, adjustPriority) || !ReadInt(position, end, argc) || !ReadInt(position, end, envc) || argc < 1 || envc < 0) {
+		std::cerr << "Invalid 'spawn' request: Header truncated" << std::endl;
+		(void)close(fds[0]);
+		(void)close(fds[1]);
+		(void)close(fds[2]);
+		return response;
+	}
 
-	Array::Ptr arguments = request->Get("arguments");
-	Dictionary::Ptr extraEnvironment = request->Get("extraEnvironment");
-	bool adjustPriority = request->Get("adjustPriority");
+	char *strings = payload + (position - payload);
 
 	// build argv
-	auto **argv = new char *[arguments->GetLength() + 1];
+	std::vector<char *> argv;
+	argv.reserve(argc + 1);
 
-	for (unsigned int i = 0; i < arguments->GetLength(); i++) {
-		String arg = arguments->Get(i);
-		argv[i] = strdup(arg.CStr());
-	}
+	for (int32_t i = 0; i < argc; i++) {
+		char *arg;
 
-	argv[arguments->GetLength()] = nullptr;
+		if (!ReadString(strings, end, arg))
+			break;
 
-	// build envp
-	int envc = 0;
+		argv.push_back(arg);
+	}
 
-	/* count existing environment variables */
-	while (environ[envc])
-		envc++;
+	argv.push_back(nullptr);
 
-	auto **envp = new char *[envc + (extraEnvironment ? extraEnvironment->GetLength() : 0) + 2];
+	// build envp
+	static char lcnumericC[] = "LC_NUMERIC=C";
 	const char* lcnumeric = "LC_NUMERIC=";
-	int j = 0;
+	std::vector<char *> envp;
 
-	for (int i = 0; i < envc; i++) {
+	for (int i = 0; environ[i]; i++) {
 		if (strncmp(environ[i], lcnumeric, strlen(lcnumeric)) == 0) {
 			continue;
 		}
 
-		envp[j] = strdup(environ[i]);
-		++j;
+		envp.push_back(environ[i]);
 	}
 
-	if (extraEnvironment) {
-		ObjectLock olock(extraEnvironment);
+	for (int32_t i = 0; i < envc; i++) {
+		char *kv;
 
-		for (const Dictionary::Pair& kv : extraEnvironment) {
-			String skv = kv.first + "=" + Convert::ToString(kv.second);
-			envp[j] = strdup(skv.CStr());
-			j++;
-		}
+		if (!ReadString(strings, end, kv))
+			break;
+
+		envp.push_back(kv);
 	}
 
-	envp[j] = strdup("LC_NUMERIC=C");
-	envp[j + 1] = nullptr;
+	envp.push_back(lcnumericC);
+	envp.push_back(nullptr);
+
+	if (argv.size() != static_cast<size_t>(argc) + 1 || envp.size() < static_cast<size_t>(envc) + 2) {
+		std::cerr << "Invalid 'spawn' request: Strings truncated" << std::endl;
+		(void)close(fds[0]);
+		(void)close(fds[1]);
+		(void)close(fds[2]);
+		return response;
+	}
 
-	extraEnvironment.reset();
+	pid_t pid = -1;
 
-	pid_t pid = fork();
+#ifdef POSIX_SPAWN_SETSID
+	/* posix_spawn() can't adjust the priority. */
+	if (!adjustPriority)
+		pid = ProcessPosixSpawn(controlFD, &argv[0], &envp[0], fds);
+#endif /* POSIX_SPAWN_SETSID */
 
 	int errorCode = 0;
 
-	if (pid < 0)
-		errorCode = errno;
+	/* Falls back to fork() if the priority has to be adjusted, POSIX_SPAWN_SETSID is unavailable or posix_spawnp() failed. */
+	if (pid == -1) {
+		pid = fork();
+
+		if (pid < 0)
+			errorCode = errno;
+	}
 
 	if (pid == 0) {
 		// child process
 
-		(void)close(l_ProcessControlFD);
+		(void)close(controlFD);
 
 		if (setsid() < 0) {
 			perror("setsid() failed");
@@ -169,7 +324,7 @@ static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& reques
 		sigemptyset(&mask);
 		sigprocmask(SIG_SETMASK, &mask, nullptr);
 
-		if (icinga2_execvpe(argv[0], argv, envp) < 0) {
+		if (icinga2_execvpe(argv[0], &argv[0], &envp[0]) < 0) {
 			char errmsg[512];
 			strcpy(errmsg, "execvpe(");
 			strncat(errmsg, argv[0], sizeof(errmsg) - strlen(errmsg) - 1);
@@ -186,74 +341,62 @@ static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& reques
 	(void)close(fds[1]);
 	(void)close(fds[2]);
 
-	// free arguments
-	for (int i = 0; argv[i]; i++)
-		free(argv[i]);
-
-	delete[] argv;
-
-	// free environment
-	for (int i = 0; envp[i]; i++)
-		free(envp[i]);
-
-	delete[] envp;
-
-	Dictionary::Ptr response = new Dictionary({
-		{ "rc", pid },
-		{ "errno", errorCode }
-	});
+	response.RC = pid;
+	response.Error = errorCode;
 
 	return response;
 }
 
-static Value ProcessKillImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
+static SpawnHelperResponse ProcessKillImpl(const char *payload, const char *end)
 {
-	pid_t pid = request->Get("pid");
-	int signum = request->Get("signum");
+	SpawnHelperResponse response = { -1, EINVAL, 0 };
+	int32_t pid, signum;
 
-	errno = 0;
-	kill(pid, signum);
-	int error = errno;
+	if (!ReadInt(payload, end, pid) || !ReadInt(payload, end, signum))
+		return response;
 
-	Dictionary::Ptr response = new Dictionary({
-		{ "errno", error }
-	});
+	errno = 0;
+	response.RC = kill(pid, signum);
+	response.Error = errno;
 
 	return response;
 }
 
-static Value ProcessWaitPIDImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
+static SpawnHelperResponse ProcessWaitPIDImpl(const char *payload, const char *end)
 {
-	pid_t pid = request->Get("pid");
+	SpawnHelperResponse response = { -1, EINVAL, 0 };
+	int32_t pid;
 
-	int status;
-	int rc = waitpid(pid, &status, 0);
+	if (!ReadInt(payload, end, pid))
+		return response;
 
-	Dictionary::Ptr response = new Dictionary({
-		{ "status", status },
-		{ "rc", rc }
-	});
+	int status = 0;
+	response.RC = waitpid(pid, &status, 0);
+	response.Error = errno;
+	response.Status = status;
 
 	return response;
 }
 
-static void ProcessHandler()
+static void ProcessHandler(int controlFD)
 {
 	sigset_t mask;
 	sigfillset(&mask);
 	sigprocmask(SIG_SETMASK, &mask, nullptr);
 
-	Utility::CloseAllFDs({0, 1, 2, l_ProcessControlFD});
+	Utility::CloseAllFDs({0, 1, 2, controlFD});
+
+	std::vector<char> payload;
 
 	for (;;) {
-		size_t length;
+		SpawnHelperHeader header;
 
 		struct msghdr msg;
 		memset(&msg, 0, sizeof(msg));
 
 		struct iovec io;
-		io.iov_base = &length;
-		io.iov_len = sizeof(length);
+		io.iov_base = &header;
+		io.iov_len = sizeof(header);
 
 		msg.msg_iov = &io;
 		msg.msg_iovlen = 1;
@@ -262,7 +405,7 @@ static void ProcessHandler()
 		msg.msg_control = cbuf;
 		msg.msg_controllen = sizeof(cbuf);
 
-		int rc = recvmsg(l_ProcessControlFD, &msg, 0);
+		int rc = recvmsg(controlFD, &msg, MSG_WAITALL);
 
 		if (rc <= 0) {
 			if (rc < 0 && (errno == EINTR || errno == EAGAIN))
@@ -271,49 +414,43 @@ static void ProcessHandler()
 			break;
 		}
 
-		auto *mbuf = new char[length];
+		if (rc != sizeof(header))
+			break;
+
+		payload.resize(header.Length + 1);
 
 		size_t count = 0;
-		while (count < length) {
-			rc = recv(l_ProcessControlFD, mbuf + count, length - count, 0);
+		while (count < header.Length) {
+			rc = recv(controlFD, &payload[count], header.Length - count, 0);
 
 			if (rc <= 0) {
 				if (rc < 0 && (errno == EINTR || errno == EAGAIN))
 					continue;
 
-				delete [] mbuf;
-
 				_exit(0);
 			}
 
 			count += rc;
-
-			if (rc == 0)
-				break;
 		}
 
-		String jrequest = String(mbuf, mbuf + count);
-
-		delete [] mbuf;
-
-		Dictionary::Ptr request = JsonDecode(jrequest);
+		char *begin = &payload[0];
+		char *end = begin + header.Length;
 
-		String command = request->Get("command");
+		SpawnHelperResponse response = { -1, EINVAL, 0 };
 
-		Value response;
-
-		if (command == "spawn")
-			response = ProcessSpawnImpl(&msg, request);
-		else if (command == "waitpid")
-			response = ProcessWaitPIDImpl(&msg, request);
-		else if (command == "kill")
-			response = ProcessKillImpl(&msg, request);
-		else
-			response = Empty;
-
-		String jresponse = JsonEncode(response);
+		switch (header.Command) {
+			case SpawnHelperSpawn:
+				response = ProcessSpawnImpl(controlFD, &msg, begin, end);
+				break;
+			case SpawnHelperKill:
+				response = ProcessKillImpl(begin, end);
+				break;
+			case SpawnHelperWaitPID:
+				response = ProcessWaitPIDImpl(begin, end);
+				break;
+		}
 
-		if (send(l_ProcessControlFD, jresponse.CStr(), jresponse.GetLength(), 0) < 0) {
+		if (send(controlFD, &response, sizeof(response), 0) < 0) {
 			BOOST_THROW_EXCEPTION(posix_error()
 				<< boost::errinfo_api_function("send")
 				<< boost::errinfo_errno(errno));
@@ -323,13 +460,13 @@ static void ProcessHandler()
 	_exit(0);
 }
 
-static void StartSpawnProcessHelper()
+static void StartSpawnProcessHelper(SpawnHelper& helper)
 {
-	if (l_ProcessControlFD != -1) {
-		(void)close(l_ProcessControlFD);
+	if (helper.FD != -1) {
+		(void)close(helper.FD);
 
 		int status;
-		(void)waitpid(l_ProcessControlPID, &status, 0);
+		(void)waitpid(helper.PID, &status, 0);
 	}
 
 	int controlFDs[2];
@@ -350,188 +487,239 @@ static void StartSpawnProcessHelper()
 	if (pid == 0) {
 		(void)close(controlFDs[1]);
 
-		l_ProcessControlFD = controlFDs[0];
+		/* Don't keep listeners alive which the worker closes. */
+		ListenerHandover::CloseHeldAfterFork();
 
-		ProcessHandler();
+		ProcessHandler(controlFDs[0]);
 
 		_exit(1);
 	}
 
 	(void)close(controlFDs[0]);
 
-	l_ProcessControlFD = controlFDs[1];
-	l_ProcessControlPID = pid;
+	helper.FD = controlFDs[1];
+	helper.PID = pid;
 }
 
-static pid_t ProcessSpawn(const std::vector<String>& arguments, const Dictionary::Ptr& extraEnvironment, bool adjustPriority, int fds[3])
+/**
+ * Sends a request to one of the spawn helpers and waits for its response.
+ *
+ * @param helperIndex The helper which spawned the process the request is about.
+ * @param command The request type.
+ * @param payload The request's payload.
+ * @param fds The FDs for the child's stdin, stdout and stderr (spawn requests only).
+ * @param response The helper's response.
+ * @returns Whether the helper responded.
+ */
+static bool ProcessSpawnHelperRequest(int helperIndex, SpawnHelperCommand command, const std::string& payload, const int *fds, SpawnHelperResponse& response)
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "spawn" },
-		{ "arguments", Array::FromVector(arguments) },
-		{ "extraEnvironment", extraEnvironment },
-		{ "adjustPriority", adjustPriority }
-	});
+	auto& helper (l_SpawnHelpers[helperIndex]);
+	SpawnHelperHeader header = { command, static_cast<uint32_t>(payload.size()) };
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
-
-	std::unique_lock<std::mutex> lock(l_ProcessControlMutex);
+	std::unique_lock<std::mutex> lock(helper.Mutex);
 
 	struct msghdr msg;
 	memset(&msg, 0, sizeof(msg));
 
 	struct iovec io;
-	io.iov_base = &length;
-	io.iov_len = sizeof(length);
+	io.iov_base = &header;
+	io.iov_len = sizeof(header);
 
 	msg.msg_iov = &io;
 	msg.msg_iovlen = 1;
 
 	char cbuf[CMSG_SPACE(sizeof(int) * 3)];
-	msg.msg_control = cbuf;
-	msg.msg_controllen = sizeof(cbuf);
 
-	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-	cmsg->cmsg_level = SOL_SOCKET;
-	cmsg->cmsg_type = SCM_RIGHTS;
-	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+	if (fds) {
+		msg.msg_control = cbuf;
+		msg.msg_controllen = sizeof(cbuf);
+
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
 
-	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 3);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 3);
 
-	msg.msg_controllen = cmsg->cmsg_len;
+		msg.msg_controllen = cmsg->cmsg_len;
+	}
 
 	do {
-		while (sendmsg(l_ProcessControlFD, &msg, 0) < 0) {
-			StartSpawnProcessHelper();
+		while (sendmsg(helper.FD, &msg, 0) < 0) {
+			StartSpawnProcessHelper(helper);
 		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
+	} while (send(helper.FD, payload.c_str(), payload.size(), 0) < 0);
 
-	char buf[4096];
+	size_t count = 0;
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+	while (count < sizeof(response)) {
+		ssize_t rc = recv(helper.FD, reinterpret_cast<char *>(&response) + count, sizeof(response) - count, 0);
 
-	if (rc <= 0)
-		return -1;
-
-	String jresponse = String(buf, buf + rc);
+		if (rc <= 0) {
+			if (rc < 0 && errno == EINTR)
+				continue;
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
+			return false;
+		}
 
-	if (response->Get("rc") == -1)
-		errno = response->Get("errno");
+		count += rc;
+	}
 
-	return response->Get("rc");
+	return true;
 }
 
-static int ProcessKill(pid_t pid, int signum)
+static pid_t ProcessSpawn(int helperIndex, const std::vector<String>& arguments, const Dictionary::Ptr& extraEnvironment, bool adjustPriority, int fds[3])
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "kill" },
-		{ "pid", pid },
-		{ "signum", signum }
-	});
+	std::string payload;
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+	AppendInt(payload, adjustPriority);
+	AppendInt(payload, arguments.size());
+	AppendInt(payload, extraEnvironment ? extraEnvironment->GetLength() : 0);
 
-	std::unique_lock<std::mutex> lock(l_ProcessControlMutex);
+	for (const String& argument : arguments) {
+		payload.append(argument.CStr(), argument.GetLength() + 1);
+	}
 
-	do {
-		while (send(l_ProcessControlFD, &length, sizeof(length), 0) < 0) {
-			StartSpawnProcessHelper();
-		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
+	if (extraEnvironment) {
+		ObjectLock olock(extraEnvironment);
 
-	char buf[4096];
+		for (const Dictionary::Pair& kv : extraEnvironment) {
+			String skv = kv.first + "=" + Convert::ToString(kv.second);
+			payload.append(skv.CStr(), skv.GetLength() + 1);
+		}
+	}
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+	SpawnHelperResponse response;
 
-	if (rc <= 0)
+	if (!ProcessSpawnHelperRequest(helperIndex, SpawnHelperSpawn, payload, fds, response))
 		return -1;
 
-	String jresponse = String(buf, buf + rc);
+	if (response.RC == -1)
+		errno = response.Error;
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	return response->Get("errno");
+	return response.RC;
 }
 
-static int ProcessWaitPID(pid_t pid, int *status)
+static int ProcessKill(int helperIndex, pid_t pid, int signum)
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "waitpid" },
-		{ "pid", pid }
-	});
+	std::string payload;
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+	AppendInt(payload, pid);
+	AppendInt(payload, signum);
 
-	std::unique_lock<std::mutex> lock(l_ProcessControlMutex);
+	SpawnHelperResponse response;
 
-	do {
-		while (send(l_ProcessControlFD, &length, sizeof(length), 0) < 0) {
-			StartSpawnProcessHelper();
-		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
+	if (!ProcessSpawnHelperRequest(helperIndex, SpawnHelperKill, payload, nullptr, response))
+		return -1;
+
+	return response.Error;
+}
+
+static int ProcessWaitPID(int helperIndex, pid_t pid, int *status)
+{
+	std::string payload;
 
-	char buf[4096];
+	AppendInt(payload, pid);
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+	SpawnHelperResponse response;
 
-	if (rc <= 0)
+	if (!ProcessSpawnHelperRequest(helperIndex, SpawnHelperWaitPID, payload, nullptr, response))
 		return -1;
 
-	String jresponse = String(buf, buf + rc);
+	*status = response.Status;
+	return response.RC;
+}
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	*status = response->Get("status");
-	return response->Get("rc");
+/* Children can only be killed and reaped by the helper which spawned them. */
+static int GetSpawnHelperIndex(const Process *process)
+{
+	return (reinterpret_cast<uintptr_t>(process) / sizeof(void *)) % l_SpawnHelperCount;
 }
 
 void Process::InitializeSpawnHelper()
 {
-	if (l_ProcessControlFD == -1)
-		StartSpawnProcessHelper();
+	if (l_SpawnHelpers)
+		return;
+
+	l_SpawnHelperCount = std::max(Configuration::ProcessSpawnHelpers, 1);
+	l_SpawnHelpers.reset(new SpawnHelper[l_SpawnHelperCount]);
+
+	for (int i = 0; i < l_SpawnHelperCount; i++)
+		StartSpawnProcessHelper(l_SpawnHelpers[i]);
 }
 #endif /* _WIN32 */
 
-static void InitializeProcess()
+#ifndef _WIN32
+static void CreateEventPipe(int eventFD[2])
 {
-#ifdef _WIN32
-	for (auto& event : l_Events) {
-		event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
-	}
-#else /* _WIN32 */
-	for (auto& eventFD : l_EventFDs) {
 #	ifdef HAVE_PIPE2
-		if (pipe2(eventFD, O_CLOEXEC) < 0) {
-			if (errno == ENOSYS) {
+	if (pipe2(eventFD, O_CLOEXEC) < 0) {
+		if (errno == ENOSYS) {
 #	endif /* HAVE_PIPE2 */
-				if (pipe(eventFD) < 0) {
-					BOOST_THROW_EXCEPTION(posix_error()
-						<< boost::errinfo_api_function("pipe")
-						<< boost::errinfo_errno(errno));
-				}
-
-				Utility::SetCloExec(eventFD[0]);
-				Utility::SetCloExec(eventFD[1]);
-#	ifdef HAVE_PIPE2
-			} else {
+			if (pipe(eventFD) < 0) {
 				BOOST_THROW_EXCEPTION(posix_error()
-					<< boost::errinfo_api_function("pipe2")
+					<< boost::errinfo_api_function("pipe")
 					<< boost::errinfo_errno(errno));
 			}
+
+			Utility::SetCloExec(eventFD[0]);
+			Utility::SetCloExec(eventFD[1]);
+#	ifdef HAVE_PIPE2
+		} else {
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("pipe2")
+				<< boost::errinfo_errno(errno));
 		}
-#	endif /* HAVE_PIPE2 */
 	}
-#endif /* _WIN32 */
+#	endif /* HAVE_PIPE2 */
 }
+#endif /* _WIN32 */
+
+#ifdef __linux__
+static int CreateEpoll(int eventFD)
+{
+	int epollFD = epoll_create1(EPOLL_CLOEXEC);
+
+	if (epollFD < 0) {
+		Log(LogWarning, "Process")
+			<< "epoll_create1() failed, falling back to poll(): " << Utility::FormatErrorNumber(errno);
+		return -1;
+	}
 
-INITIALIZE_ONCE(InitializeProcess);
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = eventFD;
+
+	if (epoll_ctl(epollFD, EPOLL_CTL_ADD, eventFD, &event) < 0) {
+		Log(LogWarning, "Process")
+			<< "epoll_ctl() failed, falling back to poll(): " << Utility::FormatErrorNumber(errno);
+		(void)close(epollFD);
+		return -1;
+	}
+
+	return epollFD;
+}
+#endif /* __linux__ */
 
 void Process::ThreadInitialize()
 {
 	/* Note to self: Make sure this runs _after_ we've daemonized. */
-	for (int tid = 0; tid < IOTHREADS; tid++) {
+	l_IOThreadCount = std::max(Configuration::ProcessIOThreads, 1);
+	l_IOThreads.reset(new ProcessIOThread[l_IOThreadCount]);
+
+	for (int tid = 0; tid < l_IOThreadCount; tid++) {
+		auto& thread (l_IOThreads[tid]);
+
+#ifdef _WIN32
+		thread.Event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+#else /* _WIN32 */
+		CreateEventPipe(thread.EventFDs);
+
+#	ifdef __linux__
+		thread.EpollFD = CreateEpoll(thread.EventFDs[0]);
+#	endif /* __linux__ */
+#endif /* _WIN32 */
+
 		std::thread t(std::bind(&Process::IOThreadProc, tid));
 		t.detach();
 	}
@@ -590,45 +778,79 @@ bool Process::GetAdjustPriority() const
 	return m_AdjustPriority;
 }
 
+/**
+ * Sets the number of bytes of output to keep, the rest is read and discarded.
+ *
+ * @param size The number of bytes, 0 for no limit
+ */
+void Process::SetMaxOutputSize(size_t size)
+{
+	m_MaxOutputSize = size;
+}
+
+size_t Process::GetMaxOutputSize() const
+{
+	return m_MaxOutputSize;
+}
+
+void Process::AppendOutput(const char *data, size_t length)
+{
+	if (m_MaxOutputSize && m_Output.size() + length > m_MaxOutputSize) {
+		length = m_MaxOutputSize > m_Output.size() ? m_MaxOutputSize - m_Output.size() : 0;
+		m_OutputTruncated = true;
+	}
+
+	m_Output.append(data, length);
+}
+
 void Process::IOThreadProc(int tid)
 {
+	auto& thread (l_IOThreads[tid]);
+
+	Utility::SetThreadName("ProcessIO");
+
+#ifdef __linux__
+	if (thread.EpollFD != -1) {
+		IOThreadProcEpoll(tid);
+		return;
+	}
+#endif /* __linux__ */
+
 #ifdef _WIN32
 	HANDLE *handles = nullptr;
 	HANDLE *fhandles = nullptr;
 #else /* _WIN32 */
-	pollfd *pfds = nullptr;
+	std::vector<pollfd> pfds;
 #endif /* _WIN32 */
 	int count = 0;
 	double now;
 
-	Utility::SetThreadName("ProcessIO");
-
 	for (;;) {
 		double timeout = -1;
 
 		now = Utility::GetTime();
 
 		{
-			std::unique_lock<std::mutex> lock(l_ProcessMutex[tid]);
+			std::unique_lock<std::mutex> lock(thread.Mutex);
 
-			count = 1 + l_Processes[tid].size();
+			count = 1 + thread.Processes.size();
 #ifdef _WIN32
 			handles = reinterpret_cast<HANDLE *>(realloc(handles, sizeof(HANDLE) * count));
 			fhandles = reinterpret_cast<HANDLE *>(realloc(fhandles, sizeof(HANDLE) * count));
 
-			fhandles[0] = l_Events[tid];
+			fhandles[0] = thread.Event;
 
 #else /* _WIN32 */
-			pfds = reinterpret_cast<pollfd *>(realloc(pfds, sizeof(pollfd) * count));
+			pfds.resize(count);
 
-			pfds[0].fd = l_EventFDs[tid][0];
+			pfds[0].fd = thread.EventFDs[0];
 			pfds[0].events = POLLIN;
 			pfds[0].revents = 0;
 #endif /* _WIN32 */
 
 			int i = 1;
 			typedef std::pair<ProcessHandle, Process::Ptr> kv_pair;
-			for (const kv_pair& kv : l_Processes[tid]) {
+			for (const kv_pair& kv : thread.Processes) {
 				const Process::Ptr& process = kv.second;
 #ifdef _WIN32
 				handles[i] = kv.first;
@@ -669,7 +891,7 @@ void Process::IOThreadProc(int tid)
 #ifdef _WIN32
 		DWORD rc = WaitForMultipleObjects(count, fhandles, FALSE, timeout == -1 ? INFINITE : static_cast<DWORD>(timeout));
 #else /* _WIN32 */
-		int rc = poll(pfds, count, timeout);
+		int rc = poll(&pfds[0], count, timeout);
 
 		if (rc < 0)
 			continue;
@@ -678,32 +900,32 @@ void Process::IOThreadProc(int tid)
 		now = Utility::GetTime();
 
 		{
-			std::unique_lock<std::mutex> lock(l_ProcessMutex[tid]);
+			std::unique_lock<std::mutex> lock(thread.Mutex);
 
 #ifdef _WIN32
 			if (rc == WAIT_OBJECT_0)
-				ResetEvent(l_Events[tid]);
+				ResetEvent(thread.Event);
 #else /* _WIN32 */
 			if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
 				char buffer[512];
-				if (read(l_EventFDs[tid][0], buffer, sizeof(buffer)) < 0)
+				if (read(thread.EventFDs[0], buffer, sizeof(buffer)) < 0)
 					Log(LogCritical, "base", "Read from event FD failed.");
 			}
 #endif /* _WIN32 */
 
 			for (int i = 1; i < count; i++) {
 #ifdef _WIN32
-				auto it = l_Processes[tid].find(handles[i]);
+				auto it = thread.Processes.find(handles[i]);
 #else /* _WIN32 */
-				auto it2 = l_FDs[tid].find(pfds[i].fd);
+				auto it2 = thread.FDs.find(pfds[i].fd);
 
-				if (it2 == l_FDs[tid].end())
+				if (it2 == thread.FDs.end())
 					continue; /* This should never happen. */
 
-				auto it = l_Processes[tid].find(it2->second);
+				auto it = thread.Processes.find(it2->second);
 #endif /* _WIN32 */
 
-				if (it == l_Processes[tid].end())
+				if (it == thread.Processes.end())
 					continue; /* This should never happen. */
 
 				bool is_timeout = false;
@@ -725,10 +947,10 @@ void Process::IOThreadProc(int tid)
 						CloseHandle(it->first);
 						CloseHandle(it->second->m_FD);
 #else /* _WIN32 */
-						l_FDs[tid].erase(it->second->m_FD);
+						thread.FDs.erase(it->second->m_FD);
 						(void)close(it->second->m_FD);
 #endif /* _WIN32 */
-						l_Processes[tid].erase(it);
+						thread.Processes.erase(it);
 					}
 				}
 			}
@@ -736,6 +958,105 @@ void Process::IOThreadProc(int tid)
 	}
 }
 
+#ifdef __linux__
+/**
+ * Like IOThreadProc(), but waits for the output FDs which are registered
+ * with the thread's epoll instance by Run() instead of rebuilding a poll
+ * set in every iteration. All processes are only checked for timeouts
+ * once the earliest deadline has passed.
+ *
+ * @param tid The I/O thread's index.
+ */
+void Process::IOThreadProcEpoll(int tid)
+{
+	auto& thread (l_IOThreads[tid]);
+	epoll_event events[128];
+
+	for (;;) {
+		int timeout = 500;
+
+		{
+			std::unique_lock<std::mutex> lock(thread.Mutex);
+
+			if (thread.NextDeadline != -1) {
+				double delta = thread.NextDeadline - Utility::GetTime();
+
+				if (delta < 0.5)
+					timeout = delta < 0.01 ? 10 : static_cast<int>(delta * 1000);
+			}
+		}
+
+		int rc = epoll_wait(thread.EpollFD, events, sizeof(events) / sizeof(events[0]), timeout);
+
+		if (rc < 0)
+			continue;
+
+		double now = Utility::GetTime();
+
+		std::unique_lock<std::mutex> lock(thread.Mutex);
+
+		for (int i = 0; i < rc; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == thread.EventFDs[0]) {
+				char buffer[512];
+				if (read(thread.EventFDs[0], buffer, sizeof(buffer)) < 0)
+					Log(LogCritical, "base", "Read from event FD failed.");
+
+				continue;
+			}
+
+			auto it2 = thread.FDs.find(fd);
+
+			if (it2 == thread.FDs.end())
+				continue; /* This should never happen. */
+
+			auto it = thread.Processes.find(it2->second);
+
+			if (it == thread.Processes.end())
+				continue; /* This should never happen. */
+
+			if (!it->second->DoEvents()) {
+				(void)epoll_ctl(thread.EpollFD, EPOLL_CTL_DEL, fd, nullptr);
+				thread.FDs.erase(it2);
+				(void)close(fd);
+				thread.Processes.erase(it);
+			}
+		}
+
+		if (thread.NextDeadline == -1 || thread.NextDeadline > now)
+			continue;
+
+		thread.NextDeadline = -1;
+
+		for (auto it = thread.Processes.begin(); it != thread.Processes.end();) {
+			const Process::Ptr& process = it->second;
+
+			if (process->m_Timeout == 0) {
+				++it;
+				continue;
+			}
+
+			if (process->m_Result.ExecutionStart + process->GetNextTimeout() < now && !process->DoEvents()) {
+				(void)epoll_ctl(thread.EpollFD, EPOLL_CTL_DEL, process->m_FD, nullptr);
+				thread.FDs.erase(process->m_FD);
+				(void)close(process->m_FD);
+				it = thread.Processes.erase(it);
+				continue;
+			}
+
+			/* DoEvents() may have extended the deadline after sending SIGTERM. */
+			double deadline = process->m_Result.ExecutionStart + process->GetNextTimeout();
+
+			if (thread.NextDeadline == -1 || deadline < thread.NextDeadline)
+				thread.NextDeadline = deadline;
+
+			++it;
+		}
+	}
+}
+#endif /* __linux__ */
+
 String Process::PrettyPrintArguments(const Process::Arguments& arguments)
 {
 #ifdef _WIN32
@@ -970,12 +1291,12 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 	fds[1] = outfds[1];
 	fds[2] = outfds[1];
 
-	m_Process = ProcessSpawn(m_Arguments, m_ExtraEnvironment, m_AdjustPriority, fds);
+	m_Process = ProcessSpawn(GetSpawnHelperIndex(this), m_Arguments, m_ExtraEnvironment, m_AdjustPriority, fds);
 	m_PID = m_Process;
 
 	if (m_PID == -1) {
-		m_OutputStream << "Fork failed with error code " << errno << " (" << Utility::FormatErrorNumber(errno) << ")";
-		Log(LogCritical, "Process", m_OutputStream.str());
+		m_Output = "Fork failed with error code " + Convert::ToString(errno) + " (" + Utility::FormatErrorNumber(errno) + ")";
+		Log(LogCritical, "Process", m_Output);
 	}
 
 	Log(LogNotice, "Process")
@@ -990,20 +1311,49 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 
 	m_Callback = callback;
 
-	int tid = GetTID();
+	auto& thread (l_IOThreads[GetTID()]);
+	bool wakeUp = true;
 
 	{
-		std::unique_lock<std::mutex> lock(l_ProcessMutex[tid]);
-		l_Processes[tid][m_Process] = this;
+		std::unique_lock<std::mutex> lock(thread.Mutex);
+		thread.Processes[m_Process] = this;
 #ifndef _WIN32
-		l_FDs[tid][m_FD] = m_Process;
+		thread.FDs[m_FD] = m_Process;
 #endif /* _WIN32 */
+
+#ifdef __linux__
+		if (thread.EpollFD != -1) {
+			epoll_event event = {};
+			event.events = EPOLLIN;
+			event.data.fd = m_FD;
+
+			if (epoll_ctl(thread.EpollFD, EPOLL_CTL_ADD, m_FD, &event) < 0) {
+				Log(LogCritical, "Process")
+					<< "Adding the output of PID " << m_PID << " to the epoll set failed: " << Utility::FormatErrorNumber(errno);
+			}
+
+			/* The FD is watched right away, the thread only has to know about an earlier deadline. */
+			if (m_Timeout != 0) {
+				double deadline = m_Result.ExecutionStart + GetNextTimeout();
+
+				if (thread.NextDeadline == -1 || deadline < thread.NextDeadline)
+					thread.NextDeadline = deadline;
+				else
+					wakeUp = false;
+			} else {
+				wakeUp = false;
+			}
+		}
+#endif /* __linux__ */
 	}
 
+	if (!wakeUp)
+		return;
+
 #ifdef _WIN32
-	SetEvent(l_Events[tid]);
+	SetEvent(thread.Event);
 #else /* _WIN32 */
-	if (write(l_EventFDs[tid][1], "T", 1) < 0 && errno != EINTR && errno != EAGAIN)
+	if (write(thread.EventFDs[1], "T", 1) < 0 && errno != EINTR && errno != EAGAIN)
 		Log(LogCritical, "base", "Write to event FD failed.");
 #endif /* _WIN32 */
 }
@@ -1034,9 +1384,9 @@ bool Process::DoEvents()
 					<< "Terminating process " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
 					<< ") after timeout of " << timeout << " seconds";
 
-				m_OutputStream << "<Timeout exceeded.>";
+				m_Output += "<Timeout exceeded.>";
 
-				int error = ProcessKill(m_Process, SIGTERM);
+				int error = ProcessKill(GetSpawnHelperIndex(this), m_Process, SIGTERM);
 				if (error) {
 					Log(LogWarning, "Process")
 						<< "Couldn't terminate the process " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
@@ -1057,10 +1407,10 @@ bool Process::DoEvents()
 				<< ") after timeout of " << timeout << " seconds";
 
 #ifdef _WIN32
-			m_OutputStream << "<Timeout exceeded.>";
+			m_Output += "<Timeout exceeded.>";
 			TerminateProcess(m_Process, 3);
 #else /* _WIN32 */
-			int error = ProcessKill(-m_Process, SIGKILL);
+			int error = ProcessKill(GetSpawnHelperIndex(this), -m_Process, SIGKILL);
 			if (error) {
 				Log(LogWarning, "Process")
 					<< "Couldn't kill the process group " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
@@ -1079,19 +1429,43 @@ bool Process::DoEvents()
 
 		DWORD rc;
 		if (!m_ReadFailed && GetOverlappedResult(m_FD, &m_Overlapped, &rc, TRUE) && rc > 0) {
-			m_OutputStream.write(m_ReadBuffer, rc);
+			AppendOutput(m_ReadBuffer, rc);
 			return true;
 		}
 #else /* _WIN32 */
-		char buffer[512];
+		/* Read straight into the output's spare capacity, which grows like a vector's.
+		 * Once the limit has been reached, the rest is read into the scratch buffer
+		 * and thrown away so that the process doesn't block on a full pipe.
+		 */
+		char scratch[4096];
+
 		for (;;) {
-			int rc = read(m_FD, buffer, sizeof(buffer));
+			size_t length = m_Output.size();
+			char *buffer = scratch;
+			size_t room = sizeof(scratch);
+
+			if (!m_MaxOutputSize || length < m_MaxOutputSize) {
+				room = std::min<size_t>(std::max<size_t>(m_Output.capacity() - length, 16 * 1024), 64 * 1024);
+
+				if (m_MaxOutputSize)
+					room = std::min(room, m_MaxOutputSize - length);
+
+				m_Output.resize(length + room);
+				buffer = &m_Output[length];
+			}
+
+			ssize_t rc = read(m_FD, buffer, room);
+
+			if (buffer != scratch)
+				m_Output.resize(length + std::max<ssize_t>(rc, 0));
 
 			if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
 				return true;
 
 			if (rc > 0) {
-				m_OutputStream.write(buffer, rc);
+				if (buffer == scratch)
+					m_OutputTruncated = true;
+
 				continue;
 			}
 
@@ -1100,7 +1474,10 @@ bool Process::DoEvents()
 #endif /* _WIN32 */
 	}
 
-	String output = m_OutputStream.str();
+	if (m_OutputTruncated)
+		m_Output += "<Output truncated after " + Convert::ToString(m_MaxOutputSize) + " bytes.>";
+
+	String output (std::move(m_Output));
 
 #ifdef _WIN32
 	WaitForSingleObject(m_Process, INFINITE);
@@ -1114,7 +1491,7 @@ bool Process::DoEvents()
 	int status, exitcode;
 	if (could_not_kill || m_PID == -1) {
 		exitcode = 128;
-	} else if (ProcessWaitPID(m_Process, &status) != m_Process) {
+	} else if (ProcessWaitPID(GetSpawnHelperIndex(this), m_Process, &status) != m_Process) {
 		exitcode = 128;
 
 		Log(LogWarning, "Process")
@@ -1153,13 +1530,14 @@ bool Process::DoEvents()
 		m_Result.PID = m_PID;
 		m_Result.ExecutionEnd = Utility::GetTime();
 		m_Result.ExitStatus = exitcode;
-		m_Result.Output = output;
+		m_Result.Output = std::move(output);
 		m_ResultAvailable = true;
 	}
 	m_ResultCondition.notify_all();
 
+	/* The result is handed over, WaitForResult() is only for processes run without a callback. */
 	if (m_Callback)
-		Utility::QueueAsyncCallback(std::bind(m_Callback, m_Result));
+		Utility::QueueAsyncCallback(std::bind(m_Callback, std::move(m_Result)));
 
 	return false;
 }
@@ -1172,7 +1550,7 @@ pid_t Process::GetPID() const
 
 int Process::GetTID() const
 {
-	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % IOTHREADS;
+	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % l_IOThreadCount;
 }
 
 double Process::GetNextTimeout() const
@@ -61,6 +61,9 @@ public:
 	void SetAdjustPriority(bool adjust);
 	bool GetAdjustPriority() const;
 
+	void SetMaxOutputSize(size_t size);
+	size_t GetMaxOutputSize() const;
+
 	void Run(const std::function<void (const ProcessResult&)>& callback = std::function<void (const ProcessResult&)>());
 
 	const ProcessResult& WaitForResult();
@@ -99,14 +102,21 @@ private:
 	char m_ReadBuffer[1024];
 #endif /* _WIN32 */
 
-	std::ostringstream m_OutputStream;
+	std::string m_Output;
+	size_t m_MaxOutputSize;
+	bool m_OutputTruncated;
 	std::function<void (const ProcessResult&)> m_Callback;
 	ProcessResult m_Result;
 	bool m_ResultAvailable;
 	std::mutex m_ResultMutex;
 	std::condition_variable m_ResultCondition;
 
+	void AppendOutput(const char *data, size_t length);
+
 	static void IOThreadProc(int tid);
+#ifdef __linux__
+	static void IOThreadProcEpoll(int tid);
+#endif /* __linux__ */
 	bool DoEvents();
 	int GetTID() const;
 	double GetNextTimeout() const;
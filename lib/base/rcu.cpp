@@ -0,0 +1,153 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/rcu.hpp"
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace icinga;
+
+/* The epoch a thread's current read-side critical section started in, 0 while it isn't in one. */
+struct RcuThreadState
+{
+	std::atomic<uint_fast64_t> Epoch{0};
+	unsigned Depth{0};
+};
+
+struct RcuRetiredItem
+{
+	uint_fast64_t Epoch;
+	std::function<void()> Deleter;
+};
+
+struct RcuRegistry
+{
+	std::mutex Mutex;
+	std::vector<std::shared_ptr<RcuThreadState> > Threads;
+	std::vector<RcuRetiredItem> Retired;
+};
+
+static std::atomic<uint_fast64_t> l_RcuEpoch (1);
+
+/* Never destroyed, threads may still leave their section while the process shuts down. */
+static RcuRegistry& GetRcuRegistry()
+{
+	static auto *registry = new RcuRegistry();
+	return *registry;
+}
+
+struct RcuThreadHandle
+{
+	std::shared_ptr<RcuThreadState> State;
+
+	RcuThreadHandle() : State(std::make_shared<RcuThreadState>())
+	{
+		auto& registry (GetRcuRegistry());
+		std::unique_lock<std::mutex> lock (registry.Mutex);
+
+		registry.Threads.push_back(State);
+	}
+
+	~RcuThreadHandle()
+	{
+		auto& registry (GetRcuRegistry());
+		std::unique_lock<std::mutex> lock (registry.Mutex);
+
+		for (auto it (registry.Threads.begin()); it != registry.Threads.end(); ++it) {
+			if (*it == State) {
+				registry.Threads.erase(it);
+				break;
+			}
+		}
+	}
+};
+
+static thread_local RcuThreadHandle l_RcuThread;
+
+void Rcu::EnterReadSection()
+{
+	auto& state (*l_RcuThread.State);
+
+	if (state.Depth++ == 0u) {
+		state.Epoch.store(l_RcuEpoch.load());
+
+		/* Pointers loaded after this have to be protected by the epoch we've just announced. */
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
+}
+
+void Rcu::LeaveReadSection()
+{
+	auto& state (*l_RcuThread.State);
+
+	if (--state.Depth == 0u)
+		state.Epoch.store(0, std::memory_order_release);
+}
+
+/**
+ * Schedules an unpublished version of some data for destruction.
+ *
+ * Readers which entered their section before the new version was
+ * published may still use the old one, so it is only destroyed once
+ * all of them have left.
+ *
+ * @param deleter Destroys the old version.
+ */
+void Rcu::Retire(std::function<void()> deleter)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	auto epoch (l_RcuEpoch.fetch_add(1));
+
+	{
+		auto& registry (GetRcuRegistry());
+		std::unique_lock<std::mutex> lock (registry.Mutex);
+
+		registry.Retired.push_back({ epoch, std::move(deleter) });
+	}
+
+	Reclaim();
+}
+
+/**
+ * Destroys all retired versions which no reader can see anymore.
+ */
+void Rcu::Reclaim()
+{
+	std::vector<RcuRetiredItem> reclaimable;
+
+	{
+		auto& registry (GetRcuRegistry());
+		std::unique_lock<std::mutex> lock (registry.Mutex);
+
+		if (registry.Retired.empty())
+			return;
+
+		auto oldest (std::numeric_limits<uint_fast64_t>::max());
+
+		for (auto& state : registry.Threads) {
+			auto epoch (state->Epoch.load(std::memory_order_acquire));
+
+			if (epoch && epoch < oldest)
+				oldest = epoch;
+		}
+
+		std::vector<RcuRetiredItem> remaining;
+
+		for (auto& item : registry.Retired) {
+			if (item.Epoch < oldest)
+				reclaimable.push_back(std::move(item));
+			else
+				remaining.push_back(std::move(item));
+		}
+
+		registry.Retired.swap(remaining);
+	}
+
+	/* Deleters may release the last reference to arbitrary objects, don't hold the mutex. */
+	for (auto& item : reclaimable)
+		item.Deleter();
+}
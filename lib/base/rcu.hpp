@@ -0,0 +1,60 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef RCU_H
+#define RCU_H
+
+#include "base/i2-base.hpp"
+#include <functional>
+
+namespace icinga
+{
+
+/**
+ * Epoch based read-copy-update.
+ *
+ * Readers enter a read-side critical section with an RcuReadLock, load a
+ * pointer which is published by writers and may use the pointee until they
+ * leave the section again. Entering and leaving only touches a thread-local
+ * counter, so readers never wait for each other or for writers.
+ *
+ * Writers publish a new version (usually with an atomic exchange) and pass
+ * the old one to Retire(). It is destroyed as soon as no reader which might
+ * still see it is left.
+ *
+ * @ingroup base
+ */
+class Rcu
+{
+public:
+	static void Retire(std::function<void()> deleter);
+	static void Reclaim();
+
+	static void EnterReadSection();
+	static void LeaveReadSection();
+};
+
+/**
+ * A scoped RCU read-side critical section. Sections may be nested.
+ *
+ * @ingroup base
+ */
+class RcuReadLock
+{
+public:
+	inline RcuReadLock()
+	{
+		Rcu::EnterReadSection();
+	}
+
+	RcuReadLock(const RcuReadLock&) = delete;
+	RcuReadLock& operator=(const RcuReadLock&) = delete;
+
+	inline ~RcuReadLock()
+	{
+		Rcu::LeaveReadSection();
+	}
+};
+
+}
+
+#endif /* RCU_H */
@@ -0,0 +1,127 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef RINGBITSET_H
+#define RINGBITSET_H
+
+#include "base/i2-base.hpp"
+#include <cstdint>
+
+namespace icinga
+{
+
+/**
+ * Counts the set bits of a 64 bit integer.
+ *
+ * @param value The integer.
+ * @returns The number of set bits.
+ */
+inline unsigned PopCount(uint_fast64_t value)
+{
+#ifdef __GNUC__
+	return __builtin_popcountll(value);
+#else /* __GNUC__ */
+	value = value - ((value >> 1) & 0x5555555555555555ull);
+	value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+	value = (value + (value >> 4)) & 0x0f0f0f0f0f0f0f0full;
+
+	return (value * 0x0101010101010101ull) >> 56;
+#endif /* __GNUC__ */
+}
+
+/**
+ * A history of the last N boolean events, stored in a single integer.
+ *
+ * Pushing an event overwrites the oldest one. The raw data and the position
+ * of the oldest event can be stored and restored, e.g. in state attributes.
+ *
+ * @ingroup base
+ */
+template<unsigned N>
+class RingBitset
+{
+	static_assert(N > 0 && N <= 64, "A RingBitset holds 1 to 64 bits.");
+
+public:
+	RingBitset(uint_fast64_t data = 0, unsigned index = 0)
+		: m_Data(data & GetFullMask()), m_Index(index % N)
+	{ }
+
+	void Push(bool bit)
+	{
+		if (bit)
+			m_Data |= uint_fast64_t(1) << m_Index;
+		else
+			m_Data &= ~(uint_fast64_t(1) << m_Index);
+
+		m_Index = (m_Index + 1) % N;
+	}
+
+	uint_fast64_t GetData() const
+	{
+		return m_Data;
+	}
+
+	/**
+	 * Returns the position of the oldest event, i.e. where the next one goes.
+	 */
+	unsigned GetIndex() const
+	{
+		return m_Index;
+	}
+
+	unsigned Count() const
+	{
+		return PopCount(m_Data);
+	}
+
+	/**
+	 * Returns the events ordered by age, the oldest one in bit 0.
+	 */
+	uint_fast64_t GetOrdered() const
+	{
+		if (!m_Index)
+			return m_Data;
+
+		return ((m_Data >> m_Index) | (m_Data << (N - m_Index))) & GetFullMask();
+	}
+
+	/**
+	 * Sums up the weights of all set bits. The oldest event weighs base,
+	 * every newer one step more than the previous one.
+	 *
+	 * @param base The weight of the oldest event.
+	 * @param step The weight added per newer event.
+	 * @returns The weighted count.
+	 */
+	uint_fast64_t GetWeightedCount(uint_fast64_t base, uint_fast64_t step) const
+	{
+		/* Bit k of a position is set in the positions selected by these masks. The sum of
+		 * the positions of all set bits is the sum of 2^k times the set bits in mask k.
+		 */
+		static const uint_fast64_t positionMasks[] = {
+			0xaaaaaaaaaaaaaaaaull, 0xccccccccccccccccull, 0xf0f0f0f0f0f0f0f0ull,
+			0xff00ff00ff00ff00ull, 0xffff0000ffff0000ull, 0xffffffff00000000ull
+		};
+
+		auto ordered (GetOrdered());
+		uint_fast64_t positions = 0;
+
+		for (unsigned k = 0; k < sizeof(positionMasks) / sizeof(positionMasks[0]); k++)
+			positions += uint_fast64_t(PopCount(ordered & positionMasks[k])) << k;
+
+		return base * PopCount(ordered) + step * positions;
+	}
+
+private:
+	uint_fast64_t m_Data;
+	unsigned m_Index;
+
+	static uint_fast64_t GetFullMask()
+	{
+		return N == 64 ? ~uint_fast64_t(0) : (uint_fast64_t(1) << (N % 64)) - 1;
+	}
+};
+
+}
+
+#endif /* RINGBITSET_H */
@@ -1,82 +1,82 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/ringbuffer.hpp"
-#include "base/objectlock.hpp"
-#include "base/utility.hpp"
 #include <algorithm>
 
 using namespace icinga;
 
-RingBuffer::RingBuffer(RingBuffer::SizeType slots)
-	: m_Slots(slots, 0), m_TimeValue(0), m_InsertedValues(0)
-{ }
-
-RingBuffer::SizeType RingBuffer::GetLength() const
+static inline uint_least64_t PackSlot(RingBuffer::SizeType tv, uint_least32_t value)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
-	return m_Slots.size();
+	return (static_cast<uint_least64_t>(static_cast<uint_least32_t>(tv)) << 32u) | value;
 }
 
-void RingBuffer::InsertValue(RingBuffer::SizeType tv, int num)
+static inline uint_least32_t GetSlotTimeValue(uint_least64_t slot)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
-
-	InsertValueUnlocked(tv, num);
+	return static_cast<uint_least32_t>(slot >> 32u);
 }
 
-void RingBuffer::InsertValueUnlocked(RingBuffer::SizeType tv, int num)
+static inline int GetSlotValue(uint_least64_t slot)
 {
-	RingBuffer::SizeType offsetTarget = tv % m_Slots.size();
-
-	if (m_TimeValue == 0)
-		m_InsertedValues = 1;
-
-	if (tv > m_TimeValue) {
-		RingBuffer::SizeType offset = m_TimeValue % m_Slots.size();
-
-		/* walk towards the target offset, resetting slots to 0 */
-		while (offset != offsetTarget) {
-			offset++;
-
-			if (offset >= m_Slots.size())
-				offset = 0;
+	return static_cast<int32_t>(static_cast<uint_least32_t>(slot & 0xffffffffu));
+}
 
-			m_Slots[offset] = 0;
+RingBuffer::RingBuffer(RingBuffer::SizeType slots)
+	: m_Slots(slots), m_FirstTimeValue(0)
+{
+	for (auto& slot : m_Slots)
+		slot.store(0, std::memory_order_relaxed);
+}
 
-			if (m_TimeValue != 0 && m_InsertedValues < m_Slots.size())
-				m_InsertedValues++;
-		}
+RingBuffer::SizeType RingBuffer::GetLength() const
+{
+	return m_Slots.size();
+}
 
-		m_TimeValue = tv;
-	}
+void RingBuffer::UpdateFirstTimeValue(RingBuffer::SizeType tv)
+{
+	SizeType first = 0;
 
-	m_Slots[offsetTarget] += num;
+	m_FirstTimeValue.compare_exchange_strong(first, tv, std::memory_order_relaxed);
 }
 
-int RingBuffer::UpdateAndGetValues(RingBuffer::SizeType tv, RingBuffer::SizeType span)
+void RingBuffer::InsertValue(RingBuffer::SizeType tv, int num)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
-
-	return UpdateAndGetValuesUnlocked(tv, span);
+	UpdateFirstTimeValue(tv);
+
+	auto& slot (m_Slots[tv % m_Slots.size()]);
+	auto tag (static_cast<uint_least32_t>(tv));
+	uint_least64_t current = slot.load(std::memory_order_relaxed);
+	uint_least64_t desired;
+
+	do {
+		uint_least32_t currentTag = GetSlotTimeValue(current);
+
+		if (currentTag == tag) {
+			desired = PackSlot(tv, static_cast<uint_least32_t>(GetSlotValue(current) + num));
+		} else if (currentTag < tag) {
+			/* The slot still holds a value from the previous round, start over. */
+			desired = PackSlot(tv, static_cast<uint_least32_t>(num));
+		} else {
+			/* The slot has already been reused for a later time value. */
+			return;
+		}
+	} while (!slot.compare_exchange_weak(current, desired, std::memory_order_relaxed));
 }
 
-int RingBuffer::UpdateAndGetValuesUnlocked(RingBuffer::SizeType tv, RingBuffer::SizeType span)
+int RingBuffer::UpdateAndGetValues(RingBuffer::SizeType tv, RingBuffer::SizeType span)
 {
-	InsertValueUnlocked(tv, 0);
+	UpdateFirstTimeValue(tv);
 
 	if (span > m_Slots.size())
 		span = m_Slots.size();
 
-	int off = m_TimeValue % m_Slots.size();
 	int sum = 0;
-	while (span > 0) {
-		sum += m_Slots[off];
 
-		if (off == 0)
-			off = m_Slots.size();
+	for (SizeType i = 0; i < span && i <= tv; i++) {
+		uint_least64_t slot = m_Slots[(tv - i) % m_Slots.size()].load(std::memory_order_relaxed);
 
-		off--;
-		span--;
+		if (GetSlotTimeValue(slot) == static_cast<uint_least32_t>(tv - i))
+			sum += GetSlotValue(slot);
 	}
 
 	return sum;
@@ -84,8 +84,11 @@ int RingBuffer::UpdateAndGetValuesUnlocked(RingBuffer::SizeType tv, RingBuffer::
 
 double RingBuffer::CalculateRate(RingBuffer::SizeType tv, RingBuffer::SizeType span)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	int sum = UpdateAndGetValues(tv, span);
+
+	/* The number of time values since the first insert, like the slots which could have been filled. */
+	SizeType first = m_FirstTimeValue.load(std::memory_order_relaxed);
+	SizeType inserted = std::min(tv >= first ? tv - first + 1 : 1, m_Slots.size());
 
-	int sum = UpdateAndGetValuesUnlocked(tv, span);
-	return sum / static_cast<double>(std::min(span, m_InsertedValues));
+	return sum / static_cast<double>(std::min(span, inserted));
 }
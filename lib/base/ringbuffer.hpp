@@ -5,8 +5,9 @@
 
 #include "base/i2-base.hpp"
 #include "base/object.hpp"
+#include <atomic>
+#include <cstdint>
 #include <vector>
-#include <mutex>
 
 namespace icinga
 {
@@ -14,6 +15,10 @@ namespace icinga
 /**
  * A ring buffer that holds a pre-defined number of integers.
  *
+ * Every slot holds the value of one time value (second) together with that
+ * time value, so writers update it without a lock and readers ignore slots
+ * which haven't been written to during the requested span.
+ *
  * @ingroup base
  */
 class RingBuffer final
@@ -31,13 +36,11 @@ public:
 	double CalculateRate(SizeType tv, SizeType span);
 
 private:
-	mutable std::mutex m_Mutex;
-	std::vector<int> m_Slots;
-	SizeType m_TimeValue;
-	SizeType m_InsertedValues;
+	/* The time value in the upper and the value in the lower 32 bits. */
+	std::vector<std::atomic<uint_least64_t>> m_Slots;
+	std::atomic<SizeType> m_FirstTimeValue;
 
-	void InsertValueUnlocked(SizeType tv, int num);
-	int UpdateAndGetValuesUnlocked(SizeType tv, SizeType span);
+	void UpdateFirstTimeValue(SizeType tv);
 };
 
 }
@@ -17,7 +17,12 @@
 #include "config/configitem.hpp"
 #include <boost/regex.hpp>
 #include <algorithm>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <set>
+#include <unordered_map>
 #ifdef _WIN32
 #include <msi.h>
 #endif /* _WIN32 */
@@ -93,6 +98,64 @@ bool ScriptUtils::CastBool(const Value& value)
 	return value.ToBool();
 }
 
+/**
+ * Keeps the most recently used compiled regular expressions. Filters call
+ * regex() with the same few patterns for every object.
+ */
+class RegexCache
+{
+public:
+	std::shared_ptr<const boost::regex> Get(const String& pattern)
+	{
+		const std::string& key (pattern.GetData());
+		Shard& shard (m_Shards[std::hash<std::string>()(key) % ShardCount]);
+
+		{
+			std::unique_lock<std::mutex> lock (shard.Mutex);
+			auto it (shard.Index.find(key));
+
+			if (it != shard.Index.end()) {
+				shard.Entries.splice(shard.Entries.begin(), shard.Entries, it->second);
+				return it->second->second;
+			}
+		}
+
+		/* Compiled without the lock, invalid patterns throw and aren't cached. */
+		std::shared_ptr<const boost::regex> expr (new boost::regex(key));
+
+		std::unique_lock<std::mutex> lock (shard.Mutex);
+
+		if (shard.Index.find(key) == shard.Index.end()) {
+			shard.Entries.emplace_front(key, expr);
+			shard.Index.emplace(key, shard.Entries.begin());
+
+			if (shard.Entries.size() > ShardCapacity) {
+				shard.Index.erase(shard.Entries.back().first);
+				shard.Entries.pop_back();
+			}
+		}
+
+		return expr;
+	}
+
+private:
+	static const size_t ShardCount = 16;
+	static const size_t ShardCapacity = 64;
+
+	typedef std::list<std::pair<std::string, std::shared_ptr<const boost::regex>>> EntryList;
+
+	struct Shard
+	{
+		std::mutex Mutex;
+		EntryList Entries;
+		std::unordered_map<std::string, EntryList::iterator> Index;
+	};
+
+	Shard m_Shards[ShardCount];
+};
+
+static RegexCache l_RegexCache;
+
 bool ScriptUtils::Regex(const std::vector<Value>& args)
 {
 	if (args.size() < 2)
@@ -111,7 +174,8 @@ bool ScriptUtils::Regex(const std::vector<Value>& args)
 	else
 		mode = MatchAll;
 
-	boost::regex expr(pattern.GetData());
+	auto compiled (l_RegexCache.Get(pattern));
+	const boost::regex& expr (*compiled);
 
 	Array::Ptr texts;
 
@@ -127,23 +127,39 @@ static Object::Ptr SerializeObject(const Object::Ptr& input, int attributeTypes,
 		return nullptr;
 
 	DictionaryData fields;
-	fields.reserve(type->GetFieldCount() + 1);
 
-	ObjectLock olock(input);
+	auto *serializedFields = type->GetSerializedFields(attributeTypes);
 
-	for (int i = 0; i < type->GetFieldCount(); i++) {
-		Field field = type->GetFieldInfo(i);
+	if (serializedFields) {
+		fields.reserve(serializedFields->size() + 1);
 
-		if (attributeTypes != 0 && (field.Attributes & attributeTypes) == 0)
-			continue;
+		ObjectLock olock(input);
 
-		if (strcmp(field.Name, "type") == 0)
-			continue;
+		for (auto& field : *serializedFields) {
+			Value value = input->GetField(field.ID);
+			stack.Push(field.Name, value);
+			fields.emplace_back(field.Name, SerializeInternal(value, attributeTypes, stack));
+			stack.Pop();
+		}
+	} else {
+		fields.reserve(type->GetFieldCount() + 1);
 
-		Value value = input->GetField(i);
-		stack.Push(field.Name, value);
-		fields.emplace_back(field.Name, SerializeInternal(value, attributeTypes, stack));
-		stack.Pop();
+		ObjectLock olock(input);
+
+		for (int i = 0; i < type->GetFieldCount(); i++) {
+			Field field = type->GetFieldInfo(i);
+
+			if (attributeTypes != 0 && (field.Attributes & attributeTypes) == 0)
+				continue;
+
+			if (strcmp(field.Name, "type") == 0)
+				continue;
+
+			Value value = input->GetField(i);
+			stack.Push(field.Name, value);
+			fields.emplace_back(field.Name, SerializeInternal(value, attributeTypes, stack));
+			stack.Pop();
+		}
 	}
 
 	fields.emplace_back("type", type->GetName());
@@ -0,0 +1,122 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/startupprofiler.hpp"
+#include "base/application.hpp"
+#include "base/array.hpp"
+#include "base/configuration.hpp"
+#include "base/utility.hpp"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using namespace icinga;
+
+namespace
+{
+
+struct PhaseStats
+{
+	String Name;
+	double Duration;
+	size_t Count;
+	size_t Calls;
+};
+
+}
+
+static std::atomic<bool> l_Recording (true);
+static std::mutex l_PhasesMutex;
+static std::vector<PhaseStats> l_Phases;
+static std::map<String, size_t> l_PhaseIndexes;
+
+/**
+ * Adds the duration of a phase to the report.
+ *
+ * @param name The name of the phase.
+ * @param duration How long the phase took, in seconds.
+ * @param count How many objects or items were processed.
+ */
+void StartupProfiler::AddPhase(const String& name, double duration, size_t count)
+{
+	if (!l_Recording.load())
+		return;
+
+	std::unique_lock<std::mutex> lock (l_PhasesMutex);
+
+	auto it (l_PhaseIndexes.find(name));
+
+	if (it == l_PhaseIndexes.end()) {
+		l_PhaseIndexes.emplace(name, l_Phases.size());
+		l_Phases.push_back(PhaseStats{name, duration, count, 1});
+		return;
+	}
+
+	auto& phase (l_Phases[it->second]);
+
+	phase.Duration += duration;
+	phase.Count += count;
+	phase.Calls++;
+}
+
+/**
+ * Stops recording phases, the startup has finished.
+ */
+void StartupProfiler::Finish()
+{
+	l_Recording.store(false);
+}
+
+/**
+ * Returns the phases recorded so far in the order they were first recorded.
+ *
+ * @returns The report.
+ */
+Dictionary::Ptr StartupProfiler::GetReport()
+{
+	ArrayData phases;
+
+	{
+		std::unique_lock<std::mutex> lock (l_PhasesMutex);
+
+		for (auto& phase : l_Phases) {
+			phases.emplace_back(new Dictionary({
+				{ "name", phase.Name },
+				{ "duration", phase.Duration },
+				{ "count", phase.Count },
+				{ "calls", phase.Calls }
+			}));
+		}
+	}
+
+	return new Dictionary({
+		{ "version", Application::GetAppVersion() },
+		{ "concurrency", Configuration::Concurrency },
+		{ "start_time", Application::GetStartTime() },
+		{ "end_time", Utility::GetTime() },
+		{ "phases", new Array(std::move(phases)) }
+	});
+}
+
+void StartupProfiler::WriteReport(const String& path)
+{
+	Utility::SaveJsonFile(path, 0644, GetReport());
+}
+
+StartupPhase::StartupPhase(String name, size_t count)
+	: m_Name(std::move(name)), m_Count(count), m_Start(Utility::GetTime())
+{ }
+
+StartupPhase::~StartupPhase()
+{
+	try {
+		StartupProfiler::AddPhase(m_Name, Utility::GetTime() - m_Start, m_Count);
+	} catch (...) {
+		/* Don't throw from a destructor, the report is only informational. */
+	}
+}
+
+void StartupPhase::SetCount(size_t count)
+{
+	m_Count = count;
+}
@@ -0,0 +1,65 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
+#include "base/string.hpp"
+
+namespace icinga
+{
+
+/**
+ * Records how long the phases of loading, committing and activating the
+ * configuration take. Phases which are recorded more than once under the
+ * same name (e.g. per type in recursive commits) are summed up.
+ *
+ * Phase names may contain a '/', e.g. "commit_items/Service". Such phases
+ * are part of the phase before the '/', their durations must not be added
+ * to it.
+ *
+ * Recording ends with Finish(), later runtime changes of the config aren't
+ * part of the startup.
+ *
+ * @ingroup base
+ */
+class StartupProfiler
+{
+public:
+	static void AddPhase(const String& name, double duration, size_t count = 0);
+
+	static void Finish();
+
+	static Dictionary::Ptr GetReport();
+	static void WriteReport(const String& path);
+
+private:
+	StartupProfiler();
+};
+
+/**
+ * Records the time from its construction to its destruction as a phase.
+ *
+ * @ingroup base
+ */
+class StartupPhase
+{
+public:
+	StartupPhase(String name, size_t count = 0);
+	~StartupPhase();
+
+	StartupPhase(const StartupPhase&) = delete;
+	StartupPhase& operator=(const StartupPhase&) = delete;
+
+	void SetCount(size_t count);
+
+private:
+	String m_Name;
+	size_t m_Count;
+	double m_Start;
+};
+
+}
+
+#endif /* STARTUPPROFILER_H */
@@ -7,6 +7,7 @@
 #include <boost/algorithm/string/case_conv.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <cctype>
 #include <ostream>
 
 using namespace icinga;
@@ -37,6 +38,10 @@ String::String(String&& other)
 	: m_Data(std::move(other.m_Data))
 { }
 
+String::String(boost::string_view data)
+	: m_Data(data.data(), data.size())
+{ }
+
 #ifndef _MSC_VER
 String::String(Value&& other)
 {
@@ -209,6 +214,19 @@ String String::SubStr(String::SizeType first, String::SizeType len) const
 	return m_Data.substr(first, len);
 }
 
+/**
+ * Returns a part of the string without copying it. The view is only valid
+ * as long as the string is neither modified nor destroyed.
+ *
+ * @param first The position of the first character.
+ * @param len The maximum number of characters.
+ * @returns The view.
+ */
+boost::string_view String::SubView(String::SizeType first, String::SizeType len) const
+{
+	return boost::string_view(m_Data).substr(first, len);
+}
+
 std::vector<String> String::Split(const char *separators) const
 {
 	std::vector<String> result;
@@ -216,6 +234,17 @@ std::vector<String> String::Split(const char *separators) const
 	return result;
 }
 
+/**
+ * Like Split(), but returns views into the string instead of copies.
+ *
+ * @param separators The characters to split at.
+ * @returns The views, see SubView().
+ */
+std::vector<boost::string_view> String::SplitView(const char *separators) const
+{
+	return icinga::SplitView(*this, separators);
+}
+
 void String::Replace(String::SizeType first, String::SizeType second, const String& str)
 {
 	m_Data.replace(first, second, str);
@@ -228,6 +257,16 @@ String String::Trim() const
 	return t;
 }
 
+/**
+ * Like Trim(), but returns a view into the string instead of a copy.
+ *
+ * @returns The view, see SubView().
+ */
+boost::string_view String::TrimView() const
+{
+	return icinga::TrimView(*this);
+}
+
 String String::ToLower() const
 {
 	String t = m_Data;
@@ -254,6 +293,11 @@ void String::Append(int count, char ch)
 	m_Data.append(count, ch);
 }
 
+void String::Append(boost::string_view str)
+{
+	m_Data.append(str.data(), str.size());
+}
+
 bool String::Contains(const String& str) const
 {
 	return (m_Data.find(str) != std::string::npos);
@@ -309,6 +353,49 @@ String::ConstReverseIterator String::REnd() const
 	return m_Data.rend();
 }
 
+/**
+ * Splits a string at any of the separators, keeping empty parts.
+ *
+ * @param str The string.
+ * @param separators The characters to split at.
+ * @returns Views into str, as many as there are separators plus one.
+ */
+std::vector<boost::string_view> icinga::SplitView(boost::string_view str, const char *separators)
+{
+	std::vector<boost::string_view> result;
+
+	for (size_t begin = 0;;) {
+		size_t end = str.find_first_of(separators, begin);
+
+		if (end == boost::string_view::npos) {
+			result.emplace_back(str.substr(begin));
+			break;
+		}
+
+		result.emplace_back(str.substr(begin, end - begin));
+		begin = end + 1;
+	}
+
+	return result;
+}
+
+/**
+ * Removes leading and trailing whitespace without copying the string.
+ *
+ * @param str The string.
+ * @returns A view into str.
+ */
+boost::string_view icinga::TrimView(boost::string_view str)
+{
+	while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front())))
+		str.remove_prefix(1);
+
+	while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back())))
+		str.remove_suffix(1);
+
+	return str;
+}
+
 std::ostream& icinga::operator<<(std::ostream& stream, const String& str)
 {
 	stream << str.GetData();
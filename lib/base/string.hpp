@@ -43,6 +43,7 @@ public:
 	String(String::SizeType n, char c);
 	String(const String& other);
 	String(String&& other);
+	explicit String(boost::string_view data);
 
 #ifndef _MSC_VER
 	String(Value&& other);
@@ -93,12 +94,15 @@ public:
 	SizeType FindLastOf(char ch, SizeType pos = NPos) const;
 
 	String SubStr(SizeType first, SizeType len = NPos) const;
+	boost::string_view SubView(SizeType first, SizeType len = NPos) const;
 
 	std::vector<String> Split(const char *separators) const;
+	std::vector<boost::string_view> SplitView(const char *separators) const;
 
 	void Replace(SizeType first, SizeType second, const String& str);
 
 	String Trim() const;
+	boost::string_view TrimView() const;
 
 	String ToLower() const;
 
@@ -107,6 +111,7 @@ public:
 	String Reverse() const;
 
 	void Append(int count, char ch);
+	void Append(boost::string_view str);
 
 	bool Contains(const String& str) const;
 
@@ -137,6 +142,9 @@ private:
 	std::string m_Data;
 };
 
+std::vector<boost::string_view> SplitView(boost::string_view str, const char *separators);
+boost::string_view TrimView(boost::string_view str);
+
 std::ostream& operator<<(std::ostream& stream, const String& str);
 std::istream& operator>>(std::istream& stream, String& str);
 
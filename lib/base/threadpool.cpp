@@ -1,13 +1,21 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/threadpool.hpp"
-#include <boost/thread/locks.hpp>
 
 using namespace icinga;
 
+/* The pool and queue index of the current worker thread, if any. */
+static thread_local ThreadPool *l_CurrentPool = nullptr;
+static thread_local size_t l_CurrentQueue = 0;
+
 ThreadPool::ThreadPool(size_t threads)
-	: m_Threads(threads), m_Pending(0)
+	: m_Threads(threads > 0 ? threads : 1), m_LowLatencyThreads(m_Threads / 8u > 0 ? m_Threads / 8u : 1),
+	m_Running(false), m_Stopping(false), m_Posting(0), m_Sleeping(0), m_LowLatencySleeping(0),
+	m_NextQueue(0), m_Pending(0), m_PendingLowLatency(0)
 {
+	for (size_t i = 0; i < m_Threads; i++)
+		m_Queues.emplace_back(new Queue());
+
 	Start();
 }
 
@@ -18,19 +26,216 @@ ThreadPool::~ThreadPool()
 
 void ThreadPool::Start()
 {
-	boost::unique_lock<decltype(m_Mutex)> lock (m_Mutex);
+	std::unique_lock<std::mutex> lock (m_StartStopMutex);
 
-	if (!m_Pool) {
-		m_Pool = decltype(m_Pool)(new boost::asio::thread_pool(m_Threads));
-	}
+	if (m_Running)
+		return;
+
+	m_Stopping = false;
+
+	for (size_t i = 0; i < m_Threads; i++)
+		m_Workers.emplace_back(&ThreadPool::WorkerThreadProc, this, i);
+
+	for (size_t i = 0; i < m_LowLatencyThreads; i++)
+		m_Workers.emplace_back(&ThreadPool::LowLatencyThreadProc, this);
+
+	m_Running = true;
 }
 
+/**
+ * Stops the worker threads after all queued work items have been processed.
+ */
 void ThreadPool::Stop()
 {
-	boost::unique_lock<decltype(m_Mutex)> lock (m_Mutex);
+	std::unique_lock<std::mutex> lock (m_StartStopMutex);
+
+	if (!m_Running)
+		return;
+
+	m_Running = false;
+
+	/* Wait for concurrent Post() calls which have seen m_Running == true. */
+	while (m_Posting.load())
+		std::this_thread::yield();
+
+	{
+		std::unique_lock<std::mutex> sleepLock (m_SleepMutex);
+		m_Stopping = true;
+		m_CV.notify_all();
+		m_LowLatencyCV.notify_all();
+	}
+
+	for (auto& worker : m_Workers)
+		worker.join();
+
+	m_Workers.clear();
+}
+
+bool ThreadPool::Enqueue(WorkFunction&& item, SchedulerPolicy policy)
+{
+	m_Posting.fetch_add(1);
+
+	if (!m_Running) {
+		m_Posting.fetch_sub(1);
+		return false;
+	}
+
+	if (policy == LowLatencyScheduler) {
+		{
+			std::unique_lock<std::mutex> lock (m_LowLatencyQueue.Mutex);
+			m_LowLatencyQueue.Items.emplace_back(std::move(item));
+		}
+
+		m_PendingLowLatency.fetch_add(1);
+		m_Pending.fetch_add(1);
+		m_Posting.fetch_sub(1);
+
+		if (m_LowLatencySleeping.load()) {
+			std::unique_lock<std::mutex> lock (m_SleepMutex);
+			m_LowLatencyCV.notify_one();
+		} else if (m_Sleeping.load()) {
+			/* All dedicated threads are busy, let a regular worker help out. */
+			std::unique_lock<std::mutex> lock (m_SleepMutex);
+			m_CV.notify_one();
+		}
+
+		return true;
+	}
+
+	size_t index;
+
+	if (l_CurrentPool == this)
+		index = l_CurrentQueue;
+	else
+		index = m_NextQueue.fetch_add(1) % m_Queues.size();
+
+	{
+		Queue& queue = *m_Queues[index];
+		std::unique_lock<std::mutex> lock (queue.Mutex);
+		queue.Items.emplace_back(std::move(item));
+	}
+
+	m_Pending.fetch_add(1);
+	m_Posting.fetch_sub(1);
+
+	if (m_Sleeping.load()) {
+		std::unique_lock<std::mutex> lock (m_SleepMutex);
+		m_CV.notify_one();
+	}
+
+	return true;
+}
+
+/**
+ * Takes a work item from the worker's own queue (oldest first) or steals one
+ * from another worker's queue (newest first).
+ */
+bool ThreadPool::TryDequeue(size_t index, WorkFunction& item)
+{
+	{
+		Queue& queue = *m_Queues[index];
+		std::unique_lock<std::mutex> lock (queue.Mutex);
+
+		if (!queue.Items.empty()) {
+			item = std::move(queue.Items.front());
+			queue.Items.pop_front();
+			m_Pending.fetch_sub(1);
+			return true;
+		}
+	}
+
+	for (size_t i = 1; i < m_Queues.size(); i++) {
+		Queue& victim = *m_Queues[(index + i) % m_Queues.size()];
+		std::unique_lock<std::mutex> lock (victim.Mutex, std::try_to_lock);
+
+		if (lock.owns_lock() && !victim.Items.empty()) {
+			item = std::move(victim.Items.back());
+			victim.Items.pop_back();
+			m_Pending.fetch_sub(1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ThreadPool::TryDequeueLowLatency(WorkFunction& item)
+{
+	if (!m_PendingLowLatency.load())
+		return false;
+
+	std::unique_lock<std::mutex> lock (m_LowLatencyQueue.Mutex);
+
+	if (m_LowLatencyQueue.Items.empty())
+		return false;
+
+	item = std::move(m_LowLatencyQueue.Items.front());
+	m_LowLatencyQueue.Items.pop_front();
+	m_PendingLowLatency.fetch_sub(1);
+	m_Pending.fetch_sub(1);
+
+	return true;
+}
+
+void ThreadPool::WorkerThreadProc(size_t index)
+{
+	l_CurrentPool = this;
+	l_CurrentQueue = index;
+
+	WorkFunction item;
+
+	for (;;) {
+		if (TryDequeue(index, item) || TryDequeueLowLatency(item)) {
+			item();
+			item = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock (m_SleepMutex);
+
+		/* Work items might be sitting in queues we've failed to lock. */
+		if (m_Pending.load())
+			continue;
+
+		if (m_Stopping)
+			break;
+
+		m_Sleeping.fetch_add(1);
+
+		/* Re-check after announcing ourselves, Enqueue() checks m_Sleeping after updating m_Pending. */
+		if (!m_Pending.load() && !m_Stopping)
+			m_CV.wait(lock);
+
+		m_Sleeping.fetch_sub(1);
+	}
+
+	l_CurrentPool = nullptr;
+}
+
+void ThreadPool::LowLatencyThreadProc()
+{
+	WorkFunction item;
+
+	for (;;) {
+		if (TryDequeueLowLatency(item)) {
+			item();
+			item = nullptr;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock (m_SleepMutex);
+
+		if (m_PendingLowLatency.load())
+			continue;
+
+		if (m_Stopping)
+			break;
+
+		m_LowLatencySleeping.fetch_add(1);
+
+		if (!m_PendingLowLatency.load() && !m_Stopping)
+			m_LowLatencyCV.wait(lock);
 
-	if (m_Pool) {
-		m_Pool->join();
-		m_Pool = nullptr;
+		m_LowLatencySleeping.fetch_sub(1);
 	}
 }
@@ -6,15 +6,16 @@
 #include "base/atomic.hpp"
 #include "base/exception.hpp"
 #include "base/logger.hpp"
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
+#include <deque>
 #include <exception>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <thread>
-#include <boost/asio/post.hpp>
-#include <boost/asio/thread_pool.hpp>
-#include <boost/thread/locks.hpp>
-#include <boost/thread/shared_mutex.hpp>
+#include <vector>
 #include <cstdint>
 
 namespace icinga
@@ -27,7 +28,12 @@ enum SchedulerPolicy
 };
 
 /**
- * A thread pool.
+ * A work-stealing thread pool.
+ *
+ * Every worker thread has its own queue. Work items posted by a worker thread
+ * go to its own queue, all other work items are distributed round-robin.
+ * Idle workers steal from the other workers' queues. Work items posted with
+ * LowLatencyScheduler go to a separate queue which has dedicated threads.
  *
  * @ingroup base
  */
@@ -43,37 +49,26 @@ public:
 	void Stop();
 
 	/**
-	 * Appends a work item to the work queue. Work items will be processed in FIFO order.
+	 * Appends a work item to a work queue. Work items of the same queue will be started in FIFO order.
 	 *
 	 * @param callback The callback function for the work item.
+	 * @param policy The scheduler policy.
 	 * @returns true if the item was queued, false otherwise.
 	 */
 	template<class T>
-	bool Post(T callback, SchedulerPolicy)
+	bool Post(T callback, SchedulerPolicy policy)
 	{
-		boost::shared_lock<decltype(m_Mutex)> lock (m_Mutex);
-
-		if (m_Pool) {
-			m_Pending.fetch_add(1);
-
-			boost::asio::post(*m_Pool, [this, callback]() {
-				m_Pending.fetch_sub(1);
-
-				try {
-					callback();
-				} catch (const std::exception& ex) {
-					Log(LogCritical, "ThreadPool")
-						<< "Exception thrown in event handler:\n"
-						<< DiagnosticInformation(ex);
-				} catch (...) {
-					Log(LogCritical, "ThreadPool", "Exception of unknown type thrown in event handler.");
-				}
-			});
-
-			return true;
-		} else {
-			return false;
-		}
+		return Enqueue([callback]() {
+			try {
+				callback();
+			} catch (const std::exception& ex) {
+				Log(LogCritical, "ThreadPool")
+					<< "Exception thrown in event handler:\n"
+					<< DiagnosticInformation(ex);
+			} catch (...) {
+				Log(LogCritical, "ThreadPool", "Exception of unknown type thrown in event handler.");
+			}
+		}, policy);
 	}
 
 	/**
@@ -87,10 +82,40 @@ public:
 	}
 
 private:
-	boost::shared_mutex m_Mutex;
-	std::unique_ptr<boost::asio::thread_pool> m_Pool;
+	struct Queue
+	{
+		std::mutex Mutex;
+		std::deque<WorkFunction> Items;
+	};
+
 	size_t m_Threads;
+	size_t m_LowLatencyThreads;
+
+	std::vector<std::unique_ptr<Queue> > m_Queues;
+	Queue m_LowLatencyQueue;
+	std::vector<std::thread> m_Workers;
+
+	std::mutex m_StartStopMutex;
+	std::mutex m_SleepMutex;
+	std::condition_variable m_CV;
+	std::condition_variable m_LowLatencyCV;
+
+	std::atomic<bool> m_Running;
+	std::atomic<bool> m_Stopping;
+	std::atomic<uint_fast32_t> m_Posting;
+	std::atomic<uint_fast32_t> m_Sleeping;
+	std::atomic<uint_fast32_t> m_LowLatencySleeping;
+	std::atomic<size_t> m_NextQueue;
 	Atomic<uint_fast64_t> m_Pending;
+	Atomic<uint_fast64_t> m_PendingLowLatency;
+
+	bool Enqueue(WorkFunction&& item, SchedulerPolicy policy);
+
+	bool TryDequeue(size_t queue, WorkFunction& item);
+	bool TryDequeueLowLatency(WorkFunction& item);
+
+	void WorkerThreadProc(size_t queue);
+	void LowLatencyThreadProc();
 };
 
 }
@@ -3,15 +3,19 @@
 #include "base/defer.hpp"
 #include "base/timer.hpp"
 #include "base/debug.hpp"
+#include "base/lockprofiler.hpp"
 #include "base/logger.hpp"
+#include "base/timingwheel.hpp"
 #include "base/utility.hpp"
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
 #include <chrono>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 using namespace icinga;
 
@@ -52,11 +56,145 @@ typedef boost::multi_index_container<
 	>
 > TimerSet;
 
+/**
+ * The set of scheduled timers. Must only be used while holding l_TimerMutex.
+ */
+class TimerQueue
+{
+public:
+	virtual ~TimerQueue() = default;
+
+	/**
+	 * Adds a timer. Its m_Next must already be set to "next".
+	 */
+	virtual void Insert(Timer *timer, double next) = 0;
+	virtual void Erase(Timer *timer) = 0;
+	virtual bool Empty() const = 0;
+
+	/**
+	 * Removes all timers which are due at "now" and appends them to "expired".
+	 */
+	virtual void PopExpired(double now, std::vector<Timer *>& expired) = 0;
+
+	/**
+	 * Returns when PopExpired() should be called next.
+	 */
+	virtual double GetNextDeadline() const = 0;
+
+	virtual std::vector<Timer *> GetTimers() const = 0;
+};
+
+/**
+ * Timers ordered by their next scheduled timestamp.
+ */
+class OrderedTimerQueue final : public TimerQueue
+{
+public:
+	void Insert(Timer *timer, double) override
+	{
+		m_Timers.insert(timer);
+	}
+
+	void Erase(Timer *timer) override
+	{
+		m_Timers.erase(timer);
+	}
+
+	bool Empty() const override
+	{
+		return m_Timers.empty();
+	}
+
+	void PopExpired(double now, std::vector<Timer *>& expired) override
+	{
+		auto& idx = boost::get<1>(m_Timers);
+
+		while (!idx.empty() && idx.begin()->GetNextUnlocked() - now <= 0.01) {
+			expired.push_back(*idx.begin());
+			idx.erase(idx.begin());
+		}
+	}
+
+	double GetNextDeadline() const override
+	{
+		return boost::get<1>(m_Timers).begin()->GetNextUnlocked();
+	}
+
+	std::vector<Timer *> GetTimers() const override
+	{
+		return std::vector<Timer *>(m_Timers.begin(), m_Timers.end());
+	}
+
+private:
+	TimerSet m_Timers;
+};
+
+/**
+ * Timers in a hierarchical timing wheel with O(1) arm/disarm.
+ */
+class WheelTimerQueue final : public TimerQueue
+{
+public:
+	WheelTimerQueue()
+		: m_Wheel(Utility::GetTime())
+	{ }
+
+	void Insert(Timer *timer, double next) override
+	{
+		m_Wheel.Insert(timer, next);
+	}
+
+	void Erase(Timer *timer) override
+	{
+		m_Wheel.Erase(timer);
+	}
+
+	bool Empty() const override
+	{
+		return m_Wheel.Empty();
+	}
+
+	void PopExpired(double now, std::vector<Timer *>& expired) override
+	{
+		m_Wheel.Advance(now, expired);
+	}
+
+	double GetNextDeadline() const override
+	{
+		return m_Wheel.GetNextDeadline();
+	}
+
+	std::vector<Timer *> GetTimers() const override
+	{
+		std::vector<Timer *> timers;
+		timers.reserve(m_Wheel.GetLength());
+
+		m_Wheel.ForEach([&timers](Timer *timer, double) { timers.push_back(timer); });
+
+		return timers;
+	}
+
+private:
+	TimingWheel<Timer *> m_Wheel;
+};
+
+/**
+ * Picks the timer engine. Set the environment variable ICINGA2_TIMER_ENGINE
+ * to "wheel" to use the timing wheel instead of the ordered index.
+ */
+static std::unique_ptr<TimerQueue> CreateTimerQueue()
+{
+	if (Utility::GetFromEnvironment("ICINGA2_TIMER_ENGINE") == "wheel")
+		return std::unique_ptr<TimerQueue>(new WheelTimerQueue());
+
+	return std::unique_ptr<TimerQueue>(new OrderedTimerQueue());
+}
+
 static std::mutex l_TimerMutex;
 static std::condition_variable l_TimerCV;
 static std::thread l_TimerThread;
 static bool l_StopTimerThread;
-static TimerSet l_Timers;
+static std::unique_ptr<TimerQueue> l_Timers (CreateTimerQueue());
 static int l_AliveTimers = 0;
 
 static Defer l_ShutdownTimersCleanlyOnExit (&Timer::Uninitialize);
@@ -71,7 +209,7 @@ Timer::~Timer()
 
 void Timer::Initialize()
 {
-	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	auto lock (LockProfiler::Lock(l_TimerMutex, "Timer"));
 
 	if (l_AliveTimers > 0) {
 		InitializeThread();
@@ -80,7 +218,7 @@ void Timer::Initialize()
 
 void Timer::Uninitialize()
 {
-	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	auto lock (LockProfiler::Lock(l_TimerMutex, "Timer"));
 
 	if (l_AliveTimers > 0) {
 		UninitializeThread();
@@ -131,7 +269,7 @@ void Timer::Call()
  */
 void Timer::SetInterval(double interval)
 {
-	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	auto lock (LockProfiler::Lock(l_TimerMutex, "Timer"));
 	m_Interval = interval;
 }
 
@@ -142,7 +280,7 @@ void Timer::SetInterval(double interval)
  */
 double Timer::GetInterval() const
 {
-	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	auto lock (LockProfiler::Lock(l_TimerMutex, "Timer"));
 	return m_Interval;
 }
 
@@ -152,7 +290,7 @@ double Timer::GetInterval() const
 void Timer::Start()
 {
 	{
-		std::unique_lock<std::mutex> lock(l_TimerMutex);
+		auto lock (LockProfiler::Lock(l_TimerMutex, "Timer"));
 		m_Started = true;
 
 		if (++l_AliveTimers == 1) {
@@ -171,14 +309,14 @@ void Timer::Stop(bool wait)
 	if (l_StopTimerThread)
 		return;
 
-	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	auto lock (LockProfiler::Lock(l_TimerMutex, "Timer"));
 
 	if (m_Started && --l_AliveTimers == 0) {
 		UninitializeThread();
 	}
 
 	m_Started = false;
-	l_Timers.erase(this);
+	l_Timers->Erase(this);
 
 	/* Notify the worker thread that we've disabled a timer. */
 	l_TimerCV.notify_all();
@@ -201,7 +339,7 @@ void Timer::Reschedule(double next)
  */
 void Timer::InternalReschedule(bool completed, double next)
 {
-	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	auto lock (LockProfiler::Lock(l_TimerMutex, "Timer"));
 
 	if (completed)
 		m_Running = false;
@@ -218,8 +356,8 @@ void Timer::InternalReschedule(bool completed, double next)
 
 	if (m_Started && !m_Running) {
 		/* Remove and re-add the timer to update the index. */
-		l_Timers.erase(this);
-		l_Timers.insert(this);
+		l_Timers->Erase(this);
+		l_Timers->Insert(this, m_Next);
 
 		/* Notify the worker that we've rescheduled a timer. */
 		l_TimerCV.notify_all();
@@ -233,7 +371,7 @@ void Timer::InternalReschedule(bool completed, double next)
  */
 double Timer::GetNext() const
 {
-	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	auto lock (LockProfiler::Lock(l_TimerMutex, "Timer"));
 	return m_Next;
 }
 
@@ -245,16 +383,13 @@ double Timer::GetNext() const
  */
 void Timer::AdjustTimers(double adjustment)
 {
-	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	auto lock (LockProfiler::Lock(l_TimerMutex, "Timer"));
 
 	double now = Utility::GetTime();
 
-	typedef boost::multi_index::nth_index<TimerSet, 1>::type TimerView;
-	TimerView& idx = boost::get<1>(l_Timers);
-
 	std::vector<Timer *> timers;
 
-	for (Timer *timer : idx) {
+	for (Timer *timer : l_Timers->GetTimers()) {
 		if (std::fabs(now - (timer->m_Next + adjustment)) <
 			std::fabs(now - timer->m_Next)) {
 			timer->m_Next += adjustment;
@@ -263,8 +398,8 @@ void Timer::AdjustTimers(double adjustment)
 	}
 
 	for (Timer *timer : timers) {
-		l_Timers.erase(timer);
-		l_Timers.insert(timer);
+		l_Timers->Erase(timer);
+		l_Timers->Insert(timer, timer->m_Next);
 	}
 
 	/* Notify the worker that we've rescheduled some timers. */
@@ -282,40 +417,39 @@ void Timer::TimerThreadProc()
 
 	Utility::SetThreadName("Timer Thread");
 
-	for (;;) {
-		std::unique_lock<std::mutex> lock(l_TimerMutex);
+	std::vector<Timer *> expired;
 
-		typedef boost::multi_index::nth_index<TimerSet, 1>::type NextTimerView;
-		NextTimerView& idx = boost::get<1>(l_Timers);
+	for (;;) {
+		auto lock (LockProfiler::Lock(l_TimerMutex, "Timer"));
 
 		/* Wait until there is at least one timer. */
-		while (idx.empty() && !l_StopTimerThread)
+		while (l_Timers->Empty() && !l_StopTimerThread)
 			l_TimerCV.wait(lock);
 
 		if (l_StopTimerThread)
 			break;
 
-		auto it = idx.begin();
-		Timer *timer = *it;
+		/* Remove all due timers from the queue so they don't get called again
+		 * until their current call is completed. */
+		expired.clear();
+		l_Timers->PopExpired(Utility::GetTime(), expired);
 
-		ch::time_point<ch::system_clock, ch::duration<double>> next (ch::duration<double>(timer->m_Next));
+		if (expired.empty()) {
+			ch::time_point<ch::system_clock, ch::duration<double>> next (ch::duration<double>(l_Timers->GetNextDeadline()));
 
-		if (next - ch::system_clock::now() > ch::duration<double>(0.01)) {
 			/* Wait for the next timer. */
 			l_TimerCV.wait_until(lock, next);
 
 			continue;
 		}
 
-		/* Remove the timer from the list so it doesn't get called again
-		 * until the current call is completed. */
-		l_Timers.erase(timer);
-
-		timer->m_Running = true;
+		for (Timer *timer : expired)
+			timer->m_Running = true;
 
 		lock.unlock();
 
-		/* Asynchronously call the timer. */
-		Utility::QueueAsyncCallback([timer]() { timer->Call(); });
+		/* Asynchronously call the timers. */
+		for (Timer *timer : expired)
+			Utility::QueueAsyncCallback([timer]() { timer->Call(); });
 	}
 }
@@ -0,0 +1,299 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+#include "base/i2-base.hpp"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A hierarchical timing wheel.
+ *
+ * Items are bucketed by the tick they are due in. Items which are further
+ * away live on coarser levels and are moved down ("cascaded") whenever the
+ * level below them completes a revolution. Arming and disarming an item is
+ * O(1), expiry is processed in batches.
+ *
+ * This class is not thread-safe, the caller is responsible for locking.
+ *
+ * @ingroup base
+ */
+template<typename T>
+class TimingWheel
+{
+public:
+	static constexpr int SlotBits = 8;
+	static constexpr uint64_t SlotCount = uint64_t(1) << SlotBits;
+	static constexpr int LevelCount = 4;
+
+	/**
+	 * Constructor for the TimingWheel class.
+	 *
+	 * @param now The current time.
+	 * @param tick The resolution of the wheel in seconds.
+	 */
+	TimingWheel(double now, double tick = 0.01)
+		: m_Tick(tick), m_Current(TickOf(now))
+	{ }
+
+	/**
+	 * Arms an item. The item must not be armed already.
+	 *
+	 * @param item The item.
+	 * @param when When the item should expire.
+	 */
+	void Insert(const T& item, double when)
+	{
+		Place(item, when);
+	}
+
+	/**
+	 * Disarms an item if it is armed.
+	 *
+	 * @param item The item.
+	 * @returns Whether the item was armed.
+	 */
+	bool Erase(const T& item)
+	{
+		auto it = m_Items.find(item);
+
+		if (it == m_Items.end())
+			return false;
+
+		GetList(it->second.Level, it->second.Slot).erase(it->second.Position);
+		m_Items.erase(it);
+
+		return true;
+	}
+
+	bool Empty() const
+	{
+		return m_Items.empty();
+	}
+
+	size_t GetLength() const
+	{
+		return m_Items.size();
+	}
+
+	/**
+	 * Advances the wheel to the specified time and collects all items which
+	 * have expired. Expired items are disarmed.
+	 *
+	 * @param now The current time.
+	 * @param expired Receives the expired items.
+	 */
+	void Advance(double now, std::vector<T>& expired)
+	{
+		uint64_t target = TickOf(now);
+
+		if (m_Items.empty()) {
+			m_Current = target;
+			return;
+		}
+
+		/* Rebuild the wheel if the clock went backwards or if we'd have to step
+		 * through lots of ticks, e.g. after a clock jump. */
+		if (target < m_Current || target - m_Current > SlotCount * SlotCount) {
+			Rebuild(target);
+		} else {
+			while (m_Current < target) {
+				m_Current++;
+
+				Cascade();
+
+				auto& slot = m_Slots[0][m_Current & (SlotCount - 1)];
+
+				for (auto& item : slot) {
+					m_Items.erase(item);
+					expired.push_back(item);
+				}
+
+				slot.clear();
+			}
+		}
+
+		for (auto& item : m_Due) {
+			m_Items.erase(item);
+			expired.push_back(item);
+		}
+
+		m_Due.clear();
+	}
+
+	/**
+	 * Returns the earliest point in time at which Advance() may return
+	 * expired items.
+	 *
+	 * @returns The timestamp.
+	 */
+	double GetNextDeadline() const
+	{
+		if (m_Items.empty())
+			return std::numeric_limits<double>::infinity();
+
+		if (!m_Due.empty())
+			return m_Current * m_Tick;
+
+		for (uint64_t i = 1; i < SlotCount; i++) {
+			uint64_t tick = m_Current + i;
+
+			/* The next revolution of the first level (and therefore a cascade) is due. */
+			if ((tick & (SlotCount - 1)) == 0)
+				return tick * m_Tick;
+
+			if (!m_Slots[0][tick & (SlotCount - 1)].empty())
+				return tick * m_Tick;
+		}
+
+		return (m_Current + SlotCount) * m_Tick;
+	}
+
+	/**
+	 * Retrieves when an armed item expires.
+	 *
+	 * @param item The item.
+	 * @param when Receives the expiry time.
+	 * @returns Whether the item is armed.
+	 */
+	bool GetExpiry(const T& item, double& when) const
+	{
+		auto it = m_Items.find(item);
+
+		if (it == m_Items.end())
+			return false;
+
+		when = it->second.When;
+		return true;
+	}
+
+	template<typename F>
+	void ForEach(F func) const
+	{
+		for (auto& kv : m_Items)
+			func(kv.first, kv.second.When);
+	}
+
+private:
+	struct Entry
+	{
+		double When;
+		int Level; /**< -1 for items which are already due */
+		size_t Slot;
+		typename std::list<T>::iterator Position;
+	};
+
+	double m_Tick;
+	uint64_t m_Current;
+
+	std::array<std::array<std::list<T>, SlotCount>, LevelCount> m_Slots;
+	std::list<T> m_Due;
+	std::unordered_map<T, Entry> m_Items;
+
+	uint64_t TickOf(double ts) const
+	{
+		if (ts <= 0)
+			return 0;
+
+		return static_cast<uint64_t>(std::floor(ts / m_Tick));
+	}
+
+	std::list<T>& GetList(int level, size_t slot)
+	{
+		if (level < 0)
+			return m_Due;
+
+		return m_Slots[level][slot];
+	}
+
+	void Place(const T& item, double when)
+	{
+		uint64_t due = TickOf(when);
+		int level = -1;
+		size_t slot = 0;
+
+		if (due > m_Current) {
+			uint64_t delta = due - m_Current;
+
+			for (level = 0; level < LevelCount - 1; level++) {
+				if (delta < (uint64_t(1) << (SlotBits * (level + 1))))
+					break;
+			}
+
+			/* Items beyond the range of the wheel wait on the last level and
+			 * are re-evaluated whenever their slot is cascaded. */
+			uint64_t maxDelta = (uint64_t(1) << (SlotBits * LevelCount)) - 1;
+
+			if (delta > maxDelta)
+				due = m_Current + maxDelta;
+
+			slot = (due >> (SlotBits * level)) & (SlotCount - 1);
+		}
+
+		auto& list = GetList(level, slot);
+		list.push_back(item);
+
+		m_Items[item] = Entry{when, level, slot, std::prev(list.end())};
+	}
+
+	void Cascade()
+	{
+		int levels = 0;
+
+		/* Figure out which levels have completed a revolution. */
+		for (int level = 1; level < LevelCount; level++) {
+			if ((m_Current & ((uint64_t(1) << (SlotBits * level)) - 1)) != 0)
+				break;
+
+			levels = level;
+		}
+
+		/* Higher levels first so their items can trickle down. */
+		for (int level = levels; level > 0; level--) {
+			std::list<T> items;
+			items.swap(m_Slots[level][(m_Current >> (SlotBits * level)) & (SlotCount - 1)]);
+
+			for (auto& item : items) {
+				auto it = m_Items.find(item);
+				double when = it->second.When;
+				m_Items.erase(it);
+				Place(item, when);
+			}
+		}
+	}
+
+	void Rebuild(uint64_t target)
+	{
+		std::vector<std::pair<T, double> > items;
+		items.reserve(m_Items.size());
+
+		for (auto& kv : m_Items)
+			items.emplace_back(kv.first, kv.second.When);
+
+		for (auto& level : m_Slots) {
+			for (auto& slot : level)
+				slot.clear();
+		}
+
+		m_Due.clear();
+		m_Items.clear();
+
+		m_Current = target;
+
+		for (auto& item : items)
+			Place(item.first, item.second);
+	}
+};
+
+}
+
+#endif /* TIMINGWHEEL_H */
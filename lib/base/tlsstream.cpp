@@ -18,13 +18,27 @@
 
 using namespace icinga;
 
-bool UnbufferedAsioTlsStream::IsVerifyOK() const
+bool UnbufferedAsioTlsStream::IsVerifyOK()
 {
+	/* The verify callback doesn't run for resumed sessions, they carry the original result. */
+	if (SSL_session_reused(native_handle()))
+		return SSL_get_verify_result(native_handle()) == X509_V_OK;
+
 	return m_VerifyOK;
 }
 
-String UnbufferedAsioTlsStream::GetVerifyError() const
+String UnbufferedAsioTlsStream::GetVerifyError()
 {
+	if (SSL_session_reused(native_handle())) {
+		long err = SSL_get_verify_result(native_handle());
+
+		if (err != X509_V_OK) {
+			std::ostringstream msgbuf;
+			msgbuf << "code " << err << ": " << X509_verify_cert_error_string(err);
+			return msgbuf.str();
+		}
+	}
+
 	return m_VerifyError;
 }
 
@@ -62,6 +76,11 @@ void UnbufferedAsioTlsStream::BeforeHandshake(handshake_type type)
 			serverName += ":" + environmentName;
 
 		SSL_set_tlsext_host_name(native_handle(), serverName.CStr());
+
+		auto session (TakeTlsClientSession(serverName));
+
+		if (session)
+			SSL_set_session(native_handle(), session.get());
 	}
 #endif /* SSL_CTRL_SET_TLSEXT_HOSTNAME */
 }
@@ -74,8 +74,8 @@ public:
 	{
 	}
 
-	bool IsVerifyOK() const;
-	String GetVerifyError() const;
+	bool IsVerifyOK();
+	String GetVerifyError();
 	std::shared_ptr<X509> GetPeerCertificate();
 
 	template<class... Args>
@@ -107,16 +107,28 @@ private:
 class AsioTlsStream : public boost::asio::buffered_stream<UnbufferedAsioTlsStream>
 {
 public:
+	/* One full TLS record. Asio's default of 1 KiB chops bulk transfers into
+	 * lots of small records and SSL_read()/SSL_write() calls. */
+	static constexpr std::size_t BufferSize = 16 * 1024;
+
 	inline
 	AsioTlsStream(boost::asio::io_context& ioContext, boost::asio::ssl::context& sslContext, const String& hostname = String())
 		: AsioTlsStream(UnbufferedAsioTlsStreamParams{ioContext, sslContext, hostname})
 	{
 	}
 
+	inline
+	boost::asio::io_context& GetIoContext()
+	{
+		return m_IoContext;
+	}
+
 private:
+	boost::asio::io_context& m_IoContext;
+
 	inline
 	AsioTlsStream(UnbufferedAsioTlsStreamParams init)
-		: buffered_stream(init)
+		: buffered_stream(init, BufferSize, BufferSize), m_IoContext(init.IoContext)
 	{
 	}
 };
@@ -11,7 +11,13 @@
 #include <boost/asio/ssl/context.hpp>
 #include <openssl/opensslv.h>
 #include <openssl/crypto.h>
+#include <openssl/ec.h>
+#include <algorithm>
+#include <ctime>
 #include <fstream>
+#include <map>
+#include <utility>
+#include <vector>
 
 namespace icinga
 {
@@ -20,6 +26,25 @@ static bool l_SSLInitialized = false;
 static std::mutex *l_Mutexes;
 static std::mutex l_RandomMutex;
 
+/* How long TLS sessions may be resumed. Resumed sessions skip certificate verification,
+ * this also limits how long a revoked certificate may be used afterwards.
+ */
+static const long l_TlsSessionTimeout = 24 * 60 * 60;
+
+static std::mutex l_ClientSessionsMutex;
+static std::map<String, std::shared_ptr<SSL_SESSION> > l_ClientSessions;
+
+/* Peer certificates which passed verification, see EnableTlsVerifyCache(). */
+struct TlsVerifyCache
+{
+	std::mutex Mutex;
+
+	/* The SHA256 fingerprint and whether the peer is a client, to when the entry expires. */
+	std::map<std::pair<std::string, bool>, time_t> Certificates;
+};
+
+static const size_t l_TlsVerifyCacheSize = 10000;
+
 String GetOpenSSLVersion()
 {
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
@@ -70,6 +95,29 @@ void InitializeOpenSSL()
 	l_SSLInitialized = true;
 }
 
+/**
+ * Remembers new client sessions by server name, so the next connection
+ * to the same server can resume them.
+ *
+ * @returns 1 if the session has been kept, 0 otherwise.
+ */
+static int StoreClientSession(SSL *ssl, SSL_SESSION *session)
+{
+	if (SSL_is_server(ssl))
+		return 0;
+
+	const char *serverName = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+
+	/* Our verify callback accepts any certificate, don't resume sessions with unverified peers. */
+	if (!serverName || SSL_get_verify_result(ssl) != X509_V_OK)
+		return 0;
+
+	std::unique_lock<std::mutex> lock (l_ClientSessionsMutex);
+	l_ClientSessions[serverName] = std::shared_ptr<SSL_SESSION>(session, SSL_SESSION_free);
+
+	return 1;
+}
+
 static void SetupSslContext(const Shared<boost::asio::ssl::context>::Ptr& context, const String& pubkey, const String& privkey, const String& cakey)
 {
 	char errbuf[256];
@@ -96,6 +144,11 @@ static void SetupSslContext(const Shared<boost::asio::ssl::context>::Ptr& contex
 	SSL_CTX_set_mode(sslContext, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 	SSL_CTX_set_session_id_context(sslContext, (const unsigned char *)"Icinga 2", 8);
 
+	// Let reconnecting peers resume their sessions instead of doing a full handshake
+	SSL_CTX_set_session_cache_mode(sslContext, SSL_SESS_CACHE_BOTH);
+	SSL_CTX_set_timeout(sslContext, l_TlsSessionTimeout);
+	SSL_CTX_sess_set_new_cb(sslContext, &StoreClientSession);
+
 	// Explicitly load ECC ciphers, required on el7 - https://github.com/Icinga/icinga2/issues/7247
 	// SSL_CTX_set_ecdh_auto is deprecated and removed in OpenSSL 1.1.x - https://github.com/openssl/openssl/issues/1437
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
@@ -186,6 +239,204 @@ Shared<boost::asio::ssl::context>::Ptr MakeAsioSslContext(const String& pubkey,
 	return context;
 }
 
+/**
+ * Takes the session of the last connection to the specified server, if any.
+ * A session is only handed out once, the new connection stores its own one.
+ *
+ * @param serverName The server name (SNI) of the connection.
+ * @returns The session or nullptr.
+ */
+std::shared_ptr<SSL_SESSION> TakeTlsClientSession(const String& serverName)
+{
+	std::unique_lock<std::mutex> lock (l_ClientSessionsMutex);
+
+	auto it (l_ClientSessions.find(serverName));
+
+	if (it == l_ClientSessions.end())
+		return nullptr;
+
+	auto session (std::move(it->second));
+	l_ClientSessions.erase(it);
+
+	return session;
+}
+
+/**
+ * Sets the keys for TLS session tickets of the specified SSL context. They
+ * are loaded from a file which is created if necessary, so peers are able
+ * to resume their sessions after a restart.
+ *
+ * @param context The SSL context.
+ * @param keyPath The path to the key file.
+ */
+void SetTlsSessionTicketKeys(const Shared<boost::asio::ssl::context>::Ptr& context, const String& keyPath)
+{
+	SSL_CTX *sslContext = context->native_handle();
+
+	long keyLength = SSL_CTX_get_tlsext_ticket_keys(sslContext, nullptr, 0);
+
+	if (keyLength <= 0)
+		return;
+
+	std::vector<unsigned char> keys (keyLength);
+	bool loaded = false;
+
+	{
+		std::ifstream fp (keyPath.CStr(), std::ifstream::binary);
+
+		if (fp) {
+			fp.read(reinterpret_cast<char *>(keys.data()), keyLength);
+			loaded = fp.gcount() == keyLength;
+		}
+	}
+
+	if (!loaded) {
+		{
+			std::unique_lock<std::mutex> lock (l_RandomMutex);
+
+			if (!RAND_bytes(keys.data(), keyLength)) {
+				char errbuf[256];
+				ERR_error_string_n(ERR_peek_error(), errbuf, sizeof errbuf);
+
+				Log(LogCritical, "SSL")
+					<< "Error for RAND_bytes: " << ERR_peek_error() << ", \"" << errbuf << "\"";
+				BOOST_THROW_EXCEPTION(openssl_error()
+					<< boost::errinfo_api_function("RAND_bytes")
+					<< errinfo_openssl_error(ERR_peek_error()));
+			}
+		}
+
+		String tempPath = keyPath + ".tmp";
+
+		std::ofstream fp (tempPath.CStr(), std::ofstream::binary | std::ofstream::trunc);
+		chmod(tempPath.CStr(), 0600);
+		fp.write(reinterpret_cast<const char *>(keys.data()), keyLength);
+		fp.close();
+
+		if (fp) {
+			Utility::RenameFile(tempPath, keyPath);
+		} else {
+			Log(LogWarning, "SSL")
+				<< "Cannot write TLS session ticket keys to '" << keyPath
+				<< "'. Sessions can't be resumed after a restart.";
+		}
+	}
+
+	SSL_CTX_set_tlsext_ticket_keys(sslContext, keys.data(), keyLength);
+}
+
+static void FreeTlsVerifyCache(void *, void *ptr, CRYPTO_EX_DATA *, int, long, void *)
+{
+	delete static_cast<TlsVerifyCache *>(ptr);
+}
+
+/**
+ * Returns when the first certificate of the verified chain expires.
+ */
+static time_t GetVerifiedChainExpiry(X509_STORE_CTX *storeCtx, time_t now)
+{
+	time_t expiry = now + l_TlsSessionTimeout;
+	STACK_OF(X509) *chain = X509_STORE_CTX_get1_chain(storeCtx);
+
+	if (!chain)
+		return now;
+
+	for (int i = 0; i < sk_X509_num(chain); i++) {
+		int days, seconds;
+
+		if (!ASN1_TIME_diff(&days, &seconds, nullptr, X509_get_notAfter(sk_X509_value(chain, i)))) {
+			expiry = now;
+			break;
+		}
+
+		expiry = std::min(expiry, now + days * 24 * 60 * 60 + seconds);
+	}
+
+	sk_X509_pop_free(chain, X509_free);
+
+	return expiry;
+}
+
+/* Replaces X509_verify_cert() during the handshake, see EnableTlsVerifyCache(). */
+static int VerifyCertificateCached(X509_STORE_CTX *storeCtx, void *arg)
+{
+	auto cache (static_cast<TlsVerifyCache *>(arg));
+	auto ssl (static_cast<SSL *>(X509_STORE_CTX_get_ex_data(storeCtx, SSL_get_ex_data_X509_STORE_CTX_idx())));
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	X509 *cert = X509_STORE_CTX_get0_cert(storeCtx);
+#else /* OPENSSL_VERSION_NUMBER >= 0x10100000L */
+	X509 *cert = storeCtx->cert;
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10100000L */
+
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	unsigned int digestLength = 0;
+
+	if (!ssl || !cert || !X509_digest(cert, EVP_sha256(), digest, &digestLength))
+		return X509_verify_cert(storeCtx);
+
+	std::pair<std::string, bool> key (std::string(reinterpret_cast<char *>(digest), digestLength), SSL_is_server(ssl));
+	time_t now = time(nullptr);
+
+	{
+		std::unique_lock<std::mutex> lock (cache->Mutex);
+		auto it (cache->Certificates.find(key));
+
+		if (it != cache->Certificates.end()) {
+			/* The store context's error is still X509_V_OK, that's the verify result of the connection. */
+			if (it->second > now)
+				return 1;
+
+			cache->Certificates.erase(it);
+		}
+	}
+
+	int rc = X509_verify_cert(storeCtx);
+
+	/* Our verify callback accepts any certificate, only the error tells whether it's valid. */
+	if (rc == 1 && X509_STORE_CTX_get_error(storeCtx) == X509_V_OK) {
+		time_t expiry = GetVerifiedChainExpiry(storeCtx, now);
+
+		if (expiry > now) {
+			std::unique_lock<std::mutex> lock (cache->Mutex);
+
+			if (cache->Certificates.size() >= l_TlsVerifyCacheSize)
+				cache->Certificates.clear();
+
+			cache->Certificates[std::move(key)] = expiry;
+		}
+	}
+
+	return rc;
+}
+
+/**
+ * Lets the specified SSL context remember peer certificates which passed
+ * verification, so reconnecting peers don't need to be verified again.
+ * An entry is kept until a certificate of the chain expires, but no longer
+ * than a session may be resumed. The cache belongs to the context, a new
+ * context (e.g. with a new CA or CRL) starts with an empty one.
+ *
+ * @param context The SSL context.
+ */
+void EnableTlsVerifyCache(const Shared<boost::asio::ssl::context>::Ptr& context)
+{
+	static int cacheIndex = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, &FreeTlsVerifyCache);
+
+	if (cacheIndex < 0)
+		return;
+
+	SSL_CTX *sslContext = context->native_handle();
+	auto cache (new TlsVerifyCache());
+
+	if (!SSL_CTX_set_ex_data(sslContext, cacheIndex, cache)) {
+		delete cache;
+		return;
+	}
+
+	SSL_CTX_set_cert_verify_callback(sslContext, &VerifyCertificateCached, cache);
+}
+
 /**
  * Set the cipher list to the specified SSL context.
  * @param context The ssl context.
@@ -374,36 +625,121 @@ std::shared_ptr<X509> GetX509Certificate(const String& pemfile)
 	return std::shared_ptr<X509>(cert, X509_free);
 }
 
-int MakeX509CSR(const String& cn, const String& keyfile, const String& csrfile, const String& certfile, bool ca)
+/**
+ * Parses the name of a private key type as given on the command line.
+ *
+ * @param name One of "rsa", "ecdsa" (P-256) and "ed25519"
+ * @returns The key type.
+ */
+PrivateKeyType ParsePrivateKeyType(const String& name)
+{
+	if (name == "rsa")
+		return PrivateKeyRSA;
+
+	if (name == "ecdsa")
+		return PrivateKeyECDSA;
+
+	if (name == "ed25519")
+		return PrivateKeyEd25519;
+
+	BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid key type '" + name + "', must be one of: rsa, ecdsa, ed25519"));
+}
+
+static EVP_PKEY *GeneratePrivateKey(PrivateKeyType keyType)
 {
 	char errbuf[256];
+	const char *function = nullptr;
+	EVP_PKEY *key = EVP_PKEY_new();
 
-	InitializeOpenSSL();
+	switch (keyType) {
+		case PrivateKeyRSA:
+			{
+				RSA *rsa = RSA_new();
+				BIGNUM *e = BN_new();
 
-	RSA *rsa = RSA_new();
-	BIGNUM *e = BN_new();
+				if (rsa && e && BN_set_word(e, RSA_F4) && RSA_generate_key_ex(rsa, 4096, e, nullptr) && EVP_PKEY_assign_RSA(key, rsa)) {
+					rsa = nullptr;
+				} else {
+					function = "RSA_generate_key";
+				}
 
-	if (!rsa || !e) {
-		ERR_error_string_n(ERR_peek_error(), errbuf, sizeof errbuf);
-		Log(LogCritical, "SSL")
-			<< "Error while creating RSA key: " << ERR_peek_error() << ", \"" << errbuf << "\"";
-		BOOST_THROW_EXCEPTION(openssl_error()
-			<< boost::errinfo_api_function("RSA_generate_key")
-			<< errinfo_openssl_error(ERR_peek_error()));
-	}
+				RSA_free(rsa);
+				BN_free(e);
+			}
+			break;
+
+		case PrivateKeyECDSA:
+			{
+				EC_KEY *ec = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+
+				if (ec) {
+					/* Only named curves are supported by TLS. */
+					EC_KEY_set_asn1_flag(ec, OPENSSL_EC_NAMED_CURVE);
+				}
+
+				if (ec && EC_KEY_generate_key(ec) && EVP_PKEY_assign_EC_KEY(key, ec)) {
+					ec = nullptr;
+				} else {
+					function = "EC_KEY_generate_key";
+				}
 
-	BN_set_word(e, RSA_F4);
+				EC_KEY_free(ec);
+			}
+			break;
+
+		case PrivateKeyEd25519:
+#ifdef EVP_PKEY_ED25519
+			{
+				EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, nullptr);
+
+				EVP_PKEY_free(key);
+				key = nullptr;
+
+				if (!ctx || EVP_PKEY_keygen_init(ctx) <= 0 || EVP_PKEY_keygen(ctx, &key) <= 0)
+					function = "EVP_PKEY_keygen";
+
+				EVP_PKEY_CTX_free(ctx);
+			}
+			break;
+#else /* EVP_PKEY_ED25519 */
+			EVP_PKEY_free(key);
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Ed25519 keys require OpenSSL 1.1.1 or later."));
+#endif /* EVP_PKEY_ED25519 */
+	}
 
-	if (!RSA_generate_key_ex(rsa, 4096, e, nullptr)) {
+	if (function) {
 		ERR_error_string_n(ERR_peek_error(), errbuf, sizeof errbuf);
 		Log(LogCritical, "SSL")
-			<< "Error while creating RSA key: " << ERR_peek_error() << ", \"" << errbuf << "\"";
+			<< "Error while creating private key: " << ERR_peek_error() << ", \"" << errbuf << "\"";
+
+		EVP_PKEY_free(key);
+
 		BOOST_THROW_EXCEPTION(openssl_error()
-			<< boost::errinfo_api_function("RSA_generate_key")
+			<< boost::errinfo_api_function(function)
 			<< errinfo_openssl_error(ERR_peek_error()));
 	}
 
-	BN_free(e);
+	return key;
+}
+
+/* Ed25519 signs the data itself rather than a digest of it. */
+static const EVP_MD *GetSignatureDigest(EVP_PKEY *key)
+{
+#ifdef EVP_PKEY_ED25519
+	if (EVP_PKEY_id(key) == EVP_PKEY_ED25519)
+		return nullptr;
+#endif /* EVP_PKEY_ED25519 */
+
+	return EVP_sha256();
+}
+
+int MakeX509CSR(const String& cn, const String& keyfile, const String& csrfile, const String& certfile, bool ca, PrivateKeyType keyType)
+{
+	char errbuf[256];
+
+	InitializeOpenSSL();
+
+	EVP_PKEY *key = GeneratePrivateKey(keyType);
 
 	Log(LogInformation, "base")
 		<< "Writing private key to '" << keyfile << "'.";
@@ -413,19 +749,29 @@ int MakeX509CSR(const String& cn, const String& keyfile, const String& csrfile,
 	if (!bio) {
 		ERR_error_string_n(ERR_peek_error(), errbuf, sizeof errbuf);
 		Log(LogCritical, "SSL")
-			<< "Error while opening private RSA key file '" << keyfile << "': " << ERR_peek_error() << ", \"" << errbuf << "\"";
+			<< "Error while opening private key file '" << keyfile << "': " << ERR_peek_error() << ", \"" << errbuf << "\"";
 		BOOST_THROW_EXCEPTION(openssl_error()
 			<< boost::errinfo_api_function("BIO_new_file")
 			<< errinfo_openssl_error(ERR_peek_error())
 			<< boost::errinfo_file_name(keyfile));
 	}
 
-	if (!PEM_write_bio_RSAPrivateKey(bio, rsa, nullptr, nullptr, 0, nullptr, nullptr)) {
+	int written;
+
+	/* RSA and EC keys are written in their traditional format, Ed25519 keys only exist as PKCS #8. */
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	if (keyType != PrivateKeyEd25519)
+		written = PEM_write_bio_PrivateKey_traditional(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+	else
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10100000L */
+		written = PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+
+	if (!written) {
 		ERR_error_string_n(ERR_peek_error(), errbuf, sizeof errbuf);
 		Log(LogCritical, "SSL")
-			<< "Error while writing private RSA key to file '" << keyfile << "': " << ERR_peek_error() << ", \"" << errbuf << "\"";
+			<< "Error while writing private key to file '" << keyfile << "': " << ERR_peek_error() << ", \"" << errbuf << "\"";
 		BOOST_THROW_EXCEPTION(openssl_error()
-			<< boost::errinfo_api_function("PEM_write_bio_RSAPrivateKey")
+			<< boost::errinfo_api_function("PEM_write_bio_PrivateKey")
 			<< errinfo_openssl_error(ERR_peek_error())
 			<< boost::errinfo_file_name(keyfile));
 	}
@@ -436,9 +782,6 @@ int MakeX509CSR(const String& cn, const String& keyfile, const String& csrfile,
 	chmod(keyfile.CStr(), 0600);
 #endif /* _WIN32 */
 
-	EVP_PKEY *key = EVP_PKEY_new();
-	EVP_PKEY_assign_RSA(key, rsa);
-
 	if (!certfile.IsEmpty()) {
 		X509_NAME *subject = X509_NAME_new();
 		X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, (unsigned char *)cn.CStr(), -1, -1, 0);
@@ -499,7 +842,7 @@ int MakeX509CSR(const String& cn, const String& keyfile, const String& csrfile,
 			}
 		}
 
-		X509_REQ_sign(req, key, EVP_sha256());
+		X509_REQ_sign(req, key, GetSignatureDigest(key));
 
 		Log(LogInformation, "base")
 			<< "Writing certificate signing request to '" << csrfile << "'.";
@@ -614,7 +957,7 @@ std::shared_ptr<X509> CreateCert(EVP_PKEY *pubkey, X509_NAME *subject, X509_NAME
 		}
 	}
 
-	X509_sign(cert, cakey, EVP_sha256());
+	X509_sign(cert, cakey, GetSignatureDigest(cakey));
 
 	return std::shared_ptr<X509>(cert, X509_free);
 }
@@ -632,8 +975,6 @@ std::shared_ptr<X509> CreateCertIcingaCA(EVP_PKEY *pubkey, X509_NAME *subject)
 
 	String cakeyfile = cadir + "/ca.key";
 
-	RSA *rsa;
-
 	BIO *cakeybio = BIO_new_file(const_cast<char *>(cakeyfile.CStr()), "r");
 
 	if (!cakeybio) {
@@ -643,12 +984,12 @@ std::shared_ptr<X509> CreateCertIcingaCA(EVP_PKEY *pubkey, X509_NAME *subject)
 		return std::shared_ptr<X509>();
 	}
 
-	rsa = PEM_read_bio_RSAPrivateKey(cakeybio, nullptr, nullptr, nullptr);
+	std::shared_ptr<EVP_PKEY> privkey (PEM_read_bio_PrivateKey(cakeybio, nullptr, nullptr, nullptr), EVP_PKEY_free);
 
-	if (!rsa) {
+	if (!privkey) {
 		ERR_error_string_n(ERR_peek_error(), errbuf, sizeof errbuf);
 		Log(LogCritical, "SSL")
-			<< "Could not read RSA key from CA key file '" << cakeyfile << "': " << ERR_peek_error() << ", \"" << errbuf << "\"";
+			<< "Could not read private key from CA key file '" << cakeyfile << "': " << ERR_peek_error() << ", \"" << errbuf << "\"";
 		return std::shared_ptr<X509>();
 	}
 
@@ -658,10 +999,7 @@ std::shared_ptr<X509> CreateCertIcingaCA(EVP_PKEY *pubkey, X509_NAME *subject)
 
 	std::shared_ptr<X509> cacert = GetX509Certificate(cacertfile);
 
-	EVP_PKEY *privkey = EVP_PKEY_new();
-	EVP_PKEY_assign_RSA(privkey, rsa);
-
-	return CreateCert(pubkey, subject, X509_get_subject_name(cacert.get()), privkey, false);
+	return CreateCert(pubkey, subject, X509_get_subject_name(cacert.get()), privkey.get(), false);
 }
 
 std::shared_ptr<X509> CreateCertIcingaCA(const std::shared_ptr<X509>& cert)
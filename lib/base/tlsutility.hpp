@@ -24,6 +24,18 @@
 namespace icinga
 {
 
+/**
+ * The type of newly generated private keys.
+ *
+ * @ingroup base
+ */
+enum PrivateKeyType
+{
+	PrivateKeyRSA,
+	PrivateKeyECDSA,
+	PrivateKeyEd25519
+};
+
 void InitializeOpenSSL();
 
 String GetOpenSSLVersion();
@@ -33,10 +45,15 @@ void AddCRLToSSLContext(const Shared<boost::asio::ssl::context>::Ptr& context, c
 void AddCRLToSSLContext(X509_STORE *x509_store, const String& crlPath);
 void SetCipherListToSSLContext(const Shared<boost::asio::ssl::context>::Ptr& context, const String& cipherList);
 void SetTlsProtocolminToSSLContext(const Shared<boost::asio::ssl::context>::Ptr& context, const String& tlsProtocolmin);
+void SetTlsSessionTicketKeys(const Shared<boost::asio::ssl::context>::Ptr& context, const String& keyPath);
+void EnableTlsVerifyCache(const Shared<boost::asio::ssl::context>::Ptr& context);
+std::shared_ptr<SSL_SESSION> TakeTlsClientSession(const String& serverName);
 
 String GetCertificateCN(const std::shared_ptr<X509>& certificate);
 std::shared_ptr<X509> GetX509Certificate(const String& pemfile);
-int MakeX509CSR(const String& cn, const String& keyfile, const String& csrfile = String(), const String& certfile = String(), bool ca = false);
+PrivateKeyType ParsePrivateKeyType(const String& name);
+int MakeX509CSR(const String& cn, const String& keyfile, const String& csrfile = String(), const String& certfile = String(), bool ca = false,
+	PrivateKeyType keyType = PrivateKeyRSA);
 std::shared_ptr<X509> CreateCert(EVP_PKEY *pubkey, X509_NAME *subject, X509_NAME *issuer, EVP_PKEY *cakey, bool ca);
 
 String GetIcingaCADir();
@@ -0,0 +1,181 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/tracing.hpp"
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <random>
+
+using namespace icinga;
+
+EventBus<void (const TraceSpan&)> Tracing::OnSpanEnded;
+
+static std::atomic<double> l_SampleRatio (0);
+
+static std::mt19937_64& GetRandomEngine()
+{
+	static thread_local std::mt19937_64 engine (std::random_device{}());
+	return engine;
+}
+
+bool TraceContext::IsValid() const
+{
+	return !TraceId.IsEmpty() && !SpanId.IsEmpty();
+}
+
+/**
+ * Formats the context as W3C traceparent, e.g. "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01".
+ * Only sampled work has a context, so the sampled flag is always set.
+ *
+ * @returns The traceparent or an empty string if the context is empty.
+ */
+String TraceContext::ToTraceparent() const
+{
+	if (!IsValid())
+		return String();
+
+	return "00-" + TraceId + "-" + SpanId + "-01";
+}
+
+static bool IsLowerHex(const String& str)
+{
+	for (char ch : str) {
+		if (!isdigit(static_cast<unsigned char>(ch)) && (ch < 'a' || ch > 'f'))
+			return false;
+	}
+
+	return true;
+}
+
+/* All-zero IDs are invalid. */
+static bool IsValidId(const String& id)
+{
+	return IsLowerHex(id) && id.FindFirstNotOf('0') != String::NPos;
+}
+
+/**
+ * Parses a W3C traceparent.
+ *
+ * @param traceparent The traceparent.
+ * @returns The context or an empty one if the traceparent isn't valid or not sampled.
+ */
+TraceContext TraceContext::FromTraceparent(const String& traceparent)
+{
+	/* version "-" trace-id "-" parent-id "-" trace-flags */
+	if (traceparent.GetLength() < 55 || traceparent[2] != '-' || traceparent[35] != '-' || traceparent[52] != '-')
+		return TraceContext();
+
+	String version = traceparent.SubStr(0, 2);
+	String traceId = traceparent.SubStr(3, 32);
+	String spanId = traceparent.SubStr(36, 16);
+	String flags = traceparent.SubStr(53, 2);
+
+	if (!IsLowerHex(version) || version == "ff" || !IsValidId(traceId) || !IsValidId(spanId) || !IsLowerHex(flags))
+		return TraceContext();
+
+	/* Only sampled traces are propagated. */
+	if (!(std::stoul(flags.GetData(), nullptr, 16) & 1))
+		return TraceContext();
+
+	return TraceContext{traceId, spanId};
+}
+
+/**
+ * Sets the ratio of checks which start a trace.
+ *
+ * @param ratio Between 0 (none) and 1 (all).
+ */
+void Tracing::SetSampleRatio(double ratio)
+{
+	l_SampleRatio.store(ratio);
+}
+
+double Tracing::GetSampleRatio()
+{
+	return l_SampleRatio.load();
+}
+
+/**
+ * Starts a new trace according to the sample ratio.
+ *
+ * @returns The context of the root span or an empty one if this one isn't sampled.
+ */
+TraceContext Tracing::StartTrace()
+{
+	double ratio = l_SampleRatio.load(std::memory_order_relaxed);
+
+	if (ratio <= 0 || (ratio < 1 && std::uniform_real_distribution<double>(0, 1)(GetRandomEngine()) >= ratio))
+		return TraceContext();
+
+	return TraceContext{NewId(16), NewId(8)};
+}
+
+/**
+ * Whether spans of traces started elsewhere should be emitted.
+ */
+bool Tracing::IsExporting()
+{
+	return !OnSpanEnded.empty();
+}
+
+/**
+ * Hands a finished span to the exporters.
+ *
+ * @param context The trace and the ID of the span.
+ * @param parentSpanId The ID of the parent span, empty for the root span.
+ * @param name The name of the span.
+ * @param start The start of the span.
+ * @param end The end of the span.
+ * @param attributes Additional attributes of the span.
+ */
+void Tracing::EmitSpan(const TraceContext& context, const String& parentSpanId, const String& name,
+	double start, double end, const Dictionary::Ptr& attributes)
+{
+	if (!context.IsValid())
+		return;
+
+	OnSpanEnded(TraceSpan{context.TraceId, context.SpanId, parentSpanId, name, start, end, attributes});
+}
+
+/**
+ * Hands a finished span with a new ID to the exporters.
+ *
+ * @param parent The context of the parent span.
+ */
+void Tracing::EmitChildSpan(const TraceContext& parent, const String& name,
+	double start, double end, const Dictionary::Ptr& attributes)
+{
+	if (!parent.IsValid())
+		return;
+
+	EmitSpan(TraceContext{parent.TraceId, NewId(8)}, parent.SpanId, name, start, end, attributes);
+}
+
+/**
+ * Creates a random, non-zero ID in lowercase hex.
+ *
+ * @param bytes The length of the ID in bytes.
+ */
+String Tracing::NewId(size_t bytes)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	auto& engine (GetRandomEngine());
+	String id;
+
+	do {
+		id.Clear();
+
+		for (size_t i = 0; i < bytes; i += 8) {
+			uint_fast64_t value = engine();
+
+			for (size_t j = 0; j < 8 && i + j < bytes; j++) {
+				id += hex[(value >> 4) & 0xf];
+				id += hex[value & 0xf];
+				value >>= 8;
+			}
+		}
+	} while (!IsValidId(id));
+
+	return id;
+}
@@ -0,0 +1,81 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef TRACING_H
+#define TRACING_H
+
+#include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
+#include "base/eventbus.hpp"
+#include "base/string.hpp"
+
+namespace icinga
+{
+
+/**
+ * Identifies a span of a sampled trace. Unsampled work has an empty context.
+ *
+ * It's propagated in the "trace" attribute of JSON-RPC messages in the W3C
+ * traceparent format (https://www.w3.org/TR/trace-context/).
+ *
+ * @ingroup base
+ */
+struct TraceContext
+{
+	String TraceId;
+	String SpanId;
+
+	bool IsValid() const;
+
+	String ToTraceparent() const;
+	static TraceContext FromTraceparent(const String& traceparent);
+};
+
+/**
+ * A finished span, i.e. one stage of a trace.
+ *
+ * @ingroup base
+ */
+struct TraceSpan
+{
+	String TraceId;
+	String SpanId;
+	String ParentSpanId;
+	String Name;
+	double Start;
+	double End;
+	Dictionary::Ptr Attributes;
+};
+
+/**
+ * Starts sampled traces and hands finished spans to the exporters.
+ *
+ * Nothing is traced unless an exporter (e.g. the OtlpTraceWriter) set a
+ * sample ratio, so the cost for unsampled work is a single check.
+ *
+ * @ingroup base
+ */
+class Tracing
+{
+public:
+	static EventBus<void (const TraceSpan&)> OnSpanEnded;
+
+	static void SetSampleRatio(double ratio);
+	static double GetSampleRatio();
+
+	static TraceContext StartTrace();
+	static bool IsExporting();
+
+	static void EmitSpan(const TraceContext& context, const String& parentSpanId, const String& name,
+		double start, double end, const Dictionary::Ptr& attributes = nullptr);
+	static void EmitChildSpan(const TraceContext& parent, const String& name,
+		double start, double end, const Dictionary::Ptr& attributes = nullptr);
+
+private:
+	Tracing();
+
+	static String NewId(size_t bytes);
+};
+
+}
+
+#endif /* TRACING_H */
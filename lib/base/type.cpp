@@ -4,6 +4,7 @@
 #include "base/scriptglobal.hpp"
 #include "base/namespace.hpp"
 #include "base/objectlock.hpp"
+#include <cstring>
 
 using namespace icinga;
 
@@ -85,6 +86,52 @@ Object::Ptr Type::Instantiate(const std::vector<Value>& args) const
 	return factory(args);
 }
 
+/**
+ * Returns the fields which Serialize() includes for the specified attribute
+ * types, so that it doesn't have to look at every field's info each time.
+ * The lists never change and live as long as the type.
+ *
+ * @param attributeTypes The attribute types, 0 for all fields
+ * @returns The fields in the order of their IDs, nullptr if the attribute types
+ *          contain other attributes than FAEphemeral, FAConfig and FAState
+ */
+const std::vector<Type::SerializedField> *Type::GetSerializedFields(int attributeTypes) const
+{
+	const int cachedTypes = FAEphemeral | FAConfig | FAState;
+
+	if (attributeTypes & ~cachedTypes)
+		return nullptr;
+
+	auto& cached (m_SerializedFields[attributeTypes]);
+	auto *fields = cached.load(std::memory_order_acquire);
+
+	if (fields)
+		return fields;
+
+	auto *built = new std::vector<SerializedField>();
+	int fieldCount = GetFieldCount();
+
+	for (int i = 0; i < fieldCount; i++) {
+		Field field = GetFieldInfo(i);
+
+		if (attributeTypes != 0 && (field.Attributes & attributeTypes) == 0)
+			continue;
+
+		if (strcmp(field.Name, "type") == 0)
+			continue;
+
+		built->push_back({ i, field.Name });
+	}
+
+	/* Another thread may have been faster, the lists are identical. */
+	if (!cached.compare_exchange_strong(fields, built, std::memory_order_acq_rel)) {
+		delete built;
+		return fields;
+	}
+
+	return built;
+}
+
 bool Type::IsAbstract() const
 {
 	return ((GetAttributes() & TAAbstract) != 0);
@@ -7,6 +7,7 @@
 #include "base/string.hpp"
 #include "base/object.hpp"
 #include "base/initialize.hpp"
+#include <atomic>
 #include <vector>
 
 namespace icinga
@@ -69,6 +70,17 @@ public:
 
 	String GetPluralName() const;
 
+	/**
+	 * A field which Serialize() includes, see GetSerializedFields().
+	 */
+	struct SerializedField
+	{
+		int ID;
+		const char *Name;
+	};
+
+	const std::vector<SerializedField> *GetSerializedFields(int attributeTypes) const;
+
 	Object::Ptr Instantiate(const std::vector<Value>& args) const;
 
 	bool IsAssignableFrom(const Type::Ptr& other) const;
@@ -96,6 +108,9 @@ protected:
 
 private:
 	Object::Ptr m_Prototype;
+
+	/* Indexed by the combination of FAEphemeral, FAConfig and FAState, built on first use. */
+	mutable std::atomic<const std::vector<SerializedField> *> m_SerializedFields[8] {};
 };
 
 class TypeType final : public Type
@@ -111,7 +111,7 @@ String Utility::GetSymbolName(const void *addr)
 #ifdef HAVE_DLADDR
 	Dl_info dli;
 
-	if (dladdr(const_cast<void *>(addr), &dli) > 0)
+	if (dladdr(const_cast<void *>(addr), &dli) > 0 && dli.dli_sname)
 		return dli.dli_sname;
 #endif /* HAVE_DLADDR */
 
@@ -139,6 +139,38 @@ String Utility::GetSymbolName(const void *addr)
 	return "(unknown function)";
 }
 
+/**
+ * Resolves a code address, e.g. a return address, to its function. The daemon is linked
+ * without exporting its symbols, those addresses are returned as module offsets for
+ * addr2line instead.
+ *
+ * @param addr The code address.
+ * @returns The demangled function name or e.g. "icinga2+0x4a3f1c".
+ */
+String Utility::GetCallSiteName(const void *addr)
+{
+	if (!addr)
+		return "(unknown)";
+
+#ifdef HAVE_DLADDR
+	Dl_info dli;
+
+	if (dladdr(const_cast<void *>(addr), &dli) > 0) {
+		if (dli.dli_sname)
+			return DemangleSymbolName(dli.dli_sname);
+
+		if (dli.dli_fname) {
+			std::ostringstream msgbuf;
+			msgbuf << BaseName(dli.dli_fname) << "+0x" << std::hex
+				<< (reinterpret_cast<uintptr_t>(addr) - reinterpret_cast<uintptr_t>(dli.dli_fbase));
+			return msgbuf.str();
+		}
+	}
+#endif /* HAVE_DLADDR */
+
+	return DemangleSymbolName(GetSymbolName(addr));
+}
+
 /**
  * Performs wildcard pattern matching.
  *
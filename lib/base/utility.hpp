@@ -46,6 +46,7 @@ public:
 	static String DemangleSymbolName(const String& sym);
 	static String GetTypeName(const std::type_info& ti);
 	static String GetSymbolName(const void *addr);
+	static String GetCallSiteName(const void *addr);
 
 	static bool Match(const String& pattern, const String& text);
 	static bool CidrMatch(const String& pattern, const String& ip);
@@ -4,10 +4,14 @@
 #define VALUE_H
 
 #include "base/object.hpp"
+#include "base/objectpool.hpp"
 #include "base/string.hpp"
-#include <boost/variant/variant.hpp>
 #include <boost/variant/get.hpp>
 #include <boost/throw_exception.hpp>
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <utility>
 
 namespace icinga
 {
@@ -28,15 +32,37 @@ enum ValueType
 	ValueObject = 4
 };
 
+/**
+ * The storage of a string Value. It is shared by all copies of the Value
+ * and never modified, so copying a string Value only copies a pointer.
+ *
+ * @ingroup base
+ */
+struct ValueStringData final
+{
+	DECLARE_OBJECT_POOL();
+
+	std::atomic<uint_fast32_t> References;
+	const String Data;
+
+	template<typename T>
+	explicit ValueStringData(T&& data)
+		: References(1), Data(std::forward<T>(data))
+	{ }
+};
+
 /**
  * A type that can hold an arbitrary value.
  *
+ * The value is stored in a tagged union of 16 bytes. Strings are stored out
+ * of line in a shared ValueStringData.
+ *
  * @ingroup base
  */
 class Value
 {
 public:
-	Value() = default;
+	Value();
 	Value(std::nullptr_t);
 	Value(int value);
 	Value(unsigned int value);
@@ -53,6 +79,7 @@ public:
 	Value(Value&& other);
 	Value(Object *value);
 	Value(const intrusive_ptr<Object>& value);
+	~Value();
 
 	template<typename T>
 	Value(const intrusive_ptr<T>& value)
@@ -135,19 +162,186 @@ public:
 	Value Clone() const;
 
 	template<typename T>
-	const T& Get() const
-	{
-		return boost::get<T>(m_Value);
-	}
+	const T& Get() const;
 
 private:
-	boost::variant<boost::blank, double, bool, String, Object::Ptr> m_Value;
+	union
+	{
+		double m_Number;
+		bool m_Boolean;
+		ValueStringData *m_String;
+		Object::Ptr m_Object;
+	};
+
+	ValueType m_Type;
+
+	void Reset();
+	void CopyFrom(const Value& other);
+	void MoveFrom(Value& other);
+
+	[[noreturn]] static void ThrowBadGet();
 };
 
-extern template const double& Value::Get<double>() const;
-extern template const bool& Value::Get<bool>() const;
-extern template const String& Value::Get<String>() const;
-extern template const Object::Ptr& Value::Get<Object::Ptr>() const;
+inline Value::Value()
+	: m_Type(ValueEmpty)
+{ }
+
+inline Value::Value(const Value& other)
+	: m_Type(ValueEmpty)
+{
+	CopyFrom(other);
+}
+
+inline Value::Value(Value&& other)
+	: m_Type(ValueEmpty)
+{
+	MoveFrom(other);
+}
+
+inline Value::~Value()
+{
+	Reset();
+}
+
+inline Value& Value::operator=(const Value& other)
+{
+	/* other might be owned by what we're about to release. */
+	Value copy (other);
+
+	Reset();
+	MoveFrom(copy);
+
+	return *this;
+}
+
+inline Value& Value::operator=(Value&& other)
+{
+	Value moved (std::move(other));
+
+	Reset();
+	MoveFrom(moved);
+
+	return *this;
+}
+
+inline ValueType Value::GetType() const
+{
+	return m_Type;
+}
+
+/**
+ * Releases the current value, leaving an empty one.
+ */
+inline void Value::Reset()
+{
+	typedef Object::Ptr ObjectPtr;
+
+	switch (m_Type) {
+		case ValueString:
+			if (m_String->References.fetch_sub(1) == 1u)
+				delete m_String;
+
+			break;
+		case ValueObject:
+			m_Object.~ObjectPtr();
+			break;
+		default:
+			break;
+	}
+
+	m_Type = ValueEmpty;
+}
+
+/**
+ * Copies another value into this one, which has to be empty.
+ */
+inline void Value::CopyFrom(const Value& other)
+{
+	switch (other.m_Type) {
+		case ValueNumber:
+			m_Number = other.m_Number;
+			break;
+		case ValueBoolean:
+			m_Boolean = other.m_Boolean;
+			break;
+		case ValueString:
+			m_String = other.m_String;
+			m_String->References.fetch_add(1, std::memory_order_relaxed);
+			break;
+		case ValueObject:
+			new (&m_Object) Object::Ptr(other.m_Object);
+			break;
+		default:
+			break;
+	}
+
+	m_Type = other.m_Type;
+}
+
+/**
+ * Moves another value into this one, which has to be empty. The other one is empty afterwards.
+ */
+inline void Value::MoveFrom(Value& other)
+{
+	typedef Object::Ptr ObjectPtr;
+
+	switch (other.m_Type) {
+		case ValueNumber:
+			m_Number = other.m_Number;
+			break;
+		case ValueBoolean:
+			m_Boolean = other.m_Boolean;
+			break;
+		case ValueString:
+			m_String = other.m_String;
+			break;
+		case ValueObject:
+			new (&m_Object) Object::Ptr(std::move(other.m_Object));
+			other.m_Object.~ObjectPtr();
+			break;
+		default:
+			break;
+	}
+
+	m_Type = other.m_Type;
+	other.m_Type = ValueEmpty;
+}
+
+template<>
+inline const double& Value::Get<double>() const
+{
+	if (m_Type != ValueNumber)
+		ThrowBadGet();
+
+	return m_Number;
+}
+
+template<>
+inline const bool& Value::Get<bool>() const
+{
+	if (m_Type != ValueBoolean)
+		ThrowBadGet();
+
+	return m_Boolean;
+}
+
+template<>
+inline const String& Value::Get<String>() const
+{
+	if (m_Type != ValueString)
+		ThrowBadGet();
+
+	return m_String->Data;
+}
+
+template<>
+inline const Object::Ptr& Value::Get<Object::Ptr>() const
+{
+	if (m_Type != ValueObject)
+		ThrowBadGet();
+
+	return m_Object;
+}
 
 extern Value Empty;
 
@@ -246,6 +440,4 @@ std::istream& operator>>(std::istream& stream, Value& value);
 
 }
 
-extern template class boost::variant<boost::blank, double, bool, icinga::String, icinga::Object::Ptr>;
-
 #endif /* VALUE_H */
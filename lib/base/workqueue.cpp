@@ -6,14 +6,36 @@
 #include "base/convert.hpp"
 #include "base/application.hpp"
 #include "base/exception.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/statsfunction.hpp"
 #include <boost/thread/tss.hpp>
+#include <algorithm>
+#include <cctype>
+#include <map>
 #include <math.h>
+#include <set>
+#include <tuple>
 
 using namespace icinga;
 
+REGISTER_STATSFUNCTION(WorkQueue, &WorkQueue::StatsFunc);
+
 std::atomic<int> WorkQueue::m_NextID(1);
 boost::thread_specific_ptr<WorkQueue *> l_ThreadWorkQueue;
 
+struct WorkQueueRegistry
+{
+	std::mutex Mutex;
+	std::set<WorkQueue *> WorkQueues;
+};
+
+/* Work queues may be destroyed during static destruction, so the registry never is. */
+static WorkQueueRegistry& GetWorkQueueRegistry()
+{
+	static auto *registry (new WorkQueueRegistry());
+	return *registry;
+}
+
 WorkQueue::WorkQueue(size_t maxItems, int threadCount, LogSeverity statsLogLevel)
 	: m_ID(m_NextID++), m_ThreadCount(threadCount), m_MaxItems(maxItems),
 	m_TaskStats(15 * 60), m_StatsLogLevel(statsLogLevel)
@@ -25,10 +47,20 @@ WorkQueue::WorkQueue(size_t maxItems, int threadCount, LogSeverity statsLogLevel
 	m_StatusTimer->SetInterval(10);
 	m_StatusTimer->OnTimerExpired.connect(std::bind(&WorkQueue::StatusTimerHandler, this));
 	m_StatusTimer->Start();
+
+	auto& registry (GetWorkQueueRegistry());
+	std::unique_lock<std::mutex> lock (registry.Mutex);
+	registry.WorkQueues.insert(this);
 }
 
 WorkQueue::~WorkQueue()
 {
+	{
+		auto& registry (GetWorkQueueRegistry());
+		std::unique_lock<std::mutex> lock (registry.Mutex);
+		registry.WorkQueues.erase(this);
+	}
+
 	m_StatusTimer->Stop(true);
 
 	Join(true);
@@ -36,7 +68,12 @@ WorkQueue::~WorkQueue()
 
 void WorkQueue::SetName(const String& name)
 {
+	auto lock = AcquireLock();
 	m_Name = name;
+
+	m_ItemsMetric = &MetricGauge::GetByName("work_queue_items", name);
+	m_TasksMetric = &MetricCounter::GetByName("work_queue_tasks", name);
+	m_ItemsMetric->Set(m_Tasks.size());
 }
 
 String WorkQueue::GetName() const
@@ -44,17 +81,18 @@ String WorkQueue::GetName() const
 	return m_Name;
 }
 
-std::unique_lock<std::mutex> WorkQueue::AcquireLock()
-{
-	return std::unique_lock<std::mutex>(m_Mutex);
-}
-
 /**
  * Enqueues a task. Tasks are guaranteed to be executed in the order
  * they were enqueued in except if there is more than one worker thread.
+ *
+ * @param enqueuer The code address the task is accounted to in the statistics, the caller by default.
  */
-void WorkQueue::EnqueueUnlocked(std::unique_lock<std::mutex>& lock, std::function<void ()>&& function, WorkQueuePriority priority)
+void WorkQueue::EnqueueUnlocked(std::unique_lock<std::mutex>& lock, std::function<void ()>&& function, WorkQueuePriority priority,
+	const void *enqueuer)
 {
+	if (!enqueuer)
+		enqueuer = I2_RETURN_ADDRESS();
+
 	if (!m_Spawned) {
 		Log(LogNotice, "WorkQueue")
 			<< "Spawning WorkQueue threads for '" << m_Name << "'";
@@ -73,19 +111,60 @@ void WorkQueue::EnqueueUnlocked(std::unique_lock<std::mutex>& lock, std::functio
 			m_CVFull.wait(lock);
 	}
 
-	m_Tasks.emplace(std::move(function), priority, ++m_NextTaskID);
+	m_Tasks.emplace(std::move(function), priority, ++m_NextTaskID, enqueuer);
+
+	if (m_ItemsMetric)
+		m_ItemsMetric->Set(m_Tasks.size());
 
 	m_CVEmpty.notify_one();
 }
 
+/**
+ * Enqueues multiple tasks while acquiring the lock only once (or once per
+ * chunk of tasks if the queue is bounded and runs full).
+ */
+void WorkQueue::EnqueueBatch(std::vector<TaskFunction>&& functions, WorkQueuePriority priority)
+{
+	if (functions.empty())
+		return;
+
+	bool wq_thread = IsWorkerThread();
+	const void *enqueuer = I2_RETURN_ADDRESS();
+
+	auto lock = AcquireLock();
+
+	/* Spawns the threads if necessary. */
+	EnqueueUnlocked(lock, std::move(functions.front()), priority, enqueuer);
+
+	for (auto it = functions.begin() + 1; it != functions.end(); it++) {
+		if (!wq_thread) {
+			while (m_Tasks.size() >= m_MaxItems && m_MaxItems != 0) {
+				m_CVEmpty.notify_all();
+				m_CVFull.wait(lock);
+			}
+		}
+
+		m_Tasks.emplace(std::move(*it), priority, ++m_NextTaskID, enqueuer);
+	}
+
+	functions.clear();
+
+	if (m_ItemsMetric)
+		m_ItemsMetric->Set(m_Tasks.size());
+
+	m_CVEmpty.notify_all();
+}
+
 /**
  * Enqueues a task. Tasks are guaranteed to be executed in the order
  * they were enqueued in except if there is more than one worker thread or when
  * allowInterleaved is true in which case the new task might be run
  * immediately if it's being enqueued from within the WorkQueue thread.
+ *
+ * @param enqueuer The code address the task is accounted to in the statistics, the caller by default.
  */
 void WorkQueue::Enqueue(std::function<void ()>&& function, WorkQueuePriority priority,
-	bool allowInterleaved)
+	bool allowInterleaved, const void *enqueuer)
 {
 	bool wq_thread = IsWorkerThread();
 
@@ -95,8 +174,11 @@ void WorkQueue::Enqueue(std::function<void ()>&& function, WorkQueuePriority pri
 		return;
 	}
 
+	if (!enqueuer)
+		enqueuer = I2_RETURN_ADDRESS();
+
 	auto lock = AcquireLock();
-	EnqueueUnlocked(lock, std::move(function), priority);
+	EnqueueUnlocked(lock, std::move(function), priority, enqueuer);
 }
 
 /**
@@ -107,7 +189,7 @@ void WorkQueue::Enqueue(std::function<void ()>&& function, WorkQueuePriority pri
  */
 void WorkQueue::Join(bool stop)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto lock (LockProfiler::Lock(m_Mutex, "WorkQueue"));
 
 	while (m_Processing || !m_Tasks.empty())
 		m_CVStarved.wait(lock);
@@ -153,7 +235,7 @@ void WorkQueue::SetExceptionCallback(const ExceptionCallback& callback)
  */
 bool WorkQueue::HasExceptions() const
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto lock (LockProfiler::Lock(m_Mutex, "WorkQueue"));
 
 	return !m_Exceptions.empty();
 }
@@ -164,7 +246,7 @@ bool WorkQueue::HasExceptions() const
  */
 std::vector<boost::exception_ptr> WorkQueue::GetExceptions() const
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto lock (LockProfiler::Lock(m_Mutex, "WorkQueue"));
 
 	return m_Exceptions;
 }
@@ -184,14 +266,14 @@ void WorkQueue::ReportExceptions(const String& facility, bool verbose) const
 
 size_t WorkQueue::GetLength() const
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto lock (LockProfiler::Lock(m_Mutex, "WorkQueue"));
 
 	return m_Tasks.size();
 }
 
 void WorkQueue::StatusTimerHandler()
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto lock (LockProfiler::Lock(m_Mutex, "WorkQueue"));
 
 	ASSERT(!m_Name.IsEmpty());
 
@@ -238,7 +320,7 @@ void WorkQueue::RunTaskFunction(const TaskFunction& func)
 		boost::exception_ptr eptr = boost::current_exception();
 
 		{
-			std::unique_lock<std::mutex> mutex(m_Mutex);
+			auto lock (LockProfiler::Lock(m_Mutex, "WorkQueue"));
 
 			if (!m_ExceptionCallback)
 				m_Exceptions.push_back(eptr);
@@ -257,7 +339,14 @@ void WorkQueue::WorkerThreadProc()
 
 	l_ThreadWorkQueue.reset(new WorkQueue *(this));
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::vector<Task> batch;
+	batch.reserve(MaxBatchSize);
+
+	/* enqueuer, wait time, run time */
+	std::vector<std::tuple<const void *, double, double>> timings;
+	timings.reserve(MaxBatchSize);
+
+	auto lock (LockProfiler::Lock(m_Mutex, "WorkQueue"));
 
 	for (;;) {
 		while (m_Tasks.empty() && !m_Stopped)
@@ -269,32 +358,74 @@ void WorkQueue::WorkerThreadProc()
 		if (m_Tasks.size() >= m_MaxItems && m_MaxItems != 0)
 			m_CVFull.notify_all();
 
-		Task task = m_Tasks.top();
-		m_Tasks.pop();
+		/* Take a fair share of the pending tasks so other worker threads aren't starved. */
+		size_t count = (m_Tasks.size() + m_ThreadCount - 1) / m_ThreadCount;
+
+		if (count > MaxBatchSize)
+			count = MaxBatchSize;
+
+		for (size_t i = 0; i < count; i++) {
+			/* Moving from top() is fine, pop() only compares the priority and ID. */
+			batch.emplace_back(std::move(const_cast<Task&>(m_Tasks.top())));
+			m_Tasks.pop();
+		}
+
+		if (m_ItemsMetric)
+			m_ItemsMetric->Set(m_Tasks.size());
 
-		m_Processing++;
+		m_Processing += static_cast<int>(count);
 
 		lock.unlock();
 
-		RunTaskFunction(task.Function);
+		for (auto& task : batch) {
+			auto start (std::chrono::steady_clock::now());
+
+			RunTaskFunction(task.Function);
+
+			auto end (std::chrono::steady_clock::now());
+
+			/* Free the task's resources before the next one runs, the timing info is kept. */
+			task.Function = nullptr;
+
+			double waitTime = std::chrono::duration<double>(start - task.Enqueued).count();
+			double runTime = std::chrono::duration<double>(end - start).count();
+
+			m_WaitTime.Record(waitTime);
+			m_RunTime.Record(runTime);
+
+			timings.emplace_back(task.Enqueuer, waitTime, runTime);
+		}
 
-		/* clear the task so whatever other resources it holds are released _before_ we re-acquire the mutex */
-		task = Task();
+		/* clear the tasks so whatever other resources they hold are released _before_ we re-acquire the mutex */
+		batch.clear();
 
-		IncreaseTaskCount();
+		IncreaseTaskCount(static_cast<int>(count));
 
 		lock.lock();
 
-		m_Processing--;
+		m_Processing -= static_cast<int>(count);
+
+		if (m_TasksMetric)
+			m_TasksMetric->Increment(count);
+
+		for (auto& timing : timings) {
+			auto& stats (m_Enqueuers[std::get<0>(timing)]);
+
+			stats.Tasks++;
+			stats.WaitTime += std::get<1>(timing);
+			stats.RunTime += std::get<2>(timing);
+		}
+
+		timings.clear();
 
 		if (m_Tasks.empty())
 			m_CVStarved.notify_all();
 	}
 }
 
-void WorkQueue::IncreaseTaskCount()
+void WorkQueue::IncreaseTaskCount(int count)
 {
-	m_TaskStats.InsertValue(Utility::GetTime(), 1);
+	m_TaskStats.InsertValue(Utility::GetTime(), count);
 }
 
 size_t WorkQueue::GetTaskCount(RingBuffer::SizeType span)
@@ -302,6 +433,118 @@ size_t WorkQueue::GetTaskCount(RingBuffer::SizeType span)
 	return m_TaskStats.UpdateAndGetValues(Utility::GetTime(), span);
 }
 
+/**
+ * Returns the statistics of this work queue.
+ *
+ * @returns The number of pending tasks, the task rate, the wait and run time histograms
+ *          and the functions which enqueued the most time consuming tasks.
+ */
+Dictionary::Ptr WorkQueue::GetStats()
+{
+	std::vector<std::pair<const void *, EnqueuerStats>> enqueuers;
+	size_t pending;
+
+	{
+		auto lock = AcquireLock();
+
+		pending = m_Tasks.size();
+		enqueuers.assign(m_Enqueuers.begin(), m_Enqueuers.end());
+	}
+
+	/* Enqueuers are merged by function, there may be many call sites within one. */
+	std::map<String, EnqueuerStats> merged;
+
+	for (auto& kv : enqueuers) {
+		auto& stats (merged[Utility::GetCallSiteName(kv.first)]);
+
+		stats.Tasks += kv.second.Tasks;
+		stats.WaitTime += kv.second.WaitTime;
+		stats.RunTime += kv.second.RunTime;
+	}
+
+	std::vector<std::pair<String, EnqueuerStats>> sorted (merged.begin(), merged.end());
+
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<String, EnqueuerStats>& a, const std::pair<String, EnqueuerStats>& b) {
+		return a.second.RunTime > b.second.RunTime;
+	});
+
+	if (sorted.size() > 5)
+		sorted.resize(5);
+
+	ArrayData topEnqueuers;
+
+	for (auto& entry : sorted) {
+		topEnqueuers.emplace_back(new Dictionary({
+			{ "enqueuer", entry.first },
+			{ "tasks", entry.second.Tasks },
+			{ "wait_time_avg", entry.second.WaitTime / entry.second.Tasks },
+			{ "run_time_avg", entry.second.RunTime / entry.second.Tasks },
+			{ "run_time_total", entry.second.RunTime }
+		}));
+	}
+
+	return new Dictionary({
+		{ "items", pending },
+		{ "max_items", m_MaxItems },
+		{ "threads", m_ThreadCount },
+		{ "task_rate", GetTaskCount(60) / 60.0 },
+		{ "wait_time", m_WaitTime.ToDictionary() },
+		{ "run_time", m_RunTime.ToDictionary() },
+		{ "enqueuers", new Array(std::move(topEnqueuers)) }
+	});
+}
+
+void WorkQueue::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	auto& registry (GetWorkQueueRegistry());
+	std::map<String, Dictionary::Ptr> queues;
+
+	{
+		/* Keeps the work queues from being destroyed meanwhile. */
+		std::unique_lock<std::mutex> lock (registry.Mutex);
+
+		for (auto queue : registry.WorkQueues) {
+			String name;
+
+			{
+				auto queueLock = queue->AcquireLock();
+				name = queue->m_Name;
+			}
+
+			if (name.IsEmpty())
+				continue;
+
+			if (queues.find(name) != queues.end())
+				name += " (#" + Convert::ToString(queue->m_ID) + ")";
+
+			queues.emplace(name, queue->GetStats());
+		}
+	}
+
+	DictionaryData nodes;
+
+	for (auto& kv : queues) {
+		nodes.emplace_back(kv.first, kv.second);
+
+		/* Names contain spaces and commas, perfdata labels shouldn't. */
+		String label = "workqueue_" + kv.first;
+
+		for (char& ch : label) {
+			if (!isalnum(static_cast<unsigned char>(ch)) && ch != '_')
+				ch = '_';
+		}
+
+		Dictionary::Ptr waitTime = kv.second->Get("wait_time");
+		Dictionary::Ptr runTime = kv.second->Get("run_time");
+
+		perfdata->Add(new PerfdataValue(label + "_items", kv.second->Get("items")));
+		perfdata->Add(new PerfdataValue(label + "_wait_time_p99", waitTime->Get("p99"), false, "s"));
+		perfdata->Add(new PerfdataValue(label + "_run_time_p99", runTime->Get("p99"), false, "s"));
+	}
+
+	status->Set("workqueues", new Dictionary(std::move(nodes)));
+}
+
 bool icinga::operator<(const Task& a, const Task& b)
 {
 	if (a.Priority < b.Priority)
@@ -316,3 +559,75 @@ bool icinga::operator<(const Task& a, const Task& b)
 
 	return false;
 }
+
+ShardedWorkQueue::ShardedWorkQueue(size_t maxItems, int shardCount, LogSeverity statsLogLevel)
+{
+	if (shardCount < 1)
+		shardCount = 1;
+
+	for (int i = 0; i < shardCount; i++)
+		m_Shards.emplace_back(new WorkQueue(maxItems, 1, statsLogLevel));
+}
+
+void ShardedWorkQueue::SetName(const String& name)
+{
+	for (decltype(m_Shards.size()) i = 0; i < m_Shards.size(); i++)
+		m_Shards[i]->SetName(name + ", shard #" + Convert::ToString(i));
+}
+
+/**
+ * Enqueues a task into the shard the key maps to.
+ *
+ * @param key Usually the object the task is about, only its address matters.
+ * @param function The task.
+ * @param priority The task's priority within its shard.
+ */
+void ShardedWorkQueue::Enqueue(const void *key, TaskFunction&& function, WorkQueuePriority priority)
+{
+	/* The low bits of heap addresses are the same for all objects. */
+	auto hash (std::hash<const void *>()(key) / sizeof(void *));
+
+	m_Shards[hash % m_Shards.size()]->Enqueue(std::move(function), priority, false, I2_RETURN_ADDRESS());
+}
+
+void ShardedWorkQueue::Join(bool stop)
+{
+	for (auto& shard : m_Shards)
+		shard->Join(stop);
+}
+
+size_t ShardedWorkQueue::GetLength() const
+{
+	size_t length = 0;
+
+	for (auto& shard : m_Shards)
+		length += shard->GetLength();
+
+	return length;
+}
+
+std::vector<size_t> ShardedWorkQueue::GetShardLengths() const
+{
+	std::vector<size_t> lengths;
+
+	for (auto& shard : m_Shards)
+		lengths.push_back(shard->GetLength());
+
+	return lengths;
+}
+
+size_t ShardedWorkQueue::GetTaskCount(RingBuffer::SizeType span)
+{
+	size_t count = 0;
+
+	for (auto& shard : m_Shards)
+		count += shard->GetTaskCount(span);
+
+	return count;
+}
+
+void ShardedWorkQueue::SetExceptionCallback(const WorkQueue::ExceptionCallback& callback)
+{
+	for (auto& shard : m_Shards)
+		shard->SetExceptionCallback(callback);
+}
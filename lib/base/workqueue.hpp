@@ -4,16 +4,24 @@
 #define WORKQUEUE_H
 
 #include "base/i2-base.hpp"
+#include "base/histogram.hpp"
 #include "base/timer.hpp"
 #include "base/ringbuffer.hpp"
 #include "base/logger.hpp"
+#include "base/lockprofiler.hpp"
+#include "base/metric.hpp"
 #include <boost/thread/thread.hpp>
 #include <boost/exception_ptr.hpp>
 #include <condition_variable>
 #include <mutex>
 #include <queue>
 #include <deque>
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace icinga
 {
@@ -32,13 +40,18 @@ struct Task
 {
 	Task() = default;
 
-	Task(TaskFunction function, WorkQueuePriority priority, int id)
-		: Function(std::move(function)), Priority(priority), ID(id)
+	Task(TaskFunction function, WorkQueuePriority priority, int id, const void *enqueuer)
+		: Function(std::move(function)), Priority(priority), ID(id),
+		Enqueued(std::chrono::steady_clock::now()), Enqueuer(enqueuer)
 	{ }
 
 	TaskFunction Function;
 	WorkQueuePriority Priority{PriorityNormal};
 	int ID{-1};
+
+	/* For the statistics: when and by which call site (a code address) the task was enqueued. */
+	std::chrono::steady_clock::time_point Enqueued;
+	const void *Enqueuer{nullptr};
 };
 
 bool operator<(const Task& a, const Task& b);
@@ -46,6 +59,10 @@ bool operator<(const Task& a, const Task& b);
 /**
  * A workqueue.
  *
+ * Every work queue records how long its tasks waited and ran, overall and by the
+ * function which enqueued them. The statistics of all named work queues are
+ * part of the feature stats (/v1/status/WorkQueue and the icinga check).
+ *
  * @ingroup base
  */
 class WorkQueue
@@ -59,40 +76,63 @@ public:
 	void SetName(const String& name);
 	String GetName() const;
 
-	std::unique_lock<std::mutex> AcquireLock();
-	void EnqueueUnlocked(std::unique_lock<std::mutex>& lock, TaskFunction&& function, WorkQueuePriority priority = PriorityNormal);
-	void Enqueue(TaskFunction&& function, WorkQueuePriority priority = PriorityNormal,
-		bool allowInterleaved = false);
+	std::unique_lock<std::mutex> AcquireLock()
+	{
+		return LockProfiler::Lock(m_Mutex, "WorkQueue");
+	}
+
+	BOOST_NOINLINE void EnqueueUnlocked(std::unique_lock<std::mutex>& lock, TaskFunction&& function,
+		WorkQueuePriority priority = PriorityNormal, const void *enqueuer = nullptr);
+	BOOST_NOINLINE void Enqueue(TaskFunction&& function, WorkQueuePriority priority = PriorityNormal,
+		bool allowInterleaved = false, const void *enqueuer = nullptr);
+	BOOST_NOINLINE void EnqueueBatch(std::vector<TaskFunction>&& functions, WorkQueuePriority priority = PriorityNormal);
 	void Join(bool stop = false);
 
+	/**
+	 * Calls func for each item. The items' costs can vary a lot (e.g. hosts
+	 * with hundreds of services), so rather than splitting them up front each
+	 * task takes chunks from a shared cursor until all of them are done.
+	 * The chunks shrink with the remaining items (guided self-scheduling).
+	 */
 	template<typename VectorType, typename FuncType>
 	void ParallelFor(const VectorType& items, const FuncType& func)
 	{
 		using SizeType = decltype(items.size());
 
 		SizeType totalCount = items.size();
+		SizeType threads = static_cast<SizeType>(m_ThreadCount);
+		auto cursor (std::make_shared<std::atomic<SizeType>>(0));
 
 		auto lock = AcquireLock();
 
-		SizeType offset = 0;
+		for (SizeType i = 0; i < threads && i < totalCount; i++) {
+			EnqueueUnlocked(lock, [&items, func, cursor, totalCount, threads, this]() {
+				for (;;) {
+					SizeType offset = cursor->load();
+
+					if (offset >= totalCount)
+						break;
+
+					SizeType count = (totalCount - offset) / (threads * 2);
+
+					if (count < 1)
+						count = 1;
+
+					offset = cursor->fetch_add(count);
+
+					if (offset >= totalCount)
+						break;
 
-		for (int i = 0; i < m_ThreadCount; i++) {
-			SizeType count = totalCount / static_cast<SizeType>(m_ThreadCount);
-			if (static_cast<SizeType>(i) < totalCount % static_cast<SizeType>(m_ThreadCount))
-				count++;
+					SizeType end = std::min(offset + count, totalCount);
 
-			EnqueueUnlocked(lock, [&items, func, offset, count, this]() {
-				for (SizeType j = offset; j < offset + count; j++) {
-					RunTaskFunction([&func, &items, j]() {
-						func(items[j]);
-					});
+					for (SizeType j = offset; j < end; j++) {
+						RunTaskFunction([&func, &items, j]() {
+							func(items[j]);
+						});
+					}
 				}
 			});
-
-			offset += count;
 		}
-
-		ASSERT(offset == items.size());
 	}
 
 	bool IsWorkerThread() const;
@@ -100,6 +140,10 @@ public:
 	size_t GetLength() const;
 	size_t GetTaskCount(RingBuffer::SizeType span);
 
+	Dictionary::Ptr GetStats();
+
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
 	void SetExceptionCallback(const ExceptionCallback& callback);
 
 	bool HasExceptions() const;
@@ -107,9 +151,12 @@ public:
 	void ReportExceptions(const String& facility, bool verbose = false) const;
 
 protected:
-	void IncreaseTaskCount();
+	void IncreaseTaskCount(int count = 1);
 
 private:
+	/* Maximum number of tasks a worker thread dequeues per lock acquisition. */
+	static constexpr size_t MaxBatchSize = 32;
+
 	int m_ID;
 	String m_Name;
 	static std::atomic<int> m_NextID;
@@ -136,12 +183,54 @@ private:
 	size_t m_PendingTasks{0};
 	double m_PendingTasksTimestamp{0};
 
+	struct EnqueuerStats
+	{
+		uint_fast64_t Tasks{0};
+		double WaitTime{0};
+		double RunTime{0};
+	};
+
+	Histogram m_WaitTime;
+	Histogram m_RunTime;
+	std::unordered_map<const void *, EnqueuerStats> m_Enqueuers;
+
+	/* Only named queues are exported to /v1/metrics. */
+	MetricGauge *m_ItemsMetric{nullptr};
+	MetricCounter *m_TasksMetric{nullptr};
+
 	void WorkerThreadProc();
 	void StatusTimerHandler();
 
 	void RunTaskFunction(const TaskFunction& func);
 };
 
+/**
+ * A set of single-threaded work queues. All tasks enqueued for the same key
+ * end up in the same queue and run in the order they were enqueued in,
+ * tasks for different keys run in parallel.
+ *
+ * @ingroup base
+ */
+class ShardedWorkQueue
+{
+public:
+	ShardedWorkQueue(size_t maxItems = 0, int shardCount = 4, LogSeverity statsLogLevel = LogInformation);
+
+	void SetName(const String& name);
+
+	BOOST_NOINLINE void Enqueue(const void *key, TaskFunction&& function, WorkQueuePriority priority = PriorityNormal);
+	void Join(bool stop = false);
+
+	size_t GetLength() const;
+	std::vector<size_t> GetShardLengths() const;
+	size_t GetTaskCount(RingBuffer::SizeType span);
+
+	void SetExceptionCallback(const WorkQueue::ExceptionCallback& callback);
+
+private:
+	std::vector<std::unique_ptr<WorkQueue> > m_Shards;
+};
+
 }
 
 #endif /* WORKQUEUE_H */
@@ -7,14 +7,21 @@
 #include "remote/apilistener.hpp"
 #include "base/configuration.hpp"
 #include "base/configtype.hpp"
+#include "base/lockprofiler.hpp"
 #include "base/objectlock.hpp"
 #include "base/utility.hpp"
 #include "base/perfdatavalue.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
 #include "base/convert.hpp"
+#include "base/defer.hpp"
+#include "base/histogram.hpp"
+#include "base/metric.hpp"
 #include "base/statsfunction.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <vector>
 
 using namespace icinga;
 
@@ -22,22 +29,79 @@ REGISTER_TYPE(CheckerComponent);
 
 REGISTER_STATSFUNCTION(CheckerComponent, &CheckerComponent::StatsFunc);
 
+/* Set while a next check is moved, so NextCheckChangedHandler() doesn't move it again. */
+static thread_local bool l_SpreadingNextCheck = false;
+
 void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
 
 	for (const CheckerComponent::Ptr& checker : ConfigType::GetObjectsByType<CheckerComponent>()) {
-		unsigned long idle = checker->GetIdleCheckables();
-		unsigned long pending = checker->GetPendingCheckables();
+		unsigned long idle = 0;
+		unsigned long pending = 0;
+		uint_fast64_t executed = 0;
+		double lagSum = 0, lagMax = 0, executeSum = 0, executeMax = 0;
+		ArrayData shards;
+
+		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
+
+		for (size_t i = 0; i < checker->m_Shards.size(); i++) {
+			Shard& shard = *checker->m_Shards[i];
+			unsigned long shardIdle, shardPending;
+
+			{
+				auto lock (LockProfiler::Lock(shard.Mutex, "CheckerComponent"));
+				shardIdle = shard.IdleCheckables.size();
+				shardPending = shard.PendingCheckables.size();
+
+				executed += shard.ChecksExecuted;
+				lagSum += shard.SchedulingLagSum;
+				lagMax = std::max(lagMax, shard.SchedulingLagMax);
+				executeSum += shard.ExecuteCheckTimeSum;
+				executeMax = std::max(executeMax, shard.ExecuteCheckTimeMax);
+			}
+
+			idle += shardIdle;
+			pending += shardPending;
+
+			shards.emplace_back(new Dictionary({
+				{ "idle", shardIdle },
+				{ "pending", shardPending }
+			}));
+
+			if (checker->m_Shards.size() > 1) {
+				String shard_prefix = perfdata_prefix + "shard" + Convert::ToString(i) + "_";
+				perfdata->Add(new PerfdataValue(shard_prefix + "idle", Convert::ToDouble(shardIdle)));
+				perfdata->Add(new PerfdataValue(shard_prefix + "pending", Convert::ToDouble(shardPending)));
+			}
+		}
+
+		double lagAvg = executed > 0 ? lagSum / executed : 0;
+		double executeAvg = executed > 0 ? executeSum / executed : 0;
 
 		nodes.emplace_back(checker->GetName(), new Dictionary({
 			{ "idle", idle },
-			{ "pending", pending }
+			{ "pending", pending },
+			{ "checks_executed", executed },
+			{ "avg_scheduling_lag", lagAvg },
+			{ "max_scheduling_lag", lagMax },
+			{ "avg_execute_check_time", executeAvg },
+			{ "max_execute_check_time", executeMax },
+			{ "overloaded", checker->m_Overloaded.load() },
+			{ "checks_overdue", checker->m_ChecksOverdue.load() },
+			{ "checks_spread", checker->m_ChecksSpread.load() },
+			{ "shards", new Array(std::move(shards)) }
 		}));
 
-		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
 		perfdata->Add(new PerfdataValue(perfdata_prefix + "idle", Convert::ToDouble(idle)));
 		perfdata->Add(new PerfdataValue(perfdata_prefix + "pending", Convert::ToDouble(pending)));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "checks_executed", Convert::ToDouble(executed), true));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "avg_scheduling_lag", lagAvg, false, "s"));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "max_scheduling_lag", lagMax, false, "s"));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "avg_execute_check_time", executeAvg, false, "s"));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "max_execute_check_time", executeMax, false, "s"));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "checks_overdue", Convert::ToDouble(checker->m_ChecksOverdue.load())));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "checks_spread", Convert::ToDouble(checker->m_ChecksSpread.load()), true));
 	}
 
 	status->Set("checkercomponent", new Dictionary(std::move(nodes)));
@@ -45,6 +109,10 @@ void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr
 
 void CheckerComponent::OnConfigLoaded()
 {
+	/* The shards must exist before the first checkable is handed to us. */
+	for (int i = 0; i < GetSchedulerThreads(); i++)
+		m_Shards.emplace_back(new Shard());
+
 	ConfigObject::OnActiveChanged.connect(std::bind(&CheckerComponent::ObjectHandler, this, _1));
 	ConfigObject::OnPausedChanged.connect(std::bind(&CheckerComponent::ObjectHandler, this, _1));
 
@@ -59,7 +127,10 @@ void CheckerComponent::Start(bool runtimeCreated)
 		<< "'" << GetName() << "' started.";
 
 
-	m_Thread = std::thread(std::bind(&CheckerComponent::CheckThreadProc, this));
+	for (size_t i = 0; i < m_Shards.size(); i++) {
+		Shard& shard = *m_Shards[i];
+		shard.Thread = std::thread(std::bind(&CheckerComponent::CheckThreadProc, this, std::ref(shard), i));
+	}
 
 	m_ResultTimer = new Timer();
 	m_ResultTimer->SetInterval(5);
@@ -69,14 +140,23 @@ void CheckerComponent::Start(bool runtimeCreated)
 
 void CheckerComponent::Stop(bool runtimeRemoved)
 {
-	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
-		m_Stopped = true;
-		m_CV.notify_all();
+	m_Stopped = true;
+
+	for (auto& shard : m_Shards) {
+		/* Take the lock so that a scheduler thread can't miss the notification
+		 * between checking m_Stopped and going to sleep. */
+		auto lock (LockProfiler::Lock(shard->Mutex, "CheckerComponent"));
+		shard->CV.notify_all();
 	}
 
 	m_ResultTimer->Stop();
-	m_Thread.join();
+
+	for (auto& shard : m_Shards) {
+		if (shard->Thread.joinable())
+			shard->Thread.join();
+	}
+
+	IcingaApplication::SetCheckerLoad(false, 0);
 
 	Log(LogInformation, "CheckerComponent")
 		<< "'" << GetName() << "' stopped.";
@@ -84,19 +164,25 @@ void CheckerComponent::Stop(bool runtimeRemoved)
 	ObjectImpl<CheckerComponent>::Stop(runtimeRemoved);
 }
 
-void CheckerComponent::CheckThreadProc()
+CheckerComponent::Shard& CheckerComponent::GetShard(const Checkable::Ptr& checkable)
 {
-	Utility::SetThreadName("Check Scheduler");
+	return *m_Shards[std::hash<Checkable *>()(checkable.get()) % m_Shards.size()];
+}
+
+void CheckerComponent::CheckThreadProc(Shard& shard, size_t index)
+{
+	Utility::SetThreadName(m_Shards.size() > 1 ? "Check Scheduler " + Convert::ToString(index) : "Check Scheduler");
 	IcingaApplication::Ptr icingaApp = IcingaApplication::GetInstance();
+	static Histogram& schedulingLag (Histogram::GetByName("check_scheduling_lag"));
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto lock (LockProfiler::Lock(shard.Mutex, "CheckerComponent"));
 
 	for (;;) {
 		typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
-		CheckTimeView& idx = boost::get<1>(m_IdleCheckables);
+		CheckTimeView& idx = boost::get<1>(shard.IdleCheckables);
 
 		while (idx.begin() == idx.end() && !m_Stopped)
-			m_CV.wait(lock);
+			shard.CV.wait(lock);
 
 		if (m_Stopped)
 			break;
@@ -112,19 +198,27 @@ void CheckerComponent::CheckThreadProc()
 //			<< " vs. max concurrent checks " << icingaApp->GetMaxConcurrentChecks() << ".";
 //#endif /* I2_DEBUG */
 
+		/* The concurrency budget is shared by all shards. */
 		if (Checkable::GetPendingChecks() >= icingaApp->GetMaxConcurrentChecks())
 			wait = 0.5;
 
 		if (wait > 0) {
 			/* Wait for the next check. */
-			m_CV.wait_for(lock, std::chrono::duration<double>(wait));
+			shard.CV.wait_for(lock, std::chrono::duration<double>(wait));
+
+			continue;
+		}
+
+		/* Don't start all checks at once after an outage, see SpreadOverdueChecks(). */
+		if (-wait > GetOverdueThreshold() && GetSpreadOverdueChecks()) {
+			SpreadOverdueChecks(shard, lock);
 
 			continue;
 		}
 
 		Checkable::Ptr checkable = csi.Object;
 
-		m_IdleCheckables.erase(checkable);
+		shard.IdleCheckables.erase(checkable);
 
 		bool forced = checkable->GetForceNextCheck();
 		bool check = true;
@@ -163,7 +257,7 @@ void CheckerComponent::CheckThreadProc()
 
 		/* reschedule the checkable if checks are disabled */
 		if (!check) {
-			m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+			shard.IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
 			lock.unlock();
 
 			Log(LogDebug, "CheckerComponent")
@@ -179,16 +273,27 @@ void CheckerComponent::CheckThreadProc()
 
 		csi = GetCheckableScheduleInfo(checkable);
 
-		Log(LogDebug, "CheckerComponent")
-			<< "Scheduling info for checkable '" << checkable->GetName() << "' ("
-			<< Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", checkable->GetNextCheck()) << "): Object '"
-			<< csi.Object->GetName() << "', Next Check: "
-			<< Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", csi.NextCheck) << "(" << csi.NextCheck << ").";
+		/* The arguments are evaluated even if nobody logs debug messages. */
+		if (LogDebug >= Logger::GetMinLogSeverity()) {
+			Log(LogDebug, "CheckerComponent")
+				<< "Scheduling info for checkable '" << checkable->GetName() << "' ("
+				<< Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", checkable->GetNextCheck()) << "): Object '"
+				<< csi.Object->GetName() << "', Next Check: "
+				<< Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", csi.NextCheck) << "(" << csi.NextCheck << ").";
+		}
+
+		shard.PendingCheckables.insert(csi);
 
-		m_PendingCheckables.insert(csi);
+		/* wait is <= 0 here, i.e. how much the check is late */
+		shard.ChecksExecuted++;
+		shard.SchedulingLagSum -= wait;
+		shard.SchedulingLagMax = std::max(shard.SchedulingLagMax, -wait);
+		shard.RecentSchedulingLagMax = std::max(shard.RecentSchedulingLagMax, -wait);
 
 		lock.unlock();
 
+		schedulingLag.Record(-wait);
+
 		if (forced) {
 			ObjectLock olock(checkable);
 			checkable->SetForceNextCheck(false);
@@ -205,8 +310,122 @@ void CheckerComponent::CheckThreadProc()
 	}
 }
 
+/**
+ * Reschedules the checks which are more than overdue_threshold late, e.g. after an
+ * outage, one after another at the rate this node is able to execute checks. Otherwise
+ * they would all be started at once, limited only by MaxConcurrentChecks.
+ *
+ * The most overdue check is rescheduled to now, so the next one this is called for
+ * is less overdue.
+ *
+ * @param shard The shard of the calling scheduler thread.
+ * @param lock The held lock of the shard, it's released while rescheduling.
+ */
+void CheckerComponent::SpreadOverdueChecks(Shard& shard, std::unique_lock<std::mutex>& lock)
+{
+	typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
+	CheckTimeView& idx = boost::get<1>(shard.IdleCheckables);
+
+	double now = Utility::GetTime();
+	std::vector<Checkable::Ptr> overdue;
+
+	for (auto it = idx.begin(); it != idx.end() && it->NextCheck < now - GetOverdueThreshold(); ++it)
+		overdue.push_back(it->Object);
+
+	lock.unlock();
+
+	/* How many checks per second all shards are able to execute with the current
+	 * execution times, the checks of the other shards are assumed to be overdue, too. */
+	double executionTime = Histogram::GetByName("check_execution_time").GetAverage();
+
+	if (executionTime <= 0)
+		executionTime = 1;
+
+	double rate = IcingaApplication::GetInstance()->GetMaxConcurrentChecks() / std::max(executionTime, 0.01) / m_Shards.size();
+	double interval = 1.0 / std::max(rate, 1e-3);
+
+	Log(LogInformation, "CheckerComponent")
+		<< "Spreading " << overdue.size() << " overdue checks over the next "
+		<< Utility::FormatDuration(overdue.size() * interval) << ".";
+
+	for (size_t i = 0; i < overdue.size(); i++)
+		overdue[i]->SetNextCheck(now + i * interval);
+
+	lock.lock();
+}
+
+/**
+ * Finds a less busy second for a check if spread_window is set, so that checks
+ * don't pile up within the same seconds, e.g. after a restart. The check is
+ * moved by whole seconds, at most by spread_window and a quarter of its check
+ * interval, to the second with the least checks of the shard. Nearer seconds
+ * win a tie.
+ *
+ * Checks which are due within the window aren't moved, e.g. the ones a user
+ * rescheduled to now.
+ *
+ * @param shard The shard of the checkable, its lock has to be held and the checkable must not be idle.
+ * @param checkable The checkable.
+ * @param nextCheck The next check of the checkable.
+ * @returns The next check to use.
+ */
+double CheckerComponent::GetSpreadNextCheck(Shard& shard, const Checkable::Ptr& checkable, double nextCheck)
+{
+	double window = std::min(GetSpreadWindow(), checkable->GetCheckInterval() / 4);
+
+	if (window < 1 || l_SpreadingNextCheck || checkable->GetForceNextCheck() || nextCheck - window <= Utility::GetTime())
+		return nextCheck;
+
+	typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
+	CheckTimeView& idx = boost::get<1>(shard.IdleCheckables);
+
+	auto countChecks ([&idx](double second) -> size_t {
+		return idx.rank(idx.lower_bound(second + 1)) - idx.rank(idx.lower_bound(second));
+	});
+
+	double second = std::floor(nextCheck);
+	size_t minChecks = countChecks(second);
+	int minOffset = 0;
+
+	for (int i = 1; i <= window && minChecks > 0; i++) {
+		for (int offset : { i, -i }) {
+			size_t checks = countChecks(second + offset);
+
+			if (checks < minChecks) {
+				minChecks = checks;
+				minOffset = offset;
+			}
+		}
+	}
+
+	return nextCheck + minOffset;
+}
+
+/**
+ * Moves the next check of a checkable found by GetSpreadNextCheck().
+ *
+ * @param checkable The checkable.
+ * @param nextCheck The new next check.
+ */
+void CheckerComponent::SetSpreadNextCheck(const Checkable::Ptr& checkable, double nextCheck)
+{
+	l_SpreadingNextCheck = true;
+
+	Defer resetSpreading ([]() {
+		l_SpreadingNextCheck = false;
+	});
+
+	checkable->SetNextCheck(nextCheck);
+
+	m_ChecksSpread++;
+}
+
 void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
 {
+	/* For checks executed in-process (e.g. dummy) this includes ProcessCheckResult()
+	 * and all handlers of its signals, for plugins only starting the process. */
+	double start = Utility::GetTime();
+
 	try {
 		checkable->ExecuteCheck();
 	} catch (const std::exception& ex) {
@@ -227,42 +446,104 @@ void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
 		Log(LogCritical, "checker", output);
 	}
 
+	double duration = Utility::GetTime() - start;
+
+	static MetricCounter& checksExecuted (MetricCounter::GetByName("checks_executed"));
+	checksExecuted.Increment();
+
 	Checkable::DecreasePendingChecks();
 
+	CheckableScheduleInfo csi;
+	double spreadNextCheck = 0;
+
 	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
+		Shard& shard = GetShard(checkable);
+		auto lock (LockProfiler::Lock(shard.Mutex, "CheckerComponent"));
+
+		shard.ExecuteCheckTimeSum += duration;
+		shard.ExecuteCheckTimeMax = std::max(shard.ExecuteCheckTimeMax, duration);
 
 		/* remove the object from the list of pending objects; if it's not in the
 		 * list this was a manual (i.e. forced) check and we must not re-add the
 		 * object to the list because it's already there. */
-		auto it = m_PendingCheckables.find(checkable);
+		auto it = shard.PendingCheckables.find(checkable);
 
-		if (it != m_PendingCheckables.end()) {
-			m_PendingCheckables.erase(it);
+		if (it != shard.PendingCheckables.end()) {
+			shard.PendingCheckables.erase(it);
 
-			if (checkable->IsActive())
-				m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+			if (checkable->IsActive()) {
+				csi = GetCheckableScheduleInfo(checkable);
+				spreadNextCheck = GetSpreadNextCheck(shard, checkable, csi.NextCheck);
 
-			m_CV.notify_all();
+				shard.IdleCheckables.insert(csi);
+			}
+
+			shard.CV.notify_all();
 		}
 	}
 
+	if (csi.Object && spreadNextCheck != csi.NextCheck)
+		SetSpreadNextCheck(checkable, spreadNextCheck);
+
 	Log(LogDebug, "CheckerComponent")
 		<< "Check finished for object '" << checkable->GetName() << "'";
 }
 
 void CheckerComponent::ResultTimerHandler()
 {
+	UpdateLoad();
+
 	std::ostringstream msgbuf;
 
-	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
+	msgbuf << "Pending checkables: " << GetPendingCheckables() << "; Idle checkables: " << GetIdleCheckables() << "; Checks/s: "
+		<< (CIB::GetActiveHostChecksStatistics(60) + CIB::GetActiveServiceChecksStatistics(60)) / 60.0;
+
+	Log(LogNotice, "CheckerComponent", msgbuf.str());
+}
+
+/**
+ * Flags the node as overloaded if checks are started more than overdue_threshold
+ * late or are waiting to be started for that long.
+ */
+void CheckerComponent::UpdateLoad()
+{
+	double now = Utility::GetTime();
+	double threshold = GetOverdueThreshold();
+	double lag = 0;
+	unsigned long overdue = 0;
 
-		msgbuf << "Pending checkables: " << m_PendingCheckables.size() << "; Idle checkables: " << m_IdleCheckables.size() << "; Checks/s: "
-			<< (CIB::GetActiveHostChecksStatistics(60) + CIB::GetActiveServiceChecksStatistics(60)) / 60.0;
+	for (auto& shard : m_Shards) {
+		auto lock (LockProfiler::Lock(shard->Mutex, "CheckerComponent"));
+
+		lag = std::max(lag, shard->RecentSchedulingLagMax);
+		shard->RecentSchedulingLagMax = 0;
+
+		typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
+		CheckTimeView& idx = boost::get<1>(shard->IdleCheckables);
+
+		for (auto it = idx.begin(); it != idx.end() && it->NextCheck < now - threshold; ++it)
+			overdue++;
+
+		if (idx.begin() != idx.end())
+			lag = std::max(lag, now - idx.begin()->NextCheck);
 	}
 
-	Log(LogNotice, "CheckerComponent", msgbuf.str());
+	bool overloaded = lag > threshold;
+
+	if (overloaded != m_Overloaded.exchange(overloaded)) {
+		if (overloaded) {
+			Log(LogWarning, "CheckerComponent")
+				<< "Checks are started up to " << Utility::FormatDuration(lag) << " late, " << overdue
+				<< " are overdue by more than " << Utility::FormatDuration(threshold)
+				<< ". Consider increasing MaxConcurrentChecks or reducing the number of checks on this node.";
+		} else {
+			Log(LogInformation, "CheckerComponent", "Checks are started on time again.");
+		}
+	}
+
+	m_ChecksOverdue = overdue;
+
+	IcingaApplication::SetCheckerLoad(overloaded, overdue);
 }
 
 void CheckerComponent::ObjectHandler(const ConfigObject::Ptr& object)
@@ -276,19 +557,20 @@ void CheckerComponent::ObjectHandler(const ConfigObject::Ptr& object)
 	bool same_zone = (!zone || Zone::GetLocalZone() == zone);
 
 	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
+		Shard& shard = GetShard(checkable);
+		auto lock (LockProfiler::Lock(shard.Mutex, "CheckerComponent"));
 
 		if (object->IsActive() && !object->IsPaused() && same_zone) {
-			if (m_PendingCheckables.find(checkable) != m_PendingCheckables.end())
+			if (shard.PendingCheckables.find(checkable) != shard.PendingCheckables.end())
 				return;
 
-			m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+			shard.IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
 		} else {
-			m_IdleCheckables.erase(checkable);
-			m_PendingCheckables.erase(checkable);
+			shard.IdleCheckables.erase(checkable);
+			shard.PendingCheckables.erase(checkable);
 		}
 
-		m_CV.notify_all();
+		shard.CV.notify_all();
 	}
 }
 
@@ -302,35 +584,80 @@ CheckableScheduleInfo CheckerComponent::GetCheckableScheduleInfo(const Checkable
 
 void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	Shard& shard = GetShard(checkable);
+	CheckableScheduleInfo csi;
+	double spreadNextCheck;
 
-	/* remove and re-insert the object from the set in order to force an index update */
-	typedef boost::multi_index::nth_index<CheckableSet, 0>::type CheckableView;
-	CheckableView& idx = boost::get<0>(m_IdleCheckables);
+	{
+		auto lock (LockProfiler::Lock(shard.Mutex, "CheckerComponent"));
 
-	auto it = idx.find(checkable);
+		/* remove and re-insert the object from the set in order to force an index update */
+		typedef boost::multi_index::nth_index<CheckableSet, 0>::type CheckableView;
+		CheckableView& idx = boost::get<0>(shard.IdleCheckables);
 
-	if (it == idx.end())
-		return;
+		auto it = idx.find(checkable);
 
-	idx.erase(checkable);
+		if (it == idx.end())
+			return;
 
-	CheckableScheduleInfo csi = GetCheckableScheduleInfo(checkable);
-	idx.insert(csi);
+		idx.erase(checkable);
 
-	m_CV.notify_all();
+		csi = GetCheckableScheduleInfo(checkable);
+		spreadNextCheck = GetSpreadNextCheck(shard, checkable, csi.NextCheck);
+
+		idx.insert(csi);
+
+		shard.CV.notify_all();
+	}
+
+	if (spreadNextCheck != csi.NextCheck)
+		SetSpreadNextCheck(checkable, spreadNextCheck);
 }
 
 unsigned long CheckerComponent::GetIdleCheckables()
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	unsigned long count = 0;
+
+	for (auto& shard : m_Shards) {
+		auto lock (LockProfiler::Lock(shard->Mutex, "CheckerComponent"));
+		count += shard->IdleCheckables.size();
+	}
 
-	return m_IdleCheckables.size();
+	return count;
 }
 
 unsigned long CheckerComponent::GetPendingCheckables()
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	unsigned long count = 0;
+
+	for (auto& shard : m_Shards) {
+		auto lock (LockProfiler::Lock(shard->Mutex, "CheckerComponent"));
+		count += shard->PendingCheckables.size();
+	}
+
+	return count;
+}
+
+void CheckerComponent::ValidateSchedulerThreads(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<CheckerComponent>::ValidateSchedulerThreads(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "scheduler_threads" }, "Value must be greater than 0."));
+}
+
+void CheckerComponent::ValidateOverdueThreshold(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<CheckerComponent>::ValidateOverdueThreshold(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "overdue_threshold" }, "Value must be greater than 0."));
+}
+
+void CheckerComponent::ValidateSpreadWindow(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<CheckerComponent>::ValidateSpreadWindow(lvalue, utils);
 
-	return m_PendingCheckables.size();
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "spread_window" }, "Value must not be negative."));
 }
@@ -10,10 +10,15 @@
 #include "base/utility.hpp"
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/ranked_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
+#include <atomic>
+#include <cstdint>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 namespace icinga
 {
@@ -56,7 +61,8 @@ public:
 		CheckableScheduleInfo,
 		boost::multi_index::indexed_by<
 			boost::multi_index::ordered_unique<boost::multi_index::member<CheckableScheduleInfo, Checkable::Ptr, &CheckableScheduleInfo::Object> >,
-			boost::multi_index::ordered_non_unique<CheckableNextCheckExtractor>
+			/* Ranked to count the checks within a time span, see GetSpreadNextCheck(). */
+			boost::multi_index::ranked_non_unique<CheckableNextCheckExtractor>
 		>
 	> CheckableSet;
 
@@ -68,19 +74,55 @@ public:
 	unsigned long GetIdleCheckables();
 	unsigned long GetPendingCheckables();
 
+	void ValidateSchedulerThreads(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateOverdueThreshold(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+	void ValidateSpreadWindow(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+
 private:
-	std::mutex m_Mutex;
-	std::condition_variable m_CV;
-	bool m_Stopped{false};
-	std::thread m_Thread;
+	/**
+	 * A scheduler partition. Every checkable is assigned to exactly one shard
+	 * (based on its hash) which is served by its own scheduler thread.
+	 *
+	 * @ingroup checker
+	 */
+	struct Shard
+	{
+		std::mutex Mutex;
+		std::condition_variable CV;
+		std::thread Thread;
+
+		CheckableSet IdleCheckables;
+		CheckableSet PendingCheckables;
 
-	CheckableSet m_IdleCheckables;
-	CheckableSet m_PendingCheckables;
+		/* How late the checks were started compared to their next_check and how
+		 * long ExecuteCheck() took, see StatsFunc(). Protected by Mutex. */
+		uint_fast64_t ChecksExecuted{0};
+		double SchedulingLagSum{0};
+		double SchedulingLagMax{0};
+		double ExecuteCheckTimeSum{0};
+		double ExecuteCheckTimeMax{0};
+
+		/* The maximum lag since the last ResultTimerHandler() run. Protected by Mutex. */
+		double RecentSchedulingLagMax{0};
+	};
+
+	std::atomic<bool> m_Stopped{false};
+	std::vector<std::unique_ptr<Shard> > m_Shards;
+
+	std::atomic<bool> m_Overloaded{false};
+	std::atomic<unsigned long> m_ChecksOverdue{0};
+	std::atomic<uint_fast64_t> m_ChecksSpread{0};
 
 	Timer::Ptr m_ResultTimer;
 
-	void CheckThreadProc();
+	Shard& GetShard(const Checkable::Ptr& checkable);
+
+	void CheckThreadProc(Shard& shard, size_t index);
+	void SpreadOverdueChecks(Shard& shard, std::unique_lock<std::mutex>& lock);
+	double GetSpreadNextCheck(Shard& shard, const Checkable::Ptr& checkable, double nextCheck);
+	void SetSpreadNextCheck(const Checkable::Ptr& checkable, double nextCheck);
 	void ResultTimerHandler();
+	void UpdateLoad();
 
 	void ExecuteCheckHelper(const Checkable::Ptr& checkable);
 
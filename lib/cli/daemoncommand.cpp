@@ -3,13 +3,16 @@
 #include "cli/daemoncommand.hpp"
 #include "cli/daemonutility.hpp"
 #include "remote/apilistener.hpp"
+#include "remote/configdiffreload.hpp"
 #include "remote/configobjectutility.hpp"
+#include "icinga/cib.hpp"
 #include "config/configcompiler.hpp"
 #include "config/configcompilercontext.hpp"
 #include "config/configitembuilder.hpp"
 #include "base/atomic.hpp"
 #include "base/defer.hpp"
 #include "base/logger.hpp"
+#include "base/listenerhandover.hpp"
 #include "base/application.hpp"
 #include "base/process.hpp"
 #include "base/timer.hpp"
@@ -17,6 +20,7 @@
 #include "base/exception.hpp"
 #include "base/convert.hpp"
 #include "base/scriptglobal.hpp"
+#include "base/startupprofiler.hpp"
 #include "base/context.hpp"
 #include "config.h"
 #include <cstdint>
@@ -169,6 +173,8 @@ void DaemonCommand::InitParameters(boost::program_options::options_description&
 		("no-config,z", "start without a configuration file")
 		("validate,C", "exit after validating the configuration")
 		("errorlog,e", po::value<std::string>(), "log fatal errors to the specified log file (only works in combination with --daemonize or --close-stdio)")
+		("timing-report", po::value<std::string>(), "write the durations of the startup phases as JSON to the specified file")
+		("stats-report", po::value<std::string>(), "write the runtime statistics as JSON to the specified file on shutdown")
 #ifndef _WIN32
 		("daemonize,d", "detach from the controlling terminal")
 		("close-stdio", "do not log to stdout (or stderr) after startup")
@@ -178,7 +184,7 @@ void DaemonCommand::InitParameters(boost::program_options::options_description&
 
 std::vector<String> DaemonCommand::GetArgumentSuggestions(const String& argument, const String& word) const
 {
-	if (argument == "config" || argument == "errorlog")
+	if (argument == "config" || argument == "errorlog" || argument == "timing-report" || argument == "stats-report")
 		return GetBashCompletionSuggestions("file", word);
 	else
 		return CLICommand::GetArgumentSuggestions(argument, word);
@@ -192,6 +198,57 @@ pid_t l_UmbrellaPid = 0;
 static Atomic<bool> l_AllowedToWork (false);
 #endif /* _WIN32 */
 
+// Where to write the durations of the startup phases to, see --timing-report
+static String l_TimingReportPath;
+
+/**
+ * Ends the startup profiling and writes its report if one was requested.
+ */
+static void WriteTimingReport()
+{
+	StartupProfiler::Finish();
+
+	if (l_TimingReportPath.IsEmpty())
+		return;
+
+	try {
+		StartupProfiler::WriteReport(l_TimingReportPath);
+
+		Log(LogInformation, "cli")
+			<< "Wrote the startup timing report to '" << l_TimingReportPath << "'.";
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "cli")
+			<< "Could not write the startup timing report to '" << l_TimingReportPath << "': " << DiagnosticInformation(ex, false);
+	}
+}
+
+// Where to write the runtime statistics to on shutdown, see --stats-report
+static String l_StatsReportPath;
+
+/**
+ * Writes the statistics of all features (as in /v1/status) if requested.
+ */
+static void WriteStatsReport()
+{
+	if (l_StatsReportPath.IsEmpty())
+		return;
+
+	try {
+		Dictionary::Ptr report = new Dictionary({
+			{ "uptime", Utility::GetTime() - Application::GetStartTime() },
+			{ "status", CIB::GetFeatureStats().first }
+		});
+
+		Utility::SaveJsonFile(l_StatsReportPath, 0644, report);
+
+		Log(LogInformation, "cli")
+			<< "Wrote the statistics report to '" << l_StatsReportPath << "'.";
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "cli")
+			<< "Could not write the statistics report to '" << l_StatsReportPath << "': " << DiagnosticInformation(ex, false);
+	}
+}
+
 #ifdef I2_DEBUG
 /**
  * Determine whether the developer wants to delay the worker process to attach a debugger to it.
@@ -244,6 +301,16 @@ int RunWorker(const std::vector<std::string>& configs, bool closeConsoleLog = fa
 			return EXIT_FAILURE;
 		}
 
+		if (ConfigDiffReload::IsEnabled()) {
+			try {
+				ConfigDiffReload::WriteRulesFile(Configuration::ObjectsPath);
+				ConfigDiffReload::SaveActiveConfig(Configuration::ObjectsPath, Configuration::VarsPath);
+			} catch (const std::exception& ex) {
+				Log(LogWarning, "cli")
+					<< "Could not save the active config for in-process reloads: " << DiagnosticInformation(ex, false);
+			}
+		}
+
 #ifndef _WIN32
 		Log(LogNotice, "cli")
 			<< "Notifying umbrella process (PID " << l_UmbrellaPid << ") about the config loading success";
@@ -268,6 +335,7 @@ int RunWorker(const std::vector<std::string>& configs, bool closeConsoleLog = fa
 
 		/* restore the previous program state */
 		try {
+			StartupPhase phase ("restore_state");
 			ConfigObject::RestoreObjects(Configuration::StatePath);
 		} catch (const std::exception& ex) {
 			Log(LogCritical, "cli")
@@ -280,6 +348,11 @@ int RunWorker(const std::vector<std::string>& configs, bool closeConsoleLog = fa
 			Log(LogCritical, "cli", "Error activating configuration.");
 			return EXIT_FAILURE;
 		}
+
+#ifndef _WIN32
+		// Listeners have been started, the inherited sockets not taken over aren't configured anymore
+		ListenerHandover::CloseHeld();
+#endif /* _WIN32 */
 	}
 
 	/* Create the internal API object storage. Do this here too with setups without API. */
@@ -294,9 +367,18 @@ int RunWorker(const std::vector<std::string>& configs, bool closeConsoleLog = fa
 			<< "Cannot clean ignored downtimes/comments: " << ex.what();
 	}
 
-	ApiListener::UpdateObjectAuthority();
+	{
+		StartupPhase phase ("update_object_authority");
+		ApiListener::UpdateObjectAuthority();
+	}
+
+	WriteTimingReport();
+
+	int rc = Application::GetInstance()->Run();
 
-	return Application::GetInstance()->Run();
+	WriteStatsReport();
+
+	return rc;
 }
 
 #ifndef _WIN32
@@ -509,6 +591,8 @@ static pid_t StartUnixWorker(const std::vector<std::string>& configs, bool close
 
 				(void)sigprocmask(SIG_UNBLOCK, &l_UnixWorkerSignals, nullptr);
 
+				ListenerHandover::InitializeWorker();
+
 				try {
 					Application::InitializeBase();
 				} catch (const std::exception& ex) {
@@ -619,6 +703,12 @@ int DaemonCommand::Run(const po::variables_map& vm, const std::vector<std::strin
 #endif /* I2_DEBUG */
 		<< ")";
 
+	if (vm.count("timing-report"))
+		l_TimingReportPath = vm["timing-report"].as<std::string>();
+
+	if (vm.count("stats-report"))
+		l_StatsReportPath = vm["stats-report"].as<std::string>();
+
 	std::vector<std::string> configs;
 	if (vm.count("config") > 0)
 		configs = vm["config"].as<std::vector<std::string> >();
@@ -633,11 +723,27 @@ int DaemonCommand::Run(const po::variables_map& vm, const std::vector<std::strin
 
 		std::vector<ConfigItem::Ptr> newItems;
 
-		if (!DaemonUtility::LoadConfigFiles(configs, newItems, Configuration::ObjectsPath, Configuration::VarsPath)) {
+		String objectsPath = Configuration::ObjectsPath;
+		String varsPath = Configuration::VarsPath;
+
+		/* Staged validations for in-process reloads must not overwrite the running config's files. */
+		bool diffReload = ScriptGlobal::Exists("ObjectsPathOverride");
+
+		if (diffReload) {
+			objectsPath = ScriptGlobal::Get("ObjectsPathOverride");
+			varsPath = ScriptGlobal::Get("VarsPathOverride");
+		}
+
+		if (!DaemonUtility::LoadConfigFiles(configs, newItems, objectsPath, varsPath)) {
 			Log(LogCritical, "cli", "Config validation failed. Re-run with 'icinga2 daemon -C' after fixing the config.");
 			return EXIT_FAILURE;
 		}
 
+		if (diffReload)
+			ConfigDiffReload::WriteRulesFile(objectsPath);
+
+		WriteTimingReport();
+
 		Log(LogInformation, "cli", "Finished validating the configuration file(s).");
 		return EXIT_SUCCESS;
 	}
@@ -724,6 +830,8 @@ int DaemonCommand::Run(const po::variables_map& vm, const std::vector<std::strin
 	if (vm.count("errorlog"))
 		errorLog = vm["errorlog"].as<std::string>();
 
+	ListenerHandover::InitializeUmbrella();
+
 	// The PID of the current seamless worker
 	pid_t currentWorker = StartUnixWorker(configs, closeConsoleLog, errorLog);
 
@@ -784,6 +892,9 @@ int DaemonCommand::Run(const po::variables_map& vm, const std::vector<std::strin
 			sd_notify(0, "RELOADING=1");
 #endif /* HAVE_SYSTEMD */
 
+			// Let the new worker inherit the listening sockets published by the current one
+			ListenerHandover::ReceivePublished();
+
 			pid_t nextWorker = StartUnixWorker(configs);
 
 			switch (nextWorker) {
@@ -796,6 +907,9 @@ int DaemonCommand::Run(const po::variables_map& vm, const std::vector<std::strin
 					Log(LogInformation, "Application")
 						<< "Reload done, old process shutting down. Child process with PID '" << nextWorker << "' is taking over.";
 
+					// The new worker owns the inherited sockets now and publishes the ones it keeps
+					ListenerHandover::CloseHeld();
+
 					(void)kill(currentWorker, SIGTERM);
 
 					{
@@ -823,6 +937,8 @@ int DaemonCommand::Run(const po::variables_map& vm, const std::vector<std::strin
 
 		}
 
+		ListenerHandover::ReceivePublished();
+
 		if (l_RequestedReopenLogs.exchange(false)) {
 			Log(LogNotice, "cli")
 				<< "Got signal " << SIGUSR1 << ", forwarding to seamless worker (PID " << currentWorker << ")";
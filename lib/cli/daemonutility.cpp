@@ -1,11 +1,14 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "cli/daemonutility.hpp"
+#include "remote/runtimeobjectstore.hpp"
 #include "base/utility.hpp"
 #include "base/logger.hpp"
 #include "base/application.hpp"
 #include "base/scriptglobal.hpp"
+#include "base/startupprofiler.hpp"
 #include "config/configcompiler.hpp"
+#include "config/configcompilercache.hpp"
 #include "config/configcompilercontext.hpp"
 #include "config/configitembuilder.hpp"
 #include <set>
@@ -42,8 +45,11 @@ static bool IncludeZoneDirRecursive(const String& path, const String& package, b
 	/* register this zone path for cluster config sync */
 	ConfigCompiler::RegisterZoneDir("_etc", path, zoneName);
 
+	std::vector<String> files;
+	Utility::GlobRecursive(path, "*.conf", [&files](const String& file) { files.push_back(file); }, GlobFile);
+
 	std::vector<std::unique_ptr<Expression> > expressions;
-	Utility::GlobRecursive(path, "*.conf", std::bind(&ConfigCompiler::CollectIncludes, std::ref(expressions), _1, zoneName, package), GlobFile);
+	ConfigCompiler::CollectIncludes(expressions, files, zoneName, package);
 	DictExpression expr(std::move(expressions));
 	if (!ExecuteExpression(&expr))
 		success = false;
@@ -74,8 +80,11 @@ static bool IncludeNonLocalZone(const String& zonePath, const String& package, b
 		return true;
 	}
 
+	std::vector<String> files;
+	Utility::GlobRecursive(zonePath, "*.conf", [&files](const String& file) { files.push_back(file); }, GlobFile);
+
 	std::vector<std::unique_ptr<Expression> > expressions;
-	Utility::GlobRecursive(zonePath, "*.conf", std::bind(&ConfigCompiler::CollectIncludes, std::ref(expressions), _1, zoneName, package), GlobFile);
+	ConfigCompiler::CollectIncludes(expressions, files, zoneName, package);
 	DictExpression expr(std::move(expressions));
 	if (!ExecuteExpression(&expr))
 		success = false;
@@ -108,7 +117,11 @@ bool DaemonUtility::ValidateConfigFiles(const std::vector<std::string>& configs,
 	if (!objectsFile.IsEmpty())
 		ConfigCompilerContext::GetInstance()->OpenObjectsFile(objectsFile);
 
+	ConfigCompilerCache::SetEnabled(true);
+
 	if (!configs.empty()) {
+		StartupPhase phase ("compile_config_files", configs.size());
+
 		for (const String& configPath : configs) {
 			try {
 				std::unique_ptr<Expression> expression = ConfigCompiler::CompileFile(configPath, String(), "_etc");
@@ -131,6 +144,8 @@ bool DaemonUtility::ValidateConfigFiles(const std::vector<std::string>& configs,
 	if (!systemNS->Contains("ZonesStageVarDir")) {
 		String zonesEtcDir = Configuration::ZonesDir;
 		if (!zonesEtcDir.IsEmpty() && Utility::PathExists(zonesEtcDir)) {
+			StartupPhase phase ("compile_zones_dir");
+
 			std::set<String> zoneEtcDirs;
 			Utility::Glob(zonesEtcDir + "/*", [&zoneEtcDirs](const String& zoneEtcDir) { zoneEtcDirs.emplace(zoneEtcDir); }, GlobDirectory);
 
@@ -161,12 +176,20 @@ bool DaemonUtility::ValidateConfigFiles(const std::vector<std::string>& configs,
 	/* Load package config files - they may contain additional zones which
 	 * are authoritative on this node and are checked in HasZoneConfigAuthority(). */
 	String packagesVarDir = Configuration::DataDir + "/api/packages";
-	if (Utility::PathExists(packagesVarDir))
+	if (Utility::PathExists(packagesVarDir)) {
+		StartupPhase phase ("compile_packages");
 		Utility::Glob(packagesVarDir + "/*", std::bind(&IncludePackage, _1, std::ref(success)), GlobDirectory);
+	}
 
 	if (!success)
 		return false;
 
+	/* Runtime comments and downtimes aren't part of the _api package. */
+	{
+		StartupPhase phase ("load_runtime_objects");
+		RuntimeObjectStore::Load();
+	}
+
 	/* Load cluster synchronized configuration files. This can be overridden for staged sync validations. */
 	String zonesVarDir = Configuration::DataDir + "/api/zones";
 
@@ -180,6 +203,8 @@ bool DaemonUtility::ValidateConfigFiles(const std::vector<std::string>& configs,
 
 
 	if (Utility::PathExists(zonesVarDir)) {
+		StartupPhase phase ("compile_cluster_zones");
+
 		std::set<String> zoneVarDirs;
 		Utility::Glob(zonesVarDir + "/*", [&zoneVarDirs](const String& zoneVarDir) { zoneVarDirs.emplace(zoneVarDir); }, GlobDirectory);
 
@@ -221,6 +246,10 @@ bool DaemonUtility::ValidateConfigFiles(const std::vector<std::string>& configs,
 		item->Register();
 	}
 
+	/* Staged validations don't compile all of the files. */
+	if (!systemNS->Contains("ZonesStageVarDir"))
+		ConfigCompilerCache::Prune();
+
 	return true;
 }
 
@@ -244,6 +273,8 @@ bool DaemonUtility::LoadConfigFiles(const std::vector<std::string>& configs,
 		return false;
 	}
 
+	StartupPhase phase ("write_objects_file");
+
 	ConfigCompilerContext::GetInstance()->FinishObjectsFile();
 
 	try {
@@ -0,0 +1,95 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "cli/internalprecompileitlcommand.hpp"
+#include "config/configcompilercache.hpp"
+#include "base/configuration.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+
+using namespace icinga;
+namespace po = boost::program_options;
+
+REGISTER_CLICOMMAND("internal/precompile-itl", InternalPrecompileItlCommand);
+
+String InternalPrecompileItlCommand::GetDescription() const
+{
+	return "Precompile the ITL at build time";
+}
+
+String InternalPrecompileItlCommand::GetShortDescription() const
+{
+	return "Precompile the ITL at build time";
+}
+
+int InternalPrecompileItlCommand::GetMinArguments() const
+{
+	return 1;
+}
+
+int InternalPrecompileItlCommand::GetMaxArguments() const
+{
+	return -1;
+}
+
+/* Runs as the build user. */
+ImpersonationLevel InternalPrecompileItlCommand::GetImpersonationLevel() const
+{
+	return ImpersonateNone;
+}
+
+bool InternalPrecompileItlCommand::IsHidden() const
+{
+	return true;
+}
+
+void InternalPrecompileItlCommand::InitParameters(boost::program_options::options_description& visibleDesc,
+	boost::program_options::options_description& hiddenDesc) const
+{
+	visibleDesc.add_options()
+		("include-dir", po::value<std::string>(), "Directory which contains the ITL files")
+		("output-dir", po::value<std::string>(), "Directory for the compiled files, installed as PkgDataDir/config-cache")
+	;
+}
+
+/**
+ * The entry point for the "internal precompile-itl" CLI command.
+ *
+ * The files are given relative to the include dir. Files which can't
+ * be cached are skipped, they are parsed at startup as before.
+ *
+ * @returns An exit status.
+ */
+int InternalPrecompileItlCommand::Run(const boost::program_options::variables_map& vm, const std::vector<std::string>& ap) const
+{
+	if (!vm.count("include-dir")) {
+		Log(LogCritical, "cli", "ITL directory (--include-dir) must be specified.");
+		return 1;
+	}
+
+	if (!vm.count("output-dir")) {
+		Log(LogCritical, "cli", "Output directory (--output-dir) must be specified.");
+		return 1;
+	}
+
+	/* The cache keys are relative to the include dir. */
+	Configuration::IncludeConfDir = vm["include-dir"].as<std::string>();
+
+	String outputDir = vm["output-dir"].as<std::string>();
+
+	for (const String& file : ap) {
+		String path = Configuration::IncludeConfDir + "/" + file;
+
+		try {
+			if (!ConfigCompilerCache::Precompile(path, outputDir)) {
+				Log(LogWarning, "cli")
+					<< "Cannot precompile '" << path << "', it will be parsed at startup.";
+			}
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "cli")
+				<< "Cannot compile '" << path << "': " << DiagnosticInformation(ex, false);
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,35 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef INTERNALPRECOMPILEITLCOMMAND_H
+#define INTERNALPRECOMPILEITLCOMMAND_H
+
+#include "cli/clicommand.hpp"
+
+namespace icinga
+{
+
+/**
+ * The "internal precompile-itl" command.
+ *
+ * @ingroup cli
+ */
+class InternalPrecompileItlCommand final : public CLICommand
+{
+public:
+	DECLARE_PTR_TYPEDEFS(InternalPrecompileItlCommand);
+
+	String GetDescription() const override;
+	String GetShortDescription() const override;
+	int GetMinArguments() const override;
+	int GetMaxArguments() const override;
+	ImpersonationLevel GetImpersonationLevel() const override;
+	bool IsHidden() const override;
+	void InitParameters(boost::program_options::options_description& visibleDesc,
+		boost::program_options::options_description& hiddenDesc) const override;
+	int Run(const boost::program_options::variables_map& vm, const std::vector<std::string>& ap) const override;
+
+};
+
+}
+
+#endif /* INTERNALPRECOMPILEITLCOMMAND_H */
@@ -2,6 +2,7 @@
 
 #include "cli/objectlistcommand.hpp"
 #include "cli/objectlistutility.hpp"
+#include "config/configcompilercontext.hpp"
 #include "base/logger.hpp"
 #include "base/application.hpp"
 #include "base/convert.hpp"
@@ -13,6 +14,7 @@
 #include "base/debug.hpp"
 #include "base/objectlock.hpp"
 #include "base/console.hpp"
+#include "base/utility.hpp"
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <fstream>
@@ -59,10 +61,6 @@ int ObjectListCommand::Run(const boost::program_options::variables_map& vm, cons
 		return 1;
 	}
 
-	std::fstream fp;
-	fp.open(objectfile.CStr(), std::ios_base::in);
-
-	StdioStream::Ptr sfp = new StdioStream(&fp, false);
 	unsigned long objects_count = 0;
 	std::map<String, int> type_count;
 
@@ -75,23 +73,57 @@ int ObjectListCommand::Run(const boost::program_options::variables_map& vm, cons
 
 	bool first = true;
 
-	String message;
-	StreamReadContext src;
-	for (;;) {
-		StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+	std::vector<ObjectsIndexEntry> index;
 
-		if (srs == StatusEof)
-			break;
+	if (ConfigCompilerContext::ReadObjectsIndex(objectfile, index)) {
+		/* Only the objects which match the filters are read and decoded. */
+		std::ifstream fp (objectfile.CStr(), std::ios_base::in | std::ios_base::binary);
+		std::string message;
 
-		if (srs != StatusNewItem)
-			continue;
+		for (const ObjectsIndexEntry& entry : index) {
+			if (!type_filter.IsEmpty() && !Utility::Match(type_filter, entry.Type))
+				continue;
 
-		ObjectListUtility::PrintObject(std::cout, first, message, type_count, name_filter, type_filter);
-		objects_count++;
-	}
+			if (!name_filter.IsEmpty() && !Utility::Match(name_filter, entry.Name) && !Utility::Match(name_filter, entry.InternalName))
+				continue;
+
+			message.resize(entry.Length);
+			fp.seekg(entry.Offset);
+			fp.read(&message[0], entry.Length);
+
+			if (!fp) {
+				Log(LogCritical, "cli")
+					<< "Cannot read objects file '" << objectfile << "'.";
+				return 1;
+			}
+
+			ObjectListUtility::PrintObject(std::cout, first, message, type_count, name_filter, type_filter);
+			objects_count++;
+		}
+	} else {
+		std::fstream fp;
+		fp.open(objectfile.CStr(), std::ios_base::in);
+
+		StdioStream::Ptr sfp = new StdioStream(&fp, false);
 
-	sfp->Close();
-	fp.close();
+		String message;
+		StreamReadContext src;
+		for (;;) {
+			StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+
+			if (srs == StatusEof)
+				break;
+
+			if (srs != StatusNewItem)
+				continue;
+
+			ObjectListUtility::PrintObject(std::cout, first, message, type_count, name_filter, type_filter);
+			objects_count++;
+		}
+
+		sfp->Close();
+		fp.close();
+	}
 
 	if (vm.count("count")) {
 		if (!first)
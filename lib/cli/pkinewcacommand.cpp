@@ -5,6 +5,7 @@
 #include "base/logger.hpp"
 
 using namespace icinga;
+namespace po = boost::program_options;
 
 REGISTER_CLICOMMAND("pki/new-ca", PKINewCACommand);
 
@@ -18,6 +19,21 @@ String PKINewCACommand::GetShortDescription() const
 	return "sets up a new CA";
 }
 
+void PKINewCACommand::InitParameters(boost::program_options::options_description& visibleDesc,
+	boost::program_options::options_description& hiddenDesc) const
+{
+	visibleDesc.add_options()
+		("key-type", po::value<std::string>(), "Key type: rsa (default), ecdsa or ed25519");
+}
+
+std::vector<String> PKINewCACommand::GetArgumentSuggestions(const String& argument, const String& word) const
+{
+	if (argument == "key-type")
+		return { "rsa", "ecdsa", "ed25519" };
+	else
+		return CLICommand::GetArgumentSuggestions(argument, word);
+}
+
 /**
  * The entry point for the "pki new-ca" CLI command.
  *
@@ -25,5 +41,16 @@ String PKINewCACommand::GetShortDescription() const
  */
 int PKINewCACommand::Run(const boost::program_options::variables_map& vm, const std::vector<std::string>& ap) const
 {
-	return PkiUtility::NewCa();
+	PrivateKeyType keyType = PrivateKeyRSA;
+
+	if (vm.count("key-type")) {
+		try {
+			keyType = ParsePrivateKeyType(vm["key-type"].as<std::string>());
+		} catch (const std::invalid_argument& ex) {
+			Log(LogCritical, "cli", ex.what());
+			return 1;
+		}
+	}
+
+	return PkiUtility::NewCa(keyType);
 }
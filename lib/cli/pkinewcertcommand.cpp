@@ -26,13 +26,16 @@ void PKINewCertCommand::InitParameters(boost::program_options::options_descripti
 		("cn", po::value<std::string>(), "Common Name")
 		("key", po::value<std::string>(), "Key file path (output)")
 		("csr", po::value<std::string>(), "CSR file path (optional, output)")
-		("cert", po::value<std::string>(), "Certificate file path (optional, output)");
+		("cert", po::value<std::string>(), "Certificate file path (optional, output)")
+		("key-type", po::value<std::string>(), "Key type: rsa (default), ecdsa or ed25519");
 }
 
 std::vector<String> PKINewCertCommand::GetArgumentSuggestions(const String& argument, const String& word) const
 {
 	if (argument == "key" || argument == "csr" || argument == "cert")
 		return GetBashCompletionSuggestions("file", word);
+	else if (argument == "key-type")
+		return { "rsa", "ecdsa", "ed25519" };
 	else
 		return CLICommand::GetArgumentSuggestions(argument, word);
 }
@@ -62,5 +65,16 @@ int PKINewCertCommand::Run(const boost::program_options::variables_map& vm, cons
 	if (vm.count("cert"))
 		cert = vm["cert"].as<std::string>();
 
-	return PkiUtility::NewCert(vm["cn"].as<std::string>(), vm["key"].as<std::string>(), csr, cert);
+	PrivateKeyType keyType = PrivateKeyRSA;
+
+	if (vm.count("key-type")) {
+		try {
+			keyType = ParsePrivateKeyType(vm["key-type"].as<std::string>());
+		} catch (const std::invalid_argument& ex) {
+			Log(LogCritical, "cli", ex.what());
+			return 1;
+		}
+	}
+
+	return PkiUtility::NewCert(vm["cn"].as<std::string>(), vm["key"].as<std::string>(), csr, cert, keyType);
 }
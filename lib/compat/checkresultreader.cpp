@@ -7,6 +7,8 @@
 #include "icinga/pluginutility.hpp"
 #include "icinga/icingaapplication.hpp"
 #include "base/configtype.hpp"
+#include "base/configuration.hpp"
+#include "base/workqueue.hpp"
 #include "base/objectlock.hpp"
 #include "base/logger.hpp"
 #include "base/convert.hpp"
@@ -15,8 +17,14 @@
 #include "base/exception.hpp"
 #include "base/context.hpp"
 #include "base/statsfunction.hpp"
+#include <cstdio>
 #include <fstream>
 
+#ifdef __linux__
+#	include <poll.h>
+#	include <sys/inotify.h>
+#endif /* __linux__ */
+
 using namespace icinga;
 
 REGISTER_TYPE(CheckResultReader);
@@ -48,10 +56,31 @@ void CheckResultReader::Start(bool runtimeCreated)
 		<< "This feature is DEPRECATED and will be removed in future releases. Check the roadmap at https://github.com/Icinga/icinga2/milestones";
 
 #ifndef _WIN32
+	/* With inotify the timer only picks up what has been missed, e.g. after a queue overflow. */
+	double interval = 5;
+
+#ifdef __linux__
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (fd >= 0 && inotify_add_watch(fd, GetSpoolDir().CStr(), IN_CLOSE_WRITE | IN_MOVED_TO) >= 0) {
+		m_StopWatching = false;
+		m_WatchThread = std::thread(std::bind(&CheckResultReader::WatchThreadProc, this, fd));
+		interval = 60;
+	} else {
+		Log(LogWarning, "CheckResultReader")
+			<< "Cannot watch '" << GetSpoolDir() << "' with inotify, falling back to polling every "
+			<< interval << " seconds: " << Utility::FormatErrorNumber(errno);
+
+		if (fd >= 0)
+			close(fd);
+	}
+#endif /* __linux__ */
+
 	m_ReadTimer = new Timer();
 	m_ReadTimer->OnTimerExpired.connect(std::bind(&CheckResultReader::ReadTimerHandler, this));
-	m_ReadTimer->SetInterval(5);
+	m_ReadTimer->SetInterval(interval);
 	m_ReadTimer->Start();
+	m_ReadTimer->Reschedule(0);
 #endif /* _WIN32 */
 }
 
@@ -63,9 +92,70 @@ void CheckResultReader::Stop(bool runtimeRemoved)
 	Log(LogInformation, "CheckResultReader")
 		<< "'" << GetName() << "' stopped.";
 
+#ifdef __linux__
+	if (m_WatchThread.joinable()) {
+		m_StopWatching = true;
+		m_WatchThread.join();
+	}
+#endif /* __linux__ */
+
 	ObjectImpl<CheckResultReader>::Stop(runtimeRemoved);
 }
 
+#ifdef __linux__
+/**
+ * Processes check result files as soon as their ".ok" file shows up.
+ *
+ * @param fd The inotify instance watching the spool directory, closed on return.
+ */
+void CheckResultReader::WatchThreadProc(int fd)
+{
+	Utility::SetThreadName("CR Watch");
+
+	alignas(inotify_event) char buffer[16 * 1024];
+
+	while (!m_StopWatching) {
+		pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+
+		if (poll(&pfd, 1, 500) <= 0)
+			continue;
+
+		ssize_t rc = read(fd, buffer, sizeof(buffer));
+
+		if (rc <= 0)
+			continue;
+
+		std::vector<String> paths;
+		bool overflow = false;
+
+		for (char *ptr = buffer; ptr < buffer + rc; ) {
+			auto *event (reinterpret_cast<const inotify_event *>(ptr));
+
+			if (event->mask & IN_Q_OVERFLOW)
+				overflow = true;
+			else if (event->len && Utility::Match("c??????.ok", event->name))
+				paths.emplace_back(GetSpoolDir() + "/" + event->name);
+
+			ptr += sizeof(inotify_event) + event->len;
+		}
+
+		try {
+			if (overflow)
+				ReadTimerHandler();
+			else
+				ProcessCheckResultFiles(paths);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "CheckResultReader")
+				<< "Cannot process check result files: " << DiagnosticInformation(ex);
+		}
+	}
+
+	close(fd);
+}
+#endif /* __linux__ */
+
 /**
  * @threadsafety Always.
  */
@@ -73,44 +163,111 @@ void CheckResultReader::ReadTimerHandler() const
 {
 	CONTEXT("Processing check result files in '" + GetSpoolDir() + "'");
 
-	Utility::Glob(GetSpoolDir() + "/c??????.ok", std::bind(&CheckResultReader::ProcessCheckResultFile, this, _1), GlobFile);
+	std::vector<String> paths;
+
+	Utility::Glob(GetSpoolDir() + "/c??????.ok", [&paths](const String& path) { paths.push_back(path); }, GlobFile);
+
+	ProcessCheckResultFiles(paths);
 }
 
+/**
+ * Processes check result files in parallel.
+ *
+ * @param paths The paths of the files' ".ok" files.
+ */
+void CheckResultReader::ProcessCheckResultFiles(const std::vector<String>& paths) const
+{
+	if (paths.empty())
+		return;
+
+	if (paths.size() == 1) {
+		ProcessCheckResultFile(paths[0]);
+		return;
+	}
+
+	WorkQueue upq (25000, Configuration::Concurrency);
+	upq.SetName("CheckResultReader");
+
+	upq.ParallelFor(paths, [this](const String& path) {
+		ProcessCheckResultFile(path);
+	});
+
+	upq.Join();
+
+	if (upq.HasExceptions())
+		upq.ReportExceptions("CheckResultReader");
+}
+
+/**
+ * Processes a check result file. It may contain multiple check results,
+ * separated by empty lines like Icinga 1.x does.
+ *
+ * @param path The path of the file's ".ok" file.
+ */
 void CheckResultReader::ProcessCheckResultFile(const String& path) const
 {
 	CONTEXT("Processing check result file '" + path + "'");
 
+	/* Whoever removes the ".ok" file processes the check result file. Both
+	 * the inotify watch and the timer may find the same file.
+	 */
+	if (std::remove(path.CStr()) != 0)
+		return;
+
 	String crfile = String(path.Begin(), path.End() - 3); /* Remove the ".ok" extension. */
 
-	std::ifstream fp;
-	fp.exceptions(std::ifstream::badbit);
-	fp.open(crfile.CStr());
+	std::vector<std::map<String, String> > records (1);
 
-	std::map<String, String> attrs;
+	{
+		std::ifstream fp;
+		fp.exceptions(std::ifstream::badbit);
+		fp.open(crfile.CStr());
 
-	while (fp.good()) {
-		std::string line;
-		std::getline(fp, line);
+		while (fp.good()) {
+			std::string line;
+			std::getline(fp, line);
 
-		if (line.empty() || line[0] == '#')
-			continue; /* Ignore comments and empty lines. */
+			if (line.empty()) {
+				if (!records.back().empty())
+					records.emplace_back();
 
-		size_t pos = line.find_first_of('=');
+				continue;
+			}
 
-		if (pos == std::string::npos)
-			continue; /* Ignore invalid lines. */
+			if (line[0] == '#')
+				continue; /* Ignore comments. */
 
-		String key = line.substr(0, pos);
-		String value = line.substr(pos + 1);
+			size_t pos = line.find_first_of('=');
 
-		attrs[key] = value;
-	}
+			if (pos == std::string::npos)
+				continue; /* Ignore invalid lines. */
 
-	/* Remove the checkresult files. */
-	Utility::Remove(path);
+			String key = line.substr(0, pos);
+			String value = line.substr(pos + 1);
+
+			records.back()[key] = value;
+		}
+	}
 
+	/* Remove the checkresult file. */
 	Utility::Remove(crfile);
 
+	for (auto& attrs : records) {
+		/* Records without a host, e.g. the file_time header, don't contain check results. */
+		if (attrs.find("host_name") == attrs.end())
+			continue;
+
+		try {
+			ProcessCheckResult(attrs);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "CheckResultReader")
+				<< "Ignoring invalid check result in '" << crfile << "': " << DiagnosticInformation(ex, false);
+		}
+	}
+}
+
+void CheckResultReader::ProcessCheckResult(std::map<String, String>& attrs) const
+{
 	Checkable::Ptr checkable;
 
 	Host::Ptr host = Host::GetByName(attrs["host_name"]);
@@ -5,7 +5,11 @@
 
 #include "compat/checkresultreader-ti.hpp"
 #include "base/timer.hpp"
+#include <atomic>
 #include <fstream>
+#include <map>
+#include <thread>
+#include <vector>
 
 namespace icinga
 {
@@ -29,8 +33,18 @@ protected:
 
 private:
 	Timer::Ptr m_ReadTimer;
+
+#ifdef __linux__
+	std::thread m_WatchThread;
+	std::atomic<bool> m_StopWatching{false};
+
+	void WatchThreadProc(int fd);
+#endif /* __linux__ */
+
 	void ReadTimerHandler() const;
+	void ProcessCheckResultFiles(const std::vector<String>& paths) const;
 	void ProcessCheckResultFile(const String& path) const;
+	void ProcessCheckResult(std::map<String, String>& attrs) const;
 };
 
 }
@@ -18,6 +18,7 @@
 #include "base/utility.hpp"
 #include "base/statsfunction.hpp"
 #include <boost/algorithm/string.hpp>
+#include <utility>
 
 using namespace icinga;
 
@@ -60,6 +61,9 @@ void CompatLogger::Start(bool runtimeCreated)
 
 	ExternalCommandProcessor::OnNewExternalCommand.connect(std::bind(&CompatLogger::ExternalCommandHandler, this, _2, _3));
 
+	m_StopWriter = false;
+	m_WriterThread = std::thread(std::bind(&CompatLogger::WriterThreadProc, this));
+
 	m_RotationTimer = new Timer();
 	m_RotationTimer->OnTimerExpired.connect(std::bind(&CompatLogger::RotationTimerHandler, this));
 	m_RotationTimer->Start();
@@ -76,6 +80,18 @@ void CompatLogger::Stop(bool runtimeRemoved)
 	Log(LogInformation, "CompatLogger")
 		<< "'" << GetName() << "' stopped.";
 
+	if (m_WriterThread.joinable()) {
+		{
+			std::unique_lock<std::mutex> lock (m_QueueMutex);
+			m_StopWriter = true;
+		}
+
+		m_QueueCV.notify_all();
+		m_WriterThread.join();
+	}
+
+	m_Index.Close();
+
 	ObjectImpl<CompatLogger>::Stop(runtimeRemoved);
 }
 
@@ -136,11 +152,7 @@ void CompatLogger::CheckResultHandler(const Checkable::Ptr& checkable, const Che
 
 	}
 
-	{
-		ObjectLock olock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str(), host->GetName());
 }
 
 /**
@@ -172,11 +184,7 @@ void CompatLogger::TriggerDowntimeHandler(const Downtime::Ptr& downtime)
 			<< "";
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str(), host->GetName());
 }
 
 /**
@@ -219,11 +227,7 @@ void CompatLogger::RemoveDowntimeHandler(const Downtime::Ptr& downtime)
 			<< "";
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str(), host->GetName());
 }
 
 /**
@@ -283,11 +287,7 @@ void CompatLogger::NotificationSentHandler(const Notification::Ptr& notification
 			<< "";
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str(), host->GetName());
 }
 
 /**
@@ -327,11 +327,7 @@ void CompatLogger::FlappingChangedHandler(const Checkable::Ptr& checkable)
 			<< "";
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str(), host->GetName());
 }
 
 void CompatLogger::EnableFlappingChangedHandler(const Checkable::Ptr& checkable)
@@ -363,11 +359,7 @@ void CompatLogger::EnableFlappingChangedHandler(const Checkable::Ptr& checkable)
 			<< "";
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str(), host->GetName());
 }
 
 void CompatLogger::ExternalCommandHandler(const String& command, const std::vector<String>& arguments)
@@ -378,11 +370,7 @@ void CompatLogger::ExternalCommandHandler(const String& command, const std::vect
 		<< boost::algorithm::join(arguments, ";")
 		<< "";
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str());
 }
 
 void CompatLogger::EventCommandHandler(const Checkable::Ptr& checkable)
@@ -414,11 +402,7 @@ void CompatLogger::EventCommandHandler(const Checkable::Ptr& checkable)
 			<< event_command_name;
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str(), host->GetName());
 }
 
 String CompatLogger::GetHostStateString(const Host::Ptr& host)
@@ -429,57 +413,114 @@ String CompatLogger::GetHostStateString(const Host::Ptr& host)
 	return Host::StateToString(host->GetState());
 }
 
-void CompatLogger::WriteLine(const String& line)
+/**
+ * Queues a line for the writer thread.
+ *
+ * @param line The line, without timestamp.
+ * @param hostName The host the line is about, if any.
+ * @threadsafety Always.
+ */
+void CompatLogger::WriteLine(const String& line, const String& hostName)
 {
-	ASSERT(OwnsLock());
+	QueueEntry entry;
+	entry.Line = line;
+	entry.HostName = hostName;
+	entry.Time = Utility::GetTime();
 
-	if (!m_OutputFile.good())
-		return;
-
-	m_OutputFile << "[" << (long)Utility::GetTime() << "] " << line << "\n";
+	Enqueue(std::move(entry));
 }
 
-void CompatLogger::Flush()
+void CompatLogger::Enqueue(QueueEntry&& entry)
 {
-	ASSERT(OwnsLock());
+	std::unique_lock<std::mutex> lock (m_QueueMutex);
 
-	if (!m_OutputFile.good())
+	/* Don't let a stalled disk eat up all memory. */
+	m_QueueSpaceCV.wait(lock, [this]() { return m_Queue.size() < MaxQueueLength || m_StopWriter; });
+
+	if (m_StopWriter)
 		return;
 
-	m_OutputFile << std::flush;
+	m_Queue.emplace_back(std::move(entry));
+
+	if (m_Queue.size() == 1)
+		m_QueueCV.notify_one();
 }
 
 /**
- * @threadsafety Always.
+ * Writes the queued lines. All lines queued at once are written and
+ * flushed together, the file is reopened here as well.
  */
-void CompatLogger::ReopenFile(bool rotate)
+void CompatLogger::WriterThreadProc()
 {
-	ObjectLock olock(this);
+	Utility::SetThreadName("CompatLogger");
 
-	String tempFile = GetLogDir() + "/icinga.log";
+	std::vector<QueueEntry> batch;
 
-	if (m_OutputFile) {
-		m_OutputFile.close();
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock (m_QueueMutex);
 
-		if (rotate) {
-			String archiveFile = GetLogDir() + "/archives/icinga-" + Utility::FormatDateTime("%m-%d-%Y-%H", Utility::GetTime()) + ".log";
+			m_QueueCV.wait(lock, [this]() { return !m_Queue.empty() || m_StopWriter; });
 
-			Log(LogNotice, "CompatLogger")
-				<< "Rotating compat log file '" << tempFile << "' -> '" << archiveFile << "'";
+			if (m_Queue.empty())
+				break;
 
-			(void) rename(tempFile.CStr(), archiveFile.CStr());
+			batch.swap(m_Queue);
 		}
-	}
 
-	m_OutputFile.open(tempFile.CStr(), std::ofstream::app);
+		m_QueueSpaceCV.notify_all();
+
+		for (auto& entry : batch) {
+			try {
+				if (entry.Reopen)
+					ReopenFileInternal(entry.Rotate);
+				else
+					WriteLineInternal(entry);
+			} catch (const std::exception& ex) {
+				Log(LogWarning, "CompatLogger")
+					<< "Cannot write compat log file: " << DiagnosticInformation(ex, false);
+			}
+		}
 
-	if (!m_OutputFile) {
-		Log(LogWarning, "CompatLogger")
-			<< "Could not open compat log file '" << tempFile << "' for writing. Log output will be lost.";
+		batch.clear();
 
-		return;
+		if (m_OutputFile.good())
+			m_OutputFile << std::flush;
 	}
 
+	if (m_OutputFile.good())
+		m_OutputFile << std::flush;
+}
+
+void CompatLogger::WriteLineInternal(const QueueEntry& entry)
+{
+	if (!m_OutputFile.good())
+		return;
+
+	auto ts = (long)entry.Time;
+	String text = "[" + Convert::ToString(ts) + "] " + entry.Line + "\n";
+
+	m_OutputFile << text;
+
+	/* Lets Livestatus history queries skip blocks which don't match the time range or host. */
+	m_Index.AddLine(text.GetLength(), ts, entry.HostName);
+}
+
+/**
+ * Queues reopening the log file, followed by its header and the current states.
+ *
+ * @param rotate Whether to archive the current log file first.
+ * @threadsafety Always.
+ */
+void CompatLogger::ReopenFile(bool rotate)
+{
+	QueueEntry entry;
+	entry.Reopen = true;
+	entry.Rotate = rotate;
+	entry.Time = Utility::GetTime();
+
+	Enqueue(std::move(entry));
+
 	WriteLine("LOG ROTATION: " + GetRotationMethod());
 	WriteLine("LOG VERSION: 2.0");
 
@@ -498,7 +539,7 @@ void CompatLogger::ReopenFile(bool rotate)
 			<< host->GetCheckAttempt() << ";"
 			<< output << "";
 
-		WriteLine(msgbuf.str());
+		WriteLine(msgbuf.str(), host->GetName());
 	}
 
 	for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>()) {
@@ -519,10 +560,41 @@ void CompatLogger::ReopenFile(bool rotate)
 			<< service->GetCheckAttempt() << ";"
 			<< output << "";
 
-		WriteLine(msgbuf.str());
+		WriteLine(msgbuf.str(), host->GetName());
+	}
+}
+
+void CompatLogger::ReopenFileInternal(bool rotate)
+{
+	String tempFile = GetLogDir() + "/icinga.log";
+
+	if (m_OutputFile.is_open()) {
+		m_OutputFile.close();
+		m_Index.Close();
+
+		if (rotate) {
+			String archiveFile = GetLogDir() + "/archives/icinga-" + Utility::FormatDateTime("%m-%d-%Y-%H", Utility::GetTime()) + ".log";
+
+			Log(LogNotice, "CompatLogger")
+				<< "Rotating compat log file '" << tempFile << "' -> '" << archiveFile << "'";
+
+			(void) rename(tempFile.CStr(), archiveFile.CStr());
+			(void) rename(CompatLogIndex::GetIndexPath(tempFile).CStr(), CompatLogIndex::GetIndexPath(archiveFile).CStr());
+		}
+	}
+
+	m_OutputFile.clear();
+	m_OutputFile.open(tempFile.CStr(), std::ofstream::app);
+
+	if (!m_OutputFile) {
+		Log(LogWarning, "CompatLogger")
+			<< "Could not open compat log file '" << tempFile << "' for writing. Log output will be lost.";
+
+		return;
 	}
 
-	Flush();
+	m_OutputFile.seekp(0, std::ios::end);
+	m_Index.Open(tempFile, m_OutputFile.tellp());
 }
 
 void CompatLogger::ScheduleNextRotation()
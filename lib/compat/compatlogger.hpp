@@ -5,8 +5,13 @@
 
 #include "compat/compatlogger-ti.hpp"
 #include "icinga/service.hpp"
+#include "icinga/compatlogindex.hpp"
 #include "base/timer.hpp"
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace icinga
 {
@@ -31,8 +36,28 @@ protected:
 	void Stop(bool runtimeRemoved) override;
 
 private:
-	void WriteLine(const String& line);
-	void Flush();
+	struct QueueEntry
+	{
+		String Line;
+		String HostName;
+		double Time{0};
+		bool Reopen{false};
+		bool Rotate{false};
+	};
+
+	static const size_t MaxQueueLength = 100000;
+
+	std::thread m_WriterThread;
+	std::mutex m_QueueMutex;
+	std::condition_variable m_QueueCV;
+	std::condition_variable m_QueueSpaceCV;
+	std::vector<QueueEntry> m_Queue;
+	bool m_StopWriter{false};
+
+	void WriteLine(const String& line, const String& hostName = String());
+	void Enqueue(QueueEntry&& entry);
+	void WriterThreadProc();
+	void WriteLineInternal(const QueueEntry& entry);
 
 	void CheckResultHandler(const Checkable::Ptr& service, const CheckResult::Ptr& cr);
 	void NotificationSentHandler(const Notification::Ptr& notification, const Checkable::Ptr& service,
@@ -52,7 +77,9 @@ private:
 	void ScheduleNextRotation();
 
 	std::ofstream m_OutputFile;
+	CompatLogIndexWriter m_Index;
 	void ReopenFile(bool rotate);
+	void ReopenFileInternal(bool rotate);
 };
 
 }
@@ -3,6 +3,10 @@
 #include "compat/externalcommandlistener.hpp"
 #include "compat/externalcommandlistener-ti.cpp"
 #include "icinga/externalcommandprocessor.hpp"
+#include "icinga/host.hpp"
+#include "icinga/service.hpp"
+#include "base/configuration.hpp"
+#include "base/perfdatavalue.hpp"
 #include "base/configtype.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
@@ -15,12 +19,26 @@ REGISTER_TYPE(ExternalCommandListener);
 
 REGISTER_STATSFUNCTION(ExternalCommandListener, &ExternalCommandListener::StatsFunc);
 
-void ExternalCommandListener::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+void ExternalCommandListener::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
 
 	for (const ExternalCommandListener::Ptr& externalcommandlistener : ConfigType::GetObjectsByType<ExternalCommandListener>()) {
 		nodes.emplace_back(externalcommandlistener->GetName(), 1); //add more stats
+
+#ifndef _WIN32
+		String prefix = "externalcommandlistener_" + externalcommandlistener->GetName() + "_";
+
+		if (externalcommandlistener->m_CheckResultQueue) {
+			perfdata->Add(new PerfdataValue(prefix + "check_result_queue_items",
+				externalcommandlistener->m_CheckResultQueue->GetLength()));
+		}
+
+		std::unique_lock<std::mutex> lock (externalcommandlistener->m_StatsMutex);
+
+		for (auto& kv : externalcommandlistener->m_CommandCounts)
+			perfdata->Add(new PerfdataValue(prefix + kv.first.ToLower(), kv.second, true));
+#endif /* _WIN32 */
 	}
 
 	status->Set("externalcommandlistener", new Dictionary(std::move(nodes)));
@@ -39,6 +57,9 @@ void ExternalCommandListener::Start(bool runtimeCreated)
 	Log(LogWarning, "ExternalCommandListener")
 		<< "This feature is DEPRECATED and will be removed in future releases. Check the roadmap at https://github.com/Icinga/icinga2/milestones";
 #ifndef _WIN32
+	m_CheckResultQueue.reset(new ShardedWorkQueue(25000, Configuration::Concurrency));
+	m_CheckResultQueue->SetName("ExternalCommandListener, " + GetName());
+
 	m_CommandThread = std::thread(std::bind(&ExternalCommandListener::CommandPipeThread, this, GetCommandPath()));
 	m_CommandThread.detach();
 #endif /* _WIN32 */
@@ -52,6 +73,11 @@ void ExternalCommandListener::Stop(bool runtimeRemoved)
 	Log(LogInformation, "ExternalCommandListener")
 		<< "'" << GetName() << "' stopped.";
 
+#ifndef _WIN32
+	if (m_CheckResultQueue)
+		m_CheckResultQueue->Join();
+#endif /* _WIN32 */
+
 	ObjectImpl<ExternalCommandListener>::Stop(runtimeRemoved);
 }
 
@@ -103,7 +129,8 @@ void ExternalCommandListener::CommandPipeThread(const String& commandPath)
 		for (;;) {
 			sock->Poll(true, false);
 
-			char buffer[8192];
+			/* Passive check result senders write many commands at once. */
+			char buffer[65536];
 			size_t rc;
 
 			try {
@@ -132,10 +159,7 @@ void ExternalCommandListener::CommandPipeThread(const String& commandPath)
 					break;
 
 				try {
-					Log(LogInformation, "ExternalCommandListener")
-						<< "Executing external command: " << command;
-
-					ExternalCommandProcessor::Execute(command);
+					DispatchCommand(command);
 				} catch (const std::exception& ex) {
 					Log(LogWarning, "ExternalCommandListener")
 						<< "External command failed: " << DiagnosticInformation(ex, false);
@@ -146,4 +170,72 @@ void ExternalCommandListener::CommandPipeThread(const String& commandPath)
 		}
 	}
 }
+
+/**
+ * Executes a command read from the pipe.
+ *
+ * Passive check results run in parallel, sharded by their checkable so the
+ * results for one checkable are still processed in the order they arrived.
+ * All other commands wait for the pending check results and run in this thread.
+ *
+ * @param line The command line.
+ */
+void ExternalCommandListener::DispatchCommand(const String& line)
+{
+	double time;
+	String command;
+	std::vector<String> arguments;
+
+	if (!ExternalCommandProcessor::Parse(line, time, command, arguments))
+		return;
+
+	{
+		std::unique_lock<std::mutex> lock (m_StatsMutex);
+		m_CommandCounts[command]++;
+	}
+
+	Log(LogNotice, "ExternalCommandListener")
+		<< "Executing external command: " << line;
+
+	Checkable::Ptr checkable = GetPassiveCheckable(command, arguments);
+
+	if (checkable) {
+		m_CheckResultQueue->Enqueue(checkable.get(), [time, command, arguments]() {
+			ExecuteCommand(time, command, arguments);
+		});
+	} else {
+		m_CheckResultQueue->Join();
+		ExternalCommandProcessor::Execute(time, command, arguments);
+	}
+}
+
+/**
+ * Returns the checkable a passive check result is for.
+ *
+ * @param command The command name.
+ * @param arguments The command's arguments.
+ * @returns The checkable, nullptr if the command isn't a valid passive check result.
+ */
+Checkable::Ptr ExternalCommandListener::GetPassiveCheckable(const String& command, const std::vector<String>& arguments)
+{
+	if (command == "PROCESS_HOST_CHECK_RESULT" && arguments.size() >= 3)
+		return Host::GetByName(arguments[0]);
+
+	if (command == "PROCESS_SERVICE_CHECK_RESULT" && arguments.size() >= 4)
+		return Service::GetByNamePair(arguments[0], arguments[1]);
+
+	return nullptr;
+}
+
+void ExternalCommandListener::ExecuteCommand(double time, const String& command, const std::vector<String>& arguments)
+{
+	try {
+		ExternalCommandProcessor::Execute(time, command, arguments);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ExternalCommandListener")
+			<< "External command failed: " << DiagnosticInformation(ex, false);
+		Log(LogNotice, "ExternalCommandListener")
+			<< "External command failed: " << DiagnosticInformation(ex, true);
+	}
+}
 #endif /* _WIN32 */
@@ -7,6 +7,12 @@
 #include "base/objectlock.hpp"
 #include "base/timer.hpp"
 #include "base/utility.hpp"
+#include "base/workqueue.hpp"
+#include "icinga/checkable.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <iostream>
 
@@ -31,8 +37,16 @@ protected:
 private:
 #ifndef _WIN32
 	std::thread m_CommandThread;
+	std::unique_ptr<ShardedWorkQueue> m_CheckResultQueue;
+
+	mutable std::mutex m_StatsMutex;
+	std::map<String, uint_fast64_t> m_CommandCounts;
 
 	void CommandPipeThread(const String& commandPath);
+	void DispatchCommand(const String& line);
+
+	static Checkable::Ptr GetPassiveCheckable(const String& command, const std::vector<String>& arguments);
+	static void ExecuteCommand(double time, const String& command, const std::vector<String>& arguments);
 #endif /* _WIN32 */
 };
 
@@ -14,6 +14,7 @@
 #include "icinga/pluginutility.hpp"
 #include "icinga/dependency.hpp"
 #include "base/configtype.hpp"
+#include "base/configuration.hpp"
 #include "base/objectlock.hpp"
 #include "base/json.hpp"
 #include "base/convert.hpp"
@@ -22,6 +23,7 @@
 #include "base/application.hpp"
 #include "base/context.hpp"
 #include "base/statsfunction.hpp"
+#include "base/workqueue.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <fstream>
@@ -777,6 +779,43 @@ void StatusDataWriter::StatusTimerHandler()
 
 	double start = Utility::GetTime();
 
+	/* Formatting the hosts and services is the expensive part, so it's done
+	 * in parallel for chunks of hosts. The file is written in order afterwards.
+	 */
+	std::vector<Host::Ptr> hosts = ConfigType::GetObjectsByType<Host>();
+	const size_t chunkSize = 256;
+
+	std::vector<size_t> chunks;
+
+	for (size_t offset = 0; offset < hosts.size(); offset += chunkSize)
+		chunks.push_back(offset);
+
+	std::vector<std::string> formatted (chunks.size());
+
+	WorkQueue upq(25000, Configuration::Concurrency);
+	upq.SetName("StatusDataWriter");
+
+	upq.ParallelFor(chunks, [this, &hosts, &formatted, chunkSize](size_t offset) {
+		std::ostringstream tempstatusfp;
+		tempstatusfp << std::fixed;
+
+		for (size_t i = offset; i < hosts.size() && i < offset + chunkSize; i++) {
+			DumpHostStatus(tempstatusfp, hosts[i]);
+
+			for (const Service::Ptr& service : hosts[i]->GetServices())
+				DumpServiceStatus(tempstatusfp, service);
+		}
+
+		formatted[offset / chunkSize] = tempstatusfp.str();
+	});
+
+	upq.Join();
+
+	if (upq.HasExceptions()) {
+		upq.ReportExceptions("StatusDataWriter");
+		return;
+	}
+
 	String statusPath = GetStatusPath();
 
 	std::fstream statusfp;
@@ -819,18 +858,9 @@ void StatusDataWriter::StatusTimerHandler()
 	statusfp << "\t" "}" "\n"
 			"\n";
 
-	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>()) {
-		std::ostringstream tempstatusfp;
-		tempstatusfp << std::fixed;
-		DumpHostStatus(tempstatusfp, host);
-		statusfp << tempstatusfp.str();
-
-		for (const Service::Ptr& service : host->GetServices()) {
-			std::ostringstream tempstatusfp;
-			tempstatusfp << std::fixed;
-			DumpServiceStatus(tempstatusfp, service);
-			statusfp << tempstatusfp.str();
-		}
+	for (auto& chunk : formatted) {
+		statusfp.write(chunk.c_str(), chunk.size());
+		chunk = std::string();
 	}
 
 	statusfp.close();
@@ -1,12 +1,17 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "config/activationcontext.hpp"
+#include "config/configitem.hpp"
 #include "base/exception.hpp"
 
 using namespace icinga;
 
 boost::thread_specific_ptr<std::stack<ActivationContext::Ptr> > ActivationContext::m_ActivationStack;
 
+/* Defined here as the items are incomplete in the header. */
+ActivationContext::ActivationContext() = default;
+ActivationContext::~ActivationContext() = default;
+
 std::stack<ActivationContext::Ptr>& ActivationContext::GetActivationStack()
 {
 	std::stack<ActivationContext::Ptr> *actx = m_ActivationStack.get();
@@ -40,6 +45,65 @@ ActivationContext::Ptr ActivationContext::GetCurrentContext()
 	return astack.top();
 }
 
+/**
+ * @returns The current context if it's only used for validating, nullptr otherwise
+ */
+ActivationContext::Ptr ActivationContext::GetCurrentValidationContext()
+{
+	std::stack<ActivationContext::Ptr> *astack = m_ActivationStack.get();
+
+	if (!astack || astack->empty() || !astack->top()->m_ValidateOnly)
+		return nullptr;
+
+	return astack->top();
+}
+
+/**
+ * Controls whether committing items in this context evaluates apply rules
+ * for them. Turning this off is only useful when the applied objects are
+ * committed in the same context anyway.
+ *
+ * @param createChildObjects Whether to create child objects.
+ */
+void ActivationContext::SetCreateChildObjects(bool createChildObjects)
+{
+	m_CreateChildObjects = createChildObjects;
+}
+
+bool ActivationContext::GetCreateChildObjects() const
+{
+	return m_CreateChildObjects;
+}
+
+/**
+ * Makes this context one for validating a part of the config against the
+ * running config, see ConfigItem::ValidateItems(). Its items are only
+ * visible within this context and hide the running items they replace.
+ *
+ * @param package The package whose running items are replaced.
+ * @param zones The zones whose running items are replaced, all zones of the package if empty.
+ */
+void ActivationContext::SetValidateOnly(const String& package, const std::set<String>& zones)
+{
+	m_ValidateOnly = true;
+	m_ValidatedPackage = package;
+	m_ValidatedZones = zones;
+}
+
+bool ActivationContext::IsValidateOnly() const
+{
+	return m_ValidateOnly;
+}
+
+/**
+ * @returns Whether the running items of the package and zone are replaced by this context's items.
+ */
+bool ActivationContext::Replaces(const String& package, const String& zone) const
+{
+	return m_ValidateOnly && package == m_ValidatedPackage
+		&& (m_ValidatedZones.empty() || m_ValidatedZones.find(zone) != m_ValidatedZones.end());
+}
+
 ActivationScope::ActivationScope(ActivationContext::Ptr context)
 	: m_Context(std::move(context))
 {
@@ -5,20 +5,49 @@
 
 #include "config/i2-config.hpp"
 #include "base/object.hpp"
+#include "base/string.hpp"
+#include "base/type.hpp"
 #include <boost/thread/tss.hpp>
+#include <map>
+#include <set>
 #include <stack>
+#include <utility>
+#include <vector>
 
 namespace icinga
 {
 
+class ConfigItem;
+
 class ActivationContext final : public Object
 {
 public:
 	DECLARE_PTR_TYPEDEFS(ActivationContext);
 
+	ActivationContext();
+	~ActivationContext() override;
+
 	static ActivationContext::Ptr GetCurrentContext();
+	static ActivationContext::Ptr GetCurrentValidationContext();
+
+	void SetCreateChildObjects(bool createChildObjects);
+	bool GetCreateChildObjects() const;
+
+	void SetValidateOnly(const String& package, const std::set<String>& zones);
+	bool IsValidateOnly() const;
+	bool Replaces(const String& package, const String& zone) const;
 
 private:
+	bool m_CreateChildObjects{true};
+
+	/* Only used for validating: which items of the running config are replaced
+	 * and the items of this context, which aren't registered globally. */
+	bool m_ValidateOnly{false};
+	String m_ValidatedPackage;
+	std::set<String> m_ValidatedZones;
+	std::map<std::pair<Type::Ptr, String>, intrusive_ptr<ConfigItem> > m_Items;
+	std::vector<intrusive_ptr<ConfigItem> > m_UnnamedItems;
+
 	static void PushContext(const ActivationContext::Ptr& context);
 	static void PopContext();
 
@@ -27,6 +56,7 @@ private:
 	static boost::thread_specific_ptr<std::stack<ActivationContext::Ptr> > m_ActivationStack;
 
 	friend class ActivationScope;
+	friend class ConfigItem;
 };
 
 class ActivationScope
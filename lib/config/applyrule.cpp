@@ -8,6 +8,8 @@ using namespace icinga;
 
 ApplyRule::RuleMap ApplyRule::m_Rules;
 ApplyRule::TypeMap ApplyRule::m_Types;
+std::mutex ApplyRule::m_IndexMutex;
+std::map<String, std::shared_ptr<const ApplyRule::RuleIndex> > ApplyRule::m_Indexes;
 
 ApplyRule::ApplyRule(String targetType, String name, Expression::Ptr expression,
 	Expression::Ptr filter, String package, String fkvar, String fvvar, Expression::Ptr fterm,
@@ -141,6 +143,64 @@ std::vector<ApplyRule>& ApplyRule::GetRules(const String& type)
 	return it->second;
 }
 
+/**
+ * Returns the rules which might match for the specified frame, in the order
+ * in which they were defined. Rules whose filter compares a field of one of
+ * the frame's local variables (e.g. "host.vars.os == \"Linux\"" or
+ * "\"linux-servers\" in host.groups") with a string are only returned if
+ * the field has the right value. All other rules are always returned, the
+ * caller still has to evaluate the filters.
+ *
+ * @param type The source type, e.g. "Service".
+ * @param frame A frame containing the objects the rules are applied to.
+ * @returns The candidate rules
+ */
+std::vector<ApplyRule *> ApplyRule::GetCandidateRules(const String& type, ScriptFrame& frame)
+{
+	std::vector<ApplyRule>& rules = GetRules(type);
+	std::shared_ptr<const RuleIndex> index = GetRuleIndex(type);
+
+	std::vector<ApplyRule *> result;
+
+	for (size_t i : index->Filters.GetCandidates(frame))
+		result.push_back(&rules[i]);
+
+	return result;
+}
+
+/**
+ * Returns the index for the rules of the specified type. The index is
+ * rebuilt if rules were added since it was last built.
+ */
+std::shared_ptr<const ApplyRule::RuleIndex> ApplyRule::GetRuleIndex(const String& type)
+{
+	std::vector<ApplyRule>& rules = GetRules(type);
+
+	std::unique_lock<std::mutex> lock(m_IndexMutex);
+
+	std::shared_ptr<const RuleIndex>& index = m_Indexes[type];
+
+	if (index && index->RuleCount == rules.size())
+		return index;
+
+	auto newIndex = std::make_shared<RuleIndex>();
+	newIndex->RuleCount = rules.size();
+
+	for (size_t i = 0; i < rules.size(); i++) {
+		const ApplyRule& rule = rules[i];
+
+		/* Rules with a "for" loop have filters which depend on the loop variables. */
+		if (rule.m_FTerm)
+			newIndex->Filters.AddUnindexed(i);
+		else
+			newIndex->Filters.Add(i, rule.m_Filter.get(), rule.m_Scope);
+	}
+
+	index = newIndex;
+
+	return index;
+}
+
 void ApplyRule::CheckMatches(bool silent)
 {
 	for (const RuleMap::value_type& kv : m_Rules) {
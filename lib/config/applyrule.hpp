@@ -5,7 +5,11 @@
 
 #include "config/i2-config.hpp"
 #include "config/expression.hpp"
+#include "config/filterindex.hpp"
 #include "base/debuginfo.hpp"
+#include <map>
+#include <memory>
+#include <mutex>
 
 namespace icinga
 {
@@ -39,6 +43,7 @@ public:
 		const Expression::Ptr& filter, const String& package, const String& fkvar, const String& fvvar, const Expression::Ptr& fterm,
 		bool ignoreOnError, const DebugInfo& di, const Dictionary::Ptr& scope);
 	static std::vector<ApplyRule>& GetRules(const String& type);
+	static std::vector<ApplyRule *> GetCandidateRules(const String& type, ScriptFrame& frame);
 
 	static void RegisterType(const String& sourceType, const std::vector<String>& targetTypes);
 	static bool IsValidSourceType(const String& sourceType);
@@ -61,9 +66,20 @@ private:
 	Dictionary::Ptr m_Scope;
 	bool m_HasMatches;
 
+	struct RuleIndex
+	{
+		size_t RuleCount;
+		FilterIndex Filters;
+	};
+
 	static TypeMap m_Types;
 	static RuleMap m_Rules;
 
+	static std::mutex m_IndexMutex;
+	static std::map<String, std::shared_ptr<const RuleIndex> > m_Indexes;
+
+	static std::shared_ptr<const RuleIndex> GetRuleIndex(const String& type);
+
 	ApplyRule(String targetType, String name, Expression::Ptr expression,
 		Expression::Ptr filter, String package, String fkvar, String fvvar, Expression::Ptr fterm,
 		bool ignoreOnError, DebugInfo di, Dictionary::Ptr scope);
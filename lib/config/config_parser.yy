@@ -48,10 +48,20 @@ do {							\
 
 using namespace icinga;
 
+static bool IsLiteral(const Expression *expr)
+{
+	return dynamic_cast<const LiteralExpression *>(expr);
+}
+
 template<typename T>
 static void MakeRBinaryOp(Expression** result, Expression *left, Expression *right, const DebugInfo& diLeft, const DebugInfo& diRight)
 {
+	bool constant = IsLiteral(left) && IsLiteral(right);
+
 	*result = new T(std::unique_ptr<Expression>(left), std::unique_ptr<Expression>(right), DebugInfoRange(diLeft, diRight));
+
+	if (constant)
+		*result = FoldConstant(*result);
 }
 
 %}
@@ -879,11 +889,21 @@ rterm_no_side_effect_no_dict: T_STRING
 	}
 	| '!' rterm
 	{
+		bool constant = IsLiteral($2);
+
 		$$ = new LogicalNegateExpression(std::unique_ptr<Expression>($2), @$);
+
+		if (constant)
+			$$ = FoldConstant($$);
 	}
 	| '~' rterm
 	{
+		bool constant = IsLiteral($2);
+
 		$$ = new NegateExpression(std::unique_ptr<Expression>($2), @$);
+
+		if (constant)
+			$$ = FoldConstant($$);
 	}
 	| T_PLUS rterm %prec UNARY_PLUS
 	{
@@ -891,7 +911,12 @@ rterm_no_side_effect_no_dict: T_STRING
 	}
 	| T_MINUS rterm %prec UNARY_MINUS
 	{
+		bool constant = IsLiteral($2);
+
 		$$ = new SubtractExpression(MakeLiteral(0), std::unique_ptr<Expression>($2), @$);
+
+		if (constant)
+			$$ = FoldConstant($$);
 	}
 	| T_THIS
 	{
@@ -1,13 +1,18 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "config/configcompiler.hpp"
+#include "config/configcompilercache.hpp"
 #include "config/configitem.hpp"
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include "base/loader.hpp"
 #include "base/context.hpp"
 #include "base/exception.hpp"
+#include "base/configuration.hpp"
+#include "base/workqueue.hpp"
 #include <fstream>
+#include <iterator>
+#include <numeric>
 
 using namespace icinga;
 
@@ -104,6 +109,44 @@ void ConfigCompiler::CollectIncludes(std::vector<std::unique_ptr<Expression> >&
 	}
 }
 
+/**
+ * Compiles the specified files in parallel. The expressions are appended in
+ * the order of the files so that they're evaluated deterministically.
+ *
+ * @param expressions The expressions for the files.
+ * @param files The files.
+ * @param zone The zone.
+ * @param package The package.
+ */
+void ConfigCompiler::CollectIncludes(std::vector<std::unique_ptr<Expression> >& expressions,
+	const std::vector<String>& files, const String& zone, const String& package)
+{
+	if (files.size() < 2) {
+		for (const String& file : files)
+			CollectIncludes(expressions, file, zone, package);
+
+		return;
+	}
+
+	std::vector<std::vector<std::unique_ptr<Expression> > > results(files.size());
+	std::vector<size_t> indices(files.size());
+	std::iota(indices.begin(), indices.end(), 0);
+
+	WorkQueue upq(25000, Configuration::Concurrency);
+	upq.SetName("ConfigCompiler::CollectIncludes");
+
+	upq.ParallelFor(indices, [&results, &files, &zone, &package](size_t index) {
+		CollectIncludes(results[index], files[index], zone, package);
+	});
+
+	upq.Join();
+
+	for (auto& result : results) {
+		for (auto& expression : result)
+			expressions.emplace_back(std::move(expression));
+	}
+}
+
 /**
  * Handles an include directive.
  *
@@ -135,14 +178,17 @@ std::unique_ptr<Expression> ConfigCompiler::HandleInclude(const String& relative
 		}
 	}
 
-	std::vector<std::unique_ptr<Expression> > expressions;
+	std::vector<String> files;
 
-	if (!Utility::Glob(includePath, std::bind(&ConfigCompiler::CollectIncludes, std::ref(expressions), _1, zone, package), GlobFile) && includePath.FindFirstOf("*?") == String::NPos) {
+	if (!Utility::Glob(includePath, [&files](const String& file) { files.push_back(file); }, GlobFile) && includePath.FindFirstOf("*?") == String::NPos) {
 		std::ostringstream msgbuf;
 		msgbuf << "Include file '" + path + "' does not exist";
 		BOOST_THROW_EXCEPTION(ScriptError(msgbuf.str(), debuginfo));
 	}
 
+	std::vector<std::unique_ptr<Expression> > expressions;
+	CollectIncludes(expressions, files, zone, package);
+
 	std::unique_ptr<DictExpression> expr{new DictExpression(std::move(expressions))};
 	expr->MakeInline();
 	return std::move(expr);
@@ -166,8 +212,11 @@ std::unique_ptr<Expression> ConfigCompiler::HandleIncludeRecursive(const String&
 	else
 		ppath = relativeBase + "/" + path;
 
+	std::vector<String> files;
+	Utility::GlobRecursive(ppath, pattern, [&files](const String& file) { files.push_back(file); }, GlobFile);
+
 	std::vector<std::unique_ptr<Expression> > expressions;
-	Utility::GlobRecursive(ppath, pattern, std::bind(&ConfigCompiler::CollectIncludes, std::ref(expressions), _1, zone, package), GlobFile);
+	CollectIncludes(expressions, files, zone, package);
 
 	std::unique_ptr<DictExpression> dict{new DictExpression(std::move(expressions))};
 	dict->MakeInline();
@@ -187,7 +236,10 @@ void ConfigCompiler::HandleIncludeZone(const String& relativeBase, const String&
 
 	RegisterZoneDir(tag, ppath, zoneName);
 
-	Utility::GlobRecursive(ppath, pattern, std::bind(&ConfigCompiler::CollectIncludes, std::ref(expressions), _1, zoneName, package), GlobFile);
+	std::vector<String> files;
+	Utility::GlobRecursive(ppath, pattern, [&files](const String& file) { files.push_back(file); }, GlobFile);
+
+	CollectIncludes(expressions, files, zoneName, package);
 }
 
 /**
@@ -264,7 +316,23 @@ std::unique_ptr<Expression> ConfigCompiler::CompileFile(const String& path, cons
 	Log(LogNotice, "ConfigCompiler")
 		<< "Compiling config file: " << path;
 
-	return CompileStream(path, &stream, zone, package);
+	if (!ConfigCompilerCache::IsEnabled())
+		return CompileStream(path, &stream, zone, package);
+
+	String content { std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>() };
+	String key = ConfigCompilerCache::GetKey(path, zone, package, content);
+
+	std::unique_ptr<Expression> expr = ConfigCompilerCache::Load(key, path);
+
+	if (expr)
+		return expr;
+
+	std::istringstream input(content);
+	expr = CompileStream(path, &input, zone, package);
+
+	ConfigCompilerCache::Store(key, path, expr.get());
+
+	return expr;
 }
 
 /**
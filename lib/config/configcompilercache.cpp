@@ -0,0 +1,637 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/configcompilercache.hpp"
+#include "config/configcompiler.hpp"
+#include "base/application.hpp"
+#include "base/configuration.hpp"
+#include "base/exception.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/objectlock.hpp"
+#include "base/tlsutility.hpp"
+#include "base/utility.hpp"
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <typeinfo>
+
+using namespace icinga;
+
+/* Bump this whenever the serialized representation of an expression changes. */
+#define CONFIG_CACHE_FORMAT "2"
+
+#define BINARY_EXPRESSIONS(X) \
+	X(Add) X(Subtract) X(Multiply) X(Divide) X(Modulo) X(Xor) X(BinaryAnd) X(BinaryOr) \
+	X(ShiftLeft) X(ShiftRight) X(Equal) X(NotEqual) X(LessThan) X(GreaterThan) \
+	X(LessThanOrEqual) X(GreaterThanOrEqual) X(In) X(NotIn) X(LogicalAnd) X(LogicalOr)
+
+#define UNARY_EXPRESSIONS(X) \
+	X(Deref) X(Ref) X(Negate) X(LogicalNegate) X(Return) X(Library)
+
+#define EMPTY_EXPRESSIONS(X) \
+	X(Break) X(Continue) X(Breakpoint) X(ImportDefaultTemplates)
+
+bool ConfigCompilerCache::m_Enabled = false;
+std::mutex ConfigCompilerCache::m_Mutex;
+std::set<String> ConfigCompilerCache::m_UsedKeys;
+
+void ConfigCompilerCache::SetEnabled(bool enabled)
+{
+	m_Enabled = enabled;
+}
+
+bool ConfigCompilerCache::IsEnabled()
+{
+	return m_Enabled;
+}
+
+String ConfigCompilerCache::GetCacheDir()
+{
+	return Configuration::CacheDir + "/config-cache";
+}
+
+/* Read-only entries for the ITL, created at build time. */
+String ConfigCompilerCache::GetPrecompiledDir()
+{
+	return Configuration::PkgDataDir + "/config-cache";
+}
+
+void ConfigCompilerCache::MarkUsed(const String& key)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_UsedKeys.insert(key);
+}
+
+/**
+ * Computes the cache key for a config file.
+ *
+ * @param path The path of the file.
+ * @param zone The zone.
+ * @param package The package.
+ * @param content The file's content.
+ * @returns The key
+ */
+String ConfigCompilerCache::GetKey(const String& path, const String& zone, const String& package, const String& content)
+{
+	String data = CONFIG_CACHE_FORMAT;
+
+	/* Files in the include dir get the same keys wherever the ITL has been built. */
+	String includePrefix = Configuration::IncludeConfDir + "/";
+	String keyPath = path;
+
+	if (path.SubStr(0, includePrefix.GetLength()) == includePrefix)
+		keyPath = "<include>/" + path.SubStr(includePrefix.GetLength());
+
+	for (const String& part : { Application::GetAppVersion(), keyPath, zone, package, content }) {
+		data += '\0';
+		data += part;
+	}
+
+	return SHA256(data);
+}
+
+/**
+ * Loads the cached expression for a config file.
+ *
+ * @param key The cache key.
+ * @param path The path of the file.
+ * @returns The expression or nullptr if it isn't cached
+ */
+std::unique_ptr<Expression> ConfigCompilerCache::Load(const String& key, const String& path)
+{
+	for (const String& dir : { GetCacheDir(), GetPrecompiledDir() }) {
+		String cachePath = dir + "/" + key;
+
+		std::ifstream fp(cachePath.CStr(), std::ifstream::in | std::ifstream::binary);
+
+		if (!fp)
+			continue;
+
+		String data { std::istreambuf_iterator<char>(fp), std::istreambuf_iterator<char>() };
+
+		try {
+			std::unique_ptr<Expression> expr = DeserializeExpression(JsonDecode(data), path);
+			MarkUsed(key);
+			return expr;
+		} catch (const std::exception& ex) {
+			Log(LogNotice, "ConfigCompilerCache")
+				<< "Ignoring invalid cache entry '" << cachePath << "': " << DiagnosticInformation(ex, false);
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+ * Stores the expression for a config file in the cache.
+ *
+ * @param key The cache key.
+ * @param path The path of the file.
+ * @param expr The expression.
+ */
+void ConfigCompilerCache::Store(const String& key, const String& path, const Expression *expr)
+{
+	StoreIn(GetCacheDir(), key, path, expr);
+}
+
+/**
+ * Compiles an ITL file and stores its expression in the given directory,
+ * see GetPrecompiledDir(). The key assumes that the file is included from
+ * the main config, i.e. with the "_etc" package and without a zone.
+ *
+ * @param path The path of the file, beneath Configuration::IncludeConfDir.
+ * @param dir The directory.
+ * @returns Whether the expression could be stored
+ */
+bool ConfigCompilerCache::Precompile(const String& path, const String& dir)
+{
+	std::ifstream stream(path.CStr(), std::ifstream::in);
+
+	if (!stream)
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("std::ifstream::open")
+			<< boost::errinfo_errno(errno)
+			<< boost::errinfo_file_name(path));
+
+	String content { std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>() };
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText(path, content, String(), "_etc");
+
+	return StoreIn(dir, GetKey(path, String(), "_etc", content), path, expr.get());
+}
+
+bool ConfigCompilerCache::StoreIn(const String& dir, const String& key, const String& path, const Expression *expr)
+{
+	String data;
+
+	try {
+		data = JsonEncode(SerializeExpression(expr, path));
+	} catch (const std::exception& ex) {
+		Log(LogDebug, "ConfigCompilerCache")
+			<< "Not caching config file '" << path << "': " << DiagnosticInformation(ex, false);
+		return false;
+	}
+
+	String cachePath = dir + "/" + key;
+
+	try {
+		Utility::MkDirP(dir, 0750);
+
+		std::fstream fp;
+		String tempPath = Utility::CreateTempFile(cachePath + ".XXXXXX", 0640, fp);
+
+		fp << data;
+		fp.close();
+
+		Utility::RenameFile(tempPath, cachePath);
+	} catch (const std::exception& ex) {
+		Log(LogNotice, "ConfigCompilerCache")
+			<< "Cannot write cache entry '" << cachePath << "': " << DiagnosticInformation(ex, false);
+		return false;
+	}
+
+	MarkUsed(key);
+	return true;
+}
+
+/**
+ * Removes all cache entries which weren't used since the process started.
+ */
+void ConfigCompilerCache::Prune()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (!Utility::PathExists(GetCacheDir()))
+		return;
+
+	Utility::Glob(GetCacheDir() + "/*", [](const String& file) {
+		if (m_UsedKeys.find(Utility::BaseName(file)) != m_UsedKeys.end())
+			return;
+
+		try {
+			Utility::Remove(file);
+		} catch (const std::exception& ex) {
+			Log(LogNotice, "ConfigCompilerCache")
+				<< "Cannot remove cache entry '" << file << "': " << DiagnosticInformation(ex, false);
+		}
+	}, GlobFile);
+}
+
+Value ConfigCompilerCache::SerializeDebugInfo(const Expression *expr, const String& path)
+{
+	const DebugInfo& di = expr->GetDebugInfo();
+
+	if (!di.Path.IsEmpty() && di.Path != path)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Debug information refers to another file: " + di.Path));
+
+	return new Array({ di.Path.IsEmpty() ? 0 : 1, di.FirstLine, di.FirstColumn, di.LastLine, di.LastColumn });
+}
+
+DebugInfo ConfigCompilerCache::DeserializeDebugInfo(const Value& value, const String& path)
+{
+	Array::Ptr arr = value;
+
+	DebugInfo di;
+
+	if (arr->Get(0).ToBool())
+		di.Path = path;
+
+	di.FirstLine = arr->Get(1);
+	di.FirstColumn = arr->Get(2);
+	di.LastLine = arr->Get(3);
+	di.LastColumn = arr->Get(4);
+
+	return di;
+}
+
+/* JsonEncode() replaces invalid UTF-8 sequences, strings like that can't be cached. */
+String ConfigCompilerCache::SerializeString(const String& value)
+{
+	if (Utility::ValidateUTF8(value) != value)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("String is not valid UTF-8."));
+
+	return value;
+}
+
+Array::Ptr ConfigCompilerCache::SerializeExpressions(const std::vector<std::unique_ptr<Expression> >& exprs, const String& path)
+{
+	ArrayData nodes;
+	nodes.reserve(exprs.size());
+
+	for (const auto& expr : exprs)
+		nodes.emplace_back(SerializeExpression(expr.get(), path));
+
+	return new Array(std::move(nodes));
+}
+
+std::vector<std::unique_ptr<Expression> > ConfigCompilerCache::DeserializeExpressions(const Array::Ptr& nodes, const String& path)
+{
+	std::vector<std::unique_ptr<Expression> > exprs;
+
+	ObjectLock olock(nodes);
+	for (const Value& node : nodes)
+		exprs.emplace_back(DeserializeExpression(node, path));
+
+	return exprs;
+}
+
+Dictionary::Ptr ConfigCompilerCache::SerializeClosedVars(const std::map<String, std::unique_ptr<Expression> >& closedVars, const String& path)
+{
+	DictionaryData nodes;
+
+	for (const auto& kv : closedVars)
+		nodes.emplace_back(SerializeString(kv.first), SerializeExpression(kv.second.get(), path));
+
+	return new Dictionary(std::move(nodes));
+}
+
+std::map<String, std::unique_ptr<Expression> > ConfigCompilerCache::DeserializeClosedVars(const Dictionary::Ptr& nodes, const String& path)
+{
+	std::map<String, std::unique_ptr<Expression> > closedVars;
+
+	ObjectLock olock(nodes);
+	for (const Dictionary::Pair& kv : nodes)
+		closedVars[kv.first] = DeserializeExpression(kv.second, path);
+
+	return closedVars;
+}
+
+/**
+ * Converts an expression into a JSON-compatible representation. Each node
+ * is an array consisting of the expression type, its debug information and
+ * the expression's fields.
+ *
+ * @param expr The expression, may be nullptr.
+ * @param path The path of the file the expression was compiled from.
+ * @returns The serialized expression
+ */
+Value ConfigCompilerCache::SerializeExpression(const Expression *expr, const String& path)
+{
+	if (!expr)
+		return Empty;
+
+	const std::type_info& type = typeid(*expr);
+
+	if (type == typeid(LiteralExpression)) {
+		Value value = static_cast<const LiteralExpression *>(expr)->GetValue();
+
+		if (value.IsString())
+			SerializeString(value);
+		else if (value.IsNumber() && !std::isfinite(value.Get<double>()))
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Literal is not a finite number."));
+		else if (value.IsObject())
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Literal is an object."));
+
+		return new Array({ "Literal", Empty, value });
+	}
+
+	if (type == typeid(GetScopeExpression))
+		return new Array({ "GetScope", Empty, static_cast<int>(static_cast<const GetScopeExpression *>(expr)->m_ScopeSpec) });
+
+	Value di = SerializeDebugInfo(expr, path);
+
+#define SERIALIZE_BINARY(name) \
+	if (type == typeid(name##Expression)) { \
+		auto binary (static_cast<const BinaryExpression *>(expr)); \
+		return new Array({ #name, di, SerializeExpression(binary->m_Operand1.get(), path), SerializeExpression(binary->m_Operand2.get(), path) }); \
+	}
+
+	BINARY_EXPRESSIONS(SERIALIZE_BINARY)
+
+#undef SERIALIZE_BINARY
+
+#define SERIALIZE_UNARY(name) \
+	if (type == typeid(name##Expression)) \
+		return new Array({ #name, di, SerializeExpression(static_cast<const UnaryExpression *>(expr)->m_Operand.get(), path) });
+
+	UNARY_EXPRESSIONS(SERIALIZE_UNARY)
+
+#undef SERIALIZE_UNARY
+
+#define SERIALIZE_EMPTY(name) \
+	if (type == typeid(name##Expression)) \
+		return new Array({ #name, di });
+
+	EMPTY_EXPRESSIONS(SERIALIZE_EMPTY)
+
+#undef SERIALIZE_EMPTY
+
+	if (type == typeid(VariableExpression)) {
+		auto variable (static_cast<const VariableExpression *>(expr));
+
+		/* The constructor adds the default imports, anything beyond that comes from
+		 * "using". Those are shared between expressions and aren't supported. */
+		static const size_t defaultImports = VariableExpression(String(), {}).m_Imports.size();
+
+		if (variable->m_Imports.size() != defaultImports)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Variable has imports."));
+
+		return new Array({ "Variable", di, SerializeString(variable->m_Variable) });
+	}
+
+	if (type == typeid(IndexerExpression)) {
+		auto indexer (static_cast<const IndexerExpression *>(expr));
+		auto binary (static_cast<const BinaryExpression *>(expr));
+
+		return new Array({ "Indexer", di, SerializeExpression(binary->m_Operand1.get(), path),
+			SerializeExpression(binary->m_Operand2.get(), path), indexer->m_OverrideFrozen });
+	}
+
+	if (type == typeid(SetExpression)) {
+		auto set (static_cast<const SetExpression *>(expr));
+		auto binary (static_cast<const BinaryExpression *>(expr));
+
+		return new Array({ "Set", di, SerializeExpression(binary->m_Operand1.get(), path),
+			SerializeExpression(binary->m_Operand2.get(), path), static_cast<int>(set->m_Op), set->m_OverrideFrozen });
+	}
+
+	if (type == typeid(SetConstExpression)) {
+		auto setConst (static_cast<const SetConstExpression *>(expr));
+
+		return new Array({ "SetConst", di, SerializeString(setConst->m_Name),
+			SerializeExpression(static_cast<const UnaryExpression *>(expr)->m_Operand.get(), path) });
+	}
+
+	if (type == typeid(FunctionCallExpression)) {
+		auto call (static_cast<const FunctionCallExpression *>(expr));
+
+		return new Array({ "FunctionCall", di, SerializeExpression(call->m_FName.get(), path), SerializeExpressions(call->m_Args, path) });
+	}
+
+	if (type == typeid(ArrayExpression))
+		return new Array({ "Array", di, SerializeExpressions(static_cast<const ArrayExpression *>(expr)->m_Expressions, path) });
+
+	if (type == typeid(DictExpression)) {
+		auto dict (static_cast<const DictExpression *>(expr));
+
+		return new Array({ "Dict", di, SerializeExpressions(dict->m_Expressions, path), dict->m_Inline });
+	}
+
+	if (type == typeid(ConditionalExpression)) {
+		auto conditional (static_cast<const ConditionalExpression *>(expr));
+
+		return new Array({ "Conditional", di, SerializeExpression(conditional->m_Condition.get(), path),
+			SerializeExpression(conditional->m_TrueBranch.get(), path), SerializeExpression(conditional->m_FalseBranch.get(), path) });
+	}
+
+	if (type == typeid(WhileExpression)) {
+		auto loop (static_cast<const WhileExpression *>(expr));
+
+		return new Array({ "While", di, SerializeExpression(loop->m_Condition.get(), path), SerializeExpression(loop->m_LoopBody.get(), path) });
+	}
+
+	if (type == typeid(ForExpression)) {
+		auto loop (static_cast<const ForExpression *>(expr));
+
+		return new Array({ "For", di, SerializeString(loop->m_FKVar), SerializeString(loop->m_FVVar),
+			SerializeExpression(loop->m_Value.get(), path), SerializeExpression(loop->m_Expression.get(), path) });
+	}
+
+	if (type == typeid(ThrowExpression)) {
+		auto throwExpr (static_cast<const ThrowExpression *>(expr));
+
+		return new Array({ "Throw", di, SerializeExpression(throwExpr->m_Message.get(), path), throwExpr->m_IncompleteExpr });
+	}
+
+	if (type == typeid(ImportExpression))
+		return new Array({ "Import", di, SerializeExpression(static_cast<const ImportExpression *>(expr)->m_Name.get(), path) });
+
+	if (type == typeid(NamespaceExpression))
+		return new Array({ "Namespace", di, SerializeExpression(static_cast<const NamespaceExpression *>(expr)->m_Expression.get(), path) });
+
+	if (type == typeid(TryExceptExpression)) {
+		auto tryExcept (static_cast<const TryExceptExpression *>(expr));
+
+		return new Array({ "TryExcept", di, SerializeExpression(tryExcept->m_TryBody.get(), path), SerializeExpression(tryExcept->m_ExceptBody.get(), path) });
+	}
+
+	if (type == typeid(FunctionExpression)) {
+		auto function (static_cast<const FunctionExpression *>(expr));
+		ArrayData args;
+
+		for (const String& arg : function->m_Args)
+			args.emplace_back(SerializeString(arg));
+
+		return new Array({ "Function", di, SerializeString(function->m_Name), new Array(std::move(args)),
+			SerializeClosedVars(function->m_ClosedVars, path), SerializeExpression(function->m_Expression.get(), path) });
+	}
+
+	if (type == typeid(ApplyExpression)) {
+		auto apply (static_cast<const ApplyExpression *>(expr));
+
+		return new Array({ "Apply", di, SerializeString(apply->m_Type), SerializeString(apply->m_Target),
+			SerializeExpression(apply->m_Name.get(), path), SerializeExpression(apply->m_Filter.get(), path),
+			SerializeString(apply->m_Package), SerializeString(apply->m_FKVar), SerializeString(apply->m_FVVar),
+			SerializeExpression(apply->m_FTerm.get(), path), SerializeClosedVars(apply->m_ClosedVars, path),
+			apply->m_IgnoreOnError, SerializeExpression(apply->m_Expression.get(), path) });
+	}
+
+	if (type == typeid(ObjectExpression)) {
+		auto object (static_cast<const ObjectExpression *>(expr));
+
+		return new Array({ "Object", di, object->m_Abstract, SerializeExpression(object->m_Type.get(), path),
+			SerializeExpression(object->m_Name.get(), path), SerializeExpression(object->m_Filter.get(), path),
+			SerializeString(object->m_Zone), SerializeString(object->m_Package), SerializeClosedVars(object->m_ClosedVars, path),
+			object->m_DefaultTmpl, object->m_IgnoreOnError, SerializeExpression(object->m_Expression.get(), path) });
+	}
+
+	if (type == typeid(IncludeExpression)) {
+		auto include (static_cast<const IncludeExpression *>(expr));
+
+		/* Usually the file's own directory, that one is kept out so that the entry can be moved. */
+		Value relativeBase;
+
+		if (include->m_RelativeBase != Utility::DirName(path))
+			relativeBase = SerializeString(include->m_RelativeBase);
+
+		return new Array({ "Include", di, relativeBase, SerializeExpression(include->m_Path.get(), path),
+			SerializeExpression(include->m_Pattern.get(), path), SerializeExpression(include->m_Name.get(), path),
+			static_cast<int>(include->m_Type), include->m_SearchIncludes, SerializeString(include->m_Zone), SerializeString(include->m_Package) });
+	}
+
+	BOOST_THROW_EXCEPTION(std::invalid_argument(String("Unsupported expression type: ") + type.name()));
+}
+
+/**
+ * Restores an expression which was serialized with SerializeExpression().
+ *
+ * @param node The serialized expression.
+ * @param path The path of the file the expression was compiled from.
+ * @returns The expression, nullptr if node is empty
+ */
+std::unique_ptr<Expression> ConfigCompilerCache::DeserializeExpression(const Value& node, const String& path)
+{
+	if (node.IsEmpty())
+		return nullptr;
+
+	Array::Ptr arr = node;
+	String type = arr->Get(0);
+
+	if (type == "Literal")
+		return MakeLiteral(arr->Get(2));
+
+	if (type == "GetScope")
+		return std::unique_ptr<Expression>(new GetScopeExpression(static_cast<ScopeSpecifier>(static_cast<int>(arr->Get(2)))));
+
+	DebugInfo di = DeserializeDebugInfo(arr->Get(1), path);
+
+	auto child ([&arr, &path](ArrayData::size_type index) {
+		return DeserializeExpression(arr->Get(index), path);
+	});
+
+#define DESERIALIZE_BINARY(name) \
+	if (type == #name) \
+		return std::unique_ptr<Expression>(new name##Expression(child(2), child(3), di));
+
+	BINARY_EXPRESSIONS(DESERIALIZE_BINARY)
+
+#undef DESERIALIZE_BINARY
+
+#define DESERIALIZE_UNARY(name) \
+	if (type == #name) \
+		return std::unique_ptr<Expression>(new name##Expression(child(2), di));
+
+	UNARY_EXPRESSIONS(DESERIALIZE_UNARY)
+
+#undef DESERIALIZE_UNARY
+
+#define DESERIALIZE_EMPTY(name) \
+	if (type == #name) \
+		return std::unique_ptr<Expression>(new name##Expression(di));
+
+	EMPTY_EXPRESSIONS(DESERIALIZE_EMPTY)
+
+#undef DESERIALIZE_EMPTY
+
+	if (type == "Variable")
+		return std::unique_ptr<Expression>(new VariableExpression(arr->Get(2), {}, di));
+
+	if (type == "Indexer") {
+		std::unique_ptr<IndexerExpression> indexer {new IndexerExpression(child(2), child(3), di)};
+
+		if (arr->Get(4).ToBool())
+			indexer->SetOverrideFrozen();
+
+		return std::move(indexer);
+	}
+
+	if (type == "Set") {
+		std::unique_ptr<SetExpression> set {new SetExpression(child(2), static_cast<CombinedSetOp>(static_cast<int>(arr->Get(4))), child(3), di)};
+
+		if (arr->Get(5).ToBool())
+			set->SetOverrideFrozen();
+
+		return std::move(set);
+	}
+
+	if (type == "SetConst")
+		return std::unique_ptr<Expression>(new SetConstExpression(arr->Get(2), child(3), di));
+
+	if (type == "FunctionCall")
+		return std::unique_ptr<Expression>(new FunctionCallExpression(child(2), DeserializeExpressions(arr->Get(3), path), di));
+
+	if (type == "Array")
+		return std::unique_ptr<Expression>(new ArrayExpression(DeserializeExpressions(arr->Get(2), path), di));
+
+	if (type == "Dict") {
+		std::unique_ptr<DictExpression> dict {new DictExpression(DeserializeExpressions(arr->Get(2), path), di)};
+
+		if (arr->Get(3).ToBool())
+			dict->MakeInline();
+
+		return std::move(dict);
+	}
+
+	if (type == "Conditional")
+		return std::unique_ptr<Expression>(new ConditionalExpression(child(2), child(3), child(4), di));
+
+	if (type == "While")
+		return std::unique_ptr<Expression>(new WhileExpression(child(2), child(3), di));
+
+	if (type == "For")
+		return std::unique_ptr<Expression>(new ForExpression(arr->Get(2), arr->Get(3), child(4), child(5), di));
+
+	if (type == "Throw")
+		return std::unique_ptr<Expression>(new ThrowExpression(child(2), arr->Get(3).ToBool(), di));
+
+	if (type == "Import")
+		return std::unique_ptr<Expression>(new ImportExpression(child(2), di));
+
+	if (type == "Namespace")
+		return std::unique_ptr<Expression>(new NamespaceExpression(child(2), di));
+
+	if (type == "TryExcept")
+		return std::unique_ptr<Expression>(new TryExceptExpression(child(2), child(3), di));
+
+	if (type == "Function") {
+		Array::Ptr vargs = arr->Get(3);
+		std::vector<String> args;
+
+		ObjectLock olock(vargs);
+		for (const Value& arg : vargs)
+			args.emplace_back(arg);
+
+		return std::unique_ptr<Expression>(new FunctionExpression(arr->Get(2), std::move(args),
+			DeserializeClosedVars(arr->Get(4), path), child(5), di));
+	}
+
+	if (type == "Apply") {
+		return std::unique_ptr<Expression>(new ApplyExpression(arr->Get(2), arr->Get(3), child(4), child(5),
+			arr->Get(6), arr->Get(7), arr->Get(8), child(9), DeserializeClosedVars(arr->Get(10), path),
+			arr->Get(11).ToBool(), child(12), di));
+	}
+
+	if (type == "Object") {
+		return std::unique_ptr<Expression>(new ObjectExpression(arr->Get(2).ToBool(), child(3), child(4), child(5),
+			arr->Get(6), arr->Get(7), DeserializeClosedVars(arr->Get(8), path), arr->Get(9).ToBool(),
+			arr->Get(10).ToBool(), child(11), di));
+	}
+
+	if (type == "Include") {
+		Value relativeBase = arr->Get(2);
+
+		return std::unique_ptr<Expression>(new IncludeExpression(relativeBase.IsEmpty() ? Utility::DirName(path) : String(relativeBase), child(3), child(4), child(5),
+			static_cast<IncludeType>(static_cast<int>(arr->Get(6))), arr->Get(7).ToBool(), arr->Get(8), arr->Get(9), di));
+	}
+
+	BOOST_THROW_EXCEPTION(std::invalid_argument("Unknown expression type: " + type));
+}
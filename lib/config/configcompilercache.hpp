@@ -0,0 +1,61 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef CONFIGCOMPILERCACHE_H
+#define CONFIGCOMPILERCACHE_H
+
+#include "config/i2-config.hpp"
+#include "config/expression.hpp"
+#include <mutex>
+#include <set>
+
+namespace icinga
+{
+
+/**
+ * An on-disk cache for the expressions of compiled config files. Entries
+ * are keyed by a hash of the file's path, zone, package and content so
+ * that only changed files have to be parsed again.
+ *
+ * Files whose expressions can't be represented (e.g. because of "using"
+ * imports or non-UTF-8 strings) aren't cached.
+ *
+ * @ingroup config
+ */
+class ConfigCompilerCache
+{
+public:
+	static void SetEnabled(bool enabled);
+	static bool IsEnabled();
+
+	static String GetKey(const String& path, const String& zone, const String& package, const String& content);
+	static std::unique_ptr<Expression> Load(const String& key, const String& path);
+	static void Store(const String& key, const String& path, const Expression *expr);
+	static void Prune();
+
+	static bool Precompile(const String& path, const String& dir);
+
+	static Value SerializeExpression(const Expression *expr, const String& path);
+	static std::unique_ptr<Expression> DeserializeExpression(const Value& node, const String& path);
+
+private:
+	static bool m_Enabled;
+	static std::mutex m_Mutex;
+	static std::set<String> m_UsedKeys;
+
+	static String GetCacheDir();
+	static String GetPrecompiledDir();
+	static bool StoreIn(const String& dir, const String& key, const String& path, const Expression *expr);
+	static void MarkUsed(const String& key);
+
+	static Value SerializeDebugInfo(const Expression *expr, const String& path);
+	static DebugInfo DeserializeDebugInfo(const Value& value, const String& path);
+	static String SerializeString(const String& value);
+	static Array::Ptr SerializeExpressions(const std::vector<std::unique_ptr<Expression> >& exprs, const String& path);
+	static std::vector<std::unique_ptr<Expression> > DeserializeExpressions(const Array::Ptr& nodes, const String& path);
+	static Dictionary::Ptr SerializeClosedVars(const std::map<String, std::unique_ptr<Expression> >& closedVars, const String& path);
+	static std::map<String, std::unique_ptr<Expression> > DeserializeClosedVars(const Dictionary::Ptr& nodes, const String& path);
+};
+
+}
+
+#endif /* CONFIGCOMPILERCACHE_H */
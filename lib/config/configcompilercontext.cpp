@@ -7,6 +7,10 @@
 #include "base/exception.hpp"
 #include "base/application.hpp"
 #include "base/utility.hpp"
+#include "base/logger.hpp"
+#include "base/stdiostream.hpp"
+#include "base/convert.hpp"
+#include <fstream>
 
 using namespace icinga;
 
@@ -31,6 +35,8 @@ void ConfigCompilerContext::OpenObjectsFile(const String& filename)
 		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open '" + m_ObjectsTempFile + "' file"));
 
 	m_ObjectsFP = fp;
+	m_ObjectsSize = 0;
+	m_ObjectsIndex.clear();
 }
 
 void ConfigCompilerContext::WriteObject(const Dictionary::Ptr& object)
@@ -39,10 +45,24 @@ void ConfigCompilerContext::WriteObject(const Dictionary::Ptr& object)
 		return;
 
 	String json = JsonEncode(object);
+	Dictionary::Ptr properties = object->Get("properties");
+
+	ObjectsIndexEntry entry;
+	entry.Type = object->Get("type");
+	entry.Name = object->Get("name");
+	entry.InternalName = properties ? properties->Get("__name") : Empty;
+	entry.Length = json.GetLength();
+
+	/* The netstring's length prefix and its colon come first. */
+	uint_fast64_t prefixLength = Convert::ToString(json.GetLength()).GetLength() + 1;
 
 	{
 		std::unique_lock<std::mutex> lock(m_Mutex);
 		NetString::WriteStringToStream(*m_ObjectsFP, json);
+
+		entry.Offset = m_ObjectsSize + prefixLength;
+		m_ObjectsSize += prefixLength + json.GetLength() + 1;
+		m_ObjectsIndex.emplace_back(std::move(entry));
 	}
 }
 
@@ -50,6 +70,7 @@ void ConfigCompilerContext::CancelObjectsFile()
 {
 	delete m_ObjectsFP;
 	m_ObjectsFP = nullptr;
+	m_ObjectsIndex.clear();
 
 #ifdef _WIN32
 	_unlink(m_ObjectsTempFile.CStr());
@@ -64,5 +85,128 @@ void ConfigCompilerContext::FinishObjectsFile()
 	m_ObjectsFP = nullptr;
 
 	Utility::RenameFile(m_ObjectsTempFile, m_ObjectsPath);
+
+	WriteObjectsIndex();
+}
+
+/**
+ * Writes the index of the objects file next to it, so "icinga2 object list"
+ * doesn't have to read the whole file. The index is a netstring stream of
+ * JSON: a header which holds the size of the objects file and then one
+ * [type, name, __name, offset, length] array per object. Offset and length
+ * refer to the JSON of the object within its netstring.
+ */
+void ConfigCompilerContext::WriteObjectsIndex()
+{
+	String indexPath = m_ObjectsPath + ".index";
+	String tempIndexPath;
+
+	try {
+		std::fstream fp;
+		tempIndexPath = Utility::CreateTempFile(indexPath + ".XXXXXX", 0600, fp);
+
+		NetString::WriteStringToStream(fp, JsonEncode(new Dictionary({
+			{ "version", 1 },
+			{ "objects_size", m_ObjectsSize }
+		})));
+
+		for (const ObjectsIndexEntry& entry : m_ObjectsIndex) {
+			NetString::WriteStringToStream(fp, JsonEncode(new Array({
+				entry.Type, entry.Name, entry.InternalName, entry.Offset, entry.Length
+			})));
+		}
+
+		fp.close();
+
+		if (fp.fail())
+			BOOST_THROW_EXCEPTION(std::runtime_error("Could not write '" + tempIndexPath + "'"));
+
+		Utility::RenameFile(tempIndexPath, indexPath);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ConfigCompilerContext")
+			<< "Could not write the objects index '" << indexPath << "': " << DiagnosticInformation(ex, false);
+
+		/* A stale index would be noticed by its objects_size, but don't leave it behind. */
+		if (!tempIndexPath.IsEmpty() && Utility::PathExists(tempIndexPath))
+			Utility::Remove(tempIndexPath);
+
+		if (Utility::PathExists(indexPath))
+			Utility::Remove(indexPath);
+	}
+
+	m_ObjectsIndex.clear();
+	m_ObjectsIndex.shrink_to_fit();
+}
+
+/**
+ * Reads the index of an objects file, see WriteObjectsIndex().
+ *
+ * @param objectsFile The objects file
+ * @param entries Receives the objects in the order of the objects file
+ * @returns Whether the index exists and belongs to the objects file
+ */
+bool ConfigCompilerContext::ReadObjectsIndex(const String& objectsFile, std::vector<ObjectsIndexEntry>& entries)
+{
+	String indexPath = objectsFile + ".index";
+
+	if (!Utility::PathExists(indexPath))
+		return false;
+
+	std::ifstream objectsFp (objectsFile.CStr(), std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+
+	if (!objectsFp)
+		return false;
+
+	uint_fast64_t objectsSize = objectsFp.tellg();
+
+	std::fstream fp (indexPath.CStr(), std::ios_base::in | std::ios_base::binary);
+	StdioStream::Ptr sfp = new StdioStream(&fp, false);
+	StreamReadContext src;
+	String message;
+	bool header = true;
+
+	entries.clear();
+
+	try {
+		for (;;) {
+			StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+
+			if (srs == StatusEof)
+				break;
+
+			if (srs != StatusNewItem)
+				continue;
+
+			if (header) {
+				Dictionary::Ptr info = JsonDecode(message);
+
+				if (info->Get("version") != 1 || static_cast<uint_fast64_t>(info->Get("objects_size")) != objectsSize)
+					return false;
+
+				header = false;
+				continue;
+			}
+
+			Array::Ptr item = JsonDecode(message);
+			ObjectsIndexEntry entry;
+
+			entry.Type = item->Get(0);
+			entry.Name = item->Get(1);
+			entry.InternalName = item->Get(2);
+			entry.Offset = item->Get(3);
+			entry.Length = item->Get(4);
+
+			if (entry.Offset + entry.Length > objectsSize)
+				return false;
+
+			entries.emplace_back(std::move(entry));
+		}
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ConfigCompilerContext")
+			<< "Ignoring the invalid objects index '" << indexPath << "': " << DiagnosticInformation(ex, false);
+		return false;
+	}
+
+	return !header;
 }
 
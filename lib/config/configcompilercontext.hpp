@@ -5,12 +5,28 @@
 
 #include "config/i2-config.hpp"
 #include "base/dictionary.hpp"
+#include <cstdint>
 #include <fstream>
 #include <mutex>
+#include <vector>
 
 namespace icinga
 {
 
+/**
+ * Where an object is stored in the objects file, see ConfigCompilerContext::ReadObjectsIndex().
+ *
+ * @ingroup config
+ */
+struct ObjectsIndexEntry
+{
+	String Type;
+	String Name;
+	String InternalName;
+	uint_fast64_t Offset;
+	uint_fast64_t Length;
+};
+
 /*
  * @ingroup config
  */
@@ -24,12 +40,18 @@ public:
 
 	static ConfigCompilerContext *GetInstance();
 
+	static bool ReadObjectsIndex(const String& objectsFile, std::vector<ObjectsIndexEntry>& entries);
+
 private:
 	String m_ObjectsPath;
 	String m_ObjectsTempFile;
 	std::fstream *m_ObjectsFP{nullptr};
+	uint_fast64_t m_ObjectsSize{0};
+	std::vector<ObjectsIndexEntry> m_ObjectsIndex;
 
 	mutable std::mutex m_Mutex;
+
+	void WriteObjectsIndex();
 };
 
 }
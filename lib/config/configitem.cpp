@@ -7,6 +7,7 @@
 #include "config/configcompiler.hpp"
 #include "base/application.hpp"
 #include "base/configtype.hpp"
+#include "base/configuration.hpp"
 #include "base/objectlock.hpp"
 #include "base/convert.hpp"
 #include "base/logger.hpp"
@@ -19,11 +20,13 @@
 #include "base/json.hpp"
 #include "base/exception.hpp"
 #include "base/function.hpp"
+#include "base/startupprofiler.hpp"
 #include "base/utility.hpp"
 #include <boost/algorithm/string/join.hpp>
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <memory>
 #include <random>
 
 using namespace icinga;
@@ -32,6 +35,7 @@ std::mutex ConfigItem::m_Mutex;
 ConfigItem::TypeMap ConfigItem::m_Items;
 ConfigItem::TypeMap ConfigItem::m_DefaultTemplates;
 ConfigItem::ItemList ConfigItem::m_UnnamedItems;
+std::map<Type::Ptr, std::shared_ptr<const ConfigItem::ObjectRuleIndex> > ConfigItem::m_ObjectRuleIndexes;
 ConfigItem::IgnoredItemList ConfigItem::m_IgnoredItems;
 
 REGISTER_FUNCTION(Internal, run_with_activation_context, &ConfigItem::RunWithActivationContext, "func");
@@ -111,6 +115,7 @@ DebugInfo ConfigItem::GetDebugInfo() const
 
 Dictionary::Ptr ConfigItem::GetScope() const
 {
+	ObjectLock olock(this);
 	return m_Scope;
 }
 
@@ -126,6 +131,8 @@ ConfigObject::Ptr ConfigItem::GetObject() const
  */
 Expression::Ptr ConfigItem::GetExpression() const
 {
+	/* Locked because of Compact(), other threads may import the item. */
+	ObjectLock olock(this);
 	return m_Expression;
 }
 
@@ -175,6 +182,9 @@ ConfigObject::Ptr ConfigItem::Commit(bool discard)
 	if (IsAbstract())
 		return nullptr;
 
+	/* Objects which are only validated are neither written nor registered. */
+	bool validateOnly = m_ActivationContext && m_ActivationContext->IsValidateOnly();
+
 	ConfigObject::Ptr dobj = static_pointer_cast<ConfigObject>(type->Instantiate(std::vector<Value>()));
 
 	dobj->SetDebugInfo(m_DebugInfo);
@@ -194,7 +204,7 @@ ConfigObject::Ptr ConfigItem::Commit(bool discard)
 			Log(LogNotice, "ConfigObject")
 				<< "Ignoring config object '" << m_Name << "' of type '" << type->GetName() << "' due to errors: " << DiagnosticInformation(ex);
 
-			{
+			if (!validateOnly) {
 				std::unique_lock<std::mutex> lock(m_Mutex);
 				m_IgnoredItems.push_back(m_DebugInfo.Path);
 			}
@@ -246,7 +256,7 @@ ConfigObject::Ptr ConfigItem::Commit(bool discard)
 			Log(LogNotice, "ConfigObject")
 				<< "Ignoring config object '" << m_Name << "' of type '" << type->GetName() << "' due to errors: " << DiagnosticInformation(ex);
 
-			{
+			if (!validateOnly) {
 				std::unique_lock<std::mutex> lock(m_Mutex);
 				m_IgnoredItems.push_back(m_DebugInfo.Path);
 			}
@@ -265,7 +275,7 @@ ConfigObject::Ptr ConfigItem::Commit(bool discard)
 			Log(LogNotice, "ConfigObject")
 				<< "Ignoring config object '" << m_Name << "' of type '" << m_Type->GetName() << "' due to errors: " << DiagnosticInformation(ex);
 
-			{
+			if (!validateOnly) {
 				std::unique_lock<std::mutex> lock(m_Mutex);
 				m_IgnoredItems.push_back(m_DebugInfo.Path);
 			}
@@ -276,6 +286,9 @@ ConfigObject::Ptr ConfigItem::Commit(bool discard)
 		throw;
 	}
 
+	if (validateOnly)
+		return dobj;
+
 	Value serializedObject;
 
 	try {
@@ -317,6 +330,11 @@ void ConfigItem::Register()
 {
 	m_ActivationContext = ActivationContext::GetCurrentContext();
 
+	if (m_ActivationContext->IsValidateOnly()) {
+		RegisterForValidation();
+		return;
+	}
+
 	std::unique_lock<std::mutex> lock(m_Mutex);
 
 	/* If this is a non-abstract object with a composite name
@@ -340,9 +358,37 @@ void ConfigItem::Register()
 
 		if (m_DefaultTmpl)
 			m_DefaultTemplates[m_Type][m_Name] = this;
+
+		if (m_Filter)
+			m_ObjectRuleIndexes.erase(m_Type);
 	}
 }
 
+/**
+ * Registers the item with its validation context only. Names have to be
+ * unique among the context's items and the running items which aren't
+ * replaced by them.
+ */
+void ConfigItem::RegisterForValidation()
+{
+	if (!m_Abstract && dynamic_cast<NameComposer *>(m_Type.get())) {
+		m_ActivationContext->m_UnnamedItems.emplace_back(this);
+		return;
+	}
+
+	ConfigItem::Ptr existing = GetByTypeAndName(m_Type, m_Name);
+
+	if (existing) {
+		std::ostringstream msgbuf;
+		msgbuf << "A configuration item of type '" << m_Type->GetName()
+				<< "' and name '" << GetName() << "' already exists ("
+				<< existing->GetDebugInfo() << "), new declaration: " << GetDebugInfo();
+		BOOST_THROW_EXCEPTION(ScriptError(msgbuf.str()));
+	}
+
+	m_ActivationContext->m_Items[std::make_pair(m_Type, m_Name)] = this;
+}
+
 /**
  * Unregisters the configuration item.
  */
@@ -357,6 +403,9 @@ void ConfigItem::Unregister()
 	m_UnnamedItems.erase(std::remove(m_UnnamedItems.begin(), m_UnnamedItems.end(), this), m_UnnamedItems.end());
 	m_Items[m_Type].erase(m_Name);
 	m_DefaultTemplates[m_Type].erase(m_Name);
+
+	if (m_Filter)
+		m_ObjectRuleIndexes.erase(m_Type);
 }
 
 /**
@@ -368,19 +417,133 @@ void ConfigItem::Unregister()
  */
 ConfigItem::Ptr ConfigItem::GetByTypeAndName(const Type::Ptr& type, const String& name)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	/* While validating, the context's items take the place of the running ones they replace. */
+	ActivationContext::Ptr validationContext = ActivationContext::GetCurrentValidationContext();
 
-	auto it = m_Items.find(type);
+	if (validationContext) {
+		auto it = validationContext->m_Items.find(std::make_pair(type, name));
 
-	if (it == m_Items.end())
-		return nullptr;
+		if (it != validationContext->m_Items.end())
+			return it->second;
+	}
 
-	auto it2 = it->second.find(name);
+	ConfigItem::Ptr item;
 
-	if (it2 == it->second.end())
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		auto it = m_Items.find(type);
+
+		if (it == m_Items.end())
+			return nullptr;
+
+		auto it2 = it->second.find(name);
+
+		if (it2 == it->second.end())
+			return nullptr;
+
+		item = it2->second;
+	}
+
+	if (validationContext && validationContext->Replaces(item->m_Package, item->m_Zone))
 		return nullptr;
 
-	return it2->second;
+	return item;
+}
+
+/**
+ * Commits the items of a validation context, see
+ * ActivationContext::SetValidateOnly(). Their objects are validated but
+ * neither registered nor activated, so the running config stays untouched.
+ * Items are committed one type after another in the order of their load
+ * dependencies, so that objects can reference objects of the same context.
+ *
+ * Neither apply rules are evaluated nor does OnAllConfigLoaded() run, both
+ * would change running objects.
+ *
+ * @param context The validation context, it has to be the current one.
+ * @param errors Receives the errors of all items which aren't valid.
+ * @returns Whether all items are valid.
+ */
+bool ConfigItem::ValidateItems(const ActivationContext::Ptr& context, std::vector<String>& errors)
+{
+	ASSERT(context->IsValidateOnly());
+
+	std::vector<std::pair<ConfigItem::Ptr, bool> > items;
+
+	for (auto& kv : context->m_Items) {
+		if (!kv.second->m_Abstract)
+			items.emplace_back(kv.second, false);
+	}
+
+	for (const ConfigItem::Ptr& item : context->m_UnnamedItems)
+		items.emplace_back(item, true);
+
+	std::set<Type::Ptr> types;
+	std::set<Type::Ptr> completed_types;
+
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		if (ConfigObject::TypeInstance->IsAssignableFrom(type))
+			types.insert(type);
+	}
+
+	size_t numErrors = errors.size();
+
+	while (types.size() != completed_types.size()) {
+		for (const Type::Ptr& type : types) {
+			if (completed_types.find(type) != completed_types.end())
+				continue;
+
+			bool unresolved_dep = false;
+
+			/* skip this type (for now) if there are unresolved load dependencies */
+			for (const String& loadDep : type->GetLoadDependencies()) {
+				Type::Ptr pLoadDep = Type::GetByName(loadDep);
+				if (types.find(pLoadDep) != types.end() && completed_types.find(pLoadDep) == completed_types.end()) {
+					unresolved_dep = true;
+					break;
+				}
+			}
+
+			if (unresolved_dep)
+				continue;
+
+			for (auto& ip : items) {
+				if (ip.first->m_Type != type)
+					continue;
+
+				try {
+					ConfigObject::Ptr object = ip.first->Commit(false);
+
+					/* Makes objects with composite names visible to references. */
+					if (object && ip.second)
+						context->m_Items[std::make_pair(type, object->GetName())] = ip.first;
+				} catch (const std::exception& ex) {
+					errors.emplace_back(DiagnosticInformation(ex, false));
+				}
+			}
+
+			completed_types.insert(type);
+		}
+	}
+
+	return errors.size() == numErrors;
+}
+
+/**
+ * @returns The items of a validation context, templates included.
+ */
+std::vector<ConfigItem::Ptr> ConfigItem::GetValidationItems(const ActivationContext::Ptr& context)
+{
+	std::vector<ConfigItem::Ptr> items (context->m_UnnamedItems.begin(), context->m_UnnamedItems.end());
+
+	for (auto& kv : context->m_Items) {
+		/* Objects with composite names are in both after they've been validated. */
+		if (kv.second->m_Abstract || !dynamic_cast<NameComposer *>(kv.second->m_Type.get()))
+			items.push_back(kv.second);
+	}
+
+	return items;
 }
 
 bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue& upq, std::vector<ConfigItem::Ptr>& newItems)
@@ -462,6 +625,8 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 			if (unresolved_dep)
 				continue;
 
+			StartupPhase commitPhase ("commit_items/commit/" + type->GetName());
+
 			int committed_items = 0;
 			upq.ParallelFor(items, [&type, &committed_items](const ItemPair& ip) {
 				const ConfigItem::Ptr& item = ip.first;
@@ -475,6 +640,7 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 
 			upq.Join();
 
+			commitPhase.SetCount(committed_items);
 			completed_types.insert(type);
 
 #ifdef I2_DEBUG
@@ -514,6 +680,8 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 			if (unresolved_dep)
 				continue;
 
+			std::unique_ptr<StartupPhase> phase (new StartupPhase("commit_items/all_config_loaded/" + type->GetName()));
+
 			int notified_items = 0;
 			upq.ParallelFor(items, [&type, &notified_items](const ItemPair& ip) {
 				const ConfigItem::Ptr& item = ip.first;
@@ -553,8 +721,14 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 			if (upq.HasExceptions())
 				return false;
 
+			phase->SetCount(notified_items);
+			phase.reset(new StartupPhase("commit_items/create_child_objects/" + type->GetName()));
+
 			notified_items = 0;
 			for (const String& loadDep : type->GetLoadDependencies()) {
+				if (!context->GetCreateChildObjects())
+					break;
+
 				upq.ParallelFor(items, [loadDep, &type, &notified_items](const ItemPair& ip) {
 					const ConfigItem::Ptr& item = ip.first;
 
@@ -578,6 +752,9 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 			if (upq.HasExceptions())
 				return false;
 
+			phase->SetCount(notified_items);
+			phase.reset();
+
 			// Make sure to activate any additionally generated items
 			if (!CommitNewItems(context, upq, newItems))
 				return false;
@@ -587,11 +764,28 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 	return true;
 }
 
+/**
+ * Frees the expression of a committed object, it's only evaluated again if
+ * another object imports this one. Templates keep theirs for their imports,
+ * the scope stays with items which have a filter, e.g. assign rules of groups.
+ */
+void ConfigItem::Compact()
+{
+	ObjectLock olock(this);
+
+	m_Expression.reset();
+
+	if (!m_Filter)
+		m_Scope.reset();
+}
+
 bool ConfigItem::CommitItems(const ActivationContext::Ptr& context, WorkQueue& upq, std::vector<ConfigItem::Ptr>& newItems, bool silent)
 {
 	if (!silent)
 		Log(LogInformation, "ConfigItem", "Committing config item(s).");
 
+	StartupPhase phase ("commit_items");
+
 	if (!CommitNewItems(context, upq, newItems)) {
 		upq.ReportExceptions("config");
 
@@ -602,7 +796,19 @@ bool ConfigItem::CommitItems(const ActivationContext::Ptr& context, WorkQueue& u
 		return false;
 	}
 
-	ApplyRule::CheckMatches(silent);
+	phase.SetCount(newItems.size());
+
+	if (Configuration::CompactConfigItems) {
+		for (const ConfigItem::Ptr& item : newItems) {
+			if (item->m_Object)
+				item->Compact();
+		}
+	}
+
+	{
+		StartupPhase checkPhase ("commit_items/check_apply_matches");
+		ApplyRule::CheckMatches(silent);
+	}
 
 	if (!silent) {
 		/* log stats for external parsers */
@@ -630,7 +836,11 @@ bool ConfigItem::ActivateItems(const std::vector<ConfigItem::Ptr>& newItems, boo
 	static std::mutex mtx;
 	std::unique_lock<std::mutex> lock(mtx);
 
+	StartupPhase phase ("activate_items", newItems.size());
+
 	if (withModAttrs) {
+		StartupPhase modAttrsPhase ("activate_items/restore_modified_attributes");
+
 		/* restore modified attributes */
 		if (Utility::PathExists(Configuration::ModAttrPath)) {
 			std::unique_ptr<Expression> expression = ConfigCompiler::CompileFile(Configuration::ModAttrPath);
@@ -666,34 +876,65 @@ bool ConfigItem::ActivateItems(const std::vector<ConfigItem::Ptr>& newItems, boo
 	if (!silent)
 		Log(LogInformation, "ConfigItem", "Triggering Start signal for config items");
 
-	/* Activate objects in priority order. */
-	std::vector<Type::Ptr> types = Type::GetAllTypes();
+	/* Activate objects in priority order. Objects with the same priority don't
+	 * depend on each other and are activated in parallel.
+	 */
+	std::map<int, std::vector<ConfigObject::Ptr> > levels;
 
-	std::sort(types.begin(), types.end(), [](const Type::Ptr& a, const Type::Ptr& b) {
-		if (a->GetActivationPriority() < b->GetActivationPriority())
-			return true;
-		return false;
-	});
+	for (const ConfigItem::Ptr& item : newItems) {
+		if (!item->m_Object)
+			continue;
 
-	for (const Type::Ptr& type : types) {
-		for (const ConfigItem::Ptr& item : newItems) {
-			if (!item->m_Object)
-				continue;
+		levels[item->m_Object->GetReflectionType()->GetActivationPriority()].push_back(item->m_Object);
+	}
 
-			ConfigObject::Ptr object = item->m_Object;
-			Type::Ptr objectType = object->GetReflectionType();
+	WorkQueue upq(25000, Configuration::Concurrency);
+	upq.SetName("ConfigItem::ActivateItems");
 
-			if (objectType != type)
-				continue;
+	for (auto& level : levels) {
+		const std::vector<ConfigObject::Ptr>& objects = level.second;
+		double start = Utility::GetTime();
 
+		StartupPhase levelPhase ("activate_items/priority " + Convert::ToString(level.first), objects.size());
+
+		auto activate = [runtimeCreated, &cookie](const ConfigObject::Ptr& object) {
 #ifdef I2_DEBUG
 			Log(LogDebug, "ConfigItem")
 				<< "Activating object '" << object->GetName() << "' of type '"
-				<< objectType->GetName() << "' with priority "
-				<< objectType->GetActivationPriority();
+				<< object->GetReflectionType()->GetName() << "' with priority "
+				<< object->GetReflectionType()->GetActivationPriority();
 #endif /* I2_DEBUG */
 
 			object->Activate(runtimeCreated, cookie);
+		};
+
+		/* Don't spawn worker threads for single runtime created objects. */
+		if (objects.size() == 1)
+			activate(objects[0]);
+		else {
+			upq.ParallelFor(objects, activate);
+			upq.Join();
+		}
+
+		if (upq.HasExceptions()) {
+			upq.ReportExceptions("ConfigItem");
+			return false;
+		}
+
+		if (!silent) {
+			std::map<String, size_t> typeCounts;
+
+			for (const ConfigObject::Ptr& object : objects)
+				typeCounts[object->GetReflectionType()->GetName()]++;
+
+			for (auto& kv : typeCounts) {
+				Log(LogNotice, "ConfigItem")
+					<< "Activated " << kv.second << " objects of type '" << kv.first << "' with priority " << level.first << ".";
+			}
+
+			Log(LogInformation, "ConfigItem")
+				<< "Activated " << objects.size() << " objects with priority " << level.first
+				<< " in " << Utility::FormatDuration(Utility::GetTime() - start) << ".";
 		}
 	}
 
@@ -746,6 +987,56 @@ std::vector<ConfigItem::Ptr> ConfigItem::GetItems(const Type::Ptr& type)
 	return items;
 }
 
+/**
+ * Returns the items of a type whose "assign where" filter might match for
+ * the specified frame, in the order of their names. Filters which compare a
+ * field of the object with a string, e.g. "host.vars.os == \"Linux\"", are
+ * indexed, see FilterIndex. The caller still has to evaluate the filters.
+ *
+ * @param type The type, e.g. HostGroup.
+ * @param frame A frame containing the object, e.g. as "host".
+ * @returns The candidate items
+ */
+std::vector<ConfigItem::Ptr> ConfigItem::GetObjectRuleCandidates(const Type::Ptr& type, ScriptFrame& frame)
+{
+	std::shared_ptr<const ObjectRuleIndex> index;
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		std::shared_ptr<const ObjectRuleIndex>& cached = m_ObjectRuleIndexes[type];
+
+		if (!cached) {
+			auto newIndex = std::make_shared<ObjectRuleIndex>();
+			auto it = m_Items.find(type);
+
+			if (it != m_Items.end()) {
+				for (const ItemMap::value_type& kv : it->second) {
+					const ConfigItem::Ptr& item = kv.second;
+
+					if (!item->m_Filter)
+						continue;
+
+					/* Compact() keeps the scope of items with a filter. */
+					newIndex->Filters.Add(newIndex->Items.size(), item->m_Filter.get(), item->m_Scope);
+					newIndex->Items.push_back(item);
+				}
+			}
+
+			cached = newIndex;
+		}
+
+		index = cached;
+	}
+
+	std::vector<ConfigItem::Ptr> items;
+
+	for (size_t i : index->Filters.GetCandidates(frame))
+		items.push_back(index->Items[i]);
+
+	return items;
+}
+
 std::vector<ConfigItem::Ptr> ConfigItem::GetDefaultTemplates(const Type::Ptr& type)
 {
 	std::vector<ConfigItem::Ptr> items;
@@ -6,6 +6,7 @@
 #include "config/i2-config.hpp"
 #include "config/expression.hpp"
 #include "config/activationcontext.hpp"
+#include "config/filterindex.hpp"
 #include "base/configobject.hpp"
 #include "base/workqueue.hpp"
 
@@ -43,6 +44,7 @@ public:
 
 	void Register();
 	void Unregister();
+	void Compact();
 
 	DebugInfo GetDebugInfo() const;
 	Dictionary::Ptr GetScope() const;
@@ -56,10 +58,14 @@ public:
 	static bool ActivateItems(const std::vector<ConfigItem::Ptr>& newItems, bool runtimeCreated = false,
 		bool silent = false, bool withModAttrs = false, const Value& cookie = Empty);
 
+	static bool ValidateItems(const ActivationContext::Ptr& context, std::vector<String>& errors);
+	static std::vector<ConfigItem::Ptr> GetValidationItems(const ActivationContext::Ptr& context);
+
 	static bool RunWithActivationContext(const Function::Ptr& function);
 
 	static std::vector<ConfigItem::Ptr> GetItems(const Type::Ptr& type);
 	static std::vector<ConfigItem::Ptr> GetDefaultTemplates(const Type::Ptr& type);
+	static std::vector<ConfigItem::Ptr> GetObjectRuleCandidates(const Type::Ptr& type, ScriptFrame& frame);
 
 	static void RemoveIgnoredItems(const String& allowedConfigPath);
 
@@ -90,6 +96,15 @@ private:
 	typedef std::vector<ConfigItem::Ptr> ItemList;
 	static ItemList m_UnnamedItems;
 
+	/* The items of a type which have an "assign where" filter, e.g. groups. */
+	struct ObjectRuleIndex
+	{
+		std::vector<ConfigItem::Ptr> Items;
+		FilterIndex Filters;
+	};
+
+	static std::map<Type::Ptr, std::shared_ptr<const ObjectRuleIndex> > m_ObjectRuleIndexes;
+
 	typedef std::vector<String> IgnoredItemList;
 	static IgnoredItemList m_IgnoredItems;
 
@@ -97,6 +112,7 @@ private:
 		const String& name);
 
 	ConfigObject::Ptr Commit(bool discard = true);
+	void RegisterForValidation();
 
 	static bool CommitNewItems(const ActivationContext::Ptr& context, WorkQueue& upq, std::vector<ConfigItem::Ptr>& newItems);
 };
@@ -482,16 +482,25 @@ ExpressionResult FunctionCallExpression::DoEvaluate(ScriptFrame& frame, DebugHin
 	if (!func->IsSideEffectFree() && frame.Sandboxed)
 		BOOST_THROW_EXCEPTION(ScriptError("Function is not marked as safe for sandbox mode.", m_DebugInfo));
 
-	std::vector<Value> arguments;
-	arguments.reserve(m_Args.size());
+	/* Most calls have only a few arguments, these are kept on the stack rather than in a vector. */
+	Value smallArguments[4];
+	std::vector<Value> largeArguments;
+	Value *arguments = smallArguments;
+
+	if (m_Args.size() > sizeof(smallArguments) / sizeof(smallArguments[0])) {
+		largeArguments.resize(m_Args.size());
+		arguments = largeArguments.data();
+	}
+
+	size_t count = 0;
 	for (const auto& arg : m_Args) {
 		ExpressionResult argres = arg->Evaluate(frame);
 		CHECK_RESULT(argres);
 
-		arguments.push_back(argres.GetValue());
+		arguments[count++] = argres.GetValue();
 	}
 
-	return VMOps::FunctionCall(frame, self, func, arguments);
+	return VMOps::FunctionCall(frame, self, func, arguments, count);
 }
 
 ExpressionResult ArrayExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
@@ -854,6 +863,43 @@ void icinga::BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scope
 	}
 }
 
+/**
+ * Evaluates an operator whose operands are literals once at parse time and
+ * replaces it with a literal holding the result. This saves evaluating the
+ * same constant sub-expression again and again, e.g. in apply rule filters
+ * which are evaluated for every object.
+ *
+ * The operator is kept as is if evaluating it fails, so the error is raised
+ * (with its debug info) when the expression is actually evaluated.
+ *
+ * @param expr The operator expression, its operands must be literals.
+ * @returns The literal or the unchanged operator expression
+ */
+Expression *icinga::FoldConstant(Expression *expr)
+{
+	Value value;
+
+	try {
+		ScriptFrame frame (false);
+		ExpressionResult result = expr->DoEvaluate(frame, nullptr);
+
+		if (result.GetCode() != ResultOK)
+			return expr;
+
+		value = result.GetValue();
+	} catch (const std::exception&) {
+		return expr;
+	}
+
+	/* Objects would be shared by all evaluations of the literal. */
+	if (value.IsObject())
+		return expr;
+
+	delete expr;
+
+	return MakeLiteralRaw(value);
+}
+
 ExpressionResult ThrowExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
 {
 	ExpressionResult messageres = m_Message->Evaluate(frame);
@@ -881,11 +927,15 @@ ExpressionResult ImportExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhi
 		BOOST_THROW_EXCEPTION(ScriptError("Import references unknown template: '" + name + "'", m_DebugInfo));
 
 	Dictionary::Ptr scope = item->GetScope();
+	Expression::Ptr expression = item->GetExpression();
+
+	if (!expression)
+		BOOST_THROW_EXCEPTION(ScriptError("Import references object '" + name + "' whose config has been freed, see CompactConfigItems", m_DebugInfo));
 
 	if (scope)
 		scope->CopyTo(frame.Locals);
 
-	ExpressionResult result = item->GetExpression()->Evaluate(frame, dhint);
+	ExpressionResult result = expression->Evaluate(frame, dhint);
 	CHECK_RESULT(result);
 
 	return Empty;
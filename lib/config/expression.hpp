@@ -274,6 +274,8 @@ public:
 
 protected:
 	std::unique_ptr<Expression> m_Operand;
+
+	friend class ConfigCompilerCache;
 };
 
 class BinaryExpression : public DebuggableExpression
@@ -286,6 +288,10 @@ public:
 protected:
 	std::unique_ptr<Expression> m_Operand1;
 	std::unique_ptr<Expression> m_Operand2;
+
+	friend class CompiledFilter;
+	friend class ConfigCompilerCache;
+	friend class FilterIndex;
 };
 
 class VariableExpression final : public DebuggableExpression
@@ -307,6 +313,7 @@ private:
 	std::vector<Expression::Ptr> m_Imports;
 
 	friend void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
+	friend class ConfigCompilerCache;
 };
 
 class DerefExpression final : public UnaryExpression
@@ -601,6 +608,8 @@ protected:
 
 private:
 	std::vector<std::unique_ptr<Expression> > m_Expressions;
+
+	friend class ConfigCompilerCache;
 };
 
 class DictExpression final : public DebuggableExpression
@@ -620,6 +629,8 @@ private:
 	bool m_Inline{false};
 
 	friend void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
+	friend class ConfigCompilerCache;
+	friend class ScopedConfigValidator;
 };
 
 class SetConstExpression final : public UnaryExpression
@@ -633,6 +644,8 @@ protected:
 	String m_Name;
 
 	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
+
+	friend class ConfigCompilerCache;
 };
 
 class SetExpression final : public BinaryExpression
@@ -652,6 +665,7 @@ private:
 	bool m_OverrideFrozen{false};
 
 	friend void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
+	friend class ConfigCompilerCache;
 };
 
 class ConditionalExpression final : public DebuggableExpression
@@ -668,6 +682,8 @@ private:
 	std::unique_ptr<Expression> m_Condition;
 	std::unique_ptr<Expression> m_TrueBranch;
 	std::unique_ptr<Expression> m_FalseBranch;
+
+	friend class ConfigCompilerCache;
 };
 
 class WhileExpression final : public DebuggableExpression
@@ -683,6 +699,8 @@ protected:
 private:
 	std::unique_ptr<Expression> m_Condition;
 	std::unique_ptr<Expression> m_LoopBody;
+
+	friend class ConfigCompilerCache;
 };
 
 
@@ -731,6 +749,8 @@ protected:
 
 private:
 	ScopeSpecifier m_ScopeSpec;
+
+	friend class ConfigCompilerCache;
 };
 
 class IndexerExpression final : public BinaryExpression
@@ -749,9 +769,11 @@ protected:
 	bool GetReference(ScriptFrame& frame, bool init_dict, Value *parent, String *index, DebugHint **dhint) const override;
 
 	friend void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
+	friend class ConfigCompilerCache;
 };
 
 void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
+Expression *FoldConstant(Expression *expr);
 
 class ThrowExpression final : public DebuggableExpression
 {
@@ -766,6 +788,8 @@ protected:
 private:
 	std::unique_ptr<Expression> m_Message;
 	bool m_IncompleteExpr;
+
+	friend class ConfigCompilerCache;
 };
 
 class ImportExpression final : public DebuggableExpression
@@ -780,6 +804,8 @@ protected:
 
 private:
 	std::unique_ptr<Expression> m_Name;
+
+	friend class ConfigCompilerCache;
 };
 
 class ImportDefaultTemplatesExpression final : public DebuggableExpression
@@ -809,6 +835,8 @@ private:
 	std::vector<String> m_Args;
 	std::map<String, std::unique_ptr<Expression> > m_ClosedVars;
 	Expression::Ptr m_Expression;
+
+	friend class ConfigCompilerCache;
 };
 
 class ApplyExpression final : public DebuggableExpression
@@ -839,6 +867,8 @@ private:
 	bool m_IgnoreOnError;
 	std::map<String, std::unique_ptr<Expression> > m_ClosedVars;
 	Expression::Ptr m_Expression;
+
+	friend class ConfigCompilerCache;
 };
 
 class NamespaceExpression final : public DebuggableExpression
@@ -853,6 +883,8 @@ protected:
 
 private:
 	Expression::Ptr m_Expression;
+
+	friend class ConfigCompilerCache;
 };
 
 class ObjectExpression final : public DebuggableExpression
@@ -880,6 +912,8 @@ private:
 	bool m_IgnoreOnError;
 	std::map<String, std::unique_ptr<Expression> > m_ClosedVars;
 	Expression::Ptr m_Expression;
+
+	friend class ConfigCompilerCache;
 };
 
 class ForExpression final : public DebuggableExpression
@@ -897,6 +931,8 @@ private:
 	String m_FVVar;
 	std::unique_ptr<Expression> m_Value;
 	std::unique_ptr<Expression> m_Expression;
+
+	friend class ConfigCompilerCache;
 };
 
 class LibraryExpression final : public UnaryExpression
@@ -938,6 +974,8 @@ private:
 	bool m_SearchIncludes;
 	String m_Zone;
 	String m_Package;
+
+	friend class ConfigCompilerCache;
 };
 
 class BreakpointExpression final : public DebuggableExpression
@@ -964,6 +1002,8 @@ protected:
 private:
 	std::unique_ptr<Expression> m_TryBody;
 	std::unique_ptr<Expression> m_ExceptBody;
+
+	friend class ConfigCompilerCache;
 };
 
 }
@@ -0,0 +1,220 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/filterindex.hpp"
+#include "base/objectlock.hpp"
+#include <algorithm>
+
+using namespace icinga;
+
+/**
+ * Adds a filter to the index.
+ *
+ * @param id The ID which GetCandidates() returns for the filter.
+ * @param filter The filter.
+ * @param scope Variables which are set when the filter is evaluated, fields
+ *              of these can't be indexed.
+ */
+void FilterIndex::Add(size_t id, const Expression *filter, const Dictionary::Ptr& scope)
+{
+	std::vector<FilterAtom> atoms;
+
+	if (!filter || !GetFilterAtoms(filter, atoms)) {
+		AddUnindexed(id);
+		return;
+	}
+
+	if (scope) {
+		for (const FilterAtom& atom : atoms) {
+			if (scope->Contains(atom.Path[0])) {
+				AddUnindexed(id);
+				return;
+			}
+		}
+	}
+
+	for (const FilterAtom& atom : atoms) {
+		PathIndex& pathIndex = m_Paths[atom.Path];
+		pathIndex.PathExpression = atom.PathExpression;
+
+		if (atom.In)
+			pathIndex.InFilters[atom.Value].push_back(id);
+		else
+			pathIndex.EqualFilters[atom.Value].push_back(id);
+	}
+}
+
+/**
+ * Adds a filter which is always a candidate.
+ *
+ * @param id The ID which GetCandidates() returns for the filter.
+ */
+void FilterIndex::AddUnindexed(size_t id)
+{
+	m_UnindexedFilters.push_back(id);
+}
+
+/**
+ * Returns the IDs of the filters which might match for the specified frame,
+ * sorted in ascending order. Filters whose fields don't have the right values
+ * are left out, the caller still has to evaluate the others.
+ *
+ * @param frame A frame containing the objects the filters are evaluated for.
+ * @returns The IDs
+ */
+std::vector<size_t> FilterIndex::GetCandidates(ScriptFrame& frame) const
+{
+	std::vector<size_t> ids (m_UnindexedFilters);
+
+	for (const auto& kv : m_Paths) {
+		const PathIndex& pathIndex = kv.second;
+		bool all = false;
+		Value value;
+
+		if (!frame.Locals->Contains(kv.first[0])) {
+			all = true;
+		} else {
+			try {
+				value = pathIndex.PathExpression->Evaluate(frame).GetValue();
+			} catch (const std::exception&) {
+				/* The filter itself will have to report the error. */
+				all = true;
+			}
+		}
+
+		/* Null never equals a non-empty string and is never an array. */
+		if (!all && value.IsEmpty())
+			continue;
+
+		if (all || !value.IsString()) {
+			for (const auto& filter : pathIndex.EqualFilters)
+				ids.insert(ids.end(), filter.second.begin(), filter.second.end());
+		} else {
+			auto it = pathIndex.EqualFilters.find(value.Get<String>());
+
+			if (it != pathIndex.EqualFilters.end())
+				ids.insert(ids.end(), it->second.begin(), it->second.end());
+		}
+
+		if (all || !value.IsObjectType<Array>()) {
+			for (const auto& filter : pathIndex.InFilters)
+				ids.insert(ids.end(), filter.second.begin(), filter.second.end());
+		} else {
+			Array::Ptr arr = value;
+
+			ObjectLock olock(arr);
+			for (const Value& item : arr) {
+				if (!item.IsString())
+					continue;
+
+				auto it = pathIndex.InFilters.find(item.Get<String>());
+
+				if (it != pathIndex.InFilters.end())
+					ids.insert(ids.end(), it->second.begin(), it->second.end());
+			}
+		}
+	}
+
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	return ids;
+}
+
+/**
+ * Determines conditions at least one of which has to hold for the filter
+ * to match.
+ *
+ * @param filter The filter.
+ * @param atoms The conditions.
+ * @returns false if no such conditions are known
+ */
+bool FilterIndex::GetFilterAtoms(const Expression *filter, std::vector<FilterAtom>& atoms)
+{
+	auto binary (dynamic_cast<const BinaryExpression *>(filter));
+
+	if (!binary)
+		return false;
+
+	/* The right operand of "&&" isn't evaluated if the left one is false, i.e.
+	 * skipping the filter based on the left operand doesn't hide any errors. */
+	if (dynamic_cast<const LogicalAndExpression *>(filter))
+		return GetFilterAtoms(binary->m_Operand1.get(), atoms);
+
+	if (dynamic_cast<const LogicalOrExpression *>(filter))
+		return GetFilterAtoms(binary->m_Operand1.get(), atoms) && GetFilterAtoms(binary->m_Operand2.get(), atoms);
+
+	FilterAtom atom;
+
+	if (dynamic_cast<const EqualExpression *>(filter)) {
+		atom.In = false;
+
+		const Expression *path = binary->m_Operand1.get();
+		const Expression *literal = binary->m_Operand2.get();
+
+		if (dynamic_cast<const LiteralExpression *>(path))
+			std::swap(path, literal);
+
+		if (!GetFilterString(literal, atom.Value) || !GetFilterPath(path, atom.Path))
+			return false;
+
+		atom.PathExpression = path;
+	} else if (dynamic_cast<const InExpression *>(filter)) {
+		atom.In = true;
+
+		if (!GetFilterString(binary->m_Operand1.get(), atom.Value) || !GetFilterPath(binary->m_Operand2.get(), atom.Path))
+			return false;
+
+		atom.PathExpression = binary->m_Operand2.get();
+	} else
+		return false;
+
+	atoms.emplace_back(std::move(atom));
+
+	return true;
+}
+
+/**
+ * Checks whether the expression is a field access like "host.vars.os".
+ *
+ * @param expr The expression.
+ * @param path The variable name followed by the field names.
+ * @returns true if the expression is a field access, false otherwise
+ */
+bool FilterIndex::GetFilterPath(const Expression *expr, std::vector<String>& path)
+{
+	auto variable (dynamic_cast<const VariableExpression *>(expr));
+
+	if (variable) {
+		path.push_back(variable->GetVariable());
+		return true;
+	}
+
+	if (!dynamic_cast<const IndexerExpression *>(expr))
+		return false;
+
+	auto indexer (static_cast<const BinaryExpression *>(expr));
+	String field;
+
+	if (!GetFilterPath(indexer->m_Operand1.get(), path) || !GetFilterString(indexer->m_Operand2.get(), field))
+		return false;
+
+	path.push_back(field);
+
+	return true;
+}
+
+/**
+ * Checks whether the expression is a non-empty string literal.
+ */
+bool FilterIndex::GetFilterString(const Expression *expr, String& value)
+{
+	auto literal (dynamic_cast<const LiteralExpression *>(expr));
+
+	if (!literal || !literal->GetValue().IsString())
+		return false;
+
+	value = literal->GetValue();
+
+	/* The empty string is equal to null. */
+	return !value.IsEmpty();
+}
@@ -0,0 +1,57 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef FILTERINDEX_H
+#define FILTERINDEX_H
+
+#include "config/i2-config.hpp"
+#include "config/expression.hpp"
+#include <map>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * An inverted index for filters which compare a field of an object with a
+ * string, e.g. "host.vars.os == \"Linux\"" or "\"linux-servers\" in host.groups".
+ * Each indexed field is evaluated once per object instead of once per filter.
+ *
+ * @ingroup config
+ */
+class FilterIndex
+{
+public:
+	void Add(size_t id, const Expression *filter, const Dictionary::Ptr& scope = nullptr);
+	void AddUnindexed(size_t id);
+
+	std::vector<size_t> GetCandidates(ScriptFrame& frame) const;
+
+private:
+	/* A condition which has to hold for a filter to match: the value at Path
+	 * is equal to Value or, for "in", an array which contains Value. */
+	struct FilterAtom
+	{
+		std::vector<String> Path;
+		const Expression *PathExpression;
+		bool In;
+		String Value;
+	};
+
+	struct PathIndex
+	{
+		const Expression *PathExpression;
+		std::map<String, std::vector<size_t> > EqualFilters;
+		std::map<String, std::vector<size_t> > InFilters;
+	};
+
+	std::vector<size_t> m_UnindexedFilters;
+	std::map<std::vector<String>, PathIndex> m_Paths;
+
+	static bool GetFilterAtoms(const Expression *filter, std::vector<FilterAtom>& atoms);
+	static bool GetFilterPath(const Expression *expr, std::vector<String>& path);
+	static bool GetFilterString(const Expression *expr, String& value);
+};
+
+}
+
+#endif /* FILTERINDEX_H */
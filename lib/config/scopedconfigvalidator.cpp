@@ -0,0 +1,140 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/scopedconfigvalidator.hpp"
+#include "config/configcompiler.hpp"
+#include "config/configitem.hpp"
+#include "config/expression.hpp"
+#include "base/exception.hpp"
+#include "base/scriptframe.hpp"
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace icinga;
+
+/**
+ * @param package The package of the files, all of its items in the running config are replaced.
+ * @param zones The zones of the files, an empty set replaces all zones of the package.
+ * @param typeFilter Decides which object types may be validated in-process.
+ */
+ScopedConfigValidator::ScopedConfigValidator(const String& package, const std::set<String>& zones, TypeFilter typeFilter)
+	: m_Context(new ActivationContext()), m_TypeFilter(std::move(typeFilter)), m_Package(package)
+{
+	m_Context->SetValidateOnly(package, zones);
+}
+
+/**
+ * Compiles a file and registers its objects and templates for validation.
+ *
+ * @param path The file.
+ * @param zone The zone of the file.
+ */
+void ScopedConfigValidator::AddFile(const String& path, const String& zone)
+{
+	if (m_Unsupported)
+		return;
+
+	std::unique_ptr<Expression> expression;
+
+	/* Same as ConfigCompiler::CollectIncludes(), files which can't be read are skipped. */
+	try {
+		expression = ConfigCompiler::CompileFile(path, zone, m_Package);
+	} catch (const std::exception& ex) {
+		m_Log << "warning/config: Cannot compile file '" << path << "': " << DiagnosticInformation(ex, false) << "\n";
+		return;
+	}
+
+	std::vector<Expression *> statements;
+	auto *dict = dynamic_cast<DictExpression *>(expression.get());
+
+	if (dict) {
+		for (auto& statement : dict->m_Expressions)
+			statements.push_back(statement.get());
+	} else
+		statements.push_back(expression.get());
+
+	ActivationScope scope (m_Context);
+
+	for (Expression *statement : statements) {
+		/* Evaluating apply rules would add them to the running config. */
+		if (dynamic_cast<ApplyExpression *>(statement))
+			continue;
+
+		/* Syntax errors are compiled into throw expressions. */
+		if (!dynamic_cast<ObjectExpression *>(statement) && !dynamic_cast<ThrowExpression *>(statement)) {
+			std::ostringstream msgbuf;
+			msgbuf << statement->GetDebugInfo();
+			SetUnsupported("Only object and template definitions and apply rules are supported, found something else at " + msgbuf.str() + ".");
+			return;
+		}
+
+		try {
+			ScriptFrame frame (true);
+			statement->Evaluate(frame);
+		} catch (const std::exception& ex) {
+			AddError(DiagnosticInformation(ex, false));
+		}
+	}
+}
+
+/**
+ * Validates the objects of all files which have been added.
+ *
+ * @returns Whether the objects are valid or have to be validated by a new process.
+ */
+ScopedValidationResult ScopedConfigValidator::Validate()
+{
+	if (m_Unsupported)
+		return ScopedValidationUnsupported;
+
+	for (const ConfigItem::Ptr& item : ConfigItem::GetValidationItems(m_Context)) {
+		if (!m_TypeFilter(item->GetType())) {
+			SetUnsupported("Objects of type '" + item->GetType()->GetName() + "' are not supported.");
+			return ScopedValidationUnsupported;
+		}
+
+		/* They're imported by objects of any zone. */
+		if (item->IsDefaultTemplate()) {
+			SetUnsupported("Default templates are not supported.");
+			return ScopedValidationUnsupported;
+		}
+	}
+
+	std::vector<String> errors;
+
+	{
+		ActivationScope scope (m_Context);
+		ConfigItem::ValidateItems(m_Context, errors);
+	}
+
+	for (const String& error : errors)
+		AddError(error);
+
+	if (m_Errors) {
+		m_Log << "critical/config: " << m_Errors << " error(s)\n";
+		return ScopedValidationInvalid;
+	}
+
+	m_Log << "information/config: Finished validating the configuration in-process.\n";
+	return ScopedValidationValid;
+}
+
+/**
+ * @returns The messages of the validation, in the same format as the ones of a validating process.
+ */
+String ScopedConfigValidator::GetLog() const
+{
+	return m_Log.str();
+}
+
+void ScopedConfigValidator::AddError(const String& message)
+{
+	m_Errors++;
+	m_Log << "critical/config: " << message << "\n";
+}
+
+void ScopedConfigValidator::SetUnsupported(const String& reason)
+{
+	m_Unsupported = true;
+	m_Log << "information/config: " << reason << " Validation requires a new process.\n";
+}
@@ -0,0 +1,63 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef SCOPEDCONFIGVALIDATOR_H
+#define SCOPEDCONFIGVALIDATOR_H
+
+#include "config/i2-config.hpp"
+#include "config/activationcontext.hpp"
+#include "base/string.hpp"
+#include "base/type.hpp"
+#include <functional>
+#include <set>
+#include <sstream>
+
+namespace icinga
+{
+
+enum ScopedValidationResult
+{
+	ScopedValidationValid,
+	ScopedValidationInvalid,
+	ScopedValidationUnsupported
+};
+
+/**
+ * Validates the objects of some config files against the running config
+ * without starting a new process. The files replace everything of the same
+ * package (and zones) in the running config, the rest of it stays visible,
+ * so that the objects can reference it.
+ *
+ * Only object and template definitions are validated. Apply rules are just
+ * compiled, anything else (e.g. global variables, functions or includes) and
+ * objects which don't pass the type filter make the files unsupported, those
+ * have to be validated by a new process as usual.
+ *
+ * @ingroup config
+ */
+class ScopedConfigValidator
+{
+public:
+	typedef std::function<bool (const Type::Ptr&)> TypeFilter;
+
+	ScopedConfigValidator(const String& package, const std::set<String>& zones, TypeFilter typeFilter);
+
+	void AddFile(const String& path, const String& zone);
+	ScopedValidationResult Validate();
+
+	String GetLog() const;
+
+private:
+	ActivationContext::Ptr m_Context;
+	TypeFilter m_TypeFilter;
+	String m_Package;
+	bool m_Unsupported{false};
+	size_t m_Errors{0};
+	std::ostringstream m_Log;
+
+	void AddError(const String& message);
+	void SetUnsupported(const String& reason);
+};
+
+}
+
+#endif /* SCOPEDCONFIGVALIDATOR_H */
@@ -42,11 +42,12 @@ public:
 
 	static inline bool FindVarImport(ScriptFrame& frame, const std::vector<Expression::Ptr>& imports, const String& name, Value *result, const DebugInfo& debugInfo = DebugInfo())
 	{
-		Value parent;
-
-		if (FindVarImportRef(frame, imports, name, &parent, debugInfo)) {
-			*result = GetField(parent, name, frame.Sandboxed, debugInfo);
-			return true;
+		/* Fetches the value right away instead of looking the name up in the import a second time. */
+		for (const auto& import : imports) {
+			ExpressionResult res = import->Evaluate(frame);
+			Object::Ptr obj = res.GetValue();
+			if (obj->GetOwnField(name, result))
+				return true;
 		}
 
 		return false;
@@ -81,12 +82,12 @@ public:
 			return type->Instantiate(args);
 	}
 
-	static inline Value FunctionCall(ScriptFrame& frame, const Value& self, const Function::Ptr& func, const std::vector<Value>& arguments)
+	static inline Value FunctionCall(ScriptFrame& frame, const Value& self, const Function::Ptr& func, const Value *arguments, size_t count)
 	{
 		if (!self.IsEmpty() || self.IsString())
-			return func->InvokeThis(self, arguments);
+			return func->InvokeThis(self, arguments, count);
 		else
-			return func->Invoke(arguments);
+			return func->Invoke(arguments, count);
 
 	}
 
@@ -95,8 +96,8 @@ public:
 	{
 		auto evaluatedClosedVars = EvaluateClosedVars(frame, closedVars);
 
-		auto wrapper = [argNames, evaluatedClosedVars, expression](const std::vector<Value>& arguments) -> Value {
-			if (arguments.size() < argNames.size())
+		Function::Callback wrapper = [argNames, evaluatedClosedVars, expression](const Value *arguments, size_t count) -> Value {
+			if (count < argNames.size())
 				BOOST_THROW_EXCEPTION(std::invalid_argument("Too few arguments for function"));
 
 			ScriptFrame *frame = ScriptFrame::GetCurrentFrame();
@@ -106,7 +107,7 @@ public:
 			if (evaluatedClosedVars)
 				evaluatedClosedVars->CopyTo(frame->Locals);
 
-			for (std::vector<Value>::size_type i = 0; i < std::min(arguments.size(), argNames.size()); i++)
+			for (std::vector<String>::size_type i = 0; i < std::min(count, argNames.size()); i++)
 				frame->Locals->Set(argNames[i], arguments[i]);
 
 			return expression->Evaluate(*frame);
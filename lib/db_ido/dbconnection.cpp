@@ -12,6 +12,11 @@
 #include "base/utility.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
+#include "base/configuration.hpp"
+#include "base/json.hpp"
+#include "base/workqueue.hpp"
+#include <numeric>
+#include <vector>
 
 using namespace icinga;
 
@@ -28,6 +33,9 @@ void DbConnection::OnConfigLoaded()
 
 	SetCategoryFilter(FilterArrayToInt(categories, DbQuery::GetCategoryFilterMap(), DbCatEverything));
 
+	m_QueriesMetric = &MetricCounter::GetByName("ido_queries", GetName());
+	m_PendingQueriesMetric = &MetricGauge::GetByName("ido_pending_queries", GetName());
+
 	if (!GetEnableHa()) {
 		Log(LogDebug, "DbConnection")
 			<< "HA functionality disabled. Won't pause IDO connection: " << GetName();
@@ -45,22 +53,119 @@ void DbConnection::Start(bool runtimeCreated)
 	Log(LogInformation, "DbConnection")
 		<< "'" << GetName() << "' started.";
 
-	DbObject::OnQuery.connect(std::bind(&DbConnection::ExecuteQuery, this, _1));
-	DbObject::OnMultipleQueries.connect(std::bind(&DbConnection::ExecuteMultipleQueries, this, _1));
+	DbObject::OnQuery.connect(std::bind(&DbConnection::CoalesceQuery, this, _1));
+	DbObject::OnMultipleQueries.connect(std::bind(&DbConnection::CoalesceMultipleQueries, this, _1));
+
+	m_CoalesceTimer = new Timer();
+	m_CoalesceTimer->SetInterval(0.5);
+	m_CoalesceTimer->OnTimerExpired.connect([this](const Timer * const&) { FlushCoalescedQueries(); });
+	m_CoalesceTimer->Start();
 }
 
 void DbConnection::Stop(bool runtimeRemoved)
 {
+	if (m_CoalesceTimer)
+		m_CoalesceTimer->Stop(true);
+
+	FlushCoalescedQueries();
+
 	Log(LogInformation, "DbConnection")
 		<< "'" << GetName() << "' stopped.";
 
 	ObjectImpl<DbConnection>::Stop(runtimeRemoved);
 }
 
+/**
+ * Checks whether a query only updates columns in an object's status row. The
+ * event handlers emit one of these for every attribute which changed (next
+ * check, flapping, reachability etc.), and they can be merged into one query.
+ */
+bool DbConnection::IsCoalescableQuery(const DbQuery& query)
+{
+	if (!query.StatusUpdate || !query.Object || !query.Fields || !query.WhereCriteria || query.NotificationInsertID)
+		return false;
+
+	if (query.Type != DbQueryUpdate && query.Type != (DbQueryInsert | DbQueryUpdate))
+		return false;
+
+	const DbType::Ptr& type = query.Object->GetType();
+
+	if (query.Table != type->GetTable() + "status")
+		return false;
+
+	ObjectLock olock(query.WhereCriteria);
+
+	for (const Dictionary::Pair& kv : query.WhereCriteria) {
+		if (kv.first != type->GetIDColumn() && kv.first != "instance_id")
+			return false;
+	}
+
+	return true;
+}
+
+void DbConnection::CoalesceQuery(const DbQuery& query)
+{
+	if (!IsCoalescableQuery(query)) {
+		/* Keep the order of writes to the status tables. */
+		if (query.Table.GetLength() > 6 && query.Table.SubStr(query.Table.GetLength() - 6) == "status")
+			FlushCoalescedQueries();
+
+		ExecuteQuery(query);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_CoalescedQueriesMutex);
+
+	auto key = std::make_tuple(query.Object, query.Table, static_cast<int>(query.Category));
+	auto it = m_CoalescedQueries.find(key);
+
+	if (it == m_CoalescedQueries.end()) {
+		DbQuery& pending = m_CoalescedQueries[key];
+		pending = query;
+		pending.Fields = query.Fields->ShallowClone();
+		return;
+	}
+
+	DbQuery& pending = it->second;
+
+	/* Later values win. An upsert for the whole row turns the merged query into an upsert. */
+	query.Fields->CopyTo(pending.Fields);
+	pending.Type |= query.Type;
+	pending.WhereCriteria = query.WhereCriteria;
+
+	if (query.Priority > pending.Priority)
+		pending.Priority = query.Priority;
+}
+
+void DbConnection::CoalesceMultipleQueries(const std::vector<DbQuery>& queries)
+{
+	for (const DbQuery& query : queries) {
+		if (query.Table.GetLength() > 6 && query.Table.SubStr(query.Table.GetLength() - 6) == "status") {
+			FlushCoalescedQueries();
+			break;
+		}
+	}
+
+	ExecuteMultipleQueries(queries);
+}
+
+void DbConnection::FlushCoalescedQueries()
+{
+	decltype(m_CoalescedQueries) queries;
+
+	{
+		std::unique_lock<std::mutex> lock(m_CoalescedQueriesMutex);
+		queries.swap(m_CoalescedQueries);
+	}
+
+	for (auto& kv : queries)
+		ExecuteQuery(kv.second);
+}
+
 void DbConnection::EnableActiveChangedHandler()
 {
 	if (!m_ActiveChangedHandler) {
-		ConfigObject::OnActiveChanged.connect(std::bind(&DbConnection::UpdateObject, this, _1));
+		ConfigObject::OnActiveChanged.connect([this](const ConfigObject::Ptr& object, const Value&) { UpdateObject(object); });
 		m_ActiveChangedHandler = true;
 	}
 }
@@ -209,23 +314,24 @@ void DbConnection::CleanUpHandler()
 
 	struct {
 		String name;
+		String id_column;
 		String time_column;
 	} tables[] = {
-		{ "acknowledgements", "entry_time" },
-		{ "commenthistory", "entry_time" },
-		{ "contactnotifications", "start_time" },
-		{ "contactnotificationmethods", "start_time" },
-		{ "downtimehistory", "entry_time" },
-		{ "eventhandlers", "start_time" },
-		{ "externalcommands", "entry_time" },
-		{ "flappinghistory", "event_time" },
-		{ "hostchecks", "start_time" },
-		{ "logentries", "logentry_time" },
-		{ "notifications", "start_time" },
-		{ "processevents", "event_time" },
-		{ "statehistory", "state_time" },
-		{ "servicechecks", "start_time" },
-		{ "systemcommands", "start_time" }
+		{ "acknowledgements", "acknowledgement_id", "entry_time" },
+		{ "commenthistory", "commenthistory_id", "entry_time" },
+		{ "contactnotifications", "contactnotification_id", "start_time" },
+		{ "contactnotificationmethods", "contactnotificationmethod_id", "start_time" },
+		{ "downtimehistory", "downtimehistory_id", "entry_time" },
+		{ "eventhandlers", "eventhandler_id", "start_time" },
+		{ "externalcommands", "externalcommand_id", "entry_time" },
+		{ "flappinghistory", "flappinghistory_id", "event_time" },
+		{ "hostchecks", "hostcheck_id", "start_time" },
+		{ "logentries", "logentry_id", "logentry_time" },
+		{ "notifications", "notification_id", "start_time" },
+		{ "processevents", "processevent_id", "event_time" },
+		{ "statehistory", "statehistory_id", "state_time" },
+		{ "servicechecks", "servicecheck_id", "start_time" },
+		{ "systemcommands", "systemcommand_id", "start_time" }
 	};
 
 	for (auto& table : tables) {
@@ -234,7 +340,7 @@ void DbConnection::CleanUpHandler()
 		if (max_age == 0)
 			continue;
 
-		CleanUpExecuteQuery(table.name, table.time_column, now - max_age);
+		CleanUpExecuteQuery(table.name, table.id_column, table.time_column, now - max_age);
 		Log(LogNotice, "DbConnection")
 			<< "Cleanup (" << table.name << "): " << max_age
 			<< " now: " << now
@@ -275,7 +381,7 @@ void DbConnection::LogStatsHandler()
 	}
 }
 
-void DbConnection::CleanUpExecuteQuery(const String&, const String&, double)
+void DbConnection::CleanUpExecuteQuery(const String&, const String&, const String&, double)
 {
 	/* Default handler does nothing. */
 }
@@ -314,6 +420,34 @@ String DbConnection::GetConfigHash(const DbType::Ptr& type, const DbReference& o
 	return it->second;
 }
 
+/**
+ * Remembers when the object's status row was last written, as stored in the
+ * database (status_update_time). This survives restarts and HA failovers and
+ * lets UpdateObject() skip the status update for unchanged objects.
+ */
+void DbConnection::SetStatusVersion(const DbType::Ptr& type, const DbReference& objid, double version)
+{
+	if (!objid.IsValid())
+		return;
+
+	m_StatusVersions[std::make_pair(type, objid)] = version;
+}
+
+double DbConnection::GetStatusVersion(const DbObject::Ptr& dbobj) const
+{
+	DbReference objid = GetObjectID(dbobj);
+
+	if (!objid.IsValid())
+		return 0;
+
+	auto it = m_StatusVersions.find(std::make_pair(dbobj->GetType(), objid));
+
+	if (it == m_StatusVersions.end())
+		return 0;
+
+	return it->second;
+}
+
 void DbConnection::SetObjectID(const DbObject::Ptr& dbobj, const DbReference& dbref)
 {
 	if (dbref.IsValid())
@@ -389,6 +523,7 @@ void DbConnection::ClearIDCache()
 	m_ConfigUpdates.clear();
 	m_StatusUpdates.clear();
 	m_ConfigHashes.clear();
+	m_StatusVersions.clear();
 }
 
 void DbConnection::SetConfigUpdate(const DbObject::Ptr& dbobj, bool hasupdate)
@@ -418,6 +553,15 @@ bool DbConnection::GetStatusUpdate(const DbObject::Ptr& dbobj) const
 }
 
 void DbConnection::UpdateObject(const ConfigObject::Ptr& object)
+{
+	UpdateObject(object, nullptr);
+}
+
+/**
+ * @param configFields The object's config fields including their hash if
+ *                     they've already been built, nullptr otherwise
+ */
+void DbConnection::UpdateObject(const ConfigObject::Ptr& object, Dictionary::Ptr configFields)
 {
 	bool isShuttingDown = Application::IsShuttingDown();
 	bool isRestarting = Application::IsRestarting();
@@ -451,10 +595,14 @@ void DbConnection::UpdateObject(const ConfigObject::Ptr& object)
 			if (!dbActive)
 				ActivateObject(dbobj);
 
-			Dictionary::Ptr configFields = dbobj->GetConfigFields();
-			String configHash = dbobj->CalculateConfigHash(configFields);
-			ASSERT(configHash.GetLength() <= 64);
-			configFields->Set("config_hash", configHash);
+			if (!configFields) {
+				configFields = dbobj->GetConfigFields();
+				String configHash = dbobj->CalculateConfigHash(configFields);
+				ASSERT(configHash.GetLength() <= 64);
+				configFields->Set("config_hash", configHash);
+			}
+
+			String configHash = configFields->Get("config_hash");
 
 			String cachedHash = GetConfigHash(dbobj);
 
@@ -463,6 +611,14 @@ void DbConnection::UpdateObject(const ConfigObject::Ptr& object)
 				dbobj->SendStatusUpdate();
 			} else {
 				dbobj->SendConfigUpdateLight();
+
+				/* The status row is stale if it's missing or if the object's status changed
+				 * after it was written, e.g. while the database was unavailable. The database
+				 * only stores full seconds. */
+				double statusVersion = GetStatusVersion(dbobj);
+
+				if (statusVersion <= 0 || dbobj->GetLastStatusChange() >= statusVersion + 1)
+					dbobj->SendStatusUpdate();
 			}
 		} else if (!active) {
 			/* This may happen on reload/restart actions too
@@ -476,24 +632,201 @@ void DbConnection::UpdateObject(const ConfigObject::Ptr& object)
 	}
 }
 
+/**
+ * Building the config fields and their hashes is what takes most of the time
+ * of a config dump. They're built in parallel, one type after the other; the
+ * queries are still sent by the query queue in the same order as before.
+ */
 void DbConnection::UpdateAllObjects()
 {
+	WorkQueue upq(25000, Configuration::Concurrency);
+	upq.SetName("DbConnection, config dump");
+
 	for (const Type::Ptr& type : Type::GetAllTypes()) {
 		auto *dtype = dynamic_cast<ConfigType *>(type.get());
 
 		if (!dtype)
 			continue;
 
-		for (const ConfigObject::Ptr& object : dtype->GetObjects()) {
-			m_QueryQueue.Enqueue([this, object](){ UpdateObject(object); }, PriorityHigh);
+		std::vector<ConfigObject::Ptr> objects = dtype->GetObjects();
+		std::vector<Dictionary::Ptr> configFields (objects.size());
+
+		if (DbType::GetByName(type->GetName())) {
+			std::vector<size_t> indices (objects.size());
+			std::iota(indices.begin(), indices.end(), 0);
+
+			/* Objects whose fields couldn't be built here are retried by UpdateObject(). */
+			upq.ParallelFor(indices, [&objects, &configFields](size_t index) {
+				const ConfigObject::Ptr& object = objects[index];
+
+				if (!object->IsActive())
+					return;
+
+				DbObject::Ptr dbobj = DbObject::GetOrCreateByObject(object);
+
+				if (!dbobj)
+					return;
+
+				Dictionary::Ptr fields = dbobj->GetConfigFields();
+				String configHash = dbobj->CalculateConfigHash(fields);
+				ASSERT(configHash.GetLength() <= 64);
+				fields->Set("config_hash", configHash);
+
+				configFields[index] = fields;
+			});
+
+			upq.Join();
+		}
+
+		for (size_t i = 0; i < objects.size(); i++) {
+			ConfigObject::Ptr object = objects[i];
+			Dictionary::Ptr fields = configFields[i];
+
+			m_QueryQueue.Enqueue([this, object, fields]() { UpdateObject(object, fields); }, PriorityHigh);
 		}
 	}
 }
 
-void DbConnection::PrepareDatabase()
+/**
+ * @param insertIDs Whether the insert IDs and config hashes have to be read
+ *                  as well, false if they've been loaded by LoadIDCache()
+ */
+void DbConnection::PrepareDatabase(bool insertIDs)
 {
 	for (const DbType::Ptr& type : DbType::GetAllTypes()) {
-		FillIDCache(type);
+		FillIDCache(type, insertIDs);
+	}
+}
+
+String DbConnection::GetIDCachePath() const
+{
+	return Configuration::DataDir + "/" + GetReflectionType()->GetName().ToLower() + "-" + GetName() + ".idcache";
+}
+
+/**
+ * Loads the object IDs, insert IDs and config hashes saved by SaveIDCache(),
+ * so the objects and config tables don't have to be read on connect.
+ *
+ * The cache file is removed either way: while connected, the cache is only
+ * kept in memory and the file would be outdated after a crash.
+ *
+ * @param token Describes the database's current state, see SaveIDCache()
+ * @param activeDbObjs Receives the objects which are active in the database
+ * @returns Whether the cache has been loaded
+ */
+bool DbConnection::LoadIDCache(const Dictionary::Ptr& token, std::vector<DbObject::Ptr>& activeDbObjs)
+{
+	String path = GetIDCachePath();
+
+	if (!Utility::PathExists(path))
+		return false;
+
+	Dictionary::Ptr cache;
+
+	try {
+		cache = Utility::LoadJsonFile(path);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "DbConnection")
+			<< "Failed to load the ID cache from '" << path << "': " << DiagnosticInformation(ex, false);
+	}
+
+	(void)unlink(path.CStr());
+
+	if (!cache || JsonEncode(cache->Get("token")) != JsonEncode(token)) {
+		Log(LogInformation, "DbConnection")
+			<< "The database changed since the ID cache has been saved, reading the IDs from the database.";
+		return false;
+	}
+
+	Array::Ptr objects = cache->Get("objects");
+	Array::Ptr insertIDs = cache->Get("insert_ids");
+	Array::Ptr configHashes = cache->Get("config_hashes");
+
+	if (!objects || !insertIDs || !configHashes)
+		return false;
+
+	ObjectLock olock(objects);
+
+	for (const Array::Ptr& object : objects) {
+		DbType::Ptr dbtype = DbType::GetByID(object->Get(0));
+
+		if (!dbtype)
+			continue;
+
+		DbObject::Ptr dbobj = dbtype->GetOrCreateObjectByName(object->Get(1), object->Get(2));
+		SetObjectID(dbobj, DbReference(object->Get(3)));
+
+		bool active = object->Get(4);
+		SetObjectActive(dbobj, active);
+
+		if (active)
+			activeDbObjs.emplace_back(std::move(dbobj));
+	}
+
+	ObjectLock ilock(insertIDs);
+
+	for (const Array::Ptr& insertID : insertIDs) {
+		DbType::Ptr dbtype = DbType::GetByID(insertID->Get(0));
+
+		if (dbtype)
+			SetInsertID(dbtype, DbReference(insertID->Get(1)), DbReference(insertID->Get(2)));
+	}
+
+	ObjectLock hlock(configHashes);
+
+	for (const Array::Ptr& configHash : configHashes) {
+		DbType::Ptr dbtype = DbType::GetByID(configHash->Get(0));
+
+		if (dbtype)
+			SetConfigHash(dbtype, DbReference(configHash->Get(1)), configHash->Get(2));
+	}
+
+	Log(LogInformation, "DbConnection")
+		<< "Loaded " << objects->GetLength() << " object IDs from the ID cache.";
+
+	return true;
+}
+
+/**
+ * Saves the ID cache after the connection has been closed orderly.
+ *
+ * @param token Describes the database's state at this point, the cache is only
+ *              loaded again if the database is still in exactly this state
+ */
+void DbConnection::SaveIDCache(const Dictionary::Ptr& token) const
+{
+	ArrayData objects, insertIDs, configHashes;
+
+	for (auto& kv : m_ObjectIDs) {
+		const DbObject::Ptr& dbobj = kv.first;
+
+		objects.emplace_back(new Array({
+			dbobj->GetType()->GetTypeID(),
+			dbobj->GetName1(),
+			dbobj->GetName2(),
+			static_cast<long>(kv.second),
+			GetObjectActive(dbobj)
+		}));
+	}
+
+	for (auto& kv : m_InsertIDs)
+		insertIDs.emplace_back(new Array({ kv.first.first->GetTypeID(), static_cast<long>(kv.first.second), static_cast<long>(kv.second) }));
+
+	for (auto& kv : m_ConfigHashes)
+		configHashes.emplace_back(new Array({ kv.first.first->GetTypeID(), static_cast<long>(kv.first.second), kv.second }));
+
+	String path = GetIDCachePath();
+
+	try {
+		Utility::SaveJsonFile(path, 0600, new Dictionary({
+			{ "token", token },
+			{ "objects", new Array(std::move(objects)) },
+			{ "insert_ids", new Array(std::move(insertIDs)) },
+			{ "config_hashes", new Array(std::move(configHashes)) }
+		}));
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "DbConnection")
+			<< "Failed to save the ID cache to '" << path << "': " << DiagnosticInformation(ex, false);
 	}
 }
 
@@ -524,6 +857,9 @@ void DbConnection::IncreaseQueryCount()
 
 	std::unique_lock<std::mutex> lock(m_StatsMutex);
 	m_QueryStats.InsertValue(now, 1);
+
+	if (m_QueriesMetric)
+		m_QueriesMetric->Increment();
 }
 
 int DbConnection::GetQueryCount(RingBuffer::SizeType span)
@@ -551,10 +887,16 @@ void DbConnection::IncreasePendingQueries(int count)
 {
 	m_PendingQueries.fetch_add(count);
 	m_InputQueries.InsertValue(Utility::GetTime(), count);
+
+	if (m_PendingQueriesMetric)
+		m_PendingQueriesMetric->Increment(count);
 }
 
 void DbConnection::DecreasePendingQueries(int count)
 {
 	m_PendingQueries.fetch_sub(count);
 	m_OutputQueries.InsertValue(Utility::GetTime(), count);
+
+	if (m_PendingQueriesMetric)
+		m_PendingQueriesMetric->Decrement(count);
 }
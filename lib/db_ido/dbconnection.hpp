@@ -7,10 +7,12 @@
 #include "db_ido/dbconnection-ti.hpp"
 #include "db_ido/dbobject.hpp"
 #include "db_ido/dbquery.hpp"
+#include "base/metric.hpp"
 #include "base/timer.hpp"
 #include "base/ringbuffer.hpp"
 #include <boost/thread/once.hpp>
 #include <mutex>
+#include <tuple>
 
 #define IDO_CURRENT_SCHEMA_VERSION "1.14.3"
 #define IDO_COMPAT_SCHEMA_VERSION "1.14.3"
@@ -35,6 +37,9 @@ public:
 	String GetConfigHash(const DbObject::Ptr& dbobj) const;
 	String GetConfigHash(const DbType::Ptr& type, const DbReference& objid) const;
 
+	void SetStatusVersion(const DbType::Ptr& type, const DbReference& objid, double version);
+	double GetStatusVersion(const DbObject::Ptr& dbobj) const;
+
 	void SetObjectID(const DbObject::Ptr& dbobj, const DbReference& dbref);
 	DbReference GetObjectID(const DbObject::Ptr& dbobj) const;
 
@@ -72,14 +77,18 @@ protected:
 	virtual void ActivateObject(const DbObject::Ptr& dbobj) = 0;
 	virtual void DeactivateObject(const DbObject::Ptr& dbobj) = 0;
 
-	virtual void CleanUpExecuteQuery(const String& table, const String& time_column, double max_age);
-	virtual void FillIDCache(const DbType::Ptr& type) = 0;
+	virtual void CleanUpExecuteQuery(const String& table, const String& id_column, const String& time_column, double max_age);
+	virtual void FillIDCache(const DbType::Ptr& type, bool insertIDs) = 0;
 	virtual void NewTransaction() = 0;
 
 	void UpdateObject(const ConfigObject::Ptr& object);
+	void UpdateObject(const ConfigObject::Ptr& object, Dictionary::Ptr configFields);
 	void UpdateAllObjects();
 
-	void PrepareDatabase();
+	void PrepareDatabase(bool insertIDs = true);
+
+	bool LoadIDCache(const Dictionary::Ptr& token, std::vector<DbObject::Ptr>& activeDbObjs);
+	void SaveIDCache(const Dictionary::Ptr& token) const;
 
 	void IncreaseQueryCount();
 
@@ -97,9 +106,13 @@ protected:
 
 	WorkQueue m_QueryQueue{10000000, 1, LogNotice};
 
+	/* The history tables which are being cleaned up batch by batch, only used inside the query queue. */
+	std::set<String> m_CleanUpsInProgress;
+
 private:
 	bool m_IDCacheValid{false};
 	std::map<std::pair<DbType::Ptr, DbReference>, String> m_ConfigHashes;
+	std::map<std::pair<DbType::Ptr, DbReference>, double> m_StatusVersions;
 	std::map<DbObject::Ptr, DbReference> m_ObjectIDs;
 	std::map<std::pair<DbType::Ptr, DbReference>, DbReference> m_InsertIDs;
 	std::set<DbObject::Ptr> m_ActiveObjects;
@@ -108,11 +121,22 @@ private:
 	Timer::Ptr m_CleanUpTimer;
 	Timer::Ptr m_LogStatsTimer;
 
+	std::mutex m_CoalescedQueriesMutex;
+	std::map<std::tuple<DbObject::Ptr, String, int>, DbQuery> m_CoalescedQueries;
+	Timer::Ptr m_CoalesceTimer;
+
 	double m_LogStatsTimeout;
 
 	void CleanUpHandler();
 	void LogStatsHandler();
 
+	String GetIDCachePath() const;
+
+	static bool IsCoalescableQuery(const DbQuery& query);
+	void CoalesceQuery(const DbQuery& query);
+	void CoalesceMultipleQueries(const std::vector<DbQuery>& queries);
+	void FlushCoalescedQueries();
+
 	static Timer::Ptr m_ProgramStatusTimer;
 	static boost::once_flag m_OnceFlag;
 
@@ -125,6 +149,9 @@ private:
 	RingBuffer m_InputQueries{10};
 	RingBuffer m_OutputQueries{10};
 	Atomic<uint_fast64_t> m_PendingQueries{0};
+
+	MetricCounter *m_QueriesMetric{nullptr};
+	MetricGauge *m_PendingQueriesMetric{nullptr};
 };
 
 struct database_error : virtual std::exception, virtual boost::exception { };
@@ -20,6 +20,9 @@
 #include "base/utility.hpp"
 #include "base/initialize.hpp"
 #include "base/logger.hpp"
+#include "base/configuration.hpp"
+#include "base/exception.hpp"
+#include "base/workqueue.hpp"
 
 using namespace icinga;
 
@@ -35,8 +38,12 @@ DbObject::DbObject(intrusive_ptr<DbType> type, String name1, String name2)
 void DbObject::StaticInitialize()
 {
 	/* triggered in ProcessCheckResult(), requires UpdateNextCheck() to be called before */
-	ConfigObject::OnStateChanged.connect(std::bind(&DbObject::StateChangedHandler, _1));
-	CustomVarObject::OnVarsChanged.connect(std::bind(&DbObject::VarsChangedHandler, _1));
+	ConfigObject::OnStateChanged.connect([](const ConfigObject::Ptr& object) {
+		GetStatusUpdateQueue().Enqueue(object.get(), [object]() { StateChangedHandler(object); });
+	});
+	CustomVarObject::OnVarsChanged.connect([](const CustomVarObject::Ptr& object) {
+		GetStatusUpdateQueue().Enqueue(object.get(), [object]() { VarsChangedHandler(object); });
+	});
 
 	/* triggered on create, update and delete objects */
 	ConfigObject::OnVersionChanged.connect(std::bind(&DbObject::VersionChangedHandler, _1));
@@ -330,6 +337,23 @@ double DbObject::GetLastStatusUpdate() const
 	return m_LastStatusUpdate;
 }
 
+/**
+ * Returns when the object's status last changed. Unlike GetLastStatusUpdate()
+ * this also takes check results into account which were restored from the
+ * state file and therefore never went through SendStatusUpdate().
+ */
+double DbObject::GetLastStatusChange() const
+{
+	double lastChange = m_LastStatusUpdate;
+
+	Checkable::Ptr checkable = dynamic_pointer_cast<Checkable>(GetObject());
+
+	if (checkable)
+		lastChange = std::max(lastChange, checkable->GetLastCheck());
+
+	return lastChange;
+}
+
 void DbObject::OnConfigUpdateHeavy()
 {
 	/* Default handler does nothing. */
@@ -422,6 +446,29 @@ void DbObject::VersionChangedHandler(const ConfigObject::Ptr& object)
 	}
 }
 
+/**
+ * Status updates are built off the thread which processed the check result,
+ * so a slow update doesn't hold up the next check. All updates for one object
+ * end up in the same shard, they're sent in the order the changes happened in.
+ *
+ * History rows are still built synchronously, they snapshot the object's
+ * state at the time of the event.
+ */
+ShardedWorkQueue& DbObject::GetStatusUpdateQueue()
+{
+	static auto *queue = []() {
+		auto *queue = new ShardedWorkQueue(25000, Configuration::Concurrency);
+		queue->SetName("DbObject, status updates");
+		queue->SetExceptionCallback([](boost::exception_ptr exp) {
+			Log(LogCritical, "DbObject")
+				<< "Exception during status update: " << DiagnosticInformation(exp);
+		});
+		return queue;
+	}();
+
+	return *queue;
+}
+
 std::mutex& DbObject::GetStaticMutex()
 {
 	static std::mutex mutex;
@@ -9,6 +9,7 @@
 #include "db_ido/dbtype.hpp"
 #include "icinga/customvarobject.hpp"
 #include "base/configobject.hpp"
+#include "base/workqueue.hpp"
 
 namespace icinga
 {
@@ -72,6 +73,7 @@ public:
 
 	double GetLastConfigUpdate() const;
 	double GetLastStatusUpdate() const;
+	double GetLastStatusChange() const;
 
 	virtual String CalculateConfigHash(const Dictionary::Ptr& configFields) const;
 
@@ -96,6 +98,7 @@ private:
 	static void VarsChangedHandler(const CustomVarObject::Ptr& object);
 	static void VersionChangedHandler(const ConfigObject::Ptr& object);
 
+	static ShardedWorkQueue& GetStatusUpdateQueue();
 	static std::mutex& GetStaticMutex();
 
 	friend class DbType;
@@ -4,6 +4,7 @@
 #include "db_ido_mysql/idomysqlconnection-ti.cpp"
 #include "db_ido/dbtype.hpp"
 #include "db_ido/dbvalue.hpp"
+#include "remote/apilistener.hpp"
 #include "base/logger.hpp"
 #include "base/objectlock.hpp"
 #include "base/convert.hpp"
@@ -14,6 +15,11 @@
 #include "base/exception.hpp"
 #include "base/statsfunction.hpp"
 #include "base/defer.hpp"
+#include "base/histogram.hpp"
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/erase.hpp>
+#include <boost/algorithm/string/join.hpp>
+#include <chrono>
 #include <utility>
 
 using namespace icinga;
@@ -21,6 +27,21 @@ using namespace icinga;
 REGISTER_TYPE(IdoMysqlConnection);
 REGISTER_STATSFUNCTION(IdoMysqlConnection, &IdoMysqlConnection::StatsFunc);
 
+/* A history table's cleanup continues with the next timer run after this many batches. */
+static const int l_MaxCleanUpBatches = 100;
+
+/* The prepared statements of a connection are closed once there are more than this many of them. */
+static const size_t l_MaxPreparedStatements = 256;
+
+/**
+ * The time until the server answered a query or a batch of async queries.
+ */
+static Histogram& GetQueryTimeHistogram()
+{
+	static Histogram& histogram (Histogram::GetByName("ido_mysql_query"));
+	return histogram;
+}
+
 void IdoMysqlConnection::OnConfigLoaded()
 {
 	ObjectImpl<IdoMysqlConnection>::OnConfigLoaded();
@@ -123,7 +144,7 @@ void IdoMysqlConnection::ExceptionHandler(boost::exception_ptr exp)
 		<< "Exception during database operation: " << DiagnosticInformation(std::move(exp));
 
 	if (GetConnected()) {
-		m_Mysql->close(&m_Connection);
+		CloseConnection();
 
 		SetConnected(false);
 	}
@@ -134,6 +155,16 @@ void IdoMysqlConnection::AssertOnWorkQueue()
 	ASSERT(m_QueryQueue.IsWorkerThread());
 }
 
+/**
+ * Closes the connection along with its prepared statements which are bound to it.
+ */
+void IdoMysqlConnection::CloseConnection()
+{
+	ClosePreparedStatements();
+
+	m_Mysql->close(&m_Connection);
+}
+
 void IdoMysqlConnection::Disconnect()
 {
 	AssertOnWorkQueue();
@@ -141,8 +172,24 @@ void IdoMysqlConnection::Disconnect()
 	if (!GetConnected())
 		return;
 
+	FinishAsyncQueries();
+
 	Query("COMMIT");
-	m_Mysql->close(&m_Connection);
+
+	if (IsIDCacheValid()) {
+		try {
+			Dictionary::Ptr token = GetIDCacheToken();
+
+			/* Someone else wrote to the database since we've connected, our cache might be outdated. */
+			if (Convert::ToLong(token->Get("conninfo_id")) == m_ConnInfoID)
+				SaveIDCache(token);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "IdoMysqlConnection")
+				<< "Failed to save the ID cache: " << DiagnosticInformation(ex, false);
+		}
+	}
+
+	CloseConnection();
 
 	SetConnected(false);
 
@@ -176,6 +223,9 @@ void IdoMysqlConnection::InternalNewTransaction()
 	if (!GetConnected())
 		return;
 
+	/* The status updates belong to the transaction which is about to be committed. */
+	FlushStatusBatches();
+
 	IncreasePendingQueries(2);
 
 	AsyncQuery("COMMIT");
@@ -214,7 +264,7 @@ void IdoMysqlConnection::Reconnect()
 		if (m_Mysql->ping(&m_Connection) == 0)
 			return;
 
-		m_Mysql->close(&m_Connection);
+		CloseConnection();
 		SetConnected(false);
 		reconnect = true;
 	}
@@ -298,7 +348,7 @@ void IdoMysqlConnection::Reconnect()
 	row = FetchRow(result);
 
 	if (!row) {
-		m_Mysql->close(&m_Connection);
+		CloseConnection();
 		SetConnected(false);
 
 		Log(LogCritical, "IdoMysqlConnection", "Schema does not provide any valid version! Verify your schema installation.");
@@ -313,7 +363,7 @@ void IdoMysqlConnection::Reconnect()
 	SetSchemaVersion(version);
 
 	if (Utility::CompareVersion(IDO_COMPAT_SCHEMA_VERSION, version) < 0) {
-		m_Mysql->close(&m_Connection);
+		CloseConnection();
 		SetConnected(false);
 
 		Log(LogCritical, "IdoMysqlConnection")
@@ -369,12 +419,18 @@ void IdoMysqlConnection::Reconnect()
 			double status_update_age = now - status_update_time;
 			double failoverTimeout = GetFailoverTimeout();
 
-			if (status_update_age < failoverTimeout) {
+			/* The other endpoint stopped writing before it handed over its objects. */
+			bool handedOver = row && status_update_time <= ApiListener::GetHandoverTime(endpoint_name);
+
+			if (status_update_age < failoverTimeout && handedOver) {
+				Log(LogInformation, "IdoMysqlConnection")
+					<< "Endpoint '" << endpoint_name << "' handed over, not waiting for the failover timeout.";
+			} else if (status_update_age < failoverTimeout) {
 				Log(LogInformation, "IdoMysqlConnection")
 					<< "Last update by endpoint '" << endpoint_name << "' was "
 					<< status_update_age << "s ago (< failover timeout of " << failoverTimeout << "s). Retrying.";
 
-				m_Mysql->close(&m_Connection);
+				CloseConnection();
 				SetConnected(false);
 				SetShouldConnect(false);
 
@@ -386,7 +442,7 @@ void IdoMysqlConnection::Reconnect()
 				Log(LogNotice, "IdoMysqlConnection")
 					<< "Local endpoint '" << my_endpoint->GetName() << "' is not authoritative, bailing out.";
 
-				m_Mysql->close(&m_Connection);
+				CloseConnection();
 				SetConnected(false);
 
 				return;
@@ -415,34 +471,41 @@ void IdoMysqlConnection::Reconnect()
 	/* update programstatus table */
 	UpdateProgramStatus();
 
+	Dictionary::Ptr idCacheToken = GetIDCacheToken();
+
 	/* record connection */
 	Query("INSERT INTO " + GetTablePrefix() + "conninfo " +
 		"(instance_id, connect_time, last_checkin_time, agent_name, agent_version, connect_type, data_start_time) VALUES ("
 		+ Convert::ToString(static_cast<long>(m_InstanceID)) + ", NOW(), NOW(), 'icinga2 db_ido_mysql', '" + Escape(Application::GetAppVersion())
 		+ "', '" + (reconnect ? "RECONNECT" : "INITIAL") + "', NOW())");
 
-	/* clear config tables for the initial config dump */
-	PrepareDatabase();
-
-	std::ostringstream q1buf;
-	q1buf << "SELECT object_id, objecttype_id, name1, name2, is_active FROM " + GetTablePrefix() + "objects WHERE instance_id = " << static_cast<long>(m_InstanceID);
-	result = Query(q1buf.str());
+	m_ConnInfoID = GetLastInsertID();
 
 	std::vector<DbObject::Ptr> activeDbObjs;
+	bool idCacheLoaded = LoadIDCache(idCacheToken, activeDbObjs);
 
-	while ((row = FetchRow(result))) {
-		DbType::Ptr dbtype = DbType::GetByID(row->Get("objecttype_id"));
+	/* clear config tables for the initial config dump */
+	PrepareDatabase(!idCacheLoaded);
 
-		if (!dbtype)
-			continue;
+	if (!idCacheLoaded) {
+		std::ostringstream q1buf;
+		q1buf << "SELECT object_id, objecttype_id, name1, name2, is_active FROM " + GetTablePrefix() + "objects WHERE instance_id = " << static_cast<long>(m_InstanceID);
+		result = Query(q1buf.str());
 
-		DbObject::Ptr dbobj = dbtype->GetOrCreateObjectByName(row->Get("name1"), row->Get("name2"));
-		SetObjectID(dbobj, DbReference(row->Get("object_id")));
-		bool active = row->Get("is_active");
-		SetObjectActive(dbobj, active);
+		while ((row = FetchRow(result))) {
+			DbType::Ptr dbtype = DbType::GetByID(row->Get("objecttype_id"));
 
-		if (active)
-			activeDbObjs.emplace_back(std::move(dbobj));
+			if (!dbtype)
+				continue;
+
+			DbObject::Ptr dbobj = dbtype->GetOrCreateObjectByName(row->Get("name1"), row->Get("name2"));
+			SetObjectID(dbobj, DbReference(row->Get("object_id")));
+			bool active = row->Get("is_active");
+			SetObjectActive(dbobj, active);
+
+			if (active)
+				activeDbObjs.emplace_back(std::move(dbobj));
+		}
 	}
 
 	SetIDCacheValid(true);
@@ -515,8 +578,258 @@ void IdoMysqlConnection::AsyncQuery(const String& query, const std::function<voi
 	m_AsyncQueries.emplace_back(std::move(aq));
 }
 
+/**
+ * Like AsyncQuery(), but the query is executed as a prepared statement. So it's
+ * parsed only once per connection, and the parameters don't have to be escaped.
+ *
+ * @param query The query with a placeholder for each parameter
+ * @param parameters Numbers and strings for the placeholders
+ * @param callback Called after the query has been executed, without a result
+ */
+void IdoMysqlConnection::AsyncPreparedQuery(const String& query, std::vector<Value> parameters, const IdoAsyncCallback& callback)
+{
+	AssertOnWorkQueue();
+
+	IdoAsyncQuery aq;
+	aq.Query = query;
+	aq.Callback = callback;
+	aq.Prepared = true;
+	aq.Parameters = std::move(parameters);
+	m_AsyncQueries.emplace_back(std::move(aq));
+}
+
+/**
+ * Prepares a statement once per connection, i.e. again after a reconnect.
+ */
+MYSQL_STMT *IdoMysqlConnection::GetPreparedStatement(const String& query)
+{
+	AssertOnWorkQueue();
+
+	auto it = m_PreparedStatements.find(query);
+
+	if (it != m_PreparedStatements.end())
+		return it->second;
+
+	/* Queries with arbitrary columns may add up, the server limits the statements of all clients. */
+	if (m_PreparedStatements.size() >= l_MaxPreparedStatements)
+		ClosePreparedStatements();
+
+	MYSQL_STMT *stmt = m_Mysql->stmt_init(&m_Connection);
+
+	if (!stmt) {
+		BOOST_THROW_EXCEPTION(
+			database_error()
+			<< errinfo_message(m_Mysql->error(&m_Connection))
+			<< errinfo_database_query(query)
+		);
+	}
+
+	if (m_Mysql->stmt_prepare(stmt, query.CStr(), query.GetLength()) != 0) {
+		String message = m_Mysql->stmt_error(stmt);
+		m_Mysql->stmt_close(stmt);
+
+		Log(LogCritical, "IdoMysqlConnection")
+			<< "Error \"" << message << "\" when preparing query \"" << query << "\"";
+
+		BOOST_THROW_EXCEPTION(
+			database_error()
+			<< errinfo_message(message)
+			<< errinfo_database_query(query)
+		);
+	}
+
+	m_PreparedStatements.emplace(query, stmt);
+
+	return stmt;
+}
+
+void IdoMysqlConnection::ExecutePreparedQuery(const IdoAsyncQuery& query)
+{
+	MYSQL_STMT *stmt = GetPreparedStatement(query.Query);
+
+	std::vector<MYSQL_BIND> binds (query.Parameters.size());
+	std::vector<long long> numbers (query.Parameters.size());
+
+	for (std::vector<Value>::size_type i = 0; i < query.Parameters.size(); i++) {
+		const Value& param = query.Parameters[i];
+		MYSQL_BIND& bind = binds[i];
+
+		if (param.IsNumber()) {
+			numbers[i] = static_cast<long long>(param.Get<double>());
+
+			bind.buffer_type = MYSQL_TYPE_LONGLONG;
+			bind.buffer = &numbers[i];
+		} else {
+			const String& str = param.Get<String>();
+
+			bind.buffer_type = MYSQL_TYPE_STRING;
+			bind.buffer = const_cast<char *>(str.CStr());
+			bind.buffer_length = str.GetLength();
+		}
+	}
+
+	auto start (std::chrono::steady_clock::now());
+
+	if (m_Mysql->stmt_bind_param(stmt, binds.data()) || m_Mysql->stmt_execute(stmt) != 0) {
+		String message = m_Mysql->stmt_error(stmt);
+
+		Log(LogCritical, "IdoMysqlConnection")
+			<< "Error \"" << message << "\" when executing prepared query \"" << query.Query << "\"";
+
+		BOOST_THROW_EXCEPTION(
+			database_error()
+			<< errinfo_message(message)
+			<< errinfo_database_query(query.Query)
+		);
+	}
+
+	GetQueryTimeHistogram().RecordSince(start);
+
+	m_AffectedRows = m_Mysql->stmt_affected_rows(stmt);
+
+	if (query.Callback)
+		query.Callback(IdoMysqlResult());
+}
+
+void IdoMysqlConnection::ClosePreparedStatements()
+{
+	for (auto& kv : m_PreparedStatements)
+		m_Mysql->stmt_close(kv.second);
+
+	m_PreparedStatements.clear();
+}
+
+/**
+ * Adds a status update to the batch for its table and columns. A previous
+ * update for the same object and columns which hasn't been sent yet is
+ * replaced. One with other columns is sent first.
+ *
+ * @param query The status update.
+ * @returns false if the fields can't be converted yet, e.g. because of missing object IDs
+ */
+bool IdoMysqlConnection::AddStatusUpdateToBatch(const DbQuery& query)
+{
+	std::vector<String> columns;
+	std::ostringstream valbuf;
+
+	{
+		ObjectLock olock(query.Fields);
+
+		for (const Dictionary::Pair& kv : query.Fields) {
+			Value value;
+
+			if (kv.second.IsEmpty() && !kv.second.IsString())
+				continue;
+
+			if (!FieldToEscapedString(kv.first, kv.second, &value))
+				return false;
+
+			if (!columns.empty())
+				valbuf << ", ";
+
+			columns.push_back(kv.first);
+			valbuf << value;
+		}
+	}
+
+	if (columns.empty())
+		return true;
+
+	String key = query.Table + ":" + boost::algorithm::join(columns, ",");
+
+	/* The batches are flushed in key order, not in the order they were queued. A pending
+	 * update of the same object with other columns has to be sent before this newer one. */
+	for (auto& kv : m_StatusBatches) {
+		if (kv.first != key && kv.second.RowIndex.find(query.Object.get()) != kv.second.RowIndex.end()) {
+			FlushStatusBatches();
+			break;
+		}
+	}
+
+	IdoStatusBatch& batch = m_StatusBatches[key];
+
+	if (batch.Table.IsEmpty()) {
+		batch.Table = query.Table;
+		batch.Columns = std::move(columns);
+	}
+
+	String row = "(" + valbuf.str() + ")";
+	auto it = batch.RowIndex.find(query.Object.get());
+
+	if (it != batch.RowIndex.end()) {
+		batch.Rows[it->second].second = std::move(row);
+
+		/* The previous update is dropped. */
+		DecreasePendingQueries(1);
+	} else {
+		batch.RowIndex[query.Object.get()] = batch.Rows.size();
+		batch.Rows.emplace_back(query.Object, std::move(row));
+	}
+
+	return true;
+}
+
+/**
+ * Converts the pending status updates into multi-row upserts, each of them
+ * fitting into max_allowed_packet.
+ */
+void IdoMysqlConnection::FlushStatusBatches()
+{
+	for (auto& kv : m_StatusBatches) {
+		IdoStatusBatch& batch = kv.second;
+
+		String prefix = "INSERT INTO " + GetTablePrefix() + batch.Table + " (" + boost::algorithm::join(batch.Columns, ", ") + ") VALUES ";
+
+		std::vector<String> updates;
+
+		for (const String& column : batch.Columns)
+			updates.push_back(column + " = VALUES(" + column + ")");
+
+		String suffix = " ON DUPLICATE KEY UPDATE " + boost::algorithm::join(updates, ", ");
+
+		size_t offset = 0;
+
+		while (offset < batch.Rows.size()) {
+			std::ostringstream qbuf;
+			qbuf << prefix;
+
+			size_t num_bytes = prefix.GetLength() + suffix.GetLength();
+			std::vector<DbObject::Ptr> objects;
+
+			for (; offset < batch.Rows.size(); offset++) {
+				const String& row = batch.Rows[offset].second;
+
+				if (!objects.empty()) {
+					if (num_bytes + row.GetLength() + 2 > m_MaxPacketSize - 512)
+						break;
+
+					qbuf << ", ";
+				}
+
+				qbuf << row;
+				num_bytes += row.GetLength() + 2;
+				objects.push_back(batch.Rows[offset].first);
+			}
+
+			qbuf << suffix;
+
+			/* Each update was counted as a pending query, the batch is a single one now. */
+			DecreasePendingQueries(objects.size() - 1);
+
+			AsyncQuery(qbuf.str(), [this, objects](const IdoMysqlResult&) {
+				for (const DbObject::Ptr& dbobj : objects)
+					SetStatusUpdate(dbobj, true);
+			});
+		}
+	}
+
+	m_StatusBatches.clear();
+}
+
 void IdoMysqlConnection::FinishAsyncQueries()
 {
+	FlushStatusBatches();
+
 	std::vector<IdoAsyncQuery> queries;
 	m_AsyncQueries.swap(queries);
 
@@ -545,9 +858,24 @@ void IdoMysqlConnection::FinishAsyncQueries()
 			m_UncommittedAsyncQueries += count;
 		});
 
+		/* Prepared statements are executed one by one, in order with the other queries. */
+		if (queries[offset].Prepared) {
+			IncreaseQueryCount();
+			count++;
+
+			Log(LogDebug, "IdoMysqlConnection")
+				<< "Prepared query: " << queries[offset].Query;
+
+			ExecutePreparedQuery(queries[offset]);
+			continue;
+		}
+
 		for (std::vector<IdoAsyncQuery>::size_type i = offset; i < queries.size(); i++) {
 			const IdoAsyncQuery& aq = queries[i];
 
+			if (aq.Prepared)
+				break;
+
 			size_t size_query = aq.Query.GetLength() + 1;
 
 			if (count > 0) {
@@ -569,6 +897,8 @@ void IdoMysqlConnection::FinishAsyncQueries()
 
 		String query = querybuf.str();
 
+		auto start (std::chrono::steady_clock::now());
+
 		if (m_Mysql->query(&m_Connection, query.CStr()) != 0) {
 			std::ostringstream msgbuf;
 			String message = m_Mysql->error(&m_Connection);
@@ -582,6 +912,8 @@ void IdoMysqlConnection::FinishAsyncQueries()
 			);
 		}
 
+		GetQueryTimeHistogram().RecordSince(start);
+
 		for (std::vector<IdoAsyncQuery>::size_type i = offset; i < offset + count; i++) {
 			const IdoAsyncQuery& aq = queries[i];
 
@@ -648,6 +980,8 @@ IdoMysqlResult IdoMysqlConnection::Query(const String& query)
 
 	IncreaseQueryCount();
 
+	auto start (std::chrono::steady_clock::now());
+
 	if (m_Mysql->query(&m_Connection, query.CStr()) != 0) {
 		std::ostringstream msgbuf;
 		String message = m_Mysql->error(&m_Connection);
@@ -663,6 +997,8 @@ IdoMysqlResult IdoMysqlConnection::Query(const String& query)
 
 	MYSQL_RES *result = m_Mysql->store_result(&m_Connection);
 
+	GetQueryTimeHistogram().RecordSince(start);
+
 	m_AffectedRows = m_Mysql->affected_rows(&m_Connection);
 
 	if (!result) {
@@ -835,13 +1171,20 @@ void IdoMysqlConnection::InternalDeactivateObject(const DbObject::Ptr& dbobj)
 	 * because the object is still in the database. */
 }
 
-bool IdoMysqlConnection::FieldToEscapedString(const String& key, const Value& value, Value *result)
+/**
+ * Converts a field of a query into the value which is written to the database.
+ *
+ * @returns false if the value isn't known yet, e.g. because of a missing object ID
+ */
+bool IdoMysqlConnection::FieldToParameter(const String& key, const Value& value, IdoMysqlParameter *result)
 {
 	if (key == "instance_id") {
-		*result = static_cast<long>(m_InstanceID);
+		result->Data = static_cast<long>(m_InstanceID);
+		result->Literal = true;
 		return true;
 	} else if (key == "session_token") {
-		*result = GetSessionToken();
+		result->Data = GetSessionToken();
+		result->Literal = true;
 		return true;
 	}
 
@@ -850,8 +1193,10 @@ bool IdoMysqlConnection::FieldToEscapedString(const String& key, const Value& va
 	if (rawvalue.IsObjectType<ConfigObject>()) {
 		DbObject::Ptr dbobjcol = DbObject::GetOrCreateByObject(rawvalue);
 
+		result->Literal = true;
+
 		if (!dbobjcol) {
-			*result = 0;
+			result->Data = 0;
 			return true;
 		}
 
@@ -878,34 +1223,69 @@ bool IdoMysqlConnection::FieldToEscapedString(const String& key, const Value& va
 			}
 		}
 
-		*result = static_cast<long>(dbrefcol);
+		result->Data = static_cast<long>(dbrefcol);
 	} else if (DbValue::IsTimestamp(value)) {
-		long ts = rawvalue;
-		std::ostringstream msgbuf;
-		msgbuf << "FROM_UNIXTIME(" << ts << ")";
-		*result = Value(msgbuf.str());
+		result->Data = static_cast<long>(rawvalue);
+		result->Timestamp = true;
 	} else if (DbValue::IsObjectInsertID(value)) {
 		auto id = static_cast<long>(rawvalue);
 
 		if (id <= 0)
 			return false;
 
-		*result = id;
-		return true;
+		result->Data = id;
+		result->Literal = true;
 	} else {
-		Value fvalue;
-
 		if (rawvalue.IsBoolean())
-			fvalue = Convert::ToLong(rawvalue);
+			result->Data = Convert::ToLong(rawvalue);
 		else
-			fvalue = rawvalue;
-
-		*result = "'" + Escape(fvalue) + "'";
+			result->Data = rawvalue;
 	}
 
 	return true;
 }
 
+bool IdoMysqlConnection::FieldToEscapedString(const String& key, const Value& value, Value *result)
+{
+	IdoMysqlParameter param;
+
+	if (!FieldToParameter(key, value, &param))
+		return false;
+
+	*result = RenderParameter(param, nullptr);
+	return true;
+}
+
+/**
+ * Renders a field for a query.
+ *
+ * @param param The field's value
+ * @param parameters The parameters of a prepared statement, nullptr to escape the value into the query
+ * @returns The SQL expression for the field
+ */
+Value IdoMysqlConnection::RenderParameter(const IdoMysqlParameter& param, std::vector<Value> *parameters)
+{
+	if (parameters) {
+		if (param.Literal || param.Timestamp)
+			parameters->push_back(param.Data);
+		else
+			parameters->push_back(Utility::ValidateUTF8(param.Data));
+
+		return param.Timestamp ? "FROM_UNIXTIME(?)" : "?";
+	}
+
+	if (param.Literal)
+		return param.Data;
+
+	if (param.Timestamp) {
+		std::ostringstream msgbuf;
+		msgbuf << "FROM_UNIXTIME(" << static_cast<long>(param.Data) << ")";
+		return String(msgbuf.str());
+	}
+
+	return "'" + Escape(param.Data) + "'";
+}
+
 void IdoMysqlConnection::ExecuteQuery(const DbQuery& query)
 {
 	if (IsPaused())
@@ -1051,18 +1431,17 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 		return;
 	}
 
-	std::ostringstream qbuf, where;
+	std::ostringstream qbuf;
+	std::vector<std::pair<String, IdoMysqlParameter> > where;
 	int type;
 
 	if (query.WhereCriteria) {
-		where << " WHERE ";
-
 		ObjectLock olock(query.WhereCriteria);
-		Value value;
-		bool first = true;
 
 		for (const Dictionary::Pair& kv : query.WhereCriteria) {
-			if (!FieldToEscapedString(kv.first, kv.second, &value)) {
+			IdoMysqlParameter param;
+
+			if (!FieldToParameter(kv.first, kv.second, &param)) {
 
 #ifdef I2_DEBUG /* I2_DEBUG */
 				Log(LogDebug, "IdoMysqlConnection")
@@ -1074,18 +1453,41 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 				return;
 			}
 
-			if (!first)
-				where << " AND ";
+			where.emplace_back(kv.first, std::move(param));
+		}
+	}
 
-			where << kv.first << " = " << value;
+	auto renderWhere = [this, &where](std::vector<Value> *parameters) {
+		std::ostringstream wherebuf;
+		bool first = true;
 
-			if (first)
-				first = false;
+		for (const auto& kv : where) {
+			wherebuf << (first ? " WHERE " : " AND ") << kv.first << " = " << RenderParameter(kv.second, parameters);
+			first = false;
 		}
-	}
+
+		return wherebuf.str();
+	};
 
 	type = (typeOverride != -1) ? typeOverride : query.Type;
 
+	/* The status tables have a unique key on the object ID which makes it possible
+	 * to coalesce their updates into multi-row upserts. */
+	if (typeOverride == -1 && query.StatusUpdate && query.Object && (type & DbQueryInsert) && (type & DbQueryUpdate) &&
+		(query.Table == "hoststatus" || query.Table == "servicestatus")) {
+		if (!AddStatusUpdateToBatch(query)) {
+
+#ifdef I2_DEBUG /* I2_DEBUG */
+			Log(LogDebug, "IdoMysqlConnection")
+				<< "Scheduling execute query task again: Cannot extract required status fields, table '" << query.Table << "'.";
+#endif /* I2_DEBUG */
+
+			m_QueryQueue.Enqueue(std::bind(&IdoMysqlConnection::InternalExecuteQuery, this, query, -1), query.Priority);
+		}
+
+		return;
+	}
+
 	bool upsert = false;
 
 	if ((type & DbQueryInsert) && (type & DbQueryUpdate)) {
@@ -1106,7 +1508,7 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 
 	if ((type & DbQueryInsert) && (type & DbQueryDelete)) {
 		std::ostringstream qdel;
-		qdel << "DELETE FROM " << GetTablePrefix() << query.Table << where.str();
+		qdel << "DELETE FROM " << GetTablePrefix() << query.Table << renderWhere(nullptr);
 		IncreasePendingQueries(1);
 		AsyncQuery(qdel.str());
 
@@ -1127,6 +1529,10 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 			VERIFY(!"Invalid query type.");
 	}
 
+	/* Inserts and updates are few shapes of queries, e.g. per history table, which are executed over and over again. */
+	bool prepared = GetEnablePreparedStatements() && (type == DbQueryInsert || type == DbQueryUpdate);
+	std::vector<Value> parameters;
+
 	if (type == DbQueryInsert || type == DbQueryUpdate) {
 		std::ostringstream colbuf, valbuf;
 
@@ -1137,12 +1543,12 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 
 		bool first = true;
 		for (const Dictionary::Pair& kv : query.Fields) {
-			Value value;
+			IdoMysqlParameter param;
 
 			if (kv.second.IsEmpty() && !kv.second.IsString())
 				continue;
 
-			if (!FieldToEscapedString(kv.first, kv.second, &value)) {
+			if (!FieldToParameter(kv.first, kv.second, &param)) {
 
 #ifdef I2_DEBUG /* I2_DEBUG */
 				Log(LogDebug, "IdoMysqlConnection")
@@ -1154,6 +1560,8 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 				return;
 			}
 
+			Value value = RenderParameter(param, prepared ? &parameters : nullptr);
+
 			if (type == DbQueryInsert) {
 				if (!first) {
 					colbuf << ", ";
@@ -1178,9 +1586,12 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 	}
 
 	if (type != DbQueryInsert)
-		qbuf << where.str();
+		qbuf << renderWhere(prepared ? &parameters : nullptr);
 
-	AsyncQuery(qbuf.str(), std::bind(&IdoMysqlConnection::FinishExecuteQuery, this, query, type, upsert));
+	if (prepared)
+		AsyncPreparedQuery(qbuf.str(), std::move(parameters), std::bind(&IdoMysqlConnection::FinishExecuteQuery, this, query, type, upsert));
+	else
+		AsyncQuery(qbuf.str(), std::bind(&IdoMysqlConnection::FinishExecuteQuery, this, query, type, upsert));
 }
 
 void IdoMysqlConnection::FinishExecuteQuery(const DbQuery& query, int type, bool upsert)
@@ -1198,6 +1609,14 @@ void IdoMysqlConnection::FinishExecuteQuery(const DbQuery& query, int type, bool
 		return;
 	}
 
+	/* Keeps the ID cache up to date for SaveIDCache(). */
+	if (query.ConfigUpdate && query.Object && query.Fields && (type & (DbQueryInsert | DbQueryUpdate))) {
+		Value configHash;
+
+		if (query.Fields->Get("config_hash", &configHash))
+			SetConfigHash(query.Object, configHash);
+	}
+
 	if (type == DbQueryInsert && query.Object) {
 		if (query.ConfigUpdate) {
 			SetInsertID(query.Object, GetLastInsertID());
@@ -1210,7 +1629,7 @@ void IdoMysqlConnection::FinishExecuteQuery(const DbQuery& query, int type, bool
 		query.NotificationInsertID->SetValue(static_cast<long>(GetLastInsertID()));
 }
 
-void IdoMysqlConnection::CleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
+void IdoMysqlConnection::CleanUpExecuteQuery(const String& table, const String& id_column, const String& time_column, double max_age)
 {
 	if (IsPaused())
 		return;
@@ -1222,40 +1641,200 @@ void IdoMysqlConnection::CleanUpExecuteQuery(const String& table, const String&
 #endif /* I2_DEBUG */
 
 	IncreasePendingQueries(1);
-	m_QueryQueue.Enqueue(std::bind(&IdoMysqlConnection::InternalCleanUpExecuteQuery, this, table, time_column, max_age), PriorityLow, true);
+	m_QueryQueue.Enqueue(std::bind(&IdoMysqlConnection::InternalCleanUpExecuteQuery, this, table, id_column, time_column, max_age, -1, 0), PriorityLow, true);
 }
 
-void IdoMysqlConnection::InternalCleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
+/**
+ * Deletes the rows older than max_age from a history table. Rather than with
+ * one DELETE which locks the table's rows for minutes, the rows are deleted by
+ * primary key range, one batch per query queue task so that other queries
+ * aren't held up. The rows are inserted roughly in chronological order, so
+ * the cleanup is done once the row after the last batch isn't old enough.
+ *
+ * @param table The table without prefix
+ * @param id_column The table's primary key
+ * @param time_column The timestamp the row's age is determined by
+ * @param max_age Rows older than this UNIX timestamp are deleted
+ * @param fromId Where the batch starts, -1 for the first row
+ * @param batch The number of batches done during this cleanup run
+ */
+void IdoMysqlConnection::InternalCleanUpExecuteQuery(const String& table, const String& id_column, const String& time_column,
+	double max_age, long fromId, int batch)
 {
 	AssertOnWorkQueue();
 
-	if (IsPaused()) {
-		DecreasePendingQueries(1);
-		return;
+	/* The queries below are accounted for on their own. */
+	DecreasePendingQueries(1);
+
+	if (batch == 0) {
+		/* The previous run is still going on. */
+		if (!m_CleanUpsInProgress.insert(table).second)
+			return;
 	}
 
-	if (!GetConnected()) {
-		DecreasePendingQueries(1);
+	bool done = true;
+	Defer finish ([this, &table, &done]() {
+		if (done)
+			m_CleanUpsInProgress.erase(table);
+	});
+
+	if (IsPaused() || !GetConnected())
+		return;
+
+	String instanceID = Convert::ToString(static_cast<long>(m_InstanceID));
+	String cutoff = "FROM_UNIXTIME(" + Convert::ToString(static_cast<long>(max_age)) + ")";
+	long batchSize = GetCleanupBatchSize();
+
+	if (batch == 0 && GetEnablePartitionedCleanup() && CleanUpPartitions(table, time_column, max_age))
+		return;
+
+	if (batchSize <= 0) {
+		Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " + instanceID +
+			" AND " + time_column + " < " + cutoff);
 		return;
 	}
 
-	AsyncQuery("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
-		Convert::ToString(static_cast<long>(m_InstanceID)) + " AND " + time_column +
-		" < FROM_UNIXTIME(" + Convert::ToString(static_cast<long>(max_age)) + ")");
+	IdoMysqlResult result = Query("SELECT " + id_column + " AS id, UNIX_TIMESTAMP(" + time_column + ") AS ts FROM " +
+		GetTablePrefix() + table + " WHERE instance_id = " + instanceID +
+		(fromId >= 0 ? " AND " + id_column + " >= " + Convert::ToString(fromId) : "") +
+		" ORDER BY " + id_column + " LIMIT 1");
+
+	Dictionary::Ptr row = FetchRow(result);
+
+	if (!row)
+		return;
+
+	/* Rows without a timestamp are never deleted, but mustn't stop the cleanup either. */
+	String ts = row->Get("ts");
+
+	if (!ts.IsEmpty() && Convert::ToDouble(ts) >= max_age)
+		return;
+
+	long firstId = Convert::ToLong(row->Get("id"));
+
+	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " + instanceID +
+		" AND " + id_column + " >= " + Convert::ToString(firstId) +
+		" AND " + id_column + " < " + Convert::ToString(firstId + batchSize) +
+		" AND " + time_column + " < " + cutoff);
+
+	if (++batch >= l_MaxCleanUpBatches)
+		return;
+
+	done = false;
+
+	IncreasePendingQueries(1);
+	m_QueryQueue.Enqueue(std::bind(&IdoMysqlConnection::InternalCleanUpExecuteQuery, this, table, id_column, time_column,
+		max_age, firstId + batchSize, batch), PriorityLow, true);
 }
 
-void IdoMysqlConnection::FillIDCache(const DbType::Ptr& type)
+/**
+ * Drops the partitions of a history table which only contain rows older than
+ * max_age. The table has to be partitioned by RANGE (UNIX_TIMESTAMP(time_column)).
+ *
+ * @param table The table without prefix
+ * @param time_column The timestamp the row's age is determined by
+ * @param max_age Rows older than this UNIX timestamp are deleted
+ * @returns false if the table isn't partitioned that way and has to be cleaned up row by row
+ */
+bool IdoMysqlConnection::CleanUpPartitions(const String& table, const String& time_column, double max_age)
 {
-	String query = "SELECT " + type->GetIDColumn() + " AS object_id, " + type->GetTable() + "_id, config_hash FROM " + GetTablePrefix() + type->GetTable() + "s";
-	IdoMysqlResult result = Query(query);
+	IdoMysqlResult result = Query("SELECT PARTITION_NAME AS name, PARTITION_EXPRESSION AS expression, PARTITION_DESCRIPTION AS bound "
+		"FROM information_schema.PARTITIONS WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = '" + Escape(GetTablePrefix() + table) +
+		"' AND PARTITION_METHOD = 'RANGE'");
 
 	Dictionary::Ptr row;
+	std::vector<String> expired;
+	bool partitioned = false;
 
 	while ((row = FetchRow(result))) {
-		DbReference dbref(row->Get("object_id"));
-		SetInsertID(type, dbref, DbReference(row->Get(type->GetTable() + "_id")));
-		SetConfigHash(type, dbref, row->Get("config_hash"));
+		String expression = row->Get("expression");
+		String bound = row->Get("bound");
+
+		boost::algorithm::to_lower(expression);
+		boost::algorithm::erase_all(expression, "`");
+
+		if (expression != "unix_timestamp(" + time_column + ")") {
+			Log(LogWarning, "IdoMysqlConnection")
+				<< "Table '" << GetTablePrefix() << table << "' isn't partitioned by UNIX_TIMESTAMP(" << time_column
+				<< "), deleting its old rows instead of dropping partitions.";
+			return false;
+		}
+
+		partitioned = true;
+
+		/* The bound is exclusive, the last partition's one may be MAXVALUE. */
+		if (bound != "MAXVALUE" && Convert::ToDouble(bound) <= max_age)
+			expired.emplace_back("`" + static_cast<String>(row->Get("name")) + "`");
+	}
+
+	if (!partitioned)
+		return false;
+
+	if (!expired.empty()) {
+		Log(LogInformation, "IdoMysqlConnection")
+			<< "Dropping " << expired.size() << " expired partition(s) of table '" << GetTablePrefix() << table << "'.";
+
+		Query("ALTER TABLE " + GetTablePrefix() + table + " DROP PARTITION " + boost::algorithm::join(expired, ", "));
 	}
+
+	return true;
+}
+
+void IdoMysqlConnection::FillIDCache(const DbType::Ptr& type, bool insertIDs)
+{
+	String query;
+	IdoMysqlResult result;
+	Dictionary::Ptr row;
+
+	if (insertIDs) {
+		query = "SELECT " + type->GetIDColumn() + " AS object_id, " + type->GetTable() + "_id, config_hash FROM " + GetTablePrefix() + type->GetTable() + "s";
+		result = Query(query);
+
+		while ((row = FetchRow(result))) {
+			DbReference dbref(row->Get("object_id"));
+			SetInsertID(type, dbref, DbReference(row->Get(type->GetTable() + "_id")));
+			SetConfigHash(type, dbref, row->Get("config_hash"));
+		}
+	}
+
+	/* Hosts and services make up most of the status rows, remember when they were
+	 * written so that a reconnect only has to send the ones which are outdated. */
+	if (type->GetTable() != "host" && type->GetTable() != "service")
+		return;
+
+	query = "SELECT " + type->GetIDColumn() + " AS object_id, UNIX_TIMESTAMP(status_update_time) AS status_update_time FROM " + GetTablePrefix() + type->GetTable() + "status";
+	result = Query(query);
+
+	while ((row = FetchRow(result))) {
+		Value version = row->Get("status_update_time");
+
+		if (!version.IsEmpty())
+			SetStatusVersion(type, DbReference(row->Get("object_id")), version);
+	}
+}
+
+/**
+ * Describes the database's state for the ID cache. Any other connection since
+ * ours adds a conninfo row, manual changes most likely change the objects.
+ */
+Dictionary::Ptr IdoMysqlConnection::GetIDCacheToken()
+{
+	String instanceID = Convert::ToString(static_cast<long>(m_InstanceID));
+
+	IdoMysqlResult result = Query("SELECT MAX(conninfo_id) AS conninfo_id FROM " + GetTablePrefix() + "conninfo WHERE instance_id = " + instanceID);
+	Dictionary::Ptr conninfo = FetchRow(result);
+	DiscardRows(result);
+
+	result = Query("SELECT COUNT(*) AS count, MAX(object_id) AS max_object_id FROM " + GetTablePrefix() + "objects WHERE instance_id = " + instanceID);
+	Dictionary::Ptr objects = FetchRow(result);
+	DiscardRows(result);
+
+	return new Dictionary({
+		{ "instance_id", instanceID },
+		{ "conninfo_id", conninfo ? conninfo->Get("conninfo_id") : Empty },
+		{ "objects", objects ? objects->Get("count") : Empty },
+		{ "max_object_id", objects ? objects->Get("max_object_id") : Empty }
+	});
 }
 
 int IdoMysqlConnection::GetPendingQueryCount() const
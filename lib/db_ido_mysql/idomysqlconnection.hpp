@@ -10,6 +10,9 @@
 #include "base/workqueue.hpp"
 #include "base/library.hpp"
 #include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace icinga
 {
@@ -22,6 +25,41 @@ struct IdoAsyncQuery
 {
 	String Query;
 	IdoAsyncCallback Callback;
+
+	/* Whether Query is executed as a prepared statement with these parameters. */
+	bool Prepared{false};
+	std::vector<Value> Parameters;
+};
+
+/**
+ * A field value of a query before it's either escaped into the query
+ * or bound to a prepared statement.
+ *
+ * @ingroup ido
+ */
+struct IdoMysqlParameter
+{
+	Value Data;
+
+	/* Data is a number which is used as it is, e.g. an object ID. */
+	bool Literal{false};
+
+	/* Data is a UNIX timestamp which is converted with FROM_UNIXTIME(). */
+	bool Timestamp{false};
+};
+
+/**
+ * Status updates for a table which are written with a single multi-row
+ * INSERT ... ON DUPLICATE KEY UPDATE statement.
+ *
+ * @ingroup ido
+ */
+struct IdoStatusBatch
+{
+	String Table;
+	std::vector<String> Columns;
+	std::vector<std::pair<DbObject::Ptr, String> > Rows;
+	std::unordered_map<DbObject *, size_t> RowIndex;
 };
 
 /**
@@ -48,12 +86,13 @@ protected:
 	void DeactivateObject(const DbObject::Ptr& dbobj) override;
 	void ExecuteQuery(const DbQuery& query) override;
 	void ExecuteMultipleQueries(const std::vector<DbQuery>& queries) override;
-	void CleanUpExecuteQuery(const String& table, const String& time_key, double time_value) override;
-	void FillIDCache(const DbType::Ptr& type) override;
+	void CleanUpExecuteQuery(const String& table, const String& id_column, const String& time_column, double max_age) override;
+	void FillIDCache(const DbType::Ptr& type, bool insertIDs) override;
 	void NewTransaction() override;
 
 private:
 	DbReference m_InstanceID;
+	long m_ConnInfoID{-1};
 
 	Library m_Library;
 	std::unique_ptr<MysqlInterface, MysqlInterfaceDeleter> m_Mysql;
@@ -63,6 +102,8 @@ private:
 	unsigned int m_MaxPacketSize;
 
 	std::vector<IdoAsyncQuery> m_AsyncQueries;
+	std::map<String, IdoStatusBatch> m_StatusBatches;
+	std::map<String, MYSQL_STMT *> m_PreparedStatements;
 	uint_fast32_t m_UncommittedAsyncQueries = 0;
 
 	Timer::Ptr m_ReconnectTimer;
@@ -70,15 +111,27 @@ private:
 
 	IdoMysqlResult Query(const String& query);
 	DbReference GetLastInsertID();
+	Dictionary::Ptr GetIDCacheToken();
 	int GetAffectedRows();
 	String Escape(const String& s);
 	Dictionary::Ptr FetchRow(const IdoMysqlResult& result);
 	void DiscardRows(const IdoMysqlResult& result);
 
 	void AsyncQuery(const String& query, const IdoAsyncCallback& callback = IdoAsyncCallback());
+	void AsyncPreparedQuery(const String& query, std::vector<Value> parameters, const IdoAsyncCallback& callback);
 	void FinishAsyncQueries();
 
+	MYSQL_STMT *GetPreparedStatement(const String& query);
+	void ExecutePreparedQuery(const IdoAsyncQuery& query);
+	void ClosePreparedStatements();
+	void CloseConnection();
+
+	bool AddStatusUpdateToBatch(const DbQuery& query);
+	void FlushStatusBatches();
+
+	bool FieldToParameter(const String& key, const Value& value, IdoMysqlParameter *result);
 	bool FieldToEscapedString(const String& key, const Value& value, Value *result);
+	Value RenderParameter(const IdoMysqlParameter& param, std::vector<Value> *parameters);
 	void InternalActivateObject(const DbObject::Ptr& dbobj);
 	void InternalDeactivateObject(const DbObject::Ptr& dbobj);
 
@@ -96,7 +149,9 @@ private:
 	void InternalExecuteMultipleQueries(const std::vector<DbQuery>& queries);
 
 	void FinishExecuteQuery(const DbQuery& query, int type, bool upsert);
-	void InternalCleanUpExecuteQuery(const String& table, const String& time_key, double time_value);
+	void InternalCleanUpExecuteQuery(const String& table, const String& id_column, const String& time_column, double max_age,
+		long fromId = -1, int batch = 0);
+	bool CleanUpPartitions(const String& table, const String& time_column, double max_age);
 	void InternalNewTransaction();
 
 	void ClearTableBySession(const String& table);
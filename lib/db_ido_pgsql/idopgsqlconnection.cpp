@@ -4,6 +4,7 @@
 #include "db_ido_pgsql/idopgsqlconnection-ti.cpp"
 #include "db_ido/dbtype.hpp"
 #include "db_ido/dbvalue.hpp"
+#include "remote/apilistener.hpp"
 #include "base/logger.hpp"
 #include "base/objectlock.hpp"
 #include "base/convert.hpp"
@@ -15,7 +16,13 @@
 #include "base/context.hpp"
 #include "base/statsfunction.hpp"
 #include "base/defer.hpp"
+#include "base/histogram.hpp"
+#include <boost/algorithm/string/join.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <chrono>
+#include <set>
 #include <utility>
+#include <vector>
 
 using namespace icinga;
 
@@ -23,6 +30,18 @@ REGISTER_TYPE(IdoPgsqlConnection);
 
 REGISTER_STATSFUNCTION(IdoPgsqlConnection, &IdoPgsqlConnection::StatsFunc);
 
+/* History tables which are only ever appended to and whose inserts don't need the new row's ID. */
+static const std::set<String> l_CopyTables = {
+	"statehistory", "logentries", "flappinghistory", "contactnotifications",
+	"eventhandlers", "externalcommands"
+};
+
+static const size_t l_CopyBufferLimit = 1024 * 1024;
+static const size_t l_MaxPreparedStatements = 1000;
+
+/* A history table's cleanup continues with the next timer run after this many batches. */
+static const int l_MaxCleanUpBatches = 100;
+
 IdoPgsqlConnection::IdoPgsqlConnection()
 {
 	m_QueryQueue.SetName("IdoPgsqlConnection, " + GetName());
@@ -138,14 +157,38 @@ void IdoPgsqlConnection::Disconnect()
 	if (!GetConnected())
 		return;
 
+	/* The connection is closed even if committing fails. */
+	Defer close ([this]() {
+		m_Pgsql->finish(m_Connection);
+		SetConnected(false);
+
+		Log(LogInformation, "IdoPgsqlConnection")
+			<< "Disconnected from '" << GetName() << "' database '" << GetDatabase() << "'.";
+	});
+
+	/* The buffered rows are lost on error, but the COMMIT is still attempted. */
+	try {
+		FlushCopyBuffers();
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "IdoPgsqlConnection")
+			<< "Failed to flush the buffered rows: " << DiagnosticInformation(ex, false);
+	}
+
 	IncreasePendingQueries(1);
 	Query("COMMIT");
 
-	m_Pgsql->finish(m_Connection);
-	SetConnected(false);
-
-	Log(LogInformation, "IdoPgsqlConnection")
-		<< "Disconnected from '" << GetName() << "' database '" << GetDatabase() << "'.";
+	if (IsIDCacheValid()) {
+		try {
+			Dictionary::Ptr token = GetIDCacheToken();
+
+			/* Someone else wrote to the database since we've connected, our cache might be outdated. */
+			if (Convert::ToLong(token->Get("conninfo_id")) == m_ConnInfoID)
+				SaveIDCache(token);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "IdoPgsqlConnection")
+				<< "Failed to save the ID cache: " << DiagnosticInformation(ex, false);
+		}
+	}
 }
 
 void IdoPgsqlConnection::TxTimerHandler()
@@ -168,6 +211,8 @@ void IdoPgsqlConnection::InternalNewTransaction()
 	if (!GetConnected())
 		return;
 
+	FlushCopyBuffers();
+
 	IncreasePendingQueries(2);
 	Query("COMMIT");
 	Query("BEGIN");
@@ -242,6 +287,9 @@ void IdoPgsqlConnection::Reconnect()
 	/* connection */
 	m_Connection = m_Pgsql->connectdb(conninfo.CStr());
 
+	/* Prepared statements only exist for the connection they were created on. */
+	m_PreparedStatements.clear();
+
 	if (!m_Connection)
 		return;
 
@@ -337,7 +385,13 @@ void IdoPgsqlConnection::Reconnect()
 			double status_update_age = now - status_update_time;
 			double failoverTimeout = GetFailoverTimeout();
 
-			if (status_update_age < GetFailoverTimeout()) {
+			/* The other endpoint stopped writing before it handed over its objects. */
+			bool handedOver = row && status_update_time <= ApiListener::GetHandoverTime(endpoint_name);
+
+			if (status_update_age < failoverTimeout && handedOver) {
+				Log(LogInformation, "IdoPgsqlConnection")
+					<< "Endpoint '" << endpoint_name << "' handed over, not waiting for the failover timeout.";
+			} else if (status_update_age < failoverTimeout) {
 				Log(LogInformation, "IdoPgsqlConnection")
 					<< "Last update by endpoint '" << endpoint_name << "' was "
 					<< status_update_age << "s ago (< failover timeout of " << failoverTimeout << "s). Retrying.";
@@ -380,6 +434,8 @@ void IdoPgsqlConnection::Reconnect()
 	/* update programstatus table */
 	UpdateProgramStatus();
 
+	Dictionary::Ptr idCacheToken = GetIDCacheToken();
+
 	/* record connection */
 	IncreasePendingQueries(1);
 	Query("INSERT INTO " + GetTablePrefix() + "conninfo " +
@@ -387,32 +443,37 @@ void IdoPgsqlConnection::Reconnect()
 		+ Convert::ToString(static_cast<long>(m_InstanceID)) + ", NOW(), NOW(), E'icinga2 db_ido_pgsql', E'" + Escape(Application::GetAppVersion())
 		+ "', E'" + (reconnect ? "RECONNECT" : "INITIAL") + "', NOW())");
 
-	/* clear config tables for the initial config dump */
-	PrepareDatabase();
-
-	std::ostringstream q1buf;
-	q1buf << "SELECT object_id, objecttype_id, name1, name2, is_active FROM " + GetTablePrefix() + "objects WHERE instance_id = " << static_cast<long>(m_InstanceID);
-	IncreasePendingQueries(1);
-	result = Query(q1buf.str());
+	m_ConnInfoID = GetSequenceValue(GetTablePrefix() + "conninfo", "conninfo_id");
 
 	std::vector<DbObject::Ptr> activeDbObjs;
+	bool idCacheLoaded = LoadIDCache(idCacheToken, activeDbObjs);
 
-	int index = 0;
-	while ((row = FetchRow(result, index))) {
-		index++;
+	/* clear config tables for the initial config dump */
+	PrepareDatabase(!idCacheLoaded);
 
-		DbType::Ptr dbtype = DbType::GetByID(row->Get("objecttype_id"));
+	if (!idCacheLoaded) {
+		std::ostringstream q1buf;
+		q1buf << "SELECT object_id, objecttype_id, name1, name2, is_active FROM " + GetTablePrefix() + "objects WHERE instance_id = " << static_cast<long>(m_InstanceID);
+		IncreasePendingQueries(1);
+		result = Query(q1buf.str());
 
-		if (!dbtype)
-			continue;
+		int index = 0;
+		while ((row = FetchRow(result, index))) {
+			index++;
 
-		DbObject::Ptr dbobj = dbtype->GetOrCreateObjectByName(row->Get("name1"), row->Get("name2"));
-		SetObjectID(dbobj, DbReference(row->Get("object_id")));
-		bool active = row->Get("is_active");
-		SetObjectActive(dbobj, active);
+			DbType::Ptr dbtype = DbType::GetByID(row->Get("objecttype_id"));
 
-		if (active)
-			activeDbObjs.push_back(dbobj);
+			if (!dbtype)
+				continue;
+
+			DbObject::Ptr dbobj = dbtype->GetOrCreateObjectByName(row->Get("name1"), row->Get("name2"));
+			SetObjectID(dbobj, DbReference(row->Get("object_id")));
+			bool active = row->Get("is_active");
+			SetObjectActive(dbobj, active);
+
+			if (active)
+				activeDbObjs.push_back(dbobj);
+		}
 	}
 
 	SetIDCacheValid(true);
@@ -478,8 +539,13 @@ IdoPgsqlResult IdoPgsqlConnection::Query(const String& query)
 
 	IncreaseQueryCount();
 
+	static Histogram& queryTime (Histogram::GetByName("ido_pgsql_query"));
+	auto start (std::chrono::steady_clock::now());
+
 	PGresult *result = m_Pgsql->exec(m_Connection, query.CStr());
 
+	queryTime.RecordSince(start);
+
 	if (!result) {
 		String message = m_Pgsql->errorMessage(m_Connection);
 		Log(LogCritical, "IdoPgsqlConnection")
@@ -517,6 +583,296 @@ IdoPgsqlResult IdoPgsqlConnection::Query(const String& query)
 	return IdoPgsqlResult(result, std::bind(&PgsqlInterface::clear, std::cref(m_Pgsql), _1));
 }
 
+/**
+ * Executes a prepared statement, preparing it first if necessary. The
+ * statement must not return any rows.
+ *
+ * @param query The statement.
+ * @param params The values for the statement's parameters in text format.
+ */
+void IdoPgsqlConnection::ExecutePrepared(const String& query, const std::vector<String>& params)
+{
+	AssertOnWorkQueue();
+
+	Defer decreaseQueries ([this]() { DecreasePendingQueries(1); });
+
+	auto checkResult = [this, &query](PGresult *result) {
+		if (!result || m_Pgsql->resultStatus(result) != PGRES_COMMAND_OK) {
+			String message = result ? m_Pgsql->resultErrorMessage(result) : m_Pgsql->errorMessage(m_Connection);
+
+			if (result)
+				m_Pgsql->clear(result);
+
+			Log(LogCritical, "IdoPgsqlConnection")
+				<< "Error \"" << message << "\" when executing query \"" << query << "\"";
+
+			BOOST_THROW_EXCEPTION(
+				database_error()
+				<< errinfo_message(message)
+				<< errinfo_database_query(query)
+			);
+		}
+	};
+
+	auto it = m_PreparedStatements.find(query);
+
+	if (it == m_PreparedStatements.end()) {
+		if (m_PreparedStatements.size() >= l_MaxPreparedStatements) {
+			IncreasePendingQueries(1);
+			Query("DEALLOCATE ALL");
+			m_PreparedStatements.clear();
+		}
+
+		String name = "icinga_stmt_" + Convert::ToString(static_cast<long>(m_PreparedStatements.size()));
+
+		Log(LogDebug, "IdoPgsqlConnection")
+			<< "Preparing statement '" << name << "': " << query;
+
+		PGresult *result = m_Pgsql->prepare(m_Connection, name.CStr(), query.CStr(), params.size(), nullptr);
+		checkResult(result);
+		m_Pgsql->clear(result);
+
+		it = m_PreparedStatements.emplace(query, name).first;
+	}
+
+	std::vector<const char *> values;
+	values.reserve(params.size());
+
+	for (const String& param : params)
+		values.push_back(param.CStr());
+
+	IncreaseQueryCount();
+
+	PGresult *result = m_Pgsql->execPrepared(m_Connection, it->second.CStr(), values.size(), values.empty() ? nullptr : &values[0], nullptr, nullptr, 0);
+	checkResult(result);
+
+	m_AffectedRows = atoi(m_Pgsql->cmdTuples(result));
+	m_Pgsql->clear(result);
+}
+
+/**
+ * Executes an UPDATE query as a prepared statement. The fields are passed
+ * as parameters which saves escaping them and parsing the statement for
+ * every update.
+ *
+ * @param query The query.
+ * @returns false if the fields can't be converted yet, e.g. because of missing object IDs
+ */
+bool IdoPgsqlConnection::PreparedUpdate(const DbQuery& query)
+{
+	std::ostringstream qbuf;
+	std::vector<String> params;
+
+	auto addParam = [this, &qbuf, &params](const String& key, const Value& value) {
+		String raw;
+		bool timestamp, quote;
+
+		if (!FieldToRawString(key, value, &raw, &timestamp, &quote))
+			return false;
+
+		params.emplace_back(std::move(raw));
+
+		if (timestamp)
+			qbuf << key << " = TO_TIMESTAMP($" << params.size() << ") AT TIME ZONE 'UTC'";
+		else
+			qbuf << key << " = $" << params.size();
+
+		return true;
+	};
+
+	qbuf << "UPDATE " << GetTablePrefix() << query.Table << " SET ";
+
+	{
+		ObjectLock olock(query.Fields);
+
+		bool first = true;
+		for (const Dictionary::Pair& kv : query.Fields) {
+			if (kv.second.IsEmpty() && !kv.second.IsString())
+				continue;
+
+			if (!first)
+				qbuf << ", ";
+
+			if (!addParam(kv.first, kv.second))
+				return false;
+
+			first = false;
+		}
+	}
+
+	qbuf << " WHERE ";
+
+	{
+		ObjectLock olock(query.WhereCriteria);
+
+		bool first = true;
+		for (const Dictionary::Pair& kv : query.WhereCriteria) {
+			if (!first)
+				qbuf << " AND ";
+
+			if (!addParam(kv.first, kv.second))
+				return false;
+
+			first = false;
+		}
+	}
+
+	ExecutePrepared(qbuf.str(), params);
+
+	return true;
+}
+
+static void AppendCopyValue(std::string& buffer, const String& value)
+{
+	for (char ch : value) {
+		switch (ch) {
+			case '\\':
+				buffer += "\\\\";
+				break;
+			case '\t':
+				buffer += "\\t";
+				break;
+			case '\n':
+				buffer += "\\n";
+				break;
+			case '\r':
+				buffer += "\\r";
+				break;
+			case '\0':
+				break;
+			default:
+				buffer += ch;
+		}
+	}
+}
+
+/**
+ * Adds the row of an INSERT query to the COPY buffer for its table.
+ *
+ * @param query The query.
+ * @returns false if the fields can't be converted yet, e.g. because of missing object IDs
+ */
+bool IdoPgsqlConnection::AddRowToCopyBuffer(const DbQuery& query)
+{
+	std::vector<String> columns;
+	std::string row;
+
+	{
+		ObjectLock olock(query.Fields);
+
+		for (const Dictionary::Pair& kv : query.Fields) {
+			if (kv.second.IsEmpty() && !kv.second.IsString())
+				continue;
+
+			String raw;
+			bool timestamp, quote;
+
+			if (!FieldToRawString(kv.first, kv.second, &raw, &timestamp, &quote))
+				return false;
+
+			if (!columns.empty())
+				row += '\t';
+
+			/* Same as TO_TIMESTAMP(...) AT TIME ZONE 'UTC' */
+			if (timestamp)
+				raw = boost::posix_time::to_iso_extended_string(boost::posix_time::from_time_t(Convert::ToLong(raw)));
+
+			AppendCopyValue(row, raw);
+			columns.push_back(kv.first);
+		}
+	}
+
+	row += '\n';
+
+	IdoPgsqlCopyBuffer& buffer = m_CopyBuffers[query.Table + ":" + boost::algorithm::join(columns, ",")];
+
+	if (buffer.Table.IsEmpty()) {
+		buffer.Table = query.Table;
+		buffer.Columns = std::move(columns);
+	}
+
+	buffer.Data += row;
+	buffer.Rows++;
+
+	m_CopyBufferSize += row.size();
+
+	if (m_CopyBufferSize >= l_CopyBufferLimit)
+		FlushCopyBuffers();
+
+	return true;
+}
+
+/**
+ * Sends the buffered rows using one COPY statement per table.
+ */
+void IdoPgsqlConnection::FlushCopyBuffers()
+{
+	AssertOnWorkQueue();
+
+	std::map<String, IdoPgsqlCopyBuffer> buffers;
+	buffers.swap(m_CopyBuffers);
+	m_CopyBufferSize = 0;
+
+	auto it = buffers.begin();
+
+	/* The rows are lost if something goes wrong, don't list them as pending anymore. */
+	Defer decreaseQueries ([this, &it, &buffers]() {
+		for (; it != buffers.end(); ++it)
+			DecreasePendingQueries(it->second.Rows);
+	});
+
+	for (; it != buffers.end(); ++it) {
+		const IdoPgsqlCopyBuffer& buffer = it->second;
+
+		String query = "COPY " + GetTablePrefix() + buffer.Table + " (" + boost::algorithm::join(buffer.Columns, ", ") + ") FROM STDIN";
+
+		Log(LogDebug, "IdoPgsqlConnection")
+			<< "Query: " << query << " (" << buffer.Rows << " rows)";
+
+		IncreaseQueryCount();
+
+		auto fail = [this, &query](PGresult *result) {
+			String message = result ? m_Pgsql->resultErrorMessage(result) : m_Pgsql->errorMessage(m_Connection);
+
+			if (result)
+				m_Pgsql->clear(result);
+
+			Log(LogCritical, "IdoPgsqlConnection")
+				<< "Error \"" << message << "\" when executing query \"" << query << "\"";
+
+			BOOST_THROW_EXCEPTION(
+				database_error()
+				<< errinfo_message(message)
+				<< errinfo_database_query(query)
+			);
+		};
+
+		PGresult *result = m_Pgsql->exec(m_Connection, query.CStr());
+
+		if (!result || m_Pgsql->resultStatus(result) != PGRES_COPY_IN)
+			fail(result);
+
+		m_Pgsql->clear(result);
+
+		if (m_Pgsql->putCopyData(m_Connection, buffer.Data.c_str(), buffer.Data.size()) != 1 ||
+			m_Pgsql->putCopyEnd(m_Connection, nullptr) != 1)
+			fail(nullptr);
+
+		result = m_Pgsql->getResult(m_Connection);
+
+		if (!result || m_Pgsql->resultStatus(result) != PGRES_COMMAND_OK)
+			fail(result);
+
+		m_Pgsql->clear(result);
+
+		/* The connection is ready for the next query once there are no more results. */
+		while ((result = m_Pgsql->getResult(m_Connection)))
+			m_Pgsql->clear(result);
+
+		DecreasePendingQueries(buffer.Rows);
+	}
+}
+
 DbReference IdoPgsqlConnection::GetSequenceValue(const String& table, const String& column)
 {
 	AssertOnWorkQueue();
@@ -534,6 +890,32 @@ DbReference IdoPgsqlConnection::GetSequenceValue(const String& table, const Stri
 	return {Convert::ToLong(row->Get("id"))};
 }
 
+/**
+ * Describes the database's state for the ID cache. Any other connection since
+ * ours adds a conninfo row, manual changes most likely change the objects.
+ */
+Dictionary::Ptr IdoPgsqlConnection::GetIDCacheToken()
+{
+	AssertOnWorkQueue();
+
+	String instanceID = Convert::ToString(static_cast<long>(m_InstanceID));
+
+	IncreasePendingQueries(1);
+	IdoPgsqlResult result = Query("SELECT MAX(conninfo_id) AS conninfo_id FROM " + GetTablePrefix() + "conninfo WHERE instance_id = " + instanceID);
+	Dictionary::Ptr conninfo = FetchRow(result, 0);
+
+	IncreasePendingQueries(1);
+	result = Query("SELECT COUNT(*) AS count, MAX(object_id) AS max_object_id FROM " + GetTablePrefix() + "objects WHERE instance_id = " + instanceID);
+	Dictionary::Ptr objects = FetchRow(result, 0);
+
+	return new Dictionary({
+		{ "instance_id", instanceID },
+		{ "conninfo_id", conninfo ? conninfo->Get("conninfo_id") : Empty },
+		{ "objects", objects ? objects->Get("count") : Empty },
+		{ "max_object_id", objects ? objects->Get("max_object_id") : Empty }
+	});
+}
+
 int IdoPgsqlConnection::GetAffectedRows()
 {
 	AssertOnWorkQueue();
@@ -650,13 +1032,27 @@ void IdoPgsqlConnection::InternalDeactivateObject(const DbObject::Ptr& dbobj)
 	 * because the object is still in the database. */
 }
 
-bool IdoPgsqlConnection::FieldToEscapedString(const String& key, const Value& value, Value *result)
+/**
+ * Converts a field into its plain text representation, e.g. for COPY
+ * statements and the parameters of prepared statements.
+ *
+ * @param key The column's name.
+ * @param value The field's value.
+ * @param result Receives the text.
+ * @param timestamp Receives whether the text is a UNIX timestamp.
+ * @param quote Receives whether the text is a string which has to be quoted in SQL statements.
+ * @returns false if an object ID or insert ID isn't available yet
+ */
+bool IdoPgsqlConnection::FieldToRawString(const String& key, const Value& value, String *result, bool *timestamp, bool *quote)
 {
+	*timestamp = false;
+	*quote = false;
+
 	if (key == "instance_id") {
-		*result = static_cast<long>(m_InstanceID);
+		*result = Convert::ToString(static_cast<long>(m_InstanceID));
 		return true;
 	} else if (key == "session_token") {
-		*result = GetSessionToken();
+		*result = Convert::ToString(GetSessionToken());
 		return true;
 	}
 
@@ -666,7 +1062,7 @@ bool IdoPgsqlConnection::FieldToEscapedString(const String& key, const Value& va
 		DbObject::Ptr dbobjcol = DbObject::GetOrCreateByObject(rawvalue);
 
 		if (!dbobjcol) {
-			*result = 0;
+			*result = "0";
 			return true;
 		}
 
@@ -693,20 +1089,18 @@ bool IdoPgsqlConnection::FieldToEscapedString(const String& key, const Value& va
 			}
 		}
 
-		*result = static_cast<long>(dbrefcol);
+		*result = Convert::ToString(static_cast<long>(dbrefcol));
 	} else if (DbValue::IsTimestamp(value)) {
 		long ts = rawvalue;
-		std::ostringstream msgbuf;
-		msgbuf << "TO_TIMESTAMP(" << ts << ") AT TIME ZONE 'UTC'";
-		*result = Value(msgbuf.str());
+		*result = Convert::ToString(ts);
+		*timestamp = true;
 	} else if (DbValue::IsObjectInsertID(value)) {
 		auto id = static_cast<long>(rawvalue);
 
 		if (id <= 0)
 			return false;
 
-		*result = id;
-		return true;
+		*result = Convert::ToString(id);
 	} else {
 		Value fvalue;
 
@@ -715,12 +1109,31 @@ bool IdoPgsqlConnection::FieldToEscapedString(const String& key, const Value& va
 		else
 			fvalue = rawvalue;
 
-		*result = "E'" + Escape(fvalue) + "'";
+		*result = Utility::ValidateUTF8(fvalue);
+		*quote = true;
 	}
 
 	return true;
 }
 
+bool IdoPgsqlConnection::FieldToEscapedString(const String& key, const Value& value, Value *result)
+{
+	String raw;
+	bool timestamp, quote;
+
+	if (!FieldToRawString(key, value, &raw, &timestamp, &quote))
+		return false;
+
+	if (timestamp)
+		*result = "TO_TIMESTAMP(" + raw + ") AT TIME ZONE 'UTC'";
+	else if (quote)
+		*result = "E'" + Escape(raw) + "'";
+	else
+		*result = raw;
+
+	return true;
+}
+
 void IdoPgsqlConnection::ExecuteQuery(const DbQuery& query)
 {
 	if (IsPaused())
@@ -869,6 +1282,15 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 
 	type = (typeOverride != -1) ? typeOverride : query.Type;
 
+	/* History rows are sent in bulk, see FlushCopyBuffers(). */
+	if (type == DbQueryInsert && !query.ConfigUpdate && !query.StatusUpdate && !query.NotificationInsertID &&
+		l_CopyTables.find(query.Table) != l_CopyTables.end()) {
+		if (!AddRowToCopyBuffer(query))
+			m_QueryQueue.Enqueue(std::bind(&IdoPgsqlConnection::InternalExecuteQuery, this, query, -1), query.Priority);
+
+		return;
+	}
+
 	bool upsert = false;
 
 	if ((type & DbQueryInsert) && (type & DbQueryUpdate)) {
@@ -896,6 +1318,23 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 		type = DbQueryInsert;
 	}
 
+	if (type == DbQueryUpdate && query.WhereCriteria) {
+		if (query.Fields->GetLength() == 0)
+			return;
+
+		if (!PreparedUpdate(query)) {
+			m_QueryQueue.Enqueue(std::bind(&IdoPgsqlConnection::InternalExecuteQuery, this, query, -1), query.Priority);
+			return;
+		}
+
+		if (upsert && GetAffectedRows() == 0) {
+			IncreasePendingQueries(1);
+			InternalExecuteQuery(query, DbQueryDelete | DbQueryInsert);
+		}
+
+		return;
+	}
+
 	switch (type) {
 		case DbQueryInsert:
 			qbuf << "INSERT INTO " << GetTablePrefix() << query.Table;
@@ -964,6 +1403,14 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 		return;
 	}
 
+	/* Keeps the ID cache up to date for SaveIDCache(). */
+	if (query.ConfigUpdate && query.Object && query.Fields && (type & (DbQueryInsert | DbQueryUpdate))) {
+		Value configHash;
+
+		if (query.Fields->Get("config_hash", &configHash))
+			SetConfigHash(query.Object, configHash);
+	}
+
 	if (type == DbQueryInsert && query.Object) {
 		if (query.ConfigUpdate) {
 			String idField = query.IdColumn;
@@ -984,43 +1431,179 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 	}
 }
 
-void IdoPgsqlConnection::CleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
+void IdoPgsqlConnection::CleanUpExecuteQuery(const String& table, const String& id_column, const String& time_column, double max_age)
 {
 	if (IsPaused())
 		return;
 
 	IncreasePendingQueries(1);
-	m_QueryQueue.Enqueue(std::bind(&IdoPgsqlConnection::InternalCleanUpExecuteQuery, this, table, time_column, max_age), PriorityLow, true);
+	m_QueryQueue.Enqueue(std::bind(&IdoPgsqlConnection::InternalCleanUpExecuteQuery, this, table, id_column, time_column, max_age, -1, 0), PriorityLow, true);
 }
 
-void IdoPgsqlConnection::InternalCleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
+/**
+ * Deletes the rows older than max_age from a history table by primary key
+ * range, one batch per query queue task. See the MySQL implementation.
+ *
+ * @param table The table without prefix
+ * @param id_column The table's primary key
+ * @param time_column The timestamp the row's age is determined by
+ * @param max_age Rows older than this UNIX timestamp are deleted
+ * @param fromId Where the batch starts, -1 for the first row
+ * @param batch The number of batches done during this cleanup run
+ */
+void IdoPgsqlConnection::InternalCleanUpExecuteQuery(const String& table, const String& id_column, const String& time_column,
+	double max_age, long fromId, int batch)
 {
 	AssertOnWorkQueue();
 
-	if (!GetConnected()) {
-		DecreasePendingQueries(1);
+	/* The queries below are accounted for on their own. */
+	DecreasePendingQueries(1);
+
+	if (batch == 0) {
+		/* The previous run is still going on. */
+		if (!m_CleanUpsInProgress.insert(table).second)
+			return;
+	}
+
+	bool done = true;
+	Defer finish ([this, &table, &done]() {
+		if (done)
+			m_CleanUpsInProgress.erase(table);
+	});
+
+	if (!GetConnected())
+		return;
+
+	String instanceID = Convert::ToString(static_cast<long>(m_InstanceID));
+	String cutoff = "TO_TIMESTAMP(" + Convert::ToString(static_cast<long>(max_age)) + ") AT TIME ZONE 'UTC'";
+	long batchSize = GetCleanupBatchSize();
+
+	if (batch == 0 && GetEnablePartitionedCleanup() && CleanUpPartitions(table, time_column, max_age))
+		return;
+
+	if (batchSize <= 0) {
+		IncreasePendingQueries(1);
+		Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " + instanceID +
+			" AND " + time_column + " < " + cutoff);
 		return;
 	}
 
-	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
-		Convert::ToString(static_cast<long>(m_InstanceID)) + " AND " + time_column +
-		" < TO_TIMESTAMP(" + Convert::ToString(static_cast<long>(max_age)) + ") AT TIME ZONE 'UTC'");
+	IncreasePendingQueries(1);
+	IdoPgsqlResult result = Query("SELECT " + id_column + " AS id, EXTRACT(EPOCH FROM " + time_column + ") AS ts FROM " +
+		GetTablePrefix() + table + " WHERE instance_id = " + instanceID +
+		(fromId >= 0 ? " AND " + id_column + " >= " + Convert::ToString(fromId) : "") +
+		" ORDER BY " + id_column + " LIMIT 1");
+
+	Dictionary::Ptr row = FetchRow(result, 0);
+
+	if (!row)
+		return;
+
+	/* Rows without a timestamp are never deleted, but mustn't stop the cleanup either. */
+	Value ts = row->Get("ts");
+
+	if (!ts.IsEmpty() && Convert::ToDouble(ts) >= max_age)
+		return;
+
+	long firstId = Convert::ToLong(row->Get("id"));
+
+	IncreasePendingQueries(1);
+	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " + instanceID +
+		" AND " + id_column + " >= " + Convert::ToString(firstId) +
+		" AND " + id_column + " < " + Convert::ToString(firstId + batchSize) +
+		" AND " + time_column + " < " + cutoff);
+
+	if (++batch >= l_MaxCleanUpBatches)
+		return;
+
+	done = false;
+
+	IncreasePendingQueries(1);
+	m_QueryQueue.Enqueue(std::bind(&IdoPgsqlConnection::InternalCleanUpExecuteQuery, this, table, id_column, time_column,
+		max_age, firstId + batchSize, batch), PriorityLow, true);
 }
 
-void IdoPgsqlConnection::FillIDCache(const DbType::Ptr& type)
+/**
+ * Drops the partitions of a history table which only contain rows older than
+ * max_age. The table has to be partitioned by RANGE (time_column).
+ *
+ * @param table The table without prefix
+ * @param time_column The timestamp the row's age is determined by
+ * @param max_age Rows older than this UNIX timestamp are deleted
+ * @returns false if the table isn't partitioned and has to be cleaned up row by row
+ */
+bool IdoPgsqlConnection::CleanUpPartitions(const String& table, const String& time_column, double max_age)
 {
-	String query = "SELECT " + type->GetIDColumn() + " AS object_id, " + type->GetTable() + "_id, config_hash FROM " + GetTablePrefix() + type->GetTable() + "s";
+	/* The upper bound is exclusive, the last partition's one may be MAXVALUE (NULL here). */
 	IncreasePendingQueries(1);
-	IdoPgsqlResult result = Query(query);
+	IdoPgsqlResult result = Query("SELECT c.relname AS name, "
+		"(substring(pg_get_expr(c.relpartbound, c.oid) FROM 'TO \\(''([^'']*)''\\)')::timestamp <= "
+		"TO_TIMESTAMP(" + Convert::ToString(static_cast<long>(max_age)) + ") AT TIME ZONE 'UTC') AS expired "
+		"FROM pg_inherits i JOIN pg_class c ON c.oid = i.inhrelid JOIN pg_class p ON p.oid = i.inhparent "
+		"WHERE p.relname = '" + Escape(GetTablePrefix() + table) + "' AND p.relkind = 'p'");
 
 	Dictionary::Ptr row;
-
+	std::vector<String> expired;
 	int index = 0;
+
+	while ((row = FetchRow(result, index))) {
+		index++;
+
+		if (row->Get("expired") == "t")
+			expired.emplace_back(row->Get("name"));
+	}
+
+	if (index == 0)
+		return false;
+
+	for (auto& partition : expired) {
+		Log(LogInformation, "IdoPgsqlConnection")
+			<< "Dropping expired partition '" << partition << "' of table '" << GetTablePrefix() << table << "'.";
+
+		IncreasePendingQueries(1);
+		Query("DROP TABLE \"" + partition + "\"");
+	}
+
+	return true;
+}
+
+void IdoPgsqlConnection::FillIDCache(const DbType::Ptr& type, bool insertIDs)
+{
+	String query;
+	IdoPgsqlResult result;
+	Dictionary::Ptr row;
+	int index;
+
+	if (insertIDs) {
+		query = "SELECT " + type->GetIDColumn() + " AS object_id, " + type->GetTable() + "_id, config_hash FROM " + GetTablePrefix() + type->GetTable() + "s";
+		IncreasePendingQueries(1);
+		result = Query(query);
+
+		index = 0;
+		while ((row = FetchRow(result, index))) {
+			index++;
+			DbReference dbref(row->Get("object_id"));
+			SetInsertID(type, dbref, DbReference(row->Get(type->GetTable() + "_id")));
+			SetConfigHash(type, dbref, row->Get("config_hash"));
+		}
+	}
+
+	/* Hosts and services make up most of the status rows, remember when they were
+	 * written so that a reconnect only has to send the ones which are outdated. */
+	if (type->GetTable() != "host" && type->GetTable() != "service")
+		return;
+
+	query = "SELECT " + type->GetIDColumn() + " AS object_id, UNIX_TIMESTAMP(status_update_time) AS status_update_time FROM " + GetTablePrefix() + type->GetTable() + "status";
+	IncreasePendingQueries(1);
+	result = Query(query);
+
+	index = 0;
 	while ((row = FetchRow(result, index))) {
 		index++;
-		DbReference dbref(row->Get("object_id"));
-		SetInsertID(type, dbref, DbReference(row->Get(type->GetTable() + "_id")));
-		SetConfigHash(type, dbref, row->Get("config_hash"));
+		Value version = row->Get("status_update_time");
+
+		if (!version.IsEmpty())
+			SetStatusVersion(type, DbReference(row->Get("object_id")), version);
 	}
 }
 
@@ -9,12 +9,26 @@
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
 #include "base/library.hpp"
+#include <map>
 
 namespace icinga
 {
 
 typedef std::shared_ptr<PGresult> IdoPgsqlResult;
 
+/**
+ * Rows for a history table which are sent with a single COPY statement.
+ *
+ * @ingroup ido
+ */
+struct IdoPgsqlCopyBuffer
+{
+	String Table;
+	std::vector<String> Columns;
+	std::string Data;
+	size_t Rows{0};
+};
+
 /**
  * An IDO pgSQL database connection.
  *
@@ -41,12 +55,13 @@ protected:
 	void DeactivateObject(const DbObject::Ptr& dbobj) override;
 	void ExecuteQuery(const DbQuery& query) override;
 	void ExecuteMultipleQueries(const std::vector<DbQuery>& queries) override;
-	void CleanUpExecuteQuery(const String& table, const String& time_key, double time_value) override;
-	void FillIDCache(const DbType::Ptr& type) override;
+	void CleanUpExecuteQuery(const String& table, const String& id_column, const String& time_column, double max_age) override;
+	void FillIDCache(const DbType::Ptr& type, bool insertIDs) override;
 	void NewTransaction() override;
 
 private:
 	DbReference m_InstanceID;
+	long m_ConnInfoID{-1};
 
 	Library m_Library;
 	std::unique_ptr<PgsqlInterface, PgsqlInterfaceDeleter> m_Pgsql;
@@ -54,16 +69,28 @@ private:
 	PGconn *m_Connection;
 	int m_AffectedRows;
 
+	std::map<String, IdoPgsqlCopyBuffer> m_CopyBuffers;
+	size_t m_CopyBufferSize{0};
+
+	std::map<String, String> m_PreparedStatements;
+
 	Timer::Ptr m_ReconnectTimer;
 	Timer::Ptr m_TxTimer;
 
 	IdoPgsqlResult Query(const String& query);
+	void ExecutePrepared(const String& query, const std::vector<String>& params);
 	DbReference GetSequenceValue(const String& table, const String& column);
+	Dictionary::Ptr GetIDCacheToken();
 	int GetAffectedRows();
 	String Escape(const String& s);
 	Dictionary::Ptr FetchRow(const IdoPgsqlResult& result, int row);
 
 	bool FieldToEscapedString(const String& key, const Value& value, Value *result);
+	bool FieldToRawString(const String& key, const Value& value, String *result, bool *timestamp, bool *quote);
+
+	bool AddRowToCopyBuffer(const DbQuery& query);
+	void FlushCopyBuffers();
+	bool PreparedUpdate(const DbQuery& query);
 	void InternalActivateObject(const DbObject::Ptr& dbobj);
 	void InternalDeactivateObject(const DbObject::Ptr& dbobj);
 
@@ -82,7 +109,9 @@ private:
 
 	void InternalExecuteQuery(const DbQuery& query, int typeOverride = -1);
 	void InternalExecuteMultipleQueries(const std::vector<DbQuery>& queries);
-	void InternalCleanUpExecuteQuery(const String& table, const String& time_key, double time_value);
+	void InternalCleanUpExecuteQuery(const String& table, const String& id_column, const String& time_column, double max_age,
+		long fromId = -1, int batch = 0);
+	bool CleanUpPartitions(const String& table, const String& time_column, double max_age);
 
 	void ClearTableBySession(const String& table);
 	void ClearTablesBySession();
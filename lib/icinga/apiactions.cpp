@@ -20,6 +20,7 @@
 #include "base/defer.hpp"
 #include "remote/actionshandler.hpp"
 #include <fstream>
+#include <vector>
 
 using namespace icinga;
 
@@ -401,18 +402,21 @@ Dictionary::Ptr ApiActions::ScheduleDowntime(const ConfigObject::Ptr& object,
 		allServices = HttpUtility::GetLastParameter(params, "all_services");
 
 	if (allServices && !service) {
-		ArrayData serviceDowntimes;
+		std::vector<Checkable::Ptr> services;
 
 		for (const Service::Ptr& hostService : host->GetServices()) {
 			Log(LogNotice, "ApiActions")
 				<< "Creating downtime for service " << hostService->GetName() << " on host " << host->GetName();
 
-			Downtime::Ptr serviceDowntime = Downtime::AddDowntime(hostService, author, comment, startTime, endTime,
-				fixed, triggerName, duration);
-			String serviceDowntimeName = serviceDowntime->GetName();
+			services.emplace_back(hostService);
+		}
 
+		ArrayData serviceDowntimes;
+
+		for (const Downtime::Ptr& serviceDowntime : Downtime::AddDowntimes(services, author, comment, startTime, endTime,
+			fixed, triggerName, duration)) {
 			serviceDowntimes.push_back(new Dictionary({
-				{ "name", serviceDowntimeName },
+				{ "name", serviceDowntime->GetName() },
 				{ "legacy_id", serviceDowntime->GetLegacyId() }
 			}));
 		}
@@ -431,14 +435,51 @@ Dictionary::Ptr ApiActions::ScheduleDowntime(const ConfigObject::Ptr& object,
 		Log(LogNotice, "ApiActions")
 			<< "Processing child options " << childOptions << " for downtime " << downtimeName;
 
-		ArrayData childDowntimes;
+		std::vector<Checkable::Ptr> children;
 
 		for (const Checkable::Ptr& child : checkable->GetAllChildren()) {
 			Log(LogNotice, "ApiActions")
 				<< "Scheduling downtime for child object " << child->GetName();
 
-			Downtime::Ptr childDowntime = Downtime::AddDowntime(child, author, comment, startTime, endTime,
-				fixed, triggerName, duration);
+			children.emplace_back(child);
+		}
+
+		/* The downtimes of all children and, if requested, of the services of all child hosts are created in two batches. */
+		std::vector<Downtime::Ptr> childDowntimeObjects = Downtime::AddDowntimes(children, author, comment, startTime, endTime,
+			fixed, triggerName, duration);
+		std::vector<Checkable::Ptr> childServices;
+		/* How many of the service downtimes belong to each child, -1 if it isn't a host whose services are scheduled. */
+		std::vector<ssize_t> childServiceCounts;
+
+		for (const Checkable::Ptr& child : children) {
+			Host::Ptr childHost;
+			Service::Ptr childService;
+			tie(childHost, childService) = GetHostService(child);
+
+			if (allServices && !childService) {
+				size_t count = childServices.size();
+
+				for (const Service::Ptr& hostService : host->GetServices()) {
+					Log(LogNotice, "ApiActions")
+						<< "Creating downtime for service " << hostService->GetName() << " on child host " << host->GetName();
+
+					childServices.emplace_back(hostService);
+				}
+
+				childServiceCounts.push_back(childServices.size() - count);
+			} else {
+				childServiceCounts.push_back(-1);
+			}
+		}
+
+		std::vector<Downtime::Ptr> childServiceDowntimeObjects = Downtime::AddDowntimes(childServices, author, comment,
+			startTime, endTime, fixed, triggerName, duration);
+		auto nextServiceDowntime (childServiceDowntimeObjects.begin());
+
+		ArrayData childDowntimes;
+
+		for (size_t i = 0; i < children.size(); i++) {
+			const Downtime::Ptr& childDowntime = childDowntimeObjects[i];
 			String childDowntimeName = childDowntime->GetName();
 
 			Log(LogNotice, "ApiActions")
@@ -450,23 +491,14 @@ Dictionary::Ptr ApiActions::ScheduleDowntime(const ConfigObject::Ptr& object,
 			});
 
 			/* For a host, also schedule all service downtimes if requested. */
-			Host::Ptr childHost;
-			Service::Ptr childService;
-			tie(childHost, childService) = GetHostService(child);
-
-			if (allServices && !childService) {
+			if (childServiceCounts[i] >= 0) {
 				ArrayData childServiceDowntimes;
 
-				for (const Service::Ptr& hostService : host->GetServices()) {
-					Log(LogNotice, "ApiActions")
-						<< "Creating downtime for service " << hostService->GetName() << " on child host " << host->GetName();
-
-					Downtime::Ptr serviceDowntime = Downtime::AddDowntime(hostService, author, comment, startTime, endTime,
-						fixed, triggerName, duration);
-					String serviceDowntimeName = serviceDowntime->GetName();
+				for (ssize_t j = 0; j < childServiceCounts[i]; j++, ++nextServiceDowntime) {
+					const Downtime::Ptr& serviceDowntime = *nextServiceDowntime;
 
 					childServiceDowntimes.push_back(new Dictionary({
-						{ "name", serviceDowntimeName },
+						{ "name", serviceDowntime->GetName() },
 						{ "legacy_id", serviceDowntime->GetLegacyId() }
 					}));
 				}
@@ -56,7 +56,7 @@ void ApiEvents::CheckResultHandler(const Checkable::Ptr& checkable, const CheckR
 	if (service)
 		result->Set("service", service->GetShortName());
 
-	result->Set("check_result", Serialize(cr));
+	result->Set("check_result", cr->GetSerialized());
 
 	result->Set("downtime_depth", checkable->GetDowntimeDepth());
 	result->Set("acknowledgement", checkable->IsAcknowledged());
@@ -92,7 +92,7 @@ void ApiEvents::StateChangeHandler(const Checkable::Ptr& checkable, const CheckR
 
 	result->Set("state", service ? static_cast<int>(service->GetState()) : static_cast<int>(host->GetState()));
 	result->Set("state_type", checkable->GetStateType());
-	result->Set("check_result", Serialize(cr));
+	result->Set("check_result", cr ? cr->GetSerialized() : nullptr);
 
 	result->Set("downtime_depth", checkable->GetDowntimeDepth());
 	result->Set("acknowledgement", checkable->IsAcknowledged());
@@ -143,7 +143,7 @@ void ApiEvents::NotificationSentToAllUsersHandler(const Notification::Ptr& notif
 	result->Set("notification_type", Notification::NotificationTypeToStringCompat(type)); //TODO: Change this to our own types.
 	result->Set("author", author);
 	result->Set("text", text);
-	result->Set("check_result", Serialize(cr));
+	result->Set("check_result", cr ? cr->GetSerialized() : nullptr);
 
 	for (const EventQueue::Ptr& queue : queues) {
 		queue->ProcessEvent(result);
@@ -14,14 +14,20 @@
 #include "base/convert.hpp"
 #include "base/utility.hpp"
 #include "base/context.hpp"
+#include "base/defer.hpp"
+#include "base/histogram.hpp"
+#include "base/metric.hpp"
+#include "base/tracing.hpp"
+#include <algorithm>
+#include <memory>
 
 using namespace icinga;
 
-boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&)> Checkable::OnNewCheckResult;
-boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&)> Checkable::OnStateChange;
-boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, std::set<Checkable::Ptr>, const MessageOrigin::Ptr&)> Checkable::OnReachabilityChanged;
-boost::signals2::signal<void (const Checkable::Ptr&, NotificationType, const CheckResult::Ptr&, const String&, const String&, const MessageOrigin::Ptr&)> Checkable::OnNotificationsRequested;
-boost::signals2::signal<void (const Checkable::Ptr&)> Checkable::OnNextCheckUpdated;
+EventBus<void (const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&)> Checkable::OnNewCheckResult;
+EventBus<void (const Checkable::Ptr&, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&)> Checkable::OnStateChange;
+EventBus<void (const Checkable::Ptr&, const CheckResult::Ptr&, std::set<Checkable::Ptr>, const MessageOrigin::Ptr&)> Checkable::OnReachabilityChanged;
+EventBus<void (const Checkable::Ptr&, NotificationType, const CheckResult::Ptr&, const String&, const String&, const MessageOrigin::Ptr&)> Checkable::OnNotificationsRequested;
+EventBus<void (const Checkable::Ptr&)> Checkable::OnNextCheckUpdated;
 
 Atomic<uint_fast64_t> Checkable::CurrentConcurrentChecks (0);
 
@@ -29,6 +35,8 @@ std::mutex Checkable::m_StatsMutex;
 int Checkable::m_PendingChecks = 0;
 std::condition_variable Checkable::m_PendingChecksCV;
 
+static MetricGauge& l_PendingChecksMetric (MetricGauge::GetByName("checks_pending"));
+
 CheckCommand::Ptr Checkable::GetCheckCommand() const
 {
 	return dynamic_pointer_cast<CheckCommand>(NavigateCheckCommandRaw());
@@ -70,10 +78,12 @@ void Checkable::UpdateNextCheck(const MessageOrigin::Ptr& origin)
 	double nextCheck = now - adj + interval;
 	double lastCheck = GetLastCheck();
 
-	Log(LogDebug, "Checkable")
-		<< "Update checkable '" << GetName() << "' with check interval '" << GetCheckInterval()
-		<< "' from last check time at " << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", (lastCheck < 0 ? 0 : lastCheck))
-		<< " (" << GetLastCheck() << ") to next check time at " << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", nextCheck) << " (" << nextCheck << ").";
+	if (LogDebug >= Logger::GetMinLogSeverity()) {
+		Log(LogDebug, "Checkable")
+			<< "Update checkable '" << GetName() << "' with check interval '" << GetCheckInterval()
+			<< "' from last check time at " << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", (lastCheck < 0 ? 0 : lastCheck))
+			<< " (" << GetLastCheck() << ") to next check time at " << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", nextCheck) << " (" << nextCheck << ").";
+	}
 
 	SetNextCheck(nextCheck, false, origin);
 }
@@ -96,6 +106,12 @@ double Checkable::GetLastCheck() const
 
 void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrigin::Ptr& origin)
 {
+	static Histogram& processCheckResultTime (Histogram::GetByName("checkable_process_check_result"));
+	static Histogram& checkLatency (Histogram::GetByName("check_latency"));
+	static Histogram& checkExecutionTime (Histogram::GetByName("check_execution_time"));
+
+	HistogramTimer processCheckResultTimer (processCheckResultTime);
+
 	{
 		ObjectLock olock(this);
 		m_CheckRunning = false;
@@ -118,6 +134,25 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 	if (cr->GetExecutionEnd() == 0)
 		cr->SetExecutionEnd(now);
 
+	std::unique_ptr<Defer> emitSpans;
+
+	if (cr->GetTraceContext().IsValid()) {
+		emitSpans.reset(new Defer([this, &cr, &origin, now]() {
+			const TraceContext& trace (cr->GetTraceContext());
+			double end = Utility::GetTime();
+			Dictionary::Ptr attributes = new Dictionary({ { "icinga.checkable", GetName() } });
+
+			Tracing::EmitChildSpan(trace, "process_check_result", now, end, attributes);
+
+			/* The stages before only happened on the node which executed the check. */
+			if (!origin || origin->IsLocal()) {
+				Tracing::EmitChildSpan(trace, "checker", cr->GetScheduleStart(), cr->GetExecutionStart(), attributes);
+				Tracing::EmitChildSpan(trace, "execute", cr->GetExecutionStart(), cr->GetExecutionEnd(), attributes);
+				Tracing::EmitSpan(trace, String(), "check", cr->GetScheduleStart(), end, attributes);
+			}
+		}));
+	}
+
 	Endpoint::Ptr command_endpoint = GetCommandEndpoint();
 
 	if (cr->GetCheckSource().IsEmpty()) {
@@ -136,7 +171,8 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 		if (listener) {
 			/* send message back to its origin */
 			Dictionary::Ptr message = ClusterEvents::MakeCheckResultMessage(this, cr);
-			listener->SyncSendMessage(command_endpoint, message);
+			ClusterEvents::SendCheckMessage(command_endpoint, message);
+			ClusterEvents::LocalScheduledCheckFinished(command_endpoint, message);
 		}
 
 		return;
@@ -146,6 +182,11 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 	if (!IsActive())
 		return;
 
+	if (cr->GetActive()) {
+		checkLatency.Record(cr->CalculateLatency());
+		checkExecutionTime.Record(cr->CalculateExecutionTime());
+	}
+
 	bool reachable = IsReachable();
 	bool notification_reachable = IsReachable(DependencyNotification);
 
@@ -274,6 +315,13 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 	else
 		stateChange = (Host::CalculateState(old_state) != Host::CalculateState(new_state));
 
+	{
+		double stateHistoryRetention = GetStateHistoryRetention();
+
+		if (stateHistoryRetention > 0)
+			m_StateHistory.Add(cr->GetExecutionEnd(), new_state, GetStateType(), reachable, stateHistoryRetention);
+	}
+
 	/* Store the current last state change for the next iteration. */
 	SetPreviousStateChange(GetLastStateChange());
 
@@ -441,7 +489,7 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 
 	if (GetStateType() == StateTypeSoft || hardChange || recovery ||
 		(is_volatile && !(IsStateOK(old_state) && IsStateOK(new_state))))
-		ExecuteEventHandler();
+		QueueEventHandler();
 
 	int suppressed_types = 0;
 
@@ -566,8 +614,29 @@ void Checkable::ExecuteCheck()
 	bool local = !endpoint || endpoint == Endpoint::GetLocalEndpoint();
 
 	if (local) {
+		cr->SetTraceContext(Tracing::StartTrace());
 		GetCheckCommand()->Execute(this, cr, nullptr, false);
 	} else {
+		double scheduledSince;
+
+		/* The endpoint runs the check itself, just make sure it does. */
+		if (ClusterEvents::IsCheckScheduledByAgent(this, endpoint, scheduledSince)) {
+			double lastResult = std::max(GetLastCheck(), scheduledSince);
+
+			if (lastResult < Utility::GetTime() - 2 * GetCheckInterval() - 60) {
+				cr->SetState(ServiceUnknown);
+				cr->SetOutput("Remote Icinga instance '" + endpoint->GetName() + "' schedules this check, but hasn't sent a check result for "
+					+ Utility::FormatDuration(Utility::GetTime() - lastResult) + ".");
+
+				ProcessCheckResult(cr);
+			}
+
+			ObjectLock olock(this);
+			m_CheckRunning = false;
+
+			return;
+		}
+
 		Dictionary::Ptr macros = new Dictionary();
 		GetCheckCommand()->Execute(this, cr, macros, false);
 
@@ -599,10 +668,7 @@ void Checkable::ExecuteCheck()
 
 			params->Set("macros", macros);
 
-			ApiListener::Ptr listener = ApiListener::GetInstance();
-
-			if (listener)
-				listener->SyncSendMessage(endpoint, message);
+			ClusterEvents::SendCheckMessage(endpoint, message);
 
 			/* Re-schedule the check so we don't run it again until after we've received
 			 * a check result from the remote instance. The check will be re-scheduled
@@ -663,12 +729,14 @@ void Checkable::IncreasePendingChecks()
 {
 	std::unique_lock<std::mutex> lock(m_StatsMutex);
 	m_PendingChecks++;
+	l_PendingChecksMetric.Set(m_PendingChecks);
 }
 
 void Checkable::DecreasePendingChecks()
 {
 	std::unique_lock<std::mutex> lock(m_StatsMutex);
 	m_PendingChecks--;
+	l_PendingChecksMetric.Set(m_PendingChecks);
 	m_PendingChecksCV.notify_one();
 }
 
@@ -685,4 +753,5 @@ void Checkable::AquirePendingCheckSlot(int maxPendingChecks)
 		m_PendingChecksCV.wait(lock);
 
 	m_PendingChecks++;
+	l_PendingChecksMetric.Set(m_PendingChecks);
 }
@@ -3,19 +3,28 @@
 #include "icinga/service.hpp"
 #include "icinga/dependency.hpp"
 #include "base/logger.hpp"
+#include <unordered_set>
 
 using namespace icinga;
 
 void Checkable::AddDependency(const Dependency::Ptr& dep)
 {
-	std::unique_lock<std::mutex> lock(m_DependencyMutex);
-	m_Dependencies.insert(dep);
+	{
+		std::unique_lock<std::mutex> lock(m_DependencyMutex);
+		m_Dependencies.insert(dep);
+	}
+
+	InvalidateReachability();
 }
 
 void Checkable::RemoveDependency(const Dependency::Ptr& dep)
 {
-	std::unique_lock<std::mutex> lock(m_DependencyMutex);
-	m_Dependencies.erase(dep);
+	{
+		std::unique_lock<std::mutex> lock(m_DependencyMutex);
+		m_Dependencies.erase(dep);
+	}
+
+	InvalidateReachability();
 }
 
 std::vector<Dependency::Ptr> Checkable::GetDependencies() const
@@ -44,6 +53,38 @@ std::vector<Dependency::Ptr> Checkable::GetReverseDependencies() const
 
 bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency, int rstack) const
 {
+	bool cacheable;
+
+	/* The cache doesn't know which dependency failed. */
+	if (failedDependency)
+		return IsReachableInternal(dt, failedDependency, rstack, &cacheable);
+
+	return IsReachableCached(dt, rstack, &cacheable);
+}
+
+bool Checkable::IsReachableCached(DependencyType dt, int rstack, bool *cacheable) const
+{
+	auto version (m_ReachabilityVersion.load());
+	auto entry (m_ReachabilityCache[dt].load());
+
+	if (entry >> 2u == version && (entry & 3u)) {
+		*cacheable = true;
+		return (entry & 3u) == 1u;
+	}
+
+	bool reachable = IsReachableInternal(dt, nullptr, rstack, cacheable);
+
+	/* Results computed while the version was bumped carry the old version and are ignored. */
+	if (*cacheable)
+		m_ReachabilityCache[dt].store(version << 2u | (reachable ? 1u : 2u));
+
+	return reachable;
+}
+
+bool Checkable::IsReachableInternal(DependencyType dt, Dependency::Ptr *failedDependency, int rstack, bool *cacheable) const
+{
+	*cacheable = true;
+
 	/* Anything greater than 256 causes recursion bus errors. */
 	int limit = 256;
 
@@ -51,11 +92,27 @@ bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency
 		Log(LogWarning, "Checkable")
 			<< "Too many nested dependencies (>" << limit << ") for checkable '" << GetName() << "': Dependency failed.";
 
+		*cacheable = false;
 		return false;
 	}
 
-	for (const Checkable::Ptr& checkable : GetParents()) {
-		if (!checkable->IsReachable(dt, failedDependency, rstack + 1))
+	auto deps = GetDependencies();
+
+	for (const Dependency::Ptr& dep : deps) {
+		Checkable::Ptr parent = dep->GetParent();
+
+		if (!parent || parent.get() == this)
+			continue;
+
+		bool parentCacheable;
+		bool parentReachable = failedDependency
+			? parent->IsReachableInternal(dt, failedDependency, rstack + 1, &parentCacheable)
+			: parent->IsReachableCached(dt, rstack + 1, &parentCacheable);
+
+		if (!parentCacheable)
+			*cacheable = false;
+
+		if (!parentReachable)
 			return false;
 	}
 
@@ -72,12 +129,14 @@ bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency
 		}
 	}
 
-	auto deps = GetDependencies();
-
 	int countDeps = deps.size();
 	int countFailed = 0;
 
 	for (const Dependency::Ptr& dep : deps) {
+		/* Whether a time period applies changes without anyone telling us. */
+		if (dep->GetPeriod())
+			*cacheable = false;
+
 		if (!dep->IsAvailable(dt)) {
 			countFailed++;
 
@@ -99,6 +158,77 @@ bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency
 	return true;
 }
 
+/**
+ * Drops the cached reachability of this checkable and everything which
+ * depends on it, i.e. its children and, for hosts, their services.
+ */
+void Checkable::InvalidateReachability()
+{
+	m_ReachabilityVersion.fetch_add(1);
+
+	for (const Checkable::Ptr& checkable : GetDescendants(true))
+		checkable->m_ReachabilityVersion.fetch_add(1);
+}
+
+/**
+ * Invalidates the reachability of our descendants if anything they
+ * look at has changed since the last time, i.e. whether we've been
+ * checked yet, our state or our state type.
+ */
+void Checkable::UpdateReachabilityInput()
+{
+	int input = (GetLastCheckResult() ? 1 : 0) | GetStateType() << 1 | GetStateRaw() << 2;
+
+	if (m_ReachabilityInput.exchange(input) != input)
+		InvalidateReachability();
+}
+
+/**
+ * Collects everything below this checkable in one breadth-first walk.
+ *
+ * @param withServices Whether a host's services count as its descendants.
+ * @param maxDepth How many levels to descend, -1 for no limit.
+ * @returns The descendants in breadth-first order, each one only once.
+ */
+std::vector<Checkable::Ptr> Checkable::GetDescendants(bool withServices, int maxDepth) const
+{
+	std::vector<Checkable::Ptr> descendants;
+	std::unordered_set<const Checkable *> visited { this };
+	size_t levelBegin = 0;
+
+	auto visit ([&descendants, &visited](Checkable::Ptr checkable) {
+		if (checkable && visited.insert(checkable.get()).second)
+			descendants.emplace_back(std::move(checkable));
+	});
+
+	auto expand ([&visit, withServices](const Checkable *checkable) {
+		for (const Dependency::Ptr& dep : checkable->GetReverseDependencies())
+			visit(dep->GetChild());
+
+		if (withServices) {
+			auto *host (dynamic_cast<const Host *>(checkable));
+
+			if (host) {
+				for (const Service::Ptr& service : host->GetServices())
+					visit(service);
+			}
+		}
+	});
+
+	expand(this);
+
+	for (int depth = 1; levelBegin < descendants.size() && (maxDepth == -1 || depth < maxDepth); depth++) {
+		size_t levelEnd = descendants.size();
+
+		for (size_t i = levelBegin; i < levelEnd; i++)
+			expand(descendants[i].get());
+
+		levelBegin = levelEnd;
+	}
+
+	return descendants;
+}
+
 std::set<Checkable::Ptr> Checkable::GetParents() const
 {
 	std::set<Checkable::Ptr> parents;
@@ -129,30 +259,7 @@ std::set<Checkable::Ptr> Checkable::GetChildren() const
 
 std::set<Checkable::Ptr> Checkable::GetAllChildren() const
 {
-	std::set<Checkable::Ptr> children = GetChildren();
-
-	GetAllChildrenInternal(children, 0);
-
-	return children;
-}
-
-void Checkable::GetAllChildrenInternal(std::set<Checkable::Ptr>& children, int level) const
-{
-	if (level > 32)
-		return;
-
-	std::set<Checkable::Ptr> localChildren;
-
-	for (const Checkable::Ptr& checkable : children) {
-		std::set<Checkable::Ptr> cChildren = checkable->GetChildren();
-
-		if (!cChildren.empty()) {
-			GetAllChildrenInternal(cChildren, level + 1);
-			localChildren.insert(cChildren.begin(), cChildren.end());
-		}
-
-		localChildren.insert(checkable);
-	}
+	std::vector<Checkable::Ptr> descendants = GetDescendants(false, 34);
 
-	children.insert(localChildren.begin(), localChildren.end());
+	return std::set<Checkable::Ptr>(descendants.begin(), descendants.end());
 }
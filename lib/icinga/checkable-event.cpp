@@ -79,3 +79,18 @@ void Checkable::ExecuteEventHandler(const Dictionary::Ptr& resolvedMacros, bool
 
 	OnEventCommandExecuted(this);
 }
+
+/**
+ * Executes the event handler for a new check result, unless its command limits
+ * the concurrent executions, see EventCommand::Enqueue().
+ */
+void Checkable::QueueEventHandler()
+{
+	EventCommand::Ptr ec = GetEventCommand();
+
+	/* Event handlers which are executed by a command endpoint don't occupy the local spawn helper. */
+	if (ec && ec->GetMaxConcurrentExecutions() > 0 && !GetCommandEndpoint())
+		ec->Enqueue(this);
+	else
+		ExecuteEventHandler();
+}
@@ -2,44 +2,14 @@
 
 #include "icinga/checkable.hpp"
 #include "icinga/icingaapplication.hpp"
+#include "base/ringbitset.hpp"
 #include "base/utility.hpp"
 
 using namespace icinga;
 
-template<typename T>
-struct Bitset
-{
-public:
-	Bitset(T value)
-		: m_Data(value)
-	{ }
-
-	void Modify(int index, bool bit)
-	{
-		if (bit)
-			m_Data |= 1 << index;
-		else
-			m_Data &= ~(1 << index);
-	}
-
-	bool Get(int index) const
-	{
-		return m_Data & (1 << index);
-	}
-
-	T GetValue() const
-	{
-		return m_Data;
-	}
-
-private:
-	T m_Data{0};
-};
-
 void Checkable::UpdateFlappingStatus(ServiceState newState)
 {
-	Bitset<unsigned long> stateChangeBuf = GetFlappingBuffer();
-	int oldestIndex = GetFlappingIndex();
+	RingBitset<20> stateChangeBuf (GetFlappingBuffer(), GetFlappingIndex());
 
 	ServiceState lastState = GetFlappingLastState();
 	bool stateChange = false;
@@ -52,18 +22,10 @@ void Checkable::UpdateFlappingStatus(ServiceState newState)
 		SetFlappingLastState(newState);
 	}
 
-	stateChangeBuf.Modify(oldestIndex, stateChange);
-	oldestIndex = (oldestIndex + 1) % 20;
-
-	double stateChanges = 0;
-
-	/* Iterate over our state array and compute a weighted total */
-	for (int i = 0; i < 20; i++) {
-		if (stateChangeBuf.Get((oldestIndex + i) % 20))
-			stateChanges += 0.8 + (0.02 * i);
-	}
+	stateChangeBuf.Push(stateChange);
 
-	double flappingValue = 100.0 * stateChanges / 20.0;
+	/* State changes weigh 0.8 (oldest) to 1.18 (newest), i.e. (40 + i) / 50. */
+	double flappingValue = 100.0 * stateChangeBuf.GetWeightedCount(40, 1) / (50 * 20);
 
 	bool flapping;
 
@@ -72,8 +34,8 @@ void Checkable::UpdateFlappingStatus(ServiceState newState)
 	else
 		flapping = flappingValue > GetFlappingThresholdHigh();
 
-	SetFlappingBuffer(stateChangeBuf.GetValue());
-	SetFlappingIndex(oldestIndex);
+	SetFlappingBuffer(stateChangeBuf.GetData());
+	SetFlappingIndex(stateChangeBuf.GetIndex());
 	SetFlappingCurrent(flappingValue);
 
 	if (flapping != GetFlapping()) {
@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "icinga/checkable.hpp"
+#include "icinga/deadlinescheduler.hpp"
 #include "icinga/host.hpp"
 #include "icinga/icingaapplication.hpp"
 #include "icinga/service.hpp"
@@ -82,6 +83,8 @@ void Checkable::SendNotifications(NotificationType type, const CheckResult::Ptr&
 							{"author", author},
 							{"text", text}
 						}));
+
+						notification->MarkStateDirty();
 					} else {
 						notification->BeginExecuteNotification(type, cr, force, false, author, text);
 					}
@@ -107,6 +110,8 @@ void Checkable::SendNotifications(NotificationType type, const CheckResult::Ptr&
 				{"author", author},
 				{"text", text}
 			}));
+
+			notification->MarkStateDirty();
 		}
 	}
 }
@@ -197,18 +202,27 @@ static void FireSuppressedNotifications(Checkable* checkable)
 	}
 }
 
+/* Checkables with suppressed notifications are looked at every few seconds until none are left. */
+static DeadlineScheduler l_SuppressedNotificationsScheduler ([](const ConfigObject::Ptr& object) {
+	Checkable::Ptr checkable = static_pointer_cast<Checkable>(object);
+
+	FireSuppressedNotifications(checkable.get());
+
+	checkable->ScheduleSuppressedNotifications();
+});
+
 /**
- * Re-sends all notifications previously suppressed by e.g. downtimes if the notification reason still applies.
+ * Makes all notifications previously suppressed by e.g. downtimes be re-sent
+ * in a few seconds if the notification reason still applies.
  */
-void Checkable::FireSuppressedNotifications(const Timer * const&)
+void Checkable::ScheduleSuppressedNotifications()
 {
-	for (auto& host : ConfigType::GetObjectsByType<Host>()) {
-		::FireSuppressedNotifications(host.get());
-	}
+	double when = 0;
 
-	for (auto& service : ConfigType::GetObjectsByType<Service>()) {
-		::FireSuppressedNotifications(service.get());
-	}
+	if (IsActive() && GetSuppressedNotifications())
+		when = Utility::GetTime() + 5;
+
+	l_SuppressedNotificationsScheduler.Schedule(this, when, true);
 }
 
 /**
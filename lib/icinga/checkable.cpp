@@ -4,6 +4,10 @@
 #include "icinga/checkable-ti.cpp"
 #include "icinga/host.hpp"
 #include "icinga/service.hpp"
+#include "icinga/deadlinescheduler.hpp"
+#include "remote/httputility.hpp"
+#include "remote/objectqueryhandler.hpp"
+#include "base/convert.hpp"
 #include "base/objectlock.hpp"
 #include "base/utility.hpp"
 #include "base/exception.hpp"
@@ -28,19 +32,100 @@ boost::signals2::signal<void (const Checkable::Ptr&, const String&, const String
 boost::signals2::signal<void (const Checkable::Ptr&, const String&, double, const MessageOrigin::Ptr&)> Checkable::OnAcknowledgementCleared;
 boost::signals2::signal<void (const Checkable::Ptr&, double)> Checkable::OnFlappingChange;
 
-static Timer::Ptr l_CheckablesFireSuppressedNotifications;
 static Timer::Ptr l_CleanDeadlinedExecutions;
 
+/* GetAcknowledgement() clears expired acknowledgements. */
+static DeadlineScheduler l_AcknowledgementsExpiry ([](const ConfigObject::Ptr& object) {
+	Checkable::Ptr checkable = static_pointer_cast<Checkable>(object);
+
+	if (checkable->IsActive() && checkable->GetAcknowledgement() != AcknowledgementNone)
+		checkable->ScheduleAcknowledgementExpiry();
+});
+
 thread_local std::function<void(const Value& commandLine, const ProcessResult&)> Checkable::ExecuteCommandProcessFinishedHandler;
 
+/**
+ * Computes the "availability" meta field of /v1/objects from the state history.
+ * The time range defaults to the retention period and can be set with the
+ * "availability_from" and "availability_until" parameters.
+ */
+static Value GetAvailabilityMeta(const ConfigObject::Ptr& object, const Dictionary::Ptr& params)
+{
+	auto checkable (dynamic_pointer_cast<Checkable>(object));
+
+	if (!checkable || checkable->GetStateHistoryRetention() <= 0)
+		return Empty;
+
+	Value untilParam = HttpUtility::GetLastParameter(params, "availability_until");
+	Value fromParam = HttpUtility::GetLastParameter(params, "availability_from");
+	double until = untilParam.IsEmpty() ? Utility::GetTime() : Convert::ToDouble(untilParam);
+	double from = fromParam.IsEmpty() ? until - checkable->GetStateHistoryRetention() : Convert::ToDouble(fromParam);
+
+	auto availability (checkable->GetStateHistoryRing().GetAvailability(from, until));
+	auto& durations (availability.Durations);
+	Dictionary::Ptr stateDurations;
+	double ok;
+
+	if (dynamic_pointer_cast<Service>(checkable)) {
+		stateDurations = new Dictionary({
+			{ "0", durations[ServiceOK] },
+			{ "1", durations[ServiceWarning] },
+			{ "2", durations[ServiceCritical] },
+			{ "3", durations[ServiceUnknown] }
+		});
+
+		ok = durations[ServiceOK];
+	} else {
+		/* Like Host::CalculateState(). */
+		stateDurations = new Dictionary({
+			{ "0", durations[ServiceOK] + durations[ServiceWarning] },
+			{ "1", durations[ServiceCritical] + durations[ServiceUnknown] }
+		});
+
+		ok = durations[ServiceOK] + durations[ServiceWarning];
+	}
+
+	double monitored = durations[ServiceOK] + durations[ServiceWarning] + durations[ServiceCritical] + durations[ServiceUnknown];
+
+	return new Dictionary({
+		{ "from", from },
+		{ "until", until },
+		{ "state_durations", stateDurations },
+		{ "unmonitored", availability.Unmonitored },
+		{ "availability", monitored > 0 ? Value(ok / monitored * 100) : Empty }
+	});
+}
+
 void Checkable::StaticInitialize()
 {
+	ObjectQueryHandler::RegisterMeta("availability", &GetAvailabilityMeta);
+
 	/* fixed downtime start */
 	Downtime::OnDowntimeStarted.connect(std::bind(&Checkable::NotifyFixedDowntimeStart, _1));
 	/* flexible downtime start */
 	Downtime::OnDowntimeTriggered.connect(std::bind(&Checkable::NotifyFlexibleDowntimeStart, _1));
 	/* fixed/flexible downtime end */
 	Downtime::OnDowntimeRemoved.connect(std::bind(&Checkable::NotifyDowntimeEnd, _1));
+
+	/* children's reachability depends on these */
+	auto updateReachability ([](const Checkable::Ptr& checkable, const Value&) {
+		checkable->UpdateReachabilityInput();
+	});
+
+	Checkable::OnStateRawChanged.connect(updateReachability);
+	Checkable::OnStateTypeChanged.connect(updateReachability);
+	Checkable::OnLastCheckResultChanged.connect(updateReachability);
+
+	auto scheduleAcknowledgementExpiry ([](const Checkable::Ptr& checkable, const Value&) {
+		checkable->ScheduleAcknowledgementExpiry();
+	});
+
+	Checkable::OnAcknowledgementRawChanged.connect(scheduleAcknowledgementExpiry);
+	Checkable::OnAcknowledgementExpiryChanged.connect(scheduleAcknowledgementExpiry);
+
+	Checkable::OnSuppressedNotificationsChanged.connect([](const Checkable::Ptr& checkable, const Value&) {
+		checkable->ScheduleSuppressedNotifications();
+	});
 }
 
 Checkable::Checkable()
@@ -98,14 +183,26 @@ void Checkable::Start(bool runtimeCreated)
 
 	ObjectImpl<Checkable>::Start(runtimeCreated);
 
+	/* The state may have been restored while change events weren't delivered yet. */
+	InvalidateReachability();
+	ScheduleAcknowledgementExpiry();
+	ScheduleSuppressedNotifications();
+
+	{
+		double retention = GetStateHistoryRetention();
+
+		if (retention <= 0) {
+			/* The state history may have been restored from before it was disabled. */
+			m_StateHistory.Clear();
+		} else if (!m_StateHistory.Covers(now) && GetLastCheckResult()) {
+			/* At least the current state is known since its last change. */
+			m_StateHistory.Add(GetLastStateChange(), GetStateRaw(), GetStateType(), GetLastReachable(), retention);
+		}
+	}
+
 	static boost::once_flag once = BOOST_ONCE_INIT;
 
 	boost::call_once(once, []() {
-		l_CheckablesFireSuppressedNotifications = new Timer();
-		l_CheckablesFireSuppressedNotifications->SetInterval(5);
-		l_CheckablesFireSuppressedNotifications->OnTimerExpired.connect(&Checkable::FireSuppressedNotifications);
-		l_CheckablesFireSuppressedNotifications->Start();
-
 		l_CleanDeadlinedExecutions = new Timer();
 		l_CleanDeadlinedExecutions->SetInterval(300);
 		l_CleanDeadlinedExecutions->OnTimerExpired.connect(&Checkable::CleanDeadlinedExecutions);
@@ -150,6 +247,19 @@ AcknowledgementType Checkable::GetAcknowledgement()
 	return avalue;
 }
 
+/**
+ * Makes the acknowledgement be cleared as soon as it expires.
+ */
+void Checkable::ScheduleAcknowledgementExpiry()
+{
+	double expiry = 0;
+
+	if (IsActive() && GetAcknowledgementRaw() != AcknowledgementNone)
+		expiry = GetAcknowledgementExpiry();
+
+	l_AcknowledgementsExpiry.Schedule(this, expiry);
+}
+
 bool Checkable::IsAcknowledged() const
 {
 	return const_cast<Checkable *>(this)->GetAcknowledgement() != AcknowledgementNone;
@@ -230,6 +340,29 @@ Timestamp Checkable::GetNextUpdate() const
 	return (GetEnableActiveChecks() ? GetNextCheck() : (cr ? cr->GetExecutionEnd() : Application::GetStartTime()) + interval) + interval + 2 * latency;
 }
 
+String Checkable::GetStateHistory() const
+{
+	return m_StateHistory.Serialize();
+}
+
+void Checkable::SetStateHistory(const String& value, bool suppress_events, const Value& cookie)
+{
+	m_StateHistory.Deserialize(value);
+
+	MarkStateDirty();
+
+	if (!suppress_events)
+		NotifyStateHistory(cookie);
+}
+
+/**
+ * @returns The recent state transitions, empty unless state_history_retention is set
+ */
+const StateHistoryRing& Checkable::GetStateHistoryRing() const
+{
+	return m_StateHistory;
+}
+
 void Checkable::NotifyFixedDowntimeStart(const Downtime::Ptr& downtime)
 {
 	if (!downtime->GetFixed())
@@ -290,6 +423,14 @@ void Checkable::ValidateMaxCheckAttempts(const Lazy<int>& lvalue, const Validati
 		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_check_attempts" }, "Value must be greater than 0."));
 }
 
+void Checkable::ValidateStateHistoryRetention(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<Checkable>::ValidateStateHistoryRetention(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "state_history_retention" }, "Value must not be negative."));
+}
+
 void Checkable::CleanDeadlinedExecutions(const Timer * const&)
 {
 	double now = Utility::GetTime();
@@ -303,6 +444,7 @@ void Checkable::CleanDeadlinedExecutions(const Timer * const&)
 				execution = executions->Get(key);
 				if (execution->Contains("deadline") && now > execution->Get("deadline")) {
 					executions->Remove(key);
+					host->MarkStateDirty();
 				}
 			}
 		}
@@ -315,6 +457,7 @@ void Checkable::CleanDeadlinedExecutions(const Timer * const&)
 				execution = executions->Get(key);
 				if (execution->Contains("deadline") && now > execution->Get("deadline")) {
 					executions->Remove(key);
+					service->MarkStateDirty();
 				}
 			}
 		}
@@ -4,6 +4,7 @@
 #define CHECKABLE_H
 
 #include "base/atomic.hpp"
+#include "base/eventbus.hpp"
 #include "base/timer.hpp"
 #include "base/process.hpp"
 #include "icinga/i2-icinga.hpp"
@@ -12,8 +13,10 @@
 #include "icinga/notification.hpp"
 #include "icinga/comment.hpp"
 #include "icinga/downtime.hpp"
+#include "icinga/statehistoryring.hpp"
 #include "remote/endpoint.hpp"
 #include "remote/messageorigin.hpp"
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <functional>
@@ -80,17 +83,23 @@ public:
 	void AddGroup(const String& name);
 
 	bool IsReachable(DependencyType dt = DependencyState, intrusive_ptr<Dependency> *failedDependency = nullptr, int rstack = 0) const;
+	void InvalidateReachability();
 
 	AcknowledgementType GetAcknowledgement();
 
 	void AcknowledgeProblem(const String& author, const String& comment, AcknowledgementType type, bool notify = true, bool persistent = false, double changeTime = Utility::GetTime(), double expiry = 0, const MessageOrigin::Ptr& origin = nullptr);
 	void ClearAcknowledgement(const String& removedBy, double changeTime = Utility::GetTime(), const MessageOrigin::Ptr& origin = nullptr);
+	void ScheduleAcknowledgementExpiry();
 
 	int GetSeverity() const override;
 	bool GetProblem() const override;
 	bool GetHandled() const override;
 	Timestamp GetNextUpdate() const override;
 
+	String GetStateHistory() const override;
+	void SetStateHistory(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
+	const StateHistoryRing& GetStateHistoryRing() const;
+
 	/* Checks */
 	intrusive_ptr<CheckCommand> GetCheckCommand() const;
 	TimePeriod::Ptr GetCheckPeriod() const;
@@ -115,10 +124,10 @@ public:
 
 	Endpoint::Ptr GetCommandEndpoint() const;
 
-	static boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&)> OnNewCheckResult;
-	static boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&)> OnStateChange;
-	static boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, std::set<Checkable::Ptr>, const MessageOrigin::Ptr&)> OnReachabilityChanged;
-	static boost::signals2::signal<void (const Checkable::Ptr&, NotificationType, const CheckResult::Ptr&,
+	static EventBus<void (const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&)> OnNewCheckResult;
+	static EventBus<void (const Checkable::Ptr&, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&)> OnStateChange;
+	static EventBus<void (const Checkable::Ptr&, const CheckResult::Ptr&, std::set<Checkable::Ptr>, const MessageOrigin::Ptr&)> OnReachabilityChanged;
+	static EventBus<void (const Checkable::Ptr&, NotificationType, const CheckResult::Ptr&,
 		const String&, const String&, const MessageOrigin::Ptr&)> OnNotificationsRequested;
 	static boost::signals2::signal<void (const Notification::Ptr&, const Checkable::Ptr&, const User::Ptr&,
 		const NotificationType&, const CheckResult::Ptr&, const String&, const String&, const String&,
@@ -130,7 +139,7 @@ public:
 		bool, bool, double, double, const MessageOrigin::Ptr&)> OnAcknowledgementSet;
 	static boost::signals2::signal<void (const Checkable::Ptr&, const String&, double, const MessageOrigin::Ptr&)> OnAcknowledgementCleared;
 	static boost::signals2::signal<void (const Checkable::Ptr&, double)> OnFlappingChange;
-	static boost::signals2::signal<void (const Checkable::Ptr&)> OnNextCheckUpdated;
+	static EventBus<void (const Checkable::Ptr&)> OnNextCheckUpdated;
 	static boost::signals2::signal<void (const Checkable::Ptr&)> OnEventCommandExecuted;
 
 	static Atomic<uint_fast64_t> CurrentConcurrentChecks;
@@ -167,6 +176,7 @@ public:
 	/* Event Handler */
 	void ExecuteEventHandler(const Dictionary::Ptr& resolvedMacros = nullptr,
 		bool useResolvedMacros = false);
+	void QueueEventHandler();
 
 	intrusive_ptr<EventCommand> GetEventCommand() const;
 
@@ -185,9 +195,11 @@ public:
 	void ValidateCheckInterval(const Lazy<double>& lvalue, const ValidationUtils& value) final;
 	void ValidateRetryInterval(const Lazy<double>& lvalue, const ValidationUtils& value) final;
 	void ValidateMaxCheckAttempts(const Lazy<int>& lvalue, const ValidationUtils& value) final;
+	void ValidateStateHistoryRetention(const Lazy<double>& lvalue, const ValidationUtils& value) final;
 
 	bool NotificationReasonApplies(NotificationType type);
 	bool NotificationReasonSuppressed(NotificationType type);
+	void ScheduleSuppressedNotifications();
 	bool IsLikelyToBeCheckedSoon();
 
 	static void IncreasePendingChecks();
@@ -221,7 +233,6 @@ private:
 
 	static void NotifyDowntimeEnd(const Downtime::Ptr& downtime);
 
-	static void FireSuppressedNotifications(const Timer * const&);
 	static void CleanDeadlinedExecutions(const Timer * const&);
 
 	/* Comments */
@@ -237,7 +248,24 @@ private:
 	std::set<intrusive_ptr<Dependency> > m_Dependencies;
 	std::set<intrusive_ptr<Dependency> > m_ReverseDependencies;
 
-	void GetAllChildrenInternal(std::set<Checkable::Ptr>& children, int level = 0) const;
+	/* Reachability per DependencyType, tagged with the version it was computed for. */
+	mutable std::atomic<uint_fast64_t> m_ReachabilityVersion{0};
+	mutable std::atomic<uint_fast64_t> m_ReachabilityCache[3] {{0}, {0}, {0}};
+	std::atomic<int> m_ReachabilityInput{-1};
+
+	bool IsReachableCached(DependencyType dt, int rstack, bool *cacheable) const;
+	bool IsReachableInternal(DependencyType dt, intrusive_ptr<Dependency> *failedDependency, int rstack, bool *cacheable) const;
+
+	void UpdateReachabilityInput();
+	std::vector<Checkable::Ptr> GetDescendants(bool withServices, int maxDepth = -1) const;
+
+	/* State history */
+	StateHistoryRing m_StateHistory;
+
+	/* What CIB has counted this object as, guarded by CIB's mutex. */
+	uint_fast32_t m_StatisticsFlags{0};
+
+	friend class CIB;
 
 	/* Flapping */
 	static const std::map<String, int> m_FlappingStateFilterMap;
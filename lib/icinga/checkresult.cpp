@@ -2,11 +2,16 @@
 
 #include "icinga/checkresult.hpp"
 #include "icinga/checkresult-ti.cpp"
+#include "base/configuration.hpp"
 #include "base/scriptglobal.hpp"
+#include "base/objectlock.hpp"
+#include "base/serializer.hpp"
+#include <algorithm>
 
 using namespace icinga;
 
 REGISTER_TYPE(CheckResult);
+IMPLEMENT_OBJECT_POOL(CheckResult);
 
 INITIALIZE_ONCE([]() {
 	ScriptGlobal::Set("Icinga.ServiceOK", ServiceOK, true);
@@ -18,6 +23,37 @@ INITIALIZE_ONCE([]() {
 	ScriptGlobal::Set("Icinga.HostDown", HostDown, true);
 })
 
+static MetricGauge& GetOutputBytesSavedMetric()
+{
+	static auto& metric (MetricGauge::GetByName("check_output_bytes_saved"));
+	return metric;
+}
+
+CheckResult::CheckResult()
+	: m_Output(&GetOutputBytesSavedMetric())
+{
+}
+
+String CheckResult::GetOutput() const
+{
+	return m_Output.Get();
+}
+
+/**
+ * Sets the output, which is kept compressed if it's at least
+ * CheckOutputCompressionThreshold bytes long. Checkables keep their last
+ * check result, so verbose plugins would add up otherwise.
+ */
+void CheckResult::SetOutput(const String& value, bool suppress_events, const Value& cookie)
+{
+	m_Output.Set(value, std::max(Configuration::CheckOutputCompressionThreshold, 0));
+
+	MarkStateDirty();
+
+	if (!suppress_events)
+		NotifyOutput(cookie);
+}
+
 double CheckResult::CalculateExecutionTime() const
 {
 	return GetExecutionEnd() - GetExecutionStart();
@@ -32,3 +68,88 @@ double CheckResult::CalculateLatency() const
 
 	return latency;
 }
+
+/**
+ * Parses the performance data once for all consumers, e.g. the perfdata writers.
+ *
+ * @returns The performance data values, in their original order.
+ */
+std::shared_ptr<const CheckResult::ParsedPerfdata> CheckResult::GetParsedPerformanceData() const
+{
+	Array::Ptr perfdata = GetPerformanceData();
+
+	std::unique_lock<std::mutex> lock (m_ParsedPerfdataMutex);
+
+	if (m_ParsedPerfdata && m_ParsedPerfdataSource == perfdata)
+		return m_ParsedPerfdata;
+
+	std::shared_ptr<ParsedPerfdata> parsed (new ParsedPerfdata());
+
+	if (perfdata) {
+		ObjectLock olock (perfdata);
+
+		parsed->reserve(perfdata->GetLength());
+
+		for (const Value& val : perfdata) {
+			PerfdataValue::Ptr pdv;
+
+			if (val.IsObjectType<PerfdataValue>()) {
+				pdv = val;
+			} else {
+				try {
+					pdv = PerfdataValue::Parse(val);
+				} catch (const std::exception&) {
+					/* Left to the consumers, they know how to report it. */
+				}
+			}
+
+			parsed->push_back({ val, std::move(pdv) });
+		}
+	}
+
+	m_ParsedPerfdataSource = perfdata;
+	m_ParsedPerfdata = std::move(parsed);
+
+	return m_ParsedPerfdata;
+}
+
+/**
+ * Serializes the check result once for all consumers, e.g. the cluster
+ * messages and the event streams. It's built again after any attribute
+ * has been changed.
+ *
+ * @returns A copy of the serialized check result, its values must not be modified.
+ */
+Dictionary::Ptr CheckResult::GetSerialized()
+{
+	/* Keeping the serialized copy would keep the output uncompressed as well. */
+	if (m_Output.IsCompressed())
+		return Serialize(CheckResult::Ptr(this));
+
+	std::unique_lock<std::mutex> lock (m_SerializedMutex);
+	uint_fast32_t version = GetStateVersion();
+
+	if (!m_Serialized || m_SerializedVersion != version) {
+		m_Serialized = Serialize(CheckResult::Ptr(this));
+		m_SerializedVersion = version;
+	}
+
+	/* The callers add the copy to their messages which may be changed later on. */
+	return m_Serialized->ShallowClone();
+}
+
+/**
+ * Returns the root span of the check if it's traced. The context isn't part of
+ * the state, it's propagated in the metadata of event::CheckResult messages.
+ *
+ * @returns The context, empty if the check isn't traced.
+ */
+const TraceContext& CheckResult::GetTraceContext() const
+{
+	return m_TraceContext;
+}
+
+void CheckResult::SetTraceContext(const TraceContext& context)
+{
+	m_TraceContext = context;
+}
@@ -5,6 +5,13 @@
 
 #include "icinga/i2-icinga.hpp"
 #include "icinga/checkresult-ti.hpp"
+#include "base/compressedstring.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/objectpool.hpp"
+#include "base/tracing.hpp"
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace icinga
 {
@@ -18,9 +25,42 @@ class CheckResult final : public ObjectImpl<CheckResult>
 {
 public:
 	DECLARE_OBJECT(CheckResult);
+	DECLARE_OBJECT_POOL();
+
+	/**
+	 * An entry of the performance data, Parsed is null if Raw isn't valid.
+	 */
+	struct ParsedPerfdataEntry
+	{
+		Value Raw;
+		PerfdataValue::Ptr Parsed;
+	};
+
+	typedef std::vector<ParsedPerfdataEntry> ParsedPerfdata;
+
+	CheckResult();
+
+	String GetOutput() const override;
+	void SetOutput(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
 	double CalculateExecutionTime() const;
 	double CalculateLatency() const;
+
+	std::shared_ptr<const ParsedPerfdata> GetParsedPerformanceData() const;
+	Dictionary::Ptr GetSerialized();
+
+	const TraceContext& GetTraceContext() const;
+	void SetTraceContext(const TraceContext& context);
+
+private:
+	CompressedString m_Output;
+	mutable std::mutex m_ParsedPerfdataMutex;
+	mutable Array::Ptr m_ParsedPerfdataSource;
+	mutable std::shared_ptr<const ParsedPerfdata> m_ParsedPerfdata;
+	std::mutex m_SerializedMutex;
+	uint_fast32_t m_SerializedVersion{0};
+	Dictionary::Ptr m_Serialized;
+	TraceContext m_TraceContext;
 };
 
 }
@@ -4,12 +4,20 @@
 #include "icinga/host.hpp"
 #include "icinga/service.hpp"
 #include "icinga/clusterevents.hpp"
+#include "icinga/dependency.hpp"
+#include "icinga/downtime.hpp"
+#include "icinga/eventcommand.hpp"
 #include "base/application.hpp"
 #include "base/objectlock.hpp"
 #include "base/utility.hpp"
 #include "base/perfdatavalue.hpp"
 #include "base/configtype.hpp"
 #include "base/statsfunction.hpp"
+#include "base/initialize.hpp"
+#include "base/timer.hpp"
+#include <boost/thread/once.hpp>
+#include <algorithm>
+#include <mutex>
 
 using namespace icinga;
 
@@ -58,200 +66,375 @@ int CIB::GetPassiveServiceChecksStatistics(long timespan)
 	return m_PassiveServiceChecksStatistics.UpdateAndGetValues(Utility::GetTime(), timespan);
 }
 
-CheckableCheckStatistics CIB::CalculateHostCheckStats()
-{
-	double min_latency = -1, max_latency = 0, sum_latency = 0;
-	int count_latency = 0;
-	double min_execution_time = -1, max_execution_time = 0, sum_execution_time = 0;
-	int count_execution_time = 0;
-	bool checkresult = false;
-
-	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>()) {
-		ObjectLock olock(host);
+INITIALIZE_ONCE(&CIB::StaticInitialize);
 
-		CheckResult::Ptr cr = host->GetLastCheckResult();
+std::mutex CIB::m_Mutex;
+HostStatistics CIB::m_HostStats = {};
+ServiceStatistics CIB::m_ServiceStats = {};
 
-		if (!cr)
-			continue;
+/**
+ * Aggregates the latency and execution time of the check results of the last
+ * 15 minutes in slots of 10 seconds, the oldest slot is recycled for the next one.
+ *
+ * @ingroup icinga
+ */
+class CheckStatisticsWindow
+{
+public:
+	void Record(double now, double latency, double executionTime)
+	{
+		auto start (static_cast<long>(now) / SlotLength);
 
-		/* set to true, we have a checkresult */
-		checkresult = true;
+		std::unique_lock<std::mutex> lock (m_Mutex);
+		auto& slot (m_Slots[start % SlotCount]);
 
-		/* latency */
-		double latency = cr->CalculateLatency();
+		if (slot.Start != start) {
+			slot = Slot();
+			slot.Start = start;
+		}
 
-		if (min_latency == -1 || latency < min_latency)
-			min_latency = latency;
+		slot.Latency.Add(latency);
+		slot.ExecutionTime.Add(executionTime);
+	}
 
-		if (latency > max_latency)
-			max_latency = latency;
+	CheckableCheckStatistics Get(double now)
+	{
+		auto current (static_cast<long>(now) / SlotLength);
+		Aggregate latency, executionTime;
 
-		sum_latency += latency;
-		count_latency++;
+		{
+			std::unique_lock<std::mutex> lock (m_Mutex);
 
-		/* execution_time */
-		double execution_time = cr->CalculateExecutionTime();
+			for (auto& slot : m_Slots) {
+				if (slot.Start > current - SlotCount && slot.Start <= current) {
+					latency.Add(slot.Latency);
+					executionTime.Add(slot.ExecutionTime);
+				}
+			}
+		}
 
-		if (min_execution_time == -1 || execution_time < min_execution_time)
-			min_execution_time = execution_time;
+		CheckableCheckStatistics ccs;
 
-		if (execution_time > max_execution_time)
-			max_execution_time = execution_time;
+		ccs.min_latency = latency.Min;
+		ccs.max_latency = latency.Max;
+		ccs.avg_latency = latency.GetAverage();
+		ccs.min_execution_time = executionTime.Min;
+		ccs.max_execution_time = executionTime.Max;
+		ccs.avg_execution_time = executionTime.GetAverage();
 
-		sum_execution_time += execution_time;
-		count_execution_time++;
+		return ccs;
 	}
 
-	if (!checkresult) {
-		min_latency = 0;
-		min_execution_time = 0;
+private:
+	static constexpr long SlotLength = 10;
+	static constexpr long SlotCount = 15 * 60 / SlotLength;
+
+	struct Aggregate
+	{
+		uint_fast64_t Count{0};
+		double Sum{0};
+		double Min{0};
+		double Max{0};
+
+		void Add(double value)
+		{
+			Min = Count ? std::min(Min, value) : value;
+			Max = Count ? std::max(Max, value) : value;
+			Sum += value;
+			Count++;
+		}
+
+		void Add(const Aggregate& other)
+		{
+			if (!other.Count)
+				return;
+
+			Min = Count ? std::min(Min, other.Min) : other.Min;
+			Max = Count ? std::max(Max, other.Max) : other.Max;
+			Sum += other.Sum;
+			Count += other.Count;
+		}
+
+		double GetAverage() const
+		{
+			return Count ? Sum / Count : 0;
+		}
+	};
+
+	struct Slot
+	{
+		long Start{-1};
+		Aggregate Latency;
+		Aggregate ExecutionTime;
+	};
+
+	std::mutex m_Mutex;
+	Slot m_Slots[SlotCount];
+};
+
+static CheckStatisticsWindow l_HostCheckStats;
+static CheckStatisticsWindow l_ServiceCheckStats;
+
+static Timer::Ptr l_StatisticsReconcileTimer;
+
+/* What a checkable is counted as in m_HostStats or m_ServiceStats, see GetStatisticsFlags(). */
+enum StatisticsFlag : uint_fast32_t
+{
+	StatisticsCounted = 1u << 0,
+	StatisticsPending = 1u << 1,
+	StatisticsUnreachable = 1u << 2,
+	StatisticsFlapping = 1u << 3,
+	StatisticsInDowntime = 1u << 4,
+	StatisticsAcknowledged = 1u << 5,
+	StatisticsHandled = 1u << 6,
+	StatisticsProblem = 1u << 7,
+	StatisticsStateShift = 8
+};
+
+static void CountHost(HostStatistics& hs, uint_fast32_t flags, int delta)
+{
+	if (!(flags & StatisticsCounted))
+		return;
+
+	if (flags & StatisticsUnreachable) {
+		hs.hosts_unreachable += delta;
+	} else {
+		switch (flags >> StatisticsStateShift) {
+			case HostUp:
+				hs.hosts_up += delta;
+				break;
+			case HostDown:
+				hs.hosts_down += delta;
+				break;
+		}
 	}
 
-	CheckableCheckStatistics ccs;
+	if (flags & StatisticsPending)
+		hs.hosts_pending += delta;
+	if (flags & StatisticsFlapping)
+		hs.hosts_flapping += delta;
+	if (flags & StatisticsInDowntime)
+		hs.hosts_in_downtime += delta;
+	if (flags & StatisticsAcknowledged)
+		hs.hosts_acknowledged += delta;
+	if (flags & StatisticsHandled)
+		hs.hosts_handled += delta;
+	if (flags & StatisticsProblem)
+		hs.hosts_problem += delta;
+}
 
-	ccs.min_latency = min_latency;
-	ccs.max_latency = max_latency;
-	ccs.avg_latency = sum_latency / count_latency;
-	ccs.min_execution_time = min_execution_time;
-	ccs.max_execution_time = max_execution_time;
-	ccs.avg_execution_time = sum_execution_time / count_execution_time;
+static void CountService(ServiceStatistics& ss, uint_fast32_t flags, int delta)
+{
+	if (!(flags & StatisticsCounted))
+		return;
+
+	switch (flags >> StatisticsStateShift) {
+		case ServiceOK:
+			ss.services_ok += delta;
+			break;
+		case ServiceWarning:
+			ss.services_warning += delta;
+			break;
+		case ServiceCritical:
+			ss.services_critical += delta;
+			break;
+		case ServiceUnknown:
+			ss.services_unknown += delta;
+			break;
+	}
 
-	return ccs;
+	if (flags & StatisticsPending)
+		ss.services_pending += delta;
+	if (flags & StatisticsUnreachable)
+		ss.services_unreachable += delta;
+	if (flags & StatisticsFlapping)
+		ss.services_flapping += delta;
+	if (flags & StatisticsInDowntime)
+		ss.services_in_downtime += delta;
+	if (flags & StatisticsAcknowledged)
+		ss.services_acknowledged += delta;
+	if (flags & StatisticsHandled)
+		ss.services_handled += delta;
+	if (flags & StatisticsProblem)
+		ss.services_problem += delta;
 }
 
-CheckableCheckStatistics CIB::CalculateServiceCheckStats()
+void CIB::StaticInitialize()
 {
-	double min_latency = -1, max_latency = 0, sum_latency = 0;
-	int count_latency = 0;
-	double min_execution_time = -1, max_execution_time = 0, sum_execution_time = 0;
-	int count_execution_time = 0;
-	bool checkresult = false;
+	ConfigObject::OnActiveChanged.connect([](const ConfigObject::Ptr& object, const Value&) {
+		auto checkable (dynamic_pointer_cast<Checkable>(object));
 
-	for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>()) {
-		ObjectLock olock(service);
+		if (checkable) {
+			static boost::once_flag once = BOOST_ONCE_INIT;
 
-		CheckResult::Ptr cr = service->GetLastCheckResult();
+			boost::call_once(once, []() {
+				l_StatisticsReconcileTimer = new Timer();
+				l_StatisticsReconcileTimer->SetInterval(60);
+				l_StatisticsReconcileTimer->OnTimerExpired.connect(std::bind(&CIB::ReconcileStatistics));
+				l_StatisticsReconcileTimer->Start();
+			});
 
-		if (!cr)
-			continue;
+			UpdateStatistics(checkable);
+			return;
+		}
 
-		/* set to true, we have a checkresult */
-		checkresult = true;
+		/* Dependencies added or removed at runtime change the reachability of their child. */
+		auto dependency (dynamic_pointer_cast<Dependency>(object));
 
-		/* latency */
-		double latency = cr->CalculateLatency();
+		if (dependency) {
+			Checkable::Ptr child = dependency->GetChild();
 
-		if (min_latency == -1 || latency < min_latency)
-			min_latency = latency;
+			if (child && UpdateStatistics(child))
+				UpdateDescendantsStatistics(child);
+		}
+	});
 
-		if (latency > max_latency)
-			max_latency = latency;
+	Checkable::OnNewCheckResult.connect([](const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const MessageOrigin::Ptr&) {
+		double now = Utility::GetTime();
 
-		sum_latency += latency;
-		count_latency++;
+		if (dynamic_cast<Host*>(checkable.get()))
+			l_HostCheckStats.Record(now, cr->CalculateLatency(), cr->CalculateExecutionTime());
+		else
+			l_ServiceCheckStats.Record(now, cr->CalculateLatency(), cr->CalculateExecutionTime());
 
-		/* execution_time */
-		double execution_time = cr->CalculateExecutionTime();
+		UpdateStatistics(checkable);
+	});
 
-		if (min_execution_time == -1 || execution_time < min_execution_time)
-			min_execution_time = execution_time;
+	/* Also the reachability of the children and whether the services of a host are handled may change. */
+	Checkable::OnStateChange.connect([](const Checkable::Ptr& checkable, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&) {
+		UpdateDescendantsStatistics(checkable);
+	});
 
-		if (execution_time > max_execution_time)
-			max_execution_time = execution_time;
+	Checkable::OnAcknowledgementSet.connect([](const Checkable::Ptr& checkable, const String&, const String&,
+		AcknowledgementType, bool, bool, double, double, const MessageOrigin::Ptr&) {
+		UpdateStatistics(checkable);
+	});
 
-		sum_execution_time += execution_time;
-		count_execution_time++;
-	}
+	Checkable::OnAcknowledgementCleared.connect([](const Checkable::Ptr& checkable, const String&, double, const MessageOrigin::Ptr&) {
+		UpdateStatistics(checkable);
+	});
 
-	if (!checkresult) {
-		min_latency = 0;
-		min_execution_time = 0;
-	}
+	Checkable::OnFlappingChange.connect([](const Checkable::Ptr& checkable, double) {
+		UpdateStatistics(checkable);
+	});
 
-	CheckableCheckStatistics ccs;
+	auto downtimeHandler ([](const Downtime::Ptr& downtime) {
+		Checkable::Ptr checkable = downtime->GetCheckable();
 
-	ccs.min_latency = min_latency;
-	ccs.max_latency = max_latency;
-	ccs.avg_latency = sum_latency / count_latency;
-	ccs.min_execution_time = min_execution_time;
-	ccs.max_execution_time = max_execution_time;
-	ccs.avg_execution_time = sum_execution_time / count_execution_time;
+		if (checkable)
+			UpdateStatistics(checkable);
+	});
 
-	return ccs;
+	Downtime::OnDowntimeStarted.connect(downtimeHandler);
+	Downtime::OnDowntimeTriggered.connect(downtimeHandler);
+	Downtime::OnDowntimeRemoved.connect(downtimeHandler);
 }
 
-ServiceStatistics CIB::CalculateServiceStats()
+uint_fast32_t CIB::GetStatisticsFlags(const Checkable::Ptr& checkable)
+{
+	if (!checkable->IsActive())
+		return 0;
+
+	uint_fast32_t flags = StatisticsCounted;
+	CheckResult::Ptr cr = checkable->GetLastCheckResult();
+
+	if (!cr)
+		flags |= StatisticsPending;
+	if (!checkable->IsReachable())
+		flags |= StatisticsUnreachable;
+	if (checkable->IsFlapping())
+		flags |= StatisticsFlapping;
+	if (checkable->IsInDowntime())
+		flags |= StatisticsInDowntime;
+	if (checkable->IsAcknowledged())
+		flags |= StatisticsAcknowledged;
+	if (checkable->GetHandled())
+		flags |= StatisticsHandled;
+	if (checkable->GetProblem())
+		flags |= StatisticsProblem;
+
+	auto host (dynamic_cast<Host*>(checkable.get()));
+	int state = host ? static_cast<int>(host->GetState()) : static_cast<int>(static_cast<Service*>(checkable.get())->GetState());
+
+	return flags | static_cast<uint_fast32_t>(state) << StatisticsStateShift;
+}
+
+/**
+ * Counts the checkable as what it is now instead of what it was before.
+ *
+ * @returns Whether its reachability or problem state changed, which its descendants depend on
+ */
+bool CIB::UpdateStatistics(const Checkable::Ptr& checkable)
 {
-	ServiceStatistics ss = {};
-
-	for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>()) {
-		ObjectLock olock(service);
-
-		if (service->GetState() == ServiceOK)
-			ss.services_ok++;
-		if (service->GetState() == ServiceWarning)
-			ss.services_warning++;
-		if (service->GetState() == ServiceCritical)
-			ss.services_critical++;
-		if (service->GetState() == ServiceUnknown)
-			ss.services_unknown++;
-
-		CheckResult::Ptr cr = service->GetLastCheckResult();
-
-		if (!cr)
-			ss.services_pending++;
-
-		if (!service->IsReachable())
-			ss.services_unreachable++;
-
-		if (service->IsFlapping())
-			ss.services_flapping++;
-		if (service->IsInDowntime())
-			ss.services_in_downtime++;
-		if (service->IsAcknowledged())
-			ss.services_acknowledged++;
-
-		if (service->GetHandled())
-			ss.services_handled++;
-		if (service->GetProblem())
-			ss.services_problem++;
+	bool isHost = dynamic_cast<Host*>(checkable.get());
+
+	/* Otherwise a concurrent update could apply the flags it computed earlier after ours. */
+	std::unique_lock<std::mutex> lock (m_Mutex);
+	auto flags (GetStatisticsFlags(checkable));
+	auto old (checkable->m_StatisticsFlags);
+
+	if (old == flags)
+		return false;
+
+	if (isHost) {
+		CountHost(m_HostStats, old, -1);
+		CountHost(m_HostStats, flags, 1);
+	} else {
+		CountService(m_ServiceStats, old, -1);
+		CountService(m_ServiceStats, flags, 1);
 	}
 
-	return ss;
+	checkable->m_StatisticsFlags = flags;
+
+	return (old ^ flags) & (StatisticsUnreachable | StatisticsProblem);
 }
 
-HostStatistics CIB::CalculateHostStats()
+void CIB::UpdateDescendantsStatistics(const Checkable::Ptr& checkable, int depth)
 {
-	HostStatistics hs = {};
-
-	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>()) {
-		ObjectLock olock(host);
-
-		if (host->IsReachable()) {
-			if (host->GetState() == HostUp)
-				hs.hosts_up++;
-			if (host->GetState() == HostDown)
-				hs.hosts_down++;
-		} else
-			hs.hosts_unreachable++;
-
-		if (!host->GetLastCheckResult())
-			hs.hosts_pending++;
-
-		if (host->IsFlapping())
-			hs.hosts_flapping++;
-		if (host->IsInDowntime())
-			hs.hosts_in_downtime++;
-		if (host->IsAcknowledged())
-			hs.hosts_acknowledged++;
-
-		if (host->GetHandled())
-			hs.hosts_handled++;
-		if (host->GetProblem())
-			hs.hosts_problem++;
+	/* Like IsReachable(), don't follow overly long dependency chains. */
+	if (depth > 256)
+		return;
+
+	for (auto& child : checkable->GetDescendants(true, 1)) {
+		if (UpdateStatistics(child))
+			UpdateDescendantsStatistics(child, depth + 1);
 	}
+}
+
+/**
+ * Re-evaluates all checkables. Some changes come without any event, e.g. a
+ * dependency's time period which starts or ends, or runtime modifications of
+ * a dependency.
+ */
+void CIB::ReconcileStatistics()
+{
+	for (auto& host : ConfigType::GetObjectsByType<Host>())
+		UpdateStatistics(host);
+
+	for (auto& service : ConfigType::GetObjectsByType<Service>())
+		UpdateStatistics(service);
+}
+
+CheckableCheckStatistics CIB::CalculateHostCheckStats()
+{
+	return l_HostCheckStats.Get(Utility::GetTime());
+}
 
-	return hs;
+CheckableCheckStatistics CIB::CalculateServiceCheckStats()
+{
+	return l_ServiceCheckStats.Get(Utility::GetTime());
+}
+
+HostStatistics CIB::CalculateHostStats()
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+	return m_HostStats;
+}
+
+ServiceStatistics CIB::CalculateServiceStats()
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+	return m_ServiceStats;
 }
 
 /*
@@ -305,6 +488,9 @@ void CIB::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata) {
 	status->Set("remote_check_queue", ClusterEvents::GetCheckRequestQueueSize());
 	status->Set("current_pending_callbacks", Application::GetTP().GetPending());
 	status->Set("current_concurrent_checks", Checkable::CurrentConcurrentChecks.load());
+	status->Set("current_running_event_handlers", EventCommand::CurrentRunningExecutions.load());
+	status->Set("current_pending_event_handlers", EventCommand::CurrentPendingExecutions.load());
+	status->Set("coalesced_event_handlers", EventCommand::CoalescedExecutions.load());
 
 	CheckableCheckStatistics scs = CalculateServiceCheckStats();
 
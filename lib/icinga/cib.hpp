@@ -4,9 +4,11 @@
 #define CIB_H
 
 #include "icinga/i2-icinga.hpp"
+#include "icinga/checkable.hpp"
 #include "base/ringbuffer.hpp"
 #include "base/dictionary.hpp"
 #include "base/array.hpp"
+#include <mutex>
 
 namespace icinga
 {
@@ -50,6 +52,10 @@ struct HostStatistics {
  * Common Information Base class. Holds some statistics (and will likely be
  * removed/refactored).
  *
+ * The host and service statistics are counted as the objects change, the
+ * check statistics cover the check results of the last 15 minutes. So
+ * querying them doesn't look at any object.
+ *
  * @ingroup icinga
  */
 class CIB
@@ -76,10 +82,19 @@ public:
 
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
+	static void StaticInitialize();
+
 private:
 	CIB();
 
 	static std::mutex m_Mutex;
+	static HostStatistics m_HostStats;
+	static ServiceStatistics m_ServiceStats;
+
+	static uint_fast32_t GetStatisticsFlags(const Checkable::Ptr& checkable);
+	static bool UpdateStatistics(const Checkable::Ptr& checkable);
+	static void UpdateDescendantsStatistics(const Checkable::Ptr& checkable, int depth = 0);
+	static void ReconcileStatistics();
 	static RingBuffer m_ActiveHostChecksStatistics;
 	static RingBuffer m_PassiveHostChecksStatistics;
 	static RingBuffer m_ActiveServiceChecksStatistics;
@@ -7,8 +7,12 @@
 #include "base/defer.hpp"
 #include "base/serializer.hpp"
 #include "base/exception.hpp"
+#include "base/objectlock.hpp"
 #include <boost/thread/once.hpp>
+#include <algorithm>
+#include <map>
 #include <thread>
+#include <vector>
 
 using namespace icinga;
 
@@ -377,3 +381,220 @@ void ClusterEvents::LogRemoteCheckQueueInformation() {
 
 	m_ChecksExecutedDuringInterval = 0;
 }
+
+/**
+ * Check messages waiting to be sent to an endpoint as one batch.
+ */
+struct CheckMessageBatch
+{
+	double Window;
+	double Deadline;
+	std::vector<Dictionary::Ptr> Messages;
+};
+
+static std::mutex l_CheckBatchesMutex;
+static std::map<std::pair<String, String>, CheckMessageBatch> l_CheckBatches;
+
+/* The batch windows of the endpoints which sent us batched checks, by endpoint name. */
+static std::map<String, double> l_CheckResultBatchWindows;
+
+static Timer::Ptr l_CheckBatchTimer;
+
+static const size_t l_MaxCheckBatchSize = 500;
+
+static void SendCheckMessageBatch(const String& endpointName, const String& method, const CheckMessageBatch& batch)
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+	Endpoint::Ptr endpoint = Endpoint::GetByName(endpointName);
+
+	if (!listener || !endpoint)
+		return;
+
+	if (batch.Messages.size() == 1) {
+		listener->SyncSendMessage(endpoint, batch.Messages.front());
+		return;
+	}
+
+	ArrayData items;
+
+	for (auto& message : batch.Messages) {
+		Dictionary::Ptr item = new Dictionary({ { "params", message->Get("params") } });
+		Value trace;
+
+		if (message->Get("trace", &trace))
+			item->Set("trace", trace);
+
+		items.emplace_back(std::move(item));
+	}
+
+	Dictionary::Ptr params = new Dictionary({ { "items", new Array(std::move(items)) } });
+
+	/* Tells the agent to batch the results the same way. */
+	if (method == "event::ExecuteCommand")
+		params->Set("batch_window", batch.Window);
+
+	listener->SyncSendMessage(endpoint, new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", method + "s" },
+		{ "params", params }
+	}));
+}
+
+/**
+ * Sends an event::ExecuteCommand or event::CheckResult message for an agent check.
+ *
+ * The messages for an endpoint are collected for the ApiListener's check_batch_window
+ * and sent as one event::ExecuteCommands message if the endpoint supports it. An agent
+ * returns the results of batched checks as event::CheckResults messages, using the
+ * window of the endpoint which sent the checks.
+ *
+ * @param endpoint The endpoint to send the message to
+ * @param message The message
+ */
+void ClusterEvents::SendCheckMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message)
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener)
+		return;
+
+	String method = message->Get("method");
+	double window = 0;
+	CheckMessageBatch fullBatch;
+
+	{
+		std::unique_lock<std::mutex> lock (l_CheckBatchesMutex);
+
+		if (method == "event::ExecuteCommand") {
+			if (endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::BatchedCheckMessages)
+				window = listener->GetCheckBatchWindow();
+		} else if (method == "event::CheckResult") {
+			auto it (l_CheckResultBatchWindows.find(endpoint->GetName()));
+
+			if (it != l_CheckResultBatchWindows.end())
+				window = it->second;
+		}
+
+		if (window > 0) {
+			auto key (std::make_pair(endpoint->GetName(), method));
+			auto& batch (l_CheckBatches[key]);
+
+			if (batch.Messages.empty()) {
+				batch.Window = window;
+				batch.Deadline = Utility::GetTime() + window;
+			}
+
+			batch.Messages.push_back(message);
+
+			if (batch.Messages.size() >= l_MaxCheckBatchSize) {
+				fullBatch = std::move(batch);
+				l_CheckBatches.erase(key);
+			}
+
+			if (!l_CheckBatchTimer) {
+				l_CheckBatchTimer = new Timer();
+				l_CheckBatchTimer->SetInterval(0.1);
+				l_CheckBatchTimer->OnTimerExpired.connect([](const Timer * const&) { FlushCheckMessages(); });
+				l_CheckBatchTimer->Start();
+			}
+		}
+	}
+
+	if (window <= 0)
+		listener->SyncSendMessage(endpoint, message);
+	else if (!fullBatch.Messages.empty())
+		SendCheckMessageBatch(endpoint->GetName(), method, fullBatch);
+}
+
+/**
+ * Sends the batches of check messages whose window has passed.
+ */
+void ClusterEvents::FlushCheckMessages()
+{
+	std::vector<std::pair<std::pair<String, String>, CheckMessageBatch>> batches;
+
+	{
+		std::unique_lock<std::mutex> lock (l_CheckBatchesMutex);
+		double now = Utility::GetTime();
+
+		for (auto it (l_CheckBatches.begin()); it != l_CheckBatches.end();) {
+			if (it->second.Deadline <= now) {
+				batches.emplace_back(it->first, std::move(it->second));
+				it = l_CheckBatches.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	for (auto& batch : batches)
+		SendCheckMessageBatch(batch.first.first, batch.first.second, batch.second);
+}
+
+/**
+ * Invokes the handler for every message of a batch, see SendCheckMessage().
+ */
+void ClusterEvents::InvokeBatchedMessages(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params,
+	const std::function<Value (const MessageOrigin::Ptr&, const Dictionary::Ptr&)>& handler)
+{
+	Array::Ptr items = params->Get("items");
+
+	if (!items)
+		return;
+
+	ObjectLock olock(items);
+
+	for (const Value& vitem : items) {
+		try {
+			Dictionary::Ptr item = vitem;
+			Dictionary::Ptr itemParams = item->Get("params");
+
+			if (!itemParams)
+				continue;
+
+			MessageOrigin::Ptr itemOrigin = new MessageOrigin();
+			itemOrigin->FromZone = origin->FromZone;
+			itemOrigin->FromClient = origin->FromClient;
+
+			Value trace;
+
+			if (item->Get("trace", &trace))
+				itemOrigin->Trace = TraceContext::FromTraceparent(trace);
+
+			handler(itemOrigin, itemParams);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ClusterEvents")
+				<< "Error while processing batched message from '" << origin->FromClient->GetIdentity() << "'\n"
+				<< DiagnosticInformation(ex);
+		}
+	}
+}
+
+Value ClusterEvents::ExecuteCommandsAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	Endpoint::Ptr endpoint = origin->FromClient->GetEndpoint();
+
+	if (!endpoint) {
+		Log(LogNotice, "ClusterEvents")
+			<< "Discarding 'execute commands' message from '" << origin->FromClient->GetIdentity() << "': Invalid endpoint origin (client not allowed).";
+		return Empty;
+	}
+
+	double window = params->Get("batch_window");
+
+	{
+		std::unique_lock<std::mutex> lock (l_CheckBatchesMutex);
+		l_CheckResultBatchWindows[endpoint->GetName()] = std::min(std::max(window, 0.0), 10.0);
+	}
+
+	InvokeBatchedMessages(origin, params, &ClusterEvents::ExecuteCommandAPIHandler);
+
+	return Empty;
+}
+
+Value ClusterEvents::CheckResultsAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	InvokeBatchedMessages(origin, params, &ClusterEvents::CheckResultAPIHandler);
+
+	return Empty;
+}
@@ -0,0 +1,427 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/clusterevents.hpp"
+#include "icinga/service.hpp"
+#include "remote/apilistener.hpp"
+#include "remote/endpoint.hpp"
+#include "remote/zone.hpp"
+#include "base/configtype.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/objectlock.hpp"
+#include "base/timer.hpp"
+#include "base/utility.hpp"
+#include <boost/thread/once.hpp>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+using namespace icinga;
+
+/* Master side: The checks an agent schedules itself, by endpoint name. */
+struct AgentCheckSchedule
+{
+	JsonRpcConnection::Ptr Client;
+	double SentAt;
+	std::set<String> Checkables;
+};
+
+/* Agent side: A check scheduled on behalf of a parent endpoint. */
+struct LocalScheduledCheck
+{
+	Dictionary::Ptr Params;
+	double CheckInterval;
+	double RetryInterval;
+	double NextCheck;
+	bool Problem;
+};
+
+/* Agent side: The checks of a parent endpoint, by checkable name. */
+struct LocalCheckSchedule
+{
+	double ReceivedAt;
+	std::map<String, LocalScheduledCheck> Checks;
+};
+
+static std::mutex l_CheckSchedulesMutex;
+static std::map<String, AgentCheckSchedule> l_AgentCheckSchedules;
+static std::map<String, LocalCheckSchedule> l_LocalCheckSchedules;
+
+static Timer::Ptr l_AgentCheckScheduleTimer;
+static Timer::Ptr l_LocalCheckScheduleTimer;
+
+/* The master re-sends the schedules this often, picking up config changes. */
+static const double l_CheckScheduleRefreshInterval = 300;
+
+static JsonRpcConnection::Ptr GetNewestClient(const Endpoint::Ptr& endpoint)
+{
+	JsonRpcConnection::Ptr newest;
+
+	for (const JsonRpcConnection::Ptr& client : endpoint->GetClients()) {
+		if (!newest || client->GetTimestamp() > newest->GetTimestamp())
+			newest = client;
+	}
+
+	return newest;
+}
+
+static String GetCheckableName(const Dictionary::Ptr& params)
+{
+	String name = params->Get("host");
+
+	if (params->Contains("service"))
+		name += "!" + params->Get("service");
+
+	return name;
+}
+
+/**
+ * Whether the endpoint runs the checkable's check itself. The ApiListener's
+ * enable_agent_scheduling makes the master send the endpoint a schedule of all
+ * its command endpoint checks, see SendCheckSchedules(), instead of every check.
+ *
+ * @param checkable The checkable whose command endpoint is the endpoint
+ * @param endpoint The command endpoint
+ * @param since When the schedule was sent
+ * @return Whether the current connection of the endpoint got a schedule with the checkable
+ */
+bool ClusterEvents::IsCheckScheduledByAgent(const Checkable::Ptr& checkable, const Endpoint::Ptr& endpoint, double& since)
+{
+	static boost::once_flag once = BOOST_ONCE_INIT;
+
+	boost::call_once(once, []() {
+		l_AgentCheckScheduleTimer = new Timer();
+		l_AgentCheckScheduleTimer->SetInterval(10);
+		l_AgentCheckScheduleTimer->OnTimerExpired.connect([](const Timer * const&) { SendCheckSchedules(); });
+		l_AgentCheckScheduleTimer->Start();
+	});
+
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener || !listener->GetEnableAgentScheduling() || !endpoint->GetConnected())
+		return false;
+
+	JsonRpcConnection::Ptr client = GetNewestClient(endpoint);
+
+	std::unique_lock<std::mutex> lock (l_CheckSchedulesMutex);
+
+	auto it (l_AgentCheckSchedules.find(endpoint->GetName()));
+
+	if (it == l_AgentCheckSchedules.end() || it->second.Client != client
+		|| it->second.Checkables.find(checkable->GetName()) == it->second.Checkables.end())
+		return false;
+
+	since = it->second.SentAt;
+
+	return true;
+}
+
+static Dictionary::Ptr MakeCheckScheduleEntry(const Checkable::Ptr& checkable)
+{
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	/* Like Checkable::ExecuteCheck(), resolve the macros without executing the command. */
+	Dictionary::Ptr macros = new Dictionary();
+	checkable->GetCheckCommand()->Execute(checkable, new CheckResult(), macros, false);
+
+	Dictionary::Ptr params = new Dictionary({
+		{ "command_type", "check_command" },
+		{ "command", checkable->GetCheckCommand()->GetName() },
+		{ "host", host->GetName() },
+		{ "macros", macros }
+	});
+
+	if (service)
+		params->Set("service", service->GetShortName());
+
+	if (!checkable->GetCheckTimeout().IsEmpty())
+		params->Set("check_timeout", checkable->GetCheckTimeout());
+
+	return new Dictionary({
+		{ "params", params },
+		{ "check_interval", checkable->GetCheckInterval() },
+		{ "retry_interval", checkable->GetRetryInterval() },
+		{ "next_check", checkable->GetNextCheck() }
+	});
+}
+
+/**
+ * Sends the schedule of their checks to the endpoints which support scheduling
+ * checks themselves, once per connection and every l_CheckScheduleRefreshInterval.
+ *
+ * The macros are resolved when the schedule is sent, so e.g. $service.state$
+ * is up to l_CheckScheduleRefreshInterval old.
+ */
+void ClusterEvents::SendCheckSchedules()
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener || !listener->GetEnableAgentScheduling())
+		return;
+
+	double now = Utility::GetTime();
+	std::map<Endpoint::Ptr, JsonRpcConnection::Ptr> due;
+
+	for (const Endpoint::Ptr& endpoint : ConfigType::GetObjectsByType<Endpoint>()) {
+		if (endpoint == Endpoint::GetLocalEndpoint() || !endpoint->GetConnected()
+			|| !(endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::LocalCheckScheduling))
+			continue;
+
+		JsonRpcConnection::Ptr client = GetNewestClient(endpoint);
+
+		if (!client)
+			continue;
+
+		std::unique_lock<std::mutex> lock (l_CheckSchedulesMutex);
+		auto it (l_AgentCheckSchedules.find(endpoint->GetName()));
+
+		if (it == l_AgentCheckSchedules.end() || it->second.Client != client || it->second.SentAt < now - l_CheckScheduleRefreshInterval)
+			due.emplace(endpoint, client);
+	}
+
+	if (due.empty())
+		return;
+
+	std::map<Endpoint::Ptr, ArrayData> checks;
+	std::map<Endpoint::Ptr, std::set<String>> checkables;
+
+	auto addCheckable ([&due, &checks, &checkables](const Checkable::Ptr& checkable) {
+		Endpoint::Ptr endpoint = checkable->GetCommandEndpoint();
+
+		if (!endpoint || due.find(endpoint) == due.end() || !checkable->IsActive() || checkable->IsPaused()
+			|| !checkable->GetEnableActiveChecks())
+			return;
+
+		try {
+			checks[endpoint].emplace_back(MakeCheckScheduleEntry(checkable));
+			checkables[endpoint].insert(checkable->GetName());
+		} catch (const std::exception& ex) {
+			/* The master keeps scheduling this one. */
+			Log(LogWarning, "ClusterEvents")
+				<< "Can't add checkable '" << checkable->GetName() << "' to the schedule of endpoint '"
+				<< endpoint->GetName() << "': " << DiagnosticInformation(ex, false);
+		}
+	});
+
+	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>())
+		addCheckable(host);
+
+	for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>())
+		addCheckable(service);
+
+	for (auto& kv : due) {
+		const Endpoint::Ptr& endpoint = kv.first;
+		auto& endpointChecks (checks[endpoint]);
+		size_t count = endpointChecks.size();
+
+		Dictionary::Ptr message = new Dictionary({
+			{ "jsonrpc", "2.0" },
+			{ "method", "event::SetCheckSchedule" },
+			{ "params", new Dictionary({
+				{ "checks", new Array(std::move(endpointChecks)) }
+			}) }
+		});
+
+		listener->SyncSendMessage(endpoint, message);
+
+		{
+			std::unique_lock<std::mutex> lock (l_CheckSchedulesMutex);
+			auto& schedule (l_AgentCheckSchedules[endpoint->GetName()]);
+
+			schedule.Client = kv.second;
+			schedule.SentAt = now;
+			schedule.Checkables = std::move(checkables[endpoint]);
+		}
+
+		Log(LogNotice, "ClusterEvents")
+			<< "Sent the schedule of " << count << " checks to endpoint '" << endpoint->GetName() << "'.";
+	}
+}
+
+/**
+ * Replaces the checks the sending endpoint wants us to schedule, see SendCheckSchedules().
+ */
+Value ClusterEvents::SetCheckScheduleAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	Endpoint::Ptr endpoint = origin->FromClient->GetEndpoint();
+
+	if (!endpoint || (origin->FromZone && !Zone::GetLocalZone()->IsChildOf(origin->FromZone))) {
+		Log(LogNotice, "ClusterEvents")
+			<< "Discarding 'set check schedule' message from '" << origin->FromClient->GetIdentity() << "': Invalid endpoint origin (client not allowed).";
+		return Empty;
+	}
+
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener)
+		return Empty;
+
+	if (!listener->GetAcceptCommands()) {
+		Log(LogWarning, "ClusterEvents")
+			<< "Ignoring check schedule from endpoint '" << endpoint->GetName() << "'. '" << listener->GetName() << "' does not accept commands.";
+		return Empty;
+	}
+
+	Array::Ptr checks = params->Get("checks");
+
+	if (!checks)
+		return Empty;
+
+	double now = Utility::GetTime();
+	LocalCheckSchedule schedule;
+	schedule.ReceivedAt = now;
+
+	{
+		ObjectLock olock(checks);
+
+		for (const Dictionary::Ptr& check : checks) {
+			Dictionary::Ptr checkParams = check->Get("params");
+
+			if (!checkParams)
+				continue;
+
+			LocalScheduledCheck entry;
+			entry.Params = checkParams;
+			entry.CheckInterval = std::max(1.0, static_cast<double>(check->Get("check_interval")));
+			entry.RetryInterval = std::max(1.0, static_cast<double>(check->Get("retry_interval")));
+			entry.Problem = false;
+
+			/* Keep the phase of the master, spread out the overdue checks. */
+			double nextCheck = check->Get("next_check");
+
+			if (nextCheck < now || nextCheck > now + entry.CheckInterval)
+				nextCheck = now + Utility::Random() % static_cast<int>(entry.CheckInterval);
+
+			entry.NextCheck = nextCheck;
+
+			schedule.Checks.emplace(GetCheckableName(checkParams), std::move(entry));
+		}
+	}
+
+	size_t count = schedule.Checks.size();
+
+	{
+		std::unique_lock<std::mutex> lock (l_CheckSchedulesMutex);
+		auto& current (l_LocalCheckSchedules[endpoint->GetName()]);
+
+		/* A refreshed schedule doesn't restart the checks. */
+		for (auto& kv : schedule.Checks) {
+			auto it (current.Checks.find(kv.first));
+
+			if (it != current.Checks.end()) {
+				kv.second.NextCheck = std::min(it->second.NextCheck, now + kv.second.CheckInterval);
+				kv.second.Problem = it->second.Problem;
+			}
+		}
+
+		current = std::move(schedule);
+
+		if (!l_LocalCheckScheduleTimer) {
+			l_LocalCheckScheduleTimer = new Timer();
+			l_LocalCheckScheduleTimer->SetInterval(1);
+			l_LocalCheckScheduleTimer->OnTimerExpired.connect([](const Timer * const&) { RunLocalCheckSchedules(); });
+			l_LocalCheckScheduleTimer->Start();
+		}
+	}
+
+	Log(LogInformation, "ClusterEvents")
+		<< "Scheduling " << count << " checks for endpoint '" << endpoint->GetName() << "' locally.";
+
+	return Empty;
+}
+
+/**
+ * Enqueues the due checks of all local schedules like event::ExecuteCommand
+ * messages, their results are sent to the endpoint which sent the schedule.
+ */
+void ClusterEvents::RunLocalCheckSchedules()
+{
+	std::vector<std::pair<String, Dictionary::Ptr>> due;
+
+	{
+		std::unique_lock<std::mutex> lock (l_CheckSchedulesMutex);
+		double now = Utility::GetTime();
+
+		for (auto it (l_LocalCheckSchedules.begin()); it != l_LocalCheckSchedules.end();) {
+			/* The endpoint doesn't want us to schedule its checks anymore. */
+			if (it->second.ReceivedAt < now - 3 * l_CheckScheduleRefreshInterval) {
+				Log(LogInformation, "ClusterEvents")
+					<< "The check schedule of endpoint '" << it->first << "' expired.";
+
+				it = l_LocalCheckSchedules.erase(it);
+				continue;
+			}
+
+			for (auto& kv : it->second.Checks) {
+				LocalScheduledCheck& check (kv.second);
+
+				if (check.NextCheck > now)
+					continue;
+
+				check.NextCheck = now + (check.Problem ? check.RetryInterval : check.CheckInterval);
+				due.emplace_back(it->first, check.Params);
+			}
+
+			++it;
+		}
+	}
+
+	for (auto& check : due) {
+		Endpoint::Ptr endpoint = Endpoint::GetByName(check.first);
+
+		if (!endpoint)
+			continue;
+
+		/* The result couldn't be sent anyway. */
+		JsonRpcConnection::Ptr client = GetNewestClient(endpoint);
+
+		if (!client)
+			continue;
+
+		MessageOrigin::Ptr origin = new MessageOrigin();
+		origin->FromClient = client;
+		origin->FromZone = endpoint->GetZone();
+
+		EnqueueCheck(origin, check.second);
+	}
+}
+
+/**
+ * Schedules the next run of a locally scheduled check with its retry interval
+ * if the check result is a problem.
+ *
+ * @param endpoint The endpoint the check result is sent to
+ * @param message The event::CheckResult message
+ */
+void ClusterEvents::LocalScheduledCheckFinished(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message)
+{
+	Dictionary::Ptr params = message->Get("params");
+	Dictionary::Ptr cr = params->Get("cr");
+
+	if (!cr)
+		return;
+
+	bool problem = static_cast<int>(cr->Get("state")) != ServiceOK;
+
+	std::unique_lock<std::mutex> lock (l_CheckSchedulesMutex);
+	auto schedule (l_LocalCheckSchedules.find(endpoint->GetName()));
+
+	if (schedule == l_LocalCheckSchedules.end())
+		return;
+
+	auto it (schedule->second.Checks.find(GetCheckableName(params)));
+
+	if (it == schedule->second.Checks.end())
+		return;
+
+	LocalScheduledCheck& check (it->second);
+
+	if (problem && !check.Problem)
+		check.NextCheck = std::min(check.NextCheck, Utility::GetTime() + check.RetryInterval);
+
+	check.Problem = problem;
+}
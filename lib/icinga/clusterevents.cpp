@@ -16,12 +16,28 @@
 #include "base/initialize.hpp"
 #include "base/serializer.hpp"
 #include "base/json.hpp"
+#include "base/defer.hpp"
+#include "base/timer.hpp"
 #include <fstream>
+#include <map>
+#include <mutex>
 
 using namespace icinga;
 
 INITIALIZE_ONCE(&ClusterEvents::StaticInitialize);
 
+/* SetNextCheck messages wait up to this long, so a check result or a later change of the same object supersedes them. */
+static const double l_NextCheckDelay = 1;
+
+static std::mutex l_PendingNextChecksMutex;
+static std::map<Checkable::Ptr, MessageOrigin::Ptr> l_PendingNextChecks;
+static Timer::Ptr l_PendingNextChecksTimer;
+
+/* Set while a check result message with a next check is processed. The relayed check result carries
+ * the sender's next check on, the next check changes of that checkable meanwhile aren't relayed. */
+static thread_local Checkable *l_CheckResultCheckable = nullptr;
+static thread_local double l_CheckResultNextCheck = 0;
+
 REGISTER_APIFUNCTION(CheckResult, event, &ClusterEvents::CheckResultAPIHandler);
 REGISTER_APIFUNCTION(SetNextCheck, event, &ClusterEvents::NextCheckChangedAPIHandler);
 REGISTER_APIFUNCTION(SetLastCheckStarted, event, &ClusterEvents::LastCheckStartedChangedAPIHandler);
@@ -33,6 +49,9 @@ REGISTER_APIFUNCTION(SetForceNextNotification, event, &ClusterEvents::ForceNextN
 REGISTER_APIFUNCTION(SetAcknowledgement, event, &ClusterEvents::AcknowledgementSetAPIHandler);
 REGISTER_APIFUNCTION(ClearAcknowledgement, event, &ClusterEvents::AcknowledgementClearedAPIHandler);
 REGISTER_APIFUNCTION(ExecuteCommand, event, &ClusterEvents::ExecuteCommandAPIHandler);
+REGISTER_APIFUNCTION(ExecuteCommands, event, &ClusterEvents::ExecuteCommandsAPIHandler);
+REGISTER_APIFUNCTION(CheckResults, event, &ClusterEvents::CheckResultsAPIHandler);
+REGISTER_APIFUNCTION(SetCheckSchedule, event, &ClusterEvents::SetCheckScheduleAPIHandler);
 REGISTER_APIFUNCTION(SendNotifications, event, &ClusterEvents::SendNotificationsAPIHandler);
 REGISTER_APIFUNCTION(NotificationSentUser, event, &ClusterEvents::NotificationSentUserAPIHandler);
 REGISTER_APIFUNCTION(NotificationSentToAllUsers, event, &ClusterEvents::NotificationSentToAllUsersAPIHandler);
@@ -77,7 +96,7 @@ Dictionary::Ptr ClusterEvents::MakeCheckResultMessage(const Checkable::Ptr& chec
 		if (!agent_service_name.IsEmpty())
 			params->Set("service", agent_service_name);
 	}
-	params->Set("cr", Serialize(cr));
+	params->Set("cr", cr->GetSerialized());
 
 	message->Set("params", params);
 
@@ -91,7 +110,22 @@ void ClusterEvents::CheckResultHandler(const Checkable::Ptr& checkable, const Ch
 	if (!listener)
 		return;
 
+	/* The check result message implies the next check, a pending SetNextCheck message would be redundant. */
+	{
+		std::unique_lock<std::mutex> lock (l_PendingNextChecksMutex);
+		l_PendingNextChecks.erase(checkable);
+	}
+
 	Dictionary::Ptr message = MakeCheckResultMessage(checkable, cr);
+
+	/* A relayed check result passes the sender's next check on, not the one we've calculated meanwhile. */
+	Dictionary::Ptr params = message->Get("params");
+	params->Set("next_check", checkable.get() == l_CheckResultCheckable ? l_CheckResultNextCheck : checkable->GetNextCheck());
+
+	/* Like "ts" this is metadata of the message, the check result doesn't know about it. */
+	if (cr->GetTraceContext().IsValid())
+		message->Set("trace", cr->GetTraceContext().ToTraceparent());
+
 	listener->RelayMessage(origin, checkable, message, true);
 }
 
@@ -125,6 +159,8 @@ Value ClusterEvents::CheckResultAPIHandler(const MessageOrigin::Ptr& origin, con
 	if (!cr)
 		return Empty;
 
+	cr->SetTraceContext(origin->Trace);
+
 	ArrayData rperf;
 
 	if (vperf) {
@@ -165,15 +201,69 @@ Value ClusterEvents::CheckResultAPIHandler(const MessageOrigin::Ptr& origin, con
 		return Empty;
 	}
 
-	if (!checkable->IsPaused() && Zone::GetLocalZone() == checkable->GetZone() && endpoint == checkable->GetCommandEndpoint())
+	if (!checkable->IsPaused() && Zone::GetLocalZone() == checkable->GetZone() && endpoint == checkable->GetCommandEndpoint()) {
 		checkable->ProcessCheckResult(cr);
-	else
-		checkable->ProcessCheckResult(cr, origin);
+	} else {
+		/* Senders which fold the next check into the check result don't send a SetNextCheck message for it. */
+		double nextCheck = params->Contains("next_check") ? static_cast<double>(params->Get("next_check")) : 0;
+
+		if (nextCheck < Application::GetStartTime() + 60) {
+			checkable->ProcessCheckResult(cr, origin);
+		} else {
+			l_CheckResultCheckable = checkable.get();
+			l_CheckResultNextCheck = nextCheck;
+
+			Defer resetNextCheck ([]() {
+				l_CheckResultCheckable = nullptr;
+				l_CheckResultNextCheck = 0;
+			});
+
+			checkable->ProcessCheckResult(cr, origin);
+
+			/* Replaces the next check ProcessCheckResult() has calculated based on our own scheduling offset. */
+			checkable->SetNextCheck(nextCheck, false, origin);
+		}
+	}
 
 	return Empty;
 }
 
+/**
+ * Relays the next check once per l_NextCheckDelay at most, unless a check result
+ * message for the same object is sent in the meantime.
+ */
 void ClusterEvents::NextCheckChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin)
+{
+	if (checkable.get() == l_CheckResultCheckable || !ApiListener::GetInstance())
+		return;
+
+	std::unique_lock<std::mutex> lock (l_PendingNextChecksMutex);
+
+	/* The latest change wins, it's sent with the next check at that time anyway. */
+	l_PendingNextChecks[checkable] = origin;
+
+	if (!l_PendingNextChecksTimer) {
+		l_PendingNextChecksTimer = new Timer();
+		l_PendingNextChecksTimer->SetInterval(l_NextCheckDelay);
+		l_PendingNextChecksTimer->OnTimerExpired.connect([](const Timer * const&) { FlushNextChecks(); });
+		l_PendingNextChecksTimer->Start();
+	}
+}
+
+void ClusterEvents::FlushNextChecks()
+{
+	std::map<Checkable::Ptr, MessageOrigin::Ptr> pending;
+
+	{
+		std::unique_lock<std::mutex> lock (l_PendingNextChecksMutex);
+		pending.swap(l_PendingNextChecks);
+	}
+
+	for (auto& kv : pending)
+		SendNextCheck(kv.first, kv.second);
+}
+
+void ClusterEvents::SendNextCheck(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin)
 {
 	ApiListener::Ptr listener = ApiListener::GetInstance();
 
@@ -893,7 +983,7 @@ void ClusterEvents::NotificationSentUserHandler(const Notification::Ptr& notific
 	params->Set("notification", notification->GetName());
 	params->Set("user", user->GetName());
 	params->Set("type", notificationType);
-	params->Set("cr", Serialize(cr));
+	params->Set("cr", cr ? cr->GetSerialized() : nullptr);
 	params->Set("author", author);
 	params->Set("text", commentText);
 	params->Set("command", command);
@@ -1001,7 +1091,7 @@ void ClusterEvents::NotificationSentToAllUsersHandler(const Notification::Ptr& n
 	params->Set("users", new Array(std::move(ausers)));
 
 	params->Set("type", notificationType);
-	params->Set("cr", Serialize(cr));
+	params->Set("cr", cr ? cr->GetSerialized() : nullptr);
 	params->Set("author", author);
 	params->Set("text", commentText);
 
@@ -1201,6 +1291,7 @@ Value ClusterEvents::ExecutedCommandAPIHandler(const MessageOrigin::Ptr& origin,
 		execution->Set("end", params->Get("end"));
 
 	execution->Remove("pending");
+	checkable->MarkStateDirty();
 
 	/* Broadcast the update */
 	Dictionary::Ptr executionsToBroadcast = new Dictionary();
@@ -52,6 +52,14 @@ public:
 	static Value AcknowledgementClearedAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 
 	static Value ExecuteCommandAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static Value ExecuteCommandsAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static Value CheckResultsAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+
+	static void SendCheckMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message);
+
+	static bool IsCheckScheduledByAgent(const Checkable::Ptr& checkable, const Endpoint::Ptr& endpoint, double& since);
+	static void LocalScheduledCheckFinished(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message);
+	static Value SetCheckScheduleAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 
 	static Dictionary::Ptr MakeCheckResultMessage(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
 
@@ -83,6 +91,13 @@ private:
 	static void RemoteCheckThreadProc();
 	static void EnqueueCheck(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 	static void ExecuteCheckFromQueue(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static void FlushCheckMessages();
+	static void SendNextCheck(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin);
+	static void FlushNextChecks();
+	static void InvokeBatchedMessages(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params,
+		const std::function<Value (const MessageOrigin::Ptr&, const Dictionary::Ptr&)>& handler);
+	static void SendCheckSchedules();
+	static void RunLocalCheckSchedules();
 };
 
 }
@@ -66,3 +66,34 @@ void Command::Validate(int types, const ValidationUtils& utils)
 		}
 	}
 }
+
+/**
+ * Returns the compiled form of the "arguments" attribute.
+ *
+ * Updates always replace the attribute's dictionary (ModifyAttribute()
+ * clones it), so a template whose source differs from the current value
+ * is stale and gets compiled again.
+ *
+ * @returns The compiled arguments, nullptr if the command has none.
+ */
+std::shared_ptr<const CommandArgumentsTemplate> Command::GetArgumentsTemplate()
+{
+	Dictionary::Ptr arguments = GetArguments();
+
+	if (!arguments)
+		return nullptr;
+
+	{
+		std::unique_lock<std::mutex> lock (m_ArgumentsTemplateMutex);
+
+		if (m_ArgumentsTemplate && m_ArgumentsTemplate->Source == arguments)
+			return m_ArgumentsTemplate;
+	}
+
+	auto tmpl (MacroProcessor::CompileArguments(arguments));
+
+	std::unique_lock<std::mutex> lock (m_ArgumentsTemplateMutex);
+	m_ArgumentsTemplate = tmpl;
+
+	return tmpl;
+}
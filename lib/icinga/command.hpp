@@ -6,10 +6,14 @@
 #include "icinga/i2-icinga.hpp"
 #include "icinga/command-ti.hpp"
 #include "remote/messageorigin.hpp"
+#include <memory>
+#include <mutex>
 
 namespace icinga
 {
 
+struct CommandArgumentsTemplate;
+
 /**
  * A command.
  *
@@ -23,6 +27,12 @@ public:
 	//virtual Dictionary::Ptr Execute(const Object::Ptr& context) = 0;
 
 	void Validate(int types, const ValidationUtils& utils) override;
+
+	std::shared_ptr<const CommandArgumentsTemplate> GetArgumentsTemplate();
+
+private:
+	std::mutex m_ArgumentsTemplateMutex;
+	std::shared_ptr<const CommandArgumentsTemplate> m_ArgumentsTemplate;
 };
 
 }
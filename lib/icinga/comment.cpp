@@ -3,10 +3,11 @@
 #include "icinga/comment.hpp"
 #include "icinga/comment-ti.cpp"
 #include "icinga/host.hpp"
+#include "icinga/deadlinescheduler.hpp"
 #include "remote/configobjectutility.hpp"
+#include "remote/runtimeobjectstore.hpp"
 #include "base/utility.hpp"
 #include "base/configtype.hpp"
-#include "base/timer.hpp"
 #include <boost/thread/once.hpp>
 
 using namespace icinga;
@@ -14,7 +15,21 @@ using namespace icinga;
 static int l_NextCommentID = 1;
 static std::mutex l_CommentMutex;
 static std::map<int, String> l_LegacyCommentsCache;
-static Timer::Ptr l_CommentsExpireTimer;
+
+static void ScheduleCommentExpiry(const Comment::Ptr& comment);
+
+static DeadlineScheduler l_CommentsExpiry ([](const ConfigObject::Ptr& object) {
+	Comment::Ptr comment = static_pointer_cast<Comment>(object);
+
+	if (!comment->IsActive())
+		return;
+
+	/* Only remove comments which are activated after daemon start. */
+	if (comment->IsExpired())
+		Comment::RemoveComment(comment->GetName());
+	else
+		ScheduleCommentExpiry(comment);
+});
 
 boost::signals2::signal<void (const Comment::Ptr&)> Comment::OnCommentAdded;
 boost::signals2::signal<void (const Comment::Ptr&)> Comment::OnCommentRemoved;
@@ -79,11 +94,10 @@ void Comment::Start(bool runtimeCreated)
 
 	static boost::once_flag once = BOOST_ONCE_INIT;
 
-	boost::call_once(once, [this]() {
-		l_CommentsExpireTimer = new Timer();
-		l_CommentsExpireTimer->SetInterval(60);
-		l_CommentsExpireTimer->OnTimerExpired.connect(std::bind(&Comment::CommentsExpireTimerHandler));
-		l_CommentsExpireTimer->Start();
+	boost::call_once(once, []() {
+		Comment::OnExpireTimeChanged.connect([](const Comment::Ptr& comment, const Value&) {
+			ScheduleCommentExpiry(comment);
+		});
 	});
 
 	{
@@ -96,6 +110,8 @@ void Comment::Start(bool runtimeCreated)
 
 	GetCheckable()->RegisterComment(this);
 
+	ScheduleCommentExpiry(this);
+
 	if (runtimeCreated)
 		OnCommentAdded(this);
 }
@@ -104,6 +120,8 @@ void Comment::Stop(bool runtimeRemoved)
 {
 	GetCheckable()->UnregisterComment(this);
 
+	l_CommentsExpiry.Unschedule(this);
+
 	if (runtimeRemoved)
 		OnCommentRemoved(this);
 
@@ -161,11 +179,9 @@ String Comment::AddComment(const Checkable::Ptr& checkable, CommentType entryTyp
 	if (!zone.IsEmpty())
 		attrs->Set("zone", zone);
 
-	String config = ConfigObjectUtility::CreateObjectConfig(Comment::TypeInstance, fullName, true, nullptr, attrs);
-
 	Array::Ptr errors = new Array();
 
-	if (!ConfigObjectUtility::CreateObject(Comment::TypeInstance, fullName, config, errors, nullptr)) {
+	if (!RuntimeObjectStore::CreateObjects(Comment::TypeInstance, { { fullName, attrs } }, errors, nullptr)) {
 		ObjectLock olock(errors);
 		for (const String& error : errors) {
 			Log(LogCritical, "Comment", error);
@@ -219,22 +235,13 @@ String Comment::GetCommentIDFromLegacyID(int id)
 	return it->second;
 }
 
-void Comment::CommentsExpireTimerHandler()
+static void ScheduleCommentExpiry(const Comment::Ptr& comment)
 {
-	std::vector<Comment::Ptr> comments;
-
-	for (const Comment::Ptr& comment : ConfigType::GetObjectsByType<Comment>()) {
-		comments.push_back(comment);
-	}
+	double expireTime = 0;
 
-	for (const Comment::Ptr& comment : comments) {
-		/* Only remove comments which are activated after daemon start. */
-		if (comment->IsActive() && comment->IsExpired()) {
-			/* Do not remove persistent comments from an acknowledgement */
-			if (comment->GetEntryType() == CommentAcknowledgement && comment->GetPersistent())
-				continue;
+	/* Do not remove persistent comments from an acknowledgement */
+	if (comment->IsActive() && !(comment->GetEntryType() == CommentAcknowledgement && comment->GetPersistent()))
+		expireTime = comment->GetExpireTime();
 
-			RemoveComment(comment->GetName());
-		}
-	}
+	l_CommentsExpiry.Schedule(comment, expireTime);
 }
@@ -46,8 +46,6 @@ protected:
 
 private:
 	ObjectImpl<Checkable>::Ptr m_Checkable;
-
-	static void CommentsExpireTimerHandler();
 };
 
 }
@@ -0,0 +1,197 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/compatlogindex.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace icinga;
+
+static const char l_CompatLogIndexMagic[8] = { 'I', '2', 'C', 'L', 'I', 'D', 'X', '\1' };
+
+bool CompatLogIndexBlock::Overlaps(int64_t from, int64_t until) const
+{
+	return LastTime >= from && FirstTime <= until;
+}
+
+bool CompatLogIndexBlock::MayContainHost(uint32_t hash) const
+{
+	return std::binary_search(HostHashes.begin(), HostHashes.end(), hash);
+}
+
+String CompatLogIndex::GetIndexPath(const String& logPath)
+{
+	return logPath + ".idx";
+}
+
+/**
+ * Hashes a host name for the index (FNV-1a). The hash has to be stable
+ * across versions and platforms as it is stored on disk.
+ *
+ * @param hostName The host name.
+ * @returns The hash.
+ */
+uint32_t CompatLogIndex::HashHostName(const String& hostName)
+{
+	uint32_t hash = 2166136261u;
+
+	for (char ch : hostName) {
+		hash ^= static_cast<unsigned char>(ch);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * Reads all blocks from an index file. Truncated records at the end of the
+ * file (e.g. after a crash) are ignored.
+ *
+ * @param indexPath The path of the index file.
+ * @param blocks Receives the blocks ordered by their offset.
+ * @returns false if the file doesn't exist or isn't an index file
+ */
+bool CompatLogIndex::ReadIndex(const String& indexPath, std::vector<CompatLogIndexBlock>& blocks)
+{
+	std::ifstream fp (indexPath.CStr(), std::ifstream::in | std::ifstream::binary);
+
+	char magic[sizeof(l_CompatLogIndexMagic)];
+
+	if (!fp.read(magic, sizeof(magic)) || memcmp(magic, l_CompatLogIndexMagic, sizeof(magic)) != 0)
+		return false;
+
+	for (;;) {
+		CompatLogIndexBlock block;
+		uint32_t count;
+
+		if (!fp.read(reinterpret_cast<char *>(&block.Offset), sizeof(block.Offset)) ||
+			!fp.read(reinterpret_cast<char *>(&block.Length), sizeof(block.Length)) ||
+			!fp.read(reinterpret_cast<char *>(&block.FirstTime), sizeof(block.FirstTime)) ||
+			!fp.read(reinterpret_cast<char *>(&block.LastTime), sizeof(block.LastTime)) ||
+			!fp.read(reinterpret_cast<char *>(&block.Lines), sizeof(block.Lines)) ||
+			!fp.read(reinterpret_cast<char *>(&count), sizeof(count)))
+			break;
+
+		/* A block can't have more hosts than lines. */
+		if (count > block.Lines)
+			break;
+
+		block.HostHashes.resize(count);
+
+		if (count > 0 && !fp.read(reinterpret_cast<char *>(&block.HostHashes[0]), count * sizeof(uint32_t)))
+			break;
+
+		/* Blocks are appended in the order they were written. */
+		if (!blocks.empty() && block.Offset < blocks.back().Offset + blocks.back().Length)
+			break;
+
+		blocks.emplace_back(std::move(block));
+	}
+
+	return true;
+}
+
+CompatLogIndexWriter::~CompatLogIndexWriter()
+{
+	Close();
+}
+
+/**
+ * Opens the index file for a log file which is about to be appended to.
+ *
+ * @param logPath The path of the log file.
+ * @param logSize The current size of the log file.
+ */
+void CompatLogIndexWriter::Open(const String& logPath, uint64_t logSize)
+{
+	Close();
+
+	String indexPath = CompatLogIndex::GetIndexPath(logPath);
+
+	std::vector<CompatLogIndexBlock> blocks;
+	bool valid = CompatLogIndex::ReadIndex(indexPath, blocks);
+
+	/* Start over if the index belongs to a previous log file. */
+	if (valid && !blocks.empty() && blocks.back().Offset + blocks.back().Length > logSize)
+		valid = false;
+
+	if (valid) {
+		m_File.open(indexPath.CStr(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
+	} else {
+		m_File.open(indexPath.CStr(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+		m_File.write(l_CompatLogIndexMagic, sizeof(l_CompatLogIndexMagic));
+	}
+
+	m_Offset = logSize;
+	m_Block = CompatLogIndexBlock();
+	m_Block.Offset = logSize;
+	m_BlockHosts.clear();
+}
+
+/**
+ * Writes the current block and closes the index file.
+ */
+void CompatLogIndexWriter::Close()
+{
+	if (!m_File.is_open())
+		return;
+
+	WriteBlock();
+
+	m_File.close();
+}
+
+/**
+ * Adds a line which has been written to the log file.
+ *
+ * @param length The length of the line including the line break.
+ * @param ts The line's timestamp.
+ * @param hostName The host the line refers to, if any.
+ */
+void CompatLogIndexWriter::AddLine(uint64_t length, int64_t ts, const String& hostName)
+{
+	if (!m_File.is_open())
+		return;
+
+	if (m_Block.Lines == 0) {
+		m_Block.FirstTime = ts;
+		m_Block.LastTime = ts;
+	}
+
+	m_Block.FirstTime = std::min(m_Block.FirstTime, ts);
+	m_Block.LastTime = std::max(m_Block.LastTime, ts);
+	m_Block.Length += length;
+
+	if (!hostName.IsEmpty())
+		m_BlockHosts.insert(CompatLogIndex::HashHostName(hostName));
+
+	m_Offset += length;
+
+	if (++m_Block.Lines >= BlockLines)
+		WriteBlock();
+}
+
+void CompatLogIndexWriter::WriteBlock()
+{
+	if (m_Block.Lines > 0 && m_File.good()) {
+		/* std::set is ordered, so are the hashes. */
+		m_Block.HostHashes.assign(m_BlockHosts.begin(), m_BlockHosts.end());
+
+		uint32_t count = m_Block.HostHashes.size();
+
+		m_File.write(reinterpret_cast<const char *>(&m_Block.Offset), sizeof(m_Block.Offset));
+		m_File.write(reinterpret_cast<const char *>(&m_Block.Length), sizeof(m_Block.Length));
+		m_File.write(reinterpret_cast<const char *>(&m_Block.FirstTime), sizeof(m_Block.FirstTime));
+		m_File.write(reinterpret_cast<const char *>(&m_Block.LastTime), sizeof(m_Block.LastTime));
+		m_File.write(reinterpret_cast<const char *>(&m_Block.Lines), sizeof(m_Block.Lines));
+		m_File.write(reinterpret_cast<const char *>(&count), sizeof(count));
+
+		if (count > 0)
+			m_File.write(reinterpret_cast<const char *>(&m_Block.HostHashes[0]), count * sizeof(uint32_t));
+
+		m_File.flush();
+	}
+
+	m_Block = CompatLogIndexBlock();
+	m_Block.Offset = m_Offset;
+	m_BlockHosts.clear();
+}
@@ -0,0 +1,93 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef COMPATLOGINDEX_H
+#define COMPATLOGINDEX_H
+
+#include "icinga/i2-icinga.hpp"
+#include "base/string.hpp"
+#include <cstdint>
+#include <fstream>
+#include <set>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A range of lines in a compat log file.
+ *
+ * @ingroup icinga
+ */
+struct CompatLogIndexBlock
+{
+	uint64_t Offset{0};
+	uint64_t Length{0};
+	int64_t FirstTime{0};
+	int64_t LastTime{0};
+	uint32_t Lines{0};
+	std::vector<uint32_t> HostHashes; /**< sorted, see CompatLogIndex::HashHostName() */
+
+	bool Overlaps(int64_t from, int64_t until) const;
+	bool MayContainHost(uint32_t hash) const;
+};
+
+/**
+ * Sidecar index for compat log files (the log file's path + ".idx").
+ *
+ * The index file starts with an 8 byte header (magic and version) which is
+ * followed by one record per block of lines: uint64 offset, uint64 length,
+ * int64 first and last timestamp, uint32 number of lines, uint32 number
+ * of host name hashes and the hashes themselves. Numbers are stored in host byte order.
+ *
+ * Blocks may not cover the whole log file, e.g. when the log file was
+ * written by an older version or if the process crashed before the block
+ * was complete. Readers have to read those parts of the log file completely.
+ *
+ * @ingroup icinga
+ */
+class CompatLogIndex
+{
+public:
+	static String GetIndexPath(const String& logPath);
+	static uint32_t HashHostName(const String& hostName);
+
+	static bool ReadIndex(const String& indexPath, std::vector<CompatLogIndexBlock>& blocks);
+
+private:
+	CompatLogIndex();
+};
+
+/**
+ * Appends blocks to a compat log index while the log file is written.
+ *
+ * @ingroup icinga
+ */
+class CompatLogIndexWriter
+{
+public:
+	static const size_t BlockLines = 256;
+
+	CompatLogIndexWriter() = default;
+	~CompatLogIndexWriter();
+
+	CompatLogIndexWriter(const CompatLogIndexWriter&) = delete;
+	CompatLogIndexWriter& operator=(const CompatLogIndexWriter&) = delete;
+
+	void Open(const String& logPath, uint64_t logSize);
+	void Close();
+
+	void AddLine(uint64_t length, int64_t ts, const String& hostName);
+
+private:
+	std::ofstream m_File;
+	uint64_t m_Offset{0};
+
+	CompatLogIndexBlock m_Block;
+	std::set<uint32_t> m_BlockHosts;
+
+	void WriteBlock();
+};
+
+}
+
+#endif /* COMPATLOGINDEX_H */
@@ -0,0 +1,122 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/deadlinescheduler.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/timer.hpp"
+#include "base/utility.hpp"
+#include <boost/thread/once.hpp>
+#include <vector>
+
+using namespace icinga;
+
+static std::mutex l_DeadlineSchedulersMutex;
+static Timer::Ptr l_DeadlineSchedulerTimer;
+
+/* Schedulers are static objects, so this one has to exist before any of them. */
+static std::vector<DeadlineScheduler*>& GetDeadlineSchedulers()
+{
+	static std::vector<DeadlineScheduler*> schedulers;
+	return schedulers;
+}
+
+DeadlineScheduler::DeadlineScheduler(Callback callback)
+	: m_Callback(std::move(callback))
+{
+	std::unique_lock<std::mutex> lock (l_DeadlineSchedulersMutex);
+	GetDeadlineSchedulers().emplace_back(this);
+}
+
+/**
+ * Makes the callback run for the object once the given point in time has
+ * been reached, replacing any previously scheduled one.
+ *
+ * @param object The object
+ * @param when The point in time, 0 (or less) to unschedule the object
+ * @param keepEarlier Whether to keep an already scheduled earlier point in time
+ */
+void DeadlineScheduler::Schedule(const ConfigObject::Ptr& object, double when, bool keepEarlier)
+{
+	static boost::once_flag once = BOOST_ONCE_INIT;
+
+	boost::call_once(once, []() {
+		l_DeadlineSchedulerTimer = new Timer();
+		l_DeadlineSchedulerTimer->SetInterval(1);
+		l_DeadlineSchedulerTimer->OnTimerExpired.connect([](const Timer * const&) { TimerHandler(); });
+		l_DeadlineSchedulerTimer->Start();
+	});
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+	auto it (m_Scheduled.find(object.get()));
+
+	if (it != m_Scheduled.end()) {
+		if (it->second == when || (keepEarlier && when > 0 && it->second < when))
+			return;
+
+		m_Deadlines.erase(std::make_pair(it->second, object));
+
+		if (when <= 0) {
+			m_Scheduled.erase(it);
+			return;
+		}
+
+		it->second = when;
+	} else {
+		if (when <= 0)
+			return;
+
+		m_Scheduled.emplace(object.get(), when);
+	}
+
+	m_Deadlines.emplace(when, object);
+}
+
+void DeadlineScheduler::Unschedule(const ConfigObject::Ptr& object)
+{
+	Schedule(object, 0);
+}
+
+/**
+ * Runs the callback for all objects which are due. They're unscheduled
+ * before, the callback has to schedule them again if necessary.
+ */
+void DeadlineScheduler::RunDue(double now)
+{
+	std::vector<ConfigObject::Ptr> due;
+
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		while (!m_Deadlines.empty() && m_Deadlines.begin()->first <= now) {
+			auto object (m_Deadlines.begin()->second);
+
+			m_Deadlines.erase(m_Deadlines.begin());
+			m_Scheduled.erase(object.get());
+			due.emplace_back(std::move(object));
+		}
+	}
+
+	for (const ConfigObject::Ptr& object : due) {
+		try {
+			m_Callback(object);
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "DeadlineScheduler")
+				<< "Exception while processing the deadline of object '" << object->GetName() << "': " << DiagnosticInformation(ex);
+		}
+	}
+}
+
+void DeadlineScheduler::TimerHandler()
+{
+	std::vector<DeadlineScheduler*> schedulers;
+
+	{
+		std::unique_lock<std::mutex> lock (l_DeadlineSchedulersMutex);
+		schedulers = GetDeadlineSchedulers();
+	}
+
+	double now = Utility::GetTime();
+
+	for (auto scheduler : schedulers)
+		scheduler->RunDue(now);
+}
@@ -0,0 +1,52 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef DEADLINESCHEDULER_H
+#define DEADLINESCHEDULER_H
+
+#include "icinga/i2-icinga.hpp"
+#include "base/configobject.hpp"
+#include <functional>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+namespace icinga
+{
+
+/**
+ * Calls back objects at the next point in time they have something to do,
+ * e.g. when a comment expires. Objects register that point in time instead
+ * of being looked at by a timer of their own every now and then.
+ *
+ * All schedulers share one timer which runs every second.
+ *
+ * @ingroup icinga
+ */
+class DeadlineScheduler
+{
+public:
+	typedef std::function<void (const ConfigObject::Ptr&)> Callback;
+
+	DeadlineScheduler(Callback callback);
+
+	DeadlineScheduler(const DeadlineScheduler&) = delete;
+	DeadlineScheduler& operator=(const DeadlineScheduler&) = delete;
+
+	void Schedule(const ConfigObject::Ptr& object, double when, bool keepEarlier = false);
+	void Unschedule(const ConfigObject::Ptr& object);
+
+private:
+	std::mutex m_Mutex;
+	std::set<std::pair<double, ConfigObject::Ptr> > m_Deadlines;
+	std::unordered_map<ConfigObject*, double> m_Scheduled;
+	Callback m_Callback;
+
+	void RunDue(double now);
+
+	static void TimerHandler();
+};
+
+}
+
+#endif /* DEADLINESCHEDULER_H */
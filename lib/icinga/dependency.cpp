@@ -211,3 +211,11 @@ void Dependency::SetChild(intrusive_ptr<Checkable> child)
 	m_Child = child;
 }
 
+/* Runtime modifications (e.g. via the API) end up here, any of them may change whether the child is reachable. */
+void Dependency::SetField(int id, const Value& value, bool suppress_events, const Value& cookie)
+{
+	ObjectImpl<Dependency>::SetField(id, value, suppress_events, cookie);
+
+	if (m_Child)
+		m_Child->InvalidateReachability();
+}
@@ -41,6 +41,8 @@ public:
 	void SetParent(intrusive_ptr<Checkable> parent);
 	void SetChild(intrusive_ptr<Checkable> child);
 
+	void SetField(int id, const Value& value, bool suppress_events = false, const Value& cookie = Empty) override;
+
 protected:
 	void OnConfigLoaded() override;
 	void OnAllConfigLoaded() override;
@@ -5,10 +5,13 @@
 #include "icinga/host.hpp"
 #include "icinga/scheduleddowntime.hpp"
 #include "remote/configobjectutility.hpp"
+#include "remote/runtimeobjectstore.hpp"
 #include "base/configtype.hpp"
 #include "base/utility.hpp"
 #include "base/timer.hpp"
 #include <boost/thread/once.hpp>
+#include <atomic>
+#include <set>
 
 using namespace icinga;
 
@@ -18,6 +21,16 @@ static std::map<int, String> l_LegacyDowntimesCache;
 static Timer::Ptr l_DowntimesExpireTimer;
 static Timer::Ptr l_DowntimesStartTimer;
 
+typedef std::set<std::pair<double, Downtime::Ptr> > DowntimeTimerIndex;
+
+/* Fixed downtimes which haven't been triggered yet, by start time. */
+static DowntimeTimerIndex l_DowntimesByStart;
+/* All active downtimes, by the time they expire at. */
+static DowntimeTimerIndex l_DowntimesByExpiry;
+
+/* Whether the expire timer has to check all downtimes' config owners. */
+static std::atomic<bool> l_CheckConfigOwners (true);
+
 boost::signals2::signal<void (const Downtime::Ptr&)> Downtime::OnDowntimeAdded;
 boost::signals2::signal<void (const Downtime::Ptr&)> Downtime::OnDowntimeRemoved;
 boost::signals2::signal<void (const Downtime::Ptr&)> Downtime::OnDowntimeStarted;
@@ -32,6 +45,20 @@ void Downtime::StaticInitialize()
 	ScriptGlobal::Set("Icinga.DowntimeNoChildren", "DowntimeNoChildren", true);
 	ScriptGlobal::Set("Icinga.DowntimeTriggeredChildren", "DowntimeTriggeredChildren", true);
 	ScriptGlobal::Set("Icinga.DowntimeNonTriggeredChildren", "DowntimeNonTriggeredChildren", true);
+
+	auto updateIndexes ([](const Downtime::Ptr& downtime, const Value&) { downtime->UpdateTimerIndexes(); });
+
+	Downtime::OnStartTimeChanged.connect(updateIndexes);
+	Downtime::OnEndTimeChanged.connect(updateIndexes);
+	Downtime::OnFixedChanged.connect(updateIndexes);
+	Downtime::OnDurationChanged.connect(updateIndexes);
+	Downtime::OnTriggerTimeChanged.connect(updateIndexes);
+
+	/* Downtimes owned by a removed scheduled downtime have to go. */
+	ConfigObject::OnActiveChanged.connect([](const ConfigObject::Ptr& object, const Value&) {
+		if (!object->IsActive() && dynamic_pointer_cast<ScheduledDowntime>(object))
+			l_CheckConfigOwners.store(true);
+	});
 }
 
 String DowntimeNameComposer::MakeName(const String& shortName, const Object::Ptr& context) const
@@ -114,6 +141,8 @@ void Downtime::Start(bool runtimeCreated)
 
 	checkable->RegisterDowntime(this);
 
+	UpdateTimerIndexes();
+
 	if (runtimeCreated)
 		OnDowntimeAdded(this);
 
@@ -133,6 +162,18 @@ void Downtime::Stop(bool runtimeRemoved)
 {
 	GetCheckable()->UnregisterDowntime(this);
 
+	UpdateTimerIndexes();
+
+	String scheduledBy = GetScheduledBy();
+
+	if (!scheduledBy.IsEmpty()) {
+		ScheduledDowntime::Ptr sd = ScheduledDowntime::GetByName(scheduledBy);
+
+		/* The scheduled downtime may have to replace this one. */
+		if (sd)
+			sd->ResetNextDowntimeCheck();
+	}
+
 	if (runtimeRemoved)
 		OnDowntimeRemoved(this);
 
@@ -206,19 +247,11 @@ int Downtime::GetNextDowntimeID()
 	return l_NextDowntimeID;
 }
 
-Downtime::Ptr Downtime::AddDowntime(const Checkable::Ptr& checkable, const String& author,
+static Dictionary::Ptr GetNewDowntimeAttrs(const Checkable::Ptr& checkable, const String& author,
 	const String& comment, double startTime, double endTime, bool fixed,
 	const String& triggeredBy, double duration,
-	const String& scheduledDowntime, const String& scheduledBy,
-	const String& id, const MessageOrigin::Ptr& origin)
+	const String& scheduledDowntime, const String& scheduledBy)
 {
-	String fullName;
-
-	if (id.IsEmpty())
-		fullName = checkable->GetName() + "!" + Utility::NewUniqueID();
-	else
-		fullName = id;
-
 	Dictionary::Ptr attrs = new Dictionary();
 
 	attrs->Set("author", author);
@@ -269,11 +302,16 @@ Downtime::Ptr Downtime::AddDowntime(const Checkable::Ptr& checkable, const Strin
 	if (!zone.IsEmpty())
 		attrs->Set("zone", zone);
 
-	String config = ConfigObjectUtility::CreateObjectConfig(Downtime::TypeInstance, fullName, true, nullptr, attrs);
+	return attrs;
+}
 
+/* Creates all downtimes in one go, see RuntimeObjectStore::CreateObjects(). */
+static std::vector<Downtime::Ptr> CreateDowntimes(const std::vector<std::pair<String, Dictionary::Ptr> >& downtimes,
+	const String& triggeredBy)
+{
 	Array::Ptr errors = new Array();
 
-	if (!ConfigObjectUtility::CreateObject(Downtime::TypeInstance, fullName, config, errors, nullptr)) {
+	if (!RuntimeObjectStore::CreateObjects(Downtime::TypeInstance, downtimes, errors, nullptr)) {
 		ObjectLock olock(errors);
 		for (const String& error : errors) {
 			Log(LogCritical, "Downtime", error);
@@ -287,22 +325,77 @@ Downtime::Ptr Downtime::AddDowntime(const Checkable::Ptr& checkable, const Strin
 		Array::Ptr triggers = parentDowntime->GetTriggers();
 
 		ObjectLock olock(triggers);
-		if (!triggers->Contains(fullName))
-			triggers->Add(fullName);
+		std::set<String> knownTriggers = triggers->ToSet<String>();
+
+		for (auto& downtime : downtimes) {
+			if (knownTriggers.insert(downtime.first).second)
+				triggers->Add(downtime.first);
+		}
 	}
 
-	Downtime::Ptr downtime = Downtime::GetByName(fullName);
+	std::vector<Downtime::Ptr> result;
+	result.reserve(downtimes.size());
 
-	if (!downtime)
-		BOOST_THROW_EXCEPTION(std::runtime_error("Could not create downtime object."));
+	for (auto& kv : downtimes) {
+		Downtime::Ptr downtime = Downtime::GetByName(kv.first);
 
-	Log(LogInformation, "Downtime")
-		<< "Added downtime '" << downtime->GetName()
-		<< "' between '" << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S", startTime)
-		<< "' and '" << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S", endTime) << "', author: '"
-		<< author << "', " << (fixed ? "fixed" : "flexible with " + Convert::ToString(duration) + "s duration");
+		if (!downtime)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Could not create downtime object."));
+
+		Log(LogInformation, "Downtime")
+			<< "Added downtime '" << downtime->GetName()
+			<< "' between '" << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S", downtime->GetStartTime())
+			<< "' and '" << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S", downtime->GetEndTime()) << "', author: '"
+			<< downtime->GetAuthor() << "', " << (downtime->GetFixed() ? "fixed" : "flexible with " + Convert::ToString(downtime->GetDuration()) + "s duration");
+
+		result.emplace_back(std::move(downtime));
+	}
+
+	return result;
+}
+
+Downtime::Ptr Downtime::AddDowntime(const Checkable::Ptr& checkable, const String& author,
+	const String& comment, double startTime, double endTime, bool fixed,
+	const String& triggeredBy, double duration,
+	const String& scheduledDowntime, const String& scheduledBy,
+	const String& id, const MessageOrigin::Ptr& origin)
+{
+	String fullName;
+
+	if (id.IsEmpty())
+		fullName = checkable->GetName() + "!" + Utility::NewUniqueID();
+	else
+		fullName = id;
+
+	Dictionary::Ptr attrs = GetNewDowntimeAttrs(checkable, author, comment, startTime, endTime,
+		fixed, triggeredBy, duration, scheduledDowntime, scheduledBy);
 
-	return downtime;
+	return CreateDowntimes({ { fullName, attrs } }, triggeredBy).front();
+}
+
+/**
+ * Schedules the same downtime for many checkables at once, e.g. for all
+ * services of a host. The downtimes are created together which is way
+ * cheaper than one AddDowntime() call per checkable.
+ *
+ * @returns The downtimes in the order of the checkables
+ */
+std::vector<Downtime::Ptr> Downtime::AddDowntimes(const std::vector<Checkable::Ptr>& checkables, const String& author,
+	const String& comment, double startTime, double endTime, bool fixed,
+	const String& triggeredBy, double duration)
+{
+	std::vector<std::pair<String, Dictionary::Ptr> > downtimes;
+	downtimes.reserve(checkables.size());
+
+	for (const Checkable::Ptr& checkable : checkables) {
+		downtimes.emplace_back(checkable->GetName() + "!" + Utility::NewUniqueID(), GetNewDowntimeAttrs(checkable,
+			author, comment, startTime, endTime, fixed, triggeredBy, duration, String(), String()));
+	}
+
+	if (downtimes.empty())
+		return std::vector<Downtime::Ptr>();
+
+	return CreateDowntimes(downtimes, triggeredBy);
 }
 
 void Downtime::RemoveDowntime(const String& id, bool cancelled, bool expired, const MessageOrigin::Ptr& origin)
@@ -415,10 +508,68 @@ String Downtime::GetDowntimeIDFromLegacyID(int id)
 	return it->second;
 }
 
+static void UpdateDowntimeTimerIndex(DowntimeTimerIndex& index, const Downtime::Ptr& downtime, double& current, double next)
+{
+	if (current == next)
+		return;
+
+	if (current >= 0)
+		index.erase(std::make_pair(current, downtime));
+
+	if (next >= 0)
+		index.emplace(next, downtime);
+
+	current = next;
+}
+
+/**
+ * Moves the downtime to the right place in the start and expiry timer
+ * indexes, or removes it from them once it's not active anymore.
+ */
+void Downtime::UpdateTimerIndexes()
+{
+	double startKey = -1;
+	double expiryKey = -1;
+
+	if (IsActive()) {
+		double triggerTime = GetTriggerTime();
+
+		if (GetFixed()) {
+			if (triggerTime == 0)
+				startKey = GetStartTime();
+
+			expiryKey = GetEndTime();
+		} else {
+			expiryKey = triggerTime > 0 ? triggerTime + GetDuration() : GetEndTime();
+		}
+	}
+
+	Downtime::Ptr self (this);
+	std::unique_lock<std::mutex> lock(l_DowntimeMutex);
+
+	UpdateDowntimeTimerIndex(l_DowntimesByStart, self, m_StartIndexKey, startKey);
+	UpdateDowntimeTimerIndex(l_DowntimesByExpiry, self, m_ExpiryIndexKey, expiryKey);
+}
+
 void Downtime::DowntimesStartTimerHandler()
 {
+	double now = Utility::GetTime();
+	std::vector<Downtime::Ptr> downtimes;
+
+	{
+		std::unique_lock<std::mutex> lock(l_DowntimeMutex);
+
+		while (!l_DowntimesByStart.empty() && l_DowntimesByStart.begin()->first <= now) {
+			auto downtime (l_DowntimesByStart.begin()->second);
+
+			l_DowntimesByStart.erase(l_DowntimesByStart.begin());
+			downtime->m_StartIndexKey = -1;
+			downtimes.emplace_back(std::move(downtime));
+		}
+	}
+
 	/* Start fixed downtimes. Flexible downtimes will be triggered on-demand. */
-	for (const Downtime::Ptr& downtime : ConfigType::GetObjectsByType<Downtime>()) {
+	for (const Downtime::Ptr& downtime : downtimes) {
 		if (downtime->IsActive() &&
 			downtime->CanBeTriggered() &&
 			downtime->GetFixed()) {
@@ -433,16 +584,38 @@ void Downtime::DowntimesStartTimerHandler()
 
 void Downtime::DowntimesExpireTimerHandler()
 {
-	std::vector<Downtime::Ptr> downtimes;
+	double now = Utility::GetTime();
+	std::set<Downtime::Ptr> downtimes;
+
+	{
+		std::unique_lock<std::mutex> lock(l_DowntimeMutex);
+
+		while (!l_DowntimesByExpiry.empty() && l_DowntimesByExpiry.begin()->first <= now) {
+			auto downtime (l_DowntimesByExpiry.begin()->second);
 
-	for (const Downtime::Ptr& downtime : ConfigType::GetObjectsByType<Downtime>()) {
-		downtimes.push_back(downtime);
+			l_DowntimesByExpiry.erase(l_DowntimesByExpiry.begin());
+			downtime->m_ExpiryIndexKey = -1;
+			downtimes.emplace(std::move(downtime));
+		}
+	}
+
+	if (l_CheckConfigOwners.exchange(false)) {
+		/* Config owners are only checked once all config is loaded. */
+		if (!ScheduledDowntime::AllConfigIsLoaded())
+			l_CheckConfigOwners.store(true);
+
+		for (Downtime *downtime : ConfigType::GetObjectsView<Downtime>()) {
+			if (!downtime->HasValidConfigOwner())
+				downtimes.insert(downtime);
+		}
 	}
 
 	for (const Downtime::Ptr& downtime : downtimes) {
 		/* Only remove downtimes which are activated after daemon start. */
 		if (downtime->IsActive() && (downtime->IsExpired() || !downtime->HasValidConfigOwner()))
 			RemoveDowntime(downtime->GetName(), false, true);
+		else
+			downtime->UpdateTimerIndexes();
 	}
 }
 
@@ -7,6 +7,7 @@
 #include "icinga/downtime-ti.hpp"
 #include "icinga/checkable-ti.hpp"
 #include "remote/messageorigin.hpp"
+#include <vector>
 
 namespace icinga
 {
@@ -51,6 +52,10 @@ public:
 		const String& scheduledBy = String(), const String& id = String(),
 		const MessageOrigin::Ptr& origin = nullptr);
 
+	static std::vector<Ptr> AddDowntimes(const std::vector<intrusive_ptr<Checkable> >& checkables, const String& author,
+		const String& comment, double startTime, double endTime, bool fixed,
+		const String& triggeredBy, double duration);
+
 	static void RemoveDowntime(const String& id, bool cancelled, bool expired = false, const MessageOrigin::Ptr& origin = nullptr);
 
 	void TriggerDowntime();
@@ -70,8 +75,14 @@ protected:
 private:
 	ObjectImpl<Checkable>::Ptr m_Checkable;
 
+	/* Keys in the start and expiry timer indexes, -1 if not indexed. Protected by l_DowntimeMutex. */
+	double m_StartIndexKey{-1};
+	double m_ExpiryIndexKey{-1};
+
 	bool CanBeTriggered();
 
+	void UpdateTimerIndexes();
+
 	static void DowntimesStartTimerHandler();
 	static void DowntimesExpireTimerHandler();
 };
@@ -2,12 +2,25 @@
 
 #include "icinga/eventcommand.hpp"
 #include "icinga/eventcommand-ti.cpp"
+#include "base/defer.hpp"
+#include "base/utility.hpp"
+#include <utility>
 
 using namespace icinga;
 
 REGISTER_TYPE(EventCommand);
 
 thread_local EventCommand::Ptr EventCommand::ExecuteOverride;
+thread_local std::function<void ()> EventCommand::ExecutionFinished;
+
+/* Executions of commands with max_concurrent_executions which are running. */
+Atomic<uint_fast64_t> EventCommand::CurrentRunningExecutions (0);
+
+/* Executions waiting for one of them to finish. */
+Atomic<uint_fast64_t> EventCommand::CurrentPendingExecutions (0);
+
+/* Executions which were merged into a pending one for the same checkable. */
+Atomic<uint_fast64_t> EventCommand::CoalescedExecutions (0);
 
 void EventCommand::Execute(const Checkable::Ptr& checkable,
 	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros)
@@ -18,3 +31,85 @@ void EventCommand::Execute(const Checkable::Ptr& checkable,
 		useResolvedMacros
 	});
 }
+
+/**
+ * Executes the event handler of a checkable now or once fewer than max_concurrent_executions
+ * executions of this command are running. A checkable is queued at most once, its macros are
+ * resolved when the event handler actually runs, i.e. with its latest state.
+ *
+ * @param checkable The checkable whose event handler is due
+ */
+void EventCommand::Enqueue(const Checkable::Ptr& checkable)
+{
+	{
+		std::unique_lock<std::mutex> lock (m_QueueMutex);
+
+		if (m_Running >= static_cast<uint_fast32_t>(GetMaxConcurrentExecutions())) {
+			if (m_Queued.insert(checkable.get()).second) {
+				m_Queue.emplace_back(checkable);
+				CurrentPendingExecutions.fetch_add(1);
+			} else {
+				CoalescedExecutions.fetch_add(1);
+			}
+
+			return;
+		}
+
+		m_Running++;
+	}
+
+	CurrentRunningExecutions.fetch_add(1);
+	RunQueued(checkable);
+}
+
+void EventCommand::RunQueued(const Checkable::Ptr& checkable)
+{
+	EventCommand::Ptr self = this;
+
+	ExecutionFinished = [self]() { self->FinishQueued(); };
+
+	Defer finish ([]() {
+		std::function<void ()> finished;
+		finished.swap(ExecutionFinished);
+
+		/* Nothing took it, so the event handler didn't run asynchronously. */
+		if (finished)
+			finished();
+	});
+
+	checkable->ExecuteEventHandler();
+}
+
+void EventCommand::FinishQueued()
+{
+	Checkable::Ptr next;
+
+	{
+		std::unique_lock<std::mutex> lock (m_QueueMutex);
+		int limit = GetMaxConcurrentExecutions();
+
+		if (m_Queue.empty() || (limit > 0 && m_Running > static_cast<uint_fast32_t>(limit))) {
+			m_Running--;
+			CurrentRunningExecutions.fetch_sub(1);
+			return;
+		}
+
+		next = std::move(m_Queue.front());
+		m_Queue.pop_front();
+		m_Queued.erase(next.get());
+		CurrentPendingExecutions.fetch_sub(1);
+	}
+
+	/* The finished execution's slot is handed over to the next one. */
+	EventCommand::Ptr self = this;
+
+	Utility::QueueAsyncCallback([self, next]() { self->RunQueued(next); });
+}
+
+void EventCommand::ValidateMaxConcurrentExecutions(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<EventCommand>::ValidateMaxConcurrentExecutions(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_concurrent_executions" }, "Value must not be negative."));
+}
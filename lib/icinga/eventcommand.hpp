@@ -5,6 +5,12 @@
 
 #include "icinga/eventcommand-ti.hpp"
 #include "icinga/checkable.hpp"
+#include "base/atomic.hpp"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
 
 namespace icinga
 {
@@ -22,9 +28,29 @@ public:
 
 	static thread_local EventCommand::Ptr ExecuteOverride;
 
+	/* Set while a queued execution runs. An execution which finishes asynchronously takes it and calls it once done. */
+	static thread_local std::function<void ()> ExecutionFinished;
+
+	static Atomic<uint_fast64_t> CurrentRunningExecutions;
+	static Atomic<uint_fast64_t> CurrentPendingExecutions;
+	static Atomic<uint_fast64_t> CoalescedExecutions;
+
 	virtual void Execute(const Checkable::Ptr& checkable,
 		const Dictionary::Ptr& resolvedMacros = nullptr,
 		bool useResolvedMacros = false);
+
+	void Enqueue(const Checkable::Ptr& checkable);
+
+	void ValidateMaxConcurrentExecutions(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+
+private:
+	std::mutex m_QueueMutex;
+	std::deque<Checkable::Ptr> m_Queue;
+	std::unordered_set<Checkable *> m_Queued;
+	uint_fast32_t m_Running{0};
+
+	void RunQueued(const Checkable::Ptr& checkable);
+	void FinishQueued();
 };
 
 }
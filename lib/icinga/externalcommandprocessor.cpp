@@ -29,9 +29,30 @@ boost::signals2::signal<void(double, const String&, const std::vector<String>&)>
 
 void ExternalCommandProcessor::Execute(const String& line)
 {
-	if (line.IsEmpty())
+	double time;
+	String command;
+	std::vector<String> arguments;
+
+	if (!Parse(line, time, command, arguments))
 		return;
 
+	Execute(time, command, arguments);
+}
+
+/**
+ * Splits a command line of the form "[<timestamp>] <command>;<arg1>;..." into its parts.
+ *
+ * @param line The command line.
+ * @param time Receives the timestamp.
+ * @param command Receives the command name.
+ * @param arguments Receives the arguments.
+ * @returns false if the line is empty, true otherwise.
+ */
+bool ExternalCommandProcessor::Parse(const String& line, double& time, String& command, std::vector<String>& arguments)
+{
+	if (line.IsEmpty())
+		return false;
+
 	if (line[0] != '[')
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing timestamp in command: " + line));
 
@@ -40,21 +61,28 @@ void ExternalCommandProcessor::Execute(const String& line)
 	if (pos == String::NPos)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing timestamp in command: " + line));
 
-	String timestamp = line.SubStr(1, pos - 1);
-	String args = line.SubStr(pos + 2, String::NPos);
+	boost::string_view timestamp = line.SubView(1, pos - 1);
+	boost::string_view args = line.SubView(pos + 2);
 
-	double ts = Convert::ToDouble(timestamp);
+	time = Convert::ToDouble(timestamp);
 
-	if (ts == 0)
+	if (time == 0)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid timestamp in command: " + line));
 
-	std::vector<String> argv = args.Split(";");
+	std::vector<boost::string_view> argv = SplitView(args, ";");
 
 	if (argv.empty())
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing arguments in command: " + line));
 
-	std::vector<String> argvExtra(argv.begin() + 1, argv.end());
-	Execute(ts, argv[0], argvExtra);
+	command = String(argv[0]);
+
+	arguments.clear();
+	arguments.reserve(argv.size() - 1);
+
+	for (auto it (argv.begin() + 1); it != argv.end(); ++it)
+		arguments.emplace_back(*it);
+
+	return true;
 }
 
 void ExternalCommandProcessor::Execute(double time, const String& command, const std::vector<String>& arguments)
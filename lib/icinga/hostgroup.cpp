@@ -47,13 +47,11 @@ void HostGroup::EvaluateObjectRules(const Host::Ptr& host)
 {
 	CONTEXT("Evaluating group memberships for host '" + host->GetName() + "'");
 
-	for (const ConfigItem::Ptr& group : ConfigItem::GetItems(HostGroup::TypeInstance))
-	{
-		if (!group->GetFilter())
-			continue;
+	ScriptFrame frame(true);
+	frame.Locals->Set("host", host);
 
+	for (const ConfigItem::Ptr& group : ConfigItem::GetObjectRuleCandidates(HostGroup::TypeInstance, frame))
 		EvaluateObjectRule(host, group);
-	}
 }
 
 std::set<Host::Ptr> HostGroup::GetMembers() const
@@ -18,12 +18,17 @@
 #include "base/initialize.hpp"
 #include "base/statsfunction.hpp"
 #include "base/loader.hpp"
+#include "base/perfdatavalue.hpp"
+#include <atomic>
 #include <fstream>
 
 using namespace icinga;
 
 static Timer::Ptr l_RetentionTimer;
 
+static std::atomic<bool> l_CheckerOverloaded (false);
+static std::atomic<unsigned long> l_ChecksOverdue (0);
+
 REGISTER_TYPE(IcingaApplication);
 /* Ensure that the priority is lower than the basic System namespace initialization in scriptframe.cpp. */
 INITIALIZE_ONCE_WITH_PRIORITY(&IcingaApplication::StaticInitialize, 50);
@@ -82,11 +87,28 @@ void IcingaApplication::StatsFunc(const Dictionary::Ptr& status, const Array::Pt
 			{ "environment", icingaapplication->GetEnvironment() },
 			{ "pid", Utility::GetPid() },
 			{ "program_start", Application::GetStartTime() },
-			{ "version", Application::GetAppVersion() }
+			{ "version", Application::GetAppVersion() },
+			{ "checker_overloaded", l_CheckerOverloaded.load() },
+			{ "checks_overdue", l_ChecksOverdue.load() }
 		}));
 	}
 
 	status->Set("icingaapplication", new Dictionary(std::move(nodes)));
+
+	perfdata->Add(new PerfdataValue("checker_overloaded", l_CheckerOverloaded.load() ? 1 : 0));
+	perfdata->Add(new PerfdataValue("checks_overdue", Convert::ToDouble(l_ChecksOverdue.load())));
+}
+
+/**
+ * Sets whether the local checker is able to start the checks on time, see CheckerComponent.
+ *
+ * @param overloaded Whether checks are started much later than scheduled.
+ * @param checksOverdue The number of checks waiting to be started for that long.
+ */
+void IcingaApplication::SetCheckerLoad(bool overloaded, unsigned long checksOverdue)
+{
+	l_CheckerOverloaded.store(overloaded);
+	l_ChecksOverdue.store(checksOverdue);
 }
 
 /**
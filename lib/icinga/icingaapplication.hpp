@@ -35,6 +35,8 @@ public:
 
 	int GetMaxConcurrentChecks() const;
 
+	static void SetCheckerLoad(bool overloaded, unsigned long checksOverdue);
+
 	String GetEnvironment() const override;
 	void SetEnvironment(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
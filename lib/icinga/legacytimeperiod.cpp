@@ -8,6 +8,11 @@
 #include "base/logger.hpp"
 #include "base/debug.hpp"
 #include "base/utility.hpp"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 using namespace icinga;
 
@@ -337,41 +342,102 @@ bool LegacyTimePeriod::IsInDayDefinition(const String& daydef, tm *reference)
 	return IsInTimeRange(&begin, &end, stride, reference);
 }
 
+struct TimeOfDay
+{
+	int Hour;
+	int Minute;
+	int Second;
+};
+
+typedef std::pair<TimeOfDay, TimeOfDay> TimeOfDayRange;
+
 static inline
-void ProcessTimeRaw(const String& in, tm *reference, tm *out)
+TimeOfDay ParseTimeOfDay(const String& in)
 {
-	*out = *reference;
+	TimeOfDay result;
 
 	auto hd (in.Split(":"));
 
 	switch (hd.size()) {
 		case 2:
-			out->tm_sec = 0;
+			result.Second = 0;
 			break;
 		case 3:
-			out->tm_sec = Convert::ToLong(hd[2]);
+			result.Second = Convert::ToLong(hd[2]);
 			break;
 		default:
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid time specification: " + in));
 	}
 
-	out->tm_hour = Convert::ToLong(hd[0]);
-	out->tm_min = Convert::ToLong(hd[1]);
+	result.Hour = Convert::ToLong(hd[0]);
+	result.Minute = Convert::ToLong(hd[1]);
+
+	return result;
 }
 
-void LegacyTimePeriod::ProcessTimeRangeRaw(const String& timerange, tm *reference, tm *begin, tm *end)
+static inline
+TimeOfDayRange ParseTimeOfDayRange(const String& timerange)
 {
 	std::vector<String> times = timerange.Split("-");
 
 	if (times.size() != 2)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid timerange: " + timerange));
 
-	ProcessTimeRaw(times[0], reference, begin);
-	ProcessTimeRaw(times[1], reference, end);
+	TimeOfDayRange range (ParseTimeOfDay(times[0]), ParseTimeOfDay(times[1]));
+
+	if (range.first.Hour * 3600 + range.first.Minute * 60 + range.first.Second >=
+		range.second.Hour * 3600 + range.second.Minute * 60 + range.second.Second)
+		range.second.Hour += 24;
+
+	return range;
+}
+
+static inline
+void ApplyTimeOfDay(const TimeOfDay& time, tm *reference, tm *out)
+{
+	*out = *reference;
+
+	out->tm_hour = time.Hour;
+	out->tm_min = time.Minute;
+	out->tm_sec = time.Second;
+}
+
+/**
+ * Parses a list of time ranges, e.g. "09:00-12:00,13:00-17:00".
+ *
+ * The result only depends on the string, ScriptFunc() would otherwise parse
+ * it again for every day of every update window. Only mktime() depends on
+ * the day, which takes care of DST.
+ */
+static std::shared_ptr<const std::vector<TimeOfDayRange> > GetParsedTimeRanges(const String& timeranges)
+{
+	static thread_local std::unordered_map<std::string, std::shared_ptr<const std::vector<TimeOfDayRange> > > cache;
+
+	auto it (cache.find(timeranges.GetData()));
+
+	if (it != cache.end())
+		return it->second;
+
+	auto ranges (std::make_shared<std::vector<TimeOfDayRange> >());
+
+	for (const String& range : timeranges.Split(","))
+		ranges->emplace_back(ParseTimeOfDayRange(range));
+
+	/* Time periods are defined in the config, this is only a safety net. */
+	if (cache.size() >= 1024)
+		cache.clear();
 
-	if (begin->tm_hour * 3600 + begin->tm_min * 60 + begin->tm_sec >=
-		end->tm_hour * 3600 + end->tm_min * 60 + end->tm_sec)
-		end->tm_hour += 24;
+	cache.emplace(timeranges.GetData(), ranges);
+
+	return ranges;
+}
+
+void LegacyTimePeriod::ProcessTimeRangeRaw(const String& timerange, tm *reference, tm *begin, tm *end)
+{
+	auto range (ParseTimeOfDayRange(timerange));
+
+	ApplyTimeOfDay(range.first, reference, begin);
+	ApplyTimeOfDay(range.second, reference, end);
 }
 
 Dictionary::Ptr LegacyTimePeriod::ProcessTimeRange(const String& timestamp, tm *reference)
@@ -388,15 +454,22 @@ Dictionary::Ptr LegacyTimePeriod::ProcessTimeRange(const String& timestamp, tm *
 
 void LegacyTimePeriod::ProcessTimeRanges(const String& timeranges, tm *reference, const Array::Ptr& result)
 {
-	std::vector<String> ranges = timeranges.Split(",");
+	for (auto& range : *GetParsedTimeRanges(timeranges)) {
+		tm begin, end;
+
+		ApplyTimeOfDay(range.first, reference, &begin);
+		ApplyTimeOfDay(range.second, reference, &end);
 
-	for (const String& range : ranges) {
-		Dictionary::Ptr segment = ProcessTimeRange(range, reference);
+		long tsBegin = mktime(&begin);
+		long tsEnd = mktime(&end);
 
-		if (segment->Get("begin") >= segment->Get("end"))
+		if (tsBegin >= tsEnd)
 			continue;
 
-		result->Add(segment);
+		result->Add(new Dictionary({
+			{ "begin", tsBegin },
+			{ "end", tsEnd }
+		}));
 	}
 }
 
@@ -11,7 +11,8 @@
 #include "base/scriptframe.hpp"
 #include "base/convert.hpp"
 #include "base/exception.hpp"
-#include <boost/algorithm/string/join.hpp>
+#include <algorithm>
+#include <unordered_map>
 
 using namespace icinga;
 
@@ -73,21 +74,123 @@ Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolv
 	return result;
 }
 
-bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resolvers,
+/**
+ * Resolves a format string which has been compiled once with CompileMacroString(),
+ * e.g. by a feature which formats every check result the same way.
+ */
+Value MacroProcessor::ResolveMacros(const MacroTemplate& tmpl, const ResolverList& resolvers,
+	const CheckResult::Ptr& cr, String *missingMacro, const MacroProcessor::EscapeCallback& escapeFn)
+{
+	return InternalResolveMacros(tmpl, resolvers, cr, missingMacro, escapeFn, nullptr, false, 1);
+}
+
+thread_local MacroResolverMemo *MacroResolverMemo::m_Current = nullptr;
+
+/**
+ * Remembers the macros which are resolved on this thread until the memo goes
+ * out of scope. Only lookups with the very same resolver list and check
+ * result make use of it.
+ *
+ * @param resolvers The resolvers the command is being prepared with.
+ * @param cr The check result the command is being prepared with.
+ */
+MacroResolverMemo::MacroResolverMemo(const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr)
+	: m_Resolvers(&resolvers), m_CheckResult(cr.get()), m_Previous(m_Current)
+{
+	m_Current = this;
+}
+
+MacroResolverMemo::~MacroResolverMemo()
+{
+	m_Current = m_Previous;
+}
+
+/* Field IDs by type and name, types are never unregistered so their addresses are stable. */
+struct MacroFieldKey
+{
+	const Type *FieldType;
+	std::string Name;
+
+	bool operator==(const MacroFieldKey& other) const
+	{
+		return FieldType == other.FieldType && Name == other.Name;
+	}
+};
+
+struct MacroFieldKeyHash
+{
+	size_t operator()(const MacroFieldKey& key) const
+	{
+		return std::hash<const Type *>()(key.FieldType) ^ std::hash<std::string>()(key.Name);
+	}
+};
+
+struct MacroFieldInfo
+{
+	int Id;
+	bool IsTimestamp;
+};
+
+static thread_local std::unordered_map<MacroFieldKey, MacroFieldInfo, MacroFieldKeyHash> l_MacroFields;
+
+/* Macros may reference arbitrary (and misspelled) attributes, so don't let it grow unbounded. */
+static const size_t l_MacroFieldsMax = 4096;
+
+static MacroFieldInfo GetMacroField(const Type::Ptr& type, const String& name)
+{
+	MacroFieldKey key { type.get(), name.GetData() };
+
+	auto it (l_MacroFields.find(key));
+
+	if (it != l_MacroFields.end())
+		return it->second;
+
+	MacroFieldInfo info { type->GetFieldId(name), false };
+
+	if (info.Id != -1)
+		info.IsTimestamp = strcmp(type->GetFieldInfo(info.Id).TypeName, "Timestamp") == 0;
+
+	if (l_MacroFields.size() >= l_MacroFieldsMax)
+		l_MacroFields.clear();
+
+	l_MacroFields.emplace(std::move(key), info);
+
+	return info;
+}
+
+bool MacroProcessor::ResolveMacro(const MacroTemplate::Segment& macro, const ResolverList& resolvers,
 	const CheckResult::Ptr& cr, Value *result, bool *recursive_macro)
 {
-	CONTEXT("Resolving macro '" + macro + "'");
+	MacroResolverMemo *memo = MacroResolverMemo::m_Current;
 
-	*recursive_macro = false;
+	if (!memo || memo->m_Resolvers != &resolvers || memo->m_CheckResult != cr.get())
+		return LookupMacro(macro, resolvers, cr, result, recursive_macro);
 
-	std::vector<String> tokens = macro.Split(".");
+	auto it (memo->m_Macros.find(macro.Text.GetData()));
 
-	String objName;
-	if (tokens.size() > 1) {
-		objName = tokens[0];
-		tokens.erase(tokens.begin());
+	if (it == memo->m_Macros.end()) {
+		MacroResolverMemo::Entry entry;
+		entry.Found = LookupMacro(macro, resolvers, cr, &entry.Result, &entry.Recursive);
+
+		it = memo->m_Macros.emplace(macro.Text.GetData(), std::move(entry)).first;
 	}
 
+	*result = it->second.Result;
+	*recursive_macro = it->second.Recursive;
+
+	return it->second.Found;
+}
+
+bool MacroProcessor::LookupMacro(const MacroTemplate::Segment& macro, const ResolverList& resolvers,
+	const CheckResult::Ptr& cr, Value *result, bool *recursive_macro)
+{
+	CONTEXT("Resolving macro '" + macro.Text + "'");
+
+	*recursive_macro = false;
+
+	const String& objName = macro.ObjName;
+	const std::vector<String>& tokens = macro.Tokens;
+
 	for (const ResolverSpec& resolver : resolvers) {
 		if (!objName.IsEmpty() && objName != resolver.first)
 			continue;
@@ -98,8 +201,7 @@ bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resol
 			if (dobj) {
 				Dictionary::Ptr vars = dobj->GetVars();
 
-				if (vars && vars->Contains(macro)) {
-					*result = vars->Get(macro);
+				if (vars && vars->Get(macro.Text, result)) {
 					*recursive_macro = true;
 					return true;
 				}
@@ -108,7 +210,7 @@ bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resol
 
 		auto *mresolver = dynamic_cast<MacroResolver *>(resolver.second.get());
 
-		if (mresolver && mresolver->ResolveMacro(boost::algorithm::join(tokens, "."), cr, result))
+		if (mresolver && mresolver->ResolveMacro(macro.Path, cr, result))
 			return true;
 
 		Value ref = resolver.second;
@@ -117,8 +219,7 @@ bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resol
 		for (const String& token : tokens) {
 			if (ref.IsObjectType<Dictionary>()) {
 				Dictionary::Ptr dict = ref;
-				if (dict->Contains(token)) {
-					ref = dict->Get(token);
+				if (dict->Get(token, &ref)) {
 					continue;
 				} else {
 					valid = false;
@@ -134,18 +235,16 @@ bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resol
 					break;
 				}
 
-				int field = type->GetFieldId(token);
+				MacroFieldInfo field = GetMacroField(type, token);
 
-				if (field == -1) {
+				if (field.Id == -1) {
 					valid = false;
 					break;
 				}
 
-				ref = object->GetField(field);
+				ref = object->GetField(field.Id);
 
-				Field fieldInfo = type->GetFieldInfo(field);
-
-				if (strcmp(fieldInfo.TypeName, "Timestamp") == 0)
+				if (field.IsTimestamp)
 					ref = static_cast<long>(ref);
 			}
 		}
@@ -175,8 +274,8 @@ Value MacroProcessor::EvaluateFunction(const Function::Ptr& func, const Resolver
 		resolvers_this->Set(resolver.first, resolver.second);
 	}
 
-	auto internalResolveMacrosShim = [resolvers, cr, resolvedMacros, useResolvedMacros, recursionLevel](const std::vector<Value>& args) {
-		if (args.size() < 1)
+	Function::Callback internalResolveMacrosShim = [resolvers, cr, resolvedMacros, useResolvedMacros, recursionLevel](const Value *args, size_t count) -> Value {
+		if (count < 1)
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Too few arguments for function"));
 
 		String missingMacro;
@@ -187,8 +286,8 @@ Value MacroProcessor::EvaluateFunction(const Function::Ptr& func, const Resolver
 
 	resolvers_this->Set("macro", new Function("macro (temporary)", internalResolveMacrosShim, { "str" }));
 
-	auto internalResolveArgumentsShim = [resolvers, cr, resolvedMacros, useResolvedMacros, recursionLevel](const std::vector<Value>& args) {
-		if (args.size() < 2)
+	Function::Callback internalResolveArgumentsShim = [resolvers, cr, resolvedMacros, useResolvedMacros, recursionLevel](const Value *args, size_t count) -> Value {
+		if (count < 2)
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Too few arguments for function"));
 
 		return MacroProcessor::ResolveArguments(args[0], args[1], resolvers, cr,
@@ -200,48 +299,118 @@ Value MacroProcessor::EvaluateFunction(const Function::Ptr& func, const Resolver
 	return func->InvokeThis(resolvers_this);
 }
 
+/* Compiled templates only depend on the string itself, a changed
+ * attribute simply results in a different key. */
+static thread_local std::unordered_map<std::string, std::shared_ptr<const MacroTemplate> > l_MacroTemplates;
+
+/* Strings resolved from custom variables end up in the cache too, so don't let it grow unbounded. */
+static const size_t l_MacroTemplatesMax = 4096;
+
+/**
+ * Splits a macro format string into literal text and macro references.
+ *
+ * @param str The format string.
+ * @returns The compiled template.
+ */
+std::shared_ptr<const MacroTemplate> MacroProcessor::CompileMacroString(const String& str)
+{
+	auto tmpl (std::make_shared<MacroTemplate>());
+	tmpl->Source = str;
+
+	size_t offset = 0, pos_first, pos_second;
+
+	while ((pos_first = str.FindFirstOf("$", offset)) != String::NPos) {
+		pos_second = str.FindFirstOf("$", pos_first + 1);
+
+		if (pos_second == String::NPos)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Closing $ not found in macro format string."));
+
+		if (pos_first > offset)
+			tmpl->Segments.push_back({ false, str.SubStr(offset, pos_first - offset) });
+
+		MacroTemplate::Segment macro { true, str.SubStr(pos_first + 1, pos_second - pos_first - 1) };
+
+		macro.Tokens = macro.Text.Split(".");
+
+		if (macro.Tokens.size() > 1) {
+			macro.ObjName = macro.Tokens[0];
+			macro.Tokens.erase(macro.Tokens.begin());
+			macro.Path = macro.Text.SubStr(macro.ObjName.GetLength() + 1);
+		} else
+			macro.Path = macro.Text;
+
+		tmpl->Segments.emplace_back(std::move(macro));
+
+		offset = pos_second + 1;
+	}
+
+	if (offset < str.GetLength())
+		tmpl->Segments.push_back({ false, str.SubStr(offset) });
+
+	return tmpl;
+}
+
+std::shared_ptr<const MacroTemplate> MacroProcessor::GetMacroTemplate(const String& str)
+{
+	auto it (l_MacroTemplates.find(str.GetData()));
+
+	if (it != l_MacroTemplates.end())
+		return it->second;
+
+	auto tmpl (CompileMacroString(str));
+
+	if (l_MacroTemplates.size() >= l_MacroTemplatesMax)
+		l_MacroTemplates.clear();
+
+	l_MacroTemplates.emplace(str.GetData(), tmpl);
+
+	return tmpl;
+}
+
 Value MacroProcessor::InternalResolveMacros(const String& str, const ResolverList& resolvers,
 	const CheckResult::Ptr& cr, String *missingMacro,
 	const MacroProcessor::EscapeCallback& escapeFn, const Dictionary::Ptr& resolvedMacros,
 	bool useResolvedMacros, int recursionLevel)
 {
-	CONTEXT("Resolving macros for string '" + str + "'");
+	return InternalResolveMacros(*GetMacroTemplate(str), resolvers, cr, missingMacro, escapeFn,
+		resolvedMacros, useResolvedMacros, recursionLevel);
+}
+
+Value MacroProcessor::InternalResolveMacros(const MacroTemplate& tmpl, const ResolverList& resolvers,
+	const CheckResult::Ptr& cr, String *missingMacro,
+	const MacroProcessor::EscapeCallback& escapeFn, const Dictionary::Ptr& resolvedMacros,
+	bool useResolvedMacros, int recursionLevel)
+{
+	CONTEXT("Resolving macros for string '" + tmpl.Source + "'");
 
 	if (recursionLevel > 15)
 		BOOST_THROW_EXCEPTION(std::runtime_error("Infinite recursion detected while resolving macros"));
 
-	size_t offset, pos_first, pos_second;
-	offset = 0;
-
-	Dictionary::Ptr resolvers_this;
+	/* we're done if this is the only macro and there are no other non-macro parts in the string */
+	bool onlyMacro = tmpl.Segments.size() == 1 && tmpl.Segments[0].IsMacro;
 
-	String result = str;
-	while ((pos_first = result.FindFirstOf("$", offset)) != String::NPos) {
-		pos_second = result.FindFirstOf("$", pos_first + 1);
+	String result;
 
-		if (pos_second == String::NPos)
-			BOOST_THROW_EXCEPTION(std::runtime_error("Closing $ not found in macro format string."));
+	for (const MacroTemplate::Segment& segment : tmpl.Segments) {
+		if (!segment.IsMacro) {
+			result += segment.Text;
+			continue;
+		}
 
-		String name = result.SubStr(pos_first + 1, pos_second - pos_first - 1);
+		const String& name = segment.Text;
 
 		Value resolved_macro;
-		bool recursive_macro;
+		bool recursive_macro = false;
 		bool found;
 
-		if (useResolvedMacros) {
-			recursive_macro = false;
-			found = resolvedMacros->Contains(name);
-
-			if (found)
-				resolved_macro = resolvedMacros->Get(name);
-		} else
-			found = ResolveMacro(name, resolvers, cr, &resolved_macro, &recursive_macro);
-
 		/* $$ is an escape sequence for $. */
 		if (name.IsEmpty()) {
 			resolved_macro = "$";
 			found = true;
-		}
+		} else if (useResolvedMacros) {
+			found = resolvedMacros->Get(name, &resolved_macro);
+		} else
+			found = ResolveMacro(segment, resolvers, cr, &resolved_macro, &recursive_macro);
 
 		if (resolved_macro.IsObjectType<Function>()) {
 			resolved_macro = EvaluateFunction(resolved_macro, resolvers, cr, escapeFn,
@@ -265,7 +434,7 @@ Value MacroProcessor::InternalResolveMacros(const String& str, const ResolverLis
 				ObjectLock olock(arr);
 				for (const Value& value : arr) {
 					if (value.IsScalar()) {
-						resolved_arr.push_back(InternalResolveMacros(value,
+						resolved_arr.push_back(InternalResolveMacros(String(value),
 							resolvers, cr, missingMacro, EscapeCallback(), nullptr,
 							false, recursionLevel + 1));
 					} else
@@ -274,7 +443,7 @@ Value MacroProcessor::InternalResolveMacros(const String& str, const ResolverLis
 
 				resolved_macro = new Array(std::move(resolved_arr));
 			} else if (resolved_macro.IsString()) {
-				resolved_macro = InternalResolveMacros(resolved_macro,
+				resolved_macro = InternalResolveMacros(String(resolved_macro),
 					resolvers, cr, missingMacro, EscapeCallback(), nullptr,
 					false, recursionLevel + 1);
 			}
@@ -286,30 +455,17 @@ Value MacroProcessor::InternalResolveMacros(const String& str, const ResolverLis
 		if (escapeFn)
 			resolved_macro = escapeFn(resolved_macro);
 
-		/* we're done if this is the only macro and there are no other non-macro parts in the string */
-		if (pos_first == 0 && pos_second == str.GetLength() - 1)
+		if (onlyMacro)
 			return resolved_macro;
 		else if (resolved_macro.IsObjectType<Array>())
-				BOOST_THROW_EXCEPTION(std::invalid_argument("Mixing both strings and non-strings in macros is not allowed."));
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Mixing both strings and non-strings in macros is not allowed."));
 
-		if (resolved_macro.IsObjectType<Array>()) {
-			/* don't allow mixing strings and arrays in macro strings */
-			if (pos_first != 0 || pos_second != str.GetLength() - 1)
-				BOOST_THROW_EXCEPTION(std::invalid_argument("Mixing both strings and non-strings in macros is not allowed."));
-
-			return resolved_macro;
-		}
-
-		String resolved_macro_str = resolved_macro;
-
-		result.Replace(pos_first, pos_second - pos_first + 1, resolved_macro_str);
-		offset = pos_first + resolved_macro_str.GetLength();
+		result += static_cast<String>(resolved_macro);
 	}
 
 	return result;
 }
 
-
 bool MacroProcessor::ValidateMacroString(const String& macro)
 {
 	if (macro.IsEmpty())
@@ -405,24 +561,73 @@ Value MacroProcessor::EscapeMacroShellArg(const Value& value)
 	return result;
 }
 
-struct CommandArgument
+/**
+ * Parses the "arguments" attribute of a command so that it doesn't have to be
+ * looked at again for each execution.
+ *
+ * @param arguments The command's arguments.
+ * @returns The compiled arguments.
+ */
+std::shared_ptr<const CommandArgumentsTemplate> MacroProcessor::CompileArguments(const Dictionary::Ptr& arguments)
 {
-	int Order{0};
-	bool SkipKey{false};
-	bool RepeatKey{true};
-	bool SkipValue{false};
-	String Key;
-	Value AValue;
-
-	bool operator<(const CommandArgument& rhs) const
-	{
-		return Order < rhs.Order;
+	if (!arguments)
+		return nullptr;
+
+	auto tmpl (std::make_shared<CommandArgumentsTemplate>());
+	tmpl->Source = arguments;
+
+	ObjectLock olock(arguments);
+	for (const Dictionary::Pair& kv : arguments) {
+		const Value& arginfo = kv.second;
+
+		CommandArgumentsTemplate::Argument arg;
+		arg.Key = kv.first;
+
+		if (arginfo.IsObjectType<Dictionary>()) {
+			Dictionary::Ptr argdict = arginfo;
+			if (argdict->Contains("key"))
+				arg.Key = argdict->Get("key");
+			arg.ArgValue = argdict->Get("value");
+			if (argdict->Contains("required"))
+				arg.Required = argdict->Get("required");
+			arg.SkipKey = argdict->Get("skip_key");
+			if (argdict->Contains("repeat_key"))
+				arg.RepeatKey = argdict->Get("repeat_key");
+			arg.Order = argdict->Get("order");
+			arg.SetIf = argdict->Get("set_if");
+		} else
+			arg.ArgValue = arginfo;
+
+		if (arg.ArgValue.IsEmpty())
+			arg.SkipValue = true;
+		else if (arg.ArgValue.IsScalar())
+			arg.ValueTemplate = CompileMacroString(arg.ArgValue);
+
+		if (!arg.SetIf.IsEmpty() && arg.SetIf.IsScalar())
+			arg.SetIfTemplate = CompileMacroString(arg.SetIf);
+
+		tmpl->Arguments.emplace_back(std::move(arg));
 	}
-};
+
+	std::stable_sort(tmpl->Arguments.begin(), tmpl->Arguments.end(),
+		[](const CommandArgumentsTemplate::Argument& a, const CommandArgumentsTemplate::Argument& b) {
+			return a.Order < b.Order;
+		});
+
+	return tmpl;
+}
 
 Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::Ptr& arguments,
 	const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
 	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel)
+{
+	return ResolveArguments(command, CompileArguments(arguments), resolvers, cr,
+		resolvedMacros, useResolvedMacros, recursionLevel);
+}
+
+Value MacroProcessor::ResolveArguments(const Value& command, const std::shared_ptr<const CommandArgumentsTemplate>& arguments,
+	const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
+	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel)
 {
 	if (useResolvedMacros)
 		REQUIRE_NOT_NULL(resolvedMacros);
@@ -436,76 +641,53 @@ Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::P
 	}
 
 	if (arguments) {
-		std::vector<CommandArgument> args;
-
-		ObjectLock olock(arguments);
-		for (const Dictionary::Pair& kv : arguments) {
-			const Value& arginfo = kv.second;
-
-			CommandArgument arg;
-			arg.Key = kv.first;
-
-			bool required = false;
-			Value argval;
-
-			if (arginfo.IsObjectType<Dictionary>()) {
-				Dictionary::Ptr argdict = arginfo;
-				if (argdict->Contains("key"))
-					arg.Key = argdict->Get("key");
-				argval = argdict->Get("value");
-				if (argdict->Contains("required"))
-					required = argdict->Get("required");
-				arg.SkipKey = argdict->Get("skip_key");
-				if (argdict->Contains("repeat_key"))
-					arg.RepeatKey = argdict->Get("repeat_key");
-				arg.Order = argdict->Get("order");
-
-				Value set_if = argdict->Get("set_if");
-
-				if (!set_if.IsEmpty()) {
-					String missingMacro;
-					Value set_if_resolved = MacroProcessor::ResolveMacros(set_if, resolvers,
-						cr, &missingMacro, MacroProcessor::EscapeCallback(), resolvedMacros,
-						useResolvedMacros, recursionLevel + 1);
-
-					if (!missingMacro.IsEmpty())
-						continue;
+		/* Scalars have been compiled already, ResolveMacros() would add another recursion level for them. */
+		auto resolve ([&](const Value& value, const std::shared_ptr<const MacroTemplate>& tmpl, String *missingMacro) -> Value {
+			if (tmpl)
+				return InternalResolveMacros(*tmpl, resolvers, cr, missingMacro, EscapeCallback(),
+					resolvedMacros, useResolvedMacros, recursionLevel + 2);
 
-					int value;
-
-					if (set_if_resolved == "true")
-						value = 1;
-					else if (set_if_resolved == "false")
-						value = 0;
-					else {
-						try {
-							value = Convert::ToLong(set_if_resolved);
-						} catch (const std::exception& ex) {
-							/* tried to convert a string */
-							Log(LogWarning, "PluginUtility")
-								<< "Error evaluating set_if value '" << set_if_resolved
-								<< "' used in argument '" << arg.Key << "': " << ex.what();
-							continue;
-						}
-					}
+			return MacroProcessor::ResolveMacros(value, resolvers, cr, missingMacro,
+				EscapeCallback(), resolvedMacros, useResolvedMacros, recursionLevel + 1);
+		});
+
+		std::vector<std::pair<const CommandArgumentsTemplate::Argument *, Value> > args;
 
-					if (!value)
+		for (const CommandArgumentsTemplate::Argument& arg : arguments->Arguments) {
+			if (!arg.SetIf.IsEmpty()) {
+				String missingMacro;
+				Value set_if_resolved = resolve(arg.SetIf, arg.SetIfTemplate, &missingMacro);
+
+				if (!missingMacro.IsEmpty())
+					continue;
+
+				int value;
+
+				if (set_if_resolved == "true")
+					value = 1;
+				else if (set_if_resolved == "false")
+					value = 0;
+				else {
+					try {
+						value = Convert::ToLong(set_if_resolved);
+					} catch (const std::exception& ex) {
+						/* tried to convert a string */
+						Log(LogWarning, "PluginUtility")
+							<< "Error evaluating set_if value '" << set_if_resolved
+							<< "' used in argument '" << arg.Key << "': " << ex.what();
 						continue;
+					}
 				}
-			}
-			else
-				argval = arginfo;
 
-			if (argval.IsEmpty())
-				arg.SkipValue = true;
+				if (!value)
+					continue;
+			}
 
 			String missingMacro;
-			arg.AValue = MacroProcessor::ResolveMacros(argval, resolvers,
-				cr, &missingMacro, MacroProcessor::EscapeCallback(), resolvedMacros,
-				useResolvedMacros, recursionLevel + 1);
+			Value avalue = resolve(arg.ArgValue, arg.ValueTemplate, &missingMacro);
 
 			if (!missingMacro.IsEmpty()) {
-				if (required) {
+				if (arg.Required) {
 					BOOST_THROW_EXCEPTION(ScriptError("Non-optional macro '" + missingMacro + "' used in argument '" +
 						arg.Key + "' is missing."));
 				}
@@ -513,21 +695,21 @@ Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::P
 				continue;
 			}
 
-			args.emplace_back(std::move(arg));
+			args.emplace_back(&arg, std::move(avalue));
 		}
 
-		std::sort(args.begin(), args.end());
-
 		Array::Ptr command_arr = resolvedCommand;
-		for (const CommandArgument& arg : args) {
+		for (const auto& entry : args) {
+			const CommandArgumentsTemplate::Argument& arg = *entry.first;
+			const Value& avalue = entry.second;
 
-			if (arg.AValue.IsObjectType<Dictionary>()) {
+			if (avalue.IsObjectType<Dictionary>()) {
 				Log(LogWarning, "PluginUtility")
 					<< "Tried to use dictionary in argument '" << arg.Key << "'.";
 				continue;
-			} else if (arg.AValue.IsObjectType<Array>()) {
+			} else if (avalue.IsObjectType<Array>()) {
 				bool first = true;
-				Array::Ptr arr = static_cast<Array::Ptr>(arg.AValue);
+				Array::Ptr arr = static_cast<Array::Ptr>(avalue);
 
 				ObjectLock olock(arr);
 				for (const Value& value : arr) {
@@ -542,7 +724,7 @@ Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::P
 					AddArgumentHelper(command_arr, arg.Key, value, add_key, !arg.SkipValue);
 				}
 			} else
-				AddArgumentHelper(command_arr, arg.Key, arg.AValue, !arg.SkipKey, !arg.SkipValue);
+				AddArgumentHelper(command_arr, arg.Key, avalue, !arg.SkipKey, !arg.SkipValue);
 		}
 	}
 
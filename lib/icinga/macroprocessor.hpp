@@ -6,11 +6,59 @@
 #include "icinga/i2-icinga.hpp"
 #include "icinga/checkable.hpp"
 #include "base/value.hpp"
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace icinga
 {
 
+/**
+ * A macro format string which has been split into literal text and
+ * macro references.
+ *
+ * @ingroup icinga
+ */
+struct MacroTemplate
+{
+	struct Segment
+	{
+		bool IsMacro;
+		String Text; /* the literal text or the macro's name */
+		String ObjName;
+		std::vector<String> Tokens;
+		String Path; /* Tokens joined by "." */
+	};
+
+	String Source;
+	std::vector<Segment> Segments;
+};
+
+/**
+ * The "arguments" attribute of a command, parsed and sorted by order.
+ *
+ * @ingroup icinga
+ */
+struct CommandArgumentsTemplate
+{
+	struct Argument
+	{
+		int Order{0};
+		bool Required{false};
+		bool SkipKey{false};
+		bool RepeatKey{true};
+		bool SkipValue{false};
+		String Key;
+		Value ArgValue;
+		Value SetIf;
+		std::shared_ptr<const MacroTemplate> ValueTemplate;
+		std::shared_ptr<const MacroTemplate> SetIfTemplate;
+	};
+
+	Dictionary::Ptr Source;
+	std::vector<Argument> Arguments;
+};
+
 /**
  * Resolves macros.
  *
@@ -29,9 +77,19 @@ public:
 		const Dictionary::Ptr& resolvedMacros = nullptr,
 		bool useResolvedMacros = false, int recursionLevel = 0);
 
+	static Value ResolveMacros(const MacroTemplate& tmpl, const ResolverList& resolvers,
+		const CheckResult::Ptr& cr = nullptr, String *missingMacro = nullptr,
+		const EscapeCallback& escapeFn = EscapeCallback());
+
 	static Value ResolveArguments(const Value& command, const Dictionary::Ptr& arguments,
 		const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
 		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel = 0);
+	static Value ResolveArguments(const Value& command, const std::shared_ptr<const CommandArgumentsTemplate>& arguments,
+		const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
+		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel = 0);
+
+	static std::shared_ptr<const MacroTemplate> CompileMacroString(const String& str);
+	static std::shared_ptr<const CommandArgumentsTemplate> CompileArguments(const Dictionary::Ptr& arguments);
 
 	static bool ValidateMacroString(const String& macro);
 	static void ValidateCustomVars(const ConfigObject::Ptr& object, const Dictionary::Ptr& value);
@@ -39,13 +97,21 @@ public:
 private:
 	MacroProcessor();
 
-	static bool ResolveMacro(const String& macro, const ResolverList& resolvers,
+	static bool ResolveMacro(const MacroTemplate::Segment& macro, const ResolverList& resolvers,
+		const CheckResult::Ptr& cr, Value *result, bool *recursive_macro);
+	static bool LookupMacro(const MacroTemplate::Segment& macro, const ResolverList& resolvers,
 		const CheckResult::Ptr& cr, Value *result, bool *recursive_macro);
 	static Value InternalResolveMacros(const String& str,
 		const ResolverList& resolvers, const CheckResult::Ptr& cr,
 		String *missingMacro, const EscapeCallback& escapeFn,
 		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros,
 		int recursionLevel = 0);
+	static Value InternalResolveMacros(const MacroTemplate& tmpl,
+		const ResolverList& resolvers, const CheckResult::Ptr& cr,
+		String *missingMacro, const EscapeCallback& escapeFn,
+		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros,
+		int recursionLevel);
+	static std::shared_ptr<const MacroTemplate> GetMacroTemplate(const String& str);
 	static Value EvaluateFunction(const Function::Ptr& func, const ResolverList& resolvers,
 		const CheckResult::Ptr& cr, const MacroProcessor::EscapeCallback& escapeFn,
 		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel);
@@ -56,6 +122,41 @@ private:
 
 };
 
+/**
+ * Caches resolved macros on the current thread while it's in scope, e.g.
+ * while a command line and its environment are being built for one
+ * execution. Custom variables which reference each other are only looked
+ * up once that way.
+ *
+ * @ingroup icinga
+ */
+class MacroResolverMemo
+{
+public:
+	MacroResolverMemo(const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr);
+	~MacroResolverMemo();
+
+	MacroResolverMemo(const MacroResolverMemo&) = delete;
+	MacroResolverMemo& operator=(const MacroResolverMemo&) = delete;
+
+private:
+	struct Entry
+	{
+		bool Found{false};
+		bool Recursive{false};
+		Value Result;
+	};
+
+	const MacroProcessor::ResolverList *m_Resolvers;
+	const CheckResult *m_CheckResult;
+	std::unordered_map<std::string, Entry> m_Macros;
+	MacroResolverMemo *m_Previous;
+
+	static thread_local MacroResolverMemo *m_Current;
+
+	friend class MacroProcessor;
+};
+
 }
 
 #endif /* MACROPROCESSOR_H */
@@ -135,13 +135,15 @@ void Notification::EvaluateApplyRules(const Host::Ptr& host)
 {
 	CONTEXT("Evaluating 'apply' rules for host '" + host->GetName() + "'");
 
-	for (ApplyRule& rule : ApplyRule::GetRules("Notification"))
-	{
-		if (rule.GetTargetType() != "Host")
+	ScriptFrame frame(true);
+	frame.Locals->Set("host", host);
+
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("Notification", frame)) {
+		if (rule->GetTargetType() != "Host")
 			continue;
 
-		if (EvaluateApplyRule(host, rule))
-			rule.AddMatch();
+		if (EvaluateApplyRule(host, *rule))
+			rule->AddMatch();
 	}
 }
 
@@ -149,11 +151,15 @@ void Notification::EvaluateApplyRules(const Service::Ptr& service)
 {
 	CONTEXT("Evaluating 'apply' rules for service '" + service->GetName() + "'");
 
-	for (ApplyRule& rule : ApplyRule::GetRules("Notification")) {
-		if (rule.GetTargetType() != "Service")
+	ScriptFrame frame(true);
+	frame.Locals->Set("host", service->GetHost());
+	frame.Locals->Set("service", service);
+
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("Notification", frame)) {
+		if (rule->GetTargetType() != "Service")
 			continue;
 
-		if (EvaluateApplyRule(service, rule))
-			rule.AddMatch();
+		if (EvaluateApplyRule(service, *rule))
+			rule->AddMatch();
 	}
 }
@@ -13,12 +13,16 @@
 #include "base/initialize.hpp"
 #include "base/scriptglobal.hpp"
 #include <algorithm>
+#include <atomic>
 
 using namespace icinga;
 
 REGISTER_TYPE(Notification);
 INITIALIZE_ONCE(&Notification::StaticInitialize);
 
+/* Bumped whenever the recipients of any notification may have changed, see GetRecipients(). */
+static std::atomic<uint_fast64_t> l_RecipientsVersion (1);
+
 std::map<String, int> Notification::m_StateFilterMap;
 std::map<String, int> Notification::m_TypeFilterMap;
 
@@ -96,6 +100,15 @@ void Notification::StaticInitialize()
 	m_TypeFilterMap["Recovery"] = NotificationRecovery;
 	m_TypeFilterMap["FlappingStart"] = NotificationFlappingStart;
 	m_TypeFilterMap["FlappingEnd"] = NotificationFlappingEnd;
+
+	Notification::OnUsersRawChanged.connect([](const Notification::Ptr&, const Value&) { InvalidateRecipients(); });
+	Notification::OnUserGroupsRawChanged.connect([](const Notification::Ptr&, const Value&) { InvalidateRecipients(); });
+
+	/* Users and groups which are referenced by name but don't exist are skipped. */
+	ConfigObject::OnActiveChanged.connect([](const ConfigObject::Ptr& object, const Value&) {
+		if (dynamic_pointer_cast<User>(object) || dynamic_pointer_cast<UserGroup>(object))
+			InvalidateRecipients();
+	});
 }
 
 void Notification::OnConfigLoaded()
@@ -200,6 +213,47 @@ std::set<UserGroup::Ptr> Notification::GetUserGroups() const
 	return result;
 }
 
+/**
+ * Returns the users and the members of the user groups, without duplicates.
+ * The result is cached until the recipients may have changed.
+ */
+std::shared_ptr<const std::vector<User::Ptr> > Notification::GetRecipients()
+{
+	uint_fast64_t version = l_RecipientsVersion.load();
+
+	{
+		std::unique_lock<std::mutex> lock (m_RecipientsMutex);
+
+		if (m_Recipients && m_RecipientsVersion == version)
+			return m_Recipients;
+	}
+
+	std::set<User::Ptr> allUsers = GetUsers();
+
+	for (const UserGroup::Ptr& ug : GetUserGroups()) {
+		std::set<User::Ptr> members = ug->GetMembers();
+		allUsers.insert(members.begin(), members.end());
+	}
+
+	auto recipients (std::make_shared<const std::vector<User::Ptr> >(allUsers.begin(), allUsers.end()));
+
+	/* If it has been invalidated meanwhile, the next call computes it again. */
+	std::unique_lock<std::mutex> lock (m_RecipientsMutex);
+
+	m_Recipients = recipients;
+	m_RecipientsVersion = version;
+
+	return recipients;
+}
+
+/**
+ * Drops the cached recipients of all notifications, e.g. after group memberships changed.
+ */
+void Notification::InvalidateRecipients()
+{
+	l_RecipientsVersion.fetch_add(1);
+}
+
 TimePeriod::Ptr Notification::GetPeriod() const
 {
 	return TimePeriod::GetByName(GetPeriodRaw());
@@ -384,20 +438,10 @@ void Notification::BeginExecuteNotification(NotificationType type, const CheckRe
 			SetLastProblemNotification(now);
 	}
 
-	std::set<User::Ptr> allUsers;
-
-	std::set<User::Ptr> users = GetUsers();
-	std::copy(users.begin(), users.end(), std::inserter(allUsers, allUsers.begin()));
-
-	for (const UserGroup::Ptr& ug : GetUserGroups()) {
-		std::set<User::Ptr> members = ug->GetMembers();
-		std::copy(members.begin(), members.end(), std::inserter(allUsers, allUsers.begin()));
-	}
-
 	std::set<User::Ptr> allNotifiedUsers;
 	Array::Ptr notifiedProblemUsers = GetNotifiedProblemUsers();
 
-	for (const User::Ptr& user : allUsers) {
+	for (const User::Ptr& user : *GetRecipients()) {
 		String userName = user->GetName();
 
 		if (!user->GetEnableNotifications()) {
@@ -447,13 +491,17 @@ void Notification::BeginExecuteNotification(NotificationType type, const CheckRe
 		allNotifiedUsers.insert(user);
 
 		/* store all notified users for later recovery checks */
-		if (type == NotificationProblem && !notifiedProblemUsers->Contains(userName))
+		if (type == NotificationProblem && !notifiedProblemUsers->Contains(userName)) {
 			notifiedProblemUsers->Add(userName);
+			MarkStateDirty();
+		}
 	}
 
 	/* if this was a recovery notification, reset all notified users */
-	if (type == NotificationRecovery)
+	if (type == NotificationRecovery) {
 		notifiedProblemUsers->Clear();
+		MarkStateDirty();
+	}
 
 	/* used in db_ido for notification history */
 	Service::OnNotificationSentToAllUsers(this, checkable, allNotifiedUsers, type, cr, author, text, nullptr);
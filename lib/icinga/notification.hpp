@@ -13,6 +13,9 @@
 #include "remote/endpoint.hpp"
 #include "remote/messageorigin.hpp"
 #include "base/array.hpp"
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace icinga
 {
@@ -73,6 +76,9 @@ public:
 	TimePeriod::Ptr GetPeriod() const;
 	std::set<User::Ptr> GetUsers() const;
 	std::set<UserGroup::Ptr> GetUserGroups() const;
+	std::shared_ptr<const std::vector<User::Ptr> > GetRecipients();
+
+	static void InvalidateRecipients();
 
 	void UpdateNotificationNumber();
 	void ResetNotificationNumber();
@@ -114,6 +120,10 @@ protected:
 private:
 	ObjectImpl<Checkable>::Ptr m_Checkable;
 
+	std::mutex m_RecipientsMutex;
+	std::shared_ptr<const std::vector<User::Ptr> > m_Recipients;
+	uint_fast64_t m_RecipientsVersion{0};
+
 	bool CheckNotificationUserFilters(NotificationType type, const User::Ptr& user, bool force, bool reminder);
 
 	void ExecuteNotificationHelper(NotificationType type, const User::Ptr& user, const CheckResult::Ptr& cr, bool force, const String& author = "", const String& text = "");
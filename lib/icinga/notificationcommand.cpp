@@ -2,6 +2,7 @@
 
 #include "icinga/notificationcommand.hpp"
 #include "icinga/notificationcommand-ti.cpp"
+#include "base/exception.hpp"
 
 using namespace icinga;
 
@@ -25,3 +26,11 @@ Dictionary::Ptr NotificationCommand::Execute(const Notification::Ptr& notificati
 		useResolvedMacros,
 	});
 }
+
+void NotificationCommand::ValidateBatchInterval(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<NotificationCommand>::ValidateBatchInterval(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "batch_interval" }, "Interval must not be negative."));
+}
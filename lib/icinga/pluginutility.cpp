@@ -9,22 +9,46 @@
 #include "base/process.hpp"
 #include "base/objectlock.hpp"
 #include "base/exception.hpp"
+#include "base/json.hpp"
 #include <boost/algorithm/string/trim.hpp>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
 
 using namespace icinga;
 
+/**
+ * A command execution whose result is shared by all checks which run the
+ * same command line within the command's shared_execution_window.
+ */
+struct SharedCommandExecution
+{
+	double Start;
+	double Expires;
+	bool Finished{false};
+	ProcessResult Result;
+	std::vector<std::function<void(const ProcessResult&)> > Subscribers;
+};
+
+static std::mutex l_SharedExecutionsMutex;
+static std::map<String, std::shared_ptr<SharedCommandExecution> > l_SharedExecutions;
+static std::deque<std::pair<double, String> > l_SharedExecutionsExpiry;
+
 void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj, const Checkable::Ptr& checkable,
 	const CheckResult::Ptr& cr, const MacroProcessor::ResolverList& macroResolvers,
 	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int timeout,
 	const std::function<void(const Value& commandLine, const ProcessResult&)>& callback)
 {
 	Value raw_command = commandObj->GetCommandLine();
-	Dictionary::Ptr raw_arguments = commandObj->GetArguments();
+
+	/* The command line, its arguments and the environment usually share quite a few macros. */
+	MacroResolverMemo memo (macroResolvers, cr);
 
 	Value command;
 
 	try {
-		command = MacroProcessor::ResolveArguments(raw_command, raw_arguments,
+		command = MacroProcessor::ResolveArguments(raw_command, commandObj->GetArgumentsTemplate(),
 			macroResolvers, cr, resolvedMacros, useResolvedMacros);
 	} catch (const std::exception& ex) {
 		String message = DiagnosticInformation(ex);
@@ -74,6 +98,17 @@ void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj, const Checkab
 	if (resolvedMacros && !useResolvedMacros)
 		return;
 
+	auto checkCommand (dynamic_pointer_cast<CheckCommand>(commandObj));
+
+	if (checkCommand && callback) {
+		double window = checkCommand->GetSharedExecutionWindow();
+
+		if (window > 0) {
+			ExecuteSharedCommand(command, envMacros, timeout, window, callback);
+			return;
+		}
+	}
+
 	Process::Ptr process = new Process(Process::PrepareCommand(command), envMacros);
 
 	process->SetTimeout(timeout);
@@ -82,6 +117,91 @@ void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj, const Checkab
 	process->Run(std::bind(callback, command, _1));
 }
 
+/**
+ * Runs a command unless the same command line with the same environment
+ * and timeout has been started within the last window seconds, in which
+ * case the callback receives that execution's result.
+ *
+ * @param command The resolved command line.
+ * @param env The resolved environment variables.
+ * @param timeout The command timeout.
+ * @param window How long (in seconds) after starting the command it may be shared.
+ * @param callback Receives the command line and the result.
+ */
+void PluginUtility::ExecuteSharedCommand(const Value& command, const Dictionary::Ptr& env, int timeout, double window,
+	const std::function<void(const Value& commandLine, const ProcessResult&)>& callback)
+{
+	String key = JsonEncode(new Array({ command, env, timeout }));
+	double now = Utility::GetTime();
+	std::shared_ptr<SharedCommandExecution> execution;
+
+	{
+		std::unique_lock<std::mutex> lock(l_SharedExecutionsMutex);
+
+		/* Running executions are removed by their completion handler once they're expired. */
+		while (!l_SharedExecutionsExpiry.empty() && l_SharedExecutionsExpiry.front().first < now) {
+			auto it (l_SharedExecutions.find(l_SharedExecutionsExpiry.front().second));
+
+			if (it != l_SharedExecutions.end() && it->second->Finished && it->second->Expires < now)
+				l_SharedExecutions.erase(it);
+
+			l_SharedExecutionsExpiry.pop_front();
+		}
+
+		auto it (l_SharedExecutions.find(key));
+
+		if (it != l_SharedExecutions.end() && it->second->Expires >= now) {
+			auto& shared (it->second);
+
+			Log(LogDebug, "PluginUtility")
+				<< "Sharing the result of command " << Process::PrettyPrintArguments(Process::PrepareCommand(command))
+				<< " started at " << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", shared->Start) << ".";
+
+			if (shared->Finished)
+				Utility::QueueAsyncCallback(std::bind(callback, command, shared->Result));
+			else
+				shared->Subscribers.emplace_back(std::bind(callback, command, _1));
+
+			return;
+		}
+
+		execution = std::make_shared<SharedCommandExecution>();
+		execution->Start = now;
+		execution->Expires = now + window;
+		execution->Subscribers.emplace_back(std::bind(callback, command, _1));
+
+		l_SharedExecutions[key] = execution;
+		l_SharedExecutionsExpiry.emplace_back(execution->Expires, key);
+	}
+
+	Process::Ptr process = new Process(Process::PrepareCommand(command), env);
+
+	process->SetTimeout(timeout);
+	process->SetAdjustPriority(true);
+
+	process->Run([execution, key](const ProcessResult& pr) {
+		std::vector<std::function<void(const ProcessResult&)> > subscribers;
+
+		{
+			std::unique_lock<std::mutex> lock(l_SharedExecutionsMutex);
+
+			execution->Finished = true;
+			execution->Result = pr;
+			subscribers.swap(execution->Subscribers);
+
+			if (execution->Expires < Utility::GetTime()) {
+				auto it (l_SharedExecutions.find(key));
+
+				if (it != l_SharedExecutions.end() && it->second == execution)
+					l_SharedExecutions.erase(it);
+			}
+		}
+
+		for (auto& subscriber : subscribers)
+			subscriber(pr);
+	});
+}
+
 ServiceState PluginUtility::ExitStatusToState(int exitStatus)
 {
 	switch (exitStatus) {
@@ -101,23 +221,21 @@ std::pair<String, String> PluginUtility::ParseCheckOutput(const String& output)
 	String text;
 	String perfdata;
 
-	std::vector<String> lines = output.Split("\r\n");
-
-	for (const String& line : lines) {
-		size_t delim = line.FindFirstOf("|");
+	for (auto line : output.SplitView("\r\n")) {
+		size_t delim = line.find('|');
 
 		if (!text.IsEmpty())
 			text += "\n";
 
-		if (delim != String::NPos) {
-			text += line.SubStr(0, delim);
+		if (delim != boost::string_view::npos) {
+			text.Append(line.substr(0, delim));
 
 			if (!perfdata.IsEmpty())
 				perfdata += " ";
 
-			perfdata += line.SubStr(delim + 1, line.GetLength());
+			perfdata.Append(line.substr(delim + 1));
 		} else {
-			text += line;
+			text.Append(line);
 		}
 	}
 
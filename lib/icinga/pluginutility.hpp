@@ -35,6 +35,9 @@ public:
 
 private:
 	PluginUtility();
+
+	static void ExecuteSharedCommand(const Value& command, const Dictionary::Ptr& env, int timeout, double window,
+		const std::function<void(const Value& commandLine, const ProcessResult&)>& callback);
 };
 
 }
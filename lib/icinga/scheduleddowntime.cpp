@@ -4,8 +4,8 @@
 #include "icinga/scheduleddowntime-ti.cpp"
 #include "icinga/legacytimeperiod.hpp"
 #include "icinga/downtime.hpp"
+#include "icinga/deadlinescheduler.hpp"
 #include "icinga/service.hpp"
-#include "base/timer.hpp"
 #include "base/configtype.hpp"
 #include "base/utility.hpp"
 #include "base/objectlock.hpp"
@@ -18,7 +18,14 @@ using namespace icinga;
 
 REGISTER_TYPE(ScheduledDowntime);
 
-static Timer::Ptr l_Timer;
+/* When CreateNextDowntime() may have something to do again. */
+static DeadlineScheduler l_ScheduledDowntimesCheck ([](const ConfigObject::Ptr& object) {
+	ScheduledDowntime::Ptr sd = static_pointer_cast<ScheduledDowntime>(object);
+
+	/* Another endpoint takes care of it, Resume() schedules a check once we're responsible again. */
+	if (sd->IsActive() && !sd->IsPaused())
+		sd->CreateNextDowntime();
+});
 
 String ScheduledDowntimeNameComposer::MakeName(const String& shortName, const Object::Ptr& context) const
 {
@@ -73,23 +80,31 @@ void ScheduledDowntime::Start(bool runtimeCreated)
 
 	static boost::once_flag once = BOOST_ONCE_INIT;
 
-	boost::call_once(once, [this]() {
-		l_Timer = new Timer();
-		l_Timer->SetInterval(60);
-		l_Timer->OnTimerExpired.connect(std::bind(&ScheduledDowntime::TimerProc));
-		l_Timer->Start();
+	boost::call_once(once, []() {
+		ScheduledDowntime::OnRangesChanged.connect([](const ScheduledDowntime::Ptr& sd, const Value&) {
+			sd->ResetNextDowntimeCheck();
+		});
 	});
 
 	if (!IsPaused())
 		Utility::QueueAsyncCallback(std::bind(&ScheduledDowntime::CreateNextDowntime, this));
 }
 
-void ScheduledDowntime::TimerProc()
+/* Don't trust what we knew before another endpoint took care of it. */
+void ScheduledDowntime::Resume()
 {
-	for (const ScheduledDowntime::Ptr& sd : ConfigType::GetObjectsByType<ScheduledDowntime>()) {
-		if (sd->IsActive() && !sd->IsPaused())
-			sd->CreateNextDowntime();
-	}
+	ObjectImpl<ScheduledDowntime>::Resume();
+
+	ResetNextDowntimeCheck();
+}
+
+/**
+ * Makes the scheduler check right away whether a new downtime has to be
+ * created, e.g. after one of ours was removed.
+ */
+void ScheduledDowntime::ResetNextDowntimeCheck()
+{
+	l_ScheduledDowntimesCheck.Schedule(this, Utility::GetTime());
 }
 
 Checkable::Ptr ScheduledDowntime::GetCheckable() const
@@ -229,6 +244,7 @@ void ScheduledDowntime::CreateNextDowntime()
 	}
 
 	double minEnd = 0;
+	double now = Utility::GetTime();
 
 	for (const Downtime::Ptr& downtime : GetCheckable()->GetDowntimes()) {
 		double end = downtime->GetEndTime();
@@ -236,13 +252,19 @@ void ScheduledDowntime::CreateNextDowntime()
 			minEnd = end;
 
 		if (downtime->GetScheduledBy() != GetName() ||
-			downtime->GetStartTime() < Utility::GetTime())
+			downtime->GetStartTime() < now)
 			continue;
 
-		/* We've found a downtime that is owned by us and that hasn't started yet - we're done. */
+		/* We've found a downtime that is owned by us and that hasn't started yet - we're done
+		 * until it starts.
+		 */
+		l_ScheduledDowntimesCheck.Schedule(this, downtime->GetStartTime());
 		return;
 	}
 
+	/* The ranges may yield a new segment any time, look again in a minute. */
+	l_ScheduledDowntimesCheck.Schedule(this, now + 60);
+
 	Log(LogDebug, "ScheduledDowntime")
 		<< "Creating new Downtime for ScheduledDowntime \"" << GetName() << "\"";
 
@@ -258,6 +280,9 @@ void ScheduledDowntime::CreateNextDowntime()
 		GetFixed(), String(), GetDuration(), GetName(), GetName());
 	String downtimeName = downtime->GetName();
 
+	if (segment.first >= now)
+		l_ScheduledDowntimesCheck.Schedule(this, segment.first);
+
 	int childOptions = Downtime::ChildOptionsFromValue(GetChildOptions());
 	if (childOptions > 0) {
 		/* 'DowntimeTriggeredChildren' schedules child downtimes triggered by the parent downtime.
@@ -33,19 +33,20 @@ public:
 	static void EvaluateApplyRules(const intrusive_ptr<Service>& service);
 	static bool AllConfigIsLoaded();
 
+	void ResetNextDowntimeCheck();
+	void CreateNextDowntime();
+
 	void ValidateRanges(const Lazy<Dictionary::Ptr>& lvalue, const ValidationUtils& utils) override;
 	void ValidateChildOptions(const Lazy<Value>& lvalue, const ValidationUtils& utils) override;
 
 protected:
 	void OnAllConfigLoaded() override;
 	void Start(bool runtimeCreated) override;
+	void Resume() override;
 
 private:
-	static void TimerProc();
-
 	std::pair<double, double> FindRunningSegment(double minEnd = 0);
 	std::pair<double, double> FindNextSegment();
-	void CreateNextDowntime();
 
 	static std::atomic<bool> m_AllConfigLoaded;
 
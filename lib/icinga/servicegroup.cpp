@@ -50,13 +50,12 @@ void ServiceGroup::EvaluateObjectRules(const Service::Ptr& service)
 {
 	CONTEXT("Evaluating group membership for service '" + service->GetName() + "'");
 
-	for (const ConfigItem::Ptr& group : ConfigItem::GetItems(ServiceGroup::TypeInstance))
-	{
-		if (!group->GetFilter())
-			continue;
+	ScriptFrame frame(true);
+	frame.Locals->Set("host", service->GetHost());
+	frame.Locals->Set("service", service);
 
+	for (const ConfigItem::Ptr& group : ConfigItem::GetObjectRuleCandidates(ServiceGroup::TypeInstance, frame))
 		EvaluateObjectRule(service, group);
-	}
 }
 
 std::set<Service::Ptr> ServiceGroup::GetMembers() const
@@ -0,0 +1,220 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/statehistoryring.hpp"
+#include "base/base64.hpp"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+using namespace icinga;
+
+/**
+ * Records the state of a checkable if it differs from the last recorded one.
+ *
+ * @param timestamp When the checkable changed to that state
+ * @param state The new state
+ * @param stateType The new state type
+ * @param reachable Whether the checkable is reachable
+ * @param retention Entries older than this many seconds are dropped, 0 keeps as many as fit
+ */
+void StateHistoryRing::Add(double timestamp, ServiceState state, StateType stateType, bool reachable, double retention)
+{
+	StateHistoryEntry entry;
+	entry.Timestamp = timestamp;
+	entry.State = state;
+	entry.HardState = stateType == StateTypeHard;
+	entry.Reachable = reachable;
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	if (m_Length) {
+		auto& last (At(m_Length - 1));
+
+		/* Late check results can't be inserted anymore, they don't change the current state either. */
+		if (timestamp < last.Timestamp)
+			return;
+
+		if (last.State == entry.State && last.HardState == entry.HardState && last.Reachable == entry.Reachable)
+			return;
+	}
+
+	Push(entry);
+
+	if (retention > 0) {
+		double cutoff = timestamp - retention;
+
+		/* The last entry before the cutoff is still needed for the state at the cutoff. */
+		while (m_Length > 1 && At(1).Timestamp <= cutoff)
+			PopFront();
+	}
+}
+
+void StateHistoryRing::Clear()
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	std::vector<StateHistoryEntry>().swap(m_Buffer);
+	m_Head = 0;
+	m_Length = 0;
+}
+
+/**
+ * @returns Whether the state at the given time is known
+ */
+bool StateHistoryRing::Covers(double timestamp) const
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	return m_Length && At(0).Timestamp <= timestamp;
+}
+
+/**
+ * Returns the transitions during a time range, starting with the one which
+ * was still current at the start of the range (if it's known).
+ *
+ * @param from The start of the time range
+ * @param until The end of the time range
+ * @returns The transitions, oldest first
+ */
+std::vector<StateHistoryEntry> StateHistoryRing::GetEntries(double from, double until) const
+{
+	std::vector<StateHistoryEntry> result;
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	for (size_t i = 0; i < m_Length; i++) {
+		auto& entry (At(i));
+
+		if (entry.Timestamp >= until)
+			break;
+
+		if (i + 1 < m_Length && At(i + 1).Timestamp <= from)
+			continue;
+
+		result.emplace_back(entry);
+	}
+
+	return result;
+}
+
+/**
+ * Sums up how long the checkable was in which state during a time range.
+ * The last transition's state counts as the current one until the end of the range.
+ *
+ * @param from The start of the time range
+ * @param until The end of the time range
+ * @returns The durations in seconds
+ */
+StateHistoryAvailability StateHistoryRing::GetAvailability(double from, double until) const
+{
+	StateHistoryAvailability result;
+	auto entries (GetEntries(from, until));
+
+	if (entries.empty()) {
+		result.Unmonitored = std::max(until - from, 0.0);
+		return result;
+	}
+
+	if (entries.front().Timestamp > from)
+		result.Unmonitored = entries.front().Timestamp - from;
+
+	for (decltype(entries.size()) i = 0; i < entries.size(); i++) {
+		double start = std::max(entries[i].Timestamp, from);
+		double end = i + 1 < entries.size() ? entries[i + 1].Timestamp : until;
+
+		if (end > start)
+			result.Durations[std::min<uint32_t>(entries[i].State, ServiceUnknown)] += end - start;
+	}
+
+	return result;
+}
+
+String StateHistoryRing::Serialize() const
+{
+	std::string data;
+
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		data.resize(m_Length * sizeof(StateHistoryEntry));
+
+		for (size_t i = 0; i < m_Length; i++) {
+			auto& entry (At(i));
+			uint32_t bits = entry.State | entry.HardState << 8u | entry.Reachable << 9u;
+			char *record = &data[i * sizeof(StateHistoryEntry)];
+
+			memcpy(record, &entry.Timestamp, sizeof(entry.Timestamp));
+			memcpy(record + 8, &bits, sizeof(bits));
+			memset(record + 12, 0, 4);
+		}
+	}
+
+	if (data.empty())
+		return String();
+
+	return Base64::Encode(String(std::move(data)));
+}
+
+void StateHistoryRing::Deserialize(const String& data)
+{
+	String raw = data.IsEmpty() ? String() : Base64::Decode(data);
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	m_Head = 0;
+	m_Length = 0;
+
+	for (size_t offset = 0; offset + sizeof(StateHistoryEntry) <= raw.GetLength(); offset += sizeof(StateHistoryEntry)) {
+		const char *record = raw.CStr() + offset;
+		StateHistoryEntry entry;
+		uint32_t bits;
+
+		memcpy(&entry.Timestamp, record, sizeof(entry.Timestamp));
+		memcpy(&bits, record + 8, sizeof(bits));
+
+		entry.State = bits & 0xffu;
+		entry.HardState = bits >> 8u & 1u;
+		entry.Reachable = bits >> 9u & 1u;
+
+		Push(entry);
+	}
+}
+
+/* The following functions have to be called with m_Mutex held. */
+
+const StateHistoryEntry& StateHistoryRing::At(size_t index) const
+{
+	return m_Buffer[(m_Head + index) % m_Buffer.size()];
+}
+
+void StateHistoryRing::Push(const StateHistoryEntry& entry)
+{
+	if (m_Length == m_Buffer.size()) {
+		if (m_Buffer.size() < MaxEntries) {
+			/* Most checkables hardly ever change their state, so the ring grows on demand. */
+			size_t capacity = std::max<size_t>(m_Buffer.size() * 2, 8);
+
+			if (capacity > MaxEntries)
+				capacity = MaxEntries;
+
+			std::vector<StateHistoryEntry> buffer (capacity);
+
+			for (size_t i = 0; i < m_Length; i++)
+				buffer[i] = At(i);
+
+			m_Buffer = std::move(buffer);
+			m_Head = 0;
+		} else {
+			PopFront();
+		}
+	}
+
+	m_Buffer[(m_Head + m_Length) % m_Buffer.size()] = entry;
+	m_Length++;
+}
+
+void StateHistoryRing::PopFront()
+{
+	m_Head = (m_Head + 1) % m_Buffer.size();
+	m_Length--;
+}
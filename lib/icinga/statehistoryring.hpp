@@ -0,0 +1,91 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef STATEHISTORYRING_H
+#define STATEHISTORYRING_H
+
+#include "icinga/i2-icinga.hpp"
+#include "icinga/checkresult.hpp"
+#include "base/string.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A state transition of a checkable.
+ *
+ * @ingroup icinga
+ */
+struct StateHistoryEntry
+{
+	double Timestamp;
+	uint32_t State : 8; /**< ServiceState, also for hosts */
+	uint32_t HardState : 1;
+	uint32_t Reachable : 1;
+};
+
+static_assert(sizeof(StateHistoryEntry) == 16, "StateHistoryEntry must be 16 bytes.");
+
+/**
+ * How long a checkable was in which state during a time range.
+ *
+ * @ingroup icinga
+ */
+struct StateHistoryAvailability
+{
+	double Durations[4]{0, 0, 0, 0}; /**< indexed by ServiceState */
+	double Unmonitored{0}; /**< before the oldest transition */
+};
+
+/**
+ * Keeps the recent state transitions of a checkable in a ring buffer,
+ * so that availability queries don't have to read any history from disk.
+ *
+ * The oldest entry is the state at the start of the covered time range.
+ * Entries older than the retention period are dropped as soon as the next
+ * entry is older than the retention period as well. If the ring is full,
+ * the oldest entry is dropped regardless.
+ *
+ * The serialized form (for the state file) is the base64-encoded sequence
+ * of entries, 16 bytes each: the timestamp as double, the packed state bits
+ * as uint32 and four unused bytes. Numbers are stored in host byte order.
+ *
+ * @ingroup icinga
+ */
+class StateHistoryRing final
+{
+public:
+	static const size_t MaxEntries = 4096;
+
+	StateHistoryRing() = default;
+
+	StateHistoryRing(const StateHistoryRing&) = delete;
+	StateHistoryRing& operator=(const StateHistoryRing&) = delete;
+
+	void Add(double timestamp, ServiceState state, StateType stateType, bool reachable, double retention);
+	void Clear();
+
+	bool Covers(double timestamp) const;
+	std::vector<StateHistoryEntry> GetEntries(double from, double until) const;
+	StateHistoryAvailability GetAvailability(double from, double until) const;
+
+	String Serialize() const;
+	void Deserialize(const String& data);
+
+private:
+	mutable std::mutex m_Mutex;
+	std::vector<StateHistoryEntry> m_Buffer;
+	size_t m_Head{0};
+	size_t m_Length{0};
+
+	const StateHistoryEntry& At(size_t index) const;
+	void Push(const StateHistoryEntry& entry);
+	void PopFront();
+};
+
+}
+
+#endif /* STATEHISTORYRING_H */
@@ -10,6 +10,7 @@
 #include "base/timer.hpp"
 #include "base/utility.hpp"
 #include <boost/thread/once.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
@@ -42,9 +43,14 @@ void TimePeriod::AddSegment(double begin, double end)
 {
 	ASSERT(OwnsLock());
 
-	Log(LogDebug, "TimePeriod")
-		<< "Adding segment '" << Utility::FormatDateTime("%c", begin) << "' <-> '"
-		<< Utility::FormatDateTime("%c", end) << "' to TimePeriod '" << GetName() << "'";
+	/* The segments are modified in place. */
+	m_CompiledSegmentsSource = nullptr;
+
+	if (LogDebug >= Logger::GetMinLogSeverity()) {
+		Log(LogDebug, "TimePeriod")
+			<< "Adding segment '" << Utility::FormatDateTime("%c", begin) << "' <-> '"
+			<< Utility::FormatDateTime("%c", end) << "' to TimePeriod '" << GetName() << "'";
+	}
 
 	if (GetValidBegin().IsEmpty() || begin < GetValidBegin())
 		SetValidBegin(begin);
@@ -103,9 +109,11 @@ void TimePeriod::RemoveSegment(double begin, double end)
 {
 	ASSERT(OwnsLock());
 
-	Log(LogDebug, "TimePeriod")
-		<< "Removing segment '" << Utility::FormatDateTime("%c", begin) << "' <-> '"
-		<< Utility::FormatDateTime("%c", end) << "' from TimePeriod '" << GetName() << "'";
+	if (LogDebug >= Logger::GetMinLogSeverity()) {
+		Log(LogDebug, "TimePeriod")
+			<< "Removing segment '" << Utility::FormatDateTime("%c", begin) << "' <-> '"
+			<< Utility::FormatDateTime("%c", end) << "' from TimePeriod '" << GetName() << "'";
+	}
 
 	if (GetValidBegin().IsEmpty() || begin < GetValidBegin())
 		SetValidBegin(begin);
@@ -288,15 +296,64 @@ bool TimePeriod::IsInside(double ts) const
 
 	Array::Ptr segments = GetSegments();
 
-	if (segments) {
+	if (!segments)
+		return false;
+
+	if (m_CompiledSegmentsSource != segments)
+		CompileSegments(segments);
+
+	/* The last segment which begins before ts is the only one which may contain it. */
+	auto it (std::lower_bound(m_CompiledSegments.begin(), m_CompiledSegments.end(), std::make_pair(ts, ts)));
+
+	if (it == m_CompiledSegments.begin())
+		return false;
+
+	--it;
+
+	return ts > it->first && ts < it->second;
+}
+
+/**
+ * Sorts the segments and merges overlapping ones so IsInside() can use a
+ * binary search. Segments which only touch each other are kept apart, their
+ * common boundary isn't inside either of them.
+ *
+ * @param segments The segments.
+ */
+void TimePeriod::CompileSegments(const Array::Ptr& segments) const
+{
+	ASSERT(OwnsLock());
+
+	std::vector<std::pair<double, double> > compiled;
+
+	{
 		ObjectLock dlock(segments);
+
+		compiled.reserve(segments->GetLength());
+
 		for (const Dictionary::Ptr& segment : segments) {
-			if (ts > segment->Get("begin") && ts < segment->Get("end"))
-				return true;
+			double begin = segment->Get("begin");
+			double end = segment->Get("end");
+
+			if (begin < end)
+				compiled.emplace_back(begin, end);
+		}
+	}
+
+	std::sort(compiled.begin(), compiled.end());
+
+	m_CompiledSegments.clear();
+
+	for (auto& segment : compiled) {
+		if (!m_CompiledSegments.empty() && segment.first < m_CompiledSegments.back().second) {
+			if (segment.second > m_CompiledSegments.back().second)
+				m_CompiledSegments.back().second = segment.second;
+		} else {
+			m_CompiledSegments.push_back(segment);
 		}
 	}
 
-	return false;
+	m_CompiledSegmentsSource = segments;
 }
 
 double TimePeriod::FindNextTransition(double begin)
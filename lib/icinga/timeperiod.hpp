@@ -5,6 +5,8 @@
 
 #include "icinga/i2-icinga.hpp"
 #include "icinga/timeperiod-ti.hpp"
+#include <utility>
+#include <vector>
 
 namespace icinga
 {
@@ -32,6 +34,12 @@ public:
 	void ValidateRanges(const Lazy<Dictionary::Ptr>& lvalue, const ValidationUtils& utils) override;
 
 private:
+	/* Sorted, non-overlapping copy of the segments for IsInside(). Protected by the object lock. */
+	mutable Array::Ptr m_CompiledSegmentsSource;
+	mutable std::vector<std::pair<double, double> > m_CompiledSegments;
+
+	void CompileSegments(const Array::Ptr& segments) const;
+
 	void AddSegment(double s, double end);
 	void AddSegment(const Dictionary::Ptr& segment);
 	void RemoveSegment(double begin, double end);
@@ -2,6 +2,7 @@
 
 #include "icinga/usergroup.hpp"
 #include "icinga/usergroup-ti.cpp"
+#include "icinga/notification.hpp"
 #include "config/objectrule.hpp"
 #include "config/configitem.hpp"
 #include "base/configtype.hpp"
@@ -47,13 +48,11 @@ void UserGroup::EvaluateObjectRules(const User::Ptr& user)
 {
 	CONTEXT("Evaluating group membership for user '" + user->GetName() + "'");
 
-	for (const ConfigItem::Ptr& group : ConfigItem::GetItems(UserGroup::TypeInstance))
-	{
-		if (!group->GetFilter())
-			continue;
+	ScriptFrame frame(true);
+	frame.Locals->Set("user", user);
 
+	for (const ConfigItem::Ptr& group : ConfigItem::GetObjectRuleCandidates(UserGroup::TypeInstance, frame))
 		EvaluateObjectRule(user, group);
-	}
 }
 
 std::set<User::Ptr> UserGroup::GetMembers() const
@@ -66,14 +65,22 @@ void UserGroup::AddMember(const User::Ptr& user)
 {
 	user->AddGroup(GetName());
 
-	std::unique_lock<std::mutex> lock(m_UserGroupMutex);
-	m_Members.insert(user);
+	{
+		std::unique_lock<std::mutex> lock(m_UserGroupMutex);
+		m_Members.insert(user);
+	}
+
+	Notification::InvalidateRecipients();
 }
 
 void UserGroup::RemoveMember(const User::Ptr& user)
 {
-	std::unique_lock<std::mutex> lock(m_UserGroupMutex);
-	m_Members.erase(user);
+	{
+		std::unique_lock<std::mutex> lock(m_UserGroupMutex);
+		m_Members.erase(user);
+	}
+
+	Notification::InvalidateRecipients();
 }
 
 bool UserGroup::ResolveGroupMembership(const User::Ptr& user, bool add, int rstack) {
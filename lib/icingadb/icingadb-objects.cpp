@@ -29,10 +29,12 @@
 #include "icinga/timeperiod.hpp"
 #include "icinga/pluginutility.hpp"
 #include "remote/zone.hpp"
+#include <functional>
 #include <iterator>
 #include <map>
 #include <memory>
 #include <set>
+#include <string>
 #include <utility>
 
 using namespace icinga;
@@ -102,9 +104,10 @@ void IcingaDB::ConfigStaticInitialize()
 
 	Checkable::OnFlappingChange.connect(&IcingaDB::FlappingChangeHandler);
 
+	/* Only the current state is sent, an update still pending for the checkable covers the new one. */
 	Checkable::OnNewCheckResult.connect([](const Checkable::Ptr& checkable, const CheckResult::Ptr&, const MessageOrigin::Ptr&) {
 		IcingaDB::NewCheckResultHandler(checkable);
-	});
+	}, 100000, EventCoalesce);
 
 	Checkable::OnNextCheckChanged.connect([](const Checkable::Ptr& checkable, const Value&) {
 		IcingaDB::NextCheckChangedHandler(checkable);
@@ -162,13 +165,32 @@ void IcingaDB::UpdateAllConfigObjects()
 
 	m_Rcon->FireAndForgetQuery({"EVAL", l_LuaResetDump, "1", "icinga:dump"}, Prio::Config);
 
-	const std::vector<String> globalKeys = {
-			m_PrefixConfigObject + "customvar",
-			m_PrefixConfigObject + "action_url",
-			m_PrefixConfigObject + "notes_url",
-			m_PrefixConfigObject + "icon_image",
-	};
-	DeleteKeys(globalKeys, Prio::Config);
+	/* After a reconnect only the objects which differ from what the previous dump
+	 * has written are sent again, everything else is still in Redis. */
+	bool incremental = m_DumpedTypesValid;
+	m_DumpedTypesValid = false;
+
+	for (auto& type : types) {
+		auto& dumped (m_DumpedTypes[type.second]);
+
+		if (!dumped) {
+			dumped.reset(new DumpedType());
+		}
+
+		if (!incremental) {
+			dumped->Objects.clear();
+		}
+	}
+
+	if (!incremental) {
+		const std::vector<String> globalKeys = {
+				m_PrefixConfigObject + "customvar",
+				m_PrefixConfigObject + "action_url",
+				m_PrefixConfigObject + "notes_url",
+				m_PrefixConfigObject + "icon_image",
+		};
+		DeleteKeys(globalKeys, Prio::Config);
+	}
 	DeleteKeys({"icinga:nextupdate:host", "icinga:nextupdate:service"}, Prio::CheckResult);
 
 	Defer resetDumpedGlobals ([this]() {
@@ -178,31 +200,67 @@ void IcingaDB::UpdateAllConfigObjects()
 		m_DumpedGlobals.IconImage.Reset();
 	});
 
-	upq.ParallelFor(types, [this](const TypePair& type) {
+	upq.ParallelFor(types, [this, incremental](const TypePair& type) {
 		String lcType = type.second;
+		DumpedType& dumped (*m_DumpedTypes.find(lcType)->second);
+		bool dumpState = (lcType == "host" || lcType == "service");
+
+		std::map<String, String> redisChecksums;
+		bool incrementalType = incremental;
 
-		std::vector<String> keys = GetTypeObjectKeys(lcType);
-		DeleteKeys(keys, Prio::Config);
+		if (incrementalType) {
+			Value reply = m_Rcon->GetResultOfQuery({"HGETALL", m_PrefixConfigCheckSum + lcType}, Prio::Config);
+
+			if (reply.IsObjectType<Array>()) {
+				Array::Ptr checksums = reply;
+				ObjectLock olock(checksums);
+
+				for (auto it (checksums->Begin()); it != checksums->End() && it + 1 != checksums->End(); it += 2) {
+					redisChecksums.emplace(*it, *(it + 1));
+				}
+			} else {
+				incrementalType = false;
+			}
+		}
+
+		if (!incrementalType) {
+			std::unique_lock<std::mutex> lock (dumped.Mutex);
+			dumped.Objects.clear();
+
+			std::vector<String> keys = GetTypeObjectKeys(lcType);
+			DeleteKeys(keys, Prio::Config);
+		}
 
 		auto objectChunks (ChunkObjects(type.first->GetObjects(), 500));
 
 		WorkQueue upqObjectType(25000, Configuration::Concurrency);
 		upqObjectType.SetName("IcingaDB:ConfigDump:" + lcType);
 
-		upqObjectType.ParallelFor(objectChunks, [this, &type, &lcType](decltype(objectChunks)::const_reference chunk) {
-			std::map<String, std::vector<String>> hMSets, publishes;
+		upqObjectType.ParallelFor(objectChunks, [this, &type, &lcType, &dumped, &redisChecksums, dumpState](decltype(objectChunks)::const_reference chunk) {
+			std::map<String, std::vector<String>> hMSets, hDels, publishes;
 			std::vector<String> states 							= {"HMSET", m_PrefixStateObject + lcType};
 			std::vector<std::vector<String> > transaction 		= {{"MULTI"}};
 			std::vector<String> hostZAdds = {"ZADD", "icinga:nextupdate:host"}, serviceZAdds = {"ZADD", "icinga:nextupdate:service"};
 
-			bool dumpState = (lcType == "host" || lcType == "service");
-
-			size_t bulkCounter = 0;
+			size_t bulkCounter = 0, changedCounter = 0;
 			for (const ConfigObject::Ptr& object : chunk) {
 				if (lcType != GetLowerCaseTypeNameDB(object))
 					continue;
 
-				CreateConfigUpdate(object, lcType, hMSets, publishes, false);
+				std::map<String, std::vector<String>> objectHMSets;
+				CreateConfigUpdate(object, lcType, objectHMSets, publishes, false);
+
+				if (UpdateDumpedObject(dumped, lcType, objectHMSets, redisChecksums, hDels)) {
+					for (auto& kv : objectHMSets) {
+						auto& fields (hMSets[kv.first]);
+
+						for (auto& field : kv.second) {
+							fields.emplace_back(std::move(field));
+						}
+					}
+
+					changedCounter++;
+				}
 
 				// Write out inital state for checkables
 				if (dumpState) {
@@ -212,6 +270,11 @@ void IcingaDB::UpdateAllConfigObjects()
 
 				bulkCounter++;
 				if (!(bulkCounter % 100)) {
+					for (auto& kv : hDels) {
+						kv.second.insert(kv.second.begin(), {"HDEL", kv.first});
+						transaction.emplace_back(std::move(kv.second));
+					}
+
 					for (auto& kv : hMSets) {
 						if (!kv.second.empty()) {
 							kv.second.insert(kv.second.begin(), {"HMSET", kv.first});
@@ -238,6 +301,7 @@ void IcingaDB::UpdateAllConfigObjects()
 					}
 
 					hMSets = decltype(hMSets)();
+					hDels = decltype(hDels)();
 					publishes = decltype(publishes)();
 
 					if (transaction.size() > 1) {
@@ -265,6 +329,11 @@ void IcingaDB::UpdateAllConfigObjects()
 				}
 			}
 
+			for (auto& kv : hDels) {
+				kv.second.insert(kv.second.begin(), {"HDEL", kv.first});
+				transaction.emplace_back(std::move(kv.second));
+			}
+
 			for (auto& kv : hMSets) {
 				if (!kv.second.empty()) {
 					kv.second.insert(kv.second.begin(), {"HMSET", kv.first});
@@ -300,7 +369,7 @@ void IcingaDB::UpdateAllConfigObjects()
 			}
 
 			Log(LogNotice, "IcingaDB")
-					<< "Dumped " << bulkCounter << " objects of type " << type.second;
+					<< "Dumped " << changedCounter << " of " << bulkCounter << " objects of type " << type.second;
 		});
 
 		upqObjectType.Join();
@@ -313,12 +382,64 @@ void IcingaDB::UpdateAllConfigObjects()
 			}
 		}
 
+		/* Remove the objects which are gone since the previous dump. */
+		std::map<String, std::vector<String>> hDels;
+
+		{
+			std::unique_lock<std::mutex> lock (dumped.Mutex);
+
+			for (auto it (dumped.Objects.begin()); it != dumped.Objects.end();) {
+				if (it->second.Seen) {
+					it->second.Seen = false;
+					++it;
+					continue;
+				}
+
+				for (auto& field : it->second.Fields) {
+					hDels[field.first].emplace_back(field.second);
+				}
+
+				redisChecksums.emplace(it->first, String());
+				dumped.Objects.erase(it++);
+			}
+
+			for (auto& kv : redisChecksums) {
+				if (dumped.Objects.find(kv.first) != dumped.Objects.end()) {
+					continue;
+				}
+
+				hDels[m_PrefixConfigObject + lcType].emplace_back(kv.first);
+				hDels[m_PrefixConfigCheckSum + lcType].emplace_back(kv.first);
+
+				if (dumpState) {
+					hDels[m_PrefixStateObject + lcType].emplace_back(kv.first);
+				}
+			}
+		}
+
+		if (!hDels.empty()) {
+			std::vector<std::vector<String>> transaction = {{"MULTI"}};
+
+			for (auto& kv : hDels) {
+				std::set<String> fields (kv.second.begin(), kv.second.end());
+				std::vector<String> hDel = {"HDEL", kv.first};
+
+				hDel.insert(hDel.end(), fields.begin(), fields.end());
+				transaction.emplace_back(std::move(hDel));
+			}
+
+			transaction.push_back({"EXEC"});
+			m_Rcon->FireAndForgetQueries(std::move(transaction), Prio::Config);
+		}
+
 		m_Rcon->FireAndForgetQuery({"XADD", "icinga:dump", "*", "type", lcType, "state", "done"}, Prio::Config);
 	});
 
 	upq.Join();
 
-	if (upq.HasExceptions()) {
+	bool failed = upq.HasExceptions();
+
+	if (failed) {
 		for (boost::exception_ptr exc : upq.GetExceptions()) {
 			try {
 				if (exc) {
@@ -338,6 +459,8 @@ void IcingaDB::UpdateAllConfigObjects()
 	m_Rcon->EnqueueCallback([&p](boost::asio::yield_context& yc) { p.set_value(); }, Prio::Config);
 	p.get_future().wait();
 
+	m_DumpedTypesValid = !failed && m_Rcon->IsConnected();
+
 	Log(LogInformation, "IcingaDB")
 			<< "Initial config/status dump finished in " << Utility::GetTime() - startTime << " seconds.";
 }
@@ -362,6 +485,242 @@ std::vector<std::vector<intrusive_ptr<ConfigObject>>> IcingaDB::ChunkObjects(std
 	return std::move(chunks);
 }
 
+/**
+ * Compares what the config dump is about to write for an object with what the previous dump has written.
+ * Fields which were written previously but are gone now are added to hDels.
+ *
+ * @param dumped What the previous dump has written for the object's type
+ * @param typeName The object's type
+ * @param hMSets What the config dump is about to write for the object
+ * @param redisChecksums The object checksums currently in Redis
+ * @param hDels Receives the fields to delete
+ *
+ * @return Whether the object has to be written
+ */
+bool IcingaDB::UpdateDumpedObject(DumpedType& dumped, const String& typeName, const std::map<String, std::vector<String>>& hMSets,
+	const std::map<String, String>& redisChecksums, std::map<String, std::vector<String>>& hDels)
+{
+	String objectKey;
+	DumpedObject object;
+
+	if (!GetDumpedObject(typeName, hMSets, objectKey, object)) {
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock (dumped.Mutex);
+
+	auto it (dumped.Objects.find(objectKey));
+
+	if (it == dumped.Objects.end()) {
+		dumped.Objects.emplace(objectKey, std::move(object));
+		return true;
+	}
+
+	auto redisChecksum (redisChecksums.find(objectKey));
+
+	bool changed = it->second.Checksum != object.Checksum || redisChecksum == redisChecksums.end() ||
+		redisChecksum->second != object.RedisChecksum;
+
+	if (changed) {
+		std::set<std::pair<String, String>> fields (object.Fields.begin(), object.Fields.end());
+
+		for (auto& field : it->second.Fields) {
+			if (fields.find(field) == fields.end()) {
+				hDels[field.first].emplace_back(field.second);
+			}
+		}
+	}
+
+	it->second = std::move(object);
+
+	return changed;
+}
+
+/**
+ * Globals are shared between objects and only written by the first object which uses them.
+ */
+bool IcingaDB::IsGlobalConfigKey(const String& key) const
+{
+	return key == m_PrefixConfigObject + "customvar" || key == m_PrefixConfigObject + "action_url" ||
+		key == m_PrefixConfigObject + "notes_url" || key == m_PrefixConfigObject + "icon_image";
+}
+
+/**
+ * Summarizes what's about to be written for an object.
+ *
+ * @param typeName The object's type
+ * @param hMSets What's about to be written for the object
+ * @param objectKey Receives the object's key
+ * @param object Receives the summary
+ *
+ * @return false if hMSets doesn't contain the object itself
+ */
+bool IcingaDB::GetDumpedObject(const String& typeName, const std::map<String, std::vector<String>>& hMSets,
+	String& objectKey, DumpedObject& object)
+{
+	auto chksms (hMSets.find(m_PrefixConfigCheckSum + typeName));
+
+	if (chksms == hMSets.end() || chksms->second.size() < 2u) {
+		return false;
+	}
+
+	objectKey = chksms->second[0];
+	object.RedisChecksum = chksms->second[1];
+	object.Seen = true;
+
+	std::hash<std::string> hashValue;
+	String data;
+
+	for (auto& kv : hMSets) {
+		if (IsGlobalConfigKey(kv.first)) {
+			continue;
+		}
+
+		for (size_t i = 0; i + 1u < kv.second.size(); i += 2u) {
+			object.Fields.emplace_back(kv.first, kv.second[i]);
+			object.ValueHashes.emplace_back(hashValue(kv.second[i + 1u].GetData()));
+
+			data += kv.first;
+			data += "\n";
+			data += kv.second[i];
+			data += "\n";
+			data += kv.second[i + 1u];
+			data += "\n";
+		}
+	}
+
+	object.Checksum = SHA1(data);
+
+	return true;
+}
+
+/**
+ * Reduces a runtime update to the fields which differ from what has been
+ * written for the object before, by the config dump or a previous update.
+ * Fields which were written previously but are gone now are added to hDels.
+ *
+ * @param typeName The object's type
+ * @param hMSets What's about to be written for the object, unchanged fields are removed
+ * @param publishes The update events, the ones for unchanged fields are removed
+ * @param hDels Receives the fields to delete
+ *
+ * @return Whether anything has changed at all
+ */
+bool IcingaDB::DiffConfigUpdate(const String& typeName, std::map<String, std::vector<String>>& hMSets,
+	std::map<String, std::vector<String>>& publishes, std::map<String, std::vector<String>>& hDels)
+{
+	auto dumped (m_DumpedTypes.find(typeName));
+
+	if (dumped == m_DumpedTypes.end() || !dumped->second) {
+		return true;
+	}
+
+	String objectKey;
+	DumpedObject object;
+
+	if (!GetDumpedObject(typeName, hMSets, objectKey, object)) {
+		return true;
+	}
+
+	std::set<std::pair<String, String>> unchanged;
+
+	{
+		std::unique_lock<std::mutex> lock (dumped->second->Mutex);
+		auto it (dumped->second->Objects.find(objectKey));
+
+		/* A config dump is running, it may or may not see this update. Let the next update write everything. */
+		if (!m_DumpedTypesValid.load()) {
+			if (it != dumped->second->Objects.end()) {
+				dumped->second->Objects.erase(it);
+			}
+
+			return true;
+		}
+
+		if (it == dumped->second->Objects.end()) {
+			dumped->second->Objects.emplace(objectKey, std::move(object));
+			return true;
+		}
+
+		std::map<std::pair<String, String>, size_t> previous;
+
+		for (size_t i = 0; i < it->second.Fields.size() && i < it->second.ValueHashes.size(); i++) {
+			previous.emplace(it->second.Fields[i], it->second.ValueHashes[i]);
+		}
+
+		for (size_t i = 0; i < object.Fields.size(); i++) {
+			auto field (previous.find(object.Fields[i]));
+
+			if (field != previous.end()) {
+				if (field->second == object.ValueHashes[i]) {
+					unchanged.emplace(field->first);
+				}
+
+				previous.erase(field);
+			}
+		}
+
+		for (auto& field : previous) {
+			hDels[field.first.first].emplace_back(field.first.second);
+		}
+
+		it->second = std::move(object);
+	}
+
+	bool changed = !hDels.empty();
+
+	for (auto& kv : hMSets) {
+		if (IsGlobalConfigKey(kv.first)) {
+			continue;
+		}
+
+		std::vector<String> fields;
+
+		for (size_t i = 0; i + 1u < kv.second.size(); i += 2u) {
+			if (unchanged.find({ kv.first, kv.second[i] }) == unchanged.end()) {
+				fields.emplace_back(std::move(kv.second[i]));
+				fields.emplace_back(std::move(kv.second[i + 1u]));
+			}
+		}
+
+		changed = changed || !fields.empty();
+		kv.second = std::move(fields);
+	}
+
+	/* The globals belong to the object's relations, they only have to be written if these changed. */
+	if (!changed) {
+		hMSets.clear();
+		publishes.clear();
+		return false;
+	}
+
+	const String channelPrefix = "icinga:config:update:";
+
+	for (auto& kv : publishes) {
+		if (kv.first.Find(channelPrefix) != 0) {
+			continue;
+		}
+
+		String key = m_PrefixConfigObject + kv.first.SubStr(channelPrefix.GetLength());
+
+		if (IsGlobalConfigKey(key)) {
+			continue;
+		}
+
+		std::vector<String> ids;
+
+		for (auto& id : kv.second) {
+			if (unchanged.find({ key, id }) == unchanged.end()) {
+				ids.emplace_back(std::move(id));
+			}
+		}
+
+		kv.second = std::move(ids);
+	}
+
+	return true;
+}
+
 void IcingaDB::DeleteKeys(const std::vector<String>& keys, RedisConnection::QueryPriority priority) {
 	std::vector<String> query = {"DEL"};
 	for (auto& key : keys) {
@@ -414,11 +773,12 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 	String objectKey = GetObjectIdentifier(object);
 	CustomVarObject::Ptr customVarObject = dynamic_pointer_cast<CustomVarObject>(object);
 	auto env (GetEnvironment());
-	String envId = SHA1(env);
+	String envId = GetEnvironmentId();
 
 	if (customVarObject) {
 		auto vars(SerializeVars(customVarObject));
 		if (vars) {
+			auto relationIds (GetCustomVarRelationIds(customVarObject, vars));
 			auto& typeCvs (hMSets[m_PrefixConfigObject + typeName + ":customvar"]);
 			auto& allCvs (hMSets[m_PrefixConfigObject + "customvar"]);
 
@@ -437,7 +797,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 					publishes["icinga:config:update:customvar"].emplace_back(kv.first);
 				}
 
-				String id = HashValue(new Array(Prepend(env, Prepend(kv.first, GetObjectIdentifiersWithoutEnv(object)))));
+				String id = relationIds->Get(kv.first);
 				typeCvs.emplace_back(id);
 				typeCvs.emplace_back(JsonEncode(new Dictionary({{"object_id", objectKey}, {"environment_id", envId}, {"customvar_id", kv.first}})));
 
@@ -868,10 +1228,16 @@ void IcingaDB::SendConfigUpdate(const ConfigObject::Ptr& object, bool runtimeUpd
 
 	String typeName = GetLowerCaseTypeNameDB(object);
 
-	std::map<String, std::vector<String>> hMSets, publishes;
+	std::map<String, std::vector<String>> hMSets, hDels, publishes;
 	std::vector<String> states 							= {"HMSET", m_PrefixStateObject + typeName};
 
 	CreateConfigUpdate(object, typeName, hMSets, publishes, runtimeUpdate);
+
+	/* E.g. a Director deployment touches many objects, but only changes a few attributes of each. */
+	if (runtimeUpdate) {
+		DiffConfigUpdate(typeName, hMSets, publishes, hDels);
+	}
+
 	Checkable::Ptr checkable = dynamic_pointer_cast<Checkable>(object);
 	if (checkable) {
 		String objectKey = GetObjectIdentifier(object);
@@ -881,6 +1247,11 @@ void IcingaDB::SendConfigUpdate(const ConfigObject::Ptr& object, bool runtimeUpd
 
 	std::vector<std::vector<String> > transaction = {{"MULTI"}};
 
+	for (auto& kv : hDels) {
+		kv.second.insert(kv.second.begin(), {"HDEL", kv.first});
+		transaction.emplace_back(std::move(kv.second));
+	}
+
 	for (auto& kv : hMSets) {
 		if (!kv.second.empty()) {
 			kv.second.insert(kv.second.begin(), {"HMSET", kv.first});
@@ -916,7 +1287,7 @@ void IcingaDB::SendConfigUpdate(const ConfigObject::Ptr& object, bool runtimeUpd
 bool IcingaDB::PrepareObject(const ConfigObject::Ptr& object, Dictionary::Ptr& attributes, Dictionary::Ptr& checksums)
 {
 	attributes->Set("name_checksum", SHA1(object->GetName()));
-	attributes->Set("environment_id", SHA1(GetEnvironment()));
+	attributes->Set("environment_id", GetEnvironmentId());
 	attributes->Set("name", object->GetName());
 
 	Zone::Ptr ObjectsZone = static_pointer_cast<Zone>(object->GetZone());
@@ -1218,6 +1589,14 @@ void IcingaDB::SendConfigDelete(const ConfigObject::Ptr& object)
 	String typeName = object->GetReflectionType()->GetName().ToLower();
 	String objectKey = GetObjectIdentifier(object);
 
+	/* The object may be created again, it has to be written as a whole then. */
+	auto dumped (m_DumpedTypes.find(GetLowerCaseTypeNameDB(object)));
+
+	if (dumped != m_DumpedTypes.end() && dumped->second) {
+		std::unique_lock<std::mutex> lock (dumped->second->Mutex);
+		dumped->second->Objects.erase(objectKey);
+	}
+
 	m_Rcon->FireAndForgetQueries({
 								   {"HDEL",    m_PrefixConfigObject + typeName, objectKey},
 								   {"DEL",     m_PrefixStateObject + typeName + ":" + objectKey},
@@ -1279,7 +1658,7 @@ void IcingaDB::SendStatusUpdate(const ConfigObject::Ptr& object, const CheckResu
 		streamadd.emplace_back(Utility::ValidateUTF8(kv.second));
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(streamadd), Prio::State);
+	FireAndForgetBatched(std::move(streamadd), Prio::State);
 
 	int hard_state;
 	if (!cr) {
@@ -1291,7 +1670,7 @@ void IcingaDB::SendStatusUpdate(const ConfigObject::Ptr& object, const CheckResu
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:state", "*",
 		"id", Utility::NewUniqueID(),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"state_type", Convert::ToString(type),
 		"soft_state", Convert::ToString(cr ? service ? Convert::ToLong(cr->GetState()) : Convert::ToLong(Host::CalculateState(cr->GetState())) : 99),
@@ -1340,7 +1719,7 @@ void IcingaDB::SendStatusUpdate(const ConfigObject::Ptr& object, const CheckResu
 		xAdd.emplace_back(GetObjectIdentifier(endpoint));
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	FireAndForgetBatched(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendSentNotification(
@@ -1366,7 +1745,7 @@ void IcingaDB::SendSentNotification(
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:notification", "*",
 		"id", notificationHistoryId,
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"notification_id", GetObjectIdentifier(notification),
 		"host_id", GetObjectIdentifier(host),
 		"type", Convert::ToString(type),
@@ -1397,19 +1776,19 @@ void IcingaDB::SendSentNotification(
 		xAdd.emplace_back(GetObjectIdentifier(endpoint));
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	FireAndForgetBatched(std::move(xAdd), Prio::History);
 
 	for (const User::Ptr& user : users) {
 		auto userId = GetObjectIdentifier(user);
 		std::vector<String> xAddUser ({
 			"XADD", "icinga:history:stream:usernotification", "*",
 			"id", Utility::NewUniqueID(),
-			"environment_id", SHA1(GetEnvironment()),
+			"environment_id", GetEnvironmentId(),
 			"notification_history_id", notificationHistoryId,
 			"user_id", GetObjectIdentifier(user),
 		});
 
-		m_Rcon->FireAndForgetQuery(std::move(xAddUser), Prio::History);
+		FireAndForgetBatched(std::move(xAddUser), Prio::History);
 	}
 }
 
@@ -1430,7 +1809,7 @@ void IcingaDB::SendStartedDowntime(const Downtime::Ptr& downtime)
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:downtime", "*",
 		"downtime_id", GetObjectIdentifier(downtime),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"entry_time", Convert::ToString(TimestampToMilliseconds(downtime->GetEntryTime())),
 		"author", Utility::ValidateUTF8(downtime->GetAuthor()),
@@ -1479,7 +1858,7 @@ void IcingaDB::SendStartedDowntime(const Downtime::Ptr& downtime)
 		xAdd.emplace_back(GetObjectIdentifier(endpoint));
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	FireAndForgetBatched(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendRemovedDowntime(const Downtime::Ptr& downtime)
@@ -1501,7 +1880,7 @@ void IcingaDB::SendRemovedDowntime(const Downtime::Ptr& downtime)
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:downtime", "*",
 		"downtime_id", GetObjectIdentifier(downtime),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"entry_time", Convert::ToString(TimestampToMilliseconds(downtime->GetEntryTime())),
 		"author", Utility::ValidateUTF8(downtime->GetAuthor()),
@@ -1552,7 +1931,7 @@ void IcingaDB::SendRemovedDowntime(const Downtime::Ptr& downtime)
 		xAdd.emplace_back(GetObjectIdentifier(endpoint));
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	FireAndForgetBatched(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendAddedComment(const Comment::Ptr& comment)
@@ -1569,7 +1948,7 @@ void IcingaDB::SendAddedComment(const Comment::Ptr& comment)
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:comment", "*",
 		"comment_id", GetObjectIdentifier(comment),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"entry_time", Convert::ToString(TimestampToMilliseconds(comment->GetEntryTime())),
 		"author", Utility::ValidateUTF8(comment->GetAuthor()),
@@ -1607,7 +1986,7 @@ void IcingaDB::SendAddedComment(const Comment::Ptr& comment)
 		}
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	FireAndForgetBatched(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendRemovedComment(const Comment::Ptr& comment)
@@ -1624,7 +2003,7 @@ void IcingaDB::SendRemovedComment(const Comment::Ptr& comment)
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:comment", "*",
 		"comment_id", GetObjectIdentifier(comment),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"entry_time", Convert::ToString(TimestampToMilliseconds(comment->GetEntryTime())),
 		"author", Utility::ValidateUTF8(comment->GetAuthor()),
@@ -1674,7 +2053,7 @@ void IcingaDB::SendRemovedComment(const Comment::Ptr& comment)
 		}
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	FireAndForgetBatched(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendFlappingChange(const Checkable::Ptr& checkable, double changeTime, double flappingLastChange)
@@ -1688,7 +2067,7 @@ void IcingaDB::SendFlappingChange(const Checkable::Ptr& checkable, double change
 
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:flapping", "*",
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"flapping_threshold_low", Convert::ToString(checkable->GetFlappingThresholdLow()),
 		"flapping_threshold_high", Convert::ToString(checkable->GetFlappingThresholdHigh()),
@@ -1737,7 +2116,7 @@ void IcingaDB::SendFlappingChange(const Checkable::Ptr& checkable, double change
 	xAdd.emplace_back("id");
 	xAdd.emplace_back(HashValue(new Array({GetEnvironment(), checkable->GetReflectionType()->GetName(), checkable->GetName(), startTime})));
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	FireAndForgetBatched(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendNextUpdate(const Checkable::Ptr& checkable)
@@ -1768,7 +2147,7 @@ void IcingaDB::SendAcknowledgementSet(const Checkable::Ptr& checkable, const Str
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:acknowledgement", "*",
 		"event_id", Utility::NewUniqueID(),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"event_type", "ack_set",
 		"author", author,
@@ -1806,7 +2185,7 @@ void IcingaDB::SendAcknowledgementSet(const Checkable::Ptr& checkable, const Str
 	xAdd.emplace_back("id");
 	xAdd.emplace_back(HashValue(new Array({GetEnvironment(), checkable->GetReflectionType()->GetName(), checkable->GetName(), setTime})));
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	FireAndForgetBatched(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendAcknowledgementCleared(const Checkable::Ptr& checkable, const String& removedBy, double changeTime, double ackLastChange)
@@ -1821,7 +2200,7 @@ void IcingaDB::SendAcknowledgementCleared(const Checkable::Ptr& checkable, const
 	std::vector<String> xAdd ({
 		"XADD", "icinga:history:stream:acknowledgement", "*",
 		"event_id", Utility::NewUniqueID(),
-		"environment_id", SHA1(GetEnvironment()),
+		"environment_id", GetEnvironmentId(),
 		"host_id", GetObjectIdentifier(host),
 		"clear_time", Convert::ToString(TimestampToMilliseconds(changeTime)),
 		"event_type", "ack_clear"
@@ -1856,7 +2235,7 @@ void IcingaDB::SendAcknowledgementCleared(const Checkable::Ptr& checkable, const
 		xAdd.emplace_back(removedBy);
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	FireAndForgetBatched(std::move(xAdd), Prio::History);
 }
 
 Dictionary::Ptr IcingaDB::SerializeState(const Checkable::Ptr& checkable)
@@ -1869,7 +2248,7 @@ Dictionary::Ptr IcingaDB::SerializeState(const Checkable::Ptr& checkable)
 	tie(host, service) = GetHostService(checkable);
 
 	attrs->Set("id", GetObjectIdentifier(checkable));;
-	attrs->Set("environment_id", SHA1(GetEnvironment()));
+	attrs->Set("environment_id", GetEnvironmentId());
 	attrs->Set("state_type", checkable->HasBeenChecked() ? checkable->GetStateType() : StateTypeHard);
 
 	// TODO: last_hard/soft_state should be "previous".
@@ -19,6 +19,7 @@
 #include "icinga/host.hpp"
 #include <boost/algorithm/string.hpp>
 #include <map>
+#include <mutex>
 #include <utility>
 #include <vector>
 
@@ -75,9 +76,44 @@ ArrayData IcingaDB::GetObjectIdentifiersWithoutEnv(const ConfigObject::Ptr& obje
 		return {object->GetName()};
 }
 
+/**
+ * Returns the object's ID. This is requested for every state update and every
+ * related object, so it's cached in the object rather than hashed every time.
+ */
 String IcingaDB::GetObjectIdentifier(const ConfigObject::Ptr& object)
 {
-	return HashValue(new Array(Prepend(GetEnvironment(), GetObjectIdentifiersWithoutEnv(object))));
+	String environment = GetEnvironment();
+	Value cached = object->GetExtension("IcingaDBIdentifier");
+
+	if (cached.IsObjectType<Array>()) {
+		Array::Ptr identifier = cached;
+
+		if (identifier->Get(0) == environment)
+			return identifier->Get(1);
+	}
+
+	String id = HashValue(new Array(Prepend(environment, GetObjectIdentifiersWithoutEnv(object))));
+
+	object->SetExtension("IcingaDBIdentifier", new Array({ environment, id }));
+
+	return id;
+}
+
+String IcingaDB::GetEnvironmentId()
+{
+	static std::mutex mutex;
+	static String environment, environmentId;
+
+	String current = GetEnvironment();
+
+	std::unique_lock<std::mutex> lock (mutex);
+
+	if (environmentId.IsEmpty() || current != environment) {
+		environment = current;
+		environmentId = SHA1(current);
+	}
+
+	return environmentId;
 }
 
 static const std::set<String> metadataWhitelist ({"package", "source_location", "templates"});
@@ -128,9 +164,22 @@ Dictionary::Ptr IcingaDB::SerializeVars(const CustomVarObject::Ptr& object)
 	if (!vars)
 		return nullptr;
 
-	Dictionary::Ptr res = new Dictionary();
 	auto env (GetEnvironment());
-	auto envChecksum (SHA1(env));
+
+	/* Every config update of the object needs this, so it's cached in the object as well.
+	 * Vars changed at runtime are replaced as a whole (see ConfigObject#ModifyAttribute()).
+	 */
+	Value cached = object->GetExtension("IcingaDBCustomVars");
+
+	if (cached.IsObjectType<Array>()) {
+		Array::Ptr serialized = cached;
+
+		if (serialized->Get(0) == env && serialized->Get(1) == vars)
+			return serialized->Get(2);
+	}
+
+	Dictionary::Ptr res = new Dictionary();
+	auto envChecksum (GetEnvironmentId());
 
 	ObjectLock olock(vars);
 
@@ -146,9 +195,44 @@ Dictionary::Ptr IcingaDB::SerializeVars(const CustomVarObject::Ptr& object)
 		);
 	}
 
+	object->SetExtension("IcingaDBCustomVars", new Array({ env, vars, res }));
+
 	return res;
 }
 
+/**
+ * Returns the IDs of the relations between the object and its custom vars
+ * by the custom var IDs in vars, which has to be the result of SerializeVars().
+ * They're cached in the object as long as that result is.
+ */
+Dictionary::Ptr IcingaDB::GetCustomVarRelationIds(const CustomVarObject::Ptr& object, const Dictionary::Ptr& vars)
+{
+	Value cached = object->GetExtension("IcingaDBCustomVarRelations");
+
+	if (cached.IsObjectType<Array>()) {
+		Array::Ptr relations = cached;
+
+		if (relations->Get(0) == vars)
+			return relations->Get(1);
+	}
+
+	Dictionary::Ptr ids = new Dictionary();
+	auto env (GetEnvironment());
+	auto objectIds (GetObjectIdentifiersWithoutEnv(object));
+
+	{
+		ObjectLock olock(vars);
+
+		for (auto& kv : vars) {
+			ids->Set(kv.first, HashValue(new Array(Prepend(env, Prepend(kv.first, ArrayData(objectIds))))));
+		}
+	}
+
+	object->SetExtension("IcingaDBCustomVarRelations", new Array({ vars, ids }));
+
+	return ids;
+}
+
 static const std::set<String> propertiesBlacklistEmpty;
 
 String IcingaDB::HashValue(const Value& value)
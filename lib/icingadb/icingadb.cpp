@@ -4,6 +4,7 @@
 #include "icingadb/icingadb-ti.cpp"
 #include "icingadb/redisconnection.hpp"
 #include "remote/eventqueue.hpp"
+#include "base/exception.hpp"
 #include "base/json.hpp"
 #include "icinga/checkable.hpp"
 #include "icinga/host.hpp"
@@ -39,7 +40,7 @@ return id
 REGISTER_TYPE(IcingaDB);
 
 IcingaDB::IcingaDB()
-	: m_Rcon(nullptr)
+	: m_Rcon(nullptr), m_DumpedTypesValid(false)
 {
 	m_Rcon = nullptr;
 
@@ -65,7 +66,18 @@ void IcingaDB::Start(bool runtimeCreated)
 
 	m_WorkQueue.SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
 
-	m_Rcon = new RedisConnection(GetHost(), GetPort(), GetPath(), GetPassword(), GetDbIndex());
+	m_Rcon = new RedisConnection(GetHost(), GetPort(), GetPath(), GetPassword(), GetDbIndex(), GetPipelineDepth());
+
+	/* Config dumps and heartbeats keep the main connection, state and history updates get their own ones. */
+	if (GetEnableSeparateConnections()) {
+		RedisConnection::Ptr state = new RedisConnection(GetHost(), GetPort(), GetPath(), GetPassword(), GetDbIndex(), GetPipelineDepth());
+		RedisConnection::Ptr history = new RedisConnection(GetHost(), GetPort(), GetPath(), GetPassword(), GetDbIndex(), GetPipelineDepth());
+
+		m_Rcon->RouteQueryKind(Prio::State, state);
+		m_Rcon->RouteQueryKind(Prio::CheckResult, state);
+		m_Rcon->RouteQueryKind(Prio::History, history);
+	}
+
 	m_Rcon->SetConnectedCallback([this](boost::asio::yield_context& yc) {
 		m_WorkQueue.Enqueue([this]() { OnConnectedHandler(); });
 	});
@@ -76,6 +88,11 @@ void IcingaDB::Start(bool runtimeCreated)
 	m_StatsTimer->OnTimerExpired.connect([this](const Timer * const&) { PublishStatsTimerHandler(); });
 	m_StatsTimer->Start();
 
+	m_FlushTimer = new Timer();
+	m_FlushTimer->SetInterval(GetFlushInterval());
+	m_FlushTimer->OnTimerExpired.connect([this](const Timer * const&) { FlushBatchedQueries(); });
+	m_FlushTimer->Start();
+
 	m_WorkQueue.SetName("IcingaDB");
 
 	m_Rcon->SuppressQueryKind(Prio::CheckResult);
@@ -135,14 +152,78 @@ void IcingaDB::PublishStats()
 	m_Rcon->FireAndForgetQuery(std::move(eval), Prio::Heartbeat);
 }
 
+/**
+ * Queues a query which is sent with the other ones of the same priority
+ * after at most flush_interval, so that events don't reach Redis one by one.
+ * The queries of one priority stay in order.
+ *
+ * @param query Redis query
+ * @param priority The query's priority
+ */
+void IcingaDB::FireAndForgetBatched(RedisConnection::Query query, RedisConnection::QueryPriority priority)
+{
+	RedisConnection::Queries batch;
+
+	{
+		std::unique_lock<std::mutex> lock (m_BatchedQueriesMutex);
+		auto& queries (m_BatchedQueries[priority]);
+
+		queries.emplace_back(std::move(query));
+
+		if (queries.size() < static_cast<size_t>(GetPipelineDepth()))
+			return;
+
+		batch.swap(queries);
+	}
+
+	m_Rcon->FireAndForgetQueries(std::move(batch), priority);
+}
+
+void IcingaDB::FlushBatchedQueries()
+{
+	std::map<RedisConnection::QueryPriority, RedisConnection::Queries> batches;
+
+	{
+		std::unique_lock<std::mutex> lock (m_BatchedQueriesMutex);
+		batches.swap(m_BatchedQueries);
+	}
+
+	for (auto& batch : batches) {
+		if (!batch.second.empty())
+			m_Rcon->FireAndForgetQueries(std::move(batch.second), batch.first);
+	}
+}
+
 void IcingaDB::Stop(bool runtimeRemoved)
 {
+	if (m_FlushTimer)
+		m_FlushTimer->Stop(true);
+
+	if (m_Rcon)
+		FlushBatchedQueries();
+
 	Log(LogInformation, "IcingaDB")
 		<< "'" << GetName() << "' stopped.";
 
 	ObjectImpl<IcingaDB>::Stop(runtimeRemoved);
 }
 
+void IcingaDB::ValidatePipelineDepth(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<IcingaDB>::ValidatePipelineDepth(lvalue, utils);
+
+	if (lvalue() < 1)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "pipeline_depth" }, "Pipeline depth must be greater than 0."));
+}
+
+void IcingaDB::ValidateFlushInterval(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<IcingaDB>::ValidateFlushInterval(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "flush_interval" }, "Flush interval must be greater than 0."));
+}
+
 void IcingaDB::AssertOnWorkQueue()
 {
 	ASSERT(m_WorkQueue.IsWorkerThread());
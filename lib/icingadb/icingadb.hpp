@@ -12,10 +12,13 @@
 #include "icinga/service.hpp"
 #include "icinga/downtime.hpp"
 #include "remote/messageorigin.hpp"
+#include <atomic>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <utility>
+#include <vector>
 
 namespace icinga
 {
@@ -36,6 +39,9 @@ public:
 	virtual void Start(bool runtimeCreated) override;
 	virtual void Stop(bool runtimeRemoved) override;
 
+	void ValidatePipelineDepth(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateFlushInterval(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+
 private:
 	class DumpedGlobals
 	{
@@ -48,16 +54,46 @@ private:
 		std::mutex m_Mutex;
 	};
 
+	/**
+	 * What the last config dump wrote for an object.
+	 */
+	struct DumpedObject
+	{
+		String Checksum; // over everything written for the object
+		String RedisChecksum; // as in icinga:checksum:<type>
+		std::vector<std::pair<String, String>> Fields; // hash keys and fields
+		std::vector<size_t> ValueHashes; // of the fields' values, in the same order
+		bool Seen;
+	};
+
+	/**
+	 * What the last config dump wrote for a type. Used to only write changed objects on reconnect.
+	 */
+	struct DumpedType
+	{
+		std::mutex Mutex;
+		std::map<String, DumpedObject> Objects;
+	};
+
 	void OnConnectedHandler();
 
 	void PublishStatsTimerHandler();
 	void PublishStats();
 
+	void FireAndForgetBatched(RedisConnection::Query query, RedisConnection::QueryPriority priority);
+	void FlushBatchedQueries();
+
 	/* config & status dump */
 	void UpdateAllConfigObjects();
 	std::vector<std::vector<intrusive_ptr<ConfigObject>>> ChunkObjects(std::vector<intrusive_ptr<ConfigObject>> objects, size_t chunkSize);
 	void DeleteKeys(const std::vector<String>& keys, RedisConnection::QueryPriority priority);
 	std::vector<String> GetTypeObjectKeys(const String& type);
+	bool IsGlobalConfigKey(const String& key) const;
+	bool GetDumpedObject(const String& typeName, const std::map<String, std::vector<String>>& hMSets, String& objectKey, DumpedObject& object);
+	bool UpdateDumpedObject(DumpedType& dumped, const String& typeName, const std::map<String, std::vector<String>>& hMSets,
+			const std::map<String, String>& redisChecksums, std::map<String, std::vector<String>>& hDels);
+	bool DiffConfigUpdate(const String& typeName, std::map<String, std::vector<String>>& hMSets,
+			std::map<String, std::vector<String>>& publishes, std::map<String, std::vector<String>>& hDels);
 	void InsertObjectDependencies(const ConfigObject::Ptr& object, const String typeName, std::map<String, std::vector<String>>& hMSets,
 			std::map<String, std::vector<String>>& publishes, bool runtimeUpdate);
 	void UpdateState(const Checkable::Ptr& checkable);
@@ -95,7 +131,9 @@ private:
 	static ArrayData GetObjectIdentifiersWithoutEnv(const ConfigObject::Ptr& object);
 	static String GetObjectIdentifier(const ConfigObject::Ptr& object);
 	static String GetEnvironment();
+	static String GetEnvironmentId();
 	static Dictionary::Ptr SerializeVars(const CustomVarObject::Ptr& object);
+	static Dictionary::Ptr GetCustomVarRelationIds(const CustomVarObject::Ptr& object, const Dictionary::Ptr& vars);
 
 	static String HashValue(const Value& value);
 	static String HashValue(const Value& value, const std::set<String>& propertiesBlacklist, bool propertiesWhitelist = false);
@@ -148,6 +186,11 @@ private:
 	Timer::Ptr m_StatsTimer;
 	WorkQueue m_WorkQueue;
 
+	/* State and history stream entries, sent as one pipelined batch per priority. */
+	std::mutex m_BatchedQueriesMutex;
+	std::map<RedisConnection::QueryPriority, RedisConnection::Queries> m_BatchedQueries;
+	Timer::Ptr m_FlushTimer;
+
 	String m_PrefixConfigObject;
 	String m_PrefixConfigCheckSum;
 	String m_PrefixStateObject;
@@ -160,6 +203,9 @@ private:
 	struct {
 		DumpedGlobals CustomVar, ActionUrl, NotesUrl, IconImage;
 	} m_DumpedGlobals;
+
+	std::map<String, std::unique_ptr<DumpedType>> m_DumpedTypes;
+	std::atomic<bool> m_DumpedTypesValid;
 };
 }
 
@@ -3,9 +3,12 @@
 #include "icingadb/redisconnection.hpp"
 #include "base/array.hpp"
 #include "base/convert.hpp"
+#include "base/debug.hpp"
 #include "base/defer.hpp"
+#include "base/histogram.hpp"
 #include "base/io-engine.hpp"
 #include "base/logger.hpp"
+#include "base/metric.hpp"
 #include "base/objectlock.hpp"
 #include "base/string.hpp"
 #include "base/tcpsocket.hpp"
@@ -14,6 +17,7 @@
 #include <boost/date_time/posix_time/posix_time_duration.hpp>
 #include <boost/utility/string_view.hpp>
 #include <boost/variant/get.hpp>
+#include <chrono>
 #include <exception>
 #include <future>
 #include <iterator>
@@ -23,19 +27,23 @@
 using namespace icinga;
 namespace asio = boost::asio;
 
-RedisConnection::RedisConnection(const String& host, const int port, const String& path, const String& password, const int db) :
-	RedisConnection(IoEngine::Get().GetIoContext(), host, port, path, password, db)
+RedisConnection::RedisConnection(const String& host, const int port, const String& path, const String& password, const int db,
+	const size_t pipelineDepth) :
+	RedisConnection(IoEngine::Get().GetIoContext(), host, port, path, password, db, pipelineDepth)
 {
 }
 
-RedisConnection::RedisConnection(boost::asio::io_context& io, String host, int port, String path, String password, int db)
+RedisConnection::RedisConnection(boost::asio::io_context& io, String host, int port, String path, String password, int db, size_t pipelineDepth)
 	: m_Host(std::move(host)), m_Port(port), m_Path(std::move(path)), m_Password(std::move(password)), m_DbIndex(db),
-	  m_Connecting(false), m_Connected(false), m_Started(false), m_Strand(io), m_QueuedWrites(io), m_QueuedReads(io)
+	  m_PipelineDepth(pipelineDepth > 0 ? pipelineDepth : 1), m_Connecting(false), m_Connected(false), m_Started(false), m_Strand(io), m_QueuedWrites(io), m_QueuedReads(io)
 {
 }
 
 void RedisConnection::Start()
 {
+	for (auto& route : m_Routes)
+		route.second->Start();
+
 	if (!m_Started.exchange(true)) {
 		Ptr keepAlive (this);
 
@@ -54,6 +62,28 @@ bool RedisConnection::IsConnected() {
 	return m_Connected.load();
 }
 
+/**
+ * Send all queries of the given kind over another connection, so that e.g. a
+ * config dump doesn't hold up the state updates. The queries of one kind stay
+ * in order. Must be called before Start().
+ *
+ * @param kind Query kind
+ * @param connection The connection, not started yet
+ */
+void RedisConnection::RouteQueryKind(RedisConnection::QueryPriority kind, const RedisConnection::Ptr& connection)
+{
+	ASSERT(!m_Started.load());
+
+	m_Routes[kind] = connection;
+}
+
+RedisConnection *RedisConnection::GetRoute(RedisConnection::QueryPriority kind) const
+{
+	auto route (m_Routes.find(kind));
+
+	return route == m_Routes.end() ? nullptr : route->second.get();
+}
+
 /**
  * Append a Redis query to a log message
  *
@@ -87,6 +117,11 @@ void LogQuery(RedisConnection::Query& query, Log& msg)
  */
 void RedisConnection::FireAndForgetQuery(RedisConnection::Query query, RedisConnection::QueryPriority priority)
 {
+	if (auto route = GetRoute(priority)) {
+		route->FireAndForgetQuery(std::move(query), priority);
+		return;
+	}
+
 	{
 		Log msg (LogNotice, "IcingaDB", "Firing and forgetting query:");
 		LogQuery(query, msg);
@@ -108,6 +143,11 @@ void RedisConnection::FireAndForgetQuery(RedisConnection::Query query, RedisConn
  */
 void RedisConnection::FireAndForgetQueries(RedisConnection::Queries queries, RedisConnection::QueryPriority priority)
 {
+	if (auto route = GetRoute(priority)) {
+		route->FireAndForgetQueries(std::move(queries), priority);
+		return;
+	}
+
 	for (auto& query : queries) {
 		Log msg (LogNotice, "IcingaDB", "Firing and forgetting query:");
 		LogQuery(query, msg);
@@ -131,11 +171,18 @@ void RedisConnection::FireAndForgetQueries(RedisConnection::Queries queries, Red
  */
 RedisConnection::Reply RedisConnection::GetResultOfQuery(RedisConnection::Query query, RedisConnection::QueryPriority priority)
 {
+	if (auto route = GetRoute(priority))
+		return route->GetResultOfQuery(std::move(query), priority);
+
 	{
 		Log msg (LogNotice, "IcingaDB", "Executing query:");
 		LogQuery(query, msg);
 	}
 
+	/* Includes waiting for the queries queued before, that's the round trip the caller sees. */
+	static Histogram& roundTrip (Histogram::GetByName("redis_query"));
+	HistogramTimer roundTripTimer (roundTrip);
+
 	std::promise<Reply> promise;
 	auto future (promise.get_future());
 	auto item (Shared<std::pair<Query, std::promise<Reply>>>::Make(std::move(query), std::move(promise)));
@@ -160,11 +207,17 @@ RedisConnection::Reply RedisConnection::GetResultOfQuery(RedisConnection::Query
  */
 RedisConnection::Replies RedisConnection::GetResultsOfQueries(RedisConnection::Queries queries, RedisConnection::QueryPriority priority)
 {
+	if (auto route = GetRoute(priority))
+		return route->GetResultsOfQueries(std::move(queries), priority);
+
 	for (auto& query : queries) {
 		Log msg (LogNotice, "IcingaDB", "Executing query:");
 		LogQuery(query, msg);
 	}
 
+	static Histogram& roundTrip (Histogram::GetByName("redis_queries"));
+	HistogramTimer roundTripTimer (roundTrip);
+
 	std::promise<Replies> promise;
 	auto future (promise.get_future());
 	auto item (Shared<std::pair<Queries, std::promise<Replies>>>::Make(std::move(queries), std::move(promise)));
@@ -181,6 +234,11 @@ RedisConnection::Replies RedisConnection::GetResultsOfQueries(RedisConnection::Q
 
 void RedisConnection::EnqueueCallback(const std::function<void(boost::asio::yield_context&)>& callback, RedisConnection::QueryPriority priority)
 {
+	if (auto route = GetRoute(priority)) {
+		route->EnqueueCallback(callback, priority);
+		return;
+	}
+
 	asio::post(m_Strand, [this, callback, priority]() {
 		m_Queues.Writes[priority].emplace(WriteQueueItem{nullptr, nullptr, nullptr, nullptr, callback});
 		m_QueuedWrites.Set();
@@ -194,6 +252,11 @@ void RedisConnection::EnqueueCallback(const std::function<void(boost::asio::yiel
  */
 void RedisConnection::SuppressQueryKind(RedisConnection::QueryPriority kind)
 {
+	if (auto route = GetRoute(kind)) {
+		route->SuppressQueryKind(kind);
+		return;
+	}
+
 	asio::post(m_Strand, [this, kind]() { m_SuppressedQueryKinds.emplace(kind); });
 }
 
@@ -204,6 +267,11 @@ void RedisConnection::SuppressQueryKind(RedisConnection::QueryPriority kind)
  */
 void RedisConnection::UnsuppressQueryKind(RedisConnection::QueryPriority kind)
 {
+	if (auto route = GetRoute(kind)) {
+		route->UnsuppressQueryKind(kind);
+		return;
+	}
+
 	asio::post(m_Strand, [this, kind]() {
 		m_SuppressedQueryKinds.erase(kind);
 		m_QueuedWrites.Set();
@@ -344,24 +412,69 @@ void RedisConnection::ReadLoop(asio::yield_context& yc)
 
 /**
  * Actually send the Redis queries queued by {FireAndForget,GetResultsOf}{Query,Queries}()
+ *
+ * Items are taken from the queues highest priority first and sent as one pipeline
+ * of up to m_PipelineDepth queries. Callbacks are run on their own once all items
+ * queued before them have been sent.
  */
 void RedisConnection::WriteLoop(asio::yield_context& yc)
 {
+	std::vector<WriteQueueItem> items;
+
 	for (;;) {
 		m_QueuedWrites.Wait(yc);
 
-	WriteFirstOfHighestPrio:
-		for (auto& queue : m_Queues.Writes) {
-			if (m_SuppressedQueryKinds.find(queue.first) != m_SuppressedQueryKinds.end() || queue.second.empty()) {
-				continue;
+		for (;;) {
+			size_t queries = 0;
+			std::function<void(boost::asio::yield_context&)> callback;
+
+			for (;;) {
+				std::queue<WriteQueueItem>* next = nullptr;
+
+				for (auto& queue : m_Queues.Writes) {
+					if (m_SuppressedQueryKinds.find(queue.first) == m_SuppressedQueryKinds.end() && !queue.second.empty()) {
+						next = &queue.second;
+						break;
+					}
+				}
+
+				if (!next) {
+					break;
+				}
+
+				auto& item (next->front());
+
+				if (item.Callback) {
+					if (items.empty()) {
+						callback = std::move(item.Callback);
+						next->pop();
+					}
+
+					break;
+				}
+
+				auto amount (GetQueryCount(item));
+
+				if (!items.empty() && queries + amount > m_PipelineDepth) {
+					break;
+				}
+
+				items.emplace_back(std::move(item));
+				next->pop();
+				queries += amount;
 			}
 
-			auto next (std::move(queue.second.front()));
-			queue.second.pop();
+			if (callback) {
+				callback(yc);
+				continue;
+			}
 
-			WriteItem(yc, std::move(next));
+			if (items.empty()) {
+				break;
+			}
 
-			goto WriteFirstOfHighestPrio;
+			WriteItems(yc, items);
+			items.clear();
 		}
 
 		m_QueuedWrites.Clear();
@@ -369,124 +482,148 @@ void RedisConnection::WriteLoop(asio::yield_context& yc)
 }
 
 /**
- * Send next and schedule receiving the response
+ * Get the amount of Redis queries in a queue item
  *
- * @param next Redis queries
+ * @param item Queue item
+ *
+ * @return Amount of queries
  */
-void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection::WriteQueueItem next)
+size_t RedisConnection::GetQueryCount(const RedisConnection::WriteQueueItem& item)
 {
-	if (next.FireAndForgetQuery) {
-		auto& item (*next.FireAndForgetQuery);
+	if (item.FireAndForgetQuery || item.GetResultOfQuery) {
+		return 1;
+	}
 
-		try {
-			WriteOne(item, yc);
-		} catch (const boost::coroutines::detail::forced_unwind&) {
-			throw;
-		} catch (const std::exception& ex) {
-			Log msg (LogCritical, "IcingaDB", "Error during sending query");
-			LogQuery(item, msg);
-			msg << " which has been fired and forgotten: " << ex.what();
+	if (item.FireAndForgetQueries) {
+		return item.FireAndForgetQueries->size();
+	}
 
-			return;
-		} catch (...) {
-			Log msg (LogCritical, "IcingaDB", "Error during sending query");
-			LogQuery(item, msg);
-			msg << " which has been fired and forgotten";
+	if (item.GetResultsOfQueries) {
+		return item.GetResultsOfQueries->first.size();
+	}
+
+	return 0;
+}
 
-			return;
+/**
+ * Send items in one pipeline and schedule receiving the responses
+ *
+ * @param items Redis queries
+ */
+void RedisConnection::WriteItems(boost::asio::yield_context& yc, std::vector<RedisConnection::WriteQueueItem>& items)
+{
+	m_WriteBuffer.clear();
+
+	for (auto& next : items) {
+		if (next.FireAndForgetQuery) {
+			EncodeRESP(m_WriteBuffer, *next.FireAndForgetQuery);
 		}
 
-		if (m_Queues.FutureResponseActions.empty() || m_Queues.FutureResponseActions.back().Action != ResponseAction::Ignore) {
-			m_Queues.FutureResponseActions.emplace(FutureResponseAction{1, ResponseAction::Ignore});
-		} else {
-			++m_Queues.FutureResponseActions.back().Amount;
+		if (next.FireAndForgetQueries) {
+			for (auto& query : *next.FireAndForgetQueries) {
+				EncodeRESP(m_WriteBuffer, query);
+			}
+		}
+
+		if (next.GetResultOfQuery) {
+			EncodeRESP(m_WriteBuffer, next.GetResultOfQuery->first);
 		}
 
-		m_QueuedReads.Set();
+		if (next.GetResultsOfQueries) {
+			for (auto& query : next.GetResultsOfQueries->first) {
+				EncodeRESP(m_WriteBuffer, query);
+			}
+		}
 	}
 
-	if (next.FireAndForgetQueries) {
-		auto& item (*next.FireAndForgetQueries);
-		size_t i = 0;
+	try {
+		WriteBuffer(yc);
+	} catch (const boost::coroutines::detail::forced_unwind&) {
+		throw;
+	} catch (...) {
+		auto error (std::current_exception());
+		String what;
 
 		try {
-			for (auto& query : item) {
-				WriteOne(query, yc);
-				++i;
-			}
-		} catch (const boost::coroutines::detail::forced_unwind&) {
-			throw;
+			std::rethrow_exception(error);
 		} catch (const std::exception& ex) {
-			Log msg (LogCritical, "IcingaDB", "Error during sending query");
-			LogQuery(item[i], msg);
-			msg << " which has been fired and forgotten: " << ex.what();
-
-			return;
+			what = ex.what();
 		} catch (...) {
-			Log msg (LogCritical, "IcingaDB", "Error during sending query");
-			LogQuery(item[i], msg);
-			msg << " which has been fired and forgotten";
-
-			return;
 		}
 
-		if (m_Queues.FutureResponseActions.empty() || m_Queues.FutureResponseActions.back().Action != ResponseAction::Ignore) {
-			m_Queues.FutureResponseActions.emplace(FutureResponseAction{item.size(), ResponseAction::Ignore});
-		} else {
-			m_Queues.FutureResponseActions.back().Amount += item.size();
-		}
+		for (auto& next : items) {
+			Query* query = nullptr;
 
-		m_QueuedReads.Set();
-	}
+			if (next.FireAndForgetQuery) {
+				query = &*next.FireAndForgetQuery;
+			} else if (next.FireAndForgetQueries && !next.FireAndForgetQueries->empty()) {
+				query = &next.FireAndForgetQueries->front();
+			}
 
-	if (next.GetResultOfQuery) {
-		auto& item (*next.GetResultOfQuery);
+			if (query) {
+				Log msg (LogCritical, "IcingaDB", "Error during sending query");
+				LogQuery(*query, msg);
+				msg << " which has been fired and forgotten";
 
-		try {
-			WriteOne(item.first, yc);
-		} catch (const boost::coroutines::detail::forced_unwind&) {
-			throw;
-		} catch (...) {
-			item.second.set_exception(std::current_exception());
+				if (!what.IsEmpty()) {
+					msg << ": " << what;
+				}
+			}
+
+			if (next.GetResultOfQuery) {
+				next.GetResultOfQuery->second.set_exception(error);
+			}
 
-			return;
+			if (next.GetResultsOfQueries) {
+				next.GetResultsOfQueries->second.set_exception(error);
+			}
 		}
 
-		m_Queues.ReplyPromises.emplace(std::move(item.second));
+		m_WriteBuffer.clear();
+		return;
+	}
 
-		if (m_Queues.FutureResponseActions.empty() || m_Queues.FutureResponseActions.back().Action != ResponseAction::Deliver) {
-			m_Queues.FutureResponseActions.emplace(FutureResponseAction{1, ResponseAction::Deliver});
-		} else {
-			++m_Queues.FutureResponseActions.back().Amount;
-		}
+	m_WriteBuffer.clear();
+
+	static MetricCounter& queriesSent (MetricCounter::GetByName("redis_queries"));
 
-		m_QueuedReads.Set();
+	for (auto& next : items) {
+		queriesSent.Increment(GetQueryCount(next));
 	}
 
-	if (next.GetResultsOfQueries) {
-		auto& item (*next.GetResultsOfQueries);
+	/* Keep the buffer of a huge pipeline, e.g. the initial config dump, from hogging memory. */
+	if (m_WriteBuffer.capacity() > 16 * 1024 * 1024) {
+		m_WriteBuffer.shrink_to_fit();
+	}
 
-		try {
-			for (auto& query : item.first) {
-				WriteOne(query, yc);
-			}
-		} catch (const boost::coroutines::detail::forced_unwind&) {
-			throw;
-		} catch (...) {
-			item.second.set_exception(std::current_exception());
+	for (auto& next : items) {
+		if (next.FireAndForgetQuery || next.FireAndForgetQueries) {
+			auto amount (GetQueryCount(next));
 
-			return;
+			if (m_Queues.FutureResponseActions.empty() || m_Queues.FutureResponseActions.back().Action != ResponseAction::Ignore) {
+				m_Queues.FutureResponseActions.emplace(FutureResponseAction{amount, ResponseAction::Ignore});
+			} else {
+				m_Queues.FutureResponseActions.back().Amount += amount;
+			}
 		}
 
-		m_Queues.RepliesPromises.emplace(std::move(item.second));
-		m_Queues.FutureResponseActions.emplace(FutureResponseAction{item.first.size(), ResponseAction::DeliverBulk});
+		if (next.GetResultOfQuery) {
+			m_Queues.ReplyPromises.emplace(std::move(next.GetResultOfQuery->second));
 
-		m_QueuedReads.Set();
-	}
+			if (m_Queues.FutureResponseActions.empty() || m_Queues.FutureResponseActions.back().Action != ResponseAction::Deliver) {
+				m_Queues.FutureResponseActions.emplace(FutureResponseAction{1, ResponseAction::Deliver});
+			} else {
+				++m_Queues.FutureResponseActions.back().Amount;
+			}
+		}
 
-	if (next.Callback) {
-		next.Callback(yc);
+		if (next.GetResultsOfQueries) {
+			m_Queues.RepliesPromises.emplace(std::move(next.GetResultsOfQueries->second));
+			m_Queues.FutureResponseActions.emplace(FutureResponseAction{next.GetResultsOfQueries->first.size(), ResponseAction::DeliverBulk});
+		}
 	}
+
+	m_QueuedReads.Set();
 }
 
 /**
@@ -504,19 +641,52 @@ RedisConnection::Reply RedisConnection::ReadOne(boost::asio::yield_context& yc)
 }
 
 /**
- * Send query
- *
- * @param query Redis query
+ * Send the queries in m_WriteBuffer
  */
-void RedisConnection::WriteOne(RedisConnection::Query& query, asio::yield_context& yc)
+void RedisConnection::WriteBuffer(asio::yield_context& yc)
 {
 	if (m_Path.IsEmpty()) {
-		WriteOne(m_TcpConn, query, yc);
+		WriteBuffer(m_TcpConn, yc);
 	} else {
-		WriteOne(m_UnixConn, query, yc);
+		WriteBuffer(m_UnixConn, yc);
+	}
+}
+
+/**
+ * Append a Redis query in the Redis protocol to buffer
+ *
+ * @param buffer Output buffer
+ * @param query Redis query
+ */
+void RedisConnection::EncodeRESP(std::vector<char>& buffer, const Query& query)
+{
+	buffer.emplace_back('*');
+	EncodeInt(buffer, query.size());
+	buffer.insert(buffer.end(), {'\r', '\n'});
+
+	for (auto& arg : query) {
+		buffer.emplace_back('$');
+		EncodeInt(buffer, arg.GetLength());
+		buffer.insert(buffer.end(), {'\r', '\n'});
+		buffer.insert(buffer.end(), arg.Begin(), arg.End());
+		buffer.insert(buffer.end(), {'\r', '\n'});
 	}
 }
 
+/**
+ * Append a Redis protocol int to buffer
+ *
+ * @param buffer Output buffer
+ * @param i Redis protocol int
+ */
+void RedisConnection::EncodeInt(std::vector<char>& buffer, intmax_t i)
+{
+	char buf[21] = {};
+	int length = sprintf(buf, "%jd", i);
+
+	buffer.insert(buffer.end(), buf, buf + length);
+}
+
 /**
  * Specify a callback that is run each time a connection is successfully established
  *
@@ -67,7 +67,7 @@ namespace icinga
 		};
 
 		RedisConnection(const String& host, const int port, const String& path,
-			const String& password = "", const int db = 0);
+			const String& password = "", const int db = 0, const size_t pipelineDepth = 1000);
 
 		void Start();
 
@@ -86,6 +86,8 @@ namespace icinga
 
 		void SetConnectedCallback(std::function<void(boost::asio::yield_context& yc)> callback);
 
+		void RouteQueryKind(QueryPriority kind, const RedisConnection::Ptr& connection);
+
 	private:
 		/**
 		 * What to do with the responses to Redis queries.
@@ -136,32 +138,37 @@ namespace icinga
 		template<class AsyncReadStream>
 		static std::vector<char> ReadLine(AsyncReadStream& stream, boost::asio::yield_context& yc, size_t hint = 0);
 
-		template<class AsyncWriteStream>
-		static void WriteRESP(AsyncWriteStream& stream, const Query& query, boost::asio::yield_context& yc);
+		static void EncodeRESP(std::vector<char>& buffer, const Query& query);
+		static void EncodeInt(std::vector<char>& buffer, intmax_t i);
 
-		template<class AsyncWriteStream>
-		static void WriteInt(AsyncWriteStream& stream, intmax_t i, boost::asio::yield_context& yc);
+		static size_t GetQueryCount(const WriteQueueItem& item);
 
-		RedisConnection(boost::asio::io_context& io, String host, int port, String path, String password, int db);
+		RedisConnection(boost::asio::io_context& io, String host, int port, String path, String password, int db, size_t pipelineDepth);
 
 		void Connect(boost::asio::yield_context& yc);
 		void ReadLoop(boost::asio::yield_context& yc);
 		void WriteLoop(boost::asio::yield_context& yc);
-		void WriteItem(boost::asio::yield_context& yc, WriteQueueItem item);
+		void WriteItems(boost::asio::yield_context& yc, std::vector<WriteQueueItem>& items);
 		Reply ReadOne(boost::asio::yield_context& yc);
-		void WriteOne(Query& query, boost::asio::yield_context& yc);
+		void WriteBuffer(boost::asio::yield_context& yc);
 
 		template<class StreamPtr>
 		Reply ReadOne(StreamPtr& stream, boost::asio::yield_context& yc);
 
 		template<class StreamPtr>
-		void WriteOne(StreamPtr& stream, Query& query, boost::asio::yield_context& yc);
+		void WriteBuffer(StreamPtr& stream, boost::asio::yield_context& yc);
+
+		RedisConnection *GetRoute(QueryPriority kind) const;
 
 		String m_Path;
 		String m_Host;
 		int m_Port;
 		String m_Password;
 		int m_DbIndex;
+		size_t m_PipelineDepth;
+
+		// RESP encoded queries of the current pipeline, reused to avoid allocations
+		std::vector<char> m_WriteBuffer;
 
 		boost::asio::io_context::strand m_Strand;
 		Shared<TcpConn>::Ptr m_TcpConn;
@@ -186,6 +193,9 @@ namespace icinga
 		AsioConditionVariable m_QueuedWrites, m_QueuedReads;
 
 		std::function<void(boost::asio::yield_context& yc)> m_ConnectedCallback;
+
+		// Connections of their own for some kinds of queries, only set up before Start()
+		std::map<QueryPriority, RedisConnection::Ptr> m_Routes;
 	};
 
 /**
@@ -319,13 +329,12 @@ RedisConnection::Reply RedisConnection::ReadOne(StreamPtr& stream, boost::asio::
 }
 
 /**
- * Write a Redis query to stream
+ * Write the queries in m_WriteBuffer to stream
  *
  * @param stream Redis server connection
- * @param query Redis query
  */
 template<class StreamPtr>
-void RedisConnection::WriteOne(StreamPtr& stream, RedisConnection::Query& query, boost::asio::yield_context& yc)
+void RedisConnection::WriteBuffer(StreamPtr& stream, boost::asio::yield_context& yc)
 {
 	namespace asio = boost::asio;
 
@@ -336,8 +345,8 @@ void RedisConnection::WriteOne(StreamPtr& stream, RedisConnection::Query& query,
 	auto strm (stream);
 
 	try {
-		WriteRESP(*strm, query, yc);
-		strm->async_flush(yc);
+		/* The whole pipeline is written at once, there's no point in copying it into the stream's buffer. */
+		asio::async_write(strm->next_layer(), asio::const_buffer(m_WriteBuffer.data(), m_WriteBuffer.size()), yc);
 	} catch (const boost::coroutines::detail::forced_unwind&) {
 		throw;
 	} catch (...) {
@@ -482,49 +491,6 @@ std::vector<char> RedisConnection::ReadLine(AsyncReadStream& stream, boost::asio
 	}
 }
 
-/**
- * Write a Redis protocol value to stream
- *
- * @param stream Redis server connection
- * @param query Redis protocol value
- */
-template<class AsyncWriteStream>
-void RedisConnection::WriteRESP(AsyncWriteStream& stream, const Query& query, boost::asio::yield_context& yc)
-{
-	namespace asio = boost::asio;
-
-	asio::async_write(stream, asio::const_buffer("*", 1), yc);
-	WriteInt(stream, query.size(), yc);
-	asio::async_write(stream, asio::const_buffer("\r\n", 2), yc);
-
-	for (auto& arg : query) {
-		asio::async_write(stream, asio::const_buffer("$", 1), yc);
-
-		WriteInt(stream, arg.GetLength(), yc);
-
-		asio::async_write(stream, asio::const_buffer("\r\n", 2), yc);
-		asio::async_write(stream, asio::const_buffer(arg.CStr(), arg.GetLength()), yc);
-		asio::async_write(stream, asio::const_buffer("\r\n", 2), yc);
-	}
-}
-
-/**
- * Write a Redis protocol int to stream
- *
- * @param stream Redis server connection
- * @param i Redis protocol int
- */
-template<class AsyncWriteStream>
-void RedisConnection::WriteInt(AsyncWriteStream& stream, intmax_t i, boost::asio::yield_context& yc)
-{
-	namespace asio = boost::asio;
-
-	char buf[21] = {};
-	sprintf(buf, "%jd", i);
-
-	asio::async_write(stream, asio::const_buffer(buf, strlen(buf)), yc);
-}
-
 }
 
 #endif //REDISCONNECTION_H
@@ -1,6 +1,11 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/aggregator.hpp"
+#include "base/configuration.hpp"
+#include "base/debug.hpp"
+#include "base/workqueue.hpp"
+#include <algorithm>
+#include <utility>
 
 using namespace icinga;
 
@@ -16,3 +21,65 @@ Filter::Ptr Aggregator::GetFilter() const
 
 AggregatorState::~AggregatorState()
 { }
+
+/**
+ * Returns the column whose values are aggregated if the aggregator only
+ * needs the numbers, an empty string otherwise. Such aggregators get all of
+ * them at once via ApplyNumbers() instead of one row at a time via Apply().
+ */
+String Aggregator::GetNumericColumn() const
+{
+	return String();
+}
+
+/**
+ * Aggregates the values of a numeric column. Large columns are split into
+ * chunks which are aggregated in parallel and merged afterwards.
+ *
+ * @param values The values of the rows which belong to the same group
+ * @param state The group's state
+ */
+void Aggregator::ApplyNumbers(const std::vector<double>& values, AggregatorState **state) const
+{
+	const size_t chunkSize = 16384;
+
+	if (values.size() < chunkSize * 2 || Configuration::Concurrency < 2) {
+		ApplyNumeric(values.data(), values.size(), state);
+		return;
+	}
+
+	std::vector<std::pair<size_t, size_t> > chunks;
+
+	for (size_t offset = 0; offset < values.size(); offset += chunkSize)
+		chunks.emplace_back(offset, std::min(offset + chunkSize, values.size()));
+
+	std::vector<AggregatorState *> partials (chunks.size(), nullptr);
+
+	WorkQueue upq(25000, Configuration::Concurrency);
+	upq.SetName("Aggregator::ApplyNumbers");
+
+	upq.ParallelFor(chunks, [this, &values, &partials, chunkSize](const std::pair<size_t, size_t>& chunk) {
+		ApplyNumeric(values.data() + chunk.first, chunk.second - chunk.first, &partials[chunk.first / chunkSize]);
+	});
+
+	upq.Join();
+
+	for (AggregatorState *partial : partials)
+		MergeState(partial, state);
+}
+
+/**
+ * Aggregates contiguous values of the column returned by GetNumericColumn().
+ */
+void Aggregator::ApplyNumeric(const double *, size_t, AggregatorState **) const
+{
+	VERIFY(!"Aggregator doesn't support numeric columns.");
+}
+
+/**
+ * Adds a partial result to a state and frees the partial one.
+ */
+void Aggregator::MergeState(AggregatorState *, AggregatorState **) const
+{
+	VERIFY(!"Aggregator doesn't support numeric columns.");
+}
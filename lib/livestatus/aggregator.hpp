@@ -6,6 +6,7 @@
 #include "livestatus/i2-livestatus.hpp"
 #include "livestatus/table.hpp"
 #include "livestatus/filter.hpp"
+#include <vector>
 
 namespace icinga
 {
@@ -30,11 +31,17 @@ public:
 	virtual double GetResultAndFreeState(AggregatorState *state) const = 0;
 	void SetFilter(const Filter::Ptr& filter);
 
+	virtual String GetNumericColumn() const;
+	void ApplyNumbers(const std::vector<double>& values, AggregatorState **state) const;
+
 protected:
 	Aggregator() = default;
 
 	Filter::Ptr GetFilter() const;
 
+	virtual void ApplyNumeric(const double *values, size_t count, AggregatorState **state) const;
+	virtual void MergeState(AggregatorState *partial, AggregatorState **state) const;
+
 private:
 	Filter::Ptr m_Filter;
 };
@@ -13,3 +13,42 @@ bool AndFilter::Apply(const Table::Ptr& table, const Value& row)
 
 	return true;
 }
+
+bool AndFilter::FindCandidateRows(const Table::Ptr& table, std::vector<Value>& rows)
+{
+	bool found = false;
+
+	/* Any sub filter's candidates will do, use the smallest set. */
+	for (const Filter::Ptr& filter : m_Filters) {
+		std::vector<Value> candidates;
+
+		if (!filter->FindCandidateRows(table, candidates))
+			continue;
+
+		if (!found || candidates.size() < rows.size()) {
+			rows = std::move(candidates);
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+bool AndFilter::FindColumnValues(const String& column, std::set<String>& values)
+{
+	bool found = false;
+
+	for (const Filter::Ptr& filter : m_Filters) {
+		std::set<String> candidates;
+
+		if (!filter->FindColumnValues(column, candidates))
+			continue;
+
+		if (!found || candidates.size() < values.size()) {
+			values = std::move(candidates);
+			found = true;
+		}
+	}
+
+	return found;
+}
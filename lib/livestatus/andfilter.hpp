@@ -19,6 +19,8 @@ public:
 	DECLARE_PTR_TYPEDEFS(AndFilter);
 
 	bool Apply(const Table::Ptr& table, const Value& row) override;
+	bool FindCandidateRows(const Table::Ptr& table, std::vector<Value>& rows) override;
+	bool FindColumnValues(const String& column, std::set<String>& values) override;
 };
 
 }
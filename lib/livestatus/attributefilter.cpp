@@ -14,11 +14,23 @@ AttributeFilter::AttributeFilter(String column, String op, String operand)
 	: m_Column(std::move(column)), m_Operator(std::move(op)), m_Operand(std::move(operand))
 { }
 
-bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
+bool AttributeFilter::FindCandidateRows(const Table::Ptr& table, std::vector<Value>& rows)
+{
+	return table->LookupRows(m_Column, m_Operator, m_Operand, rows);
+}
+
+bool AttributeFilter::FindColumnValues(const String& column, std::set<String>& values)
 {
-	Column column = table->GetColumn(m_Column);
+	if (m_Column != column || m_Operator != "=")
+		return false;
 
-	Value value = column.ExtractValue(row);
+	values.insert(m_Operand);
+	return true;
+}
+
+bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
+{
+	Value value = table->GetColumnValue(m_Column, row);
 
 	if (value.IsObjectType<Array>()) {
 		Array::Ptr array = value;
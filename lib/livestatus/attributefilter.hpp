@@ -21,6 +21,8 @@ public:
 	AttributeFilter(String column, String op, String operand);
 
 	bool Apply(const Table::Ptr& table, const Value& row) override;
+	bool FindCandidateRows(const Table::Ptr& table, std::vector<Value>& rows) override;
+	bool FindColumnValues(const String& column, std::set<String>& values) override;
 
 protected:
 	String m_Column;
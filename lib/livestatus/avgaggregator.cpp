@@ -18,9 +18,7 @@ AvgAggregatorState *AvgAggregator::EnsureState(AggregatorState **state)
 
 void AvgAggregator::Apply(const Table::Ptr& table, const Value& row, AggregatorState **state)
 {
-	Column column = table->GetColumn(m_AvgAttr);
-
-	Value value = column.ExtractValue(row);
+	Value value = table->GetColumnValue(m_AvgAttr, row);
 
 	AvgAggregatorState *pstate = EnsureState(state);
 
@@ -36,3 +34,35 @@ double AvgAggregator::GetResultAndFreeState(AggregatorState *state) const
 
 	return result;
 }
+
+String AvgAggregator::GetNumericColumn() const
+{
+	return m_AvgAttr;
+}
+
+void AvgAggregator::ApplyNumeric(const double *values, size_t count, AggregatorState **state) const
+{
+	double sum = 0;
+
+	for (size_t i = 0; i < count; i++)
+		sum += values[i];
+
+	AvgAggregatorState *pstate = EnsureState(state);
+
+	pstate->Avg += sum;
+	pstate->AvgCount += count;
+}
+
+void AvgAggregator::MergeState(AggregatorState *partial, AggregatorState **state) const
+{
+	if (!partial)
+		return;
+
+	AvgAggregatorState *pstate = EnsureState(state);
+	AvgAggregatorState *ppartial = static_cast<AvgAggregatorState *>(partial);
+
+	pstate->Avg += ppartial->Avg;
+	pstate->AvgCount += ppartial->AvgCount;
+
+	delete ppartial;
+}
@@ -5,6 +5,7 @@
 
 #include "livestatus/i2-livestatus.hpp"
 #include "livestatus/table.hpp"
+#include <set>
 
 namespace icinga
 {
@@ -19,6 +20,38 @@ public:
 
 	virtual bool Apply(const Table::Ptr& table, const Value& row) = 0;
 
+	/**
+	 * Finds the rows which may match the filter using the table's indexes
+	 * instead of scanning all rows. The filter still has to be applied
+	 * to the candidates.
+	 *
+	 * @param table The table
+	 * @param rows Receives the candidate rows
+	 * @returns false if the filter can't be answered by an index
+	 */
+	virtual bool FindCandidateRows(const Table::Ptr& table, std::vector<Value>& rows)
+	{
+		(void)table;
+		(void)rows;
+
+		return false;
+	}
+
+	/**
+	 * Finds the values a column must have for a row to match the filter.
+	 *
+	 * @param column The column's name
+	 * @param values Receives the values
+	 * @returns false if the filter doesn't restrict the column to specific values
+	 */
+	virtual bool FindColumnValues(const String& column, std::set<String>& values)
+	{
+		(void)column;
+		(void)values;
+
+		return false;
+	}
+
 protected:
 	Filter() = default;
 };
@@ -5,6 +5,7 @@
 
 #include "livestatus/table.hpp"
 #include "base/dictionary.hpp"
+#include <set>
 
 namespace icinga
 {
@@ -16,7 +17,28 @@ namespace icinga
 class HistoryTable : public Table
 {
 public:
+	DECLARE_PTR_TYPEDEFS(HistoryTable);
+
 	virtual void UpdateLogEntries(const Dictionary::Ptr& bag, int line_count, int lineno, const AddRowFunction& addRowFn) = 0;
+
+	/**
+	 * Restricts the log entries which are read to the specified hosts. The query's
+	 * filter still has to be applied, this is only used to skip parts of the log files.
+	 *
+	 * @param hostNames The host names.
+	 */
+	void SetHostNames(std::set<String> hostNames)
+	{
+		m_HostNames = std::move(hostNames);
+	}
+
+	const std::set<String>& GetHostNames() const
+	{
+		return m_HostNames;
+	}
+
+private:
+	std::set<String> m_HostNames;
 };
 
 }
@@ -185,6 +185,34 @@ void HostsTable::FetchRows(const AddRowFunction& addRowFn)
 	}
 }
 
+bool HostsTable::LookupRows(const String& column, const String& op, const String& operand, std::vector<Value>& rows)
+{
+	if (GetGroupByType() != LivestatusGroupByNone)
+		return false;
+
+	String name = GetColumnBaseName(column);
+
+	if (name == "name" && op == "=") {
+		Host::Ptr host = Host::GetByName(operand);
+
+		if (host)
+			rows.emplace_back(host);
+
+		return true;
+	} else if (name == "groups" && op == ">=") {
+		HostGroup::Ptr hg = HostGroup::GetByName(operand);
+
+		if (hg) {
+			for (const Host::Ptr& host : hg->GetMembers())
+				rows.emplace_back(host);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
 Object::Ptr HostsTable::HostGroupAccessor(const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject)
 {
 	/* return the current group by value set from within FetchRows()
@@ -18,9 +18,7 @@ InvAvgAggregatorState *InvAvgAggregator::EnsureState(AggregatorState **state)
 
 void InvAvgAggregator::Apply(const Table::Ptr& table, const Value& row, AggregatorState **state)
 {
-	Column column = table->GetColumn(m_InvAvgAttr);
-
-	Value value = column.ExtractValue(row);
+	Value value = table->GetColumnValue(m_InvAvgAttr, row);
 
 	InvAvgAggregatorState *pstate = EnsureState(state);
 
@@ -36,3 +34,35 @@ double InvAvgAggregator::GetResultAndFreeState(AggregatorState *state) const
 
 	return result;
 }
+
+String InvAvgAggregator::GetNumericColumn() const
+{
+	return m_InvAvgAttr;
+}
+
+void InvAvgAggregator::ApplyNumeric(const double *values, size_t count, AggregatorState **state) const
+{
+	double sum = 0;
+
+	for (size_t i = 0; i < count; i++)
+		sum += 1.0 / values[i];
+
+	InvAvgAggregatorState *pstate = EnsureState(state);
+
+	pstate->InvAvg += sum;
+	pstate->InvAvgCount += count;
+}
+
+void InvAvgAggregator::MergeState(AggregatorState *partial, AggregatorState **state) const
+{
+	if (!partial)
+		return;
+
+	InvAvgAggregatorState *pstate = EnsureState(state);
+	InvAvgAggregatorState *ppartial = static_cast<InvAvgAggregatorState *>(partial);
+
+	pstate->InvAvg += ppartial->InvAvg;
+	pstate->InvAvgCount += ppartial->InvAvgCount;
+
+	delete ppartial;
+}
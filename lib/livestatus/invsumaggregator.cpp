@@ -18,9 +18,7 @@ InvSumAggregatorState *InvSumAggregator::EnsureState(AggregatorState **state)
 
 void InvSumAggregator::Apply(const Table::Ptr& table, const Value& row, AggregatorState **state)
 {
-	Column column = table->GetColumn(m_InvSumAttr);
-
-	Value value = column.ExtractValue(row);
+	Value value = table->GetColumnValue(m_InvSumAttr, row);
 
 	InvSumAggregatorState *pstate = EnsureState(state);
 
@@ -35,3 +33,31 @@ double InvSumAggregator::GetResultAndFreeState(AggregatorState *state) const
 
 	return result;
 }
+
+String InvSumAggregator::GetNumericColumn() const
+{
+	return m_InvSumAttr;
+}
+
+void InvSumAggregator::ApplyNumeric(const double *values, size_t count, AggregatorState **state) const
+{
+	double sum = 0;
+
+	for (size_t i = 0; i < count; i++)
+		sum += 1.0 / values[i];
+
+	EnsureState(state)->InvSum += sum;
+}
+
+void InvSumAggregator::MergeState(AggregatorState *partial, AggregatorState **state) const
+{
+	if (!partial)
+		return;
+
+	InvSumAggregatorState *pstate = EnsureState(state);
+	InvSumAggregatorState *ppartial = static_cast<InvSumAggregatorState *>(partial);
+
+	pstate->InvSum += ppartial->InvSum;
+
+	delete ppartial;
+}
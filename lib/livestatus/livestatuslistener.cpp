@@ -2,19 +2,31 @@
 
 #include "livestatus/livestatuslistener.hpp"
 #include "livestatus/livestatuslistener-ti.cpp"
+#include "livestatus/livestatuswaittrigger.hpp"
 #include "base/utility.hpp"
 #include "base/perfdatavalue.hpp"
 #include "base/objectlock.hpp"
 #include "base/configtype.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
-#include "base/tcpsocket.hpp"
-#include "base/unixsocket.hpp"
-#include "base/networkstream.hpp"
+#include "base/io-engine.hpp"
+#include "base/defer.hpp"
 #include "base/application.hpp"
 #include "base/function.hpp"
 #include "base/statsfunction.hpp"
 #include "base/convert.hpp"
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#ifndef _WIN32
+#	include <boost/asio/local/stream_protocol.hpp>
+#endif /* _WIN32 */
+#include <cstdint>
+#include <future>
+#include <memory>
 
 using namespace icinga;
 
@@ -29,10 +41,27 @@ REGISTER_STATSFUNCTION(LivestatusListener, &LivestatusListener::StatsFunc);
 void LivestatusListener::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
+	DictionaryData tables;
+
+	for (auto& kv : LivestatusQuery::GetTableStats()) {
+		const LivestatusTableStats& stats (kv.second);
+
+		tables.emplace_back(kv.first, new Dictionary({
+			{ "queries", stats.Queries },
+			{ "avg_filter_time", stats.FilterTime / stats.Queries },
+			{ "max_filter_time", stats.FilterTimeMax },
+			{ "avg_output_time", stats.OutputTime / stats.Queries },
+			{ "max_output_time", stats.OutputTimeMax }
+		}));
+	}
+
+	/* The tables are shared by all listeners. */
+	Dictionary::Ptr tableStats = new Dictionary(std::move(tables));
 
 	for (const LivestatusListener::Ptr& livestatuslistener : ConfigType::GetObjectsByType<LivestatusListener>()) {
 		nodes.emplace_back(livestatuslistener->GetName(), new Dictionary({
-			{ "connections", l_Connections }
+			{ "connections", l_Connections },
+			{ "tables", tableStats }
 		}));
 
 		perfdata->Add(new PerfdataValue("livestatuslistener_" + livestatuslistener->GetName() + "_connections", l_Connections));
@@ -51,31 +80,60 @@ void LivestatusListener::Start(bool runtimeCreated)
 	Log(LogInformation, "LivestatusListener")
 		<< "'" << GetName() << "' started.";
 
+	namespace asio = boost::asio;
+
+	auto& io (IoEngine::Get().GetIoContext());
+	auto acceptor (Shared<Acceptor>::Make(io));
+
 	if (GetSocketType() == "tcp") {
-		TcpSocket::Ptr socket = new TcpSocket();
+		using asio::ip::tcp;
 
 		try {
-			socket->Bind(GetBindHost(), GetBindPort(), AF_UNSPEC);
-		} catch (std::exception&) {
+			tcp::resolver resolver (io);
+			tcp::resolver::query query (GetBindHost(), GetBindPort(), tcp::resolver::query::passive);
+
+			auto result (resolver.resolve(query));
+			auto current (result.begin());
+
+			for (;;) {
+				try {
+					acceptor->open(current->endpoint().protocol());
+					acceptor->set_option(asio::socket_base::reuse_address(true));
+					acceptor->bind(current->endpoint());
+
+					break;
+				} catch (const std::exception&) {
+					if (++current == result.end()) {
+						throw;
+					}
+
+					if (acceptor->is_open()) {
+						acceptor->close();
+					}
+				}
+			}
+
+			acceptor->listen();
+		} catch (const std::exception&) {
 			Log(LogCritical, "LivestatusListener")
 				<< "Cannot bind TCP socket on host '" << GetBindHost() << "' port '" << GetBindPort() << "'.";
 			return;
 		}
 
-		m_Listener = socket;
-
-		m_Thread = std::thread(std::bind(&LivestatusListener::ServerThreadProc, this));
-
 		Log(LogInformation, "LivestatusListener")
 			<< "Created TCP socket listening on host '" << GetBindHost() << "' port '" << GetBindPort() << "'.";
 	}
 	else if (GetSocketType() == "unix") {
 #ifndef _WIN32
-		UnixSocket::Ptr socket = new UnixSocket();
+		asio::local::stream_protocol::endpoint endpoint (GetSocketPath().GetData());
+
+		unlink(GetSocketPath().CStr());
 
 		try {
-			socket->Bind(GetSocketPath());
-		} catch (std::exception&) {
+			acceptor->open(endpoint.protocol());
+			acceptor->bind(endpoint);
+			acceptor->listen();
+		} catch (const std::exception&) {
 			Log(LogCritical, "LivestatusListener")
 				<< "Cannot bind UNIX socket to '" << GetSocketPath() << "'.";
 			return;
@@ -90,10 +148,6 @@ void LivestatusListener::Start(bool runtimeCreated)
 			return;
 		}
 
-		m_Listener = socket;
-
-		m_Thread = std::thread(std::bind(&LivestatusListener::ServerThreadProc, this));
-
 		Log(LogInformation, "LivestatusListener")
 			<< "Created UNIX socket in '" << GetSocketPath() << "'.";
 #else
@@ -101,7 +155,14 @@ void LivestatusListener::Start(bool runtimeCreated)
 		Log(LogCritical, "LivestatusListener", "Unix sockets are not supported on Windows.");
 		return;
 #endif
+	} else {
+		return;
 	}
+
+	m_Listener = acceptor;
+	m_ListenerStrand = Shared<asio::io_context::strand>::Make(io);
+
+	IoEngine::SpawnCoroutine(*m_ListenerStrand, [this, acceptor](asio::yield_context yc) { ListenerCoroutineProc(yc, acceptor); });
 }
 
 void LivestatusListener::Stop(bool runtimeRemoved)
@@ -111,10 +172,17 @@ void LivestatusListener::Stop(bool runtimeRemoved)
 	Log(LogInformation, "LivestatusListener")
 		<< "'" << GetName() << "' stopped.";
 
-	m_Listener->Close();
+	if (m_Listener) {
+		auto listener (m_Listener);
+
+		/* The acceptor is only touched by its coroutine's strand. */
+		m_ListenerStrand->post([listener]() {
+			boost::system::error_code ec;
+			listener->close(ec);
+		});
 
-	if (m_Thread.joinable())
-		m_Thread.join();
+		m_Listener = nullptr;
+	}
 }
 
 int LivestatusListener::GetClientsConnected()
@@ -131,77 +199,209 @@ int LivestatusListener::GetConnections()
 	return l_Connections;
 }
 
-void LivestatusListener::ServerThreadProc()
+void LivestatusListener::ListenerCoroutineProc(boost::asio::yield_context yc, const Shared<Acceptor>::Ptr& server)
 {
-	m_Listener->Listen();
+	namespace asio = boost::asio;
 
-	try {
-		for (;;) {
-			timeval tv = { 0, 500000 };
+	for (;;) {
+		/* The connection stays with the shard it's accepted for, see IoEngine::GetConnectionIoContext(). */
+		auto& shard (IoEngine::Get().GetConnectionIoContext());
+		auto client (Shared<Socket>::Make(shard));
+		boost::system::error_code ec;
 
-			if (m_Listener->Poll(true, false, &tv)) {
-				Socket::Ptr client = m_Listener->Accept();
-				Log(LogNotice, "LivestatusListener", "Client connected");
-				Utility::QueueAsyncCallback(std::bind(&LivestatusListener::ClientHandler, this, client), LowLatencyScheduler);
-			}
+		server->async_accept(*client, yc[ec]);
 
-			if (!IsActive())
-				break;
+		if (!server->is_open() || !IsActive())
+			break;
+
+		if (ec) {
+			Log(LogCritical, "LivestatusListener")
+				<< "Cannot accept new connection: " << ec.message();
+			continue;
 		}
-	} catch (std::exception&) {
-		Log(LogCritical, "LivestatusListener", "Cannot accept new connection.");
+
+		Log(LogNotice, "LivestatusListener", "Client connected");
+
+		auto strand (Shared<asio::io_context::strand>::Make(shard));
+
+		IoEngine::SpawnCoroutine(*strand, [this, strand, client](asio::yield_context yc) { ClientHandler(yc, strand, client); });
 	}
+}
 
-	m_Listener->Close();
+/**
+ * Passes a query's response to the client's coroutine while the query is
+ * running in the thread pool. Write() blocks until the chunk has been sent.
+ *
+ * @ingroup livestatus
+ */
+class LivestatusClientStream final : public Stream
+{
+public:
+	DECLARE_PTR_TYPEDEFS(LivestatusClientStream);
+
+	LivestatusClientStream(const Shared<boost::asio::io_context::strand>::Ptr& strand,
+		const Shared<boost::asio::generic::stream_protocol::socket>::Ptr& client)
+		: m_Strand(strand), m_Client(client)
+	{ }
+
+	size_t Read(void *buffer, size_t count, bool allow_partial) override
+	{
+		BOOST_THROW_EXCEPTION(std::runtime_error("Reading from the query response stream is not supported."));
+	}
+
+	void Write(const void *buffer, size_t count) override
+	{
+		auto written (std::make_shared<std::promise<boost::system::error_code>>());
+		auto result (written->get_future());
+		auto client (m_Client);
+
+		m_Strand->post([client, buffer, count, written]() {
+			boost::asio::async_write(*client, boost::asio::buffer(buffer, count),
+				[written](const boost::system::error_code& ec, size_t) { written->set_value(ec); });
+		});
+
+		auto ec (result.get());
+
+		if (ec)
+			BOOST_THROW_EXCEPTION(boost::system::system_error(ec));
+	}
+
+	/* The client's coroutine closes the connection once the query is done. */
+	void Close() override
+	{ }
+
+	bool IsEof() const override
+	{
+		return false;
+	}
+
+private:
+	Shared<boost::asio::io_context::strand>::Ptr m_Strand;
+	Shared<boost::asio::generic::stream_protocol::socket>::Ptr m_Client;
+};
+
+/**
+ * Waits for a query's "WaitCondition" or "WaitTrigger" without blocking a thread.
+ * The condition is only checked again after one of the query's triggers happened.
+ */
+static void WaitForQuery(boost::asio::yield_context yc, const Shared<boost::asio::io_context::strand>::Ptr& strand, const LivestatusQuery::Ptr& query)
+{
+	auto triggered (std::make_shared<AsioConditionVariable>(strand->context()));
+	auto timedOut (std::make_shared<bool>(false));
+
+	uint_fast64_t subscription = LivestatusWaitTrigger::Subscribe(query->GetWaitTriggers(), [strand, triggered]() {
+		strand->post([triggered]() { triggered->Set(); });
+	});
+
+	Defer unsubscribe ([subscription]() { LivestatusWaitTrigger::Unsubscribe(subscription); });
+
+	Timeout::Ptr timeout;
+
+	if (query->GetWaitTimeout() > 0) {
+		timeout = new Timeout(
+			strand->context(),
+			*strand,
+			boost::posix_time::microseconds(intmax_t(query->GetWaitTimeout() * 1000000)),
+			[triggered, timedOut](boost::asio::yield_context yc) {
+				*timedOut = true;
+				triggered->Set();
+			}
+		);
+	}
+
+	Defer cancelTimeout ([&timeout]() {
+		if (timeout)
+			timeout->Cancel();
+	});
+
+	for (bool wasTriggered = false;; wasTriggered = true) {
+		triggered->Clear();
+
+		if (*timedOut || query->IsWaitConditionMet(wasTriggered))
+			break;
+
+		triggered->Wait(yc);
+	}
 }
 
-void LivestatusListener::ClientHandler(const Socket::Ptr& client)
+/**
+ * Reads the client's queries without blocking a thread. The queries themselves
+ * run in the thread pool as they may take a while, e.g. for large tables.
+ */
+void LivestatusListener::ClientHandler(boost::asio::yield_context yc, const Shared<boost::asio::io_context::strand>::Ptr& strand, const Shared<Socket>::Ptr& client)
 {
+	namespace asio = boost::asio;
+
 	{
 		std::unique_lock<std::mutex> lock(l_ComponentMutex);
 		l_ClientsConnected++;
 		l_Connections++;
 	}
 
-	Stream::Ptr stream = new NetworkStream(client);
+	Defer disconnected ([]() {
+		std::unique_lock<std::mutex> lock(l_ComponentMutex);
+		l_ClientsConnected--;
+	});
 
-	StreamReadContext context;
+	asio::streambuf buf;
+	bool eof = false;
 
 	for (;;) {
-		String line;
-
 		std::vector<String> lines;
 
-		for (;;) {
-			StreamReadStatus srs = stream->ReadLine(&line, context);
+		while (!eof) {
+			boost::system::error_code ec;
+			size_t length = asio::async_read_until(*client, buf, '\n', yc[ec]);
 
-			if (srs == StatusEof)
-				break;
+			if (ec) {
+				/* Like Stream::ReadLine(), the data after the last newline makes up the last line. */
+				eof = true;
+				length = buf.size();
+			}
+
+			auto begin (asio::buffers_begin(buf.data()));
+			String line (begin, begin + length);
 
-			if (srs != StatusNewItem)
-				continue;
+			buf.consume(length);
+			boost::algorithm::trim_right(line);
 
-			if (line.GetLength() > 0)
-				lines.push_back(line);
-			else
+			if (line.IsEmpty())
 				break;
+
+			lines.emplace_back(std::move(line));
 		}
 
 		if (lines.empty())
 			break;
 
 		LivestatusQuery::Ptr query = new LivestatusQuery(lines, GetCompatLogPath());
-		if (!query->Execute(stream))
+
+		if (query->GetWaitTriggers())
+			WaitForQuery(yc, strand, query);
+
+		Stream::Ptr stream = new LivestatusClientStream(strand, client);
+		AsioConditionVariable done (strand->context());
+		bool keepAlive = false;
+
+		Utility::QueueAsyncCallback([query, stream, strand, &done, &keepAlive]() {
+			Defer finish ([strand, &done]() {
+				strand->post([&done]() { done.Set(); });
+			});
+
+			keepAlive = query->Execute(stream);
+		}, LowLatencyScheduler);
+
+		done.Wait(yc);
+
+		if (!keepAlive)
 			break;
 	}
 
-	{
-		std::unique_lock<std::mutex> lock(l_ComponentMutex);
-		l_ClientsConnected--;
-	}
+	boost::system::error_code ec;
+	client->shutdown(Socket::shutdown_both, ec);
+	client->close(ec);
 }
 
-
 void LivestatusListener::ValidateSocketType(const Lazy<String>& lvalue, const ValidationUtils& utils)
 {
 	ObjectImpl<LivestatusListener>::ValidateSocketType(lvalue, utils);
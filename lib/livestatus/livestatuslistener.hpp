@@ -6,8 +6,11 @@
 #include "livestatus/i2-livestatus.hpp"
 #include "livestatus/livestatuslistener-ti.hpp"
 #include "livestatus/livestatusquery.hpp"
-#include "base/socket.hpp"
-#include <thread>
+#include "base/shared.hpp"
+#include <boost/asio/generic/stream_protocol.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/spawn.hpp>
 
 using namespace icinga;
 
@@ -35,11 +38,14 @@ protected:
 	void Stop(bool runtimeRemoved) override;
 
 private:
-	void ServerThreadProc();
-	void ClientHandler(const Socket::Ptr& client);
+	typedef boost::asio::generic::stream_protocol::acceptor Acceptor;
+	typedef boost::asio::generic::stream_protocol::socket Socket;
 
-	Socket::Ptr m_Listener;
-	std::thread m_Thread;
+	void ListenerCoroutineProc(boost::asio::yield_context yc, const Shared<Acceptor>::Ptr& server);
+	void ClientHandler(boost::asio::yield_context yc, const Shared<boost::asio::io_context::strand>::Ptr& strand, const Shared<Socket>::Ptr& client);
+
+	Shared<Acceptor>::Ptr m_Listener;
+	Shared<boost::asio::io_context::strand>::Ptr m_ListenerStrand;
 };
 
 }
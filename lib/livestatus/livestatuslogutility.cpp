@@ -7,12 +7,14 @@
 #include "icinga/checkcommand.hpp"
 #include "icinga/eventcommand.hpp"
 #include "icinga/notificationcommand.hpp"
+#include "icinga/compatlogindex.hpp"
 #include "base/utility.hpp"
 #include "base/convert.hpp"
 #include "base/logger.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
 #include <fstream>
 
 using namespace icinga;
@@ -53,30 +55,36 @@ void LivestatusLogUtility::CreateLogIndexFileHandler(const String& path, std::ma
 	index[ts_start] = path;
 }
 
-void LivestatusLogUtility::CreateLogCache(std::map<time_t, String> index, HistoryTable *table,
-	time_t from, time_t until, const AddRowFunction& addRowFn)
+/**
+ * Reads a log file and adds its entries to the table. Blocks of lines
+ * which don't match the time range or the table's hosts are skipped
+ * using the log file's index, if there is one.
+ */
+static void ReadLogFile(const String& path, HistoryTable *table, time_t from, time_t until,
+	const std::set<uint32_t>& hostHashes, unsigned long& line_count, const AddRowFunction& addRowFn)
 {
-	ASSERT(table);
+	std::vector<CompatLogIndexBlock> blocks;
+	CompatLogIndex::ReadIndex(CompatLogIndex::GetIndexPath(path), blocks);
 
-	/* m_LogFileIndex map tells which log files are involved ordered by their start timestamp */
-	unsigned long line_count = 0;
-	for (const auto& kv : index) {
-		unsigned int ts = kv.first;
+	std::ifstream fp;
+	fp.exceptions(std::ifstream::badbit);
+	fp.open(path.CStr(), std::ifstream::in);
 
-		/* skip log files not in range (performance optimization) */
-		if (ts < from || ts > until)
-			continue;
+	fp.seekg(0, std::ios::end);
+	uint64_t size = fp.tellg();
+	fp.seekg(0);
 
-		String log_file = index[ts];
-		int lineno = 0;
+	uint64_t pos = 0;
+	int lineno = 0;
 
-		std::ifstream fp;
-		fp.exceptions(std::ifstream::badbit);
-		fp.open(log_file.CStr(), std::ifstream::in);
+	auto readUntil = [&](uint64_t end) {
+		fp.clear();
+		fp.seekg(pos);
 
-		while (fp.good()) {
-			std::string line;
-			std::getline(fp, line);
+		std::string line;
+
+		while (pos < end && std::getline(fp, line)) {
+			pos += line.size() + 1;
 
 			if (line.empty())
 				continue; /* Ignore empty lines */
@@ -95,8 +103,68 @@ void LivestatusLogUtility::CreateLogCache(std::map<time_t, String> index, Histor
 			line_count++;
 			lineno++;
 		}
+	};
+
+	for (const CompatLogIndexBlock& block : blocks) {
+		/* The index doesn't match the log file (anymore), read the rest. */
+		if (block.Offset < pos || block.Offset + block.Length > size)
+			break;
+
+		/* Lines which aren't covered by the index. */
+		readUntil(block.Offset);
+
+		bool match = block.Overlaps(from, until);
+
+		if (match && !hostHashes.empty()) {
+			match = std::any_of(hostHashes.begin(), hostHashes.end(),
+				[&block](uint32_t hash) { return block.MayContainHost(hash); });
+		}
+
+		if (match) {
+			readUntil(block.Offset + block.Length);
+		} else {
+			pos = block.Offset + block.Length;
+			line_count += block.Lines;
+			lineno += block.Lines;
+		}
+	}
+
+	readUntil(size);
+
+	fp.close();
+}
+
+void LivestatusLogUtility::CreateLogCache(std::map<time_t, String> index, HistoryTable *table,
+	time_t from, time_t until, const AddRowFunction& addRowFn)
+{
+	ASSERT(table);
+
+	std::set<uint32_t> hostHashes;
+
+	for (const String& hostName : table->GetHostNames()) {
+		/* Log entries without a host don't show up in the index. */
+		if (hostName.IsEmpty()) {
+			hostHashes.clear();
+			break;
+		}
+
+		hostHashes.insert(CompatLogIndex::HashHostName(hostName));
+	}
+
+	/* m_LogFileIndex map tells which log files are involved ordered by their start timestamp,
+	 * the first one is the last file which was started before the time range */
+	auto it = index.upper_bound(from);
+
+	if (it != index.begin())
+		--it;
+
+	unsigned long line_count = 0;
+	for (; it != index.end(); ++it) {
+		/* skip log files not in range (performance optimization) */
+		if (it->first > until)
+			break;
 
-		fp.close();
+		ReadLogFile(it->second, table, from, until, hostHashes, line_count, addRowFn);
 	}
 }
 
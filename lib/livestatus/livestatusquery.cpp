@@ -13,28 +13,36 @@
 #include "livestatus/negatefilter.hpp"
 #include "livestatus/orfilter.hpp"
 #include "livestatus/andfilter.hpp"
+#include "livestatus/livestatusresponsebuffer.hpp"
+#include "livestatus/historytable.hpp"
+#include "livestatus/livestatuswaittrigger.hpp"
 #include "icinga/externalcommandprocessor.hpp"
 #include "base/debug.hpp"
 #include "base/convert.hpp"
 #include "base/objectlock.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
+#include "base/defer.hpp"
 #include "base/utility.hpp"
 #include "base/json.hpp"
 #include "base/serializer.hpp"
 #include "base/timer.hpp"
 #include "base/initialize.hpp"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
 
 using namespace icinga;
 
-static int l_ExternalCommands = 0;
-static std::mutex l_QueryMutex;
+static std::atomic<int> l_ExternalCommands (0);
+static std::mutex l_TableStatsMutex;
+static std::map<String, LivestatusTableStats> l_TableStats;
 
 LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String& compat_log_path)
-	: m_KeepAlive(false), m_OutputFormat("csv"), m_ColumnHeaders(true), m_Limit(-1), m_ErrorCode(0),
-	m_LogTimeFrom(0), m_LogTimeUntil(static_cast<long>(Utility::GetTime()))
+	: m_KeepAlive(false), m_OutputFormat("csv"), m_ColumnHeaders(true), m_Limit(-1), m_WaitTriggers(0),
+	m_WaitTimeout(0), m_ErrorCode(0), m_LogTimeFrom(0), m_LogTimeUntil(static_cast<long>(Utility::GetTime()))
 {
 	if (lines.size() == 0) {
 		m_Verb = "ERROR";
@@ -81,8 +89,9 @@ LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String&
 		return;
 	}
 
-	std::deque<Filter::Ptr> filters, stats;
+	std::deque<Filter::Ptr> filters, stats, waitConditions;
 	std::deque<Aggregator::Ptr> aggregators;
+	String waitObject;
 
 	for (unsigned int i = 1; i < lines.size(); i++) {
 		line = lines[i];
@@ -131,6 +140,31 @@ LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String&
 			}
 
 			filters.push_back(filter);
+		} else if (header == "WaitCondition") {
+			Filter::Ptr filter = ParseFilter(params, m_LogTimeFrom, m_LogTimeUntil);
+
+			if (!filter) {
+				m_Verb = "ERROR";
+				m_ErrorCode = LivestatusErrorQuery;
+				m_ErrorMessage = "Invalid wait condition specification: " + line;
+				return;
+			}
+
+			waitConditions.push_back(filter);
+		} else if (header == "WaitObject") {
+			waitObject = params;
+		} else if (header == "WaitTrigger") {
+			m_WaitTriggers = LivestatusWaitTrigger::ParseTriggers(params);
+
+			if (!m_WaitTriggers) {
+				m_Verb = "ERROR";
+				m_ErrorCode = LivestatusErrorQuery;
+				m_ErrorMessage = "Invalid wait trigger: " + line;
+				return;
+			}
+		} else if (header == "WaitTimeout") {
+			/* milliseconds, 0 means forever */
+			m_WaitTimeout = Convert::ToDouble(params) / 1000;
 		} else if (header == "Stats") {
 			m_ColumnHeaders = false; // Might be explicitly re-enabled later on
 
@@ -180,13 +214,15 @@ LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String&
 			aggregators.push_back(aggregator);
 
 			stats.push_back(filter);
-		} else if (header == "Or" || header == "And" || header == "StatsOr" || header == "StatsAnd") {
-			std::deque<Filter::Ptr>& deq = (header == "Or" || header == "And") ? filters : stats;
+		} else if (header == "Or" || header == "And" || header == "StatsOr" || header == "StatsAnd" ||
+			header == "WaitConditionOr" || header == "WaitConditionAnd") {
+			std::deque<Filter::Ptr>& deq = (header == "Or" || header == "And") ? filters
+				: (header == "StatsOr" || header == "StatsAnd") ? stats : waitConditions;
 
 			unsigned int num = Convert::ToLong(params);
 			CombinerFilter::Ptr filter;
 
-			if (header == "Or" || header == "StatsOr") {
+			if (header == "Or" || header == "StatsOr" || header == "WaitConditionOr") {
 				filter = new OrFilter();
 				Log(LogDebug, "LivestatusQuery")
 					<< "Add OR filter for " << params << " column(s). " << deq.size() << " filters available.";
@@ -218,8 +254,8 @@ LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String&
 				aggregator->SetFilter(filter);
 				aggregators.push_back(aggregator);
 			}
-		} else if (header == "Negate" || header == "StatsNegate") {
-			std::deque<Filter::Ptr>& deq = (header == "Negate") ? filters : stats;
+		} else if (header == "Negate" || header == "StatsNegate" || header == "WaitConditionNegate") {
+			std::deque<Filter::Ptr>& deq = (header == "Negate") ? filters : (header == "StatsNegate") ? stats : waitConditions;
 
 			if (deq.empty()) {
 				m_Verb = "ERROR";
@@ -256,13 +292,118 @@ LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String&
 
 	m_Filter = top_filter;
 	m_Aggregators.swap(aggregators);
+
+	if (!waitConditions.empty()) {
+		if (!m_WaitTriggers)
+			m_WaitTriggers = LivestatusWaitAll;
+
+		AndFilter::Ptr waitCondition = new AndFilter();
+
+		if (!waitObject.IsEmpty()) {
+			Filter::Ptr objectFilter = GetWaitObjectFilter(m_Table, waitObject);
+
+			if (!objectFilter) {
+				m_Verb = "ERROR";
+				m_ErrorCode = LivestatusErrorQuery;
+				m_ErrorMessage = "WaitObject is not supported for table '" + m_Table + "'.";
+				return;
+			}
+
+			waitCondition->AddSubFilter(objectFilter);
+		}
+
+		for (const Filter::Ptr& filter : waitConditions) {
+			waitCondition->AddSubFilter(filter);
+		}
+
+		m_WaitCondition = waitCondition;
+	}
+}
+
+/**
+ * Builds the filter for a "WaitObject" header, i.e. the row its wait condition applies to.
+ *
+ * @param table The table's name
+ * @param object The object's name, "host;service" or "host service" for services
+ * @returns The filter, nullptr if the table doesn't support WaitObject
+ */
+Filter::Ptr LivestatusQuery::GetWaitObjectFilter(const String& table, const String& object)
+{
+	if (table == "services") {
+		size_t index = object.FindFirstOf(";");
+
+		if (index == String::NPos)
+			index = object.FindFirstOf(" ");
+
+		if (index == String::NPos)
+			return nullptr;
+
+		AndFilter::Ptr filter = new AndFilter();
+		filter->AddSubFilter(new AttributeFilter("host_name", "=", object.SubStr(0, index)));
+		filter->AddSubFilter(new AttributeFilter("description", "=", object.SubStr(index + 1)));
+		return filter;
+	}
+
+	if (table == "hosts" || table == "hostgroups" || table == "servicegroups" || table == "contacts" ||
+		table == "contactgroups" || table == "commands")
+		return new AttributeFilter("name", "=", object);
+
+	return nullptr;
+}
+
+/**
+ * Returns the "WaitTrigger" events after which to check the wait condition
+ * again, 0 if the query doesn't have to wait.
+ */
+int LivestatusQuery::GetWaitTriggers() const
+{
+	return m_WaitTriggers;
+}
+
+/**
+ * Returns for how long the query waits at most in seconds, 0 means forever.
+ */
+double LivestatusQuery::GetWaitTimeout() const
+{
+	return m_WaitTimeout;
+}
+
+/**
+ * Checks whether the query doesn't have to wait any longer.
+ *
+ * @param triggered Whether one of the query's wait triggers happened
+ * @returns true if the query can be executed
+ */
+bool LivestatusQuery::IsWaitConditionMet(bool triggered) const
+{
+	/* Without a condition, any trigger will do. */
+	if (!m_WaitCondition)
+		return triggered;
+
+	try {
+		Table::Ptr table = Table::GetByName(m_Table, m_CompatLogPath, m_LogTimeFrom, m_LogTimeUntil);
+
+		if (!table)
+			return true;
+
+		return !table->FilterRows(m_WaitCondition, 1).empty();
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "LivestatusQuery")
+			<< "Cannot evaluate wait condition: " << DiagnosticInformation(ex, false);
+
+		return true;
+	}
 }
 
 int LivestatusQuery::GetExternalCommands()
 {
-	std::unique_lock<std::mutex> lock(l_QueryMutex);
+	return l_ExternalCommands.load();
+}
 
-	return l_ExternalCommands;
+std::map<String, LivestatusTableStats> LivestatusQuery::GetTableStats()
+{
+	std::unique_lock<std::mutex> lock (l_TableStatsMutex);
+	return l_TableStats;
 }
 
 Filter::Ptr LivestatusQuery::ParseFilter(const String& params, unsigned long& from, unsigned long& until)
@@ -448,7 +589,34 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 		return;
 	}
 
+	HistoryTable::Ptr historyTable = dynamic_pointer_cast<HistoryTable>(table);
+
+	/* Let the history tables skip log entries for other hosts. */
+	if (historyTable && m_Filter) {
+		std::set<String> hostNames;
+
+		if (m_Filter->FindColumnValues("host_name", hostNames))
+			historyTable->SetHostNames(std::move(hostNames));
+	}
+
+	double filterStart = Utility::GetTime();
 	std::vector<LivestatusRowValue> objects = table->FilterRows(m_Filter, m_Limit);
+	double outputStart = Utility::GetTime();
+
+	Defer recordStats ([this, filterStart, outputStart]() {
+		double filterTime = outputStart - filterStart;
+		double outputTime = Utility::GetTime() - outputStart;
+
+		std::unique_lock<std::mutex> lock (l_TableStatsMutex);
+		auto& stats (l_TableStats[m_Table]);
+
+		stats.Queries++;
+		stats.FilterTime += filterTime;
+		stats.FilterTimeMax = std::max(stats.FilterTimeMax, filterTime);
+		stats.OutputTime += outputTime;
+		stats.OutputTimeMax = std::max(stats.OutputTimeMax, outputTime);
+	});
+
 	std::vector<String> columns;
 
 	if (m_Columns.size() > 0)
@@ -456,7 +624,9 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 	else
 		columns = table->GetColumnNames();
 
-	std::ostringstream result;
+	/* Rows are sent while they're generated unless the length has to be sent first. */
+	LivestatusResponseBuffer buffer (stream, m_ResponseHeader == "fixed16");
+	std::ostream result (&buffer);
 	bool first_row = true;
 	BeginResultSet(result);
 
@@ -491,34 +661,81 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 			AppendResultRow(result, new Array(std::move(row)), first_row);
 		}
 	} else {
-		std::map<std::vector<Value>, std::vector<AggregatorState *> > allStats;
+		/* The rows are grouped by the values of the columns, each group has a state per aggregator. */
+		std::map<std::vector<Value>, size_t> groups;
+		std::vector<std::vector<AggregatorState *> > groupStats;
+		std::vector<size_t> rowGroups;
+
+		rowGroups.reserve(objects.size());
+
+		/* Aggregators which only need the numbers of a column get all of them at once,
+		 * the others (e.g. counting filters) are applied to each row.
+		 */
+		std::vector<size_t> rowAggregators, numericAggregators;
+
+		for (size_t i = 0; i < m_Aggregators.size(); i++) {
+			if (m_Aggregators[i]->GetNumericColumn().IsEmpty())
+				rowAggregators.push_back(i);
+			else
+				numericAggregators.push_back(i);
+		}
+
+		std::vector<Column> statsColumns;
+		statsColumns.reserve(m_Columns.size());
+
+		for (const String& columnName : m_Columns)
+			statsColumns.emplace_back(table->GetColumn(columnName));
+
+		/* All aggregators are applied to every row, let them share the column values. */
+		table->BeginSnapshot(objects);
+
+		Defer endSnapshot ([&table]() { table->EndSnapshot(); });
 
 		/* add aggregated stats */
-		for (const LivestatusRowValue& object : objects) {
+		for (size_t i = 0; i < objects.size(); i++) {
+			const LivestatusRowValue& object = objects[i];
 			std::vector<Value> statsKey;
 
-			for (const String& columnName : m_Columns) {
-				Column column = table->GetColumn(columnName);
+			table->SetSnapshotRow(i);
+
+			for (const Column& column : statsColumns) {
 				statsKey.emplace_back(column.ExtractValue(object.Row, object.GroupByType, object.GroupByObject));
 			}
 
-			auto it = allStats.find(statsKey);
+			auto it = groups.find(statsKey);
 
-			if (it == allStats.end()) {
-				std::vector<AggregatorState *> newStats(m_Aggregators.size(), nullptr);
-				it = allStats.insert(std::make_pair(statsKey, newStats)).first;
+			if (it == groups.end()) {
+				it = groups.emplace(std::move(statsKey), groupStats.size()).first;
+				groupStats.emplace_back(m_Aggregators.size(), nullptr);
 			}
 
-			auto& stats = it->second;
+			rowGroups.push_back(it->second);
 
-			int index = 0;
+			auto& stats = groupStats[it->second];
 
-			for (const Aggregator::Ptr& aggregator : m_Aggregators) {
-				aggregator->Apply(table, object.Row, &stats[index]);
-				index++;
+			for (size_t index : rowAggregators) {
+				m_Aggregators[index]->Apply(table, object.Row, &stats[index]);
 			}
 		}
 
+		for (size_t index : numericAggregators) {
+			const Aggregator::Ptr& aggregator = m_Aggregators[index];
+			std::vector<double> values = table->GetSnapshotNumbers(aggregator->GetNumericColumn());
+
+			if (groupStats.size() == 1u) {
+				aggregator->ApplyNumbers(values, &groupStats[0][index]);
+				continue;
+			}
+
+			std::vector<std::vector<double> > groupValues (groupStats.size());
+
+			for (size_t i = 0; i < values.size(); i++)
+				groupValues[rowGroups[i]].push_back(values[i]);
+
+			for (size_t group = 0; group < groupValues.size(); group++)
+				aggregator->ApplyNumbers(groupValues[group], &groupStats[group][index]);
+		}
+
 		/* add column headers both for raw and aggregated data */
 		if (m_ColumnHeaders) {
 			ArrayData header;
@@ -534,7 +751,7 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 			AppendResultRow(result, new Array(std::move(header)), first_row);
 		}
 
-		for (const auto& kv : allStats) {
+		for (const auto& kv : groups) {
 			ArrayData row;
 
 			row.reserve(m_Columns.size() + m_Aggregators.size());
@@ -543,7 +760,7 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 				row.push_back(keyPart);
 			}
 
-			auto& stats = kv.second;
+			auto& stats = groupStats[kv.second];
 
 			for (size_t i = 0; i < m_Aggregators.size(); i++)
 				row.push_back(m_Aggregators[i]->GetResultAndFreeState(stats[i]));
@@ -552,7 +769,7 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 		}
 
 		/* add a bogus zero value if aggregated is empty*/
-		if (allStats.empty()) {
+		if (groups.empty()) {
 			ArrayData row;
 
 			row.reserve(m_Aggregators.size());
@@ -567,16 +784,15 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 
 	EndResultSet(result);
 
-	SendResponse(stream, LivestatusErrorOK, result.str());
+	if (m_ResponseHeader == "fixed16")
+		PrintFixed16(stream, LivestatusErrorOK, buffer.GetLength());
+
+	buffer.Commit();
 }
 
 void LivestatusQuery::ExecuteCommandHelper(const Stream::Ptr& stream)
 {
-	{
-		std::unique_lock<std::mutex> lock(l_QueryMutex);
-
-		l_ExternalCommands++;
-	}
+	l_ExternalCommands++;
 
 	Log(LogNotice, "LivestatusQuery")
 		<< "Executing command: " << m_Command;
@@ -594,7 +810,7 @@ void LivestatusQuery::ExecuteErrorHelper(const Stream::Ptr& stream)
 void LivestatusQuery::SendResponse(const Stream::Ptr& stream, int code, const String& data)
 {
 	if (m_ResponseHeader == "fixed16")
-		PrintFixed16(stream, code, data);
+		PrintFixed16(stream, code, data.GetLength());
 
 	if (m_ResponseHeader == "fixed16" || code == LivestatusErrorOK) {
 		try {
@@ -605,12 +821,12 @@ void LivestatusQuery::SendResponse(const Stream::Ptr& stream, int code, const St
 	}
 }
 
-void LivestatusQuery::PrintFixed16(const Stream::Ptr& stream, int code, const String& data)
+void LivestatusQuery::PrintFixed16(const Stream::Ptr& stream, int code, size_t length)
 {
 	ASSERT(code >= 100 && code <= 999);
 
 	String sCode = Convert::ToString(code);
-	String sLength = Convert::ToString(static_cast<long>(data.GetLength()));
+	String sLength = Convert::ToString(static_cast<long>(length));
 
 	String header = sCode + String(16 - 3 - sLength.GetLength() - 1, ' ') + sLength + m_Separators[0];
 
@@ -9,7 +9,9 @@
 #include "base/array.hpp"
 #include "base/stream.hpp"
 #include "base/scriptframe.hpp"
+#include <cstdint>
 #include <deque>
+#include <map>
 
 using namespace icinga;
 
@@ -23,6 +25,21 @@ enum LivestatusError
 	LivestatusErrorQuery = 452
 };
 
+/**
+ * Time spent on the GET queries for a table. Filtering includes fetching the
+ * rows, the output includes extracting the columns, aggregating and sending them.
+ *
+ * @ingroup livestatus
+ */
+struct LivestatusTableStats
+{
+	uint_fast64_t Queries{0};
+	double FilterTime{0};
+	double FilterTimeMax{0};
+	double OutputTime{0};
+	double OutputTimeMax{0};
+};
+
 /**
  * @ingroup livestatus
  */
@@ -35,7 +52,12 @@ public:
 
 	bool Execute(const Stream::Ptr& stream);
 
+	int GetWaitTriggers() const;
+	double GetWaitTimeout() const;
+	bool IsWaitConditionMet(bool triggered) const;
+
 	static int GetExternalCommands();
+	static std::map<String, LivestatusTableStats> GetTableStats();
 
 private:
 	String m_Verb;
@@ -56,6 +78,11 @@ private:
 
 	String m_ResponseHeader;
 
+	/* Parameters for waiting queries. */
+	Filter::Ptr m_WaitCondition;
+	int m_WaitTriggers;
+	double m_WaitTimeout;
+
 	/* Parameters for COMMAND/SCRIPT queries. */
 	String m_Command;
 	String m_Session;
@@ -80,9 +107,10 @@ private:
 	void ExecuteErrorHelper(const Stream::Ptr& stream);
 
 	void SendResponse(const Stream::Ptr& stream, int code, const String& data);
-	void PrintFixed16(const Stream::Ptr& stream, int code, const String& data);
+	void PrintFixed16(const Stream::Ptr& stream, int code, size_t length);
 
 	static Filter::Ptr ParseFilter(const String& params, unsigned long& from, unsigned long& until);
+	static Filter::Ptr GetWaitObjectFilter(const String& table, const String& object);
 };
 
 }
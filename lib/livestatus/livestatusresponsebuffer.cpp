@@ -0,0 +1,132 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "livestatus/livestatusresponsebuffer.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+using namespace icinga;
+
+/**
+ * Constructor for the LivestatusResponseBuffer class.
+ *
+ * @param stream The client's stream.
+ * @param spool Whether to hold the response back until Commit() is called.
+ */
+LivestatusResponseBuffer::LivestatusResponseBuffer(Stream::Ptr stream, bool spool)
+	: m_Stream(std::move(stream)), m_Spool(spool)
+{
+	m_Buffer.reserve(ChunkSize);
+}
+
+LivestatusResponseBuffer::~LivestatusResponseBuffer()
+{
+	if (m_SpillFile.is_open())
+		m_SpillFile.close();
+
+	if (!m_SpillPath.IsEmpty()) {
+		boost::system::error_code ec;
+		boost::filesystem::remove(m_SpillPath.GetData(), ec);
+	}
+}
+
+/**
+ * Returns the number of bytes which have been written to the buffer so far.
+ *
+ * @returns The length of the response.
+ */
+size_t LivestatusResponseBuffer::GetLength() const
+{
+	return m_Length;
+}
+
+/**
+ * Sends the rest of the response to the client.
+ */
+void LivestatusResponseBuffer::Commit()
+{
+	if (m_SpillFile.is_open()) {
+		m_SpillFile.flush();
+		m_SpillFile.seekg(0);
+
+		std::string chunk (ChunkSize, '\0');
+
+		while (m_SpillFile.read(&chunk[0], chunk.size()) || m_SpillFile.gcount() > 0)
+			WriteToStream(chunk.c_str(), m_SpillFile.gcount());
+
+		m_SpillFile.close();
+	}
+
+	WriteToStream(m_Buffer.c_str(), m_Buffer.size());
+	m_Buffer.clear();
+
+	m_Spool = false;
+}
+
+LivestatusResponseBuffer::int_type LivestatusResponseBuffer::overflow(int_type ch)
+{
+	if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+		char c = traits_type::to_char_type(ch);
+		Append(&c, 1);
+	}
+
+	return traits_type::not_eof(ch);
+}
+
+std::streamsize LivestatusResponseBuffer::xsputn(const char *s, std::streamsize n)
+{
+	Append(s, n);
+
+	return n;
+}
+
+void LivestatusResponseBuffer::Append(const char *s, size_t n)
+{
+	m_Buffer.append(s, n);
+	m_Length += n;
+
+	if (m_Spool) {
+		if (m_Buffer.size() >= MemoryLimit)
+			Spill();
+	} else if (m_Buffer.size() >= ChunkSize) {
+		WriteToStream(m_Buffer.c_str(), m_Buffer.size());
+		m_Buffer.clear();
+	}
+}
+
+void LivestatusResponseBuffer::WriteToStream(const char *s, size_t n)
+{
+	/* Keep consuming the response so the query finishes normally. */
+	if (m_Failed || n == 0)
+		return;
+
+	try {
+		m_Stream->Write(s, n);
+	} catch (const std::exception&) {
+		Log(LogCritical, "LivestatusQuery", "Cannot write query response to socket.");
+		m_Failed = true;
+	}
+}
+
+void LivestatusResponseBuffer::Spill()
+{
+	if (!m_SpillFile.is_open()) {
+		boost::filesystem::path path = boost::filesystem::temp_directory_path() / "icinga2-livestatus.XXXXXX";
+
+		m_SpillPath = Utility::CreateTempFile(path.string(), 0600, m_SpillFile);
+
+		/* CreateTempFile() opens the file for writing only. */
+		m_SpillFile.close();
+		m_SpillFile.open(m_SpillPath.CStr(), std::fstream::in | std::fstream::out | std::fstream::trunc | std::fstream::binary);
+
+		if (!m_SpillFile)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Could not open temporary file '" + m_SpillPath + "' for the query response."));
+
+		m_SpillFile.exceptions(std::fstream::badbit);
+	}
+
+	m_SpillFile.write(m_Buffer.c_str(), m_Buffer.size());
+	m_Buffer.clear();
+}
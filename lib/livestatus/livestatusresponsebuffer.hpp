@@ -0,0 +1,64 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef LIVESTATUSRESPONSEBUFFER_H
+#define LIVESTATUSRESPONSEBUFFER_H
+
+#include "livestatus/i2-livestatus.hpp"
+#include "base/stream.hpp"
+#include <fstream>
+#include <streambuf>
+#include <string>
+
+using namespace icinga;
+
+namespace icinga
+{
+
+/**
+ * Streams a query response to the client in chunks.
+ *
+ * With "ResponseHeader: fixed16" the length of the response has to be sent
+ * before the response itself. In this case the response is kept in memory
+ * and spills into a temporary file once it exceeds MemoryLimit.
+ *
+ * @ingroup livestatus
+ */
+class LivestatusResponseBuffer final : public std::streambuf
+{
+public:
+	static const size_t ChunkSize = 64 * 1024;
+	static const size_t MemoryLimit = 16 * 1024 * 1024;
+
+	LivestatusResponseBuffer(Stream::Ptr stream, bool spool);
+	~LivestatusResponseBuffer() override;
+
+	LivestatusResponseBuffer(const LivestatusResponseBuffer&) = delete;
+	LivestatusResponseBuffer& operator=(const LivestatusResponseBuffer&) = delete;
+
+	size_t GetLength() const;
+
+	void Commit();
+
+protected:
+	int_type overflow(int_type ch) override;
+	std::streamsize xsputn(const char *s, std::streamsize n) override;
+
+private:
+	Stream::Ptr m_Stream;
+	bool m_Spool;
+	bool m_Failed{false};
+	size_t m_Length{0};
+
+	std::string m_Buffer;
+
+	std::fstream m_SpillFile;
+	String m_SpillPath;
+
+	void Append(const char *s, size_t n);
+	void WriteToStream(const char *s, size_t n);
+	void Spill();
+};
+
+}
+
+#endif /* LIVESTATUSRESPONSEBUFFER_H */
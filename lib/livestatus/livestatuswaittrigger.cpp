@@ -0,0 +1,138 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "livestatus/livestatuswaittrigger.hpp"
+#include "icinga/checkable.hpp"
+#include "icinga/comment.hpp"
+#include "icinga/downtime.hpp"
+#include "icinga/externalcommandprocessor.hpp"
+#include "base/initialize.hpp"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <utility>
+
+using namespace icinga;
+
+INITIALIZE_ONCE(&LivestatusWaitTrigger::StaticInitialize);
+
+struct LivestatusWaiter
+{
+	int Triggers;
+	LivestatusWaitTrigger::Callback Callback;
+};
+
+static std::mutex l_WaitersMutex;
+static std::map<uint_fast64_t, LivestatusWaiter> l_Waiters;
+static uint_fast64_t l_NextWaiterId = 0;
+
+/* Lets the event handlers skip the mutex while nobody is waiting, i.e. most of the time. */
+static std::atomic<size_t> l_WaitersCount (0);
+
+void LivestatusWaitTrigger::StaticInitialize()
+{
+	Checkable::OnNewCheckResult.connect([](const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&) {
+		Fire(LivestatusWaitCheck);
+	});
+
+	Checkable::OnStateChange.connect([](const Checkable::Ptr&, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&) {
+		Fire(LivestatusWaitState | LivestatusWaitLog);
+	});
+
+	Checkable::OnNotificationSentToAllUsers.connect([](const Notification::Ptr&, const Checkable::Ptr&, const std::set<User::Ptr>&,
+		const NotificationType&, const CheckResult::Ptr&, const String&, const String&, const MessageOrigin::Ptr&) {
+		Fire(LivestatusWaitLog);
+	});
+
+	Downtime::OnDowntimeAdded.connect([](const Downtime::Ptr&) { Fire(LivestatusWaitDowntime); });
+	Downtime::OnDowntimeRemoved.connect([](const Downtime::Ptr&) { Fire(LivestatusWaitDowntime); });
+
+	Comment::OnCommentAdded.connect([](const Comment::Ptr&) { Fire(LivestatusWaitComment); });
+	Comment::OnCommentRemoved.connect([](const Comment::Ptr&) { Fire(LivestatusWaitComment); });
+
+	/* The program status is changed by external commands, too. */
+	ExternalCommandProcessor::OnNewExternalCommand.connect([](double, const String&, const std::vector<String>&) {
+		Fire(LivestatusWaitCommand | LivestatusWaitProgram);
+	});
+}
+
+/**
+ * Parses the value of a "WaitTrigger" header.
+ *
+ * @param triggers Space-separated trigger names
+ * @returns The triggers as LivestatusWaitTriggerType flags, 0 for unknown names
+ */
+int LivestatusWaitTrigger::ParseTriggers(const String& triggers)
+{
+	int result = 0;
+
+	for (const String& trigger : triggers.Split(" ")) {
+		if (trigger.IsEmpty())
+			continue;
+
+		if (trigger == "check")
+			result |= LivestatusWaitCheck;
+		else if (trigger == "state")
+			result |= LivestatusWaitState;
+		else if (trigger == "log")
+			result |= LivestatusWaitLog;
+		else if (trigger == "downtime")
+			result |= LivestatusWaitDowntime;
+		else if (trigger == "comment")
+			result |= LivestatusWaitComment;
+		else if (trigger == "command")
+			result |= LivestatusWaitCommand;
+		else if (trigger == "program")
+			result |= LivestatusWaitProgram;
+		else if (trigger == "all")
+			result |= LivestatusWaitAll;
+		else
+			return 0;
+	}
+
+	return result;
+}
+
+/**
+ * Registers a callback for the given triggers. It's called while holding
+ * a lock, so it should only hand the wakeup over to somebody else.
+ *
+ * @param triggers LivestatusWaitTriggerType flags
+ * @param callback Called for every matching event until Unsubscribe()
+ * @returns The ID for Unsubscribe()
+ */
+uint_fast64_t LivestatusWaitTrigger::Subscribe(int triggers, Callback callback)
+{
+	std::unique_lock<std::mutex> lock (l_WaitersMutex);
+	uint_fast64_t id = l_NextWaiterId++;
+
+	l_Waiters.emplace(id, LivestatusWaiter{triggers, std::move(callback)});
+	l_WaitersCount.store(l_Waiters.size());
+
+	return id;
+}
+
+/**
+ * Removes a callback. It isn't called anymore once this returns.
+ *
+ * @param id The ID returned by Subscribe()
+ */
+void LivestatusWaitTrigger::Unsubscribe(uint_fast64_t id)
+{
+	std::unique_lock<std::mutex> lock (l_WaitersMutex);
+
+	l_Waiters.erase(id);
+	l_WaitersCount.store(l_Waiters.size());
+}
+
+void LivestatusWaitTrigger::Fire(int trigger)
+{
+	if (!l_WaitersCount.load())
+		return;
+
+	std::unique_lock<std::mutex> lock (l_WaitersMutex);
+
+	for (auto& kv : l_Waiters) {
+		if (kv.second.Triggers & trigger)
+			kv.second.Callback();
+	}
+}
@@ -0,0 +1,51 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef LIVESTATUSWAITTRIGGER_H
+#define LIVESTATUSWAITTRIGGER_H
+
+#include "livestatus/i2-livestatus.hpp"
+#include "base/string.hpp"
+#include <cstdint>
+#include <functional>
+
+namespace icinga
+{
+
+/**
+ * @ingroup livestatus
+ */
+enum LivestatusWaitTriggerType
+{
+	LivestatusWaitCheck = 1,
+	LivestatusWaitState = 2,
+	LivestatusWaitLog = 4,
+	LivestatusWaitDowntime = 8,
+	LivestatusWaitComment = 16,
+	LivestatusWaitCommand = 32,
+	LivestatusWaitProgram = 64,
+	LivestatusWaitAll = 127
+};
+
+/**
+ * Wakes up queries with a "WaitTrigger" header once a matching event happens.
+ *
+ * @ingroup livestatus
+ */
+class LivestatusWaitTrigger
+{
+public:
+	typedef std::function<void ()> Callback;
+
+	static int ParseTriggers(const String& triggers);
+
+	static uint_fast64_t Subscribe(int triggers, Callback callback);
+	static void Unsubscribe(uint_fast64_t id);
+
+	static void Fire(int trigger);
+
+	static void StaticInitialize();
+};
+
+}
+
+#endif /* LIVESTATUSWAITTRIGGER_H */
@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/maxaggregator.hpp"
+#include <algorithm>
 
 using namespace icinga;
 
@@ -18,9 +19,7 @@ MaxAggregatorState *MaxAggregator::EnsureState(AggregatorState **state)
 
 void MaxAggregator::Apply(const Table::Ptr& table, const Value& row, AggregatorState **state)
 {
-	Column column = table->GetColumn(m_MaxAttr);
-
-	Value value = column.ExtractValue(row);
+	Value value = table->GetColumnValue(m_MaxAttr, row);
 
 	MaxAggregatorState *pstate = EnsureState(state);
 
@@ -36,3 +35,32 @@ double MaxAggregator::GetResultAndFreeState(AggregatorState *state) const
 
 	return result;
 }
+
+String MaxAggregator::GetNumericColumn() const
+{
+	return m_MaxAttr;
+}
+
+void MaxAggregator::ApplyNumeric(const double *values, size_t count, AggregatorState **state) const
+{
+	MaxAggregatorState *pstate = EnsureState(state);
+	double max = pstate->Max;
+
+	for (size_t i = 0; i < count; i++)
+		max = std::max(max, values[i]);
+
+	pstate->Max = max;
+}
+
+void MaxAggregator::MergeState(AggregatorState *partial, AggregatorState **state) const
+{
+	if (!partial)
+		return;
+
+	MaxAggregatorState *pstate = EnsureState(state);
+	MaxAggregatorState *ppartial = static_cast<MaxAggregatorState *>(partial);
+
+	pstate->Max = std::max(pstate->Max, ppartial->Max);
+
+	delete ppartial;
+}
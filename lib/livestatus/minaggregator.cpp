@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/minaggregator.hpp"
+#include <algorithm>
 
 using namespace icinga;
 
@@ -18,9 +19,7 @@ MinAggregatorState *MinAggregator::EnsureState(AggregatorState **state)
 
 void MinAggregator::Apply(const Table::Ptr& table, const Value& row, AggregatorState **state)
 {
-	Column column = table->GetColumn(m_MinAttr);
-
-	Value value = column.ExtractValue(row);
+	Value value = table->GetColumnValue(m_MinAttr, row);
 
 	MinAggregatorState *pstate = EnsureState(state);
 
@@ -43,3 +42,32 @@ double MinAggregator::GetResultAndFreeState(AggregatorState *state) const
 
 	return result;
 }
+
+String MinAggregator::GetNumericColumn() const
+{
+	return m_MinAttr;
+}
+
+void MinAggregator::ApplyNumeric(const double *values, size_t count, AggregatorState **state) const
+{
+	MinAggregatorState *pstate = EnsureState(state);
+	double min = pstate->Min;
+
+	for (size_t i = 0; i < count; i++)
+		min = std::min(min, values[i]);
+
+	pstate->Min = min;
+}
+
+void MinAggregator::MergeState(AggregatorState *partial, AggregatorState **state) const
+{
+	if (!partial)
+		return;
+
+	MinAggregatorState *pstate = EnsureState(state);
+	MinAggregatorState *ppartial = static_cast<MinAggregatorState *>(partial);
+
+	pstate->Min = std::min(pstate->Min, ppartial->Min);
+
+	delete ppartial;
+}
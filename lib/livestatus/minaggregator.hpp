@@ -31,6 +31,12 @@ public:
 	void Apply(const Table::Ptr& table, const Value& row, AggregatorState **state) override;
 	double GetResultAndFreeState(AggregatorState *state) const override;
 
+	String GetNumericColumn() const override;
+
+protected:
+	void ApplyNumeric(const double *values, size_t count, AggregatorState **state) const override;
+	void MergeState(AggregatorState *partial, AggregatorState **state) const override;
+
 private:
 	String m_MinAttr;
 
@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/orfilter.hpp"
+#include <set>
 
 using namespace icinga;
 
@@ -16,3 +17,39 @@ bool OrFilter::Apply(const Table::Ptr& table, const Value& row)
 
 	return false;
 }
+
+bool OrFilter::FindCandidateRows(const Table::Ptr& table, std::vector<Value>& rows)
+{
+	if (m_Filters.empty())
+		return false;
+
+	std::set<Object *> seen;
+
+	/* All sub filters need an index, otherwise all rows have to be scanned anyway. */
+	for (const Filter::Ptr& filter : m_Filters) {
+		std::vector<Value> candidates;
+
+		if (!filter->FindCandidateRows(table, candidates))
+			return false;
+
+		for (Value& row : candidates) {
+			if (seen.insert(row.Get<Object::Ptr>().get()).second)
+				rows.emplace_back(std::move(row));
+		}
+	}
+
+	return true;
+}
+
+bool OrFilter::FindColumnValues(const String& column, std::set<String>& values)
+{
+	if (m_Filters.empty())
+		return false;
+
+	for (const Filter::Ptr& filter : m_Filters) {
+		if (!filter->FindColumnValues(column, values))
+			return false;
+	}
+
+	return true;
+}
@@ -177,6 +177,47 @@ void ServicesTable::FetchRows(const AddRowFunction& addRowFn)
 	}
 }
 
+bool ServicesTable::LookupRows(const String& column, const String& op, const String& operand, std::vector<Value>& rows)
+{
+	if (GetGroupByType() != LivestatusGroupByNone)
+		return false;
+
+	String name = GetColumnBaseName(column);
+
+	if (name == "host_name" && op == "=") {
+		Host::Ptr host = Host::GetByName(operand);
+
+		if (host) {
+			for (const Service::Ptr& service : host->GetServices())
+				rows.emplace_back(service);
+		}
+
+		return true;
+	} else if (name == "groups" && op == ">=") {
+		ServiceGroup::Ptr sg = ServiceGroup::GetByName(operand);
+
+		if (sg) {
+			for (const Service::Ptr& service : sg->GetMembers())
+				rows.emplace_back(service);
+		}
+
+		return true;
+	} else if (name == "host_groups" && op == ">=") {
+		HostGroup::Ptr hg = HostGroup::GetByName(operand);
+
+		if (hg) {
+			for (const Host::Ptr& host : hg->GetMembers()) {
+				for (const Service::Ptr& service : host->GetServices())
+					rows.emplace_back(service);
+			}
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
 Object::Ptr ServicesTable::HostAccessor(const Value& row, const Column::ObjectAccessor& parentObjectAccessor)
 {
 	Value service;
@@ -26,6 +26,8 @@ public:
 	String GetName() const override;
 	String GetPrefix() const override;
 
+	bool LookupRows(const String& column, const String& op, const String& operand, std::vector<Value>& rows) override;
+
 protected:
 	void FetchRows(const AddRowFunction& addRowFn) override;
 
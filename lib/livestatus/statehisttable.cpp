@@ -19,9 +19,11 @@
 #include "base/logger.hpp"
 #include "base/application.hpp"
 #include "base/objectlock.hpp"
+#include "base/configtype.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
 #include <fstream>
 
 using namespace icinga;
@@ -57,6 +59,9 @@ void StateHistTable::UpdateLogEntries(const Dictionary::Ptr& log_entry_attrs, in
 	if (!checkable)
 		return;
 
+	if (m_StateHistoryCheckables.find(checkable) != m_StateHistoryCheckables.end())
+		return;
+
 	Array::Ptr state_hist_service_states;
 	Dictionary::Ptr state_hist_bag;
 	unsigned long query_part = m_TimeUntil - m_TimeFrom;
@@ -239,11 +244,13 @@ void StateHistTable::FetchRows(const AddRowFunction& addRowFn)
 	Log(LogDebug, "StateHistTable")
 		<< "Pre-selecting log file from " << m_TimeFrom << " until " << m_TimeUntil;
 
-	/* create log file index */
-	LivestatusLogUtility::CreateLogIndex(m_CompatLogPath, m_LogFileIndex);
+	if (!FetchStateHistoryRows()) {
+		/* create log file index */
+		LivestatusLogUtility::CreateLogIndex(m_CompatLogPath, m_LogFileIndex);
 
-	/* generate log cache */
-	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn);
+		/* generate log cache */
+		LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn);
+	}
 
 	Checkable::Ptr checkable;
 
@@ -256,6 +263,76 @@ void StateHistTable::FetchRows(const AddRowFunction& addRowFn)
 	}
 }
 
+/**
+ * Fills the cache from the in-memory state history of all checkables which
+ * have one covering the whole time range. Those are skipped in the log files.
+ *
+ * @returns Whether all checkables have been served, so the log files don't have to be read at all
+ */
+bool StateHistTable::FetchStateHistoryRows()
+{
+	unsigned long query_part = m_TimeUntil - m_TimeFrom;
+	bool complete = true;
+
+	auto addCheckable ([this, query_part, &complete](const Checkable::Ptr& checkable, const Host::Ptr& host, const Service::Ptr& service) {
+		auto& ring (checkable->GetStateHistoryRing());
+
+		if (checkable->GetStateHistoryRetention() <= 0 || !ring.Covers(m_TimeFrom)) {
+			complete = false;
+			return;
+		}
+
+		Array::Ptr state_hist_service_states = new Array();
+		auto entries (ring.GetEntries(m_TimeFrom, m_TimeUntil));
+
+		for (decltype(entries.size()) i = 0; i < entries.size(); i++) {
+			auto& entry (entries[i]);
+			double from = std::max(entry.Timestamp, static_cast<double>(m_TimeFrom));
+			double until = i + 1 < entries.size() ? entries[i + 1].Timestamp : static_cast<double>(m_TimeUntil);
+			int state;
+
+			/* Same as the states in the HOST ALERT and SERVICE ALERT log entries. */
+			if (service)
+				state = entry.State;
+			else if (Host::CalculateState(static_cast<ServiceState>(entry.State)) == HostUp)
+				state = HostUp;
+			else
+				state = entry.Reachable ? HostDown : 2; /* UNREACHABLE */
+
+			Dictionary::Ptr state_hist_bag = new Dictionary({
+				{ "host_name", host->GetName() },
+				{ "state", state },
+				{ "in_downtime", 0 },
+				{ "in_host_downtime", 0 },
+				{ "in_notification_period", 1 }, // assume "always"
+				{ "is_flapping", 0 },
+				{ "time", from },
+				{ "lineno", 0 },
+				{ "log_output", "" },
+				{ "from", from },
+				{ "until", until },
+				{ "query_part", query_part }
+			});
+
+			if (service)
+				state_hist_bag->Set("service_description", service->GetShortName());
+
+			state_hist_service_states->Add(state_hist_bag);
+		}
+
+		m_CheckablesCache[checkable] = state_hist_service_states;
+		m_StateHistoryCheckables.insert(checkable);
+	});
+
+	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>())
+		addCheckable(host, host, nullptr);
+
+	for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>())
+		addCheckable(service, service->GetHost(), service);
+
+	return complete;
+}
+
 Object::Ptr StateHistTable::HostAccessor(const Value& row, const Column::ObjectAccessor&)
 {
 	String host_name = static_cast<Dictionary::Ptr>(row)->Get("host_name");
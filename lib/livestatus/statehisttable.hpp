@@ -32,6 +32,8 @@ public:
 protected:
 	void FetchRows(const AddRowFunction& addRowFn) override;
 
+	bool FetchStateHistoryRows();
+
 	static Object::Ptr HostAccessor(const Value& row, const Column::ObjectAccessor& parentObjectAccessor);
 	static Object::Ptr ServiceAccessor(const Value& row, const Column::ObjectAccessor& parentObjectAccessor);
 
@@ -65,6 +67,7 @@ protected:
 private:
 	std::map<time_t, String> m_LogFileIndex;
 	std::map<Checkable::Ptr, Array::Ptr> m_CheckablesCache;
+	std::set<Checkable::Ptr> m_StateHistoryCheckables; /**< served from their state history instead of the log files */
 	time_t m_TimeFrom;
 	time_t m_TimeUntil;
 	String m_CompatLogPath;
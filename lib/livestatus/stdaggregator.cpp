@@ -19,9 +19,7 @@ StdAggregatorState *StdAggregator::EnsureState(AggregatorState **state)
 
 void StdAggregator::Apply(const Table::Ptr& table, const Value& row, AggregatorState **state)
 {
-	Column column = table->GetColumn(m_StdAttr);
-
-	Value value = column.ExtractValue(row);
+	Value value = table->GetColumnValue(m_StdAttr, row);
 
 	StdAggregatorState *pstate = EnsureState(state);
 
@@ -38,3 +36,39 @@ double StdAggregator::GetResultAndFreeState(AggregatorState *state) const
 
 	return result;
 }
+
+String StdAggregator::GetNumericColumn() const
+{
+	return m_StdAttr;
+}
+
+void StdAggregator::ApplyNumeric(const double *values, size_t count, AggregatorState **state) const
+{
+	double sum = 0, qsum = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		sum += values[i];
+		qsum += values[i] * values[i];
+	}
+
+	StdAggregatorState *pstate = EnsureState(state);
+
+	pstate->StdSum += sum;
+	pstate->StdQSum += qsum;
+	pstate->StdCount += count;
+}
+
+void StdAggregator::MergeState(AggregatorState *partial, AggregatorState **state) const
+{
+	if (!partial)
+		return;
+
+	StdAggregatorState *pstate = EnsureState(state);
+	StdAggregatorState *ppartial = static_cast<StdAggregatorState *>(partial);
+
+	pstate->StdSum += ppartial->StdSum;
+	pstate->StdQSum += ppartial->StdQSum;
+	pstate->StdCount += ppartial->StdCount;
+
+	delete ppartial;
+}
@@ -18,9 +18,7 @@ SumAggregatorState *SumAggregator::EnsureState(AggregatorState **state)
 
 void SumAggregator::Apply(const Table::Ptr& table, const Value& row, AggregatorState **state)
 {
-	Column column = table->GetColumn(m_SumAttr);
-
-	Value value = column.ExtractValue(row);
+	Value value = table->GetColumnValue(m_SumAttr, row);
 
 	SumAggregatorState *pstate = EnsureState(state);
 
@@ -35,3 +33,31 @@ double SumAggregator::GetResultAndFreeState(AggregatorState *state) const
 
 	return result;
 }
+
+String SumAggregator::GetNumericColumn() const
+{
+	return m_SumAttr;
+}
+
+void SumAggregator::ApplyNumeric(const double *values, size_t count, AggregatorState **state) const
+{
+	double sum = 0;
+
+	for (size_t i = 0; i < count; i++)
+		sum += values[i];
+
+	EnsureState(state)->Sum += sum;
+}
+
+void SumAggregator::MergeState(AggregatorState *partial, AggregatorState **state) const
+{
+	if (!partial)
+		return;
+
+	SumAggregatorState *pstate = EnsureState(state);
+	SumAggregatorState *ppartial = static_cast<SumAggregatorState *>(partial);
+
+	pstate->Sum += ppartial->Sum;
+
+	delete ppartial;
+}
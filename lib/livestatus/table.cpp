@@ -18,7 +18,11 @@
 #include "livestatus/statehisttable.hpp"
 #include "livestatus/filter.hpp"
 #include "base/array.hpp"
+#include "base/configuration.hpp"
+#include "base/workqueue.hpp"
 #include "base/dictionary.hpp"
+#include <algorithm>
+#include <utility>
 #include <boost/algorithm/string/case_conv.hpp>
 
 using namespace icinga;
@@ -79,13 +83,25 @@ void Table::AddColumn(const String& name, const Column& column)
 		ret.first->second = column;
 }
 
-Column Table::GetColumn(const String& name) const
+/**
+ * Strips the table's prefix from a column name, e.g. "host_name" becomes "name".
+ *
+ * @param name The column's name
+ * @returns The column's name without the prefix
+ */
+String Table::GetColumnBaseName(const String& name) const
 {
-	String dname = name;
 	String prefix = GetPrefix() + "_";
 
-	if (dname.Find(prefix) == 0)
-		dname = dname.SubStr(prefix.GetLength());
+	if (name.Find(prefix) == 0)
+		return name.SubStr(prefix.GetLength());
+
+	return name;
+}
+
+Column Table::GetColumn(const String& name) const
+{
+	String dname = GetColumnBaseName(name);
 
 	auto it = m_Columns.find(dname);
 
@@ -95,6 +111,110 @@ Column Table::GetColumn(const String& name) const
 	return it->second;
 }
 
+/**
+ * Returns a column's value for a row. While a snapshot is active the values
+ * of the current row are taken from the snapshot.
+ *
+ * @param name The column's name
+ * @param row The row
+ * @returns The value
+ */
+Value Table::GetColumnValue(const String& name, const Value& row)
+{
+	if (!m_SnapshotRows || m_SnapshotRow >= m_SnapshotRows->size() || !IsSnapshotRow(row))
+		return GetColumn(name).ExtractValue(row);
+
+	return GetSnapshotColumn(name)[m_SnapshotRow];
+}
+
+/**
+ * Returns a column of the snapshot converted to numbers, e.g. for aggregating
+ * all of its values at once.
+ *
+ * @param name The column's name
+ * @returns The values, one for each row of the snapshot
+ */
+std::vector<double> Table::GetSnapshotNumbers(const String& name)
+{
+	const std::vector<Value>& values = GetSnapshotColumn(name);
+	std::vector<double> numbers;
+
+	numbers.reserve(values.size());
+
+	for (const Value& value : values)
+		numbers.push_back(value);
+
+	return numbers;
+}
+
+/**
+ * Returns a column of the snapshot, the reference is valid until the next
+ * column is computed.
+ */
+const std::vector<Value>& Table::GetSnapshotColumn(const String& name)
+{
+	for (auto& column : m_SnapshotColumns) {
+		if (column.first == name)
+			return column.second;
+	}
+
+	/* Compute the column for all rows at once, it will be needed for all of them anyway. */
+	Column column = GetColumn(name);
+	std::vector<Value> values;
+	values.reserve(m_SnapshotRows->size());
+
+	for (const LivestatusRowValue& rval : *m_SnapshotRows)
+		values.emplace_back(column.ExtractValue(rval.Row));
+
+	m_SnapshotColumns.emplace_back(name, std::move(values));
+
+	return m_SnapshotColumns.back().second;
+}
+
+/**
+ * Checks whether the row is the current row of the snapshot. Only rows which
+ * are objects (e.g. hosts and services) are compared, by identity.
+ */
+bool Table::IsSnapshotRow(const Value& row) const
+{
+	const Value& current = (*m_SnapshotRows)[m_SnapshotRow].Row;
+
+	return row.IsObject() && current.IsObject() && row.Get<Object::Ptr>() == current.Get<Object::Ptr>();
+}
+
+/**
+ * Starts a snapshot of the specified rows. Columns are stored as arrays of
+ * the values of all rows, each one is computed when it's accessed the first time.
+ * Filters and aggregators which are applied to the same columns of each
+ * row (e.g. "Stats: state = 0", "Stats: state = 1") share the values.
+ *
+ * The rows must not be modified until EndSnapshot() has been called.
+ *
+ * @param rows The rows
+ */
+void Table::BeginSnapshot(const std::vector<LivestatusRowValue>& rows)
+{
+	m_SnapshotRows = &rows;
+	m_SnapshotRow = 0;
+	m_SnapshotColumns.clear();
+}
+
+/**
+ * Sets the row which is processed next.
+ *
+ * @param index The row's index in the snapshot
+ */
+void Table::SetSnapshotRow(size_t index)
+{
+	m_SnapshotRow = index;
+}
+
+void Table::EndSnapshot()
+{
+	m_SnapshotRows = nullptr;
+	m_SnapshotColumns.clear();
+}
+
 std::vector<String> Table::GetColumnNames() const
 {
 	std::vector<String> names;
@@ -110,11 +230,97 @@ std::vector<LivestatusRowValue> Table::FilterRows(const Filter::Ptr& filter, int
 {
 	std::vector<LivestatusRowValue> rs;
 
+	/* Let the indexes narrow down the rows, e.g. for "Filter: host_name = foo". */
+	if (filter && GetGroupByType() == LivestatusGroupByNone) {
+		std::vector<Value> candidates;
+
+		if (filter->FindCandidateRows(this, candidates)) {
+			for (const Value& row : candidates) {
+				if (!FilteredAddRow(rs, filter, limit, row, LivestatusGroupByNone, nullptr))
+					break;
+			}
+
+			return rs;
+		}
+	}
+
+	/* Without a limit all rows have to be checked anyway. Fetching them is cheap,
+	 * so collect them first and evaluate the filter in parallel. */
+	if (filter && limit == -1 && Configuration::Concurrency > 1) {
+		FetchRows([&rs](const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject) {
+			LivestatusRowValue rval;
+			rval.Row = row;
+			rval.GroupByType = groupByType;
+			rval.GroupByObject = groupByObject;
+
+			rs.emplace_back(std::move(rval));
+
+			return true;
+		});
+
+		ParallelFilter(rs, filter);
+
+		return rs;
+	}
+
 	FetchRows(std::bind(&Table::FilteredAddRow, this, std::ref(rs), filter, limit, _1, _2, _3));
 
 	return rs;
 }
 
+/**
+ * Removes all rows which don't match the filter. Large result sets
+ * are split into chunks which are filtered in parallel.
+ *
+ * @param rs The rows
+ * @param filter The filter
+ */
+void Table::ParallelFilter(std::vector<LivestatusRowValue>& rs, const Filter::Ptr& filter)
+{
+	const size_t chunkSize = 1024;
+
+	std::vector<char> matches (rs.size(), 0);
+
+	if (rs.size() < chunkSize * 2) {
+		for (size_t i = 0; i < rs.size(); i++)
+			matches[i] = filter->Apply(this, rs[i].Row);
+	} else {
+		std::vector<std::pair<size_t, size_t> > chunks;
+
+		for (size_t offset = 0; offset < rs.size(); offset += chunkSize)
+			chunks.emplace_back(offset, std::min(offset + chunkSize, rs.size()));
+
+		WorkQueue upq(25000, Configuration::Concurrency);
+		upq.SetName("Table::FilterRows");
+
+		Table::Ptr self (this);
+
+		upq.ParallelFor(chunks, [self, &rs, &matches, &filter](const std::pair<size_t, size_t>& chunk) {
+			for (size_t i = chunk.first; i < chunk.second; i++)
+				matches[i] = filter->Apply(self, rs[i].Row);
+		});
+
+		upq.Join();
+
+		/* Report invalid filters to the client just like the sequential code path does. */
+		if (upq.HasExceptions())
+			boost::rethrow_exception(upq.GetExceptions()[0]);
+	}
+
+	size_t count = 0;
+
+	for (size_t i = 0; i < rs.size(); i++) {
+		if (matches[i]) {
+			if (count != i)
+				rs[count] = std::move(rs[i]);
+
+			count++;
+		}
+	}
+
+	rs.resize(count);
+}
+
 bool Table::FilteredAddRow(std::vector<LivestatusRowValue>& rs, const Filter::Ptr& filter, int limit, const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject)
 {
 	if (limit != -1 && static_cast<int>(rs.size()) == limit)
@@ -132,6 +338,26 @@ bool Table::FilteredAddRow(std::vector<LivestatusRowValue>& rs, const Filter::Pt
 	return true;
 }
 
+/**
+ * Finds the rows which may have the specified value using an index.
+ * Tables without indexes don't support any lookups.
+ *
+ * @param column The column's name
+ * @param op The filter's operator
+ * @param operand The filter's operand
+ * @param rows Receives the rows, which are Objects
+ * @returns false if there's no index for the column and operator
+ */
+bool Table::LookupRows(const String& column, const String& op, const String& operand, std::vector<Value>& rows)
+{
+	(void)column;
+	(void)op;
+	(void)operand;
+	(void)rows;
+
+	return false;
+}
+
 Value Table::ZeroAccessor(const Value&)
 {
 	return 0;
@@ -44,11 +44,22 @@ public:
 	Column GetColumn(const String& name) const;
 	std::vector<String> GetColumnNames() const;
 
+	Value GetColumnValue(const String& name, const Value& row);
+
+	virtual bool LookupRows(const String& column, const String& op, const String& operand, std::vector<Value>& rows);
+
+	void BeginSnapshot(const std::vector<LivestatusRowValue>& rows);
+	void SetSnapshotRow(size_t index);
+	void EndSnapshot();
+	std::vector<double> GetSnapshotNumbers(const String& name);
+
 	LivestatusGroupByType GetGroupByType() const;
 
 protected:
 	Table(LivestatusGroupByType type = LivestatusGroupByNone);
 
+	String GetColumnBaseName(const String& name) const;
+
 	virtual void FetchRows(const AddRowFunction& addRowFn) = 0;
 
 	static Value ZeroAccessor(const Value&);
@@ -63,7 +74,15 @@ protected:
 private:
 	std::map<String, Column> m_Columns;
 
+	/* Column values of all rows, see BeginSnapshot() */
+	const std::vector<LivestatusRowValue> *m_SnapshotRows{nullptr};
+	size_t m_SnapshotRow{0};
+	std::vector<std::pair<String, std::vector<Value> > > m_SnapshotColumns;
+
 	bool FilteredAddRow(std::vector<LivestatusRowValue>& rs, const intrusive_ptr<Filter>& filter, int limit, const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject);
+	void ParallelFilter(std::vector<LivestatusRowValue>& rs, const intrusive_ptr<Filter>& filter);
+	bool IsSnapshotRow(const Value& row) const;
+	const std::vector<Value>& GetSnapshotColumn(const String& name);
 };
 
 }
@@ -4,6 +4,7 @@
 #include "icinga/cib.hpp"
 #include "icinga/service.hpp"
 #include "icinga/checkcommand.hpp"
+#include "icinga/eventcommand.hpp"
 #include "icinga/macroprocessor.hpp"
 #include "icinga/icingaapplication.hpp"
 #include "icinga/clusterevents.hpp"
@@ -81,6 +82,9 @@ void IcingaCheckTask::ScriptFunc(const Checkable::Ptr& checkable, const CheckRes
 
 	perfdata->Add(new PerfdataValue("current_pending_callbacks", Application::GetTP().GetPending()));
 	perfdata->Add(new PerfdataValue("current_concurrent_checks", Checkable::CurrentConcurrentChecks.load()));
+	perfdata->Add(new PerfdataValue("current_running_event_handlers", EventCommand::CurrentRunningExecutions.load()));
+	perfdata->Add(new PerfdataValue("current_pending_event_handlers", EventCommand::CurrentPendingExecutions.load()));
+	perfdata->Add(new PerfdataValue("coalesced_event_handlers", EventCommand::CoalescedExecutions.load(), true));
 	perfdata->Add(new PerfdataValue("remote_check_queue", ClusterEvents::GetCheckRequestQueueSize()));
 
 	CheckableCheckStatistics scs = CIB::CalculateServiceCheckStats();
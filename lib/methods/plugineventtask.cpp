@@ -11,6 +11,7 @@
 #include "base/utility.hpp"
 #include "base/process.hpp"
 #include "base/convert.hpp"
+#include "base/defer.hpp"
 
 using namespace icinga;
 
@@ -47,8 +48,26 @@ void PluginEventTask::ScriptFunc(const Checkable::Ptr& checkable,
 		callback = std::bind(&PluginEventTask::ProcessFinishedHandler, checkable, _1, _2);
 	}
 
-	PluginUtility::ExecuteCommand(commandObj, checkable, checkable->GetLastCheckResult(),
-		resolvers, resolvedMacros, useResolvedMacros, timeout, callback);
+	/* A queued execution is done once the process has finished, see EventCommand::Enqueue(). */
+	std::function<void ()> finished;
+	finished.swap(EventCommand::ExecutionFinished);
+
+	if (finished) {
+		callback = [callback, finished](const Value& commandLine, const ProcessResult& pr) {
+			Defer finish (finished);
+			callback(commandLine, pr);
+		};
+	}
+
+	try {
+		PluginUtility::ExecuteCommand(commandObj, checkable, checkable->GetLastCheckResult(),
+			resolvers, resolvedMacros, useResolvedMacros, timeout, callback);
+	} catch (...) {
+		if (finished)
+			finished();
+
+		throw;
+	}
 }
 
 void PluginEventTask::ProcessFinishedHandler(const Checkable::Ptr& checkable, const Value& commandLine, const ProcessResult& pr)
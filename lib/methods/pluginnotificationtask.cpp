@@ -12,11 +12,43 @@
 #include "base/utility.hpp"
 #include "base/process.hpp"
 #include "base/convert.hpp"
+#include "base/json.hpp"
+#include "base/timer.hpp"
+#include <boost/thread/once.hpp>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 using namespace icinga;
 
 REGISTER_FUNCTION_NONCONST(Internal, PluginNotification, &PluginNotificationTask::ScriptFunc, "notification:user:cr:itype:author:comment:resolvedMacros:useResolvedMacros");
 
+/**
+ * The notifications for a user which wait for the batch_interval of their command.
+ * The first one's macros are used for the command line, all of them are
+ * passed as "$notification.batch$".
+ */
+struct NotificationBatch
+{
+	NotificationCommand::Ptr Command;
+	Notification::Ptr FirstNotification;
+	User::Ptr NotifiedUser;
+	CheckResult::Ptr CR;
+	NotificationType Type;
+	String Author;
+	String Comment;
+	double Due;
+	ArrayData Entries;
+};
+
+/* Keeps the payload below the usual limit for a single argument or environment variable. */
+static const size_t l_MaxBatchSize = 100;
+
+static std::mutex l_BatchesMutex;
+static std::map<std::pair<String, String>, NotificationBatch> l_Batches;
+static Timer::Ptr l_BatchTimer;
+
 void PluginNotificationTask::ScriptFunc(const Notification::Ptr& notification,
 	const User::Ptr& user, const CheckResult::Ptr& cr, int itype,
 	const String& author, const String& comment, const Dictionary::Ptr& resolvedMacros,
@@ -29,6 +61,21 @@ void PluginNotificationTask::ScriptFunc(const Notification::Ptr& notification,
 
 	auto type = static_cast<NotificationType>(itype);
 
+	/* Notifications executed on behalf of others (command endpoints, the API) aren't delayed. */
+	if (commandObj->GetBatchInterval() > 0 && !resolvedMacros && !NotificationCommand::ExecuteOverride
+		&& !Checkable::ExecuteCommandProcessFinishedHandler) {
+		AddToBatch(commandObj, notification, user, cr, type, author, comment);
+		return;
+	}
+
+	ExecuteNotificationCommand(commandObj, notification, user, cr, type, author, comment, nullptr, resolvedMacros, useResolvedMacros);
+}
+
+void PluginNotificationTask::ExecuteNotificationCommand(const NotificationCommand::Ptr& commandObj,
+	const Notification::Ptr& notification, const User::Ptr& user, const CheckResult::Ptr& cr,
+	NotificationType type, const String& author, const String& comment, const Array::Ptr& batch,
+	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros)
+{
 	Checkable::Ptr checkable = notification->GetCheckable();
 
 	Dictionary::Ptr notificationExtra = new Dictionary({
@@ -37,6 +84,11 @@ void PluginNotificationTask::ScriptFunc(const Notification::Ptr& notification,
 		{ "comment", comment }
 	});
 
+	if (batch) {
+		notificationExtra->Set("batch", JsonEncode(batch));
+		notificationExtra->Set("batch_count", batch->GetLength());
+	}
+
 	Host::Ptr host;
 	Service::Ptr service;
 	tie(host, service) = GetHostService(checkable);
@@ -68,6 +120,114 @@ void PluginNotificationTask::ScriptFunc(const Notification::Ptr& notification,
 		resolvedMacros, useResolvedMacros, timeout, callback);
 }
 
+/**
+ * Delays a notification until the command's batch_interval has passed since
+ * the first pending one for the same user, then all of them are sent at once.
+ */
+void PluginNotificationTask::AddToBatch(const NotificationCommand::Ptr& commandObj,
+	const Notification::Ptr& notification, const User::Ptr& user, const CheckResult::Ptr& cr,
+	NotificationType type, const String& author, const String& comment)
+{
+	static boost::once_flag once = BOOST_ONCE_INIT;
+
+	boost::call_once(once, []() {
+		l_BatchTimer = new Timer();
+		l_BatchTimer->SetInterval(1);
+		l_BatchTimer->OnTimerExpired.connect([](const Timer * const&) { FlushBatches(); });
+		l_BatchTimer->Start();
+	});
+
+	Checkable::Ptr checkable = notification->GetCheckable();
+
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	Dictionary::Ptr entry = new Dictionary({
+		{ "notification", notification->GetName() },
+		{ "type", Notification::NotificationTypeToStringCompat(type) },
+		{ "author", author },
+		{ "comment", comment },
+		{ "host", host->GetName() },
+		{ "host_display_name", host->GetDisplayName() },
+		{ "state", service ? Service::StateToString(service->GetState()) : Host::StateToString(host->GetState()) },
+		{ "output", cr ? cr->GetOutput() : "" },
+		{ "timestamp", Utility::GetTime() }
+	});
+
+	if (service) {
+		entry->Set("service", service->GetShortName());
+		entry->Set("service_display_name", service->GetDisplayName());
+	}
+
+	NotificationBatch full;
+
+	{
+		std::unique_lock<std::mutex> lock (l_BatchesMutex);
+		auto key (std::make_pair(commandObj->GetName(), user->GetName()));
+		auto it (l_Batches.find(key));
+
+		if (it == l_Batches.end()) {
+			NotificationBatch batch;
+			batch.Command = commandObj;
+			batch.FirstNotification = notification;
+			batch.NotifiedUser = user;
+			batch.CR = cr;
+			batch.Type = type;
+			batch.Author = author;
+			batch.Comment = comment;
+			batch.Due = Utility::GetTime() + commandObj->GetBatchInterval();
+
+			it = l_Batches.emplace(key, std::move(batch)).first;
+		}
+
+		it->second.Entries.emplace_back(entry);
+
+		if (it->second.Entries.size() < l_MaxBatchSize)
+			return;
+
+		full = std::move(it->second);
+		l_Batches.erase(it);
+	}
+
+	ExecuteNotificationCommand(full.Command, full.FirstNotification, full.NotifiedUser, full.CR, full.Type,
+		full.Author, full.Comment, new Array(std::move(full.Entries)), nullptr, false);
+}
+
+void PluginNotificationTask::FlushBatches()
+{
+	std::vector<NotificationBatch> due;
+
+	{
+		std::unique_lock<std::mutex> lock (l_BatchesMutex);
+		double now = Utility::GetTime();
+
+		for (auto it (l_Batches.begin()); it != l_Batches.end();) {
+			if (it->second.Due <= now) {
+				due.emplace_back(std::move(it->second));
+				it = l_Batches.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	for (auto& batch : due) {
+		Log(LogInformation, "PluginNotificationTask")
+			<< "Sending " << batch.Entries.size() << " batched notification(s) to user '"
+			<< batch.NotifiedUser->GetName() << "' using command '" << batch.Command->GetName() << "'.";
+
+		try {
+			ExecuteNotificationCommand(batch.Command, batch.FirstNotification, batch.NotifiedUser, batch.CR, batch.Type,
+				batch.Author, batch.Comment, new Array(std::move(batch.Entries)), nullptr, false);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "PluginNotificationTask")
+				<< "Exception occurred during batched notification for user '" << batch.NotifiedUser->GetName()
+				<< "' using command '" << batch.Command->GetName() << "': " << DiagnosticInformation(ex, false);
+		}
+	}
+}
+
 void PluginNotificationTask::ProcessFinishedHandler(const Checkable::Ptr& checkable, const Value& commandLine, const ProcessResult& pr)
 {
 	if (pr.ExitStatus != 0) {
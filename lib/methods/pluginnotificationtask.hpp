@@ -5,6 +5,7 @@
 
 #include "methods/i2-methods.hpp"
 #include "icinga/notification.hpp"
+#include "icinga/notificationcommand.hpp"
 #include "icinga/service.hpp"
 #include "base/process.hpp"
 
@@ -29,6 +30,16 @@ private:
 
 	static void ProcessFinishedHandler(const Checkable::Ptr& checkable,
 		const Value& commandLine, const ProcessResult& pr);
+
+	static void ExecuteNotificationCommand(const NotificationCommand::Ptr& commandObj,
+		const Notification::Ptr& notification, const User::Ptr& user, const CheckResult::Ptr& cr,
+		NotificationType type, const String& author, const String& comment, const Array::Ptr& batch,
+		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros);
+
+	static void AddToBatch(const NotificationCommand::Ptr& commandObj,
+		const Notification::Ptr& notification, const User::Ptr& user, const CheckResult::Ptr& cr,
+		NotificationType type, const String& author, const String& comment);
+	static void FlushBatches();
 };
 
 }
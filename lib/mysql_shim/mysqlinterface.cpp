@@ -97,6 +97,41 @@ struct MysqlInterfaceImpl final : public MysqlInterface
 		return mysql_ssl_set(mysql, key, cert, ca, capath, cipher);
 	}
 
+	my_ulonglong stmt_affected_rows(MYSQL_STMT *stmt) const override
+	{
+		return mysql_stmt_affected_rows(stmt);
+	}
+
+	bool stmt_bind_param(MYSQL_STMT *stmt, MYSQL_BIND *bnd) const override
+	{
+		return mysql_stmt_bind_param(stmt, bnd);
+	}
+
+	bool stmt_close(MYSQL_STMT *stmt) const override
+	{
+		return mysql_stmt_close(stmt);
+	}
+
+	const char *stmt_error(MYSQL_STMT *stmt) const override
+	{
+		return mysql_stmt_error(stmt);
+	}
+
+	int stmt_execute(MYSQL_STMT *stmt) const override
+	{
+		return mysql_stmt_execute(stmt);
+	}
+
+	MYSQL_STMT *stmt_init(MYSQL *mysql) const override
+	{
+		return mysql_stmt_init(mysql);
+	}
+
+	int stmt_prepare(MYSQL_STMT *stmt, const char *query, unsigned long length) const override
+	{
+		return mysql_stmt_prepare(stmt, query, length);
+	}
+
 	MYSQL_RES *store_result(MYSQL *mysql) const override
 	{
 		return mysql_store_result(mysql);
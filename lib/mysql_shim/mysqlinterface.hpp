@@ -36,6 +36,13 @@ struct MysqlInterface
 		const char *db, unsigned int port, const char *unix_socket, unsigned long clientflag) const = 0;
 	virtual unsigned long real_escape_string(MYSQL *mysql, char *to, const char *from, unsigned long length) const = 0;
 	virtual bool ssl_set(MYSQL *mysql, const char *key, const char *cert, const char *ca, const char *capath, const char *cipher) const = 0;
+	virtual my_ulonglong stmt_affected_rows(MYSQL_STMT *stmt) const = 0;
+	virtual bool stmt_bind_param(MYSQL_STMT *stmt, MYSQL_BIND *bnd) const = 0;
+	virtual bool stmt_close(MYSQL_STMT *stmt) const = 0;
+	virtual const char *stmt_error(MYSQL_STMT *stmt) const = 0;
+	virtual int stmt_execute(MYSQL_STMT *stmt) const = 0;
+	virtual MYSQL_STMT *stmt_init(MYSQL *mysql) const = 0;
+	virtual int stmt_prepare(MYSQL_STMT *stmt, const char *query, unsigned long length) const = 0;
 	virtual MYSQL_RES *store_result(MYSQL *mysql) const = 0;
 	virtual unsigned int thread_safe() const = 0;
 
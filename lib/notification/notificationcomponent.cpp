@@ -42,6 +42,26 @@ void NotificationComponent::Start(bool runtimeCreated)
 	Checkable::OnNotificationsRequested.connect(std::bind(&NotificationComponent::SendNotificationsHandler, this, _1,
 		_2, _3, _4, _5));
 
+	/* Keep the reminder queue up to date, ProcessNotification() isn't the only one changing these. */
+	Notification::OnNextNotificationChanged.connect(std::bind(&NotificationComponent::RequeueNotification, this, _1));
+	Notification::OnIntervalChanged.connect(std::bind(&NotificationComponent::RequeueNotification, this, _1));
+	Notification::OnNoMoreNotificationsChanged.connect(std::bind(&NotificationComponent::RequeueNotification, this, _1));
+	Notification::OnSuppressedNotificationsChanged.connect(std::bind(&NotificationComponent::RequeueNotification, this, _1));
+
+	ConfigObject::OnActiveChanged.connect([this](const ConfigObject::Ptr& object, const Value&) {
+		auto notification (dynamic_pointer_cast<Notification>(object));
+
+		if (notification)
+			RequeueNotification(notification);
+	});
+
+	ConfigObject::OnPausedChanged.connect([this](const ConfigObject::Ptr& object, const Value&) {
+		auto notification (dynamic_pointer_cast<Notification>(object));
+
+		if (notification)
+			RequeueNotification(notification);
+	});
+
 	m_NotificationTimer = new Timer();
 	m_NotificationTimer->SetInterval(5);
 	m_NotificationTimer->OnTimerExpired.connect(std::bind(&NotificationComponent::NotificationTimerHandler, this));
@@ -122,6 +142,11 @@ void FireSuppressedNotifications(const Notification::Ptr& notification)
 /**
  * Periodically sends notifications.
  *
+ * Only notifications which are due for a reminder or have stashed or
+ * suppressed notifications are looked at. Until the object authority has
+ * been updated, notifications may be stashed without anybody noticing, so
+ * all notifications are scanned.
+ *
  * @param - Event arguments for the timer.
  */
 void NotificationComponent::NotificationTimerHandler()
@@ -131,126 +156,197 @@ void NotificationComponent::NotificationTimerHandler()
 	/* Function already checks whether 'api' feature is enabled. */
 	Endpoint::Ptr myEndpoint = Endpoint::GetLocalEndpoint();
 
-	for (const Notification::Ptr& notification : ConfigType::GetObjectsByType<Notification>()) {
+	std::set<Notification::Ptr> notifications;
+
+	if (m_FullScan) {
+		m_FullScan = !ApiListener::UpdatedObjectAuthority();
+
+		for (Notification *notification : ConfigType::GetObjectsView<Notification>())
+			notifications.insert(notification);
+	} else {
+		std::unique_lock<std::mutex> lock (m_QueueMutex);
+
+		notifications.swap(m_PendingNotifications);
+
+		while (!m_DueNotifications.empty() && m_DueNotifications.begin()->first <= now) {
+			auto notification (m_DueNotifications.begin()->second);
+
+			m_DueNotifications.erase(m_DueNotifications.begin());
+			m_DueTimes.erase(notification);
+			notifications.insert(std::move(notification));
+		}
+	}
+
+	for (const Notification::Ptr& notification : notifications) {
 		if (!notification->IsActive())
 			continue;
 
-		String notificationName = notification->GetName();
-		bool updatedObjectAuthority = ApiListener::UpdatedObjectAuthority();
-
-		/* Skip notification if paused, in a cluster setup & HA feature is enabled. */
-		if (notification->IsPaused()) {
-			if (updatedObjectAuthority) {
-				auto stashedNotifications (notification->GetStashedNotifications());
-				ObjectLock olock(stashedNotifications);
+		ProcessNotification(notification, now, myEndpoint);
+		RequeueNotification(notification);
+	}
+}
 
-				if (stashedNotifications->GetLength()) {
-					Log(LogNotice, "NotificationComponent")
-						<< "Notification '" << notificationName << "': HA cluster active, this endpoint does not have the authority. Dropping all stashed notifications.";
+void NotificationComponent::ProcessNotification(const Notification::Ptr& notification, double now, const Endpoint::Ptr& myEndpoint)
+{
+	String notificationName = notification->GetName();
+	bool updatedObjectAuthority = ApiListener::UpdatedObjectAuthority();
 
-					stashedNotifications->Clear();
-				}
-			}
+	/* Skip notification if paused, in a cluster setup & HA feature is enabled. */
+	if (notification->IsPaused()) {
+		if (updatedObjectAuthority) {
+			auto stashedNotifications (notification->GetStashedNotifications());
+			ObjectLock olock(stashedNotifications);
 
-			if (myEndpoint && GetEnableHA()) {
+			if (stashedNotifications->GetLength()) {
 				Log(LogNotice, "NotificationComponent")
-					<< "Reminder notification '" << notificationName << "': HA cluster active, this endpoint does not have the authority (paused=true). Skipping.";
-				continue;
+					<< "Notification '" << notificationName << "': HA cluster active, this endpoint does not have the authority. Dropping all stashed notifications.";
+
+				stashedNotifications->Clear();
+				notification->MarkStateDirty();
 			}
 		}
 
-		Checkable::Ptr checkable = notification->GetCheckable();
+		if (myEndpoint && GetEnableHA()) {
+			Log(LogNotice, "NotificationComponent")
+				<< "Reminder notification '" << notificationName << "': HA cluster active, this endpoint does not have the authority (paused=true). Skipping.";
+			return;
+		}
+	}
 
-		if (!IcingaApplication::GetInstance()->GetEnableNotifications() || !checkable->GetEnableNotifications())
-			continue;
+	Checkable::Ptr checkable = notification->GetCheckable();
+
+	if (!IcingaApplication::GetInstance()->GetEnableNotifications() || !checkable->GetEnableNotifications())
+		return;
 
-		bool reachable = checkable->IsReachable(DependencyNotification);
+	bool reachable = checkable->IsReachable(DependencyNotification);
 
-		if (reachable) {
-			{
-				Array::Ptr unstashedNotifications = new Array();
+	if (reachable) {
+		{
+			Array::Ptr unstashedNotifications = new Array();
 
-				{
-					auto stashedNotifications (notification->GetStashedNotifications());
-					ObjectLock olock(stashedNotifications);
+			{
+				auto stashedNotifications (notification->GetStashedNotifications());
+				ObjectLock olock(stashedNotifications);
 
+				if (stashedNotifications->GetLength()) {
 					stashedNotifications->CopyTo(unstashedNotifications);
 					stashedNotifications->Clear();
+					notification->MarkStateDirty();
 				}
+			}
 
-				ObjectLock olock(unstashedNotifications);
-
-				for (Dictionary::Ptr unstashedNotification : unstashedNotifications) {
-					try {
-						Log(LogNotice, "NotificationComponent")
-							<< "Attempting to send stashed notification '" << notificationName << "'.";
-
-						notification->BeginExecuteNotification(
-							(NotificationType)(int)unstashedNotification->Get("type"),
-							(CheckResult::Ptr)unstashedNotification->Get("cr"),
-							(bool)unstashedNotification->Get("force"),
-							(bool)unstashedNotification->Get("reminder"),
-							(String)unstashedNotification->Get("author"),
-							(String)unstashedNotification->Get("text")
-						);
-					} catch (const std::exception& ex) {
-						Log(LogWarning, "NotificationComponent")
-							<< "Exception occurred during notification for object '"
-							<< notificationName << "': " << DiagnosticInformation(ex, false);
-					}
+			ObjectLock olock(unstashedNotifications);
+
+			for (Dictionary::Ptr unstashedNotification : unstashedNotifications) {
+				try {
+					Log(LogNotice, "NotificationComponent")
+						<< "Attempting to send stashed notification '" << notificationName << "'.";
+
+					notification->BeginExecuteNotification(
+						(NotificationType)(int)unstashedNotification->Get("type"),
+						(CheckResult::Ptr)unstashedNotification->Get("cr"),
+						(bool)unstashedNotification->Get("force"),
+						(bool)unstashedNotification->Get("reminder"),
+						(String)unstashedNotification->Get("author"),
+						(String)unstashedNotification->Get("text")
+					);
+				} catch (const std::exception& ex) {
+					Log(LogWarning, "NotificationComponent")
+						<< "Exception occurred during notification for object '"
+						<< notificationName << "': " << DiagnosticInformation(ex, false);
 				}
 			}
-
-			FireSuppressedNotifications(notification);
 		}
 
-		if (notification->GetInterval() <= 0 && notification->GetNoMoreNotifications()) {
-			Log(LogNotice, "NotificationComponent")
-				<< "Reminder notification '" << notificationName << "': Notification was sent out once and interval=0 disables reminder notifications.";
-			continue;
-		}
+		FireSuppressedNotifications(notification);
+	}
 
-		if (notification->GetNextNotification() > now)
-			continue;
+	if (notification->GetInterval() <= 0 && notification->GetNoMoreNotifications()) {
+		Log(LogNotice, "NotificationComponent")
+			<< "Reminder notification '" << notificationName << "': Notification was sent out once and interval=0 disables reminder notifications.";
+		return;
+	}
 
-		{
-			ObjectLock olock(notification);
-			notification->SetNextNotification(Utility::GetTime() + notification->GetInterval());
-		}
+	if (notification->GetNextNotification() > now)
+		return;
 
-		{
-			Host::Ptr host;
-			Service::Ptr service;
-			tie(host, service) = GetHostService(checkable);
+	{
+		ObjectLock olock(notification);
+		notification->SetNextNotification(Utility::GetTime() + notification->GetInterval());
+	}
 
-			ObjectLock olock(checkable);
+	{
+		Host::Ptr host;
+		Service::Ptr service;
+		tie(host, service) = GetHostService(checkable);
 
-			if (checkable->GetStateType() == StateTypeSoft)
-				continue;
+		ObjectLock olock(checkable);
 
-			/* Don't send reminder notifications for OK/Up states. */
-			if ((service && service->GetState() == ServiceOK) || (!service && host->GetState() == HostUp))
-				continue;
+		if (checkable->GetStateType() == StateTypeSoft)
+			return;
 
-			/* Don't send reminder notifications before initial ones. */
-			if (checkable->GetSuppressedNotifications() & NotificationProblem)
-				continue;
+		/* Don't send reminder notifications for OK/Up states. */
+		if ((service && service->GetState() == ServiceOK) || (!service && host->GetState() == HostUp))
+			return;
 
-			/* Skip in runtime filters. */
-			if (!reachable || checkable->IsInDowntime() || checkable->IsAcknowledged() || checkable->IsFlapping())
-				continue;
-		}
+		/* Don't send reminder notifications before initial ones. */
+		if (checkable->GetSuppressedNotifications() & NotificationProblem)
+			return;
 
-		try {
-			Log(LogNotice, "NotificationComponent")
-				<< "Attempting to send reminder notification '" << notificationName << "'.";
+		/* Skip in runtime filters. */
+		if (!reachable || checkable->IsInDowntime() || checkable->IsAcknowledged() || checkable->IsFlapping())
+			return;
+	}
 
-			notification->BeginExecuteNotification(NotificationProblem, checkable->GetLastCheckResult(), false, true);
-		} catch (const std::exception& ex) {
-			Log(LogWarning, "NotificationComponent")
-				<< "Exception occurred during notification for object '"
-				<< notificationName << "': " << DiagnosticInformation(ex, false);
-		}
+	try {
+		Log(LogNotice, "NotificationComponent")
+			<< "Attempting to send reminder notification '" << notificationName << "'.";
+
+		notification->BeginExecuteNotification(NotificationProblem, checkable->GetLastCheckResult(), false, true);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "NotificationComponent")
+			<< "Exception occurred during notification for object '"
+			<< notificationName << "': " << DiagnosticInformation(ex, false);
+	}
+}
+
+/**
+ * Makes sure the next tick looks at a notification if it has stashed or
+ * suppressed notifications, and queues it for its next reminder.
+ *
+ * @param notification The notification.
+ */
+void NotificationComponent::RequeueNotification(const Notification::Ptr& notification)
+{
+	if (!notification->IsActive())
+		return;
+
+	/* Paused notifications are requeued once they're resumed. */
+	if (notification->IsPaused() && Endpoint::GetLocalEndpoint() && GetEnableHA())
+		return;
+
+	bool pending = notification->GetSuppressedNotifications() || notification->GetStashedNotifications()->GetLength();
+	bool reminders = notification->GetInterval() > 0 || !notification->GetNoMoreNotifications();
+	double next = notification->GetNextNotification();
+
+	std::unique_lock<std::mutex> lock (m_QueueMutex);
+
+	if (pending)
+		m_PendingNotifications.insert(notification);
+
+	auto due (m_DueTimes.find(notification));
+
+	if (due != m_DueTimes.end()) {
+		if (reminders && due->second == next)
+			return;
+
+		m_DueNotifications.erase(std::make_pair(due->second, notification));
+		m_DueTimes.erase(due);
+	}
+
+	if (reminders) {
+		m_DueNotifications.emplace(next, notification);
+		m_DueTimes.emplace(notification, next);
 	}
 }
 
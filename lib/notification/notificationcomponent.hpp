@@ -7,6 +7,9 @@
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/timer.hpp"
+#include <map>
+#include <mutex>
+#include <set>
 
 namespace icinga
 {
@@ -28,7 +31,15 @@ public:
 private:
 	Timer::Ptr m_NotificationTimer;
 
+	std::mutex m_QueueMutex;
+	std::set<std::pair<double, Notification::Ptr> > m_DueNotifications;
+	std::map<Notification::Ptr, double> m_DueTimes;
+	std::set<Notification::Ptr> m_PendingNotifications;
+	bool m_FullScan{true};
+
 	void NotificationTimerHandler();
+	void ProcessNotification(const Notification::Ptr& notification, double now, const Endpoint::Ptr& myEndpoint);
+	void RequeueNotification(const Notification::Ptr& notification);
 	void SendNotificationsHandler(const Checkable::Ptr& checkable, NotificationType type,
 		const CheckResult::Ptr& cr, const String& author, const String& text);
 };
@@ -3,6 +3,7 @@
 #include "perfdata/elasticsearchwriter.hpp"
 #include "perfdata/elasticsearchwriter-ti.cpp"
 #include "remote/url.hpp"
+#include "remote/messagecompression.hpp"
 #include "icinga/compatutility.hpp"
 #include "icinga/service.hpp"
 #include "icinga/checkcommand.hpp"
@@ -87,6 +88,16 @@ void ElasticsearchWriter::Resume()
 
 	m_WorkQueue.SetExceptionCallback(std::bind(&ElasticsearchWriter::ExceptionHandler, this, _1));
 
+	/* The spool is kept while paused, a new one would replay what's been replayed already. */
+	if (GetEnableSpool() && !m_Spool) {
+		try {
+			m_Spool = new PerfdataSpool(PerfdataSpool::GetWriterPath("ElasticsearchWriter", GetName()));
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "ElasticsearchWriter")
+				<< "Cannot open spool for '" << GetName() << "', data will be dropped while Elasticsearch isn't available: " << DiagnosticInformation(ex, false);
+		}
+	}
+
 	/* Setup timer for periodically flushing m_DataBuffer */
 	m_FlushTimer = new Timer();
 	m_FlushTimer->SetInterval(GetFlushInterval());
@@ -103,9 +114,18 @@ void ElasticsearchWriter::Resume()
 /* Pause is equivalent to Stop, but with HA capabilities to resume at runtime. */
 void ElasticsearchWriter::Pause()
 {
-	Flush();
+	{
+		std::unique_lock<std::mutex> lock(m_DataBufferMutex);
+		Flush();
+	}
+
 	m_WorkQueue.Join();
-	Flush();
+
+	{
+		std::unique_lock<std::mutex> lock(m_DataBufferMutex);
+		Flush();
+		Disconnect();
+	}
 
 	Log(LogInformation, "ElasticsearchWriter")
 		<< "'" << GetName() << "' paused.";
@@ -137,51 +157,42 @@ void ElasticsearchWriter::AddCheckResult(const Dictionary::Ptr& fields, const Ch
 	if (!GetEnableSendPerfdata())
 		return;
 
-	Array::Ptr perfdata = cr->GetPerformanceData();
+	auto perfdata (cr->GetParsedPerformanceData());
 
 	CheckCommand::Ptr checkCommand = checkable->GetCheckCommand();
 
-	if (perfdata) {
-		ObjectLock olock(perfdata);
-		for (const Value& val : perfdata) {
-			PerfdataValue::Ptr pdv;
-
-			if (val.IsObjectType<PerfdataValue>())
-				pdv = val;
-			else {
-				try {
-					pdv = PerfdataValue::Parse(val);
-				} catch (const std::exception&) {
-					Log(LogWarning, "ElasticsearchWriter")
-						<< "Ignoring invalid perfdata for checkable '"
-						<< checkable->GetName() << "' and command '"
-						<< checkCommand->GetName() << "' with value: " << val;
-					continue;
-				}
-			}
+	for (auto& entry : *perfdata) {
+		const PerfdataValue::Ptr& pdv = entry.Parsed;
 
-			String escapedKey = pdv->GetLabel();
-			boost::replace_all(escapedKey, " ", "_");
-			boost::replace_all(escapedKey, ".", "_");
-			boost::replace_all(escapedKey, "\\", "_");
-			boost::algorithm::replace_all(escapedKey, "::", ".");
+		if (!pdv) {
+			Log(LogWarning, "ElasticsearchWriter")
+				<< "Ignoring invalid perfdata for checkable '"
+				<< checkable->GetName() << "' and command '"
+				<< checkCommand->GetName() << "' with value: " << entry.Raw;
+			continue;
+		}
 
-			String perfdataPrefix = prefix + "perfdata." + escapedKey;
+		String escapedKey = pdv->GetLabel();
+		boost::replace_all(escapedKey, " ", "_");
+		boost::replace_all(escapedKey, ".", "_");
+		boost::replace_all(escapedKey, "\\", "_");
+		boost::algorithm::replace_all(escapedKey, "::", ".");
 
-			fields->Set(perfdataPrefix + ".value", pdv->GetValue());
+		String perfdataPrefix = prefix + "perfdata." + escapedKey;
 
-			if (!pdv->GetMin().IsEmpty())
-				fields->Set(perfdataPrefix + ".min", pdv->GetMin());
-			if (!pdv->GetMax().IsEmpty())
-				fields->Set(perfdataPrefix + ".max", pdv->GetMax());
-			if (!pdv->GetWarn().IsEmpty())
-				fields->Set(perfdataPrefix + ".warn", pdv->GetWarn());
-			if (!pdv->GetCrit().IsEmpty())
-				fields->Set(perfdataPrefix + ".crit", pdv->GetCrit());
+		fields->Set(perfdataPrefix + ".value", pdv->GetValue());
 
-			if (!pdv->GetUnit().IsEmpty())
-				fields->Set(perfdataPrefix + ".unit", pdv->GetUnit());
-		}
+		if (!pdv->GetMin().IsEmpty())
+			fields->Set(perfdataPrefix + ".min", pdv->GetMin());
+		if (!pdv->GetMax().IsEmpty())
+			fields->Set(perfdataPrefix + ".max", pdv->GetMax());
+		if (!pdv->GetWarn().IsEmpty())
+			fields->Set(perfdataPrefix + ".warn", pdv->GetWarn());
+		if (!pdv->GetCrit().IsEmpty())
+			fields->Set(perfdataPrefix + ".crit", pdv->GetCrit());
+
+		if (!pdv->GetUnit().IsEmpty())
+			fields->Set(perfdataPrefix + ".unit", pdv->GetUnit());
 	}
 }
 
@@ -405,6 +416,8 @@ void ElasticsearchWriter::FlushTimeout()
 		Log(LogDebug, "ElasticsearchWriter")
 			<< "Timer expired writing " << m_DataBuffer.size() << " data points";
 		Flush();
+	} else if (m_Spool) {
+		ReplaySpool();
 	}
 }
 
@@ -425,10 +438,54 @@ void ElasticsearchWriter::Flush()
 	 */
 	body += "\n";
 
-	SendRequest(body);
+	if (!m_Spool) {
+		SendRequest(body);
+		return;
+	}
+
+	/* Spool the data if Elasticsearch isn't available, the spool is replayed once it is. */
+	try {
+		if (!SendRequest(body)) {
+			m_Spool->Append(body);
+			return;
+		}
+	} catch (const std::exception&) {
+		m_Spool->Append(body);
+		throw;
+	}
+
+	ReplaySpool();
 }
 
-void ElasticsearchWriter::SendRequest(const String& body)
+/**
+ * Sends a chunk of the spooled bulk requests to Elasticsearch.
+ */
+void ElasticsearchWriter::ReplaySpool()
+{
+	if (m_Spool->IsEmpty())
+		return;
+
+	size_t count = m_Spool->Replay(PerfdataSpool::ReplayChunkSize, [this](const String& body) {
+		try {
+			return SendRequest(body);
+		} catch (const std::exception&) {
+			return false;
+		}
+	});
+
+	if (count > 0) {
+		Log(LogInformation, "ElasticsearchWriter")
+			<< "Replayed " << count << " spooled bulk requests to Elasticsearch, " << m_Spool->GetSize() << " bytes left.";
+	}
+}
+
+/**
+ * Sends a bulk request to Elasticsearch.
+ *
+ * @param body The bulk request body.
+ * @returns false if Elasticsearch isn't available and sending should be retried later, true otherwise
+ */
+bool ElasticsearchWriter::SendRequest(const String& body)
 {
 	namespace beast = boost::beast;
 	namespace http = beast::http;
@@ -456,26 +513,11 @@ void ElasticsearchWriter::SendRequest(const String& body)
 
 	url->SetPath(path);
 
-	OptionalTlsStream stream;
-
-	try {
-		stream = Connect();
-	} catch (const std::exception& ex) {
-		Log(LogWarning, "ElasticsearchWriter")
-			<< "Flush failed, cannot connect to Elasticsearch: " << DiagnosticInformation(ex, false);
-		return;
-	}
-
-	Defer s ([&stream]() {
-		if (stream.first) {
-			stream.first->next_layer().shutdown();
-		}
-	});
-
-	http::request<http::string_body> request (http::verb::post, std::string(url->Format(true)), 10);
+	http::request<http::string_body> request (http::verb::post, std::string(url->Format(true)), 11);
 
 	request.set(http::field::user_agent, "Icinga/" + Application::GetAppVersion());
 	request.set(http::field::host, url->GetHost() + ":" + url->GetPort());
+	request.keep_alive(true);
 
 	/* Specify required headers by Elasticsearch. */
 	request.set(http::field::accept, "application/json");
@@ -493,7 +535,13 @@ void ElasticsearchWriter::SendRequest(const String& body)
 	if (!username.IsEmpty() && !password.IsEmpty())
 		request.set(http::field::authorization, "Basic " + Base64::Encode(username + ":" + password));
 
-	request.body() = body;
+	if (GetEnableCompression()) {
+		request.set(http::field::content_encoding, "gzip");
+		request.body() = GzipCompress(body);
+	} else {
+		request.body() = body;
+	}
+
 	request.content_length(request.body().size());
 
 	/* Don't log the request body to debug log, this is already done above. */
@@ -501,30 +549,57 @@ void ElasticsearchWriter::SendRequest(const String& body)
 		<< "Sending " << request.method_string() << " request" << ((!username.IsEmpty() && !password.IsEmpty()) ? " with basic auth" : "" )
 		<< " to '" << url->Format() << "'.";
 
-	try {
-		if (stream.first) {
-			http::write(*stream.first, request);
-			stream.first->flush();
-		} else {
-			http::write(*stream.second, request);
-			stream.second->flush();
+	/* The connection is kept open between flushes. Elasticsearch might have closed it
+	 * in the meantime, so sending the request is retried once on a new connection. */
+	bool reused = m_Stream.first || m_Stream.second;
+
+	for (;;) {
+		if (!m_Stream.first && !m_Stream.second) {
+			try {
+				m_Stream = Connect();
+			} catch (const std::exception& ex) {
+				Log(LogWarning, "ElasticsearchWriter")
+					<< "Flush failed, cannot connect to Elasticsearch: " << DiagnosticInformation(ex, false);
+				return false;
+			}
 		}
-	} catch (const std::exception&) {
-		Log(LogWarning, "ElasticsearchWriter")
-			<< "Cannot write to HTTP API on host '" << GetHost() << "' port '" << GetPort() << "'.";
-		throw;
+
+		try {
+			if (m_Stream.first) {
+				http::write(*m_Stream.first, request);
+				m_Stream.first->flush();
+			} else {
+				http::write(*m_Stream.second, request);
+				m_Stream.second->flush();
+			}
+		} catch (const std::exception&) {
+			Disconnect();
+
+			if (reused) {
+				reused = false;
+				continue;
+			}
+
+			Log(LogWarning, "ElasticsearchWriter")
+				<< "Cannot write to HTTP API on host '" << GetHost() << "' port '" << GetPort() << "'.";
+			throw;
+		}
+
+		break;
 	}
 
 	http::parser<false, http::string_body> parser;
 	beast::flat_buffer buf;
 
 	try {
-		if (stream.first) {
-			http::read(*stream.first, buf, parser);
+		if (m_Stream.first) {
+			http::read(*m_Stream.first, buf, parser);
 		} else {
-			http::read(*stream.second, buf, parser);
+			http::read(*m_Stream.second, buf, parser);
 		}
 	} catch (const std::exception& ex) {
+		Disconnect();
+
 		Log(LogWarning, "ElasticsearchWriter")
 			<< "Failed to parse HTTP response from host '" << GetHost() << "' port '" << GetPort() << "': " << DiagnosticInformation(ex, false);
 		throw;
@@ -532,6 +607,9 @@ void ElasticsearchWriter::SendRequest(const String& body)
 
 	auto& response (parser.get());
 
+	if (!response.keep_alive())
+		Disconnect();
+
 	if (response.result_int() > 299) {
 		if (response.result() == http::status::unauthorized) {
 			/* More verbose error logging with Elasticsearch is hidden behind a proxy. */
@@ -544,7 +622,7 @@ void ElasticsearchWriter::SendRequest(const String& body)
 					<< "401 Unauthorized. The HTTP API requires authentication but no username/password has been configured.";
 			}
 
-			return;
+			return true;
 		}
 
 		std::ostringstream msgbuf;
@@ -569,7 +647,7 @@ void ElasticsearchWriter::SendRequest(const String& body)
 		} catch (...) {
 			Log(LogWarning, "ElasticsearchWriter")
 				<< "Unable to parse JSON response:\n" << body;
-			return;
+			return response.result_int() < 500 && response.result() != http::status::too_many_requests;
 		}
 
 		String error = jsonResponse->Get("error");
@@ -577,6 +655,9 @@ void ElasticsearchWriter::SendRequest(const String& body)
 		Log(LogCritical, "ElasticsearchWriter")
 			<< "Error: '" << error << "'. " << msgbuf.str();
 	}
+
+	/* Server errors and throttling are temporary, the data is rejected for good otherwise. */
+	return response.result_int() < 500 && response.result() != http::status::too_many_requests;
 }
 
 OptionalTlsStream ElasticsearchWriter::Connect()
@@ -627,6 +708,22 @@ OptionalTlsStream ElasticsearchWriter::Connect()
 	return std::move(stream);
 }
 
+/**
+ * Closes the connection which is kept open between flushes (if any).
+ */
+void ElasticsearchWriter::Disconnect()
+{
+	if (m_Stream.first) {
+		try {
+			m_Stream.first->next_layer().shutdown();
+		} catch (const std::exception&) {
+			/* The connection is being dropped anyway. */
+		}
+	}
+
+	m_Stream = OptionalTlsStream();
+}
+
 void ElasticsearchWriter::AssertOnWorkQueue()
 {
 	ASSERT(m_WorkQueue.IsWorkerThread());
@@ -638,6 +735,9 @@ void ElasticsearchWriter::ExceptionHandler(boost::exception_ptr exp)
 
 	Log(LogDebug, "ElasticsearchWriter")
 		<< "Exception during Elasticsearch operation: " << DiagnosticInformation(std::move(exp));
+
+	std::unique_lock<std::mutex> lock(m_DataBufferMutex);
+	Disconnect();
 }
 
 String ElasticsearchWriter::FormatTimestamp(double ts)
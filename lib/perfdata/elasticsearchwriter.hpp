@@ -4,6 +4,7 @@
 #define ELASTICSEARCHWRITER_H
 
 #include "perfdata/elasticsearchwriter-ti.hpp"
+#include "perfdata/perfdataspool.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/workqueue.hpp"
@@ -34,6 +35,8 @@ private:
 	Timer::Ptr m_FlushTimer;
 	std::vector<String> m_DataBuffer;
 	std::mutex m_DataBufferMutex;
+	OptionalTlsStream m_Stream;
+	PerfdataSpool::Ptr m_Spool;
 
 	void AddCheckResult(const Dictionary::Ptr& fields, const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
 
@@ -52,11 +55,13 @@ private:
 		const Dictionary::Ptr& fields, double ts);
 
 	OptionalTlsStream Connect();
+	void Disconnect();
 	void AssertOnWorkQueue();
 	void ExceptionHandler(boost::exception_ptr exp);
 	void FlushTimeout();
 	void Flush();
-	void SendRequest(const String& body);
+	void ReplaySpool();
+	bool SendRequest(const String& body);
 };
 
 }
@@ -7,6 +7,7 @@
 #include "icinga/checkcommand.hpp"
 #include "icinga/macroprocessor.hpp"
 #include "icinga/compatutility.hpp"
+#include "remote/messagecompression.hpp"
 #include "base/tcpsocket.hpp"
 #include "base/configtype.hpp"
 #include "base/objectlock.hpp"
@@ -27,6 +28,9 @@
 #include <boost/asio/buffer.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/asio/error.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
 
 using namespace icinga;
 
@@ -34,6 +38,14 @@ REGISTER_TYPE(GelfWriter);
 
 REGISTER_STATSFUNCTION(GelfWriter, &GelfWriter::StatsFunc);
 
+/* Messages are written in batches of about this size via TCP. */
+static const size_t l_MaxBatchSize = 64 * 1024;
+
+/* Larger messages are split into GELF chunks via UDP, each chunk fits into one packet. */
+static const size_t l_MaxDatagramSize = 1420;
+static const size_t l_ChunkHeaderSize = 12;
+static const size_t l_MaxChunks = 128;
+
 void GelfWriter::OnConfigLoaded()
 {
 	ObjectImpl<GelfWriter>::OnConfigLoaded();
@@ -82,6 +94,17 @@ void GelfWriter::Resume()
 	/* Register exception handler for WQ tasks. */
 	m_WorkQueue.SetExceptionCallback(std::bind(&GelfWriter::ExceptionHandler, this, _1));
 
+	/* The spool is kept while paused, a new one would replay what's been replayed already. */
+	if (GetEnableSpool() && !m_Spool) {
+		try {
+			/* Messages are spooled with null byte delimiters via TCP only. */
+			m_Spool = new PerfdataSpool(PerfdataSpool::GetWriterPath("GelfWriter", GetEnableUdp() ? GetName() + "-udp" : GetName()));
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "GelfWriter")
+				<< "Cannot open spool for '" << GetName() << "', data will be dropped while Graylog isn't available: " << DiagnosticInformation(ex, false);
+		}
+	}
+
 	/* Timer for reconnecting */
 	m_ReconnectTimer = new Timer();
 	m_ReconnectTimer->SetInterval(10);
@@ -103,13 +126,23 @@ void GelfWriter::Pause()
 	try {
 		ReconnectInternal();
 	} catch (const std::exception&) {
-		Log(LogInformation, "GelfWriter")
-			<< "'" << GetName() << "' paused. Unable to connect, not flushing buffers. Data may be lost on reload.";
+		if (m_Spool) {
+			/* The pending messages end up in the spool. */
+			m_WorkQueue.Enqueue(std::bind(&GelfWriter::FlushMessages, this));
+			m_WorkQueue.Join();
+
+			Log(LogInformation, "GelfWriter")
+				<< "'" << GetName() << "' paused. Unable to connect, spooled buffers.";
+		} else {
+			Log(LogInformation, "GelfWriter")
+				<< "'" << GetName() << "' paused. Unable to connect, not flushing buffers. Data may be lost on reload.";
+		}
 
 		ObjectImpl<GelfWriter>::Pause();
 		return;
 	}
 
+	m_WorkQueue.Enqueue(std::bind(&GelfWriter::FlushMessages, this));
 	m_WorkQueue.Join();
 	DisconnectInternal();
 
@@ -144,6 +177,12 @@ void GelfWriter::Reconnect()
 	}
 
 	ReconnectInternal();
+
+	if (m_Spool)
+		ReplaySpool();
+
+	/* Messages are only flushed by events if the queue runs empty. */
+	FlushMessages();
 }
 
 void GelfWriter::ReconnectInternal()
@@ -160,6 +199,29 @@ void GelfWriter::ReconnectInternal()
 	Log(LogNotice, "GelfWriter")
 		<< "Reconnecting to Graylog Gelf on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
+	if (GetEnableUdp()) {
+		using boost::asio::ip::udp;
+
+		try {
+			udp::resolver resolver (IoEngine::Get().GetIoContext());
+			auto result (resolver.resolve(udp::resolver::query(GetHost(), GetPort())));
+			std::unique_ptr<udp::socket> socket (new udp::socket(IoEngine::Get().GetIoContext()));
+
+			/* Datagrams are sent to the first address, a connected socket doesn't need it for every send. */
+			socket->open(result.begin()->endpoint().protocol());
+			socket->connect(result.begin()->endpoint());
+
+			m_UdpSocket = std::move(socket);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "GelfWriter")
+				<< "Can't connect to Graylog Gelf on host '" << GetHost() << "' port '" << GetPort() << ".'";
+			throw;
+		}
+
+		SetConnected(true);
+		return;
+	}
+
 	bool ssl = GetEnableTls();
 
 	if (ssl) {
@@ -205,6 +267,41 @@ void GelfWriter::ReconnectInternal()
 		<< "Finished reconnecting to Graylog Gelf in " << std::setw(2) << Utility::GetTime() - startTime << " second(s).";
 }
 
+/**
+ * Sends a chunk of the spooled messages to Graylog.
+ *
+ * Called inside the WQ.
+ */
+void GelfWriter::ReplaySpool()
+{
+	if (m_Spool->IsEmpty())
+		return;
+
+	ObjectLock olock(this);
+
+	if (!GetConnected())
+		return;
+
+	size_t count = m_Spool->Replay(PerfdataSpool::ReplayChunkSize, [this](const String& log) {
+		try {
+			if (m_UdpSocket)
+				SendDatagrams(log);
+			else
+				WriteInternal(log);
+		} catch (const std::exception&) {
+			DisconnectInternal();
+			return false;
+		}
+
+		return true;
+	});
+
+	if (count > 0) {
+		Log(LogInformation, "GelfWriter")
+			<< "Replayed " << count << " spooled messages to Graylog, " << m_Spool->GetSize() << " bytes left.";
+	}
+}
+
 void GelfWriter::ReconnectTimerHandler()
 {
 	m_WorkQueue.Enqueue(std::bind(&GelfWriter::Reconnect, this), PriorityNormal);
@@ -222,7 +319,11 @@ void GelfWriter::DisconnectInternal()
 	if (!GetConnected())
 		return;
 
-	if (m_Stream.first) {
+	if (m_UdpSocket) {
+		boost::system::error_code ec;
+		m_UdpSocket->close(ec);
+		m_UdpSocket.reset();
+	} else if (m_Stream.first) {
 		boost::system::error_code ec;
 		m_Stream.first->next_layer().shutdown(ec);
 
@@ -299,47 +400,38 @@ void GelfWriter::CheckResultHandlerInternal(const Checkable::Ptr& checkable, con
 	}
 
 	if (cr && GetEnableSendPerfdata()) {
-		Array::Ptr perfdata = cr->GetPerformanceData();
-
-		if (perfdata) {
-			ObjectLock olock(perfdata);
-			for (const Value& val : perfdata) {
-				PerfdataValue::Ptr pdv;
-
-				if (val.IsObjectType<PerfdataValue>())
-					pdv = val;
-				else {
-					try {
-						pdv = PerfdataValue::Parse(val);
-					} catch (const std::exception&) {
-						Log(LogWarning, "GelfWriter")
-							<< "Ignoring invalid perfdata for checkable '"
-							<< checkable->GetName() << "' and command '"
-							<< checkCommand->GetName() << "' with value: " << val;
-						continue;
-					}
-				}
-
-				String escaped_key = pdv->GetLabel();
-				boost::replace_all(escaped_key, " ", "_");
-				boost::replace_all(escaped_key, ".", "_");
-				boost::replace_all(escaped_key, "\\", "_");
-				boost::algorithm::replace_all(escaped_key, "::", ".");
-
-				fields->Set("_" + escaped_key, pdv->GetValue());
-
-				if (!pdv->GetMin().IsEmpty())
-					fields->Set("_" + escaped_key + "_min", pdv->GetMin());
-				if (!pdv->GetMax().IsEmpty())
-					fields->Set("_" + escaped_key + "_max", pdv->GetMax());
-				if (!pdv->GetWarn().IsEmpty())
-					fields->Set("_" + escaped_key + "_warn", pdv->GetWarn());
-				if (!pdv->GetCrit().IsEmpty())
-					fields->Set("_" + escaped_key + "_crit", pdv->GetCrit());
-
-				if (!pdv->GetUnit().IsEmpty())
-					fields->Set("_" + escaped_key + "_unit", pdv->GetUnit());
+		auto perfdata (cr->GetParsedPerformanceData());
+
+		for (auto& entry : *perfdata) {
+			const PerfdataValue::Ptr& pdv = entry.Parsed;
+
+			if (!pdv) {
+				Log(LogWarning, "GelfWriter")
+					<< "Ignoring invalid perfdata for checkable '"
+					<< checkable->GetName() << "' and command '"
+					<< checkCommand->GetName() << "' with value: " << entry.Raw;
+				continue;
 			}
+
+			String escaped_key = pdv->GetLabel();
+			boost::replace_all(escaped_key, " ", "_");
+			boost::replace_all(escaped_key, ".", "_");
+			boost::replace_all(escaped_key, "\\", "_");
+			boost::algorithm::replace_all(escaped_key, "::", ".");
+
+			fields->Set("_" + escaped_key, pdv->GetValue());
+
+			if (!pdv->GetMin().IsEmpty())
+				fields->Set("_" + escaped_key + "_min", pdv->GetMin());
+			if (!pdv->GetMax().IsEmpty())
+				fields->Set("_" + escaped_key + "_max", pdv->GetMax());
+			if (!pdv->GetWarn().IsEmpty())
+				fields->Set("_" + escaped_key + "_warn", pdv->GetWarn());
+			if (!pdv->GetCrit().IsEmpty())
+				fields->Set("_" + escaped_key + "_crit", pdv->GetCrit());
+
+			if (!pdv->GetUnit().IsEmpty())
+				fields->Set("_" + escaped_key + "_unit", pdv->GetUnit());
 		}
 	}
 
@@ -480,34 +572,170 @@ String GelfWriter::ComposeGelfMessage(const Dictionary::Ptr& fields, const Strin
 	return JsonEncode(fields);
 }
 
+/**
+ * Sends a message via UDP or adds it to the pending batch of messages via TCP.
+ *
+ * Called inside the WQ.
+ *
+ * @param checkable Host/service object
+ * @param gelfMessage JSON encoded GELF message
+ */
 void GelfWriter::SendLogMessage(const Checkable::Ptr& checkable, const String& gelfMessage)
 {
-	std::ostringstream msgbuf;
-	msgbuf << gelfMessage;
-	msgbuf << '\0';
+	Log(LogDebug, "GelfWriter")
+		<< "Checkable '" << checkable->GetName() << "' sending message '" << gelfMessage << "'.";
+
+	if (GetEnableUdp()) {
+		ObjectLock olock(this);
 
-	String log = msgbuf.str();
+		if (!GetConnected()) {
+			if (m_Spool)
+				m_Spool->Append(gelfMessage);
+
+			return;
+		}
+
+		try {
+			SendDatagrams(gelfMessage);
+		} catch (const std::exception&) {
+			if (m_Spool)
+				m_Spool->Append(gelfMessage);
+
+			Log(LogCritical, "GelfWriter")
+				<< "Cannot write to UDP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
+
+			throw;
+		}
+
+		return;
+	}
+
+	m_MessageBuffer.append(gelfMessage.CStr(), gelfMessage.GetLength());
+	m_MessageBuffer += '\0';
+
+	/* Events are queued faster than they're sent, so write all the queued ones at once. */
+	if (m_MessageBuffer.size() >= l_MaxBatchSize || m_WorkQueue.GetLength() == 0)
+		FlushMessages();
+}
+
+/**
+ * Writes the pending batch of null byte delimited messages via TCP, or to the spool if not connected.
+ *
+ * Called inside the WQ.
+ */
+void GelfWriter::FlushMessages()
+{
+	if (m_MessageBuffer.empty())
+		return;
+
+	String log (std::move(m_MessageBuffer));
+	m_MessageBuffer.clear();
 
 	ObjectLock olock(this);
 
-	if (!GetConnected())
+	if (!GetConnected()) {
+		if (m_Spool)
+			m_Spool->Append(log);
+
 		return;
+	}
 
 	try {
-		Log(LogDebug, "GelfWriter")
-			<< "Checkable '" << checkable->GetName() << "' sending message '" << log << "'.";
+		WriteInternal(log);
+	} catch (const std::exception&) {
+		if (m_Spool)
+			m_Spool->Append(log);
 
-		if (m_Stream.first) {
-			boost::asio::write(*m_Stream.first, boost::asio::buffer(msgbuf.str()));
-			m_Stream.first->flush();
-		} else {
-			boost::asio::write(*m_Stream.second, boost::asio::buffer(msgbuf.str()));
-			m_Stream.second->flush();
-		}
-	} catch (const std::exception& ex) {
 		Log(LogCritical, "GelfWriter")
 			<< "Cannot write to TCP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
-		throw ex;
+		throw;
+	}
+}
+
+/**
+ * Writes null byte delimited messages to the TCP (or TLS) stream.
+ *
+ * Called with the object locked.
+ *
+ * @param data One or more messages
+ */
+void GelfWriter::WriteInternal(const String& data)
+{
+	if (m_Stream.first) {
+		boost::asio::write(*m_Stream.first, boost::asio::buffer(data.CStr(), data.GetLength()));
+		m_Stream.first->flush();
+	} else {
+		boost::asio::write(*m_Stream.second, boost::asio::buffer(data.CStr(), data.GetLength()));
+		m_Stream.second->flush();
+	}
+}
+
+/**
+ * Sends a message via UDP, compressed if enabled. Messages which don't fit
+ * into one datagram are split into GELF chunks: magic bytes 0x1e 0x0f, an
+ * 8 byte message ID, the chunk's sequence number and the number of chunks.
+ *
+ * Called with the object locked.
+ *
+ * @param gelfMessage JSON encoded GELF message
+ */
+void GelfWriter::SendDatagrams(const String& gelfMessage)
+{
+	namespace asio = boost::asio;
+
+	String payload = GetEnableCompression() ? GzipCompress(gelfMessage) : gelfMessage;
+
+	if (payload.GetLength() <= l_MaxDatagramSize) {
+		m_UdpSocket->send(asio::buffer(payload.CStr(), payload.GetLength()));
+		return;
 	}
+
+	size_t chunkSize = l_MaxDatagramSize - l_ChunkHeaderSize;
+	size_t chunks = (payload.GetLength() + chunkSize - 1) / chunkSize;
+
+	if (chunks > l_MaxChunks) {
+		Log(LogWarning, "GelfWriter")
+			<< "Dropping message of " << payload.GetLength() << " bytes, Graylog accepts at most "
+			<< l_MaxChunks << " chunks via UDP.";
+		return;
+	}
+
+	uint_least64_t id = m_ChunkedMessageIds();
+	char header[l_ChunkHeaderSize] = { '\x1e', '\x0f' };
+
+	for (int i = 0; i < 8; i++)
+		header[2 + i] = static_cast<char>((id >> (i * 8u)) & 255u);
+
+	header[11] = static_cast<char>(chunks);
+
+	for (size_t i = 0; i < chunks; i++) {
+		size_t offset = i * chunkSize;
+
+		header[10] = static_cast<char>(i);
+
+		std::array<asio::const_buffer, 2> buffers {{
+			asio::buffer(header, l_ChunkHeaderSize),
+			asio::buffer(payload.CStr() + offset, std::min(chunkSize, payload.GetLength() - offset))
+		}};
+
+		m_UdpSocket->send(buffers);
+	}
+}
+
+/**
+ * Validate the combination of configuration settings
+ *
+ * @param types Attribute types to validate
+ * @param utils Helper, unused
+ */
+void GelfWriter::Validate(int types, const ValidationUtils& utils)
+{
+	ObjectImpl<GelfWriter>::Validate(types, utils);
+
+	if (!(types & FAConfig))
+		return;
+
+	if (GetEnableUdp() && GetEnableTls())
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "enable_udp" }, "TLS isn't available via UDP."));
 }
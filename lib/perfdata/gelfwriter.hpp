@@ -4,12 +4,17 @@
 #define GELFWRITER_H
 
 #include "perfdata/gelfwriter-ti.hpp"
+#include "perfdata/perfdataspool.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/tcpsocket.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include <boost/asio/ip/udp.hpp>
 #include <fstream>
+#include <memory>
+#include <random>
+#include <string>
 
 namespace icinga
 {
@@ -27,6 +32,8 @@ public:
 
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
+	void Validate(int types, const ValidationUtils& utils) override;
+
 protected:
 	void OnConfigLoaded() override;
 	void Resume() override;
@@ -34,8 +41,14 @@ protected:
 
 private:
 	OptionalTlsStream m_Stream;
+	std::unique_ptr<boost::asio::ip::udp::socket> m_UdpSocket;
+	PerfdataSpool::Ptr m_Spool;
 	WorkQueue m_WorkQueue{10000000, 1};
 
+	/* Only used inside the WQ. */
+	std::string m_MessageBuffer;
+	std::mt19937_64 m_ChunkedMessageIds{std::random_device()()};
+
 	Timer::Ptr m_ReconnectTimer;
 
 	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
@@ -51,6 +64,9 @@ private:
 
 	String ComposeGelfMessage(const Dictionary::Ptr& fields, const String& source, double ts);
 	void SendLogMessage(const Checkable::Ptr& checkable, const String& gelfMessage);
+	void FlushMessages();
+	void WriteInternal(const String& data);
+	void SendDatagrams(const String& gelfMessage);
 
 	void ReconnectTimerHandler();
 
@@ -58,6 +74,7 @@ private:
 	void DisconnectInternal();
 	void Reconnect();
 	void ReconnectInternal();
+	void ReplaySpool();
 
 	void AssertOnWorkQueue();
 
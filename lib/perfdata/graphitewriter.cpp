@@ -20,6 +20,8 @@
 #include "base/statsfunction.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <cstdint>
+#include <cstring>
 #include <utility>
 
 using namespace icinga;
@@ -28,6 +30,13 @@ REGISTER_TYPE(GraphiteWriter);
 
 REGISTER_STATSFUNCTION(GraphiteWriter, &GraphiteWriter::StatsFunc);
 
+/* Metrics are written in batches of about this size, datagrams have to fit into one IP packet. */
+static const size_t l_MaxBatchSize = 64 * 1024;
+static const size_t l_MaxDatagramSize = 1400;
+
+/* Carbon's pickle receiver reads one length-prefixed pickle at a time, see FlushMetrics(). */
+static const size_t l_MaxPickleSize = 1024 * 1024;
+
 /*
  * Enable HA capabilities once the config object is loaded.
  */
@@ -87,6 +96,17 @@ void GraphiteWriter::Resume()
 	/* Register exception handler for WQ tasks. */
 	m_WorkQueue.SetExceptionCallback(std::bind(&GraphiteWriter::ExceptionHandler, this, _1));
 
+	/* The spool is kept while paused, a new one would replay what's been replayed already. */
+	if (GetEnableSpool() && !m_Spool) {
+		try {
+			/* Pickled metrics mustn't be replayed to a plaintext receiver and vice versa. */
+			m_Spool = new PerfdataSpool(PerfdataSpool::GetWriterPath("GraphiteWriter", GetEnablePickle() ? GetName() + "-pickle" : GetName()));
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "GraphiteWriter")
+				<< "Cannot open spool for '" << GetName() << "', data will be dropped while Graphite isn't available: " << DiagnosticInformation(ex, false);
+		}
+	}
+
 	/* Timer for reconnecting */
 	m_ReconnectTimer = new Timer();
 	m_ReconnectTimer->SetInterval(10);
@@ -108,13 +128,23 @@ void GraphiteWriter::Pause()
 	try {
 		ReconnectInternal();
 	} catch (const std::exception&) {
-		Log(LogInformation, "GraphiteWriter")
-			<< "'" << GetName() << "' paused. Unable to connect, not flushing buffers. Data may be lost on reload.";
+		if (m_Spool) {
+			/* The pending metrics end up in the spool. */
+			m_WorkQueue.Enqueue(std::bind(&GraphiteWriter::FlushMetrics, this));
+			m_WorkQueue.Join();
+
+			Log(LogInformation, "GraphiteWriter")
+				<< "'" << GetName() << "' paused. Unable to connect, spooled buffers.";
+		} else {
+			Log(LogInformation, "GraphiteWriter")
+				<< "'" << GetName() << "' paused. Unable to connect, not flushing buffers. Data may be lost on reload.";
+		}
 
 		ObjectImpl<GraphiteWriter>::Pause();
 		return;
 	}
 
+	m_WorkQueue.Enqueue(std::bind(&GraphiteWriter::FlushMetrics, this));
 	m_WorkQueue.Join();
 	DisconnectInternal();
 
@@ -147,7 +177,7 @@ void GraphiteWriter::ExceptionHandler(boost::exception_ptr exp)
 		<< "Exception during Graphite operation: " << DiagnosticInformation(std::move(exp));
 
 	if (GetConnected()) {
-		m_Stream->close();
+		CloseSocket();
 
 		SetConnected(false);
 	}
@@ -168,6 +198,12 @@ void GraphiteWriter::Reconnect()
 	}
 
 	ReconnectInternal();
+
+	if (m_Spool)
+		ReplaySpool();
+
+	/* Metrics are only flushed by check results if the queue runs empty. */
+	FlushMetrics();
 }
 
 /**
@@ -187,10 +223,24 @@ void GraphiteWriter::ReconnectInternal()
 	Log(LogNotice, "GraphiteWriter")
 		<< "Reconnecting to Graphite on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
-	m_Stream = Shared<AsioTcpStream>::Make(IoEngine::Get().GetIoContext());
-
 	try {
-		icinga::Connect(m_Stream->lowest_layer(), GetHost(), GetPort());
+		if (GetEnableUdp()) {
+			using boost::asio::ip::udp;
+
+			udp::resolver resolver (IoEngine::Get().GetIoContext());
+			auto result (resolver.resolve(udp::resolver::query(GetHost(), GetPort())));
+			std::unique_ptr<udp::socket> socket (new udp::socket(IoEngine::Get().GetIoContext()));
+
+			/* Datagrams are sent to the first address, a connected socket doesn't need it for every send. */
+			socket->open(result.begin()->endpoint().protocol());
+			socket->connect(result.begin()->endpoint());
+
+			m_UdpSocket = std::move(socket);
+		} else {
+			m_Stream = Shared<AsioTcpStream>::Make(IoEngine::Get().GetIoContext());
+
+			icinga::Connect(m_Stream->lowest_layer(), GetHost(), GetPort());
+		}
 	} catch (const std::exception& ex) {
 		Log(LogWarning, "GraphiteWriter")
 			<< "Can't connect to Graphite on host '" << GetHost() << "' port '" << GetPort() << ".'";
@@ -206,6 +256,38 @@ void GraphiteWriter::ReconnectInternal()
 		<< "Finished reconnecting to Graphite in " << std::setw(2) << Utility::GetTime() - startTime << " second(s).";
 }
 
+/**
+ * Sends a chunk of the spooled metrics to Graphite.
+ *
+ * Called inside the WQ.
+ */
+void GraphiteWriter::ReplaySpool()
+{
+	if (m_Spool->IsEmpty())
+		return;
+
+	std::unique_lock<std::mutex> lock(m_StreamMutex);
+
+	if (!GetConnected())
+		return;
+
+	size_t count = m_Spool->Replay(PerfdataSpool::ReplayChunkSize, [this](const String& metric) {
+		try {
+			WriteInternal(metric);
+		} catch (const std::exception&) {
+			DisconnectInternal();
+			return false;
+		}
+
+		return true;
+	});
+
+	if (count > 0) {
+		Log(LogInformation, "GraphiteWriter")
+			<< "Replayed " << count << " spooled metrics to Graphite, " << m_Spool->GetSize() << " bytes left.";
+	}
+}
+
 /**
  * Reconnect handler called by the timer.
  *
@@ -241,11 +323,25 @@ void GraphiteWriter::DisconnectInternal()
 	if (!GetConnected())
 		return;
 
-	m_Stream->close();
+	CloseSocket();
 
 	SetConnected(false);
 }
 
+/**
+ * Closes the TCP stream or the UDP socket.
+ */
+void GraphiteWriter::CloseSocket()
+{
+	if (m_UdpSocket) {
+		boost::system::error_code ec;
+		m_UdpSocket->close(ec);
+		m_UdpSocket.reset();
+	} else {
+		m_Stream->close();
+	}
+}
+
 /**
  * Check result event handler, checks whether feature is not paused in HA setups.
  *
@@ -285,20 +381,7 @@ void GraphiteWriter::CheckResultHandlerInternal(const Checkable::Ptr& checkable,
 	Service::Ptr service;
 	tie(host, service) = GetHostService(checkable);
 
-	MacroProcessor::ResolverList resolvers;
-	if (service)
-		resolvers.emplace_back("service", service);
-	resolvers.emplace_back("host", host);
-	resolvers.emplace_back("icinga", IcingaApplication::GetInstance());
-
-	String prefix;
-
-	if (service) {
-		prefix = MacroProcessor::ResolveMacros(GetServiceNameTemplate(), resolvers, cr, nullptr, std::bind(&GraphiteWriter::EscapeMacroMetric, _1));
-	} else {
-		prefix = MacroProcessor::ResolveMacros(GetHostNameTemplate(), resolvers, cr, nullptr, std::bind(&GraphiteWriter::EscapeMacroMetric, _1));
-	}
-
+	String prefix = GetMetricPrefix(checkable, host, service, cr);
 	String prefixPerfdata = prefix + ".perfdata";
 	String prefixMetadata = prefix + ".metadata";
 
@@ -322,6 +405,52 @@ void GraphiteWriter::CheckResultHandlerInternal(const Checkable::Ptr& checkable,
 	}
 
 	SendPerfdata(checkable, prefixPerfdata, cr, ts);
+
+	/* Check results are queued faster than they're sent, so write all the queued ones at once. */
+	if (m_MetricBuffer.size() >= l_MaxBatchSize || m_WorkQueue.GetLength() == 0)
+		FlushMetrics();
+}
+
+/**
+ * Resolves the host/service name template of a checkable. Resolving and
+ * escaping the macros for every check result is expensive, so the result is
+ * cached until the host or service is modified.
+ *
+ * Called inside the WQ.
+ *
+ * @param checkable Host/service object
+ * @param host Host object
+ * @param service Service object, if any
+ * @param cr Check result
+ * @return Metric prefix
+ */
+String GraphiteWriter::GetMetricPrefix(const Checkable::Ptr& checkable, const Host::Ptr& host, const Service::Ptr& service, const CheckResult::Ptr& cr)
+{
+	double hostVersion = host->GetVersion();
+	double serviceVersion = service ? service->GetVersion() : 0;
+
+	auto it (m_MetricPrefixes.find(checkable->GetName()));
+
+	if (it != m_MetricPrefixes.end() && it->second.HostVersion == hostVersion && it->second.ServiceVersion == serviceVersion)
+		return it->second.Prefix;
+
+	MacroProcessor::ResolverList resolvers;
+	if (service)
+		resolvers.emplace_back("service", service);
+	resolvers.emplace_back("host", host);
+	resolvers.emplace_back("icinga", IcingaApplication::GetInstance());
+
+	String prefix;
+
+	if (service) {
+		prefix = MacroProcessor::ResolveMacros(GetServiceNameTemplate(), resolvers, cr, nullptr, std::bind(&GraphiteWriter::EscapeMacroMetric, _1));
+	} else {
+		prefix = MacroProcessor::ResolveMacros(GetHostNameTemplate(), resolvers, cr, nullptr, std::bind(&GraphiteWriter::EscapeMacroMetric, _1));
+	}
+
+	m_MetricPrefixes[checkable->GetName()] = MetricPrefix{hostVersion, serviceVersion, prefix};
+
+	return prefix;
 }
 
 /**
@@ -334,29 +463,22 @@ void GraphiteWriter::CheckResultHandlerInternal(const Checkable::Ptr& checkable,
  */
 void GraphiteWriter::SendPerfdata(const Checkable::Ptr& checkable, const String& prefix, const CheckResult::Ptr& cr, double ts)
 {
-	Array::Ptr perfdata = cr->GetPerformanceData();
+	auto perfdata (cr->GetParsedPerformanceData());
 
-	if (!perfdata)
+	if (perfdata->empty())
 		return;
 
 	CheckCommand::Ptr checkCommand = checkable->GetCheckCommand();
 
-	ObjectLock olock(perfdata);
-	for (const Value& val : perfdata) {
-		PerfdataValue::Ptr pdv;
-
-		if (val.IsObjectType<PerfdataValue>())
-			pdv = val;
-		else {
-			try {
-				pdv = PerfdataValue::Parse(val);
-			} catch (const std::exception&) {
-				Log(LogWarning, "GraphiteWriter")
-					<< "Ignoring invalid perfdata for checkable '"
-					<< checkable->GetName() << "' and command '"
-					<< checkCommand->GetName() << "' with value: " << val;
-				continue;
-			}
+	for (auto& entry : *perfdata) {
+		const PerfdataValue::Ptr& pdv = entry.Parsed;
+
+		if (!pdv) {
+			Log(LogWarning, "GraphiteWriter")
+				<< "Ignoring invalid perfdata for checkable '"
+				<< checkable->GetName() << "' and command '"
+				<< checkCommand->GetName() << "' with value: " << entry.Raw;
+			continue;
 		}
 
 		String escapedKey = EscapeMetricLabel(pdv->GetLabel());
@@ -377,7 +499,36 @@ void GraphiteWriter::SendPerfdata(const Checkable::Ptr& checkable, const String&
 }
 
 /**
- * Computes metric data and sends to Graphite
+ * Appends a BINUNICODE opcode to a pickle
+ */
+static void PickleString(std::string& pickle, const String& str)
+{
+	uint_least32_t length = str.GetLength();
+
+	pickle += 'X';
+
+	for (int i = 0; i < 4; i++)
+		pickle += static_cast<char>((length >> (i * 8u)) & 255u);
+
+	pickle.append(str.CStr(), str.GetLength());
+}
+
+/**
+ * Appends a BINFLOAT opcode (big-endian IEEE 754 binary64) to a pickle
+ */
+static void PickleFloat(std::string& pickle, double value)
+{
+	uint_least64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	pickle += 'G';
+
+	for (int i = 7; i >= 0; i--)
+		pickle += static_cast<char>((bits >> (i * 8u)) & 255u);
+}
+
+/**
+ * Computes metric data and adds it to the pending batch, see FlushMetrics()
  *
  * @param checkable Host/service object
  * @param prefix Computed metric prefix string
@@ -387,33 +538,106 @@ void GraphiteWriter::SendPerfdata(const Checkable::Ptr& checkable, const String&
  */
 void GraphiteWriter::SendMetric(const Checkable::Ptr& checkable, const String& prefix, const String& name, double value, double ts)
 {
-	namespace asio = boost::asio;
-
-	std::ostringstream msgbuf;
-	msgbuf << prefix << "." << name << " " << Convert::ToString(value) << " " << static_cast<long>(ts);
+	String path = prefix + "." + name;
 
 	Log(LogDebug, "GraphiteWriter")
-		<< "Checkable '" << checkable->GetName() << "' adds to metric list: '" << msgbuf.str() << "'.";
+		<< "Checkable '" << checkable->GetName() << "' adds to metric list: '" << path << " " << value << " " << static_cast<long>(ts) << "'.";
+
+	if (GetEnablePickle()) {
+		if (m_MetricBuffer.size() >= l_MaxPickleSize)
+			FlushMetrics();
+
+		/* (path, (timestamp, value)) */
+		PickleString(m_MetricBuffer, path);
+		PickleFloat(m_MetricBuffer, static_cast<long>(ts));
+		PickleFloat(m_MetricBuffer, value);
+		m_MetricBuffer += "\x86\x86";
+		return;
+	}
+
+	String line = path + " " + Convert::ToString(value) + " " + Convert::ToString(static_cast<long>(ts)) + "\n";
+
+	if (GetEnableUdp() && m_MetricBuffer.size() + line.GetLength() > l_MaxDatagramSize)
+		FlushMetrics();
+
+	m_MetricBuffer.append(line.CStr(), line.GetLength());
+}
+
+/**
+ * Sends the pending batch of metrics to Graphite, or to the spool if not connected.
+ *
+ * Called inside the WQ.
+ */
+void GraphiteWriter::FlushMetrics()
+{
+	if (m_MetricBuffer.empty())
+		return;
+
+	String data;
+
+	if (GetEnablePickle()) {
+		/* A list of tuples, pickle protocol 2: PROTO 2, EMPTY_LIST, MARK, ..., APPENDS, STOP */
+		std::string pickle ("\x80\x02](", 4);
+		pickle += m_MetricBuffer;
+		pickle += "e.";
+
+		uint_least32_t length = pickle.size();
+		char header[4] = {
+			static_cast<char>(length >> 24u),
+			static_cast<char>((length >> 16u) & 255u),
+			static_cast<char>((length >> 8u) & 255u),
+			static_cast<char>(length & 255u)
+		};
+
+		data = String(header, header + 4) + String(std::move(pickle));
+	} else {
+		data = String(std::move(m_MetricBuffer));
+	}
 
-	// do not send \n to debug log
-	msgbuf << "\n";
+	m_MetricBuffer.clear();
 
 	std::unique_lock<std::mutex> lock(m_StreamMutex);
 
-	if (!GetConnected())
+	if (!GetConnected()) {
+		if (m_Spool)
+			m_Spool->Append(data);
+
 		return;
+	}
 
 	try {
-		asio::write(*m_Stream, asio::buffer(msgbuf.str()));
-		m_Stream->flush();
-	} catch (const std::exception& ex) {
+		WriteInternal(data);
+	} catch (const std::exception&) {
+		if (m_Spool)
+			m_Spool->Append(data);
+
 		Log(LogCritical, "GraphiteWriter")
-			<< "Cannot write to TCP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
+			<< "Cannot write to " << (GetEnableUdp() ? "UDP" : "TCP") << " socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
-		throw ex;
+		throw;
 	}
 }
 
+/**
+ * Writes already encoded metrics to the TCP stream or sends them as one UDP datagram.
+ *
+ * Called with m_StreamMutex locked.
+ *
+ * @param data Plaintext lines or a length-prefixed pickle
+ */
+void GraphiteWriter::WriteInternal(const String& data)
+{
+	namespace asio = boost::asio;
+
+	if (m_UdpSocket) {
+		m_UdpSocket->send(asio::buffer(data.CStr(), data.GetLength()));
+		return;
+	}
+
+	asio::write(*m_Stream, asio::buffer(data.CStr(), data.GetLength()));
+	m_Stream->flush();
+}
+
 /**
  * Escape metric tree elements
  *
@@ -478,6 +702,23 @@ Value GraphiteWriter::EscapeMacroMetric(const Value& value)
 		return EscapeMetric(value);
 }
 
+/**
+ * Validate the combination of configuration settings
+ *
+ * @param types Attribute types to validate
+ * @param utils Helper, unused
+ */
+void GraphiteWriter::Validate(int types, const ValidationUtils& utils)
+{
+	ObjectImpl<GraphiteWriter>::Validate(types, utils);
+
+	if (!(types & FAConfig))
+		return;
+
+	if (GetEnablePickle() && GetEnableUdp())
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "enable_udp" }, "Carbon doesn't accept the pickle protocol via UDP."));
+}
+
 /**
  * Validate the configuration setting 'host_name_template'
  *
@@ -4,13 +4,18 @@
 #define GRAPHITEWRITER_H
 
 #include "perfdata/graphitewriter-ti.hpp"
+#include "perfdata/perfdataspool.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/tcpsocket.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include <boost/asio/ip/udp.hpp>
 #include <fstream>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <string>
 
 namespace icinga
 {
@@ -28,6 +33,7 @@ public:
 
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
+	void Validate(int types, const ValidationUtils& utils) override;
 	void ValidateHostNameTemplate(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
 	void ValidateServiceNameTemplate(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
 
@@ -39,13 +45,32 @@ protected:
 private:
 	Shared<AsioTcpStream>::Ptr m_Stream;
 	std::mutex m_StreamMutex;
+	PerfdataSpool::Ptr m_Spool;
 	WorkQueue m_WorkQueue{10000000, 1};
 
+	std::unique_ptr<boost::asio::ip::udp::socket> m_UdpSocket;
+
+	/* The resolved metric prefix of a checkable, valid as long as neither its host nor its service changed. */
+	struct MetricPrefix
+	{
+		double HostVersion;
+		double ServiceVersion;
+		String Prefix;
+	};
+
+	/* Only used inside the WQ. */
+	std::map<String, MetricPrefix> m_MetricPrefixes;
+	std::string m_MetricBuffer;
+
 	Timer::Ptr m_ReconnectTimer;
 
 	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
 	void CheckResultHandlerInternal(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
+	String GetMetricPrefix(const Checkable::Ptr& checkable, const Host::Ptr& host, const Service::Ptr& service, const CheckResult::Ptr& cr);
 	void SendMetric(const Checkable::Ptr& checkable, const String& prefix, const String& name, double value, double ts);
+	void FlushMetrics();
+	void WriteInternal(const String& data);
+	void CloseSocket();
 	void SendPerfdata(const Checkable::Ptr& checkable, const String& prefix, const CheckResult::Ptr& cr, double ts);
 	static String EscapeMetric(const String& str);
 	static String EscapeMetricLabel(const String& str);
@@ -57,6 +82,7 @@ private:
 	void DisconnectInternal();
 	void Reconnect();
 	void ReconnectInternal();
+	void ReplaySpool();
 
 	void AssertOnWorkQueue();
 
@@ -3,6 +3,7 @@
 #include "perfdata/influxdbwriter.hpp"
 #include "perfdata/influxdbwriter-ti.cpp"
 #include "remote/url.hpp"
+#include "remote/messagecompression.hpp"
 #include "icinga/service.hpp"
 #include "icinga/macroprocessor.hpp"
 #include "icinga/icingaapplication.hpp"
@@ -90,7 +91,7 @@ void InfluxdbWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&
 	for (const InfluxdbWriter::Ptr& influxdbwriter : ConfigType::GetObjectsByType<InfluxdbWriter>()) {
 		size_t workQueueItems = influxdbwriter->m_WorkQueue.GetLength();
 		double workQueueItemRate = influxdbwriter->m_WorkQueue.GetTaskCount(60) / 60.0;
-		size_t dataBufferItems = influxdbwriter->m_DataBuffer.size();
+		size_t dataBufferItems = influxdbwriter->m_DataBufferItems;
 
 		nodes.emplace_back(influxdbwriter->GetName(), new Dictionary({
 			{ "work_queue_items", workQueueItems },
@@ -116,6 +117,16 @@ void InfluxdbWriter::Resume()
 	/* Register exception handler for WQ tasks. */
 	m_WorkQueue.SetExceptionCallback(std::bind(&InfluxdbWriter::ExceptionHandler, this, _1));
 
+	/* The spool is kept while paused, a new one would replay what's been replayed already. */
+	if (GetEnableSpool() && !m_Spool) {
+		try {
+			m_Spool = new PerfdataSpool(PerfdataSpool::GetWriterPath("InfluxdbWriter", GetName()));
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "InfluxdbWriter")
+				<< "Cannot open spool for '" << GetName() << "', data will be dropped while InfluxDB isn't available: " << DiagnosticInformation(ex, false);
+		}
+	}
+
 	/* Setup timer for periodically flushing m_DataBuffer */
 	m_FlushTimer = new Timer();
 	m_FlushTimer->SetInterval(GetFlushInterval());
@@ -148,6 +159,8 @@ void InfluxdbWriter::Pause()
 
 	Flush();
 
+	Disconnect();
+
 	Log(LogInformation, "InfluxdbWriter")
 		<< "'" << GetName() << "' paused.";
 
@@ -166,7 +179,7 @@ void InfluxdbWriter::ExceptionHandler(boost::exception_ptr exp)
 	Log(LogDebug, "InfluxdbWriter")
 		<< "Exception during InfluxDB operation: " << DiagnosticInformation(std::move(exp));
 
-	//TODO: Close the connection, if we keep it open.
+	Disconnect();
 }
 
 OptionalTlsStream InfluxdbWriter::Connect()
@@ -217,6 +230,22 @@ OptionalTlsStream InfluxdbWriter::Connect()
 	return std::move(stream);
 }
 
+/**
+ * Closes the connection which is kept open between flushes (if any).
+ */
+void InfluxdbWriter::Disconnect()
+{
+	if (m_Stream.first) {
+		try {
+			m_Stream.first->next_layer().shutdown();
+		} catch (const std::exception&) {
+			/* The connection is being dropped anyway. */
+		}
+	}
+
+	m_Stream = OptionalTlsStream();
+}
+
 void InfluxdbWriter::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
 {
 	if (IsPaused())
@@ -274,46 +303,37 @@ void InfluxdbWriter::CheckResultHandlerWQ(const Checkable::Ptr& checkable, const
 
 	CheckCommand::Ptr checkCommand = checkable->GetCheckCommand();
 
-	Array::Ptr perfdata = cr->GetPerformanceData();
-
-	if (perfdata) {
-		ObjectLock olock(perfdata);
-		for (const Value& val : perfdata) {
-			PerfdataValue::Ptr pdv;
-
-			if (val.IsObjectType<PerfdataValue>())
-				pdv = val;
-			else {
-				try {
-					pdv = PerfdataValue::Parse(val);
-				} catch (const std::exception&) {
-					Log(LogWarning, "InfluxdbWriter")
-						<< "Ignoring invalid perfdata for checkable '"
-						<< checkable->GetName() << "' and command '"
-						<< checkCommand->GetName() << "' with value: " << val;
-					continue;
-				}
-			}
+	auto perfdata (cr->GetParsedPerformanceData());
 
-			Dictionary::Ptr fields = new Dictionary();
-			fields->Set("value", pdv->GetValue());
-
-			if (GetEnableSendThresholds()) {
-				if (!pdv->GetCrit().IsEmpty())
-					fields->Set("crit", pdv->GetCrit());
-				if (!pdv->GetWarn().IsEmpty())
-					fields->Set("warn", pdv->GetWarn());
-				if (!pdv->GetMin().IsEmpty())
-					fields->Set("min", pdv->GetMin());
-				if (!pdv->GetMax().IsEmpty())
-					fields->Set("max", pdv->GetMax());
-			}
-			if (!pdv->GetUnit().IsEmpty()) {
-				fields->Set("unit", pdv->GetUnit());
-			}
+	for (auto& entry : *perfdata) {
+		const PerfdataValue::Ptr& pdv = entry.Parsed;
+
+		if (!pdv) {
+			Log(LogWarning, "InfluxdbWriter")
+				<< "Ignoring invalid perfdata for checkable '"
+				<< checkable->GetName() << "' and command '"
+				<< checkCommand->GetName() << "' with value: " << entry.Raw;
+			continue;
+		}
 
-			SendMetric(checkable, tmpl, pdv->GetLabel(), fields, ts);
+		Dictionary::Ptr fields = new Dictionary();
+		fields->Set("value", pdv->GetValue());
+
+		if (GetEnableSendThresholds()) {
+			if (!pdv->GetCrit().IsEmpty())
+				fields->Set("crit", pdv->GetCrit());
+			if (!pdv->GetWarn().IsEmpty())
+				fields->Set("warn", pdv->GetWarn());
+			if (!pdv->GetMin().IsEmpty())
+				fields->Set("min", pdv->GetMin());
+			if (!pdv->GetMax().IsEmpty())
+				fields->Set("max", pdv->GetMax());
+		}
+		if (!pdv->GetUnit().IsEmpty()) {
+			fields->Set("unit", pdv->GetUnit());
 		}
+
+		SendMetric(checkable, tmpl, pdv->GetLabel(), fields, ts);
 	}
 
 	if (GetEnableSendMetadata()) {
@@ -383,8 +403,18 @@ String InfluxdbWriter::EscapeValue(const Value& value)
 void InfluxdbWriter::SendMetric(const Checkable::Ptr& checkable, const Dictionary::Ptr& tmpl,
 	const String& label, const Dictionary::Ptr& fields, double ts)
 {
-	std::ostringstream msgbuf;
-	msgbuf << EscapeKeyOrTagValue(tmpl->Get("measurement"));
+	/* The line is appended to the data buffer directly, see below for the separator. */
+	std::string& msgbuf (m_DataBuffer.GetData());
+	size_t offset = msgbuf.size();
+
+	if (offset == 0)
+		msgbuf.reserve(GetFlushThreshold() * 128);
+	else
+		msgbuf += '\n';
+
+	size_t begin = msgbuf.size();
+
+	msgbuf += EscapeKeyOrTagValue(tmpl->Get("measurement"));
 
 	Dictionary::Ptr tags = tmpl->Get("tags");
 	if (tags) {
@@ -392,16 +422,21 @@ void InfluxdbWriter::SendMetric(const Checkable::Ptr& checkable, const Dictionar
 		for (const Dictionary::Pair& pair : tags) {
 			// Empty macro expansion, no tag
 			if (!pair.second.IsEmpty()) {
-				msgbuf << "," << EscapeKeyOrTagValue(pair.first) << "=" << EscapeKeyOrTagValue(pair.second);
+				msgbuf += ',';
+				msgbuf += EscapeKeyOrTagValue(pair.first);
+				msgbuf += '=';
+				msgbuf += EscapeKeyOrTagValue(pair.second);
 			}
 		}
 	}
 
 	// Label may be empty in the case of metadata
-	if (!label.IsEmpty())
-		msgbuf << ",metric=" << EscapeKeyOrTagValue(label);
+	if (!label.IsEmpty()) {
+		msgbuf += ",metric=";
+		msgbuf += EscapeKeyOrTagValue(label);
+	}
 
-	msgbuf << " ";
+	msgbuf += ' ';
 
 	{
 		bool first = true;
@@ -411,24 +446,26 @@ void InfluxdbWriter::SendMetric(const Checkable::Ptr& checkable, const Dictionar
 			if (first)
 				first = false;
 			else
-				msgbuf << ",";
+				msgbuf += ',';
 
-			msgbuf << EscapeKeyOrTagValue(pair.first) << "=" << EscapeValue(pair.second);
+			msgbuf += EscapeKeyOrTagValue(pair.first);
+			msgbuf += '=';
+			msgbuf += EscapeValue(pair.second);
 		}
 	}
 
-	msgbuf << " " <<  static_cast<unsigned long>(ts);
+	msgbuf += ' ';
+	msgbuf += std::to_string(static_cast<unsigned long>(ts));
 
 	Log(LogDebug, "InfluxdbWriter")
-		<< "Checkable '" << checkable->GetName() << "' adds to metric list:'" << msgbuf.str() << "'.";
+		<< "Checkable '" << checkable->GetName() << "' adds to metric list:'" << msgbuf.substr(begin) << "'.";
 
-	// Buffer the data point
-	m_DataBuffer.emplace_back(msgbuf.str());
+	m_DataBufferItems++;
 
 	// Flush if we've buffered too much to prevent excessive memory use
-	if (static_cast<int>(m_DataBuffer.size()) >= GetFlushThreshold()) {
+	if (static_cast<int>(m_DataBufferItems) >= GetFlushThreshold()) {
 		Log(LogDebug, "InfluxdbWriter")
-			<< "Data buffer overflow writing " << m_DataBuffer.size() << " data points";
+			<< "Data buffer overflow writing " << m_DataBufferItems << " data points";
 
 		try {
 			Flush();
@@ -448,42 +485,82 @@ void InfluxdbWriter::FlushTimeoutWQ()
 	AssertOnWorkQueue();
 
 	Log(LogDebug, "InfluxdbWriter")
-		<< "Timer expired writing " << m_DataBuffer.size() << " data points";
+		<< "Timer expired writing " << m_DataBufferItems << " data points";
 
 	Flush();
 }
 
 void InfluxdbWriter::Flush()
 {
-	namespace beast = boost::beast;
-	namespace http = beast::http;
-
 	/* Flush can be called from 1) Timeout 2) Threshold 3) on shutdown/reload. */
-	if (m_DataBuffer.empty())
+	if (m_DataBuffer.IsEmpty()) {
+		if (m_Spool)
+			ReplaySpool();
+
 		return;
+	}
 
 	Log(LogDebug, "InfluxdbWriter")
 		<< "Flushing data buffer to InfluxDB.";
 
-	String body = boost::algorithm::join(m_DataBuffer, "\n");
-	m_DataBuffer.clear();
+	/* Copy rather than move the data, the buffer keeps its capacity for the next data points. */
+	String body = m_DataBuffer;
 
-	OptionalTlsStream stream;
+	m_DataBuffer.GetData().clear();
+	m_DataBufferItems = 0;
 
-	try {
-		stream = Connect();
-	} catch (const std::exception& ex) {
-		Log(LogWarning, "InfluxDbWriter")
-			<< "Flush failed, cannot connect to InfluxDB: " << DiagnosticInformation(ex, false);
+	if (!m_Spool) {
+		SendRequest(body);
 		return;
 	}
 
-	Defer s ([&stream]() {
-		if (stream.first) {
-			stream.first->next_layer().shutdown();
+	/* Spool the data if InfluxDB isn't available, the spool is replayed once it is. */
+	try {
+		if (!SendRequest(body)) {
+			m_Spool->Append(body);
+			return;
+		}
+	} catch (const std::exception&) {
+		m_Spool->Append(body);
+		throw;
+	}
+
+	ReplaySpool();
+}
+
+/**
+ * Sends a chunk of the spooled data to InfluxDB.
+ */
+void InfluxdbWriter::ReplaySpool()
+{
+	if (m_Spool->IsEmpty())
+		return;
+
+	size_t count = m_Spool->Replay(PerfdataSpool::ReplayChunkSize, [this](const String& body) {
+		try {
+			return SendRequest(body);
+		} catch (const std::exception&) {
+			return false;
 		}
 	});
 
+	if (count > 0) {
+		Log(LogInformation, "InfluxdbWriter")
+			<< "Replayed " << count << " spooled requests to InfluxDB, " << m_Spool->GetSize() << " bytes left.";
+	}
+}
+
+/**
+ * Sends data points to InfluxDB.
+ *
+ * @param body The data points in the line protocol.
+ * @returns false if InfluxDB isn't available and sending should be retried later, true otherwise
+ */
+bool InfluxdbWriter::SendRequest(const String& body)
+{
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+
 	Url::Ptr url = new Url();
 	url->SetScheme(GetSslEnable() ? "https" : "http");
 	url->SetHost(GetHost());
@@ -500,10 +577,11 @@ void InfluxdbWriter::Flush()
 	if (!GetPassword().IsEmpty())
 		url->AddQueryElement("p", GetPassword());
 
-	http::request<http::string_body> request (http::verb::post, std::string(url->Format(true)), 10);
+	http::request<http::string_body> request (http::verb::post, std::string(url->Format(true)), 11);
 
 	request.set(http::field::user_agent, "Icinga/" + Application::GetAppVersion());
 	request.set(http::field::host, url->GetHost() + ":" + url->GetPort());
+	request.keep_alive(true);
 
 	{
 		Dictionary::Ptr basicAuth = GetBasicAuth();
@@ -516,33 +594,66 @@ void InfluxdbWriter::Flush()
 		}
 	}
 
-	request.body() = body;
+	if (GetEnableCompression()) {
+		request.set(http::field::content_encoding, "gzip");
+		request.body() = GzipCompress(body);
+	} else {
+		request.body() = body;
+	}
+
 	request.content_length(request.body().size());
 
-	try {
-		if (stream.first) {
-			http::write(*stream.first, request);
-			stream.first->flush();
-		} else {
-			http::write(*stream.second, request);
-			stream.second->flush();
+	/* The connection is kept open between flushes. InfluxDB might have closed it in
+	 * the meantime, so sending the request is retried once on a new connection. */
+	bool reused = m_Stream.first || m_Stream.second;
+
+	for (;;) {
+		if (!m_Stream.first && !m_Stream.second) {
+			try {
+				m_Stream = Connect();
+			} catch (const std::exception& ex) {
+				Log(LogWarning, "InfluxDbWriter")
+					<< "Flush failed, cannot connect to InfluxDB: " << DiagnosticInformation(ex, false);
+				return false;
+			}
 		}
-	} catch (const std::exception& ex) {
-		Log(LogWarning, "InfluxdbWriter")
-			<< "Cannot write to TCP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
-		throw;
+
+		try {
+			if (m_Stream.first) {
+				http::write(*m_Stream.first, request);
+				m_Stream.first->flush();
+			} else {
+				http::write(*m_Stream.second, request);
+				m_Stream.second->flush();
+			}
+		} catch (const std::exception& ex) {
+			Disconnect();
+
+			if (reused) {
+				reused = false;
+				continue;
+			}
+
+			Log(LogWarning, "InfluxdbWriter")
+				<< "Cannot write to TCP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
+			throw;
+		}
+
+		break;
 	}
 
 	http::parser<false, http::string_body> parser;
 	beast::flat_buffer buf;
 
 	try {
-		if (stream.first) {
-			http::read(*stream.first, buf, parser);
+		if (m_Stream.first) {
+			http::read(*m_Stream.first, buf, parser);
 		} else {
-			http::read(*stream.second, buf, parser);
+			http::read(*m_Stream.second, buf, parser);
 		}
 	} catch (const std::exception& ex) {
+		Disconnect();
+
 		Log(LogWarning, "InfluxdbWriter")
 			<< "Failed to parse HTTP response from host '" << GetHost() << "' port '" << GetPort() << "': " << DiagnosticInformation(ex);
 		throw;
@@ -550,6 +661,9 @@ void InfluxdbWriter::Flush()
 
 	auto& response (parser.get());
 
+	if (!response.keep_alive())
+		Disconnect();
+
 	if (response.result() != http::status::no_content) {
 		Log(LogWarning, "InfluxdbWriter")
 			<< "Unexpected response code: " << response.result();
@@ -558,7 +672,7 @@ void InfluxdbWriter::Flush()
 		if (contentType != "application/json") {
 			Log(LogWarning, "InfluxdbWriter")
 				<< "Unexpected Content-Type: " << contentType;
-			return;
+			return response.result_int() < 500 && response.result() != http::status::too_many_requests;
 		}
 
 		Dictionary::Ptr jsonResponse;
@@ -569,7 +683,7 @@ void InfluxdbWriter::Flush()
 		} catch (...) {
 			Log(LogWarning, "InfluxdbWriter")
 				<< "Unable to parse JSON response:\n" << body;
-			return;
+			return response.result_int() < 500 && response.result() != http::status::too_many_requests;
 		}
 
 		String error = jsonResponse->Get("error");
@@ -577,6 +691,9 @@ void InfluxdbWriter::Flush()
 		Log(LogCritical, "InfluxdbWriter")
 			<< "InfluxDB error message:\n" << error;
 	}
+
+	/* Server errors and throttling are temporary, the data is rejected for good otherwise. */
+	return response.result_int() < 500 && response.result() != http::status::too_many_requests;
 }
 
 void InfluxdbWriter::ValidateHostTemplate(const Lazy<Dictionary::Ptr>& lvalue, const ValidationUtils& utils)
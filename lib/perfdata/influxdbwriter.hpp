@@ -4,6 +4,7 @@
 #define INFLUXDBWRITER_H
 
 #include "perfdata/influxdbwriter-ti.hpp"
+#include "perfdata/perfdataspool.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/tcpsocket.hpp"
@@ -39,7 +40,10 @@ protected:
 private:
 	WorkQueue m_WorkQueue{10000000, 1};
 	Timer::Ptr m_FlushTimer;
-	std::vector<String> m_DataBuffer;
+	String m_DataBuffer;
+	size_t m_DataBufferItems{0};
+	OptionalTlsStream m_Stream;
+	PerfdataSpool::Ptr m_Spool;
 
 	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
 	void CheckResultHandlerWQ(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
@@ -48,11 +52,14 @@ private:
 	void FlushTimeout();
 	void FlushTimeoutWQ();
 	void Flush();
+	void ReplaySpool();
+	bool SendRequest(const String& body);
 
 	static String EscapeKeyOrTagValue(const String& str);
 	static String EscapeValue(const Value& value);
 
 	OptionalTlsStream Connect();
+	void Disconnect();
 
 	void AssertOnWorkQueue();
 
@@ -7,6 +7,9 @@
 #include "icinga/macroprocessor.hpp"
 #include "icinga/icingaapplication.hpp"
 #include "icinga/compatutility.hpp"
+#include "remote/messagecompression.hpp"
+#include "base/io-engine.hpp"
+#include "base/json.hpp"
 #include "base/tcpsocket.hpp"
 #include "base/configtype.hpp"
 #include "base/objectlock.hpp"
@@ -21,6 +24,17 @@
 #include "base/statsfunction.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http/field.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/beast/http/parser.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/status.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <boost/beast/http/verb.hpp>
+#include <boost/beast/http/write.hpp>
+#include <string>
+#include <utility>
 
 using namespace icinga;
 
@@ -35,6 +49,8 @@ void OpenTsdbWriter::OnConfigLoaded()
 {
 	ObjectImpl<OpenTsdbWriter>::OnConfigLoaded();
 
+	m_WorkQueue.SetName("OpenTsdbWriter, " + GetName());
+
 	if (!GetEnableHa()) {
 		Log(LogDebug, "OpenTsdbWriter")
 			<< "HA functionality disabled. Won't pause connection: " << GetName();
@@ -56,6 +72,7 @@ void OpenTsdbWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
 
 	for (const OpenTsdbWriter::Ptr& opentsdbwriter : ConfigType::GetObjectsByType<OpenTsdbWriter>()) {
 		nodes.emplace_back(opentsdbwriter->GetName(), new Dictionary({
+			{ "work_queue_items", opentsdbwriter->m_WorkQueue.GetLength() },
 			{ "connected", opentsdbwriter->GetConnected() }
 		}));
 	}
@@ -75,11 +92,33 @@ void OpenTsdbWriter::Resume()
 
 	ReadConfigTemplate(m_ServiceConfigTemplate, m_HostConfigTemplate);
 
-	m_ReconnectTimer = new Timer();
-	m_ReconnectTimer->SetInterval(10);
-	m_ReconnectTimer->OnTimerExpired.connect(std::bind(&OpenTsdbWriter::ReconnectTimerHandler, this));
-	m_ReconnectTimer->Start();
-	m_ReconnectTimer->Reschedule(0);
+	/* The spool is kept while paused, a new one would replay what's been replayed already. */
+	if (GetEnableSpool() && !m_Spool) {
+		try {
+			/* HTTP batches mustn't be replayed to the telnet interface and vice versa. */
+			m_Spool = new PerfdataSpool(PerfdataSpool::GetWriterPath("OpenTsdbWriter", GetEnableHttp() ? GetName() + "-http" : GetName()));
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "OpenTsdbWriter")
+				<< "Cannot open spool for '" << GetName() << "', data will be dropped while OpenTSDB isn't available: " << DiagnosticInformation(ex, false);
+		}
+	}
+
+	if (GetEnableHttp()) {
+		/* Each batch is sent with its own request, there's no connection to keep up. */
+		m_WorkQueue.SetExceptionCallback(std::bind(&OpenTsdbWriter::ExceptionHandler, this, _1));
+
+		m_FlushTimer = new Timer();
+		m_FlushTimer->SetInterval(GetFlushInterval());
+		m_FlushTimer->OnTimerExpired.connect(std::bind(&OpenTsdbWriter::FlushTimeout, this));
+		m_FlushTimer->Start();
+		m_FlushTimer->Reschedule(0);
+	} else {
+		m_ReconnectTimer = new Timer();
+		m_ReconnectTimer->SetInterval(10);
+		m_ReconnectTimer->OnTimerExpired.connect(std::bind(&OpenTsdbWriter::ReconnectTimerHandler, this));
+		m_ReconnectTimer->Start();
+		m_ReconnectTimer->Reschedule(0);
+	}
 
 	Service::OnNewCheckResult.connect(std::bind(&OpenTsdbWriter::CheckResultHandler, this, _1, _2));
 }
@@ -90,11 +129,22 @@ void OpenTsdbWriter::Resume()
 void OpenTsdbWriter::Pause()
 {
 	m_ReconnectTimer.reset();
+	m_FlushTimer.reset();
 
 	Log(LogInformation, "OpentsdbWriter")
 		<< "'" << GetName() << "' paused.";
 
-	m_Stream->close();
+	if (GetEnableHttp()) {
+		{
+			ObjectLock olock(this);
+			Flush();
+		}
+
+		m_WorkQueue.Join();
+		m_HttpStream.reset();
+	} else {
+		m_Stream->close();
+	}
 
 	SetConnected(false);
 
@@ -112,8 +162,12 @@ void OpenTsdbWriter::ReconnectTimerHandler()
 
 	SetShouldConnect(true);
 
-	if (GetConnected())
+	if (GetConnected()) {
+		if (m_Spool)
+			ReplaySpool();
+
 		return;
+	}
 
 	double startTime = Utility::GetTime();
 
@@ -141,6 +195,55 @@ void OpenTsdbWriter::ReconnectTimerHandler()
 
 	Log(LogInformation, "OpenTsdbWriter")
 		<< "Finished reconnecting to OpenTSDB in " << std::setw(2) << Utility::GetTime() - startTime << " second(s).";
+
+	if (m_Spool)
+		ReplaySpool();
+}
+
+/**
+ * Sends a chunk of the spooled metrics to OpenTSDB.
+ */
+void OpenTsdbWriter::ReplaySpool()
+{
+	if (m_Spool->IsEmpty())
+		return;
+
+	size_t count;
+
+	if (GetEnableHttp()) {
+		/* Called inside the WQ. */
+		count = m_Spool->Replay(PerfdataSpool::ReplayChunkSize, [this](const String& body) {
+			try {
+				return SendRequest(body);
+			} catch (const std::exception&) {
+				return false;
+			}
+		});
+	} else {
+		ObjectLock olock(this);
+
+		if (!GetConnected())
+			return;
+
+		count = m_Spool->Replay(PerfdataSpool::ReplayChunkSize, [this](const String& put) {
+			try {
+				boost::asio::write(*m_Stream, boost::asio::buffer(put.CStr(), put.GetLength()));
+				m_Stream->flush();
+			} catch (const std::exception&) {
+				m_Stream->close();
+				SetConnected(false);
+
+				return false;
+			}
+
+			return true;
+		});
+	}
+
+	if (count > 0) {
+		Log(LogInformation, "OpenTsdbWriter")
+			<< "Replayed " << count << " spooled metrics to OpenTSDB, " << m_Spool->GetSize() << " bytes left.";
+	}
 }
 
 /**
@@ -162,83 +265,16 @@ void OpenTsdbWriter::CheckResultHandler(const Checkable::Ptr& checkable, const C
 
 	Service::Ptr service = dynamic_pointer_cast<Service>(checkable);
 	Host::Ptr host;
-	Dictionary::Ptr config_tmpl;
-	Dictionary::Ptr config_tmpl_tags;
-	String config_tmpl_metric;
 
-	if (service) {
+	if (service)
 		host = service->GetHost();
-		config_tmpl = m_ServiceConfigTemplate;
-	}
-	else {
+	else
 		host = static_pointer_cast<Host>(checkable);
-		config_tmpl = m_HostConfigTemplate;
-	}
-
-	// Get the tags nested dictionary in the service/host template in the config
-	if (config_tmpl) {
-		config_tmpl_tags = config_tmpl->Get("tags");
-		config_tmpl_metric = config_tmpl->Get("metric");
-	}
 
+	TagSet tagSet = GetTagSet(checkable, host, service, cr);
+	String config_tmpl_metric = tagSet.Metric;
+	std::map<String, String>& tags (tagSet.Tags);
 	String metric;
-	std::map<String, String> tags;
-
-	// Resolve macros in configuration template and build custom tag list
-	if (config_tmpl_tags || !config_tmpl_metric.IsEmpty()) {
-
-		// Configure config template macro resolver
-		MacroProcessor::ResolverList resolvers;
-		if (service)
-			resolvers.emplace_back("service", service);
-		resolvers.emplace_back("host", host);
-		resolvers.emplace_back("icinga", IcingaApplication::GetInstance());
-		
-		// Resolve macros for the service and host template config line
-		if (config_tmpl_tags) {
-			ObjectLock olock(config_tmpl_tags);
-			
-			for (const Dictionary::Pair& pair : config_tmpl_tags) {
-				
-				String missing_macro;
-				Value value = MacroProcessor::ResolveMacros(pair.second, resolvers, cr, &missing_macro);
-				
-				if (!missing_macro.IsEmpty()) {
-					Log(LogDebug, "OpenTsdbWriter")
-						<< "Unable to resolve macro:'" << missing_macro 
-						<< "' for this host or service.";
-					
-					continue;
-				}
-				
-				String tagname = Convert::ToString(pair.first);
-				tags[tagname] = EscapeTag(value);
-				
-			}
-		}
-		
-		// Resolve macros for the metric config line
-		if (!config_tmpl_metric.IsEmpty()) {
-			
-			String missing_macro;
-			Value value = MacroProcessor::ResolveMacros(config_tmpl_metric, resolvers, cr, &missing_macro);
-			
-			if (!missing_macro.IsEmpty()) {
-				Log(LogDebug, "OpenTsdbWriter")
-					<< "Unable to resolve macro:'" << missing_macro 
-					<< "' for this host or service.";
-				
-			}
-			else {
-			
-				config_tmpl_metric = Convert::ToString(value);
-			
-			}
-		}
-	}
-
-	String escaped_hostName = EscapeTag(host->GetName());
-	tags["host"] = escaped_hostName;
 
 	double ts = cr->GetExecutionEnd();
 
@@ -287,6 +323,107 @@ void OpenTsdbWriter::CheckResultHandler(const Checkable::Ptr& checkable, const C
 	SendMetric(checkable, metric + ".execution_time", tags, cr->CalculateExecutionTime(), ts);
 }
 
+/**
+ * Resolves the metric and tags from the host/service template of a checkable.
+ * Resolving the macros for every check result is expensive, so the result is
+ * cached until the host or service is modified.
+ *
+ * @param checkable Host/service object
+ * @param host Host object
+ * @param service Service object, if any
+ * @param cr Check result
+ * @return Metric (empty if not configured) and tags including the host tag
+ */
+OpenTsdbWriter::TagSet OpenTsdbWriter::GetTagSet(const Checkable::Ptr& checkable, const Host::Ptr& host,
+	const Service::Ptr& service, const CheckResult::Ptr& cr)
+{
+	double hostVersion = host->GetVersion();
+	double serviceVersion = service ? service->GetVersion() : 0;
+
+	{
+		std::unique_lock<std::mutex> lock (m_TagSetsMutex);
+		auto it (m_TagSets.find(checkable->GetName()));
+
+		if (it != m_TagSets.end() && it->second.HostVersion == hostVersion && it->second.ServiceVersion == serviceVersion)
+			return it->second;
+	}
+
+	TagSet tagSet;
+	tagSet.HostVersion = hostVersion;
+	tagSet.ServiceVersion = serviceVersion;
+
+	Dictionary::Ptr config_tmpl = service ? m_ServiceConfigTemplate : m_HostConfigTemplate;
+	Dictionary::Ptr config_tmpl_tags;
+	String config_tmpl_metric;
+
+	// Get the tags nested dictionary in the service/host template in the config
+	if (config_tmpl) {
+		config_tmpl_tags = config_tmpl->Get("tags");
+		config_tmpl_metric = config_tmpl->Get("metric");
+	}
+
+	// Resolve macros in configuration template and build custom tag list
+	if (config_tmpl_tags || !config_tmpl_metric.IsEmpty()) {
+
+		// Configure config template macro resolver
+		MacroProcessor::ResolverList resolvers;
+		if (service)
+			resolvers.emplace_back("service", service);
+		resolvers.emplace_back("host", host);
+		resolvers.emplace_back("icinga", IcingaApplication::GetInstance());
+
+		// Resolve macros for the service and host template config line
+		if (config_tmpl_tags) {
+			ObjectLock olock(config_tmpl_tags);
+
+			for (const Dictionary::Pair& pair : config_tmpl_tags) {
+
+				String missing_macro;
+				Value value = MacroProcessor::ResolveMacros(pair.second, resolvers, cr, &missing_macro);
+
+				if (!missing_macro.IsEmpty()) {
+					Log(LogDebug, "OpenTsdbWriter")
+						<< "Unable to resolve macro:'" << missing_macro
+						<< "' for this host or service.";
+
+					continue;
+				}
+
+				String tagname = Convert::ToString(pair.first);
+				tagSet.Tags[tagname] = EscapeTag(value);
+
+			}
+		}
+
+		// Resolve macros for the metric config line
+		if (!config_tmpl_metric.IsEmpty()) {
+
+			String missing_macro;
+			Value value = MacroProcessor::ResolveMacros(config_tmpl_metric, resolvers, cr, &missing_macro);
+
+			if (!missing_macro.IsEmpty()) {
+				Log(LogDebug, "OpenTsdbWriter")
+					<< "Unable to resolve macro:'" << missing_macro
+					<< "' for this host or service.";
+
+			}
+			else {
+
+				tagSet.Metric = Convert::ToString(value);
+
+			}
+		}
+	}
+
+	String escaped_hostName = EscapeTag(host->GetName());
+	tagSet.Tags["host"] = escaped_hostName;
+
+	std::unique_lock<std::mutex> lock (m_TagSetsMutex);
+	m_TagSets[checkable->GetName()] = tagSet;
+
+	return tagSet;
+}
+
 /**
  * Parse and send performance data metrics to OpenTSDB
  *
@@ -299,29 +436,22 @@ void OpenTsdbWriter::CheckResultHandler(const Checkable::Ptr& checkable, const C
 void OpenTsdbWriter::SendPerfdata(const Checkable::Ptr& checkable, const String& metric,
 	const std::map<String, String>& tags, const CheckResult::Ptr& cr, double ts)
 {
-	Array::Ptr perfdata = cr->GetPerformanceData();
+	auto perfdata (cr->GetParsedPerformanceData());
 
-	if (!perfdata)
+	if (perfdata->empty())
 		return;
 
 	CheckCommand::Ptr checkCommand = checkable->GetCheckCommand();
 
-	ObjectLock olock(perfdata);
-	for (const Value& val : perfdata) {
-		PerfdataValue::Ptr pdv;
+	for (auto& entry : *perfdata) {
+		const PerfdataValue::Ptr& pdv = entry.Parsed;
 
-		if (val.IsObjectType<PerfdataValue>())
-			pdv = val;
-		else {
-			try {
-				pdv = PerfdataValue::Parse(val);
-			} catch (const std::exception&) {
-				Log(LogWarning, "OpenTsdbWriter")
-					<< "Ignoring invalid perfdata for checkable '"
-					<< checkable->GetName() << "' and command '"
-					<< checkCommand->GetName() << "' with value: " << val;
-				continue;
-			}
+		if (!pdv) {
+			Log(LogWarning, "OpenTsdbWriter")
+				<< "Ignoring invalid perfdata for checkable '"
+				<< checkable->GetName() << "' and command '"
+				<< checkCommand->GetName() << "' with value: " << entry.Raw;
+			continue;
 		}
 		
 		String metric_name;
@@ -364,6 +494,33 @@ void OpenTsdbWriter::SendPerfdata(const Checkable::Ptr& checkable, const String&
 void OpenTsdbWriter::SendMetric(const Checkable::Ptr& checkable, const String& metric,
 	const std::map<String, String>& tags, double value, double ts)
 {
+	if (GetEnableHttp()) {
+		DictionaryData tagData;
+
+		for (auto& tag : tags)
+			tagData.emplace_back(tag.first, tag.second);
+
+		String point = JsonEncode(new Dictionary({
+			{ "metric", metric },
+			{ "timestamp", static_cast<long>(ts) },
+			{ "value", value },
+			{ "tags", new Dictionary(std::move(tagData)) }
+		}));
+
+		Log(LogDebug, "OpenTsdbWriter")
+			<< "Checkable '" << checkable->GetName() << "' adds to metric list: '" << point << "'.";
+
+		ObjectLock olock(this);
+
+		m_DataBuffer.emplace_back(std::move(point));
+
+		/* Flush if we've buffered too much to prevent excessive memory use. */
+		if (static_cast<int>(m_DataBuffer.size()) >= GetFlushThreshold())
+			Flush();
+
+		return;
+	}
+
 	String tags_string = "";
 
 	for (const Dictionary::Pair& tag : tags) {
@@ -387,8 +544,12 @@ void OpenTsdbWriter::SendMetric(const Checkable::Ptr& checkable, const String& m
 
 	ObjectLock olock(this);
 
-	if (!GetConnected())
+	if (!GetConnected()) {
+		if (m_Spool)
+			m_Spool->Append(put);
+
 		return;
+	}
 
 	try {
 		Log(LogDebug, "OpenTsdbWriter")
@@ -399,9 +560,193 @@ void OpenTsdbWriter::SendMetric(const Checkable::Ptr& checkable, const String& m
 	} catch (const std::exception& ex) {
 		Log(LogCritical, "OpenTsdbWriter")
 			<< "Cannot write to TCP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
+
+		/* Reconnect (and replay the spool) with the next reconnect timer run. */
+		if (m_Spool) {
+			m_Spool->Append(put);
+
+			m_Stream->close();
+			SetConnected(false);
+		}
 	}
 }
 
+/**
+ * Flush timer handler, sends the buffered data points (if any) or else a
+ * chunk of the spool.
+ */
+void OpenTsdbWriter::FlushTimeout()
+{
+	ObjectLock olock(this);
+
+	if (!m_DataBuffer.empty())
+		Flush();
+	else if (m_Spool)
+		m_WorkQueue.Enqueue(std::bind(&OpenTsdbWriter::ReplaySpool, this));
+}
+
+/**
+ * Hands the buffered data points as one batch to the WQ.
+ *
+ * Called with the object locked.
+ */
+void OpenTsdbWriter::Flush()
+{
+	if (m_DataBuffer.empty())
+		return;
+
+	String body = "[" + boost::algorithm::join(m_DataBuffer, ",") + "]";
+	m_DataBuffer.clear();
+
+	m_WorkQueue.Enqueue(std::bind(&OpenTsdbWriter::SendBatch, this, std::move(body)));
+}
+
+/**
+ * Sends a batch of data points, spools it if OpenTSDB isn't available.
+ *
+ * Called inside the WQ.
+ *
+ * @param body JSON array of data points
+ */
+void OpenTsdbWriter::SendBatch(const String& body)
+{
+	try {
+		if (!SendRequest(body)) {
+			if (m_Spool)
+				m_Spool->Append(body);
+
+			return;
+		}
+	} catch (const std::exception&) {
+		if (m_Spool)
+			m_Spool->Append(body);
+
+		throw;
+	}
+
+	if (m_Spool)
+		ReplaySpool();
+}
+
+/**
+ * Sends a batch of data points to the HTTP API (/api/put). The connection
+ * is kept open between batches.
+ *
+ * Called inside the WQ.
+ *
+ * @param body JSON array of data points
+ * @returns false if OpenTSDB isn't available and sending should be retried later, true otherwise
+ */
+bool OpenTsdbWriter::SendRequest(const String& body)
+{
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+
+	http::request<http::string_body> request (http::verb::post, "/api/put", 11);
+
+	request.set(http::field::user_agent, "Icinga/" + Application::GetAppVersion());
+	request.set(http::field::host, GetHost() + ":" + GetPort());
+	request.set(http::field::content_type, "application/json");
+	request.keep_alive(true);
+
+	if (GetEnableCompression()) {
+		request.set(http::field::content_encoding, "gzip");
+		request.body() = GzipCompress(body);
+	} else {
+		request.body() = body;
+	}
+
+	request.content_length(request.body().size());
+
+	/* OpenTSDB might have closed the connection in the meantime, so sending
+	 * the request is retried once on a new connection. */
+	bool reused = (bool)m_HttpStream;
+
+	for (;;) {
+		if (!m_HttpStream) {
+			auto stream (Shared<AsioTcpStream>::Make(IoEngine::Get().GetIoContext()));
+
+			try {
+				icinga::Connect(stream->lowest_layer(), GetHost(), GetPort());
+			} catch (const std::exception&) {
+				Log(LogWarning, "OpenTsdbWriter")
+					<< "Can't connect to OpenTSDB on host '" << GetHost() << "' port '" << GetPort() << "'.";
+
+				SetConnected(false);
+				return false;
+			}
+
+			m_HttpStream = std::move(stream);
+		}
+
+		try {
+			http::write(*m_HttpStream, request);
+			m_HttpStream->flush();
+		} catch (const std::exception&) {
+			m_HttpStream.reset();
+
+			if (reused) {
+				reused = false;
+				continue;
+			}
+
+			Log(LogWarning, "OpenTsdbWriter")
+				<< "Cannot write to HTTP API on host '" << GetHost() << "' port '" << GetPort() << "'.";
+
+			SetConnected(false);
+			return false;
+		}
+
+		break;
+	}
+
+	http::parser<false, http::string_body> parser;
+	beast::flat_buffer buf;
+
+	try {
+		http::read(*m_HttpStream, buf, parser);
+	} catch (const std::exception& ex) {
+		m_HttpStream.reset();
+
+		Log(LogWarning, "OpenTsdbWriter")
+			<< "Failed to parse HTTP response from host '" << GetHost() << "' port '" << GetPort() << "': " << DiagnosticInformation(ex, false);
+
+		SetConnected(false);
+		return false;
+	}
+
+	SetConnected(true);
+
+	auto& response (parser.get());
+
+	if (!response.keep_alive())
+		m_HttpStream.reset();
+
+	if (response.result_int() > 299) {
+		Log(LogCritical, "OpenTsdbWriter")
+			<< "Unexpected response code " << response.result_int() << " from host '" << GetHost()
+			<< "' port '" << GetPort() << "': " << response.body();
+	}
+
+	/* Server errors and throttling are temporary, invalid data points are rejected for good. */
+	return response.result_int() < 500 && response.result() != http::status::too_many_requests;
+}
+
+/**
+ * Exception handler for the WQ.
+ *
+ * @param exp Exception pointer
+ */
+void OpenTsdbWriter::ExceptionHandler(boost::exception_ptr exp)
+{
+	Log(LogCritical, "OpenTsdbWriter", "Exception during OpenTSDB operation: Verify that your backend is operational!");
+
+	Log(LogDebug, "OpenTsdbWriter")
+		<< "Exception during OpenTSDB operation: " << DiagnosticInformation(std::move(exp));
+
+	m_HttpStream.reset();
+}
+
 /**
  * Escape tags for OpenTSDB
  * http://opentsdb.net/docs/build/html/user_guide/query/timeseries.html#precisions-on-metrics-and-tags
@@ -4,11 +4,16 @@
 #define OPENTSDBWRITER_H
 
 #include "perfdata/opentsdbwriter-ti.hpp"
+#include "perfdata/perfdataspool.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/tcpsocket.hpp"
 #include "base/timer.hpp"
+#include "base/workqueue.hpp"
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <vector>
 
 namespace icinga
 {
@@ -36,13 +41,33 @@ protected:
 
 private:
 	Shared<AsioTcpStream>::Ptr m_Stream;
+	PerfdataSpool::Ptr m_Spool;
 
 	Timer::Ptr m_ReconnectTimer;
 
+	/* HTTP mode: data points are buffered and sent in batches by the WQ. */
+	WorkQueue m_WorkQueue{10000000, 1};
+	Timer::Ptr m_FlushTimer;
+	std::vector<String> m_DataBuffer;
+	Shared<AsioTcpStream>::Ptr m_HttpStream;
+
+	/* The metric and tags of a checkable from the templates, valid as long as neither its host nor its service changed. */
+	struct TagSet
+	{
+		double HostVersion;
+		double ServiceVersion;
+		String Metric;
+		std::map<String, String> Tags;
+	};
+
+	std::map<String, TagSet> m_TagSets;
+	std::mutex m_TagSetsMutex;
+
 	Dictionary::Ptr m_ServiceConfigTemplate;
 	Dictionary::Ptr m_HostConfigTemplate;
 
 	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
+	TagSet GetTagSet(const Checkable::Ptr& checkable, const Host::Ptr& host, const Service::Ptr& service, const CheckResult::Ptr& cr);
 	void SendMetric(const Checkable::Ptr& checkable, const String& metric,
 		const std::map<String, String>& tags, double value, double ts);
 	void SendPerfdata(const Checkable::Ptr& checkable, const String& metric,
@@ -51,6 +76,13 @@ private:
 	static String EscapeMetric(const String& str);
 
 	void ReconnectTimerHandler();
+	void ReplaySpool();
+
+	void FlushTimeout();
+	void Flush();
+	void SendBatch(const String& body);
+	bool SendRequest(const String& body);
+	void ExceptionHandler(boost::exception_ptr exp);
 
 	void ReadConfigTemplate(const Dictionary::Ptr& stemplate, 
 		const Dictionary::Ptr& htemplate);
@@ -0,0 +1,405 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "perfdata/otlptracewriter.hpp"
+#include "perfdata/otlptracewriter-ti.cpp"
+#include "remote/url.hpp"
+#include "icinga/icingaapplication.hpp"
+#include "base/application.hpp"
+#include "base/configtype.hpp"
+#include "base/convert.hpp"
+#include "base/io-engine.hpp"
+#include "base/tcpsocket.hpp"
+#include "base/json.hpp"
+#include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/exception.hpp"
+#include "base/statsfunction.hpp"
+#include <boost/asio/ssl/context.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http/field.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/beast/http/parser.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <boost/beast/http/verb.hpp>
+#include <boost/beast/http/write.hpp>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+
+using namespace icinga;
+
+REGISTER_TYPE(OtlpTraceWriter);
+
+REGISTER_STATSFUNCTION(OtlpTraceWriter, &OtlpTraceWriter::StatsFunc);
+
+void OtlpTraceWriter::OnConfigLoaded()
+{
+	ObjectImpl<OtlpTraceWriter>::OnConfigLoaded();
+
+	m_WorkQueue.SetName("OtlpTraceWriter, " + GetName());
+
+	/* Every endpoint exports the spans it has seen itself. */
+	SetHAMode(HARunEverywhere);
+}
+
+void OtlpTraceWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	DictionaryData nodes;
+
+	for (const OtlpTraceWriter::Ptr& otlptracewriter : ConfigType::GetObjectsByType<OtlpTraceWriter>()) {
+		size_t workQueueItems = otlptracewriter->m_WorkQueue.GetLength();
+		double workQueueItemRate = otlptracewriter->m_WorkQueue.GetTaskCount(60) / 60.0;
+		uint_fast64_t droppedSpans = otlptracewriter->m_DroppedSpans.load();
+
+		nodes.emplace_back(otlptracewriter->GetName(), new Dictionary({
+			{ "work_queue_items", workQueueItems },
+			{ "work_queue_item_rate", workQueueItemRate },
+			{ "dropped_spans", droppedSpans }
+		}));
+
+		perfdata->Add(new PerfdataValue("otlptracewriter_" + otlptracewriter->GetName() + "_work_queue_items", workQueueItems));
+		perfdata->Add(new PerfdataValue("otlptracewriter_" + otlptracewriter->GetName() + "_work_queue_item_rate", workQueueItemRate));
+		perfdata->Add(new PerfdataValue("otlptracewriter_" + otlptracewriter->GetName() + "_dropped_spans", droppedSpans, true));
+	}
+
+	status->Set("otlptracewriter", new Dictionary(std::move(nodes)));
+}
+
+void OtlpTraceWriter::Resume()
+{
+	ObjectImpl<OtlpTraceWriter>::Resume();
+
+	Log(LogInformation, "OtlpTraceWriter")
+		<< "'" << GetName() << "' resumed, tracing " << GetSampleRatio() * 100 << "% of the checks.";
+
+	m_WorkQueue.SetExceptionCallback(std::bind(&OtlpTraceWriter::ExceptionHandler, this, _1));
+
+	/* Setup timer for periodically flushing m_Spans */
+	m_FlushTimer = new Timer();
+	m_FlushTimer->SetInterval(GetFlushInterval());
+	m_FlushTimer->OnTimerExpired.connect(std::bind(&OtlpTraceWriter::FlushTimeout, this));
+	m_FlushTimer->Start();
+	m_FlushTimer->Reschedule(0);
+
+	/* Spans are only emitted once someone listens, so connect before sampling starts. */
+	Tracing::OnSpanEnded.connect(std::bind(&OtlpTraceWriter::SpanEndedHandler, this, _1));
+	Tracing::SetSampleRatio(GetSampleRatio());
+}
+
+/* Pause is equivalent to Stop, but with HA capabilities to resume at runtime. */
+void OtlpTraceWriter::Pause()
+{
+	Tracing::SetSampleRatio(0);
+
+	m_WorkQueue.Enqueue(std::bind(&OtlpTraceWriter::Flush, this));
+	m_WorkQueue.Join();
+
+	Disconnect();
+
+	Log(LogInformation, "OtlpTraceWriter")
+		<< "'" << GetName() << "' paused.";
+
+	ObjectImpl<OtlpTraceWriter>::Pause();
+}
+
+void OtlpTraceWriter::ValidateSampleRatio(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<OtlpTraceWriter>::ValidateSampleRatio(lvalue, utils);
+
+	if (!(lvalue() >= 0 && lvalue() <= 1))
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "sample_ratio" }, "Value must be between 0 and 1."));
+}
+
+/**
+ * Buffers a finished span. It's called synchronously by whoever ended the
+ * span (e.g. the check result processing), so it doesn't do any I/O.
+ */
+void OtlpTraceWriter::SpanEndedHandler(const TraceSpan& span)
+{
+	if (IsPaused())
+		return;
+
+	std::unique_lock<std::mutex> lock(m_SpansMutex);
+
+	/* Traces are a sample anyway, drop spans rather than buffering without limit
+	 * while the collector isn't available.
+	 */
+	if (m_Spans.size() >= static_cast<size_t>(GetFlushThreshold()) * 10) {
+		m_DroppedSpans.fetch_add(1);
+		return;
+	}
+
+	m_Spans.push_back(span);
+
+	if (m_Spans.size() == static_cast<size_t>(GetFlushThreshold()))
+		m_WorkQueue.Enqueue(std::bind(&OtlpTraceWriter::Flush, this));
+}
+
+void OtlpTraceWriter::FlushTimeout()
+{
+	m_WorkQueue.Enqueue(std::bind(&OtlpTraceWriter::Flush, this));
+}
+
+/**
+ * Converts a span into the OTLP JSON encoding.
+ *
+ * @param span The span.
+ * @returns The span as in the "spans" array of an ExportTraceServiceRequest.
+ */
+Dictionary::Ptr OtlpTraceWriter::SpanToOtlp(const TraceSpan& span)
+{
+	/* int64 values are encoded as strings, as JSON numbers can't represent nanoseconds since the epoch. */
+	auto formatNanoseconds ([](double ts) -> String {
+		return Convert::ToString(static_cast<unsigned long long>(std::llround(ts * 1e6)) * 1000ull);
+	});
+
+	ArrayData attributes;
+
+	if (span.Attributes) {
+		ObjectLock olock(span.Attributes);
+
+		for (const Dictionary::Pair& kv : span.Attributes) {
+			Dictionary::Ptr value;
+
+			if (kv.second.IsBoolean())
+				value = new Dictionary({ { "boolValue", kv.second } });
+			else if (kv.second.IsNumber())
+				value = new Dictionary({ { "doubleValue", kv.second } });
+			else
+				value = new Dictionary({ { "stringValue", Convert::ToString(kv.second) } });
+
+			attributes.emplace_back(new Dictionary({
+				{ "key", kv.first },
+				{ "value", value }
+			}));
+		}
+	}
+
+	Dictionary::Ptr result = new Dictionary({
+		{ "traceId", span.TraceId },
+		{ "spanId", span.SpanId },
+		{ "name", span.Name },
+		{ "kind", 1 }, /* SPAN_KIND_INTERNAL */
+		{ "startTimeUnixNano", formatNanoseconds(span.Start) },
+		{ "endTimeUnixNano", formatNanoseconds(span.End) },
+		{ "attributes", new Array(std::move(attributes)) }
+	});
+
+	if (!span.ParentSpanId.IsEmpty())
+		result->Set("parentSpanId", span.ParentSpanId);
+
+	return result;
+}
+
+void OtlpTraceWriter::Flush()
+{
+	std::vector<TraceSpan> spans;
+
+	{
+		std::unique_lock<std::mutex> lock(m_SpansMutex);
+		std::swap(spans, m_Spans);
+	}
+
+	if (spans.empty())
+		return;
+
+	Log(LogDebug, "OtlpTraceWriter")
+		<< "Exporting " << spans.size() << " spans.";
+
+	ArrayData otlpSpans;
+	otlpSpans.reserve(spans.size());
+
+	for (auto& span : spans)
+		otlpSpans.emplace_back(SpanToOtlp(span));
+
+	Array::Ptr resourceAttributes = new Array({
+		new Dictionary({
+			{ "key", "service.name" },
+			{ "value", new Dictionary({ { "stringValue", GetServiceName() } }) }
+		}),
+		new Dictionary({
+			{ "key", "host.name" },
+			{ "value", new Dictionary({ { "stringValue", IcingaApplication::GetInstance()->GetNodeName() } }) }
+		})
+	});
+
+	Dictionary::Ptr request = new Dictionary({
+		{ "resourceSpans", new Array({
+			new Dictionary({
+				{ "resource", new Dictionary({ { "attributes", resourceAttributes } }) },
+				{ "scopeSpans", new Array({
+					new Dictionary({
+						{ "scope", new Dictionary({
+							{ "name", "icinga2" },
+							{ "version", Application::GetAppVersion() }
+						}) },
+						{ "spans", new Array(std::move(otlpSpans)) }
+					})
+				}) }
+			})
+		}) }
+	});
+
+	SendRequest(JsonEncode(request));
+}
+
+/**
+ * Sends an ExportTraceServiceRequest to the collector.
+ *
+ * @param body The request in the OTLP JSON encoding.
+ */
+void OtlpTraceWriter::SendRequest(const String& body)
+{
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+
+	Url::Ptr url = new Url();
+
+	url->SetScheme(GetEnableTls() ? "https" : "http");
+	url->SetHost(GetHost());
+	url->SetPort(GetPort());
+	url->SetPath({ "v1", "traces" });
+
+	http::request<http::string_body> request (http::verb::post, std::string(url->Format(true)), 11);
+
+	request.set(http::field::user_agent, "Icinga/" + Application::GetAppVersion());
+	request.set(http::field::host, url->GetHost() + ":" + url->GetPort());
+	request.set(http::field::content_type, "application/json");
+	request.keep_alive(true);
+
+	request.body() = body;
+	request.content_length(request.body().size());
+
+	/* The connection is kept open between flushes. The collector might have closed it
+	 * in the meantime, so sending the request is retried once on a new connection. */
+	bool reused = m_Stream.first || m_Stream.second;
+
+	for (;;) {
+		if (!m_Stream.first && !m_Stream.second)
+			m_Stream = Connect();
+
+		try {
+			if (m_Stream.first) {
+				http::write(*m_Stream.first, request);
+				m_Stream.first->flush();
+			} else {
+				http::write(*m_Stream.second, request);
+				m_Stream.second->flush();
+			}
+		} catch (const std::exception&) {
+			Disconnect();
+
+			if (reused) {
+				reused = false;
+				continue;
+			}
+
+			Log(LogWarning, "OtlpTraceWriter")
+				<< "Cannot write to the OTLP collector on host '" << GetHost() << "' port '" << GetPort() << "'.";
+			throw;
+		}
+
+		break;
+	}
+
+	http::parser<false, http::string_body> parser;
+	beast::flat_buffer buf;
+
+	try {
+		if (m_Stream.first) {
+			http::read(*m_Stream.first, buf, parser);
+		} else {
+			http::read(*m_Stream.second, buf, parser);
+		}
+	} catch (const std::exception& ex) {
+		Disconnect();
+
+		Log(LogWarning, "OtlpTraceWriter")
+			<< "Failed to parse HTTP response from host '" << GetHost() << "' port '" << GetPort() << "': " << DiagnosticInformation(ex, false);
+		throw;
+	}
+
+	auto& response (parser.get());
+
+	if (!response.keep_alive())
+		Disconnect();
+
+	if (response.result_int() > 299) {
+		Log(LogWarning, "OtlpTraceWriter")
+			<< "Unexpected response code " << response.result_int() << " from URL '" << url->Format() << "', spans have been dropped.";
+	}
+}
+
+OptionalTlsStream OtlpTraceWriter::Connect()
+{
+	Log(LogNotice, "OtlpTraceWriter")
+		<< "Connecting to the OTLP collector on host '" << GetHost() << "' port '" << GetPort() << "'.";
+
+	OptionalTlsStream stream;
+	bool tls = GetEnableTls();
+
+	if (tls) {
+		Shared<boost::asio::ssl::context>::Ptr sslContext;
+
+		try {
+			sslContext = MakeAsioSslContext(GetCertPath(), GetKeyPath(), GetCaPath());
+		} catch (const std::exception&) {
+			Log(LogWarning, "OtlpTraceWriter")
+				<< "Unable to create SSL context.";
+			throw;
+		}
+
+		stream.first = Shared<AsioTlsStream>::Make(IoEngine::Get().GetIoContext(), *sslContext, GetHost());
+	} else {
+		stream.second = Shared<AsioTcpStream>::Make(IoEngine::Get().GetIoContext());
+	}
+
+	try {
+		icinga::Connect(tls ? stream.first->lowest_layer() : stream.second->lowest_layer(), GetHost(), GetPort());
+	} catch (const std::exception&) {
+		Log(LogWarning, "OtlpTraceWriter")
+			<< "Can't connect to the OTLP collector on host '" << GetHost() << "' port '" << GetPort() << "'.";
+		throw;
+	}
+
+	if (tls) {
+		auto& tlsStream (stream.first->next_layer());
+
+		try {
+			tlsStream.handshake(tlsStream.client);
+		} catch (const std::exception&) {
+			Log(LogWarning, "OtlpTraceWriter")
+				<< "TLS handshake with host '" << GetHost() << "' on port " << GetPort() << " failed.";
+			throw;
+		}
+	}
+
+	return std::move(stream);
+}
+
+/**
+ * Closes the connection which is kept open between flushes (if any).
+ */
+void OtlpTraceWriter::Disconnect()
+{
+	if (m_Stream.first) {
+		try {
+			m_Stream.first->next_layer().shutdown();
+		} catch (const std::exception&) {
+			/* The connection is being dropped anyway. */
+		}
+	}
+
+	m_Stream = OptionalTlsStream();
+}
+
+void OtlpTraceWriter::ExceptionHandler(boost::exception_ptr exp)
+{
+	Log(LogWarning, "OtlpTraceWriter")
+		<< "Cannot export spans, verify that the OTLP collector is operational: " << DiagnosticInformation(std::move(exp), false);
+
+	Disconnect();
+}
@@ -0,0 +1,61 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef OTLPTRACEWRITER_H
+#define OTLPTRACEWRITER_H
+
+#include "perfdata/otlptracewriter-ti.hpp"
+#include "base/configobject.hpp"
+#include "base/workqueue.hpp"
+#include "base/timer.hpp"
+#include "base/tlsstream.hpp"
+#include "base/tracing.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * Exports the spans of sampled traces via OTLP/HTTP (JSON encoding).
+ *
+ * @ingroup perfdata
+ */
+class OtlpTraceWriter final : public ObjectImpl<OtlpTraceWriter>
+{
+public:
+	DECLARE_OBJECT(OtlpTraceWriter);
+	DECLARE_OBJECTNAME(OtlpTraceWriter);
+
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
+	static Dictionary::Ptr SpanToOtlp(const TraceSpan& span);
+
+	void ValidateSampleRatio(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+
+protected:
+	void OnConfigLoaded() override;
+	void Resume() override;
+	void Pause() override;
+
+private:
+	WorkQueue m_WorkQueue{10000000, 1};
+	Timer::Ptr m_FlushTimer;
+	std::vector<TraceSpan> m_Spans;
+	std::mutex m_SpansMutex;
+	std::atomic<uint_fast64_t> m_DroppedSpans{0};
+	OptionalTlsStream m_Stream;
+
+	void SpanEndedHandler(const TraceSpan& span);
+	void FlushTimeout();
+	void Flush();
+	void SendRequest(const String& body);
+
+	OptionalTlsStream Connect();
+	void Disconnect();
+	void ExceptionHandler(boost::exception_ptr exp);
+};
+
+}
+
+#endif /* OTLPTRACEWRITER_H */
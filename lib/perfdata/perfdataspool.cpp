@@ -0,0 +1,282 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "perfdata/perfdataspool.hpp"
+#include "base/configuration.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+using namespace icinga;
+
+/**
+ * Opens the spool directory (which is created if necessary) and picks up the
+ * segments which were left by a previous run.
+ *
+ * @param path The path of the spool directory.
+ * @param maxSize The maximum size of all segments in bytes.
+ */
+PerfdataSpool::PerfdataSpool(const String& path, uint64_t maxSize)
+	: m_Path(path), m_MaxSize(maxSize)
+{
+	/* Only whole segments are dropped, so a small limit needs small segments. */
+	m_SegmentSize = maxSize / 4 < SegmentSize ? maxSize / 4 : SegmentSize;
+
+	Utility::MkDirP(m_Path, 0750);
+
+	Utility::Glob(m_Path + "/*.spool", [this](const String& file) {
+		String name = Utility::BaseName(file);
+		Segment segment;
+
+		try {
+			segment.Id = std::stoull(name.SubStr(0, name.GetLength() - 6).GetData());
+		} catch (const std::exception&) {
+			return;
+		}
+
+		boost::system::error_code ec;
+		segment.Size = boost::filesystem::file_size(file.GetData(), ec);
+
+		if (ec)
+			return;
+
+		m_Segments.push_back(segment);
+		m_Size += segment.Size;
+	}, GlobFile);
+
+	std::sort(m_Segments.begin(), m_Segments.end(), [](const Segment& a, const Segment& b) {
+		return a.Id < b.Id;
+	});
+
+	if (m_Size > 0) {
+		Log(LogInformation, "PerfdataSpool")
+			<< "Found " << m_Size << " bytes of spooled data in '" << m_Path << "'.";
+	}
+}
+
+/**
+ * Returns the spool directory for the specified perfdata writer.
+ *
+ * @param type The writer's type, e.g. "GraphiteWriter".
+ * @param name The writer's name.
+ * @returns The path
+ */
+String PerfdataSpool::GetWriterPath(const String& type, const String& name)
+{
+	return Configuration::DataDir + "/perfdata-spool/" + type.ToLower() + "-" + name;
+}
+
+String PerfdataSpool::GetSegmentPath(uint64_t id) const
+{
+	return m_Path + "/" + Convert::ToString(id) + ".spool";
+}
+
+/**
+ * Starts a new segment for appending. Existing segments are never appended
+ * to, they might end with a partially written record.
+ */
+void PerfdataSpool::OpenSegment()
+{
+	if (m_Writer.is_open())
+		m_Writer.close();
+
+	Segment segment;
+	segment.Id = m_Segments.empty() ? 0 : m_Segments.back().Id + 1;
+	segment.Size = 0;
+
+	m_Writer.open(GetSegmentPath(segment.Id).CStr(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+	m_WriterSize = 0;
+
+	m_Segments.push_back(segment);
+}
+
+void PerfdataSpool::RemoveOldestSegment()
+{
+	const Segment& segment = m_Segments.front();
+
+	if (m_Segments.size() == 1 && m_Writer.is_open())
+		m_Writer.close();
+
+	Utility::Remove(GetSegmentPath(segment.Id));
+
+	m_Size -= segment.Size;
+	m_ReadOffset = 0;
+	m_Segments.pop_front();
+}
+
+/**
+ * Appends a record to the spool. If the spool grows too large the oldest
+ * segments are dropped.
+ *
+ * @param record The data.
+ */
+void PerfdataSpool::Append(const String& record)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (!m_Writer.is_open() || m_WriterSize >= m_SegmentSize)
+		OpenSegment();
+
+	uint32_t length = record.GetLength();
+
+	m_Writer.write(reinterpret_cast<const char *>(&length), sizeof(length));
+	m_Writer.write(record.CStr(), length);
+	m_Writer.flush();
+
+	if (!m_Writer.good()) {
+		Log(LogWarning, "PerfdataSpool")
+			<< "Cannot write to spool '" << m_Path << "', the data is lost.";
+
+		/* The segment might end with a partial record now, it's not appended to anymore. */
+		m_Writer.close();
+		return;
+	}
+
+	m_WriterSize += sizeof(length) + length;
+	m_Segments.back().Size = m_WriterSize;
+	m_Size += sizeof(length) + length;
+
+	while (m_Size > m_MaxSize && m_Segments.size() > 1) {
+		Log(LogWarning, "PerfdataSpool")
+			<< "Spool '" << m_Path << "' exceeds " << m_MaxSize << " bytes, dropping "
+			<< m_Segments.front().Size - m_ReadOffset << " bytes of the oldest data.";
+
+		RemoveOldestSegment();
+	}
+}
+
+/**
+ * Replays records from the oldest segment on. The records are passed to the
+ * callback one by one until it returns false (e.g. because the backend is not
+ * available anymore) or until maxBytes have been replayed. Only the records
+ * for which the callback returned true are removed from the spool.
+ *
+ * The callback is called without holding the spool's lock, i.e. records can
+ * be appended in the meantime.
+ *
+ * @param maxBytes Limit for the data to replay, at least one record is replayed.
+ * @param callback Sends a record, returns whether that succeeded.
+ * @returns The number of replayed records.
+ */
+size_t PerfdataSpool::Replay(size_t maxBytes, const std::function<bool (const String&)>& callback)
+{
+	namespace ip = boost::interprocess;
+
+	std::unique_lock<std::mutex> replayLock(m_ReplayMutex);
+
+	size_t count = 0;
+	uint64_t bytes = 0;
+
+	while (bytes < maxBytes) {
+		Segment segment;
+		uint64_t offset;
+		bool writing;
+
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+
+			if (m_Segments.empty())
+				break;
+
+			segment = m_Segments.front();
+			offset = m_ReadOffset;
+			writing = m_Segments.size() == 1 && m_Writer.is_open();
+
+			if (offset >= segment.Size) {
+				if (writing)
+					break;
+
+				RemoveOldestSegment();
+				continue;
+			}
+		}
+
+		std::unique_ptr<ip::mapped_region> region;
+
+		try {
+			ip::file_mapping file (GetSegmentPath(segment.Id).CStr(), ip::read_only);
+			region.reset(new ip::mapped_region(file, ip::read_only, offset, segment.Size - offset));
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "PerfdataSpool")
+				<< "Cannot read spool segment '" << GetSegmentPath(segment.Id) << "', dropping it: " << DiagnosticInformation(ex, false);
+		}
+
+		auto data (region ? static_cast<const char *>(region->get_address()) : nullptr);
+		uint64_t size = region ? region->get_size() : 0;
+		uint64_t pos = 0;
+		bool stop = false;
+
+		while (bytes < maxBytes) {
+			uint32_t length;
+
+			if (size - pos < sizeof(length))
+				break;
+
+			memcpy(&length, data + pos, sizeof(length));
+
+			/* A partial record at the end of a segment is left over from a crash. */
+			if (size - pos - sizeof(length) < length) {
+				pos = size;
+				break;
+			}
+
+			if (!callback(String(data + pos + sizeof(length), data + pos + sizeof(length) + length))) {
+				stop = true;
+				break;
+			}
+
+			pos += sizeof(length) + length;
+			bytes += sizeof(length) + length;
+			count++;
+		}
+
+		/* An unreadable segment is dropped. */
+		if (!region)
+			pos = segment.Size - offset;
+
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+
+			/* The segment might have been dropped by Append() in the meantime. */
+			if (!m_Segments.empty() && m_Segments.front().Id == segment.Id) {
+				m_ReadOffset = offset + pos;
+
+				if (m_ReadOffset >= m_Segments.front().Size && !(m_Segments.size() == 1 && m_Writer.is_open()))
+					RemoveOldestSegment();
+			}
+		}
+
+		if (stop)
+			break;
+	}
+
+	return count;
+}
+
+/**
+ * Checks whether the spool has any records which haven't been replayed yet.
+ *
+ * @returns true if there is nothing to replay, false otherwise
+ */
+bool PerfdataSpool::IsEmpty()
+{
+	return GetSize() == 0;
+}
+
+/**
+ * Returns the size of the records which haven't been replayed yet.
+ *
+ * @returns The size in bytes
+ */
+uint64_t PerfdataSpool::GetSize()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	return m_Size - m_ReadOffset;
+}
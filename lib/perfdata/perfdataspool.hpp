@@ -0,0 +1,78 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef PERFDATASPOOL_H
+#define PERFDATASPOOL_H
+
+#include "base/object.hpp"
+#include "base/string.hpp"
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+
+namespace icinga
+{
+
+/**
+ * A disk-backed spool for data which a perfdata writer couldn't send to its
+ * backend. It is replayed in chunks once the backend is available again.
+ *
+ * The spool is a directory of segment files named "<id>.spool". Records are
+ * appended to the newest segment and replayed from the oldest one, which is
+ * removed once all of its records have been replayed. Each record consists
+ * of a uint32 length (host byte order) followed by the data.
+ *
+ * The total size of all segments is limited, the oldest segments are dropped
+ * if the limit is exceeded. Records are delivered at least once, a restart
+ * replays the oldest segment from its beginning.
+ *
+ * @ingroup perfdata
+ */
+class PerfdataSpool final : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(PerfdataSpool);
+
+	static const uint64_t SegmentSize = 16 * 1024 * 1024;
+	static const uint64_t DefaultMaxSize = 256 * 1024 * 1024;
+	static const size_t ReplayChunkSize = 4 * 1024 * 1024;
+
+	PerfdataSpool(const String& path, uint64_t maxSize = DefaultMaxSize);
+
+	static String GetWriterPath(const String& type, const String& name);
+
+	void Append(const String& record);
+	size_t Replay(size_t maxBytes, const std::function<bool (const String&)>& callback);
+
+	bool IsEmpty();
+	uint64_t GetSize();
+
+private:
+	struct Segment
+	{
+		uint64_t Id;
+		uint64_t Size;
+	};
+
+	String m_Path;
+	uint64_t m_MaxSize;
+	uint64_t m_SegmentSize;
+
+	std::mutex m_Mutex;
+	std::deque<Segment> m_Segments;
+	uint64_t m_Size{0};
+	uint64_t m_ReadOffset{0};
+	std::ofstream m_Writer;
+	uint64_t m_WriterSize{0};
+
+	std::mutex m_ReplayMutex;
+
+	String GetSegmentPath(uint64_t id) const;
+	void OpenSegment();
+	void RemoveOldestSegment();
+};
+
+}
+
+#endif /* PERFDATASPOOL_H */
@@ -21,6 +21,9 @@ REGISTER_TYPE(PerfdataWriter);
 
 REGISTER_STATSFUNCTION(PerfdataWriter, &PerfdataWriter::StatsFunc);
 
+/* The lines are collected in memory until there are this many bytes of them or the file is rotated. */
+static const size_t l_FlushThreshold = 64 * 1024;
+
 void PerfdataWriter::OnConfigLoaded()
 {
 	ObjectImpl<PerfdataWriter>::OnConfigLoaded();
@@ -33,6 +36,10 @@ void PerfdataWriter::OnConfigLoaded()
 	} else {
 		SetHAMode(HARunOnce);
 	}
+
+	/* The format templates are parsed once rather than for every check result. */
+	m_ServiceFormat = MacroProcessor::CompileMacroString(GetServiceFormatTemplate());
+	m_HostFormat = MacroProcessor::CompileMacroString(GetHostFormatTemplate());
 }
 
 void PerfdataWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
@@ -60,8 +67,7 @@ void PerfdataWriter::Resume()
 	m_RotationTimer->SetInterval(GetRotationInterval());
 	m_RotationTimer->Start();
 
-	RotateFile(m_ServiceOutputFile, GetServiceTempPath(), GetServicePerfdataPath());
-	RotateFile(m_HostOutputFile, GetHostTempPath(), GetHostPerfdataPath());
+	RotateAllFiles();
 }
 
 void PerfdataWriter::Pause()
@@ -115,39 +121,69 @@ void PerfdataWriter::CheckResultHandler(const Checkable::Ptr& checkable, const C
 	resolvers.emplace_back("icinga", IcingaApplication::GetInstance());
 
 	if (service) {
-		String line = MacroProcessor::ResolveMacros(GetServiceFormatTemplate(), resolvers, cr, nullptr, &PerfdataWriter::EscapeMacroMetric);
+		String line = MacroProcessor::ResolveMacros(*m_ServiceFormat, resolvers, cr, nullptr, &PerfdataWriter::EscapeMacroMetric);
+		WriteLine(m_ServiceOutput, line);
+	} else {
+		String line = MacroProcessor::ResolveMacros(*m_HostFormat, resolvers, cr, nullptr, &PerfdataWriter::EscapeMacroMetric);
+		WriteLine(m_HostOutput, line);
+	}
+}
 
-		{
-			std::unique_lock<std::mutex> lock(m_StreamMutex);
+/**
+ * Adds a line to the output's buffer. Only the check result handler which fills up the buffer
+ * writes it to the file, the others don't wait for that.
+ */
+void PerfdataWriter::WriteLine(PerfdataOutput& output, const String& line)
+{
+	{
+		std::unique_lock<std::mutex> lock (output.BufferMutex);
 
-			if (!m_ServiceOutputFile.good())
-				return;
+		output.Buffer.append(line.GetData());
+		output.Buffer += '\n';
 
-			m_ServiceOutputFile << line << "\n";
-		}
-	} else {
-		String line = MacroProcessor::ResolveMacros(GetHostFormatTemplate(), resolvers, cr, nullptr, &PerfdataWriter::EscapeMacroMetric);
+		if (output.Buffer.size() < l_FlushThreshold)
+			return;
+	}
 
-		{
-			std::unique_lock<std::mutex> lock(m_StreamMutex);
+	FlushOutput(output);
+}
 
-			if (!m_HostOutputFile.good())
-				return;
+/**
+ * Writes the output's buffer to its file with one large write.
+ *
+ * @returns The lock of the output's file which is still held, e.g. for rotating it
+ */
+std::unique_lock<std::mutex> PerfdataWriter::FlushOutput(PerfdataOutput& output)
+{
+	std::string buffer;
 
-			m_HostOutputFile << line << "\n";
-		}
-	}
+	std::unique_lock<std::mutex> lock (output.BufferMutex);
+	buffer.swap(output.Buffer);
+	output.Buffer.reserve(buffer.capacity());
+
+	std::unique_lock<std::mutex> fileLock (output.FileMutex);
+	lock.unlock();
+
+	/* Without a file the lines are lost, see RotateFile(). */
+	if (!buffer.empty() && output.File.good())
+		output.File.write(buffer.data(), buffer.size());
+
+	return fileLock;
 }
 
-void PerfdataWriter::RotateFile(std::ofstream& output, const String& temp_path, const String& perfdata_path)
+/**
+ * Closes the output's file with all the lines buffered for it and opens a new one.
+ * New lines are still added to the buffer in the meantime.
+ */
+void PerfdataWriter::RotateFile(PerfdataOutput& output, const String& temp_path, const String& perfdata_path)
 {
 	Log(LogDebug, "PerfdataWriter")
 		<< "Rotating perfdata files.";
 
-	std::unique_lock<std::mutex> lock(m_StreamMutex);
+	std::unique_lock<std::mutex> fileLock (FlushOutput(output));
 
-	if (output.good()) {
-		output.close();
+	if (output.File.good()) {
+		output.File.close();
 
 		if (Utility::PathExists(temp_path)) {
 			String finalFile = perfdata_path + "." + Convert::ToString((long)Utility::GetTime());
@@ -159,9 +195,9 @@ void PerfdataWriter::RotateFile(std::ofstream& output, const String& temp_path,
 		}
 	}
 
-	output.open(temp_path.CStr());
+	output.File.open(temp_path.CStr());
 
-	if (!output.good()) {
+	if (!output.File.good()) {
 		Log(LogWarning, "PerfdataWriter")
 			<< "Could not open perfdata file '" << temp_path << "' for writing. Perfdata will be lost.";
 	}
@@ -177,8 +213,8 @@ void PerfdataWriter::RotationTimerHandler()
 
 void PerfdataWriter::RotateAllFiles()
 {
-	RotateFile(m_ServiceOutputFile, GetServiceTempPath(), GetServicePerfdataPath());
-	RotateFile(m_HostOutputFile, GetHostTempPath(), GetHostPerfdataPath());
+	RotateFile(m_ServiceOutput, GetServiceTempPath(), GetServicePerfdataPath());
+	RotateFile(m_HostOutput, GetHostTempPath(), GetHostPerfdataPath());
 }
 
 void PerfdataWriter::ValidateHostFormatTemplate(const Lazy<String>& lvalue, const ValidationUtils& utils)
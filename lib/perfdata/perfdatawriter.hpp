@@ -5,13 +5,32 @@
 
 #include "perfdata/perfdatawriter-ti.hpp"
 #include "icinga/service.hpp"
+#include "icinga/macroprocessor.hpp"
 #include "base/configobject.hpp"
 #include "base/timer.hpp"
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
 
 namespace icinga
 {
 
+/**
+ * A perfdata file and the lines which haven't been written to it yet.
+ *
+ * @ingroup perfdata
+ */
+struct PerfdataOutput
+{
+	std::mutex BufferMutex;
+	std::string Buffer;
+
+	/* Locked before BufferMutex is released, so the buffers are written in order. */
+	std::mutex FileMutex;
+	std::ofstream File;
+};
+
 /**
  * An Icinga perfdata writer.
  *
@@ -35,16 +54,20 @@ protected:
 
 private:
 	Timer::Ptr m_RotationTimer;
-	std::ofstream m_ServiceOutputFile;
-	std::ofstream m_HostOutputFile;
-	std::mutex m_StreamMutex;
+	PerfdataOutput m_ServiceOutput;
+	PerfdataOutput m_HostOutput;
+	std::shared_ptr<const MacroTemplate> m_ServiceFormat;
+	std::shared_ptr<const MacroTemplate> m_HostFormat;
 
 	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
 	static Value EscapeMacroMetric(const Value& value);
 
+	static void WriteLine(PerfdataOutput& output, const String& line);
+	static std::unique_lock<std::mutex> FlushOutput(PerfdataOutput& output);
+
 	void RotationTimerHandler();
 	void RotateAllFiles();
-	void RotateFile(std::ofstream& output, const String& temp_path, const String& perfdata_path);
+	void RotateFile(PerfdataOutput& output, const String& temp_path, const String& perfdata_path);
 };
 
 }
@@ -35,6 +35,12 @@ struct PgsqlInterface
 	virtual PGconn *setdbLogin(const char *pghost, const char *pgport, const char *pgoptions, const char *pgtty, const char *dbName, const char *login, const char *pwd) const = 0;
 	virtual PGconn *connectdb(const char *conninfo) const = 0;
 	virtual ConnStatusType status(const PGconn *conn) const = 0;
+	virtual int putCopyData(PGconn *conn, const char *buffer, int nbytes) const = 0;
+	virtual int putCopyEnd(PGconn *conn, const char *errormsg) const = 0;
+	virtual PGresult *getResult(PGconn *conn) const = 0;
+	virtual PGresult *prepare(PGconn *conn, const char *stmtName, const char *query, int nParams, const Oid *paramTypes) const = 0;
+	virtual PGresult *execPrepared(PGconn *conn, const char *stmtName, int nParams, const char * const *paramValues,
+		const int *paramLengths, const int *paramFormats, int resultFormat) const = 0;
 
 protected:
 	PgsqlInterface() = default;
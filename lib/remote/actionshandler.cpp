@@ -6,8 +6,13 @@
 #include "remote/apiaction.hpp"
 #include "base/defer.hpp"
 #include "base/exception.hpp"
+#include "base/io-engine.hpp"
 #include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <atomic>
 #include <set>
+#include <unordered_map>
+#include <vector>
 
 using namespace icinga;
 
@@ -46,25 +51,81 @@ bool ActionsHandler::HandleRequest(
 	QueryDescription qd;
 
 	const std::vector<String>& types = action->GetTypes();
-	std::vector<Value> objs;
+
+	/* What to invoke the action for. Targets which couldn't be resolved have their result already. */
+	struct ActionTarget
+	{
+		ConfigObject::Ptr Object;
+		Dictionary::Ptr Params;
+		Value Result;
+	};
+
+	std::vector<ActionTarget> targets;
 
 	String permission = "actions/" + actionName;
 
+	Value bulkTargets;
+
+	if (params)
+		bulkTargets = params->Get("targets");
+
 	if (!types.empty()) {
 		qd.Types = std::set<String>(types.begin(), types.end());
 		qd.Permission = permission;
 
-		try {
-			objs = FilterUtility::GetFilterTargets(qd, params, user);
-		} catch (const std::exception& ex) {
-			HttpUtility::SendJsonError(response, params, 404,
-				"No objects found.",
-				DiagnosticInformation(ex));
-			return true;
+		if (bulkTargets.IsEmpty()) {
+			try {
+				for (const ConfigObject::Ptr& obj : FilterUtility::GetFilterTargets(qd, params, user)) {
+					targets.push_back({ obj, params });
+				}
+			} catch (const std::exception& ex) {
+				HttpUtility::SendJsonError(response, params, 404,
+					"No objects found.",
+					DiagnosticInformation(ex));
+				return true;
+			}
+		} else {
+			/* Bulk requests carry their own parameters (and filter) per item,
+			 * e.g. many check results. The other parameters apply to all items.
+			 */
+			if (!bulkTargets.IsObjectType<Array>()) {
+				HttpUtility::SendJsonError(response, params, 400, "Parameter 'targets' must be an array.");
+				return true;
+			}
+
+			Dictionary::Ptr commonParams = params->ShallowClone();
+			commonParams->Remove("targets");
+
+			Array::Ptr items = bulkTargets;
+			ObjectLock olock(items);
+
+			for (const Value& item : items) {
+				if (!item.IsObjectType<Dictionary>()) {
+					targets.push_back({ nullptr, nullptr, new Dictionary({
+						{ "code", 400 },
+						{ "status", "Each item of 'targets' must be a dictionary." }
+					}) });
+					continue;
+				}
+
+				Dictionary::Ptr itemParams = commonParams->ShallowClone();
+				static_cast<Dictionary::Ptr>(item)->CopyTo(itemParams);
+
+				try {
+					for (const ConfigObject::Ptr& obj : FilterUtility::GetFilterTargets(qd, itemParams, user)) {
+						targets.push_back({ obj, itemParams });
+					}
+				} catch (const std::exception& ex) {
+					targets.push_back({ nullptr, nullptr, new Dictionary({
+						{ "code", 404 },
+						{ "status", "No objects found: " + DiagnosticInformation(ex, false) }
+					}) });
+				}
+			}
 		}
 	} else {
 		FilterUtility::CheckPermission(user, permission);
-		objs.emplace_back(nullptr);
+		targets.push_back({ nullptr, params });
 	}
 
 	ArrayData results;
@@ -74,17 +135,17 @@ bool ActionsHandler::HandleRequest(
 
 	bool verbose = false;
 
-	ActionsHandler::AuthenticatedApiUser = user;
-	Defer a ([]() {
-		ActionsHandler::AuthenticatedApiUser = nullptr;
-	});
-
 	if (params)
 		verbose = HttpUtility::GetLastParameter(params, "verbose");
 
-	for (const ConfigObject::Ptr& obj : objs) {
+	auto invoke ([&action, &user, verbose](const ActionTarget& target) -> Value {
+		ActionsHandler::AuthenticatedApiUser = user;
+		Defer a ([]() {
+			ActionsHandler::AuthenticatedApiUser = nullptr;
+		});
+
 		try {
-			results.emplace_back(action->Invoke(obj, params));
+			return action->Invoke(target.Object, target.Params);
 		} catch (const std::exception& ex) {
 			Dictionary::Ptr fail = new Dictionary({
 				{ "code", 500 },
@@ -95,8 +156,76 @@ bool ActionsHandler::HandleRequest(
 			if (verbose)
 				fail->Set("diagnostic_information", DiagnosticInformation(ex));
 
-			results.emplace_back(std::move(fail));
+			return fail;
 		}
+	});
+
+	if (targets.size() < 2u) {
+		for (auto& target : targets) {
+			if (target.Result.IsEmpty())
+				target.Result = invoke(target);
+		}
+	} else {
+		/* Bulk actions run in the thread pool, a batch of targets per task. The actions
+		 * lock the objects they modify themselves, so different objects don't wait for
+		 * each other. This coroutine waits without blocking its I/O thread.
+		 *
+		 * All targets of an object are in the same batch, so e.g. check results for the
+		 * same checkable are processed in the order of the request.
+		 */
+		const size_t batchSize = 64;
+
+		std::vector<std::vector<size_t>> batches;
+		std::unordered_map<ConfigObject*, size_t> objectBatches;
+
+		for (size_t i = 0; i < targets.size(); i++) {
+			if (!targets[i].Result.IsEmpty())
+				continue;
+
+			auto objectBatch (objectBatches.find(targets[i].Object.get()));
+
+			if (objectBatch != objectBatches.end()) {
+				batches[objectBatch->second].emplace_back(i);
+				continue;
+			}
+
+			if (batches.empty() || batches.back().size() >= batchSize)
+				batches.emplace_back();
+
+			batches.back().emplace_back(i);
+			objectBatches.emplace(targets[i].Object.get(), batches.size() - 1u);
+		}
+
+		if (!batches.empty()) {
+			std::atomic<size_t> pendingBatches (batches.size());
+			auto& strand (server.GetIoStrand());
+			AsioConditionVariable done (strand.context());
+
+			for (auto& batch : batches) {
+				Utility::QueueAsyncCallback([&targets, &batch, &pendingBatches, &strand, &done, &invoke]() {
+					Defer finish ([&pendingBatches, &strand, &done]() {
+						if (--pendingBatches == 0u)
+							strand.post([&done]() { done.Set(); });
+					});
+
+					for (size_t i : batch) {
+						targets[i].Result = invoke(targets[i]);
+					}
+				});
+			}
+
+			{
+				IoBoundWorkSlot dontLockTheIoThread (yc, HttpUtility::GetCpuBoundWorkClass(request));
+
+				done.Wait(yc);
+			}
+		}
+	}
+
+	results.reserve(targets.size());
+
+	for (auto& target : targets) {
+		results.emplace_back(std::move(target.Result));
 	}
 
 	int statusCode = 500;
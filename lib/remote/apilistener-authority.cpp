@@ -2,14 +2,22 @@
 
 #include "remote/zone.hpp"
 #include "remote/apilistener.hpp"
+#include "remote/apifunction.hpp"
+#include "remote/jsonrpcconnection.hpp"
 #include "base/configtype.hpp"
 #include "base/utility.hpp"
 #include "base/convert.hpp"
+#include "base/logger.hpp"
 
 using namespace icinga;
 
+REGISTER_APIFUNCTION(Handover, icinga, &ApiListener::HandoverAPIHandler);
+
 std::atomic<bool> ApiListener::m_UpdatedObjectAuthority (false);
 
+std::mutex ApiListener::m_HandoversLock;
+std::map<String, double> ApiListener::m_Handovers;
+
 void ApiListener::UpdateObjectAuthority()
 {
 	/* Always run this, even if there is no 'api' feature enabled. */
@@ -29,9 +37,20 @@ void ApiListener::UpdateObjectAuthority()
 	if (my_zone) {
 		my_endpoint = Endpoint::GetLocalEndpoint();
 
+		std::map<String, double> handovers;
+
+		{
+			std::unique_lock<std::mutex> lock (m_HandoversLock);
+			handovers = m_Handovers;
+		}
+
 		int num_total = 0;
 
 		for (const Endpoint::Ptr& endpoint : my_zone->GetEndpoints()) {
+			/* Endpoints which handed over their objects are about to leave, don't wait for them either. */
+			if (endpoint != my_endpoint && handovers.find(endpoint->GetName()) != handovers.end())
+				continue;
+
 			num_total++;
 
 			if (endpoint != my_endpoint && !endpoint->GetConnected())
@@ -82,3 +101,86 @@ void ApiListener::UpdateObjectAuthority()
 
 	m_UpdatedObjectAuthority.store(true);
 }
+
+/**
+ * Hands the objects of this endpoint over to the other endpoints in the local zone.
+ *
+ * Called on shutdown once the HA features have been stopped. The other endpoints
+ * take over immediately instead of waiting for the connection to drop and the
+ * authority timer to fire. The connections are closed after the message has been
+ * written, so nothing else is relayed to them by this instance.
+ */
+void ApiListener::HandOverObjectAuthority()
+{
+	Zone::Ptr my_zone = Zone::GetLocalZone();
+	Endpoint::Ptr my_endpoint = Endpoint::GetLocalEndpoint();
+
+	if (!my_zone || !my_endpoint)
+		return;
+
+	Dictionary::Ptr message = new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "icinga::Handover" },
+		{ "params", new Dictionary() }
+	});
+
+	for (const Endpoint::Ptr& endpoint : my_zone->GetEndpoints()) {
+		if (endpoint == my_endpoint)
+			continue;
+
+		for (const JsonRpcConnection::Ptr& client : endpoint->GetClients()) {
+			Log(LogInformation, "ApiListener")
+				<< "Handing over object authority to endpoint '" << endpoint->GetName() << "'.";
+
+			client->SendMessage(message);
+			client->Disconnect();
+		}
+	}
+}
+
+Value ApiListener::HandoverAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr&)
+{
+	Endpoint::Ptr endpoint = origin->FromClient->GetEndpoint();
+
+	if (!endpoint || endpoint->GetZone() != Zone::GetLocalZone()) {
+		Log(LogNotice, "ApiListener")
+			<< "Discarding 'object authority handover' message from '" << origin->FromClient->GetIdentity() << "': Invalid endpoint origin (client not allowed).";
+		return Empty;
+	}
+
+	Log(LogInformation, "ApiListener")
+		<< "Endpoint '" << endpoint->GetName() << "' is shutting down and hands over its objects.";
+
+	{
+		std::unique_lock<std::mutex> lock (m_HandoversLock);
+		m_Handovers[endpoint->GetName()] = Utility::GetTime();
+	}
+
+	Utility::QueueAsyncCallback(&ApiListener::UpdateObjectAuthority);
+
+	return Empty;
+}
+
+/**
+ * Returns when the endpoint handed over its objects, see HandOverObjectAuthority().
+ *
+ * The endpoint has stopped its HA features at that point, e.g. the DB IDO
+ * feature doesn't have to wait for the failover timeout.
+ *
+ * @param endpoint The endpoint name.
+ * @returns The time of the handover, 0 if the endpoint didn't hand over since it connected.
+ */
+double ApiListener::GetHandoverTime(const String& endpoint)
+{
+	std::unique_lock<std::mutex> lock (m_HandoversLock);
+
+	auto it (m_Handovers.find(endpoint));
+
+	return it == m_Handovers.end() ? 0 : it->second;
+}
+
+void ApiListener::ClearHandover(const Endpoint::Ptr& endpoint)
+{
+	std::unique_lock<std::mutex> lock (m_HandoversLock);
+	m_Handovers.erase(endpoint->GetName());
+}
@@ -4,6 +4,7 @@
 #include "remote/apifunction.hpp"
 #include "remote/configobjectutility.hpp"
 #include "remote/jsonrpc.hpp"
+#include "remote/runtimeobjectstore.hpp"
 #include "base/configtype.hpp"
 #include "base/json.hpp"
 #include "base/convert.hpp"
@@ -27,6 +28,9 @@ void ApiListener::ConfigUpdateObjectHandler(const ConfigObject::Ptr& object, con
 	if (!listener)
 		return;
 
+	/* Lets SyncClient() skip objects which haven't changed since an endpoint's last sync. */
+	object->SetExtension("ConfigSyncChanged", Utility::GetTime());
+
 	if (object->IsActive()) {
 		/* Sync object config */
 		listener->UpdateConfigObject(object, cookie);
@@ -120,7 +124,21 @@ Value ApiListener::ConfigUpdateObjectAPIHandler(const MessageOrigin::Ptr& origin
 		 * Create the config object through our internal API.
 		 * IMPORTANT: Pass the origin to prevent cluster sync loops.
 		 */
-		if (!ConfigObjectUtility::CreateObject(ptype, objName, config, errors, nullptr, origin)) {
+		Dictionary::Ptr attrs = params->Get("attrs");
+		bool created;
+
+		if (attrs && RuntimeObjectStore::IsStoredType(ptype)) {
+			/* The name and version are set while creating the object. */
+			attrs = attrs->ShallowClone();
+			attrs->Remove("name");
+			attrs->Remove("version");
+
+			created = RuntimeObjectStore::CreateObjects(ptype, { { objName, attrs } }, errors, nullptr, origin);
+		} else {
+			created = ConfigObjectUtility::CreateObject(ptype, objName, config, errors, nullptr, origin);
+		}
+
+		if (!created) {
 			Log(LogCritical, "ApiListener")
 				<< "Could not create object '" << objName << "':";
 
@@ -327,7 +345,16 @@ void ApiListener::UpdateConfigObject(const ConfigObject::Ptr& object, const Mess
 	params->Set("version", object->GetVersion());
 	params->Set("zone", object->GetZoneName());
 
-	if (object->GetPackage() == "_api") {
+	Dictionary::Ptr storedAttrs;
+
+	if (object->GetPackage() == "_api")
+		storedAttrs = RuntimeObjectStore::GetObjectAttrs(object->GetReflectionType(), object->GetName());
+
+	if (storedAttrs) {
+		/* Peers which know the runtime object store use the attributes, older ones the config. */
+		params->Set("attrs", storedAttrs);
+		params->Set("config", RuntimeObjectStore::GetObjectConfig(object->GetReflectionType(), storedAttrs));
+	} else if (object->GetPackage() == "_api") {
 		String file;
 
 		try {
@@ -439,7 +466,13 @@ void ApiListener::DeleteConfigObject(const ConfigObject::Ptr& object, const Mess
 }
 
 /* Initial sync on connect for new endpoints */
-void ApiListener::SendRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient)
+/**
+ * Sends the runtime config objects the endpoint's zone has access to.
+ *
+ * @param aclient The endpoint's connection.
+ * @param since Only send objects which have changed since then, 0 sends all objects.
+ */
+void ApiListener::SendRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient, double since)
 {
 	Endpoint::Ptr endpoint = aclient->GetEndpoint();
 	ASSERT(endpoint);
@@ -447,7 +480,10 @@ void ApiListener::SendRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient
 	Zone::Ptr azone = endpoint->GetZone();
 
 	Log(LogInformation, "ApiListener")
-		<< "Syncing runtime objects to endpoint '" << endpoint->GetName() << "'.";
+		<< "Syncing runtime objects " << (since > 0 ? "changed since its last sync " : "")
+		<< "to endpoint '" << endpoint->GetName() << "'.";
+
+	size_t count = 0;
 
 	for (const Type::Ptr& type : Type::GetAllTypes()) {
 		auto *dtype = dynamic_cast<ConfigType *>(type.get());
@@ -460,11 +496,20 @@ void ApiListener::SendRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient
 			if (!azone->CanAccessObject(object))
 				continue;
 
+			/* Deleted objects are in the replay log, unchanged ones are up to date. */
+			if (since > 0) {
+				Value changed = object->GetExtension("ConfigSyncChanged");
+
+				if (changed.IsEmpty() || static_cast<double>(changed) < since)
+					continue;
+			}
+
 			/* send the config object to the connected client */
 			UpdateConfigObject(object, nullptr, aclient);
+			count++;
 		}
 	}
 
 	Log(LogInformation, "ApiListener")
-		<< "Finished syncing runtime objects to endpoint '" << endpoint->GetName() << "'.";
+		<< "Finished syncing " << count << " runtime objects to endpoint '" << endpoint->GetName() << "'.";
 }
@@ -2,26 +2,165 @@
 
 #include "remote/apilistener.hpp"
 #include "remote/apifunction.hpp"
+#include "remote/configspoolfile.hpp"
+#include "remote/scopedvalidation.hpp"
 #include "config/configcompiler.hpp"
 #include "base/tlsutility.hpp"
 #include "base/json.hpp"
 #include "base/configtype.hpp"
+#include "base/configuration.hpp"
 #include "base/logger.hpp"
 #include "base/convert.hpp"
 #include "base/application.hpp"
+#include "base/base64.hpp"
 #include "base/exception.hpp"
 #include "base/shared.hpp"
 #include "base/utility.hpp"
+#include "base/workqueue.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iomanip>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
 #include <thread>
 
 using namespace icinga;
 
 REGISTER_APIFUNCTION(Update, config, &ApiListener::ConfigUpdateHandler);
+REGISTER_APIFUNCTION(FetchFile, config, &ApiListener::ConfigFetchFileHandler);
+REGISTER_APIFUNCTION(FileChunk, config, &ApiListener::ConfigFileChunkHandler);
 
 std::mutex ApiListener::m_ConfigSyncStageLock;
 
+/* Larger config files are only referenced in config::Update messages to peers with the ChunkedConfigSync capability. */
+static const size_t l_ConfigFileReferenceSize = 64 * 1024;
+
+/* A config::FileChunk message carries at most that many bytes of a file. */
+static const size_t l_ConfigFileChunkSize = 1024 * 1024;
+
+/**
+ * A referenced config file which is neither in the blob directory
+ * nor unchanged in production and has to be fetched from the parent.
+ */
+struct ConfigFileFetch
+{
+	String Zone;
+	String Path;
+	String Checksum;
+	size_t Size;
+};
+
+/* The config update which waits for its referenced files, only one at a time. */
+static std::mutex l_ConfigFetchMutex;
+static MessageOrigin::Ptr l_ConfigFetchOrigin;
+static Dictionary::Ptr l_ConfigFetchParams;
+static std::deque<ConfigFileFetch> l_ConfigFetchQueue;
+
+/**
+ * Writes the contents of config files inside a config::Update message
+ * to the spool directory, everything else is kept in memory.
+ *
+ * @param path e.g. ["params", "update", "<zone>", "<file>"]
+ * @param value The string
+ * @return A ConfigSpoolFile or the string itself
+ */
+static Value SpoolConfigFile(const std::vector<String>& path, String&& value)
+{
+	if (path.size() != 4 || path[0] != "params" || (path[1] != "update" && path[1] != "update_v2"))
+		return std::move(value);
+
+	String spoolDir = ApiListener::GetApiZonesSpoolDir();
+
+	try {
+		return ConfigSpoolFile::Create(spoolDir, value);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ApiListener")
+			<< "Cannot spool received config file to '" << spoolDir << "', keeping it in memory: "
+			<< DiagnosticInformation(ex, false);
+
+		return std::move(value);
+	}
+}
+
+/**
+ * Spools large config files of config::Update messages to disk while they're
+ * being decoded, so the whole zone tree isn't in memory multiple times.
+ */
+const LargeStringSink& ApiListener::GetConfigUpdateSink()
+{
+	static const LargeStringSink sink { 4096, &SpoolConfigFile };
+
+	return sink;
+}
+
+/**
+ * A config file's checksum, valid as long as its modification time and size stay the same.
+ */
+struct ConfigFileChecksum
+{
+	time_t MTime;
+	size_t Size;
+	bool ValidUTF8;
+	String Checksum;
+};
+
+static std::mutex l_ConfigFileChecksumsMutex;
+static std::map<String, ConfigFileChecksum> l_ConfigFileChecksums;
+static bool l_ConfigFileChecksumsLoaded = false;
+static bool l_ConfigFileChecksumsChanged = false;
+
+static String GetConfigFileChecksumsPath()
+{
+	return ApiListener::GetApiDir() + "config-checksums.json";
+}
+
+/**
+ * Loads the checksums persisted by ApiListener::SaveConfigFileChecksums() once.
+ * Has to be called with l_ConfigFileChecksumsMutex held.
+ */
+static void LoadConfigFileChecksums()
+{
+	if (l_ConfigFileChecksumsLoaded)
+		return;
+
+	l_ConfigFileChecksumsLoaded = true;
+
+	String path = GetConfigFileChecksumsPath();
+
+	if (!Utility::PathExists(path))
+		return;
+
+	try {
+		Dictionary::Ptr checksums = Utility::LoadJsonFile(path);
+
+		if (!checksums)
+			return;
+
+		ObjectLock olock(checksums);
+
+		for (const Dictionary::Pair& kv : checksums) {
+			Array::Ptr entry = kv.second;
+
+			l_ConfigFileChecksums[kv.first] = ConfigFileChecksum{
+				static_cast<time_t>(Convert::ToLong(entry->Get(0))),
+				static_cast<size_t>(Convert::ToLong(entry->Get(1))),
+				entry->Get(2).ToBool(),
+				entry->Get(3)
+			};
+		}
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ApiListener")
+			<< "Ignoring config file checksums from '" << path << "': " << DiagnosticInformation(ex, false);
+
+		l_ConfigFileChecksums.clear();
+	}
+}
+
 /**
  * Entrypoint for updating all authoritative configs from /etc/zones.d, packages, etc.
  * into var/lib/icinga2/api/zones
@@ -177,7 +316,14 @@ void ApiListener::SyncLocalZoneDir(const Zone::Ptr& zone) const
  *
  * @param aclient Connected JSON-RPC client.
  */
-void ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient)
+/**
+ * Sends the config files of the endpoint's child zones and the global zones.
+ *
+ * @param aclient The endpoint's connection.
+ * @param lastChecksum The checksum returned for the endpoint's last sync, nothing is sent if it's still the same.
+ * @returns A checksum of the config files.
+ */
+String ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient, const String& lastChecksum)
 {
 	Endpoint::Ptr endpoint = aclient->GetEndpoint();
 	ASSERT(endpoint);
@@ -187,11 +333,15 @@ void ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient)
 
 	// Don't send config updates to parent zones
 	if (!clientZone->IsChildOf(localZone))
-		return;
+		return String();
 
 	Dictionary::Ptr configUpdateV1 = new Dictionary();
 	Dictionary::Ptr configUpdateV2 = new Dictionary();
 	Dictionary::Ptr configUpdateChecksums = new Dictionary(); // new since 2.11
+	Dictionary::Ptr configUpdateReferences = new Dictionary();
+
+	// Large files are fetched separately in chunks and only if they changed, so they don't stall the connection.
+	bool chunked = endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::ChunkedConfigSync;
 
 	String zonesDir = GetApiZonesDir();
 
@@ -211,24 +361,43 @@ void ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient)
 			<< "Syncing configuration files for " << (zone->IsGlobal() ? "global " : "")
 			<< "zone '" << zoneName << "' to endpoint '" << endpoint->GetName() << "'.";
 
-		ConfigDirInformation config = LoadConfigDir(zoneDir);
+		ConfigDirInformation config = LoadConfigDir(zoneDir, chunked ? l_ConfigFileReferenceSize : SIZE_MAX);
 
 		configUpdateV1->Set(zoneName, config.UpdateV1);
 		configUpdateV2->Set(zoneName, config.UpdateV2);
 		configUpdateChecksums->Set(zoneName, config.Checksums); // new since 2.11
+
+		if (chunked)
+			configUpdateReferences->Set(zoneName, config.References);
 	}
 
+	String checksum = SHA256(JsonEncode(configUpdateChecksums));
+
+	if (checksum == lastChecksum) {
+		Log(LogInformation, "ApiListener")
+			<< "Configuration files for endpoint '" << endpoint->GetName() << "' haven't changed since its last sync.";
+
+		return checksum;
+	}
+
+	Dictionary::Ptr params = new Dictionary({
+		{ "update", configUpdateV1 },
+		{ "update_v2", configUpdateV2 },	// Since 2.4.2.
+		{ "checksums", configUpdateChecksums } 	// Since 2.11.0.
+	});
+
+	if (chunked)
+		params->Set("references", configUpdateReferences);
+
 	Dictionary::Ptr message = new Dictionary({
 		{ "jsonrpc", "2.0" },
 		{ "method", "config::Update" },
-		{ "params", new Dictionary({
-			{ "update", configUpdateV1 },
-			{ "update_v2", configUpdateV2 },	// Since 2.4.2.
-			{ "checksums", configUpdateChecksums } 	// Since 2.11.0.
-		}) }
+		{ "params", params }
 	});
 
 	aclient->SendMessage(message);
+
+	return checksum;
 }
 
 static bool CompareTimestampsConfigChange(const Dictionary::Ptr& productionConfig, const Dictionary::Ptr& receivedConfig,
@@ -281,6 +450,22 @@ static bool CompareTimestampsConfigChange(const Dictionary::Ptr& productionConfi
 	return configChange;
 }
 
+void ApiListener::HandleConfigUpdateAsync(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	ApiListener::Ptr listener = this;
+
+	std::thread([origin, params, listener]() {
+		try {
+			listener->HandleConfigUpdate(origin, params);
+		} catch (const std::exception& ex) {
+			auto msg ("Exception during config sync: " + DiagnosticInformation(ex));
+
+			Log(LogCritical, "ApiListener") << msg;
+			listener->UpdateLastFailedZonesStageValidation(msg);
+		}
+	}).detach();
+}
+
 /**
  * Registered handler when a new config::Update message is received.
  *
@@ -312,16 +497,7 @@ Value ApiListener::ConfigUpdateHandler(const MessageOrigin::Ptr& origin, const D
 		return Empty;
 	}
 
-	std::thread([origin, params, listener]() {
-		try {
-			listener->HandleConfigUpdate(origin, params);
-		} catch (const std::exception& ex) {
-			auto msg ("Exception during config sync: " + DiagnosticInformation(ex));
-
-			Log(LogCritical, "ApiListener") << msg;
-			listener->UpdateLastFailedZonesStageValidation(msg);
-		}
-	}).detach();
+	listener->HandleConfigUpdateAsync(origin, params);
 	return Empty;
 }
 
@@ -332,6 +508,10 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 	 */
 	std::lock_guard<std::mutex> lock(m_ConfigSyncStageLock);
 
+	// The update is applied once all referenced files are here, see ConfigFileChunkHandler().
+	if (!FetchMissingConfigFiles(origin, params))
+		return;
+
 	String apiZonesStageDir = GetApiZonesStageDir();
 	String fromEndpointName = origin->FromClient->GetEndpoint()->GetName();
 	String fromZoneName = GetFromZoneName(origin->FromZone);
@@ -351,8 +531,17 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 	if (params->Contains("checksums"))
 		checksums = params->Get("checksums");
 
+	// Large files which are not part of the message, see SendConfigUpdate().
+	Dictionary::Ptr references;
+
+	if (params->Contains("references"))
+		references = params->Get("references");
+
 	bool configChange = false;
 
+	// The zones whose config changed, only these have to be validated.
+	std::set<String> changedZones;
+
 	// Keep track of the relative config paths for later validation and copying. TODO: Find a better algorithm.
 	std::vector<String> relativePaths;
 
@@ -414,14 +603,20 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 		if (checksums)
 			newConfigInfo.Checksums = checksums->Get(kv.first);
 
-		// Load the current production config details.
-		ConfigDirInformation productionConfigInfo = LoadConfigDir(productionConfigZoneDir);
+		// Copy the referenced files into the spool directory, they have been fetched (if necessary) before.
+		if (references && checksums)
+			newConfigInfo.References = ResolveConfigReferences(zoneName, references->Get(kv.first), newConfigInfo.Checksums);
+
+		// Load the current production config details, large files only by checksum if the parent does so, too.
+		ConfigDirInformation productionConfigInfo = LoadConfigDir(productionConfigZoneDir,
+			references ? l_ConfigFileReferenceSize : SIZE_MAX);
 
 		// Merge updateV1 and updateV2
 		Dictionary::Ptr productionConfig = MergeConfigUpdate(productionConfigInfo);
 		Dictionary::Ptr newConfig = MergeConfigUpdate(newConfigInfo);
 
 		bool timestampChanged = false;
+		bool zoneChange = false;
 
 		if (CompareTimestampsConfigChange(productionConfig, newConfig, stageConfigZoneDir)) {
 			timestampChanged = true;
@@ -438,7 +633,7 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 			if (timestampChanged) {
 
 				if (CheckConfigChange(productionConfigInfo, newConfigInfo))
-					configChange = true;
+					zoneChange = true;
 			}
 
 		} else {
@@ -453,7 +648,7 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 				<< fromEndpointName << ". This behaviour is deprecated. Please upgrade the parent endpoint to 2.11+";
 
 			if (timestampChanged) {
-				configChange = true;
+				zoneChange = true;
 			}
 
 			// Keep another hack when there's a timestamp file missing.
@@ -465,7 +660,7 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 					// This is super expensive with a string content comparison.
 					if (productionConfig->Get(kv.first) != kv.second) {
 						if (!Utility::Match("*/.timestamp", kv.first))
-							configChange = true;
+							zoneChange = true;
 					}
 				}
 			}
@@ -495,12 +690,22 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 				if (Utility::BaseName(path) == ".authoritative")
 					continue;
 
-				// Sync string content only.
-				String content = kv.second;
-
 				// Generate a directory tree (zones/1/2/3 might not exist yet).
 				Utility::MkDirP(Utility::DirName(path), 0755);
 
+				// Large files have been spooled while decoding the message, just move them.
+				if (kv.second.IsObjectType<ConfigSpoolFile>()) {
+					ConfigSpoolFile::Ptr spooled = kv.second;
+
+					Utility::RenameFile(spooled->GetPath(), path);
+
+					numBytes += spooled->GetSize();
+					continue;
+				}
+
+				// Sync string content only.
+				String content = kv.second;
+
 				// Write the content to file.
 				std::ofstream fp(path.CStr(), std::ofstream::out | std::ostream::binary | std::ostream::trunc);
 				fp << content;
@@ -520,7 +725,7 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 
 			for (const Dictionary::Pair& kv : productionConfig) {
 				if (!newConfig->Contains(kv.first)) {
-					configChange = true;
+					zoneChange = true;
 
 					String path = stageConfigZoneDir + "/" + kv.first;
 					Utility::Remove(path);
@@ -528,9 +733,18 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 			}
 		}
 
+		if (zoneChange) {
+			configChange = true;
+			changedZones.insert(zoneName);
+		}
+
 		count++;
 	}
 
+	// All fetched files have been copied into the staging directory.
+	if (references && Utility::PathExists(GetApiZonesBlobDir()))
+		Utility::RemoveDirRecursive(GetApiZonesBlobDir());
+
 	/*
 	 * We have processed all configuration files and stored them in the staging directory.
 	 *
@@ -544,7 +758,7 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 		Log(LogInformation, "ApiListener")
 			<< "Received configuration updates (" << count << ") from endpoint '" << fromEndpointName
 			<< "' are different to production, triggering validation and reload.";
-		TryActivateZonesStage(relativePaths);
+		TryActivateZonesStage(relativePaths, changedZones);
 	} else {
 		Log(LogInformation, "ApiListener")
 			<< "Received configuration updates (" << count << ") from endpoint '" << fromEndpointName
@@ -553,48 +767,372 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 	}
 }
 
+static size_t GetFileSize(const String& path)
+{
+	std::ifstream fp(path.CStr(), std::ifstream::binary | std::ifstream::ate);
+
+	return fp ? static_cast<size_t>(fp.tellg()) : 0;
+}
+
+/* Fetched files are stored by their checksum until the config update is applied. */
+static String GetConfigBlobPath(const String& checksum)
+{
+	return ApiListener::GetApiZonesBlobDir() + checksum;
+}
+
+/* The caller must hold l_ConfigFetchMutex. */
+static void ResetConfigFetch()
+{
+	l_ConfigFetchOrigin = nullptr;
+	l_ConfigFetchParams = nullptr;
+	l_ConfigFetchQueue.clear();
+}
+
 /**
- * Spawns a new validation process with 'System.ZonesStageVarDir' set to override the config validation zone dirs with
- * our current stage. Then waits for the validation result and if it was successful, the configuration is copied from
- * stage to production and a restart is triggered. On validation failure, there is no restart and this is logged.
+ * Requests the next chunk of the first file in the fetch queue. Continues
+ * where the last connection (or process) stopped with this file.
  *
- * The caller of this function must hold m_ConfigSyncStageLock.
+ * The caller must hold l_ConfigFetchMutex.
+ */
+static void RequestConfigFileChunk()
+{
+	auto& fetch (l_ConfigFetchQueue.front());
+
+	l_ConfigFetchOrigin->FromClient->SendMessage(new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "config::FetchFile" },
+		{ "params", new Dictionary({
+			{ "zone", fetch.Zone },
+			{ "path", fetch.Path },
+			{ "checksum", fetch.Checksum },
+			{ "offset", GetFileSize(GetConfigBlobPath(fetch.Checksum) + ".part") }
+		}) }
+	}));
+}
+
+/**
+ * Checks whether all files referenced by a config update are available,
+ * either fetched before or unchanged in production. Otherwise the update is
+ * put aside and the missing files are requested from the parent.
  *
- * @param relativePaths Collected paths including the zone name, which are copied from stage to current directories.
+ * The caller must hold m_ConfigSyncStageLock.
+ *
+ * @param origin Where the config update came from.
+ * @param params The config update.
+ * @returns Whether the config update can be applied now.
  */
-void ApiListener::TryActivateZonesStage(const std::vector<String>& relativePaths)
+bool ApiListener::FetchMissingConfigFiles(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
 {
-	VERIFY(Application::GetArgC() >= 1);
+	Dictionary::Ptr references = params->Get("references");
+	Dictionary::Ptr checksums = params->Get("checksums");
+	std::deque<ConfigFileFetch> missing;
+	std::set<String> missingChecksums;
+	size_t missingBytes = 0;
 
-	/* Inherit parent process args. */
-	Array::Ptr args = new Array({
-		Application::GetExePath(Application::GetArgV()[0]),
-	});
+	if (references && checksums) {
+		ObjectLock olock(references);
 
-	for (int i = 1; i < Application::GetArgC(); i++) {
-		String argV = Application::GetArgV()[i];
+		for (const Dictionary::Pair& zoneReferences : references) {
+			String zoneName = zoneReferences.first;
 
-		if (argV == "-d" || argV == "--daemonize")
-			continue;
+			// HandleConfigUpdate() ignores these zones.
+			if (!Zone::GetByName(zoneName) || ConfigCompiler::HasZoneConfigAuthority(zoneName))
+				continue;
 
-		args->Add(argV);
+			Dictionary::Ptr files = zoneReferences.second;
+			Dictionary::Ptr zoneChecksums = checksums->Get(zoneName);
+
+			if (!files || !zoneChecksums)
+				continue;
+
+			ObjectLock flock(files);
+
+			for (const Dictionary::Pair& kv : files) {
+				String checksum = zoneChecksums->Get(kv.first);
+
+				// It's used as file name.
+				if (checksum.IsEmpty() || checksum.FindFirstNotOf("0123456789abcdef") != String::NPos) {
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid checksum '" + checksum
+						+ "' for config file '" + kv.first + "' of zone '" + zoneName + "'."));
+				}
+
+				if (missingChecksums.find(checksum) != missingChecksums.end() || Utility::PathExists(GetConfigBlobPath(checksum)))
+					continue;
+
+				String productionFile = GetApiZonesDir() + zoneName + kv.first;
+				struct stat statbuf;
+
+				if (stat(productionFile.CStr(), &statbuf) >= 0) {
+					String productionChecksum;
+					bool validUtf8;
+
+					if (!GetCachedConfigFileChecksum(productionFile, statbuf.st_mtime, statbuf.st_size, productionChecksum, validUtf8)) {
+						std::ifstream fp(productionFile.CStr(), std::ifstream::binary);
+
+						if (fp) {
+							String content((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
+
+							productionChecksum = GetConfigFileChecksum(productionFile, statbuf.st_mtime, statbuf.st_size,
+								content, content == Utility::ValidateUTF8(content));
+						}
+					}
+
+					if (productionChecksum == checksum)
+						continue;
+				}
+
+				size_t size = Convert::ToLong(kv.second);
+
+				missing.push_back({ zoneName, kv.first, checksum, size });
+				missingChecksums.insert(checksum);
+				missingBytes += size;
+			}
+		}
 	}
 
-	args->Add("--validate");
+	std::unique_lock<std::mutex> lock (l_ConfigFetchMutex);
 
-	// Set the ZonesStageDir. This creates our own local chroot without any additional automated zone includes.
-	args->Add("--define");
-	args->Add("System.ZonesStageVarDir=" + GetApiZonesStageDir());
+	// A newer config update replaces the one which waits for its files.
+	ResetConfigFetch();
 
-	Process::Ptr process = new Process(Process::PrepareCommand(args));
-	process->SetTimeout(Application::GetReloadTimeout());
+	if (missing.empty())
+		return true;
 
-	process->Run();
-	const ProcessResult& pr = process->WaitForResult();
+	l_ConfigFetchOrigin = origin;
+	l_ConfigFetchParams = params;
+	l_ConfigFetchQueue = std::move(missing);
+
+	Log(LogInformation, "ApiListener")
+		<< "Fetching " << l_ConfigFetchQueue.size() << " changed config files (" << missingBytes
+		<< " Bytes) from endpoint '" << origin->FromClient->GetEndpoint()->GetName() << "' before applying its config update.";
+
+	Utility::MkDirP(GetApiZonesBlobDir(), 0700);
+	RequestConfigFileChunk();
+
+	return false;
+}
+
+/**
+ * Copies the files referenced by a config update into the spool directory,
+ * so they're moved into the stage directory like large files from the message.
+ *
+ * @param zoneName The zone.
+ * @param references The zone's referenced files, relative path => size.
+ * @param checksums The zone's checksums, relative path => checksum.
+ * @returns The referenced files, relative path => ConfigSpoolFile.
+ */
+Dictionary::Ptr ApiListener::ResolveConfigReferences(const String& zoneName, const Dictionary::Ptr& references, const Dictionary::Ptr& checksums)
+{
+	Dictionary::Ptr resolved = new Dictionary();
+
+	if (!references || !checksums)
+		return resolved;
+
+	String spoolDir = GetApiZonesSpoolDir();
+
+	Utility::MkDirP(spoolDir, 0700);
+
+	ObjectLock olock(references);
+
+	for (const Dictionary::Pair& kv : references) {
+		String source = GetConfigBlobPath(checksums->Get(kv.first));
+
+		// Not fetched, so it's unchanged in production. See FetchMissingConfigFiles().
+		if (!Utility::PathExists(source))
+			source = GetApiZonesDir() + zoneName + kv.first;
+
+		std::fstream fp;
+		String tempPath = Utility::CreateTempFile(spoolDir + "file.XXXXXX", 0600, fp);
+		fp.close();
+
+		ConfigSpoolFile::Ptr spooled = new ConfigSpoolFile(tempPath, Convert::ToLong(kv.second));
+
+		Utility::CopyFile(source, tempPath);
+		resolved->Set(kv.first, spooled);
+	}
+
+	return resolved;
+}
+
+/**
+ * Registered handler when a child requests a chunk of a config file which has
+ * been referenced in a config::Update message.
+ *
+ * @param origin Where this message came from.
+ * @param params The zone, relative path and checksum of the file and the offset of the chunk.
+ * @returns Empty, required by the interface.
+ */
+Value ApiListener::ConfigFetchFileHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	Endpoint::Ptr endpoint = origin->FromClient->GetEndpoint();
+
+	// Same rules as for sending the config update, see SendConfigUpdate().
+	if (!endpoint || !endpoint->GetZone()->IsChildOf(Zone::GetLocalZone()))
+		return Empty;
+
+	String zoneName = params->Get("zone");
+	String path = params->Get("path");
+	Zone::Ptr zone = Zone::GetByName(zoneName);
+
+	if (!zone || (!zone->IsChildOf(endpoint->GetZone()) && !zone->IsGlobal()) || path.Find("..") != String::NPos) {
+		Log(LogWarning, "ApiListener")
+			<< "Ignoring request for config file '" << path << "' of zone '" << zoneName
+			<< "' from endpoint '" << endpoint->GetName() << "'.";
+		return Empty;
+	}
+
+	String file = GetApiZonesDir() + zoneName + path;
+	std::ifstream fp(file.CStr(), std::ifstream::binary | std::ifstream::ate);
+
+	if (!fp) {
+		Log(LogNotice, "ApiListener")
+			<< "Cannot send config file '" << file << "' to endpoint '" << endpoint->GetName() << "': It doesn't exist anymore.";
+		return Empty;
+	}
+
+	size_t size = fp.tellg();
+	double requestedOffset = params->Get("offset");
+	size_t offset = std::min(static_cast<size_t>(std::max(requestedOffset, 0.0)), size);
+	std::string chunk (std::min(size - offset, l_ConfigFileChunkSize), '\0');
+
+	fp.seekg(offset);
+	fp.read(&chunk[0], chunk.size());
+
+	origin->FromClient->SendMessage(new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "config::FileChunk" },
+		{ "params", new Dictionary({
+			{ "checksum", params->Get("checksum") },
+			{ "offset", offset },
+			{ "size", size },
+			{ "data", Base64::Encode(chunk) }
+		}) }
+	}));
 
+	return Empty;
+}
+
+/**
+ * Registered handler when a chunk of a config file which is being fetched
+ * is received. Once all files are there, the config update is applied.
+ *
+ * @param origin Where this message came from.
+ * @param params The checksum of the file, the offset of the chunk, the file's size and the chunk.
+ * @returns Empty, required by the interface.
+ */
+Value ApiListener::ConfigFileChunkHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener)
+		return Empty;
+
+	std::unique_lock<std::mutex> lock (l_ConfigFetchMutex);
+
+	// Chunks for a config update which has been replaced meanwhile.
+	if (l_ConfigFetchQueue.empty() || origin->FromClient != l_ConfigFetchOrigin->FromClient)
+		return Empty;
+
+	auto& fetch (l_ConfigFetchQueue.front());
+	String fromEndpointName = origin->FromClient->GetEndpoint()->GetName();
+	String partPath = GetConfigBlobPath(fetch.Checksum) + ".part";
+	size_t offset = GetFileSize(partPath);
+
+	if (params->Get("checksum") != fetch.Checksum || static_cast<double>(params->Get("offset")) != offset)
+		return Empty;
+
+	if (static_cast<double>(params->Get("size")) != fetch.Size) {
+		Log(LogWarning, "ApiListener")
+			<< "Config file '" << fetch.Path << "' of zone '" << fetch.Zone << "' changed on endpoint '"
+			<< fromEndpointName << "' while fetching it, waiting for the next config update.";
+
+		Utility::Remove(partPath);
+		ResetConfigFetch();
+		return Empty;
+	}
+
+	String data = Base64::Decode(params->Get("data"));
+
+	{
+		std::ofstream fp(partPath.CStr(), std::ofstream::out | std::ostream::binary | std::ostream::app);
+		fp << data;
+		fp.close();
+
+		if (fp.fail()) {
+			Log(LogCritical, "ApiListener")
+				<< "Cannot write '" << partPath << "', giving up on the config update from endpoint '" << fromEndpointName << "'.";
+
+			ResetConfigFetch();
+			return Empty;
+		}
+	}
+
+	offset += data.GetLength();
+
+	if (offset < fetch.Size && !data.IsEmpty()) {
+		RequestConfigFileChunk();
+		return Empty;
+	}
+
+	std::ifstream fp(partPath.CStr(), std::ifstream::binary);
+	String content((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
+
+	fp.close();
+
+	if (offset != fetch.Size || GetChecksum(content) != fetch.Checksum) {
+		Log(LogWarning, "ApiListener")
+			<< "Discarding config file '" << fetch.Path << "' of zone '" << fetch.Zone << "' fetched from endpoint '"
+			<< fromEndpointName << "': Its checksum doesn't match. Waiting for the next config update.";
+
+		Utility::Remove(partPath);
+		ResetConfigFetch();
+		return Empty;
+	}
+
+	Utility::RenameFile(partPath, GetConfigBlobPath(fetch.Checksum));
+	l_ConfigFetchQueue.pop_front();
+
+	if (!l_ConfigFetchQueue.empty()) {
+		RequestConfigFileChunk();
+		return Empty;
+	}
+
+	MessageOrigin::Ptr updateOrigin = l_ConfigFetchOrigin;
+	Dictionary::Ptr updateParams = l_ConfigFetchParams;
+
+	ResetConfigFetch();
+	lock.unlock();
+
+	Log(LogInformation, "ApiListener")
+		<< "Fetched all changed config files from endpoint '" << fromEndpointName << "', applying its config update.";
+
+	listener->HandleConfigUpdateAsync(updateOrigin, updateParams);
+
+	return Empty;
+}
+
+/**
+ * Validates our current stage in a new process, see RunZonesStageValidationProcess(). If the validation was
+ * successful, the configuration is copied from stage to production and a restart is triggered. On validation failure,
+ * there is no restart and this is logged.
+ *
+ * With scoped validation enabled, only the changed zones are validated in-process if that's supported.
+ *
+ * The caller of this function must hold m_ConfigSyncStageLock.
+ *
+ * @param relativePaths Collected paths including the zone name, which are copied from stage to current directories.
+ * @param changedZones The zones whose config changed.
+ */
+void ApiListener::TryActivateZonesStage(const std::vector<String>& relativePaths, const std::set<String>& changedZones)
+{
 	String apiZonesDir = GetApiZonesDir();
 	String apiZonesStageDir = GetApiZonesStageDir();
 
+	ProcessResult pr;
+
+	if (!ScopedValidation::IsEnabled() || !ScopedValidation::ValidateZones(apiZonesStageDir, changedZones, pr))
+		pr = RunZonesStageValidationProcess();
+
 	String logFile = apiZonesStageDir + "/startup.log";
 	std::ofstream fpLog(logFile.CStr(), std::ofstream::out | std::ostream::binary | std::ostream::trunc);
 	fpLog << pr.Output;
@@ -655,6 +1193,43 @@ void ApiListener::TryActivateZonesStage(const std::vector<String>& relativePaths
 		listener->UpdateLastFailedZonesStageValidation(pr.Output);
 }
 
+/**
+ * Spawns a new validation process with 'System.ZonesStageVarDir' set to override the config validation zone dirs with
+ * our current stage and waits for its result.
+ *
+ * @returns The result of the validation process.
+ */
+ProcessResult ApiListener::RunZonesStageValidationProcess()
+{
+	VERIFY(Application::GetArgC() >= 1);
+
+	/* Inherit parent process args. */
+	Array::Ptr args = new Array({
+		Application::GetExePath(Application::GetArgV()[0]),
+	});
+
+	for (int i = 1; i < Application::GetArgC(); i++) {
+		String argV = Application::GetArgV()[i];
+
+		if (argV == "-d" || argV == "--daemonize")
+			continue;
+
+		args->Add(argV);
+	}
+
+	args->Add("--validate");
+
+	// Set the ZonesStageDir. This creates our own local chroot without any additional automated zone includes.
+	args->Add("--define");
+	args->Add("System.ZonesStageVarDir=" + GetApiZonesStageDir());
+
+	Process::Ptr process = new Process(Process::PrepareCommand(args));
+	process->SetTimeout(Application::GetReloadTimeout());
+
+	process->Run();
+	return process->WaitForResult();
+}
+
 /**
  * Update the structure from the last failed validation output.
  * Uses the current timestamp.
@@ -784,19 +1359,145 @@ bool ApiListener::CheckConfigChange(const ConfigDirInformation& oldConfig, const
  * Load the given config dir and read their file content into the config structure.
  *
  * @param dir Path to the config directory.
+ * @param maxContentSize Larger files are only put into the references with their checksum.
  * @returns ConfigDirInformation structure.
  */
-ConfigDirInformation ApiListener::LoadConfigDir(const String& dir)
+ConfigDirInformation ApiListener::LoadConfigDir(const String& dir, size_t maxContentSize)
 {
 	ConfigDirInformation config;
 	config.UpdateV1 = new Dictionary();
 	config.UpdateV2 = new Dictionary();
 	config.Checksums = new Dictionary();
+	config.References = new Dictionary();
+
+	std::vector<String> files;
+	Utility::GlobRecursive(dir, "*", [&files](const String& file) { files.push_back(file); }, GlobFile);
+
+	/* Spinning up threads isn't worth it for a few files. */
+	if (files.size() < 64 || Configuration::Concurrency < 2) {
+		for (const String& file : files)
+			ConfigGlobHandler(config, dir, file, maxContentSize);
+	} else {
+		WorkQueue upq(25000, Configuration::Concurrency);
+		upq.SetName("ApiListener::LoadConfigDir");
+
+		upq.ParallelFor(files, [&config, &dir, maxContentSize](const String& file) {
+			ConfigGlobHandler(config, dir, file, maxContentSize);
+		});
+
+		upq.Join();
+
+		if (upq.HasExceptions())
+			upq.ReportExceptions("ApiListener");
+	}
+
+	SaveConfigFileChecksums();
 
-	Utility::GlobRecursive(dir, "*", std::bind(&ApiListener::ConfigGlobHandler, std::ref(config), dir, _1), GlobFile);
 	return config;
 }
 
+/**
+ * Looks up the checksum of a config file which hasn't changed since it was
+ * calculated, so that the file doesn't have to be read at all.
+ *
+ * @param file Full file name.
+ * @param mtime The file's current modification time.
+ * @param size The file's current size.
+ * @param checksum The checksum, if found.
+ * @param validUtf8 Whether the file's content is valid UTF-8, if found.
+ * @returns Whether the checksum was found.
+ */
+bool ApiListener::GetCachedConfigFileChecksum(const String& file, time_t mtime, size_t size, String& checksum, bool& validUtf8)
+{
+	std::unique_lock<std::mutex> lock (l_ConfigFileChecksumsMutex);
+
+	LoadConfigFileChecksums();
+
+	auto it (l_ConfigFileChecksums.find(file));
+
+	if (it == l_ConfigFileChecksums.end() || it->second.MTime != mtime || it->second.Size != size)
+		return false;
+
+	checksum = it->second.Checksum;
+	validUtf8 = it->second.ValidUTF8;
+
+	return true;
+}
+
+/**
+ * Returns the checksum of a config file's content. Config files rarely change,
+ * so the checksum is remembered together with the file's modification time
+ * and size and only calculated again once one of them changes.
+ *
+ * @param file Full file name.
+ * @param mtime The file's modification time from before it was read.
+ * @param size The file's size from before it was read.
+ * @param content The file's content.
+ * @param validUtf8 Whether the content is valid UTF-8.
+ * @returns The checksum as string.
+ */
+String ApiListener::GetConfigFileChecksum(const String& file, time_t mtime, size_t size, const String& content, bool validUtf8)
+{
+	String checksum;
+	bool cachedValidUtf8;
+
+	/* The file could have been changed after it was stat()ed, the content has to fit at least. */
+	if (content.GetLength() == size && GetCachedConfigFileChecksum(file, mtime, size, checksum, cachedValidUtf8))
+		return checksum;
+
+	checksum = GetChecksum(content);
+
+	/* A change within the same second after reading the file wouldn't change its modification time. */
+	if (mtime + 1 < Utility::GetTime()) {
+		std::unique_lock<std::mutex> lock (l_ConfigFileChecksumsMutex);
+
+		l_ConfigFileChecksums[file] = ConfigFileChecksum{mtime, size, validUtf8, checksum};
+		l_ConfigFileChecksumsChanged = true;
+	}
+
+	return checksum;
+}
+
+/**
+ * Persists the config file checksums in the API directory if they have
+ * changed, so they don't have to be calculated again after a restart.
+ * The checksums of files which don't exist anymore are dropped.
+ */
+void ApiListener::SaveConfigFileChecksums()
+{
+	std::unique_lock<std::mutex> lock (l_ConfigFileChecksumsMutex);
+
+	if (!l_ConfigFileChecksumsChanged)
+		return;
+
+	l_ConfigFileChecksumsChanged = false;
+
+	Dictionary::Ptr checksums = new Dictionary();
+
+	for (auto it (l_ConfigFileChecksums.begin()); it != l_ConfigFileChecksums.end();) {
+		if (!Utility::PathExists(it->first)) {
+			it = l_ConfigFileChecksums.erase(it);
+			continue;
+		}
+
+		checksums->Set(it->first, new Array({
+			static_cast<double>(it->second.MTime),
+			static_cast<double>(it->second.Size),
+			it->second.ValidUTF8,
+			it->second.Checksum
+		}));
+
+		++it;
+	}
+
+	try {
+		Utility::SaveJsonFile(GetConfigFileChecksumsPath(), 0600, checksums);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ApiListener")
+			<< "Failed to save config file checksums: " << DiagnosticInformation(ex, false);
+	}
+}
+
 /**
  * Read the given file and store it in the config information structure.
  * Callback function for Glob().
@@ -804,8 +1505,9 @@ ConfigDirInformation ApiListener::LoadConfigDir(const String& dir)
  * @param config Reference to the config information object.
  * @param path File path.
  * @param file Full file name.
+ * @param maxContentSize Larger files are only put into the references with their checksum.
  */
-void ApiListener::ConfigGlobHandler(ConfigDirInformation& config, const String& path, const String& file)
+void ApiListener::ConfigGlobHandler(ConfigDirInformation& config, const String& path, const String& file, size_t maxContentSize)
 {
 	// Avoid loading the authoritative marker for syncs at all cost.
 	if (Utility::BaseName(file) == ".authoritative")
@@ -816,6 +1518,24 @@ void ApiListener::ConfigGlobHandler(ConfigDirInformation& config, const String&
 	Log(LogNotice, "ApiListener")
 		<< "Creating config update for file '" << file << "'.";
 
+	String relativePath = file.SubStr(path.GetLength());
+	struct stat statbuf;
+
+	if (stat(file.CStr(), &statbuf) < 0)
+		return;
+
+	// Large files which haven't changed since the last time don't even have to be read.
+	if (static_cast<size_t>(statbuf.st_size) > maxContentSize) {
+		String checksum;
+		bool validUtf8;
+
+		if (GetCachedConfigFileChecksum(file, statbuf.st_mtime, statbuf.st_size, checksum, validUtf8) && validUtf8) {
+			config.References->Set(relativePath, static_cast<double>(statbuf.st_size));
+			config.Checksums->Set(relativePath, checksum);
+			return;
+		}
+	}
+
 	std::ifstream fp(file.CStr(), std::ifstream::binary);
 	if (!fp)
 		return;
@@ -823,7 +1543,6 @@ void ApiListener::ConfigGlobHandler(ConfigDirInformation& config, const String&
 	String content((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
 
 	Dictionary::Ptr update;
-	String relativePath = file.SubStr(path.GetLength());
 
 	/*
 	 * 'update' messages contain conf files. 'update_v2' syncs everything else (.timestamp).
@@ -832,6 +1551,15 @@ void ApiListener::ConfigGlobHandler(ConfigDirInformation& config, const String&
 	 */
 	String sanitizedContent = Utility::ValidateUTF8(content);
 
+	bool validUtf8 = content == sanitizedContent;
+
+	// Large files are only referenced, they're transferred as is, so they have to be valid already.
+	if (content.GetLength() > maxContentSize && validUtf8) {
+		config.References->Set(relativePath, content.GetLength());
+		config.Checksums->Set(relativePath, GetConfigFileChecksum(file, statbuf.st_mtime, statbuf.st_size, content, validUtf8));
+		return;
+	}
+
 	if (Utility::Match("*.conf", file)) {
 		update = config.UpdateV1;
 
@@ -845,7 +1573,7 @@ void ApiListener::ConfigGlobHandler(ConfigDirInformation& config, const String&
 		 * Binary files are not supported when wrapped into JSON encoded messages.
 		 * Rationale: https://github.com/Icinga/icinga2/issues/7382
 		 */
-		if (content != sanitizedContent) {
+		if (!validUtf8) {
 			Log(LogCritical, "ApiListener")
 				<< "Ignoring file '" << file << "' for cluster config sync: Does not contain valid UTF8. Binary files are not supported.";
 			return;
@@ -858,7 +1586,7 @@ void ApiListener::ConfigGlobHandler(ConfigDirInformation& config, const String&
 	 *
 	 * IMPORTANT: Ignore the .authoritative file above, this must not be synced.
 	 * */
-	config.Checksums->Set(relativePath, GetChecksum(content));
+	config.Checksums->Set(relativePath, GetConfigFileChecksum(file, statbuf.st_mtime, statbuf.st_size, content, validUtf8));
 }
 
 /**
@@ -877,5 +1605,8 @@ Dictionary::Ptr ApiListener::MergeConfigUpdate(const ConfigDirInformation& confi
 	if (config.UpdateV2)
 		config.UpdateV2->CopyTo(result);
 
+	if (config.References)
+		config.References->CopyTo(result);
+
 	return result;
 }
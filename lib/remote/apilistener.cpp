@@ -8,9 +8,11 @@
 #include "remote/apifunction.hpp"
 #include "remote/configpackageutility.hpp"
 #include "remote/configobjectutility.hpp"
+#include "base/configuration.hpp"
 #include "base/convert.hpp"
 #include "base/defer.hpp"
 #include "base/io-engine.hpp"
+#include "base/listenerhandover.hpp"
 #include "base/netstring.hpp"
 #include "base/json.hpp"
 #include "base/configtype.hpp"
@@ -23,7 +25,9 @@
 #include "base/statsfunction.hpp"
 #include "base/exception.hpp"
 #include "base/tcpsocket.hpp"
+#include "base/tracing.hpp"
 #include <boost/asio/buffer.hpp>
+#include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/io_context_strand.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/spawn.hpp>
@@ -32,6 +36,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 #include <boost/system/error_code.hpp>
+#include <algorithm>
 #include <climits>
 #include <cstdint>
 #include <fstream>
@@ -42,6 +47,10 @@
 #include <sstream>
 #include <utility>
 
+#ifndef _WIN32
+#	include <unistd.h>
+#endif /* _WIN32 */
+
 using namespace icinga;
 
 REGISTER_TYPE(ApiListener);
@@ -56,7 +65,12 @@ REGISTER_APIFUNCTION(Hello, icinga, &ApiListener::HelloAPIHandler);
 ApiListener::ApiListener()
 {
 	m_RelayQueue.SetName("ApiListener, RelayQueue");
+
+	m_RelayLanes.reset(new ShardedWorkQueue(0, Configuration::Concurrency));
+	m_RelayLanes->SetName("ApiListener, RelayLanes");
 	m_SyncQueue.SetName("ApiListener, SyncQueue");
+	m_ReplayQueue.SetName("ApiListener, ReplayQueue");
+	m_LogCompressionQueue.SetName("ApiListener, LogCompressionQueue");
 }
 
 String ApiListener::GetApiDir()
@@ -74,6 +88,16 @@ String ApiListener::GetApiZonesStageDir()
 	return GetApiDir() + "zones-stage/";
 }
 
+String ApiListener::GetApiZonesSpoolDir()
+{
+	return GetApiDir() + "zones-spool/";
+}
+
+String ApiListener::GetApiZonesBlobDir()
+{
+	return GetApiDir() + "zones-blobs/";
+}
+
 String ApiListener::GetCertsDir()
 {
 	return Configuration::DataDir + "/certs/";
@@ -218,6 +242,15 @@ void ApiListener::UpdateSSLContext()
 		}
 	}
 
+	try {
+		SetTlsSessionTicketKeys(context, GetCertsDir() + "/session-tickets.key");
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ApiListener")
+			<< "Cannot set TLS session ticket keys: " << DiagnosticInformation(ex, false);
+	}
+
+	EnableTlsVerifyCache(context);
+
 	m_SSLContext = context;
 
 	for (const Endpoint::Ptr& endpoint : ConfigType::GetObjectsByType<Endpoint>()) {
@@ -249,6 +282,13 @@ void ApiListener::Start(bool runtimeCreated)
 
 	SyncLocalZoneDirs();
 
+	/* Left over from config updates and uploads which were being received during a crash. */
+	if (Utility::PathExists(GetApiZonesSpoolDir()))
+		Utility::RemoveDirRecursive(GetApiZonesSpoolDir());
+
+	if (Utility::PathExists(ConfigPackageUtility::GetSpoolDir()))
+		Utility::RemoveDirRecursive(ConfigPackageUtility::GetSpoolDir());
+
 	ObjectImpl<ApiListener>::Start(runtimeCreated);
 
 	{
@@ -256,6 +296,8 @@ void ApiListener::Start(bool runtimeCreated)
 		OpenLogFile();
 	}
 
+	CompressRotatedLogFiles();
+
 	/* create the primary JSON-RPC listener */
 	if (!AddListener(GetBindHost(), GetBindPort())) {
 		Log(LogCritical, "ApiListener")
@@ -305,6 +347,8 @@ void ApiListener::Stop(bool runtimeDeleted)
 	Log(LogInformation, "ApiListener")
 		<< "'" << GetName() << "' stopped.";
 
+	HandOverObjectAuthority();
+
 	{
 		std::unique_lock<std::mutex> lock(m_LogLock);
 		CloseLogFile();
@@ -369,51 +413,83 @@ bool ApiListener::AddListener(const String& node, const String& service)
 	auto& io (IoEngine::Get().GetIoContext());
 	auto acceptor (Shared<tcp::acceptor>::Make(io));
 
-	try {
-		tcp::resolver resolver (io);
-		tcp::resolver::query query (node, service, tcp::resolver::query::passive);
+#ifndef _WIN32
+	/* Clients connecting during a reload wait in the backlog of the socket inherited from the previous worker. */
+	String handoverKey = "ApiListener [" + node + "]:" + service;
+	int inherited = ListenerHandover::Take(handoverKey);
 
-		auto result (resolver.resolve(query));
-		auto current (result.begin());
+	if (inherited != -1) {
+		sockaddr_storage addr;
+		socklen_t addrLen = sizeof(addr);
 
-		for (;;) {
-			try {
-				acceptor->open(current->endpoint().protocol());
+		try {
+			if (getsockname(inherited, reinterpret_cast<sockaddr*>(&addr), &addrLen) < 0) {
+				BOOST_THROW_EXCEPTION(posix_error()
+					<< boost::errinfo_api_function("getsockname")
+					<< boost::errinfo_errno(errno));
+			}
 
-				{
-					auto fd (acceptor->native_handle());
+			acceptor->assign(addr.ss_family == AF_INET6 ? tcp::v6() : tcp::v4(), inherited);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ApiListener")
+				<< "Cannot take over TCP socket for host '" << node << "' on port '" << service << "', binding anew: " << ex.what();
 
-					const int optFalse = 0;
-					setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char *>(&optFalse), sizeof(optFalse));
+			(void)close(inherited);
+		}
+	}
+#endif /* _WIN32 */
+
+	if (!acceptor->is_open()) {
+		try {
+			tcp::resolver resolver (io);
+			tcp::resolver::query query (node, service, tcp::resolver::query::passive);
 
-					const int optTrue = 1;
-					setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&optTrue), sizeof(optTrue));
+			auto result (resolver.resolve(query));
+			auto current (result.begin());
+
+			for (;;) {
+				try {
+					acceptor->open(current->endpoint().protocol());
+
+					{
+						auto fd (acceptor->native_handle());
+
+						const int optFalse = 0;
+						setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char *>(&optFalse), sizeof(optFalse));
+
+						const int optTrue = 1;
+						setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&optTrue), sizeof(optTrue));
 #ifdef SO_REUSEPORT
-					setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char *>(&optTrue), sizeof(optTrue));
+						setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char *>(&optTrue), sizeof(optTrue));
 #endif /* SO_REUSEPORT */
-				}
+					}
 
-				acceptor->bind(current->endpoint());
+					acceptor->bind(current->endpoint());
 
-				break;
-			} catch (const std::exception&) {
-				if (++current == result.end()) {
-					throw;
-				}
+					break;
+				} catch (const std::exception&) {
+					if (++current == result.end()) {
+						throw;
+					}
 
-				if (acceptor->is_open()) {
-					acceptor->close();
+					if (acceptor->is_open()) {
+						acceptor->close();
+					}
 				}
 			}
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "ApiListener")
+				<< "Cannot bind TCP socket for host '" << node << "' on port '" << service << "': " << ex.what();
+			return false;
 		}
-	} catch (const std::exception& ex) {
-		Log(LogCritical, "ApiListener")
-			<< "Cannot bind TCP socket for host '" << node << "' on port '" << service << "': " << ex.what();
-		return false;
 	}
 
 	acceptor->listen(INT_MAX);
 
+#ifndef _WIN32
+	ListenerHandover::Publish(handoverKey, acceptor->native_handle());
+#endif /* _WIN32 */
+
 	auto localEndpoint (acceptor->local_endpoint());
 
 	Log(LogInformation, "ApiListener")
@@ -439,12 +515,38 @@ void ApiListener::ListenerCoroutineProc(boost::asio::yield_context yc, const Sha
 		lastModified = Utility::GetFileCreationTime(crlPath);
 	}
 
+	/* Token bucket for max_connection_rate, allows bursts of up to one second's worth of connections. */
+	double tokens = std::max(GetMaxConnectionRate(), 1.0);
+	double lastRefill = Utility::GetTime();
+
 	for (;;) {
 		try {
-			asio::ip::tcp::socket socket (io);
+			/* The connection stays with the shard it's accepted for, see IoEngine::GetConnectionIoContext(). */
+			auto& shard (IoEngine::Get().GetConnectionIoContext());
+			asio::ip::tcp::socket socket (shard);
 
 			server->async_accept(socket.lowest_layer(), yc);
 
+			double rate = GetMaxConnectionRate();
+
+			if (rate > 0) {
+				double now = Utility::GetTime();
+
+				tokens = std::min(std::max(rate, 1.0), tokens + (now - lastRefill) * rate);
+				lastRefill = now;
+
+				if (tokens < 1) {
+					/* Further connections stay in the listen backlog meanwhile. */
+					asio::deadline_timer timer (io, boost::posix_time::microseconds(int64_t((1 - tokens) / rate * 1000000)));
+					timer.async_wait(yc);
+
+					tokens = 1;
+					lastRefill = Utility::GetTime();
+				}
+
+				tokens -= 1;
+			}
+
 			if (!crlPath.IsEmpty()) {
 				time_t currentCreationTime = Utility::GetFileCreationTime(crlPath);
 
@@ -455,10 +557,10 @@ void ApiListener::ListenerCoroutineProc(boost::asio::yield_context yc, const Sha
 				}
 			}
 
-			auto sslConn (Shared<AsioTlsStream>::Make(io, *sslContext));
+			auto sslConn (Shared<AsioTlsStream>::Make(shard, *sslContext));
 			sslConn->lowest_layer() = std::move(socket);
 
-			auto strand (Shared<asio::io_context::strand>::Make(io));
+			auto strand (Shared<asio::io_context::strand>::Make(shard));
 
 			IoEngine::SpawnCoroutine(*strand, [this, strand, sslConn](asio::yield_context yc) { NewClientHandler(yc, strand, sslConn, String(), RoleServer); });
 		} catch (const std::exception& ex) {
@@ -483,7 +585,7 @@ void ApiListener::AddConnection(const Endpoint::Ptr& endpoint)
 		return;
 	}
 
-	auto& io (IoEngine::Get().GetIoContext());
+	auto& io (IoEngine::Get().GetConnectionIoContext());
 	auto strand (Shared<asio::io_context::strand>::Make(io));
 
 	IoEngine::SpawnCoroutine(*strand, [this, strand, endpoint, &io](asio::yield_context yc) {
@@ -542,7 +644,25 @@ static const auto l_AppVersionInt (([]() -> unsigned long {
 		+ boost::lexical_cast<unsigned long>(match[3].str());
 })());
 
-static const auto l_MyCapabilities (ApiCapabilities::ExecuteArbitraryCommand);
+static const auto l_MyCapabilities (
+	(uint_fast64_t)ApiCapabilities::ExecuteArbitraryCommand | (uint_fast64_t)ApiCapabilities::CompressedMessages
+		| (uint_fast64_t)ApiCapabilities::BinaryMessages | (uint_fast64_t)ApiCapabilities::BatchedCheckMessages
+		| (uint_fast64_t)ApiCapabilities::LocalCheckScheduling | (uint_fast64_t)ApiCapabilities::ChunkedConfigSync
+);
+
+/**
+ * Returns the capabilities announced via icinga::Hello. Check result deltas
+ * need the last check results on both ends, so both have to enable them.
+ */
+uint_fast64_t ApiListener::GetMyCapabilities() const
+{
+	uint_fast64_t capabilities = l_MyCapabilities;
+
+	if (GetEnableCheckResultDeltas())
+		capabilities |= (uint_fast64_t)ApiCapabilities::CheckResultDeltas;
+
+	return capabilities;
+}
 
 /**
  * Processes a new client connection.
@@ -677,7 +797,7 @@ void ApiListener::NewClientHandlerInternal(
 			{ "method", "icinga::Hello" },
 			{ "params", new Dictionary({
 				{ "version", (double)l_AppVersionInt },
-				{ "capabilities", (double)l_MyCapabilities }
+				{ "capabilities", (double)GetMyCapabilities() }
 			}) }
 		}), yc);
 
@@ -716,7 +836,7 @@ void ApiListener::NewClientHandlerInternal(
 				{ "method", "icinga::Hello" },
 				{ "params", new Dictionary({
 					{ "version", (double)l_AppVersionInt },
-					{ "capabilities", (double)l_MyCapabilities }
+					{ "capabilities", (double)GetMyCapabilities() }
 				}) }
 			}), yc);
 
@@ -741,11 +861,18 @@ void ApiListener::NewClientHandlerInternal(
 		JsonRpcConnection::Ptr aclient = new JsonRpcConnection(identity, verify_ok, client, role);
 
 		if (endpoint) {
+			ClearHandover(endpoint);
 			endpoint->AddClient(aclient);
 
-			Utility::QueueAsyncCallback([this, aclient, endpoint]() {
+			/* Don't relay messages to the endpoint before it has been synced, they are replayed. */
+			{
+				ObjectLock olock(endpoint);
+				endpoint->SetSyncing(true);
+			}
+
+			m_SyncQueue.Enqueue([this, aclient, endpoint]() {
 				SyncClient(aclient, endpoint, true);
-			});
+			}, GetSyncPriority(endpoint));
 		} else if (!AddAnonymousClient(aclient)) {
 			Log(LogNotice, "ApiListener")
 				<< "Ignoring anonymous JSON-RPC connection " << conninfo
@@ -770,10 +897,90 @@ void ApiListener::NewClientHandlerInternal(
 	}
 }
 
+/**
+ * Determines the order in which endpoints are synced after connecting, so
+ * a reconnecting cluster is operational before the agents are done.
+ *
+ * @param endpoint The endpoint.
+ * @returns High for the parent and the local zone, normal for satellites
+ *          (child zones with children of their own), low for everything else.
+ */
+WorkQueuePriority ApiListener::GetSyncPriority(const Endpoint::Ptr& endpoint)
+{
+	Zone::Ptr eZone = endpoint->GetZone();
+	Zone::Ptr myZone = Zone::GetLocalZone();
+
+	if (!eZone || !myZone || eZone == myZone || myZone->GetParent() == eZone)
+		return PriorityHigh;
+
+	for (const Zone::Ptr& zone : ConfigType::GetObjectsByType<Zone>()) {
+		if (zone->GetParent() == eZone)
+			return PriorityNormal;
+	}
+
+	return PriorityLow;
+}
+
+/**
+ * Removes and returns what has been synced to the endpoint during its last
+ * connection. Nothing is returned unless the sync has been confirmed and the
+ * last full sync is less than a day ago, which limits how long an endpoint
+ * which lost its state may miss objects.
+ *
+ * @param endpoint The endpoint.
+ * @returns The sync state, Started is 0 if a full sync is required.
+ */
+ApiListener::EndpointSyncState ApiListener::TakeEndpointSyncState(const Endpoint::Ptr& endpoint)
+{
+	std::unique_lock<std::mutex> lock (m_EndpointSyncStatesLock);
+
+	auto it (m_EndpointSyncStates.find(endpoint->GetName()));
+
+	if (it == m_EndpointSyncStates.end())
+		return EndpointSyncState();
+
+	EndpointSyncState state = it->second;
+	m_EndpointSyncStates.erase(it);
+
+	if (!state.Confirmed || Utility::GetTime() - state.LastFullSync > 24 * 60 * 60)
+		return EndpointSyncState();
+
+	return state;
+}
+
+/**
+ * The messages of a sync are sent asynchronously. Syncs are only used as a
+ * base for later ones once the endpoint stayed connected and sent us messages
+ * for a while afterwards.
+ */
+void ApiListener::ConfirmEndpointSyncStates()
+{
+	double now = Utility::GetTime();
+
+	std::unique_lock<std::mutex> lock (m_EndpointSyncStatesLock);
+
+	for (auto& kv : m_EndpointSyncStates) {
+		auto& state (kv.second);
+
+		if (state.Confirmed || now < state.Finished + 10)
+			continue;
+
+		Endpoint::Ptr endpoint = Endpoint::GetByName(kv.first);
+
+		if (endpoint && endpoint->GetConnected() && endpoint->GetLastMessageReceived() > state.Finished + 10)
+			state.Confirmed = true;
+	}
+}
+
 void ApiListener::SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoint::Ptr& endpoint, bool needSync)
 {
 	Zone::Ptr eZone = endpoint->GetZone();
 
+	EndpointSyncState lastSync = TakeEndpointSyncState(endpoint);
+	EndpointSyncState sync;
+	sync.Started = Utility::GetTime();
+	sync.LastFullSync = lastSync.Started > 0 ? lastSync.LastFullSync : sync.Started;
+
 	try {
 		{
 			ObjectLock olock(endpoint);
@@ -801,17 +1008,24 @@ void ApiListener::SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoi
 			<< "Sending config updates for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
 
 		/* sync zone file config */
-		SendConfigUpdate(aclient);
+		sync.ConfigChecksum = SendConfigUpdate(aclient, lastSync.ConfigChecksum);
 
 		Log(LogInformation, "ApiListener")
 			<< "Finished sending config file updates for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
 
-		/* sync runtime config */
-		SendRuntimeConfigObjects(aclient);
+		/* sync runtime config, objects changed during the last sync are sent again */
+		SendRuntimeConfigObjects(aclient, lastSync.Started);
 
 		Log(LogInformation, "ApiListener")
 			<< "Finished sending runtime config updates for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
 
+		sync.Finished = Utility::GetTime();
+
+		{
+			std::unique_lock<std::mutex> lock (m_EndpointSyncStatesLock);
+			m_EndpointSyncStates[endpoint->GetName()] = sync;
+		}
+
 		if (!needSync) {
 			ObjectLock olock2(endpoint);
 			endpoint->SetSyncing(false);
@@ -821,13 +1035,14 @@ void ApiListener::SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoi
 		Log(LogInformation, "ApiListener")
 			<< "Sending replay log for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
 
-		ReplayLog(aclient);
+		/* The log is replayed asynchronously, together with the other endpoints which are catching up. */
+		ReplayLog(aclient, [this, endpoint, eZone]() {
+			if (eZone == Zone::GetLocalZone())
+				UpdateObjectAuthority();
 
-		if (eZone == Zone::GetLocalZone())
-			UpdateObjectAuthority();
-
-		Log(LogInformation, "ApiListener")
-			<< "Finished sending replay log for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
+			Log(LogInformation, "ApiListener")
+				<< "Finished sending replay log for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
+		});
 	} catch (const std::exception& ex) {
 		{
 			ObjectLock olock2(endpoint);
@@ -849,6 +1064,8 @@ void ApiListener::ApiTimerHandler()
 {
 	double now = Utility::GetTime();
 
+	ConfirmEndpointSyncStates();
+
 	std::vector<int> files;
 	Utility::Glob(GetApiDir() + "log/*", std::bind(&ApiListener::LogGlobHandler, std::ref(files), _1), GlobFile);
 	std::sort(files.begin(), files.end());
@@ -881,7 +1098,11 @@ void ApiListener::ApiTimerHandler()
 			String path = GetApiDir() + "log/" + Convert::ToString(ts);
 			Log(LogNotice, "ApiListener")
 				<< "Removing old log file: " << path;
+
+			std::unique_lock<std::mutex> lock (m_LogCompressionLock);
+			m_LogSavedBytes -= ReplayLogCompressor::GetSavedBytes(path);
 			(void)unlink(path.CStr());
+			(void)unlink(ReplayLogReader::GetIndexPath(path).CStr());
 		}
 	}
 
@@ -1027,7 +1248,28 @@ void ApiListener::RelayMessage(const MessageOrigin::Ptr& origin,
 	if (!IsActive())
 		return;
 
-	m_RelayQueue.Enqueue(std::bind(&ApiListener::SyncRelayMessage, this, origin, secobj, message, log), PriorityNormal, true);
+	TraceContext trace;
+
+	if (Tracing::IsExporting())
+		trace = TraceContext::FromTraceparent(message->Get("trace"));
+
+	if (!trace.IsValid()) {
+		m_RelayQueue.Enqueue(std::bind(&ApiListener::SyncRelayMessage, this, origin, secobj, message, log), PriorityNormal, true);
+		return;
+	}
+
+	double enqueued = Utility::GetTime();
+
+	m_RelayQueue.Enqueue([this, origin, secobj, message, log, trace, enqueued]() {
+		double start = Utility::GetTime();
+
+		SyncRelayMessage(origin, secobj, message, log);
+
+		Dictionary::Ptr attributes = new Dictionary({ { "icinga.method", message->Get("method") } });
+
+		Tracing::EmitChildSpan(trace, "relay_queue", enqueued, start, attributes);
+		Tracing::EmitChildSpan(trace, "relay", start, Utility::GetTime(), attributes);
+	}, PriorityNormal, true);
 }
 
 void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObject::Ptr& secobj)
@@ -1036,21 +1278,18 @@ void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObj
 
 	ASSERT(ts != 0);
 
-	Dictionary::Ptr pmessage = new Dictionary();
-	pmessage->Set("timestamp", ts);
-
-	pmessage->Set("message", JsonEncode(message));
+	ReplayLogRecord record;
+	record.Timestamp = ts;
+	record.Message = JsonEncode(message);
 
 	if (secobj) {
-		Dictionary::Ptr secname = new Dictionary();
-		secname->Set("type", secobj->GetReflectionType()->GetName());
-		secname->Set("name", secobj->GetName());
-		pmessage->Set("secobj", secname);
+		record.SecobjType = secobj->GetReflectionType()->GetName();
+		record.SecobjName = secobj->GetName();
 	}
 
 	std::unique_lock<std::mutex> lock(m_LogLock);
 	if (m_LogFile) {
-		NetString::WriteStringToStream(m_LogFile, JsonEncode(pmessage));
+		m_LogFile->Write(record);
 		m_LogMessageCount++;
 		SetLogMessageTimestamp(ts);
 
@@ -1063,6 +1302,21 @@ void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObj
 }
 
 void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message)
+{
+	EncodedMessageCache messageCache;
+
+	SyncSendMessage(endpoint, message, messageCache);
+}
+
+/**
+ * Sends a message to the endpoint's most recent connection.
+ *
+ * @param endpoint The endpoint to send the message to
+ * @param message The message
+ * @param messageCache The encoded message, encoded on first use
+ *                     so that it's shared by all endpoints the message is sent to
+ */
+void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message, EncodedMessageCache& messageCache)
 {
 	ObjectLock olock(endpoint);
 
@@ -1081,7 +1335,7 @@ void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionar
 			if (client->GetTimestamp() != maxTs)
 				continue;
 
-			client->SendMessage(message);
+			client->SendMessage(message, messageCache);
 		}
 	}
 }
@@ -1092,12 +1346,13 @@ void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionar
  *
  * @param targetZone The zone to relay to
  * @param origin Information about where this message is relayed from (if it was not generated locally)
- * @param message The message to relay
+ * @param relayedMessage The message to relay, it's sent from the relay lanes of the target endpoints
  * @param currentZoneMaster The current master node of the local zone
  * @return true if the message has been relayed to all relevant endpoints,
  *         false if it hasn't and must be persisted in the replay log
  */
-bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message, const Endpoint::Ptr& currentZoneMaster)
+bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrigin::Ptr& origin, const std::shared_ptr<RelayedMessage>& relayedMessage,
+	const Endpoint::Ptr& currentZoneMaster)
 {
 	ASSERT(targetZone);
 
@@ -1191,7 +1446,13 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 
 			relayed = true;
 
-			SyncSendMessage(targetEndpoint, message);
+			/* Sending, i.e. encoding, happens in the lane of the endpoint. Messages are relayed
+			 * in the order of their "ts" here and every lane keeps that order, which matters
+			 * because endpoints ignore messages older than the last one they've received. */
+			m_RelayLanes->Enqueue(targetEndpoint.get(), [this, targetEndpoint, relayedMessage]() {
+				std::unique_lock<std::mutex> lock (relayedMessage->Mutex);
+				SyncSendMessage(targetEndpoint, relayedMessage->Message, relayedMessage->Cache);
+			});
 		}
 
 		if (log_needed && !log_done) {
@@ -1200,7 +1461,7 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 	}
 
 	if (!skippedEndpoints.empty()) {
-		double ts = message->Get("ts");
+		double ts = relayedMessage->Message->Get("ts");
 
 		for (const Endpoint::Ptr& skippedEndpoint : skippedEndpoints)
 			skippedEndpoint->SetLocalLogPosition(ts);
@@ -1235,10 +1496,14 @@ void ApiListener::SyncRelayMessage(const MessageOrigin::Ptr& origin,
 
 	Endpoint::Ptr master = GetMaster();
 
-	bool need_log = !RelayMessageOne(target_zone, origin, message, master);
+	/* The message isn't modified anymore, serialize it only once for all endpoints. */
+	auto relayed (std::make_shared<RelayedMessage>());
+	relayed->Message = message;
+
+	bool need_log = !RelayMessageOne(target_zone, origin, relayed, master);
 
 	for (const Zone::Ptr& zone : target_zone->GetAllParentsRaw()) {
-		if (!RelayMessageOne(zone, origin, message, master))
+		if (!RelayMessageOne(zone, origin, relayed, master))
 			need_log = true;
 	}
 
@@ -1253,15 +1518,22 @@ void ApiListener::OpenLogFile()
 
 	Utility::MkDirP(Utility::DirName(path), 0750);
 
-	auto *fp = new std::fstream(path.CStr(), std::fstream::out | std::ofstream::app);
+	/* Don't append to a log file written by an older version. */
+	if (ReplayLogReader::IsLegacyLog(path) && !RotateLogFile()) {
+		Log(LogCritical, "ApiListener")
+			<< "Not opening spool file '" << path << "': It was written by an older version and could not be rotated.";
+		return;
+	}
+
+	ReplayLogWriter::Ptr logFile = new ReplayLogWriter(path);
 
-	if (!fp->good()) {
+	if (!logFile->IsGood()) {
 		Log(LogWarning, "ApiListener")
 			<< "Could not open spool file: " << path;
 		return;
 	}
 
-	m_LogFile = new StdioStream(fp, true);
+	m_LogFile = logFile;
 	m_LogMessageCount = 0;
 	SetLogMessageTimestamp(Utility::GetTime());
 }
@@ -1276,8 +1548,13 @@ void ApiListener::CloseLogFile()
 	m_LogFile.reset();
 }
 
-/* must hold m_LogLock */
-void ApiListener::RotateLogFile()
+/**
+ * Moves the current log file aside, so that a new one can be started.
+ * Must hold m_LogLock.
+ *
+ * @returns Whether the log file has been moved
+ */
+bool ApiListener::RotateLogFile()
 {
 	double ts = GetLogMessageTimestamp();
 
@@ -1288,16 +1565,93 @@ void ApiListener::RotateLogFile()
 	String newpath = GetApiDir() + "log/" + Convert::ToString(static_cast<int>(ts)+1);
 
 	// If the log is being rotated more than once per second,
-	// don't overwrite the previous one, but silently deny rotation.
-	if (!Utility::PathExists(newpath)) {
+	// don't overwrite the previous one, but deny rotation.
+	if (Utility::PathExists(newpath))
+		return false;
+
+	try {
+		Utility::RenameFile(oldpath, newpath);
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "ApiListener")
+			<< "Cannot rotate replay log file from '" << oldpath << "' to '"
+			<< newpath << "': " << ex.what();
+		return false;
+	}
+
+	try {
+		String oldIndexPath = ReplayLogReader::GetIndexPath(oldpath);
+
+		if (Utility::PathExists(oldIndexPath))
+			Utility::RenameFile(oldIndexPath, ReplayLogReader::GetIndexPath(newpath));
+	} catch (const std::exception& ex) {
+		/* The log file itself has been moved, the reader works without its index. */
+		Log(LogWarning, "ApiListener")
+			<< "Cannot rotate replay log index of '" << oldpath << "': " << ex.what();
+	}
+
+	CompressLogFile(newpath);
+
+	return true;
+}
+
+/**
+ * Replaces a rotated log file with a compressed copy in the background.
+ * Replaying reads the copy's frames from the index entry it needs onwards,
+ * readers which have opened the log file before keep reading the old one.
+ *
+ * @param path The path of the rotated log file.
+ */
+void ApiListener::CompressLogFile(const String& path)
+{
+	m_LogCompressionQueue.Enqueue([this, path]() {
+		String compressedPath = path + ".tmp";
+		uint64_t savedBytes = 0;
+
 		try {
-			Utility::RenameFile(oldpath, newpath);
+			if (ReplayLogCompressor::Compress(path, compressedPath, savedBytes)) {
+				std::unique_lock<std::mutex> lock (m_LogCompressionLock);
+
+				/* The log file might have been removed by ApiTimerHandler() meanwhile. */
+				if (Utility::PathExists(path)) {
+					Utility::RenameFile(compressedPath, path);
+					(void)unlink(ReplayLogReader::GetIndexPath(path).CStr());
+
+					m_LogSavedBytes += savedBytes;
+
+					Log(LogNotice, "ApiListener")
+						<< "Compressed log file '" << path << "', saved " << savedBytes << " bytes.";
+				}
+			}
 		} catch (const std::exception& ex) {
-			Log(LogCritical, "ApiListener")
-				<< "Cannot rotate replay log file from '" << oldpath << "' to '"
-				<< newpath << "': " << ex.what();
+			Log(LogWarning, "ApiListener")
+				<< "Cannot compress log file '" << path << "': " << DiagnosticInformation(ex, false);
 		}
+
+		if (Utility::PathExists(compressedPath))
+			(void)unlink(compressedPath.CStr());
+	});
+}
+
+/**
+ * Compresses the rotated log files which are left from before the last
+ * restart and counts the bytes saved by the compressed ones.
+ */
+void ApiListener::CompressRotatedLogFiles()
+{
+	std::vector<int> files;
+	Utility::Glob(GetApiDir() + "log/*", std::bind(&ApiListener::LogGlobHandler, std::ref(files), _1), GlobFile);
+
+	for (int ts : files) {
+		String path = GetApiDir() + "log/" + Convert::ToString(ts);
+
+		if (ReplayLogReader::IsCompressedLog(path))
+			m_LogSavedBytes += ReplayLogCompressor::GetSavedBytes(path);
+		else if (ReplayLogReader::IsBinaryLog(path))
+			CompressLogFile(path);
 	}
+
+	/* Left over from a crash while compressing. */
+	Utility::Glob(GetApiDir() + "log/*.tmp", [](const String& path) { (void)unlink(path.CStr()); }, GlobFile);
 }
 
 void ApiListener::LogGlobHandler(std::vector<int>& files, const String& file)
@@ -1318,160 +1672,311 @@ void ApiListener::LogGlobHandler(std::vector<int>& files, const String& file)
 	files.push_back(ts);
 }
 
-void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
+/**
+ * Replays the log to the endpoint of the given connection. The endpoint is
+ * only registered here, the log is read by RunReplayLogs() which serves all
+ * endpoints catching up at the same time with one pass over the log files.
+ *
+ * @param client The connection.
+ * @param onFinished Called once the endpoint isn't syncing anymore.
+ */
+void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client, const std::function<void()>& onFinished)
 {
 	Endpoint::Ptr endpoint = client->GetEndpoint();
+	ASSERT(endpoint);
+
+	Zone::Ptr zone = endpoint->GetZone();
 
-	if (endpoint->GetLogDuration() == 0) {
-		ObjectLock olock2(endpoint);
-		endpoint->SetSyncing(false);
+	if (endpoint->GetLogDuration() == 0 || !zone) {
+		{
+			ObjectLock olock2(endpoint);
+			endpoint->SetSyncing(false);
+		}
+
+		onFinished();
 		return;
 	}
 
-	CONTEXT("Replaying log for Endpoint '" + endpoint->GetName() + "'");
-
-	int count = -1;
-	double peer_ts = endpoint->GetLocalLogPosition();
-	double logpos_ts = peer_ts;
-	bool last_sync = false;
+	ReplayLogTarget target;
+	target.Client = client;
+	target.PeerEndpoint = endpoint;
+	target.PeerZone = zone;
+	target.PeerTs = endpoint->GetLocalLogPosition();
+	target.LogPositionTs = target.PeerTs;
+	target.OnFinished = onFinished;
 
-	Endpoint::Ptr target_endpoint = client->GetEndpoint();
-	ASSERT(target_endpoint);
+	std::unique_lock<std::mutex> lock (m_ReplayTargetsLock);
 
-	Zone::Ptr target_zone = target_endpoint->GetZone();
+	m_NewReplayTargets.emplace_back(std::move(target));
 
-	if (!target_zone) {
-		ObjectLock olock2(endpoint);
-		endpoint->SetSyncing(false);
-		return;
+	if (!m_ReplayRunning) {
+		m_ReplayRunning = true;
+		m_ReplayQueue.Enqueue([this]() { RunReplayLogs(); });
 	}
+}
 
-	for (;;) {
-		std::unique_lock<std::mutex> lock(m_LogLock);
+/**
+ * Replays the log to all registered endpoints until none is left. Every pass
+ * reads the log files once, starting with the oldest position any endpoint
+ * needs, and sends each record to all endpoints which haven't seen it yet.
+ * Endpoints registered meanwhile join with the next pass.
+ */
+void ApiListener::RunReplayLogs()
+{
+	std::vector<ReplayLogTarget> targets;
 
-		CloseLogFile();
+	try {
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock (m_ReplayTargetsLock);
 
-		if (count == -1 || count > 50000) {
-			OpenLogFile();
-			lock.unlock();
-		} else {
-			last_sync = true;
-		}
+				for (auto& target : m_NewReplayTargets)
+					targets.emplace_back(std::move(target));
+
+				m_NewReplayTargets.clear();
 
-		count = 0;
+				if (targets.empty()) {
+					m_ReplayRunning = false;
+					return;
+				}
+			}
 
-		std::vector<int> files;
-		Utility::Glob(GetApiDir() + "log/*", std::bind(&ApiListener::LogGlobHandler, std::ref(files), _1), GlobFile);
-		std::sort(files.begin(), files.end());
+			std::unique_lock<std::mutex> lock(m_LogLock);
 
-		std::vector<std::pair<int, String>> allFiles;
+			CloseLogFile();
 
-		for (int ts : files) {
-			if (ts >= peer_ts) {
-				allFiles.emplace_back(ts, GetApiDir() + "log/" + Convert::ToString(ts));
+			/* The last pass blocks new log messages, so it's only done once all endpoints almost caught up. */
+			bool last_sync = true;
+
+			for (auto& target : targets) {
+				if (target.Count == -1 || target.Count > 50000)
+					last_sync = false;
 			}
-		}
 
-		allFiles.emplace_back(Utility::GetTime() + 1, GetApiDir() + "log/current");
+			if (!last_sync) {
+				OpenLogFile();
+				lock.unlock();
+			}
 
-		for (auto& file : allFiles) {
-			Log(LogNotice, "ApiListener")
-				<< "Replaying log: " << file.second;
+			double peer_ts = targets[0].PeerTs;
 
-			auto *fp = new std::fstream(file.second.CStr(), std::fstream::in | std::fstream::binary);
-			StdioStream::Ptr logStream = new StdioStream(fp, true);
+			for (auto& target : targets) {
+				target.Count = 0;
+				target.Failed = false;
+				peer_ts = std::min(peer_ts, target.PeerTs);
+			}
 
-			String message;
-			StreamReadContext src;
-			while (true) {
-				Dictionary::Ptr pmessage;
+			size_t superseded = 0;
+			std::vector<int> files;
+			Utility::Glob(GetApiDir() + "log/*", std::bind(&ApiListener::LogGlobHandler, std::ref(files), _1), GlobFile);
+			std::sort(files.begin(), files.end());
 
-				try {
-					StreamReadStatus srs = NetString::ReadStringFromStream(logStream, &message, src);
+			std::vector<std::pair<int, String>> allFiles;
 
-					if (srs == StatusEof)
-						break;
+			for (int ts : files) {
+				if (ts >= peer_ts) {
+					allFiles.emplace_back(ts, GetApiDir() + "log/" + Convert::ToString(ts));
+				}
+			}
 
-					if (srs != StatusNewItem)
-						continue;
+			allFiles.emplace_back(Utility::GetTime() + 1, GetApiDir() + "log/current");
 
-					pmessage = JsonDecode(message);
-				} catch (const std::exception&) {
-					Log(LogWarning, "ApiListener")
-						<< "Unexpected end-of-file for cluster log: " << file.second;
+			auto readLogFile ([&peer_ts](const String& path, const std::function<bool (const ReplayLogRecord&)>& handler) {
+				if (!ReplayLogReader::IsLegacyLog(path)) {
+					/* Skip straight to the first record which might be newer than peer_ts
+					 * and don't even read the records we don't need. */
+					ReplayLogReader reader (path);
+					reader.Seek(peer_ts);
 
-					/* Log files may be incomplete or corrupted. This is perfectly OK. */
-					break;
+					ReplayLogRecord record;
+
+					while (reader.ReadNext(record, peer_ts)) {
+						if (!handler(record))
+							break;
+					}
+				} else {
+					ReadLegacyLogFile(path, handler);
 				}
+			});
 
-				if (pmessage->Get("timestamp") <= peer_ts)
-					continue;
+			/* Messages superseded by later ones in the log aren't replayed, that's
+			 * a lot less to catch up with after a longer connection loss. */
+			ReplayLogCompactor compactor (GetCompactReplayLogCheckResults());
 
-				Dictionary::Ptr secname = pmessage->Get("secobj");
+			for (auto& file : allFiles) {
+				readLogFile(file.second, [&compactor, &peer_ts](const ReplayLogRecord& record) {
+					if (record.Timestamp > peer_ts)
+						compactor.Add(record);
 
-				if (secname) {
-					ConfigObject::Ptr secobj = ConfigObject::GetObject(secname->Get("type"), secname->Get("name"));
+					return true;
+				});
+			}
 
-					if (!secobj)
-						continue;
+			for (auto& file : allFiles) {
+				Log(LogNotice, "ApiListener")
+					<< "Replaying log: " << file.second;
 
-					if (!target_zone->CanAccessObject(secobj))
-						continue;
-				}
+				auto replay ([&](const ReplayLogRecord& record) -> bool {
+					if (record.Timestamp <= peer_ts)
+						return true;
 
-				try  {
-					client->SendRawMessage(pmessage->Get("message"));
-					count++;
-				} catch (const std::exception& ex) {
-					Log(LogWarning, "ApiListener")
-						<< "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex, false);
+					if (compactor.IsSuperseded(record)) {
+						superseded++;
+						return true;
+					}
 
-					Log(LogDebug, "ApiListener")
-						<< "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex);
+					ConfigObject::Ptr secobj;
 
-					break;
-				}
+					if (!record.SecobjType.IsEmpty()) {
+						secobj = ConfigObject::GetObject(record.SecobjType, record.SecobjName);
 
-				peer_ts = pmessage->Get("timestamp");
+						if (!secobj)
+							return true;
+					}
 
-				if (file.first > logpos_ts + 10) {
-					logpos_ts = file.first;
+					for (auto& target : targets) {
+						if (target.Failed || record.Timestamp <= target.PeerTs)
+							continue;
 
-					Dictionary::Ptr lmessage = new Dictionary({
-						{ "jsonrpc", "2.0" },
-						{ "method", "log::SetLogPosition" },
-						{ "params", new Dictionary({
-							{ "log_position", logpos_ts }
-						}) }
-					});
+						if (secobj && !target.PeerZone->CanAccessObject(secobj))
+							continue;
 
-					client->SendMessage(lmessage);
-				}
+						try  {
+							target.Client->SendRawMessage(record.Message, MessagePriority::Bulk);
+							target.Count++;
+						} catch (const std::exception& ex) {
+							Log(LogWarning, "ApiListener")
+								<< "Error while replaying log for endpoint '" << target.PeerEndpoint->GetName() << "': " << DiagnosticInformation(ex, false);
+
+							Log(LogDebug, "ApiListener")
+								<< "Error while replaying log for endpoint '" << target.PeerEndpoint->GetName() << "': " << DiagnosticInformation(ex);
+
+							/* Skip the rest of this file for this endpoint only. */
+							target.Failed = true;
+							continue;
+						}
+
+						target.PeerTs = record.Timestamp;
+
+						if (file.first > target.LogPositionTs + 10) {
+							target.LogPositionTs = file.first;
+
+							Dictionary::Ptr lmessage = new Dictionary({
+								{ "jsonrpc", "2.0" },
+								{ "method", "log::SetLogPosition" },
+								{ "params", new Dictionary({
+									{ "log_position", target.LogPositionTs }
+								}) }
+							});
+
+							target.Client->SendMessage(lmessage);
+						}
+					}
+
+					return true;
+				});
+
+				readLogFile(file.second, replay);
+
+				for (auto& target : targets)
+					target.Failed = false;
 			}
 
-			logStream->Close();
-		}
+			for (auto& target : targets) {
+				Log(target.Count > 0 ? LogInformation : LogNotice, "ApiListener")
+					<< "Replayed " << target.Count << " messages to endpoint '" << target.PeerEndpoint->GetName()
+					<< "', left out " << superseded << " superseded ones.";
+			}
 
-		if (count > 0) {
-			Log(LogInformation, "ApiListener")
-				<< "Replayed " << count << " messages.";
+			if (last_sync) {
+				for (auto& target : targets) {
+					{
+						ObjectLock olock2(target.PeerEndpoint);
+						target.PeerEndpoint->SetSyncing(false);
+					}
+
+					target.OnFinished();
+				}
+
+				targets.clear();
+
+				OpenLogFile();
+			}
 		}
-		else {
-			Log(LogNotice, "ApiListener")
-				<< "Replayed " << count << " messages.";
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "ApiListener")
+			<< "Error while replaying log: " << DiagnosticInformation(ex, false);
+
+		Log(LogDebug, "ApiListener")
+			<< "Error while replaying log: " << DiagnosticInformation(ex);
+
+		std::unique_lock<std::mutex> lock (m_ReplayTargetsLock);
+
+		for (auto& target : m_NewReplayTargets)
+			targets.emplace_back(std::move(target));
+
+		m_NewReplayTargets.clear();
+		m_ReplayRunning = false;
+
+		lock.unlock();
+
+		for (auto& target : targets) {
+			ObjectLock olock2(target.PeerEndpoint);
+			target.PeerEndpoint->SetSyncing(false);
 		}
+	}
+}
 
-		if (last_sync) {
-			{
-				ObjectLock olock2(endpoint);
-				endpoint->SetSyncing(false);
-			}
+/**
+ * Reads a replay log file in the JSON netstring format used by older versions.
+ *
+ * @param path The path of the log file.
+ * @param handler Called for every message, returns false to stop reading.
+ */
+void ApiListener::ReadLegacyLogFile(const String& path, const std::function<bool (const ReplayLogRecord&)>& handler)
+{
+	auto *fp = new std::fstream(path.CStr(), std::fstream::in | std::fstream::binary);
+	StdioStream::Ptr logStream = new StdioStream(fp, true);
 
-			OpenLogFile();
+	String message;
+	StreamReadContext src;
+	while (true) {
+		Dictionary::Ptr pmessage;
+
+		try {
+			StreamReadStatus srs = NetString::ReadStringFromStream(logStream, &message, src);
+
+			if (srs == StatusEof)
+				break;
+
+			if (srs != StatusNewItem)
+				continue;
 
+			pmessage = JsonDecode(message);
+		} catch (const std::exception&) {
+			Log(LogWarning, "ApiListener")
+				<< "Unexpected end-of-file for cluster log: " << path;
+
+			/* Log files may be incomplete or corrupted. This is perfectly OK. */
 			break;
 		}
+
+		ReplayLogRecord record;
+		record.Timestamp = pmessage->Get("timestamp");
+		record.Message = pmessage->Get("message");
+
+		Dictionary::Ptr secname = pmessage->Get("secobj");
+
+		if (secname) {
+			record.SecobjType = secname->Get("type");
+			record.SecobjName = secname->Get("name");
+		}
+
+		if (!handler(record))
+			break;
 	}
+
+	logStream->Close();
 }
 
 void ApiListener::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
@@ -1492,6 +1997,9 @@ void ApiListener::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& per
 	status->Set("api", stats.first);
 }
 
+/* Indexed by MessagePriority. */
+static const char * const l_MessagePriorityNames[] = { "control", "check_execution", "check_result", "bulk" };
+
 std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 {
 	Dictionary::Ptr perfdata = new Dictionary();
@@ -1566,9 +2074,30 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 	size_t httpClients = GetHttpClients().size();
 	size_t syncQueueItems = m_SyncQueue.GetLength();
 	size_t relayQueueItems = m_RelayQueue.GetLength();
+	std::vector<size_t> relayLaneItems = m_RelayLanes->GetShardLengths();
+	size_t relayLaneItemsSum = 0, relayLaneItemsMax = 0;
+
+	for (size_t items : relayLaneItems) {
+		relayLaneItemsSum += items;
+		relayLaneItemsMax = std::max(relayLaneItemsMax, items);
+	}
+
 	double workQueueItemRate = JsonRpcConnection::GetWorkQueueRate();
 	double syncQueueItemRate = m_SyncQueue.GetTaskCount(60) / 60.0;
 	double relayQueueItemRate = m_RelayQueue.GetTaskCount(60) / 60.0;
+	double relayLaneItemRate = m_RelayLanes->GetTaskCount(60) / 60.0;
+	double avgWriteBatchSize = JsonRpcConnection::GetAverageWriteBatchSize();
+	double replayLogSavedBytes = m_LogSavedBytes.load();
+
+	auto outgoingQueueItems (JsonRpcConnection::GetOutgoingQueueItems());
+	Dictionary::Ptr outgoingQueueItemsByPriority = new Dictionary();
+
+	for (size_t i = 0; i < outgoingQueueItems.size(); i++) {
+		String priority = l_MessagePriorityNames[i];
+
+		outgoingQueueItemsByPriority->Set(priority, outgoingQueueItems[i]);
+		perfdata->Set("num_json_rpc_outgoing_queue_items_" + priority, outgoingQueueItems[i]);
+	}
 
 	Dictionary::Ptr status = new Dictionary({
 		{ "identity", GetIdentity() },
@@ -1584,9 +2113,14 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 			{ "anonymous_clients", jsonRpcAnonymousClients },
 			{ "sync_queue_items", syncQueueItems },
 			{ "relay_queue_items", relayQueueItems },
+			{ "relay_lane_items", Array::FromVector(relayLaneItems) },
 			{ "work_queue_item_rate", workQueueItemRate },
 			{ "sync_queue_item_rate", syncQueueItemRate },
-			{ "relay_queue_item_rate", relayQueueItemRate }
+			{ "relay_queue_item_rate", relayQueueItemRate },
+			{ "relay_lane_item_rate", relayLaneItemRate },
+			{ "avg_write_batch_size", avgWriteBatchSize },
+			{ "outgoing_queue_items", outgoingQueueItemsByPriority },
+			{ "replay_log_saved_bytes", replayLogSavedBytes }
 		}) },
 
 		{ "http", new Dictionary({
@@ -1603,10 +2137,15 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 	perfdata->Set("num_http_clients", httpClients);
 	perfdata->Set("num_json_rpc_sync_queue_items", syncQueueItems);
 	perfdata->Set("num_json_rpc_relay_queue_items", relayQueueItems);
+	perfdata->Set("num_json_rpc_relay_lane_items", relayLaneItemsSum);
+	perfdata->Set("num_json_rpc_relay_lane_items_max", relayLaneItemsMax);
 
 	perfdata->Set("num_json_rpc_work_queue_item_rate", workQueueItemRate);
 	perfdata->Set("num_json_rpc_sync_queue_item_rate", syncQueueItemRate);
 	perfdata->Set("num_json_rpc_relay_queue_item_rate", relayQueueItemRate);
+	perfdata->Set("num_json_rpc_relay_lane_item_rate", relayLaneItemRate);
+	perfdata->Set("num_json_rpc_avg_write_batch_size", avgWriteBatchSize);
+	perfdata->Set("replay_log_saved_bytes", replayLogSavedBytes);
 
 	return std::make_pair(status, perfdata);
 }
@@ -1679,8 +2218,23 @@ Value ApiListener::HelloAPIHandler(const MessageOrigin::Ptr& origin, const Dicti
 			if (endpoint) {
 				unsigned long nodeVersion = params->Get("version");
 
+				uint_fast64_t capabilities = (double)params->Get("capabilities");
+
 				endpoint->SetIcingaVersion(nodeVersion);
-				endpoint->SetCapabilities((double)params->Get("capabilities"));
+				endpoint->SetCapabilities(capabilities);
+
+				if (capabilities & (uint_fast64_t)ApiCapabilities::CompressedMessages)
+					client->EnableCompression();
+
+				if (capabilities & (uint_fast64_t)ApiCapabilities::BinaryMessages)
+					client->EnableBinaryMessages();
+
+				if (capabilities & (uint_fast64_t)ApiCapabilities::CheckResultDeltas) {
+					ApiListener::Ptr listener = ApiListener::GetInstance();
+
+					if (listener && listener->GetEnableCheckResultDeltas())
+						client->EnableCheckResultDeltas();
+				}
 
 				if (nodeVersion == 0u) {
 					nodeVersion = 21200;
@@ -1812,6 +2366,62 @@ void ApiListener::ValidateTlsHandshakeTimeout(const Lazy<double>& lvalue, const
 		BOOST_THROW_EXCEPTION(ValidationError(this, { "tls_handshake_timeout" }, "Value must be greater than 0."));
 }
 
+void ApiListener::ValidateWriteBatchSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateWriteBatchSize(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "write_batch_size" }, "Value must be greater than 0."));
+}
+
+void ApiListener::ValidateWriteBatchDelay(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateWriteBatchDelay(lvalue, utils);
+
+	if (lvalue() < 0 || lvalue() > 1)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "write_batch_delay" }, "Value must be between 0 and 1."));
+}
+
+void ApiListener::ValidateEventsQueueSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateEventsQueueSize(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "events_queue_size" }, "Value must not be negative."));
+}
+
+void ApiListener::ValidateEventsFlushDelay(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateEventsFlushDelay(lvalue, utils);
+
+	if (lvalue() < 0 || lvalue() > 1)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "events_flush_delay" }, "Value must be between 0 and 1."));
+}
+
+void ApiListener::ValidateResponseCacheTtl(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateResponseCacheTtl(lvalue, utils);
+
+	if (lvalue() < 0 || lvalue() > 60)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "response_cache_ttl" }, "Value must be between 0 and 60."));
+}
+
+void ApiListener::ValidateMaxConnectionRate(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateMaxConnectionRate(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_connection_rate" }, "Value must not be negative."));
+}
+
+void ApiListener::ValidateCheckBatchWindow(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateCheckBatchWindow(lvalue, utils);
+
+	if (lvalue() < 0 || lvalue() > 10)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "check_batch_window" }, "Value must be between 0 and 10."));
+}
+
 bool ApiListener::IsHACluster()
 {
 	Zone::Ptr zone = Zone::GetLocalZone();
@@ -8,7 +8,9 @@
 #include "remote/httpserverconnection.hpp"
 #include "remote/endpoint.hpp"
 #include "remote/messageorigin.hpp"
+#include "remote/replaylog.hpp"
 #include "base/configobject.hpp"
+#include "base/largestringsink.hpp"
 #include "base/process.hpp"
 #include "base/shared.hpp"
 #include "base/timer.hpp"
@@ -22,6 +24,8 @@
 #include <boost/asio/spawn.hpp>
 #include <boost/asio/ssl/context.hpp>
 #include <cstdint>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 
@@ -38,6 +42,21 @@ struct ConfigDirInformation
 	Dictionary::Ptr UpdateV1;
 	Dictionary::Ptr UpdateV2;
 	Dictionary::Ptr Checksums;
+	Dictionary::Ptr References; // Large files which are sent in chunks, relative path => size.
+};
+
+/**
+ * A message which is sent to several endpoints from their relay lanes.
+ * It's encoded only once per wire format, by the first lane which sends it.
+ *
+ * @ingroup remote
+ */
+struct RelayedMessage
+{
+	Dictionary::Ptr Message;
+
+	std::mutex Mutex;
+	EncodedMessageCache Cache;
 };
 
 /**
@@ -66,7 +85,13 @@ struct ConfigDirInformation
  */
 enum class ApiCapabilities : uint_fast64_t
 {
-	ExecuteArbitraryCommand = 1u
+	ExecuteArbitraryCommand = 1u,
+	CompressedMessages = 1u << 1u,
+	BinaryMessages = 1u << 2u,
+	BatchedCheckMessages = 1u << 3u,
+	LocalCheckScheduling = 1u << 4u,
+	CheckResultDeltas = 1u << 5u,
+	ChunkedConfigSync = 1u << 6u
 };
 
 /**
@@ -85,6 +110,8 @@ public:
 	static String GetApiDir();
 	static String GetApiZonesDir();
 	static String GetApiZonesStageDir();
+	static String GetApiZonesSpoolDir();
+	static String GetApiZonesBlobDir();
 	static String GetCertsDir();
 	static String GetCaDir();
 	static String GetCertificateRequestsDir();
@@ -117,6 +144,9 @@ public:
 	/* filesync */
 	static Value ConfigUpdateHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 	void HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static const LargeStringSink& GetConfigUpdateSink();
+	static Value ConfigFetchFileHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static Value ConfigFileChunkHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 
 	/* configsync */
 	static void ConfigUpdateObjectHandler(const ConfigObject::Ptr& object, const Value& cookie);
@@ -131,6 +161,8 @@ public:
 	static Value HelloAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 
 	static void UpdateObjectAuthority();
+	static Value HandoverAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static double GetHandoverTime(const String& endpoint);
 
 	static bool IsHACluster();
 	static String GetFromZoneName(const Zone::Ptr& fromZone);
@@ -156,6 +188,13 @@ protected:
 
 	void ValidateTlsProtocolmin(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
 	void ValidateTlsHandshakeTimeout(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+	void ValidateWriteBatchSize(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateWriteBatchDelay(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+	void ValidateEventsQueueSize(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateEventsFlushDelay(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+	void ValidateResponseCacheTtl(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+	void ValidateMaxConnectionRate(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+	void ValidateCheckBatchWindow(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
 
 private:
 	Shared<boost::asio::ssl::context>::Ptr m_SSLContext;
@@ -176,6 +215,12 @@ private:
 	static ApiListener::Ptr m_Instance;
 	static std::atomic<bool> m_UpdatedObjectAuthority;
 
+	static std::mutex m_HandoversLock;
+	static std::map<String, double> m_Handovers;
+
+	static void HandOverObjectAuthority();
+	static void ClearHandover(const Endpoint::Ptr& endpoint);
+
 	void ApiTimerHandler();
 	void ApiReconnectTimerHandler();
 	void CleanupCertificateRequestsTimerHandler();
@@ -188,6 +233,8 @@ private:
 		boost::asio::yield_context yc, const Shared<boost::asio::io_context::strand>::Ptr& strand,
 		const Shared<AsioTlsStream>::Ptr& client, const String& hostname, ConnectionRole role
 	);
+	uint_fast64_t GetMyCapabilities() const;
+
 	void NewClientHandlerInternal(
 		boost::asio::yield_context yc, const Shared<boost::asio::io_context::strand>::Ptr& strand,
 		const Shared<AsioTlsStream>::Ptr& client, const String& hostname, ConnectionRole role
@@ -195,21 +242,51 @@ private:
 	void ListenerCoroutineProc(boost::asio::yield_context yc, const Shared<boost::asio::ip::tcp::acceptor>::Ptr& server, const Shared<boost::asio::ssl::context>::Ptr& sslContext);
 
 	WorkQueue m_RelayQueue;
+	std::unique_ptr<ShardedWorkQueue> m_RelayLanes;
 	WorkQueue m_SyncQueue{0, 4};
 
 	std::mutex m_LogLock;
-	Stream::Ptr m_LogFile;
+	ReplayLogWriter::Ptr m_LogFile;
 	size_t m_LogMessageCount{0};
 
-	bool RelayMessageOne(const Zone::Ptr& zone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message, const Endpoint::Ptr& currentZoneMaster);
+	/* Rotated log files are compressed in the background, see CompressLogFile(). */
+	WorkQueue m_LogCompressionQueue{0, 1};
+	std::mutex m_LogCompressionLock;
+	std::atomic<uint64_t> m_LogSavedBytes{0};
+
+	/* An endpoint which is being sent the replay log, see RunReplayLogs(). */
+	struct ReplayLogTarget
+	{
+		JsonRpcConnection::Ptr Client;
+		Endpoint::Ptr PeerEndpoint;
+		Zone::Ptr PeerZone;
+		double PeerTs;
+		double LogPositionTs;
+		int Count{-1};
+		bool Failed{false};
+		std::function<void()> OnFinished;
+	};
+
+	WorkQueue m_ReplayQueue{0, 1};
+	std::mutex m_ReplayTargetsLock;
+	std::vector<ReplayLogTarget> m_NewReplayTargets;
+	bool m_ReplayRunning{false};
+
+	void SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message, EncodedMessageCache& messageCache);
+	bool RelayMessageOne(const Zone::Ptr& zone, const MessageOrigin::Ptr& origin, const std::shared_ptr<RelayedMessage>& relayedMessage,
+		const Endpoint::Ptr& currentZoneMaster);
 	void SyncRelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log);
 	void PersistMessage(const Dictionary::Ptr& message, const ConfigObject::Ptr& secobj);
 
 	void OpenLogFile();
-	void RotateLogFile();
+	bool RotateLogFile();
 	void CloseLogFile();
+	void CompressLogFile(const String& path);
+	void CompressRotatedLogFiles();
 	static void LogGlobHandler(std::vector<int>& files, const String& file);
-	void ReplayLog(const JsonRpcConnection::Ptr& client);
+	void ReplayLog(const JsonRpcConnection::Ptr& client, const std::function<void()>& onFinished);
+	void RunReplayLogs();
+	static void ReadLegacyLogFile(const String& path, const std::function<bool (const ReplayLogRecord&)>& handler);
 
 	static void CopyCertificateFile(const String& oldCertPath, const String& newCertPath);
 
@@ -222,16 +299,23 @@ private:
 	void SyncLocalZoneDirs() const;
 	void SyncLocalZoneDir(const Zone::Ptr& zone) const;
 
-	void SendConfigUpdate(const JsonRpcConnection::Ptr& aclient);
+	String SendConfigUpdate(const JsonRpcConnection::Ptr& aclient, const String& lastChecksum = String());
 
 	static Dictionary::Ptr MergeConfigUpdate(const ConfigDirInformation& config);
 
-	static ConfigDirInformation LoadConfigDir(const String& dir);
-	static void ConfigGlobHandler(ConfigDirInformation& config, const String& path, const String& file);
+	static ConfigDirInformation LoadConfigDir(const String& dir, size_t maxContentSize = SIZE_MAX);
+	static void ConfigGlobHandler(ConfigDirInformation& config, const String& path, const String& file, size_t maxContentSize);
+	void HandleConfigUpdateAsync(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static bool FetchMissingConfigFiles(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static Dictionary::Ptr ResolveConfigReferences(const String& zoneName, const Dictionary::Ptr& references, const Dictionary::Ptr& checksums);
 
-	static void TryActivateZonesStage(const std::vector<String>& relativePaths);
+	static void TryActivateZonesStage(const std::vector<String>& relativePaths, const std::set<String>& changedZones);
+	static ProcessResult RunZonesStageValidationProcess();
 
 	static String GetChecksum(const String& content);
+	static bool GetCachedConfigFileChecksum(const String& file, time_t mtime, size_t size, String& checksum, bool& validUtf8);
+	static String GetConfigFileChecksum(const String& file, time_t mtime, size_t size, const String& content, bool validUtf8);
+	static void SaveConfigFileChecksums();
 	static bool CheckConfigChange(const ConfigDirInformation& oldConfig, const ConfigDirInformation& newConfig);
 
 	void UpdateLastFailedZonesStageValidation(const String& log);
@@ -242,9 +326,26 @@ private:
 		const JsonRpcConnection::Ptr& client = nullptr);
 	void DeleteConfigObject(const ConfigObject::Ptr& object, const MessageOrigin::Ptr& origin,
 		const JsonRpcConnection::Ptr& client = nullptr);
-	void SendRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient);
+	void SendRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient, double since = 0);
+
+	/* What has been synced to an endpoint during its last connection. */
+	struct EndpointSyncState
+	{
+		double Started{0};
+		double Finished{0};
+		double LastFullSync{0};
+		String ConfigChecksum;
+		bool Confirmed{false};
+	};
+
+	std::mutex m_EndpointSyncStatesLock;
+	std::map<String, EndpointSyncState> m_EndpointSyncStates;
+
+	EndpointSyncState TakeEndpointSyncState(const Endpoint::Ptr& endpoint);
+	void ConfirmEndpointSyncStates();
 
 	void SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoint::Ptr& endpoint, bool needSync);
+	static WorkQueuePriority GetSyncPriority(const Endpoint::Ptr& endpoint);
 
 	/* API Config Packages */
 	mutable std::mutex m_ActivePackageStagesLock;
@@ -0,0 +1,286 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/checkresultdelta.hpp"
+#include "base/array.hpp"
+#include "base/convert.hpp"
+#include "base/objectlock.hpp"
+
+using namespace icinga;
+
+/* The check result attributes which may differ in a compact message, besides the performance data. */
+static const char * const l_VolatileAttributes[] = { "schedule_start", "schedule_end", "execution_start", "execution_end" };
+
+static bool IsVolatileAttribute(const String& key)
+{
+	for (auto attr : l_VolatileAttributes) {
+		if (key == attr)
+			return true;
+	}
+
+	return false;
+}
+
+/* Unlike Value::operator==() this one compares dictionaries by content. */
+static bool IsEqual(const Value& lhs, const Value& rhs)
+{
+	if (lhs.IsObjectType<Dictionary>() && rhs.IsObjectType<Dictionary>()) {
+		Dictionary::Ptr dl = lhs;
+		Dictionary::Ptr dr = rhs;
+
+		if (dl == dr)
+			return true;
+
+		if (dl->GetLength() != dr->GetLength())
+			return false;
+
+		ObjectLock olock(dl);
+
+		for (const Dictionary::Pair& kv : dl) {
+			Value value;
+
+			if (!dr->Get(kv.first, &value) || !IsEqual(kv.second, value))
+				return false;
+		}
+
+		return true;
+	}
+
+	if (lhs.IsObjectType<Array>() && rhs.IsObjectType<Array>()) {
+		Array::Ptr al = lhs;
+		Array::Ptr ar = rhs;
+
+		if (al == ar)
+			return true;
+
+		if (al->GetLength() != ar->GetLength())
+			return false;
+
+		for (Array::SizeType i = 0; i < al->GetLength(); i++) {
+			if (!IsEqual(al->Get(i), ar->Get(i)))
+				return false;
+		}
+
+		return true;
+	}
+
+	return lhs == rhs;
+}
+
+static bool GetCheckResult(const Dictionary::Ptr& params, const String& key, Dictionary::Ptr& cr)
+{
+	Value value;
+
+	if (!params->Get(key, &value) || !value.IsObjectType<Dictionary>())
+		return false;
+
+	cr = value;
+	return true;
+}
+
+static String GetCheckableKey(const Dictionary::Ptr& params)
+{
+	String key = params->Get("host");
+	Value service;
+
+	if (params->Get("service", &service))
+		key += "!" + static_cast<String>(service);
+
+	return key;
+}
+
+static bool IsCheckResultMessage(const Dictionary::Ptr& message)
+{
+	String method = message->Get("method");
+
+	return method == "event::CheckResult";
+}
+
+/**
+ * Returns the changes since the base check result if there are only changed
+ * timestamps and performance data values, nullptr otherwise.
+ */
+static Dictionary::Ptr Diff(const Dictionary::Ptr& base, const Dictionary::Ptr& cr)
+{
+	if (base->GetLength() != cr->GetLength())
+		return nullptr;
+
+	Dictionary::Ptr delta = new Dictionary();
+
+	ObjectLock olock(cr);
+
+	for (const Dictionary::Pair& kv : cr) {
+		Value baseValue;
+
+		if (!base->Get(kv.first, &baseValue))
+			return nullptr;
+
+		if (IsVolatileAttribute(kv.first)) {
+			if (kv.second != baseValue)
+				delta->Set(kv.first, kv.second);
+
+			continue;
+		}
+
+		if (kv.first == "performance_data" && kv.second.IsObjectType<Array>() && baseValue.IsObjectType<Array>()) {
+			Array::Ptr perf = kv.second;
+			Array::Ptr basePerf = baseValue;
+
+			if (perf->GetLength() != basePerf->GetLength())
+				return nullptr;
+
+			Dictionary::Ptr changed = new Dictionary();
+
+			for (Array::SizeType i = 0; i < perf->GetLength(); i++) {
+				Value value = perf->Get(i);
+
+				if (!IsEqual(value, basePerf->Get(i)))
+					changed->Set(Convert::ToString(i), value);
+			}
+
+			if (changed->GetLength())
+				delta->Set("performance_data", changed);
+
+			continue;
+		}
+
+		if (!IsEqual(kv.second, baseValue))
+			return nullptr;
+	}
+
+	return delta;
+}
+
+/**
+ * Creates the compact version of a message. Must be called for every message
+ * sent over the connection in the order they are sent.
+ *
+ * @param message The message, it isn't modified
+ * @return The compact message or nullptr if the message has to be sent as is
+ */
+Dictionary::Ptr CheckResultDeltaEncoder::Encode(const Dictionary::Ptr& message)
+{
+	if (!IsCheckResultMessage(message))
+		return nullptr;
+
+	Dictionary::Ptr params = message->Get("params");
+	Dictionary::Ptr cr;
+
+	if (!params || !GetCheckResult(params, "cr", cr))
+		return nullptr;
+
+	LastResult& last (m_LastResults[GetCheckableKey(params)]);
+	Dictionary::Ptr base = last.CheckResult;
+
+	last.CheckResult = cr;
+
+	if (!base || last.Deltas >= MaxDeltas) {
+		last.Deltas = 0;
+		return nullptr;
+	}
+
+	Dictionary::Ptr delta = Diff(base, cr);
+
+	if (!delta) {
+		last.Deltas = 0;
+		return nullptr;
+	}
+
+	last.Deltas++;
+
+	delta->Set("base", base->Get("execution_end"));
+
+	params = params->ShallowClone();
+	params->Remove("cr");
+	params->Set("cr_delta", delta);
+
+	Dictionary::Ptr compact = message->ShallowClone();
+	compact->Set("params", params);
+
+	return compact;
+}
+
+/**
+ * Restores a compact message in place. Must be called for every message
+ * received over the connection in the order they are received.
+ *
+ * @param message The message
+ * @return false if the message is a compact one whose base check result is unknown
+ */
+bool CheckResultDeltaDecoder::Decode(const Dictionary::Ptr& message)
+{
+	if (!IsCheckResultMessage(message))
+		return true;
+
+	Value vparams = message->Get("params");
+
+	if (!vparams.IsObjectType<Dictionary>())
+		return true;
+
+	Dictionary::Ptr params = vparams;
+	String key = GetCheckableKey(params);
+	Dictionary::Ptr cr;
+
+	/* The handler modifies the check result, so keep a copy. */
+	if (GetCheckResult(params, "cr", cr)) {
+		m_LastResults[key] = cr->ShallowClone();
+		return true;
+	}
+
+	Dictionary::Ptr delta;
+
+	if (!GetCheckResult(params, "cr_delta", delta))
+		return true;
+
+	auto it (m_LastResults.find(key));
+
+	if (it == m_LastResults.end() || it->second->Get("execution_end") != delta->Get("base")) {
+		if (it != m_LastResults.end())
+			m_LastResults.erase(it);
+
+		return false;
+	}
+
+	cr = it->second->ShallowClone();
+
+	{
+		ObjectLock olock(delta);
+
+		for (const Dictionary::Pair& kv : delta) {
+			if (kv.first == "base")
+				continue;
+
+			if (kv.first != "performance_data") {
+				cr->Set(kv.first, kv.second);
+				continue;
+			}
+
+			Value basePerf = cr->Get("performance_data");
+			Dictionary::Ptr changed = kv.second;
+
+			if (!basePerf.IsObjectType<Array>() || !changed)
+				return false;
+
+			Array::Ptr perf = static_cast<Array::Ptr>(basePerf)->ShallowClone();
+
+			ObjectLock perfLock(changed);
+
+			for (const Dictionary::Pair& value : changed) {
+				long index = Convert::ToLong(value.first);
+
+				if (index < 0 || index >= static_cast<long>(perf->GetLength()))
+					return false;
+
+				perf->Set(index, value.second);
+			}
+
+			cr->Set("performance_data", perf);
+		}
+	}
+
+	it->second = cr;
+
+	params->Remove("cr_delta");
+	params->Set("cr", cr->ShallowClone());
+
+	return true;
+}
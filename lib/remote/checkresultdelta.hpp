@@ -0,0 +1,60 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef CHECKRESULTDELTA_H
+#define CHECKRESULTDELTA_H
+
+#include "remote/i2-remote.hpp"
+#include "base/dictionary.hpp"
+#include "base/string.hpp"
+#include <map>
+
+namespace icinga
+{
+
+/**
+ * Replaces event::CheckResult messages for a single connection with compact
+ * ones if only the timestamps and performance data values changed since the
+ * last check result of the same checkable sent over the connection.
+ *
+ * A compact message carries "cr_delta" instead of "cr": The changed timestamps,
+ * the changed performance data values by index and the execution end of the
+ * check result it's based on.
+ *
+ * @ingroup remote
+ */
+class CheckResultDeltaEncoder final
+{
+public:
+	/* Every that many check results of a checkable are sent in full, so a receiver which lost one recovers. */
+	static const int MaxDeltas = 10;
+
+	Dictionary::Ptr Encode(const Dictionary::Ptr& message);
+
+private:
+	struct LastResult
+	{
+		Dictionary::Ptr CheckResult;
+		int Deltas;
+	};
+
+	std::map<String, LastResult> m_LastResults;
+};
+
+/**
+ * Restores the full event::CheckResult messages of a single connection
+ * from the compact ones created by a CheckResultDeltaEncoder.
+ *
+ * @ingroup remote
+ */
+class CheckResultDeltaDecoder final
+{
+public:
+	bool Decode(const Dictionary::Ptr& message);
+
+private:
+	std::map<String, Dictionary::Ptr> m_LastResults;
+};
+
+}
+
+#endif /* CHECKRESULTDELTA_H */
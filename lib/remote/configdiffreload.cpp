@@ -0,0 +1,636 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/configdiffreload.hpp"
+#include "remote/apilistener.hpp"
+#include "remote/configobjectutility.hpp"
+#include "remote/runtimeobjectstore.hpp"
+#include "config/activationcontext.hpp"
+#include "config/applyrule.hpp"
+#include "config/configcompiler.hpp"
+#include "config/configcompilercache.hpp"
+#include "config/configitembuilder.hpp"
+#include "base/configtype.hpp"
+#include "base/configuration.hpp"
+#include "base/dependencygraph.hpp"
+#include "base/exception.hpp"
+#include "base/function.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/namespace.hpp"
+#include "base/netstring.hpp"
+#include "base/objectlock.hpp"
+#include "base/scriptframe.hpp"
+#include "base/scriptglobal.hpp"
+#include "base/serializer.hpp"
+#include "base/stdiostream.hpp"
+#include "base/tlsutility.hpp"
+#include "base/utility.hpp"
+#include "base/workqueue.hpp"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <set>
+
+using namespace icinga;
+
+std::mutex ConfigDiffReload::m_Mutex;
+
+/**
+ * Checks whether an ApiListener object enables in-process reloads.
+ *
+ * @returns Whether config packages should be reloaded in-process.
+ */
+bool ConfigDiffReload::IsEnabled()
+{
+	for (const ApiListener::Ptr& listener : ConfigType::GetObjectsByType<ApiListener>()) {
+		if (listener->GetEnableDiffReload())
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Writes a digest of everything which can't be compared using the objects
+ * file next to it. The file is removed if there are rules which can't be
+ * represented.
+ *
+ * @param objectsFile The objects file which was written for the current config.
+ */
+void ConfigDiffReload::WriteRulesFile(const String& objectsFile)
+{
+	String rulesFile = objectsFile + ".rules";
+	String digest;
+
+	try {
+		digest = GetRulesDigest();
+	} catch (const std::exception& ex) {
+		Log(LogNotice, "ConfigDiffReload")
+			<< "Templates and rules can't be compared, in-process reloads will fall back to a full reload: " << DiagnosticInformation(ex, false);
+
+		if (Utility::PathExists(rulesFile))
+			Utility::Remove(rulesFile);
+
+		return;
+	}
+
+	std::fstream fp;
+	String tempFilename = Utility::CreateTempFile(rulesFile + ".XXXXXX", 0600, fp);
+
+	if (!fp)
+		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open '" + tempFilename + "' file"));
+
+	fp << digest;
+	fp.close();
+
+	Utility::RenameFile(tempFilename, rulesFile);
+}
+
+/**
+ * Remembers the files of the config the process is running with. Later
+ * reloads are compared against these copies.
+ *
+ * @param objectsFile The objects file for the running config.
+ * @param varsFile The vars file for the running config.
+ */
+void ConfigDiffReload::SaveActiveConfig(const String& objectsFile, const String& varsFile)
+{
+	String activeRulesFile = Configuration::ObjectsPath + ".rules.active";
+
+	Utility::CopyFile(objectsFile, Configuration::ObjectsPath + ".active");
+	Utility::CopyFile(varsFile, Configuration::VarsPath + ".active");
+
+	if (Utility::PathExists(objectsFile + ".rules"))
+		Utility::CopyFile(objectsFile + ".rules", activeRulesFile);
+	else if (Utility::PathExists(activeRulesFile))
+		Utility::Remove(activeRulesFile);
+}
+
+/**
+ * Updates the running process to a new config. Objects which were removed
+ * or changed are deleted, objects which were added or changed are created
+ * from their serialized attributes. Objects which depend on deleted objects
+ * are recreated as well and keep their state. Modified attributes of
+ * recreated objects are lost.
+ *
+ * If this returns false without having touched any objects the process is
+ * still running with the previous config, otherwise the caller must restart
+ * it.
+ *
+ * @param objectsFile The objects file written by the config validation.
+ * @param varsFile The vars file written by the config validation.
+ * @returns Whether the new config was applied.
+ */
+bool ConfigDiffReload::Apply(const String& objectsFile, const String& varsFile)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	String activeObjectsFile = Configuration::ObjectsPath + ".active";
+	String activeVarsFile = Configuration::VarsPath + ".active";
+
+	if (!Utility::PathExists(activeObjectsFile) || !Utility::PathExists(activeVarsFile)) {
+		Log(LogInformation, "ConfigDiffReload", "No active config was saved, falling back to a full reload.");
+		return false;
+	}
+
+	String activeRules = ReadRulesFile(Configuration::ObjectsPath + ".rules.active");
+	String newRules = ReadRulesFile(objectsFile + ".rules");
+
+	if (activeRules.IsEmpty() || activeRules != newRules) {
+		Log(LogInformation, "ConfigDiffReload", "Templates or rules have changed, falling back to a full reload.");
+		return false;
+	}
+
+	std::map<String, String> activeVars, newVars;
+
+	if (!ReadVarsFile(activeVarsFile, activeVars) || !ReadVarsFile(varsFile, newVars) || activeVars != newVars) {
+		Log(LogInformation, "ConfigDiffReload", "Global variables have changed, falling back to a full reload.");
+		return false;
+	}
+
+	ObjectMap activeObjects, newObjects;
+
+	if (!ReadObjectsFile(activeObjectsFile, activeObjects) || !ReadObjectsFile(objectsFile, newObjects))
+		return false;
+
+	std::set<ObjectKey> removed, updated;
+
+	for (auto& kv : activeObjects) {
+		auto it = newObjects.find(kv.first);
+
+		if (it == newObjects.end())
+			removed.insert(kv.first);
+		else if (JsonEncode(kv.second->Get("properties")) != JsonEncode(it->second->Get("properties")))
+			updated.insert(kv.first);
+	}
+
+	for (auto& kv : newObjects) {
+		if (activeObjects.find(kv.first) == activeObjects.end())
+			updated.insert(kv.first);
+	}
+
+	if (removed.empty() && updated.empty()) {
+		Log(LogInformation, "ConfigDiffReload", "No objects have changed.");
+		SaveActiveConfig(objectsFile, varsFile);
+		return true;
+	}
+
+	for (const std::set<ObjectKey>& keys : { removed, updated }) {
+		for (const ObjectKey& key : keys) {
+			if (!IsSupportedType(key.first)) {
+				Log(LogInformation, "ConfigDiffReload")
+					<< "Object '" << key.second << "' of type '" << key.first
+					<< "' can't be reloaded in-process, falling back to a full reload.";
+				return false;
+			}
+		}
+	}
+
+	/* Collect the objects which have to go, dependent objects first. */
+	std::vector<ConfigObject::Ptr> deleted;
+	std::set<ConfigObject *> seen;
+
+	std::function<void(const ConfigObject::Ptr&)> collect = [&deleted, &seen, &collect](const ConfigObject::Ptr& object) {
+		if (!seen.insert(object.get()).second)
+			return;
+
+		for (const Object::Ptr& parent : DependencyGraph::GetParents(object)) {
+			ConfigObject::Ptr parentObj = dynamic_pointer_cast<ConfigObject>(parent);
+
+			if (parentObj)
+				collect(parentObj);
+		}
+
+		deleted.push_back(object);
+	};
+
+	for (const std::set<ObjectKey>& keys : { removed, updated }) {
+		for (const ObjectKey& key : keys) {
+			ConfigObject::Ptr object = ConfigObject::GetObject(key.first, key.second);
+
+			if (object)
+				collect(object);
+		}
+	}
+
+	std::set<ObjectKey> created = updated;
+	std::vector<String> apiFiles;
+	std::vector<ConfigItem::Ptr> storedItems;
+	std::map<ObjectKey, Value> states;
+	std::map<ObjectKey, ConfigItem::Ptr> oldItems;
+
+	for (const ConfigObject::Ptr& object : deleted) {
+		Type::Ptr type = object->GetReflectionType();
+		ObjectKey key(type->GetName(), object->GetName());
+
+		if (newObjects.find(key) != newObjects.end()) {
+			created.insert(key);
+			oldItems[key] = ConfigItem::GetByTypeAndName(type, key.second);
+		} else if (object->GetPackage() == "_api") {
+			/* Runtime objects aren't part of the objects file, they're loaded from their store or config file again. */
+			ConfigItem::Ptr item = RuntimeObjectStore::CreateItem(type, key.second);
+
+			if (item) {
+				storedItems.push_back(item);
+			} else {
+				String path = ConfigObjectUtility::GetObjectConfigPath(type, key.second);
+
+				if (Utility::PathExists(path))
+					apiFiles.push_back(path);
+			}
+		} else
+			continue;
+
+		states[key] = Serialize(object, FAState);
+	}
+
+	/* Make sure all new objects can be built before touching the running ones. */
+	std::vector<std::pair<ObjectKey, Dictionary::Ptr> > records;
+
+	for (const ObjectKey& key : created) {
+		Dictionary::Ptr record = newObjects[key];
+		Value properties;
+
+		if (!ResolveValue(record->Get("properties"), properties)) {
+			Log(LogInformation, "ConfigDiffReload")
+				<< "Object '" << key.second << "' of type '" << key.first
+				<< "' has attributes which can't be restored, falling back to a full reload.";
+			return false;
+		}
+
+		record = record->ShallowClone();
+		record->Set("properties", properties);
+		records.emplace_back(key, record);
+	}
+
+	Log(LogInformation, "ConfigDiffReload")
+		<< "Reloading config in-process: " << removed.size() << " objects were removed and " << updated.size()
+		<< " added or changed, deleting " << deleted.size() << " and creating " << created.size() + apiFiles.size() + storedItems.size() << " objects.";
+
+	try {
+		for (const ConfigObject::Ptr& object : deleted) {
+			/* Deactivating without the "ConfigObjectDeleted" extension doesn't send cluster delete events. */
+			object->Deactivate(true);
+
+			ConfigItem::Ptr item = ConfigItem::GetByTypeAndName(object->GetReflectionType(), object->GetName());
+
+			if (item)
+				item->Unregister();
+			else
+				object->Unregister();
+		}
+
+		ActivationScope ascope;
+
+		/* Applied objects are part of the objects file, the rules must not create them again. */
+		ascope.GetContext()->SetCreateChildObjects(false);
+
+		for (auto& kv : records) {
+			auto it = oldItems.find(kv.first);
+			CreateItem(kv.second, it != oldItems.end() ? it->second : nullptr)->Register();
+		}
+
+		for (const ConfigItem::Ptr& item : storedItems)
+			item->Register();
+
+		for (const String& path : apiFiles) {
+			std::unique_ptr<Expression> expr = ConfigCompiler::CompileFile(path, String(), "_api");
+
+			ScriptFrame frame(true);
+			expr->Evaluate(frame);
+		}
+
+		WorkQueue upq(25000, Configuration::Concurrency);
+		upq.SetName("ConfigDiffReload::Apply");
+
+		std::vector<ConfigItem::Ptr> newItems;
+
+		if (!ConfigItem::CommitItems(ascope.GetContext(), upq, newItems, true)) {
+			for (const boost::exception_ptr& ex : upq.GetExceptions()) {
+				Log(LogCritical, "ConfigDiffReload")
+					<< DiagnosticInformation(ex);
+			}
+
+			return false;
+		}
+
+		for (const ConfigItem::Ptr& item : newItems) {
+			ConfigObject::Ptr object = item->GetObject();
+
+			if (!object)
+				continue;
+
+			auto it = states.find(ObjectKey(object->GetReflectionType()->GetName(), object->GetName()));
+
+			if (it != states.end())
+				Deserialize(object, it->second, false, FAState);
+
+			object->OnStateLoaded();
+			object->SetStateLoaded(true);
+		}
+
+		if (!ConfigItem::ActivateItems(newItems, true, true))
+			return false;
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "ConfigDiffReload")
+			<< "In-process reload failed: " << DiagnosticInformation(ex);
+		return false;
+	}
+
+	ApiListener::UpdateObjectAuthority();
+
+	Log(LogInformation, "ConfigDiffReload", "Finished reloading config in-process.");
+
+	SaveActiveConfig(objectsFile, varsFile);
+
+	return true;
+}
+
+String ConfigDiffReload::GetRulesDigest()
+{
+	std::vector<String> rules;
+
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		if (!dynamic_cast<ConfigType *>(type.get()))
+			continue;
+
+		for (const ConfigItem::Ptr& item : ConfigItem::GetItems(type)) {
+			/* Objects are compared using their attributes, only their assign rules are left. */
+			if (!item->IsAbstract() && !item->GetFilter())
+				continue;
+
+			String path = item->GetDebugInfo().Path;
+
+			rules.push_back(JsonEncode(new Array({
+				type->GetName(),
+				item->GetName(),
+				item->IsAbstract(),
+				item->IsDefaultTemplate(),
+				ConfigCompilerCache::SerializeExpression(item->IsAbstract() ? item->GetExpression().get() : nullptr, path),
+				ConfigCompilerCache::SerializeExpression(item->GetFilter().get(), path),
+				GetScopeDigest(item->GetScope())
+			})));
+		}
+
+		for (const ApplyRule& rule : ApplyRule::GetRules(type->GetName())) {
+			String path = rule.GetDebugInfo().Path;
+
+			rules.push_back(JsonEncode(new Array({
+				type->GetName(),
+				rule.GetTargetType(),
+				rule.GetName(),
+				rule.GetPackage(),
+				rule.GetFKVar(),
+				rule.GetFVVar(),
+				rule.GetIgnoreOnError(),
+				ConfigCompilerCache::SerializeExpression(rule.GetExpression().get(), path),
+				ConfigCompilerCache::SerializeExpression(rule.GetFilter().get(), path),
+				ConfigCompilerCache::SerializeExpression(rule.GetFTerm().get(), path),
+				GetScopeDigest(rule.GetScope())
+			})));
+		}
+	}
+
+	std::sort(rules.begin(), rules.end());
+
+	String data;
+
+	for (const String& rule : rules)
+		data += rule + "\n";
+
+	return SHA256(data);
+}
+
+/* Closures can't be compared, only scopes made of plain values are supported. */
+String ConfigDiffReload::GetScopeDigest(const Value& scope)
+{
+	std::function<void(const Value&)> check = [&check](const Value& value) {
+		if (value.IsObjectType<Dictionary>()) {
+			Dictionary::Ptr dict = value;
+			ObjectLock olock(dict);
+
+			for (const Dictionary::Pair& kv : dict)
+				check(kv.second);
+		} else if (value.IsObjectType<Array>()) {
+			Array::Ptr arr = value;
+			ObjectLock olock(arr);
+
+			for (const Value& item : arr)
+				check(item);
+		} else if (value.IsObject())
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Scope contains a value of type '" + value.GetTypeName() + "'."));
+	};
+
+	check(scope);
+
+	return JsonEncode(scope);
+}
+
+String ConfigDiffReload::ReadRulesFile(const String& rulesFile)
+{
+	if (!Utility::PathExists(rulesFile))
+		return String();
+
+	std::ifstream fp(rulesFile.CStr(), std::ifstream::in | std::ifstream::binary);
+	return String(std::istreambuf_iterator<char>(fp), std::istreambuf_iterator<char>());
+}
+
+bool ConfigDiffReload::ReadObjectsFile(const String& objectsFile, ObjectMap& objects)
+{
+	std::fstream fp;
+	fp.open(objectsFile.CStr(), std::ios_base::in);
+
+	if (!fp) {
+		Log(LogWarning, "ConfigDiffReload")
+			<< "Could not open objects file '" << objectsFile << "'.";
+		return false;
+	}
+
+	StdioStream::Ptr sfp = new StdioStream(&fp, false);
+
+	String message;
+	StreamReadContext src;
+	for (;;) {
+		StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+
+		if (srs == StatusEof)
+			break;
+
+		if (srs != StatusNewItem)
+			continue;
+
+		Dictionary::Ptr record = JsonDecode(message);
+		Dictionary::Ptr properties = record->Get("properties");
+
+		/* The running process is authoritative for runtime objects. */
+		if (properties->Get("package") == "_api")
+			continue;
+
+		objects[ObjectKey(record->Get("type"), properties->Get("__name"))] = record;
+	}
+
+	sfp->Close();
+
+	return true;
+}
+
+bool ConfigDiffReload::ReadVarsFile(const String& varsFile, std::map<String, String>& vars)
+{
+	std::fstream fp;
+	fp.open(varsFile.CStr(), std::ios_base::in);
+
+	if (!fp) {
+		Log(LogWarning, "ConfigDiffReload")
+			<< "Could not open vars file '" << varsFile << "'.";
+		return false;
+	}
+
+	StdioStream::Ptr sfp = new StdioStream(&fp, false);
+
+	String message;
+	StreamReadContext src;
+	for (;;) {
+		StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+
+		if (srs == StatusEof)
+			break;
+
+		if (srs != StatusNewItem)
+			continue;
+
+		Dictionary::Ptr variable = JsonDecode(message);
+		String name = variable->Get("name");
+
+		/* These are only defined for staged validations. */
+		if (name == "ActiveStageOverride" || name == "ObjectsPathOverride" || name == "VarsPathOverride")
+			continue;
+
+		vars[name] = JsonEncode(variable->Get("value"));
+	}
+
+	sfp->Close();
+
+	return true;
+}
+
+bool ConfigDiffReload::IsSupportedType(const String& type)
+{
+	static const std::set<String> types {
+		"CheckCommand", "Dependency", "EventCommand", "Host", "HostGroup", "Notification",
+		"NotificationCommand", "ScheduledDowntime", "Service", "ServiceGroup", "TimePeriod",
+		"User", "UserGroup"
+	};
+
+	return types.find(type) != types.end();
+}
+
+/**
+ * Turns serialized attributes back into values which can be assigned to
+ * an object. Serialize() writes objects as dictionaries with a "type" key,
+ * only registered global functions can be looked up again.
+ *
+ * @param value The serialized value.
+ * @param result The value which can be assigned.
+ * @returns Whether the value could be restored.
+ */
+bool ConfigDiffReload::ResolveValue(const Value& value, Value& result)
+{
+	if (value.IsObjectType<Array>()) {
+		Array::Ptr arr = value;
+		ArrayData items;
+
+		ObjectLock olock(arr);
+		for (const Value& item : arr) {
+			Value resolved;
+
+			if (!ResolveValue(item, resolved))
+				return false;
+
+			items.push_back(resolved);
+		}
+
+		result = new Array(std::move(items));
+		return true;
+	}
+
+	if (value.IsObjectType<Dictionary>()) {
+		Dictionary::Ptr dict = value;
+
+		if (dict->Contains("type")) {
+			if (dict->Get("type") != "Function")
+				return false;
+
+			String name = dict->Get("name");
+			size_t pos = name.Find("#");
+
+			if (pos == String::NPos)
+				return false;
+
+			Value ns = ScriptGlobal::Get(name.SubStr(0, pos), &Empty);
+			Value func;
+
+			if (!ns.IsObjectType<Namespace>() || !static_cast<Namespace::Ptr>(ns)->Get(name.SubStr(pos + 1), &func) || !func.IsObjectType<Function>())
+				return false;
+
+			result = func;
+			return true;
+		}
+
+		DictionaryData items;
+
+		ObjectLock olock(dict);
+		for (const Dictionary::Pair& kv : dict) {
+			Value resolved;
+
+			if (!ResolveValue(kv.second, resolved))
+				return false;
+
+			items.emplace_back(kv.first, resolved);
+		}
+
+		result = new Dictionary(std::move(items));
+		return true;
+	}
+
+	result = value;
+	return true;
+}
+
+ConfigItem::Ptr ConfigDiffReload::CreateItem(const Dictionary::Ptr& record, const ConfigItem::Ptr& oldItem)
+{
+	Dictionary::Ptr properties = record->Get("properties");
+	Array::Ptr debugInfo = record->Get("debug_info");
+
+	DebugInfo di;
+
+	if (debugInfo && debugInfo->GetLength() == 5) {
+		di.Path = debugInfo->Get(0);
+		di.FirstLine = debugInfo->Get(1);
+		di.FirstColumn = debugInfo->Get(2);
+		di.LastLine = debugInfo->Get(3);
+		di.LastColumn = debugInfo->Get(4);
+	}
+
+	ConfigItemBuilder builder(di);
+	builder.SetType(Type::GetByName(record->Get("type")));
+	builder.SetName(properties->Get("name"));
+	builder.SetZone(properties->Get("zone"));
+	builder.SetPackage(properties->Get("package"));
+
+	/* Group assign rules are unchanged, they're taken from the previous item. */
+	if (oldItem && oldItem->GetFilter()) {
+		builder.SetFilter(oldItem->GetFilter());
+		builder.SetScope(oldItem->GetScope());
+	}
+
+	ObjectLock olock(properties);
+	for (const Dictionary::Pair& kv : properties) {
+		if (kv.first == "__name")
+			continue;
+
+		builder.AddExpression(new SetExpression(MakeIndexer(ScopeThis, kv.first), OpSetLiteral, MakeLiteral(kv.second), di));
+	}
+
+	return builder.Compile();
+}
@@ -0,0 +1,54 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef CONFIGDIFFRELOAD_H
+#define CONFIGDIFFRELOAD_H
+
+#include "remote/i2-remote.hpp"
+#include "config/configitem.hpp"
+#include "base/dictionary.hpp"
+#include <map>
+#include <mutex>
+
+namespace icinga
+{
+
+/**
+ * Applies a validated config to the running process by recreating only the
+ * objects which differ from the active config instead of restarting it.
+ *
+ * Anything which isn't visible in the objects file (global variables,
+ * templates, apply rules and group assign rules) has to be unchanged, and
+ * all changed objects must be of a supported type. Otherwise Apply() fails
+ * and the caller is expected to fall back to a full reload.
+ *
+ * @ingroup remote
+ */
+class ConfigDiffReload
+{
+public:
+	static bool IsEnabled();
+
+	static void WriteRulesFile(const String& objectsFile);
+	static void SaveActiveConfig(const String& objectsFile, const String& varsFile);
+	static bool Apply(const String& objectsFile, const String& varsFile);
+
+	static bool IsSupportedType(const String& type);
+
+private:
+	typedef std::pair<String, String> ObjectKey;
+	typedef std::map<ObjectKey, Dictionary::Ptr> ObjectMap;
+
+	static std::mutex m_Mutex;
+
+	static String GetRulesDigest();
+	static String GetScopeDigest(const Value& scope);
+	static String ReadRulesFile(const String& rulesFile);
+	static bool ReadObjectsFile(const String& objectsFile, ObjectMap& objects);
+	static bool ReadVarsFile(const String& varsFile, std::map<String, String>& vars);
+	static bool ResolveValue(const Value& value, Value& result);
+	static ConfigItem::Ptr CreateItem(const Dictionary::Ptr& record, const ConfigItem::Ptr& oldItem);
+};
+
+}
+
+#endif /* CONFIGDIFFRELOAD_H */
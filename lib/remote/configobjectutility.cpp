@@ -3,9 +3,11 @@
 #include "remote/configobjectutility.hpp"
 #include "remote/configpackageutility.hpp"
 #include "remote/apilistener.hpp"
+#include "remote/runtimeobjectstore.hpp"
 #include "config/configcompiler.hpp"
 #include "config/configitem.hpp"
 #include "base/configwriter.hpp"
+#include "base/convert.hpp"
 #include "base/exception.hpp"
 #include "base/dependencygraph.hpp"
 #include "base/tlsutility.hpp"
@@ -14,6 +16,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/system/error_code.hpp>
 #include <fstream>
+#include <set>
 #include <utility>
 
 using namespace icinga;
@@ -107,8 +110,13 @@ String ConfigObjectUtility::EscapeName(const String& name)
 	return Utility::EscapeString(name, "<>:\"/\\|?*", true);
 }
 
-String ConfigObjectUtility::CreateObjectConfig(const Type::Ptr& type, const String& fullName,
-	bool ignoreOnError, const Array::Ptr& templates, const Dictionary::Ptr& attrs)
+/**
+ * Validates the attributes of a new object and completes them with the
+ * parts of its full name and its version.
+ *
+ * @returns The object's attributes, "name" holds the name of its config item
+ */
+Dictionary::Ptr ConfigObjectUtility::CreateObjectAttrs(const Type::Ptr& type, const String& fullName, const Dictionary::Ptr& attrs)
 {
 	auto *nc = dynamic_cast<NameComposer *>(type.get());
 	Dictionary::Ptr nameParts;
@@ -142,11 +150,22 @@ String ConfigObjectUtility::CreateObjectConfig(const Type::Ptr& type, const Stri
 	if (nameParts)
 		nameParts->CopyTo(allAttrs);
 
-	allAttrs->Remove("name");
+	allAttrs->Set("name", name);
 
 	/* update the version for config sync */
 	allAttrs->Set("version", Utility::GetTime());
 
+	return allAttrs;
+}
+
+String ConfigObjectUtility::CreateObjectConfig(const Type::Ptr& type, const String& fullName,
+	bool ignoreOnError, const Array::Ptr& templates, const Dictionary::Ptr& attrs)
+{
+	Dictionary::Ptr allAttrs = CreateObjectAttrs(type, fullName, attrs);
+	String name = allAttrs->Get("name");
+
+	allAttrs->Remove("name");
+
 	std::ostringstream config;
 	ConfigWriter::EmitConfigItem(config, type->GetName(), name, false, ignoreOnError, templates, allAttrs);
 	ConfigWriter::EmitRaw(config, "\n");
@@ -156,41 +175,74 @@ String ConfigObjectUtility::CreateObjectConfig(const Type::Ptr& type, const Stri
 
 bool ConfigObjectUtility::CreateObject(const Type::Ptr& type, const String& fullName,
 	const String& config, const Array::Ptr& errors, const Array::Ptr& diagnosticInformation, const Value& cookie)
+{
+	return CreateObjects(type, { { fullName, config } }, errors, diagnosticInformation, cookie);
+}
+
+/**
+ * Creates objects of the same type in one go. Every object still gets its own
+ * config file, so that it can be deleted on its own later on. But the files
+ * are compiled in the same activation context and all items are committed and
+ * activated together, so either all objects are created or none.
+ *
+ * @param type The objects' type
+ * @param configs The objects' full names and their config, see CreateObjectConfig()
+ * @returns Whether the objects were created
+ */
+bool ConfigObjectUtility::CreateObjects(const Type::Ptr& type, const std::vector<std::pair<String, String> >& configs,
+	const Array::Ptr& errors, const Array::Ptr& diagnosticInformation, const Value& cookie)
 {
 	CreateStorage();
 
 	{
 		auto configType (dynamic_cast<ConfigType*>(type.get()));
+		std::set<String> names;
 
-		if (configType && configType->GetObject(fullName)) {
-			errors->Add("Object '" + fullName + "' already exists.");
-			return false;
+		for (auto& config : configs) {
+			if ((configType && configType->GetObject(config.first)) || !names.insert(config.first).second) {
+				errors->Add("Object '" + config.first + "' already exists.");
+				return false;
+			}
 		}
 	}
 
-	String path;
+	std::vector<String> paths;
+	paths.reserve(configs.size());
 
-	try {
-		path = GetObjectConfigPath(type, fullName);
-	} catch (const std::exception& ex) {
-		errors->Add("Config package broken: " + DiagnosticInformation(ex, false));
-		return false;
+	for (auto& config : configs) {
+		try {
+			paths.emplace_back(GetObjectConfigPath(type, config.first));
+		} catch (const std::exception& ex) {
+			errors->Add("Config package broken: " + DiagnosticInformation(ex, false));
+			return false;
+		}
 	}
 
-	Utility::MkDirP(Utility::DirName(path), 0700);
+	auto removePaths ([&paths]() {
+		for (auto& path : paths)
+			Utility::Remove(path);
+	});
 
-	std::ofstream fp(path.CStr(), std::ofstream::out | std::ostream::trunc);
-	fp << config;
-	fp.close();
-
-	std::unique_ptr<Expression> expr = ConfigCompiler::CompileFile(path, String(), "_api");
+	/* Only for logging. */
+	String names = configs.size() == 1 ? "'" + configs[0].first + "'" : Convert::ToString(configs.size()) + " objects";
 
 	try {
 		ActivationScope ascope;
 
-		ScriptFrame frame(true);
-		expr->Evaluate(frame);
-		expr.reset();
+		for (size_t i = 0; i < configs.size(); i++) {
+			auto& path (paths[i]);
+
+			Utility::MkDirP(Utility::DirName(path), 0700);
+
+			std::ofstream fp(path.CStr(), std::ofstream::out | std::ostream::trunc);
+			fp << configs[i].second;
+			fp.close();
+
+			std::unique_ptr<Expression> expr = ConfigCompiler::CompileFile(path, String(), "_api");
+
+			ScriptFrame frame(true);
+			expr->Evaluate(frame);
+		}
 
 		WorkQueue upq;
 		upq.SetName("ConfigObjectUtility::CreateObject");
@@ -204,9 +256,9 @@ bool ConfigObjectUtility::CreateObject(const Type::Ptr& type, const String& full
 		if (!ConfigItem::CommitItems(ascope.GetContext(), upq, newItems, true)) {
 			if (errors) {
 				Log(LogNotice, "ConfigObjectUtility")
-					<< "Failed to commit config item '" << fullName << "'. Aborting and removing config path '" << path << "'.";
+					<< "Failed to commit config item " << names << ". Aborting and removing its config files.";
 
-				Utility::Remove(path);
+				removePaths();
 
 				for (const boost::exception_ptr& ex : upq.GetExceptions()) {
 					errors->Add(DiagnosticInformation(ex, false));
@@ -227,9 +279,9 @@ bool ConfigObjectUtility::CreateObject(const Type::Ptr& type, const String& full
 		if (!ConfigItem::ActivateItems(newItems, true, true, false, cookie)) {
 			if (errors) {
 				Log(LogNotice, "ConfigObjectUtility")
-					<< "Failed to activate config object '" << fullName << "'. Aborting and removing config path '" << path << "'.";
+					<< "Failed to activate config object " << names << ". Aborting and removing its config files.";
 
-				Utility::Remove(path);
+				removePaths();
 
 				for (const boost::exception_ptr& ex : upq.GetExceptions()) {
 					errors->Add(DiagnosticInformation(ex, false));
@@ -249,20 +301,23 @@ bool ConfigObjectUtility::CreateObject(const Type::Ptr& type, const String& full
 		if (type->GetName() != "Comment" && type->GetName() != "Downtime")
 			ApiListener::UpdateObjectAuthority();
 
-		// At this stage we should have a config object already. If not, it was ignored before.
+		// At this stage we should have the config objects already. If not, they were ignored before.
 		auto *ctype = dynamic_cast<ConfigType *>(type.get());
-		ConfigObject::Ptr obj = ctype->GetObject(fullName);
-
-		if (obj) {
-			Log(LogInformation, "ConfigObjectUtility")
-				<< "Created and activated object '" << fullName << "' of type '" << type->GetName() << "'.";
-		} else {
-			Log(LogNotice, "ConfigObjectUtility")
-				<< "Object '" << fullName << "' was not created but ignored due to errors.";
+
+		for (auto& config : configs) {
+			ConfigObject::Ptr obj = ctype->GetObject(config.first);
+
+			if (obj) {
+				Log(LogInformation, "ConfigObjectUtility")
+					<< "Created and activated object '" << config.first << "' of type '" << type->GetName() << "'.";
+			} else {
+				Log(LogNotice, "ConfigObjectUtility")
+					<< "Object '" << config.first << "' was not created but ignored due to errors.";
+			}
 		}
 
 	} catch (const std::exception& ex) {
-		Utility::Remove(path);
+		removePaths();
 
 		if (errors)
 			errors->Add(DiagnosticInformation(ex, false));
@@ -332,6 +387,14 @@ bool ConfigObjectUtility::DeleteObjectHelper(const ConfigObject::Ptr& object, bo
 		return false;
 	}
 
+	/* Objects which are kept in the runtime object store don't have a config file. */
+	if (RuntimeObjectStore::RemoveObject(type, name)) {
+		Log(LogInformation, "ConfigObjectUtility")
+			<< "Deleted object '" << name << "' of type '" << type->GetName() << "'.";
+
+		return true;
+	}
+
 	String path;
 
 	try {
@@ -2,7 +2,11 @@
 
 #include "remote/configpackageutility.hpp"
 #include "remote/apilistener.hpp"
+#include "remote/configdiffreload.hpp"
+#include "remote/configspoolfile.hpp"
+#include "remote/scopedvalidation.hpp"
 #include "base/application.hpp"
+#include "base/configuration.hpp"
 #include "base/exception.hpp"
 #include "base/utility.hpp"
 #include <boost/algorithm/string.hpp>
@@ -17,6 +21,15 @@ String ConfigPackageUtility::GetPackageDir()
 	return Configuration::DataDir + "/api/packages";
 }
 
+/**
+ * Returns where large files of uploaded stages are kept until the stage is created.
+ * Next to the package directory, so they can be moved into it.
+ */
+String ConfigPackageUtility::GetSpoolDir()
+{
+	return Configuration::DataDir + "/api/packages-spool/";
+}
+
 void ConfigPackageUtility::CreatePackage(const String& name)
 {
 	String path = GetPackageDir() + "/" + name;
@@ -106,6 +119,15 @@ String ConfigPackageUtility::CreateStage(const String& packageName, const Dictio
 
 			// Pass the directory and generate a dir tree, if it does not already exist
 			Utility::MkDirP(Utility::DirName(filePath), 0750);
+
+			// Large files have been spooled while decoding the request, just move them.
+			if (kv.second.IsObjectType<ConfigSpoolFile>()) {
+				ConfigSpoolFile::Ptr spooled = kv.second;
+
+				Utility::RenameFile(spooled->GetPath(), filePath);
+				continue;
+			}
+
 			std::ofstream fp(filePath.CStr(), std::ofstream::out | std::ostream::binary | std::ostream::trunc);
 			fp << kv.second;
 			fp.close();
@@ -171,7 +193,7 @@ void ConfigPackageUtility::ActivateStage(const String& packageName, const String
 	WritePackageConfig(packageName);
 }
 
-void ConfigPackageUtility::TryActivateStageCallback(const ProcessResult& pr, const String& packageName, const String& stageName, bool activate, bool reload)
+void ConfigPackageUtility::TryActivateStageCallback(const ProcessResult& pr, const String& packageName, const String& stageName, bool activate, bool reload, bool diffReload)
 {
 	String logFile = GetPackageDir() + "/" + packageName + "/" + stageName + "/startup.log";
 	std::ofstream fpLog(logFile.CStr(), std::ofstream::out | std::ostream::binary | std::ostream::trunc);
@@ -192,17 +214,57 @@ void ConfigPackageUtility::TryActivateStageCallback(const ProcessResult& pr, con
 				ActivateStage(packageName, stageName);
 			}
 
-			if (reload)
-				Application::RequestRestart();
+			if (reload) {
+				String prefix = GetDiffReloadPrefix(packageName, stageName);
+
+				if (!diffReload || !ConfigDiffReload::Apply(prefix + ".debug", prefix + ".vars"))
+					Application::RequestRestart();
+			}
 		}
 	} else {
 		Log(LogCritical, "ConfigPackageUtility")
 			<< "Config validation failed for package '"
 			<< packageName << "' and stage '" << stageName << "'.";
 	}
+
+	if (diffReload) {
+		String prefix = GetDiffReloadPrefix(packageName, stageName);
+
+		for (const String& path : { prefix + ".debug", prefix + ".debug.rules", prefix + ".vars" }) {
+			if (Utility::PathExists(path))
+				Utility::Remove(path);
+		}
+	}
+}
+
+String ConfigPackageUtility::GetDiffReloadPrefix(const String& packageName, const String& stageName)
+{
+	return Configuration::CacheDir + "/icinga2-" + packageName + "-" + stageName;
 }
 
 void ConfigPackageUtility::AsyncTryActivateStage(const String& packageName, const String& stageName, bool activate, bool reload)
+{
+	/* Keep the validation's objects and vars files apart from the running config's. */
+	bool diffReload = activate && reload && ConfigDiffReload::IsEnabled();
+
+	/* A diff reload needs the objects and vars files written by a validation process. */
+	if (!diffReload && ScopedValidation::IsEnabled()) {
+		Utility::QueueAsyncCallback([packageName, stageName, activate, reload]() {
+			ProcessResult pr;
+
+			if (ScopedValidation::ValidatePackageStage(packageName, stageName, pr))
+				TryActivateStageCallback(pr, packageName, stageName, activate, reload, false);
+			else
+				RunValidationProcess(packageName, stageName, activate, reload, false);
+		});
+
+		return;
+	}
+
+	RunValidationProcess(packageName, stageName, activate, reload, diffReload);
+}
+
+void ConfigPackageUtility::RunValidationProcess(const String& packageName, const String& stageName, bool activate, bool reload, bool diffReload)
 {
 	VERIFY(Application::GetArgC() >= 1);
 
@@ -226,9 +288,18 @@ void ConfigPackageUtility::AsyncTryActivateStage(const String& packageName, cons
 	args->Add("--define");
 	args->Add("ActiveStageOverride=" + packageName + ":" + stageName);
 
+	if (diffReload) {
+		String prefix = GetDiffReloadPrefix(packageName, stageName);
+
+		args->Add("--define");
+		args->Add("ObjectsPathOverride=" + prefix + ".debug");
+		args->Add("--define");
+		args->Add("VarsPathOverride=" + prefix + ".vars");
+	}
+
 	Process::Ptr process = new Process(Process::PrepareCommand(args));
 	process->SetTimeout(Application::GetReloadTimeout());
-	process->Run(std::bind(&TryActivateStageCallback, _1, packageName, stageName, activate, reload));
+	process->Run(std::bind(&TryActivateStageCallback, _1, packageName, stageName, activate, reload, diffReload));
 }
 
 void ConfigPackageUtility::DeleteStage(const String& packageName, const String& stageName)
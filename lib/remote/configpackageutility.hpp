@@ -23,6 +23,7 @@ class ConfigPackageUtility
 
 public:
 	static String GetPackageDir();
+	static String GetSpoolDir();
 
 	static void CreatePackage(const String& name);
 	static void DeletePackage(const String& name);
@@ -54,7 +55,9 @@ private:
 	static void WritePackageConfig(const String& packageName);
 	static void WriteStageConfig(const String& packageName, const String& stageName);
 
-	static void TryActivateStageCallback(const ProcessResult& pr, const String& packageName, const String& stageName, bool activate, bool reload);
+	static String GetDiffReloadPrefix(const String& packageName, const String& stageName);
+	static void RunValidationProcess(const String& packageName, const String& stageName, bool activate, bool reload, bool diffReload);
+	static void TryActivateStageCallback(const ProcessResult& pr, const String& packageName, const String& stageName, bool activate, bool reload, bool diffReload);
 };
 
 }
@@ -0,0 +1,54 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/configspoolfile.hpp"
+#include "base/exception.hpp"
+#include "base/utility.hpp"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+using namespace icinga;
+
+ConfigSpoolFile::ConfigSpoolFile(String path, size_t size)
+	: m_Path(std::move(path)), m_Size(size)
+{ }
+
+ConfigSpoolFile::~ConfigSpoolFile()
+{
+	(void)remove(m_Path.CStr());
+}
+
+/**
+ * Writes a config file to a new file in the spool directory.
+ *
+ * @param spoolDir The spool directory, created if necessary
+ * @param content The file's content
+ * @returns The spooled file
+ */
+ConfigSpoolFile::Ptr ConfigSpoolFile::Create(const String& spoolDir, const String& content)
+{
+	Utility::MkDirP(spoolDir, 0700);
+
+	std::fstream fp;
+	String tempPath = Utility::CreateTempFile(spoolDir + "file.XXXXXX", 0600, fp);
+	ConfigSpoolFile::Ptr spooled = new ConfigSpoolFile(tempPath, content.GetLength());
+
+	fp << content;
+	fp.close();
+
+	if (fp.fail())
+		BOOST_THROW_EXCEPTION(std::runtime_error("Cannot write '" + tempPath + "'."));
+
+	return spooled;
+}
+
+const String& ConfigSpoolFile::GetPath() const
+{
+	return m_Path;
+}
+
+size_t ConfigSpoolFile::GetSize() const
+{
+	return m_Size;
+}
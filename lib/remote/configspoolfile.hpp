@@ -0,0 +1,41 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef CONFIGSPOOLFILE_H
+#define CONFIGSPOOLFILE_H
+
+#include "remote/i2-remote.hpp"
+#include "base/object.hpp"
+#include "base/string.hpp"
+
+namespace icinga
+{
+
+/**
+ * A received config file which has been written to a spool directory
+ * while decoding the message instead of being kept in memory.
+ *
+ * @ingroup remote
+ */
+class ConfigSpoolFile final : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(ConfigSpoolFile);
+
+	ConfigSpoolFile(String path, size_t size);
+
+	/* Nothing left to remove once the file has been moved to its destination. */
+	~ConfigSpoolFile() override;
+
+	static ConfigSpoolFile::Ptr Create(const String& spoolDir, const String& content);
+
+	const String& GetPath() const;
+	size_t GetSize() const;
+
+private:
+	String m_Path;
+	size_t m_Size;
+};
+
+}
+
+#endif /* CONFIGSPOOLFILE_H */
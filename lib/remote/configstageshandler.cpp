@@ -2,15 +2,55 @@
 
 #include "remote/configstageshandler.hpp"
 #include "remote/configpackageutility.hpp"
+#include "remote/configspoolfile.hpp"
 #include "remote/httputility.hpp"
 #include "remote/filterutility.hpp"
 #include "base/application.hpp"
 #include "base/exception.hpp"
+#include "base/logger.hpp"
+#include <utility>
 
 using namespace icinga;
 
 REGISTER_URLHANDLER("/v1/config/stages", ConfigStagesHandler);
 
+/**
+ * Writes the contents of uploaded files to the spool directory,
+ * everything else is kept in memory.
+ *
+ * @param path e.g. ["files", "<file>"]
+ * @param value The string
+ * @return A ConfigSpoolFile or the string itself
+ */
+static Value SpoolStageFile(const std::vector<String>& path, String&& value)
+{
+	if (path.size() != 2 || path[0] != "files")
+		return std::move(value);
+
+	String spoolDir = ConfigPackageUtility::GetSpoolDir();
+
+	try {
+		return ConfigSpoolFile::Create(spoolDir, value);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ConfigStagesHandler")
+			<< "Cannot spool uploaded config file to '" << spoolDir << "', keeping it in memory: "
+			<< DiagnosticInformation(ex, false);
+
+		return std::move(value);
+	}
+}
+
+/**
+ * Spools large files of uploaded stages to disk while they're being decoded,
+ * so they aren't in memory multiple times.
+ */
+const LargeStringSink *ConfigStagesHandler::GetRequestBodySink() const
+{
+	static const LargeStringSink sink { 4096, &SpoolStageFile };
+
+	return &sink;
+}
+
 bool ConfigStagesHandler::HandleRequest(
 	AsioTlsStream& stream,
 	const ApiUser::Ptr& user,
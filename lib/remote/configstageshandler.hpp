@@ -24,6 +24,8 @@ public:
 		HttpServerConnection& server
 	) override;
 
+	const LargeStringSink *GetRequestBodySink() const override;
+
 private:
 	void HandleGet(
 		const ApiUser::Ptr& user,
@@ -8,12 +8,135 @@
 #include "remote/apiaction.hpp"
 #include "remote/zone.hpp"
 #include "base/configtype.hpp"
+#include "base/objectlock.hpp"
 #include <set>
+#include <utility>
+#include <vector>
 
 using namespace icinga;
 
 REGISTER_URLHANDLER("/v1/objects", CreateObjectHandler);
 
+/**
+ * Puts objects into the local zone if not explicitly defined. This allows
+ * additional zone members to sync the configuration at some later point.
+ */
+static Dictionary::Ptr PrepareAttrs(Dictionary::Ptr attrs)
+{
+	Zone::Ptr localZone = Zone::GetLocalZone();
+
+	if (localZone) {
+		String localZoneName = localZone->GetName();
+
+		if (!attrs) {
+			attrs = new Dictionary({
+				{ "zone", localZoneName }
+			});
+		} else if (!attrs->Contains("zone")) {
+			attrs->Set("zone", localZoneName);
+		}
+	}
+
+	/* Sanity checks for unique groups array. */
+	if (attrs && attrs->Contains("groups")) {
+		Array::Ptr groups = attrs->Get("groups");
+
+		if (groups)
+			attrs->Set("groups", groups->Unique());
+	}
+
+	return attrs;
+}
+
+/**
+ * Creates all objects of the "objects" array with one compile and activation
+ * pass, see ConfigObjectUtility::CreateObjects(). Either all of them are
+ * created or none.
+ */
+static void CreateObjects(const Type::Ptr& type, boost::beast::http::response<boost::beast::http::string_body>& response,
+	const Dictionary::Ptr& params)
+{
+	namespace http = boost::beast::http;
+
+	Value vobjects = params->Get("objects");
+
+	if (!vobjects.IsObjectType<Array>()) {
+		HttpUtility::SendJsonError(response, params, 400, "Objects must be specified as an array.");
+		return;
+	}
+
+	Array::Ptr objects = vobjects;
+
+	bool ignoreOnError = false;
+
+	if (params->Contains("ignore_on_error"))
+		ignoreOnError = HttpUtility::GetLastParameter(params, "ignore_on_error");
+
+	bool verbose = HttpUtility::GetLastParameter(params, "verbose");
+
+	std::vector<std::pair<String, String> > configs;
+	ArrayData results;
+	Array::Ptr errors = new Array();
+	Array::Ptr diagnosticInformation = new Array();
+
+	{
+		ObjectLock olock(objects);
+
+		for (const Value& vobject : objects) {
+			if (!vobject.IsObjectType<Dictionary>()) {
+				HttpUtility::SendJsonError(response, params, 400, "Each object must be specified as a dictionary.");
+				return;
+			}
+
+			Dictionary::Ptr object = vobject;
+			String name = object->Get("name");
+
+			if (name.IsEmpty()) {
+				HttpUtility::SendJsonError(response, params, 400, "Each object must have a name.");
+				return;
+			}
+
+			results.emplace_back(new Dictionary({ { "name", name } }));
+
+			try {
+				configs.emplace_back(name, ConfigObjectUtility::CreateObjectConfig(type, name, ignoreOnError,
+					object->Get("templates"), PrepareAttrs(object->Get("attrs"))));
+			} catch (const std::exception& ex) {
+				errors->Add("Object '" + name + "': " + DiagnosticInformation(ex, false));
+				diagnosticInformation->Add(DiagnosticInformation(ex));
+			}
+		}
+	}
+
+	bool created = errors->GetLength() == 0 && ConfigObjectUtility::CreateObjects(type, configs, errors, diagnosticInformation);
+	auto *ctype = dynamic_cast<ConfigType *>(type.get());
+
+	for (const Dictionary::Ptr& result1 : results) {
+		if (!created) {
+			result1->Set("errors", errors);
+			result1->Set("code", 500);
+			result1->Set("status", "Object could not be created.");
+
+			if (verbose)
+				result1->Set("diagnostic_information", diagnosticInformation);
+
+			continue;
+		}
+
+		result1->Set("code", 200);
+
+		if (ctype->GetObject(result1->Get("name")))
+			result1->Set("status", "Object was created");
+		else if (ignoreOnError)
+			result1->Set("status", "Object was not created but 'ignore_on_error' was set to true");
+	}
+
+	response.result(created ? http::status::ok : http::status::internal_server_error);
+	HttpUtility::SendJsonBody(response, params, new Dictionary({
+		{ "results", new Array(std::move(results)) }
+	}));
+}
+
 bool CreateObjectHandler::HandleRequest(
 	AsioTlsStream& stream,
 	const ApiUser::Ptr& user,
@@ -27,7 +150,7 @@ bool CreateObjectHandler::HandleRequest(
 {
 	namespace http = boost::beast::http;
 
-	if (url->GetPath().size() != 4)
+	if (url->GetPath().size() != 3 && url->GetPath().size() != 4)
 		return false;
 
 	if (request.method() != http::verb::put)
@@ -42,36 +165,14 @@ bool CreateObjectHandler::HandleRequest(
 
 	FilterUtility::CheckPermission(user, "objects/create/" + type->GetName());
 
-	String name = url->GetPath()[3];
-	Array::Ptr templates = params->Get("templates");
-	Dictionary::Ptr attrs = params->Get("attrs");
-
-	/* Put created objects into the local zone if not explicitly defined.
-	 * This allows additional zone members to sync the
-	 * configuration at some later point.
-	 */
-	Zone::Ptr localZone = Zone::GetLocalZone();
-	String localZoneName;
-
-	if (localZone) {
-		localZoneName = localZone->GetName();
-
-		if (!attrs) {
-			attrs = new Dictionary({
-				{ "zone", localZoneName }
-			});
-		} else if (!attrs->Contains("zone")) {
-			attrs->Set("zone", localZoneName);
-		}
+	if (url->GetPath().size() == 3) {
+		CreateObjects(type, response, params);
+		return true;
 	}
 
-	/* Sanity checks for unique groups array. */
-	if (attrs->Contains("groups")) {
-		Array::Ptr groups = attrs->Get("groups");
-
-		if (groups)
-			attrs->Set("groups", groups->Unique());
-	}
+	String name = url->GetPath()[3];
+	Array::Ptr templates = params->Get("templates");
+	Dictionary::Ptr attrs = PrepareAttrs(params->Get("attrs"));
 
 	Dictionary::Ptr result1 = new Dictionary();
 	String status;
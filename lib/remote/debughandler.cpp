@@ -0,0 +1,84 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/debughandler.hpp"
+#include "remote/httputility.hpp"
+#include "remote/filterutility.hpp"
+#include "base/convert.hpp"
+#include "base/lockprofiler.hpp"
+#include "base/logger.hpp"
+#include <algorithm>
+
+using namespace icinga;
+
+REGISTER_URLHANDLER("/v1/debug", DebugHandler);
+
+/* URL parameters are strings, JSON bodies may contain booleans or numbers. */
+static bool ParameterToBool(const Value& value)
+{
+	if (value.IsString())
+		return value == "1" || value == "true";
+
+	return value.ToBool();
+}
+
+bool DebugHandler::HandleRequest(
+	AsioTlsStream& stream,
+	const ApiUser::Ptr& user,
+	boost::beast::http::request<boost::beast::http::string_body>& request,
+	const Url::Ptr& url,
+	boost::beast::http::response<boost::beast::http::string_body>& response,
+	const Dictionary::Ptr& params,
+	boost::asio::yield_context& yc,
+	HttpServerConnection& server
+)
+{
+	if (url->GetPath().size() != 3)
+		return false;
+
+	String name = url->GetPath()[2];
+
+	FilterUtility::CheckPermission(user, "debug/" + name);
+
+	if (name == "locks")
+		return HandleLocks(request, response, params);
+
+	HttpUtility::SendJsonError(response, params, 404, "Unknown debug report: " + name);
+	return true;
+}
+
+/**
+ * GET returns the lock contention report, POST enables or disables the lock profiler.
+ */
+bool DebugHandler::HandleLocks(
+	boost::beast::http::request<boost::beast::http::string_body>& request,
+	boost::beast::http::response<boost::beast::http::string_body>& response,
+	const Dictionary::Ptr& params
+)
+{
+	namespace http = boost::beast::http;
+
+	if (request.method() == http::verb::post) {
+		Value enabled = HttpUtility::GetLastParameter(params, "enabled");
+
+		if (!enabled.IsEmpty()) {
+			LockProfiler::SetEnabled(ParameterToBool(enabled));
+
+			Log(LogInformation, "DebugHandler")
+				<< "Lock profiler " << (LockProfiler::IsEnabled() ? "enabled" : "disabled") << " via the API.";
+		}
+
+		if (ParameterToBool(HttpUtility::GetLastParameter(params, "reset")))
+			LockProfiler::Reset();
+	} else if (request.method() != http::verb::get) {
+		return false;
+	}
+
+	Value limit = HttpUtility::GetLastParameter(params, "limit");
+
+	response.result(http::status::ok);
+	HttpUtility::SendJsonBody(response, params, new Dictionary({
+		{ "results", new Array({ LockProfiler::GetReport(limit.IsEmpty() ? 25 : std::max(Convert::ToLong(limit), 0L)) }) }
+	}));
+
+	return true;
+}
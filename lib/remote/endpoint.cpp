@@ -17,6 +17,8 @@ REGISTER_TYPE(Endpoint);
 boost::signals2::signal<void(const Endpoint::Ptr&, const JsonRpcConnection::Ptr&)> Endpoint::OnConnected;
 boost::signals2::signal<void(const Endpoint::Ptr&, const JsonRpcConnection::Ptr&)> Endpoint::OnDisconnected;
 
+static MetricGauge& l_ConnectedEndpoints (MetricGauge::GetByName("endpoints_connected"));
+
 void Endpoint::OnAllConfigLoaded()
 {
 	ObjectImpl<Endpoint>::OnAllConfigLoaded();
@@ -24,6 +26,11 @@ void Endpoint::OnAllConfigLoaded()
 	if (!m_Zone)
 		BOOST_THROW_EXCEPTION(ScriptError("Endpoint '" + GetName() +
 			"' does not belong to a zone.", GetDebugInfo()));
+
+	m_MessagesSentMetric = &MetricCounter::GetByName("endpoint_messages_sent", GetName());
+	m_MessagesReceivedMetric = &MetricCounter::GetByName("endpoint_messages_received", GetName());
+	m_BytesSentMetric = &MetricCounter::GetByName("endpoint_bytes_sent", GetName());
+	m_BytesReceivedMetric = &MetricCounter::GetByName("endpoint_bytes_received", GetName());
 }
 
 void Endpoint::SetCachedZone(const Zone::Ptr& zone)
@@ -41,7 +48,9 @@ void Endpoint::AddClient(const JsonRpcConnection::Ptr& client)
 
 	{
 		std::unique_lock<std::mutex> lock(m_ClientsLock);
-		m_Clients.insert(client);
+
+		if (m_Clients.insert(client).second && m_Clients.size() == 1)
+			l_ConnectedEndpoints.Increment();
 	}
 
 	bool is_master = ApiListener::GetInstance()->IsMaster();
@@ -58,7 +67,9 @@ void Endpoint::RemoveClient(const JsonRpcConnection::Ptr& client)
 
 	{
 		std::unique_lock<std::mutex> lock(m_ClientsLock);
-		m_Clients.erase(client);
+
+		if (m_Clients.erase(client) && m_Clients.empty())
+			l_ConnectedEndpoints.Decrement();
 
 		Log(LogWarning, "ApiListener")
 			<< "Removing API client for endpoint '" << GetName() << "'. " << m_Clients.size() << " API clients left.";
@@ -107,6 +118,11 @@ void Endpoint::AddMessageSent(int bytes)
 	m_MessagesSent.InsertValue(time, 1);
 	m_BytesSent.InsertValue(time, bytes);
 	SetLastMessageSent(time);
+
+	if (m_MessagesSentMetric) {
+		m_MessagesSentMetric->Increment();
+		m_BytesSentMetric->Increment(bytes);
+	}
 }
 
 void Endpoint::AddMessageReceived(int bytes)
@@ -115,6 +131,11 @@ void Endpoint::AddMessageReceived(int bytes)
 	m_MessagesReceived.InsertValue(time, 1);
 	m_BytesReceived.InsertValue(time, bytes);
 	SetLastMessageReceived(time);
+
+	if (m_MessagesReceivedMetric) {
+		m_MessagesReceivedMetric->Increment();
+		m_BytesReceivedMetric->Increment(bytes);
+	}
 }
 
 double Endpoint::GetMessagesSentPerSecond() const
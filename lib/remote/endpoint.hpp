@@ -5,7 +5,9 @@
 
 #include "remote/i2-remote.hpp"
 #include "remote/endpoint-ti.hpp"
+#include "base/metric.hpp"
 #include "base/ringbuffer.hpp"
+#include <mutex>
 #include <set>
 
 namespace icinga
@@ -61,6 +63,11 @@ private:
 	mutable RingBuffer m_MessagesReceived{60};
 	mutable RingBuffer m_BytesSent{60};
 	mutable RingBuffer m_BytesReceived{60};
+
+	MetricCounter *m_MessagesSentMetric{nullptr};
+	MetricCounter *m_MessagesReceivedMetric{nullptr};
+	MetricCounter *m_BytesSentMetric{nullptr};
+	MetricCounter *m_BytesReceivedMetric{nullptr};
 };
 
 }
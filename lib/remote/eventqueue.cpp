@@ -150,8 +150,16 @@ std::map<String, EventsInbox::Filter> EventsInbox::m_Filters ({{"", EventsInbox:
 
 EventsRouter EventsRouter::m_Instance;
 
-EventsInbox::EventsInbox(String filter, const String& filterSource)
-	: m_Timer(IoEngine::Get().GetIoContext())
+/**
+ * Creates an inbox.
+ *
+ * @param filter The filter expression.
+ * @param filterSource The source to report errors in the filter for.
+ * @param maxEvents How many events may be pending, 0 for no limit.
+ * @param overflow What to do with new events once maxEvents is reached.
+ */
+EventsInbox::EventsInbox(String filter, const String& filterSource, std::size_t maxEvents, EventsOverflow overflow)
+	: m_MaxEvents(maxEvents), m_Overflow(overflow), m_Shifted(0), m_Overflowed(false), m_Timer(IoEngine::Get().GetIoContext())
 {
 	std::unique_lock<std::mutex> lock (m_FiltersMutex);
 	m_Filter = m_Filters.find(filter);
@@ -191,13 +199,48 @@ const Expression::Ptr& EventsInbox::GetFilter()
 
 void EventsInbox::Push(Dictionary::Ptr event)
 {
+	String key;
+
+	if (m_Overflow == EventsOverflow::Coalesce)
+		key = GetCoalescingKey(event);
+
 	std::unique_lock<std::mutex> lock (m_Mutex);
 
-	m_Queue.emplace(std::move(event));
+	if (!key.IsEmpty()) {
+		auto pending (m_Pending.find(key));
+
+		if (pending != m_Pending.end()) {
+			m_Queue[pending->second - m_Shifted].first = std::move(event);
+			return;
+		}
+	}
+
+	if (m_MaxEvents && m_Queue.size() >= m_MaxEvents) {
+		if (!m_Overflowed) {
+			m_Overflowed = true;
+
+			Log(LogWarning, "EventsInbox")
+				<< "Event stream client can't keep up, dropping the oldest of " << m_Queue.size() << " pending events.";
+		}
+
+		DropOldest();
+	}
+
+	if (!key.IsEmpty())
+		m_Pending.emplace(key, m_Shifted + m_Queue.size());
+
+	m_Queue.emplace_back(std::move(event), std::move(key));
 	m_Timer.expires_at(boost::posix_time::neg_infin);
 }
 
-Dictionary::Ptr EventsInbox::Shift(boost::asio::yield_context yc, double timeout)
+/**
+ * Waits for events and takes all pending ones.
+ *
+ * @param yc The coroutine to wait in.
+ * @param timeout How long to wait for the first event.
+ * @returns The events, empty on timeout.
+ */
+std::vector<Dictionary::Ptr> EventsInbox::Shift(boost::asio::yield_context yc, double timeout)
 {
 	std::unique_lock<std::mutex> lock (m_Mutex, std::defer_lock);
 
@@ -225,17 +268,72 @@ Dictionary::Ptr EventsInbox::Shift(boost::asio::yield_context yc, double timeout
 		}
 
 		if (m_Queue.empty()) {
-			return nullptr;
+			return {};
 		}
 	}
 
-	auto event (std::move(m_Queue.front()));
-	m_Queue.pop();
-	return std::move(event);
+	std::vector<Dictionary::Ptr> events;
+	events.reserve(m_Queue.size());
+
+	for (auto& event : m_Queue) {
+		events.emplace_back(std::move(event.first));
+	}
+
+	m_Shifted += m_Queue.size();
+	m_Queue.clear();
+	m_Pending.clear();
+	m_Overflowed = false;
+
+	return events;
+}
+
+/**
+ * Identifies the object an event is about, e.g. a service.
+ *
+ * @returns The event type and the object, empty if the event isn't about a single object.
+ */
+String EventsInbox::GetCoalescingKey(const Dictionary::Ptr& event)
+{
+	Value host, objectName;
+	String key = event->Get("type");
+
+	if (event->Get("host", &host)) {
+		key += "\n";
+		key += host;
+		key += "\n";
+		key += event->Get("service");
+		return key;
+	}
+
+	if (event->Get("object_name", &objectName)) {
+		key += "\n";
+		key += event->Get("object_type");
+		key += "\n";
+		key += objectName;
+		return key;
+	}
+
+	return String();
+}
+
+void EventsInbox::DropOldest()
+{
+	auto& oldest (m_Queue.front());
+
+	if (!oldest.second.IsEmpty()) {
+		auto pending (m_Pending.find(oldest.second));
+
+		if (pending != m_Pending.end() && pending->second == m_Shifted)
+			m_Pending.erase(pending);
+	}
+
+	m_Queue.pop_front();
+	m_Shifted++;
 }
 
-EventsSubscriber::EventsSubscriber(std::set<EventType> types, String filter, const String& filterSource)
-	: m_Types(std::move(types)), m_Inbox(new EventsInbox(std::move(filter), filterSource))
+EventsSubscriber::EventsSubscriber(std::set<EventType> types, String filter, const String& filterSource,
+	std::size_t maxEvents, EventsOverflow overflow)
+	: m_Types(std::move(types)), m_Inbox(new EventsInbox(std::move(filter), filterSource, maxEvents, overflow))
 {
 	EventsRouter::GetInstance().Subscribe(m_Types, m_Inbox);
 }
@@ -15,7 +15,8 @@
 #include <set>
 #include <map>
 #include <deque>
-#include <queue>
+#include <utility>
+#include <vector>
 
 namespace icinga
 {
@@ -86,12 +87,27 @@ enum class EventType : uint_fast8_t
 	ObjectModified
 };
 
+/**
+ * What an events inbox does with a new event once it is full.
+ */
+enum class EventsOverflow : uint_fast8_t
+{
+	/* The oldest pending event is dropped. */
+	DropOldest,
+	/* A pending event of the same type for the same object is replaced by the
+	 * new one, no matter whether the inbox is full. If there is none, the
+	 * oldest pending event is dropped.
+	 */
+	Coalesce
+};
+
 class EventsInbox : public Object
 {
 public:
 	DECLARE_PTR_TYPEDEFS(EventsInbox);
 
-	EventsInbox(String filter, const String& filterSource);
+	EventsInbox(String filter, const String& filterSource, std::size_t maxEvents = 0,
+		EventsOverflow overflow = EventsOverflow::DropOldest);
 	EventsInbox(const EventsInbox&) = delete;
 	EventsInbox(EventsInbox&&) = delete;
 	EventsInbox& operator=(const EventsInbox&) = delete;
@@ -101,7 +117,7 @@ public:
 	const Expression::Ptr& GetFilter();
 
 	void Push(Dictionary::Ptr event);
-	Dictionary::Ptr Shift(boost::asio::yield_context yc, double timeout = 5);
+	std::vector<Dictionary::Ptr> Shift(boost::asio::yield_context yc, double timeout = 5);
 
 private:
 	struct Filter
@@ -115,14 +131,30 @@ private:
 
 	std::mutex m_Mutex;
 	decltype(m_Filters.begin()) m_Filter;
-	std::queue<Dictionary::Ptr> m_Queue;
+	std::size_t m_MaxEvents;
+	EventsOverflow m_Overflow;
+
+	/* The pending events and their coalescing keys. */
+	std::deque<std::pair<Dictionary::Ptr, String> > m_Queue;
+
+	/* The number of events which have left the queue so far, i.e. the sequence
+	 * number of the first one. m_Pending maps coalescing keys to sequence numbers.
+	 */
+	uint_fast64_t m_Shifted;
+	std::map<String, uint_fast64_t> m_Pending;
+	bool m_Overflowed;
+
 	boost::asio::deadline_timer m_Timer;
+
+	static String GetCoalescingKey(const Dictionary::Ptr& event);
+	void DropOldest();
 };
 
 class EventsSubscriber
 {
 public:
-	EventsSubscriber(std::set<EventType> types, String filter, const String& filterSource);
+	EventsSubscriber(std::set<EventType> types, String filter, const String& filterSource,
+		std::size_t maxEvents = 0, EventsOverflow overflow = EventsOverflow::DropOldest);
 	EventsSubscriber(const EventsSubscriber&) = delete;
 	EventsSubscriber(EventsSubscriber&&) = delete;
 	EventsSubscriber& operator=(const EventsSubscriber&) = delete;
@@ -1,7 +1,9 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "remote/eventshandler.hpp"
+#include "remote/apilistener.hpp"
 #include "remote/httputility.hpp"
+#include "remote/messagecompression.hpp"
 #include "remote/filterutility.hpp"
 #include "config/configcompiler.hpp"
 #include "config/expression.hpp"
@@ -10,9 +12,13 @@
 #include "base/objectlock.hpp"
 #include "base/json.hpp"
 #include <boost/asio/buffer.hpp>
+#include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <cstdint>
+#include <iterator>
 #include <map>
+#include <memory>
 #include <set>
 
 using namespace icinga;
@@ -98,40 +104,97 @@ bool EventsHandler::HandleRequest(
 		}
 	}
 
-	EventsSubscriber subscriber (std::move(eventTypes), HttpUtility::GetLastParameter(params, "filter"), l_ApiQuery);
+	String overflowName = HttpUtility::GetLastParameter(params, "overflow");
+	EventsOverflow overflow;
+
+	if (overflowName.IsEmpty() || overflowName == "drop_oldest") {
+		overflow = EventsOverflow::DropOldest;
+	} else if (overflowName == "coalesce") {
+		overflow = EventsOverflow::Coalesce;
+	} else {
+		HttpUtility::SendJsonError(response, params, 400, "Invalid 'overflow' query parameter, must be 'drop_oldest' or 'coalesce'.");
+		return true;
+	}
+
+	std::size_t maxEvents = 10000;
+	double flushDelay = 0;
+
+	{
+		ApiListener::Ptr listener = ApiListener::GetInstance();
+
+		if (listener) {
+			maxEvents = listener->GetEventsQueueSize();
+			flushDelay = listener->GetEventsFlushDelay();
+		}
+	}
+
+	EventsSubscriber subscriber (std::move(eventTypes), HttpUtility::GetLastParameter(params, "filter"), l_ApiQuery, maxEvents, overflow);
 
 	server.StartStreaming();
 
 	response.result(http::status::ok);
 	response.set(http::field::content_type, "application/json");
+	response.set(http::field::vary, "Accept-Encoding");
 
-	IoBoundWorkSlot dontLockTheIoThread (yc);
+	/* Every write is flushed through the deflater, so the client can decompress each event as it arrives. */
+	std::unique_ptr<HttpBodyDeflater> deflater;
+
+	{
+		String encoding = HttpUtility::GetResponseEncoding(request);
+
+		if (!encoding.IsEmpty()) {
+			deflater.reset(new HttpBodyDeflater(encoding));
+			response.set(http::field::content_encoding, encoding.CStr());
+		}
+	}
+
+	IoBoundWorkSlot dontLockTheIoThread (yc, HttpUtility::GetCpuBoundWorkClass(request));
 
 	http::async_write(stream, response, yc);
 	stream.async_flush(yc);
 
-	asio::const_buffer newLine ("\n", 1);
+	asio::deadline_timer flushTimer (server.GetIoStrand().context());
 
 	for (;;) {
-		auto event (subscriber.GetInbox()->Shift(yc));
+		auto events (subscriber.GetInbox()->Shift(yc));
 
-		if (event) {
-			CpuBoundWork buildingResponse (yc);
+		if (events.empty()) {
+			if (server.Disconnected()) {
+				return true;
+			}
 
-			String body = JsonEncode(event);
+			continue;
+		}
 
-			boost::algorithm::replace_all(body, "\n", "");
+		if (flushDelay > 0) {
+			/* Give more events the chance to join this write. */
+			flushTimer.expires_from_now(boost::posix_time::microseconds(static_cast<int64_t>(flushDelay * 1000 * 1000)));
+			flushTimer.async_wait(yc);
+
+			auto moreEvents (subscriber.GetInbox()->Shift(yc, 0));
+
+			events.insert(events.end(), std::make_move_iterator(moreEvents.begin()), std::make_move_iterator(moreEvents.end()));
+		}
 
-			asio::const_buffer payload (body.CStr(), body.GetLength());
+		CpuBoundWork buildingResponse (yc, CpuBoundWorkClass::EventStream);
 
-			buildingResponse.Done();
+		String body;
 
-			asio::async_write(stream, payload, yc);
-			asio::async_write(stream, newLine, yc);
-			stream.async_flush(yc);
-		} else if (server.Disconnected()) {
-			return true;
+		for (auto& event : events) {
+			String line = JsonEncode(event);
+
+			boost::algorithm::replace_all(line, "\n", "");
+
+			body += line;
+			body += "\n";
 		}
+
+		if (deflater)
+			body = deflater->Compress(body, true);
+
+		buildingResponse.Done();
+
+		asio::async_write(stream, asio::const_buffer(body.CStr(), body.GetLength()), yc);
+		stream.async_flush(yc);
 	}
 }
-
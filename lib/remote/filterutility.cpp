@@ -4,6 +4,7 @@
 #include "remote/httputility.hpp"
 #include "config/configcompiler.hpp"
 #include "config/expression.hpp"
+#include "config/vmops.hpp"
 #include "base/namespace.hpp"
 #include "base/json.hpp"
 #include "base/configtype.hpp"
@@ -72,6 +73,21 @@ bool FilterUtility::EvaluateFilter(ScriptFrame& frame, Expression *filter,
 	if (!filter)
 		return true;
 
+	PrepareFilterFrame(frame, target, variableName);
+
+	return Convert::ToBool(filter->Evaluate(frame));
+}
+
+/**
+ * Sets the variables a filter expression sees for a target: "obj", the
+ * variable name and the navigation fields.
+ *
+ * @param frame The script frame.
+ * @param target The target object.
+ * @param variableName The variable name, defaults to the lower case type name.
+ */
+void FilterUtility::PrepareFilterFrame(ScriptFrame& frame, const Object::Ptr& target, const String& variableName)
+{
 	Type::Ptr type = target->GetReflectionType();
 	String varName;
 
@@ -110,16 +126,250 @@ bool FilterUtility::EvaluateFilter(ScriptFrame& frame, Expression *filter,
 		else
 			frameNS->Set(field.Name, joinedObj);
 	}
+}
 
-	return Convert::ToBool(filter->Evaluate(frame));
+/**
+ * Prepares a filter for objects of a type.
+ *
+ * @param filter The filter, may be nullptr.
+ * @param type The type of the targets, nullptr if they aren't config objects.
+ * @param variableName The variable name, defaults to the lower case type name.
+ */
+CompiledFilter::CompiledFilter(Expression *filter, const Type::Ptr& type, const String& variableName)
+	: m_Filter(filter), m_Type(type), m_VariableName(variableName)
+{
+	if (filter)
+		AddOperands(filter);
+}
+
+void CompiledFilter::AddOperands(const Expression *expr)
+{
+	if (dynamic_cast<const LogicalAndExpression *>(expr)) {
+		auto binary (static_cast<const BinaryExpression *>(expr));
+
+		AddOperands(binary->m_Operand1.get());
+		AddOperands(binary->m_Operand2.get());
+		return;
+	}
+
+	Operand operand;
+	operand.Expr = expr;
+	operand.Native = m_Type && CompilePredicate(expr, operand);
+
+	m_Operands.emplace_back(std::move(operand));
+}
+
+/**
+ * Checks whether the expression compares a field path with a literal.
+ */
+bool CompiledFilter::CompilePredicate(const Expression *expr, Operand& operand) const
+{
+	auto binary (dynamic_cast<const BinaryExpression *>(expr));
+
+	if (!binary)
+		return false;
+
+	const Expression *path = binary->m_Operand1.get();
+	const Expression *literal = binary->m_Operand2.get();
+
+	if (dynamic_cast<const EqualExpression *>(expr) || dynamic_cast<const NotEqualExpression *>(expr)) {
+		operand.Operator = dynamic_cast<const EqualExpression *>(expr) ? PredicateEqual : PredicateNotEqual;
+
+		if (dynamic_cast<const LiteralExpression *>(path))
+			std::swap(path, literal);
+	} else if (dynamic_cast<const InExpression *>(expr) || dynamic_cast<const NotInExpression *>(expr)) {
+		operand.Operator = dynamic_cast<const InExpression *>(expr) ? PredicateIn : PredicateNotIn;
+
+		std::swap(path, literal);
+	} else
+		return false;
+
+	auto literalExpr (dynamic_cast<const LiteralExpression *>(literal));
+
+	if (!literalExpr)
+		return false;
+
+	operand.Literal = literalExpr->GetValue();
+
+	return CompilePath(path, operand);
+}
+
+/**
+ * Checks whether the expression is a field path like "host.vars.env" which
+ * starts with the target or one of its navigation fields.
+ */
+bool CompiledFilter::CompilePath(const Expression *expr, Operand& operand) const
+{
+	std::vector<const Expression *> indexers;
+
+	while (dynamic_cast<const IndexerExpression *>(expr)) {
+		indexers.push_back(expr);
+		expr = static_cast<const BinaryExpression *>(expr)->m_Operand1.get();
+	}
+
+	auto variable (dynamic_cast<const VariableExpression *>(expr));
+
+	if (!variable)
+		return false;
+
+	for (auto it (indexers.rbegin()); it != indexers.rend(); ++it) {
+		auto index (dynamic_cast<const LiteralExpression *>(static_cast<const BinaryExpression *>(*it)->m_Operand2.get()));
+
+		if (!index || !index->GetValue().IsString())
+			return false;
+
+		operand.Path.emplace_back(index->GetValue(), &(*it)->GetDebugInfo());
+	}
+
+	/* Same lookup order as the variables set by FilterUtility::PrepareFilterFrame(). */
+	String varName = m_VariableName.IsEmpty() ? m_Type->GetName().ToLower() : m_VariableName;
+	String name = variable->GetVariable();
+
+	operand.NavigationFid = -1;
+	operand.Fid = -1;
+
+	for (int fid = 0; fid < m_Type->GetFieldCount(); fid++) {
+		Field field = m_Type->GetFieldInfo(fid);
+
+		if ((field.Attributes & FANavigation) && name == (field.NavigationName ? field.NavigationName : field.Name))
+			operand.NavigationFid = fid;
+	}
+
+	if (operand.NavigationFid != -1 || operand.Path.empty())
+		return operand.NavigationFid != -1;
+
+	if (name != "obj" && name != varName)
+		return false;
+
+	int fid = m_Type->GetFieldId(operand.Path.front().first);
+
+	if (fid != -1) {
+		/* Leave the error for fields which are hidden in sandbox mode to the interpreter. */
+		if (m_Type->GetFieldInfo(fid).Attributes & FANoUserView)
+			return false;
+
+		operand.Fid = fid;
+	}
+
+	return true;
+}
+
+/**
+ * Evaluates the filter for a target.
+ *
+ * @param frame The script frame for the operands which aren't evaluated natively.
+ * @param target The target object.
+ * @returns Whether the target matches the filter.
+ */
+bool CompiledFilter::Evaluate(ScriptFrame& frame, const Object::Ptr& target) const
+{
+	if (target->GetReflectionType() != m_Type)
+		return FilterUtility::EvaluateFilter(frame, m_Filter, target, m_VariableName);
+
+	bool prepared = false;
+
+	for (auto& operand : m_Operands) {
+		bool result;
+
+		if (!operand.Native || !EvaluatePredicate(operand, target, frame.Sandboxed, result)) {
+			if (!prepared) {
+				FilterUtility::PrepareFilterFrame(frame, target, m_VariableName);
+				prepared = true;
+			}
+
+			result = Convert::ToBool(operand.Expr->Evaluate(frame));
+		}
+
+		if (!result)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Evaluates a predicate without the interpreter.
+ *
+ * @returns false if the interpreter has to evaluate the predicate, e.g. to report an error
+ */
+bool CompiledFilter::EvaluatePredicate(const Operand& operand, const Object::Ptr& target, bool sandboxed, bool& result) const
+{
+	Value value;
+	auto step (operand.Path.begin());
+
+	if (operand.NavigationFid != -1) {
+		value = target->NavigateField(operand.NavigationFid);
+	} else if (operand.Fid != -1) {
+		value = target->GetField(operand.Fid);
+		++step;
+	} else {
+		value = target;
+	}
+
+	for (; step != operand.Path.end(); ++step) {
+		value = VMOps::GetField(value, step->first, sandboxed, *step->second);
+	}
+
+	switch (operand.Operator) {
+		case PredicateEqual:
+			result = value == operand.Literal;
+			return true;
+		case PredicateNotEqual:
+			result = value != operand.Literal;
+			return true;
+		default:
+			break;
+	}
+
+	if (value.IsEmpty()) {
+		result = operand.Operator == PredicateNotIn;
+		return true;
+	}
+
+	if (!value.IsObjectType<Array>())
+		return false;
+
+	Array::Ptr arr = value;
+	result = arr->Contains(operand.Literal) == (operand.Operator == PredicateIn);
+
+	return true;
+}
+
+/**
+ * Finds the name a target must have to match the filter, if it's checked
+ * before any operand which the interpreter has to evaluate.
+ *
+ * @param name The full object name.
+ * @returns true if such a name is known
+ */
+bool CompiledFilter::GetIndexedName(String& name) const
+{
+	for (auto& operand : m_Operands) {
+		if (!operand.Native)
+			return false;
+
+		if (operand.Operator != PredicateEqual || operand.NavigationFid != -1 || operand.Path.size() != 1
+			|| !operand.Literal.IsString() || operand.Literal.IsEmpty())
+			continue;
+
+		const String& field = operand.Path.front().first;
+
+		/* The short name of e.g. services isn't the name they are indexed by. */
+		if (field == "__name" || (field == "name" && !dynamic_cast<NameComposer *>(m_Type.get()))) {
+			name = operand.Literal;
+			return true;
+		}
+	}
+
+	return false;
 }
 
 static void FilteredAddTarget(ScriptFrame& permissionFrame, Expression *permissionFilter,
-	ScriptFrame& frame, Expression *ufilter, std::vector<Value>& result, const String& variableName, const Object::Ptr& target)
+	ScriptFrame& frame, const CompiledFilter& ufilter, std::vector<Value>& result, const String& variableName, const Object::Ptr& target)
 {
 	if (FilterUtility::EvaluateFilter(permissionFrame, permissionFilter, target, variableName)) {
-		if (FilterUtility::EvaluateFilter(frame, ufilter, target, variableName)) {
-			result.emplace_back(std::move(target));
+		if (ufilter.Evaluate(frame, target)) {
+			result.emplace_back(target);
 		}
 	}
 }
@@ -246,9 +496,11 @@ std::vector<Value> FilterUtility::GetFilterTargets(const QueryDescription& qd, c
 		ScriptFrame frame(false, frameNS);
 		frame.Sandboxed = true;
 
+		std::unique_ptr<Expression> ufilter;
+
 		if (query->Contains("filter")) {
 			String filter = HttpUtility::GetLastParameter(query, "filter");
-			std::unique_ptr<Expression> ufilter = ConfigCompiler::CompileText("<API query>", filter);
+			ufilter = ConfigCompiler::CompileText("<API query>", filter);
 
 			Dictionary::Ptr filter_vars = query->Get("filter_vars");
 			if (filter_vars) {
@@ -257,17 +509,29 @@ std::vector<Value> FilterUtility::GetFilterTargets(const QueryDescription& qd, c
 					frameNS->Set(kv.first, kv.second);
 				}
 			}
+		}
+
+		/* Predicates are only evaluated natively for config objects, their fields are known. */
+		Type::Ptr ptype = Type::GetByName(type);
+
+		if (!dynamic_pointer_cast<ConfigObjectTargetProvider>(provider))
+			ptype = nullptr;
+
+		CompiledFilter compiledFilter (ufilter.get(), ptype, variableName);
+
+		auto addTarget ([&permissionFrame, permissionFilter, &frame, &compiledFilter, &result, &variableName](const Value& target) {
+			FilteredAddTarget(permissionFrame, permissionFilter, frame, compiledFilter, result, variableName, target);
+		});
+
+		String name;
+
+		if (ptype && compiledFilter.GetIndexedName(name)) {
+			ConfigObject::Ptr target = ConfigObject::GetObject(type, name);
 
-			provider->FindTargets(type, std::bind(&FilteredAddTarget,
-				std::ref(permissionFrame), permissionFilter,
-				std::ref(frame), &*ufilter, std::ref(result), variableName, _1));
+			if (target)
+				addTarget(target);
 		} else {
-			/* Ensure to pass a nullptr as filter expression.
-			 * GCC 8.1.1 on F28 causes problems, see GH #6533.
-			 */
-			provider->FindTargets(type, std::bind(&FilteredAddTarget,
-				std::ref(permissionFrame), permissionFilter,
-				std::ref(frame), nullptr, std::ref(result), variableName, _1));
+			provider->FindTargets(type, addTarget);
 		}
 	}
 
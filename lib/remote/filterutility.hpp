@@ -42,6 +42,62 @@ struct QueryDescription
 	String Permission;
 };
 
+/**
+ * A filter expression prepared for evaluating it against many objects of one type.
+ *
+ * The operands of the top-level "&&" chain which compare a field path like
+ * "host.vars.env" with a literal are evaluated without the interpreter, the
+ * other ones in a script frame as usual. The operands are evaluated in order,
+ * just like the "&&" operator would do.
+ *
+ * @ingroup remote
+ */
+class CompiledFilter
+{
+public:
+	CompiledFilter(Expression *filter, const Type::Ptr& type, const String& variableName = String());
+
+	bool Evaluate(ScriptFrame& frame, const Object::Ptr& target) const;
+	bool GetIndexedName(String& name) const;
+
+private:
+	enum PredicateOperator
+	{
+		PredicateEqual,
+		PredicateNotEqual,
+		PredicateIn,
+		PredicateNotIn
+	};
+
+	struct Operand
+	{
+		const Expression *Expr;
+
+		/* The operand is a predicate which is evaluated natively. */
+		bool Native;
+		PredicateOperator Operator;
+		Value Literal;
+
+		/* The variable at the beginning of the path is a navigation field
+		 * of the target or, if NavigationFid is -1, the target itself. */
+		int NavigationFid;
+
+		/* The field of the target after the variable, if any and known. */
+		int Fid;
+		std::vector<std::pair<String, const DebugInfo *> > Path;
+	};
+
+	Expression *m_Filter;
+	Type::Ptr m_Type;
+	String m_VariableName;
+	std::vector<Operand> m_Operands;
+
+	void AddOperands(const Expression *expr);
+	bool CompilePredicate(const Expression *expr, Operand& operand) const;
+	bool CompilePath(const Expression *expr, Operand& operand) const;
+	bool EvaluatePredicate(const Operand& operand, const Object::Ptr& target, bool sandboxed, bool& result) const;
+};
+
 /**
  * Filter utilities.
  *
@@ -56,6 +112,7 @@ public:
 		const ApiUser::Ptr& user, const String& variableName = String());
 	static bool EvaluateFilter(ScriptFrame& frame, Expression *filter,
 		const Object::Ptr& target, const String& variableName = String());
+	static void PrepareFilterFrame(ScriptFrame& frame, const Object::Ptr& target, const String& variableName = String());
 };
 
 }
@@ -5,8 +5,13 @@
 #include "remote/httputility.hpp"
 #include "base/singleton.hpp"
 #include "base/exception.hpp"
+#include "base/histogram.hpp"
+#include "base/io-engine.hpp"
 #include <boost/algorithm/string/join.hpp>
 #include <boost/beast/http.hpp>
+#include <chrono>
+#include <utility>
+#include <memory>
 
 using namespace icinga;
 
@@ -46,6 +51,29 @@ void HttpHandler::Register(const Url::Ptr& url, const HttpHandler::Ptr& handler)
 	handlers->Add(handler);
 }
 
+/**
+ * Whether the handler does enough work to need one of the I/O engine's
+ * slots for CPU-bound work. Handlers which only build small responses
+ * from data at hand may return false, so they don't wait for busy ones.
+ *
+ * @returns true if the handler needs a CpuBoundWork slot
+ */
+bool HttpHandler::IsCpuBound() const
+{
+	return true;
+}
+
+/**
+ * Returns the sink for large strings of request bodies, e.g. to spool
+ * uploaded files to disk while decoding instead of keeping them in memory.
+ *
+ * @returns The sink or nullptr
+ */
+const LargeStringSink *HttpHandler::GetRequestBodySink() const
+{
+	return nullptr;
+}
+
 void HttpHandler::ProcessRequest(
 	AsioTlsStream& stream,
 	const ApiUser::Ptr& user,
@@ -55,8 +83,17 @@ void HttpHandler::ProcessRequest(
 	HttpServerConnection& server
 )
 {
+	/* Parsing a request body is CPU-bound, for other requests it depends on the handler. */
+	std::unique_ptr<CpuBoundWork> handlingRequest;
+	auto workClass (HttpUtility::GetCpuBoundWorkClass(request));
+
+	if (!request.body().empty())
+		handlingRequest.reset(new CpuBoundWork(yc, workClass));
+
 	Dictionary::Ptr node = m_UrlTree;
-	std::vector<HttpHandler::Ptr> handlers;
+
+	/* The handlers and the length of the path they were registered for. */
+	std::vector<std::pair<HttpHandler::Ptr, std::vector<String>::size_type>> handlers;
 
 	Url::Ptr url = new Url(request.target().to_string());
 	auto& path (url->GetPath());
@@ -67,7 +104,7 @@ void HttpHandler::ProcessRequest(
 		if (current_handlers) {
 			ObjectLock olock(current_handlers);
 			for (const HttpHandler::Ptr& current_handler : current_handlers) {
-				handlers.push_back(current_handler);
+				handlers.emplace_back(current_handler, i);
 			}
 		}
 
@@ -92,7 +129,11 @@ void HttpHandler::ProcessRequest(
 	Dictionary::Ptr params;
 
 	try {
-		params = HttpUtility::FetchRequestParameters(url, request.body());
+		/* The most specific handler decides how to decode large strings. The body isn't needed
+		 * anymore once decoded, it's freed right away rather than with the request.
+		 */
+		params = HttpUtility::FetchRequestParameters(url, std::move(request.body()),
+			handlers.empty() ? nullptr : handlers.front().first->GetRequestBodySink());
 	} catch (const std::exception& ex) {
 		HttpUtility::SendJsonError(response, params, 400, "Invalid request body: " + DiagnosticInformation(ex, false));
 		return;
@@ -107,8 +148,17 @@ void HttpHandler::ProcessRequest(
 	 * do exist.
 	 */
 	try {
-		for (const HttpHandler::Ptr& handler : handlers) {
-			if (handler->HandleRequest(stream, user, request, url, response, params, yc, server)) {
+		for (auto& handler : handlers) {
+			if (!handlingRequest && handler.first->IsCpuBound())
+				handlingRequest.reset(new CpuBoundWork(yc, workClass));
+
+			auto start (std::chrono::steady_clock::now());
+
+			if (handler.first->HandleRequest(stream, user, request, url, response, params, yc, server)) {
+				/* Keyed by the URL the handler was registered for rather than the requested one, e.g. /v1/objects. */
+				Histogram::GetByName("http_/" + boost::algorithm::join(std::vector<String>(path.begin(), path.begin() + handler.second), "/"))
+					.RecordSince(start);
+
 				processed = true;
 				break;
 			}
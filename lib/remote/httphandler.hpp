@@ -7,6 +7,7 @@
 #include "remote/url.hpp"
 #include "remote/httpserverconnection.hpp"
 #include "remote/apiuser.hpp"
+#include "base/largestringsink.hpp"
 #include "base/registry.hpp"
 #include "base/tlsstream.hpp"
 #include <vector>
@@ -37,6 +38,9 @@ public:
 		HttpServerConnection& server
 	) = 0;
 
+	virtual bool IsCpuBound() const;
+	virtual const LargeStringSink *GetRequestBodySink() const;
+
 	static void Register(const Url::Ptr& url, const HttpHandler::Ptr& handler);
 	static void ProcessRequest(
 		AsioTlsStream& stream,
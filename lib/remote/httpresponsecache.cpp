@@ -0,0 +1,113 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/httpresponsecache.hpp"
+#include "remote/apilistener.hpp"
+#include "base/utility.hpp"
+
+using namespace icinga;
+
+std::mutex HttpResponseCache::m_Mutex;
+std::map<String, HttpResponseCache::Entry> HttpResponseCache::m_Entries;
+
+/* Limits the memory used by clients which query many different URLs. */
+static const size_t l_MaxEntries = 1024;
+
+/**
+ * Builds the cache key for a request. Parameters may be passed in the URL
+ * as well as in the body, so both are part of the key.
+ *
+ * @param user The authenticated API user.
+ * @param request The request.
+ * @returns The cache key.
+ */
+String HttpResponseCache::GetKey(const ApiUser::Ptr& user, const boost::beast::http::request<boost::beast::http::string_body>& request)
+{
+	String key = user ? user->GetName() : String();
+
+	key += "\n";
+	key += String(request.target().to_string());
+	key += "\n";
+	key += String(request.body());
+
+	return key;
+}
+
+/**
+ * Fills in a response from the cache.
+ *
+ * @param key The cache key, see GetKey().
+ * @param response The response to fill in.
+ * @returns true if a cached response was found
+ */
+bool HttpResponseCache::Get(const String& key, boost::beast::http::response<boost::beast::http::string_body>& response)
+{
+	namespace http = boost::beast::http;
+
+	if (GetTtl() <= 0)
+		return false;
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	auto it (m_Entries.find(key));
+
+	if (it == m_Entries.end())
+		return false;
+
+	if (it->second.Expires < Utility::GetTime()) {
+		m_Entries.erase(it);
+		return false;
+	}
+
+	response.result(it->second.Status);
+	response.set(http::field::content_type, it->second.ContentType);
+	response.body() = it->second.Body;
+	response.content_length(response.body().size());
+
+	return true;
+}
+
+/**
+ * Caches a response if it's successful.
+ *
+ * @param key The cache key, see GetKey().
+ * @param response The response.
+ */
+void HttpResponseCache::Set(const String& key, const boost::beast::http::response<boost::beast::http::string_body>& response)
+{
+	namespace http = boost::beast::http;
+
+	double ttl = GetTtl();
+
+	if (ttl <= 0 || response.result() != http::status::ok)
+		return;
+
+	double now = Utility::GetTime();
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	if (m_Entries.size() >= l_MaxEntries) {
+		for (auto it (m_Entries.begin()); it != m_Entries.end();) {
+			if (it->second.Expires < now)
+				it = m_Entries.erase(it);
+			else
+				++it;
+		}
+
+		if (m_Entries.size() >= l_MaxEntries)
+			return;
+	}
+
+	auto& entry (m_Entries[key]);
+
+	entry.Expires = now + ttl;
+	entry.Status = response.result_int();
+	entry.ContentType = response[http::field::content_type].to_string();
+	entry.Body = response.body();
+}
+
+double HttpResponseCache::GetTtl()
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	return listener ? listener->GetResponseCacheTtl() : 0;
+}
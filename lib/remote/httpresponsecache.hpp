@@ -0,0 +1,49 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef HTTPRESPONSECACHE_H
+#define HTTPRESPONSECACHE_H
+
+#include "remote/i2-remote.hpp"
+#include "remote/apiuser.hpp"
+#include "base/string.hpp"
+#include <map>
+#include <mutex>
+#include <string>
+#include <boost/beast/http.hpp>
+
+namespace icinga
+{
+
+/**
+ * Short-lived cache for the responses of expensive read-only API endpoints
+ * such as /v1/status. Responses are cached per user and request, so the
+ * permissions of the user are taken into account.
+ *
+ * @ingroup remote
+ */
+class HttpResponseCache
+{
+public:
+	static String GetKey(const ApiUser::Ptr& user, const boost::beast::http::request<boost::beast::http::string_body>& request);
+
+	static bool Get(const String& key, boost::beast::http::response<boost::beast::http::string_body>& response);
+	static void Set(const String& key, const boost::beast::http::response<boost::beast::http::string_body>& response);
+
+private:
+	struct Entry
+	{
+		double Expires;
+		unsigned Status;
+		std::string ContentType;
+		std::string Body;
+	};
+
+	static std::mutex m_Mutex;
+	static std::map<String, Entry> m_Entries;
+
+	static double GetTtl();
+};
+
+}
+
+#endif /* HTTPRESPONSECACHE_H */
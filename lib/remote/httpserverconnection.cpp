@@ -35,12 +35,12 @@ using namespace icinga;
 auto const l_ServerHeader ("Icinga/" + Application::GetAppVersion());
 
 HttpServerConnection::HttpServerConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream)
-	: HttpServerConnection(identity, authenticated, stream, IoEngine::Get().GetIoContext())
+	: HttpServerConnection(identity, authenticated, stream, stream->GetIoContext())
 {
 }
 
 HttpServerConnection::HttpServerConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream, boost::asio::io_context& io)
-	: m_Stream(stream), m_Seen(Utility::GetTime()), m_IoStrand(io), m_ShuttingDown(false), m_HasStartedStreaming(false),
+	: m_Stream(stream), m_Seen(Utility::GetTime()), m_IoStrand(io), m_ShuttingDown(false), m_HasStartedStreaming(false), m_HasSentResponse(false),
 	m_CheckLivenessTimer(io)
 {
 	if (authenticated) {
@@ -64,7 +64,8 @@ void HttpServerConnection::Start()
 	HttpServerConnection::Ptr keepAlive (this);
 
 	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { ProcessMessages(yc); });
-	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { CheckLiveness(yc); });
+	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { CheckLiveness(yc); },
+		IoEngine::GetSmallCoroutineStackSize());
 }
 
 void HttpServerConnection::Disconnect()
@@ -101,7 +102,7 @@ void HttpServerConnection::Disconnect()
 			auto listener (ApiListener::GetInstance());
 
 			if (listener) {
-				CpuBoundWork removeHttpClient (yc);
+				CpuBoundWork removeHttpClient (yc, CpuBoundWorkClass::ApiRead);
 
 				listener->RemoveHttpClient(this);
 			}
@@ -129,7 +130,26 @@ void HttpServerConnection::StartStreaming()
 
 			Disconnect();
 		}
-	});
+	}, IoEngine::GetSmallCoroutineStackSize());
+}
+
+/**
+ * Tells the connection that the current request's handler has written the
+ * whole response on its own, e.g. in chunks. Unlike streaming, the
+ * connection may be used for further requests afterwards.
+ */
+void HttpServerConnection::MarkResponseSent()
+{
+	m_HasSentResponse = true;
+}
+
+/**
+ * Returns the strand the connection's coroutines run on, e.g. to wake up a
+ * request handler which waits for work done in other threads.
+ */
+boost::asio::io_context::strand& HttpServerConnection::GetIoStrand()
+{
+	return m_IoStrand;
 }
 
 bool HttpServerConnection::Disconnected()
@@ -239,7 +259,7 @@ bool HandleAccessControl(
 		auto headerAllowOrigin (listener->GetAccessControlAllowOrigin());
 
 		if (headerAllowOrigin) {
-			CpuBoundWork allowOriginHeader (yc);
+			CpuBoundWork allowOriginHeader (yc, HttpUtility::GetCpuBoundWorkClass(request));
 
 			auto allowedOrigins (headerAllowOrigin->ToSet<String>());
 
@@ -363,7 +383,7 @@ bool EnsureValidBody(
 		Array::Ptr permissions = authenticatedUser->GetPermissions();
 
 		if (permissions) {
-			CpuBoundWork evalPermissions (yc);
+			CpuBoundWork evalPermissions (yc, HttpUtility::GetCpuBoundWorkClass(parser.get()));
 
 			ObjectLock olock(permissions);
 
@@ -445,17 +465,18 @@ bool ProcessRequest(
 	boost::beast::http::response<boost::beast::http::string_body>& response,
 	HttpServerConnection& server,
 	bool& hasStartedStreaming,
+	bool& hasSentResponse,
+	bool flush,
 	boost::asio::yield_context& yc
 )
 {
 	namespace http = boost::beast::http;
 
 	try {
-		CpuBoundWork handlingRequest (yc);
-
 		HttpHandler::ProcessRequest(stream, authenticatedUser, request, response, yc, server);
 	} catch (const std::exception& ex) {
-		if (hasStartedStreaming) {
+		/* The response has been sent in part already, the client can't be told what went wrong. */
+		if (hasStartedStreaming || hasSentResponse) {
 			return false;
 		}
 
@@ -481,14 +502,41 @@ bool ProcessRequest(
 		return false;
 	}
 
+	if (hasSentResponse) {
+		return true;
+	}
+
+	if (response.body().size() >= HttpUtility::MinCompressedBodyLength) {
+		CpuBoundWork compressingResponse (yc, HttpUtility::GetCpuBoundWorkClass(request));
+
+		HttpUtility::CompressBody(response, HttpUtility::GetResponseEncoding(request));
+	}
+
 	boost::system::error_code ec;
 
 	http::async_write(stream, response, yc[ec]);
-	stream.async_flush(yc[ec]);
+
+	if (flush) {
+		stream.async_flush(yc[ec]);
+	}
 
 	return true;
 }
 
+/**
+ * Checks whether the client has already sent the header of another request.
+ *
+ * @param buf The data read but not parsed yet.
+ * @returns true if a complete request header is buffered
+ */
+static inline
+bool HasPipelinedRequest(const boost::beast::flat_buffer& buf)
+{
+	auto data (buf.data());
+
+	return boost::string_view(static_cast<const char *>(data.data()), data.size()).find("\r\n\r\n") != boost::string_view::npos;
+}
+
 void HttpServerConnection::ProcessMessages(boost::asio::yield_context yc)
 {
 	namespace beast = boost::beast;
@@ -534,7 +582,7 @@ void HttpServerConnection::ProcessMessages(boost::asio::yield_context yc)
 			auto authenticatedUser (m_ApiUser);
 
 			if (!authenticatedUser) {
-				CpuBoundWork fetchingAuthenticatedUser (yc);
+				CpuBoundWork fetchingAuthenticatedUser (yc, HttpUtility::GetCpuBoundWorkClass(request));
 
 				authenticatedUser = ApiUser::GetByAuthHeader(request[http::field::authorization].to_string());
 			}
@@ -567,12 +615,18 @@ void HttpServerConnection::ProcessMessages(boost::asio::yield_context yc)
 			}
 
 			m_Seen = std::numeric_limits<decltype(m_Seen)>::max();
+			m_HasSentResponse = false;
+
+			bool keepAlive = request.version() == 11 && request[http::field::connection] != "close";
+
+			/* Responses to pipelined requests leave together, once the client waits for them. */
+			bool flush = !keepAlive || !HasPipelinedRequest(buf);
 
-			if (!ProcessRequest(*m_Stream, request, authenticatedUser, response, *this, m_HasStartedStreaming, yc)) {
+			if (!ProcessRequest(*m_Stream, request, authenticatedUser, response, *this, m_HasStartedStreaming, m_HasSentResponse, flush, yc)) {
 				break;
 			}
 
-			if (request.version() != 11 || request[http::field::connection] == "close") {
+			if (!keepAlive) {
 				break;
 			}
 		}
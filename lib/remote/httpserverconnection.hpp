@@ -30,8 +30,10 @@ public:
 	void Start();
 	void Disconnect();
 	void StartStreaming();
+	void MarkResponseSent();
 
 	bool Disconnected();
+	boost::asio::io_context::strand& GetIoStrand();
 
 private:
 	ApiUser::Ptr m_ApiUser;
@@ -41,6 +43,7 @@ private:
 	boost::asio::io_context::strand m_IoStrand;
 	bool m_ShuttingDown;
 	bool m_HasStartedStreaming;
+	bool m_HasSentResponse;
 	boost::asio::deadline_timer m_CheckLivenessTimer;
 
 	HttpServerConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream, boost::asio::io_context& io);
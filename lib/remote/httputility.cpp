@@ -2,16 +2,27 @@
 
 #include "remote/httputility.hpp"
 #include "remote/url.hpp"
+#include "remote/messagecompression.hpp"
 #include "base/json.hpp"
 #include "base/logger.hpp"
+#include <cstdlib>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 #include <boost/beast/http.hpp>
 
 using namespace icinga;
 
-Dictionary::Ptr HttpUtility::FetchRequestParameters(const Url::Ptr& url, const std::string& body)
+/**
+ * Decodes the request body and adds the URL's query parameters.
+ *
+ * @param url The URL
+ * @param body The body, consumed so it doesn't stay in memory along with the decoded parameters
+ * @param sink Replaces large strings, see LargeStringSink
+ * @returns The parameters
+ */
+Dictionary::Ptr HttpUtility::FetchRequestParameters(const Url::Ptr& url, std::string&& body, const LargeStringSink *sink)
 {
 	Dictionary::Ptr result;
 
@@ -19,7 +30,7 @@ Dictionary::Ptr HttpUtility::FetchRequestParameters(const Url::Ptr& url, const s
 		Log(LogDebug, "HttpUtility")
 			<< "Request body: '" << body << '\'';
 
-		result = JsonDecode(body);
+		result = JsonDecode(String(std::move(body)), sink);
 	}
 
 	if (!result)
@@ -52,6 +63,90 @@ Value HttpUtility::GetLastParameter(const Dictionary::Ptr& params, const String&
 		return arr->Get(arr->GetLength() - 1);
 }
 
+/**
+ * Returns the class of the CPU-bound work done for a request.
+ * GET requests (also overridden ones) only read, all others may write.
+ *
+ * @param request The request.
+ * @returns The class for CpuBoundWork and IoBoundWorkSlot.
+ */
+CpuBoundWorkClass HttpUtility::GetCpuBoundWorkClass(const boost::beast::http::request<boost::beast::http::string_body>& request)
+{
+	return request.method() == boost::beast::http::verb::get ? CpuBoundWorkClass::ApiRead : CpuBoundWorkClass::ApiWrite;
+}
+
+/**
+ * Negotiates the content coding of the response body via "Accept-Encoding".
+ * gzip is preferred over deflate if the client accepts both equally.
+ *
+ * @param request The request.
+ * @returns "gzip", "deflate" or an empty string for an uncompressed body.
+ */
+String HttpUtility::GetResponseEncoding(const boost::beast::http::request<boost::beast::http::string_body>& request)
+{
+	String header (request[boost::beast::http::field::accept_encoding]);
+
+	if (header.IsEmpty())
+		return String();
+
+	String result;
+	double resultQuality = 0;
+
+	for (auto& coding : header.Split(",")) {
+		auto params (coding.Split(";"));
+		String name = params[0].Trim().ToLower();
+		double quality = 1;
+
+		for (decltype(params.size()) i = 1; i < params.size(); i++) {
+			String param = params[i].Trim();
+
+			if (param.SubStr(0, 2) == "q=")
+				quality = std::strtod(param.CStr() + 2, nullptr);
+		}
+
+		if (name == "*")
+			name = "gzip";
+
+		if (!HttpBodyDeflater::IsSupportedEncoding(name) || quality <= 0)
+			continue;
+
+		if (quality > resultQuality || (quality == resultQuality && name == "gzip")) {
+			result = std::move(name);
+			resultQuality = quality;
+		}
+	}
+
+	return result;
+}
+
+/**
+ * Compresses the complete body of a response if it's large enough.
+ *
+ * @param response The response, its body must not change anymore.
+ * @param encoding The content coding as returned by GetResponseEncoding().
+ */
+void HttpUtility::CompressBody(boost::beast::http::response<boost::beast::http::string_body>& response, const String& encoding)
+{
+	namespace http = boost::beast::http;
+
+	if (response.body().size() < MinCompressedBodyLength || response.count(http::field::content_encoding))
+		return;
+
+	response.set(http::field::vary, "Accept-Encoding");
+
+	if (encoding.IsEmpty())
+		return;
+
+	HttpBodyDeflater deflater (encoding);
+	String body = deflater.Compress(String(std::move(response.body())));
+
+	body += deflater.Finish();
+
+	response.body() = std::move(body.GetData());
+	response.set(http::field::content_encoding, encoding.CStr());
+	response.content_length(response.body().size());
+}
+
 void HttpUtility::SendJsonBody(boost::beast::http::response<boost::beast::http::string_body>& response, const Dictionary::Ptr& params, const Value& val)
 {
 	namespace http = boost::beast::http;
@@ -5,6 +5,8 @@
 
 #include "remote/url.hpp"
 #include "base/dictionary.hpp"
+#include "base/io-engine.hpp"
+#include "base/largestringsink.hpp"
 #include <boost/beast/http.hpp>
 #include <string>
 
@@ -20,8 +22,15 @@ class HttpUtility
 {
 
 public:
-	static Dictionary::Ptr FetchRequestParameters(const Url::Ptr& url, const std::string& body);
+	static Dictionary::Ptr FetchRequestParameters(const Url::Ptr& url, std::string&& body, const LargeStringSink *sink = nullptr);
 	static Value GetLastParameter(const Dictionary::Ptr& params, const String& key);
+	static CpuBoundWorkClass GetCpuBoundWorkClass(const boost::beast::http::request<boost::beast::http::string_body>& request);
+
+	/* Compressing smaller bodies costs more CPU time than it saves transfer time. */
+	static const size_t MinCompressedBodyLength = 1024;
+
+	static String GetResponseEncoding(const boost::beast::http::request<boost::beast::http::string_body>& request);
+	static void CompressBody(boost::beast::http::response<boost::beast::http::string_body>& response, const String& encoding);
 
 	static void SendJsonBody(boost::beast::http::response<boost::beast::http::string_body>& response, const Dictionary::Ptr& params, const Value& val);
 	static void SendJsonError(boost::beast::http::response<boost::beast::http::string_body>& response, const Dictionary::Ptr& params, const int code,
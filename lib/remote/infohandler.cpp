@@ -8,6 +8,11 @@ using namespace icinga;
 
 REGISTER_URLHANDLER("/", InfoHandler);
 
+bool InfoHandler::IsCpuBound() const
+{
+	return false;
+}
+
 bool InfoHandler::HandleRequest(
 	AsioTlsStream& stream,
 	const ApiUser::Ptr& user,
@@ -23,6 +23,8 @@ public:
 		boost::asio::yield_context& yc,
 		HttpServerConnection& server
 	) override;
+
+	bool IsCpuBound() const override;
 };
 
 }
@@ -3,6 +3,7 @@
 #include "remote/jsonrpc.hpp"
 #include "base/netstring.hpp"
 #include "base/json.hpp"
+#include "base/object-packer.hpp"
 #include "base/console.hpp"
 #include "base/scriptglobal.hpp"
 #include "base/convert.hpp"
@@ -95,6 +96,32 @@ size_t JsonRpc::SendRawMessage(const Shared<AsioTlsStream>::Ptr& stream, const S
 	return NetString::WriteStringToStream(stream, json, yc);
 }
 
+/**
+ * Appends a raw message in the netstring format to a buffer
+ * which is sent to the connected peer later on.
+ *
+ * @param buffer Send buffer
+ * @param json message
+ *
+ * @return bytes appended
+ */
+size_t JsonRpc::AppendRawMessage(std::string& buffer, const String& json)
+{
+#ifdef I2_DEBUG
+	if (GetDebugJsonRpcCached())
+		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << ">> " << json << ConsoleColorTag(Console_Normal) << "\n";
+#endif /* I2_DEBUG */
+
+	size_t oldSize = buffer.size();
+
+	buffer += std::to_string(json.GetLength());
+	buffer += ':';
+	buffer += json.GetData();
+	buffer += ',';
+
+	return buffer.size() - oldSize;
+}
+
 /**
  * Reads a message from the connected peer.
  *
@@ -141,12 +168,19 @@ String JsonRpc::ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, boost::asi
  * Decode message, enforce a Dictionary
  *
  * @param message JSON string
+ * @param sink Replaces large strings, see LargeStringSink
  *
  * @return Dictionary ptr
  */
-Dictionary::Ptr JsonRpc::DecodeMessage(const String& message)
+Dictionary::Ptr JsonRpc::DecodeMessage(const String& message, const LargeStringSink *sink)
 {
-	Value value = JsonDecode(message);
+	Value value;
+
+	/* Peers with the BinaryMessages capability send packed dictionaries (see PackMessage()). */
+	if (!message.IsEmpty() && message[0] == '\6')
+		value = UnpackObject(message, sink);
+	else
+		value = JsonDecode(message, sink);
 
 	if (!value.IsObjectType<Dictionary>()) {
 		BOOST_THROW_EXCEPTION(std::invalid_argument("JSON-RPC"
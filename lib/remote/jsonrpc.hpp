@@ -6,8 +6,10 @@
 #include "base/stream.hpp"
 #include "base/dictionary.hpp"
 #include "base/tlsstream.hpp"
+#include "base/largestringsink.hpp"
 #include "remote/i2-remote.hpp"
 #include <memory>
+#include <string>
 #include <boost/asio/spawn.hpp>
 
 namespace icinga
@@ -24,11 +26,12 @@ public:
 	static size_t SendMessage(const Shared<AsioTlsStream>::Ptr& stream, const Dictionary::Ptr& message);
 	static size_t SendMessage(const Shared<AsioTlsStream>::Ptr& stream, const Dictionary::Ptr& message, boost::asio::yield_context yc);
 	static size_t SendRawMessage(const Shared<AsioTlsStream>::Ptr& stream, const String& json, boost::asio::yield_context yc);
+	static size_t AppendRawMessage(std::string& buffer, const String& json);
 
 	static String ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, ssize_t maxMessageLength = -1);
 	static String ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, boost::asio::yield_context yc, ssize_t maxMessageLength = -1);
 
-	static Dictionary::Ptr DecodeMessage(const String& message);
+	static Dictionary::Ptr DecodeMessage(const String& message, const LargeStringSink *sink = nullptr);
 
 private:
 	JsonRpc();
@@ -6,33 +6,132 @@
 #include "base/initialize.hpp"
 #include "base/configtype.hpp"
 #include "base/logger.hpp"
+#include "base/timingwheel.hpp"
 #include "base/utility.hpp"
-#include <boost/asio/spawn.hpp>
-#include <boost/date_time/posix_time/posix_time_duration.hpp>
-#include <boost/system/system_error.hpp>
+#include <boost/thread/once.hpp>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 using namespace icinga;
 
 REGISTER_APIFUNCTION(Heartbeat, event, &JsonRpcConnection::HeartbeatAPIHandler);
 
+/* Every connection is looked at this often, anonymous ones are closed on their first visit. */
+static const double l_SupervisionInterval = 10;
+
+/* All connections share one timer instead of two per connection. */
+static std::mutex l_SupervisorMutex;
+static TimingWheel<JsonRpcConnection*> l_SupervisorWheel (Utility::GetTime(), 1);
+static std::unordered_map<JsonRpcConnection*, JsonRpcConnection::Ptr> l_SupervisedConnections;
+static Timer::Ptr l_SupervisorTimer;
+
+void JsonRpcConnection::StartSupervision()
+{
+	static boost::once_flag once = BOOST_ONCE_INIT;
+
+	boost::call_once(once, []() {
+		l_SupervisorTimer = new Timer();
+		l_SupervisorTimer->SetInterval(1);
+		l_SupervisorTimer->OnTimerExpired.connect([](const Timer * const&) { SuperviseConnections(); });
+		l_SupervisorTimer->Start();
+	});
+
+	std::unique_lock<std::mutex> lock (l_SupervisorMutex);
+
+	l_SupervisedConnections.emplace(this, this);
+	l_SupervisorWheel.Insert(this, Utility::GetTime() + l_SupervisionInterval);
+}
+
+void JsonRpcConnection::StopSupervision()
+{
+	Ptr keepAlive;
+
+	{
+		std::unique_lock<std::mutex> lock (l_SupervisorMutex);
+		auto it (l_SupervisedConnections.find(this));
+
+		if (it == l_SupervisedConnections.end())
+			return;
+
+		/* Not destroyed while holding the lock. */
+		keepAlive = std::move(it->second);
+
+		l_SupervisedConnections.erase(it);
+		l_SupervisorWheel.Erase(this);
+	}
+}
+
 /**
- * We still send a heartbeat without timeout here
- * to keep the m_Seen variable up to date. This is to keep the
- * cluster connection alive when there isn't much going on.
+ * Hands the connections which are due to their strands in one batch.
  */
-
-void JsonRpcConnection::HandleAndWriteHeartbeats(boost::asio::yield_context yc)
+void JsonRpcConnection::SuperviseConnections()
 {
-	boost::system::error_code ec;
+	std::vector<JsonRpcConnection*> expired;
+	std::vector<Ptr> due;
+
+	{
+		std::unique_lock<std::mutex> lock (l_SupervisorMutex);
+		double now = Utility::GetTime();
+
+		l_SupervisorWheel.Advance(now, expired);
 
-	for (;;) {
-		m_HeartbeatTimer.expires_from_now(boost::posix_time::seconds(20));
-		m_HeartbeatTimer.async_wait(yc[ec]);
+		for (auto connection : expired) {
+			auto it (l_SupervisedConnections.find(connection));
 
-		if (m_ShuttingDown) {
-			break;
+			if (it == l_SupervisedConnections.end())
+				continue;
+
+			due.emplace_back(it->second);
+			l_SupervisorWheel.Insert(connection, now + l_SupervisionInterval);
 		}
-		
+	}
+
+	for (auto& connection : due)
+		connection->m_IoStrand.post([connection]() { connection->Supervise(); });
+}
+
+/**
+ * Closes dead and anonymous connections. We still send a heartbeat without
+ * timeout to keep the peer's m_Seen variable up to date. This is to keep the
+ * cluster connection alive when there isn't much going on.
+ */
+void JsonRpcConnection::Supervise()
+{
+	if (m_ShuttingDown)
+		return;
+
+	if (!m_Authenticated) {
+		/* Anonymous connections are normally only used for requesting a certificate and are closed after this request
+		 * is received. However, the request is only sent if the child has successfully verified the certificate of its
+		 * parent so that it is an authenticated connection from its perspective. In case this verification fails, both
+		 * ends view it as an anonymous connection and never actually use it but attempt a reconnect after 10 seconds
+		 * leaking the connection. Therefore close it after a timeout.
+		 */
+		boost::system::error_code ec;
+		auto remote (m_Stream->lowest_layer().remote_endpoint(ec));
+
+		Log(LogInformation, "JsonRpcConnection")
+			<< "Closing anonymous connection [" << remote.address() << "]:" << remote.port() << " after 10 seconds.";
+
+		Disconnect();
+		return;
+	}
+
+	double now = Utility::GetTime();
+
+	if (m_Seen < now - 60 && (!m_Endpoint || !m_Endpoint->GetSyncing())) {
+		Log(LogInformation, "JsonRpcConnection")
+			<<  "No messages for identity '" << m_Identity << "' have been received in the last 60 seconds.";
+
+		Disconnect();
+		return;
+	}
+
+	/* Only idle connections need heartbeats, see WriteOutgoingMessages(). */
+	if (m_NextHeartbeat <= now) {
+		m_NextHeartbeat = now + 20;
+
 		SendMessageInternal(new Dictionary({
 			{ "jsonrpc", "2.0" },
 			{ "method", "event::Heartbeat" },
@@ -45,4 +144,3 @@ Value JsonRpcConnection::HeartbeatAPIHandler(const MessageOrigin::Ptr& origin, c
 {
 	return Empty;
 }
-
@@ -8,16 +8,21 @@
 #include "base/configtype.hpp"
 #include "base/io-engine.hpp"
 #include "base/json.hpp"
+#include "base/object-packer.hpp"
 #include "base/objectlock.hpp"
 #include "base/utility.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
+#include "base/histogram.hpp"
+#include "base/tracing.hpp"
 #include "base/convert.hpp"
 #include "base/tlsstream.hpp"
 #include <memory>
 #include <utility>
+#include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/spawn.hpp>
+#include <boost/asio/write.hpp>
 #include <boost/date_time/posix_time/posix_time_duration.hpp>
 #include <boost/system/system_error.hpp>
 #include <boost/thread/once.hpp>
@@ -28,10 +33,18 @@ static Value SetLogPositionHandler(const MessageOrigin::Ptr& origin, const Dicti
 REGISTER_APIFUNCTION(SetLogPosition, log, &SetLogPositionHandler);
 
 static RingBuffer l_TaskStats (15 * 60);
+static RingBuffer l_WriteBatchStats (15 * 60);
+static RingBuffer l_WriteBatchMessageStats (15 * 60);
+
+/* Queued messages of all connections by priority. */
+static std::atomic<size_t> l_OutgoingQueueItems[(size_t)MessagePriority::Count];
+
+/* The bytes each priority but Control may write per round, see DequeueMessages(). */
+static const size_t l_PriorityQuantums[(size_t)MessagePriority::Count] = { 0, 64 * 1024, 32 * 1024, 16 * 1024 };
 
 JsonRpcConnection::JsonRpcConnection(const String& identity, bool authenticated,
 	const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role)
-	: JsonRpcConnection(identity, authenticated, stream, role, IoEngine::Get().GetIoContext())
+	: JsonRpcConnection(identity, authenticated, stream, role, stream->GetIoContext())
 {
 }
 
@@ -39,13 +52,22 @@ JsonRpcConnection::JsonRpcConnection(const String& identity, bool authenticated,
 	const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role, boost::asio::io_context& io)
 	: m_Identity(identity), m_Authenticated(authenticated), m_Stream(stream), m_Role(role),
 	m_Timestamp(Utility::GetTime()), m_Seen(Utility::GetTime()), m_NextHeartbeat(0), m_IoStrand(io),
-	m_OutgoingMessagesQueued(io), m_WriterDone(io), m_ShuttingDown(false),
-	m_CheckLivenessTimer(io), m_HeartbeatTimer(io)
+	m_OutgoingMessagesQueued(io), m_WriterDone(io), m_ShuttingDown(false), m_CompressionEnabled(false), m_BinaryMessagesEnabled(false),
+	m_CheckResultDeltasEnabled(false)
 {
+	m_OutgoingMessagesDeficits.fill(0);
+
 	if (authenticated)
 		m_Endpoint = Endpoint::GetByName(identity);
 }
 
+JsonRpcConnection::~JsonRpcConnection()
+{
+	/* Messages which haven't been sent anymore. */
+	for (size_t i = 0; i < m_OutgoingMessagesQueues.size(); i++)
+		l_OutgoingQueueItems[i].fetch_sub(m_OutgoingMessagesQueues[i].size());
+}
+
 void JsonRpcConnection::Start()
 {
 	namespace asio = boost::asio;
@@ -54,8 +76,8 @@ void JsonRpcConnection::Start()
 
 	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { HandleIncomingMessages(yc); });
 	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { WriteOutgoingMessages(yc); });
-	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { HandleAndWriteHeartbeats(yc); });
-	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { CheckLiveness(yc); });
+
+	StartSupervision();
 }
 
 void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
@@ -80,7 +102,15 @@ void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 		m_Seen = Utility::GetTime();
 
 		try {
-			CpuBoundWork handleMessage (yc);
+			CpuBoundWork handleMessage (yc, CpuBoundWorkClass::Cluster);
+
+			/* Only peers which know about our capabilities send compressed messages. */
+			if (MessageInflater::IsCompressed(message)) {
+				if (!m_Inflater)
+					m_Inflater.reset(new MessageInflater());
+
+				message = m_Inflater->Decompress(message, m_Endpoint ? -1 : 1024 * 1024);
+			}
 
 			MessageHandler(message);
 		} catch (const std::exception& ex) {
@@ -93,7 +123,7 @@ void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 			break;
 		}
 
-		CpuBoundWork taskStats (yc);
+		CpuBoundWork taskStats (yc, CpuBoundWorkClass::Cluster);
 
 		l_TaskStats.InsertValue(Utility::GetTime(), 1);
 	}
@@ -103,38 +133,100 @@ void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 
 void JsonRpcConnection::WriteOutgoingMessages(boost::asio::yield_context yc)
 {
+	namespace asio = boost::asio;
+
 	Defer signalWriterDone ([this]() { m_WriterDone.Set(); });
 
+	size_t batchSize = 64 * 1024;
+	double batchDelay = 0;
+
+	{
+		ApiListener::Ptr listener = ApiListener::GetInstance();
+
+		if (listener) {
+			batchSize = listener->GetWriteBatchSize();
+			batchDelay = listener->GetWriteBatchDelay();
+		}
+	}
+
+	asio::deadline_timer batchTimer (m_IoStrand.context());
+	std::string batch;
+	std::vector<Shared<String>::Ptr> queue;
+
 	do {
 		m_OutgoingMessagesQueued.Wait(yc);
 
-		auto queue (std::move(m_OutgoingMessagesQueue));
+		if (batchDelay > 0 && !m_ShuttingDown) {
+			/* Give more messages the chance to join this batch. */
+			batchTimer.expires_from_now(boost::posix_time::microseconds(static_cast<int64_t>(batchDelay * 1000 * 1000)));
+			batchTimer.async_wait(yc);
+		}
 
-		m_OutgoingMessagesQueue.clear();
 		m_OutgoingMessagesQueued.Clear();
 
-		if (!queue.empty()) {
-			try {
+		if (!DequeueMessages(batchSize, queue))
+			continue;
+
+		try {
+			/* Messages which have been written to the buffered stream directly (e.g. icinga::Hello)
+			 * have to go first. The batches bypass the stream's small buffer so that each TLS record
+			 * carries as many messages as possible. */
+			m_Stream->async_flush(yc);
+
+			auto& tlsStream (m_Stream->next_layer());
+			int batches = 0;
+			int messages = 0;
+
+			bool compress = m_CompressionEnabled.load();
+
+			if (compress && !m_Deflater)
+				m_Deflater.reset(new MessageDeflater());
+
+			/* The queues are looked at again after each batch, so messages queued
+			 * meanwhile with a higher priority don't wait for a whole backlog. */
+			do {
 				for (auto& message : queue) {
-					size_t bytesSent = JsonRpc::SendRawMessage(m_Stream, message, yc);
+					size_t bytesSent;
+
+					if (compress && message->GetLength() >= MessageDeflater::MinMessageLength)
+						bytesSent = JsonRpc::AppendRawMessage(batch, m_Deflater->Compress(*message));
+					else
+						bytesSent = JsonRpc::AppendRawMessage(batch, *message);
+					messages++;
 
 					if (m_Endpoint) {
 						m_Endpoint->AddMessageSent(bytesSent);
 					}
 				}
 
-				m_Stream->async_flush(yc);
-			} catch (const std::exception& ex) {
-				if (!m_ShuttingDown) {
-					std::ostringstream info;
-					info << "Error while sending JSON-RPC message for identity '" << m_Identity << "'";
-					Log(LogWarning, "JsonRpcConnection")
-						<< info.str() << "\n" << DiagnosticInformation(ex);
-				}
+				queue.clear();
+
+				asio::async_write(tlsStream, asio::buffer(batch), yc);
+				batch.clear();
+				batches++;
+			} while (DequeueMessages(batchSize, queue));
+
+			double now = Utility::GetTime();
+
+			/* The peer considers any message a sign of life, not just heartbeats. */
+			m_NextHeartbeat = now + 20;
 
-				break;
+			l_WriteBatchStats.InsertValue(now, batches);
+			l_WriteBatchMessageStats.InsertValue(now, messages);
+		} catch (const std::exception& ex) {
+			if (!m_ShuttingDown) {
+				std::ostringstream info;
+				info << "Error while sending JSON-RPC message for identity '" << m_Identity << "'";
+				Log(LogWarning, "JsonRpcConnection")
+					<< info.str() << "\n" << DiagnosticInformation(ex);
 			}
+
+			break;
 		}
+
+		/* Don't keep huge buffers around for idle connections. */
+		if (batch.capacity() > batchSize * 2)
+			std::string().swap(batch);
 	} while (!m_ShuttingDown);
 
 	Disconnect();
@@ -177,22 +269,201 @@ void JsonRpcConnection::SendMessage(const Dictionary::Ptr& message)
 	m_IoStrand.post([this, keepAlive, message]() { SendMessageInternal(message); });
 }
 
-void JsonRpcConnection::SendRawMessage(const String& message)
+/**
+ * Sends a message which is also sent to other connections. The message is
+ * encoded only once per wire format.
+ *
+ * @param message The message
+ * @param cache The encodings of the message which have been created so far
+ */
+void JsonRpcConnection::SendMessage(const Dictionary::Ptr& message, EncodedMessageCache& cache)
+{
+	std::unique_lock<std::mutex> lock;
+
+	/* The encoder has to see the messages in the order they're queued. */
+	if (m_CheckResultDeltasEnabled.load()) {
+		lock = std::unique_lock<std::mutex>(m_CheckResultDeltaMutex);
+
+		Dictionary::Ptr compact = m_CheckResultDeltaEncoder.Encode(message);
+
+		if (compact) {
+			SendMessage(compact);
+			return;
+		}
+	}
+
+	bool binary = m_BinaryMessagesEnabled.load();
+	Shared<String>::Ptr& encoded (binary ? cache.Binary : cache.Json);
+
+	if (!encoded)
+		encoded = Shared<String>::Make(binary ? PackMessage(message) : JsonEncode(message));
+
+	SendRawMessage(encoded, GetMessagePriority(message));
+}
+
+void JsonRpcConnection::SendRawMessage(const String& message, MessagePriority priority)
+{
+	SendRawMessage(Shared<String>::Make(message), priority);
+}
+
+/**
+ * Queues an already encoded message. The message may be shared with other
+ * connections and must not be modified afterwards.
+ *
+ * @param message The JSON-encoded message
+ * @param priority The message's class, raw messages are mostly replayed ones
+ */
+void JsonRpcConnection::SendRawMessage(const Shared<String>::Ptr& message, MessagePriority priority)
 {
 	Ptr keepAlive (this);
 
-	m_IoStrand.post([this, keepAlive, message]() {
-		m_OutgoingMessagesQueue.emplace_back(message);
-		m_OutgoingMessagesQueued.Set();
-	});
+	m_IoStrand.post([this, keepAlive, message, priority]() { EnqueueMessage(message, priority); });
+}
+
+/**
+ * Compresses all further messages sent to the peer. Must only be called
+ * if the peer has announced the CompressedMessages capability.
+ */
+void JsonRpcConnection::EnableCompression()
+{
+	m_CompressionEnabled.store(true);
+}
+
+/**
+ * Packs all further messages sent to the peer instead of JSON-encoding them.
+ * Must only be called if the peer has announced the BinaryMessages capability.
+ */
+void JsonRpcConnection::EnableBinaryMessages()
+{
+	m_BinaryMessagesEnabled.store(true);
+}
+
+/**
+ * Sends check results which only differ in timestamps and performance data
+ * values from the previous one as compact messages, see CheckResultDeltaEncoder.
+ * Must only be called if both peers have enabled check result deltas.
+ */
+void JsonRpcConnection::EnableCheckResultDeltas()
+{
+	m_CheckResultDeltasEnabled.store(true);
+}
+
+String JsonRpcConnection::EncodeMessage(const Dictionary::Ptr& message) const
+{
+	if (m_BinaryMessagesEnabled.load())
+		return PackMessage(message);
+
+	return JsonEncode(message);
 }
 
 void JsonRpcConnection::SendMessageInternal(const Dictionary::Ptr& message)
 {
-	m_OutgoingMessagesQueue.emplace_back(JsonEncode(message));
+	EnqueueMessage(Shared<String>::Make(EncodeMessage(message)), GetMessagePriority(message));
+}
+
+void JsonRpcConnection::EnqueueMessage(const Shared<String>::Ptr& message, MessagePriority priority)
+{
+	m_OutgoingMessagesQueues[(size_t)priority].emplace_back(message);
+	l_OutgoingQueueItems[(size_t)priority].fetch_add(1);
+
 	m_OutgoingMessagesQueued.Set();
 }
 
+/**
+ * Takes the messages for the next batch of about batchSize bytes out of the
+ * queues. Control messages always go first. The other priorities share the
+ * batches by their quantums (deficit round robin), so e.g. a replay log
+ * backlog doesn't delay check commands by more than a few batches.
+ *
+ * @param batchSize The batch size in bytes
+ * @param messages Gets the messages
+ * @returns Whether there were any messages
+ */
+bool JsonRpcConnection::DequeueMessages(size_t batchSize, std::vector<Shared<String>::Ptr>& messages)
+{
+	size_t bytes = 0;
+
+	auto take ([this, &messages, &bytes](size_t priority) {
+		auto& queue (m_OutgoingMessagesQueues[priority]);
+
+		bytes += queue.front()->GetLength();
+		messages.emplace_back(std::move(queue.front()));
+		queue.pop_front();
+
+		l_OutgoingQueueItems[priority].fetch_sub(1);
+	});
+
+	while (!m_OutgoingMessagesQueues[(size_t)MessagePriority::Control].empty())
+		take((size_t)MessagePriority::Control);
+
+	for (;;) {
+		bool queued = false;
+
+		for (size_t i = (size_t)MessagePriority::Control + 1; i < m_OutgoingMessagesQueues.size(); i++) {
+			auto& queue (m_OutgoingMessagesQueues[i]);
+			auto& deficit (m_OutgoingMessagesDeficits[i]);
+
+			if (queue.empty())
+				continue;
+
+			deficit += l_PriorityQuantums[i];
+
+			while (!queue.empty() && queue.front()->GetLength() <= deficit) {
+				deficit -= queue.front()->GetLength();
+				take(i);
+			}
+
+			/* An idle priority doesn't save up for later. */
+			if (queue.empty())
+				deficit = 0;
+			else
+				queued = true;
+		}
+
+		if (!queued || bytes >= batchSize)
+			break;
+	}
+
+	return !messages.empty();
+}
+
+/**
+ * Classifies an outgoing message by its method.
+ *
+ * @param message The message
+ * @returns Its priority
+ */
+MessagePriority JsonRpcConnection::GetMessagePriority(const Dictionary::Ptr& message)
+{
+	String method = message->Get("method");
+
+	if (method == "event::Heartbeat" || method == "icinga::Hello" || method == "icinga::Handover"
+		|| method == "log::SetLogPosition" || method == "config::FetchFile" || method.SubStr(0, 5) == "pki::")
+		return MessagePriority::Control;
+
+	if (method == "event::ExecuteCommand" || method == "event::ExecuteCommands" || method == "event::SetCheckSchedule")
+		return MessagePriority::CheckExecution;
+
+	if (method == "config::Update" || method == "config::FileChunk"
+		|| method == "config::UpdateObject" || method == "config::DeleteObject")
+		return MessagePriority::Bulk;
+
+	return MessagePriority::CheckResult;
+}
+
+/**
+ * Returns the number of queued outgoing messages of all connections by priority.
+ */
+std::array<size_t, (size_t)MessagePriority::Count> JsonRpcConnection::GetOutgoingQueueItems()
+{
+	std::array<size_t, (size_t)MessagePriority::Count> items;
+
+	for (size_t i = 0; i < items.size(); i++)
+		items[i] = l_OutgoingQueueItems[i].load();
+
+	return items;
+}
+
 void JsonRpcConnection::Disconnect()
 {
 	namespace asio = boost::asio;
@@ -203,11 +474,13 @@ void JsonRpcConnection::Disconnect()
 		if (!m_ShuttingDown) {
 			m_ShuttingDown = true;
 
+			StopSupervision();
+
 			Log(LogWarning, "JsonRpcConnection")
 				<< "API client disconnected for identity '" << m_Identity << "'";
 
 			{
-				CpuBoundWork removeClient (yc);
+				CpuBoundWork removeClient (yc, CpuBoundWorkClass::Cluster);
 
 				if (m_Endpoint) {
 					m_Endpoint->RemoveClient(this);
@@ -230,9 +503,6 @@ void JsonRpcConnection::Disconnect()
 			 */
 			boost::system::error_code ec;
 
-			m_CheckLivenessTimer.cancel();
-			m_HeartbeatTimer.cancel();
-
 			m_Stream->lowest_layer().cancel(ec);
 
 			Timeout::Ptr shutdownTimeout (new Timeout(
@@ -256,7 +526,17 @@ void JsonRpcConnection::Disconnect()
 
 void JsonRpcConnection::MessageHandler(const String& jsonString)
 {
-	Dictionary::Ptr message = JsonRpc::DecodeMessage(jsonString);
+	double received = Utility::GetTime();
+
+	/* Only endpoints may send config updates, so only their file contents are spooled to disk. */
+	Dictionary::Ptr message = JsonRpc::DecodeMessage(jsonString, m_Endpoint ? &ApiListener::GetConfigUpdateSink() : nullptr);
+
+	/* Restore compact check results before ignoring old messages, the next one may be based on them. */
+	if (m_CheckResultDeltasEnabled.load() && !m_CheckResultDeltaDecoder.Decode(message)) {
+		Log(LogNotice, "JsonRpcConnection")
+			<< "Discarding compact check result from identity '" << m_Identity << "': The check result it's based on is unknown.";
+		return;
+	}
 
 	if (m_Endpoint && message->Contains("ts")) {
 		double ts = message->Get("ts");
@@ -271,6 +551,11 @@ void JsonRpcConnection::MessageHandler(const String& jsonString)
 	MessageOrigin::Ptr origin = new MessageOrigin();
 	origin->FromClient = this;
 
+	Value trace;
+
+	if (message->Get("trace", &trace))
+		origin->Trace = TraceContext::FromTraceparent(trace);
+
 	if (m_Endpoint) {
 		if (m_Endpoint->GetZone() != Zone::GetLocalZone())
 			origin->FromZone = m_Endpoint->GetZone();
@@ -308,11 +593,19 @@ void JsonRpcConnection::MessageHandler(const String& jsonString)
 			Log(LogNotice, "JsonRpcConnection")
 				<< "Call to non-existent function '" << method << "' from endpoint '" << m_Identity << "'.";
 		} else {
+			HistogramTimer handlerTimer (Histogram::GetByName("jsonrpc_" + method));
+
 			Dictionary::Ptr params = message->Get("params");
 			if (params)
 				resultMessage->Set("result", afunc->Invoke(origin, params));
 			else
 				resultMessage->Set("result", Empty);
+
+			if (origin->Trace.IsValid() && Tracing::IsExporting()) {
+				Tracing::EmitChildSpan(origin->Trace, method, received, Utility::GetTime(), new Dictionary({
+					{ "icinga.endpoint", m_Identity }
+				}));
+			}
 		}
 	} catch (const std::exception& ex) {
 		/* TODO: Add a user readable error message for the remote caller */
@@ -344,52 +637,23 @@ Value SetLogPositionHandler(const MessageOrigin::Ptr& origin, const Dictionary::
 	return Empty;
 }
 
-void JsonRpcConnection::CheckLiveness(boost::asio::yield_context yc)
+double JsonRpcConnection::GetWorkQueueRate()
 {
-	boost::system::error_code ec;
-
-	if (!m_Authenticated) {
-		/* Anonymous connections are normally only used for requesting a certificate and are closed after this request
-		 * is received. However, the request is only sent if the child has successfully verified the certificate of its
-		 * parent so that it is an authenticated connection from its perspective. In case this verification fails, both
-		 * ends view it as an anonymous connection and never actually use it but attempt a reconnect after 10 seconds
-		 * leaking the connection. Therefore close it after a timeout.
-		 */
-
-		m_CheckLivenessTimer.expires_from_now(boost::posix_time::seconds(10));
-		m_CheckLivenessTimer.async_wait(yc[ec]);
-
-		if (m_ShuttingDown) {
-			return;
-		}
-
-		auto remote (m_Stream->lowest_layer().remote_endpoint());
-
-		Log(LogInformation, "JsonRpcConnection")
-			<< "Closing anonymous connection [" << remote.address() << "]:" << remote.port() << " after 10 seconds.";
-
-		Disconnect();
-	} else {
-		for (;;) {
-			m_CheckLivenessTimer.expires_from_now(boost::posix_time::seconds(30));
-			m_CheckLivenessTimer.async_wait(yc[ec]);
-
-			if (m_ShuttingDown) {
-				break;
-			}
-
-			if (m_Seen < Utility::GetTime() - 60 && (!m_Endpoint || !m_Endpoint->GetSyncing())) {
-				Log(LogInformation, "JsonRpcConnection")
-					<<  "No messages for identity '" << m_Identity << "' have been received in the last 60 seconds.";
-
-				Disconnect();
-				break;
-			}
-		}
-	}
+	return l_TaskStats.UpdateAndGetValues(Utility::GetTime(), 60) / 60.0;
 }
 
-double JsonRpcConnection::GetWorkQueueRate()
+/**
+ * Returns the average number of messages per TLS write during the last minute.
+ *
+ * @returns Messages per batch
+ */
+double JsonRpcConnection::GetAverageWriteBatchSize()
 {
-	return l_TaskStats.UpdateAndGetValues(Utility::GetTime(), 60) / 60.0;
+	double now = Utility::GetTime();
+	int batches = l_WriteBatchStats.UpdateAndGetValues(now, 60);
+
+	if (batches == 0)
+		return 0;
+
+	return l_WriteBatchMessageStats.UpdateAndGetValues(now, 60) / static_cast<double>(batches);
 }
@@ -4,12 +4,19 @@
 #define JSONRPCCONNECTION_H
 
 #include "remote/i2-remote.hpp"
+#include "remote/checkresultdelta.hpp"
 #include "remote/endpoint.hpp"
+#include "remote/messagecompression.hpp"
 #include "base/io-engine.hpp"
+#include "base/shared.hpp"
 #include "base/tlsstream.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include <array>
+#include <atomic>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/io_context_strand.hpp>
@@ -30,8 +37,36 @@ enum ClientType
 	ClientHttp
 };
 
+/**
+ * The outgoing messages of a connection are written by these classes. Control
+ * messages always go first, the others share the connection by their weights.
+ *
+ * @ingroup remote
+ */
+enum class MessagePriority
+{
+	Control,
+	CheckExecution,
+	CheckResult, // And all other events
+	Bulk, // Replay log and config sync
+
+	Count
+};
+
 class MessageOrigin;
 
+/**
+ * The encodings of a message which is sent to multiple connections.
+ * Each one is created on first use.
+ *
+ * @ingroup remote
+ */
+struct EncodedMessageCache
+{
+	Shared<String>::Ptr Json;
+	Shared<String>::Ptr Binary;
+};
+
 /**
  * An API client connection.
  *
@@ -43,6 +78,7 @@ public:
 	DECLARE_PTR_TYPEDEFS(JsonRpcConnection);
 
 	JsonRpcConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role);
+	~JsonRpcConnection() override;
 
 	void Start();
 
@@ -56,11 +92,21 @@ public:
 	void Disconnect();
 
 	void SendMessage(const Dictionary::Ptr& request);
-	void SendRawMessage(const String& request);
+	void SendMessage(const Dictionary::Ptr& request, EncodedMessageCache& cache);
+	void SendRawMessage(const String& request, MessagePriority priority = MessagePriority::Bulk);
+	void SendRawMessage(const Shared<String>::Ptr& request, MessagePriority priority = MessagePriority::Bulk);
+
+	void EnableCompression();
+	void EnableBinaryMessages();
+	void EnableCheckResultDeltas();
 
 	static Value HeartbeatAPIHandler(const intrusive_ptr<MessageOrigin>& origin, const Dictionary::Ptr& params);
 
 	static double GetWorkQueueRate();
+	static double GetAverageWriteBatchSize();
+	static std::array<size_t, (size_t)MessagePriority::Count> GetOutgoingQueueItems();
+
+	static MessagePriority GetMessagePriority(const Dictionary::Ptr& message);
 
 	static void SendCertificateRequest(const JsonRpcConnection::Ptr& aclient, const intrusive_ptr<MessageOrigin>& origin, const String& path);
 
@@ -74,18 +120,28 @@ private:
 	double m_Seen;
 	double m_NextHeartbeat;
 	boost::asio::io_context::strand m_IoStrand;
-	std::vector<String> m_OutgoingMessagesQueue;
+	std::array<std::deque<Shared<String>::Ptr>, (size_t)MessagePriority::Count> m_OutgoingMessagesQueues;
+	std::array<size_t, (size_t)MessagePriority::Count> m_OutgoingMessagesDeficits;
 	AsioConditionVariable m_OutgoingMessagesQueued;
 	AsioConditionVariable m_WriterDone;
 	bool m_ShuttingDown;
-	boost::asio::deadline_timer m_CheckLivenessTimer, m_HeartbeatTimer;
+	std::atomic<bool> m_CompressionEnabled;
+	std::atomic<bool> m_BinaryMessagesEnabled;
+	std::atomic<bool> m_CheckResultDeltasEnabled;
+	std::mutex m_CheckResultDeltaMutex;
+	CheckResultDeltaEncoder m_CheckResultDeltaEncoder;
+	CheckResultDeltaDecoder m_CheckResultDeltaDecoder;
+	std::unique_ptr<MessageDeflater> m_Deflater;
+	std::unique_ptr<MessageInflater> m_Inflater;
 
 	JsonRpcConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role, boost::asio::io_context& io);
 
 	void HandleIncomingMessages(boost::asio::yield_context yc);
 	void WriteOutgoingMessages(boost::asio::yield_context yc);
-	void HandleAndWriteHeartbeats(boost::asio::yield_context yc);
-	void CheckLiveness(boost::asio::yield_context yc);
+	void StartSupervision();
+	void StopSupervision();
+	void Supervise();
+	static void SuperviseConnections();
 
 	bool ProcessMessage();
 	void MessageHandler(const String& jsonString);
@@ -93,6 +149,9 @@ private:
 	void CertificateRequestResponseHandler(const Dictionary::Ptr& message);
 
 	void SendMessageInternal(const Dictionary::Ptr& request);
+	void EnqueueMessage(const Shared<String>::Ptr& message, MessagePriority priority);
+	bool DequeueMessages(size_t batchSize, std::vector<Shared<String>::Ptr>& messages);
+	String EncodeMessage(const Dictionary::Ptr& request) const;
 };
 
 }
@@ -0,0 +1,299 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/messagecompression.hpp"
+#include "base/exception.hpp"
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace icinga;
+
+/* The most common strings of event::CheckResult messages (as encoded by
+ * JsonEncode(), i.e. with sorted keys). zlib prefers the most frequent
+ * strings at the end of the dictionary. */
+static const char l_CheckResultDictionary[] =
+	"\"event::SetNextCheck\",\"params\":{\"host\":\"\",\"next_check\":"
+	"\"event::Heartbeat\",\"params\":{\"timeout\":120.0}"
+	"\"performance_data\":[\"rta=\"ms;\",\"pl=\"%;\",\"time=\"s;\"size=\"B;\"load1=\"load5=\"load15=\"],"
+	"\"active\":false,\"active\":true,\"check_source\":\"\",\"command\":[\"/usr/lib/nagios/plugins/check_\",\"-H\",\"-w\",\"-c\"],"
+	"\"execution_end\":\"execution_start\":\"exit_status\":0.0,\"output\":\"OK - \",\"output\":\"PING OK - Packet loss = 0%, RTA = ms\","
+	"\"schedule_end\":\"schedule_start\":\"scheduling_source\":\"\",\"state\":0.0,\"ttl\":0.0,\"type\":\"CheckResult\","
+	"\"vars_after\":{\"attempt\":1.0,\"reachable\":true,\"state\":0.0,\"state_type\":1.0},"
+	"\"vars_before\":{\"attempt\":1.0,\"reachable\":true,\"state\":0.0,\"state_type\":1.0}},"
+	"{\"jsonrpc\":\"2.0\",\"method\":\"event::CheckResult\",\"params\":{\"cr\":{\"active\":true,\"check_source\":\"\",";
+
+static void ThrowZlibError(const char *function, int rc)
+{
+	BOOST_THROW_EXCEPTION(std::runtime_error(std::string(function) + "() failed: " + zError(rc)));
+}
+
+MessageDeflater::MessageDeflater()
+{
+	m_Stream.zalloc = Z_NULL;
+	m_Stream.zfree = Z_NULL;
+	m_Stream.opaque = Z_NULL;
+
+	/* Raw deflate, the frames are delimited by the netstrings anyway. */
+	int rc = deflateInit2(&m_Stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+
+	if (rc != Z_OK)
+		ThrowZlibError("deflateInit2", rc);
+
+	rc = deflateSetDictionary(&m_Stream, reinterpret_cast<const Bytef *>(l_CheckResultDictionary), sizeof(l_CheckResultDictionary) - 1);
+
+	if (rc != Z_OK) {
+		deflateEnd(&m_Stream);
+		ThrowZlibError("deflateSetDictionary", rc);
+	}
+}
+
+MessageDeflater::~MessageDeflater()
+{
+	deflateEnd(&m_Stream);
+}
+
+/**
+ * Compresses a message into a frame which can only be decompressed by the
+ * peer's MessageInflater if all previous frames have been decompressed.
+ *
+ * @param message The JSON-encoded message
+ * @returns The compressed frame
+ */
+String MessageDeflater::Compress(const String& message)
+{
+	std::string frame (1, FrameMarker);
+	frame.resize(1 + deflateBound(&m_Stream, message.GetLength()) + 16);
+
+	m_Stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(message.CStr()));
+	m_Stream.avail_in = message.GetLength();
+
+	size_t used = 1;
+
+	for (;;) {
+		m_Stream.next_out = reinterpret_cast<Bytef *>(&frame[used]);
+		m_Stream.avail_out = frame.size() - used;
+
+		int rc = deflate(&m_Stream, Z_SYNC_FLUSH);
+
+		if (rc != Z_OK && rc != Z_BUF_ERROR)
+			ThrowZlibError("deflate", rc);
+
+		used = frame.size() - m_Stream.avail_out;
+
+		/* Z_SYNC_FLUSH is done once there's output space left. */
+		if (m_Stream.avail_in == 0 && m_Stream.avail_out > 0)
+			break;
+
+		frame.resize(frame.size() * 2);
+	}
+
+	frame.resize(used);
+
+	return frame;
+}
+
+MessageInflater::MessageInflater()
+{
+	m_Stream.zalloc = Z_NULL;
+	m_Stream.zfree = Z_NULL;
+	m_Stream.opaque = Z_NULL;
+	m_Stream.next_in = Z_NULL;
+	m_Stream.avail_in = 0;
+
+	int rc = inflateInit2(&m_Stream, -15);
+
+	if (rc != Z_OK)
+		ThrowZlibError("inflateInit2", rc);
+
+	rc = inflateSetDictionary(&m_Stream, reinterpret_cast<const Bytef *>(l_CheckResultDictionary), sizeof(l_CheckResultDictionary) - 1);
+
+	if (rc != Z_OK) {
+		inflateEnd(&m_Stream);
+		ThrowZlibError("inflateSetDictionary", rc);
+	}
+}
+
+MessageInflater::~MessageInflater()
+{
+	inflateEnd(&m_Stream);
+}
+
+bool MessageInflater::IsCompressed(const String& frame)
+{
+	return !frame.IsEmpty() && frame[0] == MessageDeflater::FrameMarker;
+}
+
+/**
+ * Decompresses a frame.
+ *
+ * @param frame The compressed frame
+ * @param maxMessageLength Maximum length of the decompressed message, -1 for no limit
+ * @returns The JSON-encoded message
+ */
+String MessageInflater::Decompress(const String& frame, ssize_t maxMessageLength)
+{
+	std::string message;
+	message.resize(frame.GetLength() * 4 + 256);
+
+	m_Stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(frame.CStr() + 1));
+	m_Stream.avail_in = frame.GetLength() - 1;
+
+	size_t used = 0;
+
+	for (;;) {
+		m_Stream.next_out = reinterpret_cast<Bytef *>(&message[used]);
+		m_Stream.avail_out = message.size() - used;
+
+		int rc = inflate(&m_Stream, Z_SYNC_FLUSH);
+
+		if (rc != Z_OK && rc != Z_BUF_ERROR)
+			ThrowZlibError("inflate", rc);
+
+		used = message.size() - m_Stream.avail_out;
+
+		if (maxMessageLength >= 0 && used > static_cast<size_t>(maxMessageLength))
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Decompressed message is too long"));
+
+		if (m_Stream.avail_in == 0 && m_Stream.avail_out > 0)
+			break;
+
+		if (rc == Z_BUF_ERROR && m_Stream.avail_out > 0)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Truncated compressed message"));
+
+		message.resize(message.size() * 2);
+	}
+
+	message.resize(used);
+
+	return message;
+}
+
+/**
+ * @param encoding The HTTP content coding, "gzip" or "deflate"
+ */
+HttpBodyDeflater::HttpBodyDeflater(const String& encoding)
+{
+	if (!IsSupportedEncoding(encoding))
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Unsupported content coding: " + encoding));
+
+	m_Stream.zalloc = Z_NULL;
+	m_Stream.zfree = Z_NULL;
+	m_Stream.opaque = Z_NULL;
+
+	/* HTTP's "deflate" is the zlib format, 15 + 16 makes zlib write a gzip header and trailer instead.
+	 * Level 1 compresses JSON almost as well as the default level at a fraction of the CPU time. */
+	int rc = deflateInit2(&m_Stream, 1, Z_DEFLATED, encoding == "gzip" ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY);
+
+	if (rc != Z_OK)
+		ThrowZlibError("deflateInit2", rc);
+}
+
+HttpBodyDeflater::~HttpBodyDeflater()
+{
+	deflateEnd(&m_Stream);
+}
+
+bool HttpBodyDeflater::IsSupportedEncoding(const String& encoding)
+{
+	return encoding == "gzip" || encoding == "deflate";
+}
+
+/**
+ * Compresses the next part of the body.
+ *
+ * @param data The next part of the uncompressed body
+ * @param flush Whether the client shall be able to decompress everything so far, e.g. for events
+ * @returns The compressed data which is ready, may be empty unless flushing
+ */
+String HttpBodyDeflater::Compress(const String& data, bool flush)
+{
+	return Deflate(data.CStr(), data.GetLength(), flush ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+}
+
+/**
+ * Terminates the compressed body.
+ *
+ * @returns The remaining compressed data
+ */
+String HttpBodyDeflater::Finish()
+{
+	return Deflate(nullptr, 0, Z_FINISH);
+}
+
+String HttpBodyDeflater::Deflate(const char *data, size_t length, int flush)
+{
+	std::string result;
+	result.resize(deflateBound(&m_Stream, length) + 16);
+
+	m_Stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+	m_Stream.avail_in = length;
+
+	size_t used = 0;
+
+	for (;;) {
+		m_Stream.next_out = reinterpret_cast<Bytef *>(&result[used]);
+		m_Stream.avail_out = result.size() - used;
+
+		int rc = deflate(&m_Stream, flush);
+
+		if (rc == Z_STREAM_END)
+			break;
+
+		if (rc != Z_OK && rc != Z_BUF_ERROR)
+			ThrowZlibError("deflate", rc);
+
+		used = result.size() - m_Stream.avail_out;
+
+		/* Flushing is done once there's output space left. */
+		if (flush != Z_FINISH && m_Stream.avail_in == 0 && m_Stream.avail_out > 0)
+			break;
+
+		result.resize(result.size() * 2);
+	}
+
+	result.resize(result.size() - m_Stream.avail_out);
+
+	return String(std::move(result));
+}
+
+/**
+ * Compresses data into a gzip stream, e.g. for an HTTP request body which
+ * is sent with "Content-Encoding: gzip".
+ *
+ * @param data The uncompressed data
+ * @returns The gzip stream
+ */
+String icinga::GzipCompress(const String& data)
+{
+	z_stream stream;
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+
+	/* 15 + 16 makes zlib write a gzip header and trailer. */
+	int rc = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+
+	if (rc != Z_OK)
+		ThrowZlibError("deflateInit2", rc);
+
+	std::string result;
+	result.resize(deflateBound(&stream, data.GetLength()));
+
+	stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.CStr()));
+	stream.avail_in = data.GetLength();
+	stream.next_out = reinterpret_cast<Bytef *>(&result[0]);
+	stream.avail_out = result.size();
+
+	/* deflateBound() guarantees that a single call is enough. */
+	rc = deflate(&stream, Z_FINISH);
+	size_t used = result.size() - stream.avail_out;
+
+	deflateEnd(&stream);
+
+	if (rc != Z_STREAM_END)
+		ThrowZlibError("deflate", rc);
+
+	result.resize(used);
+
+	return result;
+}
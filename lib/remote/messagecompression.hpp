@@ -0,0 +1,96 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef MESSAGECOMPRESSION_H
+#define MESSAGECOMPRESSION_H
+
+#include "remote/i2-remote.hpp"
+#include "base/string.hpp"
+#include <zlib.h>
+
+namespace icinga
+{
+
+/**
+ * Compresses JSON-RPC messages for a single connection.
+ *
+ * All messages share one deflate stream (primed with a dictionary of
+ * typical check result messages) which is flushed after every message,
+ * so later messages benefit from the content of earlier ones.
+ *
+ * @ingroup remote
+ */
+class MessageDeflater final
+{
+public:
+	/* Compressed frames start with this byte. JSON-RPC messages start with '{'. */
+	static const char FrameMarker = '\x01';
+
+	/* Compressing smaller messages (e.g. heartbeats) isn't worth it. */
+	static const size_t MinMessageLength = 256;
+
+	MessageDeflater();
+	~MessageDeflater();
+
+	MessageDeflater(const MessageDeflater&) = delete;
+	MessageDeflater& operator=(const MessageDeflater&) = delete;
+
+	String Compress(const String& message);
+
+private:
+	z_stream m_Stream;
+};
+
+/**
+ * Decompresses JSON-RPC messages compressed by a MessageDeflater.
+ *
+ * @ingroup remote
+ */
+class MessageInflater final
+{
+public:
+	MessageInflater();
+	~MessageInflater();
+
+	MessageInflater(const MessageInflater&) = delete;
+	MessageInflater& operator=(const MessageInflater&) = delete;
+
+	static bool IsCompressed(const String& frame);
+
+	String Decompress(const String& frame, ssize_t maxMessageLength = -1);
+
+private:
+	z_stream m_Stream;
+};
+
+/**
+ * Compresses an HTTP response body with the content coding negotiated
+ * via "Accept-Encoding", either at once or piece by piece for streamed
+ * and chunked responses.
+ *
+ * @ingroup remote
+ */
+class HttpBodyDeflater final
+{
+public:
+	HttpBodyDeflater(const String& encoding);
+	~HttpBodyDeflater();
+
+	HttpBodyDeflater(const HttpBodyDeflater&) = delete;
+	HttpBodyDeflater& operator=(const HttpBodyDeflater&) = delete;
+
+	static bool IsSupportedEncoding(const String& encoding);
+
+	String Compress(const String& data, bool flush = false);
+	String Finish();
+
+private:
+	z_stream m_Stream;
+
+	String Deflate(const char *data, size_t length, int flush);
+};
+
+String GzipCompress(const String& data);
+
+}
+
+#endif /* MESSAGECOMPRESSION_H */
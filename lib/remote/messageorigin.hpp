@@ -5,6 +5,7 @@
 
 #include "remote/zone.hpp"
 #include "remote/jsonrpcconnection.hpp"
+#include "base/tracing.hpp"
 
 namespace icinga
 {
@@ -19,6 +20,7 @@ public:
 
 	Zone::Ptr FromZone;
 	JsonRpcConnection::Ptr FromClient;
+	TraceContext Trace;
 
 	bool IsLocal() const;
 };
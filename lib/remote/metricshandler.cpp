@@ -0,0 +1,44 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/metricshandler.hpp"
+#include "remote/filterutility.hpp"
+#include "base/metric.hpp"
+
+using namespace icinga;
+
+REGISTER_URLHANDLER("/v1/metrics", MetricsHandler);
+
+/* Scrapes only read counters, unlike /v1/status they don't look at any objects. */
+bool MetricsHandler::IsCpuBound() const
+{
+	return false;
+}
+
+bool MetricsHandler::HandleRequest(
+	AsioTlsStream& stream,
+	const ApiUser::Ptr& user,
+	boost::beast::http::request<boost::beast::http::string_body>& request,
+	const Url::Ptr& url,
+	boost::beast::http::response<boost::beast::http::string_body>& response,
+	const Dictionary::Ptr& params,
+	boost::asio::yield_context& yc,
+	HttpServerConnection& server
+)
+{
+	namespace http = boost::beast::http;
+
+	if (url->GetPath().size() != 2)
+		return false;
+
+	if (request.method() != http::verb::get)
+		return false;
+
+	FilterUtility::CheckPermission(user, "metrics");
+
+	response.result(http::status::ok);
+	response.set(http::field::content_type, "text/plain; version=0.0.4; charset=utf-8");
+	response.body() = FormatPrometheusMetrics();
+	response.content_length(response.body().size());
+
+	return true;
+}
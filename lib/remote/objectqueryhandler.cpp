@@ -2,22 +2,42 @@
 
 #include "remote/objectqueryhandler.hpp"
 #include "remote/httputility.hpp"
+#include "remote/messagecompression.hpp"
 #include "remote/filterutility.hpp"
 #include "base/serializer.hpp"
 #include "base/dependencygraph.hpp"
 #include "base/configtype.hpp"
+#include "base/io-engine.hpp"
+#include "base/json.hpp"
 #include <boost/algorithm/string/case_conv.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/http/chunk_encode.hpp>
+#include <boost/beast/http/empty_body.hpp>
+#include <boost/beast/http/serializer.hpp>
+#include <boost/beast/http/write.hpp>
+#include <algorithm>
+#include <map>
+#include <memory>
 #include <set>
 
 using namespace icinga;
 
 REGISTER_URLHANDLER("/v1/objects", ObjectQueryHandler);
 
-Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& object,
+/**
+ * Resolves the requested attributes of a type to field IDs, once per request.
+ *
+ * @param type The type of the objects.
+ * @param attrPrefix The name of the join, the prefix of its attributes.
+ * @param attrs The attributes requested by the user.
+ * @param isJoin Whether the objects are joined ones.
+ * @param allAttrs Whether all attributes are requested.
+ * @returns The user-visible fields to serialize.
+ */
+ObjectQueryHandler::AttributeProjection ObjectQueryHandler::CompileProjection(const Type::Ptr& type,
 	const String& attrPrefix, const Array::Ptr& attrs, bool isJoin, bool allAttrs)
 {
-	Type::Ptr type = object->GetReflectionType();
-
 	std::vector<int> fids;
 
 	if (isJoin && attrs) {
@@ -64,14 +84,15 @@ Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& obje
 		}
 	}
 
-	DictionaryData resultAttrs;
-	resultAttrs.reserve(fids.size());
+	std::sort(fids.begin(), fids.end());
+	fids.erase(std::unique(fids.begin(), fids.end()), fids.end());
+
+	std::vector<std::pair<String, int> > fields;
+	fields.reserve(fids.size());
 
 	for (int fid : fids) {
 		Field field = type->GetFieldInfo(fid);
 
-		Value val = object->GetField(fid);
-
 		/* hide attributes which shouldn't be user-visible */
 		if (field.Attributes & FANoUserView)
 			continue;
@@ -80,11 +101,59 @@ Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& obje
 		if (field.Attributes & FANavigation && !(field.Attributes & (FAConfig | FAState)))
 			continue;
 
-		Value sval = Serialize(val, FAConfig | FAState);
-		resultAttrs.emplace_back(field.Name, sval);
+		fields.emplace_back(field.Name, fid);
+	}
+
+	/* Same order as the keys of a dictionary. */
+	std::sort(fields.begin(), fields.end());
+
+	AttributeProjection projection;
+	projection.reserve(fields.size());
+
+	for (auto& field : fields) {
+		projection.emplace_back(JsonEncode(field.first) + ":", field.second);
 	}
 
-	return new Dictionary(std::move(resultAttrs));
+	return projection;
+}
+
+/**
+ * Appends the projected attributes of an object as JSON object members.
+ *
+ * @param output The JSON text.
+ * @param object The object.
+ * @param projection The fields to serialize.
+ */
+void ObjectQueryHandler::SerializeObjectAttrs(String& output, const Object::Ptr& object, const AttributeProjection& projection)
+{
+	bool first = true;
+
+	for (auto& field : projection) {
+		if (!first)
+			output += ",";
+
+		first = false;
+
+		output += field.first;
+		output += JsonEncode(Serialize(object->GetField(field.second), FAConfig | FAState));
+	}
+}
+
+/**
+ * Makes "meta" accept another field. Has to be called during static initialization.
+ *
+ * @param name The name of the field
+ * @param callback Computes the field for an object
+ */
+void ObjectQueryHandler::RegisterMeta(const String& name, const MetaCallback& callback)
+{
+	GetMetaRegistry()[name] = callback;
+}
+
+std::map<String, ObjectQueryHandler::MetaCallback>& ObjectQueryHandler::GetMetaRegistry()
+{
+	static std::map<String, MetaCallback> registry;
+	return registry;
 }
 
 bool ObjectQueryHandler::HandleRequest(
@@ -98,6 +167,7 @@ bool ObjectQueryHandler::HandleRequest(
 	HttpServerConnection& server
 )
 {
+	namespace asio = boost::asio;
 	namespace http = boost::beast::http;
 
 	if (url->GetPath().size() < 3 || url->GetPath().size() > 4)
@@ -164,9 +234,6 @@ bool ObjectQueryHandler::HandleRequest(
 		return true;
 	}
 
-	ArrayData results;
-	results.reserve(objs.size());
-
 	std::set<String> joinAttrs;
 	std::set<String> userJoinAttrs;
 
@@ -189,11 +256,98 @@ bool ObjectQueryHandler::HandleRequest(
 		joinAttrs.insert(field.Name);
 	}
 
-	for (const ConfigObject::Ptr& obj : objs) {
-		DictionaryData result1{
-			{ "name", obj->GetName() },
-			{ "type", obj->GetReflectionType()->GetName() }
-		};
+	/* Everything which depends only on the request is checked before the first object is sent. */
+	if (umetas) {
+		ObjectLock olock(umetas);
+		for (const String& meta : umetas) {
+			if (meta != "used_by" && meta != "location" && GetMetaRegistry().find(meta) == GetMetaRegistry().end()) {
+				HttpUtility::SendJsonError(response, params, 400, "Invalid field specified for meta: " + meta);
+				return true;
+			}
+		}
+	}
+
+	for (const String& joinAttr : joinAttrs) {
+		int fid = type->GetFieldId(joinAttr);
+
+		if (fid < 0) {
+			HttpUtility::SendJsonError(response, params, 400, "Invalid field specified for join: " + joinAttr);
+			return true;
+		}
+
+		if (!(type->GetFieldInfo(fid).Attributes & FANavigation)) {
+			HttpUtility::SendJsonError(response, params, 400, "Not a joinable field: " + joinAttr);
+			return true;
+		}
+	}
+
+	/* The attributes are resolved to field IDs once, the joined types are only known per object. */
+	AttributeProjection attrs;
+
+	try {
+		attrs = CompileProjection(type, String(), uattrs, false, false);
+	} catch (const ScriptError& ex) {
+		HttpUtility::SendJsonError(response, params, 400, ex.what());
+		return true;
+	}
+
+	struct JoinProjection
+	{
+		int Fid;
+		String Prefix;
+		String Key;
+		std::map<Type *, AttributeProjection> Projections;
+	};
+
+	std::vector<JoinProjection> joins;
+
+	for (const String& joinAttr : joinAttrs) {
+		int fid = type->GetFieldId(joinAttr);
+		String prefix = type->GetFieldInfo(fid).NavigationName;
+
+		joins.push_back(JoinProjection{fid, prefix, JsonEncode(prefix) + ":", {}});
+	}
+
+	std::stable_sort(joins.begin(), joins.end(), [](const JoinProjection& a, const JoinProjection& b) {
+		return a.Prefix < b.Prefix;
+	});
+
+	joins.erase(std::unique(joins.begin(), joins.end(), [](const JoinProjection& a, const JoinProjection& b) {
+		return a.Prefix == b.Prefix;
+	}), joins.end());
+
+	/* Each object is written as JSON text right away, with its keys in the order of a dictionary. */
+	auto serializeObject ([&attrs, &joins, &ujoins, &umetas, &params, allJoins](String& output, const ConfigObject::Ptr& obj) {
+		output += "{\"attrs\":{";
+		SerializeObjectAttrs(output, obj, attrs);
+		output += "},\"joins\":{";
+
+		bool first = true;
+
+		for (auto& join : joins) {
+			Object::Ptr joinedObj = obj->NavigateField(join.Fid);
+
+			if (!joinedObj)
+				continue;
+
+			Type::Ptr joinedType = joinedObj->GetReflectionType();
+			auto projection (join.Projections.find(joinedType.get()));
+
+			if (projection == join.Projections.end()) {
+				projection = join.Projections.emplace(joinedType.get(),
+					CompileProjection(joinedType, join.Prefix, ujoins, true, allJoins)).first;
+			}
+
+			if (!first)
+				output += ",";
+
+			first = false;
+
+			output += join.Key;
+			output += "{";
+			SerializeObjectAttrs(output, joinedObj, projection->second);
+			output += "}";
+		}
 
 		DictionaryData metaAttrs;
 
@@ -219,65 +373,136 @@ bool ObjectQueryHandler::HandleRequest(
 				} else if (meta == "location") {
 					metaAttrs.emplace_back("location", obj->GetSourceLocation());
 				} else {
-					HttpUtility::SendJsonError(response, params, 400, "Invalid field specified for meta: " + meta);
-					return true;
+					Value value = GetMetaRegistry().find(meta)->second(obj, params);
+
+					if (!value.IsEmpty())
+						metaAttrs.emplace_back(meta, std::move(value));
 				}
 			}
 		}
 
-		result1.emplace_back("meta", new Dictionary(std::move(metaAttrs)));
+		output += "},\"meta\":";
+		output += metaAttrs.empty() ? String("{}") : JsonEncode(new Dictionary(std::move(metaAttrs)));
+		output += ",\"name\":";
+		output += JsonEncode(obj->GetName());
+		output += ",\"type\":";
+		output += JsonEncode(obj->GetReflectionType()->GetName());
+		output += "}";
+	});
+
+	/* HTTP/1.0 doesn't know chunks and pretty printing needs the whole result. */
+	if (request.version() != 11 || HttpUtility::GetLastParameter(params, "pretty")) {
+		String body ("{\"results\":[");
 
 		try {
-			result1.emplace_back("attrs", SerializeObjectAttrs(obj, String(), uattrs, false, false));
+			bool first = true;
+
+			for (const ConfigObject::Ptr& obj : objs) {
+				if (!first)
+					body += ",";
+
+				first = false;
+
+				serializeObject(body, obj);
+			}
 		} catch (const ScriptError& ex) {
 			HttpUtility::SendJsonError(response, params, 400, ex.what());
 			return true;
 		}
 
-		DictionaryData joins;
+		body += "]}";
 
-		for (const String& joinAttr : joinAttrs) {
-			Object::Ptr joinedObj;
-			int fid = type->GetFieldId(joinAttr);
+		response.result(http::status::ok);
 
-			if (fid < 0) {
-				HttpUtility::SendJsonError(response, params, 400, "Invalid field specified for join: " + joinAttr);
-				return true;
-			}
+		if (HttpUtility::GetLastParameter(params, "pretty")) {
+			HttpUtility::SendJsonBody(response, params, JsonDecode(body));
+		} else {
+			response.set(http::field::content_type, "application/json");
+			response.body() = std::move(body.GetData());
+			response.content_length(response.body().size());
+		}
 
-			Field field = type->GetFieldInfo(fid);
+		return true;
+	}
 
-			if (!(field.Attributes & FANavigation)) {
-				HttpUtility::SendJsonError(response, params, 400, "Not a joinable field: " + joinAttr);
-				return true;
+	/* The results are streamed in chunks, so that they are never all in memory at once.
+	 * The first object is serialized up front, so that invalid attributes are still reported.
+	 */
+	String chunk ("{\"results\":[");
+	auto next (objs.begin());
+
+	if (next != objs.end()) {
+		try {
+			serializeObject(chunk, *next);
+		} catch (const ScriptError& ex) {
+			HttpUtility::SendJsonError(response, params, 400, ex.what());
+			return true;
+		}
+
+		++next;
+	}
+
+	response.result(http::status::ok);
+
+	http::response<http::empty_body> head (response.base());
+	head.set(http::field::content_type, "application/json");
+	head.keep_alive(request.keep_alive());
+	head.chunked(true);
+	head.set(http::field::vary, "Accept-Encoding");
+
+	std::unique_ptr<HttpBodyDeflater> deflater;
+
+	{
+		String encoding = HttpUtility::GetResponseEncoding(request);
+
+		if (!encoding.IsEmpty()) {
+			deflater.reset(new HttpBodyDeflater(encoding));
+			head.set(http::field::content_encoding, encoding.CStr());
+		}
+	}
+
+	server.MarkResponseSent();
+
+	IoBoundWorkSlot dontLockTheIoThread (yc, HttpUtility::GetCpuBoundWorkClass(request));
+
+	http::response_serializer<http::empty_body> serializer (head);
+	http::async_write_header(stream, serializer, yc);
+
+	for (;;) {
+		{
+			CpuBoundWork buildingResponse (yc, CpuBoundWorkClass::ApiRead);
+
+			while (next != objs.end() && chunk.GetLength() < 64u * 1024u) {
+				chunk += ",";
+				serializeObject(chunk, *next);
+				++next;
 			}
 
-			joinedObj = obj->NavigateField(fid);
+			if (next == objs.end())
+				chunk += "]}";
 
-			if (!joinedObj)
-				continue;
+			if (deflater) {
+				String compressed = deflater->Compress(chunk);
 
-			String prefix = field.NavigationName;
+				if (next == objs.end())
+					compressed += deflater->Finish();
 
-			try {
-				joins.emplace_back(prefix, SerializeObjectAttrs(joinedObj, prefix, ujoins, true, allJoins));
-			} catch (const ScriptError& ex) {
-				HttpUtility::SendJsonError(response, params, 400, ex.what());
-				return true;
+				chunk = std::move(compressed);
 			}
 		}
 
-		result1.emplace_back("joins", new Dictionary(std::move(joins)));
+		/* An empty chunk would terminate the body, the deflater may not have any output yet. */
+		if (!chunk.IsEmpty())
+			asio::async_write(stream, http::make_chunk(asio::const_buffer(chunk.CStr(), chunk.GetLength())), yc);
 
-		results.push_back(new Dictionary(std::move(result1)));
-	}
+		if (next == objs.end())
+			break;
 
-	Dictionary::Ptr result = new Dictionary({
-		{ "results", new Array(std::move(results)) }
-	});
+		chunk.Clear();
+	}
 
-	response.result(http::status::ok);
-	HttpUtility::SendJsonBody(response, params, result);
+	asio::async_write(stream, http::make_chunk_last(), yc);
+	stream.async_flush(yc);
 
 	return true;
 }
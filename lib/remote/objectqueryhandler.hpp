@@ -4,6 +4,9 @@
 #define OBJECTQUERYHANDLER_H
 
 #include "remote/httphandler.hpp"
+#include "base/configobject.hpp"
+#include <functional>
+#include <map>
 
 namespace icinga
 {
@@ -13,6 +16,14 @@ class ObjectQueryHandler final : public HttpHandler
 public:
 	DECLARE_PTR_TYPEDEFS(ObjectQueryHandler);
 
+	/**
+	 * Computes an additional "meta" field of an object, e.g. in a library which
+	 * the remote library can't depend on. Empty values are omitted.
+	 */
+	typedef std::function<Value (const ConfigObject::Ptr& object, const Dictionary::Ptr& params)> MetaCallback;
+
+	static void RegisterMeta(const String& name, const MetaCallback& callback);
+
 	bool HandleRequest(
 		AsioTlsStream& stream,
 		const ApiUser::Ptr& user,
@@ -25,8 +36,17 @@ public:
 	) override;
 
 private:
-	static Dictionary::Ptr SerializeObjectAttrs(const Object::Ptr& object, const String& attrPrefix,
+	/**
+	 * The user-visible fields of a type which were requested, sorted by name.
+	 * The names are stored JSON-encoded, followed by the colon.
+	 */
+	typedef std::vector<std::pair<String, int> > AttributeProjection;
+
+	static AttributeProjection CompileProjection(const Type::Ptr& type, const String& attrPrefix,
 		const Array::Ptr& attrs, bool isJoin, bool allAttrs);
+	static void SerializeObjectAttrs(String& output, const Object::Ptr& object, const AttributeProjection& projection);
+
+	static std::map<String, MetaCallback>& GetMetaRegistry();
 };
 
 }
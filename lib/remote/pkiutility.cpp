@@ -23,7 +23,7 @@
 
 using namespace icinga;
 
-int PkiUtility::NewCa()
+int PkiUtility::NewCa(PrivateKeyType keyType)
 {
 	String caDir = ApiListener::GetCaDir();
 	String caCertFile = caDir + "/ca.crt";
@@ -37,15 +37,15 @@ int PkiUtility::NewCa()
 
 	Utility::MkDirP(caDir, 0700);
 
-	MakeX509CSR("Icinga CA", caKeyFile, String(), caCertFile, true);
+	MakeX509CSR("Icinga CA", caKeyFile, String(), caCertFile, true, keyType);
 
 	return 0;
 }
 
-int PkiUtility::NewCert(const String& cn, const String& keyfile, const String& csrfile, const String& certfile)
+int PkiUtility::NewCert(const String& cn, const String& keyfile, const String& csrfile, const String& certfile, PrivateKeyType keyType)
 {
 	try {
-		MakeX509CSR(cn, keyfile, csrfile, certfile);
+		MakeX509CSR(cn, keyfile, csrfile, certfile, false, keyType);
 	} catch(std::exception&) {
 		return 1;
 	}
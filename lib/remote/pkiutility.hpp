@@ -7,6 +7,7 @@
 #include "base/exception.hpp"
 #include "base/dictionary.hpp"
 #include "base/string.hpp"
+#include "base/tlsutility.hpp"
 #include <openssl/x509v3.h>
 #include <memory>
 
@@ -19,8 +20,9 @@ namespace icinga
 class PkiUtility
 {
 public:
-	static int NewCa();
-	static int NewCert(const String& cn, const String& keyfile, const String& csrfile, const String& certfile);
+	static int NewCa(PrivateKeyType keyType = PrivateKeyRSA);
+	static int NewCert(const String& cn, const String& keyfile, const String& csrfile, const String& certfile,
+		PrivateKeyType keyType = PrivateKeyRSA);
 	static int SignCsr(const String& csrfile, const String& certfile);
 	static std::shared_ptr<X509> FetchCert(const String& host, const String& port);
 	static int WriteCert(const std::shared_ptr<X509>& cert, const String& trustedfile);
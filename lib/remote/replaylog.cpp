@@ -0,0 +1,735 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/replaylog.hpp"
+#include "base/dictionary.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/objectlock.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <zlib.h>
+
+using namespace icinga;
+
+static const char l_ReplayLogMagic[8] = { 'I', '2', 'R', 'L', 'O', 'G', '\0', '\1' };
+static const char l_CompressedReplayLogMagic[8] = { 'I', '2', 'R', 'L', 'O', 'G', 'Z', '\1' };
+
+/* Magic and uncompressed size of a compressed log. */
+static const size_t l_CompressedHeaderSize = 16;
+
+struct ReplayLogRecordHeader
+{
+	uint32_t MessageLength;
+	uint16_t TypeLength;
+	uint16_t NameLength;
+	double Timestamp;
+
+	static const size_t Size = 16;
+
+	uint64_t GetPayloadLength() const
+	{
+		return static_cast<uint64_t>(MessageLength) + TypeLength + NameLength;
+	}
+};
+
+static bool ReadMagic(std::istream& fp, bool& compressed)
+{
+	char magic[sizeof(l_ReplayLogMagic)];
+
+	if (!fp.read(magic, sizeof(magic)))
+		return false;
+
+	compressed = memcmp(magic, l_CompressedReplayLogMagic, sizeof(magic)) == 0;
+
+	return compressed || memcmp(magic, l_ReplayLogMagic, sizeof(magic)) == 0;
+}
+
+static bool ReadMagic(std::istream& fp)
+{
+	bool compressed;
+
+	return ReadMagic(fp, compressed) && !compressed;
+}
+
+static void DecodeRecordHeader(const char *buf, ReplayLogRecordHeader& header)
+{
+	memcpy(&header.MessageLength, buf, sizeof(header.MessageLength));
+	memcpy(&header.TypeLength, buf + 4, sizeof(header.TypeLength));
+	memcpy(&header.NameLength, buf + 6, sizeof(header.NameLength));
+	memcpy(&header.Timestamp, buf + 8, sizeof(header.Timestamp));
+}
+
+static void EncodeRecordHeader(char *buf, const ReplayLogRecordHeader& header)
+{
+	memcpy(buf, &header.MessageLength, sizeof(header.MessageLength));
+	memcpy(buf + 4, &header.TypeLength, sizeof(header.TypeLength));
+	memcpy(buf + 6, &header.NameLength, sizeof(header.NameLength));
+	memcpy(buf + 8, &header.Timestamp, sizeof(header.Timestamp));
+}
+
+static bool ReadRecordHeader(std::istream& fp, ReplayLogRecordHeader& header)
+{
+	char buf[ReplayLogRecordHeader::Size];
+
+	if (!fp.read(buf, sizeof(buf)))
+		return false;
+
+	DecodeRecordHeader(buf, header);
+	return true;
+}
+
+static void WriteRecordHeader(std::ostream& fp, const ReplayLogRecordHeader& header)
+{
+	char buf[ReplayLogRecordHeader::Size];
+
+	EncodeRecordHeader(buf, header);
+	fp.write(buf, sizeof(buf));
+}
+
+template<typename T>
+static bool ReadNumber(std::istream& fp, T& value)
+{
+	return static_cast<bool>(fp.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+template<typename T>
+static void WriteNumber(std::ostream& fp, const T& value)
+{
+	fp.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+/**
+ * Opens the log file for appending. A new file gets the binary log header.
+ * An existing file which isn't an uncompressed binary log is left alone and
+ * the writer isn't good.
+ *
+ * @param path The path of the log file.
+ */
+ReplayLogWriter::ReplayLogWriter(const String& path)
+{
+	boost::system::error_code ec;
+	uint64_t size = boost::filesystem::file_size(path.GetData(), ec);
+
+	if (!ec && size > 0) {
+		/* Find the end of the last complete record (the process might have crashed
+		 * while writing it) and the highest timestamp for the index. */
+		std::ifstream fp (path.CStr(), std::ifstream::in | std::ifstream::binary);
+
+		/* Truncating anything else, e.g. a legacy log which couldn't be rotated, would lose all of it. */
+		if (!ReadMagic(fp)) {
+			Log(LogCritical, "ReplayLogWriter")
+				<< "Refusing to append to '" << path << "': It's not a binary replay log.";
+			return;
+		}
+
+		uint64_t validSize = sizeof(l_ReplayLogMagic);
+		ReplayLogRecordHeader header;
+
+		while (ReadRecordHeader(fp, header)) {
+			uint64_t next = validSize + ReplayLogRecordHeader::Size + header.GetPayloadLength();
+
+			if (next > size)
+				break;
+
+			fp.seekg(next);
+			validSize = next;
+
+			if (header.Timestamp > m_MaxTimestamp)
+				m_MaxTimestamp = header.Timestamp;
+		}
+
+		fp.close();
+
+		/* Only a partial record at the end is cut off. */
+		if (validSize < size)
+			boost::filesystem::resize_file(path.GetData(), validSize, ec);
+	}
+
+	m_File.open(path.CStr(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
+
+	if (!m_File.good())
+		return;
+
+	m_File.seekp(0, std::ios::end);
+	m_Offset = m_File.tellp();
+
+	if (m_Offset == 0) {
+		m_File.write(l_ReplayLogMagic, sizeof(l_ReplayLogMagic));
+		m_Offset = sizeof(l_ReplayLogMagic);
+	}
+
+	m_Index.open(ReplayLogReader::GetIndexPath(path).CStr(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
+}
+
+bool ReplayLogWriter::IsGood() const
+{
+	return m_File.is_open() && m_File.good();
+}
+
+void ReplayLogWriter::Write(const ReplayLogRecord& record)
+{
+	ReplayLogRecordHeader header;
+	header.MessageLength = record.Message.GetLength();
+	header.TypeLength = record.SecobjType.GetLength();
+	header.NameLength = record.SecobjName.GetLength();
+	header.Timestamp = record.Timestamp;
+
+	WriteRecordHeader(m_File, header);
+	m_File.write(record.SecobjType.CStr(), header.TypeLength);
+	m_File.write(record.SecobjName.CStr(), header.NameLength);
+	m_File.write(record.Message.CStr(), header.MessageLength);
+	m_File.flush();
+
+	m_Offset += ReplayLogRecordHeader::Size + header.GetPayloadLength();
+
+	if (record.Timestamp > m_MaxTimestamp)
+		m_MaxTimestamp = record.Timestamp;
+
+	if (++m_UnindexedRecords >= IndexInterval && m_Index.good()) {
+		m_Index.write(reinterpret_cast<const char *>(&m_MaxTimestamp), sizeof(m_MaxTimestamp));
+		m_Index.write(reinterpret_cast<const char *>(&m_Offset), sizeof(m_Offset));
+		m_Index.flush();
+
+		m_UnindexedRecords = 0;
+	}
+}
+
+void ReplayLogWriter::Close()
+{
+	m_File.close();
+
+	if (m_Index.is_open())
+		m_Index.close();
+}
+
+ReplayLogReader::ReplayLogReader(const String& path)
+	: m_Path(path), m_File(path.CStr(), std::ifstream::in | std::ifstream::binary)
+{
+	if (!ReadMagic(m_File, m_Compressed)) {
+		m_File.setstate(std::ios::failbit);
+		return;
+	}
+
+	if (!m_Compressed)
+		return;
+
+	/* The index is stored behind the frames, its offset at the end of the file. */
+	uint64_t rawSize;
+
+	if (!ReadNumber(m_File, rawSize) || !m_File.seekg(-static_cast<std::streamoff>(sizeof(m_FramesEnd)), std::ios::end)) {
+		m_File.setstate(std::ios::failbit);
+		return;
+	}
+
+	uint64_t indexEnd = m_File.tellg();
+
+	if (!ReadNumber(m_File, m_FramesEnd) || m_FramesEnd < l_CompressedHeaderSize || m_FramesEnd > indexEnd) {
+		m_File.setstate(std::ios::failbit);
+		return;
+	}
+
+	m_IndexEnd = indexEnd;
+	m_File.seekg(l_CompressedHeaderSize);
+}
+
+/**
+ * Checks whether the specified file is a binary replay log, compressed or
+ * not. Older versions used JSON netstrings instead.
+ *
+ * @param path The path of the log file.
+ * @returns true if the file starts with a binary log header, false otherwise
+ */
+bool ReplayLogReader::IsBinaryLog(const String& path)
+{
+	std::ifstream fp (path.CStr(), std::ifstream::in | std::ifstream::binary);
+	bool compressed;
+
+	return ReadMagic(fp, compressed);
+}
+
+/**
+ * Checks whether the specified file is a binary replay log which has been
+ * compressed by ReplayLogCompressor.
+ *
+ * @param path The path of the log file.
+ * @returns true if the file starts with the compressed log header, false otherwise
+ */
+bool ReplayLogReader::IsCompressedLog(const String& path)
+{
+	std::ifstream fp (path.CStr(), std::ifstream::in | std::ifstream::binary);
+	bool compressed;
+
+	return ReadMagic(fp, compressed) && compressed;
+}
+
+/**
+ * Checks whether the specified file is a non-empty log file in the JSON
+ * netstring format used by older versions.
+ *
+ * @param path The path of the log file.
+ * @returns true if the file is a legacy log, false otherwise
+ */
+bool ReplayLogReader::IsLegacyLog(const String& path)
+{
+	std::ifstream fp (path.CStr(), std::ifstream::in | std::ifstream::binary);
+
+	if (!fp || fp.peek() == std::ifstream::traits_type::eof())
+		return false;
+
+	bool compressed;
+
+	return !ReadMagic(fp, compressed);
+}
+
+String ReplayLogReader::GetIndexPath(const String& path)
+{
+	return path + ".idx";
+}
+
+bool ReplayLogReader::IsGood() const
+{
+	return m_File.good();
+}
+
+/**
+ * Skips all records which are known to have a timestamp less than or equal
+ * to the specified timestamp, based on the index file.
+ *
+ * @param after The timestamp.
+ */
+void ReplayLogReader::Seek(double after)
+{
+	if (!m_File.good())
+		return;
+
+	std::ifstream indexFile;
+
+	/* A compressed log's index points to the start of its frames. */
+	if (m_Compressed)
+		m_File.seekg(m_FramesEnd);
+	else
+		indexFile.open(GetIndexPath(m_Path).CStr(), std::ifstream::in | std::ifstream::binary);
+
+	std::istream& index (m_Compressed ? static_cast<std::istream&>(m_File) : indexFile);
+	uint64_t offset = 0;
+
+	for (;;) {
+		if (m_Compressed && static_cast<uint64_t>(m_File.tellg()) >= m_IndexEnd)
+			break;
+
+		double ts;
+		uint64_t entryOffset;
+
+		if (!ReadNumber(index, ts) || !ReadNumber(index, entryOffset))
+			break;
+
+		/* The entries' timestamps are monotonic. */
+		if (ts > after)
+			break;
+
+		offset = entryOffset;
+	}
+
+	if (m_Compressed) {
+		m_File.clear();
+		m_File.seekg(offset > 0 ? offset : l_CompressedHeaderSize);
+
+		m_Frame.clear();
+		m_FramePos = 0;
+	} else if (offset > 0)
+		m_File.seekg(offset);
+}
+
+/**
+ * Reads the next record which has a timestamp greater than the specified
+ * timestamp. The payload of all other records is skipped without reading it.
+ *
+ * @param record Receives the record.
+ * @param after The timestamp.
+ * @returns true if a record was read, false on EOF or if the file is truncated
+ */
+bool ReplayLogReader::ReadNext(ReplayLogRecord& record, double after)
+{
+	char buf[ReplayLogRecordHeader::Size];
+
+	while (ReadBytes(buf, sizeof(buf))) {
+		ReplayLogRecordHeader header;
+		DecodeRecordHeader(buf, header);
+
+		if (header.Timestamp <= after) {
+			if (!SkipBytes(header.GetPayloadLength()))
+				return false;
+
+			continue;
+		}
+
+		std::string type (header.TypeLength, '\0'), name (header.NameLength, '\0'), message (header.MessageLength, '\0');
+
+		if (!ReadBytes(&type[0], type.size()) || !ReadBytes(&name[0], name.size()) || !ReadBytes(&message[0], message.size()))
+			return false;
+
+		record.Timestamp = header.Timestamp;
+		record.SecobjType = std::move(type);
+		record.SecobjName = std::move(name);
+		record.Message = std::move(message);
+
+		return true;
+	}
+
+	return false;
+}
+
+bool ReplayLogReader::ReadBytes(char *buffer, size_t length)
+{
+	if (!m_Compressed)
+		return length == 0 || m_File.read(buffer, length);
+
+	while (length > 0) {
+		if (m_FramePos >= m_Frame.size() && !ReadFrame())
+			return false;
+
+		size_t count = std::min(length, m_Frame.size() - m_FramePos);
+		memcpy(buffer, m_Frame.data() + m_FramePos, count);
+
+		m_FramePos += count;
+		buffer += count;
+		length -= count;
+	}
+
+	return true;
+}
+
+bool ReplayLogReader::SkipBytes(uint64_t length)
+{
+	if (!m_Compressed)
+		return static_cast<bool>(m_File.seekg(static_cast<std::streamoff>(length), std::ios::cur));
+
+	while (length > 0) {
+		if (m_FramePos >= m_Frame.size() && !ReadFrame())
+			return false;
+
+		size_t count = std::min<uint64_t>(length, m_Frame.size() - m_FramePos);
+
+		m_FramePos += count;
+		length -= count;
+	}
+
+	return true;
+}
+
+/**
+ * Inflates the next frame of a compressed log.
+ *
+ * @returns false after the last frame or if the frame is damaged
+ */
+bool ReplayLogReader::ReadFrame()
+{
+	if (!m_File.good() || static_cast<uint64_t>(m_File.tellg()) >= m_FramesEnd)
+		return false;
+
+	uint32_t compressedLength, rawLength;
+
+	if (!ReadNumber(m_File, compressedLength) || !ReadNumber(m_File, rawLength) || rawLength == 0)
+		return false;
+
+	std::string compressed (compressedLength, '\0');
+
+	if (!m_File.read(&compressed[0], compressed.size()))
+		return false;
+
+	m_Frame.resize(rawLength);
+	m_FramePos = 0;
+
+	uLongf used = rawLength;
+	int rc = uncompress(reinterpret_cast<Bytef *>(&m_Frame[0]), &used, reinterpret_cast<const Bytef *>(compressed.data()), compressed.size());
+
+	if (rc != Z_OK || used != rawLength) {
+		m_Frame.clear();
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Writes a compressed copy of a binary log file. A truncated last record is
+ * left out.
+ *
+ * @param path The path of the binary log file.
+ * @param compressedPath The path of the compressed copy.
+ * @param savedBytes Receives how much smaller the compressed copy is.
+ * @returns true if the copy has been written and is smaller, false otherwise
+ */
+bool ReplayLogCompressor::Compress(const String& path, const String& compressedPath, uint64_t& savedBytes)
+{
+	std::ifstream input (path.CStr(), std::ifstream::in | std::ifstream::binary);
+
+	if (!ReadMagic(input))
+		return false;
+
+	std::ofstream output (compressedPath.CStr(), std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+
+	if (!output)
+		return false;
+
+	uint64_t rawSize = sizeof(l_ReplayLogMagic);
+
+	output.write(l_CompressedReplayLogMagic, sizeof(l_CompressedReplayLogMagic));
+	WriteNumber(output, rawSize);
+
+	uint64_t offset = l_CompressedHeaderSize;
+	std::vector<std::pair<double, uint64_t> > index;
+	std::string frame;
+	size_t frameRecords = 0;
+	double maxTimestamp = 0;
+
+	auto writeFrame ([&output, &offset, &index, &frame, &frameRecords, &maxTimestamp]() -> bool {
+		if (frame.empty())
+			return true;
+
+		if (frame.size() > std::numeric_limits<uint32_t>::max())
+			return false;
+
+		std::string compressed;
+		compressed.resize(compressBound(frame.size()));
+
+		uLongf used = compressed.size();
+
+		if (compress2(reinterpret_cast<Bytef *>(&compressed[0]), &used, reinterpret_cast<const Bytef *>(frame.data()),
+			frame.size(), Z_DEFAULT_COMPRESSION) != Z_OK)
+			return false;
+
+		WriteNumber(output, static_cast<uint32_t>(used));
+		WriteNumber(output, static_cast<uint32_t>(frame.size()));
+		output.write(compressed.data(), used);
+
+		offset += sizeof(uint32_t) * 2 + used;
+
+		/* All records before the next frame are at most as new as the newest one so far. */
+		index.emplace_back(maxTimestamp, offset);
+
+		frame.clear();
+		frameRecords = 0;
+
+		return true;
+	});
+
+	char buf[ReplayLogRecordHeader::Size];
+
+	while (input.read(buf, sizeof(buf))) {
+		ReplayLogRecordHeader header;
+		DecodeRecordHeader(buf, header);
+
+		size_t start = frame.size();
+		uint64_t recordSize = ReplayLogRecordHeader::Size + header.GetPayloadLength();
+
+		frame.resize(start + recordSize);
+		memcpy(&frame[start], buf, sizeof(buf));
+
+		if (!input.read(&frame[start + sizeof(buf)], header.GetPayloadLength())) {
+			frame.resize(start);
+			break;
+		}
+
+		rawSize += recordSize;
+
+		if (header.Timestamp > maxTimestamp)
+			maxTimestamp = header.Timestamp;
+
+		if ((++frameRecords >= ReplayLogWriter::IndexInterval || frame.size() >= MaxFrameSize) && !writeFrame())
+			return false;
+	}
+
+	if (!writeFrame())
+		return false;
+
+	for (auto& entry : index) {
+		WriteNumber(output, entry.first);
+		WriteNumber(output, entry.second);
+	}
+
+	WriteNumber(output, offset);
+
+	uint64_t compressedSize = output.tellp();
+
+	output.seekp(sizeof(l_CompressedReplayLogMagic));
+	WriteNumber(output, rawSize);
+	output.close();
+
+	if (!output || compressedSize >= rawSize)
+		return false;
+
+	savedBytes = rawSize - compressedSize;
+	return true;
+}
+
+/**
+ * @param path The path of a log file.
+ * @returns How much smaller the file is than the uncompressed log, 0 unless it's compressed
+ */
+uint64_t ReplayLogCompressor::GetSavedBytes(const String& path)
+{
+	std::ifstream fp (path.CStr(), std::ifstream::in | std::ifstream::binary);
+	bool compressed;
+	uint64_t rawSize;
+
+	if (!ReadMagic(fp, compressed) || !compressed || !ReadNumber(fp, rawSize))
+		return 0;
+
+	boost::system::error_code ec;
+	uint64_t size = boost::filesystem::file_size(path.GetData(), ec);
+
+	if (ec || size >= rawSize)
+		return 0;
+
+	return rawSize - size;
+}
+
+/* The methods whose messages set the complete value of an attribute, so only the last one matters. */
+static const char * const l_CompactableMethods[] = {
+	"event::SetNextCheck",
+	"event::SetLastCheckStarted",
+	"event::SetForceNextCheck",
+	"event::SetForceNextNotification",
+	"event::SetNextNotification",
+	"event::SetSuppressedNotifications",
+	"event::SetSuppressedNotificationTypes"
+};
+
+/**
+ * @param compactCheckResults Whether check results which don't change the checkable's
+ * state, state type, attempt or reachability may be left out, too. The peer's metric
+ * writers miss them then.
+ */
+ReplayLogCompactor::ReplayLogCompactor(bool compactCheckResults)
+	: m_CompactCheckResults(compactCheckResults)
+{
+}
+
+/**
+ * Extracts the method from a JSON encoded message without decoding it.
+ *
+ * @param message The message as written by JsonEncode()
+ * @returns The method or an empty string
+ */
+String ReplayLogCompactor::GetMethod(const String& message)
+{
+	static const String prefix = "\"method\":\"";
+
+	auto begin (message.Find(prefix));
+
+	if (begin == String::NPos)
+		return String();
+
+	begin += prefix.GetLength();
+
+	auto end (message.FindFirstOf('"', begin));
+
+	if (end == String::NPos)
+		return String();
+
+	return message.SubStr(begin, end - begin);
+}
+
+/**
+ * Returns the object and method a record carries the state of.
+ *
+ * @param record The record
+ * @param method Gets the record's method
+ * @returns The key or an empty string if the record has to be replayed anyway
+ */
+String ReplayLogCompactor::GetKey(const ReplayLogRecord& record, String& method) const
+{
+	if (record.SecobjType.IsEmpty())
+		return String();
+
+	method = GetMethod(record.Message);
+
+	bool compactable = m_CompactCheckResults && method == "event::CheckResult";
+
+	for (auto compactableMethod : l_CompactableMethods) {
+		if (method == compactableMethod) {
+			compactable = true;
+			break;
+		}
+	}
+
+	if (!compactable)
+		return String();
+
+	/* Object names may contain anything, types and methods no tabs. */
+	return method + "\t" + record.SecobjType + "\t" + record.SecobjName;
+}
+
+/**
+ * Whether a check result changes anything besides the check result itself.
+ */
+static bool IsStateChange(const String& message)
+{
+	Dictionary::Ptr params;
+
+	try {
+		params = Dictionary::Ptr(JsonDecode(message))->Get("params");
+	} catch (const std::exception&) {
+		return true;
+	}
+
+	Value cr;
+
+	if (!params || !params->Get("cr", &cr) || !cr.IsObjectType<Dictionary>())
+		return true;
+
+	Value before = Dictionary::Ptr(cr)->Get("vars_before");
+	Value after = Dictionary::Ptr(cr)->Get("vars_after");
+
+	if (!before.IsObjectType<Dictionary>() || !after.IsObjectType<Dictionary>())
+		return true;
+
+	Dictionary::Ptr varsBefore = before;
+	Dictionary::Ptr varsAfter = after;
+
+	ObjectLock olock(varsAfter);
+
+	for (const Dictionary::Pair& kv : varsAfter) {
+		if (varsBefore->Get(kv.first) != kv.second)
+			return true;
+	}
+
+	return false;
+}
+
+void ReplayLogCompactor::Add(const ReplayLogRecord& record)
+{
+	String method;
+	String key = GetKey(record, method);
+
+	if (key.IsEmpty())
+		return;
+
+	if (method == "event::CheckResult" && IsStateChange(record.Message))
+		m_StateChanges.emplace(key, record.Timestamp);
+
+	double& latest (m_LatestRecords[key]);
+
+	if (record.Timestamp > latest)
+		latest = record.Timestamp;
+}
+
+bool ReplayLogCompactor::IsSuperseded(const ReplayLogRecord& record) const
+{
+	String method;
+	String key = GetKey(record, method);
+
+	if (key.IsEmpty())
+		return false;
+
+	auto latest (m_LatestRecords.find(key));
+
+	/* The latest record or one appended to the log after all records have been added. */
+	if (latest == m_LatestRecords.end() || record.Timestamp >= latest->second)
+		return false;
+
+	return m_StateChanges.find(std::make_pair(key, record.Timestamp)) == m_StateChanges.end();
+}
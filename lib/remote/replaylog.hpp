@@ -0,0 +1,161 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef REPLAYLOG_H
+#define REPLAYLOG_H
+
+#include "remote/i2-remote.hpp"
+#include "base/object.hpp"
+#include "base/string.hpp"
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A single message in the cluster replay log.
+ *
+ * @ingroup remote
+ */
+struct ReplayLogRecord
+{
+	double Timestamp{0};
+	String SecobjType;
+	String SecobjName;
+	String Message;
+};
+
+/**
+ * Appends messages to a binary replay log file.
+ *
+ * A binary log starts with an 8 byte header (magic and version) which is
+ * followed by the records. Each record consists of a 16 byte header (uint32
+ * message length, uint16 secobj type length, uint16 secobj name length, double
+ * timestamp) and the secobj type, secobj name and message bytes. Numbers are
+ * stored in host byte order as the files never leave the local node.
+ *
+ * Every IndexInterval records an entry is appended to the index file (the log
+ * file's path + ".idx"). An entry is a pair of (double, uint64) which states
+ * that all records stored before the offset have a timestamp less than or
+ * equal to the entry's timestamp.
+ *
+ * @ingroup remote
+ */
+class ReplayLogWriter final : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(ReplayLogWriter);
+
+	static const size_t IndexInterval = 1000;
+
+	ReplayLogWriter(const String& path);
+
+	bool IsGood() const;
+
+	void Write(const ReplayLogRecord& record);
+	void Close();
+
+private:
+	std::ofstream m_File;
+	std::ofstream m_Index;
+	uint64_t m_Offset{0};
+	size_t m_UnindexedRecords{0};
+	double m_MaxTimestamp{0};
+};
+
+/**
+ * Reads a binary replay log file.
+ *
+ * @ingroup remote
+ */
+class ReplayLogReader final
+{
+public:
+	ReplayLogReader(const String& path);
+
+	static bool IsBinaryLog(const String& path);
+	static bool IsCompressedLog(const String& path);
+	static bool IsLegacyLog(const String& path);
+	static String GetIndexPath(const String& path);
+
+	bool IsGood() const;
+
+	void Seek(double after);
+	bool ReadNext(ReplayLogRecord& record, double after);
+
+private:
+	String m_Path;
+	std::ifstream m_File;
+
+	bool m_Compressed{false};
+	uint64_t m_FramesEnd{0};
+	uint64_t m_IndexEnd{0};
+	std::string m_Frame;
+	size_t m_FramePos{0};
+
+	bool ReadBytes(char *buffer, size_t length);
+	bool SkipBytes(uint64_t length);
+	bool ReadFrame();
+};
+
+/**
+ * Compresses rotated binary log files, they're only read again for replaying.
+ *
+ * A compressed log starts with an 8 byte header (magic and version) and the
+ * uint64 size of the uncompressed log. It's followed by frames, each of them
+ * consisting of the uint32 compressed and uncompressed length and the zlib
+ * compressed records. Every frame holds complete records only, up to
+ * ReplayLogWriter::IndexInterval records or MaxFrameSize bytes.
+ *
+ * The frames are followed by the index, its entries are the same as in the
+ * index file of an uncompressed log but point to the start of a frame. The
+ * file ends with the uint64 offset of the index. As the index is part of the
+ * file, replacing an uncompressed log with its compressed copy doesn't
+ * interfere with readers of the uncompressed one.
+ *
+ * @ingroup remote
+ */
+class ReplayLogCompressor final
+{
+public:
+	static const size_t MaxFrameSize = 1024 * 1024;
+
+	static bool Compress(const String& path, const String& compressedPath, uint64_t& savedBytes);
+	static uint64_t GetSavedBytes(const String& path);
+};
+
+/**
+ * Finds the records which don't have to be replayed because a later record
+ * of the same object and method carries the complete state anyway, e.g. all
+ * but the last event::SetNextCheck of a checkable.
+ *
+ * All records which are going to be replayed have to be added first.
+ *
+ * @ingroup remote
+ */
+class ReplayLogCompactor final
+{
+public:
+	ReplayLogCompactor(bool compactCheckResults);
+
+	void Add(const ReplayLogRecord& record);
+	bool IsSuperseded(const ReplayLogRecord& record) const;
+
+	static String GetMethod(const String& message);
+
+private:
+	bool m_CompactCheckResults;
+	std::map<String, double> m_LatestRecords;
+	std::set<std::pair<String, double>> m_StateChanges;
+
+	String GetKey(const ReplayLogRecord& record, String& method) const;
+};
+
+}
+
+#endif /* REPLAYLOG_H */
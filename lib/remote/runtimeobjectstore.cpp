@@ -0,0 +1,496 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/runtimeobjectstore.hpp"
+#include "remote/configobjectutility.hpp"
+#include "config/activationcontext.hpp"
+#include "config/configitembuilder.hpp"
+#include "base/configtype.hpp"
+#include "base/configuration.hpp"
+#include "base/configwriter.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/netstring.hpp"
+#include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include "base/workqueue.hpp"
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+using namespace icinga;
+
+typedef std::pair<String, String> RuntimeObjectKey;
+
+static std::mutex l_RuntimeObjectsMutex;
+/* The attributes of all live objects by their type and full name. */
+static std::map<RuntimeObjectKey, Dictionary::Ptr> l_RuntimeObjects;
+static std::ofstream l_Journal;
+static bool l_JournalLoaded = false;
+static bool l_JournalDamaged = false;
+static size_t l_JournalRecords = 0;
+
+/* The journal is rewritten once it holds this many obsolete records more than live ones. */
+static const size_t l_JournalSlack = 1000;
+
+static Dictionary::Ptr MakeRecord(const RuntimeObjectKey& key, const Dictionary::Ptr& attrs)
+{
+	Dictionary::Ptr record = new Dictionary({
+		{ "type", key.first },
+		{ "name", key.second }
+	});
+
+	if (attrs)
+		record->Set("attrs", attrs);
+	else
+		record->Set("removed", true);
+
+	return record;
+}
+
+/* Has to be called with l_RuntimeObjectsMutex held. */
+static void ReadJournal()
+{
+	String path = RuntimeObjectStore::GetJournalPath();
+
+	l_RuntimeObjects.clear();
+	l_JournalLoaded = true;
+	l_JournalDamaged = false;
+	l_JournalRecords = 0;
+
+	if (!Utility::PathExists(path))
+		return;
+
+	std::ifstream fp (path.CStr(), std::ios_base::in | std::ios_base::binary);
+	String content ((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
+
+	const char *data = content.CStr();
+	const char *end = data + content.GetLength();
+	boost::string_view message;
+
+	try {
+		while (NetString::ReadStringFromBuffer(data, end, message)) {
+			Dictionary::Ptr record = JsonDecode(String(message.begin(), message.end()));
+
+			if (!record)
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Journal record is not a dictionary"));
+
+			RuntimeObjectKey key (record->Get("type"), record->Get("name"));
+
+			if (record->Get("removed").ToBool()) {
+				l_RuntimeObjects.erase(key);
+			} else {
+				Dictionary::Ptr attrs = record->Get("attrs");
+
+				if (!attrs)
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Journal record has no attributes"));
+
+				l_RuntimeObjects[key] = attrs;
+			}
+
+			l_JournalRecords++;
+		}
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "RuntimeObjectStore")
+			<< "Could not read journal '" << path << "': " << DiagnosticInformation(ex, false);
+
+		l_JournalDamaged = true;
+	}
+
+	/* The process might have been killed while writing the last record. */
+	if (data != end && !l_JournalDamaged) {
+		Log(LogWarning, "RuntimeObjectStore")
+			<< "Ignoring the incomplete last record of journal '" << path << "'.";
+
+		l_JournalDamaged = true;
+	}
+}
+
+/* Has to be called with l_RuntimeObjectsMutex held. */
+static void CompactJournal()
+{
+	String path = RuntimeObjectStore::GetJournalPath();
+	String tempPath;
+
+	l_Journal.close();
+	l_Journal.clear();
+
+	try {
+		std::fstream fp;
+		tempPath = Utility::CreateTempFile(path + ".XXXXXX", 0600, fp);
+
+		for (auto& kv : l_RuntimeObjects)
+			NetString::WriteStringToStream(fp, JsonEncode(MakeRecord(kv.first, kv.second)));
+
+		fp.close();
+
+		if (fp.fail())
+			BOOST_THROW_EXCEPTION(std::runtime_error("Could not write '" + tempPath + "'"));
+
+		Utility::RenameFile(tempPath, path);
+	} catch (const std::exception&) {
+		if (!tempPath.IsEmpty() && Utility::PathExists(tempPath))
+			Utility::Remove(tempPath);
+
+		throw;
+	}
+
+	Log(LogNotice, "RuntimeObjectStore")
+		<< "Compacted journal '" << path << "' from " << l_JournalRecords << " to " << l_RuntimeObjects.size() << " records.";
+
+	l_JournalRecords = l_RuntimeObjects.size();
+	l_JournalDamaged = false;
+}
+
+/**
+ * Applies the records to the live objects and writes them to the journal
+ * in one go. Has to be called with l_RuntimeObjectsMutex held.
+ */
+static void WriteJournal(const std::vector<std::pair<RuntimeObjectKey, Dictionary::Ptr> >& records)
+{
+	if (!l_JournalLoaded)
+		ReadJournal();
+
+	for (auto& record : records) {
+		if (record.second)
+			l_RuntimeObjects[record.first] = record.second;
+		else
+			l_RuntimeObjects.erase(record.first);
+	}
+
+	/* A rewritten journal holds the records already. */
+	if (l_JournalDamaged || l_JournalRecords + records.size() > l_RuntimeObjects.size() * 2 + l_JournalSlack) {
+		CompactJournal();
+		return;
+	}
+
+	String path = RuntimeObjectStore::GetJournalPath();
+
+	if (!l_Journal.is_open()) {
+		Utility::MkDirP(Utility::DirName(path), 0700);
+		l_Journal.open(path.CStr(), std::ios_base::out | std::ios_base::app | std::ios_base::binary);
+	}
+
+	std::ostringstream buf;
+
+	for (auto& record : records)
+		NetString::WriteStringToStream(buf, JsonEncode(MakeRecord(record.first, record.second)));
+
+	l_Journal << buf.str();
+	l_Journal.flush();
+
+	if (!l_Journal) {
+		l_Journal.close();
+		l_Journal.clear();
+
+		/* Whatever made it into the file, it's rewritten next time. */
+		l_JournalDamaged = true;
+
+		BOOST_THROW_EXCEPTION(std::runtime_error("Could not write journal '" + path + "'"));
+	}
+
+	l_JournalRecords += records.size();
+}
+
+String RuntimeObjectStore::GetJournalPath()
+{
+	return Configuration::DataDir + "/api/runtime-objects.journal";
+}
+
+bool RuntimeObjectStore::IsStoredType(const Type::Ptr& type)
+{
+	/* if (type == Comment::TypeInstance || type == Downtime::TypeInstance)
+	 * Does not work since this would require libicinga, which has a dependency on libremote.
+	 */
+	return type->GetName() == "Comment" || type->GetName() == "Downtime";
+}
+
+/**
+ * Reads the journal and registers the config items of all objects in it.
+ * They're committed and activated together with all other config items.
+ */
+void RuntimeObjectStore::Load()
+{
+	std::vector<std::pair<RuntimeObjectKey, Dictionary::Ptr> > objects;
+
+	{
+		std::unique_lock<std::mutex> lock (l_RuntimeObjectsMutex);
+
+		ReadJournal();
+		objects.assign(l_RuntimeObjects.begin(), l_RuntimeObjects.end());
+	}
+
+	for (auto& object : objects) {
+		Type::Ptr type = Type::GetByName(object.first.first);
+
+		if (!type) {
+			Log(LogWarning, "RuntimeObjectStore")
+				<< "Ignoring object '" << object.first.second << "' of unknown type '" << object.first.first << "'.";
+			continue;
+		}
+
+		BuildItem(type, object.second)->Register();
+	}
+
+	if (!objects.empty()) {
+		Log(LogInformation, "RuntimeObjectStore")
+			<< "Loaded " << objects.size() << " runtime objects from '" << GetJournalPath() << "'.";
+	}
+}
+
+/**
+ * Creates objects of the same type in one go, like
+ * ConfigObjectUtility::CreateObjects() but without any config files. All
+ * objects are written to the journal at once and their items are committed
+ * and activated together, so either all objects are created or none.
+ *
+ * Objects which reference missing objects are ignored, just like runtime
+ * objects from config files are.
+ *
+ * @param type The objects' type
+ * @param objects The objects' full names and their attributes, see ConfigObjectUtility::CreateObjectAttrs()
+ * @returns Whether the objects were created
+ */
+bool RuntimeObjectStore::CreateObjects(const Type::Ptr& type, const std::vector<std::pair<String, Dictionary::Ptr> >& objects,
+	const Array::Ptr& errors, const Array::Ptr& diagnosticInformation, const Value& cookie)
+{
+	auto *ctype = dynamic_cast<ConfigType *>(type.get());
+
+	{
+		std::set<String> names;
+
+		for (auto& object : objects) {
+			if (ctype->GetObject(object.first) || !names.insert(object.first).second) {
+				errors->Add("Object '" + object.first + "' already exists.");
+				return false;
+			}
+		}
+	}
+
+	/* Only for logging. */
+	String names = objects.size() == 1 ? "'" + objects[0].first + "'" : Convert::ToString(objects.size()) + " objects";
+
+	std::vector<std::pair<RuntimeObjectKey, Dictionary::Ptr> > records;
+	records.reserve(objects.size());
+
+	auto removeRecords ([&records]() {
+		for (auto& record : records)
+			record.second = nullptr;
+
+		try {
+			std::unique_lock<std::mutex> lock (l_RuntimeObjectsMutex);
+			WriteJournal(records);
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "RuntimeObjectStore")
+				<< "Could not remove objects from the journal: " << DiagnosticInformation(ex, false);
+		}
+	});
+
+	try {
+		for (auto& object : objects) {
+			records.emplace_back(RuntimeObjectKey(type->GetName(), object.first),
+				ConfigObjectUtility::CreateObjectAttrs(type, object.first, object.second));
+		}
+	} catch (const std::exception& ex) {
+		if (errors)
+			errors->Add(DiagnosticInformation(ex, false));
+
+		if (diagnosticInformation)
+			diagnosticInformation->Add(DiagnosticInformation(ex));
+
+		return false;
+	}
+
+	/* Written before the objects exist, so that deleting them right away works. */
+	try {
+		std::unique_lock<std::mutex> lock (l_RuntimeObjectsMutex);
+		WriteJournal(records);
+	} catch (const std::exception& ex) {
+		removeRecords();
+
+		if (errors)
+			errors->Add(DiagnosticInformation(ex, false));
+
+		if (diagnosticInformation)
+			diagnosticInformation->Add(DiagnosticInformation(ex));
+
+		return false;
+	}
+
+	try {
+		ActivationScope ascope;
+
+		for (auto& record : records)
+			BuildItem(type, record.second)->Register();
+
+		WorkQueue upq;
+		upq.SetName("RuntimeObjectStore::CreateObjects");
+
+		std::vector<ConfigItem::Ptr> newItems;
+
+		/*
+		 * Activate the config objects.
+		 * IMPORTANT: Forward the cookie aka origin in order to prevent sync loops in the same zone!
+		 */
+		if (!ConfigItem::CommitItems(ascope.GetContext(), upq, newItems, true) ||
+			!ConfigItem::ActivateItems(newItems, true, true, false, cookie)) {
+			Log(LogNotice, "RuntimeObjectStore")
+				<< "Failed to create " << names << " of type '" << type->GetName() << "'. Aborting and removing them from the journal.";
+
+			removeRecords();
+
+			for (const boost::exception_ptr& ex : upq.GetExceptions()) {
+				if (errors)
+					errors->Add(DiagnosticInformation(ex, false));
+
+				if (diagnosticInformation)
+					diagnosticInformation->Add(DiagnosticInformation(ex));
+			}
+
+			return false;
+		}
+	} catch (const std::exception& ex) {
+		removeRecords();
+
+		if (errors)
+			errors->Add(DiagnosticInformation(ex, false));
+
+		if (diagnosticInformation)
+			diagnosticInformation->Add(DiagnosticInformation(ex));
+
+		return false;
+	}
+
+	/* Ignored objects must not come back on the next start. */
+	std::vector<std::pair<RuntimeObjectKey, Dictionary::Ptr> > ignored;
+
+	for (auto& record : records) {
+		if (!ctype->GetObject(record.first.second)) {
+			Log(LogNotice, "RuntimeObjectStore")
+				<< "Object '" << record.first.second << "' was not created but ignored due to errors.";
+
+			ignored.emplace_back(record.first, nullptr);
+		}
+	}
+
+	if (!ignored.empty()) {
+		try {
+			std::unique_lock<std::mutex> lock (l_RuntimeObjectsMutex);
+			WriteJournal(ignored);
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "RuntimeObjectStore")
+				<< "Could not remove ignored objects from the journal: " << DiagnosticInformation(ex, false);
+		}
+	}
+
+	Log(LogInformation, "RuntimeObjectStore")
+		<< "Created and activated " << names << " of type '" << type->GetName() << "'.";
+
+	return true;
+}
+
+/**
+ * Removes an object from the journal. The object itself has to be
+ * deactivated and unregistered by the caller.
+ *
+ * @returns Whether the object was stored here
+ */
+bool RuntimeObjectStore::RemoveObject(const Type::Ptr& type, const String& fullName)
+{
+	if (!IsStoredType(type))
+		return false;
+
+	RuntimeObjectKey key (type->GetName(), fullName);
+	std::unique_lock<std::mutex> lock (l_RuntimeObjectsMutex);
+
+	if (!l_JournalLoaded)
+		ReadJournal();
+
+	if (l_RuntimeObjects.find(key) == l_RuntimeObjects.end())
+		return false;
+
+	try {
+		WriteJournal({ { key, nullptr } });
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "RuntimeObjectStore")
+			<< "Could not remove object '" << fullName << "' from the journal: " << DiagnosticInformation(ex, false);
+	}
+
+	return true;
+}
+
+/**
+ * @returns The attributes of a stored object, nullptr if it isn't stored here
+ */
+Dictionary::Ptr RuntimeObjectStore::GetObjectAttrs(const Type::Ptr& type, const String& fullName)
+{
+	std::unique_lock<std::mutex> lock (l_RuntimeObjectsMutex);
+	auto it (l_RuntimeObjects.find(RuntimeObjectKey(type->GetName(), fullName)));
+
+	if (it == l_RuntimeObjects.end())
+		return nullptr;
+
+	return it->second->ShallowClone();
+}
+
+/**
+ * Renders the config of a stored object for cluster peers which don't know
+ * this store and create runtime objects from config files.
+ *
+ * @param attrs The object's attributes, see GetObjectAttrs()
+ */
+String RuntimeObjectStore::GetObjectConfig(const Type::Ptr& type, const Dictionary::Ptr& attrs)
+{
+	Dictionary::Ptr allAttrs = attrs->ShallowClone();
+	String name = allAttrs->Get("name");
+
+	allAttrs->Remove("name");
+
+	std::ostringstream config;
+	ConfigWriter::EmitConfigItem(config, type->GetName(), name, false, true, nullptr, allAttrs);
+	ConfigWriter::EmitRaw(config, "\n");
+
+	return config.str();
+}
+
+/**
+ * Builds the config item of a stored object again, e.g. for an in-process reload.
+ *
+ * @returns The item which has to be registered, nullptr if the object isn't stored here
+ */
+ConfigItem::Ptr RuntimeObjectStore::CreateItem(const Type::Ptr& type, const String& fullName)
+{
+	Dictionary::Ptr attrs = GetObjectAttrs(type, fullName);
+
+	if (!attrs)
+		return nullptr;
+
+	return BuildItem(type, attrs);
+}
+
+ConfigItem::Ptr RuntimeObjectStore::BuildItem(const Type::Ptr& type, const Dictionary::Ptr& attrs)
+{
+	DebugInfo di;
+	di.Path = GetJournalPath();
+
+	ConfigItemBuilder builder(di);
+	builder.SetType(type);
+	builder.SetName(attrs->Get("name"));
+	builder.SetZone(attrs->Get("zone"));
+	builder.SetPackage("_api");
+	builder.SetIgnoreOnError(true);
+
+	ObjectLock olock(attrs);
+	for (const Dictionary::Pair& kv : attrs) {
+		if (kv.first == "name")
+			continue;
+
+		builder.AddExpression(new SetExpression(MakeIndexer(ScopeThis, kv.first), OpSetLiteral, MakeLiteral(kv.second), di));
+	}
+
+	return builder.Compile();
+}
@@ -0,0 +1,54 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef RUNTIMEOBJECTSTORE_H
+#define RUNTIMEOBJECTSTORE_H
+
+#include "remote/i2-remote.hpp"
+#include "config/configitem.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include "base/type.hpp"
+#include <utility>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * Keeps runtime objects which are created and deleted frequently, i.e.
+ * comments and downtimes, in a journal instead of one config file each.
+ *
+ * The journal consists of netstring-encoded JSON records. A record either
+ * adds an object with its attributes or removes it again. Once most of the
+ * records are obsolete, the journal is rewritten with the live objects only.
+ *
+ * The objects' config items are built from their attributes directly, so
+ * there's neither a file nor a config compiler involved.
+ *
+ * @ingroup remote
+ */
+class RuntimeObjectStore
+{
+public:
+	static String GetJournalPath();
+	static bool IsStoredType(const Type::Ptr& type);
+
+	static void Load();
+
+	static bool CreateObjects(const Type::Ptr& type, const std::vector<std::pair<String, Dictionary::Ptr> >& objects,
+		const Array::Ptr& errors, const Array::Ptr& diagnosticInformation, const Value& cookie = Empty);
+	static bool RemoveObject(const Type::Ptr& type, const String& fullName);
+
+	static Dictionary::Ptr GetObjectAttrs(const Type::Ptr& type, const String& fullName);
+	static String GetObjectConfig(const Type::Ptr& type, const Dictionary::Ptr& attrs);
+	static ConfigItem::Ptr CreateItem(const Type::Ptr& type, const String& fullName);
+
+private:
+	RuntimeObjectStore();
+
+	static ConfigItem::Ptr BuildItem(const Type::Ptr& type, const Dictionary::Ptr& attrs);
+};
+
+}
+
+#endif /* RUNTIMEOBJECTSTORE_H */
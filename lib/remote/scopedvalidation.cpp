@@ -0,0 +1,130 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/scopedvalidation.hpp"
+#include "remote/apilistener.hpp"
+#include "remote/configdiffreload.hpp"
+#include "remote/configpackageutility.hpp"
+#include "remote/zone.hpp"
+#include "base/configtype.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <vector>
+
+using namespace icinga;
+
+bool ScopedValidation::IsEnabled()
+{
+	for (const ApiListener::Ptr& listener : ConfigType::GetObjectsByType<ApiListener>()) {
+		if (listener->GetEnableScopedValidation())
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Validates the synced config of some zones, it replaces their synced config
+ * in the running one.
+ *
+ * @param stageDir The stage directory with one directory per zone.
+ * @param zones The zones which changed.
+ * @param pr Receives the result if the zones could be validated.
+ * @returns Whether the zones could be validated in-process.
+ */
+bool ScopedValidation::ValidateZones(const String& stageDir, const std::set<String>& zones, ProcessResult& pr)
+{
+	double start = Utility::GetTime();
+
+	for (const String& zoneName : zones) {
+		Zone::Ptr zone = Zone::GetByName(zoneName);
+
+		/* The templates of global zones are used by the objects of all zones. */
+		if (!zone || zone->IsGlobal()) {
+			Log(LogInformation, "ScopedValidation")
+				<< "Zone '" << zoneName << "' can't be validated in-process, starting a validation process.";
+			return false;
+		}
+	}
+
+	ScopedConfigValidator validator ("_cluster", zones, &ScopedValidation::IsSupportedType);
+
+	for (const String& zoneName : zones) {
+		std::vector<String> files;
+		Utility::GlobRecursive(stageDir + zoneName, "*.conf", [&files](const String& file) { files.push_back(file); }, GlobFile);
+
+		for (const String& file : files)
+			validator.AddFile(file, zoneName);
+	}
+
+	return Finish(validator, start, "config sync stage '" + stageDir + "'", pr);
+}
+
+/**
+ * Validates a stage of a config package, it replaces the package's active
+ * stage in the running config.
+ *
+ * @param packageName The package.
+ * @param stageName The stage.
+ * @param pr Receives the result if the stage could be validated.
+ * @returns Whether the stage could be validated in-process.
+ */
+bool ScopedValidation::ValidatePackageStage(const String& packageName, const String& stageName, ProcessResult& pr)
+{
+	double start = Utility::GetTime();
+	String stageDir = ConfigPackageUtility::GetPackageDir() + "/" + packageName + "/" + stageName;
+
+	ScopedConfigValidator validator (packageName, std::set<String>(), &ScopedValidation::IsSupportedType);
+
+	Utility::GlobRecursive(stageDir + "/conf.d", "*.conf", [&validator](const String& file) {
+		validator.AddFile(file, String());
+	}, GlobFile);
+
+	std::vector<String> zoneDirs;
+	Utility::Glob(stageDir + "/zones.d/*", [&zoneDirs](const String& dir) { zoneDirs.push_back(dir); }, GlobDirectory);
+
+	for (const String& zoneDir : zoneDirs) {
+		String zoneName = Utility::BaseName(zoneDir);
+		Zone::Ptr zone = Zone::GetByName(zoneName);
+
+		if (!zone || zone->IsGlobal()) {
+			Log(LogInformation, "ScopedValidation")
+				<< "Zone '" << zoneName << "' of package '" << packageName
+				<< "' can't be validated in-process, starting a validation process.";
+			return false;
+		}
+
+		Utility::GlobRecursive(zoneDir, "*.conf", [&validator, &zoneName](const String& file) {
+			validator.AddFile(file, zoneName);
+		}, GlobFile);
+	}
+
+	return Finish(validator, start, "package '" + packageName + "' and stage '" + stageName + "'", pr);
+}
+
+bool ScopedValidation::IsSupportedType(const Type::Ptr& type)
+{
+	return ConfigDiffReload::IsSupportedType(type->GetName());
+}
+
+bool ScopedValidation::Finish(ScopedConfigValidator& validator, double start, const String& what, ProcessResult& pr)
+{
+	ScopedValidationResult result = validator.Validate();
+
+	if (result == ScopedValidationUnsupported) {
+		Log(LogInformation, "ScopedValidation")
+			<< "The config of " << what << " can't be validated in-process, starting a validation process: " << validator.GetLog();
+		return false;
+	}
+
+	pr.PID = 0;
+	pr.ExecutionStart = start;
+	pr.ExecutionEnd = Utility::GetTime();
+	pr.ExitStatus = result == ScopedValidationValid ? 0 : 1;
+	pr.Output = validator.GetLog();
+
+	Log(LogInformation, "ScopedValidation")
+		<< "Validated the config of " << what << " in-process in "
+		<< Utility::FormatDuration(pr.ExecutionEnd - pr.ExecutionStart) << ".";
+
+	return true;
+}
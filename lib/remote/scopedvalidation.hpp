@@ -0,0 +1,40 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef SCOPEDVALIDATION_H
+#define SCOPEDVALIDATION_H
+
+#include "remote/i2-remote.hpp"
+#include "config/scopedconfigvalidator.hpp"
+#include "base/process.hpp"
+#include "base/string.hpp"
+#include <set>
+
+namespace icinga
+{
+
+/**
+ * Validates synced zones and config package stages in the running process,
+ * see ScopedConfigValidator. The results look like the ones of a validation
+ * process. If the config isn't supported, the caller has to start such a
+ * process as usual.
+ *
+ * @ingroup remote
+ */
+class ScopedValidation
+{
+public:
+	static bool IsEnabled();
+
+	static bool ValidateZones(const String& stageDir, const std::set<String>& zones, ProcessResult& pr);
+	static bool ValidatePackageStage(const String& packageName, const String& stageName, ProcessResult& pr);
+
+private:
+	ScopedValidation();
+
+	static bool IsSupportedType(const Type::Ptr& type);
+	static bool Finish(ScopedConfigValidator& validator, double start, const String& what, ProcessResult& pr);
+};
+
+}
+
+#endif /* SCOPEDVALIDATION_H */
@@ -2,6 +2,7 @@
 
 #include "remote/statushandler.hpp"
 #include "remote/httputility.hpp"
+#include "remote/httpresponsecache.hpp"
 #include "remote/filterutility.hpp"
 #include "base/serializer.hpp"
 #include "base/statsfunction.hpp"
@@ -87,6 +88,11 @@ bool StatusHandler::HandleRequest(
 	if (request.method() != http::verb::get)
 		return false;
 
+	String cacheKey = HttpResponseCache::GetKey(user, request);
+
+	if (HttpResponseCache::Get(cacheKey, response))
+		return true;
+
 	QueryDescription qd;
 	qd.Types.insert("Status");
 	qd.Provider = new StatusTargetProvider();
@@ -114,6 +120,7 @@ bool StatusHandler::HandleRequest(
 
 	response.result(http::status::ok);
 	HttpUtility::SendJsonBody(response, params, result);
+	HttpResponseCache::Set(cacheKey, response);
 
 	return true;
 }
@@ -2,6 +2,7 @@
 
 #include "remote/templatequeryhandler.hpp"
 #include "remote/httputility.hpp"
+#include "remote/httpresponsecache.hpp"
 #include "remote/filterutility.hpp"
 #include "config/configitem.hpp"
 #include "base/configtype.hpp"
@@ -94,6 +95,11 @@ bool TemplateQueryHandler::HandleRequest(
 	if (request.method() != http::verb::get)
 		return false;
 
+	String cacheKey = HttpResponseCache::GetKey(user, request);
+
+	if (HttpResponseCache::Get(cacheKey, response))
+		return true;
+
 	Type::Ptr type = FilterUtility::TypeFromPluralName(url->GetPath()[2]);
 
 	if (!type) {
@@ -131,6 +137,7 @@ bool TemplateQueryHandler::HandleRequest(
 
 	response.result(http::status::ok);
 	HttpUtility::SendJsonBody(response, params, result);
+	HttpResponseCache::Set(cacheKey, response);
 
 	return true;
 }
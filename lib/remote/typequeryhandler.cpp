@@ -2,6 +2,7 @@
 
 #include "remote/typequeryhandler.hpp"
 #include "remote/httputility.hpp"
+#include "remote/httpresponsecache.hpp"
 #include "remote/filterutility.hpp"
 #include "base/configtype.hpp"
 #include "base/scriptglobal.hpp"
@@ -65,6 +66,11 @@ bool TypeQueryHandler::HandleRequest(
 	if (request.method() != http::verb::get)
 		return false;
 
+	String cacheKey = HttpResponseCache::GetKey(user, request);
+
+	if (HttpResponseCache::Get(cacheKey, response))
+		return true;
+
 	QueryDescription qd;
 	qd.Types.insert("Type");
 	qd.Permission = "types";
@@ -151,6 +157,7 @@ bool TypeQueryHandler::HandleRequest(
 
 	response.result(http::status::ok);
 	HttpUtility::SendJsonBody(response, params, result);
+	HttpResponseCache::Set(cacheKey, response);
 
 	return true;
 }
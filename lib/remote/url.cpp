@@ -5,67 +5,67 @@
 #include "base/objectlock.hpp"
 #include "remote/url.hpp"
 #include "remote/url-characters.hpp"
-#include <boost/tokenizer.hpp>
 
 using namespace icinga;
 
 Url::Url(const String& base_url)
 {
-	String url = base_url;
+	/* Only views into base_url are passed around until the parts are stored. */
+	boost::string_view url (base_url);
 
-	if (url.GetLength() == 0)
+	if (url.empty())
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid URL Empty URL."));
 
-	size_t pHelper = String::NPos;
+	size_t pHelper = boost::string_view::npos;
 	if (url[0] != '/')
-		pHelper = url.Find(":");
+		pHelper = url.find(':');
 
-	if (pHelper != String::NPos) {
-		if (!ParseScheme(url.SubStr(0, pHelper)))
+	if (pHelper != boost::string_view::npos) {
+		if (!ParseScheme(url.substr(0, pHelper)))
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid URL Scheme."));
-		url = url.SubStr(pHelper + 1);
+		url = url.substr(pHelper + 1);
 	}
 
-	if (*url.Begin() != '/')
+	if (url.empty() || url[0] != '/')
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid URL: '/' expected after scheme."));
 
-	if (url.GetLength() == 1) {
+	if (url.size() == 1) {
 		return;
 	}
 
-	if (*(url.Begin() + 1) == '/') {
-		pHelper = url.Find("/", 2);
+	if (url[1] == '/') {
+		pHelper = url.find('/', 2);
 
-		if (pHelper == String::NPos)
+		if (pHelper == boost::string_view::npos)
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid URL: Missing '/' after authority."));
 
-		if (!ParseAuthority(url.SubStr(0, pHelper)))
+		if (!ParseAuthority(url.substr(0, pHelper)))
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid URL Authority"));
 
-		url = url.SubStr(pHelper);
+		url = url.substr(pHelper);
 	}
 
-	if (*url.Begin() == '/') {
-		pHelper = url.FindFirstOf("#?");
-		if (!ParsePath(url.SubStr(1, pHelper - 1)))
+	if (url[0] == '/') {
+		pHelper = url.find_first_of("#?");
+		if (!ParsePath(url.substr(1, pHelper - 1)))
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid URL Path"));
 
-		if (pHelper != String::NPos)
-			url = url.SubStr(pHelper);
+		if (pHelper != boost::string_view::npos)
+			url = url.substr(pHelper);
 	} else
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid URL: Missing path."));
 
-	if (*url.Begin() == '?') {
-		pHelper = url.Find("#");
-		if (!ParseQuery(url.SubStr(1, pHelper - 1)))
+	if (url[0] == '?') {
+		pHelper = url.find('#');
+		if (!ParseQuery(url.substr(1, pHelper - 1)))
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid URL Query"));
 
-		if (pHelper != String::NPos)
-			url = url.SubStr(pHelper);
+		if (pHelper != boost::string_view::npos)
+			url = url.substr(pHelper);
 	}
 
-	if (*url.Begin() == '#') {
-		if (!ParseFragment(url.SubStr(1)))
+	if (url[0] == '#') {
+		if (!ParseFragment(url.substr(1)))
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid URL Fragment"));
 	}
 }
@@ -228,45 +228,45 @@ String Url::Format(bool onlyPathAndQuery, bool printCredentials) const
 	return url;
 }
 
-bool Url::ParseScheme(const String& scheme)
+bool Url::ParseScheme(boost::string_view scheme)
 {
-	m_Scheme = scheme;
+	m_Scheme = String(scheme);
 
-	if (scheme.FindFirstOf(ALPHA) != 0)
+	if (scheme.find_first_of(ALPHA) != 0)
 		return false;
 
 	return (ValidateToken(scheme, ACSCHEME));
 }
 
-bool Url::ParseAuthority(const String& authority)
+bool Url::ParseAuthority(boost::string_view authority)
 {
-	String auth = authority.SubStr(2);
-	size_t pos = auth.Find("@");
-	if (pos != String::NPos && pos != 0) {
-		if (!Url::ParseUserinfo(auth.SubStr(0, pos)))
+	boost::string_view auth = authority.substr(2);
+	size_t pos = auth.find('@');
+	if (pos != boost::string_view::npos && pos != 0) {
+		if (!Url::ParseUserinfo(auth.substr(0, pos)))
 			return false;
-		auth = auth.SubStr(pos+1);
+		auth = auth.substr(pos+1);
 	}
 
-	pos = auth.Find(":");
-	if (pos != String::NPos) {
-		if (pos == 0 || pos == auth.GetLength() - 1 || !Url::ParsePort(auth.SubStr(pos+1)))
+	pos = auth.find(':');
+	if (pos != boost::string_view::npos) {
+		if (pos == 0 || pos == auth.size() - 1 || !Url::ParsePort(auth.substr(pos+1)))
 			return false;
 	}
 
-	m_Host = auth.SubStr(0, pos);
+	m_Host = String(auth.substr(0, pos));
 	return ValidateToken(m_Host, ACHOST);
 }
 
-bool Url::ParseUserinfo(const String& userinfo)
+bool Url::ParseUserinfo(boost::string_view userinfo)
 {
-	size_t pos = userinfo.Find(":");
-	m_Username = userinfo.SubStr(0, pos);
+	size_t pos = userinfo.find(':');
+	m_Username = String(userinfo.substr(0, pos));
 	if (!ValidateToken(m_Username, ACUSERINFO))
 		return false;
 	m_Username = Utility::UnescapeString(m_Username);
-	if (pos != String::NPos && pos != userinfo.GetLength() - 1) {
-		m_Password = userinfo.SubStr(pos+1);
+	if (pos != boost::string_view::npos && pos != userinfo.size() - 1) {
+		m_Password = String(userinfo.substr(pos+1));
 		if (!ValidateToken(m_Username, ACUSERINFO))
 			return false;
 		m_Password = Utility::UnescapeString(m_Password);
@@ -276,88 +276,77 @@ bool Url::ParseUserinfo(const String& userinfo)
 	return true;
 }
 
-bool Url::ParsePort(const String& port)
+bool Url::ParsePort(boost::string_view port)
 {
-	m_Port = Utility::UnescapeString(port);
+	m_Port = Utility::UnescapeString(String(port));
 	if (!ValidateToken(m_Port, ACPORT))
 		return false;
 	return true;
 }
 
-bool Url::ParsePath(const String& path)
+bool Url::ParsePath(boost::string_view path)
 {
-	const std::string& pathStr = path;
-	boost::char_separator<char> sep("/");
-	boost::tokenizer<boost::char_separator<char> > tokens(pathStr, sep);
-
-	for (const String& token : tokens) {
-		if (token.IsEmpty())
+	for (auto token : SplitView(path, "/")) {
+		if (token.empty())
 			continue;
 
 		if (!ValidateToken(token, ACPATHSEGMENT))
 			return false;
 
-		m_Path.emplace_back(Utility::UnescapeString(token));
+		m_Path.emplace_back(Utility::UnescapeString(String(token)));
 	}
 
 	return true;
 }
 
-bool Url::ParseQuery(const String& query)
+bool Url::ParseQuery(boost::string_view query)
 {
-	/* Tokenizer does not like String AT ALL */
-	const std::string& queryStr = query;
-	boost::char_separator<char> sep("&");
-	boost::tokenizer<boost::char_separator<char> > tokens(queryStr, sep);
+	for (auto token : SplitView(query, "&")) {
+		if (token.empty())
+			continue;
 
-	for (const String& token : tokens) {
-		size_t pHelper = token.Find("=");
+		size_t pHelper = token.find('=');
 
 		if (pHelper == 0)
 			// /?foo=bar&=bar == invalid
 			return false;
 
-		String key = token.SubStr(0, pHelper);
-		String value = Empty;
+		boost::string_view key = token.substr(0, pHelper);
+		boost::string_view rawValue;
 
-		if (pHelper != String::NPos && pHelper != token.GetLength() - 1)
-			value = token.SubStr(pHelper+1);
+		if (pHelper != boost::string_view::npos && pHelper != token.size() - 1)
+			rawValue = token.substr(pHelper+1);
 
-		if (!ValidateToken(value, ACQUERY))
+		if (!ValidateToken(rawValue, ACQUERY))
 			return false;
 
-		value = Utility::UnescapeString(value);
+		String value = Utility::UnescapeString(String(rawValue));
 
-		pHelper = key.Find("[]");
+		pHelper = key.find("[]");
 
-		if (pHelper == 0 || (pHelper != String::NPos && pHelper != key.GetLength()-2))
+		if (pHelper == 0 || (pHelper != boost::string_view::npos && pHelper != key.size()-2))
 			return false;
 
-		key = key.SubStr(0, pHelper);
+		key = key.substr(0, pHelper);
 
 		if (!ValidateToken(key, ACQUERY))
 			return false;
 
-		m_Query.emplace_back(Utility::UnescapeString(key), std::move(value));
+		m_Query.emplace_back(Utility::UnescapeString(String(key)), std::move(value));
 	}
 
 	return true;
 }
 
-bool Url::ParseFragment(const String& fragment)
+bool Url::ParseFragment(boost::string_view fragment)
 {
-	m_Fragment = Utility::UnescapeString(fragment);
+	m_Fragment = Utility::UnescapeString(String(fragment));
 
 	return ValidateToken(fragment, ACFRAGMENT);
 }
 
-bool Url::ValidateToken(const String& token, const String& symbols)
+bool Url::ValidateToken(boost::string_view token, const char *symbols)
 {
-	for (const char ch : token) {
-		if (symbols.FindFirstOf(ch) == String::NPos)
-			return false;
-	}
-
-	return true;
+	return token.find_first_not_of(symbols) == boost::string_view::npos;
 }
 
@@ -63,15 +63,15 @@ private:
 	bool m_ArrayFormatUseBrackets;
 	String m_Fragment;
 
-	bool ParseScheme(const String& scheme);
-	bool ParseAuthority(const String& authority);
-	bool ParseUserinfo(const String& userinfo);
-	bool ParsePort(const String& port);
-	bool ParsePath(const String& path);
-	bool ParseQuery(const String& query);
-	bool ParseFragment(const String& fragment);
+	bool ParseScheme(boost::string_view scheme);
+	bool ParseAuthority(boost::string_view authority);
+	bool ParseUserinfo(boost::string_view userinfo);
+	bool ParsePort(boost::string_view port);
+	bool ParsePath(boost::string_view path);
+	bool ParseQuery(boost::string_view query);
+	bool ParseFragment(boost::string_view fragment);
 
-	static bool ValidateToken(const String& token, const String& symbols);
+	static bool ValidateToken(boost::string_view token, const char *symbols);
 };
 
 }
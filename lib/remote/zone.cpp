@@ -11,6 +11,8 @@ using namespace icinga;
 
 REGISTER_TYPE(Zone);
 
+std::atomic<size_t> Zone::m_NextIndex (0);
+
 void Zone::OnAllConfigLoaded()
 {
 	ObjectImpl<Zone>::OnAllConfigLoaded();
@@ -44,6 +46,16 @@ void Zone::OnAllConfigLoaded()
 		if (levels > 32)
 			BOOST_THROW_EXCEPTION(ScriptError("Infinite recursion detected while resolving zone graph. Check your zone hierarchy.", GetDebugInfo()));
 	}
+
+	m_Ancestry.assign(m_Index + 1, false);
+	m_Ancestry[m_Index] = true;
+
+	for (auto& parent : m_AllParents) {
+		if (parent->m_Index >= m_Ancestry.size())
+			m_Ancestry.resize(parent->m_Index + 1);
+
+		m_Ancestry[parent->m_Index] = true;
+	}
 }
 
 Zone::Ptr Zone::GetParent() const
@@ -73,7 +85,7 @@ std::set<Endpoint::Ptr> Zone::GetEndpoints() const
 	return result;
 }
 
-std::vector<Zone::Ptr> Zone::GetAllParentsRaw() const
+const std::vector<Zone::Ptr>& Zone::GetAllParentsRaw() const
 {
 	return m_AllParents;
 }
@@ -106,18 +118,20 @@ bool Zone::CanAccessObject(const ConfigObject::Ptr& object)
 	return object_zone->IsChildOf(this);
 }
 
+/**
+ * Returns whether this zone is the specified one or one of its descendants.
+ * The zone hierarchy is fixed once all config is loaded, so this is looked up
+ * in a bitset computed back then instead of walking up the parents.
+ */
 bool Zone::IsChildOf(const Zone::Ptr& zone)
 {
-	Zone::Ptr azone = this;
-
-	while (azone) {
-		if (azone == zone)
-			return true;
+	if (!zone)
+		return false;
 
-		azone = azone->GetParent();
-	}
+	if (zone.get() == this)
+		return true;
 
-	return false;
+	return zone->m_Index < m_Ancestry.size() && m_Ancestry[zone->m_Index];
 }
 
 bool Zone::IsGlobal() const
@@ -6,6 +6,8 @@
 #include "remote/i2-remote.hpp"
 #include "remote/zone-ti.hpp"
 #include "remote/endpoint.hpp"
+#include <atomic>
+#include <vector>
 
 namespace icinga
 {
@@ -23,7 +25,7 @@ public:
 
 	Zone::Ptr GetParent() const;
 	std::set<Endpoint::Ptr> GetEndpoints() const;
-	std::vector<Zone::Ptr> GetAllParentsRaw() const;
+	const std::vector<Zone::Ptr>& GetAllParentsRaw() const;
 	Array::Ptr GetAllParents() const override;
 
 	bool CanAccessObject(const ConfigObject::Ptr& object);
@@ -39,6 +41,12 @@ protected:
 private:
 	Zone::Ptr m_Parent;
 	std::vector<Zone::Ptr> m_AllParents;
+
+	/* Bit n is set for this zone and its parents, n being their m_Index. */
+	std::vector<bool> m_Ancestry;
+	size_t m_Index{m_NextIndex.fetch_add(1)};
+
+	static std::atomic<size_t> m_NextIndex;
 };
 
 }
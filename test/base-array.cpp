@@ -141,6 +141,30 @@ BOOST_AUTO_TEST_CASE(clone)
 	BOOST_CHECK(clone->Get(2) == 5);
 }
 
+BOOST_AUTO_TEST_CASE(copyonwrite)
+{
+	Array::Ptr array = new Array({ 7, 2, 5 });
+	Array::Ptr clone = static_pointer_cast<Array>(array->Clone());
+	Array::Ptr copy = array->ShallowClone();
+
+	{
+		ObjectLock olock(clone);
+
+		for (Value& val : clone)
+			val = 0;
+	}
+
+	copy->Sort();
+	array->Add(1);
+
+	BOOST_CHECK(array->GetLength() == 4);
+	BOOST_CHECK(array->Get(0) == 7);
+	BOOST_CHECK(clone->GetLength() == 3);
+	BOOST_CHECK(clone->Get(0) == 0);
+	BOOST_CHECK(copy->GetLength() == 3);
+	BOOST_CHECK(copy->Get(0) == 2);
+}
+
 BOOST_AUTO_TEST_CASE(json)
 {
 	Array::Ptr array = new Array();
@@ -0,0 +1,55 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/compressedstring.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_compressedstring)
+
+BOOST_AUTO_TEST_CASE(roundtrip)
+{
+	CompressedString str;
+
+	BOOST_CHECK(str.Get() == "");
+
+	str.Set("short", 16);
+	BOOST_CHECK(!str.IsCompressed());
+	BOOST_CHECK(str.Get() == "short");
+
+	String text;
+
+	for (int i = 0; i < 100; i++)
+		text += "DISK OK - free space: / 3326 MB (56% inode=99%);\n";
+
+	str.Set(text, 16);
+	BOOST_CHECK(str.IsCompressed());
+	BOOST_CHECK(str.Get() == text);
+
+	str.Set(text, 0);
+	BOOST_CHECK(!str.IsCompressed());
+	BOOST_CHECK(str.Get() == text);
+}
+
+BOOST_AUTO_TEST_CASE(savedbytes)
+{
+	MetricGauge& savedBytes = MetricGauge::GetByName("test_compressedstring_saved_bytes");
+	String text (4096, 'x');
+
+	{
+		CompressedString str (&savedBytes);
+
+		str.Set(text, 1024);
+		BOOST_CHECK(savedBytes.GetValue() > 0);
+		BOOST_CHECK(savedBytes.GetValue() < 4096);
+
+		str.Set("x", 1024);
+		BOOST_CHECK(savedBytes.GetValue() == 0);
+
+		str.Set(text, 1024);
+	}
+
+	BOOST_CHECK(savedBytes.GetValue() == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 #include "base/dictionary.hpp"
 #include "base/objectlock.hpp"
 #include "base/json.hpp"
+#include "base/convert.hpp"
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
@@ -107,6 +108,63 @@ BOOST_AUTO_TEST_CASE(foreach)
 	BOOST_CHECK(seen_test2);
 }
 
+BOOST_AUTO_TEST_CASE(unordered)
+{
+	Dictionary::Ptr dictionary = new Dictionary();
+
+	for (int i = 0; i < 100; i++)
+		dictionary->Set(Convert::ToString((i * 37) % 100), i);
+
+	BOOST_CHECK(dictionary->GetLength() == 100);
+	BOOST_CHECK(dictionary->Get("37") == 1);
+	BOOST_CHECK(dictionary->Contains("99"));
+
+	dictionary->Set("37", "updated");
+	dictionary->Remove("99");
+
+	BOOST_CHECK(dictionary->GetLength() == 99);
+	BOOST_CHECK(dictionary->Get("37") == "updated");
+	BOOST_CHECK(!dictionary->Contains("99"));
+
+	ObjectLock olock(dictionary);
+	String last;
+
+	for (const Dictionary::Pair& kv : dictionary) {
+		BOOST_CHECK(last.IsEmpty() || last < kv.first);
+		last = kv.first;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(duplicates)
+{
+	Dictionary::Ptr dictionary = new Dictionary({ {"b", 1}, {"a", 2}, {"b", 3} });
+
+	BOOST_CHECK(dictionary->GetLength() == 2);
+	BOOST_CHECK(dictionary->Get("b") == 1);
+}
+
+BOOST_AUTO_TEST_CASE(freeze)
+{
+	Dictionary::Ptr dictionary = new Dictionary();
+	dictionary->Set("c", 3);
+	dictionary->Set("a", 1);
+	dictionary->Set("b", 2);
+	dictionary->Freeze();
+
+	BOOST_CHECK(dictionary->GetLength() == 3);
+	BOOST_CHECK(dictionary->Get("a") == 1);
+	BOOST_CHECK(dictionary->Get("b") == 2);
+	BOOST_CHECK(dictionary->Get("c") == 3);
+
+	BOOST_CHECK_THROW(dictionary->Set("d", 4), std::invalid_argument);
+
+	dictionary->Set("d", 4, true);
+	BOOST_CHECK(dictionary->Get("d") == 4);
+
+	std::vector<String> keys = dictionary->GetKeys();
+	BOOST_CHECK(keys == std::vector<String>({ "a", "b", "c", "d" }));
+}
+
 BOOST_AUTO_TEST_CASE(remove)
 {
 	Dictionary::Ptr dictionary = new Dictionary();
@@ -168,6 +226,35 @@ BOOST_AUTO_TEST_CASE(clone)
 	BOOST_CHECK(dictionary->Get("test2") == "hello world");
 }
 
+BOOST_AUTO_TEST_CASE(copyonwrite)
+{
+	Dictionary::Ptr dictionary = new Dictionary({
+		{ "test1", 7 },
+		{ "test2", "hello world" }
+	});
+
+	Dictionary::Ptr clone = static_pointer_cast<Dictionary>(dictionary->Clone());
+	Dictionary::Ptr copy = new Dictionary();
+	dictionary->CopyTo(copy);
+
+	{
+		ObjectLock olock(clone);
+
+		for (Dictionary::Pair& kv : clone)
+			kv.second = 0;
+	}
+
+	copy->Remove("test1");
+	dictionary->Set("test2", "test");
+
+	BOOST_CHECK(dictionary->Get("test1") == 7);
+	BOOST_CHECK(dictionary->Get("test2") == "test");
+	BOOST_CHECK(clone->Get("test1") == 0);
+	BOOST_CHECK(clone->Get("test2") == 0);
+	BOOST_CHECK(!copy->Contains("test1"));
+	BOOST_CHECK(copy->Get("test2") == "hello world");
+}
+
 BOOST_AUTO_TEST_CASE(json)
 {
 	Dictionary::Ptr dictionary = new Dictionary();
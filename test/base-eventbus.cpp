@@ -0,0 +1,126 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/eventbus.hpp"
+#include "base/object.hpp"
+#include "icingaapplication-fixture.hpp"
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_FIXTURE_TEST_SUITE(base_eventbus, IcingaApplicationFixture)
+
+BOOST_AUTO_TEST_CASE(sync)
+{
+	EventBus<void (int)> bus;
+	std::vector<int> results;
+
+	BOOST_CHECK(bus.empty());
+
+	bus(0);
+
+	bus.connect([&results](int i) { results.push_back(i); });
+	bus.connect([&results](int i) { results.push_back(i * 10); });
+
+	BOOST_CHECK(bus.num_slots() == 2);
+
+	bus(1);
+	bus(2);
+
+	BOOST_CHECK(results.size() == 4);
+	BOOST_CHECK(results[0] == 1);
+	BOOST_CHECK(results[1] == 10);
+	BOOST_CHECK(results[2] == 2);
+	BOOST_CHECK(results[3] == 20);
+}
+
+BOOST_AUTO_TEST_CASE(async_order)
+{
+	EventBus<void (int)> bus;
+	std::mutex mutex;
+	std::vector<int> results;
+
+	bus.connect([&mutex, &results](int i) {
+		std::unique_lock<std::mutex> lock (mutex);
+		results.push_back(i);
+	}, 1000, EventDropNewest);
+
+	for (int i = 0; i < 500; i++)
+		bus(i);
+
+	for (int i = 0; i < 500; i++) {
+		{
+			std::unique_lock<std::mutex> lock (mutex);
+
+			if (results.size() == 500u)
+				break;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	std::unique_lock<std::mutex> lock (mutex);
+
+	BOOST_CHECK(results.size() == 500);
+
+	for (decltype(results.size()) i = 0; i < results.size(); i++)
+		BOOST_CHECK(results[i] == (int)i);
+
+	BOOST_CHECK(bus.GetDroppedEvents() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(async_coalesce)
+{
+	EventBus<void (const Object::Ptr&, int)> bus;
+	Object::Ptr object = new Object();
+
+	std::promise<void> entered, release;
+	auto released (release.get_future().share());
+	std::atomic<bool> first (true);
+	std::mutex mutex;
+	std::vector<int> results;
+
+	bus.connect([&](const Object::Ptr&, int i) {
+		if (first.exchange(false)) {
+			entered.set_value();
+			released.wait();
+		}
+
+		std::unique_lock<std::mutex> lock (mutex);
+		results.push_back(i);
+	}, 1000, EventCoalesce);
+
+	bus(object, 0);
+	entered.get_future().wait();
+
+	/* The subscriber is busy, these replace each other in its queue. */
+	for (int i = 1; i <= 10; i++)
+		bus(object, i);
+
+	release.set_value();
+
+	for (int i = 0; i < 500; i++) {
+		{
+			std::unique_lock<std::mutex> lock (mutex);
+
+			if (results.size() == 2u)
+				break;
+		}
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	std::unique_lock<std::mutex> lock (mutex);
+
+	BOOST_REQUIRE(results.size() == 2);
+	BOOST_CHECK(results[0] == 0);
+	BOOST_CHECK(results[1] == 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
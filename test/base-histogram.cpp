@@ -0,0 +1,99 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/histogram.hpp"
+#include <BoostTestTargetConfig.h>
+#include <thread>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_histogram)
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+	Histogram histogram;
+
+	BOOST_CHECK(histogram.GetCount() == 0);
+	BOOST_CHECK(histogram.GetAverage() == 0);
+	BOOST_CHECK(histogram.GetMax() == 0);
+	BOOST_CHECK(histogram.GetPercentile(99) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(percentiles)
+{
+	Histogram histogram;
+
+	/* 1ms to 1s */
+	for (int i = 1; i <= 1000; i++)
+		histogram.Record(i / 1000.0);
+
+	BOOST_CHECK(histogram.GetCount() == 1000);
+	BOOST_CHECK_CLOSE(histogram.GetAverage(), 0.5005, 0.01);
+	BOOST_CHECK_CLOSE(histogram.GetMax(), 1, 0.01);
+
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(50), 0.5, 3.2);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(90), 0.9, 3.2);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(99), 0.99, 3.2);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(100), 1, 0.01);
+}
+
+BOOST_AUTO_TEST_CASE(tail)
+{
+	Histogram histogram;
+
+	for (int i = 0; i < 990; i++)
+		histogram.Record(0.001);
+
+	for (int i = 0; i < 10; i++)
+		histogram.Record(2);
+
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(50), 0.001, 3.2);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(99), 0.001, 3.2);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(99.9), 2, 3.2);
+	BOOST_CHECK(histogram.GetAverage() < 0.03);
+}
+
+BOOST_AUTO_TEST_CASE(range)
+{
+	Histogram histogram;
+
+	histogram.Record(-1);
+	histogram.Record(0);
+	histogram.Record(0.000001);
+	histogram.Record(1e9);
+
+	BOOST_CHECK(histogram.GetCount() == 4);
+	BOOST_CHECK(histogram.GetPercentile(25) == 0);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(75), 0.000001, 0.01);
+	BOOST_CHECK_CLOSE(histogram.GetMax(), ((uint_fast64_t(1) << Histogram::MaxValueBits) - 1) / 1e6, 0.01);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent)
+{
+	Histogram histogram;
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < 4; i++) {
+		threads.emplace_back([&histogram, i]() {
+			for (int j = 0; j < 10000; j++)
+				histogram.Record((i + 1) / 1000.0);
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	BOOST_CHECK(histogram.GetCount() == 40000);
+	BOOST_CHECK_CLOSE(histogram.GetMax(), 0.004, 0.01);
+	BOOST_CHECK_CLOSE(histogram.GetPercentile(50), 0.002, 3.2);
+}
+
+BOOST_AUTO_TEST_CASE(byname)
+{
+	Histogram& histogram = Histogram::GetByName("test_byname");
+
+	BOOST_CHECK(&histogram == &Histogram::GetByName("test_byname"));
+	BOOST_CHECK(&histogram != &Histogram::GetByName("test_byname2"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
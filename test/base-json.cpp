@@ -96,11 +96,61 @@ BOOST_AUTO_TEST_CASE(decode)
 	BOOST_CHECK(uint.IsNumber() && uint.Get<double>() == 23.0);
 }
 
+BOOST_AUTO_TEST_CASE(decode_unordered)
+{
+	auto output ((Dictionary::Ptr)JsonDecode(R"EOF({"c": 1, "a": {"y": [2, 3], "x": null}, "b": 4, "c": 5})EOF"));
+	BOOST_CHECK(output->GetKeys() == std::vector<String>({"a", "b", "c"}));
+	BOOST_CHECK(output->Get("c") == 5);
+
+	auto a ((Dictionary::Ptr)output->Get("a"));
+	BOOST_CHECK(a->GetKeys() == std::vector<String>({"x", "y"}));
+	BOOST_CHECK(((Array::Ptr)a->Get("y"))->GetLength() == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(escape)
+{
+	String input ("\"quote\" \\ \x01 \x7F \xF0\x9F\x98\x80 0123456789abcdef");
+	String output (R"EOF("\"quote\" \\ \u0001 \u007f \ud83d\ude00 0123456789abcdef")EOF");
+
+	BOOST_CHECK(JsonEncode(input) == output);
+	BOOST_CHECK(JsonDecode(output) == input);
+	BOOST_CHECK(JsonDecode("\"\\/\\b\\f\\n\\r\\t\\u00E4\"") == "/\b\f\n\r\t\xC3\xA4");
+
+	BOOST_CHECK(JsonDecode("1e3") == 1000);
+	BOOST_CHECK(JsonDecode("-5e-1") == -0.5);
+	BOOST_CHECK(JsonDecode("12345678901234567890") == 12345678901234567890.0);
+}
+
+BOOST_AUTO_TEST_CASE(decode_sink)
+{
+	std::vector<std::vector<String>> paths;
+	LargeStringSink sink { 5, [&paths](const std::vector<String>& path, String&& value) -> Value {
+		paths.push_back(path);
+		return value.GetLength();
+	} };
+
+	Dictionary::Ptr result = JsonDecode(R"EOF({"a":"long string","b":["short","long string"],"c":"long"})EOF", &sink);
+
+	BOOST_CHECK(result->Get("a") == 11);
+	BOOST_CHECK(Array::Ptr(result->Get("b"))->Get(0) == "short");
+	BOOST_CHECK(Array::Ptr(result->Get("b"))->Get(1) == 11);
+	BOOST_CHECK(result->Get("c") == "long");
+
+	BOOST_REQUIRE(paths.size() == 3u);
+	BOOST_CHECK(paths[0] == std::vector<String>({"a"}));
+	BOOST_CHECK(paths[1] == std::vector<String>({"b", "0"}));
+	BOOST_CHECK(paths[2] == std::vector<String>({"b", "1"}));
+}
+
 BOOST_AUTO_TEST_CASE(invalid1)
 {
 	BOOST_CHECK_THROW(JsonDecode("\"1.7"), std::exception);
 	BOOST_CHECK_THROW(JsonDecode("{8: \"test\"}"), std::exception);
 	BOOST_CHECK_THROW(JsonDecode("{\"test\": \"test\""), std::exception);
+	BOOST_CHECK_THROW(JsonDecode("[1, 2,]"), std::exception);
+	BOOST_CHECK_THROW(JsonDecode("01"), std::exception);
+	BOOST_CHECK_THROW(JsonDecode("\"\\ud800\""), std::exception);
+	BOOST_CHECK_THROW(JsonDecode("[] []"), std::exception);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
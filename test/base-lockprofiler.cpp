@@ -0,0 +1,106 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/lockprofiler.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+#include <thread>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_lockprofiler)
+
+/**
+ * Returns the number of recorded waits for locks whose name starts with the given prefix.
+ */
+static double GetWaits(const String& prefix, double *total = nullptr)
+{
+	Array::Ptr locks = LockProfiler::GetReport(100)->Get("locks");
+	double count = 0;
+
+	ObjectLock olock(locks);
+
+	for (const Dictionary::Ptr& entry : locks) {
+		if (String(entry->Get("lock")).Find(prefix) == 0) {
+			count += entry->Get("count");
+
+			if (total)
+				*total += entry->Get("wait_total");
+		}
+	}
+
+	return count;
+}
+
+BOOST_AUTO_TEST_CASE(disabled)
+{
+	LockProfiler::SetEnabled(false);
+	LockProfiler::Reset();
+
+	std::mutex mutex;
+	auto lock (LockProfiler::Lock(mutex, "test_disabled"));
+
+	std::thread waiter ([&mutex]() {
+		auto lock (LockProfiler::Lock(mutex, "test_disabled"));
+	});
+
+	Utility::Sleep(0.05);
+	lock.unlock();
+	waiter.join();
+
+	BOOST_CHECK(GetWaits("test_disabled") == 0);
+}
+
+BOOST_AUTO_TEST_CASE(mutex)
+{
+	LockProfiler::SetEnabled(true);
+
+	std::mutex mutex;
+	auto lock (LockProfiler::Lock(mutex, "test_mutex"));
+
+	std::thread waiter ([&mutex]() {
+		auto lock (LockProfiler::Lock(mutex, "test_mutex"));
+	});
+
+	Utility::Sleep(0.05);
+	lock.unlock();
+	waiter.join();
+
+	double total = 0;
+
+	BOOST_CHECK(GetWaits("test_mutex", &total) == 1);
+	BOOST_CHECK(total >= 0.04);
+
+	/* Uncontended */
+	{
+		auto lock (LockProfiler::Lock(mutex, "test_mutex"));
+	}
+
+	BOOST_CHECK(GetWaits("test_mutex") == 1);
+
+	LockProfiler::SetEnabled(false);
+}
+
+BOOST_AUTO_TEST_CASE(objectlock)
+{
+	LockProfiler::SetEnabled(true);
+
+	Dictionary::Ptr dict = new Dictionary();
+	ObjectLock olock(dict);
+
+	std::thread waiter ([&dict]() {
+		ObjectLock olock(dict);
+	});
+
+	Utility::Sleep(0.05);
+	olock.Unlock();
+	waiter.join();
+
+	BOOST_CHECK(GetWaits("ObjectLock") >= 1);
+
+	LockProfiler::SetEnabled(false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,34 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/metric.hpp"
+#include "base/histogram.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_metric)
+
+BOOST_AUTO_TEST_CASE(byname)
+{
+	MetricCounter& counter = MetricCounter::GetByName("test_byname", "a");
+
+	BOOST_CHECK(&counter == &MetricCounter::GetByName("test_byname", "a"));
+	BOOST_CHECK(&counter != &MetricCounter::GetByName("test_byname", "b"));
+	BOOST_CHECK(&counter != &MetricCounter::GetByName("test_byname"));
+}
+
+BOOST_AUTO_TEST_CASE(prometheus)
+{
+	MetricCounter::GetByName("test_counter").Increment(3);
+	MetricGauge::GetByName("test_gauge", "x \"y\"").Set(-2);
+	Histogram::GetByName("test_/histogram").Record(0.5);
+
+	String text = FormatPrometheusMetrics();
+
+	BOOST_CHECK(text.Contains("# TYPE icinga2_test_counter_total counter\nicinga2_test_counter_total 3\n"));
+	BOOST_CHECK(text.Contains("# TYPE icinga2_test_gauge gauge\nicinga2_test_gauge{name=\"x \\\"y\\\"\"} -2\n"));
+	BOOST_CHECK(text.Contains("# TYPE icinga2_test__histogram_seconds summary\n"));
+	BOOST_CHECK(text.Contains("icinga2_test__histogram_seconds_count 1\n"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
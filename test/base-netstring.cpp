@@ -22,4 +22,25 @@ BOOST_AUTO_TEST_CASE(netstring)
 	fifo->Close();
 }
 
+BOOST_AUTO_TEST_CASE(buffer)
+{
+	String data ("5:hello,0:,3:abc");
+	const char *current = data.CStr();
+	const char *end = current + data.GetLength();
+	boost::string_view message;
+
+	BOOST_CHECK(NetString::ReadStringFromBuffer(current, end, message));
+	BOOST_CHECK(message == "hello");
+	BOOST_CHECK(NetString::ReadStringFromBuffer(current, end, message));
+	BOOST_CHECK(message.empty());
+
+	/* The last message is incomplete. */
+	BOOST_CHECK(!NetString::ReadStringFromBuffer(current, end, message));
+	BOOST_CHECK(current == data.CStr() + 11);
+
+	String invalid ("05:hello,");
+	current = invalid.CStr();
+	BOOST_CHECK_THROW(NetString::ReadStringFromBuffer(current, current + invalid.GetLength(), message), std::invalid_argument);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
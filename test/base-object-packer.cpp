@@ -5,6 +5,8 @@
 #include "base/string.hpp"
 #include "base/array.hpp"
 #include "base/dictionary.hpp"
+#include "base/json.hpp"
+#include "base/namespace.hpp"
 #include <BoostTestTargetConfig.h>
 #include <climits>
 #include <initializer_list>
@@ -261,4 +263,88 @@ BOOST_AUTO_TEST_CASE(pack_object)
 	));
 }
 
+BOOST_AUTO_TEST_CASE(unpack_roundtrip)
+{
+	Dictionary::Ptr dict = new Dictionary({
+		{"null", Empty},
+		{"false", false},
+		{"true", true},
+		{"42.125", 42.125},
+		{"foobar", "foobar"},
+		{"[]", (Array::Ptr)new Array({1, "two", (Dictionary::Ptr)new Dictionary({{"three", 3}})})}
+	});
+
+	Value value = UnpackObject(PackObject(dict));
+
+	BOOST_REQUIRE(value.IsObjectType<Dictionary>());
+	BOOST_CHECK(PackObject(value) == PackObject(dict));
+
+	Dictionary::Ptr result = value;
+	BOOST_CHECK(result->Get("null").IsEmpty());
+	BOOST_CHECK(result->Get("true") == true);
+	BOOST_CHECK(result->Get("42.125") == 42.125);
+	BOOST_CHECK(result->Get("foobar") == "foobar");
+}
+
+BOOST_AUTO_TEST_CASE(pack_message)
+{
+	Namespace::Ptr ns = new Namespace();
+	ns->Set("b", 2);
+	ns->Set("a", "x");
+
+	Dictionary::Ptr dict = new Dictionary({
+		{"ns", ns},
+		{"invalid", String("\xff\xfe")}
+	});
+
+	/* Messages must decode to the same as their JSON encoding. */
+	Value expected = JsonDecode(JsonEncode(dict));
+	Value value = UnpackObject(PackMessage(dict));
+
+	BOOST_REQUIRE(value.IsObjectType<Dictionary>());
+	BOOST_CHECK(JsonEncode(value) == JsonEncode(expected));
+
+	Dictionary::Ptr result = value;
+	BOOST_REQUIRE(result->Get("ns").IsObjectType<Dictionary>());
+	BOOST_CHECK(Dictionary::Ptr(result->Get("ns"))->Get("a") == "x");
+	BOOST_CHECK(result->Get("invalid") != String("\xff\xfe"));
+
+	/* Hashes stay as they were. */
+	BOOST_CHECK(PackMessage((Array::Ptr)new Array({1, "two"})) == PackObject((Array::Ptr)new Array({1, "two"})));
+}
+
+BOOST_AUTO_TEST_CASE(unpack_sink)
+{
+	std::vector<std::vector<String>> paths;
+	LargeStringSink sink { 5, [&paths](const std::vector<String>& path, String&& value) -> Value {
+		paths.push_back(path);
+		return value.GetLength();
+	} };
+
+	Dictionary::Ptr dict = new Dictionary({
+		{"a", "long string"},
+		{"b", (Array::Ptr)new Array({"short", "long string"})}
+	});
+
+	Dictionary::Ptr result = UnpackObject(PackObject(dict), &sink);
+
+	BOOST_CHECK(result->Get("a") == 11);
+	BOOST_CHECK(Array::Ptr(result->Get("b"))->Get(0) == "short");
+	BOOST_CHECK(Array::Ptr(result->Get("b"))->Get(1) == 11);
+
+	BOOST_REQUIRE(paths.size() == 2u);
+	BOOST_CHECK(paths[0] == std::vector<String>({"a"}));
+	BOOST_CHECK(paths[1] == std::vector<String>({"b", "1"}));
+}
+
+BOOST_AUTO_TEST_CASE(unpack_invalid)
+{
+	String packed = PackObject((Array::Ptr)new Array({"foobar"}));
+
+	BOOST_CHECK_THROW(UnpackObject(packed.SubStr(0, packed.GetLength() - 1)), std::invalid_argument);
+	BOOST_CHECK_THROW(UnpackObject(packed + String(1, '\0')), std::invalid_argument);
+	BOOST_CHECK_THROW(UnpackObject(String(std::string("\5\xff\xff\xff\xff\xff\xff\xff\xff", 9))), std::invalid_argument);
+	BOOST_CHECK_THROW(UnpackObject("\7"), std::invalid_argument);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
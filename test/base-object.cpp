@@ -1,8 +1,12 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/object.hpp"
+#include "base/objectlock.hpp"
 #include "base/value.hpp"
 #include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 using namespace icinga;
 
@@ -36,4 +40,36 @@ BOOST_AUTO_TEST_CASE(getself)
 	BOOST_CHECK(vobject.IsObjectType<TestObject>());
 }
 
+BOOST_AUTO_TEST_CASE(lock)
+{
+	TestObject::Ptr tobject = new TestObject();
+	int counter = 0;
+	std::atomic<bool> owned (true);
+
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < 4; i++) {
+		threads.emplace_back([&tobject, &counter, &owned]() {
+			for (int j = 0; j < 10000; j++) {
+				ObjectLock olock(tobject);
+				ObjectLock nested(tobject);
+
+				counter++;
+
+				nested.Unlock();
+
+				if (!tobject->OwnsLock())
+					owned.store(false);
+			}
+		});
+	}
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	BOOST_CHECK(counter == 40000);
+	BOOST_CHECK(owned.load());
+	BOOST_CHECK(!tobject->OwnsLock());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
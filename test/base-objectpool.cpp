@@ -0,0 +1,69 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/objectpool.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include <BoostTestTargetConfig.h>
+#include <thread>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_objectpool)
+
+BOOST_AUTO_TEST_CASE(recycle)
+{
+	Array::Ptr first = new Array();
+	const void *address = first.get();
+
+	first.reset();
+
+	Array::Ptr second = new Array();
+
+	BOOST_CHECK(second.get() == address);
+}
+
+BOOST_AUTO_TEST_CASE(size_class)
+{
+	/* Objects without a pool of their own share the one of their size class. */
+	Object::Ptr first = new Object();
+	const void *address = first.get();
+
+	first.reset();
+
+	Object::Ptr second = new Object();
+
+	BOOST_CHECK(second.get() == address);
+	BOOST_CHECK(second->GetObjectSize() == sizeof(Object));
+	BOOST_CHECK(Array::Ptr(new Array())->GetObjectSize() == sizeof(Array));
+}
+
+BOOST_AUTO_TEST_CASE(other_thread)
+{
+	std::vector<Dictionary::Ptr> dicts;
+
+	for (int i = 0; i < 10000; i++)
+		dicts.emplace_back(new Dictionary({ { "i", i } }));
+
+	/* Released by another thread, its blocks end up in the shared free list. */
+	std::thread([&dicts]() { dicts.clear(); }).join();
+
+	for (int i = 0; i < 10000; i++)
+		dicts.emplace_back(new Dictionary({ { "i", i } }));
+
+	BOOST_CHECK(dicts.back()->Get("i") == 9999);
+
+	Dictionary::Ptr status = new Dictionary();
+	ObjectPool::StatsFunc(status, new Array());
+
+	Dictionary::Ptr pools = status->Get("objectpool");
+	BOOST_REQUIRE(pools);
+
+	Dictionary::Ptr pool = pools->Get("Dictionary");
+	BOOST_REQUIRE(pool);
+
+	BOOST_CHECK(pool->Get("recycled") > 0);
+	BOOST_CHECK(pool->Get("in_use") >= 10000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,70 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/ringbitset.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_ringbitset)
+
+BOOST_AUTO_TEST_CASE(push)
+{
+	RingBitset<4> bits;
+
+	bits.Push(true);
+	bits.Push(false);
+	bits.Push(true);
+
+	BOOST_CHECK(bits.GetData() == 5);
+	BOOST_CHECK(bits.GetIndex() == 3);
+	BOOST_CHECK(bits.Count() == 2);
+
+	/* Overwrites the oldest one. */
+	bits.Push(false);
+	bits.Push(false);
+
+	BOOST_CHECK(bits.GetData() == 4);
+	BOOST_CHECK(bits.GetIndex() == 1);
+	BOOST_CHECK(bits.Count() == 1);
+
+	RingBitset<4> restored (bits.GetData(), bits.GetIndex());
+
+	BOOST_CHECK(restored.GetData() == bits.GetData());
+	BOOST_CHECK(restored.GetIndex() == bits.GetIndex());
+}
+
+BOOST_AUTO_TEST_CASE(ordered)
+{
+	RingBitset<20> bits;
+
+	for (int i = 0; i < 25; i++)
+		bits.Push(i % 3 == 0);
+
+	/* Events 5 to 24, the oldest one first. */
+	auto ordered (bits.GetOrdered());
+
+	for (int i = 0; i < 20; i++)
+		BOOST_CHECK(bool(ordered & (1ull << i)) == ((i + 5) % 3 == 0));
+}
+
+BOOST_AUTO_TEST_CASE(weighted)
+{
+	RingBitset<64> bits;
+
+	for (int i = 0; i < 100; i++)
+		bits.Push(i % 7 == 0 || i % 5 == 0);
+
+	uint_fast64_t expected = 0;
+
+	for (int i = 0; i < 64; i++) {
+		int event = i + 36;
+
+		if (event % 7 == 0 || event % 5 == 0)
+			expected += 3 + 2 * i;
+	}
+
+	BOOST_CHECK(bits.GetWeightedCount(3, 2) == expected);
+	BOOST_CHECK(bits.GetWeightedCount(1, 0) == bits.Count());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,54 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/ringbuffer.hpp"
+#include <BoostTestTargetConfig.h>
+#include <thread>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_ringbuffer)
+
+BOOST_AUTO_TEST_CASE(values)
+{
+	RingBuffer rb (10);
+
+	rb.InsertValue(100, 1);
+	rb.InsertValue(100, 2);
+	rb.InsertValue(103, 4);
+
+	BOOST_CHECK(rb.UpdateAndGetValues(103, 1) == 4);
+	BOOST_CHECK(rb.UpdateAndGetValues(103, 10) == 7);
+	BOOST_CHECK(rb.CalculateRate(103, 10) == 7 / 4.0);
+
+	/* The slot of 100 is reused for 110. */
+	rb.InsertValue(110, 8);
+
+	BOOST_CHECK(rb.UpdateAndGetValues(110, 10) == 12);
+	BOOST_CHECK(rb.UpdateAndGetValues(120, 10) == 0);
+
+	/* Too old to be counted anymore. */
+	rb.InsertValue(100, 16);
+
+	BOOST_CHECK(rb.UpdateAndGetValues(110, 10) == 12);
+}
+
+BOOST_AUTO_TEST_CASE(threads)
+{
+	RingBuffer rb (60);
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < 4; i++) {
+		threads.emplace_back([&rb]() {
+			for (int j = 0; j < 10000; j++)
+				rb.InsertValue(1000 + j % 3, 1);
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	BOOST_CHECK(rb.UpdateAndGetValues(1002, 3) == 40000);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
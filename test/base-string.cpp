@@ -101,4 +101,27 @@ BOOST_AUTO_TEST_CASE(find)
 	BOOST_CHECK(s.FindFirstOf("xl") == 2);
 }
 
+BOOST_AUTO_TEST_CASE(views)
+{
+	String s = "  a;b;;c  ";
+
+	BOOST_CHECK(s.TrimView() == "a;b;;c");
+	BOOST_CHECK(s.SubView(2, 3) == "a;b");
+	BOOST_CHECK(s.SubView(8) == "  ");
+
+	auto tokens (SplitView(s.TrimView(), ";"));
+	auto copies (s.Trim().Split(";"));
+
+	BOOST_REQUIRE(tokens.size() == copies.size());
+
+	for (decltype(tokens.size()) i = 0; i < tokens.size(); i++)
+		BOOST_CHECK(String(tokens[i]) == copies[i]);
+
+	BOOST_CHECK(String().SplitView(";").size() == 1);
+
+	String t;
+	t.Append(s.SubView(2, 1));
+	BOOST_CHECK(t == "a");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
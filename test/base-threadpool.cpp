@@ -0,0 +1,59 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/threadpool.hpp"
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_threadpool)
+
+BOOST_AUTO_TEST_CASE(post)
+{
+	std::atomic<int> count (0);
+
+	{
+		ThreadPool tp (4);
+
+		for (int i = 0; i < 1000; i++) {
+			BOOST_CHECK(tp.Post([&tp, &count]() {
+				/* Posting from within a worker uses its own queue. */
+				tp.Post([&count]() { count++; }, DefaultScheduler);
+				count++;
+			}, DefaultScheduler));
+		}
+
+		/* Stop() rejects new work items, wait for the nested ones first. */
+		for (int i = 0; i < 500 && count < 2000; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		tp.Stop();
+		BOOST_CHECK(!tp.Post([]() { }, DefaultScheduler));
+	}
+
+	BOOST_CHECK(count == 2000);
+}
+
+BOOST_AUTO_TEST_CASE(low_latency)
+{
+	ThreadPool tp (2);
+	std::promise<void> release;
+	std::shared_future<void> released (release.get_future());
+
+	/* Keep all regular workers busy. */
+	for (int i = 0; i < 2; i++)
+		tp.Post([released]() { released.wait(); }, DefaultScheduler);
+
+	std::promise<void> done;
+	tp.Post([&done]() { done.set_value(); }, LowLatencyScheduler);
+
+	BOOST_CHECK(done.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+
+	release.set_value();
+	tp.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
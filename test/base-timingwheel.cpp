@@ -0,0 +1,99 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/timingwheel.hpp"
+#include <BoostTestTargetConfig.h>
+#include <algorithm>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_timingwheel)
+
+BOOST_AUTO_TEST_CASE(expire)
+{
+	TimingWheel<int> wheel (1000);
+	std::vector<int> expired;
+
+	wheel.Insert(1, 1000.5);
+	wheel.Insert(2, 1001);
+	wheel.Insert(3, 999);
+
+	BOOST_CHECK(wheel.GetLength() == 3);
+
+	wheel.Advance(1000, expired);
+	BOOST_CHECK(expired == std::vector<int>({ 3 }));
+
+	expired.clear();
+	wheel.Advance(1000.6, expired);
+	BOOST_CHECK(expired == std::vector<int>({ 1 }));
+
+	expired.clear();
+	wheel.Advance(1001, expired);
+	BOOST_CHECK(expired == std::vector<int>({ 2 }));
+
+	BOOST_CHECK(wheel.Empty());
+}
+
+BOOST_AUTO_TEST_CASE(erase)
+{
+	TimingWheel<int> wheel (1000);
+	std::vector<int> expired;
+
+	wheel.Insert(1, 1001);
+	wheel.Insert(2, 1001);
+
+	BOOST_CHECK(wheel.Erase(1));
+	BOOST_CHECK(!wheel.Erase(1));
+
+	wheel.Advance(1002, expired);
+	BOOST_CHECK(expired == std::vector<int>({ 2 }));
+}
+
+BOOST_AUTO_TEST_CASE(cascade)
+{
+	TimingWheel<int> wheel (1000);
+	std::vector<int> expired;
+
+	/* One item per level. */
+	wheel.Insert(1, 1001);
+	wheel.Insert(2, 1100);
+	wheel.Insert(3, 2000);
+	wheel.Insert(4, 1000 + 86400 * 3);
+
+	for (double now = 1000; now < 1000 + 86400 * 3 + 1; now += 0.5) {
+		double deadline = wheel.GetNextDeadline();
+		size_t count = expired.size();
+
+		wheel.Advance(now, expired);
+
+		/* Nothing may expire before the advertised deadline. */
+		if (now < deadline)
+			BOOST_CHECK(expired.size() == count);
+	}
+
+	BOOST_CHECK(expired == std::vector<int>({ 1, 2, 3, 4 }));
+	BOOST_CHECK(wheel.Empty());
+}
+
+BOOST_AUTO_TEST_CASE(clock_jump)
+{
+	TimingWheel<int> wheel (1000);
+	std::vector<int> expired;
+
+	wheel.Insert(1, 1010);
+
+	/* Backwards: nothing expires and the item is kept. */
+	wheel.Advance(500, expired);
+	BOOST_CHECK(expired.empty());
+
+	double when;
+	BOOST_CHECK(wheel.GetExpiry(1, when) && when == 1010);
+
+	wheel.Insert(2, 505);
+
+	/* Far forward. */
+	wheel.Advance(100000, expired);
+	std::sort(expired.begin(), expired.end());
+	BOOST_CHECK(expired == std::vector<int>({ 1, 2 }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
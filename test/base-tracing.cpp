@@ -0,0 +1,54 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/tracing.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_tracing)
+
+BOOST_AUTO_TEST_CASE(traceparent)
+{
+	TraceContext context = TraceContext::FromTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+
+	BOOST_CHECK(context.IsValid());
+	BOOST_CHECK(context.TraceId == "4bf92f3577b34da6a3ce929d0e0e4736");
+	BOOST_CHECK(context.SpanId == "00f067aa0ba902b7");
+	BOOST_CHECK(context.ToTraceparent() == "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+
+	BOOST_CHECK(TraceContext().ToTraceparent() == "");
+}
+
+BOOST_AUTO_TEST_CASE(invalid)
+{
+	BOOST_CHECK(!TraceContext::FromTraceparent("").IsValid());
+	BOOST_CHECK(!TraceContext::FromTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7").IsValid());
+	BOOST_CHECK(!TraceContext::FromTraceparent("00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01").IsValid());
+	BOOST_CHECK(!TraceContext::FromTraceparent("00-00000000000000000000000000000000-00f067aa0ba902b7-01").IsValid());
+	BOOST_CHECK(!TraceContext::FromTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01").IsValid());
+	BOOST_CHECK(!TraceContext::FromTraceparent("ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01").IsValid());
+
+	/* not sampled */
+	BOOST_CHECK(!TraceContext::FromTraceparent("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00").IsValid());
+}
+
+BOOST_AUTO_TEST_CASE(sampling)
+{
+	double ratio = Tracing::GetSampleRatio();
+
+	Tracing::SetSampleRatio(0);
+	BOOST_CHECK(!Tracing::StartTrace().IsValid());
+
+	Tracing::SetSampleRatio(1);
+
+	TraceContext context = Tracing::StartTrace();
+
+	BOOST_CHECK(context.IsValid());
+	BOOST_CHECK(context.TraceId.GetLength() == 32);
+	BOOST_CHECK(context.SpanId.GetLength() == 16);
+	BOOST_CHECK(TraceContext::FromTraceparent(context.ToTraceparent()).TraceId == context.TraceId);
+
+	Tracing::SetSampleRatio(ratio);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
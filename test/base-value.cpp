@@ -49,4 +49,32 @@ BOOST_AUTO_TEST_CASE(format)
 	BOOST_CHECK(v != 3);
 }
 
+BOOST_AUTO_TEST_CASE(copy)
+{
+	BOOST_CHECK(sizeof(Value) <= 16);
+
+	Value s = "hello";
+	Value copy = s;
+
+	BOOST_CHECK(&copy.Get<String>() == &s.Get<String>());
+
+	copy = 3;
+	BOOST_CHECK(s == "hello");
+	BOOST_CHECK(copy == 3);
+
+	Value moved = std::move(s);
+	BOOST_CHECK(moved == "hello");
+	BOOST_CHECK(s.IsEmpty());
+
+	moved.Swap(copy);
+	BOOST_CHECK(moved == 3);
+	BOOST_CHECK(copy == "hello");
+
+	Object::Ptr object = new Object();
+	Value o = object;
+	BOOST_CHECK(o.Get<Object::Ptr>() == object);
+
+	BOOST_CHECK_THROW(o.Get<String>(), boost::bad_get);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,152 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/workqueue.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_workqueue)
+
+BOOST_AUTO_TEST_CASE(enqueue_batch_order)
+{
+	WorkQueue wq;
+	wq.SetName("Test");
+
+	std::vector<int> results;
+	std::vector<TaskFunction> tasks;
+
+	for (int i = 0; i < 100; i++)
+		tasks.emplace_back([&results, i]() { results.push_back(i); });
+
+	wq.EnqueueBatch(std::move(tasks));
+	wq.Join();
+
+	BOOST_CHECK(results.size() == 100);
+
+	for (int i = 0; i < 100; i++)
+		BOOST_CHECK(results[i] == i);
+}
+
+BOOST_AUTO_TEST_CASE(enqueue_batch_bounded)
+{
+	WorkQueue wq (10, 4);
+	wq.SetName("Test");
+
+	std::atomic<int> count (0);
+	std::vector<TaskFunction> tasks;
+
+	for (int i = 0; i < 1000; i++)
+		tasks.emplace_back([&count]() { count++; });
+
+	wq.EnqueueBatch(std::move(tasks));
+	wq.Join();
+
+	BOOST_CHECK(count == 1000);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_for)
+{
+	WorkQueue wq (0, 4);
+	wq.SetName("Test");
+
+	std::vector<int> items;
+
+	for (int i = 0; i < 1000; i++)
+		items.push_back(i);
+
+	std::vector<std::atomic<int>> calls (items.size());
+
+	for (auto& count : calls)
+		count = 0;
+
+	/* The first items are much more expensive than the rest. */
+	wq.ParallelFor(items, [&calls](int i) {
+		if (i < 4)
+			Utility::Sleep(0.05);
+
+		calls[i]++;
+	});
+
+	wq.Join();
+
+	for (auto& count : calls)
+		BOOST_CHECK(count == 1);
+
+	std::vector<int> none;
+	wq.ParallelFor(none, [](int) { BOOST_FAIL("Called for no items"); });
+	wq.Join();
+}
+
+BOOST_AUTO_TEST_CASE(sharded_key_order)
+{
+	ShardedWorkQueue wq (0, 4);
+	wq.SetName("Test");
+
+	int keys[8];
+	std::vector<int> results[8];
+
+	for (int i = 0; i < 100; i++) {
+		for (int k = 0; k < 8; k++)
+			wq.Enqueue(&keys[k], [&results, k, i]() { results[k].push_back(i); });
+	}
+
+	wq.Join();
+
+	for (int k = 0; k < 8; k++) {
+		BOOST_CHECK(results[k].size() == 100);
+
+		for (int i = 0; i < 100; i++)
+			BOOST_CHECK(results[k][i] == i);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(stats)
+{
+	WorkQueue wq;
+	wq.SetName("Test");
+
+	for (int i = 0; i < 10; i++)
+		wq.Enqueue([]() { Utility::Sleep(0.01); });
+
+	wq.Join();
+
+	Dictionary::Ptr stats = wq.GetStats();
+	Dictionary::Ptr runTime = stats->Get("run_time");
+	Dictionary::Ptr waitTime = stats->Get("wait_time");
+	Array::Ptr enqueuers = stats->Get("enqueuers");
+
+	BOOST_CHECK(stats->Get("items") == 0);
+	BOOST_CHECK(runTime->Get("count") == 10);
+	BOOST_CHECK(runTime->Get("p50") >= 0.009);
+
+	/* The last task waited for all the others. */
+	BOOST_CHECK(waitTime->Get("max") >= 0.08);
+
+	/* All of them have been enqueued by this test case. */
+	BOOST_CHECK(enqueuers->GetLength() == 1);
+
+	Dictionary::Ptr enqueuer = enqueuers->Get(0);
+	BOOST_CHECK(enqueuer->Get("tasks") == 10);
+}
+
+BOOST_AUTO_TEST_CASE(statsfunc)
+{
+	WorkQueue wq;
+	wq.SetName("Test statsfunc");
+
+	wq.Enqueue([]() { });
+	wq.Join();
+
+	Dictionary::Ptr status = new Dictionary();
+	Array::Ptr perfdata = new Array();
+
+	WorkQueue::StatsFunc(status, perfdata);
+
+	Dictionary::Ptr queues = status->Get("workqueues");
+	BOOST_CHECK(queues->Contains("Test statsfunc"));
+	BOOST_CHECK(perfdata->GetLength() >= 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
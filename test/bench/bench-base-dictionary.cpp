@@ -0,0 +1,74 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench.hpp"
+#include "base/dictionary.hpp"
+#include "base/convert.hpp"
+
+using namespace icinga;
+
+/* Roughly the number of attributes of a host or service object. */
+static const int l_DictionaryKeys = 64;
+
+static std::vector<String> MakeKeys()
+{
+	std::vector<String> keys;
+
+	for (int i = 0; i < l_DictionaryKeys; i++)
+		keys.emplace_back("attribute_" + Convert::ToString(i));
+
+	return keys;
+}
+
+static void DictionaryGet(BenchmarkState& state)
+{
+	std::vector<String> keys = MakeKeys();
+	Dictionary::Ptr dict = new Dictionary();
+
+	for (auto& key : keys)
+		dict->Set(key, key);
+
+	size_t i = 0;
+
+	while (state.KeepRunning()) {
+		Value value = dict->Get(keys[i++ % keys.size()]);
+		DoNotOptimize(value);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+}
+
+REGISTER_BENCHMARK(DictionaryGet);
+
+static void DictionarySet(BenchmarkState& state)
+{
+	std::vector<String> keys = MakeKeys();
+	Dictionary::Ptr dict = new Dictionary();
+	size_t i = 0;
+
+	while (state.KeepRunning()) {
+		dict->Set(keys[i % keys.size()], (double)i);
+		i++;
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+}
+
+REGISTER_BENCHMARK(DictionarySet);
+
+static void DictionaryBuild(BenchmarkState& state)
+{
+	std::vector<String> keys = MakeKeys();
+
+	while (state.KeepRunning()) {
+		Dictionary::Ptr dict = new Dictionary();
+
+		for (auto& key : keys)
+			dict->Set(key, key);
+
+		DoNotOptimize(dict);
+	}
+
+	state.SetItemsProcessed(state.GetIterations() * keys.size());
+}
+
+REGISTER_BENCHMARK(DictionaryBuild);
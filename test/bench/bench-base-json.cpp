@@ -0,0 +1,107 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include "base/json.hpp"
+#include "base/object-packer.hpp"
+
+using namespace icinga;
+
+/**
+ * Builds an event::CheckResult cluster message as it is sent for every check.
+ */
+static Dictionary::Ptr MakeCheckResultMessage()
+{
+	Dictionary::Ptr cr = new Dictionary({
+		{ "type", "CheckResult" },
+		{ "active", true },
+		{ "check_source", "master1.example.com" },
+		{ "command", new Array({ "/usr/lib/nagios/plugins/check_ping", "-H", "192.0.2.10", "-c", "5000,100%", "-w", "3000,80%" }) },
+		{ "execution_start", 1600000000.123 },
+		{ "execution_end", 1600000004.456 },
+		{ "exit_status", 0 },
+		{ "output", "PING OK - Packet loss = 0%, RTA = 0.42 ms" },
+		{ "performance_data", new Array({ "rta=0.420000ms;3000.000000;5000.000000;0.000000", "pl=0%;80;100;0" }) },
+		{ "schedule_start", 1600000000.0 },
+		{ "schedule_end", 1600000004.5 },
+		{ "state", 0 },
+		{ "vars_after", new Dictionary({ { "attempt", 1 }, { "reachable", true }, { "state", 0 }, { "state_type", 1 } }) },
+		{ "vars_before", new Dictionary({ { "attempt", 1 }, { "reachable", true }, { "state", 0 }, { "state_type", 1 } }) }
+	});
+
+	return new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::CheckResult" },
+		{ "params", new Dictionary({
+			{ "host", "web01.example.com" },
+			{ "service", "ping4" },
+			{ "cr", cr }
+		}) },
+		{ "ts", 1600000004.5 }
+	});
+}
+
+static void JsonEncodeCheckResult(BenchmarkState& state)
+{
+	Dictionary::Ptr message = MakeCheckResultMessage();
+	uint_fast64_t bytes = 0;
+
+	while (state.KeepRunning()) {
+		String encoded = JsonEncode(message);
+		bytes += encoded.GetLength();
+		DoNotOptimize(encoded);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+	state.SetBytesProcessed(bytes);
+}
+
+REGISTER_BENCHMARK(JsonEncodeCheckResult);
+
+static void JsonDecodeCheckResult(BenchmarkState& state)
+{
+	String encoded = JsonEncode(MakeCheckResultMessage());
+
+	while (state.KeepRunning()) {
+		Value decoded = JsonDecode(encoded);
+		DoNotOptimize(decoded);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+	state.SetBytesProcessed(state.GetIterations() * encoded.GetLength());
+}
+
+REGISTER_BENCHMARK(JsonDecodeCheckResult);
+
+static void PackObjectCheckResult(BenchmarkState& state)
+{
+	Dictionary::Ptr message = MakeCheckResultMessage();
+	uint_fast64_t bytes = 0;
+
+	while (state.KeepRunning()) {
+		String packed = PackObject(message);
+		bytes += packed.GetLength();
+		DoNotOptimize(packed);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+	state.SetBytesProcessed(bytes);
+}
+
+REGISTER_BENCHMARK(PackObjectCheckResult);
+
+static void UnpackObjectCheckResult(BenchmarkState& state)
+{
+	String packed = PackObject(MakeCheckResultMessage());
+
+	while (state.KeepRunning()) {
+		Value unpacked = UnpackObject(packed);
+		DoNotOptimize(unpacked);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+	state.SetBytesProcessed(state.GetIterations() * packed.GetLength());
+}
+
+REGISTER_BENCHMARK(UnpackObjectCheckResult);
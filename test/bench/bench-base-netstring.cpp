@@ -0,0 +1,66 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench.hpp"
+#include "base/netstring.hpp"
+#include "base/fifo.hpp"
+#include <cstdlib>
+#include <sstream>
+
+using namespace icinga;
+
+/* The size of a typical cluster message. */
+static const size_t l_MessageLength = 1024;
+
+static void NetStringWriteRead(BenchmarkState& state)
+{
+	FIFO::Ptr fifo = new FIFO();
+	String message (l_MessageLength, 'x');
+	StreamReadContext src;
+	String result;
+
+	while (state.KeepRunning()) {
+		NetString::WriteStringToStream(fifo, message);
+
+		if (NetString::ReadStringFromStream(fifo, &result, src) != StatusNewItem)
+			std::abort();
+
+		DoNotOptimize(result);
+	}
+
+	fifo->Close();
+
+	state.SetItemsProcessed(state.GetIterations());
+	state.SetBytesProcessed(state.GetIterations() * l_MessageLength);
+}
+
+REGISTER_BENCHMARK(NetStringWriteRead);
+
+static void NetStringReadFromBuffer(BenchmarkState& state)
+{
+	std::ostringstream stream;
+	String message (l_MessageLength, 'x');
+
+	/* A read buffer with many messages, as received from a connection. */
+	for (int i = 0; i < 64; i++)
+		NetString::WriteStringToStream(stream, message);
+
+	String buffer (stream.str());
+	const char *begin = buffer.CStr();
+	const char *end = begin + buffer.GetLength();
+	const char *current = begin;
+	boost::string_view result;
+
+	while (state.KeepRunning()) {
+		if (!NetString::ReadStringFromBuffer(current, end, result)) {
+			current = begin;
+			NetString::ReadStringFromBuffer(current, end, result);
+		}
+
+		DoNotOptimize(result);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+	state.SetBytesProcessed(state.GetIterations() * l_MessageLength);
+}
+
+REGISTER_BENCHMARK(NetStringReadFromBuffer);
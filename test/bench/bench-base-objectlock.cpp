@@ -0,0 +1,36 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench.hpp"
+#include "base/object.hpp"
+#include "base/objectlock.hpp"
+
+using namespace icinga;
+
+static void ObjectLockUncontended(BenchmarkState& state)
+{
+	Object::Ptr object = new Object();
+
+	while (state.KeepRunning()) {
+		ObjectLock olock(object);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+}
+
+REGISTER_BENCHMARK(ObjectLockUncontended);
+
+/* All threads lock the same object, like the cluster and check threads do for a busy checkable. */
+static Object::Ptr l_ContendedObject = new Object();
+
+static void ObjectLockContended(BenchmarkState& state)
+{
+	while (state.KeepRunning()) {
+		ObjectLock olock(l_ContendedObject);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+}
+
+REGISTER_BENCHMARK_THREADS(ObjectLockContended, 2);
+REGISTER_BENCHMARK_THREADS(ObjectLockContended, 4);
+REGISTER_BENCHMARK_THREADS(ObjectLockContended, 8);
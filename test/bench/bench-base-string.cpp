@@ -0,0 +1,40 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench.hpp"
+#include "base/string.hpp"
+
+using namespace icinga;
+
+/* A performance data string as returned by check plugins. */
+static const char *l_PerfdataLine = "rta=0.420000ms;3000.000000;5000.000000;0.000000 pl=0%;80;100;0 "
+	"rtmax=0.510000ms;;;; rtmin=0.380000ms;;;;";
+
+static void StringSplit(BenchmarkState& state)
+{
+	String line (l_PerfdataLine);
+
+	while (state.KeepRunning()) {
+		std::vector<String> tokens = line.Split(" ;");
+		DoNotOptimize(tokens);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+	state.SetBytesProcessed(state.GetIterations() * line.GetLength());
+}
+
+REGISTER_BENCHMARK(StringSplit);
+
+static void StringSplitView(BenchmarkState& state)
+{
+	String line (l_PerfdataLine);
+
+	while (state.KeepRunning()) {
+		std::vector<boost::string_view> tokens = line.SplitView(" ;");
+		DoNotOptimize(tokens);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+	state.SetBytesProcessed(state.GetIterations() * line.GetLength());
+}
+
+REGISTER_BENCHMARK(StringSplitView);
@@ -0,0 +1,66 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench.hpp"
+#include "base/value.hpp"
+
+using namespace icinga;
+
+static void ValueAddNumbers(BenchmarkState& state)
+{
+	Value sum = 0;
+	Value step = 1.5;
+
+	while (state.KeepRunning())
+		sum = sum + step;
+
+	DoNotOptimize(sum);
+
+	state.SetItemsProcessed(state.GetIterations());
+}
+
+REGISTER_BENCHMARK(ValueAddNumbers);
+
+static void ValueAddStrings(BenchmarkState& state)
+{
+	Value prefix = "checkercomponent_";
+	Value name = "checker";
+
+	while (state.KeepRunning()) {
+		Value result = prefix + name;
+		DoNotOptimize(result);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+}
+
+REGISTER_BENCHMARK(ValueAddStrings);
+
+static void ValueCompareNumbers(BenchmarkState& state)
+{
+	Value lhs = 42;
+	Value rhs = 42.5;
+
+	while (state.KeepRunning()) {
+		bool result = lhs < rhs;
+		DoNotOptimize(result);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+}
+
+REGISTER_BENCHMARK(ValueCompareNumbers);
+
+static void ValueMultiplyMixed(BenchmarkState& state)
+{
+	Value lhs = "3";
+	Value rhs = 1.5;
+
+	while (state.KeepRunning()) {
+		Value result = lhs * rhs;
+		DoNotOptimize(result);
+	}
+
+	state.SetItemsProcessed(state.GetIterations());
+}
+
+REGISTER_BENCHMARK(ValueMultiplyMixed);
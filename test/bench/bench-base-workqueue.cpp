@@ -0,0 +1,73 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench.hpp"
+#include "base/workqueue.hpp"
+#include <atomic>
+
+using namespace icinga;
+
+static void WorkQueueEnqueue(BenchmarkState& state)
+{
+	WorkQueue wq;
+	wq.SetName("Bench");
+
+	std::atomic<uint_fast64_t> count (0);
+
+	while (state.KeepRunning())
+		wq.Enqueue([&count]() { count++; });
+
+	/* The tasks are done once they have been processed, not enqueued. */
+	state.ResumeTiming();
+	wq.Join();
+	state.PauseTiming();
+
+	state.SetItemsProcessed(count.load());
+}
+
+REGISTER_BENCHMARK(WorkQueueEnqueue);
+
+static void WorkQueueEnqueueBounded(BenchmarkState& state)
+{
+	WorkQueue wq (1000, 4);
+	wq.SetName("Bench");
+
+	std::atomic<uint_fast64_t> count (0);
+
+	while (state.KeepRunning())
+		wq.Enqueue([&count]() { count++; });
+
+	state.ResumeTiming();
+	wq.Join();
+	state.PauseTiming();
+
+	state.SetItemsProcessed(count.load());
+}
+
+REGISTER_BENCHMARK(WorkQueueEnqueueBounded);
+
+static void WorkQueueEnqueueBatch(BenchmarkState& state)
+{
+	WorkQueue wq;
+	wq.SetName("Bench");
+
+	std::atomic<uint_fast64_t> count (0);
+	std::vector<TaskFunction> tasks;
+
+	while (state.KeepRunning()) {
+		tasks.emplace_back([&count]() { count++; });
+
+		if (tasks.size() == 100) {
+			wq.EnqueueBatch(std::move(tasks));
+			tasks.clear();
+		}
+	}
+
+	state.ResumeTiming();
+	wq.EnqueueBatch(std::move(tasks));
+	wq.Join();
+	state.PauseTiming();
+
+	state.SetItemsProcessed(count.load());
+}
+
+REGISTER_BENCHMARK(WorkQueueEnqueueBatch);
@@ -0,0 +1,213 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench.hpp"
+#include "bench-remote.hpp"
+#include "base/json.hpp"
+#include "base/netstring.hpp"
+#include "base/object-packer.hpp"
+#include "base/utility.hpp"
+#include "base/workqueue.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace icinga;
+
+/**
+ * Floods a connection with messages. Every message is flushed on its own,
+ * like a connection which isn't busy does, and carries its send time in "ts".
+ */
+static void JsonRpcFlood(BenchmarkState& state, Dictionary::Ptr (*makeMessage)(uint_fast64_t), bool binary)
+{
+	TlsStreamPair pair = MakeTlsStreamPair();
+	MessageReceiver receiver (pair.Server, state.GetIterations());
+
+	uint_fast64_t sent = 0, bytes = 0, maxInFlight = 0;
+
+	while (state.KeepRunning()) {
+		Dictionary::Ptr message = makeMessage(sent);
+		message->Set("ts", Utility::GetTime());
+
+		bytes += NetString::WriteStringToStream(pair.Client, binary ? PackObject(message) : JsonEncode(message));
+		pair.Client->flush();
+
+		sent++;
+		maxInFlight = std::max(maxInFlight, sent - receiver.GetReceived());
+	}
+
+	state.ResumeTiming();
+	receiver.Join();
+	state.PauseTiming();
+
+	state.SetItemsProcessed(sent);
+	state.SetBytesProcessed(bytes);
+	state.SetCounter("avg_latency_us", receiver.GetAverageLatency() * 1e6);
+	state.SetCounter("max_latency_us", receiver.GetMaxLatency() * 1e6);
+	state.SetCounter("max_in_flight", maxInFlight);
+}
+
+static void JsonRpcCheckResult(BenchmarkState& state)
+{
+	JsonRpcFlood(state, &MakeCheckResultMessage, false);
+}
+
+REGISTER_BENCHMARK(JsonRpcCheckResult);
+
+static void JsonRpcCheckResultBinary(BenchmarkState& state)
+{
+	JsonRpcFlood(state, &MakeCheckResultMessage, true);
+}
+
+REGISTER_BENCHMARK(JsonRpcCheckResultBinary);
+
+static void JsonRpcSetNextCheck(BenchmarkState& state)
+{
+	JsonRpcFlood(state, &MakeSetNextCheckMessage, false);
+}
+
+REGISTER_BENCHMARK(JsonRpcSetNextCheck);
+
+/**
+ * A connected endpoint. Like JsonRpcConnection::WriteOutgoingMessages() its
+ * writer thread sends all queued messages and flushes them together.
+ */
+struct SimulatedEndpoint
+{
+	TlsStreamPair Pair;
+	std::unique_ptr<MessageReceiver> Receiver;
+
+	std::mutex Mutex;
+	std::condition_variable CV;
+	std::deque<Shared<String>::Ptr> Queue;
+	bool Stopped{false};
+	std::thread Writer;
+
+	SimulatedEndpoint(uint_fast64_t count)
+		: Pair(MakeTlsStreamPair()), Receiver(new MessageReceiver(Pair.Server, count)), Writer(&SimulatedEndpoint::WriterProc, this)
+	{ }
+
+	~SimulatedEndpoint()
+	{
+		Stop();
+	}
+
+	void SendRawMessage(const Shared<String>::Ptr& message)
+	{
+		std::unique_lock<std::mutex> lock (Mutex);
+		Queue.emplace_back(message);
+		CV.notify_one();
+	}
+
+	void Stop()
+	{
+		{
+			std::unique_lock<std::mutex> lock (Mutex);
+			Stopped = true;
+			CV.notify_one();
+		}
+
+		if (Writer.joinable())
+			Writer.join();
+	}
+
+	void WriterProc()
+	{
+		std::unique_lock<std::mutex> lock (Mutex);
+
+		for (;;) {
+			while (Queue.empty() && !Stopped)
+				CV.wait(lock);
+
+			if (Queue.empty())
+				break;
+
+			std::deque<Shared<String>::Ptr> queue;
+			queue.swap(Queue);
+
+			lock.unlock();
+
+			for (auto& message : queue)
+				NetString::WriteStringToStream(Pair.Client, *message);
+
+			Pair.Client->flush();
+
+			lock.lock();
+		}
+	}
+};
+
+/**
+ * Relays check results to the given number of endpoints through a work queue
+ * like ApiListener::RelayMessage() does. The messages are generated as fast as
+ * possible, i.e. faster than they can be sent, and pile up in the queue. The
+ * latency is measured from enqueueing a message to receiving it.
+ */
+static void RelayQueue(BenchmarkState& state, int endpointCount)
+{
+	std::vector<std::unique_ptr<SimulatedEndpoint>> endpoints;
+
+	for (int i = 0; i < endpointCount; i++)
+		endpoints.emplace_back(new SimulatedEndpoint(state.GetIterations()));
+
+	WorkQueue relayQueue;
+	relayQueue.SetName("ApiListener, RelayQueue");
+
+	uint_fast64_t index = 0;
+	size_t maxLength = 0;
+
+	while (state.KeepRunning()) {
+		Dictionary::Ptr message = MakeCheckResultMessage(index++);
+		message->Set("ts", Utility::GetTime());
+
+		relayQueue.Enqueue([&endpoints, message]() {
+			/* Like ApiListener::SyncRelayMessage(), encode once for all endpoints. */
+			auto encoded (Shared<String>::Make(JsonEncode(message)));
+
+			for (auto& endpoint : endpoints)
+				endpoint->SendRawMessage(encoded);
+		}, PriorityNormal, true);
+
+		maxLength = std::max(maxLength, relayQueue.GetLength());
+	}
+
+	state.ResumeTiming();
+
+	relayQueue.Join();
+
+	for (auto& endpoint : endpoints) {
+		endpoint->Stop();
+		endpoint->Receiver->Join();
+	}
+
+	state.PauseTiming();
+
+	double latencySum = 0, latencyMax = 0;
+
+	for (auto& endpoint : endpoints) {
+		latencySum += endpoint->Receiver->GetAverageLatency();
+		latencyMax = std::max(latencyMax, endpoint->Receiver->GetMaxLatency());
+	}
+
+	state.SetItemsProcessed(index);
+	state.SetCounter("avg_latency_us", latencySum / endpointCount * 1e6);
+	state.SetCounter("max_latency_us", latencyMax * 1e6);
+	state.SetCounter("max_queue_length", maxLength);
+}
+
+static void RelayQueueOneEndpoint(BenchmarkState& state)
+{
+	RelayQueue(state, 1);
+}
+
+REGISTER_BENCHMARK(RelayQueueOneEndpoint);
+
+/* E.g. two satellites of a child zone and the other master of the local zone. */
+static void RelayQueueThreeEndpoints(BenchmarkState& state)
+{
+	RelayQueue(state, 3);
+}
+
+REGISTER_BENCHMARK(RelayQueueThreeEndpoints);
@@ -0,0 +1,123 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench.hpp"
+#include "bench-remote.hpp"
+#include "remote/replaylog.hpp"
+#include "base/convert.hpp"
+#include "base/json.hpp"
+#include "base/netstring.hpp"
+#include "base/utility.hpp"
+#include <boost/filesystem/operations.hpp>
+#include <cstdlib>
+#include <fstream>
+
+using namespace icinga;
+
+/**
+ * Writes a replay log with the given number of check results (the backlog).
+ */
+static String WriteBacklog(uint_fast64_t count)
+{
+	std::fstream fp;
+	String path = Utility::CreateTempFile((boost::filesystem::temp_directory_path() / "icinga2-bench-replaylog-XXXXXX").string(), 0600, fp);
+	fp.close();
+	Utility::Remove(path);
+
+	ReplayLogWriter::Ptr writer = new ReplayLogWriter(path);
+
+	if (!writer->IsGood())
+		std::abort();
+
+	for (uint_fast64_t i = 0; i < count; i++) {
+		Dictionary::Ptr message = MakeCheckResultMessage(i);
+		message->Set("ts", 1 + i * 0.001);
+
+		ReplayLogRecord record;
+		record.Timestamp = 1 + i * 0.001;
+		record.SecobjType = "Service";
+		record.SecobjName = "host" + Convert::ToString(i) + "!ping4";
+		record.Message = JsonEncode(message);
+
+		writer->Write(record);
+	}
+
+	writer->Close();
+
+	return path;
+}
+
+static void RemoveBacklog(const String& path)
+{
+	Utility::Remove(path);
+	Utility::Remove(ReplayLogReader::GetIndexPath(path));
+}
+
+/**
+ * Reads a backlog as fast as possible, without sending it.
+ */
+static void ReplayLogRead(BenchmarkState& state)
+{
+	String path = WriteBacklog(state.GetIterations());
+	uint_fast64_t bytes = 0;
+
+	{
+		ReplayLogReader reader (path);
+		reader.Seek(0);
+
+		ReplayLogRecord record;
+
+		while (state.KeepRunning()) {
+			if (!reader.ReadNext(record, 0))
+				std::abort();
+
+			bytes += record.Message.GetLength();
+		}
+	}
+
+	RemoveBacklog(path);
+
+	state.SetItemsProcessed(state.GetIterations());
+	state.SetBytesProcessed(bytes);
+}
+
+REGISTER_BENCHMARK(ReplayLogRead);
+
+/**
+ * Replays a backlog to a reconnected endpoint like ApiListener::ReplayLog()
+ * does, until the endpoint has received and decoded all of it.
+ */
+static void ReplayLogCatchUp(BenchmarkState& state)
+{
+	String path = WriteBacklog(state.GetIterations());
+	uint_fast64_t bytes = 0;
+
+	{
+		TlsStreamPair pair = MakeTlsStreamPair();
+		MessageReceiver receiver (pair.Server, state.GetIterations());
+
+		ReplayLogReader reader (path);
+		reader.Seek(0);
+
+		ReplayLogRecord record;
+
+		while (state.KeepRunning()) {
+			if (!reader.ReadNext(record, 0))
+				std::abort();
+
+			/* The stream is buffered, it's flushed whenever the buffer is full. */
+			bytes += NetString::WriteStringToStream(pair.Client, record.Message);
+		}
+
+		state.ResumeTiming();
+		pair.Client->flush();
+		receiver.Join();
+		state.PauseTiming();
+	}
+
+	RemoveBacklog(path);
+
+	state.SetItemsProcessed(state.GetIterations());
+	state.SetBytesProcessed(bytes);
+}
+
+REGISTER_BENCHMARK(ReplayLogCatchUp);
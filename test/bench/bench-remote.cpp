@@ -0,0 +1,184 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench-remote.hpp"
+#include "bench.hpp"
+#include "icinga/checkresult.hpp"
+#include "remote/apifunction.hpp"
+#include "remote/jsonrpc.hpp"
+#include "base/array.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/serializer.hpp"
+#include "base/tlsutility.hpp"
+#include "base/utility.hpp"
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <utility>
+
+using namespace icinga;
+
+/**
+ * Creates a connected pair of TLS streams. Both ends use the same self-signed
+ * certificate which is created on first use. The streams are meant for the
+ * synchronous API, i.e. no I/O engine is running.
+ */
+TlsStreamPair icinga::MakeTlsStreamPair()
+{
+	namespace asio = boost::asio;
+
+	static std::once_flag contextOnce;
+	static Shared<asio::ssl::context>::Ptr sslContext;
+	static asio::io_context io;
+
+	std::call_once(contextOnce, []() {
+		String prefix = (boost::filesystem::temp_directory_path() / ("icinga2-bench-" + Convert::ToString(Utility::GetPid()))).string();
+		String keyPath = prefix + ".key";
+		String certPath = prefix + ".crt";
+
+		MakeX509CSR("icinga2-bench", keyPath, String(), certPath);
+		sslContext = MakeAsioSslContext(certPath, keyPath);
+
+		/* The context holds the certificate and key now. */
+		Utility::Remove(keyPath);
+		Utility::Remove(certPath);
+	});
+
+	asio::ip::tcp::acceptor acceptor (io, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+
+	TlsStreamPair pair;
+	pair.Client = Shared<AsioTlsStream>::Make(io, *sslContext, "icinga2-bench");
+	pair.Server = Shared<AsioTlsStream>::Make(io, *sslContext);
+
+	pair.Client->lowest_layer().connect(acceptor.local_endpoint());
+	acceptor.accept(pair.Server->lowest_layer());
+
+	pair.Client->lowest_layer().set_option(asio::ip::tcp::no_delay(true));
+	pair.Server->lowest_layer().set_option(asio::ip::tcp::no_delay(true));
+
+	std::thread serverHandshake ([&pair]() {
+		pair.Server->next_layer().handshake(UnbufferedAsioTlsStream::server);
+	});
+
+	pair.Client->next_layer().handshake(UnbufferedAsioTlsStream::client);
+	serverHandshake.join();
+
+	return pair;
+}
+
+/**
+ * Creates an event::CheckResult message like ClusterEvents::MakeCheckResultMessage()
+ * does for the result of a typical plugin.
+ */
+Dictionary::Ptr icinga::MakeCheckResultMessage(uint_fast64_t index)
+{
+	double now = Utility::GetTime();
+
+	CheckResult::Ptr cr = new CheckResult();
+	cr->SetCommand(new Array({ "/usr/lib/nagios/plugins/check_ping", "-H", "192.0.2." + Convert::ToString(index % 254 + 1),
+		"-c", "5000,100%", "-w", "3000,80%" }));
+	cr->SetExitStatus(0);
+	cr->SetState(ServiceOK);
+	cr->SetOutput("PING OK - Packet loss = 0%, RTA = 0.42 ms");
+	cr->SetPerformanceData(new Array({ "rta=0.420000ms;3000.000000;5000.000000;0.000000", "pl=0%;80;100;0" }));
+	cr->SetCheckSource("satellite1.example.com");
+	cr->SetScheduleStart(now - 0.01);
+	cr->SetScheduleEnd(now);
+	cr->SetExecutionStart(now - 0.01);
+	cr->SetExecutionEnd(now);
+
+	return new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::CheckResult" },
+		{ "params", new Dictionary({
+			{ "host", "host" + Convert::ToString(index) },
+			{ "service", "ping4" },
+			{ "cr", Serialize(cr) }
+		}) }
+	});
+}
+
+/**
+ * Creates an event::SetNextCheck message like ClusterEvents::NextCheckChangedHandler() does.
+ */
+Dictionary::Ptr icinga::MakeSetNextCheckMessage(uint_fast64_t index)
+{
+	return new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::SetNextCheck" },
+		{ "params", new Dictionary({
+			{ "host", "host" + Convert::ToString(index) },
+			{ "service", "ping4" },
+			{ "next_check", Utility::GetTime() + 60 }
+		}) }
+	});
+}
+
+MessageReceiver::MessageReceiver(Shared<AsioTlsStream>::Ptr stream, uint_fast64_t count)
+	: m_Stream(std::move(stream)), m_Count(count), m_Thread(&MessageReceiver::ThreadProc, this)
+{ }
+
+MessageReceiver::~MessageReceiver()
+{
+	Join();
+}
+
+void MessageReceiver::Join()
+{
+	if (m_Thread.joinable())
+		m_Thread.join();
+}
+
+uint_fast64_t MessageReceiver::GetReceived() const
+{
+	return m_Received.load();
+}
+
+/**
+ * Only valid after Join().
+ */
+double MessageReceiver::GetAverageLatency() const
+{
+	uint_fast64_t received = m_Received.load();
+
+	return received > 0 ? m_LatencySum / received : 0;
+}
+
+/**
+ * Only valid after Join().
+ */
+double MessageReceiver::GetMaxLatency() const
+{
+	return m_LatencyMax;
+}
+
+void MessageReceiver::ThreadProc()
+{
+	try {
+		for (uint_fast64_t i = 0; i < m_Count; i++) {
+			Dictionary::Ptr message = JsonRpc::DecodeMessage(JsonRpc::ReadMessage(m_Stream));
+
+			/* The handlers need the endpoint of a connection, the benchmarks don't have any.
+			 * Processing check results is measured by tools/bench/config-benchmark.py. */
+			ApiFunction::Ptr function = ApiFunction::GetByName(message->Get("method"));
+			DoNotOptimize(function);
+
+			Value ts;
+
+			if (message->Get("ts", &ts)) {
+				double latency = Utility::GetTime() - static_cast<double>(ts);
+
+				m_LatencySum += latency;
+				m_LatencyMax = std::max(m_LatencyMax, latency);
+			}
+
+			m_Received++;
+		}
+	} catch (const std::exception& ex) {
+		std::cerr << "Error while receiving messages: " << DiagnosticInformation(ex) << "\n";
+		std::abort();
+	}
+}
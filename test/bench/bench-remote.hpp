@@ -0,0 +1,61 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef BENCH_REMOTE_H
+#define BENCH_REMOTE_H
+
+#include "base/dictionary.hpp"
+#include "base/shared.hpp"
+#include "base/tlsstream.hpp"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace icinga
+{
+
+/**
+ * Both ends of a TLS connection over the loopback interface, set up like
+ * the connections between cluster endpoints.
+ */
+struct TlsStreamPair
+{
+	Shared<AsioTlsStream>::Ptr Client;
+	Shared<AsioTlsStream>::Ptr Server;
+};
+
+TlsStreamPair MakeTlsStreamPair();
+
+Dictionary::Ptr MakeCheckResultMessage(uint_fast64_t index);
+Dictionary::Ptr MakeSetNextCheckMessage(uint_fast64_t index);
+
+/**
+ * Reads, decodes and dispatches a number of JSON-RPC messages from a stream in
+ * its own thread, like the receiving end of a cluster connection. The latency is
+ * measured from the "ts" attribute of a message to the time it was dispatched.
+ */
+class MessageReceiver
+{
+public:
+	MessageReceiver(Shared<AsioTlsStream>::Ptr stream, uint_fast64_t count);
+	~MessageReceiver();
+
+	void Join();
+
+	uint_fast64_t GetReceived() const;
+	double GetAverageLatency() const;
+	double GetMaxLatency() const;
+
+private:
+	Shared<AsioTlsStream>::Ptr m_Stream;
+	uint_fast64_t m_Count;
+	std::atomic<uint_fast64_t> m_Received{0};
+	double m_LatencySum{0};
+	double m_LatencyMax{0};
+	std::thread m_Thread;
+
+	void ThreadProc();
+};
+
+}
+
+#endif /* BENCH_REMOTE_H */
@@ -0,0 +1,261 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "bench.hpp"
+#include "base/application.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include "base/json.hpp"
+#include "base/utility.hpp"
+#include <boost/regex.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <thread>
+
+using namespace icinga;
+
+std::vector<Benchmark>& icinga::GetBenchmarks()
+{
+	static std::vector<Benchmark> benchmarks;
+	return benchmarks;
+}
+
+struct BenchmarkResult
+{
+	uint_fast64_t Iterations;
+	double RealTime;
+	double CpuTime;
+	double ItemsPerSecond;
+	double BytesPerSecond;
+	std::map<std::string, double> Counters;
+};
+
+/**
+ * Runs a benchmark once with the given number of iterations per thread.
+ *
+ * @param benchmark The benchmark.
+ * @param iterations The number of iterations per thread.
+ * @param elapsed The measured wall clock time, in seconds.
+ * @returns The result with times per iteration in nanoseconds.
+ */
+static BenchmarkResult RunBenchmark(const Benchmark& benchmark, uint_fast64_t iterations, double& elapsed)
+{
+	std::vector<BenchmarkState> states;
+
+	for (int i = 0; i < benchmark.Threads; i++)
+		states.emplace_back(iterations, i, benchmark.Threads);
+
+	if (benchmark.Threads == 1) {
+		benchmark.Function(states[0]);
+	} else {
+		/* The threads start together, their creation isn't measured. */
+		std::atomic<int> ready (0);
+		std::atomic<bool> go (false);
+		std::vector<std::thread> threads;
+
+		for (int i = 0; i < benchmark.Threads; i++) {
+			threads.emplace_back([&benchmark, &states, &ready, &go, i]() {
+				ready++;
+
+				while (!go.load())
+					std::this_thread::yield();
+
+				benchmark.Function(states[i]);
+			});
+		}
+
+		while (ready.load() < benchmark.Threads)
+			std::this_thread::yield();
+
+		go.store(true);
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	/* The threads run in parallel, their measured time spans overlap. The CPU time is the
+	 * one of the whole process, so every thread has seen (about) the total one. */
+	elapsed = 0;
+	double cpu = 0;
+	uint_fast64_t items = 0, bytes = 0;
+	BenchmarkResult result;
+
+	for (auto& state : states) {
+		elapsed = std::max(elapsed, state.GetRealTime());
+		cpu = std::max(cpu, state.GetCpuTime());
+		items += state.GetItemsProcessed();
+		bytes += state.GetBytesProcessed();
+
+		for (auto& counter : state.GetCounters())
+			result.Counters[counter.first] += counter.second;
+	}
+
+	result.Iterations = iterations;
+	result.RealTime = elapsed * 1e9 / iterations;
+	result.CpuTime = cpu * 1e9 / iterations / benchmark.Threads;
+	result.ItemsPerSecond = elapsed > 0 ? items / elapsed : 0;
+	result.BytesPerSecond = elapsed > 0 ? bytes / elapsed : 0;
+	return result;
+}
+
+/**
+ * Runs a benchmark with as many iterations as fit into the minimum time.
+ */
+static BenchmarkResult RunBenchmark(const Benchmark& benchmark, double minTime)
+{
+	uint_fast64_t iterations = 1;
+
+	for (;;) {
+		double elapsed;
+		BenchmarkResult result = RunBenchmark(benchmark, iterations, elapsed);
+
+		if (elapsed >= minTime || iterations >= 1000000000)
+			return result;
+
+		/* Aim a bit higher than the minimum time, but don't grow too fast on timer noise. */
+		double multiplier = elapsed > 0 ? std::min(minTime * 1.4 / elapsed, 10.0) : 10.0;
+
+		iterations = std::max<uint_fast64_t>(iterations + 1, static_cast<uint_fast64_t>(iterations * multiplier));
+	}
+}
+
+static void PrintConsole(const Benchmark& benchmark, const BenchmarkResult& result)
+{
+	std::printf("%-40s %14.0f ns %14.0f ns %12lu", benchmark.Name.c_str(),
+		result.RealTime, result.CpuTime, (unsigned long)result.Iterations);
+
+	if (result.ItemsPerSecond > 0)
+		std::printf(" items_per_second=%.6g/s", result.ItemsPerSecond);
+
+	if (result.BytesPerSecond > 0)
+		std::printf(" bytes_per_second=%.6g/s", result.BytesPerSecond);
+
+	for (auto& counter : result.Counters)
+		std::printf(" %s=%.6g", counter.first.c_str(), counter.second);
+
+	std::printf("\n");
+	std::fflush(stdout);
+}
+
+static void PrintUsage(const char *program)
+{
+	std::cerr << "Usage: " << program << " [--benchmark_filter=<regex>] [--benchmark_format=console|json]"
+		<< " [--benchmark_min_time=<seconds>] [--benchmark_list_tests]\n";
+}
+
+int main(int argc, char **argv)
+{
+	std::string filter (".");
+	std::string format ("console");
+	double minTime = 0.5;
+	bool listTests = false;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg (argv[i]);
+
+		if (arg.find("--benchmark_filter=") == 0) {
+			filter = arg.substr(19);
+		} else if (arg.find("--benchmark_format=") == 0) {
+			format = arg.substr(19);
+		} else if (arg.find("--benchmark_min_time=") == 0) {
+			minTime = std::atof(arg.substr(21).c_str());
+		} else if (arg == "--benchmark_list_tests") {
+			listTests = true;
+		} else {
+			PrintUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (format != "console" && format != "json") {
+		PrintUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	boost::regex expr (filter);
+	std::vector<Benchmark> benchmarks;
+
+	for (auto& benchmark : GetBenchmarks()) {
+		if (boost::regex_search(benchmark.Name, expr))
+			benchmarks.push_back(benchmark);
+	}
+
+	std::sort(benchmarks.begin(), benchmarks.end(), [](const Benchmark& a, const Benchmark& b) {
+		return a.Name < b.Name;
+	});
+
+	if (listTests) {
+		for (auto& benchmark : benchmarks)
+			std::cout << benchmark.Name << "\n";
+
+		return EXIT_SUCCESS;
+	}
+
+	Application::InitializeBase();
+
+	if (format == "console") {
+		std::printf("%-40s %17s %17s %12s\n", "Benchmark", "Time", "CPU", "Iterations");
+		std::printf("%s\n", std::string(90, '-').c_str());
+	}
+
+	ArrayData results;
+
+	for (auto& benchmark : benchmarks) {
+		BenchmarkResult result = RunBenchmark(benchmark, minTime);
+
+		if (format == "console") {
+			PrintConsole(benchmark, result);
+			continue;
+		}
+
+		Dictionary::Ptr entry = new Dictionary({
+			{ "name", benchmark.Name },
+			{ "run_name", benchmark.Name },
+			{ "run_type", "iteration" },
+			{ "threads", benchmark.Threads },
+			{ "iterations", result.Iterations },
+			{ "real_time", result.RealTime },
+			{ "cpu_time", result.CpuTime },
+			{ "time_unit", "ns" }
+		});
+
+		if (result.ItemsPerSecond > 0)
+			entry->Set("items_per_second", result.ItemsPerSecond);
+
+		if (result.BytesPerSecond > 0)
+			entry->Set("bytes_per_second", result.BytesPerSecond);
+
+		for (auto& counter : result.Counters)
+			entry->Set(counter.first, counter.second);
+
+		results.emplace_back(std::move(entry));
+	}
+
+	if (format == "json") {
+		Dictionary::Ptr output = new Dictionary({
+			{ "context", new Dictionary({
+				{ "date", Utility::FormatDateTime("%Y-%m-%dT%H:%M:%S%z", Utility::GetTime()) },
+				{ "executable", argv[0] },
+				{ "num_cpus", (double)std::thread::hardware_concurrency() },
+				{ "library_build_type",
+#ifdef I2_DEBUG
+					"debug"
+#else /* I2_DEBUG */
+					"release"
+#endif /* I2_DEBUG */
+				}
+			}) },
+			{ "benchmarks", new Array(std::move(results)) }
+		});
+
+		std::cout << JsonEncode(output, true) << "\n";
+	}
+
+	std::cout.flush();
+
+	/* Skip the destructors of the static objects, like the test runner does. */
+	std::_Exit(EXIT_SUCCESS);
+}
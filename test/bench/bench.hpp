@@ -0,0 +1,202 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * The state of a running benchmark. The benchmark function runs its
+ * measured code once per iteration:
+ *
+ *     while (state.KeepRunning()) {
+ *         ...
+ *     }
+ *
+ * Setup before and cleanup after the loop are not measured. Work which
+ * belongs to the measurement but happens after the loop (e.g. waiting for
+ * another thread to receive everything) goes between ResumeTiming() and
+ * PauseTiming().
+ */
+class BenchmarkState
+{
+public:
+	BenchmarkState(uint_fast64_t iterations, int threadIndex, int threads)
+		: m_Iterations(iterations), m_Remaining(iterations), m_ThreadIndex(threadIndex), m_Threads(threads)
+	{ }
+
+	bool KeepRunning()
+	{
+		if (m_Remaining == m_Iterations && !m_Running)
+			ResumeTiming();
+
+		if (m_Remaining == 0) {
+			if (m_Running)
+				PauseTiming();
+
+			return false;
+		}
+
+		m_Remaining--;
+		return true;
+	}
+
+	void ResumeTiming()
+	{
+		m_Running = true;
+		m_Start = std::chrono::steady_clock::now();
+		m_CpuStart = std::clock();
+	}
+
+	void PauseTiming()
+	{
+		m_Running = false;
+		m_RealTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+		m_CpuTime += double(std::clock() - m_CpuStart) / CLOCKS_PER_SEC;
+	}
+
+	/**
+	 * The measured wall clock time in seconds.
+	 */
+	double GetRealTime() const
+	{
+		return m_RealTime;
+	}
+
+	/**
+	 * The CPU time of the whole process (i.e. including helper threads)
+	 * while measuring, in seconds.
+	 */
+	double GetCpuTime() const
+	{
+		return m_CpuTime;
+	}
+
+	uint_fast64_t GetIterations() const
+	{
+		return m_Iterations;
+	}
+
+	int GetThreadIndex() const
+	{
+		return m_ThreadIndex;
+	}
+
+	int GetThreads() const
+	{
+		return m_Threads;
+	}
+
+	/**
+	 * Sets how many items (e.g. messages) have been processed by this
+	 * thread in total, reported as items_per_second.
+	 */
+	void SetItemsProcessed(uint_fast64_t items)
+	{
+		m_ItemsProcessed = items;
+	}
+
+	uint_fast64_t GetItemsProcessed() const
+	{
+		return m_ItemsProcessed;
+	}
+
+	/**
+	 * Sets how many bytes have been processed by this thread in total,
+	 * reported as bytes_per_second.
+	 */
+	void SetBytesProcessed(uint_fast64_t bytes)
+	{
+		m_BytesProcessed = bytes;
+	}
+
+	uint_fast64_t GetBytesProcessed() const
+	{
+		return m_BytesProcessed;
+	}
+
+	/**
+	 * Reports an additional value (e.g. a latency), summed up over all
+	 * threads of the benchmark.
+	 */
+	void SetCounter(const std::string& name, double value)
+	{
+		m_Counters[name] = value;
+	}
+
+	const std::map<std::string, double>& GetCounters() const
+	{
+		return m_Counters;
+	}
+
+private:
+	uint_fast64_t m_Iterations;
+	uint_fast64_t m_Remaining;
+	int m_ThreadIndex;
+	int m_Threads;
+	uint_fast64_t m_ItemsProcessed{0};
+	uint_fast64_t m_BytesProcessed{0};
+	std::map<std::string, double> m_Counters;
+
+	bool m_Running{false};
+	std::chrono::steady_clock::time_point m_Start;
+	std::clock_t m_CpuStart{0};
+	double m_RealTime{0};
+	double m_CpuTime{0};
+};
+
+typedef void (*BenchmarkFunction)(BenchmarkState&);
+
+struct Benchmark
+{
+	std::string Name;
+	BenchmarkFunction Function;
+	int Threads;
+};
+
+std::vector<Benchmark>& GetBenchmarks();
+
+struct BenchmarkRegistration
+{
+	BenchmarkRegistration(const char *name, BenchmarkFunction function, int threads)
+	{
+		std::string fullName (name);
+
+		if (threads > 1)
+			fullName += "/threads:" + std::to_string(threads);
+
+		GetBenchmarks().push_back(Benchmark{fullName, function, threads});
+	}
+};
+
+/**
+ * Keeps the compiler from optimizing away a result which is never used.
+ */
+template<typename T>
+inline void DoNotOptimize(const T& value)
+{
+#ifdef __GNUC__
+	asm volatile("" : : "r,m"(value) : "memory");
+#else /* __GNUC__ */
+	static const volatile void *sink;
+	sink = &value;
+#endif /* __GNUC__ */
+}
+
+}
+
+#define REGISTER_BENCHMARK(name) \
+	static icinga::BenchmarkRegistration l_Benchmark ## name(#name, &name, 1)
+
+#define REGISTER_BENCHMARK_THREADS(name, threads) \
+	static icinga::BenchmarkRegistration l_Benchmark ## name ## threads(#name, &name, threads)
+
+#endif /* BENCH_H */
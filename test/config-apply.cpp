@@ -0,0 +1,61 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/applyrule.hpp"
+#include "config/configcompiler.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(config_apply)
+
+static std::vector<String> GetCandidateNames(const Dictionary::Ptr& host)
+{
+	ScriptFrame frame(true);
+	frame.Locals->Set("host", host);
+
+	std::vector<String> names;
+
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("ApplyTest", frame))
+		names.push_back(rule->GetName());
+
+	return names;
+}
+
+BOOST_AUTO_TEST_CASE(candidate_rules)
+{
+	ApplyRule::RegisterType("ApplyTest", { "Host" });
+
+	ScriptFrame frame(true);
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>",
+		"apply ApplyTest \"linux\" { assign where host.vars.os == \"Linux\" }\n"
+		"apply ApplyTest \"web\" { assign where \"web\" in host.groups && host.vars.os != \"Windows\" }\n"
+		"apply ApplyTest \"either\" { assign where \"Windows\" == host.vars.os || host.name == \"h2\" }\n"
+		"apply ApplyTest \"other\" { assign where host.vars.os != \"Linux\" }\n");
+	expr->Evaluate(frame);
+
+	Dictionary::Ptr linuxHost = new Dictionary({
+		{ "name", "h1" },
+		{ "vars", new Dictionary({ { "os", "Linux" } }) },
+		{ "groups", new Array({ "web" }) }
+	});
+
+	BOOST_CHECK(GetCandidateNames(linuxHost) == std::vector<String>({ "linux", "web", "other" }));
+
+	Dictionary::Ptr windowsHost = new Dictionary({
+		{ "name", "h2" },
+		{ "vars", new Dictionary({ { "os", "Windows" } }) }
+	});
+
+	BOOST_CHECK(GetCandidateNames(windowsHost) == std::vector<String>({ "either", "other" }));
+
+	/* Values other than strings don't rule anything out. */
+	Dictionary::Ptr numberHost = new Dictionary({
+		{ "vars", new Dictionary({ { "os", 5 } }) }
+	});
+
+	BOOST_CHECK(GetCandidateNames(numberHost) == std::vector<String>({ "linux", "either", "other" }));
+
+	BOOST_CHECK(GetCandidateNames(new Dictionary()) == std::vector<String>({ "other" }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,55 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/configcompiler.hpp"
+#include "config/configcompilercache.hpp"
+#include "base/configuration.hpp"
+#include "base/json.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(config_compilercache)
+
+BOOST_AUTO_TEST_CASE(roundtrip)
+{
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>",
+		"var x = { a = 1 + 2, b = [ \"x\", true, null ] }\n"
+		"var f = function(y) use (x) { return x.a * y }\n"
+		"if (x.b[1] && \"x\" in x.b) { f(2) } else { 0 }\n");
+
+	String json = JsonEncode(ConfigCompilerCache::SerializeExpression(expr.get(), "<test>"));
+	std::unique_ptr<Expression> copy = ConfigCompilerCache::DeserializeExpression(JsonDecode(json), "<test>");
+
+	BOOST_CHECK(JsonEncode(ConfigCompilerCache::SerializeExpression(copy.get(), "<test>")) == json);
+
+	ScriptFrame frame(true);
+	BOOST_CHECK(copy->Evaluate(frame).GetValue() == 6);
+}
+
+BOOST_AUTO_TEST_CASE(relocatable)
+{
+	String oldIncludeDir = Configuration::IncludeConfDir;
+
+	Configuration::IncludeConfDir = "/build/itl";
+	String key = ConfigCompilerCache::GetKey("/build/itl/plugins", "", "_etc", "include \"plugins-contrib.d/*.conf\"");
+
+	Configuration::IncludeConfDir = "/usr/share/icinga2/include";
+	BOOST_CHECK(ConfigCompilerCache::GetKey("/usr/share/icinga2/include/plugins", "", "_etc", "include \"plugins-contrib.d/*.conf\"") == key);
+
+	Configuration::IncludeConfDir = oldIncludeDir;
+
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("/build/itl/plugins", "include \"plugins-contrib.d/*.conf\"");
+	String json = JsonEncode(ConfigCompilerCache::SerializeExpression(expr.get(), "/build/itl/plugins"));
+	std::unique_ptr<Expression> copy = ConfigCompilerCache::DeserializeExpression(JsonDecode(json), "/usr/share/icinga2/include/plugins");
+
+	BOOST_CHECK(JsonEncode(ConfigCompilerCache::SerializeExpression(copy.get(), "/usr/share/icinga2/include/plugins")) == json);
+}
+
+BOOST_AUTO_TEST_CASE(unsupported)
+{
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>", "using Internal\nx");
+
+	BOOST_CHECK_THROW(ConfigCompilerCache::SerializeExpression(expr.get(), "<test>"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -35,6 +35,12 @@ BOOST_AUTO_TEST_CASE(simple)
 	expr = ConfigCompiler::CompileText("<test>", "5m / 5");
 	BOOST_CHECK(expr->Evaluate(frame).GetValue() == 60);
 
+	expr = ConfigCompiler::CompileText("<test>", "1 / 0");
+	BOOST_CHECK_THROW(expr->Evaluate(frame).GetValue(), ScriptError);
+
+	expr = ConfigCompiler::CompileText("<test>", "-(2 + 3) * 2 == -10 && !false");
+	BOOST_CHECK(expr->Evaluate(frame).GetValue());
+
 	expr = ConfigCompiler::CompileText("<test>", "7 & 3");
 	BOOST_CHECK(expr->Evaluate(frame).GetValue() == 3);
 
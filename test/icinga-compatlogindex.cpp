@@ -0,0 +1,83 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/compatlogindex.hpp"
+#include "base/convert.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+#include <boost/filesystem/operations.hpp>
+#include <fstream>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(icinga_compatlogindex)
+
+BOOST_AUTO_TEST_CASE(write_and_read)
+{
+	std::fstream fp;
+	String path = Utility::CreateTempFile((boost::filesystem::temp_directory_path() / "compatlog-XXXXXX").string(), 0600, fp);
+	fp.close();
+
+	String indexPath = CompatLogIndex::GetIndexPath(path);
+	uint64_t size = 0;
+
+	{
+		CompatLogIndexWriter writer;
+		writer.Open(path, 0);
+
+		for (int i = 0; i < 1000; i++) {
+			String line = "[" + Convert::ToString(1000 + i) + "] HOST ALERT: host" + Convert::ToString(i % 3) + ";UP;HARD;1;\n";
+			writer.AddLine(line.GetLength(), 1000 + i, "host" + Convert::ToString(i % 3));
+			size += line.GetLength();
+		}
+
+		writer.AddLine(10, 5000, "other");
+		size += 10;
+	}
+
+	std::vector<CompatLogIndexBlock> blocks;
+	BOOST_REQUIRE(CompatLogIndex::ReadIndex(indexPath, blocks));
+
+	uint32_t blockLines = CompatLogIndexWriter::BlockLines;
+
+	/* three full blocks and the rest which was written on close */
+	BOOST_REQUIRE_EQUAL(blocks.size(), 4);
+	BOOST_CHECK_EQUAL(blocks[0].Offset, 0);
+	BOOST_CHECK_EQUAL(blocks[0].Lines, blockLines);
+	BOOST_CHECK_EQUAL(blocks[0].FirstTime, 1000);
+	BOOST_CHECK_EQUAL(blocks[0].LastTime, 1000 + blockLines - 1);
+	BOOST_CHECK_EQUAL(blocks[1].Offset, blocks[0].Offset + blocks[0].Length);
+	BOOST_CHECK_EQUAL(blocks[3].Offset + blocks[3].Length, size);
+
+	BOOST_CHECK(blocks[0].MayContainHost(CompatLogIndex::HashHostName("host1")));
+	BOOST_CHECK(!blocks[0].MayContainHost(CompatLogIndex::HashHostName("other")));
+	BOOST_CHECK(blocks[3].MayContainHost(CompatLogIndex::HashHostName("other")));
+
+	BOOST_CHECK(blocks[0].Overlaps(1100, 1200));
+	BOOST_CHECK(!blocks[0].Overlaps(2000, 3000));
+
+	/* appending to the same log file keeps the existing blocks */
+	{
+		CompatLogIndexWriter writer;
+		writer.Open(path, size);
+		writer.AddLine(10, 6000, "other");
+	}
+
+	blocks.clear();
+	BOOST_REQUIRE(CompatLogIndex::ReadIndex(indexPath, blocks));
+	BOOST_CHECK_EQUAL(blocks.size(), 5);
+
+	/* an index which doesn't fit the log file is discarded */
+	{
+		CompatLogIndexWriter writer;
+		writer.Open(path, 0);
+	}
+
+	blocks.clear();
+	BOOST_REQUIRE(CompatLogIndex::ReadIndex(indexPath, blocks));
+	BOOST_CHECK(blocks.empty());
+
+	(void)unlink(path.CStr());
+	(void)unlink(indexPath.CStr());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -86,4 +86,50 @@ BOOST_AUTO_TEST_CASE(multi_parent)
 	BOOST_CHECK(childHost->IsReachable() == false);
 }
 
+BOOST_AUTO_TEST_CASE(chain)
+{
+	/* A router, a switch behind it and a server behind the switch. */
+	std::vector<Host::Ptr> hosts;
+
+	for (int i = 0; i < 3; i++) {
+		Host::Ptr host = new Host();
+		host->SetActive(true);
+		host->SetMaxCheckAttempts(1);
+		host->Activate();
+		host->SetAuthority(true);
+		host->SetStateRaw(ServiceOK);
+		host->SetStateType(StateTypeHard);
+		host->SetLastCheckResult(new CheckResult());
+
+		if (!hosts.empty()) {
+			Dependency::Ptr dep = new Dependency();
+
+			dep->SetParent(hosts.back());
+			dep->SetChild(host);
+			dep->SetStateFilter(StateFilterUp);
+
+			host->AddDependency(dep);
+			hosts.back()->AddReverseDependency(dep);
+		}
+
+		hosts.push_back(host);
+	}
+
+	std::set<Checkable::Ptr> children = hosts[0]->GetAllChildren();
+	BOOST_CHECK(children.size() == 2);
+	BOOST_CHECK(children.find(hosts[2]) != children.end());
+
+	BOOST_CHECK(hosts[2]->IsReachable() == true);
+
+	/* The router goes down, the server is cut off two levels below. */
+	hosts[0]->SetStateRaw(ServiceCritical);
+
+	BOOST_CHECK(hosts[1]->IsReachable() == false);
+	BOOST_CHECK(hosts[2]->IsReachable() == false);
+
+	hosts[0]->SetStateRaw(ServiceOK);
+
+	BOOST_CHECK(hosts[2]->IsReachable() == true);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
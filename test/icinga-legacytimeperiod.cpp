@@ -265,4 +265,43 @@ BOOST_AUTO_TEST_CASE(advanced)
 	AdvancedHelper("09:00:03-30:00:04", {{2014, 9, 24}, {9, 0, 3}}, {{2014, 9, 25}, {6, 0, 4}});
 }
 
+BOOST_AUTO_TEST_CASE(process_time_ranges)
+{
+	tm reference = {};
+	reference.tm_year = 2019 - 1900;
+	reference.tm_mon = 4;
+	reference.tm_mday = 6;
+	reference.tm_isdst = -1;
+
+	tm expected = reference;
+	expected.tm_hour = 9;
+	long nine = mktime(&expected);
+
+	/* The second run uses the parsed ranges from the first one. */
+	for (int i = 0; i < 2; i++) {
+		Array::Ptr segments = new Array();
+
+		LegacyTimePeriod::ProcessTimeRanges("09:00-12:00,13:00-17:00,22:00-06:00", &reference, segments);
+
+		BOOST_REQUIRE(segments->GetLength() == 3);
+
+		Dictionary::Ptr segment = segments->Get(0);
+		BOOST_CHECK(segment->Get("begin") == nine);
+		BOOST_CHECK(segment->Get("end") == nine + 3 * 3600);
+
+		segment = segments->Get(1);
+		BOOST_CHECK(segment->Get("begin") == nine + 4 * 3600);
+		BOOST_CHECK(segment->Get("end") == nine + 8 * 3600);
+
+		segment = segments->Get(2);
+		BOOST_CHECK(segment->Get("begin") == nine + 13 * 3600);
+		BOOST_CHECK(segment->Get("end") == nine + 21 * 3600);
+	}
+
+	Array::Ptr segments = new Array();
+
+	BOOST_CHECK_THROW(LegacyTimePeriod::ProcessTimeRanges("09:00-12:00,13", &reference, segments), std::invalid_argument);
+	BOOST_CHECK_THROW(LegacyTimePeriod::ProcessTimeRanges("09:00-12:00,13", &reference, segments), std::invalid_argument);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
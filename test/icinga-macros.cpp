@@ -47,4 +47,58 @@ BOOST_AUTO_TEST_CASE(simple)
 
 }
 
+BOOST_AUTO_TEST_CASE(arguments)
+{
+	Dictionary::Ptr macros = new Dictionary();
+	macros->Set("address", "127.0.0.1");
+	macros->Set("verbose", true);
+	macros->Set("quiet", false);
+	macros->Set("ports", new Array({ 22, 80 }));
+
+	MacroProcessor::ResolverList resolvers;
+	resolvers.emplace_back("macros", macros);
+
+	Dictionary::Ptr arguments = new Dictionary({
+		{ "-H", "$address$" },
+		{ "-p", new Dictionary({
+			{ "value", "$ports$" },
+			{ "order", 1 }
+		}) },
+		{ "-v", new Dictionary({
+			{ "set_if", "$verbose$" },
+			{ "order", -1 }
+		}) },
+		{ "-q", new Dictionary({
+			{ "set_if", "$quiet$" }
+		}) },
+		{ "-w", new Dictionary({
+			{ "value", "$warning$" }
+		}) }
+	});
+
+	auto tmpl (MacroProcessor::CompileArguments(arguments));
+	BOOST_CHECK(tmpl->Arguments.size() == 5);
+	BOOST_CHECK(tmpl->Arguments[0].Key == "-v");
+
+	for (int i = 0; i < 2; i++) {
+		Array::Ptr result = MacroProcessor::ResolveArguments(new Array({ "check_test" }), tmpl, resolvers, nullptr, nullptr, false);
+
+		BOOST_CHECK(result->GetLength() == 8);
+		BOOST_CHECK(result->Get(0) == "check_test");
+		BOOST_CHECK(result->Get(1) == "-v");
+		BOOST_CHECK(result->Get(2) == "-H");
+		BOOST_CHECK(result->Get(3) == "127.0.0.1");
+		BOOST_CHECK(result->Get(4) == "-p");
+		BOOST_CHECK(result->Get(5) == "22");
+		BOOST_CHECK(result->Get(6) == "-p");
+		BOOST_CHECK(result->Get(7) == "80");
+	}
+
+	auto compiled (MacroProcessor::CompileMacroString("x $macros.address$ $$"));
+	BOOST_CHECK(compiled->Segments.size() == 4);
+	BOOST_CHECK(compiled->Segments[1].ObjName == "macros");
+	BOOST_CHECK(compiled->Segments[1].Path == "address");
+	BOOST_CHECK(MacroProcessor::ResolveMacros("x $macros.address$ $$", resolvers) == "x 127.0.0.1 $");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
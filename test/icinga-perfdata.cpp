@@ -2,6 +2,7 @@
 
 #include "base/perfdatavalue.hpp"
 #include "icinga/pluginutility.hpp"
+#include "icinga/checkresult.hpp"
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
@@ -305,4 +306,29 @@ BOOST_AUTO_TEST_CASE(multi)
 	BOOST_CHECK(pd->Get(1) == "test::b=4");
 }
 
+BOOST_AUTO_TEST_CASE(parsed)
+{
+	CheckResult::Ptr cr = new CheckResult();
+	cr->SetPerformanceData(PluginUtility::SplitPerfdata("a=1;2;3 b=1,5 c=10ms"));
+
+	auto parsed (cr->GetParsedPerformanceData());
+
+	BOOST_REQUIRE(parsed->size() == 3);
+	BOOST_CHECK(parsed->at(0).Parsed->GetLabel() == "a");
+	BOOST_CHECK(parsed->at(0).Parsed->GetCrit() == 3);
+	BOOST_CHECK(!parsed->at(1).Parsed);
+	BOOST_CHECK(parsed->at(1).Raw == "b=1,5");
+	BOOST_CHECK(parsed->at(2).Parsed->GetValue() == 0.01);
+
+	/* Parsed once, shared by all consumers. */
+	BOOST_CHECK(cr->GetParsedPerformanceData() == parsed);
+
+	cr->SetPerformanceData(PluginUtility::SplitPerfdata("d=4"));
+
+	parsed = cr->GetParsedPerformanceData();
+
+	BOOST_REQUIRE(parsed->size() == 1);
+	BOOST_CHECK(parsed->at(0).Parsed->GetLabel() == "d");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,83 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/statehistoryring.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(icinga_statehistoryring)
+
+BOOST_AUTO_TEST_CASE(transitions)
+{
+	StateHistoryRing ring;
+
+	BOOST_CHECK(!ring.Covers(1000));
+
+	ring.Add(1000, ServiceOK, StateTypeHard, true, 0);
+	ring.Add(1100, ServiceOK, StateTypeHard, true, 0);
+	ring.Add(1200, ServiceCritical, StateTypeSoft, true, 0);
+	ring.Add(1300, ServiceCritical, StateTypeHard, true, 0);
+	ring.Add(1400, ServiceOK, StateTypeHard, true, 0);
+
+	/* Late check results are ignored. */
+	ring.Add(1350, ServiceWarning, StateTypeHard, true, 0);
+
+	BOOST_CHECK(ring.Covers(1000));
+	BOOST_CHECK(!ring.Covers(999));
+
+	auto entries (ring.GetEntries(1250, 1500));
+
+	BOOST_REQUIRE(entries.size() == 3);
+	BOOST_CHECK(entries[0].Timestamp == 1200 && entries[0].State == ServiceCritical && !entries[0].HardState);
+	BOOST_CHECK(entries[1].Timestamp == 1300 && entries[1].HardState);
+	BOOST_CHECK(entries[2].Timestamp == 1400 && entries[2].State == ServiceOK);
+
+	auto availability (ring.GetAvailability(900, 1500));
+
+	BOOST_CHECK(availability.Unmonitored == 100);
+	BOOST_CHECK(availability.Durations[ServiceOK] == 300);
+	BOOST_CHECK(availability.Durations[ServiceCritical] == 200);
+	BOOST_CHECK(availability.Durations[ServiceWarning] == 0);
+}
+
+BOOST_AUTO_TEST_CASE(retention)
+{
+	StateHistoryRing ring;
+
+	for (int i = 0; i < 100; i++)
+		ring.Add(1000 + i * 10, i % 2 ? ServiceCritical : ServiceOK, StateTypeHard, true, 100);
+
+	/* The last entry before the cutoff remains for the state at the cutoff. */
+	BOOST_CHECK(ring.Covers(1890));
+	BOOST_CHECK(!ring.Covers(1880));
+
+	for (int i = 0; i < 10000; i++)
+		ring.Add(10000 + i, i % 2 ? ServiceCritical : ServiceOK, StateTypeHard, true, 0);
+
+	BOOST_CHECK(ring.GetEntries(0, 100000).size() == StateHistoryRing::MaxEntries);
+	BOOST_CHECK(ring.Covers(20000 - StateHistoryRing::MaxEntries));
+	BOOST_CHECK(!ring.Covers(20000 - StateHistoryRing::MaxEntries - 1));
+}
+
+BOOST_AUTO_TEST_CASE(serialize)
+{
+	StateHistoryRing ring;
+
+	ring.Add(1000.5, ServiceOK, StateTypeHard, true, 0);
+	ring.Add(2000.25, ServiceUnknown, StateTypeSoft, false, 0);
+
+	StateHistoryRing restored;
+	restored.Deserialize(ring.Serialize());
+
+	auto entries (restored.GetEntries(0, 3000));
+
+	BOOST_REQUIRE(entries.size() == 2);
+	BOOST_CHECK(entries[0].Timestamp == 1000.5 && entries[0].State == ServiceOK && entries[0].HardState && entries[0].Reachable);
+	BOOST_CHECK(entries[1].Timestamp == 2000.25 && entries[1].State == ServiceUnknown && !entries[1].HardState && !entries[1].Reachable);
+
+	restored.Deserialize(String());
+
+	BOOST_CHECK(restored.GetEntries(0, 3000).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 #include "base/application.hpp"
 #include "base/stdiostream.hpp"
 #include "base/json.hpp"
+#include "base/objectlock.hpp"
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
@@ -102,6 +103,79 @@ BOOST_AUTO_TEST_CASE(services)
 
 	BOOST_TEST_MESSAGE("Done with testing livestatus services...");
 }
+
+BOOST_AUTO_TEST_CASE(fixed16)
+{
+	std::vector<String> lines;
+	lines.emplace_back("GET hosts");
+	lines.emplace_back("Columns: host_name");
+	lines.emplace_back("ResponseHeader: fixed16");
+	lines.emplace_back("\n");
+
+	LivestatusQuery::Ptr query = new LivestatusQuery(lines, "");
+
+	std::stringstream stream;
+	StdioStream::Ptr sstream = new StdioStream(&stream, false);
+
+	query->Execute(sstream);
+
+	std::string output = stream.str();
+
+	BOOST_REQUIRE(output.size() >= 16);
+	BOOST_CHECK(output.substr(0, 3) == "200");
+
+	/* the header states the length of the body */
+	BOOST_CHECK_EQUAL(std::stoul(output.substr(3, 12)), output.size() - 16);
+	BOOST_CHECK(output.find("test-01") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(filter_by_name)
+{
+	std::vector<String> lines;
+	lines.emplace_back("GET services");
+	lines.emplace_back("Columns: host_name service_description");
+	lines.emplace_back("Filter: host_name = test-01");
+	lines.emplace_back("OutputFormat: json");
+	lines.emplace_back("\n");
+
+	Array::Ptr query_result = JsonDecode(LivestatusQueryHelper(lines));
+
+	BOOST_CHECK(query_result->GetLength() > 0);
+
+	ObjectLock olock(query_result);
+	for (const Array::Ptr& row : query_result) {
+		BOOST_CHECK(row->Get(0) == "test-01");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(stats_group_by)
+{
+	std::vector<String> lines;
+	lines.emplace_back("GET hosts");
+	lines.emplace_back("Columns: address");
+	lines.emplace_back("Stats: sum max_check_attempts");
+	lines.emplace_back("Stats: avg max_check_attempts");
+	lines.emplace_back("Stats: state >= 0");
+	lines.emplace_back("OutputFormat: json");
+	lines.emplace_back("\n");
+
+	Array::Ptr query_result = JsonDecode(LivestatusQueryHelper(lines));
+
+	BOOST_REQUIRE(query_result->GetLength() == 2);
+
+	Array::Ptr res1 = query_result->Get(0);
+	Array::Ptr res2 = query_result->Get(1);
+
+	/* the groups are sorted by their columns */
+	BOOST_CHECK(res1->Get(0) == "127.0.0.1");
+	BOOST_CHECK(res2->Get(0) == "127.0.0.2");
+
+	for (const Array::Ptr& row : { res1, res2 }) {
+		BOOST_CHECK(row->Get(1) == 3);
+		BOOST_CHECK(row->Get(2) == 3);
+		BOOST_CHECK(row->Get(3) == 1);
+	}
+}
 //____________________________________________________________________________//
 
 BOOST_AUTO_TEST_SUITE_END()
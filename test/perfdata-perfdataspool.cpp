@@ -0,0 +1,92 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/convert.hpp"
+#include "base/utility.hpp"
+#include "perfdata/perfdataspool.hpp"
+#include <BoostTestTargetConfig.h>
+#include <boost/filesystem/operations.hpp>
+#include <vector>
+
+using namespace icinga;
+
+static String MakeSpoolPath()
+{
+	return (boost::filesystem::temp_directory_path() / ("perfdataspool-" + Utility::NewUniqueID()).GetData()).string();
+}
+
+BOOST_AUTO_TEST_SUITE(perfdata_perfdataspool)
+
+BOOST_AUTO_TEST_CASE(append_and_replay)
+{
+	String path = MakeSpoolPath();
+
+	{
+		PerfdataSpool::Ptr spool = new PerfdataSpool(path);
+		BOOST_CHECK(spool->IsEmpty());
+
+		for (int i = 0; i < 10; i++)
+			spool->Append("record" + Convert::ToString(i));
+
+		BOOST_CHECK(!spool->IsEmpty());
+
+		/* Records are only removed if the callback succeeded. */
+		std::vector<String> records;
+
+		BOOST_CHECK(spool->Replay(1024, [&records](const String& record) {
+			records.push_back(record);
+			return records.size() < 4;
+		}) == 3);
+
+		BOOST_CHECK(records.size() == 4);
+		BOOST_CHECK(records[0] == "record0");
+
+		records.clear();
+
+		/* The limit is checked after each record, 3 records of 11 bytes exceed 30 bytes. */
+		BOOST_CHECK(spool->Replay(30, [&records](const String& record) {
+			records.push_back(record);
+			return true;
+		}) == 3);
+
+		BOOST_CHECK(records.size() == 3);
+		BOOST_CHECK(records[0] == "record3");
+	}
+
+	/* Another instance picks up the segments, replaying them from the start. */
+	PerfdataSpool::Ptr spool = new PerfdataSpool(path);
+	BOOST_CHECK(spool->GetSize() == 10 * 11);
+
+	std::vector<String> records;
+
+	BOOST_CHECK(spool->Replay(1024, [&records](const String& record) {
+		records.push_back(record);
+		return true;
+	}) == 10);
+
+	BOOST_CHECK(records.back() == "record9");
+	BOOST_CHECK(spool->IsEmpty());
+
+	Utility::RemoveDirRecursive(path);
+}
+
+BOOST_AUTO_TEST_CASE(max_size)
+{
+	String path = MakeSpoolPath();
+	PerfdataSpool::Ptr spool = new PerfdataSpool(path, 1000);
+
+	for (int i = 0; i < 200; i++)
+		spool->Append(String(20, 'x'));
+
+	BOOST_CHECK(spool->GetSize() <= 1000);
+
+	size_t count = spool->Replay(1024 * 1024, [](const String& record) {
+		return record == String(20, 'x');
+	});
+
+	BOOST_CHECK(count > 0 && count < 200);
+	BOOST_CHECK(spool->IsEmpty());
+
+	Utility::RemoveDirRecursive(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
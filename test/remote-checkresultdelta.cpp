@@ -0,0 +1,100 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/convert.hpp"
+#include "base/json.hpp"
+#include "remote/checkresultdelta.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+static Dictionary::Ptr MakeMessage(double executionEnd, const String& output, double rta)
+{
+	return new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::CheckResult" },
+		{ "params", new Dictionary({
+			{ "host", "host1" },
+			{ "service", "ping4" },
+			{ "cr", new Dictionary({
+				{ "execution_start", executionEnd - 1 },
+				{ "execution_end", executionEnd },
+				{ "state", 0 },
+				{ "output", output },
+				{ "performance_data", new Array({ "rta=" + Convert::ToString(rta) + "ms", "pl=0%" }) },
+				{ "vars_after", new Dictionary({ { "attempt", 1 } }) }
+			}) }
+		}) }
+	});
+}
+
+/* Like on the wire, the receiver doesn't share any objects with the sender. */
+static Dictionary::Ptr Transmit(const Dictionary::Ptr& message)
+{
+	return JsonDecode(JsonEncode(message));
+}
+
+BOOST_AUTO_TEST_SUITE(remote_checkresultdelta)
+
+BOOST_AUTO_TEST_CASE(roundtrip)
+{
+	CheckResultDeltaEncoder encoder;
+	CheckResultDeltaDecoder decoder;
+
+	BOOST_CHECK(!encoder.Encode(MakeMessage(100, "PING OK", 1)));
+	BOOST_CHECK(decoder.Decode(Transmit(MakeMessage(100, "PING OK", 1))));
+
+	Dictionary::Ptr message = MakeMessage(160, "PING OK", 2);
+	Dictionary::Ptr compact = encoder.Encode(message);
+
+	BOOST_REQUIRE(compact);
+
+	Dictionary::Ptr delta = Dictionary::Ptr(compact->Get("params"))->Get("cr_delta");
+
+	BOOST_CHECK(!delta->Contains("output"));
+	BOOST_CHECK(delta->Get("base") == 100);
+	BOOST_CHECK(Dictionary::Ptr(delta->Get("performance_data"))->GetKeys() == std::vector<String>{ "0" });
+
+	/* The original message is still sent to other connections. */
+	BOOST_CHECK(Dictionary::Ptr(message->Get("params"))->Contains("cr"));
+
+	Dictionary::Ptr received = Transmit(compact);
+
+	BOOST_REQUIRE(decoder.Decode(received));
+	BOOST_CHECK(JsonEncode(received) == JsonEncode(message));
+}
+
+BOOST_AUTO_TEST_CASE(changed)
+{
+	CheckResultDeltaEncoder encoder;
+
+	encoder.Encode(MakeMessage(100, "PING OK", 1));
+
+	BOOST_CHECK(!encoder.Encode(MakeMessage(160, "PING WARNING", 1)));
+	BOOST_CHECK(encoder.Encode(MakeMessage(220, "PING WARNING", 1)));
+}
+
+BOOST_AUTO_TEST_CASE(full_every_n)
+{
+	CheckResultDeltaEncoder encoder;
+
+	BOOST_CHECK(!encoder.Encode(MakeMessage(0, "PING OK", 1)));
+
+	for (int i = 1; i <= CheckResultDeltaEncoder::MaxDeltas; i++)
+		BOOST_CHECK(encoder.Encode(MakeMessage(i, "PING OK", 1)));
+
+	BOOST_CHECK(!encoder.Encode(MakeMessage(CheckResultDeltaEncoder::MaxDeltas + 1, "PING OK", 1)));
+}
+
+BOOST_AUTO_TEST_CASE(unknown_base)
+{
+	CheckResultDeltaEncoder encoder;
+	CheckResultDeltaDecoder decoder;
+
+	encoder.Encode(MakeMessage(100, "PING OK", 1));
+	decoder.Decode(Transmit(MakeMessage(90, "PING OK", 1)));
+
+	BOOST_CHECK(!decoder.Decode(Transmit(encoder.Encode(MakeMessage(160, "PING OK", 1)))));
+	BOOST_CHECK(!CheckResultDeltaDecoder().Decode(Transmit(encoder.Encode(MakeMessage(220, "PING OK", 1)))));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
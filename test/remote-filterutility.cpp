@@ -0,0 +1,89 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/filterutility.hpp"
+#include "remote/zone.hpp"
+#include "config/configcompiler.hpp"
+#include "base/namespace.hpp"
+#include "icingaapplication-fixture.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+static Zone::Ptr MakeZone(const String& name, bool global, const Array::Ptr& endpoints)
+{
+	Zone::Ptr zone = new Zone();
+	zone->SetName(name, true);
+	zone->SetGlobal(global, true);
+	zone->SetEndpointsRaw(endpoints, true);
+	return zone;
+}
+
+static bool Matches(const String& filter, const Object::Ptr& target)
+{
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>", filter);
+	CompiledFilter compiledFilter (expr.get(), Zone::TypeInstance);
+
+	ScriptFrame frame (false, new Namespace());
+	frame.Sandboxed = true;
+
+	bool result = compiledFilter.Evaluate(frame, target);
+
+	ScriptFrame interpreterFrame (false, new Namespace());
+	interpreterFrame.Sandboxed = true;
+
+	BOOST_CHECK(result == FilterUtility::EvaluateFilter(interpreterFrame, expr.get(), target));
+
+	return result;
+}
+
+BOOST_FIXTURE_TEST_SUITE(remote_filterutility, IcingaApplicationFixture)
+
+BOOST_AUTO_TEST_CASE(native)
+{
+	Zone::Ptr z1 = MakeZone("z1", true, new Array({ "e1", "e2" }));
+	Zone::Ptr z2 = MakeZone("z2", false, nullptr);
+
+	BOOST_CHECK(Matches("zone.name == \"z1\"", z1));
+	BOOST_CHECK(!Matches("zone.name == \"z1\"", z2));
+	BOOST_CHECK(Matches("\"z2\" == obj.name", z2));
+	BOOST_CHECK(Matches("zone.name != \"z1\"", z2));
+	BOOST_CHECK(Matches("\"e2\" in zone.endpoints", z1));
+	BOOST_CHECK(!Matches("\"e2\" in zone.endpoints", z2));
+	BOOST_CHECK(Matches("\"e3\" !in zone.endpoints", z1));
+	BOOST_CHECK(Matches("zone.endpoints == null", z2));
+	BOOST_CHECK(Matches("parent == null", z1));
+}
+
+BOOST_AUTO_TEST_CASE(interpreted)
+{
+	Zone::Ptr z1 = MakeZone("z1", true, nullptr);
+	Zone::Ptr z2 = MakeZone("z2", true, nullptr);
+
+	BOOST_CHECK(Matches("zone.global && zone.name != \"z1\"", z2));
+	BOOST_CHECK(!Matches("zone.global && zone.name != \"z1\"", z1));
+	BOOST_CHECK(Matches("zone.name == \"z1\" && match(\"z*\", zone.name)", z1));
+	BOOST_CHECK(!Matches("zone.name == \"z1\" || zone.name == \"z3\"", z2));
+
+	/* The interpreter reports the invalid operand of "in". */
+	BOOST_CHECK_THROW(Matches("\"z\" in zone.name", z1), ScriptError);
+}
+
+BOOST_AUTO_TEST_CASE(indexed_name)
+{
+	String name;
+
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>", "zone.name == \"z1\" && zone.global");
+	BOOST_CHECK(CompiledFilter(expr.get(), Zone::TypeInstance).GetIndexedName(name));
+	BOOST_CHECK(name == "z1");
+
+	expr = ConfigCompiler::CompileText("<test>", "zone.global && zone.name == \"z1\"");
+	BOOST_CHECK(!CompiledFilter(expr.get(), Zone::TypeInstance).GetIndexedName(name));
+
+	expr = ConfigCompiler::CompileText("<test>", "zone.name == \"z1\" || zone.global");
+	BOOST_CHECK(!CompiledFilter(expr.get(), Zone::TypeInstance).GetIndexedName(name));
+
+	expr = ConfigCompiler::CompileText("<test>", "zone.name == \"z1\"");
+	BOOST_CHECK(!CompiledFilter(expr.get(), nullptr).GetIndexedName(name));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
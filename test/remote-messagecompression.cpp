@@ -0,0 +1,139 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/convert.hpp"
+#include "remote/messagecompression.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(remote_messagecompression)
+
+BOOST_AUTO_TEST_CASE(roundtrip)
+{
+	MessageDeflater deflater;
+	MessageInflater inflater;
+
+	for (int i = 0; i < 100; i++) {
+		String message = "{\"jsonrpc\":\"2.0\",\"method\":\"event::CheckResult\",\"params\":{\"cr\":{\"active\":true,"
+			"\"output\":\"PING OK - Packet loss = 0%, RTA = " + Convert::ToString(i) + " ms\"},\"host\":\"host"
+			+ Convert::ToString(i) + "\"}}";
+
+		String frame = deflater.Compress(message);
+
+		BOOST_CHECK(MessageInflater::IsCompressed(frame));
+		BOOST_CHECK(!MessageInflater::IsCompressed(message));
+		BOOST_CHECK(frame.GetLength() < message.GetLength());
+		BOOST_CHECK(inflater.Decompress(frame) == message);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(large)
+{
+	MessageDeflater deflater;
+	MessageInflater inflater;
+
+	String message (1024 * 1024, 'x');
+	String frame = deflater.Compress(message);
+
+	BOOST_CHECK(inflater.Decompress(frame) == message);
+	BOOST_CHECK_THROW(MessageInflater().Decompress(MessageDeflater().Compress(message), 1024), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(gzip)
+{
+	String data;
+
+	for (int i = 0; i < 1000; i++)
+		data += "perfdata,hostname=host" + Convert::ToString(i) + " value=" + Convert::ToString(i) + " 1600000000\n";
+
+	String compressed = GzipCompress(data);
+
+	BOOST_CHECK(compressed.GetLength() < data.GetLength());
+	BOOST_CHECK(compressed.GetLength() > 2 && compressed[0] == '\x1f' && compressed[1] == '\x8b');
+
+	z_stream stream;
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	stream.next_in = Z_NULL;
+	stream.avail_in = 0;
+
+	BOOST_REQUIRE(inflateInit2(&stream, 15 + 16) == Z_OK);
+
+	std::string result (data.GetLength() + 1, '\0');
+
+	stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed.CStr()));
+	stream.avail_in = compressed.GetLength();
+	stream.next_out = reinterpret_cast<Bytef *>(&result[0]);
+	stream.avail_out = result.size();
+
+	BOOST_CHECK(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+	result.resize(result.size() - stream.avail_out);
+	inflateEnd(&stream);
+
+	BOOST_CHECK(result == data.GetData());
+	BOOST_CHECK(GzipCompress(String()).GetLength() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(http_body)
+{
+	for (String encoding : { "gzip", "deflate" }) {
+		HttpBodyDeflater deflater (encoding);
+		String data;
+		String compressed;
+
+		z_stream stream;
+		stream.zalloc = Z_NULL;
+		stream.zfree = Z_NULL;
+		stream.opaque = Z_NULL;
+		stream.next_in = Z_NULL;
+		stream.avail_in = 0;
+
+		BOOST_REQUIRE(inflateInit2(&stream, encoding == "gzip" ? 15 + 16 : 15) == Z_OK);
+
+		for (int i = 0; i < 100; i++) {
+			String event = "{\"host\":\"host" + Convert::ToString(i) + "\",\"type\":\"CheckResult\"}\n";
+			String part = deflater.Compress(event, true);
+
+			data += event;
+			compressed += part;
+
+			/* Every flushed part can be decompressed on its own. */
+			std::string result (event.GetLength() + 1, '\0');
+
+			stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(part.CStr()));
+			stream.avail_in = part.GetLength();
+			stream.next_out = reinterpret_cast<Bytef *>(&result[0]);
+			stream.avail_out = result.size();
+
+			BOOST_CHECK(inflate(&stream, Z_SYNC_FLUSH) == Z_OK);
+			result.resize(result.size() - stream.avail_out);
+
+			BOOST_CHECK(result == event.GetData());
+		}
+
+		compressed += deflater.Finish();
+		inflateEnd(&stream);
+
+		BOOST_CHECK(compressed.GetLength() < data.GetLength());
+
+		BOOST_REQUIRE(inflateInit2(&stream, encoding == "gzip" ? 15 + 16 : 15) == Z_OK);
+
+		std::string result (data.GetLength() + 1, '\0');
+
+		stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(compressed.CStr()));
+		stream.avail_in = compressed.GetLength();
+		stream.next_out = reinterpret_cast<Bytef *>(&result[0]);
+		stream.avail_out = result.size();
+
+		BOOST_CHECK(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+		result.resize(result.size() - stream.avail_out);
+		inflateEnd(&stream);
+
+		BOOST_CHECK(result == data.GetData());
+	}
+
+	BOOST_CHECK(!HttpBodyDeflater::IsSupportedEncoding("zstd"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
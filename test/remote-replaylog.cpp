@@ -0,0 +1,204 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/convert.hpp"
+#include "base/utility.hpp"
+#include "remote/replaylog.hpp"
+#include <BoostTestTargetConfig.h>
+#include <boost/filesystem/operations.hpp>
+#include <fstream>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(remote_replaylog)
+
+BOOST_AUTO_TEST_CASE(write_and_read)
+{
+	std::fstream fp;
+	String path = Utility::CreateTempFile((boost::filesystem::temp_directory_path() / "replaylog-XXXXXX").string(), 0600, fp);
+	fp.close();
+	(void)unlink(path.CStr());
+
+	{
+		ReplayLogWriter::Ptr writer = new ReplayLogWriter(path);
+		BOOST_REQUIRE(writer->IsGood());
+
+		for (int i = 1; i <= 2500; i++) {
+			ReplayLogRecord record;
+			record.Timestamp = i;
+			record.Message = "{\"id\":" + Convert::ToString(i) + "}";
+
+			if (i % 2 == 0) {
+				record.SecobjType = "Host";
+				record.SecobjName = "host" + Convert::ToString(i);
+			}
+
+			writer->Write(record);
+		}
+
+		writer->Close();
+	}
+
+	BOOST_CHECK(ReplayLogReader::IsBinaryLog(path));
+	BOOST_CHECK(!ReplayLogReader::IsLegacyLog(path));
+
+	ReplayLogReader reader (path);
+	BOOST_REQUIRE(reader.IsGood());
+
+	reader.Seek(2100);
+
+	ReplayLogRecord record;
+	int count = 0;
+
+	while (reader.ReadNext(record, 2100)) {
+		count++;
+		BOOST_CHECK(record.Timestamp == 2100 + count);
+		BOOST_CHECK(record.Message == "{\"id\":" + Convert::ToString(2100 + count) + "}");
+		BOOST_CHECK(record.SecobjType == (count % 2 == 0 ? "Host" : ""));
+	}
+
+	BOOST_CHECK(count == 400);
+
+	(void)unlink(path.CStr());
+}
+
+BOOST_AUTO_TEST_CASE(compressed)
+{
+	std::fstream fp;
+	String path = Utility::CreateTempFile((boost::filesystem::temp_directory_path() / "replaylog-XXXXXX").string(), 0600, fp);
+	fp.close();
+	(void)unlink(path.CStr());
+
+	{
+		ReplayLogWriter::Ptr writer = new ReplayLogWriter(path);
+		BOOST_REQUIRE(writer->IsGood());
+
+		for (int i = 1; i <= 2500; i++) {
+			ReplayLogRecord record;
+			record.Timestamp = i;
+			record.SecobjType = "Host";
+			record.SecobjName = "host" + Convert::ToString(i % 10);
+			record.Message = "{\"id\":" + Convert::ToString(i) + "}";
+
+			writer->Write(record);
+		}
+
+		writer->Close();
+	}
+
+	String compressedPath = path + ".tmp";
+	uint64_t savedBytes = 0;
+
+	BOOST_REQUIRE(ReplayLogCompressor::Compress(path, compressedPath, savedBytes));
+	BOOST_CHECK(savedBytes > 0);
+
+	Utility::RenameFile(compressedPath, path);
+	(void)unlink(ReplayLogReader::GetIndexPath(path).CStr());
+
+	BOOST_CHECK(ReplayLogReader::IsBinaryLog(path));
+	BOOST_CHECK(ReplayLogReader::IsCompressedLog(path));
+	BOOST_CHECK(!ReplayLogReader::IsLegacyLog(path));
+	BOOST_CHECK(ReplayLogCompressor::GetSavedBytes(path) == savedBytes);
+
+	for (int after : { 0, 1000, 2100, 2500 }) {
+		ReplayLogReader reader (path);
+		BOOST_REQUIRE(reader.IsGood());
+
+		reader.Seek(after);
+
+		ReplayLogRecord record;
+		int count = 0;
+
+		while (reader.ReadNext(record, after)) {
+			count++;
+			BOOST_CHECK(record.Timestamp == after + count);
+			BOOST_CHECK(record.SecobjName == "host" + Convert::ToString((after + count) % 10));
+			BOOST_CHECK(record.Message == "{\"id\":" + Convert::ToString(after + count) + "}");
+		}
+
+		BOOST_CHECK(count == 2500 - after);
+	}
+
+	/* Nothing left to save. */
+	BOOST_CHECK(!ReplayLogCompressor::Compress(path, compressedPath, savedBytes));
+
+	(void)unlink(path.CStr());
+	(void)unlink(compressedPath.CStr());
+}
+
+BOOST_AUTO_TEST_CASE(legacy)
+{
+	std::fstream fp;
+	String path = Utility::CreateTempFile((boost::filesystem::temp_directory_path() / "replaylog-XXXXXX").string(), 0600, fp);
+	fp << "11:{\"ts\":1.0},";
+	fp.close();
+
+	BOOST_CHECK(!ReplayLogReader::IsBinaryLog(path));
+	BOOST_CHECK(ReplayLogReader::IsLegacyLog(path));
+
+	/* A writer must neither truncate nor append to it. */
+	{
+		ReplayLogWriter::Ptr writer = new ReplayLogWriter(path);
+		BOOST_CHECK(!writer->IsGood());
+	}
+
+	BOOST_CHECK(boost::filesystem::file_size(path.GetData()) == 14);
+	BOOST_CHECK(ReplayLogReader::IsLegacyLog(path));
+
+	(void)unlink(path.CStr());
+	(void)unlink(ReplayLogReader::GetIndexPath(path).CStr());
+}
+
+static ReplayLogRecord MakeRecord(double ts, const String& method, const String& host, const String& params = "{}")
+{
+	ReplayLogRecord record;
+	record.Timestamp = ts;
+	record.SecobjType = "Host";
+	record.SecobjName = host;
+	record.Message = "{\"jsonrpc\":\"2.0\",\"method\":\"" + method + "\",\"params\":" + params + ",\"ts\":" + Convert::ToString(ts) + "}";
+
+	return record;
+}
+
+BOOST_AUTO_TEST_CASE(compactor)
+{
+	String ok = R"EOF({"cr":{"vars_before":{"state":0,"state_type":1},"vars_after":{"state":0,"state_type":1}}})EOF";
+	String down = R"EOF({"cr":{"vars_before":{"state":0,"state_type":1},"vars_after":{"state":1,"state_type":0}}})EOF";
+
+	std::vector<ReplayLogRecord> records ({
+		MakeRecord(1, "event::SetNextCheck", "host1"),
+		MakeRecord(2, "event::SetNextCheck", "host2"),
+		MakeRecord(3, "event::CheckResult", "host1", ok),
+		MakeRecord(4, "event::CheckResult", "host1", down),
+		MakeRecord(5, "event::SetAcknowledgement", "host1"),
+		MakeRecord(6, "event::CheckResult", "host1", ok),
+		MakeRecord(7, "event::SetNextCheck", "host1"),
+		MakeRecord(8, "event::SetAcknowledgement", "host1")
+	});
+
+	ReplayLogCompactor compactor (true);
+	ReplayLogCompactor checkResultsKept (false);
+
+	for (auto& record : records) {
+		compactor.Add(record);
+		checkResultsKept.Add(record);
+	}
+
+	BOOST_CHECK(compactor.IsSuperseded(records[0]));
+	BOOST_CHECK(!compactor.IsSuperseded(records[1]));
+	BOOST_CHECK(compactor.IsSuperseded(records[2]));
+	BOOST_CHECK(!compactor.IsSuperseded(records[3]));
+	BOOST_CHECK(!compactor.IsSuperseded(records[4]));
+	BOOST_CHECK(!compactor.IsSuperseded(records[5]));
+	BOOST_CHECK(!compactor.IsSuperseded(records[6]));
+	BOOST_CHECK(!compactor.IsSuperseded(records[7]));
+
+	BOOST_CHECK(checkResultsKept.IsSuperseded(records[0]));
+	BOOST_CHECK(!checkResultsKept.IsSuperseded(records[2]));
+
+	/* Appended after the compactor has seen the log. */
+	BOOST_CHECK(!compactor.IsSuperseded(MakeRecord(9, "event::SetNextCheck", "host3")));
+
+	BOOST_CHECK(ReplayLogCompactor::GetMethod(records[0].Message) == "event::SetNextCheck");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,685 @@
+#!/usr/bin/env python3
+# Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+
+
+"""Generates a large synthetic configuration and measures how long Icinga 2
+takes to validate it and to start up with it.
+
+The configuration consists of N hosts with M services each, created by
+apply rules, plus host and service dependencies and notifications for
+every service. It doesn't need the ITL or any plugins.
+
+The durations of the startup phases are taken from the JSON report of
+'icinga2 daemon --timing-report'.
+
+The checker mode runs the same configuration with active checks using the
+in-process dummy or random check commands, once without writers and once per
+writer given with --writers. The writers send to local sinks which discard
+everything. It reports the scheduling lag (start of the check versus its
+next_check), the checks per second and how long executing a check took,
+which includes ProcessCheckResult() and all its signal handlers. These are
+taken from 'icinga2 daemon --stats-report'.
+
+The livestatus mode starts the configuration with a LivestatusListener and
+replays the queries from test/livestatus/queries with concurrent clients. It
+reports the p50/p99 latency seen by the clients per query file and per table,
+and how long the daemon spent filtering the rows versus extracting and sending
+the columns for each table.
+"""
+
+import argparse
+import grp
+import http.server
+import json
+import os
+import pwd
+import random
+import shutil
+import signal
+import socket
+import socketserver
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+
+WRITERS = ("perfdata", "graphite", "opentsdb", "gelf", "influxdb", "elasticsearch")
+
+
+def write_config(path, hosts, services, routers, users, dependencies, notifications,
+                 checker=None, writer=None, sink_port=None, livestatus_socket=None):
+    with open(path, "w") as f:
+        w = f.write
+
+        w("/* Generated by config-benchmark.py: %d hosts, %d services per host. */\n\n" % (hosts, services))
+
+        w('object CheckCommand "bench-dummy" {\n'
+          '\timport "dummy-check-command"\n\n'
+          '\tvars.dummy_state = 0\n'
+          '\tvars.dummy_text = "OK - $host.name$ $service.name$ | time=0.01s size=1024B"\n'
+          '}\n\n')
+
+        w('object CheckCommand "bench-random" {\n'
+          '\timport "random-check-command"\n'
+          '}\n\n')
+
+        check_command = "bench-" + checker["command"] if checker else "bench-dummy"
+        check_interval = "%ds" % checker["interval"] if checker else "1m"
+
+        if checker:
+            w('object CheckerComponent "checker" { }\n\n')
+
+        if writer:
+            write_writer(w, writer, sink_port)
+
+        if livestatus_socket:
+            w('object LivestatusListener "bench" {\n'
+              '\tsocket_type = "unix"\n'
+              '\tsocket_path = "%s"\n'
+              '}\n\n' % livestatus_socket)
+
+        w('object NotificationCommand "bench-notification" {\n'
+          '\timport "plugin-notification-command"\n\n'
+          '\tcommand = [ "/bin/true" ]\n'
+          '\tenv = {\n'
+          '\t\tHOSTNAME = "$host.name$"\n'
+          '\t\tSERVICENAME = "$service.name$"\n'
+          '\t\tUSEREMAIL = "$user.email$"\n'
+          '\t}\n'
+          '}\n\n')
+
+        w('object TimePeriod "bench-24x7" {\n'
+          '\tranges = {\n')
+        for day in ("monday", "tuesday", "wednesday", "thursday", "friday", "saturday", "sunday"):
+            w('\t\t%s = "00:00-24:00"\n' % day)
+        w('\t}\n'
+          '}\n\n')
+
+        for i in range(users):
+            w('object User "bench-user-%d" {\n'
+              '\temail = "bench-user-%d@example.com"\n'
+              '\tgroups = [ "bench-users" ]\n'
+              '}\n\n' % (i, i))
+
+        w('object UserGroup "bench-users" { }\n\n')
+
+        for os_name in ("linux", "windows"):
+            w('object HostGroup "bench-%s" {\n'
+              '\tassign where host.vars.os == "%s"\n'
+              '}\n\n' % (os_name, os_name))
+
+        w('template Host "bench-host" {\n'
+          '\tcheck_command = "bench-dummy"\n'
+          '\tcheck_interval = 5m\n'
+          '\tretry_interval = 1m\n'
+          '\tenable_active_checks = %s\n'
+          '}\n\n' % ("true" if checker else "false"))
+
+        w('template Service "bench-service" {\n'
+          '\tcheck_command = "%s"\n'
+          '\tcheck_interval = %s\n'
+          '\tretry_interval = %s\n'
+          '\tenable_active_checks = %s\n'
+          '\tvars.notify = true\n'
+          '}\n\n' % (check_command, check_interval, check_interval, "true" if checker else "false"))
+
+        for i in range(routers):
+            w('object Host "bench-router-%d" {\n'
+              '\timport "bench-host"\n\n'
+              '\taddress = "198.51.100.%d"\n'
+              '}\n\n' % (i, i % 254 + 1))
+
+        for i in range(hosts):
+            w('object Host "bench-host-%d" {\n'
+              '\timport "bench-host"\n\n'
+              '\taddress = "10.%d.%d.%d"\n'
+              '\tvars.os = "%s"\n'
+              '\tvars.router = "bench-router-%d"\n'
+              '}\n\n' % (i, (i >> 16) & 255, (i >> 8) & 255, i & 255,
+                         "linux" if i % 4 else "windows", i % routers))
+
+        # Half of the rules match by name, half by custom variables, like real world configs do.
+        for i in range(services):
+            if i % 2:
+                assign = 'match("bench-host-*", host.name)'
+            else:
+                assign = 'host.vars.os in [ "linux", "windows" ]'
+
+            w('apply Service "bench-service-%d" {\n'
+              '\timport "bench-service"\n\n'
+              '\tvars.index = %d\n\n'
+              '\tassign where %s\n'
+              '}\n\n' % (i, i, assign))
+
+        if dependencies:
+            w('apply Dependency "bench-router" to Host {\n'
+              '\tparent_host_name = host.vars.router\n'
+              '\tdisable_checks = true\n\n'
+              '\tassign where host.vars.router\n'
+              '}\n\n')
+
+            w('apply Dependency "bench-first-service" to Service {\n'
+              '\tparent_service_name = "bench-service-0"\n'
+              '\tstates = [ OK, Warning ]\n\n'
+              '\tassign where host.vars.router && service.name != "bench-service-0"\n'
+              '}\n\n')
+
+        if notifications:
+            w('apply Notification "bench-notification" to Service {\n'
+              '\tcommand = "bench-notification"\n'
+              '\tuser_groups = [ "bench-users" ]\n'
+              '\tperiod = "bench-24x7"\n'
+              '\tinterval = 2h\n\n'
+              '\tassign where service.vars.notify\n'
+              '}\n\n')
+
+
+def write_writer(w, writer, port):
+    if writer == "perfdata":
+        w('object PerfdataWriter "bench" { }\n\n')
+    elif writer == "graphite":
+        w('object GraphiteWriter "bench" {\n'
+          '\thost = "127.0.0.1"\n'
+          '\tport = %d\n'
+          '}\n\n' % port)
+    elif writer == "opentsdb":
+        w('object OpenTsdbWriter "bench" {\n'
+          '\thost = "127.0.0.1"\n'
+          '\tport = %d\n'
+          '}\n\n' % port)
+    elif writer == "gelf":
+        w('object GelfWriter "bench" {\n'
+          '\thost = "127.0.0.1"\n'
+          '\tport = %d\n'
+          '}\n\n' % port)
+    elif writer == "influxdb":
+        w('object InfluxdbWriter "bench" {\n'
+          '\thost = "127.0.0.1"\n'
+          '\tport = %d\n'
+          '\tdatabase = "icinga2"\n'
+          '}\n\n' % port)
+    elif writer == "elasticsearch":
+        w('object ElasticsearchWriter "bench" {\n'
+          '\thost = "127.0.0.1"\n'
+          '\tport = %d\n'
+          '\tindex = "icinga2"\n'
+          '}\n\n' % port)
+
+
+class DiscardHandler(socketserver.BaseRequestHandler):
+    def handle(self):
+        while self.request.recv(65536):
+            pass
+
+
+class HttpSinkHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_POST(self):
+        self.rfile.read(int(self.headers.get("Content-Length", 0)))
+
+        # InfluxDB answers writes with 204, Elasticsearch bulk requests with a JSON document.
+        if self.path.startswith("/write"):
+            self.send_response(204)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+        else:
+            body = b'{"errors":false,"items":[]}'
+            self.send_response(200)
+            self.send_header("Content-Type", "application/json")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        pass
+
+
+class ThreadingTCPServer(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+class ThreadingHTTPServer(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+
+
+def start_sink(writer):
+    """Starts a server on a free local port which accepts and discards whatever the writer sends."""
+
+    if writer in ("influxdb", "elasticsearch"):
+        server = ThreadingHTTPServer(("127.0.0.1", 0), HttpSinkHandler)
+    else:
+        server = ThreadingTCPServer(("127.0.0.1", 0), DiscardHandler)
+
+    thread = threading.Thread(target=server.serve_forever)
+    thread.daemon = True
+    thread.start()
+
+    return server
+
+
+def icinga2_command(args, workdir, config, report):
+    user = pwd.getpwuid(os.getuid()).pw_name
+    group = grp.getgrgid(os.getgid()).gr_name
+
+    defines = {
+        "Configuration.RunAsUser": user,
+        "Configuration.RunAsGroup": group,
+        "Configuration.DataDir": os.path.join(workdir, "lib"),
+        "Configuration.CacheDir": os.path.join(workdir, "cache"),
+        "Configuration.LogDir": os.path.join(workdir, "log"),
+        "Configuration.SpoolDir": os.path.join(workdir, "spool"),
+        "Configuration.RunDir": os.path.join(workdir, "run"),
+        "Configuration.InitRunDir": os.path.join(workdir, "run"),
+        "Configuration.ZonesDir": os.path.join(workdir, "zones.d"),
+        "Configuration.ObjectsPath": os.path.join(workdir, "cache", "icinga2.debug"),
+        "Configuration.VarsPath": os.path.join(workdir, "cache", "icinga2.vars"),
+        "Configuration.StatePath": os.path.join(workdir, "lib", "icinga2.state"),
+        "Configuration.ModAttrPath": os.path.join(workdir, "lib", "modified-attributes.conf"),
+        "Configuration.PidPath": os.path.join(workdir, "run", "icinga2.pid"),
+        "Configuration.Concurrency": str(args.concurrency) if args.concurrency else None,
+    }
+
+    command = [args.icinga2]
+
+    for key, value in sorted(defines.items()):
+        if value is not None:
+            command += ["-D", "%s=%s" % (key, value)]
+
+    command += ["daemon", "-c", config, "--timing-report", report]
+
+    return command
+
+
+def run_validate(args, workdir, config):
+    report = os.path.join(workdir, "validate.json")
+    command = icinga2_command(args, workdir, config, report) + ["-C"]
+
+    started = time.time()
+    subprocess.check_call(command, stdout=subprocess.DEVNULL if not args.verbose else None)
+    elapsed = time.time() - started
+
+    with open(report) as f:
+        result = json.load(f)
+
+    result["wall_time"] = elapsed
+    return result
+
+
+def run_startup(args, workdir, config, name, duration=0, workload=None):
+    report = os.path.join(workdir, name + ".json")
+    stats = os.path.join(workdir, name + "-stats.json")
+
+    for path in (report, stats):
+        if os.path.exists(path):
+            os.unlink(path)
+
+    command = icinga2_command(args, workdir, config, report)
+
+    if duration:
+        command += ["--stats-report", stats]
+
+    started = time.time()
+    process = subprocess.Popen(command, stdout=subprocess.DEVNULL if not args.verbose else None)
+
+    try:
+        while not os.path.exists(report):
+            if process.poll() is not None:
+                raise RuntimeError("icinga2 exited with code %d before it finished starting up" % process.returncode)
+
+            if time.time() - started > args.timeout:
+                raise RuntimeError("icinga2 didn't start up within %d seconds" % args.timeout)
+
+            time.sleep(0.1)
+
+        elapsed = time.time() - started
+
+        if duration:
+            if workload:
+                workload(duration)
+            else:
+                time.sleep(duration)
+
+            if process.poll() is not None:
+                raise RuntimeError("icinga2 exited with code %d while running the benchmark" % process.returncode)
+    finally:
+        if process.poll() is None:
+            process.send_signal(signal.SIGTERM)
+            process.wait()
+
+    # The report is renamed into place once it has been written completely.
+    with open(report) as f:
+        result = json.load(f)
+
+    result["wall_time"] = elapsed
+
+    if duration:
+        with open(stats) as f:
+            result["stats"] = json.load(f)
+
+    return result
+
+
+def run_checker(args, workdir, writer):
+    sink = start_sink(writer) if writer and writer != "perfdata" else None
+
+    try:
+        config = os.path.join(workdir, "icinga2-checker.conf")
+        checker = {"command": args.check_command, "interval": args.check_interval}
+
+        write_config(config, args.hosts, args.services, args.routers, args.users,
+                     not args.no_dependencies, not args.no_notifications,
+                     checker, writer, sink.server_address[1] if sink else None)
+
+        # Every run starts without a state file, i.e. with the same check schedule.
+        state = os.path.join(workdir, "lib", "icinga2.state")
+
+        if os.path.exists(state):
+            os.unlink(state)
+
+        startup = run_startup(args, workdir, config, "checker-" + (writer or "none"), args.duration)
+    finally:
+        if sink:
+            sink.shutdown()
+            sink.server_close()
+
+    stats = startup.pop("stats")
+    checkers = stats["status"].get("checkercomponent", {}).values()
+    executed = sum(c["checks_executed"] for c in checkers)
+
+    def average(key):
+        return sum(c[key] * c["checks_executed"] for c in checkers) / executed if executed else 0
+
+    return {
+        "startup_time": startup["wall_time"],
+        "uptime": stats["uptime"],
+        "checks_executed": executed,
+        "checks_per_second": executed / stats["uptime"] if stats["uptime"] > 0 else 0,
+        "avg_scheduling_lag": average("avg_scheduling_lag"),
+        "max_scheduling_lag": max([c["max_scheduling_lag"] for c in checkers] or [0]),
+        "avg_execute_check_time": average("avg_execute_check_time"),
+        "max_execute_check_time": max([c["max_execute_check_time"] for c in checkers] or [0]),
+        "status": stats["status"],
+    }
+
+
+def load_queries(directory):
+    """Loads the GET queries of the corpus, each one answered with a fixed16 response header."""
+
+    queries = []
+
+    for root, dirs, files in os.walk(directory):
+        for name in sorted(files):
+            with open(os.path.join(root, name)) as f:
+                lines = [line.strip() for line in f if line.strip()]
+
+            if not lines or not lines[0].startswith("GET "):
+                continue
+
+            lines = [line for line in lines if not line.startswith("ResponseHeader:")]
+            lines.append("ResponseHeader: fixed16")
+
+            queries.append({
+                "name": os.path.relpath(os.path.join(root, name), directory),
+                "table": lines[0].split()[1],
+                "text": ("\n".join(lines) + "\n\n").encode(),
+            })
+
+    return sorted(queries, key=lambda query: query["name"])
+
+
+def receive_exactly(sock, length):
+    data = b""
+
+    while len(data) < length:
+        chunk = sock.recv(min(length - len(data), 65536))
+
+        if not chunk:
+            raise RuntimeError("livestatus closed the connection after %d of %d bytes" % (len(data), length))
+
+        data += chunk
+
+    return data
+
+
+def livestatus_query(path, query):
+    """Sends a query and reads the whole response, returns its status code."""
+
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(path)
+        sock.sendall(query["text"])
+
+        # E.g. "200          1234\n"
+        header = receive_exactly(sock, 16)
+        receive_exactly(sock, int(header[4:15]))
+
+        return int(header[:3])
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+
+    values = sorted(values)
+    return values[min(len(values) - 1, int(round(p / 100.0 * (len(values) - 1))))]
+
+
+def latency_summary(latencies, errors):
+    return {
+        "queries": len(latencies),
+        "errors": errors,
+        "p50_latency": percentile(latencies, 50),
+        "p99_latency": percentile(latencies, 99),
+    }
+
+
+def run_livestatus(args, workdir):
+    queries = load_queries(args.queries)
+
+    if not queries:
+        raise RuntimeError("no GET queries found in '%s'" % args.queries)
+
+    path = os.path.join(workdir, "run", "livestatus")
+    config = os.path.join(workdir, "icinga2-livestatus.conf")
+
+    write_config(config, args.hosts, args.services, args.routers, args.users,
+                 not args.no_dependencies, not args.no_notifications, livestatus_socket=path)
+
+    latencies = {query["name"]: [] for query in queries}
+    errors = {query["name"]: 0 for query in queries}
+    lock = threading.Lock()
+
+    def client(index, deadline):
+        # Every client sends the whole corpus in its own order, so the query types are mixed.
+        order = list(queries)
+        rng = random.Random(index)
+
+        while time.time() < deadline:
+            rng.shuffle(order)
+
+            for query in order:
+                if time.time() >= deadline:
+                    break
+
+                started = time.time()
+
+                try:
+                    ok = livestatus_query(path, query) == 200
+                except (OSError, RuntimeError, ValueError):
+                    ok = False
+
+                elapsed = time.time() - started
+
+                with lock:
+                    if ok:
+                        latencies[query["name"]].append(elapsed)
+                    else:
+                        errors[query["name"]] += 1
+
+    def workload(duration):
+        started = time.time()
+
+        while not os.path.exists(path):
+            if time.time() - started > 10:
+                raise RuntimeError("the livestatus socket '%s' wasn't created" % path)
+
+            time.sleep(0.1)
+
+        deadline = time.time() + duration
+        clients = [threading.Thread(target=client, args=(i, deadline)) for i in range(args.clients)]
+
+        for thread in clients:
+            thread.start()
+
+        for thread in clients:
+            thread.join()
+
+    startup = run_startup(args, workdir, config, "livestatus", args.duration, workload)
+    stats = startup.pop("stats")
+
+    listener = stats["status"].get("livestatuslistener", {}).get("bench", {})
+    server = listener.get("tables", {})
+
+    by_query = {}
+    by_table = {}
+
+    for query in queries:
+        name, table = query["name"], query["table"]
+        by_query[name] = latency_summary(latencies[name], errors[name])
+        by_query[name]["table"] = table
+
+        entry = by_table.setdefault(table, {"latencies": [], "errors": 0})
+        entry["latencies"] += latencies[name]
+        entry["errors"] += errors[name]
+
+    tables = {}
+
+    for table, entry in by_table.items():
+        tables[table] = latency_summary(entry["latencies"], entry["errors"])
+        tables[table]["server"] = server.get(table, {})
+
+    total = sum(len(values) for values in latencies.values())
+
+    return {
+        "startup_time": startup["wall_time"],
+        "clients": args.clients,
+        "queries_per_second": total / float(args.duration),
+        "queries": by_query,
+        "tables": tables,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--icinga2", default="icinga2", help="the icinga2 binary (default: %(default)s)")
+    parser.add_argument("--hosts", type=int, default=1000, help="number of hosts (default: %(default)s)")
+    parser.add_argument("--services", type=int, default=10, help="number of services per host (default: %(default)s)")
+    parser.add_argument("--routers", type=int, default=20, help="number of parent hosts (default: %(default)s)")
+    parser.add_argument("--users", type=int, default=10, help="number of notified users (default: %(default)s)")
+    parser.add_argument("--no-dependencies", action="store_true", help="don't generate dependencies")
+    parser.add_argument("--no-notifications", action="store_true", help="don't generate notifications")
+    parser.add_argument("--concurrency", type=int, help="override Configuration.Concurrency")
+    parser.add_argument("--mode", choices=("validate", "startup", "all", "checker", "livestatus"), default="all",
+                        help="validate only, start up (twice, the second run restores the state), both, "
+                             "run the checks or replay livestatus queries (default: %(default)s)")
+    parser.add_argument("--check-command", choices=("dummy", "random"), default="dummy",
+                        help="check command for the checker mode (default: %(default)s)")
+    parser.add_argument("--check-interval", type=int, default=60,
+                        help="check interval in seconds for the checker mode (default: %(default)s)")
+    parser.add_argument("--duration", type=int, default=120,
+                        help="seconds to run the checks or queries for after the startup in the checker "
+                             "and livestatus modes (default: %(default)s)")
+    parser.add_argument("--writers", default="",
+                        help="comma-separated writers to run the checker mode with additionally to no writer at all (%s)"
+                             % ", ".join(WRITERS))
+    parser.add_argument("--queries", default=os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                                          "..", "..", "test", "livestatus", "queries"),
+                        help="query corpus for the livestatus mode (default: test/livestatus/queries)")
+    parser.add_argument("--clients", type=int, default=4,
+                        help="concurrent clients for the livestatus mode (default: %(default)s)")
+    parser.add_argument("--timeout", type=int, default=3600, help="seconds to wait for a startup (default: %(default)s)")
+    parser.add_argument("--workdir", help="keep the generated config and data in this directory")
+    parser.add_argument("--output", help="write the report to this file instead of stdout")
+    parser.add_argument("--verbose", action="store_true", help="show the output of icinga2")
+    args = parser.parse_args()
+
+    if args.routers < 1:
+        parser.error("at least one router is required")
+
+    if args.clients < 1:
+        parser.error("at least one client is required")
+
+    writers = [writer for writer in args.writers.split(",") if writer]
+
+    for writer in writers:
+        if writer not in WRITERS:
+            parser.error("unknown writer '%s'" % writer)
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix="icinga2-config-benchmark-")
+
+    try:
+        for subdir in ("lib", "cache", "log", "spool", "run", "zones.d"):
+            os.makedirs(os.path.join(workdir, subdir), exist_ok=True)
+
+        config = os.path.join(workdir, "icinga2.conf")
+
+        started = time.time()
+        write_config(config, args.hosts, args.services, args.routers, args.users,
+                     not args.no_dependencies, not args.no_notifications)
+        generated = time.time() - started
+
+        result = {
+            "parameters": {
+                "hosts": args.hosts,
+                "services_per_host": args.services,
+                "routers": args.routers,
+                "users": args.users,
+                "dependencies": not args.no_dependencies,
+                "notifications": not args.no_notifications,
+                "config_size": os.path.getsize(config),
+                "generate_time": generated,
+            },
+        }
+
+        if args.mode in ("validate", "all"):
+            result["validate"] = run_validate(args, workdir, config)
+
+        if args.mode in ("startup", "all"):
+            # The first startup creates the state file which the second one restores.
+            result["startup"] = run_startup(args, workdir, config, "startup")
+            result["startup_with_state"] = run_startup(args, workdir, config, "startup-with-state")
+
+        if args.mode == "checker":
+            result["parameters"].update({
+                "check_command": args.check_command,
+                "check_interval": args.check_interval,
+                "duration": args.duration,
+            })
+
+            result["checker"] = {}
+
+            for writer in [None] + writers:
+                result["checker"][writer or "none"] = run_checker(args, workdir, writer)
+
+        if args.mode == "livestatus":
+            result["parameters"]["duration"] = args.duration
+            result["livestatus"] = run_livestatus(args, workdir)
+
+        output = json.dumps(result, indent=4, sort_keys=True)
+
+        if args.output:
+            with open(args.output, "w") as f:
+                f.write(output + "\n")
+        else:
+            print(output)
+    finally:
+        if not args.workdir:
+            shutil.rmtree(workdir, ignore_errors=True)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
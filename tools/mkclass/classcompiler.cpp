@@ -849,6 +849,9 @@ void ClassCompiler::HandleClass(const Klass& klass, const ClassDebugInfo&)
 					m_Impl << "\t" << "Track" << field.GetFriendlyName() << "(oldValue, value);" << std::endl;
 				}
 
+				if (field.Attributes & FAState)
+					m_Impl << "\t" << "MarkStateDirty();" << std::endl;
+
 				m_Impl << "\t" << "if (!suppress_events)" << std::endl
 					<< "\t\t" << "Notify" << field.GetFriendlyName() << "(cookie);" << std::endl
 					<< "}" << std::endl << std::endl;
@@ -1003,6 +1006,10 @@ void ClassCompiler::HandleClass(const Klass& klass, const ClassDebugInfo&)
 			m_Impl << "void ObjectImpl<" << klass.Name << ">::Notify" << field.GetFriendlyName() << "(const Value& cookie)" << std::endl
 				<< "{" << std::endl;
 
+			/* Most fields don't have any subscribers, e.g. the ones of check results. */
+			m_Impl << "\t" << "if (On" << field.GetFriendlyName() << "Changed.empty())" << std::endl
+				<< "\t\t" << "return;" << std::endl << std::endl;
+
 			if (field.Name != "active") {
 				m_Impl << "\t" << "auto *dobj = dynamic_cast<ConfigObject *>(this);" << std::endl
 					<< "\t" << "if (!dobj || dobj->IsActive())" << std::endl